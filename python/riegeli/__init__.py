@@ -14,6 +14,7 @@
 """Writes or reads Riegeli/records files."""
 
 from riegeli.base import riegeli_error
+from riegeli.records import async_record_reader
 from riegeli.records import record_position
 from riegeli.records import record_reader
 from riegeli.records import record_writer
@@ -29,7 +30,8 @@ __all__ = ('RiegeliError', 'CancelledError', 'UnknownError',
            'UnimplementedError', 'InternalError', 'UnavailableError',
            'DataLossError', 'FlushType', 'RecordPosition', 'SkippedRegion',
            'RecordsMetadata', 'set_record_type', 'RecordWriter',
-           'EXISTENCE_ONLY', 'get_record_type', 'RecordReader')
+           'EXISTENCE_ONLY', 'get_record_type', 'RecordReader',
+           'AsyncRecordReader')
 
 # pylint: disable=invalid-name
 RiegeliError = riegeli_error.RiegeliError
@@ -58,3 +60,4 @@ RecordWriter = record_writer.RecordWriter
 EXISTENCE_ONLY = record_reader.EXISTENCE_ONLY
 get_record_type = record_reader.get_record_type
 RecordReader = record_reader.RecordReader
+AsyncRecordReader = async_record_reader.AsyncRecordReader
@@ -397,5 +397,48 @@ absl::optional<absl::partial_ordering> PartialOrderingFromPython(
                            : absl::partial_ordering::greater;
 }
 
+absl::optional<PythonPtr> OpenIfPath(PyObject* object, const char* mode) {
+  if (!PyUnicode_Check(object) && !PyBytes_Check(object)) {
+    static constexpr Identifier id_fspath("__fspath__");
+    const int has_fspath = PyObject_HasAttr(object, id_fspath.get());
+    if (has_fspath == 0) return PythonPtr();
+  }
+  static constexpr ImportedConstant kOpen("io", "open");
+  if (ABSL_PREDICT_FALSE(!kOpen.Verify())) return absl::nullopt;
+  PythonPtr file(PyObject_CallFunction(kOpen.get(), "Os", object, mode));
+  if (ABSL_PREDICT_FALSE(file == nullptr)) return absl::nullopt;
+  return file;
+}
+
+absl::optional<int> NativeFileDescriptor(PyObject* object) {
+  static constexpr ImportedConstant kFileIO("io", "FileIO");
+  static constexpr ImportedConstant kBufferedReader("io", "BufferedReader");
+  static constexpr ImportedConstant kBufferedWriter("io", "BufferedWriter");
+  static constexpr ImportedConstant kBufferedRandom("io", "BufferedRandom");
+  if (ABSL_PREDICT_FALSE(!kFileIO.Verify()) ||
+      ABSL_PREDICT_FALSE(!kBufferedReader.Verify()) ||
+      ABSL_PREDICT_FALSE(!kBufferedWriter.Verify()) ||
+      ABSL_PREDICT_FALSE(!kBufferedRandom.Verify())) {
+    return absl::nullopt;
+  }
+  PyObject* const type = reinterpret_cast<PyObject*>(Py_TYPE(object));
+  if (type != kFileIO.get() && type != kBufferedReader.get() &&
+      type != kBufferedWriter.get() && type != kBufferedRandom.get()) {
+    // Subclasses may override methods, so they must be called.
+    return -1;
+  }
+  // `BufferedReader` etc. may wrap a raw stream which is not a file.
+  const int fd = PyObject_AsFileDescriptor(object);
+  if (fd < 0) {
+    if (ABSL_PREDICT_FALSE(!PyErr_ExceptionMatches(PyExc_OSError) &&
+                           !PyErr_ExceptionMatches(PyExc_ValueError))) {
+      return absl::nullopt;
+    }
+    PyErr_Clear();
+    return -1;
+  }
+  return fd;
+}
+
 }  // namespace python
 }  // namespace riegeli
@@ -555,6 +555,22 @@ absl::optional<Position> PositionFromPython(PyObject* object);
 absl::optional<absl::partial_ordering> PartialOrderingFromPython(
     PyObject* object);
 
+// If `object` is a file path (`str`, `bytes`, or `os.PathLike`), opens it with
+// `io.open(object, mode)` and returns the file. Otherwise returns `nullptr`.
+//
+// Returns `absl::nullopt` on failure (with Python exception set).
+absl::optional<PythonPtr> OpenIfPath(PyObject* object, const char* mode);
+
+// If `object` is a file created by `io.open()`, i.e. its type is exactly
+// `io.FileIO`, `io.BufferedReader`, `io.BufferedWriter`, or
+// `io.BufferedRandom`, returns its file descriptor. Otherwise returns -1.
+//
+// For such objects reading and writing the file descriptor directly is
+// equivalent to calling their methods, except for their own buffering.
+//
+// Returns `absl::nullopt` on failure (with Python exception set).
+absl::optional<int> NativeFileDescriptor(PyObject* object);
+
 // Implementation details follow.
 
 inline Exception::Exception(const Exception& that) noexcept { *this = that; }
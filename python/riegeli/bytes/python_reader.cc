@@ -23,7 +23,11 @@
 #include "python/riegeli/bytes/python_reader.h"
 // clang-format: do not reorder the above include.
 
+#include <errno.h>
 #include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include <cstring>
 #include <limits>
@@ -38,6 +42,7 @@
 #include "absl/types/span.h"
 #include "python/riegeli/base/utils.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/errno_mapping.h"
 #include "riegeli/bytes/buffered_reader.h"
 
 namespace riegeli {
@@ -79,11 +84,33 @@ PythonReader::PythonReader(PyObject* src, Options options)
     }
     set_limit_pos(*file_pos);
     supports_random_access_ = true;
+    if (options.use_fileno()) {
+      const absl::optional<int> fd = NativeFileDescriptor(src_.get());
+      if (ABSL_PREDICT_FALSE(fd == absl::nullopt)) {
+        FailOperation("fileno()");
+        return;
+      }
+      fd_ = *fd;
+    }
   }
 }
 
 void PythonReader::Done() {
   BufferedReader::Done();
+  if (fd_ >= 0 && !owns_src_ && ABSL_PREDICT_TRUE(healthy())) {
+    // Reading the file descriptor directly did not change the stream
+    // position.
+    PythonLock lock;
+    const PythonPtr file_pos = PositionToPython(limit_pos());
+    if (ABSL_PREDICT_FALSE(file_pos == nullptr)) {
+      FailOperation("PositionToPython()");
+    } else {
+      static constexpr Identifier id_seek("seek");
+      const PythonPtr seek_result(PyObject_CallMethodObjArgs(
+          src_.get(), id_seek.get(), file_pos.get(), nullptr));
+      if (ABSL_PREDICT_FALSE(seek_result == nullptr)) FailOperation("seek()");
+    }
+  }
   if (owns_src_ && src_ != nullptr) {
     PythonLock lock;
     static constexpr Identifier id_close("close");
@@ -108,6 +135,15 @@ bool PythonReader::FailOperation(absl::string_view operation) {
       absl::StrCat(operation, " failed: ", exception_.message())));
 }
 
+bool PythonReader::FailFdOperation(absl::string_view operation) {
+  const int error_number = errno;
+  RIEGELI_ASSERT_NE(error_number, 0)
+      << "Failed precondition of PythonReader::FailFdOperation(): "
+         "zero errno";
+  return Fail(
+      ErrnoToCanonicalStatus(error_number, absl::StrCat(operation, " failed")));
+}
+
 bool PythonReader::ReadInternal(size_t min_length, size_t max_length,
                                 char* dest) {
   RIEGELI_ASSERT_GT(min_length, 0u)
@@ -122,6 +158,28 @@ bool PythonReader::ReadInternal(size_t min_length, size_t max_length,
                          std::numeric_limits<Position>::max() - limit_pos())) {
     return FailOverflow();
   }
+  if (fd_ >= 0) {
+    for (;;) {
+    again:
+      const ssize_t length_read =
+          pread(fd_, dest,
+                UnsignedMin(max_length,
+                            size_t{std::numeric_limits<ssize_t>::max()}),
+                IntCast<off_t>(limit_pos()));
+      if (ABSL_PREDICT_FALSE(length_read < 0)) {
+        if (errno == EINTR) goto again;
+        return FailFdOperation("pread()");
+      }
+      if (ABSL_PREDICT_FALSE(length_read == 0)) return false;
+      RIEGELI_ASSERT_LE(IntCast<size_t>(length_read), max_length)
+          << "pread() read more than requested";
+      move_limit_pos(IntCast<size_t>(length_read));
+      if (IntCast<size_t>(length_read) >= min_length) return true;
+      dest += length_read;
+      min_length -= IntCast<size_t>(length_read);
+      max_length -= IntCast<size_t>(length_read);
+    }
+  }
   PythonLock lock;
   // Find a read function to use, preferring in order: `readinto1()`,
   // `readinto()`, `read1()`, `read()`.
@@ -245,6 +303,20 @@ bool PythonReader::SeekBehindBuffer(Position new_pos) {
   if (ABSL_PREDICT_FALSE(!supports_random_access_)) {
     return BufferedReader::SeekBehindBuffer(new_pos);
   }
+  if (fd_ >= 0) {
+    if (new_pos > limit_pos()) {
+      // Seeking forwards.
+      const absl::optional<Position> size = FdSize();
+      if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
+      if (ABSL_PREDICT_FALSE(new_pos > *size)) {
+        // File ends.
+        set_limit_pos(*size);
+        return false;
+      }
+    }
+    set_limit_pos(new_pos);
+    return true;
+  }
   PythonLock lock;
   if (new_pos > limit_pos()) {
     // Seeking forwards.
@@ -314,12 +386,22 @@ inline absl::optional<Position> PythonReader::SizeInternal() {
   return *size;
 }
 
+inline absl::optional<Position> PythonReader::FdSize() {
+  struct stat stat_info;
+  if (ABSL_PREDICT_FALSE(fstat(fd_, &stat_info) < 0)) {
+    FailFdOperation("fstat()");
+    return absl::nullopt;
+  }
+  return IntCast<Position>(stat_info.st_size);
+}
+
 absl::optional<Position> PythonReader::SizeImpl() {
   if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
   if (ABSL_PREDICT_FALSE(!supports_random_access_)) {
     Fail(absl::UnimplementedError("PythonReader::Size() not supported"));
     return absl::nullopt;
   }
+  if (fd_ >= 0) return FdSize();
   PythonLock lock;
   const absl::optional<Position> size = SizeInternal();
   if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return absl::nullopt;
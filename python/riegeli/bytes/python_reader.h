@@ -52,6 +52,10 @@ namespace python {
 // `Options::assumed_pos() == absl::nullopt` and the stream supports random
 // access (this is checked by calling `seekable()`).
 //
+// If random access is supported and the stream is a file created by
+// `io.open()`, data are read directly from its file descriptor with `pread()`,
+// without holding the GIL (see `Options::set_use_fileno()`).
+//
 // Warning: if random access is not supported and the stream is not owned,
 // it will have an unpredictable amount of extra data consumed because of
 // buffering.
@@ -107,10 +111,30 @@ class PythonReader : public BufferedReader {
     }
     size_t buffer_size() const { return buffer_size_; }
 
+    // If `true` and random access is supported, and the stream is a file
+    // created by `io.open()` (its type is exactly `io.FileIO`,
+    // `io.BufferedReader`, or `io.BufferedRandom`), then data are read directly
+    // from its file descriptor, without calling Python methods and without
+    // holding the GIL. The stream position is set with `seek()` when the
+    // `PythonReader` is closed.
+    //
+    // If `false`, Python methods are always called.
+    //
+    // Default: `true`.
+    Options& set_use_fileno(bool use_fileno) & {
+      use_fileno_ = use_fileno;
+      return *this;
+    }
+    Options&& set_use_fileno(bool use_fileno) && {
+      return std::move(set_use_fileno(use_fileno));
+    }
+    bool use_fileno() const { return use_fileno_; }
+
    private:
     bool owns_src_ = true;
     absl::optional<Position> assumed_pos_;
     size_t buffer_size_ = kDefaultBufferSize;
+    bool use_fileno_ = true;
   };
 
   // Creates a closed `PythonReader`.
@@ -140,11 +164,15 @@ class PythonReader : public BufferedReader {
 
  private:
   ABSL_ATTRIBUTE_COLD bool FailOperation(absl::string_view operation);
+  ABSL_ATTRIBUTE_COLD bool FailFdOperation(absl::string_view operation);
   absl::optional<Position> SizeInternal();
+  absl::optional<Position> FdSize();
 
   PythonPtrLocking src_;
   bool owns_src_ = false;
   bool supports_random_access_ = false;
+  // If non-negative, the file descriptor of `src_` which is read directly.
+  int fd_ = -1;
   Exception exception_;
   PythonPtrLocking read_function_;
   absl::string_view read_function_name_;
@@ -158,6 +186,7 @@ inline PythonReader::PythonReader(PythonReader&& that) noexcept
       src_(std::move(that.src_)),
       owns_src_(that.owns_src_),
       supports_random_access_(that.supports_random_access_),
+      fd_(that.fd_),
       exception_(std::move(that.exception_)),
       read_function_(std::move(that.read_function_)),
       read_function_name_(that.read_function_name_),
@@ -170,6 +199,7 @@ inline PythonReader& PythonReader::operator=(PythonReader&& that) noexcept {
   src_ = std::move(that.src_);
   owns_src_ = that.owns_src_;
   supports_random_access_ = that.supports_random_access_;
+  fd_ = that.fd_;
   exception_ = std::move(that.exception_);
   read_function_ = std::move(that.read_function_);
   read_function_name_ = that.read_function_name_;
@@ -23,7 +23,12 @@
 #include "python/riegeli/bytes/python_writer.h"
 // clang-format: do not reorder the above include.
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include <limits>
 #include <memory>
@@ -37,6 +42,7 @@
 #include "absl/types/optional.h"
 #include "python/riegeli/base/utils.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/errno_mapping.h"
 #include "riegeli/bytes/buffered_writer.h"
 
 namespace riegeli {
@@ -63,6 +69,33 @@ PythonWriter::PythonWriter(PyObject* dest, Options options)
       // Random access is not supported. Assume 0 as the initial position.
       return;
     }
+    absl::optional<int> fd = -1;
+    if (options.use_fileno()) {
+      fd = NativeFileDescriptor(dest_.get());
+      if (ABSL_PREDICT_FALSE(fd == absl::nullopt)) {
+        FailOperation("fileno()");
+        return;
+      }
+      if (*fd >= 0) {
+        const int flags = fcntl(*fd, F_GETFL);
+        if (ABSL_PREDICT_FALSE(flags < 0)) {
+          FailFdOperation("fcntl()");
+          return;
+        }
+        // `pwrite()` ignores the position if `O_APPEND` is set.
+        if ((flags & O_APPEND) != 0) fd = -1;
+      }
+      if (*fd >= 0) {
+        // Data buffered by the stream must precede data written directly.
+        static constexpr Identifier id_flush("flush");
+        const PythonPtr flush_result(
+            PyObject_CallMethodObjArgs(dest_.get(), id_flush.get(), nullptr));
+        if (ABSL_PREDICT_FALSE(flush_result == nullptr)) {
+          FailOperation("flush()");
+          return;
+        }
+      }
+    }
     static constexpr Identifier id_tell("tell");
     const PythonPtr tell_result(
         PyObject_CallMethodObjArgs(dest_.get(), id_tell.get(), nullptr));
@@ -78,11 +111,15 @@ PythonWriter::PythonWriter(PyObject* dest, Options options)
     }
     set_start_pos(*file_pos);
     supports_random_access_ = true;
+    fd_ = *fd;
   }
 }
 
 void PythonWriter::Done() {
   BufferedWriter::Done();
+  if (fd_ >= 0 && !owns_dest_ && ABSL_PREDICT_TRUE(healthy())) {
+    SyncStreamPos();
+  }
   if (owns_dest_ && dest_ != nullptr) {
     PythonLock lock;
     static constexpr Identifier id_close("close");
@@ -107,6 +144,33 @@ bool PythonWriter::FailOperation(absl::string_view operation) {
       absl::StrCat(operation, " failed: ", exception_.message())));
 }
 
+bool PythonWriter::FailFdOperation(absl::string_view operation) {
+  const int error_number = errno;
+  RIEGELI_ASSERT_NE(error_number, 0)
+      << "Failed precondition of PythonWriter::FailFdOperation(): "
+         "zero errno";
+  return Fail(
+      ErrnoToCanonicalStatus(error_number, absl::StrCat(operation, " failed")));
+}
+
+bool PythonWriter::SyncStreamPos() {
+  RIEGELI_ASSERT_GE(fd_, 0)
+      << "Failed precondition of PythonWriter::SyncStreamPos(): "
+         "file descriptor not used";
+  PythonLock lock;
+  const PythonPtr file_pos = PositionToPython(start_pos());
+  if (ABSL_PREDICT_FALSE(file_pos == nullptr)) {
+    return FailOperation("PositionToPython()");
+  }
+  static constexpr Identifier id_seek("seek");
+  const PythonPtr seek_result(PyObject_CallMethodObjArgs(
+      dest_.get(), id_seek.get(), file_pos.get(), nullptr));
+  if (ABSL_PREDICT_FALSE(seek_result == nullptr)) {
+    return FailOperation("seek()");
+  }
+  return true;
+}
+
 bool PythonWriter::WriteInternal(absl::string_view src) {
   RIEGELI_ASSERT(!src.empty())
       << "Failed precondition of BufferedWriter::WriteInternal(): "
@@ -117,6 +181,25 @@ bool PythonWriter::WriteInternal(absl::string_view src) {
                          std::numeric_limits<Position>::max() - start_pos())) {
     return FailOverflow();
   }
+  if (fd_ >= 0) {
+    do {
+    again:
+      const ssize_t length_written = pwrite(
+          fd_, src.data(),
+          UnsignedMin(src.size(), size_t{std::numeric_limits<ssize_t>::max()}),
+          IntCast<off_t>(start_pos()));
+      if (ABSL_PREDICT_FALSE(length_written < 0)) {
+        if (errno == EINTR) goto again;
+        return FailFdOperation("pwrite()");
+      }
+      RIEGELI_ASSERT_GT(length_written, 0) << "pwrite() returned 0";
+      RIEGELI_ASSERT_LE(IntCast<size_t>(length_written), src.size())
+          << "pwrite() wrote more than requested";
+      move_start_pos(IntCast<size_t>(length_written));
+      src.remove_prefix(IntCast<size_t>(length_written));
+    } while (!src.empty());
+    return true;
+  }
   PythonLock lock;
   if (ABSL_PREDICT_FALSE(write_function_ == nullptr)) {
     static constexpr Identifier id_write("write");
@@ -190,6 +273,23 @@ bool PythonWriter::WriteInternal(absl::string_view src) {
 
 bool PythonWriter::FlushImpl(FlushType flush_type) {
   if (ABSL_PREDICT_FALSE(!BufferedWriter::FlushImpl(flush_type))) return false;
+  if (fd_ >= 0) {
+    switch (flush_type) {
+      case FlushType::kFromObject:
+        if (!owns_dest_) return true;
+        ABSL_FALLTHROUGH_INTENDED;
+      case FlushType::kFromProcess:
+        return SyncStreamPos();
+      case FlushType::kFromMachine:
+        if (ABSL_PREDICT_FALSE(!SyncStreamPos())) return false;
+        if (ABSL_PREDICT_FALSE(fsync(fd_) < 0)) {
+          return FailFdOperation("fsync()");
+        }
+        return true;
+    }
+    RIEGELI_ASSERT_UNREACHABLE()
+        << "Unknown flush type: " << static_cast<int>(flush_type);
+  }
   switch (flush_type) {
     case FlushType::kFromObject:
       if (!owns_dest_) return true;
@@ -216,6 +316,20 @@ bool PythonWriter::SeekBehindBuffer(Position new_pos) {
   if (ABSL_PREDICT_FALSE(!supports_random_access_)) {
     return Fail(absl::UnimplementedError("PythonWriter::Seek() not supported"));
   }
+  if (fd_ >= 0) {
+    if (new_pos >= start_pos()) {
+      // Seeking forwards.
+      const absl::optional<Position> size = FdSize();
+      if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
+      if (ABSL_PREDICT_FALSE(new_pos > *size)) {
+        // File ends.
+        set_start_pos(*size);
+        return false;
+      }
+    }
+    set_start_pos(new_pos);
+    return true;
+  }
   PythonLock lock;
   if (new_pos >= start_pos()) {
     // Seeking forwards.
@@ -288,6 +402,15 @@ inline absl::optional<Position> PythonWriter::SizeInternal() {
   return *size;
 }
 
+inline absl::optional<Position> PythonWriter::FdSize() {
+  struct stat stat_info;
+  if (ABSL_PREDICT_FALSE(fstat(fd_, &stat_info) < 0)) {
+    FailFdOperation("fstat()");
+    return absl::nullopt;
+  }
+  return IntCast<Position>(stat_info.st_size);
+}
+
 absl::optional<Position> PythonWriter::SizeBehindBuffer() {
   RIEGELI_ASSERT_EQ(buffer_size(), 0u)
       << "Failed precondition of BufferedWriter::SizeBehindBuffer(): "
@@ -297,6 +420,7 @@ absl::optional<Position> PythonWriter::SizeBehindBuffer() {
     Fail(absl::UnimplementedError("PythonWriter::Size() not supported"));
     return absl::nullopt;
   }
+  if (fd_ >= 0) return FdSize();
   PythonLock lock;
   const absl::optional<Position> size = SizeInternal();
   if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return absl::nullopt;
@@ -324,6 +448,22 @@ bool PythonWriter::TruncateBehindBuffer(Position new_size) {
     return Fail(
         absl::UnimplementedError("PythonWriter::Truncate() not supported"));
   }
+  if (fd_ >= 0) {
+    const absl::optional<Position> size = FdSize();
+    if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
+    if (ABSL_PREDICT_FALSE(new_size > *size)) {
+      // File ends.
+      set_start_pos(*size);
+      return false;
+    }
+  again:
+    if (ABSL_PREDICT_FALSE(ftruncate(fd_, IntCast<off_t>(new_size)) < 0)) {
+      if (errno == EINTR) goto again;
+      return FailFdOperation("ftruncate()");
+    }
+    set_start_pos(new_size);
+    return true;
+  }
   PythonLock lock;
   const absl::optional<Position> size = SizeInternal();
   if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
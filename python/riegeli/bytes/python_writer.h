@@ -50,6 +50,10 @@ namespace python {
 // `PythonWriter` supports random access if
 // `Options::assumed_pos() == absl::nullopt` and the stream supports random
 // access (this is checked by calling `seekable()`).
+//
+// If random access is supported and the stream is a file created by
+// `io.open()`, data are written directly to its file descriptor with
+// `pwrite()`, without holding the GIL (see `Options::set_use_fileno()`).
 class PythonWriter : public BufferedWriter {
  public:
   class Options {
@@ -104,10 +108,31 @@ class PythonWriter : public BufferedWriter {
     }
     size_t buffer_size() const { return buffer_size_; }
 
+    // If `true` and random access is supported, and the stream is a file
+    // created by `io.open()` (its type is exactly `io.FileIO`,
+    // `io.BufferedWriter`, or `io.BufferedRandom`) and not opened for
+    // appending, then data are written directly to its file descriptor,
+    // without calling Python methods and without holding the GIL. The stream
+    // is flushed initially, and its position is set with `seek()` when the
+    // `PythonWriter` is flushed or closed.
+    //
+    // If `false`, Python methods are always called.
+    //
+    // Default: `true`.
+    Options& set_use_fileno(bool use_fileno) & {
+      use_fileno_ = use_fileno;
+      return *this;
+    }
+    Options&& set_use_fileno(bool use_fileno) && {
+      return std::move(set_use_fileno(use_fileno));
+    }
+    bool use_fileno() const { return use_fileno_; }
+
    private:
     bool owns_dest_ = true;
     absl::optional<Position> assumed_pos_;
     size_t buffer_size_ = kDefaultBufferSize;
+    bool use_fileno_ = true;
   };
 
   // Creates a closed `PythonWriter`.
@@ -139,11 +164,17 @@ class PythonWriter : public BufferedWriter {
 
  private:
   ABSL_ATTRIBUTE_COLD bool FailOperation(absl::string_view operation);
+  ABSL_ATTRIBUTE_COLD bool FailFdOperation(absl::string_view operation);
   absl::optional<Position> SizeInternal();
+  absl::optional<Position> FdSize();
+  // Sets the stream position to `start_pos()` after writing to `fd_`.
+  bool SyncStreamPos();
 
   PythonPtrLocking dest_;
   bool owns_dest_ = false;
   bool supports_random_access_ = false;
+  // If non-negative, the file descriptor of `dest_` which is written directly.
+  int fd_ = -1;
   Exception exception_;
   PythonPtrLocking write_function_;
   bool use_bytes_ = false;
@@ -156,6 +187,7 @@ inline PythonWriter::PythonWriter(PythonWriter&& that) noexcept
       dest_(std::move(that.dest_)),
       owns_dest_(that.owns_dest_),
       supports_random_access_(that.supports_random_access_),
+      fd_(that.fd_),
       exception_(std::move(that.exception_)),
       write_function_(std::move(that.write_function_)),
       use_bytes_(that.use_bytes_) {}
@@ -167,6 +199,7 @@ inline PythonWriter& PythonWriter::operator=(PythonWriter&& that) noexcept {
   dest_ = std::move(that.dest_);
   owns_dest_ = that.owns_dest_;
   supports_random_access_ = that.supports_random_access_;
+  fd_ = that.fd_;
   exception_ = std::move(that.exception_);
   write_function_ = std::move(that.write_function_);
   use_bytes_ = that.use_bytes_;
@@ -0,0 +1,161 @@
+# Copyright 2020 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Reads records from a Riegeli/records file without blocking asyncio."""
+
+import asyncio
+import concurrent.futures
+
+from riegeli.records import record_reader
+
+__all__ = ('AsyncRecordReader',)
+
+
+class AsyncRecordReader:
+  """Reads records from a Riegeli/records file without blocking asyncio.
+
+  A `RecordReader` is owned by a background thread. The file is opened, and
+  records are read and decoded in batches in that thread, with the GIL released
+  while a batch is being read. The next batch is prefetched while the current
+  one is consumed by the event loop.
+
+  Usage:
+    async with riegeli.AsyncRecordReader(filename) as reader:
+      async for record in reader:
+        ...
+  """
+
+  __slots__ = ('_executor', '_reader', '_batch_size', '_pending', '_batch',
+               '_index', '_eof')
+
+  def __init__(self, src, *, batch_size=1024, **kwargs):
+    """Will read from the given file.
+
+    Args:
+      src: Like for `RecordReader`.
+      batch_size: The maximum number of records read by the background thread
+        at a time. Larger batches reduce the overhead of switching threads;
+        smaller batches reduce latency and memory usage.
+      **kwargs: Other arguments of `RecordReader`. A `recovery` function is
+        called in the background thread.
+    """
+    if batch_size <= 0:
+      raise ValueError('batch_size must be positive')
+    self._executor = concurrent.futures.ThreadPoolExecutor(max_workers=1)
+    self._batch_size = batch_size
+    self._batch = []
+    self._index = 0
+    self._eof = False
+    # Opening can block too. Tasks of `_executor` run in order, so reading
+    # starts after opening.
+    self._reader = self._executor.submit(record_reader.RecordReader, src,
+                                         **kwargs)
+    self._pending = self._executor.submit(self._read_batch)
+
+  def _read_batch(self):
+    return self._reader.result().read_records_batch(self._batch_size)
+
+  async def read_records_batch(self):
+    """Reads the next batch of records.
+
+    Returns:
+      The records read as bytes. An empty list is returned only at end of file.
+    """
+    if self._index < len(self._batch):
+      batch = self._batch[self._index:]
+      self._batch = []
+      self._index = 0
+      return batch
+    if self._eof:
+      return []
+    # `shield()` keeps `_pending` if the caller is cancelled, so that the batch
+    # is not lost.
+    batch = await asyncio.shield(asyncio.wrap_future(self._pending))
+    if batch:
+      self._pending = self._executor.submit(self._read_batch)
+    else:
+      self._eof = True
+    return batch
+
+  async def read_record(self):
+    """Reads the next record.
+
+    Returns:
+      The record read as bytes, or None at end of file.
+    """
+    while self._index == len(self._batch):
+      self._batch = await self.read_records_batch()
+      self._index = 0
+      if not self._batch:
+        return None
+    record = self._batch[self._index]
+    self._batch[self._index] = None
+    self._index += 1
+    return record
+
+  async def read_message(self, message_type):
+    """Reads the next record and parses it as a message.
+
+    Args:
+      message_type: The proto message type to parse the record as.
+
+    Returns:
+      The record read as parsed message, or None at end of file.
+    """
+    record = await self.read_record()
+    if record is None:
+      return None
+    return message_type.FromString(record)
+
+  async def read_messages(self, message_type):
+    """Returns an async iterator which reads all remaining records.
+
+    Args:
+      message_type: The proto message type to parse records as.
+
+    Yields:
+      The next record read as parsed message.
+    """
+    while True:
+      message = await self.read_message(message_type)
+      if message is None:
+        return
+      yield message
+
+  def __aiter__(self):
+    return self
+
+  async def __anext__(self):
+    record = await self.read_record()
+    if record is None:
+      raise StopAsyncIteration
+    return record
+
+  async def close(self):
+    """Closes the underlying `RecordReader`, waiting for pending reading."""
+    if self._executor is None:
+      return
+    executor = self._executor
+    self._executor = None
+    await asyncio.wrap_future(executor.submit(self._close))
+    executor.shutdown(wait=False)
+
+  def _close(self):
+    if self._reader.exception() is None:
+      self._reader.result().close()
+
+  async def __aenter__(self):
+    return self
+
+  async def __aexit__(self, exc_type, exc_value, traceback):
+    await self.close()
@@ -23,11 +23,14 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <cstring>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/compare.h"
 #include "absl/types/optional.h"
 #include "python/riegeli/base/utils.h"
@@ -145,6 +148,59 @@ struct PyRecordIterObject {
 
 extern PyTypeObject PyRecordIter_Type;
 
+// A record exposed through the buffer protocol without copying it.
+struct PyRecordBufferObject {
+  // clang-format off
+  PyObject_HEAD
+  static_assert(true, "");  // clang-format workaround.
+  // clang-format on
+
+  // Invariant: if `record.has_value()` then `record->TryFlat() != absl::nullopt`
+  PythonWrapped<Chain> record;
+};
+
+extern PyTypeObject PyRecordBuffer_Type;
+
+// Refers to a contiguous Python buffer obtained with the buffer protocol.
+class PythonBuffer {
+ public:
+  PythonBuffer() noexcept { buffer_.obj = nullptr; }
+
+  PythonBuffer(const PythonBuffer&) = delete;
+  PythonBuffer& operator=(const PythonBuffer&) = delete;
+
+  ~PythonBuffer() {
+    PythonLock::AssertHeld();
+    if (buffer_.obj != nullptr) PyBuffer_Release(&buffer_);
+  }
+
+  // Gets a writable C-contiguous buffer, including its format if `format` is
+  // `true`.
+  //
+  // Returns `false` on failure (with Python exception set).
+  //
+  // Must be called at most once for each `PythonBuffer` object.
+  bool FromPython(PyObject* object, bool format) {
+    RIEGELI_ASSERT(buffer_.obj == nullptr)
+        << "Failed precondition of PythonBuffer::FromPython(): "
+           "called more than once";
+    return PyObject_GetBuffer(object, &buffer_,
+                              format ? PyBUF_CONTIG | PyBUF_FORMAT
+                                     : PyBUF_CONTIG) == 0;
+  }
+
+  char* data() const { return static_cast<char*>(buffer_.buf); }
+  size_t size() const { return IntCast<size_t>(buffer_.len); }
+  size_t itemsize() const { return IntCast<size_t>(buffer_.itemsize); }
+  absl::string_view format() const {
+    return buffer_.format == nullptr ? absl::string_view("B")
+                                     : absl::string_view(buffer_.format);
+  }
+
+ private:
+  Py_buffer buffer_;
+};
+
 bool RecordReaderHasException(PyRecordReaderObject* self) {
   return self->recovery_exception.has_value() ||
          !self->record_reader->healthy();
@@ -251,20 +307,27 @@ static int RecordReaderClear(PyRecordReaderObject* self) {
 static int RecordReaderInit(PyRecordReaderObject* self, PyObject* args,
                             PyObject* kwargs) {
   static constexpr const char* keywords[] = {
-      "src",      "owns_src", "assumed_pos", "buffer_size", "field_projection",
-      "recovery", nullptr};
+      "src",         "owns_src",    "assumed_pos",
+      "buffer_size", "chunk_range", "field_projection",
+      "recovery",    "parallelism", nullptr};
   PyObject* src_arg;
   PyObject* owns_src_arg = nullptr;
   PyObject* assumed_pos_arg = nullptr;
   PyObject* buffer_size_arg = nullptr;
+  PyObject* chunk_range_arg = nullptr;
   PyObject* field_projection_arg = nullptr;
   PyObject* recovery_arg = nullptr;
+  int parallelism = 0;
   if (ABSL_PREDICT_FALSE(!PyArg_ParseTupleAndKeywords(
-          args, kwargs, "O|$OOOOO:RecordReader", const_cast<char**>(keywords),
+          args, kwargs, "O|$OOOOOOi:RecordReader", const_cast<char**>(keywords),
           &src_arg, &owns_src_arg, &assumed_pos_arg, &buffer_size_arg,
-          &field_projection_arg, &recovery_arg))) {
+          &chunk_range_arg, &field_projection_arg, &recovery_arg,
+          &parallelism))) {
     return -1;
   }
+  const absl::optional<PythonPtr> opened_src = OpenIfPath(src_arg, "rb");
+  if (ABSL_PREDICT_FALSE(opened_src == absl::nullopt)) return -1;
+  if (*opened_src != nullptr) src_arg = opened_src->get();
 
   PythonReader::Options python_reader_options;
   if (owns_src_arg != nullptr) {
@@ -272,6 +335,8 @@ static int RecordReaderInit(PyRecordReaderObject* self, PyObject* args,
     if (ABSL_PREDICT_FALSE(owns_src_is_true < 0)) return -1;
     python_reader_options.set_owns_src(owns_src_is_true != 0);
   }
+  // A file opened here is always owned.
+  if (*opened_src != nullptr) python_reader_options.set_owns_src(true);
   if (assumed_pos_arg != nullptr && assumed_pos_arg != Py_None) {
     const absl::optional<Position> assumed_pos =
         PositionFromPython(assumed_pos_arg);
@@ -285,6 +350,28 @@ static int RecordReaderInit(PyRecordReaderObject* self, PyObject* args,
   }
 
   RecordReaderBase::Options record_reader_options;
+  if (ABSL_PREDICT_FALSE(parallelism < 0)) {
+    PyErr_SetString(PyExc_ValueError, "parallelism must be non-negative");
+    return -1;
+  }
+  record_reader_options.set_parallelism(parallelism);
+  if (chunk_range_arg != nullptr && chunk_range_arg != Py_None) {
+    PyObject* begin_arg;
+    PyObject* end_arg;
+    if (ABSL_PREDICT_FALSE(!PyArg_ParseTuple(chunk_range_arg, "OO:chunk_range",
+                                             &begin_arg, &end_arg))) {
+      return -1;
+    }
+    const absl::optional<Position> begin = PositionFromPython(begin_arg);
+    if (ABSL_PREDICT_FALSE(begin == absl::nullopt)) return -1;
+    const absl::optional<Position> end = PositionFromPython(end_arg);
+    if (ABSL_PREDICT_FALSE(end == absl::nullopt)) return -1;
+    if (ABSL_PREDICT_FALSE(*begin > *end)) {
+      PyErr_SetString(PyExc_ValueError, "chunk_range in reverse order");
+      return -1;
+    }
+    record_reader_options.set_chunk_range(*begin, *end);
+  }
   if (field_projection_arg != nullptr && field_projection_arg != Py_None) {
     absl::optional<FieldProjection> field_projection =
         FieldProjectionFromPython(field_projection_arg);
@@ -484,6 +571,114 @@ static PyObject* RecordReaderReadRecord(PyRecordReaderObject* self,
   return ChainToPython(record).release();
 }
 
+static PyObject* RecordReaderReadRecordView(PyRecordReaderObject* self,
+                                            PyObject* args) {
+  if (ABSL_PREDICT_FALSE(!self->record_reader.Verify())) return nullptr;
+  Chain record;
+  const bool ok = PythonUnlocked([&] {
+    if (ABSL_PREDICT_FALSE(!self->record_reader->ReadRecord(record))) {
+      return false;
+    }
+    // A record which is not split between chunk fragments is not copied.
+    record.Flatten();
+    return true;
+  });
+  if (ABSL_PREDICT_FALSE(!ok)) {
+    if (ABSL_PREDICT_FALSE(RecordReaderHasException(self))) {
+      SetExceptionFromRecordReader(self);
+      return nullptr;
+    }
+    Py_RETURN_NONE;
+  }
+  const PythonPtr record_buffer(
+      PyType_GenericAlloc(&PyRecordBuffer_Type, 0));
+  if (ABSL_PREDICT_FALSE(record_buffer == nullptr)) return nullptr;
+  reinterpret_cast<PyRecordBufferObject*>(record_buffer.get())
+      ->record.emplace(std::move(record));
+  return PyMemoryView_FromObject(record_buffer.get());
+}
+
+static PyObject* RecordReaderReadRecordsInto(PyRecordReaderObject* self,
+                                             PyObject* args,
+                                             PyObject* kwargs) {
+  static constexpr const char* keywords[] = {"buffer", "offsets", nullptr};
+  PyObject* buffer_arg;
+  PyObject* offsets_arg;
+  if (ABSL_PREDICT_FALSE(!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "OO:read_records_into", const_cast<char**>(keywords),
+          &buffer_arg, &offsets_arg))) {
+    return nullptr;
+  }
+  PythonBuffer buffer;
+  if (ABSL_PREDICT_FALSE(!buffer.FromPython(buffer_arg, false))) return nullptr;
+  PythonBuffer offsets;
+  if (ABSL_PREDICT_FALSE(!offsets.FromPython(offsets_arg, true))) {
+    return nullptr;
+  }
+  if (ABSL_PREDICT_FALSE(offsets.itemsize() != sizeof(int64_t) ||
+                         offsets.format().empty() ||
+                         (offsets.format().back() != 'q' &&
+                          offsets.format().back() != 'l'))) {
+    PyErr_SetString(PyExc_TypeError, "offsets must be an array of int64");
+    return nullptr;
+  }
+  const size_t max_records = offsets.size() / sizeof(int64_t);
+  if (ABSL_PREDICT_FALSE(max_records == 0)) {
+    PyErr_SetString(PyExc_ValueError, "offsets must not be empty");
+    return nullptr;
+  }
+  if (ABSL_PREDICT_FALSE(!self->record_reader.Verify())) return nullptr;
+  size_t num_records = 0;
+  size_t length_written = 0;
+  size_t record_too_large = 0;
+  const bool ok = PythonUnlocked([&] {
+    int64_t offset = 0;
+    std::memcpy(offsets.data(), &offset, sizeof(int64_t));
+    while (num_records < max_records - 1) {
+      absl::string_view record;
+      if (ABSL_PREDICT_FALSE(!self->record_reader->ReadRecord(record))) {
+        return false;
+      }
+      if (ABSL_PREDICT_FALSE(record.size() > buffer.size() - length_written)) {
+        // Unread the record, so that it is returned by the next call. This
+        // does not need random access because the chunk is already read.
+        if (ABSL_PREDICT_FALSE(!self->record_reader->Seek(
+                self->record_reader->last_pos()))) {
+          return false;
+        }
+        if (num_records == 0) record_too_large = record.size();
+        return true;
+      }
+      if (
+          // `std::memcpy(_, nullptr, 0)` is undefined.
+          !record.empty()) {
+        std::memcpy(buffer.data() + length_written, record.data(),
+                    record.size());
+        length_written += record.size();
+      }
+      ++num_records;
+      offset = IntCast<int64_t>(length_written);
+      std::memcpy(offsets.data() + num_records * sizeof(int64_t), &offset,
+                  sizeof(int64_t));
+    }
+    return true;
+  });
+  if (ABSL_PREDICT_FALSE(!ok) && num_records == 0 &&
+      ABSL_PREDICT_FALSE(RecordReaderHasException(self))) {
+    // If some records were read, their number is returned, and the exception
+    // will be raised by the next call.
+    SetExceptionFromRecordReader(self);
+    return nullptr;
+  }
+  if (ABSL_PREDICT_FALSE(record_too_large > 0)) {
+    PyErr_Format(PyExc_ValueError,
+                 "buffer too small for the next record: %zu < %zu",
+                 buffer.size(), record_too_large);
+    return nullptr;
+  }
+  return SizeToPython(num_records).release();
+}
+
 static PyObject* RecordReaderReadMessage(PyRecordReaderObject* self,
                                          PyObject* args, PyObject* kwargs) {
   static constexpr const char* keywords[] = {"message_type", nullptr};
@@ -530,6 +725,51 @@ static PyRecordIterObject* RecordReaderReadRecords(PyRecordReaderObject* self,
   return iter.release();
 }
 
+static PyObject* RecordReaderReadRecordsBatch(PyRecordReaderObject* self,
+                                              PyObject* args,
+                                              PyObject* kwargs) {
+  static constexpr const char* keywords[] = {"max_records", nullptr};
+  PyObject* max_records_arg;
+  if (ABSL_PREDICT_FALSE(!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "O:read_records_batch", const_cast<char**>(keywords),
+          &max_records_arg))) {
+    return nullptr;
+  }
+  const absl::optional<size_t> max_records = SizeFromPython(max_records_arg);
+  if (ABSL_PREDICT_FALSE(max_records == absl::nullopt)) return nullptr;
+  if (ABSL_PREDICT_FALSE(!self->record_reader.Verify())) return nullptr;
+  // Read all records with the GIL released once, instead of releasing and
+  // reacquiring it for each record.
+  std::vector<Chain> records;
+  const bool ok = PythonUnlocked([&] {
+    records.reserve(UnsignedMin(*max_records, size_t{1} << 16));
+    while (records.size() < *max_records) {
+      Chain record;
+      if (ABSL_PREDICT_FALSE(!self->record_reader->ReadRecord(record))) {
+        return false;
+      }
+      records.push_back(std::move(record));
+    }
+    return true;
+  });
+  if (ABSL_PREDICT_FALSE(!ok) && records.empty() &&
+      ABSL_PREDICT_FALSE(RecordReaderHasException(self))) {
+    // If some records were read, they are returned, and the exception will be
+    // raised by the next call.
+    SetExceptionFromRecordReader(self);
+    return nullptr;
+  }
+  PythonPtr result(PyList_New(IntCast<Py_ssize_t>(records.size())));
+  if (ABSL_PREDICT_FALSE(result == nullptr)) return nullptr;
+  for (size_t i = 0; i < records.size(); ++i) {
+    PythonPtr record_object = ChainToPython(records[i]);
+    if (ABSL_PREDICT_FALSE(record_object == nullptr)) return nullptr;
+    PyList_SET_ITEM(result.get(), IntCast<Py_ssize_t>(i),
+                    record_object.release());
+  }
+  return result.release();
+}
+
 static PyRecordIterObject* RecordReaderReadMessages(PyRecordReaderObject* self,
                                                     PyObject* args,
                                                     PyObject* kwargs) {
@@ -915,6 +1155,46 @@ Reads the next record.
 
 Returns:
   The record read as bytes, or None at end of file.
+)doc"},
+    {"read_record_view",
+     reinterpret_cast<PyCFunction>(RecordReaderReadRecordView), METH_NOARGS,
+     R"doc(
+read_record_view(self) -> Optional[memoryview]
+
+Reads the next record without copying it to a bytes object.
+
+The memoryview refers to the decoded chunk data, which are kept alive while the
+memoryview is referenced. The record is copied only if it is split between
+fragments of the decoded chunk.
+
+Returns:
+  The record read as a read-only memoryview, or None at end of file.
+)doc"},
+    {"read_records_into",
+     reinterpret_cast<PyCFunction>(RecordReaderReadRecordsInto),
+     METH_VARARGS | METH_KEYWORDS, R"doc(
+read_records_into(self, buffer: Buffer, offsets: Buffer) -> int
+
+Reads the next records into preallocated arrays, e.g. NumPy arrays.
+
+Records are stored consecutively in buffer. Record i occupies
+buffer[offsets[i]:offsets[i + 1]], with offsets[0] == 0.
+
+Reading stops at end of file, when offsets is full, or before a record which
+does not fit in the remaining part of buffer. That record is returned by the
+next read.
+
+Args:
+  buffer: A writable contiguous buffer for record contents.
+  offsets: A writable contiguous array of int64, with room for one more element
+    than the maximum number of records to read.
+
+Returns:
+  The number of records read. 0 means end of file, unless offsets has only one
+  element.
+
+Raises:
+  ValueError: If the next record does not fit in the whole buffer.
 )doc"},
     {"read_message", reinterpret_cast<PyCFunction>(RecordReaderReadMessage),
      METH_VARARGS | METH_KEYWORDS, R"doc(
@@ -936,6 +1216,25 @@ Returns an iterator which reads all remaining records.
 
 Yields:
   The next record read as bytes.
+)doc"},
+    {"read_records_batch",
+     reinterpret_cast<PyCFunction>(RecordReaderReadRecordsBatch),
+     METH_VARARGS | METH_KEYWORDS, R"doc(
+read_records_batch(self, max_records: int) -> List[bytes]
+
+Reads up to max_records next records.
+
+This is faster than calling read_record() repeatedly: the GIL is released once
+for reading the whole batch, so that other Python threads run while records are
+being read and decoded.
+
+Args:
+  max_records: Maximum number of records to read.
+
+Returns:
+  The records read as bytes. Fewer than max_records are returned only at end of
+  file or before an exception, which is then raised by the next call. An empty
+  list is returned only if max_records is 0 or at end of file.
 )doc"},
     {"read_messages", reinterpret_cast<PyCFunction>(RecordReaderReadMessages),
      METH_VARARGS | METH_KEYWORDS, R"doc(
@@ -1169,24 +1468,32 @@ PyTypeObject PyRecordReader_Type = {
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,  // tp_flags
     R"doc(
 RecordReader(
-    src: BinaryIO,
+    src: Union[BinaryIO, str, bytes, os.PathLike],
     *,
     owns_src: bool = True,
     assumed_pos: Optional[int] = None,
     buffer_size: int = 64 << 10,
+    chunk_range: Optional[Tuple[int, int]] = None,
     field_projection: Optional[Iterable[Iterable[int]]] = None,
-    recovery: Optional[Callable[[SkippedRegion], Any]] = None) -> RecordReader
+    recovery: Optional[Callable[[SkippedRegion], Any]] = None,
+    parallelism: int = 0) -> RecordReader
 
 Will read from the given file.
 
 Args:
-  src: Binary IO stream to read from.
+  src: Binary IO stream to read from, or a file path to open in binary mode.
+    A file opened from a path is always owned.
   owns_src: If True, src is owned, and close() or __exit__() calls src.close().
   assumed_pos: If None, src must support random access, RecordReader will
     support random access, and RecordReader will set the position of src on
     close(). If an int, it is enough that src supports sequential access, and
     this position will be assumed initially.
   buffer_size: Tunes how much data is buffered after reading from src.
+  chunk_range: If not None, a pair (begin, end) of file positions. Only chunks
+    which begin in [begin, end) are read. This partitions a file between
+    independent readers at chunk granularity without overlap, e.g. shard i of n
+    can use (size * i // n, size * (i + 1) // n). If begin > 0, src must support
+    random access.
   field_projection: If not None, the set of fields to be included in returned
     records, allowing to exclude the remaining fields (but does not guarantee
     that they will be excluded). Excluding data makes reading faster. Projection
@@ -1205,6 +1512,11 @@ Args:
     reading continues. If the recovery function raises StopIteration, reading
     ends. If close() is called and file contents were truncated, the recovery
     function is called if set; the RecordReader remains closed.
+  parallelism: The maximum number of chunks being decoded in parallel in
+    background threads, which do not hold the GIL. Larger parallelism can
+    increase throughput, up to a point where it no longer matters; smaller
+    parallelism reduces memory usage. If 0, chunks are decoded in the reading
+    thread.
 
 The src argument should be a binary IO stream which supports:
  * close()          - for close() or __exit__() if owns_src
@@ -1215,12 +1527,16 @@ The src argument should be a binary IO stream which supports:
                       or for seek(), seek_numeric(), or size()
 
 Example values for src:
+ * filename
  * io.FileIO(filename, 'rb')
  * io.open(filename, 'rb') - better with buffering=0, or use io.FileIO() instead
  * open(filename, 'rb')    - better with buffering=0, or use io.FileIO() instead
  * io.BytesIO(contents)
  * tf.io.gfile.GFile(filename, 'rb')
 
+If src is a seekable file created by io.open() and assumed_pos is None, data are
+read directly from its file descriptor without holding the GIL.
+
 Warning: if owns_src is False and assumed_pos is not None, src will have an
 unpredictable amount of extra data consumed because of buffering.
 )doc",                                                              // tp_doc
@@ -1343,6 +1659,85 @@ PyTypeObject PyRecordIter_Type = {
     nullptr,                                             // tp_finalize
 };
 
+extern "C" {
+
+static void RecordBufferDestructor(PyRecordBufferObject* self) {
+  self->record.reset();
+  Py_TYPE(self)->tp_free(self);
+}
+
+static int RecordBufferGetBuffer(PyRecordBufferObject* self, Py_buffer* view,
+                                 int flags) {
+  const absl::string_view record = *self->record->TryFlat();
+  return PyBuffer_FillInfo(view, reinterpret_cast<PyObject*>(self),
+                           const_cast<char*>(record.data()),
+                           IntCast<Py_ssize_t>(record.size()), 1, flags);
+}
+
+}  // extern "C"
+
+const PyBufferProcs kRecordBufferAsBuffer = {
+    reinterpret_cast<getbufferproc>(RecordBufferGetBuffer),  // bf_getbuffer
+    nullptr,                                                 // bf_releasebuffer
+};
+
+PyTypeObject PyRecordBuffer_Type = {
+    // clang-format off
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    // clang-format on
+    "RecordBuffer",                                        // tp_name
+    sizeof(PyRecordBufferObject),                          // tp_basicsize
+    0,                                                     // tp_itemsize
+    reinterpret_cast<destructor>(RecordBufferDestructor),  // tp_dealloc
+#if PY_VERSION_HEX >= 0x03080000
+    0,  // tp_vectorcall_offset
+#else
+    nullptr,  // tp_print
+#endif
+    nullptr,  // tp_getattr
+    nullptr,  // tp_setattr
+    nullptr,  // tp_as_async
+    nullptr,  // tp_repr
+    nullptr,  // tp_as_number
+    nullptr,  // tp_as_sequence
+    nullptr,  // tp_as_mapping
+    nullptr,  // tp_hash
+    nullptr,  // tp_call
+    nullptr,  // tp_str
+    nullptr,  // tp_getattro
+    nullptr,  // tp_setattro
+    const_cast<PyBufferProcs*>(&kRecordBufferAsBuffer),  // tp_as_buffer
+    Py_TPFLAGS_DEFAULT,                                  // tp_flags
+    nullptr,                                             // tp_doc
+    nullptr,                                             // tp_traverse
+    nullptr,                                             // tp_clear
+    nullptr,                                             // tp_richcompare
+    0,                                                   // tp_weaklistoffset
+    nullptr,                                             // tp_iter
+    nullptr,                                             // tp_iternext
+    nullptr,                                             // tp_methods
+    nullptr,                                             // tp_members
+    nullptr,                                             // tp_getset
+    nullptr,                                             // tp_base
+    nullptr,                                             // tp_dict
+    nullptr,                                             // tp_descr_get
+    nullptr,                                             // tp_descr_set
+    0,                                                   // tp_dictoffset
+    nullptr,                                             // tp_init
+    nullptr,                                             // tp_alloc
+    nullptr,                                             // tp_new
+    nullptr,                                             // tp_free
+    nullptr,                                             // tp_is_gc
+    nullptr,                                             // tp_bases
+    nullptr,                                             // tp_mro
+    nullptr,                                             // tp_cache
+    nullptr,                                             // tp_subclasses
+    nullptr,                                             // tp_weaklist
+    nullptr,                                             // tp_del
+    0,                                                   // tp_version_tag
+    nullptr,                                             // tp_finalize
+};
+
 const char* const kModuleName = "riegeli.records.record_reader";
 const char kModuleDoc[] = R"doc(Reads records from a Riegeli/records file.)doc";
 
@@ -1384,6 +1779,9 @@ PyObject* InitModule() {
   if (ABSL_PREDICT_FALSE(PyType_Ready(&PyRecordIter_Type) < 0)) {
     return nullptr;
   }
+  if (ABSL_PREDICT_FALSE(PyType_Ready(&PyRecordBuffer_Type) < 0)) {
+    return nullptr;
+  }
   PythonPtr module(PyModule_Create(&kModuleDef));
   if (ABSL_PREDICT_FALSE(module == nullptr)) return nullptr;
   PythonPtr existence_only = IntToPython(Field::kExistenceOnly);
@@ -22,7 +22,9 @@
 
 #include <stddef.h>
 
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
@@ -210,6 +212,28 @@ void SetExceptionFromRecordWriter(PyRecordWriterObject* self) {
   SetRiegeliError(self->record_writer->status());
 }
 
+// Writes `records` with the GIL released once.
+//
+// Returns `false` on failure (with Python exception set).
+bool WriteBatch(PyRecordWriterObject* self,
+                const std::vector<std::unique_ptr<BytesLike>>& records) {
+  if (ABSL_PREDICT_FALSE(!self->record_writer.Verify())) return false;
+  const bool ok = PythonUnlocked([&] {
+    for (const std::unique_ptr<BytesLike>& record : records) {
+      if (ABSL_PREDICT_FALSE(
+              !self->record_writer->WriteRecord(absl::string_view(*record)))) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (ABSL_PREDICT_FALSE(!ok)) {
+    SetExceptionFromRecordWriter(self);
+    return false;
+  }
+  return true;
+}
+
 extern "C" {
 
 static void RecordWriterDestructor(PyRecordWriterObject* self) {
@@ -251,6 +275,9 @@ static int RecordWriterInit(PyRecordWriterObject* self, PyObject* args,
           &options_arg, &metadata_arg, &serialized_metadata_arg))) {
     return -1;
   }
+  const absl::optional<PythonPtr> opened_dest = OpenIfPath(dest_arg, "wb");
+  if (ABSL_PREDICT_FALSE(opened_dest == absl::nullopt)) return -1;
+  if (*opened_dest != nullptr) dest_arg = opened_dest->get();
 
   PythonWriter::Options python_writer_options;
   if (owns_dest_arg != nullptr) {
@@ -258,6 +285,8 @@ static int RecordWriterInit(PyRecordWriterObject* self, PyObject* args,
     if (ABSL_PREDICT_FALSE(owns_dest_is_true < 0)) return -1;
     python_writer_options.set_owns_dest(owns_dest_is_true != 0);
   }
+  // A file opened here is always owned.
+  if (*opened_dest != nullptr) python_writer_options.set_owns_dest(true);
   if (assumed_pos_arg != nullptr && assumed_pos_arg != Py_None) {
     const absl::optional<Position> assumed_pos =
         PositionFromPython(assumed_pos_arg);
@@ -497,6 +526,67 @@ static PyObject* RecordWriterWriteMessages(PyRecordWriterObject* self,
   Py_RETURN_NONE;
 }
 
+static PyObject* RecordWriterWriteRecordsBatch(PyRecordWriterObject* self,
+                                               PyObject* args,
+                                               PyObject* kwargs) {
+  static constexpr const char* keywords[] = {"records", nullptr};
+  PyObject* records_arg;
+  if (ABSL_PREDICT_FALSE(!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "O:write_records_batch", const_cast<char**>(keywords),
+          &records_arg))) {
+    return nullptr;
+  }
+  const PythonPtr records_seq(
+      PySequence_Fast(records_arg, "records must be a sequence"));
+  if (ABSL_PREDICT_FALSE(records_seq == nullptr)) return nullptr;
+  const Py_ssize_t num_records = PySequence_Fast_GET_SIZE(records_seq.get());
+  std::vector<std::unique_ptr<BytesLike>> records;
+  records.reserve(IntCast<size_t>(num_records));
+  for (Py_ssize_t i = 0; i < num_records; ++i) {
+    records.push_back(std::make_unique<BytesLike>());
+    if (ABSL_PREDICT_FALSE(!records.back()->FromPython(
+            PySequence_Fast_GET_ITEM(records_seq.get(), i)))) {
+      return nullptr;
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!WriteBatch(self, records))) return nullptr;
+  Py_RETURN_NONE;
+}
+
+static PyObject* RecordWriterWriteMessagesBatch(PyRecordWriterObject* self,
+                                                PyObject* args,
+                                                PyObject* kwargs) {
+  static constexpr const char* keywords[] = {"records", nullptr};
+  PyObject* records_arg;
+  if (ABSL_PREDICT_FALSE(!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "O:write_messages_batch", const_cast<char**>(keywords),
+          &records_arg))) {
+    return nullptr;
+  }
+  const PythonPtr records_seq(
+      PySequence_Fast(records_arg, "records must be a sequence"));
+  if (ABSL_PREDICT_FALSE(records_seq == nullptr)) return nullptr;
+  const Py_ssize_t num_records = PySequence_Fast_GET_SIZE(records_seq.get());
+  std::vector<std::unique_ptr<BytesLike>> records;
+  records.reserve(IntCast<size_t>(num_records));
+  for (Py_ssize_t i = 0; i < num_records; ++i) {
+    // records.append(record.SerializeToString())
+    static constexpr Identifier id_SerializeToString("SerializeToString");
+    const PythonPtr serialized_object(PyObject_CallMethodObjArgs(
+        PySequence_Fast_GET_ITEM(records_seq.get(), i),
+        id_SerializeToString.get(), nullptr));
+    if (ABSL_PREDICT_FALSE(serialized_object == nullptr)) return nullptr;
+    // `BytesLike` keeps a reference to `serialized_object`.
+    records.push_back(std::make_unique<BytesLike>());
+    if (ABSL_PREDICT_FALSE(
+            !records.back()->FromPython(serialized_object.get()))) {
+      return nullptr;
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!WriteBatch(self, records))) return nullptr;
+  Py_RETURN_NONE;
+}
+
 static PyObject* RecordWriterFlush(PyRecordWriterObject* self, PyObject* args,
                                    PyObject* kwargs) {
   static constexpr const char* keywords[] = {"flush_type", nullptr};
@@ -619,6 +709,34 @@ Writes a number of records.
 
 Args:
   records: Records to write as an iterable of proto messages.
+)doc"},
+    {"write_records_batch",
+     reinterpret_cast<PyCFunction>(RecordWriterWriteRecordsBatch),
+     METH_VARARGS | METH_KEYWORDS, R"doc(
+write_records_batch(
+    self, records: Sequence[Union[bytes, bytearray, memoryview]]) -> None
+
+Writes a number of records.
+
+This is faster than write_records() because the GIL is released once for writing
+the whole batch, so that other Python threads run while records are being
+written and encoded.
+
+Args:
+  records: Records to write as a sequence of bytes-like objects.
+)doc"},
+    {"write_messages_batch",
+     reinterpret_cast<PyCFunction>(RecordWriterWriteMessagesBatch),
+     METH_VARARGS | METH_KEYWORDS, R"doc(
+write_messages_batch(self, records: Sequence[Message]) -> None
+
+Writes a number of records.
+
+Messages are serialized first, and then the GIL is released once for writing
+the whole batch, like in write_records_batch().
+
+Args:
+  records: Records to write as a sequence of proto messages.
 )doc"},
     {"flush", reinterpret_cast<PyCFunction>(RecordWriterFlush),
      METH_VARARGS | METH_KEYWORDS, R"doc(
@@ -740,7 +858,7 @@ PyTypeObject PyRecordWriter_Type = {
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,  // tp_flags
     R"doc(
 RecordWriter(
-    dest: BinaryIO,
+    dest: Union[BinaryIO, str, bytes, os.PathLike],
     *,
     owns_dest: bool = True,
     assumed_pos: Optional[int] = None,
@@ -753,7 +871,8 @@ RecordWriter(
 Will write to the given file.
 
 Args:
-  dest: Binary IO stream to write to.
+  dest: Binary IO stream to write to, or a file path to open with mode 'wb'.
+    A file opened from a path is always owned.
   owns_dest: If True, dest is owned, close() or __exit__() calls dest.close(),
     and flush(flush_type) calls dest.flush() even if flush_type is
     FlushType.FROM_OBJECT.
@@ -778,6 +897,7 @@ The dest argument should be a binary IO stream which supports:
  * tell()           - if assumed_pos is None
 
 Example values for dest (possibly with 'ab' instead of 'wb' for appending):
+ * filename
  * io.FileIO(filename, 'wb')
  * io.open(filename, 'wb') - better with buffering=0, or use io.FileIO() instead
  * open(filename, 'wb')    - better with buffering=0, or use io.FileIO() instead
@@ -787,6 +907,9 @@ Example values for dest (possibly with 'ab' instead of 'wb' for appending):
 
 Options are documented at
 https://github.com/google/riegeli/blob/master/doc/record_writer_options.md
+
+If dest is a seekable file created by io.open() and not opened for appending,
+data are written directly to its file descriptor without holding the GIL.
 )doc",                                                              // tp_doc
     reinterpret_cast<traverseproc>(RecordWriterTraverse),  // tp_traverse
     reinterpret_cast<inquiry>(RecordWriterClear),          // tp_clear
@@ -13,10 +13,13 @@
 # limitations under the License.
 
 import abc
+import array
+import asyncio
 import contextlib
 from enum import Enum
 import io
 import itertools
+import pathlib
 
 from absl import logging
 from absl.testing import absltest
@@ -399,6 +402,140 @@ class RecordsTest(parameterized.TestCase):
             list(reader.read_records()),
             [sample_string(i, 10000) for i in range(23)])
 
+  def test_write_read_path(self):
+    filename = self.create_tempfile().full_path
+    with riegeli.RecordWriter(filename) as writer:
+      writer.write_records(sample_string(i, 10000) for i in range(23))
+    with riegeli.RecordReader(pathlib.Path(filename)) as reader:
+      self.assertEqual(
+          list(reader.read_records()),
+          [sample_string(i, 10000) for i in range(23)])
+
+  def test_unowned_file_position(self):
+    filename = self.create_tempfile().full_path
+    with open(filename, 'wb') as dest:
+      dest.write(b'prefix')
+      with riegeli.RecordWriter(dest, owns_dest=False) as writer:
+        writer.write_records(sample_string(i, 10000) for i in range(23))
+        writer.flush()
+        self.assertEqual(dest.tell(), writer.pos.numeric)
+      self.assertEqual(dest.tell(), writer.pos.numeric)
+    with open(filename, 'rb') as src:
+      self.assertEqual(src.read(6), b'prefix')
+      with riegeli.RecordReader(src, owns_src=False) as reader:
+        self.assertEqual(
+            list(reader.read_records()),
+            [sample_string(i, 10000) for i in range(23)])
+
+  @_PARAMETERIZE_BY_FILE_SPEC_AND_RANDOM_ACCESS_AND_PARALLELISM
+  def test_write_read_records_batch(self, file_spec, random_access,
+                                    parallelism):
+    with contextlib.closing(file_spec(self.create_tempfile,
+                                      random_access)) as files:
+      with riegeli.RecordWriter(
+          files.writing_open(),
+          owns_dest=files.writing_should_close,
+          assumed_pos=files.writing_assumed_pos,
+          options=record_writer_options(parallelism)) as writer:
+        writer.write_records(sample_string(i, 10000) for i in range(23))
+      with riegeli.RecordReader(
+          files.reading_open(),
+          owns_src=files.reading_should_close,
+          assumed_pos=files.reading_assumed_pos,
+          parallelism=parallelism) as reader:
+        self.assertEqual(
+            reader.read_records_batch(10),
+            [sample_string(i, 10000) for i in range(10)])
+        self.assertEqual(reader.read_records_batch(0), [])
+        self.assertEqual(
+            reader.read_records_batch(20),
+            [sample_string(i, 10000) for i in range(10, 23)])
+        self.assertEqual(reader.read_records_batch(10), [])
+
+  @_PARAMETERIZE_BY_FILE_SPEC_AND_RANDOM_ACCESS_AND_PARALLELISM
+  def test_write_read_records_async(self, file_spec, random_access,
+                                    parallelism):
+    with contextlib.closing(file_spec(self.create_tempfile,
+                                      random_access)) as files:
+      with riegeli.RecordWriter(
+          files.writing_open(),
+          owns_dest=files.writing_should_close,
+          assumed_pos=files.writing_assumed_pos,
+          options=record_writer_options(parallelism)) as writer:
+        writer.write_records(sample_string(i, 10000) for i in range(23))
+
+      async def read_all():
+        async with riegeli.AsyncRecordReader(
+            files.reading_open(),
+            owns_src=files.reading_should_close,
+            assumed_pos=files.reading_assumed_pos,
+            parallelism=parallelism,
+            batch_size=10) as reader:
+          first = await reader.read_record()
+          rest = [record async for record in reader]
+          self.assertIsNone(await reader.read_record())
+          return [first] + rest
+
+      self.assertEqual(
+          asyncio.run(read_all()),
+          [sample_string(i, 10000) for i in range(23)])
+
+  @_PARAMETERIZE_BY_FILE_SPEC_AND_RANDOM_ACCESS_AND_PARALLELISM
+  def test_write_read_record_view(self, file_spec, random_access,
+                                  parallelism):
+    with contextlib.closing(file_spec(self.create_tempfile,
+                                      random_access)) as files:
+      with riegeli.RecordWriter(
+          files.writing_open(),
+          owns_dest=files.writing_should_close,
+          assumed_pos=files.writing_assumed_pos,
+          options=record_writer_options(parallelism)) as writer:
+        writer.write_records(sample_string(i, 10000) for i in range(23))
+      with riegeli.RecordReader(
+          files.reading_open(),
+          owns_src=files.reading_should_close,
+          assumed_pos=files.reading_assumed_pos) as reader:
+        views = []
+        for i in range(23):
+          view = reader.read_record_view()
+          self.assertIsInstance(view, memoryview)
+          self.assertTrue(view.readonly)
+          views.append(view)
+        self.assertIsNone(reader.read_record_view())
+        # Views remain valid after further reading.
+        self.assertEqual([bytes(view) for view in views],
+                         [sample_string(i, 10000) for i in range(23)])
+
+  @_PARAMETERIZE_BY_FILE_SPEC_AND_RANDOM_ACCESS_AND_PARALLELISM
+  def test_write_read_records_into(self, file_spec, random_access,
+                                   parallelism):
+    with contextlib.closing(file_spec(self.create_tempfile,
+                                      random_access)) as files:
+      with riegeli.RecordWriter(
+          files.writing_open(),
+          owns_dest=files.writing_should_close,
+          assumed_pos=files.writing_assumed_pos,
+          options=record_writer_options(parallelism)) as writer:
+        writer.write_records(sample_string(i, 10000) for i in range(23))
+      with riegeli.RecordReader(
+          files.reading_open(),
+          owns_src=files.reading_should_close,
+          assumed_pos=files.reading_assumed_pos) as reader:
+        records = []
+        buffer = bytearray(35000)
+        offsets = array.array('q', [0] * 11)
+        with self.assertRaises(ValueError):
+          reader.read_records_into(bytearray(100), offsets)
+        while True:
+          num_records = reader.read_records_into(buffer, offsets)
+          if num_records == 0:
+            break
+          self.assertLessEqual(num_records, 3)
+          records.extend(
+              bytes(buffer[offsets[i]:offsets[i + 1]])
+              for i in range(num_records))
+        self.assertEqual(records, [sample_string(i, 10000) for i in range(23)])
+
   @_PARAMETERIZE_BY_FILE_SPEC_AND_RANDOM_ACCESS_AND_PARALLELISM
   def test_write_read_messages(self, file_spec, random_access, parallelism):
     with contextlib.closing(file_spec(self.create_tempfile,
@@ -417,6 +554,28 @@ class RecordsTest(parameterized.TestCase):
             list(reader.read_messages(records_test_pb2.SimpleMessage)),
             [sample_message(i, 10000) for i in range(23)])
 
+  @_PARAMETERIZE_BY_FILE_SPEC_AND_RANDOM_ACCESS_AND_PARALLELISM
+  def test_write_read_batches(self, file_spec, random_access, parallelism):
+    with contextlib.closing(file_spec(self.create_tempfile,
+                                      random_access)) as files:
+      with riegeli.RecordWriter(
+          files.writing_open(),
+          owns_dest=files.writing_should_close,
+          assumed_pos=files.writing_assumed_pos,
+          options=record_writer_options(parallelism)) as writer:
+        writer.write_records_batch(
+            [sample_message(i, 10000).SerializeToString() for i in range(10)])
+        writer.write_records_batch([])
+        writer.write_messages_batch(
+            [sample_message(i, 10000) for i in range(10, 23)])
+      with riegeli.RecordReader(
+          files.reading_open(),
+          owns_src=files.reading_should_close,
+          assumed_pos=files.reading_assumed_pos) as reader:
+        self.assertEqual(
+            list(reader.read_messages(records_test_pb2.SimpleMessage)),
+            [sample_message(i, 10000) for i in range(23)])
+
   @_PARAMETERIZE_BY_FILE_SPEC_AND_RANDOM_ACCESS_AND_PARALLELISM
   def test_write_read_messages_with_field_projection(self, file_spec,
                                                      random_access,
@@ -177,9 +177,9 @@ class RiegeliDatasetTest(DatasetTestBase):
 
     self.test_filenames = self._create_files()
 
-  def dataset_fn(self, filenames, num_epochs=1, batch_size=None):
-    repeat_dataset = riegeli_dataset_ops.RiegeliDataset(filenames).repeat(
-        num_epochs)
+  def dataset_fn(self, filenames, num_epochs=1, batch_size=None, **kwargs):
+    repeat_dataset = riegeli_dataset_ops.RiegeliDataset(
+        filenames, **kwargs).repeat(num_epochs)
     if batch_size:
       return repeat_dataset.batch(batch_size)
     return repeat_dataset
@@ -238,6 +238,112 @@ class RiegeliDatasetTest(DatasetTestBase):
           [self._record(j, i) for i in range(self._num_records)])
     self.assertDatasetProduces(dataset, expected_output=expected_output * 10)
 
+  def test_read_interleaved(self):
+    for num_parallel_reads in (0, 2):
+      dataset = self.dataset_fn(
+          self.test_filenames,
+          cycle_length=2,
+          block_length=3,
+          num_parallel_reads=num_parallel_reads,
+          parallelism=2)
+      expected_output = []
+      for begin in range(0, self._num_records, 3):
+        for j in range(self._num_files):
+          expected_output.extend([
+              self._record(j, i)
+              for i in range(begin, min(begin + 3, self._num_records))
+          ])
+      self.assertDatasetProduces(dataset, expected_output=expected_output)
+
+  def test_read_cycle_longer_than_files(self):
+    dataset = self.dataset_fn(
+        self.test_filenames, cycle_length=3, num_parallel_reads=3)
+    expected_output = []
+    for i in range(self._num_records):
+      expected_output.extend(
+          [self._record(j, i) for j in range(self._num_files)])
+    self.assertDatasetProduces(dataset, expected_output=expected_output)
+
+  def test_read_record_batches(self):
+    dataset = riegeli_dataset_ops.RiegeliDataset(
+        self.test_filenames, batch_size=3).repeat(2)
+    expected_output = []
+    for j in range(self._num_files):
+      expected_output.extend(
+          [self._record(j, i) for i in range(self._num_records)])
+    expected_output *= 2
+    # Batches do not cross epochs.
+    expected_batches = []
+    epoch_size = len(expected_output) // 2
+    for epoch_begin in (0, epoch_size):
+      for begin in range(epoch_begin, epoch_begin + epoch_size, 3):
+        expected_batches.append(
+            expected_output[begin:min(begin + 3, epoch_begin + epoch_size)])
+    self.assertDatasetProduces(dataset, expected_output=expected_batches)
+
+  def test_read_shards(self):
+    outputs = []
+    for shard_index in range(3):
+      dataset = self.dataset_fn(
+          self.test_filenames[0], shard_index=shard_index, num_shards=3)
+      get_next = self.getNext(dataset)
+      while True:
+        try:
+          outputs.append(self.evaluate(get_next()))
+        except errors.OutOfRangeError:
+          break
+    # Shards are disjoint and together cover the file.
+    self.assertEqual(outputs,
+                     [self._record(0, i) for i in range(self._num_records)])
+
+  def test_read_examples(self):
+    filename = os.path.join(self.get_temp_dir(), 'riegeli.examples')
+    with riegeli.RecordWriter(
+        tf.io.gfile.GFile(filename, 'wb'), options='transpose') as writer:
+      for i in range(self._num_records):
+        writer.write_message(
+            tf.train.Example(
+                features=tf.train.Features(
+                    feature={
+                        'id':
+                            tf.train.Feature(
+                                int64_list=tf.train.Int64List(value=[i])),
+                        'name':
+                            tf.train.Feature(
+                                bytes_list=tf.train.BytesList(
+                                    value=[self._record(0, i)])),
+                    })))
+    features = {'id': tf.io.FixedLenFeature([], tf.dtypes.int64)}
+    self.assertEqual(
+        riegeli_dataset_ops.example_field_projection(features),
+        [(1, 1, 1), (1, 1, 2, 3)])
+    dataset = riegeli_dataset_ops.example_dataset(
+        filename, features, batch_size=3)
+    self.assertDatasetProduces(
+        dataset,
+        expected_output=[{
+            'id': [0, 1, 2]
+        }, {
+            'id': [3, 4, 5]
+        }, {
+            'id': [6]
+        }])
+
+  def test_write_shards(self):
+    filenames = [
+        os.path.join(self.get_temp_dir(), f'riegeli.written.{i}')
+        for i in range(2)
+    ]
+    records = [self._record(0, i) for i in range(self._num_records)]
+    self.evaluate(
+        riegeli_dataset_ops.RiegeliDatasetWriter(
+            filenames, options='parallelism:2').write(
+                dataset_ops.Dataset.from_tensor_slices(records)))
+    # Elements are distributed between files round-robin.
+    for i, filename in enumerate(filenames):
+      self.assertDatasetProduces(
+          self.dataset_fn(filename), expected_output=records[i::2])
+
 
 if __name__ == '__main__':
   tf.test.main()
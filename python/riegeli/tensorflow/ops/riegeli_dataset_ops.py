@@ -23,31 +23,234 @@ from tensorflow.python.platform import resource_loader
 gen_riegeli_dataset_ops = load_library.load_op_library(
     resource_loader.get_path_to_datafile('_riegeli_dataset_ops.so'))
 
-__all__ = ('RiegeliDataset',)
+__all__ = ('RiegeliDataset', 'RiegeliDatasetWriter',
+           'example_field_projection', 'example_dataset')
 
 _DEFAULT_BUFFER_SIZE = 64 << 10
 
+# Number of records parsed together by `example_dataset()` with `batch_size=0`,
+# before splitting the batch into single records.
+_DEFAULT_EXAMPLE_PARSE_BATCH_SIZE = 1024
+
+# Field numbers in `tf.train.Example`: `Example.features`, `Features.feature`,
+# and `key` and `value` of the map entry.
+_EXAMPLE_FEATURE_KEY = (1, 1, 1)
+_EXAMPLE_FEATURE_VALUE = (1, 1, 2)
+# Field numbers of `Feature.bytes_list`, `Feature.float_list`, and
+# `Feature.int64_list`.
+_FEATURE_LIST_FIELDS = {
+    tf.dtypes.string: 1,
+    tf.dtypes.float32: 2,
+    tf.dtypes.int64: 3,
+}
+
 
 class RiegeliDataset(dataset_ops.DatasetSource):
   """A `Dataset` comprising records from one or more Riegeli/records files."""
 
-  __slots__ = ('_filenames', '_buffer_size')
+  __slots__ = ('_filenames', '_buffer_size', '_batch_size')
 
-  def __init__(self, filenames, buffer_size=None):
+  def __init__(self,
+               filenames,
+               buffer_size=None,
+               cycle_length=1,
+               block_length=1,
+               num_parallel_reads=0,
+               parallelism=0,
+               batch_size=0,
+               shard_index=0,
+               num_shards=1,
+               field_projection=None):
     """Creates a `RiegeliDataset`.
 
     Args:
       filenames: A `tf.string` tensor containing one or more filenames.
       buffer_size: A `tf.int64` scalar which tunes how much data is buffered
         after reading from the file. Default: 64K.
+      cycle_length: The number of files read concurrently. Records are
+        interleaved between them, and the position in each file is preserved
+        by checkpoints. Default: 1 (files are read one after another).
+      block_length: The number of consecutive records to return from each file
+        before moving on to the next one in the cycle. Default: 1.
+      num_parallel_reads: If positive, the number of threads reading blocks of
+        records ahead from files in the cycle. If 0, records are read on
+        demand. Default: 0.
+      parallelism: If positive, the number of chunks of each file which are
+        read ahead and decoded in background. If 0, chunks are decoded on
+        demand. Default: 0.
+      batch_size: If positive, each element is a `tf.string` vector of up to
+        this many records, fewer only at the end of the dataset or before an
+        error. This avoids per-record overhead of the dataset and a separate
+        `batch()` copy. If 0, each element is a `tf.string` scalar with one
+        record. Default: 0.
+      shard_index: The shard of each file to read, in [0, `num_shards`).
+        Default: 0.
+      num_shards: If greater than 1, each file is split by position into this
+        many shards, and only chunks beginning in the range of `shard_index`
+        are read. Workers reading different shards read disjoint records
+        without coordination. Default: 1.
+      field_projection: If not None, the set of fields to be included in
+        returned records, allowing to exclude the remaining fields (but does
+        not guarantee exclusion). Excluding data makes reading faster. Like for
+        `riegeli.RecordReader`, this is a collection of field paths, each being
+        a sequence of field numbers descending from the root message, possibly
+        ending with `riegeli.EXISTENCE_ONLY`. None or empty includes all fields.
+        Default: None.
     """
     self._filenames = tf.convert_to_tensor(filenames, name='filenames')
     self._buffer_size = convert.optional_param_to_tensor(
         'buffer_size', buffer_size, argument_default=_DEFAULT_BUFFER_SIZE)
+    self._batch_size = batch_size
+    if field_projection is None:
+      field_projection = ()
     variant_tensor = gen_riegeli_dataset_ops.riegeli_dataset(
-        self._filenames, self._buffer_size)
+        self._filenames,
+        self._buffer_size,
+        cycle_length=cycle_length,
+        block_length=block_length,
+        num_parallel_reads=num_parallel_reads,
+        parallelism=parallelism,
+        batch_size=batch_size,
+        shard_index=shard_index,
+        num_shards=num_shards,
+        field_projection=[
+            '.'.join(str(field_number) for field_number in field)
+            for field in field_projection
+        ])
     super(RiegeliDataset, self).__init__(variant_tensor)
 
   @property
   def element_spec(self):
+    if self._batch_size > 0:
+      return tf.TensorSpec([None], tf.dtypes.string)
     return tf.TensorSpec([], tf.dtypes.string)
+
+
+class RiegeliDatasetWriter:
+  """Writes a `Dataset` of strings to Riegeli/records files.
+
+  Records are encoded in the TensorFlow runtime, without passing them through
+  Python.
+  """
+
+  __slots__ = ('_filenames', '_options')
+
+  def __init__(self, filenames, options=''):
+    """Creates a `RiegeliDatasetWriter`.
+
+    Args:
+      filenames: A `tf.string` tensor containing one or more filenames.
+        Dataset elements are distributed between files round-robin, e.g. to
+        be read later in parallel.
+      options: Options of `riegeli.RecordWriter` in text format, e.g.
+        'transpose,parallelism:4'. Each file is encoded independently with
+        these options; with "parallelism", chunks of each file are encoded in
+        background threads. Default: ''.
+    """
+    self._filenames = tf.convert_to_tensor(
+        filenames, dtype=tf.dtypes.string, name='filenames')
+    self._options = options
+
+  def write(self, dataset):
+    """Writes records from a dataset to the files.
+
+    Args:
+      dataset: A `Dataset` whose elements are `tf.string` scalars or vectors.
+        Each element of a vector is written as a separate record, so that a
+        dataset of batches can be written.
+
+    Returns:
+      In graph mode, an operation which writes the records when run. In eager
+      mode, the records are written before returning.
+    """
+    element_spec = dataset.element_spec
+    if (not isinstance(element_spec, tf.TensorSpec) or
+        element_spec.dtype != tf.dtypes.string or
+        element_spec.shape.rank is None or element_spec.shape.rank > 1):
+      raise TypeError(
+          'dataset elements must be tf.string scalars or vectors, not '
+          f'{element_spec}')
+    return gen_riegeli_dataset_ops.write_riegeli_dataset(
+        dataset._variant_tensor,  # pylint: disable=protected-access
+        self._filenames,
+        options=self._options)
+
+
+def example_field_projection(features):
+  """Returns a field projection of `tf.train.Example` for a feature spec.
+
+  Field projection can select fields by field numbers, but not map entries by
+  keys, so all feature keys are included, but feature values are included only
+  for value types used in `features`. This speeds up reading files written with
+  "transpose" when features of other types are present.
+
+  Args:
+    features: A dict mapping feature keys to `FixedLenFeature`,
+      `FixedLenSequenceFeature`, `VarLenFeature`, or `SparseFeature` values,
+      like for `tf.io.parse_example()`.
+
+  Returns:
+    A field projection for the `field_projection` argument of `RiegeliDataset`,
+    or None if `features` contain other kinds of features, which requires
+    including all fields.
+  """
+  list_fields = set()
+  for feature in features.values():
+    if isinstance(feature, tf.io.SparseFeature):
+      list_fields.add(_FEATURE_LIST_FIELDS[tf.dtypes.int64])
+    elif not isinstance(feature, (tf.io.FixedLenFeature,
+                                  tf.io.FixedLenSequenceFeature,
+                                  tf.io.VarLenFeature)):
+      return None
+    list_field = _FEATURE_LIST_FIELDS.get(tf.dtypes.as_dtype(feature.dtype))
+    if list_field is None:
+      return None
+    list_fields.add(list_field)
+  return [_EXAMPLE_FEATURE_KEY] + [
+      _EXAMPLE_FEATURE_VALUE + (list_field,)
+      for list_field in sorted(list_fields)
+  ]
+
+
+def example_dataset(filenames,
+                    features,
+                    batch_size=0,
+                    parse_batch_size=_DEFAULT_EXAMPLE_PARSE_BATCH_SIZE,
+                    **kwargs):
+  """Creates a `Dataset` of parsed `tf.train.Example` records.
+
+  Records are read with a field projection built by
+  `example_field_projection()`, and parsed with `tf.io.parse_example()` in
+  batches, which amortizes the parsing overhead over many records.
+
+  With `batch_size=0`, records are still read and parsed in batches of
+  `parse_batch_size`, and single records are then produced by unbatching.
+
+  Args:
+    filenames: Like for `RiegeliDataset`.
+    features: A dict mapping feature keys to feature specs, like for
+      `tf.io.parse_example()`.
+    batch_size: If positive, each element is a dict of features of up to this
+      many records, like from `tf.io.parse_example()`. If 0, each element is a
+      dict of features of one record, like from `tf.io.parse_single_example()`.
+      Default: 0.
+    parse_batch_size: The number of records read and parsed together if
+      `batch_size` is 0. Ignored if `batch_size` is positive. Default: 1024.
+    **kwargs: Other arguments of `RiegeliDataset`, except for
+      `field_projection`.
+
+  Returns:
+    A `Dataset` whose elements are dicts mapping feature keys to `Tensor`,
+    `SparseTensor`, or `RaggedTensor` values.
+  """
+  dataset = RiegeliDataset(
+      filenames,
+      batch_size=batch_size if batch_size > 0 else parse_batch_size,
+      field_projection=example_field_projection(features),
+      **kwargs)
+  dataset = dataset.map(
+      lambda records: tf.io.parse_example(records, features),
+      num_parallel_calls=tf.data.experimental.AUTOTUNE)
+  if batch_size <= 0:
+    dataset = dataset.unbatch()
+  return dataset
@@ -0,0 +1,157 @@
+# Copyright 2020 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""PyTorch dataset for Riegeli/records files."""
+
+import os
+import random
+
+import torch.distributed
+import torch.utils.data
+
+import riegeli
+
+__all__ = ('RiegeliDataset',)
+
+_DEFAULT_SHARD_SIZE = 64 << 20
+
+
+class RiegeliDataset(torch.utils.data.IterableDataset):
+  """An `IterableDataset` comprising records from Riegeli/records files.
+
+  Files are split by position into shards of about `shard_size` bytes. Shards
+  are distributed round-robin between all data loader workers of all
+  distributed ranks, and each worker reads only chunks beginning in its shards,
+  so that workers read disjoint records without coordination and every record
+  is read once per epoch.
+
+  Records are read in batches with `RecordReader.read_records_batch()`, which
+  releases the GIL while records are read and decoded.
+  """
+
+  def __init__(self,
+               filenames,
+               message_type=None,
+               batch_size=None,
+               shard_size=_DEFAULT_SHARD_SIZE,
+               shuffle_shards=False,
+               seed=0,
+               rank=None,
+               world_size=None,
+               buffer_size=64 << 10,
+               field_projection=None,
+               parallelism=0):
+    """Creates a `RiegeliDataset`.
+
+    Args:
+      filenames: A file path or a sequence of file paths.
+      message_type: If not None, records are parsed as this proto message type.
+        If None, records are bytes.
+      batch_size: If not None, each element is a list of up to this many
+        records, fewer only at the end of a shard. If None, each element is a
+        single record.
+      shard_size: The approximate number of bytes in a shard. Smaller shards
+        balance the load between workers better; larger shards reduce the
+        overhead of opening files and of partially read chunks. Default: 64M.
+      shuffle_shards: If True, the order of shards is shuffled in each epoch.
+        All workers must use the same `seed` and `set_epoch()`.
+      seed: The seed for shuffling shards.
+      rank: The rank of this process among distributed processes. If None, it
+        is taken from `torch.distributed` if initialized, otherwise 0.
+      world_size: The number of distributed processes. If None, it is taken
+        from `torch.distributed` if initialized, otherwise 1.
+      buffer_size: Tunes how much data is buffered after reading from a file.
+      field_projection: If not None, the set of fields to be included in
+        returned records, like for `riegeli.RecordReader`.
+      parallelism: The maximum number of chunks of each file being decoded in
+        parallel in background threads, like for `riegeli.RecordReader`.
+    """
+    super().__init__()
+    if isinstance(filenames, (str, bytes, os.PathLike)):
+      filenames = [filenames]
+    if batch_size is not None and batch_size <= 0:
+      raise ValueError('batch_size must be positive')
+    if shard_size <= 0:
+      raise ValueError('shard_size must be positive')
+    if rank is None or world_size is None:
+      distributed = (
+          torch.distributed.is_available() and
+          torch.distributed.is_initialized())
+      if rank is None:
+        rank = torch.distributed.get_rank() if distributed else 0
+      if world_size is None:
+        world_size = torch.distributed.get_world_size() if distributed else 1
+    if not 0 <= rank < world_size:
+      raise ValueError('rank must be in [0, world_size)')
+    self._filenames = list(filenames)
+    self._message_type = message_type
+    self._batch_size = batch_size
+    self._shard_size = shard_size
+    self._shuffle_shards = shuffle_shards
+    self._seed = seed
+    self._epoch = 0
+    self._rank = rank
+    self._world_size = world_size
+    self._buffer_size = buffer_size
+    self._field_projection = field_projection
+    self._parallelism = parallelism
+
+  def set_epoch(self, epoch):
+    """Sets the epoch used for shuffling shards, like for `DistributedSampler`.
+
+    Args:
+      epoch: The epoch number.
+    """
+    self._epoch = epoch
+
+  def _shards(self):
+    """Returns all shards as a list of (filename, begin, end) tuples."""
+    shards = []
+    for filename in self._filenames:
+      size = os.path.getsize(filename)
+      num_shards = max(1, -(-size // self._shard_size))
+      for index in range(num_shards):
+        shards.append((filename, size * index // num_shards,
+                       size * (index + 1) // num_shards))
+    if self._shuffle_shards:
+      random.Random(self._seed + self._epoch).shuffle(shards)
+    return shards
+
+  def __iter__(self):
+    worker_info = torch.utils.data.get_worker_info()
+    if worker_info is None:
+      worker_id, num_workers = 0, 1
+    else:
+      worker_id, num_workers = worker_info.id, worker_info.num_workers
+    consumer_id = self._rank * num_workers + worker_id
+    num_consumers = self._world_size * num_workers
+    batch_size = 1024 if self._batch_size is None else self._batch_size
+    for filename, begin, end in self._shards()[consumer_id::num_consumers]:
+      with riegeli.RecordReader(
+          filename,
+          buffer_size=self._buffer_size,
+          chunk_range=(begin, end),
+          field_projection=self._field_projection,
+          parallelism=self._parallelism) as reader:
+        while True:
+          records = reader.read_records_batch(batch_size)
+          if not records:
+            break
+          if self._message_type is not None:
+            records = [
+                self._message_type.FromString(record) for record in records
+            ]
+          if self._batch_size is None:
+            yield from records
+          else:
+            yield records
@@ -43,6 +43,7 @@ setuptools.setup(
     ],
     extras_require={
         'tensorflow': ['tensorflow>=1.15,<3'],
+        'torch': ['torch>=1.2'],
     },
     packages=setuptools.find_packages(),
     include_package_data=True,
@@ -14,15 +14,210 @@
 
 #include "riegeli/base/buffer.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <utility>
 
+#include "absl/base/optimization.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/memory.h"
+#include "riegeli/base/recycling_pool.h"
 
 namespace riegeli {
 
+namespace {
+
+// Freed buffers with capacities `kMinBufferSize << buffer_class` are kept for
+// reuse. Each thread keeps up to `kMaxBuffersPerClass` buffers of each class
+// and `kMaxThreadCachedBytes` in total, without synchronization. Buffers which
+// do not fit there go to a global `RecyclingPool` of their class, which also
+// refills an empty thread cache.
+//
+// The thread cache is trivially destructible, so that it remains usable by
+// other thread-local destructors. `BufferCacheCleaner` returns cached buffers
+// to the global pools at thread exit and disables the cache afterwards.
+constexpr size_t kNumBufferClasses = 9;
+constexpr size_t kMaxBuffersPerClass = 4;
+constexpr size_t kMaxThreadCachedBytes = size_t{512} << 10;
+// Thread-local statistics are added to the global statistics when their sum
+// reaches this value.
+constexpr uint64_t kStatsBatchSize = 256;
+
+static_assert(kMinBufferSize << (kNumBufferClasses - 1) == kMaxBufferSize,
+              "Buffer classes should end at kMaxBufferSize");
+
+struct BufferDeleter {
+  void operator()(char* ptr) const { operator delete(ptr); }
+};
+
+using BufferPool = RecyclingPool<char, BufferDeleter>;
+
+struct GlobalBufferPools {
+  BufferPool pools[kNumBufferClasses];
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+};
+
+GlobalBufferPools& global_buffer_pools() {
+  static NoDestructor<GlobalBufferPools> kGlobalBufferPools;
+  return *kGlobalBufferPools;
+}
+
+struct BufferCache {
+  struct Class {
+    size_t num_buffers;
+    char* buffers[kMaxBuffersPerClass];
+  };
+
+  bool disabled;
+  size_t cached_bytes;
+  uint64_t hits;
+  uint64_t misses;
+  Class classes[kNumBufferClasses];
+};
+
+thread_local BufferCache buffer_cache;
+
+// Returns the index into `BufferCache::classes` of the smallest class with
+// capacity at least `min_capacity`, or `kNumBufferClasses` if buffers for
+// `min_capacity` are not pooled.
+inline size_t MinBufferClass(size_t min_capacity) {
+  if (min_capacity > kMaxBufferSize) return kNumBufferClasses;
+  size_t buffer_class = 0;
+  while ((kMinBufferSize << buffer_class) < min_capacity) ++buffer_class;
+  const size_t capacity = kMinBufferSize << buffer_class;
+  if (capacity - min_capacity > min_capacity / 8) return kNumBufferClasses;
+  return buffer_class;
+}
+
+// Returns the index into `BufferCache::classes` for `capacity`, or
+// `kNumBufferClasses` if buffers of `capacity` are not pooled.
+inline size_t BufferClass(size_t capacity) {
+  for (size_t buffer_class = 0; buffer_class < kNumBufferClasses;
+       ++buffer_class) {
+    if ((kMinBufferSize << buffer_class) == capacity) return buffer_class;
+  }
+  return kNumBufferClasses;
+}
+
+void PublishStats() {
+  GlobalBufferPools& global = global_buffer_pools();
+  global.hits.fetch_add(std::exchange(buffer_cache.hits, 0),
+                        std::memory_order_relaxed);
+  global.misses.fetch_add(std::exchange(buffer_cache.misses, 0),
+                          std::memory_order_relaxed);
+}
+
+inline void CountAllocation(bool hit) {
+  ++(hit ? buffer_cache.hits : buffer_cache.misses);
+  if (ABSL_PREDICT_FALSE(buffer_cache.hits + buffer_cache.misses >=
+                         kStatsBatchSize)) {
+    PublishStats();
+  }
+}
+
+// Puts `data` into the global pool of `buffer_class`.
+void PutToGlobalPool(size_t buffer_class, char* data) {
+  BufferPool& pool = global_buffer_pools().pools[buffer_class];
+  // The handle puts the buffer into the pool when destroyed.
+  BufferPool::Handle handle(data,
+                            BufferPool::Recycler(&pool, BufferDeleter()));
+}
+
+struct BufferCacheCleaner {
+  ~BufferCacheCleaner() {
+    if (!active) return;
+    buffer_cache.disabled = true;
+    for (size_t buffer_class = 0; buffer_class < kNumBufferClasses;
+         ++buffer_class) {
+      BufferCache::Class& cached = buffer_cache.classes[buffer_class];
+      for (size_t i = 0; i < cached.num_buffers; ++i) {
+        PutToGlobalPool(buffer_class, cached.buffers[i]);
+      }
+      cached.num_buffers = 0;
+    }
+    buffer_cache.cached_bytes = 0;
+    PublishStats();
+  }
+
+  bool active = false;
+};
+
+thread_local BufferCacheCleaner buffer_cache_cleaner;
+
+}  // namespace
+
+void Buffer::AllocateInternal(size_t min_capacity) {
+  const size_t buffer_class = MinBufferClass(min_capacity);
+  if (buffer_class == kNumBufferClasses) {
+    const size_t capacity = EstimatedAllocatedSize(min_capacity);
+    data_ = static_cast<char*>(operator new(capacity));
+    capacity_ = capacity;
+    MaybeAdviseHugePages(data_, capacity_);
+    return;
+  }
+  const size_t capacity = kMinBufferSize << buffer_class;
+  BufferCache::Class& cached = buffer_cache.classes[buffer_class];
+  if (cached.num_buffers > 0) {
+    --cached.num_buffers;
+    data_ = cached.buffers[cached.num_buffers];
+    capacity_ = capacity;
+    buffer_cache.cached_bytes -= capacity;
+    CountAllocation(true);
+    return;
+  }
+  bool hit = true;
+  data_ = global_buffer_pools()
+              .pools[buffer_class]
+              .Get([capacity, &hit] {
+                hit = false;
+                return std::unique_ptr<char, BufferDeleter>(
+                    static_cast<char*>(operator new(capacity)));
+              })
+              .release();
+  capacity_ = capacity;
+  CountAllocation(hit);
+}
+
+void Buffer::Deallocate(char* data, size_t capacity) {
+  const size_t buffer_class = BufferClass(capacity);
+  if (buffer_class == kNumBufferClasses) {
+#if __cpp_sized_deallocation || __GXX_DELETE_WITH_SIZE__
+    operator delete(data, capacity);
+#else
+    operator delete(data);
+#endif
+    return;
+  }
+  BufferCache::Class& cached = buffer_cache.classes[buffer_class];
+  if (!buffer_cache.disabled && cached.num_buffers < kMaxBuffersPerClass &&
+      buffer_cache.cached_bytes + capacity <= kMaxThreadCachedBytes) {
+    // Ensure that cached buffers are returned to the global pools at thread
+    // exit.
+    buffer_cache_cleaner.active = true;
+    cached.buffers[cached.num_buffers] = data;
+    ++cached.num_buffers;
+    buffer_cache.cached_bytes += capacity;
+    return;
+  }
+  PutToGlobalPool(buffer_class, data);
+}
+
+BufferPoolStats Buffer::PoolStats() {
+  const GlobalBufferPools& global = global_buffer_pools();
+  BufferPoolStats stats;
+  stats.hits = global.hits.load(std::memory_order_relaxed) + buffer_cache.hits;
+  stats.misses =
+      global.misses.load(std::memory_order_relaxed) + buffer_cache.misses;
+  return stats;
+}
+
 absl::Cord Buffer::ToCord(absl::string_view substr) {
   RIEGELI_ASSERT(std::greater_equal<>()(substr.data(), data()))
       << "Failed precondition of Buffer::ToCord(): "
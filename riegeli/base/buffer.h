@@ -16,6 +16,7 @@
 #define RIEGELI_BASE_BUFFER_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <utility>
 
@@ -26,7 +27,28 @@
 
 namespace riegeli {
 
+// Statistics of the pool of freed buffers which `Buffer` draws from.
+struct BufferPoolStats {
+  // Returns `hits / (hits + misses)`, or 0 if there were no allocations.
+  double hit_rate() const {
+    return hits + misses == 0 ? 0.0
+                              : static_cast<double>(hits) /
+                                    static_cast<double>(hits + misses);
+  }
+
+  // Number of allocations which reused a freed buffer.
+  uint64_t hits = 0;
+  // Number of allocations of a pooled size which needed a new buffer.
+  uint64_t misses = 0;
+};
+
 // Dynamically allocated byte buffer.
+//
+// Buffers with capacities being powers of 2 between `kMinBufferSize` and
+// `kMaxBufferSize` are recycled after being freed: each thread keeps a few
+// freed buffers of each size, backed by a global `RecyclingPool`. A request
+// for `min_capacity` is served from the pool if a pooled capacity exceeds
+// `min_capacity` by at most 1/8.
 class Buffer {
  public:
   Buffer() noexcept {}
@@ -65,6 +87,48 @@ class Buffer {
   // `*this` is left unchanged or deallocated.
   absl::Cord ToCord(absl::string_view substr);
 
+  // Returns statistics of the pool of freed buffers, accumulated over all
+  // threads since the program started.
+  //
+  // Statistics of a running thread are published in batches, so they can lag
+  // behind by a few hundred allocations per thread.
+  static BufferPoolStats PoolStats();
+
+ private:
+  void AllocateInternal(size_t min_capacity);
+  void DeleteInternal();
+  static void Deallocate(char* data, size_t capacity);
+
+  char* data_ = nullptr;
+  size_t capacity_ = 0;
+  // Invariant: if `data_ == nullptr` then `capacity_ == 0`
+};
+
+// Dynamically allocated byte buffer whose data and capacity are aligned to
+// `alignment`, e.g. for I/O with `O_DIRECT`.
+template <size_t alignment>
+class AlignedBuffer {
+ public:
+  AlignedBuffer() noexcept {}
+
+  // Ensures at least `min_capacity` of space.
+  explicit AlignedBuffer(size_t min_capacity);
+
+  // The source `AlignedBuffer` is left deallocated.
+  AlignedBuffer(AlignedBuffer&& that) noexcept;
+  AlignedBuffer& operator=(AlignedBuffer&& that) noexcept;
+
+  ~AlignedBuffer() { DeleteInternal(); }
+
+  // Ensures at least `min_capacity` of space. Existing contents are lost.
+  void Reset(size_t min_capacity);
+
+  // Returns the data pointer.
+  char* data() const { return data_; }
+
+  // Returns the usable data size, a multiple of `alignment`.
+  size_t capacity() const { return capacity_; }
+
  private:
   void AllocateInternal(size_t min_capacity);
   void DeleteInternal();
@@ -99,18 +163,8 @@ inline void Buffer::Reset(size_t min_capacity) {
   AllocateInternal(min_capacity);
 }
 
-inline void Buffer::AllocateInternal(size_t min_capacity) {
-  const size_t capacity = EstimatedAllocatedSize(min_capacity);
-  data_ = static_cast<char*>(operator new(capacity));
-  capacity_ = capacity;
-}
-
 inline void Buffer::DeleteInternal() {
-#if __cpp_sized_deallocation || __GXX_DELETE_WITH_SIZE__
-  if (data_ != nullptr) operator delete(data_, capacity_);
-#else
-  if (data_ != nullptr) operator delete(data_);
-#endif
+  if (data_ != nullptr) Deallocate(data_, capacity_);
 }
 
 inline char* Buffer::Release() {
@@ -120,6 +174,50 @@ inline char* Buffer::Release() {
 
 inline void Buffer::DeleteReleased(void* ptr) { operator delete(ptr); }
 
+template <size_t alignment>
+inline AlignedBuffer<alignment>::AlignedBuffer(size_t min_capacity) {
+  AllocateInternal(min_capacity);
+}
+
+template <size_t alignment>
+inline AlignedBuffer<alignment>::AlignedBuffer(AlignedBuffer&& that) noexcept
+    : data_(std::exchange(that.data_, nullptr)),
+      capacity_(std::exchange(that.capacity_, 0)) {}
+
+template <size_t alignment>
+inline AlignedBuffer<alignment>& AlignedBuffer<alignment>::operator=(
+    AlignedBuffer&& that) noexcept {
+  // Exchange `that.data_` early to support self-assignment.
+  char* const data = std::exchange(that.data_, nullptr);
+  DeleteInternal();
+  data_ = data;
+  capacity_ = std::exchange(that.capacity_, 0);
+  return *this;
+}
+
+template <size_t alignment>
+inline void AlignedBuffer<alignment>::Reset(size_t min_capacity) {
+  if (data_ != nullptr) {
+    if (capacity_ >= min_capacity) return;
+    DeleteInternal();
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+  AllocateInternal(min_capacity);
+}
+
+template <size_t alignment>
+inline void AlignedBuffer<alignment>::AllocateInternal(size_t min_capacity) {
+  const size_t capacity = RoundUp<alignment>(UnsignedMax(min_capacity, 1u));
+  data_ = NewAligned<char, alignment>(capacity);
+  capacity_ = capacity;
+}
+
+template <size_t alignment>
+inline void AlignedBuffer<alignment>::DeleteInternal() {
+  if (data_ != nullptr) DeleteAligned<char, alignment>(data_, capacity_);
+}
+
 }  // namespace riegeli
 
 #endif  // RIEGELI_BASE_BUFFER_H_
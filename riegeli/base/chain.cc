@@ -85,6 +85,14 @@ void ZeroRef::RegisterSubobjects(MemoryEstimator& memory_estimator) const {}
 
 void ZeroRef::DumpStructure(std::ostream& out) const { out << "[zero] { }"; }
 
+// Returns `true` if `src` consists of a single fragment.
+bool CordIsFlat(const absl::Cord& src) {
+  for (const absl::string_view fragment : src.Chunks()) {
+    return fragment.size() == src.size();
+  }
+  return true;
+}
+
 // Like `dest.Append(src)`, but avoids splitting `src` into 4083-byte fragments.
 void AppendToCord(absl::string_view src, absl::Cord& dest) {
   if (src.size() <= 4096 - 13 /* `kMaxFlatSize` from cord.cc */) {
@@ -202,14 +210,16 @@ class Chain::FlatCordRef {
   void DumpStructure(std::ostream& out) const;
 
   // Appends the `absl::Cord` to `dest`.
-  void AppendTo(absl::Cord& dest) const;
+  void AppendTo(absl::Cord& dest) const&;
+  void AppendTo(absl::Cord& dest) &&;
 
   // Appends `substr` to `dest`. `substr` must be contained in
   // `absl::string_view(*this)`.
   void AppendSubstrTo(absl::string_view substr, absl::Cord& dest) const;
 
   // Prepends the `absl::Cord` to `dest`.
-  void PrependTo(absl::Cord& dest) const;
+  void PrependTo(absl::Cord& dest) const&;
+  void PrependTo(absl::Cord& dest) &&;
 
  private:
   absl::Cord src_;
@@ -251,7 +261,7 @@ inline void Chain::FlatCordRef::DumpStructure(std::ostream& out) const {
   out << "[cord] { }";
 }
 
-inline void Chain::FlatCordRef::AppendTo(absl::Cord& dest) const {
+inline void Chain::FlatCordRef::AppendTo(absl::Cord& dest) const& {
   RIEGELI_ASSERT_LE(src_.size(),
                     std::numeric_limits<size_t>::max() - dest.size())
       << "Failed precondition of Chain::FlatCordRef::AppendTo(): "
@@ -259,6 +269,14 @@ inline void Chain::FlatCordRef::AppendTo(absl::Cord& dest) const {
   dest.Append(src_);
 }
 
+inline void Chain::FlatCordRef::AppendTo(absl::Cord& dest) && {
+  RIEGELI_ASSERT_LE(src_.size(),
+                    std::numeric_limits<size_t>::max() - dest.size())
+      << "Failed precondition of Chain::FlatCordRef::AppendTo(): "
+         "Cord size overflow";
+  dest.Append(std::move(src_));
+}
+
 inline void Chain::FlatCordRef::AppendSubstrTo(absl::string_view substr,
                                                absl::Cord& dest) const {
   RIEGELI_ASSERT_LE(substr.size(),
@@ -281,7 +299,7 @@ inline void Chain::FlatCordRef::AppendSubstrTo(absl::string_view substr,
       src_.Subcord(PtrDistance(fragment.data(), substr.data()), substr.size()));
 }
 
-inline void Chain::FlatCordRef::PrependTo(absl::Cord& dest) const {
+inline void Chain::FlatCordRef::PrependTo(absl::Cord& dest) const& {
   RIEGELI_ASSERT_LE(src_.size(),
                     std::numeric_limits<size_t>::max() - dest.size())
       << "Failed precondition of Chain::FlatCordRef::PrependTo(): "
@@ -289,12 +307,145 @@ inline void Chain::FlatCordRef::PrependTo(absl::Cord& dest) const {
   dest.Prepend(src_);
 }
 
+inline void Chain::FlatCordRef::PrependTo(absl::Cord& dest) && {
+  RIEGELI_ASSERT_LE(src_.size(),
+                    std::numeric_limits<size_t>::max() - dest.size())
+      << "Failed precondition of Chain::FlatCordRef::PrependTo(): "
+         "Cord size overflow";
+  dest.Prepend(std::move(src_));
+}
+
+namespace {
+
+// Freed internal blocks kept per thread for reuse by `NewInternal()`, to avoid
+// allocator calls when chains are repeatedly built and destroyed, e.g. when
+// chunks are encoded and decoded.
+//
+// Blocks with capacities between `kMinBufferSize` and `2 * kMaxBufferSize` are
+// grouped in classes by their capacity rounded down to a power of 2. A block is
+// reused only when its capacity exceeds the requested capacity by at most 1/8,
+// which is comparable to rounding by size classes of the memory allocator.
+//
+// The cache is trivially destructible, so that it remains usable by other
+// thread-local destructors. `BlockCacheCleaner` frees cached blocks at thread
+// exit and disables the cache afterwards.
+constexpr size_t kNumBlockClasses = 9;
+constexpr size_t kMaxBlocksPerClass = 16;
+constexpr size_t kMaxCachedBytes = size_t{1} << 20;
+
+static_assert(kMinBufferSize << (kNumBlockClasses - 1) == kMaxBufferSize,
+              "Block classes should end at kMaxBufferSize");
+
+struct BlockCache {
+  struct Class {
+    size_t num_blocks;
+    // Memory of destroyed `Chain::RawBlock` objects.
+    void* blocks[kMaxBlocksPerClass];
+    size_t capacities[kMaxBlocksPerClass];
+  };
+
+  bool disabled;
+  size_t cached_bytes;
+  Class classes[kNumBlockClasses];
+};
+
+thread_local BlockCache block_cache;
+
+// Returns the index into `BlockCache::classes` for `capacity`, or
+// `kNumBlockClasses` if blocks of `capacity` are not cached.
+inline size_t BlockClass(size_t capacity) {
+  if (capacity < kMinBufferSize) return kNumBlockClasses;
+  size_t block_class = 0;
+  while (capacity >= 2 * kMinBufferSize) {
+    capacity /= 2;
+    ++block_class;
+    if (block_class == kNumBlockClasses) break;
+  }
+  return block_class;
+}
+
+// `Block` is `Chain::RawBlock`, which is private and can be named only from
+// its members.
+template <typename Block>
+void FreeCachedBlocks() {
+  block_cache.disabled = true;
+  for (BlockCache::Class& cached : block_cache.classes) {
+    for (size_t i = 0; i < cached.num_blocks; ++i) {
+      // `DeleteAligned()` destroys the object, so construct it back first.
+      const size_t raw_capacity =
+          Block::kInternalAllocatedOffset() + cached.capacities[i];
+      DeleteAligned<Block>(new (cached.blocks[i]) Block(&raw_capacity),
+                           raw_capacity);
+    }
+    cached.num_blocks = 0;
+  }
+  block_cache.cached_bytes = 0;
+}
+
+struct BlockCacheCleaner {
+  ~BlockCacheCleaner() {
+    if (free_cached_blocks != nullptr) free_cached_blocks();
+  }
+
+  void (*free_cached_blocks)() = nullptr;
+};
+
+thread_local BlockCacheCleaner block_cache_cleaner;
+
+}  // namespace
+
 inline Chain::RawBlock* Chain::RawBlock::NewInternal(size_t min_capacity) {
   RIEGELI_ASSERT_GT(min_capacity, 0u)
       << "Failed precondition of Chain::RawBlock::NewInternal(): zero capacity";
+  const size_t first_class = BlockClass(min_capacity);
+  if (first_class < kNumBlockClasses) {
+    const size_t max_capacity = min_capacity + min_capacity / 8;
+    for (size_t block_class = first_class;
+         block_class < UnsignedMin(first_class + 2, kNumBlockClasses);
+         ++block_class) {
+      BlockCache::Class& cached = block_cache.classes[block_class];
+      for (size_t i = cached.num_blocks; i > 0; --i) {
+        const size_t capacity = cached.capacities[i - 1];
+        if (capacity >= min_capacity && capacity <= max_capacity) {
+          void* const block = cached.blocks[i - 1];
+          --cached.num_blocks;
+          cached.blocks[i - 1] = cached.blocks[cached.num_blocks];
+          cached.capacities[i - 1] = cached.capacities[cached.num_blocks];
+          block_cache.cached_bytes -= capacity;
+          const size_t raw_capacity = kInternalAllocatedOffset() + capacity;
+          return new (block) RawBlock(&raw_capacity);
+        }
+      }
+    }
+  }
   size_t raw_capacity;
-  return SizeReturningNewAligned<RawBlock>(
+  RawBlock* const block = SizeReturningNewAligned<RawBlock>(
       kInternalAllocatedOffset() + min_capacity, &raw_capacity, &raw_capacity);
+  MaybeAdviseHugePages(block, raw_capacity);
+  return block;
+}
+
+void Chain::RawBlock::DeleteInternal(RawBlock* block) {
+  RIEGELI_ASSERT(block->is_internal())
+      << "Failed precondition of Chain::RawBlock::DeleteInternal(): "
+         "block not internal";
+  const size_t capacity = block->capacity();
+  const size_t block_class = BlockClass(capacity);
+  if (block_class < kNumBlockClasses && !block_cache.disabled &&
+      block_cache.cached_bytes + capacity <= kMaxCachedBytes) {
+    BlockCache::Class& cached = block_cache.classes[block_class];
+    if (cached.num_blocks < kMaxBlocksPerClass) {
+      // Ensure that cached blocks are freed at thread exit.
+      block_cache_cleaner.free_cached_blocks = FreeCachedBlocks<RawBlock>;
+      block->~RawBlock();
+      cached.blocks[cached.num_blocks] = block;
+      cached.capacities[cached.num_blocks] = capacity;
+      ++cached.num_blocks;
+      block_cache.cached_bytes += capacity;
+      return;
+    }
+  }
+  DeleteAligned<RawBlock>(block, kInternalAllocatedOffset() + capacity);
 }
 
 inline Chain::RawBlock::RawBlock(const size_t* raw_capacity)
@@ -544,6 +695,19 @@ inline void Chain::RawBlock::AppendTo(absl::Cord& dest) {
     Unref<ownership>();
     return;
   }
+  if (ownership == Ownership::kSteal) {
+    if (FlatCordRef* const cord_ref =
+            checked_external_object_with_unique_owner<FlatCordRef>()) {
+      RIEGELI_ASSERT_EQ(size(), absl::string_view(*cord_ref).size())
+          << "Failed invariant of Chain::RawBlock: "
+             "block size differs from Cord size";
+      // The block is going away, so its `absl::Cord` can be moved instead of
+      // being referenced again.
+      std::move(*cord_ref).AppendTo(dest);
+      Unref<ownership>();
+      return;
+    }
+  }
   if (const FlatCordRef* const cord_ref =
           checked_external_object<FlatCordRef>()) {
     RIEGELI_ASSERT_EQ(size(), absl::string_view(*cord_ref).size())
@@ -631,6 +795,19 @@ inline void Chain::RawBlock::PrependTo(absl::Cord& dest) {
     Unref<ownership>();
     return;
   }
+  if (ownership == Ownership::kSteal) {
+    if (FlatCordRef* const cord_ref =
+            checked_external_object_with_unique_owner<FlatCordRef>()) {
+      RIEGELI_ASSERT_EQ(size(), absl::string_view(*cord_ref).size())
+          << "Failed invariant of Chain::RawBlock: "
+             "block size differs from Cord size";
+      // The block is going away, so its `absl::Cord` can be moved instead of
+      // being referenced again.
+      std::move(*cord_ref).PrependTo(dest);
+      Unref<ownership>();
+      return;
+    }
+  }
   if (const FlatCordRef* const cord_ref =
           checked_external_object<FlatCordRef>()) {
     RIEGELI_ASSERT_EQ(size(), absl::string_view(*cord_ref).size())
@@ -1022,6 +1199,38 @@ Chain::CharPosition Chain::FindPosition(size_t pos) const {
   }
 }
 
+void Chain::AppendSubstrTo(size_t pos, size_t length, Chain& dest,
+                           const Options& options) const {
+  RIEGELI_ASSERT_LE(pos, size())
+      << "Failed precondition of Chain::AppendSubstrTo(): "
+         "position out of range";
+  RIEGELI_ASSERT_LE(length, size() - pos)
+      << "Failed precondition of Chain::AppendSubstrTo(): "
+         "length out of range";
+  if (length == 0) return;
+  const CharPosition char_pos = FindPosition(pos);
+  BlockIterator block_iter = char_pos.block_iter;
+  absl::string_view block = *block_iter;
+  block.remove_prefix(char_pos.char_index);
+  while (length > block.size()) {
+    block_iter.AppendSubstrTo(block, dest, options);
+    length -= block.size();
+    ++block_iter;
+    block = *block_iter;
+  }
+  block_iter.AppendSubstrTo(block.substr(0, length), dest, options);
+}
+
+Chain Chain::Substr(size_t pos, size_t length, const Options& options) const {
+  RIEGELI_ASSERT_LE(pos, size())
+      << "Failed precondition of Chain::Substr(): position out of range";
+  RIEGELI_ASSERT_LE(length, size() - pos)
+      << "Failed precondition of Chain::Substr(): length out of range";
+  Chain dest;
+  AppendSubstrTo(pos, length, dest, options);
+  return dest;
+}
+
 size_t Chain::EstimateMemory() const {
   MemoryEstimator memory_estimator;
   memory_estimator.RegisterMemory(sizeof(Chain));
@@ -1734,6 +1943,14 @@ void Chain::AppendCord(CordRef&& src, const Options& options) {
   RIEGELI_CHECK_LE(src.size(), std::numeric_limits<size_t>::max() - size_)
       << "Failed precondition of Chain::Append(Cord): "
          "Chain size overflow";
+  if (src.size() > kMaxBytesToCopy && CordIsFlat(src)) {
+    // Share `src` as a whole, instead of referring to its only fragment through
+    // a substring of `src`.
+    Append(ChainBlock::FromExternal<FlatCordRef>(
+               std::forward_as_tuple(std::forward<CordRef>(src))),
+           options);
+    return;
+  }
   // Avoid creating wasteful blocks and then rewriting them: append copied
   // fragments when their accumulated size is known, tweaking `size_hint` for
   // block sizing.
@@ -298,6 +298,23 @@ class Chain {
   // Precondition: `pos <= size()`
   CharPosition FindPosition(size_t pos) const;
 
+  // Appends `length` characters starting at position `pos` to `dest`, sharing
+  // blocks instead of copying them where this is efficient.
+  //
+  // The blocks are located with `FindPosition()`, without scanning the blocks
+  // before `pos`.
+  //
+  // Precondition: `pos <= size() && length <= size() - pos`
+  void AppendSubstrTo(size_t pos, size_t length, Chain& dest,
+                      const Options& options = kDefaultOptions) const;
+
+  // Returns `length` characters starting at position `pos`, sharing blocks
+  // instead of copying them where this is efficient.
+  //
+  // Precondition: `pos <= size() && length <= size() - pos`
+  Chain Substr(size_t pos, size_t length,
+               const Options& options = kDefaultOptions) const;
+
   // Estimates the amount of memory used by this `Chain`.
   size_t EstimateMemory() const;
   // Registers this `Chain` with `MemoryEstimator`.
@@ -939,8 +956,15 @@ class Chain::RawBlock {
   static constexpr size_t kMaxCapacity = ChainBlock::kMaxSize;
 
   // Creates an internal block.
+  //
+  // A block recently freed by the same thread is reused if it has a suitable
+  // capacity.
   static RawBlock* NewInternal(size_t min_capacity);
 
+  // Destroys an internal block created by `NewInternal()`, keeping it for reuse
+  // by the same thread if it has one of common capacities.
+  static void DeleteInternal(RawBlock* block);
+
   // Constructs an internal block. This constructor is public for
   // `SizeReturningNewAligned()`.
   explicit RawBlock(const size_t* raw_capacity);
@@ -1333,7 +1357,7 @@ void Chain::RawBlock::Unref() {
       (has_unique_owner() ||
        ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)) {
     if (is_internal()) {
-      DeleteAligned<RawBlock>(this, kInternalAllocatedOffset() + capacity());
+      DeleteInternal(this);
     } else {
       external_.methods->delete_block(this);
     }
@@ -0,0 +1,280 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Make `sched_getcpu()` and `pthread_setaffinity_np()` available.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "riegeli/base/executor.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <stddef.h>
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "riegeli/base/base.h"
+
+namespace riegeli {
+
+namespace {
+
+// Parses a list of CPUs like "0-3,8,10-11" from sysfs.
+std::vector<int> ParseCpuList(absl::string_view cpu_list) {
+  std::vector<int> cpus;
+  for (const absl::string_view range :
+       absl::StrSplit(cpu_list, ',', absl::SkipWhitespace())) {
+    const std::pair<absl::string_view, absl::string_view> bounds =
+        absl::StrSplit(range, absl::MaxSplits('-', 1));
+    int first, last;
+    if (!absl::SimpleAtoi(bounds.first, &first)) continue;
+    if (bounds.second.empty()) {
+      last = first;
+    } else if (!absl::SimpleAtoi(bounds.second, &last)) {
+      continue;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+// Returns CPUs of each NUMA node, or an empty vector if this cannot be
+// determined.
+std::vector<std::vector<int>> NumaNodes() {
+  std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+  for (int node = 0;; ++node) {
+    std::ifstream file(absl::StrCat("/sys/devices/system/node/node", node,
+                                    "/cpulist"));
+    if (!file) break;
+    std::string cpu_list;
+    std::getline(file, cpu_list);
+    std::vector<int> cpus = ParseCpuList(cpu_list);
+    // Nodes with memory but without CPUs cannot run threads.
+    if (!cpus.empty()) nodes.push_back(std::move(cpus));
+  }
+#endif
+  return nodes;
+}
+
+// The `Executor` whose worker thread is the current thread, or `nullptr`.
+thread_local const Executor* current_executor = nullptr;
+
+// Returns the CPU which the current thread is running on, or -1 if unknown.
+int CurrentCpu() {
+#ifdef __linux__
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+}  // namespace
+
+Executor::Executor(int max_threads) : max_threads_(max_threads) {
+  RIEGELI_ASSERT_GT(max_threads, 0)
+      << "Failed precondition of Executor::Executor(): "
+         "non-positive max_threads";
+}
+
+Executor::Executor(Options options) : max_threads_(options.max_threads()) {
+  if (!options.numa_aware()) return;
+  std::vector<std::vector<int>> nodes = NumaNodes();
+  if (nodes.size() < 2) return;
+  size_t num_cpus = 0;
+  for (const std::vector<int>& cpus : nodes) num_cpus += cpus.size();
+  for (size_t node = 0; node < nodes.size(); ++node) {
+    for (const int cpu : nodes[node]) {
+      if (IntCast<size_t>(cpu) >= node_of_cpu_.size()) {
+        node_of_cpu_.resize(IntCast<size_t>(cpu) + 1, -1);
+      }
+      node_of_cpu_[IntCast<size_t>(cpu)] = IntCast<int>(node);
+    }
+    // Split threads between nodes proportionally to their CPUs.
+    const int node_max_threads = IntCast<int>(
+        UnsignedMax(IntCast<size_t>(max_threads_) * nodes[node].size() /
+                        num_cpus,
+                    size_t{1}));
+    nodes_.push_back(std::unique_ptr<Executor>(
+        new Executor(node_max_threads, std::move(nodes[node]))));
+  }
+}
+
+Executor::Executor(int max_threads, std::vector<int> cpus)
+    : max_threads_(max_threads), cpus_(std::move(cpus)) {}
+
+Executor::~Executor() {
+  RIEGELI_ASSERT(current_executor != this)
+      << "Failed precondition of Executor::~Executor(): "
+         "destroyed by its own task";
+  // Node executors wait for their tasks when destroyed.
+  nodes_.clear();
+  absl::MutexLock lock(&mutex_);
+  exiting_ = true;
+  mutex_.Await(absl::Condition(
+      +[](size_t* num_threads) { return *num_threads == 0; }, &num_threads_));
+}
+
+int Executor::DefaultMaxThreads() {
+  const unsigned hardware_concurrency = std::thread::hardware_concurrency();
+  return hardware_concurrency == 0 ? 1 : IntCast<int>(hardware_concurrency);
+}
+
+void Executor::Schedule(const void* client, std::function<void()> task) {
+  if (!nodes_.empty()) {
+    const int cpu = CurrentCpu();
+    size_t node = 0;
+    if (cpu >= 0 && IntCast<size_t>(cpu) < node_of_cpu_.size() &&
+        node_of_cpu_[IntCast<size_t>(cpu)] >= 0) {
+      node = IntCast<size_t>(node_of_cpu_[IntCast<size_t>(cpu)]);
+    }
+    nodes_[node]->Schedule(client, std::move(task));
+    return;
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    RIEGELI_ASSERT(!exiting_)
+        << "Failed precondition of Executor::Schedule(): no new tasks may be "
+           "scheduled while the executor is exiting";
+    const auto client_iter = client_index_.find(client);
+    if (client_iter == client_index_.end()) {
+      if (free_clients_.empty()) {
+        clients_.emplace_back();
+      } else {
+        clients_.splice(clients_.end(), free_clients_, free_clients_.begin());
+      }
+      const std::list<ClientTasks>::iterator client_tasks =
+          std::prev(clients_.end());
+      client_tasks->client = client;
+      client_tasks->tasks.push_back(std::move(task));
+      client_index_.emplace(client, client_tasks);
+    } else {
+      client_iter->second->tasks.push_back(std::move(task));
+    }
+    ++num_tasks_;
+    if (num_idle_threads_ >= num_tasks_ ||
+        num_threads_ >= IntCast<size_t>(max_threads_)) {
+      return;
+    }
+    ++num_threads_;
+  }
+  std::thread([this] { WorkerThread(); }).detach();
+}
+
+void Executor::WorkerThread() {
+#ifdef __linux__
+  if (!cpus_.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const int cpu : cpus_) {
+      if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpu_set);
+    }
+    // Failure is not a problem: the thread runs on any CPU then.
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  }
+#endif
+  current_executor = this;
+  for (;;) {
+    absl::ReleasableMutexLock lock(&mutex_);
+    ++num_idle_threads_;
+    mutex_.AwaitWithTimeout(
+        absl::Condition(
+            +[](Executor* self) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+              return self->num_tasks_ > 0 || self->exiting_;
+            },
+            this),
+        absl::Seconds(1));
+    --num_idle_threads_;
+    if (num_tasks_ == 0) {
+      // Pending tasks are completed even if `exiting_`.
+      --num_threads_;
+      current_executor = nullptr;
+      return;
+    }
+    // Take a task from the client at the front, then move the client to the
+    // back, so that clients are served in turns.
+    const std::list<ClientTasks>::iterator client_tasks = clients_.begin();
+    const std::function<void()> task = std::move(client_tasks->tasks.front());
+    client_tasks->tasks.pop_front();
+    --num_tasks_;
+    if (client_tasks->tasks.empty()) {
+      client_index_.erase(client_tasks->client);
+      free_clients_.splice(free_clients_.end(), clients_, client_tasks);
+    } else {
+      clients_.splice(clients_.end(), clients_, client_tasks);
+    }
+    lock.Release();
+    task();
+  }
+}
+
+void ParallelFor(Executor* executor, size_t size,
+                 const std::function<void(size_t index)>& function) {
+  if (executor == nullptr || size <= 1) {
+    for (size_t index = 0; index < size; ++index) function(index);
+    return;
+  }
+  // Tasks scheduled too late to claim an index can run after this returns, so
+  // they own the state which they access then.
+  struct SharedState {
+    explicit SharedState(size_t size) : size(size) {}
+
+    const size_t size;
+    std::atomic<size_t> next_index{0};
+    absl::Mutex mutex;
+    size_t num_done ABSL_GUARDED_BY(mutex) = 0;
+    bool all_done ABSL_GUARDED_BY(mutex) = false;
+  };
+  const std::shared_ptr<SharedState> state =
+      std::make_shared<SharedState>(size);
+  const std::function<void()> run_claimed = [state, &function] {
+    for (;;) {
+      const size_t index =
+          state->next_index.fetch_add(1, std::memory_order_relaxed);
+      if (index >= state->size) return;
+      function(index);
+      absl::MutexLock lock(&state->mutex);
+      if (++state->num_done == state->size) state->all_done = true;
+    }
+  };
+  const size_t num_tasks =
+      UnsignedMin(size - 1, IntCast<size_t>(executor->max_threads()));
+  for (size_t i = 0; i < num_tasks; ++i) {
+    executor->Schedule(state.get(), run_claimed);
+  }
+  run_claimed();
+  absl::MutexLock lock(&state->mutex);
+  state->mutex.Await(absl::Condition(&state->all_done));
+}
+
+}  // namespace riegeli
@@ -0,0 +1,171 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BASE_EXECUTOR_H_
+#define RIEGELI_BASE_EXECUTOR_H_
+
+#include <stddef.h>
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+
+namespace riegeli {
+
+// A thread pool with a bounded number of lazily created worker threads, which
+// can be shared by many clients, e.g. `RecordWriter`s and `RecordReader`s with
+// `set_executor()` in their options. Worker threads exit after being idle for
+// one second.
+//
+// Tasks are queued per client. Idle threads take tasks from clients having
+// pending tasks in turns, so that a client scheduling many tasks at once does
+// not delay tasks of other clients until its backlog is drained.
+//
+// Tasks must not block waiting for other tasks of the same `Executor`,
+// otherwise they could deadlock when all threads are busy.
+//
+// With `Options::set_numa_aware(true)` on a machine with multiple NUMA nodes,
+// threads are split between nodes and pinned to CPUs of their node, and a task
+// runs on the node of the thread which scheduled it. Memory allocated and first
+// written by a task is then placed on that node by the kernel, so e.g. chunks
+// of a `RecordWriter` are encoded and stored close to their producer.
+class Executor {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Maximum number of threads.
+    //
+    // Default: `DefaultMaxThreads()`.
+    Options& set_max_threads(int max_threads) & {
+      RIEGELI_ASSERT_GT(max_threads, 0)
+          << "Failed precondition of Executor::Options::set_max_threads(): "
+             "non-positive max_threads";
+      max_threads_ = max_threads;
+      return *this;
+    }
+    Options&& set_max_threads(int max_threads) && {
+      return std::move(set_max_threads(max_threads));
+    }
+    int max_threads() const { return max_threads_; }
+
+    // If `true`, threads are placed on NUMA nodes as described for `Executor`.
+    // This is effective only on Linux with multiple NUMA nodes.
+    //
+    // Default: `false`.
+    Options& set_numa_aware(bool numa_aware) & {
+      numa_aware_ = numa_aware;
+      return *this;
+    }
+    Options&& set_numa_aware(bool numa_aware) && {
+      return std::move(set_numa_aware(numa_aware));
+    }
+    bool numa_aware() const { return numa_aware_; }
+
+   private:
+    int max_threads_ = DefaultMaxThreads();
+    bool numa_aware_ = false;
+  };
+
+  // Creates an `Executor` running tasks on at most `max_threads` threads.
+  //
+  // Precondition: `max_threads > 0`
+  explicit Executor(int max_threads = DefaultMaxThreads());
+
+  explicit Executor(Options options);
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  // Waits for pending tasks to complete and for threads to exit.
+  //
+  // The `Executor` must not be destroyed by its own task, e.g. by dropping the
+  // last `std::shared_ptr` to it, because the destructor would wait for the
+  // thread running that task to exit.
+  ~Executor();
+
+  // Returns the number of hardware threads, at least 1.
+  static int DefaultMaxThreads();
+
+  // Returns the maximum number of threads.
+  int max_threads() const { return max_threads_; }
+
+  // Returns the number of NUMA nodes which threads are placed on, or 1 if
+  // threads are not placed on NUMA nodes.
+  int num_numa_nodes() const {
+    return nodes_.empty() ? 1 : IntCast<int>(nodes_.size());
+  }
+
+  // Schedules `task` to run on some thread.
+  //
+  // `client` identifies the source of the task for fairness, and is not
+  // dereferenced. Tasks of the same client are started in the order they were
+  // scheduled.
+  void Schedule(const void* client, std::function<void()> task);
+
+ private:
+  struct ClientTasks {
+    const void* client;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // Creates an `Executor` for a single NUMA node, with threads pinned to
+  // `cpus`.
+  explicit Executor(int max_threads, std::vector<int> cpus);
+
+  void WorkerThread();
+
+  int max_threads_;
+  // If not empty, executors of NUMA nodes, which run all tasks.
+  std::vector<std::unique_ptr<Executor>> nodes_;
+  // If `!nodes_.empty()`, the index of the node of each CPU, or -1 if the CPU
+  // is not on any node.
+  std::vector<int> node_of_cpu_;
+  // If not empty, CPUs which worker threads are pinned to.
+  std::vector<int> cpus_;
+  absl::Mutex mutex_;
+  bool exiting_ ABSL_GUARDED_BY(mutex_) = false;
+  size_t num_threads_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t num_idle_threads_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t num_tasks_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Clients having pending tasks, in the order in which they are served.
+  std::list<ClientTasks> clients_ ABSL_GUARDED_BY(mutex_);
+  // Nodes of `clients_` which have no tasks, kept for reuse to avoid
+  // allocating them again when a client schedules a task after being idle.
+  std::list<ClientTasks> free_clients_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<const void*, std::list<ClientTasks>::iterator>
+      client_index_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Calls `function(index)` for each `index` in [0..`size`), concurrently in
+// `executor` if it is not `nullptr`, and returns when all calls completed.
+//
+// Indices are claimed in order by tasks and by the calling thread, which does
+// not wait for tasks which did not start. Hence this may be called in a task of
+// `executor` even if all its threads are busy.
+void ParallelFor(Executor* executor, size_t size,
+                 const std::function<void(size_t index)>& function);
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BASE_EXECUTOR_H_
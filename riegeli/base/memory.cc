@@ -15,8 +15,13 @@
 #include "riegeli/base/memory.h"
 
 #include <stddef.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #include <array>
+#include <atomic>
 
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
@@ -24,6 +29,39 @@
 
 namespace riegeli {
 
+namespace {
+
+// Size of a transparent huge page on common architectures.
+constexpr size_t kHugePageSize = size_t{2} << 20;
+
+std::atomic<size_t> huge_page_threshold{size_t{4} << 20};
+
+}  // namespace
+
+void SetHugePageThreshold(size_t threshold) {
+  huge_page_threshold.store(threshold, std::memory_order_relaxed);
+}
+
+size_t HugePageThreshold() {
+  return huge_page_threshold.load(std::memory_order_relaxed);
+}
+
+namespace internal {
+
+void AdviseHugePagesSlow(void* ptr, size_t size) {
+#ifdef MADV_HUGEPAGE
+  const uintptr_t begin =
+      RoundUp<kHugePageSize>(reinterpret_cast<uintptr_t>(ptr));
+  const uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size) &
+                        ~uintptr_t{kHugePageSize - 1};
+  if (begin >= end) return;
+  // Failure is not a problem: the memory remains usable with regular pages.
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+#endif
+}
+
+}  // namespace internal
+
 extern const std::array<char, kDefaultBufferSize> kArrayOfZeros = {0};
 
 absl::Cord CordOfZeros(size_t length) {
@@ -22,6 +22,7 @@
 #include <new>
 #include <utility>
 
+#include "absl/base/optimization.h"
 #include "absl/strings/cord.h"
 #include "riegeli/base/base.h"
 
@@ -225,6 +226,36 @@ inline T* SizeReturningNewAligned(size_t min_num_bytes,
   return ptr;
 }
 
+// Allocations of at least `HugePageThreshold()` bytes made for `Buffer` and for
+// blocks of `Chain` are advised to be backed by transparent huge pages with
+// `madvise(MADV_HUGEPAGE)`, which reduces TLB misses when large decoded chunks,
+// compressor windows, or file buffers are accessed.
+//
+// The advice covers the part of the allocation aligned to huge pages, so the
+// allocation itself is unchanged and deallocation needs no special handling.
+// It has effect only if transparent huge pages are enabled in the `madvise`
+// or `always` mode; on other systems it is ignored.
+//
+// `SetHugePageThreshold(std::numeric_limits<size_t>::max())` disables this.
+//
+// Default: 4M.
+void SetHugePageThreshold(size_t threshold);
+size_t HugePageThreshold();
+
+namespace internal {
+
+void AdviseHugePagesSlow(void* ptr, size_t size);
+
+}  // namespace internal
+
+// Advises huge pages for the allocation of `size` bytes at `ptr` if `size` is
+// at least `HugePageThreshold()`.
+inline void MaybeAdviseHugePages(void* ptr, size_t size) {
+  if (ABSL_PREDICT_FALSE(size >= HugePageThreshold())) {
+    internal::AdviseHugePagesSlow(ptr, size);
+  }
+}
+
 // `kDefaultBufferSize` of zero bytes.
 extern const std::array<char, kDefaultBufferSize> kArrayOfZeros;
 
@@ -0,0 +1,131 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/base/memory_budget.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+
+namespace riegeli {
+
+constexpr uint64_t MemoryBudget::Account::kReportStep;
+
+MemoryBudget::Account::Account(std::shared_ptr<MemoryBudget> budget)
+    : budget_(std::move(budget)) {
+  if (budget_ != nullptr) budget_->Register(this);
+}
+
+MemoryBudget::Account::~Account() {
+  if (budget_ != nullptr) budget_->Unregister(this);
+}
+
+void MemoryBudget::Account::UpdateFlushable(uint64_t flushable_bytes) {
+  if (budget_ == nullptr) return;
+  if (flushable_bytes >= reported_flushable_bytes_ &&
+      flushable_bytes - reported_flushable_bytes_ < kReportStep) {
+    return;
+  }
+  reported_flushable_bytes_ = flushable_bytes;
+  budget_->SetFlushable(this, flushable_bytes);
+}
+
+void MemoryBudget::Account::AddPending(uint64_t pending_bytes) {
+  if (budget_ == nullptr || pending_bytes == 0) return;
+  budget_->AddPending(this, pending_bytes);
+}
+
+void MemoryBudget::Account::RemovePending(uint64_t pending_bytes) {
+  if (budget_ == nullptr || pending_bytes == 0) return;
+  budget_->RemovePending(this, pending_bytes);
+}
+
+uint64_t MemoryBudget::used_bytes() const {
+  absl::MutexLock lock(&mutex_);
+  return used_bytes_;
+}
+
+void MemoryBudget::Register(Account* account) {
+  absl::MutexLock lock(&mutex_);
+  accounts_.insert(account);
+}
+
+void MemoryBudget::Unregister(Account* account) {
+  absl::MutexLock lock(&mutex_);
+  used_bytes_ -= account->flushable_bytes_ + account->pending_bytes_;
+  requested_bytes_ -= account->requested_bytes_;
+  accounts_.erase(account);
+}
+
+void MemoryBudget::SetFlushable(Account* account, uint64_t flushable_bytes) {
+  absl::MutexLock lock(&mutex_);
+  used_bytes_ = used_bytes_ - account->flushable_bytes_ + flushable_bytes;
+  if (flushable_bytes < account->flushable_bytes_ &&
+      account->requested_bytes_ > 0) {
+    // The account flushed, which satisfies the request.
+    requested_bytes_ -= account->requested_bytes_;
+    account->requested_bytes_ = 0;
+    account->flush_requested_.store(false, std::memory_order_relaxed);
+  }
+  account->flushable_bytes_ = flushable_bytes;
+  MaybeRequestFlushes();
+}
+
+void MemoryBudget::AddPending(Account* account, uint64_t pending_bytes) {
+  absl::MutexLock lock(&mutex_);
+  account->pending_bytes_ += pending_bytes;
+  used_bytes_ += pending_bytes;
+  MaybeRequestFlushes();
+}
+
+void MemoryBudget::RemovePending(Account* account, uint64_t pending_bytes) {
+  absl::MutexLock lock(&mutex_);
+  RIEGELI_ASSERT_LE(pending_bytes, account->pending_bytes_)
+      << "Failed precondition of MemoryBudget::Account::RemovePending(): "
+         "removing more bytes than pending";
+  account->pending_bytes_ -= pending_bytes;
+  used_bytes_ -= pending_bytes;
+}
+
+void MemoryBudget::MaybeRequestFlushes() {
+  if (used_bytes_ <= max_bytes_) return;
+  const uint64_t excess = used_bytes_ - max_bytes_;
+  if (requested_bytes_ >= excess) return;
+  std::vector<Account*> candidates;
+  for (Account* const account : accounts_) {
+    if (account->requested_bytes_ == 0 && account->flushable_bytes_ > 0) {
+      candidates.push_back(account);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Account* a, const Account* b) {
+              return a->flushable_bytes_ > b->flushable_bytes_;
+            });
+  for (Account* const account : candidates) {
+    if (requested_bytes_ >= excess) break;
+    account->requested_bytes_ = account->flushable_bytes_;
+    requested_bytes_ += account->requested_bytes_;
+    account->flush_requested_.store(true, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace riegeli
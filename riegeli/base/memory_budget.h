@@ -0,0 +1,124 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BASE_MEMORY_BUDGET_H_
+#define RIEGELI_BASE_MEMORY_BUDGET_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+
+namespace riegeli {
+
+// A limit of memory buffered by many objects together, e.g. `RecordWriter`s
+// with `set_memory_budget()` in their options.
+//
+// Each object reports its buffered bytes through an `Account`. Flushable bytes
+// can be released by the object on request, e.g. records of a chunk being
+// collected, which are released by closing the chunk early. Pending bytes are
+// released on their own, e.g. chunks being encoded and written in background.
+//
+// When the total exceeds the limit, accounts with the most flushable bytes are
+// asked to flush, until their flushable bytes cover the excess. An account
+// sees the request the next time its object checks `flush_requested()`, so
+// the limit is soft: an idle object keeps its memory until it is used again.
+class MemoryBudget {
+ public:
+  // Buffered bytes of one object.
+  //
+  // `UpdateFlushable()` and `flush_requested()` must be called by the thread
+  // using the object. `AddPending()` and `RemovePending()` are thread-safe.
+  class Account {
+   public:
+    // Creates an `Account` in `budget`. If `budget` is `nullptr`, the
+    // `Account` does nothing.
+    explicit Account(std::shared_ptr<MemoryBudget> budget);
+
+    Account(const Account&) = delete;
+    Account& operator=(const Account&) = delete;
+
+    // Releases all bytes of the `Account`.
+    ~Account();
+
+    // Sets the number of flushable bytes.
+    //
+    // Increases smaller than `kReportStep` are not reported to the
+    // `MemoryBudget`, to avoid contention when many small records are added.
+    // Decreases are always reported, and satisfy a flush request.
+    void UpdateFlushable(uint64_t flushable_bytes);
+
+    // Adds or removes pending bytes.
+    void AddPending(uint64_t pending_bytes);
+    void RemovePending(uint64_t pending_bytes);
+
+    // Returns `true` if the `MemoryBudget` asked to reduce flushable bytes.
+    bool flush_requested() const {
+      return flush_requested_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    friend class MemoryBudget;
+
+    static constexpr uint64_t kReportStep = uint64_t{64} << 10;
+
+    std::shared_ptr<MemoryBudget> budget_;
+    // Flushable bytes last reported, accessed only by the thread using the
+    // object.
+    uint64_t reported_flushable_bytes_ = 0;
+    // Guarded by `budget_->mutex_`.
+    uint64_t flushable_bytes_ = 0;
+    uint64_t pending_bytes_ = 0;
+    // Flushable bytes counted in `budget_->requested_bytes_`.
+    uint64_t requested_bytes_ = 0;
+    std::atomic<bool> flush_requested_{false};
+  };
+
+  // Creates a `MemoryBudget` with a limit of `max_bytes`.
+  explicit MemoryBudget(uint64_t max_bytes) : max_bytes_(max_bytes) {}
+
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  // Returns the limit.
+  uint64_t max_bytes() const { return max_bytes_; }
+
+  // Returns the total bytes of all accounts.
+  uint64_t used_bytes() const;
+
+ private:
+  void Register(Account* account);
+  void Unregister(Account* account);
+  void SetFlushable(Account* account, uint64_t flushable_bytes);
+  void AddPending(Account* account, uint64_t pending_bytes);
+  void RemovePending(Account* account, uint64_t pending_bytes);
+  // If `used_bytes_` exceeds `max_bytes_` by more than `requested_bytes_`,
+  // asks more accounts to flush, largest first.
+  void MaybeRequestFlushes() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  uint64_t max_bytes_;
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_set<Account*> accounts_ ABSL_GUARDED_BY(mutex_);
+  uint64_t used_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Flushable bytes of accounts asked to flush which did not flush yet.
+  uint64_t requested_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BASE_MEMORY_BUDGET_H_
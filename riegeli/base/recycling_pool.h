@@ -28,6 +28,8 @@
 #include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/memory.h"
 
@@ -41,6 +43,14 @@ namespace riegeli {
 // Deleter specifies how an object should be eventually deleted, like in
 // `std::unique_ptr<T, Deleter>`.
 //
+// Each thread keeps one recently returned object per template instantiation
+// outside of the shared pool, so that a `Get()` following a `Put()` in the
+// same thread avoids locking. That object is not counted by `max_size` and is
+// deleted at thread exit.
+//
+// Objects in the shared pool are evicted when they exceed `max_size` (older
+// first) or when they have been idle for longer than `max_age`.
+//
 // `RecyclingPool` is thread-safe.
 template <typename T, typename Deleter = std::default_delete<T>>
 class RecyclingPool {
@@ -81,9 +91,11 @@ class RecyclingPool {
   // The default value of the constructor argument.
   static constexpr size_t kDefaultMaxSize = 16;
 
-  // Creates a pool with the given maximum number of objects to keep.
-  explicit RecyclingPool(size_t max_size = kDefaultMaxSize)
-      : max_size_(max_size) {}
+  // Creates a pool with the given maximum number of objects to keep, and the
+  // maximum time for which an idle object is kept.
+  explicit RecyclingPool(size_t max_size = kDefaultMaxSize,
+                         absl::Duration max_age = absl::InfiniteDuration())
+      : max_size_(max_size), max_age_(max_age) {}
 
   RecyclingPool(const RecyclingPool&) = delete;
   RecyclingPool& operator=(const RecyclingPool&) = delete;
@@ -91,9 +103,11 @@ class RecyclingPool {
   // Returns a default global pool specific to template parameters of
   // `RecyclingPool`.
   //
-  // If called multiple times with different `max_size` arguments, the last
-  // `max_size` is in effect.
-  static RecyclingPool& global(size_t max_size = kDefaultMaxSize);
+  // If called multiple times with different `max_size` or `max_age` arguments,
+  // the last ones are in effect.
+  static RecyclingPool& global(
+      size_t max_size = kDefaultMaxSize,
+      absl::Duration max_age = absl::InfiniteDuration());
 
   // Creates an object, or returns an existing object from the pool if possible.
   //
@@ -106,14 +120,43 @@ class RecyclingPool {
   Handle Get(Factory factory, Refurbisher refurbisher = DefaultRefurbisher());
 
  private:
+  struct Entry {
+    Entry(std::unique_ptr<T, Deleter> object, absl::Time deadline)
+        : object(std::move(object)), deadline(deadline) {}
+
+    std::unique_ptr<T, Deleter> object;
+    // The time after which the object is evicted.
+    absl::Time deadline;
+  };
+
+  struct ThreadCache {
+    explicit ThreadCache(bool* destroyed) : destroyed(destroyed) {}
+
+    ThreadCache(const ThreadCache&) = delete;
+    ThreadCache& operator=(const ThreadCache&) = delete;
+
+    ~ThreadCache() { *destroyed = true; }
+
+    bool* destroyed;
+    // The pool which `object` was put into.
+    RecyclingPool* pool = nullptr;
+    std::unique_ptr<T, Deleter> object;
+  };
+
+  // Returns the cache of the current thread, or `nullptr` if it was already
+  // destroyed during thread exit.
+  static ThreadCache* thread_cache();
+
   void set_max_size(size_t max_size);
+  void set_max_age(absl::Duration max_age);
 
   void Put(std::unique_ptr<T, Deleter> object);
 
   std::atomic<size_t> max_size_;
   absl::Mutex mutex_;
+  absl::Duration max_age_ ABSL_GUARDED_BY(mutex_);
   // All objects, ordered by freshness (older to newer).
-  std::deque<std::unique_ptr<T, Deleter>> by_freshness_ ABSL_GUARDED_BY(mutex_);
+  std::deque<Entry> by_freshness_ ABSL_GUARDED_BY(mutex_);
 };
 
 // `KeyedRecyclingPool<T, Key, Deleter>` keeps a pool of idle objects of type
@@ -129,6 +172,10 @@ class RecyclingPool {
 // equality comparable, hashable (by `absl::Hash`), default constructible, and
 // copyable.
 //
+// Like in `RecyclingPool`, each thread keeps one recently returned object per
+// template instantiation outside of the shared pool, and objects in the shared
+// pool are evicted by `max_size` and `max_age`.
+//
 // `KeyedRecyclingPool` is thread-safe.
 template <typename T, typename Key, typename Deleter = std::default_delete<T>>
 class KeyedRecyclingPool {
@@ -170,9 +217,12 @@ class KeyedRecyclingPool {
   // The default value of the constructor argument.
   static constexpr size_t kDefaultMaxSize = 16;
 
-  // Creates a pool with the given maximum number of objects to keep.
-  explicit KeyedRecyclingPool(size_t max_size = kDefaultMaxSize)
-      : max_size_(max_size), cache_(by_key_.end()) {}
+  // Creates a pool with the given maximum number of objects to keep, and the
+  // maximum time for which an idle object is kept.
+  explicit KeyedRecyclingPool(
+      size_t max_size = kDefaultMaxSize,
+      absl::Duration max_age = absl::InfiniteDuration())
+      : max_size_(max_size), max_age_(max_age), cache_(by_key_.end()) {}
 
   KeyedRecyclingPool(const KeyedRecyclingPool&) = delete;
   KeyedRecyclingPool& operator=(const KeyedRecyclingPool&) = delete;
@@ -180,9 +230,11 @@ class KeyedRecyclingPool {
   // Returns a default global pool specific to template parameters of
   // `KeyedRecyclingPool`.
   //
-  // If called multiple times with different `max_size` arguments, the last
-  // `max_size` is in effect.
-  static KeyedRecyclingPool& global(size_t max_size = kDefaultMaxSize);
+  // If called multiple times with different `max_size` or `max_age` arguments,
+  // the last ones are in effect.
+  static KeyedRecyclingPool& global(
+      size_t max_size = kDefaultMaxSize,
+      absl::Duration max_age = absl::InfiniteDuration());
 
   // Creates an object, or returns an existing object from the pool if possible.
   //
@@ -196,9 +248,18 @@ class KeyedRecyclingPool {
              Refurbisher refurbisher = DefaultRefurbisher());
 
  private:
+  struct FreshnessEntry {
+    FreshnessEntry(const Key& key, absl::Time deadline)
+        : key(key), deadline(deadline) {}
+
+    Key key;
+    // The time after which the object is evicted.
+    absl::Time deadline;
+  };
+
   // Adding or removing elements in `ByFreshness` must not invalidate other
   // iterators.
-  using ByFreshness = std::list<Key>;
+  using ByFreshness = std::list<FreshnessEntry>;
 
   struct Entry {
     Entry(std::unique_ptr<T, Deleter> object,
@@ -214,14 +275,35 @@ class KeyedRecyclingPool {
 
   using ByKey = absl::flat_hash_map<Key, Entries>;
 
+  struct ThreadCache {
+    explicit ThreadCache(bool* destroyed) : destroyed(destroyed) {}
+
+    ThreadCache(const ThreadCache&) = delete;
+    ThreadCache& operator=(const ThreadCache&) = delete;
+
+    ~ThreadCache() { *destroyed = true; }
+
+    bool* destroyed;
+    // The pool which `object` was put into, and its key.
+    KeyedRecyclingPool* pool = nullptr;
+    Key key;
+    std::unique_ptr<T, Deleter> object;
+  };
+
+  // Returns the cache of the current thread, or `nullptr` if it was already
+  // destroyed during thread exit.
+  static ThreadCache* thread_cache();
+
   void set_max_size(size_t max_size);
+  void set_max_age(absl::Duration max_age);
 
   void Put(const Key& key, std::unique_ptr<T, Deleter> object);
 
   std::atomic<size_t> max_size_;
   absl::Mutex mutex_;
-  // The key of each object, ordered by the freshness of the object (older to
-  // newer).
+  absl::Duration max_age_ ABSL_GUARDED_BY(mutex_);
+  // The key and deadline of each object, ordered by the freshness of the
+  // object (older to newer).
   ByFreshness by_freshness_ ABSL_GUARDED_BY(mutex_);
   // Objects grouped by their keys. Within each map value the list of objects is
   // non-empty and is ordered by their freshness (older to newer). Each object
@@ -244,27 +326,49 @@ inline void RecyclingPool<T, Deleter>::Recycler::operator()(T* ptr) const {
 }
 
 template <typename T, typename Deleter>
-RecyclingPool<T, Deleter>& RecyclingPool<T, Deleter>::global(size_t max_size) {
-  static NoDestructor<RecyclingPool> kStaticRecyclingPool(max_size);
+RecyclingPool<T, Deleter>& RecyclingPool<T, Deleter>::global(
+    size_t max_size, absl::Duration max_age) {
+  static NoDestructor<RecyclingPool> kStaticRecyclingPool(max_size, max_age);
   kStaticRecyclingPool->set_max_size(max_size);
+  kStaticRecyclingPool->set_max_age(max_age);
   return *kStaticRecyclingPool;
 }
 
+template <typename T, typename Deleter>
+inline typename RecyclingPool<T, Deleter>::ThreadCache*
+RecyclingPool<T, Deleter>::thread_cache() {
+  // `destroyed` is trivially destructible, so it remains valid while other
+  // thread-local objects are destroyed.
+  static thread_local bool destroyed = false;
+  if (ABSL_PREDICT_FALSE(destroyed)) return nullptr;
+  static thread_local ThreadCache cache(&destroyed);
+  return &cache;
+}
+
 template <typename T, typename Deleter>
 inline void RecyclingPool<T, Deleter>::set_max_size(size_t max_size) {
   max_size_.store(max_size, std::memory_order_relaxed);
 }
 
+template <typename T, typename Deleter>
+inline void RecyclingPool<T, Deleter>::set_max_age(absl::Duration max_age) {
+  absl::MutexLock lock(&mutex_);
+  max_age_ = max_age;
+}
+
 template <typename T, typename Deleter>
 template <typename Factory, typename Refurbisher>
 typename RecyclingPool<T, Deleter>::Handle RecyclingPool<T, Deleter>::Get(
     Factory factory, Refurbisher refurbisher) {
   std::unique_ptr<T, Deleter> returned;
-  {
+  ThreadCache* const cache = thread_cache();
+  if (cache != nullptr && cache->pool == this && cache->object != nullptr) {
+    returned = std::move(cache->object);
+  } else {
     absl::MutexLock lock(&mutex_);
     if (ABSL_PREDICT_TRUE(!by_freshness_.empty())) {
       // Return the newest entry.
-      returned = std::move(by_freshness_.back());
+      returned = std::move(by_freshness_.back().object);
       by_freshness_.pop_back();
     }
   }
@@ -279,15 +383,26 @@ typename RecyclingPool<T, Deleter>::Handle RecyclingPool<T, Deleter>::Get(
 
 template <typename T, typename Deleter>
 void RecyclingPool<T, Deleter>::Put(std::unique_ptr<T, Deleter> object) {
+  ThreadCache* const cache = thread_cache();
+  if (cache != nullptr && cache->object == nullptr &&
+      ABSL_PREDICT_TRUE(max_size_.load(std::memory_order_relaxed) > 0)) {
+    cache->pool = this;
+    cache->object = std::move(object);
+    return;
+  }
   std::vector<std::unique_ptr<T, Deleter>> evicted;
   absl::MutexLock lock(&mutex_);
+  const bool has_max_age = max_age_ != absl::InfiniteDuration();
+  const absl::Time now = has_max_age ? absl::Now() : absl::InfiniteFuture();
   // Add a newest entry.
-  by_freshness_.push_back(std::move(object));
-  while (ABSL_PREDICT_FALSE(by_freshness_.size() >
-                            max_size_.load(std::memory_order_relaxed))) {
+  by_freshness_.emplace_back(std::move(object), now + max_age_);
+  while (ABSL_PREDICT_FALSE(
+      by_freshness_.size() > max_size_.load(std::memory_order_relaxed) ||
+      (has_max_age && by_freshness_.front().deadline < now))) {
     // Evict the oldest entry.
-    evicted.push_back(std::move(by_freshness_.front()));
+    evicted.push_back(std::move(by_freshness_.front().object));
     by_freshness_.pop_front();
+    if (by_freshness_.empty()) break;
   }
   // Destroy `evicted` after releasing `mutex_`.
 }
@@ -303,24 +418,49 @@ inline void KeyedRecyclingPool<T, Key, Deleter>::Recycler::operator()(
 
 template <typename T, typename Key, typename Deleter>
 KeyedRecyclingPool<T, Key, Deleter>&
-KeyedRecyclingPool<T, Key, Deleter>::global(size_t max_size) {
-  static NoDestructor<KeyedRecyclingPool> kStaticKeyedRecyclingPool(max_size);
+KeyedRecyclingPool<T, Key, Deleter>::global(size_t max_size,
+                                            absl::Duration max_age) {
+  static NoDestructor<KeyedRecyclingPool> kStaticKeyedRecyclingPool(max_size,
+                                                                    max_age);
   kStaticKeyedRecyclingPool->set_max_size(max_size);
+  kStaticKeyedRecyclingPool->set_max_age(max_age);
   return *kStaticKeyedRecyclingPool;
 }
 
+template <typename T, typename Key, typename Deleter>
+inline typename KeyedRecyclingPool<T, Key, Deleter>::ThreadCache*
+KeyedRecyclingPool<T, Key, Deleter>::thread_cache() {
+  // `destroyed` is trivially destructible, so it remains valid while other
+  // thread-local objects are destroyed.
+  static thread_local bool destroyed = false;
+  if (ABSL_PREDICT_FALSE(destroyed)) return nullptr;
+  static thread_local ThreadCache cache(&destroyed);
+  return &cache;
+}
+
 template <typename T, typename Key, typename Deleter>
 inline void KeyedRecyclingPool<T, Key, Deleter>::set_max_size(size_t max_size) {
   max_size_.store(max_size, std::memory_order_relaxed);
 }
 
+template <typename T, typename Key, typename Deleter>
+inline void KeyedRecyclingPool<T, Key, Deleter>::set_max_age(
+    absl::Duration max_age) {
+  absl::MutexLock lock(&mutex_);
+  max_age_ = max_age;
+}
+
 template <typename T, typename Key, typename Deleter>
 template <typename Factory, typename Refurbisher>
 typename KeyedRecyclingPool<T, Key, Deleter>::Handle
 KeyedRecyclingPool<T, Key, Deleter>::Get(Key key, Factory factory,
                                          Refurbisher refurbisher) {
   std::unique_ptr<T, Deleter> returned;
-  {
+  ThreadCache* const thread_cache_ptr = thread_cache();
+  if (thread_cache_ptr != nullptr && thread_cache_ptr->pool == this &&
+      thread_cache_ptr->object != nullptr && thread_cache_ptr->key == key) {
+    returned = std::move(thread_cache_ptr->object);
+  } else {
     absl::MutexLock lock(&mutex_);
     if (cache_ != by_key_.end()) {
       // Finish erasing the cached entry.
@@ -362,8 +502,18 @@ KeyedRecyclingPool<T, Key, Deleter>::Get(Key key, Factory factory,
 template <typename T, typename Key, typename Deleter>
 void KeyedRecyclingPool<T, Key, Deleter>::Put(
     const Key& key, std::unique_ptr<T, Deleter> object) {
+  ThreadCache* const thread_cache_ptr = thread_cache();
+  if (thread_cache_ptr != nullptr && thread_cache_ptr->object == nullptr &&
+      ABSL_PREDICT_TRUE(max_size_.load(std::memory_order_relaxed) > 0)) {
+    thread_cache_ptr->pool = this;
+    thread_cache_ptr->key = key;
+    thread_cache_ptr->object = std::move(object);
+    return;
+  }
   std::vector<std::unique_ptr<T, Deleter>> evicted;
   absl::MutexLock lock(&mutex_);
+  const bool has_max_age = max_age_ != absl::InfiniteDuration();
+  const absl::Time now = has_max_age ? absl::Now() : absl::InfiniteFuture();
   // Add a newest entry with this key.
   if (ABSL_PREDICT_TRUE(cache_ != by_key_.end())) {
     Entries& entries = cache_->second;
@@ -371,11 +521,16 @@ void KeyedRecyclingPool<T, Key, Deleter>::Put(
         << "Failed invariant of KeyedRecyclingPool: "
            "empty by_key_ value";
     if (ABSL_PREDICT_TRUE(cache_->first == key)) {
-      // `cache_` hit. Set the object pointer again.
+      // `cache_` hit. Set the object pointer again, and make it the newest.
       RIEGELI_ASSERT(entries.back().object == nullptr)
           << "Failed invariant of KeyedRecyclingPool: "
              "non-nullptr object pointed to by cache_";
       entries.back().object = std::move(object);
+      const typename ByFreshness::iterator by_freshness_iter =
+          entries.back().by_freshness_iter;
+      by_freshness_iter->deadline = now + max_age_;
+      by_freshness_.splice(by_freshness_.end(), by_freshness_,
+                           by_freshness_iter);
       cache_ = by_key_.end();
       return;
     }
@@ -384,15 +539,16 @@ void KeyedRecyclingPool<T, Key, Deleter>::Put(
     entries.pop_back();
     if (entries.empty()) by_key_.erase(cache_);
   }
-  by_freshness_.push_back(key);
+  by_freshness_.emplace_back(key, now + max_age_);
   typename ByFreshness::iterator by_freshness_iter = by_freshness_.end();
   --by_freshness_iter;
   // This invalidates `by_key_` iterators, including `cache_`.
   by_key_[key].emplace_back(std::move(object), by_freshness_iter);
-  while (ABSL_PREDICT_FALSE(by_freshness_.size() >
-                            max_size_.load(std::memory_order_relaxed))) {
+  while (ABSL_PREDICT_FALSE(
+      by_freshness_.size() > max_size_.load(std::memory_order_relaxed) ||
+      (has_max_age && by_freshness_.front().deadline < now))) {
     // Evict the oldest entry.
-    const Key& evicted_key = by_freshness_.front();
+    const Key& evicted_key = by_freshness_.front().key;
     const typename ByKey::iterator by_key_iter = by_key_.find(evicted_key);
     RIEGELI_ASSERT(by_key_iter != by_key_.end())
         << "Failed invariant of KeyedRecyclingPool: "
@@ -408,6 +564,7 @@ void KeyedRecyclingPool<T, Key, Deleter>::Put(
     entries.pop_front();
     if (entries.empty()) by_key_.erase(by_key_iter);
     by_freshness_.pop_front();
+    if (by_freshness_.empty()) break;
   }
   cache_ = by_key_.end();
   // Destroy `evicted` after releasing `mutex_`.
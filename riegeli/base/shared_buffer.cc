@@ -14,14 +14,130 @@
 
 #include "riegeli/base/shared_buffer.h"
 
+#include <stddef.h>
+
+#include <atomic>
 #include <functional>
+#include <memory>
 
+#include "absl/memory/memory.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/memory.h"
+#include "riegeli/base/recycling_pool.h"
 
 namespace riegeli {
 
+namespace {
+
+// Payloads with allocated sizes `SizeClassSize(size_class)` are kept for reuse.
+// Size classes are `kMinPooledSize << k` multiplied by 4/4, 5/4, 6/4, or 7/4,
+// so that a request wastes at most a quarter of the allocated size.
+constexpr size_t kMinPooledSizeLog2 = 16;
+constexpr size_t kNumPooledPowers = 10;
+constexpr size_t kNumSizeClasses = kNumPooledPowers * 4;
+// Idle payloads are large, so few of them are kept, and not for long.
+constexpr size_t kMaxPooledPerClass = 4;
+constexpr absl::Duration kMaxPooledAge = absl::Seconds(60);
+
+static_assert(size_t{1} << kMinPooledSizeLog2 == kMaxBufferSize,
+              "Pooled shared buffers should begin at kMaxBufferSize");
+
+constexpr size_t SizeClassSize(size_t size_class) {
+  return (size_t{4} + size_class % 4)
+         << (kMinPooledSizeLog2 - 2 + size_class / 4);
+}
+
+// Returns the smallest size class with size at least `min_size`, or
+// `kNumSizeClasses` if allocations of `min_size` are not pooled.
+inline size_t MinSizeClass(size_t min_size) {
+  if (min_size < SizeClassSize(0) ||
+      min_size > SizeClassSize(kNumSizeClasses - 1)) {
+    return kNumSizeClasses;
+  }
+  size_t size_class = 0;
+  while (SizeClassSize(size_class) < min_size) ++size_class;
+  return size_class;
+}
+
+// Returns the size class of `size`, or `kNumSizeClasses` if allocations of
+// `size` are not pooled.
+inline size_t SizeClass(size_t size) {
+  const size_t size_class = MinSizeClass(size);
+  if (size_class == kNumSizeClasses || SizeClassSize(size_class) != size) {
+    return kNumSizeClasses;
+  }
+  return size_class;
+}
+
+}  // namespace
+
+// Deletes a payload which is not pooled further.
+struct SharedBuffer::PayloadDeleter {
+  void operator()(Payload* payload) const {
+    DeleteAligned<Payload>(
+        payload, offsetof(Payload, allocated_begin) + payload->capacity);
+  }
+};
+
+struct SharedBuffer::PayloadPools {
+  using Pool = RecyclingPool<Payload, PayloadDeleter>;
+
+  PayloadPools() {
+    for (std::unique_ptr<Pool>& pool : pools) {
+      pool = absl::make_unique<Pool>(kMaxPooledPerClass, kMaxPooledAge);
+    }
+  }
+
+  static Pool& global(size_t size_class) {
+    static NoDestructor<PayloadPools> kPayloadPools;
+    return *kPayloadPools->pools[size_class];
+  }
+
+  std::unique_ptr<Pool> pools[kNumSizeClasses];
+};
+
+void SharedBuffer::AllocateInternal(size_t min_capacity) {
+  const size_t min_size =
+      SaturatingAdd(offsetof(Payload, allocated_begin), min_capacity);
+  const size_t size_class = MinSizeClass(min_size);
+  if (size_class == kNumSizeClasses) {
+    size_t raw_capacity;
+    payload_.reset(SizeReturningNewAligned<Payload>(min_size, &raw_capacity));
+    payload_->capacity = raw_capacity - offsetof(Payload, allocated_begin);
+    return;
+  }
+  const size_t size = SizeClassSize(size_class);
+  PayloadPools::Pool& pool = PayloadPools::global(size_class);
+  Payload* const payload =
+      pool.Get(
+              [size] {
+                Payload* const payload = NewAligned<Payload>(size);
+                payload->capacity = size - offsetof(Payload, allocated_begin);
+                return std::unique_ptr<Payload, PayloadDeleter>(payload);
+              },
+              [](Payload* payload) {
+                payload->ref_count.store(1, std::memory_order_relaxed);
+              })
+          .release();
+  payload_.reset(payload);
+}
+
+void SharedBuffer::DeletePayload(Payload* payload) {
+  const size_t size_class =
+      SizeClass(offsetof(Payload, allocated_begin) + payload->capacity);
+  if (size_class == kNumSizeClasses) {
+    PayloadDeleter()(payload);
+    return;
+  }
+  PayloadPools::Pool& pool = PayloadPools::global(size_class);
+  // The handle puts the payload into the pool when destroyed.
+  PayloadPools::Pool::Handle handle(
+      payload, PayloadPools::Pool::Recycler(&pool, PayloadDeleter()));
+}
+
 absl::Cord SharedBuffer::ToCord(absl::string_view substr) const {
   RIEGELI_ASSERT(std::greater_equal<>()(substr.data(), const_data()))
       << "Failed precondition of SharedBuffer::ToCord(): "
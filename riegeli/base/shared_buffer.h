@@ -31,6 +31,12 @@ namespace riegeli {
 // Dynamically allocated byte buffer.
 //
 // Like `Buffer`, but ownership of the data can be shared.
+//
+// Large buffers, between `kMaxBufferSize` and tens of megabytes, are allocated
+// in size classes four per power of 2, and are recycled through a global
+// `RecyclingPool` of their class when their last owner releases them, in
+// whichever thread that happens. This makes repeatedly allocating buffers of
+// similar large sizes, e.g. for decoded chunks shared with consumers, cheap.
 class SharedBuffer {
  public:
   SharedBuffer() noexcept {}
@@ -96,6 +102,12 @@ class SharedBuffer {
     char allocated_begin[1];
   };
 
+  struct PayloadDeleter;
+  struct PayloadPools;
+
+  // Deletes `payload`, or puts it into the pool of its size class.
+  static void DeletePayload(Payload* payload);
+
   void AllocateInternal(size_t min_capacity);
 
   RefCountedPtr<Payload> payload_;
@@ -112,7 +124,7 @@ inline void SharedBuffer::Payload::Unref() {
   // reference count is 1.
   if (ref_count.load(std::memory_order_acquire) == 1 ||
       ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
-    DeleteAligned<Payload>(this, offsetof(Payload, allocated_begin) + capacity);
+    DeletePayload(this);
   }
 }
 
@@ -155,13 +167,6 @@ inline size_t SharedBuffer::capacity() const {
   return payload_->capacity;
 }
 
-inline void SharedBuffer::AllocateInternal(size_t min_capacity) {
-  size_t raw_capacity;
-  payload_.reset(SizeReturningNewAligned<Payload>(
-      offsetof(Payload, allocated_begin) + min_capacity, &raw_capacity));
-  payload_->capacity = raw_capacity - offsetof(Payload, allocated_begin);
-}
-
 inline void* SharedBuffer::Share() const {
   if (payload_ == nullptr) return nullptr;
   payload_->Ref();
@@ -0,0 +1,285 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/benchmarks/benchmark_corpus.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/benchmarks/benchmark.pb.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/chunk_encoding/simple_encoder.h"
+#include "riegeli/chunk_encoding/transpose_encoder.h"
+#include "riegeli/messages/message_wire_format.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+namespace benchmarks {
+
+namespace {
+
+constexpr uint64_t kSeed = 0x5265676c6942656eu;
+
+constexpr size_t kNumRecords = 10000;
+constexpr size_t kNumWideRecords = 2000;
+constexpr uint64_t kNumWideFields = 4000;
+constexpr size_t kNumLines = 20000;
+constexpr size_t kNumCsvRecords = 10000;
+constexpr size_t kCompressibleSize = size_t{4} << 20;
+constexpr size_t kNumVarints = 100000;
+
+constexpr absl::string_view kWords[] = {
+    "alpha", "bravo",  "charlie", "delta",   "echo",   "foxtrot",
+    "golf",  "hotel",  "india",   "juliett", "kilo",   "lima",
+    "mike",  "oscar",  "papa",    "quebec",  "romeo",  "sierra",
+    "tango", "victor", "whiskey", "x-ray",   "yankee", "zulu"};
+
+// Deterministic random source. Only the raw engine output is used:
+// distributions are implementation-defined and would make corpora differ
+// between standard libraries.
+class Random {
+ public:
+  Random() : engine_(kSeed) {}
+
+  uint64_t Next() { return engine_(); }
+  // Returns a value in [0, n). The modulo bias is irrelevant here.
+  uint64_t Uniform(uint64_t n) { return engine_() % n; }
+  bool OneIn(uint64_t n) { return Uniform(n) == 0; }
+  absl::string_view Word() {
+    return kWords[Uniform(sizeof(kWords) / sizeof(kWords[0]))];
+  }
+
+ private:
+  std::mt19937_64 engine_;
+};
+
+void AppendVarint(uint64_t value, std::string& dest) {
+  char buffer[kMaxLengthVarint64];
+  dest.append(buffer, PtrDistance(buffer, WriteVarint64(value, buffer)));
+}
+
+// Appends a message with fields chosen from `kNumWideFields` field numbers.
+// Field numbers are skewed towards small ones, so that some fields are common
+// and most are rare, as in wide real-world schemas.
+void AppendWideMessage(Random& random, int depth, std::string& dest) {
+  const size_t num_fields = 8 + random.Uniform(32);
+  for (size_t i = 0; i < num_fields; ++i) {
+    const int field_number = 1 + IntCast<int>(random.Uniform(
+                                     1 + random.Uniform(kNumWideFields)));
+    switch (random.Uniform(depth < 1 ? 8 : 7)) {
+      default:
+        AppendVarint(MakeTag(field_number, WireType::kVarint), dest);
+        AppendVarint(random.Uniform(uint64_t{1} << random.Uniform(40)), dest);
+        break;
+      case 5:
+      case 6: {
+        AppendVarint(MakeTag(field_number, WireType::kLengthDelimited), dest);
+        const absl::string_view word = random.Word();
+        AppendVarint(word.size(), dest);
+        dest.append(word.data(), word.size());
+      } break;
+      case 7: {
+        std::string submessage;
+        AppendWideMessage(random, depth + 1, submessage);
+        AppendVarint(MakeTag(field_number, WireType::kLengthDelimited), dest);
+        AppendVarint(submessage.size(), dest);
+        dest.append(submessage);
+      } break;
+    }
+  }
+}
+
+}  // namespace
+
+const std::vector<std::string>& SerializedRecords() {
+  static const std::vector<std::string>* const kRecords = [] {
+    Random random;
+    std::vector<std::string>* const records = new std::vector<std::string>();
+    records->reserve(kNumRecords);
+    BenchmarkRecord record;
+    for (size_t i = 0; i < kNumRecords; ++i) {
+      record.Clear();
+      record.set_id(1000000 + i * 7);
+      record.set_name(absl::StrCat(random.Word(), "_", random.Uniform(1000)));
+      const size_t num_values = random.Uniform(16);
+      for (size_t j = 0; j < num_values; ++j) {
+        record.add_values(static_cast<int32_t>(random.Uniform(1 << 20)) -
+                          (1 << 19));
+      }
+      if (!random.OneIn(4)) {
+        BenchmarkRecord::Nested& nested = *record.mutable_nested();
+        nested.set_timestamp(int64_t{1600000000} + static_cast<int64_t>(i));
+        nested.set_score(static_cast<double>(random.Uniform(1000000)) / 1000.0);
+        nested.set_flag(random.OneIn(2));
+      }
+      const size_t num_tags = random.Uniform(4);
+      for (size_t j = 0; j < num_tags; ++j) {
+        record.add_tags(std::string(random.Word()));
+      }
+      records->push_back(record.SerializeAsString());
+    }
+    return records;
+  }();
+  return *kRecords;
+}
+
+const std::vector<std::string>& WideSerializedRecords() {
+  static const std::vector<std::string>* const kRecords = [] {
+    Random random;
+    std::vector<std::string>* const records = new std::vector<std::string>();
+    records->reserve(kNumWideRecords);
+    std::string record;
+    for (size_t i = 0; i < kNumWideRecords; ++i) {
+      record.clear();
+      AppendWideMessage(random, 0, record);
+      records->push_back(record);
+    }
+    return records;
+  }();
+  return *kRecords;
+}
+
+const std::string& TextCorpus() {
+  static const std::string* const kText = [] {
+    Random random;
+    std::string* const text = new std::string();
+    for (size_t i = 0; i < kNumLines; ++i) {
+      const size_t num_words = random.Uniform(32);
+      for (size_t j = 0; j < num_words; ++j) {
+        if (j > 0) text->push_back(' ');
+        absl::StrAppend(text, random.Word());
+      }
+      text->push_back('\n');
+    }
+    return text;
+  }();
+  return *kText;
+}
+
+const std::string& CsvCorpus() {
+  static const std::string* const kCsv = [] {
+    Random random;
+    std::string* const csv = new std::string(
+        "id,name,city,count,score,flag,comment,tags\n");
+    for (size_t i = 0; i < kNumCsvRecords; ++i) {
+      absl::StrAppend(csv, i, ",", random.Word(), ",", random.Word(), ",",
+                      random.Uniform(100000), ",", random.Uniform(1000), ".",
+                      random.Uniform(100), ",",
+                      random.OneIn(2) ? "true" : "false", ",");
+      switch (random.Uniform(4)) {
+        case 0:
+          break;
+        case 1:
+          absl::StrAppend(csv, random.Word(), " ", random.Word());
+          break;
+        case 2:
+          absl::StrAppend(csv, "\"", random.Word(), ", ", random.Word(), "\"");
+          break;
+        case 3:
+          absl::StrAppend(csv, "\"", random.Word(), " \"\"", random.Word(),
+                          "\"\"\n", random.Word(), "\"");
+          break;
+      }
+      absl::StrAppend(csv, ",\"", random.Word(), ",", random.Word(), "\"\n");
+    }
+    return csv;
+  }();
+  return *kCsv;
+}
+
+const Chain& CompressibleCorpus() {
+  static const Chain* const kCompressible = [] {
+    Random random;
+    Chain* const compressible = new Chain();
+    std::string fragment;
+    while (compressible->size() < kCompressibleSize) {
+      fragment.clear();
+      if (random.OneIn(8)) {
+        const size_t length = 16 + random.Uniform(64);
+        for (size_t i = 0; i < length; ++i) {
+          fragment.push_back(static_cast<char>(random.Next()));
+        }
+      } else {
+        absl::StrAppend(&fragment, random.Word(), " ", random.Word(), " ",
+                        random.Uniform(100), "\n");
+      }
+      compressible->Append(fragment);
+    }
+    return compressible;
+  }();
+  return *kCompressible;
+}
+
+const std::vector<uint64_t>& VarintValues() {
+  static const std::vector<uint64_t>* const kValues = [] {
+    Random random;
+    std::vector<uint64_t>* const values = new std::vector<uint64_t>();
+    values->reserve(kNumVarints);
+    for (size_t i = 0; i < kNumVarints; ++i) {
+      // Choose the bit width first so that short and long varints are equally
+      // represented.
+      const int width = 1 + static_cast<int>(random.Uniform(64));
+      const uint64_t value = random.Next();
+      values->push_back(width == 64 ? value
+                                    : value & ((uint64_t{1} << width) - 1));
+    }
+    return values;
+  }();
+  return *kValues;
+}
+
+Chunk EncodeRecordsChunk(CompressorOptions compressor_options, bool transpose) {
+  const std::vector<std::string>& records = SerializedRecords();
+  std::unique_ptr<ChunkEncoder> encoder;
+  if (transpose) {
+    encoder = std::make_unique<TransposeEncoder>(std::move(compressor_options),
+                                                 uint64_t{1} << 20);
+  } else {
+    encoder = std::make_unique<SimpleEncoder>(std::move(compressor_options),
+                                              uint64_t{1} << 20);
+  }
+  for (const std::string& record : records) {
+    RIEGELI_CHECK(encoder->AddRecord(absl::string_view(record)))
+        << encoder->status();
+  }
+  Chunk chunk;
+  ChunkType chunk_type;
+  uint64_t num_records;
+  uint64_t decoded_data_size;
+  ChainWriter<> data_writer(&chunk.data);
+  RIEGELI_CHECK(encoder->EncodeAndClose(data_writer, chunk_type, num_records,
+                                        decoded_data_size))
+      << encoder->status();
+  RIEGELI_CHECK(data_writer.Close()) << data_writer.status();
+  chunk.header =
+      ChunkHeader(chunk.data, chunk_type, num_records, decoded_data_size);
+  return chunk;
+}
+
+}  // namespace benchmarks
+}  // namespace riegeli
@@ -0,0 +1,67 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BENCHMARKS_BENCHMARK_CORPUS_H_
+#define RIEGELI_BENCHMARKS_BENCHMARK_CORPUS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "riegeli/base/chain.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+
+namespace riegeli {
+namespace benchmarks {
+
+// Fixed corpora shared by the microbenchmarks.
+//
+// Every corpus is generated from a fixed seed using only the raw output of
+// `std::mt19937_64` (which is fully specified by the standard), so results are
+// comparable across runs, machines, and standard library implementations.
+// Corpora are generated on first use and cached for the process lifetime.
+
+// Serialized `BenchmarkRecord` protos, about 100 bytes each.
+const std::vector<std::string>& SerializedRecords();
+
+// Serialized proto messages of a wide schema: each record has a few dozen
+// varint and string fields out of a few thousand field numbers, some of them
+// in submessages, about 500 bytes each.
+const std::vector<std::string>& WideSerializedRecords();
+
+// Text consisting of lines terminated with LF, of lengths between 0 and about
+// 200 bytes, mostly printable ASCII.
+const std::string& TextCorpus();
+
+// CSV with a header and 8 fields per record. Some fields are quoted and contain
+// commas, quotes, or newlines.
+const std::string& CsvCorpus();
+
+// Moderately compressible bytes: a mix of repeated phrases and random bytes,
+// roughly 4 MiB.
+const Chain& CompressibleCorpus();
+
+// Unsigned integers with varint lengths spread between 1 and 10 bytes.
+const std::vector<uint64_t>& VarintValues();
+
+// Encodes `SerializedRecords()` into a chunk, transposed or simple.
+Chunk EncodeRecordsChunk(CompressorOptions compressor_options, bool transpose);
+
+}  // namespace benchmarks
+}  // namespace riegeli
+
+#endif  // RIEGELI_BENCHMARKS_BENCHMARK_CORPUS_H_
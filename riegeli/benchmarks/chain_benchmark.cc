@@ -0,0 +1,74 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "benchmark/benchmark.h"
+#include "riegeli/base/chain.h"
+
+namespace riegeli {
+namespace {
+
+// Builds a 1 MiB `Chain` from fragments of `state.range(0)` bytes.
+
+constexpr size_t kTotalSize = size_t{1} << 20;
+
+void BM_ChainAppend(benchmark::State& state) {
+  const std::string fragment(static_cast<size_t>(state.range(0)), 'x');
+  for (auto _ : state) {
+    Chain chain;
+    for (size_t size = 0; size < kTotalSize; size += fragment.size()) {
+      chain.Append(absl::string_view(fragment));
+    }
+    benchmark::DoNotOptimize(chain);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kTotalSize));
+}
+BENCHMARK(BM_ChainAppend)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+void BM_ChainPrepend(benchmark::State& state) {
+  const std::string fragment(static_cast<size_t>(state.range(0)), 'x');
+  for (auto _ : state) {
+    Chain chain;
+    for (size_t size = 0; size < kTotalSize; size += fragment.size()) {
+      chain.Prepend(absl::string_view(fragment));
+    }
+    benchmark::DoNotOptimize(chain);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kTotalSize));
+}
+BENCHMARK(BM_ChainPrepend)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+void BM_ChainAppendChain(benchmark::State& state) {
+  Chain fragment;
+  fragment.Append(std::string(static_cast<size_t>(state.range(0)), 'x'));
+  for (auto _ : state) {
+    Chain chain;
+    for (size_t size = 0; size < kTotalSize; size += fragment.size()) {
+      chain.Append(fragment);
+    }
+    benchmark::DoNotOptimize(chain);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kTotalSize));
+}
+BENCHMARK(BM_ChainAppendChain)->RangeMultiplier(8)->Range(1, 64 << 10);
+
+}  // namespace
+}  // namespace riegeli
@@ -0,0 +1,70 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+
+#include <utility>
+
+#include "absl/strings/string_view.h"
+#include "benchmark/benchmark.h"
+#include "riegeli/base/base.h"
+#include "riegeli/benchmarks/benchmark_corpus.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+
+namespace riegeli {
+namespace {
+
+// Decodes a whole chunk and iterates over its records, as `RecordReader` does.
+void BM_ChunkDecoder(benchmark::State& state,
+                     CompressorOptions compressor_options, bool transpose) {
+  const Chunk chunk = benchmarks::EncodeRecordsChunk(
+      std::move(compressor_options), transpose);
+  ChunkDecoder decoder;
+  for (auto _ : state) {
+    RIEGELI_CHECK(decoder.Decode(chunk)) << decoder.status();
+    absl::string_view record;
+    while (decoder.ReadRecord(record)) benchmark::DoNotOptimize(record);
+    RIEGELI_CHECK(decoder.healthy()) << decoder.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(chunk.header.num_records()));
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations()) *
+      static_cast<int64_t>(chunk.header.decoded_data_size()));
+}
+BENCHMARK_CAPTURE(BM_ChunkDecoder, simple_uncompressed,
+                  CompressorOptions().set_uncompressed(), false);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, simple_brotli,
+                  CompressorOptions().set_brotli(), false);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, simple_zstd, CompressorOptions().set_zstd(),
+                  false);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, simple_snappy,
+                  CompressorOptions().set_snappy(), false);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, simple_lz4, CompressorOptions().set_lz4(),
+                  false);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, transposed_uncompressed,
+                  CompressorOptions().set_uncompressed(), true);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, transposed_brotli,
+                  CompressorOptions().set_brotli(), true);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, transposed_zstd,
+                  CompressorOptions().set_zstd(), true);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, transposed_snappy,
+                  CompressorOptions().set_snappy(), true);
+BENCHMARK_CAPTURE(BM_ChunkDecoder, transposed_lz4,
+                  CompressorOptions().set_lz4(), true);
+
+}  // namespace
+}  // namespace riegeli
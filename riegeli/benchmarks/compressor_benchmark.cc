@@ -0,0 +1,85 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+
+#include <tuple>
+#include <utility>
+
+#include "benchmark/benchmark.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/benchmarks/benchmark_corpus.h"
+#include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/chunk_encoding/compressor.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+#include "riegeli/chunk_encoding/decompressor.h"
+
+namespace riegeli {
+namespace {
+
+Chain Compress(const CompressorOptions& compressor_options, const Chain& src) {
+  internal::Compressor compressor(compressor_options);
+  RIEGELI_CHECK(compressor.writer().Write(src)) << compressor.status();
+  Chain compressed;
+  ChainWriter<> writer(&compressed);
+  RIEGELI_CHECK(compressor.EncodeAndClose(writer)) << compressor.status();
+  RIEGELI_CHECK(writer.Close()) << writer.status();
+  return compressed;
+}
+
+void BM_Compress(benchmark::State& state,
+                 CompressorOptions compressor_options) {
+  const Chain& src = benchmarks::CompressibleCorpus();
+  Chain compressed;
+  for (auto _ : state) compressed = Compress(compressor_options, src);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(src.size()));
+  state.counters["ratio"] = static_cast<double>(src.size()) /
+                            static_cast<double>(compressed.size());
+}
+BENCHMARK_CAPTURE(BM_Compress, uncompressed,
+                  CompressorOptions().set_uncompressed());
+BENCHMARK_CAPTURE(BM_Compress, brotli, CompressorOptions().set_brotli());
+BENCHMARK_CAPTURE(BM_Compress, zstd, CompressorOptions().set_zstd());
+BENCHMARK_CAPTURE(BM_Compress, snappy, CompressorOptions().set_snappy());
+BENCHMARK_CAPTURE(BM_Compress, lz4, CompressorOptions().set_lz4());
+
+void BM_Decompress(benchmark::State& state,
+                   CompressorOptions compressor_options) {
+  const Chain& src = benchmarks::CompressibleCorpus();
+  const Chain compressed = Compress(compressor_options, src);
+  Chain decompressed;
+  for (auto _ : state) {
+    internal::Decompressor<ChainReader<>> decompressor(
+        std::forward_as_tuple(&compressed),
+        compressor_options.compression_type());
+    decompressed.Clear();
+    RIEGELI_CHECK(decompressor.reader().Read(src.size(), decompressed))
+        << decompressor.status();
+    RIEGELI_CHECK(decompressor.VerifyEndAndClose()) << decompressor.status();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(src.size()));
+}
+BENCHMARK_CAPTURE(BM_Decompress, uncompressed,
+                  CompressorOptions().set_uncompressed());
+BENCHMARK_CAPTURE(BM_Decompress, brotli, CompressorOptions().set_brotli());
+BENCHMARK_CAPTURE(BM_Decompress, zstd, CompressorOptions().set_zstd());
+BENCHMARK_CAPTURE(BM_Decompress, snappy, CompressorOptions().set_snappy());
+BENCHMARK_CAPTURE(BM_Decompress, lz4, CompressorOptions().set_lz4());
+
+}  // namespace
+}  // namespace riegeli
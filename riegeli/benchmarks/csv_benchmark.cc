@@ -0,0 +1,48 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "riegeli/base/base.h"
+#include "riegeli/benchmarks/benchmark_corpus.h"
+#include "riegeli/bytes/string_reader.h"
+#include "riegeli/csv/csv_reader.h"
+
+namespace riegeli {
+namespace {
+
+void BM_CsvReader(benchmark::State& state) {
+  const std::string& csv = benchmarks::CsvCorpus();
+  std::vector<std::string> record;
+  int64_t num_records = 0;
+  for (auto _ : state) {
+    CsvReader<StringReader<>> csv_reader(std::forward_as_tuple(csv));
+    num_records = 0;
+    while (csv_reader.ReadRecord(record)) ++num_records;
+    RIEGELI_CHECK(csv_reader.Close()) << csv_reader.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_records);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(csv.size()));
+}
+BENCHMARK(BM_CsvReader);
+
+}  // namespace
+}  // namespace riegeli
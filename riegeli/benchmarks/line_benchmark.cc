@@ -0,0 +1,108 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "benchmark/benchmark.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/benchmarks/benchmark_corpus.h"
+#include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/string_reader.h"
+#include "riegeli/lines/line_reading.h"
+
+namespace riegeli {
+namespace {
+
+void BM_ReadLineFromString(benchmark::State& state) {
+  const std::string& text = benchmarks::TextCorpus();
+  const ReadLineOptions options =
+      ReadLineOptions().set_newline(state.range(0) == 0
+                                        ? ReadLineOptions::Newline::kLf
+                                        : ReadLineOptions::Newline::kAny);
+  int64_t num_lines = 0;
+  for (auto _ : state) {
+    StringReader<> reader(text);
+    absl::string_view line;
+    num_lines = 0;
+    while (ReadLine(reader, line, options)) ++num_lines;
+    RIEGELI_CHECK(reader.VerifyEndAndClose()) << reader.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_lines);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(text.size()));
+}
+// Argument 0: `Newline::kLf`, argument 1: `Newline::kAny`.
+BENCHMARK(BM_ReadLineFromString)->Arg(0)->Arg(1);
+
+void BM_ReadLinesFromString(benchmark::State& state) {
+  const std::string& text = benchmarks::TextCorpus();
+  const ReadLineOptions options =
+      ReadLineOptions().set_newline(state.range(0) == 0
+                                        ? ReadLineOptions::Newline::kLf
+                                        : ReadLineOptions::Newline::kAny);
+  int64_t num_lines = 0;
+  for (auto _ : state) {
+    StringReader<> reader(text);
+    std::vector<absl::string_view> lines;
+    num_lines = 0;
+    while (ReadLines(reader, lines, std::numeric_limits<size_t>::max(),
+                     options)) {
+      num_lines += static_cast<int64_t>(lines.size());
+    }
+    RIEGELI_CHECK(reader.VerifyEndAndClose()) << reader.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_lines);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(text.size()));
+}
+// Argument 0: `Newline::kLf`, argument 1: `Newline::kAny`.
+BENCHMARK(BM_ReadLinesFromString)->Arg(0)->Arg(1);
+
+// Reads from a `Chain` of small blocks, so that lines often cross block
+// boundaries and `ReadLine()` must copy them.
+void BM_ReadLineFromFragmentedChain(benchmark::State& state) {
+  const std::string& text = benchmarks::TextCorpus();
+  Chain chain;
+  const size_t block_size = static_cast<size_t>(state.range(0));
+  for (size_t pos = 0; pos < text.size(); pos += block_size) {
+    // `text` has static storage duration, so it can be attached directly.
+    chain.Append(
+        Chain::FromExternal(absl::string_view(text).substr(pos, block_size)));
+  }
+  int64_t num_lines = 0;
+  for (auto _ : state) {
+    ChainReader<> reader(&chain);
+    absl::string_view line;
+    num_lines = 0;
+    while (ReadLine(reader, line)) ++num_lines;
+    RIEGELI_CHECK(reader.VerifyEndAndClose()) << reader.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_lines);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_ReadLineFromFragmentedChain)->Arg(256)->Arg(4096);
+
+}  // namespace
+}  // namespace riegeli
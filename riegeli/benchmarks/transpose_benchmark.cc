@@ -0,0 +1,140 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "benchmark/benchmark.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/benchmarks/benchmark_corpus.h"
+#include "riegeli/brotli/brotli_dictionary.h"
+#include "riegeli/bytes/chain_backward_writer.h"
+#include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/chunk_encoding/field_projection.h"
+#include "riegeli/chunk_encoding/transpose_decoder.h"
+#include "riegeli/chunk_encoding/transpose_encoder.h"
+#include "riegeli/zstd/zstd_reader.h"
+
+namespace riegeli {
+namespace {
+
+constexpr uint64_t kBucketSize = uint64_t{1} << 20;
+
+size_t RecordsSize(const std::vector<std::string>& records) {
+  size_t size = 0;
+  for (const std::string& record : records) size += record.size();
+  return size;
+}
+
+void TransposeEncoderBenchmark(benchmark::State& state,
+                               CompressorOptions compressor_options,
+                               const std::vector<std::string>& records) {
+  Chain encoded;
+  for (auto _ : state) {
+    TransposeEncoder encoder(compressor_options, kBucketSize);
+    for (const std::string& record : records) {
+      RIEGELI_CHECK(encoder.AddRecord(absl::string_view(record)))
+          << encoder.status();
+    }
+    encoded.Clear();
+    ChainWriter<> writer(&encoded);
+    ChunkType chunk_type;
+    uint64_t num_records;
+    uint64_t decoded_data_size;
+    RIEGELI_CHECK(encoder.EncodeAndClose(writer, chunk_type, num_records,
+                                         decoded_data_size))
+        << encoder.status();
+    RIEGELI_CHECK(writer.Close()) << writer.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(records.size()));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(RecordsSize(records)));
+  state.counters["encoded_size"] = static_cast<double>(encoded.size());
+}
+
+void BM_TransposeEncoder(benchmark::State& state,
+                         CompressorOptions compressor_options) {
+  TransposeEncoderBenchmark(state, std::move(compressor_options),
+                            benchmarks::SerializedRecords());
+}
+BENCHMARK_CAPTURE(BM_TransposeEncoder, uncompressed,
+                  CompressorOptions().set_uncompressed());
+BENCHMARK_CAPTURE(BM_TransposeEncoder, brotli,
+                  CompressorOptions().set_brotli());
+BENCHMARK_CAPTURE(BM_TransposeEncoder, zstd, CompressorOptions().set_zstd());
+BENCHMARK_CAPTURE(BM_TransposeEncoder, snappy,
+                  CompressorOptions().set_snappy());
+BENCHMARK_CAPTURE(BM_TransposeEncoder, lz4, CompressorOptions().set_lz4());
+
+// Records with thousands of distinct field numbers, where building the state
+// machine rather than compression dominates encoding.
+void BM_TransposeEncoderWide(benchmark::State& state,
+                             CompressorOptions compressor_options) {
+  TransposeEncoderBenchmark(state, std::move(compressor_options),
+                            benchmarks::WideSerializedRecords());
+}
+BENCHMARK_CAPTURE(BM_TransposeEncoderWide, uncompressed,
+                  CompressorOptions().set_uncompressed());
+BENCHMARK_CAPTURE(BM_TransposeEncoderWide, zstd,
+                  CompressorOptions().set_zstd());
+
+void BM_TransposeDecoder(benchmark::State& state,
+                         CompressorOptions compressor_options) {
+  const Chunk chunk = benchmarks::EncodeRecordsChunk(
+      std::move(compressor_options), /*transpose=*/true);
+  Chain decoded;
+  std::vector<size_t> limits;
+  for (auto _ : state) {
+    ChainReader<> src(&chunk.data);
+    decoded.Clear();
+    ChainBackwardWriter<> dest(&decoded);
+    TransposeDecoder decoder;
+    RIEGELI_CHECK(decoder.Decode(chunk.header.chunk_type(),
+                                 chunk.header.num_records(),
+                                 chunk.header.decoded_data_size(),
+                                 FieldProjection::All(),
+                                 ZstdReaderBase::Dictionary(),
+                                 BrotliDictionary(), src, dest, limits))
+        << decoder.status();
+    RIEGELI_CHECK(dest.Close()) << dest.status();
+    RIEGELI_CHECK(src.VerifyEndAndClose()) << src.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(chunk.header.num_records()));
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations()) *
+      static_cast<int64_t>(chunk.header.decoded_data_size()));
+}
+BENCHMARK_CAPTURE(BM_TransposeDecoder, uncompressed,
+                  CompressorOptions().set_uncompressed());
+BENCHMARK_CAPTURE(BM_TransposeDecoder, brotli,
+                  CompressorOptions().set_brotli());
+BENCHMARK_CAPTURE(BM_TransposeDecoder, zstd, CompressorOptions().set_zstd());
+BENCHMARK_CAPTURE(BM_TransposeDecoder, snappy,
+                  CompressorOptions().set_snappy());
+BENCHMARK_CAPTURE(BM_TransposeDecoder, lz4, CompressorOptions().set_lz4());
+
+}  // namespace
+}  // namespace riegeli
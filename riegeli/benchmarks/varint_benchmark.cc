@@ -0,0 +1,116 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "benchmark/benchmark.h"
+#include "riegeli/base/base.h"
+#include "riegeli/benchmarks/benchmark_corpus.h"
+#include "riegeli/bytes/string_reader.h"
+#include "riegeli/bytes/string_writer.h"
+#include "riegeli/varint/varint_reading.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+namespace {
+
+std::string EncodedVarints() {
+  std::string encoded;
+  StringWriter<> writer(&encoded);
+  for (const uint64_t value : benchmarks::VarintValues()) {
+    WriteVarint64(value, writer);
+  }
+  RIEGELI_CHECK(writer.Close()) << writer.status();
+  return encoded;
+}
+
+void BM_WriteVarint64ToWriter(benchmark::State& state) {
+  const std::vector<uint64_t>& values = benchmarks::VarintValues();
+  std::string encoded;
+  for (auto _ : state) {
+    encoded.clear();
+    StringWriter<> writer(&encoded);
+    for (const uint64_t value : values) WriteVarint64(value, writer);
+    RIEGELI_CHECK(writer.Close()) << writer.status();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(values.size()));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(encoded.size()));
+}
+BENCHMARK(BM_WriteVarint64ToWriter);
+
+void BM_WriteVarint64ToArray(benchmark::State& state) {
+  const std::vector<uint64_t>& values = benchmarks::VarintValues();
+  std::vector<char> encoded(values.size() * kMaxLengthVarint64);
+  size_t size = 0;
+  for (auto _ : state) {
+    char* cursor = encoded.data();
+    for (const uint64_t value : values) cursor = WriteVarint64(value, cursor);
+    size = static_cast<size_t>(cursor - encoded.data());
+    benchmark::DoNotOptimize(encoded.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(values.size()));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(size));
+}
+BENCHMARK(BM_WriteVarint64ToArray);
+
+void BM_ReadVarint64FromReader(benchmark::State& state) {
+  const std::string encoded = EncodedVarints();
+  const size_t num_values = benchmarks::VarintValues().size();
+  for (auto _ : state) {
+    StringReader<> reader(encoded);
+    for (size_t i = 0; i < num_values; ++i) {
+      const absl::optional<uint64_t> value = ReadVarint64(reader);
+      RIEGELI_CHECK(value != absl::nullopt) << reader.status();
+      benchmark::DoNotOptimize(*value);
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(num_values));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(encoded.size()));
+}
+BENCHMARK(BM_ReadVarint64FromReader);
+
+void BM_ReadVarint64FromArray(benchmark::State& state) {
+  const std::string encoded = EncodedVarints();
+  const size_t num_values = benchmarks::VarintValues().size();
+  for (auto _ : state) {
+    const char* cursor = encoded.data();
+    const char* const limit = encoded.data() + encoded.size();
+    for (size_t i = 0; i < num_values; ++i) {
+      const absl::optional<ReadFromStringResult<uint64_t>> result =
+          ReadVarint64(cursor, limit);
+      RIEGELI_CHECK(result != absl::nullopt) << "Invalid varint";
+      benchmark::DoNotOptimize(result->value);
+      cursor = result->cursor;
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(num_values));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(encoded.size()));
+}
+BENCHMARK(BM_ReadVarint64FromArray);
+
+}  // namespace
+}  // namespace riegeli
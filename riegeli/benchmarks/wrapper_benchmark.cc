@@ -0,0 +1,112 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "benchmark/benchmark.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/benchmarks/benchmark_corpus.h"
+#include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/limiting_reader.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/wrapped_reader.h"
+
+namespace riegeli {
+namespace {
+
+// Blocks of the source are small, so that reads often cross block boundaries
+// and go through slow paths of each layer.
+constexpr size_t kBlockSize = 256;
+constexpr size_t kReadSize = 100;
+
+const Chain& FragmentedCorpus() {
+  static const Chain* const kChain = [] {
+    const std::string& text = benchmarks::TextCorpus();
+    Chain* const chain = new Chain();
+    for (size_t pos = 0; pos < text.size(); pos += kBlockSize) {
+      // `text` has static storage duration, so it can be attached directly.
+      chain->Append(
+          Chain::FromExternal(absl::string_view(text).substr(pos, kBlockSize)));
+    }
+    return chain;
+  }();
+  return *kChain;
+}
+
+void ReadAllInPieces(Reader& reader) {
+  char buffer[kReadSize];
+  while (reader.Read(kReadSize, buffer)) {
+    benchmark::DoNotOptimize(buffer);
+  }
+}
+
+// Reads through `state.range(0)` nested `LimitingReader`s, which collapse into
+// one layer.
+void BM_ReadThroughLimitingReaders(benchmark::State& state) {
+  const Chain& src = FragmentedCorpus();
+  const size_t num_layers = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    ChainReader<> chain_reader(&src);
+    // `std::deque` keeps addresses of elements stable.
+    std::deque<LimitingReader<>> layers;
+    Reader* reader = &chain_reader;
+    for (size_t i = 0; i < num_layers; ++i) {
+      layers.emplace_back(reader, src.size() - i);
+      reader = &layers.back();
+    }
+    ReadAllInPieces(*reader);
+    while (!layers.empty()) {
+      RIEGELI_CHECK(layers.back().Close()) << layers.back().status();
+      layers.pop_back();
+    }
+    RIEGELI_CHECK(chain_reader.Close()) << chain_reader.status();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(src.size()));
+}
+BENCHMARK(BM_ReadThroughLimitingReaders)->DenseRange(0, 4);
+
+// Reads through `state.range(0)` nested `WrappedReader`s, each adding a layer
+// of virtual calls on slow paths, for comparison.
+void BM_ReadThroughWrappedReaders(benchmark::State& state) {
+  const Chain& src = FragmentedCorpus();
+  const size_t num_layers = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    ChainReader<> chain_reader(&src);
+    std::deque<WrappedReader<>> layers;
+    Reader* reader = &chain_reader;
+    for (size_t i = 0; i < num_layers; ++i) {
+      layers.emplace_back(reader);
+      reader = &layers.back();
+    }
+    ReadAllInPieces(*reader);
+    while (!layers.empty()) {
+      RIEGELI_CHECK(layers.back().Close()) << layers.back().status();
+      layers.pop_back();
+    }
+    RIEGELI_CHECK(chain_reader.Close()) << chain_reader.status();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(src.size()));
+}
+BENCHMARK(BM_ReadThroughWrappedReaders)->DenseRange(0, 4);
+
+}  // namespace
+}  // namespace riegeli
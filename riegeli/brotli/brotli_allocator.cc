@@ -16,6 +16,18 @@
 
 #include <stddef.h>
 
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/memory.h"
+
 namespace riegeli {
 
 namespace internal {
@@ -30,6 +42,87 @@ void RiegeliBrotliFreeFunc(void* opaque, void* ptr) {
 
 }  // namespace internal
 
+#if __cplusplus < 201703
+constexpr size_t BrotliAllocator::kMaxRetainedBytes;
+#endif
+
 BrotliAllocator::Interface::~Interface() {}
 
+// Each block is preceded by a header holding its usable size, so that `Free()`
+// can find the free list to return the block to.
+class BrotliAllocator::RecyclingImplementation : public Interface {
+ public:
+  RecyclingImplementation() noexcept {}
+
+  RecyclingImplementation(const RecyclingImplementation&) = delete;
+  RecyclingImplementation& operator=(const RecyclingImplementation&) = delete;
+
+  ~RecyclingImplementation();
+
+  void* Alloc(size_t size) const override;
+  void Free(void* ptr) const override;
+
+ private:
+  static constexpr size_t kHeaderSize = alignof(max_align_t);
+
+  mutable absl::Mutex mutex_;
+  // Free blocks keyed by their usable size, pointing to their headers.
+  mutable absl::flat_hash_map<size_t, std::vector<void*>> free_blocks_
+      ABSL_GUARDED_BY(mutex_);
+  // Total usable size of `free_blocks_`.
+  mutable size_t retained_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+#if __cplusplus < 201703
+constexpr size_t BrotliAllocator::RecyclingImplementation::kHeaderSize;
+#endif
+
+BrotliAllocator::RecyclingImplementation::~RecyclingImplementation() {
+  for (const auto& entry : free_blocks_) {
+    for (void* const block : entry.second) std::free(block);
+  }
+}
+
+void* BrotliAllocator::RecyclingImplementation::Alloc(size_t size) const {
+  {
+    absl::MutexLock lock(&mutex_);
+    const auto iter = free_blocks_.find(size);
+    if (iter != free_blocks_.end() && !iter->second.empty()) {
+      void* const block = iter->second.back();
+      iter->second.pop_back();
+      retained_bytes_ -= size;
+      return static_cast<char*>(block) + kHeaderSize;
+    }
+  }
+  if (ABSL_PREDICT_FALSE(size > std::numeric_limits<size_t>::max() -
+                                    kHeaderSize)) {
+    return nullptr;
+  }
+  void* const block = std::malloc(kHeaderSize + size);
+  if (ABSL_PREDICT_FALSE(block == nullptr)) return nullptr;
+  *static_cast<size_t*>(block) = size;
+  return static_cast<char*>(block) + kHeaderSize;
+}
+
+void BrotliAllocator::RecyclingImplementation::Free(void* ptr) const {
+  if (ptr == nullptr) return;
+  void* const block = static_cast<char*>(ptr) - kHeaderSize;
+  const size_t size = *static_cast<const size_t*>(block);
+  {
+    absl::MutexLock lock(&mutex_);
+    if (size <= kMaxRetainedBytes - retained_bytes_) {
+      free_blocks_[size].push_back(block);
+      retained_bytes_ += size;
+      return;
+    }
+  }
+  std::free(block);
+}
+
+BrotliAllocator BrotliAllocator::Recycling() {
+  static const NoDestructor<std::shared_ptr<const Interface>> kRecycling(
+      std::make_shared<const RecyclingImplementation>());
+  return BrotliAllocator(*kRecycling);
+}
+
 }  // namespace riegeli
@@ -52,6 +52,20 @@ class BrotliAllocator {
   explicit BrotliAllocator(AllocFunctor&& alloc_functor,
                            FreeFunctor&& free_functor);
 
+  // Returns an allocator which keeps blocks of memory freed by the Brotli
+  // engine and reuses them for later allocations of the same size, instead of
+  // returning them to the system.
+  //
+  // Brotli encoder and decoder states cannot be reset for another stream, so
+  // each stream creates a new state. With this allocator its large tables and
+  // buffers are taken from the previous streams, which reduces allocation
+  // overhead when many small streams are processed, e.g. chunks.
+  //
+  // The allocator is shared by the whole process and is thread-safe. Retained
+  // memory is bounded by `kMaxRetainedBytes`.
+  static constexpr size_t kMaxRetainedBytes = size_t{64} << 20;
+  static BrotliAllocator Recycling();
+
   // Returns parameters for `Brotli{Encoder,Decoder}CreateInstance()`.
   brotli_alloc_func alloc_func() const;
   brotli_free_func free_func() const;
@@ -72,6 +86,11 @@ class BrotliAllocator {
   template <typename AllocFunctor, typename FreeFunctor>
   class Implementation;
 
+  class RecyclingImplementation;
+
+  explicit BrotliAllocator(std::shared_ptr<const Interface> impl) noexcept
+      : impl_(std::move(impl)) {}
+
   std::shared_ptr<const Interface> impl_;
 };
 
@@ -0,0 +1,74 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/brotli/brotli_dictionary.h"
+
+#include <stdint.h>
+
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "brotli/encode.h"
+#include "brotli/shared_dictionary.h"
+#include "riegeli/base/base.h"
+
+namespace riegeli {
+
+struct BrotliDictionary::Shared {
+  absl::Mutex mutex;
+  int compression_level ABSL_GUARDED_BY(mutex) =
+      std::numeric_limits<int>::min();
+  std::shared_ptr<const BrotliEncoderPreparedDictionary> prepared_dictionary
+      ABSL_GUARDED_BY(mutex);
+};
+
+std::shared_ptr<BrotliDictionary::Shared> BrotliDictionary::EnsureShared()
+    const {
+  absl::MutexLock lock(&mutex_);
+  if (shared_ == nullptr) shared_ = std::make_shared<Shared>();
+  return shared_;
+}
+
+std::shared_ptr<const BrotliEncoderPreparedDictionary>
+BrotliDictionary::PrepareDictionary(int compression_level) const {
+  RIEGELI_ASSERT(!empty())
+      << "Failed precondition of BrotliDictionary::PrepareDictionary(): "
+         "no dictionary";
+  RIEGELI_ASSERT_NE(compression_level, std::numeric_limits<int>::min())
+      << "Failed precondition of BrotliDictionary::PrepareDictionary(): "
+         "compression level out of range";
+  const std::shared_ptr<Shared> shared = EnsureShared();
+  {
+    absl::MutexLock lock(&shared->mutex);
+    if (shared->compression_level == compression_level) {
+      return shared->prepared_dictionary;
+    }
+  }
+  // The prepared dictionary refers to `data()` without copying it.
+  std::unique_ptr<BrotliEncoderPreparedDictionary,
+                  BrotliEncoderPreparedDictionaryDeleter>
+      prepared_dictionary(BrotliEncoderPrepareDictionary(
+          BROTLI_SHARED_DICTIONARY_RAW, data().size(),
+          reinterpret_cast<const uint8_t*>(data().data()), compression_level,
+          nullptr, nullptr, nullptr));
+  absl::MutexLock lock(&shared->mutex);
+  shared->compression_level = compression_level;
+  shared->prepared_dictionary = std::move(prepared_dictionary);
+  return shared->prepared_dictionary;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,176 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BROTLI_BROTLI_DICTIONARY_H_
+#define RIEGELI_BROTLI_BROTLI_DICTIONARY_H_
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "brotli/encode.h"
+
+namespace riegeli {
+
+// A custom shared dictionary for Brotli, used in addition to the built-in
+// dictionary of the Brotli format. Compressed data can refer to the dictionary
+// as if it preceded them.
+//
+// The same dictionary must be used for compression and decompression.
+// `BrotliDictionary` is used by both `BrotliWriter` and `BrotliReader`.
+//
+// Copying a `BrotliDictionary` shares the dictionary data (unless set with
+// `set_data_unowned()`) and the dictionary prepared for compression.
+class BrotliDictionary {
+ public:
+  BrotliDictionary() noexcept {}
+
+  BrotliDictionary(const BrotliDictionary& that);
+  BrotliDictionary& operator=(const BrotliDictionary& that);
+
+  BrotliDictionary(BrotliDictionary&& that) noexcept;
+  BrotliDictionary& operator=(BrotliDictionary&& that) noexcept;
+
+  // Sets parameters to defaults.
+  BrotliDictionary& reset() & {
+    owned_data_.reset();
+    data_ = absl::string_view();
+    InvalidateShared();
+    return *this;
+  }
+  BrotliDictionary&& reset() && { return std::move(reset()); }
+
+  // Sets a dictionary, interpreted as raw data.
+  //
+  // `std::string&&` is accepted with a template to avoid implicit conversions
+  // to `std::string` which can be ambiguous against `absl::string_view`
+  // (e.g. `const char*`).
+  BrotliDictionary& set_data(absl::string_view data) & {
+    owned_data_ = std::make_shared<const std::string>(data);
+    data_ = *owned_data_;
+    InvalidateShared();
+    return *this;
+  }
+  template <typename Src,
+            std::enable_if_t<std::is_same<Src, std::string>::value, int> = 0>
+  BrotliDictionary& set_data(Src&& data) & {
+    // `std::move(data)` is correct and `std::forward<Src>(data)` is not
+    // necessary: `Src` is always `std::string`, never an lvalue reference.
+    owned_data_ = std::make_shared<const std::string>(std::move(data));
+    data_ = *owned_data_;
+    InvalidateShared();
+    return *this;
+  }
+  BrotliDictionary&& set_data(absl::string_view data) && {
+    return std::move(set_data(data));
+  }
+  template <typename Src,
+            std::enable_if_t<std::is_same<Src, std::string>::value, int> = 0>
+  BrotliDictionary&& set_data(Src&& data) && {
+    // `std::move(data)` is correct and `std::forward<Src>(data)` is not
+    // necessary: `Src` is always `std::string`, never an lvalue reference.
+    return std::move(set_data(std::move(data)));
+  }
+
+  // Like `set_data()`, but does not take ownership of `data`, which must not
+  // be changed until the last `BrotliWriter` or `BrotliReader` using this
+  // dictionary is closed or no longer used.
+  BrotliDictionary& set_data_unowned(absl::string_view data) & {
+    owned_data_.reset();
+    data_ = data;
+    InvalidateShared();
+    return *this;
+  }
+  BrotliDictionary&& set_data_unowned(absl::string_view data) && {
+    return std::move(set_data_unowned(data));
+  }
+
+  // Returns `true` if no dictionary is present.
+  bool empty() const { return data_.empty(); }
+
+  // Returns the dictionary data.
+  absl::string_view data() const { return data_; }
+
+ private:
+  friend class BrotliWriterBase;
+
+  struct BrotliEncoderPreparedDictionaryDeleter {
+    void operator()(BrotliEncoderPreparedDictionary* ptr) const {
+      BrotliEncoderDestroyPreparedDictionary(ptr);
+    }
+  };
+
+  struct Shared;
+
+  // Ensures that `shared_` is present.
+  std::shared_ptr<Shared> EnsureShared() const;
+
+  // Clears `shared_`.
+  void InvalidateShared() { shared_.reset(); }
+
+  // Returns the dictionary prepared for compression, or `nullptr` if
+  // `BrotliEncoderPrepareDictionary()` failed.
+  //
+  // Precondition: `!empty()`
+  std::shared_ptr<const BrotliEncoderPreparedDictionary> PrepareDictionary(
+      int compression_level) const;
+
+  std::shared_ptr<const std::string> owned_data_;
+  absl::string_view data_;
+
+  mutable absl::Mutex mutex_;
+  // If multiple `BrotliDictionary` objects are known to use the same
+  // dictionary, `shared_` is present and shared between them, to avoid
+  // preparing the dictionary from the same data multiple times.
+  //
+  // `shared_` is guarded by `mutex_` for const access. It is not guarded for
+  // non-const access which is assumed to be exclusive.
+  mutable std::shared_ptr<Shared> shared_;
+};
+
+// Implementation details follow.
+
+inline BrotliDictionary::BrotliDictionary(const BrotliDictionary& that)
+    : owned_data_(that.owned_data_),
+      data_(that.data_),
+      shared_(that.empty() ? nullptr : that.EnsureShared()) {}
+
+inline BrotliDictionary& BrotliDictionary::operator=(
+    const BrotliDictionary& that) {
+  owned_data_ = that.owned_data_;
+  data_ = that.data_;
+  shared_ = that.empty() ? nullptr : that.EnsureShared();
+  return *this;
+}
+
+inline BrotliDictionary::BrotliDictionary(BrotliDictionary&& that) noexcept
+    : owned_data_(std::move(that.owned_data_)),
+      data_(std::exchange(that.data_, absl::string_view())),
+      shared_(std::move(that.shared_)) {}
+
+inline BrotliDictionary& BrotliDictionary::operator=(
+    BrotliDictionary&& that) noexcept {
+  owned_data_ = std::move(that.owned_data_);
+  data_ = std::exchange(that.data_, absl::string_view());
+  shared_ = std::move(that.shared_);
+  return *this;
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BROTLI_BROTLI_DICTIONARY_H_
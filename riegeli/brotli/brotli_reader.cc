@@ -25,6 +25,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "brotli/decode.h"
+#include "brotli/shared_dictionary.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/pullable_reader.h"
@@ -55,6 +56,15 @@ inline void BrotliReaderBase::InitializeDecompressor() {
           uint32_t{true}))) {
     Fail(absl::InternalError(
         "BrotliDecoderSetParameter(BROTLI_DECODER_PARAM_LARGE_WINDOW) failed"));
+    return;
+  }
+  if (!dictionary_.empty()) {
+    if (ABSL_PREDICT_FALSE(!BrotliDecoderAttachDictionary(
+            decompressor_.get(), BROTLI_SHARED_DICTIONARY_RAW,
+            dictionary_.data().size(),
+            reinterpret_cast<const uint8_t*>(dictionary_.data().data())))) {
+      Fail(absl::InternalError("BrotliDecoderAttachDictionary() failed"));
+    }
   }
 }
 
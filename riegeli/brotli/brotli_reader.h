@@ -29,6 +29,7 @@
 #include "riegeli/base/dependency.h"
 #include "riegeli/base/object.h"
 #include "riegeli/brotli/brotli_allocator.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/pullable_reader.h"
 #include "riegeli/bytes/reader.h"
 
@@ -41,6 +42,27 @@ class BrotliReaderBase : public PullableReader {
    public:
     Options() noexcept {}
 
+    // Shared dictionary. It must be the dictionary used for compression, if
+    // any.
+    //
+    // Default: `BrotliDictionary()` (no dictionary).
+    Options& set_dictionary(const BrotliDictionary& dictionary) & {
+      dictionary_ = dictionary;
+      return *this;
+    }
+    Options& set_dictionary(BrotliDictionary&& dictionary) & {
+      dictionary_ = std::move(dictionary);
+      return *this;
+    }
+    Options&& set_dictionary(const BrotliDictionary& dictionary) && {
+      return std::move(set_dictionary(dictionary));
+    }
+    Options&& set_dictionary(BrotliDictionary&& dictionary) && {
+      return std::move(set_dictionary(std::move(dictionary)));
+    }
+    BrotliDictionary& dictionary() { return dictionary_; }
+    const BrotliDictionary& dictionary() const { return dictionary_; }
+
     // Memory allocator used by the Brotli engine.
     //
     // Default: `BrotliAllocator()`.
@@ -62,6 +84,7 @@ class BrotliReaderBase : public PullableReader {
     const BrotliAllocator& allocator() const { return allocator_; }
 
    private:
+    BrotliDictionary dictionary_;
     BrotliAllocator allocator_;
   };
 
@@ -79,13 +102,14 @@ class BrotliReaderBase : public PullableReader {
  protected:
   BrotliReaderBase() noexcept : PullableReader(kInitiallyClosed) {}
 
-  explicit BrotliReaderBase(BrotliAllocator&& allocator);
+  explicit BrotliReaderBase(BrotliDictionary&& dictionary,
+                            BrotliAllocator&& allocator);
 
   BrotliReaderBase(BrotliReaderBase&& that) noexcept;
   BrotliReaderBase& operator=(BrotliReaderBase&& that) noexcept;
 
   void Reset();
-  void Reset(BrotliAllocator&& allocator);
+  void Reset(BrotliDictionary&& dictionary, BrotliAllocator&& allocator);
   void Initialize(Reader* src);
 
   void Done() override;
@@ -106,6 +130,8 @@ class BrotliReaderBase : public PullableReader {
 
   void InitializeDecompressor();
 
+  // Must outlive `decompressor_`, which refers to its data.
+  BrotliDictionary dictionary_;
   BrotliAllocator allocator_;
   // If `true`, the source is truncated (without a clean end of the compressed
   // stream) at the current position. If the source does not grow, `Close()`
@@ -199,13 +225,17 @@ explicit BrotliReader(
 
 // Implementation details follow.
 
-inline BrotliReaderBase::BrotliReaderBase(BrotliAllocator&& allocator)
-    : PullableReader(kInitiallyOpen), allocator_(std::move(allocator)) {}
+inline BrotliReaderBase::BrotliReaderBase(BrotliDictionary&& dictionary,
+                                          BrotliAllocator&& allocator)
+    : PullableReader(kInitiallyOpen),
+      dictionary_(std::move(dictionary)),
+      allocator_(std::move(allocator)) {}
 
 inline BrotliReaderBase::BrotliReaderBase(BrotliReaderBase&& that) noexcept
     : PullableReader(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
+      dictionary_(std::move(that.dictionary_)),
       allocator_(std::move(that.allocator_)),
       truncated_(that.truncated_),
       initial_compressed_pos_(that.initial_compressed_pos_),
@@ -216,10 +246,13 @@ inline BrotliReaderBase& BrotliReaderBase::operator=(
   PullableReader::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
+  // `decompressor_` is assigned first because it refers to the previous
+  // `dictionary_` and `allocator_`.
+  decompressor_ = std::move(that.decompressor_);
+  dictionary_ = std::move(that.dictionary_);
   allocator_ = std::move(that.allocator_);
   truncated_ = that.truncated_;
   initial_compressed_pos_ = that.initial_compressed_pos_;
-  decompressor_ = std::move(that.decompressor_);
   return *this;
 }
 
@@ -228,26 +261,33 @@ inline void BrotliReaderBase::Reset() {
   truncated_ = false;
   initial_compressed_pos_ = 0;
   decompressor_.reset();
+  dictionary_ = BrotliDictionary();
   allocator_ = BrotliAllocator();
 }
 
-inline void BrotliReaderBase::Reset(BrotliAllocator&& allocator) {
+inline void BrotliReaderBase::Reset(BrotliDictionary&& dictionary,
+                                    BrotliAllocator&& allocator) {
   PullableReader::Reset(kInitiallyOpen);
   truncated_ = false;
   initial_compressed_pos_ = 0;
   decompressor_.reset();
+  dictionary_ = std::move(dictionary);
   allocator_ = std::move(allocator);
 }
 
 template <typename Src>
 inline BrotliReader<Src>::BrotliReader(const Src& src, Options options)
-    : BrotliReaderBase(std::move(options.allocator())), src_(src) {
+    : BrotliReaderBase(std::move(options.dictionary()),
+                       std::move(options.allocator())),
+      src_(src) {
   Initialize(src_.get());
 }
 
 template <typename Src>
 inline BrotliReader<Src>::BrotliReader(Src&& src, Options options)
-    : BrotliReaderBase(std::move(options.allocator())), src_(std::move(src)) {
+    : BrotliReaderBase(std::move(options.dictionary()),
+                       std::move(options.allocator())),
+      src_(std::move(src)) {
   Initialize(src_.get());
 }
 
@@ -255,7 +295,8 @@ template <typename Src>
 template <typename... SrcArgs>
 inline BrotliReader<Src>::BrotliReader(std::tuple<SrcArgs...> src_args,
                                        Options options)
-    : BrotliReaderBase(std::move(options.allocator())),
+    : BrotliReaderBase(std::move(options.dictionary()),
+                       std::move(options.allocator())),
       src_(std::move(src_args)) {
   Initialize(src_.get());
 }
@@ -285,14 +326,16 @@ inline void BrotliReader<Src>::Reset() {
 
 template <typename Src>
 inline void BrotliReader<Src>::Reset(const Src& src, Options options) {
-  BrotliReaderBase::Reset(std::move(options.allocator()));
+  BrotliReaderBase::Reset(std::move(options.dictionary()),
+                          std::move(options.allocator()));
   src_.Reset(src);
   Initialize(src_.get());
 }
 
 template <typename Src>
 inline void BrotliReader<Src>::Reset(Src&& src, Options options) {
-  BrotliReaderBase::Reset(std::move(options.allocator()));
+  BrotliReaderBase::Reset(std::move(options.dictionary()),
+                          std::move(options.allocator()));
   src_.Reset(std::move(src));
   Initialize(src_.get());
 }
@@ -301,7 +344,8 @@ template <typename Src>
 template <typename... SrcArgs>
 inline void BrotliReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
                                      Options options) {
-  BrotliReaderBase::Reset(std::move(options.allocator()));
+  BrotliReaderBase::Reset(std::move(options.dictionary()),
+                          std::move(options.allocator()));
   src_.Reset(std::move(src_args));
   Initialize(src_.get());
 }
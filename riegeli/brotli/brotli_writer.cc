@@ -69,6 +69,19 @@ void BrotliWriterBase::Initialize(Writer* dest, int compression_level,
         "BrotliEncoderSetParameter(BROTLI_PARAM_QUALITY) failed"));
     return;
   }
+  if (!dictionary_.empty()) {
+    prepared_dictionary_ = dictionary_.PrepareDictionary(compression_level);
+    if (ABSL_PREDICT_FALSE(prepared_dictionary_ == nullptr)) {
+      Fail(absl::InternalError("BrotliEncoderPrepareDictionary() failed"));
+      return;
+    }
+    if (ABSL_PREDICT_FALSE(!BrotliEncoderAttachPreparedDictionary(
+            compressor_.get(), prepared_dictionary_.get()))) {
+      Fail(absl::InternalError(
+          "BrotliEncoderAttachPreparedDictionary() failed"));
+      return;
+    }
+  }
   // Reduce `window_log` if `size_hint` indicates that data will be smaller.
   // TODO(eustas): Do this automatically in the Brotli engine.
   if (size_hint != absl::nullopt) {
@@ -119,6 +132,7 @@ void BrotliWriterBase::DoneBehindBuffer(absl::string_view src) {
 void BrotliWriterBase::Done() {
   BufferedWriter::Done();
   compressor_.reset();
+  prepared_dictionary_.reset();
 }
 
 void BrotliWriterBase::AnnotateFailure(absl::Status& status) {
@@ -31,6 +31,7 @@
 #include "riegeli/base/base.h"
 #include "riegeli/base/dependency.h"
 #include "riegeli/brotli/brotli_allocator.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/buffered_writer.h"
 #include "riegeli/bytes/writer.h"
 
@@ -94,6 +95,28 @@ class BrotliWriterBase : public BufferedWriter {
     }
     int window_log() const { return window_log_; }
 
+    // Shared dictionary. This improves compression of small data which share
+    // content with the dictionary. The same dictionary must be used for
+    // decompression.
+    //
+    // Default: `BrotliDictionary()` (no dictionary).
+    Options& set_dictionary(const BrotliDictionary& dictionary) & {
+      dictionary_ = dictionary;
+      return *this;
+    }
+    Options& set_dictionary(BrotliDictionary&& dictionary) & {
+      dictionary_ = std::move(dictionary);
+      return *this;
+    }
+    Options&& set_dictionary(const BrotliDictionary& dictionary) && {
+      return std::move(set_dictionary(dictionary));
+    }
+    Options&& set_dictionary(BrotliDictionary&& dictionary) && {
+      return std::move(set_dictionary(std::move(dictionary)));
+    }
+    BrotliDictionary& dictionary() { return dictionary_; }
+    const BrotliDictionary& dictionary() const { return dictionary_; }
+
     // Memory allocator used by the Brotli engine.
     //
     // Default: `BrotliAllocator()`.
@@ -152,6 +175,7 @@ class BrotliWriterBase : public BufferedWriter {
    private:
     int compression_level_ = kDefaultCompressionLevel;
     int window_log_ = kDefaultWindowLog;
+    BrotliDictionary dictionary_;
     BrotliAllocator allocator_;
     absl::optional<Position> size_hint_;
     size_t buffer_size_ = kDefaultBufferSize;
@@ -164,15 +188,16 @@ class BrotliWriterBase : public BufferedWriter {
  protected:
   BrotliWriterBase() noexcept {}
 
-  explicit BrotliWriterBase(BrotliAllocator&& allocator, size_t buffer_size,
+  explicit BrotliWriterBase(BrotliDictionary&& dictionary,
+                            BrotliAllocator&& allocator, size_t buffer_size,
                             absl::optional<Position> size_hint);
 
   BrotliWriterBase(BrotliWriterBase&& that) noexcept;
   BrotliWriterBase& operator=(BrotliWriterBase&& that) noexcept;
 
   void Reset();
-  void Reset(BrotliAllocator&& allocator, size_t buffer_size,
-             absl::optional<Position> size_hint);
+  void Reset(BrotliDictionary&& dictionary, BrotliAllocator&& allocator,
+             size_t buffer_size, absl::optional<Position> size_hint);
   void Initialize(Writer* dest, int compression_level, int window_log,
                   absl::optional<Position> size_hint);
 
@@ -196,7 +221,10 @@ class BrotliWriterBase : public BufferedWriter {
   bool WriteInternal(absl::string_view src, Writer& dest,
                      BrotliEncoderOperation op);
 
+  BrotliDictionary dictionary_;
   BrotliAllocator allocator_;
+  // Must outlive `compressor_`, which refers to it.
+  std::shared_ptr<const BrotliEncoderPreparedDictionary> prepared_dictionary_;
   std::unique_ptr<BrotliEncoderState, BrotliEncoderStateDeleter> compressor_;
 };
 
@@ -278,17 +306,21 @@ explicit BrotliWriter(
 
 // Implementation details follow.
 
-inline BrotliWriterBase::BrotliWriterBase(BrotliAllocator&& allocator,
+inline BrotliWriterBase::BrotliWriterBase(BrotliDictionary&& dictionary,
+                                          BrotliAllocator&& allocator,
                                           size_t buffer_size,
                                           absl::optional<Position> size_hint)
     : BufferedWriter(buffer_size, size_hint),
+      dictionary_(std::move(dictionary)),
       allocator_(std::move(allocator)) {}
 
 inline BrotliWriterBase::BrotliWriterBase(BrotliWriterBase&& that) noexcept
     : BufferedWriter(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
+      dictionary_(std::move(that.dictionary_)),
       allocator_(std::move(that.allocator_)),
+      prepared_dictionary_(std::move(that.prepared_dictionary_)),
       compressor_(std::move(that.compressor_)) {}
 
 inline BrotliWriterBase& BrotliWriterBase::operator=(
@@ -296,28 +328,38 @@ inline BrotliWriterBase& BrotliWriterBase::operator=(
   BufferedWriter::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
-  allocator_ = std::move(that.allocator_);
+  // `compressor_` is assigned first because it refers to the previous
+  // `prepared_dictionary_`.
   compressor_ = std::move(that.compressor_);
+  dictionary_ = std::move(that.dictionary_);
+  allocator_ = std::move(that.allocator_);
+  prepared_dictionary_ = std::move(that.prepared_dictionary_);
   return *this;
 }
 
 inline void BrotliWriterBase::Reset() {
   BufferedWriter::Reset();
   compressor_.reset();
+  prepared_dictionary_.reset();
+  dictionary_ = BrotliDictionary();
   allocator_ = BrotliAllocator();
 }
 
-inline void BrotliWriterBase::Reset(BrotliAllocator&& allocator,
+inline void BrotliWriterBase::Reset(BrotliDictionary&& dictionary,
+                                    BrotliAllocator&& allocator,
                                     size_t buffer_size,
                                     absl::optional<Position> size_hint) {
   BufferedWriter::Reset(buffer_size, size_hint);
   compressor_.reset();
+  prepared_dictionary_.reset();
+  dictionary_ = std::move(dictionary);
   allocator_ = std::move(allocator);
 }
 
 template <typename Dest>
 inline BrotliWriter<Dest>::BrotliWriter(const Dest& dest, Options options)
-    : BrotliWriterBase(std::move(options.allocator()), options.buffer_size(),
+    : BrotliWriterBase(std::move(options.dictionary()),
+                       std::move(options.allocator()), options.buffer_size(),
                        options.size_hint()),
       dest_(dest) {
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
@@ -326,7 +368,8 @@ inline BrotliWriter<Dest>::BrotliWriter(const Dest& dest, Options options)
 
 template <typename Dest>
 inline BrotliWriter<Dest>::BrotliWriter(Dest&& dest, Options options)
-    : BrotliWriterBase(std::move(options.allocator()), options.buffer_size(),
+    : BrotliWriterBase(std::move(options.dictionary()),
+                       std::move(options.allocator()), options.buffer_size(),
                        options.size_hint()),
       dest_(std::move(dest)) {
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
@@ -337,7 +380,8 @@ template <typename Dest>
 template <typename... DestArgs>
 inline BrotliWriter<Dest>::BrotliWriter(std::tuple<DestArgs...> dest_args,
                                         Options options)
-    : BrotliWriterBase(std::move(options.allocator()), options.buffer_size(),
+    : BrotliWriterBase(std::move(options.dictionary()),
+                       std::move(options.allocator()), options.buffer_size(),
                        options.size_hint()),
       dest_(std::move(dest_args)) {
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
@@ -369,7 +413,8 @@ inline void BrotliWriter<Dest>::Reset() {
 
 template <typename Dest>
 inline void BrotliWriter<Dest>::Reset(const Dest& dest, Options options) {
-  BrotliWriterBase::Reset(std::move(options.allocator()), options.buffer_size(),
+  BrotliWriterBase::Reset(std::move(options.dictionary()),
+                          std::move(options.allocator()), options.buffer_size(),
                           options.size_hint());
   dest_.Reset(dest);
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
@@ -378,7 +423,8 @@ inline void BrotliWriter<Dest>::Reset(const Dest& dest, Options options) {
 
 template <typename Dest>
 inline void BrotliWriter<Dest>::Reset(Dest&& dest, Options options) {
-  BrotliWriterBase::Reset(std::move(options.allocator()), options.buffer_size(),
+  BrotliWriterBase::Reset(std::move(options.dictionary()),
+                          std::move(options.allocator()), options.buffer_size(),
                           options.size_hint());
   dest_.Reset(std::move(dest));
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
@@ -389,7 +435,8 @@ template <typename Dest>
 template <typename... DestArgs>
 inline void BrotliWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
                                       Options options) {
-  BrotliWriterBase::Reset(std::move(options.allocator()), options.buffer_size(),
+  BrotliWriterBase::Reset(std::move(options.dictionary()),
+                          std::move(options.allocator()), options.buffer_size(),
                           options.size_hint());
   dest_.Reset(std::move(dest_args));
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
@@ -0,0 +1,296 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_ASYNC_JOINING_READER_H_
+#define RIEGELI_BYTES_ASYNC_JOINING_READER_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/joining_reader.h"
+#include "riegeli/bytes/reader.h"
+
+namespace riegeli {
+
+// Abstract class of a `JoiningReader` which opens the next shard in background
+// while the current shard is being read, and reads its first buffer, so that
+// reading does not stall at shard boundaries, e.g. on remote storage.
+//
+// If shard sizes are known in advance, `AsyncJoiningReader` also supports
+// `Size()` and random access, opening only the shard containing the new
+// position.
+//
+// Instead of `OpenShardImpl()`, a derived class overrides `OpenShardAsync()`,
+// and optionally `AbandonShard()`. They are called in background threads, so
+// they must not access mutable state of `*this` other than their arguments.
+//
+// The `Shard` template parameter is as for `JoiningReader`, and it must be
+// default-constructible and movable without invalidating the buffer of the
+// shard `Reader`, e.g. `std::unique_ptr<Reader>` or `FdReader<>`.
+//
+// `Close()` must be called by the destructor of the most derived class if it
+// was not called earlier, because opening ahead calls virtual functions of
+// `*this`.
+template <typename Shard>
+class AsyncJoiningReader : public JoiningReader<Shard> {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // If `true`, the next shard is opened in background while the current
+    // shard is being read, and its first buffer is read.
+    //
+    // Default: `true`.
+    Options& set_open_ahead(bool open_ahead) & {
+      open_ahead_ = open_ahead;
+      return *this;
+    }
+    Options&& set_open_ahead(bool open_ahead) && {
+      return std::move(set_open_ahead(open_ahead));
+    }
+    bool open_ahead() const { return open_ahead_; }
+
+    // If set, the sizes of all shards in order. This enables `Size()` and
+    // random access.
+    //
+    // The sizes must be accurate: a shard which ends early or late makes
+    // positions of later shards wrong.
+    //
+    // Default: `absl::nullopt` (shard sizes are unknown).
+    Options& set_shard_sizes(absl::optional<std::vector<Position>> shard_sizes)
+        & {
+      shard_sizes_ = std::move(shard_sizes);
+      return *this;
+    }
+    Options&& set_shard_sizes(
+        absl::optional<std::vector<Position>> shard_sizes) && {
+      return std::move(set_shard_sizes(std::move(shard_sizes)));
+    }
+    absl::optional<std::vector<Position>>& shard_sizes() {
+      return shard_sizes_;
+    }
+    const absl::optional<std::vector<Position>>& shard_sizes() const {
+      return shard_sizes_;
+    }
+
+   private:
+    bool open_ahead_ = true;
+    absl::optional<std::vector<Position>> shard_sizes_;
+  };
+
+  AsyncJoiningReader(const AsyncJoiningReader&) = delete;
+  AsyncJoiningReader& operator=(const AsyncJoiningReader&) = delete;
+
+  ~AsyncJoiningReader();
+
+  bool SupportsRandomAccess() override { return !shard_begins_.empty(); }
+
+ protected:
+  // Creates an open `AsyncJoiningReader`. The derived class constructor should
+  // call `OpenShard()`.
+  explicit AsyncJoiningReader(Options options = Options());
+
+  void Done() override;
+
+  // Opens the shard with the given index (0, 1, 2, ...) into `shard`, or sets
+  // `exists` to `false` if there is no such shard.
+  //
+  // This may be called in background, concurrently with reading the previous
+  // shard.
+  virtual absl::Status OpenShardAsync(Position shard_index, Shard& shard,
+                                      bool& exists) = 0;
+
+  // Disposes of a shard opened ahead but not needed.
+  //
+  // The default implementation closes the shard `Reader`, ignoring failures.
+  virtual void AbandonShard(Shard& shard);
+
+  bool OpenShardImpl() override;
+  bool SeekBehindScratch(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
+
+ private:
+  struct OpenedShard {
+    absl::Status status;
+    Shard shard;
+    bool exists = false;
+  };
+
+  OpenedShard OpenShardNow(Position shard_index);
+  void StartOpeningAhead();
+  // Waits for opening ahead, abandoning the shard.
+  void CancelOpeningAhead();
+
+  bool open_ahead_;
+  // If shard sizes are known, positions where shards begin, followed by the
+  // total size; otherwise empty.
+  std::vector<Position> shard_begins_;
+  Position next_shard_index_ = 0;
+  // If valid, the next shard is being opened in background.
+  std::future<OpenedShard> opening_ahead_;
+};
+
+// Implementation details follow.
+
+template <typename Shard>
+inline AsyncJoiningReader<Shard>::AsyncJoiningReader(Options options)
+    : JoiningReader<Shard>(Object::kInitiallyOpen),
+      open_ahead_(options.open_ahead()) {
+  if (options.shard_sizes() != absl::nullopt) {
+    shard_begins_.reserve(options.shard_sizes()->size() + 1);
+    Position pos = 0;
+    shard_begins_.push_back(pos);
+    for (const Position shard_size : *options.shard_sizes()) {
+      pos += shard_size;
+      shard_begins_.push_back(pos);
+    }
+  }
+}
+
+template <typename Shard>
+AsyncJoiningReader<Shard>::~AsyncJoiningReader() {
+  CancelOpeningAhead();
+}
+
+template <typename Shard>
+void AsyncJoiningReader<Shard>::Done() {
+  JoiningReader<Shard>::Done();
+  CancelOpeningAhead();
+}
+
+template <typename Shard>
+void AsyncJoiningReader<Shard>::AbandonShard(Shard& shard) {
+  Dependency<Reader*, Shard> shard_reader(std::move(shard));
+  shard_reader->Close();
+}
+
+template <typename Shard>
+typename AsyncJoiningReader<Shard>::OpenedShard
+AsyncJoiningReader<Shard>::OpenShardNow(Position shard_index) {
+  OpenedShard opened;
+  if (!shard_begins_.empty() && shard_index >= shard_begins_.size() - 1) {
+    return opened;
+  }
+  opened.status = OpenShardAsync(shard_index, opened.shard, opened.exists);
+  return opened;
+}
+
+template <typename Shard>
+void AsyncJoiningReader<Shard>::StartOpeningAhead() {
+  // `std::function` requires a copyable task, hence `std::shared_ptr`.
+  const std::shared_ptr<std::promise<OpenedShard>> promise =
+      std::make_shared<std::promise<OpenedShard>>();
+  opening_ahead_ = promise->get_future();
+  const Position shard_index = next_shard_index_;
+  internal::ThreadPool::global().Schedule([this, promise, shard_index] {
+    OpenedShard opened = OpenShardNow(shard_index);
+    if (opened.status.ok() && opened.exists) {
+      // Read the first buffer. A failure is reported when the shard is read.
+      Dependency<Reader*, Shard> shard_reader(std::move(opened.shard));
+      shard_reader->Pull();
+      opened.shard = std::move(shard_reader.manager());
+    }
+    promise->set_value(std::move(opened));
+  });
+}
+
+template <typename Shard>
+void AsyncJoiningReader<Shard>::CancelOpeningAhead() {
+  if (!opening_ahead_.valid()) return;
+  OpenedShard opened = opening_ahead_.get();
+  if (opened.status.ok() && opened.exists) AbandonShard(opened.shard);
+}
+
+template <typename Shard>
+bool AsyncJoiningReader<Shard>::OpenShardImpl() {
+  OpenedShard opened = opening_ahead_.valid() ? opening_ahead_.get()
+                                              : OpenShardNow(next_shard_index_);
+  if (ABSL_PREDICT_FALSE(!opened.status.ok())) {
+    return this->Fail(std::move(opened.status));
+  }
+  if (!opened.exists) return false;
+  ++next_shard_index_;
+  this->shard() = std::move(opened.shard);
+  if (open_ahead_) StartOpeningAhead();
+  return true;
+}
+
+template <typename Shard>
+bool AsyncJoiningReader<Shard>::SeekBehindScratch(Position new_pos) {
+  if (shard_begins_.empty()) {
+    return JoiningReader<Shard>::SeekBehindScratch(new_pos);
+  }
+  if (ABSL_PREDICT_FALSE(!this->healthy())) return false;
+  // Discard the current shard and the shard opened ahead.
+  this->set_buffer();
+  if (this->shard_is_open()) {
+    Shard shard = std::move(this->shard());
+    this->shard() = Shard();
+    AbandonShard(shard);
+  }
+  CancelOpeningAhead();
+  const Position size = shard_begins_.back();
+  if (new_pos >= size) {
+    // Seeking to the end or past it.
+    next_shard_index_ = shard_begins_.size() - 1;
+    this->set_limit_pos(size);
+    return new_pos == size;
+  }
+  // The shard containing `new_pos` is the last one beginning at or before it.
+  // Empty shards are skipped.
+  const size_t shard_index =
+      IntCast<size_t>(std::upper_bound(shard_begins_.begin(),
+                                       shard_begins_.end(), new_pos) -
+                      shard_begins_.begin()) -
+      1;
+  next_shard_index_ = shard_index;
+  this->set_limit_pos(shard_begins_[shard_index]);
+  if (ABSL_PREDICT_FALSE(!OpenShardImpl())) {
+    if (ABSL_PREDICT_FALSE(!this->healthy())) return false;
+    return this->Fail(absl::DataLossError("Shard expected but missing"));
+  }
+  Reader& shard = *this->shard_reader();
+  const Position pos_in_shard = new_pos - shard_begins_[shard_index];
+  if (ABSL_PREDICT_FALSE(!shard.Seek(pos_in_shard))) {
+    if (ABSL_PREDICT_FALSE(!shard.healthy())) return this->Fail(shard);
+    return this->Fail(absl::DataLossError("Shard shorter than its size"));
+  }
+  this->set_limit_pos(new_pos);
+  this->MakeBuffer(shard);
+  return this->healthy();
+}
+
+template <typename Shard>
+absl::optional<Position> AsyncJoiningReader<Shard>::SizeImpl() {
+  if (shard_begins_.empty()) return JoiningReader<Shard>::SizeImpl();
+  if (ABSL_PREDICT_FALSE(!this->healthy())) return absl::nullopt;
+  return shard_begins_.back();
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_ASYNC_JOINING_READER_H_
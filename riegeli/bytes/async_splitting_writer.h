@@ -0,0 +1,288 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_ASYNC_SPLITTING_WRITER_H_
+#define RIEGELI_BYTES_ASYNC_SPLITTING_WRITER_H_
+
+#include <future>
+#include <memory>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/splitting_writer.h"
+#include "riegeli/bytes/writer.h"
+
+namespace riegeli {
+
+// Abstract class of a `SplittingWriter` which opens and closes shards in
+// background, so that writing does not stall at shard boundaries while a full
+// shard is flushed and closed, and the next shard is created, e.g. on remote
+// storage.
+//
+// Instead of `OpenShardImpl()` and `CloseShardImpl()`, a derived class
+// overrides `OpenShardAsync()`, and optionally `CloseShardAsync()` and
+// `AbandonShard()`. They are called in background threads, so they must not
+// access mutable state of `*this` other than their arguments.
+//
+// The `Shard` template parameter is as for `SplittingWriter`, and it must be
+// default-constructible and movable, e.g. `std::unique_ptr<Writer>` or
+// `FdWriter<>`.
+//
+// `Close()` must be called by the destructor of the most derived class if it
+// was not called earlier, because background operations call virtual functions
+// of `*this`.
+template <typename Shard>
+class AsyncSplittingWriter : public SplittingWriter<Shard> {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // If `true`, the next shard is opened in background while the current
+    // shard is being written. A shard opened this way which is not needed
+    // when writing finishes is passed to `AbandonShard()`.
+    //
+    // Default: `true`.
+    Options& set_open_ahead(bool open_ahead) & {
+      open_ahead_ = open_ahead;
+      return *this;
+    }
+    Options&& set_open_ahead(bool open_ahead) && {
+      return std::move(set_open_ahead(open_ahead));
+    }
+    bool open_ahead() const { return open_ahead_; }
+
+    // Sets the maximum number of full shards being closed in background.
+    // Writing waits if this many shards are pending when another shard fills.
+    //
+    // 0 closes shards synchronously.
+    //
+    // Default: 2.
+    Options& set_max_pending_closes(int max_pending_closes) & {
+      RIEGELI_ASSERT_GE(max_pending_closes, 0)
+          << "Failed precondition of "
+             "AsyncSplittingWriter::Options::set_max_pending_closes(): "
+             "negative number of pending closes";
+      max_pending_closes_ = max_pending_closes;
+      return *this;
+    }
+    Options&& set_max_pending_closes(int max_pending_closes) && {
+      return std::move(set_max_pending_closes(max_pending_closes));
+    }
+    int max_pending_closes() const { return max_pending_closes_; }
+
+   private:
+    bool open_ahead_ = true;
+    int max_pending_closes_ = 2;
+  };
+
+  AsyncSplittingWriter(const AsyncSplittingWriter&) = delete;
+  AsyncSplittingWriter& operator=(const AsyncSplittingWriter&) = delete;
+
+  ~AsyncSplittingWriter();
+
+ protected:
+  // Creates an open `AsyncSplittingWriter`. The derived class constructor
+  // should call `OpenShard()`.
+  explicit AsyncSplittingWriter(Options options = Options());
+
+  void Done() override;
+
+  // Opens the shard with the given index (0, 1, 2, ...) into `shard`, and sets
+  // `size_limit` to its positive size limit.
+  //
+  // This may be called in background, concurrently with writing to the
+  // previous shard and with closing earlier shards.
+  virtual absl::Status OpenShardAsync(Position shard_index, Shard& shard,
+                                      Position& size_limit) = 0;
+
+  // Closes a full shard. If the shard is a temporary destination for shard
+  // data, moves it to the final destination.
+  //
+  // This may be called in background.
+  //
+  // The default implementation closes the shard `Writer`.
+  virtual absl::Status CloseShardAsync(Shard& shard);
+
+  // Disposes of a shard opened ahead but not needed, e.g. deletes its file.
+  //
+  // The default implementation closes the shard `Writer`, ignoring failures.
+  virtual void AbandonShard(Shard& shard);
+
+  Position OpenShardImpl() override;
+  bool CloseShardImpl() override;
+
+ private:
+  struct OpenedShard {
+    absl::Status status;
+    Shard shard;
+    Position size_limit = 0;
+  };
+
+  OpenedShard OpenShardNow();
+  void StartOpeningAhead();
+  // Waits for background operations, abandoning a shard opened ahead.
+  // Returns the first failure of a background close.
+  absl::Status WaitForBackground();
+
+  bool open_ahead_;
+  int max_pending_closes_;
+  Position next_shard_index_ = 0;
+  // If valid, the next shard is being opened in background.
+  std::future<OpenedShard> opening_ahead_;
+  absl::Mutex mutex_;
+  int pending_closes_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::Status close_status_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Implementation details follow.
+
+template <typename Shard>
+inline AsyncSplittingWriter<Shard>::AsyncSplittingWriter(Options options)
+    : SplittingWriter<Shard>(Object::kInitiallyOpen),
+      open_ahead_(options.open_ahead()),
+      max_pending_closes_(options.max_pending_closes()) {}
+
+template <typename Shard>
+AsyncSplittingWriter<Shard>::~AsyncSplittingWriter() {
+  WaitForBackground().IgnoreError();
+}
+
+template <typename Shard>
+void AsyncSplittingWriter<Shard>::Done() {
+  SplittingWriter<Shard>::Done();
+  absl::Status status = WaitForBackground();
+  if (ABSL_PREDICT_FALSE(!status.ok()) && this->healthy()) {
+    this->Fail(std::move(status));
+  }
+}
+
+template <typename Shard>
+absl::Status AsyncSplittingWriter<Shard>::CloseShardAsync(Shard& shard) {
+  Dependency<Writer*, Shard> shard_writer(std::move(shard));
+  if (ABSL_PREDICT_FALSE(!shard_writer->Close())) {
+    return shard_writer->status();
+  }
+  return absl::OkStatus();
+}
+
+template <typename Shard>
+void AsyncSplittingWriter<Shard>::AbandonShard(Shard& shard) {
+  Dependency<Writer*, Shard> shard_writer(std::move(shard));
+  shard_writer->Close();
+}
+
+template <typename Shard>
+typename AsyncSplittingWriter<Shard>::OpenedShard
+AsyncSplittingWriter<Shard>::OpenShardNow() {
+  OpenedShard opened;
+  opened.status =
+      OpenShardAsync(next_shard_index_++, opened.shard, opened.size_limit);
+  return opened;
+}
+
+template <typename Shard>
+void AsyncSplittingWriter<Shard>::StartOpeningAhead() {
+  // `std::function` requires a copyable task, hence `std::shared_ptr`.
+  const std::shared_ptr<std::promise<OpenedShard>> promise =
+      std::make_shared<std::promise<OpenedShard>>();
+  opening_ahead_ = promise->get_future();
+  const Position shard_index = next_shard_index_++;
+  internal::ThreadPool::global().Schedule([this, promise, shard_index] {
+    OpenedShard opened;
+    opened.status =
+        OpenShardAsync(shard_index, opened.shard, opened.size_limit);
+    promise->set_value(std::move(opened));
+  });
+}
+
+template <typename Shard>
+Position AsyncSplittingWriter<Shard>::OpenShardImpl() {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (ABSL_PREDICT_FALSE(!close_status_.ok())) {
+      this->Fail(close_status_);
+      return 0;
+    }
+  }
+  OpenedShard opened =
+      opening_ahead_.valid() ? opening_ahead_.get() : OpenShardNow();
+  if (ABSL_PREDICT_FALSE(!opened.status.ok())) {
+    this->Fail(std::move(opened.status));
+    return 0;
+  }
+  RIEGELI_ASSERT_GT(opened.size_limit, 0u)
+      << "Failed postcondition of AsyncSplittingWriter::OpenShardAsync(): "
+         "zero size limit";
+  this->shard() = std::move(opened.shard);
+  if (open_ahead_) StartOpeningAhead();
+  return opened.size_limit;
+}
+
+template <typename Shard>
+bool AsyncSplittingWriter<Shard>::CloseShardImpl() {
+  // Moving the shard out leaves `shard()` closed.
+  const std::shared_ptr<Shard> closing =
+      std::make_shared<Shard>(std::move(this->shard()));
+  if (max_pending_closes_ == 0) {
+    absl::Status status = CloseShardAsync(*closing);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return this->Fail(std::move(status));
+    return true;
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(
+        +[](AsyncSplittingWriter* self) {
+          return self->pending_closes_ < self->max_pending_closes_;
+        },
+        this));
+    if (ABSL_PREDICT_FALSE(!close_status_.ok())) {
+      return this->Fail(close_status_);
+    }
+    ++pending_closes_;
+  }
+  internal::ThreadPool::global().Schedule([this, closing] {
+    absl::Status status = CloseShardAsync(*closing);
+    absl::MutexLock lock(&mutex_);
+    if (ABSL_PREDICT_FALSE(!status.ok()) && close_status_.ok()) {
+      close_status_ = std::move(status);
+    }
+    --pending_closes_;
+  });
+  return true;
+}
+
+template <typename Shard>
+absl::Status AsyncSplittingWriter<Shard>::WaitForBackground() {
+  if (opening_ahead_.valid()) {
+    OpenedShard opened = opening_ahead_.get();
+    if (opened.status.ok()) AbandonShard(opened.shard);
+  }
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(
+      +[](int* pending_closes) { return *pending_closes == 0; },
+      &pending_closes_));
+  return close_status_;
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_ASYNC_SPLITTING_WRITER_H_
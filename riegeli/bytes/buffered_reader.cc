@@ -18,16 +18,20 @@
 
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/parallelism.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/bytes/writer.h"
@@ -35,6 +39,8 @@
 namespace riegeli {
 
 void BufferedReader::Done() {
+  DoneBackground();
+  read_ahead_.reset();
   if (available() > 0) {
     if (!SupportsRandomAccess()) {
       // Seeking back is not feasible.
@@ -57,7 +63,137 @@ void BufferedReader::VerifyEnd() {
   Reader::VerifyEnd();
 }
 
-inline void BufferedReader::SyncBuffer() {
+size_t BufferedReader::EstimateMemory() const {
+  // A non-empty `buffer_` is usually allocated with `buffer_size_` of
+  // capacity. Blocks read ahead take at most `read_ahead_->max_blocks` of
+  // `read_ahead_->block_size`.
+  size_t memory =
+      buffer_.empty() ? size_t{0} : UnsignedMax(buffer_.size(), buffer_size_);
+  if (read_ahead_ != nullptr) {
+    memory = SaturatingAdd(memory, read_ahead_->max_blocks *
+                                       read_ahead_->block_size);
+  }
+  return memory;
+}
+
+void BufferedReader::set_read_ahead(size_t max_buffers) {
+  DoneBackground();
+  if (max_buffers == 0) {
+    read_ahead_.reset();
+    return;
+  }
+  read_ahead_ = std::make_unique<ReadAhead>(max_buffers, buffer_size_);
+  absl::MutexLock lock(&read_ahead_->mutex);
+  read_ahead_->next_pos = limit_pos();
+}
+
+void BufferedReader::DoneBackground() {
+  if (read_ahead_ == nullptr) return;
+  absl::MutexLock lock(&read_ahead_->mutex);
+  read_ahead_->Discard(limit_pos());
+}
+
+size_t BufferedReader::ReadAheadInternal(Position pos, size_t max_length,
+                                         char* dest, absl::Status& status) {
+  status = absl::UnimplementedError("Read-ahead not supported");
+  return 0;
+}
+
+void BufferedReader::ReadAhead::StartTask(BufferedReader* reader) {
+  if (running || stopped || blocks.size() >= max_blocks) return;
+  running = true;
+  internal::ThreadPool::global().Schedule(
+      [reader, this] { reader->ReadAheadTask(this); });
+}
+
+void BufferedReader::ReadAhead::Discard(Position pos) {
+  cancelled = true;
+  mutex.Await(absl::Condition(
+      +[](bool* running) { return !*running; }, &running));
+  cancelled = false;
+  blocks.clear();
+  next_pos = pos;
+  stopped = false;
+  status = absl::OkStatus();
+}
+
+void BufferedReader::ReadAheadTask(ReadAhead* read_ahead) {
+  absl::MutexLock lock(&read_ahead->mutex);
+  while (!read_ahead->cancelled && !read_ahead->stopped &&
+         read_ahead->blocks.size() < read_ahead->max_blocks) {
+    ReadAheadBlock block;
+    block.data = Buffer(read_ahead->block_size);
+    block.pos = read_ahead->next_pos;
+    absl::Status status;
+    read_ahead->mutex.Unlock();
+    block.length = ReadAheadInternal(block.pos, read_ahead->block_size,
+                                     block.data.data(), status);
+    read_ahead->mutex.Lock();
+    if (read_ahead->cancelled) break;
+    if (block.length == 0) {
+      read_ahead->stopped = true;
+      read_ahead->status = std::move(status);
+      break;
+    }
+    RIEGELI_ASSERT_LE(block.length, read_ahead->block_size)
+        << "BufferedReader::ReadAheadInternal() read more than requested";
+    read_ahead->next_pos += block.length;
+    read_ahead->blocks.push_back(std::move(block));
+  }
+  read_ahead->running = false;
+}
+
+bool BufferedReader::ReadFromReadAhead(size_t min_length, size_t max_length,
+                                       char* dest) {
+  RIEGELI_ASSERT_GT(min_length, 0u)
+      << "Failed precondition of BufferedReader::ReadFromReadAhead(): "
+         "nothing to read";
+  RIEGELI_ASSERT_GE(max_length, min_length)
+      << "Failed precondition of BufferedReader::ReadFromReadAhead(): "
+         "max_length < min_length";
+  ReadAhead& read_ahead = *read_ahead_;
+  absl::MutexLock lock(&read_ahead.mutex);
+  if (read_ahead.blocks.empty()
+          ? read_ahead.next_pos != limit_pos()
+          : read_ahead.blocks.front().pos + read_ahead.blocks.front().consumed !=
+                limit_pos()) {
+    // The position was changed by seeking, data read ahead are not useful.
+    read_ahead.Discard(limit_pos());
+  }
+  for (;;) {
+    if (read_ahead.blocks.empty()) {
+      if (read_ahead.stopped) {
+        // Let the next call try reading again.
+        read_ahead.stopped = false;
+        if (ABSL_PREDICT_FALSE(!read_ahead.status.ok())) {
+          return Fail(std::exchange(read_ahead.status, absl::OkStatus()));
+        }
+        return false;
+      }
+      read_ahead.StartTask(this);
+      read_ahead.mutex.Await(absl::Condition(
+          +[](ReadAhead* read_ahead) {
+            return !read_ahead->blocks.empty() || !read_ahead->running;
+          },
+          &read_ahead));
+      continue;
+    }
+    ReadAheadBlock& block = read_ahead.blocks.front();
+    const size_t length = UnsignedMin(block.length - block.consumed, max_length);
+    std::memcpy(dest, block.data.data() + block.consumed, length);
+    block.consumed += length;
+    move_limit_pos(length);
+    if (block.consumed == block.length) read_ahead.blocks.pop_front();
+    if (length >= min_length) break;
+    dest += length;
+    min_length -= length;
+    max_length -= length;
+  }
+  read_ahead.StartTask(this);
+  return true;
+}
+
+void BufferedReader::SyncBuffer() {
   set_buffer();
   buffer_.Clear();
 }
@@ -97,7 +233,7 @@ bool BufferedReader::PullSlow(size_t min_length, size_t recommended_length) {
   }
   // Read more data into `buffer_`.
   const Position pos_before = limit_pos();
-  const bool ok = ReadInternal(min_length - available_length,
+  const bool ok = ReadFromSource(min_length - available_length,
                                flat_buffer.size(), flat_buffer.data());
   RIEGELI_ASSERT_GE(limit_pos(), pos_before)
       << "BufferedReader::ReadInternal() decreased limit_pos()";
@@ -106,6 +242,11 @@ bool BufferedReader::PullSlow(size_t min_length, size_t recommended_length) {
       << "BufferedReader::ReadInternal() read more than requested";
   buffer_.RemoveSuffix(flat_buffer.size() - IntCast<size_t>(length_read));
   set_buffer(buffer_.data(), buffer_.size(), cursor_index);
+  if (buffer_size_ < max_buffer_size_) {
+    // Reading is sequential since the last seek, so read more at a time.
+    buffer_size_ = buffer_size_ <= max_buffer_size_ / 2 ? buffer_size_ * 2
+                                                        : max_buffer_size_;
+  }
   return ok;
 }
 
@@ -147,7 +288,7 @@ bool BufferedReader::ReadSlow(size_t length, char* dest) {
     }
     SyncBuffer();
     if (ABSL_PREDICT_FALSE(!healthy())) return false;
-    return ReadInternal(length, length, dest);
+    return ReadFromSource(length, length, dest);
   }
   return Reader::ReadSlow(length, dest);
 }
@@ -172,7 +313,7 @@ bool BufferedReader::ReadSlow(size_t length, Chain& dest) {
       SyncBuffer();
       const absl::Span<char> flat_buffer = dest.AppendFixedBuffer(length);
       const Position pos_before = limit_pos();
-      if (ABSL_PREDICT_FALSE(!ReadInternal(
+      if (ABSL_PREDICT_FALSE(!ReadFromSource(
               flat_buffer.size(), flat_buffer.size(), flat_buffer.data()))) {
         RIEGELI_ASSERT_GE(limit_pos(), pos_before)
             << "BufferedReader::ReadInternal() decreased limit_pos()";
@@ -202,7 +343,7 @@ bool BufferedReader::ReadSlow(size_t length, Chain& dest) {
     }
     // Read more data into `buffer_`.
     const Position pos_before = limit_pos();
-    ok = ReadInternal(1, flat_buffer.size(), flat_buffer.data());
+    ok = ReadFromSource(1, flat_buffer.size(), flat_buffer.data());
     RIEGELI_ASSERT_GE(limit_pos(), pos_before)
         << "BufferedReader::ReadInternal() decreased limit_pos()";
     const Position length_read = limit_pos() - pos_before;
@@ -237,7 +378,7 @@ bool BufferedReader::ReadSlow(size_t length, absl::Cord& dest) {
       Buffer flat_buffer(length);
       const Position pos_before = limit_pos();
       if (ABSL_PREDICT_FALSE(
-              !ReadInternal(length, length, flat_buffer.data()))) {
+              !ReadFromSource(length, length, flat_buffer.data()))) {
         RIEGELI_ASSERT_GE(limit_pos(), pos_before)
             << "BufferedReader::ReadInternal() decreased limit_pos()";
         const Position length_read = limit_pos() - pos_before;
@@ -269,7 +410,7 @@ bool BufferedReader::ReadSlow(size_t length, absl::Cord& dest) {
     }
     // Read more data into `buffer_`.
     const Position pos_before = limit_pos();
-    ok = ReadInternal(1, flat_buffer.size(), flat_buffer.data());
+    ok = ReadFromSource(1, flat_buffer.size(), flat_buffer.data());
     RIEGELI_ASSERT_GE(limit_pos(), pos_before)
         << "BufferedReader::ReadInternal() decreased limit_pos()";
     const Position length_read = limit_pos() - pos_before;
@@ -328,7 +469,7 @@ bool BufferedReader::CopySlow(Position length, Writer& dest) {
     }
     // Read more data into `buffer_`.
     const Position pos_before = limit_pos();
-    read_ok = ReadInternal(1, flat_buffer.size(), flat_buffer.data());
+    read_ok = ReadFromSource(1, flat_buffer.size(), flat_buffer.data());
     RIEGELI_ASSERT_GE(limit_pos(), pos_before)
         << "BufferedReader::ReadInternal() decreased limit_pos()";
     const Position length_read = limit_pos() - pos_before;
@@ -372,6 +513,61 @@ bool BufferedReader::CopySlow(size_t length, BackwardWriter& dest) {
   return dest.Write(std::move(data));
 }
 
+bool BufferedReader::ReadVectoredInternal(
+    absl::Span<const absl::Span<char>> dest) {
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of BufferedReader::ReadVectoredInternal(): "
+      << status();
+  for (const absl::Span<char> piece : dest) {
+    if (piece.empty()) continue;
+    if (ABSL_PREDICT_FALSE(
+            !ReadInternal(piece.size(), piece.size(), piece.data()))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool BufferedReader::ReadVSlow(absl::Span<const absl::Span<char>> dest) {
+  RIEGELI_ASSERT(!dest.empty())
+      << "Failed precondition of Reader::ReadVSlow(): no pieces";
+  RIEGELI_ASSERT_LT(available(), dest.front().size())
+      << "Failed precondition of Reader::ReadVSlow(): "
+         "enough data available, use ReadV() instead";
+  // Read-ahead serves data in its own blocks, so pieces are read one by one.
+  if (read_ahead_ != nullptr) return Reader::ReadVSlow(dest);
+  std::vector<absl::Span<char>> direct;
+  size_t index = 0;
+  while (index < dest.size()) {
+    const absl::Span<char> piece = dest[index];
+    if (available() >= piece.size() || piece.size() < LengthToReadDirectly()) {
+      if (ABSL_PREDICT_FALSE(!Read(piece.size(), piece.data()))) return false;
+      ++index;
+      continue;
+    }
+    // Take the rest of the buffer, then read the remaining part of this piece
+    // and following long pieces directly, with one operation if supported.
+    const size_t available_length = available();
+    if (
+        // `std::memcpy(_, nullptr, 0)` is undefined.
+        available_length > 0) {
+      std::memcpy(piece.data(), cursor(), available_length);
+    }
+    SyncBuffer();
+    if (ABSL_PREDICT_FALSE(!healthy())) return false;
+    direct.clear();
+    direct.push_back(piece.subspan(available_length));
+    ++index;
+    while (index < dest.size() &&
+           dest[index].size() >= LengthToReadDirectly()) {
+      direct.push_back(dest[index]);
+      ++index;
+    }
+    if (ABSL_PREDICT_FALSE(!ReadVectoredInternal(direct))) return false;
+  }
+  return true;
+}
+
 void BufferedReader::ReadHintSlow(size_t length) {
   RIEGELI_ASSERT_LT(available(), length)
       << "Failed precondition of Reader::ReadHintSlow(): "
@@ -395,7 +591,7 @@ void BufferedReader::ReadHintSlow(size_t length) {
   }
   // Read more data into `buffer_`.
   const Position pos_before = limit_pos();
-  ReadInternal(1, flat_buffer.size(), flat_buffer.data());
+  ReadFromSource(1, flat_buffer.size(), flat_buffer.data());
   RIEGELI_ASSERT_GE(limit_pos(), pos_before)
       << "BufferedReader::ReadInternal() decreased limit_pos()";
   const Position length_read = limit_pos() - pos_before;
@@ -423,7 +619,10 @@ bool BufferedReader::SeekSlow(Position new_pos) {
       << "Failed precondition of Reader::SeekSlow(): "
          "position in the buffer, use Seek() instead";
   SyncBuffer();
-  return SeekBehindBuffer(new_pos);
+  const bool ok = SeekBehindBuffer(new_pos);
+  // Reading after a seek might be random access, so read less at a time.
+  buffer_size_ = min_buffer_size_;
+  return ok;
 }
 
 }  // namespace riegeli
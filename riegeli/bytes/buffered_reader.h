@@ -17,11 +17,18 @@
 
 #include <stddef.h>
 
+#include <deque>
+#include <memory>
 #include <utility>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
 #include "absl/strings/cord.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
 #include "riegeli/bytes/backward_writer.h"
@@ -39,6 +46,7 @@ namespace riegeli {
 class BufferedReader : public Reader {
  public:
   void VerifyEnd() override;
+  size_t EstimateMemory() const override;
 
  protected:
   // Creates a closed `BufferedReader`.
@@ -70,6 +78,34 @@ class BufferedReader : public Reader {
   // Changes the size hint after construction.
   void set_size_hint(absl::optional<Position> size_hint);
 
+  // Enables adaptive buffer sizing: while reading sequentially, the length of
+  // each read into the buffer doubles, up to `max_buffer_size`. After seeking
+  // outside the buffer it returns to the buffer size given at construction,
+  // which serves random access with short reads.
+  //
+  // If `max_buffer_size` is not larger than the buffer size given at
+  // construction, adaptive buffer sizing is disabled.
+  void set_max_buffer_size(size_t max_buffer_size);
+
+  // Enables asynchronous read-ahead: while data already read are being
+  // consumed, up to `max_buffers` further buffers are read on a background
+  // thread by `ReadAheadInternal()`, which must be implemented by the derived
+  // class. `ReadInternal()` is then not used.
+  //
+  // If `max_buffers == 0`, read-ahead is disabled.
+  //
+  // A derived class which enables read-ahead must call `DoneBackground()` in
+  // its destructor and before moving or resetting its source, because
+  // `ReadAheadInternal()` can be running concurrently until then.
+  void set_read_ahead(size_t max_buffers);
+
+  // Returns the current `max_buffers` for read-ahead, 0 if disabled.
+  size_t read_ahead() const;
+
+  // Waits for the background read-ahead to finish, and discards data read
+  // ahead.
+  void DoneBackground();
+
   // `BufferedReader::{Done,SyncImpl}()` seek the source back to the current
   // position if not all buffered data were read. This is feasible only if
   // `SupportsRandomAccess()`.
@@ -98,6 +134,40 @@ class BufferedReader : public Reader {
   virtual bool ReadInternal(size_t min_length, size_t max_length,
                             char* dest) = 0;
 
+  // Reads pieces of data from the source to `dest`, filling each piece in
+  // turn, from the physical source position which is `limit_pos()`. This is
+  // used for `ReadV()` with large pieces, bypassing the buffer.
+  //
+  // Does not use buffer pointers. Increments `limit_pos()` by the total length
+  // read, which must be the total size of `dest` on success. Returns `true` on
+  // success.
+  //
+  // By default calls `ReadInternal()` for each non-empty piece. Can be
+  // overridden if reading several pieces at once can be implemented better,
+  // e.g. with `readv()`.
+  //
+  // Precondition: `healthy()`
+  virtual bool ReadVectoredInternal(absl::Span<const absl::Span<char>> dest);
+
+  // Reads data from the source at physical source position `pos`, for
+  // read-ahead enabled with `set_read_ahead()`.
+  //
+  // This is called on a background thread, possibly concurrently with other
+  // member functions, so it must not use or change the state of the `Reader`
+  // (`pos` is given explicitly instead of using `limit_pos()`, and the length
+  // read is returned instead of moving `limit_pos()`), and it must not change
+  // the physical position of the source as seen by other member functions.
+  //
+  // Tries to read at most `max_length`, but can return successfully after
+  // reading at least 1 byte. Returns the length read, 0 if the source ends or
+  // on failure, in which case `status` is set.
+  //
+  // By default fails with `absl::UnimplementedError`.
+  //
+  // Precondition: `max_length > 0`
+  virtual size_t ReadAheadInternal(Position pos, size_t max_length, char* dest,
+                                   absl::Status& status);
+
   // Implementation of `SeekSlow()`, called while no data are buffered.
   //
   // By default it is implemented analogously to the corresponding `Reader`
@@ -117,28 +187,81 @@ class BufferedReader : public Reader {
   using Reader::CopySlow;
   bool CopySlow(Position length, Writer& dest) override;
   bool CopySlow(size_t length, BackwardWriter& dest) override;
+  bool ReadVSlow(absl::Span<const absl::Span<char>> dest) override;
   void ReadHintSlow(size_t length) override;
   bool SyncImpl(SyncType sync_type) override;
   bool SeekSlow(Position new_pos) override;
 
- private:
   // Discards buffer contents and sets buffer pointers to `nullptr`.
   //
   // This can move `pos()` forwards to account for skipping over previously
   // buffered data. `limit_pos()` remains unchanged.
   void SyncBuffer();
 
+ private:
   // Minimum length for which it is better to append current contents of
   // `buffer_` and read the remaining data directly than to read the data
   // through `buffer_`.
   size_t LengthToReadDirectly() const;
 
-  // Invariant: if `is_open()` then `buffer_size_ > 0`
+  struct ReadAhead;
+
+  // Calls `ReadInternal()`, or takes data from `read_ahead_` if present.
+  bool ReadFromSource(size_t min_length, size_t max_length, char* dest);
+  bool ReadFromReadAhead(size_t min_length, size_t max_length, char* dest);
+  void ReadAheadTask(ReadAhead* read_ahead);
+
+  struct ReadAheadBlock {
+    Buffer data;
+    Position pos = 0;
+    size_t length = 0;
+    // Length already taken by `ReadFromReadAhead()`.
+    size_t consumed = 0;
+  };
+
+  // State of read-ahead, shared with the background task.
+  struct ReadAhead {
+    explicit ReadAhead(size_t max_blocks, size_t block_size)
+        : max_blocks(max_blocks), block_size(block_size) {}
+
+    // Schedules `ReadAheadTask()` unless it is running or not needed.
+    void StartTask(BufferedReader* reader) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex);
+    // Waits for `ReadAheadTask()` and discards blocks, restarting at `pos`.
+    void Discard(Position pos) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex);
+
+    const size_t max_blocks;
+    const size_t block_size;
+    absl::Mutex mutex;
+    // Blocks read ahead, at consecutive positions.
+    std::deque<ReadAheadBlock> blocks ABSL_GUARDED_BY(mutex);
+    // Position of the next block to read.
+    Position next_pos ABSL_GUARDED_BY(mutex) = 0;
+    // Whether `ReadAheadTask()` is scheduled or running.
+    bool running ABSL_GUARDED_BY(mutex) = false;
+    // Whether `ReadAheadTask()` should return early.
+    bool cancelled ABSL_GUARDED_BY(mutex) = false;
+    // Whether `ReadAheadInternal()` reached the end of the source or failed,
+    // so that no more blocks are read until the blocks are consumed.
+    bool stopped ABSL_GUARDED_BY(mutex) = false;
+    // Failure of `ReadAheadInternal()` if `stopped`.
+    absl::Status status ABSL_GUARDED_BY(mutex);
+  };
+
+  // The buffer size given at construction, and the current buffer size, which
+  // can grow up to `max_buffer_size_` if adaptive buffer sizing is enabled.
+  //
+  // Invariants if `is_open()`:
+  //   `min_buffer_size_ > 0`
+  //   `min_buffer_size_ <= buffer_size_ <= max_buffer_size_`
+  size_t min_buffer_size_ = 0;
   size_t buffer_size_ = 0;
+  size_t max_buffer_size_ = 0;
   Position size_hint_ = 0;
   // Buffered data, read directly before the physical source position which is
   // `limit_pos()`.
   ChainBlock buffer_;
+  // Present if read-ahead is enabled.
+  std::unique_ptr<ReadAhead> read_ahead_;
 
   // Invariants:
   //   if `!buffer_.empty()` then `start() == buffer_.data()`
@@ -150,7 +273,9 @@ class BufferedReader : public Reader {
 inline BufferedReader::BufferedReader(
     size_t buffer_size, absl::optional<Position> size_hint) noexcept
     : Reader(kInitiallyOpen),
+      min_buffer_size_(buffer_size),
       buffer_size_(buffer_size),
+      max_buffer_size_(buffer_size),
       size_hint_(size_hint.value_or(0)) {
   RIEGELI_ASSERT_GT(buffer_size, 0u)
       << "Failed precondition of BufferedReader::BufferedReader(size_t): "
@@ -161,42 +286,79 @@ inline BufferedReader::BufferedReader(BufferedReader&& that) noexcept
     : Reader(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
+      min_buffer_size_(that.min_buffer_size_),
       buffer_size_(that.buffer_size_),
+      max_buffer_size_(that.max_buffer_size_),
       size_hint_(that.size_hint_),
-      buffer_(std::move(that.buffer_)) {}
+      buffer_(std::move(that.buffer_)),
+      read_ahead_(std::move(that.read_ahead_)) {
+  // The background task may still be reading from the source of `that`, which
+  // is going to be moved by the derived class.
+  DoneBackground();
+}
 
 inline BufferedReader& BufferedReader::operator=(
     BufferedReader&& that) noexcept {
+  DoneBackground();
+  that.DoneBackground();
   Reader::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
+  min_buffer_size_ = that.min_buffer_size_;
   buffer_size_ = that.buffer_size_;
+  max_buffer_size_ = that.max_buffer_size_;
   size_hint_ = that.size_hint_;
   buffer_ = std::move(that.buffer_);
+  read_ahead_ = std::move(that.read_ahead_);
   return *this;
 }
 
 inline void BufferedReader::Reset() {
+  DoneBackground();
   Reader::Reset(kInitiallyClosed);
+  min_buffer_size_ = 0;
   buffer_size_ = 0;
+  max_buffer_size_ = 0;
   size_hint_ = 0;
   buffer_.Clear();
+  read_ahead_.reset();
 }
 
 inline void BufferedReader::Reset(size_t buffer_size,
                                   absl::optional<Position> size_hint) {
   RIEGELI_ASSERT_GT(buffer_size, 0u)
       << "Failed precondition of BufferedReader::Reset(): zero buffer size";
+  DoneBackground();
   Reader::Reset(kInitiallyOpen);
+  min_buffer_size_ = buffer_size;
   buffer_size_ = buffer_size;
+  max_buffer_size_ = buffer_size;
   size_hint_ = size_hint.value_or(0);
   buffer_.Clear();
+  read_ahead_.reset();
 }
 
 inline void BufferedReader::set_size_hint(absl::optional<Position> size_hint) {
   size_hint_ = size_hint.value_or(0);
 }
 
+inline void BufferedReader::set_max_buffer_size(size_t max_buffer_size) {
+  max_buffer_size_ = UnsignedMax(max_buffer_size, min_buffer_size_);
+  buffer_size_ = UnsignedMin(buffer_size_, max_buffer_size_);
+}
+
+inline size_t BufferedReader::read_ahead() const {
+  return read_ahead_ == nullptr ? 0 : read_ahead_->max_blocks;
+}
+
+inline bool BufferedReader::ReadFromSource(size_t min_length,
+                                           size_t max_length, char* dest) {
+  if (read_ahead_ == nullptr) {
+    return ReadInternal(min_length, max_length, dest);
+  }
+  return ReadFromReadAhead(min_length, max_length, dest);
+}
+
 }  // namespace riegeli
 
 #endif  // RIEGELI_BYTES_BUFFERED_READER_H_
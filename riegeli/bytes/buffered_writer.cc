@@ -18,13 +18,16 @@
 
 #include <array>
 #include <limits>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
+#include "riegeli/base/chain.h"
 #include "riegeli/base/memory.h"
 #include "riegeli/bytes/writer.h"
 
@@ -66,12 +69,19 @@ inline size_t BufferedWriter::LengthToWriteDirectly() const {
   return buffer_size_;
 }
 
+inline void BufferedWriter::GrowBufferSize(size_t length) {
+  if (length > buffer_size_ && buffer_size_ < max_buffer_size_) {
+    buffer_size_ = UnsignedMin(length, max_buffer_size_);
+  }
+}
+
 bool BufferedWriter::PushSlow(size_t min_length, size_t recommended_length) {
   RIEGELI_ASSERT_LT(available(), min_length)
       << "Failed precondition of Writer::PushSlow(): "
          "enough space available, use Push() instead";
   if (ABSL_PREDICT_FALSE(!SyncBuffer())) return false;
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  GrowBufferSize(min_length);
   if (ABSL_PREDICT_FALSE(min_length >
                          std::numeric_limits<Position>::max() - start_pos())) {
     return FailOverflow();
@@ -122,6 +132,7 @@ bool BufferedWriter::WriteSlow(absl::string_view src) {
       << "Failed precondition of Writer::WriteSlow(string_view): "
          "enough space available, use Write(string_view) instead";
   if (src.size() >= LengthToWriteDirectly()) {
+    GrowBufferSize(src.size());
     if (ABSL_PREDICT_FALSE(!SyncBuffer())) return false;
     if (ABSL_PREDICT_FALSE(!healthy())) return false;
     return WriteInternal(src);
@@ -129,6 +140,39 @@ bool BufferedWriter::WriteSlow(absl::string_view src) {
   return Writer::WriteSlow(src);
 }
 
+bool BufferedWriter::WriteSlow(const Chain& src) {
+  RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), src.size())
+      << "Failed precondition of Writer::WriteSlow(Chain): "
+         "enough space available, use Write(Chain) instead";
+  if (src.size() >= LengthToWriteDirectly()) {
+    GrowBufferSize(src.size());
+    // Buffered data are written together with blocks of `src`, so that a
+    // destination supporting vectored writes needs one operation and no
+    // copying.
+    const absl::string_view data(start(), written_to_buffer());
+    set_buffer();
+    if (ABSL_PREDICT_FALSE(!healthy())) return false;
+    std::vector<absl::string_view> srcs;
+    srcs.reserve(1 + src.blocks().size());
+    if (!data.empty()) srcs.push_back(data);
+    for (const absl::string_view block : src.blocks()) srcs.push_back(block);
+    return WriteVectoredInternal(srcs);
+  }
+  return Writer::WriteSlow(src);
+}
+
+bool BufferedWriter::WriteVectoredInternal(
+    absl::Span<const absl::string_view> srcs) {
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of BufferedWriter::WriteVectoredInternal(): "
+      << status();
+  for (const absl::string_view src : srcs) {
+    if (src.empty()) continue;
+    if (ABSL_PREDICT_FALSE(!WriteInternal(src))) return false;
+  }
+  return true;
+}
+
 bool BufferedWriter::WriteZerosSlow(Position length) {
   RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), length)
       << "Failed precondition of Writer::WriteZerosSlow(): "
@@ -150,6 +194,7 @@ bool BufferedWriter::FlushImpl(FlushType flush_type) {
 
 bool BufferedWriter::SeekImpl(Position new_pos) {
   if (ABSL_PREDICT_FALSE(!SyncBuffer())) return false;
+  buffer_size_ = min_buffer_size_;
   return SeekBehindBuffer(new_pos);
 }
 
@@ -22,8 +22,10 @@
 #include "absl/base/optimization.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
+#include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
 #include "riegeli/bytes/writer.h"
 
@@ -38,6 +40,7 @@ namespace riegeli {
 class BufferedWriter : public Writer {
  public:
   bool PrefersCopying() const override { return true; }
+  size_t EstimateMemory() const override { return buffer_.capacity(); }
 
  protected:
   // Creates a closed `BufferedWriter`.
@@ -66,6 +69,15 @@ class BufferedWriter : public Writer {
   void Reset(size_t buffer_size,
              absl::optional<Position> size_hint = absl::nullopt);
 
+  // Enables adaptive buffer sizing: when a write longer than the buffer size
+  // arrives, the buffer size grows to its length, up to `max_buffer_size`, so
+  // that later writes are gathered into longer writes to the destination.
+  // After seeking it returns to the buffer size given at construction.
+  //
+  // If `max_buffer_size` is not larger than the buffer size given at
+  // construction, adaptive buffer sizing is disabled.
+  void set_max_buffer_size(size_t max_buffer_size);
+
   // `BufferedWriter::{Done,FlushImpl}()` call `{Done,Flush}BehindBuffer()` to
   // write the last piece of data and close/flush the destination.
   //
@@ -93,6 +105,22 @@ class BufferedWriter : public Writer {
   //   `healthy()`
   virtual bool WriteInternal(absl::string_view src) = 0;
 
+  // Writes a sequence of pieces of data to the destination, to the physical
+  // destination position which is `start_pos()`. This is used for writing a
+  // large `Chain` together with buffered data, without copying its blocks.
+  //
+  // Does not use buffer pointers. Increments `start_pos()` by the total length
+  // written, which must be the total size of `srcs` on success. Returns `true`
+  // on success.
+  //
+  // By default calls `WriteInternal()` for each non-empty piece. Can be
+  // overridden if writing several pieces at once can be implemented better,
+  // e.g. with `writev()`.
+  //
+  // Preconditions:
+  //   `healthy()`
+  virtual bool WriteVectoredInternal(absl::Span<const absl::string_view> srcs);
+
   // Implementation of `FlushImpl()`, called with the last piece of data.
   //
   // By default writes data to the destination. Can be overridden if writing
@@ -118,6 +146,7 @@ class BufferedWriter : public Writer {
   bool PushSlow(size_t min_length, size_t recommended_length) override;
   using Writer::WriteSlow;
   bool WriteSlow(absl::string_view src) override;
+  bool WriteSlow(const Chain& src) override;
   bool WriteZerosSlow(Position length) override;
   bool FlushImpl(FlushType flush_type) override;
   bool SeekImpl(Position new_pos) override;
@@ -131,8 +160,18 @@ class BufferedWriter : public Writer {
   // and write the data directly than to write the data through `buffer_`.
   size_t LengthToWriteDirectly() const;
 
-  // Invariant: if `is_open()` then `buffer_size_ > 0`
+  // Grows `buffer_size_` for a write of `length`.
+  void GrowBufferSize(size_t length);
+
+  // The buffer size given at construction, and the current buffer size, which
+  // can grow up to `max_buffer_size_` if adaptive buffer sizing is enabled.
+  //
+  // Invariants if `is_open()`:
+  //   `min_buffer_size_ > 0`
+  //   `min_buffer_size_ <= buffer_size_ <= max_buffer_size_`
+  size_t min_buffer_size_ = 0;
   size_t buffer_size_ = 0;
+  size_t max_buffer_size_ = 0;
   Position size_hint_ = 0;
   // Contains buffered data, to be written directly after the physical
   // destination position which is `start_pos()`.
@@ -144,7 +183,9 @@ class BufferedWriter : public Writer {
 inline BufferedWriter::BufferedWriter(
     size_t buffer_size, absl::optional<Position> size_hint) noexcept
     : Writer(kInitiallyOpen),
+      min_buffer_size_(buffer_size),
       buffer_size_(buffer_size),
+      max_buffer_size_(buffer_size),
       size_hint_(size_hint.value_or(0)) {
   RIEGELI_ASSERT_GT(buffer_size, 0u)
       << "Failed precondition of BufferedWriter::BufferedWriter(size_t): "
@@ -155,7 +196,9 @@ inline BufferedWriter::BufferedWriter(BufferedWriter&& that) noexcept
     : Writer(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
+      min_buffer_size_(that.min_buffer_size_),
       buffer_size_(that.buffer_size_),
+      max_buffer_size_(that.max_buffer_size_),
       size_hint_(that.size_hint_),
       buffer_(std::move(that.buffer_)) {}
 
@@ -164,7 +207,9 @@ inline BufferedWriter& BufferedWriter::operator=(
   Writer::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
+  min_buffer_size_ = that.min_buffer_size_;
   buffer_size_ = that.buffer_size_;
+  max_buffer_size_ = that.max_buffer_size_;
   size_hint_ = that.size_hint_;
   buffer_ = std::move(that.buffer_);
   return *this;
@@ -172,7 +217,9 @@ inline BufferedWriter& BufferedWriter::operator=(
 
 inline void BufferedWriter::Reset() {
   Writer::Reset(kInitiallyClosed);
+  min_buffer_size_ = 0;
   buffer_size_ = 0;
+  max_buffer_size_ = 0;
   size_hint_ = 0;
 }
 
@@ -181,10 +228,17 @@ inline void BufferedWriter::Reset(size_t buffer_size,
   RIEGELI_ASSERT_GT(buffer_size, 0u)
       << "Failed precondition of BufferedWriter::Reset(): zero buffer size";
   Writer::Reset(kInitiallyOpen);
+  min_buffer_size_ = buffer_size;
   buffer_size_ = buffer_size;
+  max_buffer_size_ = buffer_size;
   size_hint_ = size_hint.value_or(0);
 }
 
+inline void BufferedWriter::set_max_buffer_size(size_t max_buffer_size) {
+  max_buffer_size_ = UnsignedMax(max_buffer_size, min_buffer_size_);
+  buffer_size_ = UnsignedMin(buffer_size_, max_buffer_size_);
+}
+
 }  // namespace riegeli
 
 #endif  // RIEGELI_BYTES_BUFFERED_WRITER_H_
@@ -167,6 +167,12 @@ class ChainBackwardWriterBase : public BackwardWriter {
 // constructor argument is a `Chain&` or `const Chain&` (to avoid writing to an
 // unintentionally separate copy of an existing object). This requires C++17.
 //
+// Each block is filled from its end. A new block is allocated only when the
+// first block is full, with a size growing geometrically with the size of the
+// destination, from `min_block_size()` up to `max_block_size()`. The array of
+// block pointers of a `Chain` keeps spare space before its first element, so
+// prepending a block takes amortized constant time.
+//
 // The `Chain` must not be accessed until the `ChainBackwardWriter` is closed or
 // no longer used.
 template <typename Dest = Chain*>
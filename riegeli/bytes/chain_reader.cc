@@ -234,6 +234,20 @@ bool ChainReaderBase::SeekBehindScratch(Position new_pos) {
     set_buffer();
     return new_pos == src.size();
   }
+  if (new_pos > limit_pos() && iter_ != src.blocks().cend()) {
+    // Seeking forwards a little, e.g. with `Skip()`, often lands in the next
+    // block. Check it before searching all blocks, which matters for chains
+    // with many blocks.
+    const Chain::BlockIterator next_iter = iter_ + 1;
+    if (next_iter != src.blocks().cend() &&
+        new_pos - limit_pos() < next_iter->size()) {
+      iter_ = next_iter;
+      set_buffer(iter_->data(), iter_->size(),
+                 IntCast<size_t>(new_pos - limit_pos()));
+      move_limit_pos(iter_->size());
+      return true;
+    }
+  }
   const Chain::CharPosition char_pos = src.FindPosition(new_pos);
   iter_ = char_pos.block_iter;
   set_buffer(iter_->data(), iter_->size(), char_pos.char_index);
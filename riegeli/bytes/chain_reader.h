@@ -36,6 +36,33 @@ namespace riegeli {
 // Template parameter independent part of `ChainReader`.
 class ChainReaderBase : public PullableReader {
  public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // If a `Pull()` spans blocks of the `Chain`, data are copied to a scratch
+    // buffer. If `merge_length > 0`, following blocks which fit in full within
+    // `merge_length` bytes of scratch are copied too, so that a sequence of
+    // small blocks is merged once, instead of being copied again at each block
+    // boundary. The scratch buffer is reused.
+    //
+    // This helps when small reads, e.g. of varints or headers, are frequent
+    // and the `Chain` consists of many small blocks.
+    //
+    // Default: 0 (only the data needed by `Pull()` are copied).
+    Options& set_merge_length(size_t merge_length) & {
+      merge_length_ = merge_length;
+      return *this;
+    }
+    Options&& set_merge_length(size_t merge_length) && {
+      return std::move(set_merge_length(merge_length));
+    }
+    size_t merge_length() const { return merge_length_; }
+
+   private:
+    size_t merge_length_ = 0;
+  };
+
   // Returns the `Chain` being read from. Unchanged by `Close()`.
   virtual const Chain* src_chain() const = 0;
 
@@ -52,7 +79,7 @@ class ChainReaderBase : public PullableReader {
 
   void Reset(InitiallyClosed);
   void Reset(InitiallyOpen);
-  void Initialize(const Chain* src);
+  void Initialize(const Chain* src, const Options& options);
 
   void Done() override;
   bool PullBehindScratch() override;
@@ -95,13 +122,14 @@ class ChainReader : public ChainReaderBase {
   ChainReader() noexcept : ChainReaderBase(kInitiallyClosed) {}
 
   // Will read from the `Chain` provided by `src`.
-  explicit ChainReader(const Src& src);
-  explicit ChainReader(Src&& src);
+  explicit ChainReader(const Src& src, Options options = Options());
+  explicit ChainReader(Src&& src, Options options = Options());
 
   // Will read from the `Chain` provided by a `Src` constructed from elements of
   // `src_args`. This avoids constructing a temporary `Src` and moving from it.
   template <typename... SrcArgs>
-  explicit ChainReader(std::tuple<SrcArgs...> src_args);
+  explicit ChainReader(std::tuple<SrcArgs...> src_args,
+                       Options options = Options());
 
   ChainReader(ChainReader&& that) noexcept;
   ChainReader& operator=(ChainReader&& that) noexcept;
@@ -109,10 +137,10 @@ class ChainReader : public ChainReaderBase {
   // Makes `*this` equivalent to a newly constructed `ChainReader`. This avoids
   // constructing a temporary `ChainReader` and moving from it.
   void Reset();
-  void Reset(const Src& src);
-  void Reset(Src&& src);
+  void Reset(const Src& src, Options options = Options());
+  void Reset(Src&& src, Options options = Options());
   template <typename... SrcArgs>
-  void Reset(std::tuple<SrcArgs...> src_args);
+  void Reset(std::tuple<SrcArgs...> src_args, Options options = Options());
 
   // Returns the object providing and possibly owning the `Chain` being read
   // from. Unchanged by `Close()`.
@@ -131,11 +159,17 @@ class ChainReader : public ChainReaderBase {
 #if __cpp_deduction_guides
 ChainReader()->ChainReader<DeleteCtad<>>;
 template <typename Src>
-explicit ChainReader(const Src& src) -> ChainReader<std::decay_t<Src>>;
+explicit ChainReader(const Src& src, ChainReaderBase::Options options =
+                                         ChainReaderBase::Options())
+    -> ChainReader<std::decay_t<Src>>;
 template <typename Src>
-explicit ChainReader(Src&& src) -> ChainReader<std::decay_t<Src>>;
+explicit ChainReader(Src&& src, ChainReaderBase::Options options =
+                                    ChainReaderBase::Options())
+    -> ChainReader<std::decay_t<Src>>;
 template <typename... SrcArgs>
-explicit ChainReader(std::tuple<SrcArgs...> src_args)
+explicit ChainReader(
+    std::tuple<SrcArgs...> src_args,
+    ChainReaderBase::Options options = ChainReaderBase::Options())
     -> ChainReader<DeleteCtad<std::tuple<SrcArgs...>>>;
 #endif
 
@@ -166,9 +200,11 @@ inline void ChainReaderBase::Reset(InitiallyOpen) {
   // `iter_` will be set by `Initialize()`.
 }
 
-inline void ChainReaderBase::Initialize(const Chain* src) {
+inline void ChainReaderBase::Initialize(const Chain* src,
+                                        const Options& options) {
   RIEGELI_ASSERT(src != nullptr)
       << "Failed precondition of ChainReader: null Chain pointer";
+  set_scratch_merge_length(options.merge_length());
   iter_ = src->blocks().cbegin();
   if (iter_ != src->blocks().cend()) {
     set_buffer(iter_->data(), iter_->size());
@@ -177,22 +213,23 @@ inline void ChainReaderBase::Initialize(const Chain* src) {
 }
 
 template <typename Src>
-inline ChainReader<Src>::ChainReader(const Src& src)
+inline ChainReader<Src>::ChainReader(const Src& src, Options options)
     : ChainReaderBase(kInitiallyOpen), src_(src) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options);
 }
 
 template <typename Src>
-inline ChainReader<Src>::ChainReader(Src&& src)
+inline ChainReader<Src>::ChainReader(Src&& src, Options options)
     : ChainReaderBase(kInitiallyOpen), src_(std::move(src)) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options);
 }
 
 template <typename Src>
 template <typename... SrcArgs>
-inline ChainReader<Src>::ChainReader(std::tuple<SrcArgs...> src_args)
+inline ChainReader<Src>::ChainReader(std::tuple<SrcArgs...> src_args,
+                                     Options options)
     : ChainReaderBase(kInitiallyOpen), src_(std::move(src_args)) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options);
 }
 
 template <typename Src>
@@ -220,25 +257,26 @@ inline void ChainReader<Src>::Reset() {
 }
 
 template <typename Src>
-inline void ChainReader<Src>::Reset(const Src& src) {
+inline void ChainReader<Src>::Reset(const Src& src, Options options) {
   ChainReaderBase::Reset(kInitiallyOpen);
   src_.Reset(src);
-  Initialize(src_.get());
+  Initialize(src_.get(), options);
 }
 
 template <typename Src>
-inline void ChainReader<Src>::Reset(Src&& src) {
+inline void ChainReader<Src>::Reset(Src&& src, Options options) {
   ChainReaderBase::Reset(kInitiallyOpen);
   src_.Reset(std::move(src));
-  Initialize(src_.get());
+  Initialize(src_.get(), options);
 }
 
 template <typename Src>
 template <typename... SrcArgs>
-inline void ChainReader<Src>::Reset(std::tuple<SrcArgs...> src_args) {
+inline void ChainReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
+                                   Options options) {
   ChainReaderBase::Reset(kInitiallyOpen);
   src_.Reset(std::move(src_args));
-  Initialize(src_.get());
+  Initialize(src_.get(), options);
 }
 
 template <typename Src>
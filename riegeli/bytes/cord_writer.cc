@@ -90,7 +90,7 @@ bool CordWriterBase::WriteSlow(const Chain& src) {
   RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), src.size())
       << "Failed precondition of Writer::WriteSlow(Chain): "
          "enough space available, use Write(Chain) instead";
-  if (src.size() <= kMaxBytesToCopy) return Writer::WriteSlow(src);
+  if (src.size() <= max_bytes_to_copy_) return Writer::WriteSlow(src);
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   absl::Cord& dest = *dest_cord();
   RIEGELI_ASSERT_EQ(start_pos(), dest.size())
@@ -109,7 +109,7 @@ bool CordWriterBase::WriteSlow(Chain&& src) {
   RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), src.size())
       << "Failed precondition of Writer::WriteSlow(Chain&&): "
          "enough space available, use Write(Chain&&) instead";
-  if (src.size() <= kMaxBytesToCopy) {
+  if (src.size() <= max_bytes_to_copy_) {
     // Not `std::move(src)`: forward to `Writer::WriteSlow(const Chain&)`,
     // because `Writer::WriteSlow(Chain&&)` would forward to
     // `CordWriterBase::WriteSlow(const Chain&)`.
@@ -133,7 +133,7 @@ bool CordWriterBase::WriteSlow(const absl::Cord& src) {
   RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), src.size())
       << "Failed precondition of Writer::WriteSlow(Cord): "
          "enough space available, use Write(Cord) instead";
-  if (src.size() <= kMaxBytesToCopy) return Writer::WriteSlow(src);
+  if (src.size() <= max_bytes_to_copy_) return Writer::WriteSlow(src);
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   absl::Cord& dest = *dest_cord();
   RIEGELI_ASSERT_EQ(start_pos(), dest.size())
@@ -152,7 +152,7 @@ bool CordWriterBase::WriteSlow(absl::Cord&& src) {
   RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), src.size())
       << "Failed precondition of Writer::WriteSlow(Cord&&): "
          "enough space available, use Write(Cord&&) instead";
-  if (src.size() <= kMaxBytesToCopy) {
+  if (src.size() <= max_bytes_to_copy_) {
     // Not `std::move(src)`: forward to `Writer::WriteSlow(const absl::Cord&)`,
     // because `Writer::WriteSlow(absl::Cord&&)` would forward to
     // `CordWriterBase::WriteSlow(const absl::Cord&)`.
@@ -104,11 +104,31 @@ class CordWriterBase : public Writer {
     }
     size_t max_block_size() const { return max_block_size_; }
 
+    // Maximal length of a `Chain` or `absl::Cord` written which is copied to
+    // the buffer instead of being appended to the destination by sharing its
+    // memory.
+    //
+    // Sharing avoids copying, but appending many medium-sized pieces makes the
+    // destination fragmented. Setting this to e.g. `max_block_size()` makes the
+    // destination consist of large flat blocks, which is faster to read later
+    // at the cost of copying pieces up to that length once.
+    //
+    // Default: `kMaxBytesToCopy` (255).
+    Options& set_max_bytes_to_copy(size_t max_bytes_to_copy) & {
+      max_bytes_to_copy_ = max_bytes_to_copy;
+      return *this;
+    }
+    Options&& set_max_bytes_to_copy(size_t max_bytes_to_copy) && {
+      return std::move(set_max_bytes_to_copy(max_bytes_to_copy));
+    }
+    size_t max_bytes_to_copy() const { return max_bytes_to_copy_; }
+
    private:
     bool append_ = false;
     absl::optional<Position> size_hint_;
     size_t min_block_size_ = kMinBufferSize;
     size_t max_block_size_ = kMaxBufferSize;
+    size_t max_bytes_to_copy_ = kMaxBytesToCopy;
   };
 
   // Returns the `absl::Cord` being written to. Unchanged by `Close()`.
@@ -149,6 +169,7 @@ class CordWriterBase : public Writer {
   size_t size_hint_ = 0;
   size_t min_block_size_ = kMinBufferSize;
   size_t max_block_size_ = kMaxBufferSize;
+  size_t max_bytes_to_copy_ = kMaxBytesToCopy;
 
   // Buffered data to be appended, in either `buffer_` or `short_buffer_`.
   Buffer buffer_;
@@ -245,7 +266,8 @@ inline CordWriterBase::CordWriterBase(const Options& options)
     : Writer(kInitiallyOpen),
       size_hint_(SaturatingIntCast<size_t>(options.size_hint().value_or(0))),
       min_block_size_(options.min_block_size()),
-      max_block_size_(options.max_block_size()) {}
+      max_block_size_(options.max_block_size()),
+      max_bytes_to_copy_(options.max_bytes_to_copy()) {}
 
 inline CordWriterBase::CordWriterBase(CordWriterBase&& that) noexcept
     : Writer(std::move(that)),
@@ -254,6 +276,7 @@ inline CordWriterBase::CordWriterBase(CordWriterBase&& that) noexcept
       size_hint_(that.size_hint_),
       min_block_size_(that.min_block_size_),
       max_block_size_(that.max_block_size_),
+      max_bytes_to_copy_(that.max_bytes_to_copy_),
       buffer_(std::move(that.buffer_)) {
   if (start() == that.short_buffer_) {
     std::memcpy(short_buffer_, that.short_buffer_, kShortBufferSize);
@@ -269,6 +292,7 @@ inline CordWriterBase& CordWriterBase::operator=(
   size_hint_ = that.size_hint_;
   min_block_size_ = that.min_block_size_;
   max_block_size_ = that.max_block_size_;
+  max_bytes_to_copy_ = that.max_bytes_to_copy_;
   buffer_ = std::move(that.buffer_);
   if (start() == that.short_buffer_) {
     std::memcpy(short_buffer_, that.short_buffer_, kShortBufferSize);
@@ -282,6 +306,7 @@ inline void CordWriterBase::Reset() {
   size_hint_ = 0;
   min_block_size_ = kMinBufferSize;
   max_block_size_ = kMaxBufferSize;
+  max_bytes_to_copy_ = kMaxBytesToCopy;
 }
 
 inline void CordWriterBase::Reset(const Options& options) {
@@ -289,6 +314,7 @@ inline void CordWriterBase::Reset(const Options& options) {
   size_hint_ = SaturatingIntCast<size_t>(options.size_hint().value_or(0));
   min_block_size_ = options.min_block_size();
   max_block_size_ = options.max_block_size();
+  max_bytes_to_copy_ = options.max_bytes_to_copy();
 }
 
 inline void CordWriterBase::Initialize(absl::Cord* dest, bool append) {
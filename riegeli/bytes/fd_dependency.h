@@ -15,6 +15,7 @@
 #ifndef RIEGELI_BYTES_FD_DEPENDENCY_H_
 #define RIEGELI_BYTES_FD_DEPENDENCY_H_
 
+#include <stddef.h>
 #include <unistd.h>
 
 #include <cerrno>
@@ -43,6 +44,11 @@ RIEGELI_INTERNAL_INLINE_CONSTEXPR(absl::string_view, kCloseFunctionName,
                                   "close()");
 #endif
 
+// Alignment of buffer addresses, file positions, and lengths used for I/O with
+// `O_DIRECT`. This is the logical block size of most devices, or a multiple of
+// it.
+RIEGELI_INTERNAL_INLINE_CONSTEXPR(size_t, kDirectIoAlignment, 4096);
+
 }  // namespace internal
 
 // Owns a file descriptor (-1 means none).
@@ -0,0 +1,446 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/bytes/fd_io_uring.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RIEGELI_INTERNAL_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef RIEGELI_INTERNAL_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace riegeli {
+namespace internal {
+
+namespace {
+
+// The length of a single request is limited to `unsigned` by the kernel ABI.
+constexpr size_t kMaxRequestLength = size_t{1} << 30;
+
+}  // namespace
+
+#ifdef RIEGELI_INTERNAL_HAVE_IO_URING
+
+IoUring::~IoUring() {
+  if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != nullptr) munmap(sq_ring_, sq_ring_size_);
+  if (ring_fd_ >= 0) close(ring_fd_);
+}
+
+bool IoUring::Open(unsigned entries) {
+  RIEGELI_ASSERT_LT(ring_fd_, 0)
+      << "Failed precondition of IoUring::Open(): already open";
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (ABSL_PREDICT_FALSE(ring_fd_ < 0)) return false;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size_ = UnsignedMax(sq_ring_size_, cq_ring_size_);
+    cq_ring_size_ = sq_ring_size_;
+  }
+  void* const sq_ring = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring_fd_,
+                             IORING_OFF_SQ_RING);
+  if (ABSL_PREDICT_FALSE(sq_ring == MAP_FAILED)) return false;
+  sq_ring_ = sq_ring;
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    void* const cq_ring = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, ring_fd_,
+                               IORING_OFF_CQ_RING);
+    if (ABSL_PREDICT_FALSE(cq_ring == MAP_FAILED)) return false;
+    cq_ring_ = cq_ring;
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* const sqes =
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (ABSL_PREDICT_FALSE(sqes == MAP_FAILED)) return false;
+  sqes_ = sqes;
+  char* const sq_base = static_cast<char*>(sq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.array);
+  char* const cq_base = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq_base + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq_base + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq_base + params.cq_off.ring_mask);
+  cqes_ = cq_base + params.cq_off.cqes;
+  return true;
+}
+
+inline bool IoUring::Submit(uint8_t opcode, int fd, uint64_t addr,
+                            size_t length, Position offset,
+                            uint64_t user_data) {
+  RIEGELI_ASSERT_GE(ring_fd_, 0)
+      << "Failed precondition of IoUring::Submit(): not open";
+  // This is the only producer of submissions, the kernel only reads `sq_tail_`.
+  const unsigned tail = __atomic_load_n(sq_tail_, __ATOMIC_RELAXED);
+  const unsigned index = tail & sq_mask_;
+  struct io_uring_sqe* const sqe =
+      static_cast<struct io_uring_sqe*>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->off = offset;
+  sqe->addr = addr;
+  sqe->len = IntCast<uint32_t>(UnsignedMin(length, kMaxRequestLength));
+  sqe->user_data = user_data;
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  for (;;) {
+    const long result =
+        syscall(__NR_io_uring_enter, ring_fd_, 1u, 0u, 0u, nullptr, 0);
+    if (ABSL_PREDICT_TRUE(result >= 0)) return true;
+    if (errno != EINTR) return false;
+  }
+}
+
+bool IoUring::SubmitRead(int fd, char* dest, size_t length, Position offset,
+                         uint64_t user_data) {
+  return Submit(IORING_OP_READ, fd, reinterpret_cast<uint64_t>(dest), length,
+                offset, user_data);
+}
+
+bool IoUring::SubmitWrite(int fd, const char* src, size_t length,
+                          Position offset, uint64_t user_data) {
+  return Submit(IORING_OP_WRITE, fd, reinterpret_cast<uint64_t>(src), length,
+                offset, user_data);
+}
+
+bool IoUring::WaitForCompletion(uint64_t& user_data, int32_t& result) {
+  RIEGELI_ASSERT_GE(ring_fd_, 0)
+      << "Failed precondition of IoUring::WaitForCompletion(): not open";
+  for (;;) {
+    // This is the only consumer of completions, the kernel only reads
+    // `cq_head_`.
+    const unsigned head = __atomic_load_n(cq_head_, __ATOMIC_RELAXED);
+    if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      const struct io_uring_cqe& cqe =
+          static_cast<const struct io_uring_cqe*>(cqes_)[head & cq_mask_];
+      user_data = cqe.user_data;
+      result = cqe.res;
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+    const long enter_result = syscall(__NR_io_uring_enter, ring_fd_, 0u, 1u,
+                                      IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ABSL_PREDICT_FALSE(enter_result < 0) && errno != EINTR) return false;
+  }
+}
+
+#else  // !RIEGELI_INTERNAL_HAVE_IO_URING
+
+IoUring::~IoUring() {}
+
+bool IoUring::Open(unsigned entries) {
+  errno = ENOSYS;
+  return false;
+}
+
+bool IoUring::Submit(uint8_t opcode, int fd, uint64_t addr, size_t length,
+                     Position offset, uint64_t user_data) {
+  errno = ENOSYS;
+  return false;
+}
+
+bool IoUring::SubmitRead(int fd, char* dest, size_t length, Position offset,
+                         uint64_t user_data) {
+  errno = ENOSYS;
+  return false;
+}
+
+bool IoUring::SubmitWrite(int fd, const char* src, size_t length,
+                          Position offset, uint64_t user_data) {
+  errno = ENOSYS;
+  return false;
+}
+
+bool IoUring::WaitForCompletion(uint64_t& user_data, int32_t& result) {
+  errno = ENOSYS;
+  return false;
+}
+
+#endif  // !RIEGELI_INTERNAL_HAVE_IO_URING
+
+std::unique_ptr<IoUringReadAhead> IoUringReadAhead::Create(int fd,
+                                                           size_t queue_depth,
+                                                           size_t block_size) {
+  RIEGELI_ASSERT_GT(queue_depth, 0u)
+      << "Failed precondition of IoUringReadAhead::Create(): "
+         "zero queue depth";
+  RIEGELI_ASSERT_GT(block_size, 0u)
+      << "Failed precondition of IoUringReadAhead::Create(): "
+         "zero block size";
+  std::unique_ptr<IoUringReadAhead> read_ahead(new IoUringReadAhead(
+      fd, queue_depth, UnsignedMin(block_size, kMaxRequestLength)));
+  if (ABSL_PREDICT_FALSE(
+          !read_ahead->ring_.Open(IntCast<unsigned>(queue_depth)))) {
+    return nullptr;
+  }
+  return read_ahead;
+}
+
+IoUringReadAhead::IoUringReadAhead(int fd, size_t queue_depth,
+                                   size_t block_size)
+    : fd_(fd), block_size_(block_size), blocks_(queue_depth) {}
+
+IoUringReadAhead::~IoUringReadAhead() { Discard(); }
+
+inline bool IoUringReadAhead::Schedule() {
+  while (blocks_in_flight_ < blocks_.size()) {
+    const size_t index = (front_ + blocks_in_flight_) % blocks_.size();
+    Block& block = blocks_[index];
+    if (block.data == nullptr) block.data.reset(new char[block_size_]);
+    if (ABSL_PREDICT_FALSE(!ring_.SubmitRead(fd_, block.data.get(),
+                                             block_size_, next_pos_, index))) {
+      return false;
+    }
+    block.pos = next_pos_;
+    block.length = 0;
+    block.consumed = 0;
+    block.completed = false;
+    ++pending_;
+    ++blocks_in_flight_;
+    next_pos_ += block_size_;
+  }
+  return true;
+}
+
+inline bool IoUringReadAhead::WaitForFront() {
+  RIEGELI_ASSERT_GT(blocks_in_flight_, 0u)
+      << "Failed precondition of IoUringReadAhead::WaitForFront(): "
+         "no blocks in flight";
+  while (!blocks_[front_].completed) {
+    uint64_t index;
+    int32_t result;
+    if (ABSL_PREDICT_FALSE(!ring_.WaitForCompletion(index, result))) {
+      return false;
+    }
+    Block& block = blocks_[IntCast<size_t>(index)];
+    if (ABSL_PREDICT_FALSE(result == -EINTR || result == -EAGAIN)) {
+      if (ABSL_PREDICT_FALSE(!ring_.SubmitRead(fd_, block.data.get(),
+                                               block_size_, block.pos,
+                                               index))) {
+        return false;
+      }
+      continue;
+    }
+    --pending_;
+    block.completed = true;
+    if (ABSL_PREDICT_FALSE(result < 0)) {
+      errno = -result;
+      return false;
+    }
+    block.length = IntCast<size_t>(result);
+  }
+  return true;
+}
+
+ssize_t IoUringReadAhead::Read(Position pos, size_t min_length,
+                               size_t max_length, char* dest) {
+  RIEGELI_ASSERT_GT(min_length, 0u)
+      << "Failed precondition of IoUringReadAhead::Read(): nothing to read";
+  RIEGELI_ASSERT_GE(max_length, min_length)
+      << "Failed precondition of IoUringReadAhead::Read(): "
+         "max_length < min_length";
+  max_length = UnsignedMin(max_length, kMaxRequestLength);
+  min_length = UnsignedMin(min_length, max_length);
+  if (blocks_in_flight_ == 0 ||
+      blocks_[front_].pos + blocks_[front_].consumed != pos) {
+    // Reads in flight are not useful at `pos`.
+    if (ABSL_PREDICT_FALSE(!Discard())) return -1;
+    next_pos_ = pos;
+  }
+  size_t length_read = 0;
+  for (;;) {
+    if (ABSL_PREDICT_FALSE(!Schedule()) && blocks_in_flight_ == 0) return -1;
+    if (ABSL_PREDICT_FALSE(!WaitForFront())) {
+      const int error_number = errno;
+      Discard();
+      errno = error_number;
+      return -1;
+    }
+    Block& block = blocks_[front_];
+    if (block.consumed == block.length) {
+      // The source ends.
+      if (ABSL_PREDICT_FALSE(!Discard())) return -1;
+      return IntCast<ssize_t>(length_read);
+    }
+    const size_t length =
+        UnsignedMin(block.length - block.consumed, max_length - length_read);
+    memcpy(dest + length_read, block.data.get() + block.consumed, length);
+    block.consumed += length;
+    length_read += length;
+    if (block.consumed == block.length) {
+      if (block.length < block_size_) {
+        // A short read. Blocks following it would leave a gap.
+        if (ABSL_PREDICT_FALSE(!Discard())) return -1;
+        next_pos_ = pos + length_read;
+      } else {
+        front_ = (front_ + 1) % blocks_.size();
+        --blocks_in_flight_;
+      }
+    }
+    if (length_read >= min_length) {
+      // Keep the queue full while the caller processes the data. A failure
+      // will be reported by the next `Read()`.
+      Schedule();
+      return IntCast<ssize_t>(length_read);
+    }
+  }
+}
+
+bool IoUringReadAhead::Discard() {
+  while (pending_ > 0) {
+    uint64_t index;
+    int32_t result;
+    if (ABSL_PREDICT_FALSE(!ring_.WaitForCompletion(index, result))) {
+      return false;
+    }
+    --pending_;
+  }
+  front_ = 0;
+  blocks_in_flight_ = 0;
+  return true;
+}
+
+std::unique_ptr<IoUringWriteBehind> IoUringWriteBehind::Create(
+    int fd, size_t queue_depth) {
+  RIEGELI_ASSERT_GT(queue_depth, 0u)
+      << "Failed precondition of IoUringWriteBehind::Create(): "
+         "zero queue depth";
+  std::unique_ptr<IoUringWriteBehind> write_behind(
+      new IoUringWriteBehind(fd, queue_depth));
+  if (ABSL_PREDICT_FALSE(
+          !write_behind->ring_.Open(IntCast<unsigned>(queue_depth)))) {
+    return nullptr;
+  }
+  return write_behind;
+}
+
+IoUringWriteBehind::IoUringWriteBehind(int fd, size_t queue_depth)
+    : fd_(fd), blocks_(queue_depth) {}
+
+IoUringWriteBehind::~IoUringWriteBehind() { Flush(); }
+
+inline bool IoUringWriteBehind::WaitForOne() {
+  RIEGELI_ASSERT_GT(blocks_in_flight_, 0u)
+      << "Failed precondition of IoUringWriteBehind::WaitForOne(): "
+         "no blocks in flight";
+  for (;;) {
+    uint64_t index;
+    int32_t result;
+    if (ABSL_PREDICT_FALSE(!ring_.WaitForCompletion(index, result))) {
+      return false;
+    }
+    Block& block = blocks_[IntCast<size_t>(index)];
+    if (ABSL_PREDICT_TRUE(result > 0)) {
+      block.written += IntCast<size_t>(result);
+    } else if (result != -EINTR && result != -EAGAIN) {
+      if (error_number_ == 0) error_number_ = result == 0 ? ENOSPC : -result;
+      block.written = block.length;
+    }
+    if (block.written < block.length) {
+      // A short write, continue it.
+      if (ABSL_PREDICT_FALSE(!ring_.SubmitWrite(
+              fd_, block.data.get() + block.written,
+              block.length - block.written, block.pos + block.written,
+              index))) {
+        return false;
+      }
+      continue;
+    }
+    block.in_flight = false;
+    --blocks_in_flight_;
+    return true;
+  }
+}
+
+bool IoUringWriteBehind::Write(Position pos, absl::string_view src) {
+  while (!src.empty()) {
+    if (ABSL_PREDICT_FALSE(error_number_ != 0)) {
+      errno = error_number_;
+      return false;
+    }
+    if (blocks_in_flight_ == blocks_.size()) {
+      if (ABSL_PREDICT_FALSE(!WaitForOne())) return false;
+      continue;
+    }
+    size_t index = 0;
+    while (blocks_[index].in_flight) ++index;
+    Block& block = blocks_[index];
+    const size_t length = UnsignedMin(src.size(), kMaxRequestLength);
+    if (block.capacity < length) {
+      block.data.reset(new char[length]);
+      block.capacity = length;
+    }
+    memcpy(block.data.get(), src.data(), length);
+    if (ABSL_PREDICT_FALSE(
+            !ring_.SubmitWrite(fd_, block.data.get(), length, pos, index))) {
+      return false;
+    }
+    block.pos = pos;
+    block.length = length;
+    block.written = 0;
+    block.in_flight = true;
+    ++blocks_in_flight_;
+    pos += length;
+    src.remove_prefix(length);
+  }
+  return true;
+}
+
+bool IoUringWriteBehind::Flush() {
+  while (blocks_in_flight_ > 0) {
+    if (ABSL_PREDICT_FALSE(!WaitForOne())) return false;
+  }
+  if (ABSL_PREDICT_FALSE(error_number_ != 0)) {
+    errno = std::exchange(error_number_, 0);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace internal
+}  // namespace riegeli
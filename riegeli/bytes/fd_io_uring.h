@@ -0,0 +1,200 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_FD_IO_URING_H_
+#define RIEGELI_BYTES_FD_IO_URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+
+namespace riegeli {
+namespace internal {
+
+// A minimal Linux io_uring instance used by `FdReader` and `FdWriter` to keep
+// multiple requests in flight. It talks to the kernel with raw syscalls, so
+// it has no library dependencies.
+//
+// On systems without io_uring `Open()` fails with `ENOSYS`, and callers fall
+// back to blocking `read()`/`write()`.
+class IoUring {
+ public:
+  IoUring() noexcept {}
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring();
+
+  // Creates the ring with room for at least `entries` requests in flight.
+  //
+  // Returns `false` with `errno` set on failure.
+  bool Open(unsigned entries);
+
+  // Submits a read of `length` bytes at `offset` of `fd` into `dest`, or a
+  // write of `length` bytes at `offset` of `fd` from `src`. `user_data` is
+  // returned with the completion.
+  //
+  // Fewer requests than requested from `Open()` must be in flight.
+  //
+  // Returns `false` with `errno` set on failure.
+  bool SubmitRead(int fd, char* dest, size_t length, Position offset,
+                  uint64_t user_data);
+  bool SubmitWrite(int fd, const char* src, size_t length, Position offset,
+                   uint64_t user_data);
+
+  // Waits for the next completion and returns its `user_data` and result, the
+  // latter being like the result of `pread()`/`pwrite()` except that an error
+  // is returned as a negated `errno` value.
+  //
+  // Returns `false` with `errno` set on failure.
+  bool WaitForCompletion(uint64_t& user_data, int32_t& result);
+
+ private:
+  bool Submit(uint8_t opcode, int fd, uint64_t addr, size_t length,
+              Position offset, uint64_t user_data);
+
+  int ring_fd_ = -1;
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  void* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  void* cqes_ = nullptr;
+};
+
+// Keeps up to `queue_depth` reads of `block_size` bytes in flight, at
+// consecutive positions following the last position read.
+class IoUringReadAhead {
+ public:
+  // Returns `nullptr` with `errno` set if io_uring is not available.
+  static std::unique_ptr<IoUringReadAhead> Create(int fd, size_t queue_depth,
+                                                  size_t block_size);
+
+  IoUringReadAhead(const IoUringReadAhead&) = delete;
+  IoUringReadAhead& operator=(const IoUringReadAhead&) = delete;
+
+  // Waits for reads in flight, because their buffers are owned.
+  ~IoUringReadAhead();
+
+  // Reads at least `min_length` and at most `max_length` bytes starting at
+  // `pos`, or less if the file ends, and schedules reads following them.
+  //
+  // Returns the length read (0 if the file ends at `pos`), or -1 with `errno`
+  // set on failure.
+  //
+  // Precondition: `0 < min_length <= max_length`
+  ssize_t Read(Position pos, size_t min_length, size_t max_length, char* dest);
+
+  // Waits for reads in flight and forgets their results.
+  //
+  // Returns `false` with `errno` set on failure.
+  bool Discard();
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    Position pos = 0;
+    // Length read, valid if `completed`.
+    size_t length = 0;
+    // Length already given to the caller of `Read()`.
+    size_t consumed = 0;
+    bool completed = false;
+  };
+
+  explicit IoUringReadAhead(int fd, size_t queue_depth, size_t block_size);
+
+  bool Schedule();
+  bool WaitForFront();
+
+  IoUring ring_;
+  int fd_;
+  size_t block_size_;
+  // Circular buffer of `blocks_in_flight_` blocks starting at `front_`.
+  std::vector<Block> blocks_;
+  size_t front_ = 0;
+  size_t blocks_in_flight_ = 0;
+  // Position of the next block to schedule.
+  Position next_pos_ = 0;
+  // Number of reads submitted but not completed.
+  size_t pending_ = 0;
+};
+
+// Keeps up to `queue_depth` writes in flight. Data to write are copied, so
+// that the caller may reuse its buffer immediately.
+//
+// Errors of writes in flight are reported by later calls.
+class IoUringWriteBehind {
+ public:
+  // Returns `nullptr` with `errno` set if io_uring is not available.
+  static std::unique_ptr<IoUringWriteBehind> Create(int fd,
+                                                    size_t queue_depth);
+
+  IoUringWriteBehind(const IoUringWriteBehind&) = delete;
+  IoUringWriteBehind& operator=(const IoUringWriteBehind&) = delete;
+
+  // Waits for writes in flight, because their buffers are owned.
+  ~IoUringWriteBehind();
+
+  // Schedules writing `src` at `pos`, waiting for an earlier write if
+  // `queue_depth` writes are in flight.
+  //
+  // Returns `false` with `errno` set on failure.
+  bool Write(Position pos, absl::string_view src);
+
+  // Waits for all writes in flight.
+  //
+  // Returns `false` with `errno` set on failure.
+  bool Flush();
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+    Position pos = 0;
+    size_t length = 0;
+    // Length already written, more is resubmitted after a short write.
+    size_t written = 0;
+    bool in_flight = false;
+  };
+
+  explicit IoUringWriteBehind(int fd, size_t queue_depth);
+
+  bool WaitForOne();
+
+  IoUring ring_;
+  int fd_;
+  std::vector<Block> blocks_;
+  size_t blocks_in_flight_ = 0;
+  // `errno` of the first failed write not reported yet, or 0.
+  int error_number_ = 0;
+};
+
+}  // namespace internal
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_FD_IO_URING_H_
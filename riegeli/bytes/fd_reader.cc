@@ -12,6 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// Make `O_DIRECT` available.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 // Make `pread()` available.
 #if !defined(_XOPEN_SOURCE) || _XOPEN_SOURCE < 500
 #undef _XOPEN_SOURCE
@@ -30,30 +35,47 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstring>
 #include <limits>
 #include <string>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
+#include "absl/strings/cord.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/errno_mapping.h"
 #include "riegeli/base/memory_estimator.h"
+#include "riegeli/base/object.h"
 #include "riegeli/base/status.h"
+#include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/buffered_reader.h"
 #include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/fd_io_uring.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/bytes/io_observer.h"
+#include "riegeli/bytes/writer.h"
 
 namespace riegeli {
 
 namespace {
 
+// The number of consecutive reads without a seek after which `FdReader` with
+// `Options::access_hints()` considers the access pattern sequential.
+constexpr size_t kSequentialReadsForAdvice = 2;
+
 class MMapRef {
  public:
   MMapRef() noexcept {}
@@ -93,7 +115,8 @@ inline void FdReaderBase::SetFilename(int src) {
   }
 }
 
-int FdReaderBase::OpenFd(absl::string_view filename, int flags) {
+int FdReaderBase::OpenFd(absl::string_view filename, int flags,
+                         bool direct_io) {
   RIEGELI_ASSERT((flags & O_ACCMODE) == O_RDONLY ||
                  (flags & O_ACCMODE) == O_RDWR)
       << "Failed precondition of FdReader: "
@@ -101,10 +124,21 @@ int FdReaderBase::OpenFd(absl::string_view filename, int flags) {
   // TODO: When `absl::string_view` becomes C++17 `std::string_view`:
   // `filename_ = filename`
   filename_.assign(filename.data(), filename.size());
+#ifdef O_DIRECT
+  if (direct_io) flags |= O_DIRECT;
+#endif
 again:
   const int src = open(filename_.c_str(), flags, 0666);
   if (ABSL_PREDICT_FALSE(src < 0)) {
     if (errno == EINTR) goto again;
+#ifdef O_DIRECT
+    if (errno == EINVAL && (flags & O_DIRECT) != 0) {
+      // The filesystem does not support `O_DIRECT`. Aligned reads still work
+      // through the page cache.
+      flags &= ~O_DIRECT;
+      goto again;
+    }
+#endif
     FailOperation("open()");
     return -1;
   }
@@ -152,6 +186,28 @@ void FdReaderBase::InitializePos(int src, absl::optional<Position> assumed_pos,
     set_limit_pos(IntCast<Position>(file_pos));
     supports_random_access_ = true;
   }
+  if (!supports_random_access_) direct_io_ = false;
+  if (io_uring_queue_depth_ > 0 && supports_random_access_ && !direct_io_) {
+    // If io_uring is not available, `io_uring_` remains `nullptr` and
+    // `read()` or `pread()` is used.
+    io_uring_ = internal::IoUringReadAhead::Create(
+        src, io_uring_queue_depth_, buffer_size_for_io_uring_);
+  }
+  if (read_ahead_ > 0 && supports_random_access_ && !direct_io_ &&
+      io_uring_ == nullptr) {
+    set_read_ahead(read_ahead_);
+  }
+  reads_at_explicit_pos_ =
+      direct_io_ || io_uring_ != nullptr || read_ahead() > 0;
+  if (!supports_random_access_) access_hints_ = false;
+  drop_cache_pos_ = limit_pos();
+}
+
+void FdReaderBase::Done() {
+  if (reads_at_explicit_pos_) SyncPos();
+  BufferedReader::Done();
+  io_uring_.reset();
+  direct_buffer_ = AlignedBuffer<internal::kDirectIoAlignment>();
 }
 
 bool FdReaderBase::FailOperation(absl::string_view operation) {
@@ -186,8 +242,23 @@ bool FdReaderBase::ReadInternal(size_t min_length, size_t max_length,
                              limit_pos())) {
     return FailOverflow();
   }
+  if (access_hints_) AdviseSequential(src);
+  if (io_uring_ != nullptr) {
+    const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+    const ssize_t length_read =
+        io_uring_->Read(limit_pos(), min_length, max_length, dest);
+    timer.ReportRead("io_uring read", limit_pos(), max_length,
+                     length_read >= 0, static_cast<size_t>(length_read));
+    if (ABSL_PREDICT_FALSE(length_read < 0)) {
+      return FailOperation("io_uring read");
+    }
+    move_limit_pos(IntCast<size_t>(length_read));
+    return IntCast<size_t>(length_read) >= min_length;
+  }
+  if (direct_io_) return ReadDirect(min_length, max_length, dest);
   for (;;) {
   again:
+    const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
     const ssize_t length_read =
         has_independent_pos_
             ? pread(src, dest,
@@ -197,6 +268,9 @@ bool FdReaderBase::ReadInternal(size_t min_length, size_t max_length,
             : read(src, dest,
                    UnsignedMin(max_length,
                                size_t{std::numeric_limits<ssize_t>::max()}));
+    timer.ReportRead(has_independent_pos_ ? "pread()" : "read()", limit_pos(),
+                     max_length, length_read >= 0,
+                     static_cast<size_t>(length_read));
     if (ABSL_PREDICT_FALSE(length_read < 0)) {
       if (errno == EINTR) goto again;
       return FailOperation(has_independent_pos_ ? "pread()" : "read()");
@@ -213,6 +287,286 @@ bool FdReaderBase::ReadInternal(size_t min_length, size_t max_length,
   }
 }
 
+bool FdReaderBase::ReadVectoredInternal(
+    absl::Span<const absl::Span<char>> dest) {
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of BufferedReader::ReadVectoredInternal(): "
+      << status();
+  if (io_uring_ != nullptr || direct_io_) {
+    return BufferedReader::ReadVectoredInternal(dest);
+  }
+  const int src = src_fd();
+  if (access_hints_) AdviseSequential(src);
+  // Skip empty pieces, and bound the number of pieces passed at once.
+  std::vector<iovec> iovecs;
+  iovecs.reserve(UnsignedMin(dest.size(), size_t{IOV_MAX}));
+  size_t dest_index = 0;
+  for (;;) {
+    iovecs.clear();
+    size_t length = 0;
+    while (dest_index < dest.size() && iovecs.size() < size_t{IOV_MAX}) {
+      const absl::Span<char> piece = dest[dest_index];
+      if (piece.size() > size_t{std::numeric_limits<ssize_t>::max()} - length) {
+        break;
+      }
+      ++dest_index;
+      if (piece.empty()) continue;
+      iovecs.push_back(iovec{piece.data(), piece.size()});
+      length += piece.size();
+    }
+    if (iovecs.empty()) {
+      if (dest_index == dest.size()) return true;
+      // A single piece too long for one call.
+      const absl::Span<char> piece = dest[dest_index];
+      if (ABSL_PREDICT_FALSE(
+              !ReadInternal(piece.size(), piece.size(), piece.data()))) {
+        return false;
+      }
+      ++dest_index;
+      continue;
+    }
+    if (ABSL_PREDICT_FALSE(length >
+                           Position{std::numeric_limits<off_t>::max()} -
+                               limit_pos())) {
+      return FailOverflow();
+    }
+    iovec* iov = iovecs.data();
+    int iov_count = IntCast<int>(iovecs.size());
+    do {
+    again:
+      const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+      const ssize_t length_read =
+          has_independent_pos_
+              ? preadv(src, iov, iov_count, IntCast<off_t>(limit_pos()))
+              : readv(src, iov, iov_count);
+      timer.ReportRead(has_independent_pos_ ? "preadv()" : "readv()",
+                       limit_pos(), length, length_read >= 0,
+                       static_cast<size_t>(length_read));
+      if (ABSL_PREDICT_FALSE(length_read < 0)) {
+        if (errno == EINTR) goto again;
+        return FailOperation(has_independent_pos_ ? "preadv()" : "readv()");
+      }
+      if (ABSL_PREDICT_FALSE(length_read == 0)) return false;
+      RIEGELI_ASSERT_LE(IntCast<size_t>(length_read), length)
+          << (has_independent_pos_ ? "preadv()" : "readv()")
+          << " read more than requested";
+      move_limit_pos(IntCast<size_t>(length_read));
+      length -= IntCast<size_t>(length_read);
+      // Skip pieces read completely, and the read prefix of the next piece.
+      size_t remaining = IntCast<size_t>(length_read);
+      while (iov_count > 0 && remaining >= iov->iov_len) {
+        remaining -= iov->iov_len;
+        ++iov;
+        --iov_count;
+      }
+      if (remaining > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+        iov->iov_len -= remaining;
+      }
+    } while (length > 0);
+  }
+}
+
+bool FdReaderBase::CopySlow(Position length, Writer& dest) {
+  RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), length)
+      << "Failed precondition of Reader::CopySlow(Writer&): "
+         "enough data available, use Copy(Writer&) instead";
+  // Copying between fds is done by the kernel if possible, without passing
+  // data through user space.
+  if (length - UnsignedMin(available(), length) >= kDefaultBufferSize &&
+      !reads_at_explicit_pos_ &&
+      dest.GetTypeId() == TypeId::For<FdWriterBase>()) {
+    const size_t available_length = available();
+    if (available_length > 0) {
+      const bool write_ok =
+          dest.Write(absl::string_view(cursor(), available_length));
+      move_cursor(available_length);
+      if (ABSL_PREDICT_FALSE(!write_ok)) return false;
+      length -= available_length;
+    }
+    SyncBuffer();
+    if (ABSL_PREDICT_FALSE(!healthy())) return false;
+    const int src = src_fd();
+    if (ABSL_PREDICT_FALSE(length >
+                           Position{std::numeric_limits<off_t>::max()} -
+                               limit_pos())) {
+      return FailOverflow();
+    }
+    if (access_hints_) AdviseSequential(src);
+    const absl::optional<Position> length_copied =
+        static_cast<FdWriterBase&>(dest).CopyFromFd(
+            src,
+            has_independent_pos_ ? absl::make_optional(limit_pos())
+                                 : absl::nullopt,
+            length);
+    if (length_copied != absl::nullopt) {
+      move_limit_pos(*length_copied);
+      return *length_copied == length;
+    }
+  }
+  return BufferedReader::CopySlow(length, dest);
+}
+
+inline bool FdReaderBase::ReadDirect(size_t min_length, size_t max_length,
+                                     char* dest) {
+  RIEGELI_ASSERT(direct_io_)
+      << "Failed precondition of FdReaderBase::ReadDirect(): "
+         "direct I/O not used";
+  const int src = src_fd();
+  if (direct_buffer_.capacity() == 0) {
+    direct_buffer_.Reset(UnsignedMin(
+        RoundUp<internal::kDirectIoAlignment>(buffer_size_for_io_uring_),
+        RoundDown<internal::kDirectIoAlignment>(
+            size_t{std::numeric_limits<ssize_t>::max()})));
+  }
+  for (;;) {
+    if (limit_pos() >= direct_buffer_pos_ &&
+        limit_pos() < direct_buffer_pos_ + direct_buffer_length_) {
+      const size_t offset = IntCast<size_t>(limit_pos() - direct_buffer_pos_);
+      const size_t length =
+          UnsignedMin(direct_buffer_length_ - offset, max_length);
+      std::memcpy(dest, direct_buffer_.data() + offset, length);
+      move_limit_pos(length);
+      if (length >= min_length) return true;
+      dest += length;
+      min_length -= length;
+      max_length -= length;
+    }
+    // `O_DIRECT` requires the position, length, and buffer address to be
+    // aligned, so the whole block containing `limit_pos()` is read.
+    const Position block_pos =
+        RoundDown<internal::kDirectIoAlignment>(limit_pos());
+    const size_t offset = IntCast<size_t>(limit_pos() - block_pos);
+    direct_buffer_length_ = 0;
+  again:
+    const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+    const ssize_t length_read =
+        pread(src, direct_buffer_.data(), direct_buffer_.capacity(),
+              IntCast<off_t>(block_pos));
+    timer.ReportRead("pread()", block_pos, direct_buffer_.capacity(),
+                     length_read >= 0, static_cast<size_t>(length_read));
+    if (ABSL_PREDICT_FALSE(length_read < 0)) {
+      if (errno == EINTR) goto again;
+      return FailOperation("pread()");
+    }
+    RIEGELI_ASSERT_LE(IntCast<size_t>(length_read), direct_buffer_.capacity())
+        << "pread() read more than requested";
+    direct_buffer_pos_ = block_pos;
+    direct_buffer_length_ = IntCast<size_t>(length_read);
+    if (ABSL_PREDICT_FALSE(direct_buffer_length_ <= offset)) return false;
+  }
+}
+
+size_t FdReaderBase::ReadAheadInternal(Position pos, size_t max_length,
+                                       char* dest, absl::Status& status) {
+  RIEGELI_ASSERT_GT(max_length, 0u)
+      << "Failed precondition of BufferedReader::ReadAheadInternal(): "
+         "nothing to read";
+  // This runs on a background thread, so only the fd is used.
+  const int src = src_fd();
+  if (ABSL_PREDICT_FALSE(pos >= Position{std::numeric_limits<off_t>::max()})) {
+    status = absl::ResourceExhaustedError("FdReader position overflow");
+    return 0;
+  }
+  max_length = UnsignedMin(max_length,
+                           Position{std::numeric_limits<off_t>::max()} - pos,
+                           size_t{std::numeric_limits<ssize_t>::max()});
+again:
+  const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+  const ssize_t length_read = pread(src, dest, max_length, IntCast<off_t>(pos));
+  timer.ReportRead("pread()", pos, max_length, length_read >= 0,
+                   static_cast<size_t>(length_read));
+  if (ABSL_PREDICT_FALSE(length_read < 0)) {
+    if (errno == EINTR) goto again;
+    status = ErrnoToCanonicalStatus(errno, "pread() failed");
+    return 0;
+  }
+  RIEGELI_ASSERT_LE(IntCast<size_t>(length_read), max_length)
+      << "pread() read more than requested";
+  return IntCast<size_t>(length_read);
+}
+
+void FdReaderBase::ReadHintSlow(size_t length) {
+  RIEGELI_ASSERT_LT(available(), length)
+      << "Failed precondition of Reader::ReadHintSlow(): "
+         "enough data available, use ReadHint() instead";
+#ifdef POSIX_FADV_WILLNEED
+  if (access_hints_ && ABSL_PREDICT_TRUE(healthy())) {
+    const int src = src_fd();
+    const Position length_to_read = length - available();
+    if (length_to_read <=
+        Position{std::numeric_limits<off_t>::max()} - limit_pos()) {
+      // Failures of access hints are not significant.
+      posix_fadvise(src, IntCast<off_t>(limit_pos()),
+                    IntCast<off_t>(length_to_read), POSIX_FADV_WILLNEED);
+    }
+  }
+#endif
+  BufferedReader::ReadHintSlow(length);
+}
+
+inline void FdReaderBase::AdviseSequential(int src) {
+  RIEGELI_ASSERT(access_hints_)
+      << "Failed precondition of FdReaderBase::AdviseSequential(): "
+         "access hints not used";
+#ifdef POSIX_FADV_SEQUENTIAL
+  // Failures of access hints are not significant.
+  if (sequential_reads_ < kSequentialReadsForAdvice) {
+    ++sequential_reads_;
+    if (sequential_reads_ < kSequentialReadsForAdvice) return;
+    posix_fadvise(src, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  if (drop_cache_behind_ && limit_pos() > drop_cache_pos_) {
+    posix_fadvise(src, IntCast<off_t>(drop_cache_pos_),
+                  IntCast<off_t>(limit_pos() - drop_cache_pos_),
+                  POSIX_FADV_DONTNEED);
+    drop_cache_pos_ = limit_pos();
+  }
+#endif
+}
+
+inline void FdReaderBase::AdviseSeek(int src, Position new_pos) {
+  RIEGELI_ASSERT(access_hints_)
+      << "Failed precondition of FdReaderBase::AdviseSeek(): "
+         "access hints not used";
+  if (new_pos == limit_pos()) return;
+#ifdef POSIX_FADV_NORMAL
+  if (sequential_reads_ >= kSequentialReadsForAdvice) {
+    // Failures of access hints are not significant.
+    posix_fadvise(src, 0, 0, POSIX_FADV_NORMAL);
+  }
+#endif
+  sequential_reads_ = 0;
+  // Data read before a seek are not dropped from the page cache, because
+  // random access can return to them.
+  drop_cache_pos_ = new_pos;
+}
+
+inline bool FdReaderBase::SyncPos() {
+  RIEGELI_ASSERT(reads_at_explicit_pos_)
+      << "Failed precondition of FdReaderBase::SyncPos(): "
+         "reads not at explicit positions";
+  if (io_uring_ != nullptr && ABSL_PREDICT_FALSE(!io_uring_->Discard())) {
+    return FailOperation("io_uring read");
+  }
+  // The file could have been changed.
+  direct_buffer_length_ = 0;
+  if (has_independent_pos_ || ABSL_PREDICT_FALSE(!healthy())) return true;
+  // Reads at explicit positions do not move the fd position. If data are
+  // buffered, `BufferedReader` seeks back to `pos()` afterwards.
+  const int src = src_fd();
+  if (ABSL_PREDICT_FALSE(lseek(src, IntCast<off_t>(limit_pos()), SEEK_SET) <
+                         0)) {
+    return FailOperation("lseek()");
+  }
+  return true;
+}
+
+bool FdReaderBase::SyncImpl(SyncType sync_type) {
+  if (reads_at_explicit_pos_) SyncPos();
+  return BufferedReader::SyncImpl(sync_type);
+}
+
 inline bool FdReaderBase::SeekInternal(int src, Position new_pos) {
   RIEGELI_ASSERT_EQ(available(), 0u)
       << "Failed precondition of FdReaderBase::SeekInternal(): "
@@ -220,11 +574,13 @@ inline bool FdReaderBase::SeekInternal(int src, Position new_pos) {
   RIEGELI_ASSERT(supports_random_access_)
       << "Failed precondition of FdReaderBase::SeekInternal(): "
          "random access not supported";
+  io_stats_.AddSeek();
   if (!has_independent_pos_) {
     if (ABSL_PREDICT_FALSE(lseek(src, IntCast<off_t>(new_pos), SEEK_SET) < 0)) {
       return FailOperation("lseek()");
     }
   }
+  if (access_hints_) AdviseSeek(src, new_pos);
   set_limit_pos(new_pos);
   return true;
 }
@@ -308,6 +664,28 @@ void FdMMapReaderBase::InitializePos(int src,
     FailOperation("fstat()");
     return;
   }
+  if (window_size_ > 0) {
+    const size_t page_size = IntCast<size_t>(sysconf(_SC_PAGESIZE));
+    window_size_ =
+        UnsignedMin(window_size_, std::numeric_limits<size_t>::max() -
+                                      (page_size - 1)) +
+        (page_size - 1);
+    window_size_ -= window_size_ % page_size;
+    file_size_ = IntCast<Position>(stat_info.st_size);
+    Position initial_pos;
+    if (independent_pos != absl::nullopt) {
+      initial_pos = *independent_pos;
+    } else {
+      const off_t file_pos = lseek(src, 0, SEEK_CUR);
+      if (ABSL_PREDICT_FALSE(file_pos < 0)) {
+        FailOperation("lseek()");
+        return;
+      }
+      initial_pos = IntCast<Position>(file_pos);
+    }
+    MapWindow(UnsignedMin(initial_pos, file_size_));
+    return;
+  }
   if (ABSL_PREDICT_FALSE(IntCast<Position>(stat_info.st_size) >
                          std::numeric_limits<size_t>::max())) {
     Fail(absl::OutOfRangeError(absl::StrCat("mmap() cannot be used reading ",
@@ -315,9 +693,8 @@ void FdMMapReaderBase::InitializePos(int src,
     return;
   }
   if (stat_info.st_size == 0) return;
-  void* const data = mmap(nullptr, IntCast<size_t>(stat_info.st_size),
-                          PROT_READ, MAP_SHARED, src, 0);
-  if (ABSL_PREDICT_FALSE(data == MAP_FAILED)) {
+  const char* const data = MMap(src, 0, IntCast<size_t>(stat_info.st_size));
+  if (ABSL_PREDICT_FALSE(data == nullptr)) {
     FailOperation("mmap()");
     return;
   }
@@ -326,8 +703,7 @@ void FdMMapReaderBase::InitializePos(int src,
   // `Chain` and updates the `ChainReader` to read from it.
   ChainReader::Reset(std::forward_as_tuple(ChainBlock::FromExternal<MMapRef>(
       std::forward_as_tuple(),
-      absl::string_view(static_cast<const char*>(data),
-                        IntCast<size_t>(stat_info.st_size)))));
+      absl::string_view(data, IntCast<size_t>(stat_info.st_size)))));
   if (independent_pos != absl::nullopt) {
     move_cursor(UnsignedMin(*independent_pos, available()));
   } else {
@@ -338,6 +714,64 @@ void FdMMapReaderBase::InitializePos(int src,
     }
     move_cursor(UnsignedMin(IntCast<Position>(file_pos), available()));
   }
+  if (will_need_) AdviseWillNeed();
+}
+
+inline const char* FdMMapReaderBase::MMap(int src, Position offset,
+                                          size_t length) {
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (populate_) flags |= MAP_POPULATE;
+#endif
+  void* const data =
+      mmap(nullptr, length, PROT_READ, flags, src, IntCast<off_t>(offset));
+  if (ABSL_PREDICT_FALSE(data == MAP_FAILED)) return nullptr;
+  // Failures of access hints are not significant.
+#ifdef MADV_HUGEPAGE
+  if (huge_pages_) madvise(data, length, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_SEQUENTIAL
+  if (sequential_) madvise(data, length, MADV_SEQUENTIAL);
+#endif
+  return static_cast<const char*>(data);
+}
+
+inline void FdMMapReaderBase::AdviseWillNeed() {
+#ifdef MADV_WILLNEED
+  if (available() == 0) return;
+  // `madvise()` requires an address aligned to the page size. The buffer is a
+  // whole mapping, which starts at a page boundary.
+  const size_t page_size = IntCast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t offset = read_from_buffer() / page_size * page_size;
+  // Failures of access hints are not significant.
+  madvise(const_cast<char*>(start()) + offset, buffer_size() - offset,
+          MADV_WILLNEED);
+#endif
+}
+
+bool FdMMapReaderBase::MapWindow(Position new_pos) {
+  RIEGELI_ASSERT_GT(window_size_, 0u)
+      << "Failed precondition of FdMMapReaderBase::MapWindow(): "
+         "window not used";
+  if (new_pos >= file_size_) {
+    // File ends.
+    ChainReader::Reset(std::forward_as_tuple());
+    set_limit_pos(file_size_);
+    return false;
+  }
+  const int src = src_fd();
+  const Position window_pos = new_pos / window_size_ * window_size_;
+  const size_t length = IntCast<size_t>(
+      UnsignedMin(Position{window_size_}, file_size_ - window_pos));
+  const char* const data = MMap(src, window_pos, length);
+  if (ABSL_PREDICT_FALSE(data == nullptr)) return FailOperation("mmap()");
+  // The previous window is unmapped when no longer referenced.
+  ChainReader::Reset(std::forward_as_tuple(ChainBlock::FromExternal<MMapRef>(
+      std::forward_as_tuple(), absl::string_view(data, length))));
+  set_buffer(data, length, IntCast<size_t>(new_pos - window_pos));
+  set_limit_pos(window_pos + length);
+  if (will_need_) AdviseWillNeed();
+  return true;
 }
 
 void FdMMapReaderBase::Done() {
@@ -346,6 +780,134 @@ void FdMMapReaderBase::Done() {
   ChainReader::src().Clear();
 }
 
+bool FdMMapReaderBase::PullBehindScratch() {
+  if (window_size_ == 0) return ChainReader::PullBehindScratch();
+  RIEGELI_ASSERT_EQ(available(), 0u)
+      << "Failed precondition of PullableReader::PullBehindScratch(): "
+         "enough data available, use Pull() instead";
+  RIEGELI_ASSERT(!scratch_used())
+      << "Failed precondition of PullableReader::PullBehindScratch(): "
+         "scratch used";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  return MapWindow(limit_pos());
+}
+
+bool FdMMapReaderBase::ReadBehindScratch(size_t length, Chain& dest) {
+  if (window_size_ == 0) return ChainReader::ReadBehindScratch(length, dest);
+  RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), length)
+      << "Failed precondition of PullableReader::ReadBehindScratch(Chain&): "
+         "enough data available, use Read(Chain&) instead";
+  RIEGELI_ASSERT_LE(length, std::numeric_limits<size_t>::max() - dest.size())
+      << "Failed precondition of PullableReader::ReadBehindScratch(Chain&): "
+         "Chain size overflow";
+  RIEGELI_ASSERT(!scratch_used())
+      << "Failed precondition of PullableReader::ReadBehindScratch(Chain&): "
+         "scratch used";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  for (;;) {
+    const size_t length_to_read = UnsignedMin(length, available());
+    if (length_to_read > 0) {
+      iter_.AppendSubstrTo(absl::string_view(cursor(), length_to_read), dest);
+      move_cursor(length_to_read);
+      length -= length_to_read;
+      if (length == 0) return true;
+    }
+    if (ABSL_PREDICT_FALSE(!MapWindow(limit_pos()))) return false;
+  }
+}
+
+bool FdMMapReaderBase::ReadBehindScratch(size_t length, absl::Cord& dest) {
+  if (window_size_ == 0) return ChainReader::ReadBehindScratch(length, dest);
+  RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), length)
+      << "Failed precondition of PullableReader::ReadBehindScratch(Cord&): "
+         "enough data available, use Read(Cord&) instead";
+  RIEGELI_ASSERT_LE(length, std::numeric_limits<size_t>::max() - dest.size())
+      << "Failed precondition of PullableReader::ReadBehindScratch(Cord&): "
+         "Cord size overflow";
+  RIEGELI_ASSERT(!scratch_used())
+      << "Failed precondition of PullableReader::ReadBehindScratch(Cord&): "
+         "scratch used";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  for (;;) {
+    const size_t length_to_read = UnsignedMin(length, available());
+    if (length_to_read > 0) {
+      iter_.AppendSubstrTo(absl::string_view(cursor(), length_to_read), dest);
+      move_cursor(length_to_read);
+      length -= length_to_read;
+      if (length == 0) return true;
+    }
+    if (ABSL_PREDICT_FALSE(!MapWindow(limit_pos()))) return false;
+  }
+}
+
+bool FdMMapReaderBase::CopyBehindScratch(Position length, Writer& dest) {
+  if (window_size_ == 0) return ChainReader::CopyBehindScratch(length, dest);
+  RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), length)
+      << "Failed precondition of PullableReader::CopyBehindScratch(Writer&): "
+         "enough data available, use Copy(Writer&) instead";
+  RIEGELI_ASSERT(!scratch_used())
+      << "Failed precondition of PullableReader::CopyBehindScratch(Writer&): "
+         "scratch used";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  for (;;) {
+    const size_t length_to_copy =
+        IntCast<size_t>(UnsignedMin(length, available()));
+    if (length_to_copy > 0) {
+      Chain data;
+      iter_.AppendSubstrTo(absl::string_view(cursor(), length_to_copy), data);
+      move_cursor(length_to_copy);
+      if (ABSL_PREDICT_FALSE(!dest.Write(std::move(data)))) return false;
+      length -= length_to_copy;
+      if (length == 0) return true;
+    }
+    if (ABSL_PREDICT_FALSE(!MapWindow(limit_pos()))) return false;
+  }
+}
+
+bool FdMMapReaderBase::CopyBehindScratch(size_t length, BackwardWriter& dest) {
+  if (window_size_ == 0) return ChainReader::CopyBehindScratch(length, dest);
+  RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), length)
+      << "Failed precondition of "
+         "PullableReader::CopyBehindScratch(BackwardWriter&): "
+         "enough data available, use Copy(BackwardWriter&) instead";
+  RIEGELI_ASSERT(!scratch_used())
+      << "Failed precondition of "
+         "PullableReader::CopyBehindScratch(BackwardWriter&): "
+         "scratch used";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (ABSL_PREDICT_FALSE(length > file_size_ - pos())) {
+    MapWindow(file_size_);
+    return false;
+  }
+  Chain data;
+  if (ABSL_PREDICT_FALSE(!FdMMapReaderBase::ReadBehindScratch(length, data))) {
+    return false;
+  }
+  return dest.Write(std::move(data));
+}
+
+bool FdMMapReaderBase::SeekBehindScratch(Position new_pos) {
+  if (window_size_ == 0) return ChainReader::SeekBehindScratch(new_pos);
+  RIEGELI_ASSERT(new_pos < start_pos() || new_pos > limit_pos())
+      << "Failed precondition of PullableReader::SeekBehindScratch(): "
+         "position in the buffer, use Seek() instead";
+  RIEGELI_ASSERT(!scratch_used())
+      << "Failed precondition of PullableReader::SeekBehindScratch(): "
+         "scratch used";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (new_pos >= file_size_) {
+    MapWindow(file_size_);
+    return new_pos == file_size_;
+  }
+  return MapWindow(new_pos);
+}
+
+absl::optional<Position> FdMMapReaderBase::SizeImpl() {
+  if (window_size_ == 0) return ChainReader::SizeImpl();
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  return file_size_;
+}
+
 bool FdMMapReaderBase::FailOperation(absl::string_view operation) {
   const int error_number = errno;
   RIEGELI_ASSERT_NE(error_number, 0)
@@ -18,6 +18,7 @@
 #include <fcntl.h>
 #include <stddef.h>
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <type_traits>
@@ -26,14 +27,22 @@
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
+#include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/dependency.h"
+#include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/buffered_reader.h"
 #include "riegeli/bytes/chain_reader.h"
 #include "riegeli/bytes/fd_dependency.h"
+#include "riegeli/bytes/fd_io_uring.h"
+#include "riegeli/bytes/io_observer.h"
+#include "riegeli/bytes/io_stats.h"
+#include "riegeli/bytes/writer.h"
 
 namespace riegeli {
 
@@ -101,10 +110,140 @@ class FdReaderBase : public BufferedReader {
     }
     size_t buffer_size() const { return buffer_size_; }
 
+    // If larger than `buffer_size()`, the length of reads grows up to
+    // `max_buffer_size()` while the file is read sequentially, and returns to
+    // `buffer_size()` after seeking. This suits both long sequential scans and
+    // random access with short reads.
+    //
+    // Default: 0 (the length of reads is `buffer_size()`).
+    Options& set_max_buffer_size(size_t max_buffer_size) & {
+      max_buffer_size_ = max_buffer_size;
+      return *this;
+    }
+    Options&& set_max_buffer_size(size_t max_buffer_size) && {
+      return std::move(set_max_buffer_size(max_buffer_size));
+    }
+    size_t max_buffer_size() const { return max_buffer_size_; }
+
+    // If positive, reads are submitted through Linux io_uring, keeping up to
+    // `io_uring_queue_depth()` reads of `buffer_size()` in flight ahead of the
+    // current position. This overlaps the latency of the storage with
+    // processing of the data already read.
+    //
+    // This is used only if random access is supported. If io_uring is not
+    // available, `read()` or `pread()` is used instead.
+    //
+    // Default: 0 (io_uring is not used).
+    Options& set_io_uring_queue_depth(size_t io_uring_queue_depth) & {
+      io_uring_queue_depth_ = io_uring_queue_depth;
+      return *this;
+    }
+    Options&& set_io_uring_queue_depth(size_t io_uring_queue_depth) && {
+      return std::move(set_io_uring_queue_depth(io_uring_queue_depth));
+    }
+    size_t io_uring_queue_depth() const { return io_uring_queue_depth_; }
+
+    // If positive, up to `read_ahead()` further buffers of `buffer_size()` are
+    // read with `pread()` on a background thread while data already read are
+    // being consumed.
+    //
+    // This is used only if random access is supported and io_uring is not
+    // used.
+    //
+    // Default: 0 (no read-ahead).
+    Options& set_read_ahead(size_t read_ahead) & {
+      read_ahead_ = read_ahead;
+      return *this;
+    }
+    Options&& set_read_ahead(size_t read_ahead) && {
+      return std::move(set_read_ahead(read_ahead));
+    }
+    size_t read_ahead() const { return read_ahead_; }
+
+    // If `true`, the file is read bypassing the page cache: it is opened with
+    // `O_DIRECT` (if opened by `FdReader` and if the filesystem supports it),
+    // and reads are performed with `pread()` into an aligned buffer at aligned
+    // positions and lengths, as `O_DIRECT` requires. If the fd is given, it
+    // should have been opened with `O_DIRECT`.
+    //
+    // This is used only if random access is supported. io_uring and
+    // read-ahead are then not used.
+    //
+    // Default: `false`.
+    Options& set_direct_io(bool direct_io) & {
+      direct_io_ = direct_io;
+      return *this;
+    }
+    Options&& set_direct_io(bool direct_io) && {
+      return std::move(set_direct_io(direct_io));
+    }
+    bool direct_io() const { return direct_io_; }
+
+    // If `true`, access patterns are described to the kernel with
+    // `posix_fadvise()`:
+    //  * `POSIX_FADV_SEQUENTIAL` after consecutive reads without a seek,
+    //    which increases kernel read-ahead, and `POSIX_FADV_NORMAL` again after
+    //    a seek elsewhere, e.g. by `RecordReader::Seek()`
+    //  * `POSIX_FADV_WILLNEED` for data announced by `ReadHint()`, e.g. for a
+    //    whole chunk by `RecordReader`
+    //
+    // This is used only if random access is supported.
+    //
+    // Default: `false`.
+    Options& set_access_hints(bool access_hints) & {
+      access_hints_ = access_hints;
+      return *this;
+    }
+    Options&& set_access_hints(bool access_hints) && {
+      return std::move(set_access_hints(access_hints));
+    }
+    bool access_hints() const { return access_hints_; }
+
+    // If `true`, data already read while reading sequentially are dropped from
+    // the page cache with `POSIX_FADV_DONTNEED`, so that a scan of a large file
+    // does not evict more useful data.
+    //
+    // This is used only if `access_hints()`.
+    //
+    // Default: `false`.
+    Options& set_drop_cache_behind(bool drop_cache_behind) & {
+      drop_cache_behind_ = drop_cache_behind;
+      return *this;
+    }
+    Options&& set_drop_cache_behind(bool drop_cache_behind) && {
+      return std::move(set_drop_cache_behind(drop_cache_behind));
+    }
+    bool drop_cache_behind() const { return drop_cache_behind_; }
+
+    // Sets the `IoObserver` which receives `read()` and `pread()` calls, with
+    // their timings.
+    //
+    // If `nullptr`, calls are not reported.
+    //
+    // Default: `nullptr`.
+    Options& set_io_observer(std::shared_ptr<IoObserver> io_observer) & {
+      io_observer_ = std::move(io_observer);
+      return *this;
+    }
+    Options&& set_io_observer(std::shared_ptr<IoObserver> io_observer) && {
+      return std::move(set_io_observer(std::move(io_observer)));
+    }
+    std::shared_ptr<IoObserver>& io_observer() { return io_observer_; }
+    const std::shared_ptr<IoObserver>& io_observer() const {
+      return io_observer_;
+    }
+
    private:
     absl::optional<Position> assumed_pos_;
     absl::optional<Position> independent_pos_;
     size_t buffer_size_ = kDefaultBufferSize;
+    size_t max_buffer_size_ = 0;
+    size_t io_uring_queue_depth_ = 0;
+    size_t read_ahead_ = 0;
+    bool direct_io_ = false;
+    bool access_hints_ = false;
+    bool drop_cache_behind_ = false;
+    std::shared_ptr<IoObserver> io_observer_;
   };
 
   // Returns the fd being read from. If the fd is owned then changed to -1 by
@@ -115,37 +254,88 @@ class FdReaderBase : public BufferedReader {
   // "/proc/self/fd/<fd>" if fd was given). Unchanged by `Close()`.
   const std::string& filename() const { return filename_; }
 
+  // Returns counters of system calls performed so far, without blocking.
+  //
+  // This can be called concurrently with reading, e.g. to export the counters
+  // periodically.
+  IoStats io_stats() const { return io_stats_.Get(); }
+
   bool SupportsRandomAccess() override { return supports_random_access_; }
 
  protected:
   FdReaderBase() noexcept {}
 
-  explicit FdReaderBase(size_t buffer_size);
+  explicit FdReaderBase(size_t buffer_size, size_t max_buffer_size,
+                        size_t io_uring_queue_depth, size_t read_ahead,
+                        bool direct_io, bool access_hints,
+                        bool drop_cache_behind,
+                        std::shared_ptr<IoObserver> io_observer);
 
   FdReaderBase(FdReaderBase&& that) noexcept;
   FdReaderBase& operator=(FdReaderBase&& that) noexcept;
 
   void Reset();
-  void Reset(size_t buffer_size);
+  void Reset(size_t buffer_size, size_t max_buffer_size,
+             size_t io_uring_queue_depth, size_t read_ahead, bool direct_io,
+             bool access_hints, bool drop_cache_behind,
+             std::shared_ptr<IoObserver> io_observer);
   void Initialize(int src, absl::optional<Position> assumed_pos,
                   absl::optional<Position> independent_pos);
-  int OpenFd(absl::string_view filename, int flags);
+  int OpenFd(absl::string_view filename, int flags, bool direct_io);
   void InitializePos(int src, absl::optional<Position> assumed_pos,
                      absl::optional<Position> independent_pos);
   ABSL_ATTRIBUTE_COLD bool FailOperation(absl::string_view operation);
 
+  void Done() override;
   void AnnotateFailure(absl::Status& status) override;
   bool ReadInternal(size_t min_length, size_t max_length, char* dest) override;
+  bool ReadVectoredInternal(absl::Span<const absl::Span<char>> dest) override;
+  size_t ReadAheadInternal(Position pos, size_t max_length, char* dest,
+                           absl::Status& status) override;
+  using BufferedReader::CopySlow;
+  bool CopySlow(Position length, Writer& dest) override;
+  void ReadHintSlow(size_t length) override;
+  bool SyncImpl(SyncType sync_type) override;
   bool SeekBehindBuffer(Position new_pos) override;
   absl::optional<Position> SizeImpl() override;
 
  private:
   void SetFilename(int src);
   bool SeekInternal(int dest, Position new_pos);
+  bool ReadDirect(size_t min_length, size_t max_length, char* dest);
+  bool SyncPos();
+  void AdviseSequential(int src);
+  void AdviseSeek(int src, Position new_pos);
 
   std::string filename_;
   bool supports_random_access_ = false;
   bool has_independent_pos_ = false;
+  size_t buffer_size_for_io_uring_ = 0;
+  size_t io_uring_queue_depth_ = 0;
+  size_t read_ahead_ = 0;
+  // Whether direct I/O was requested, and then whether it is used.
+  bool direct_io_ = false;
+  // Present if reads are submitted through io_uring.
+  std::unique_ptr<internal::IoUringReadAhead> io_uring_;
+  // Whether reads are performed at explicit positions, because of io_uring,
+  // read-ahead, or direct I/O. The fd position is then synchronized by
+  // `Close()` and `Sync()` if `!has_independent_pos_`.
+  bool reads_at_explicit_pos_ = false;
+  // If `direct_io_`, data read at the aligned position `direct_buffer_pos_`
+  // with length `direct_buffer_length_`, not necessarily returned yet.
+  AlignedBuffer<internal::kDirectIoAlignment> direct_buffer_;
+  Position direct_buffer_pos_ = 0;
+  size_t direct_buffer_length_ = 0;
+  bool access_hints_ = false;
+  bool drop_cache_behind_ = false;
+  // If `access_hints_`, the number of reads since the last seek, saturated
+  // when `POSIX_FADV_SEQUENTIAL` is given.
+  size_t sequential_reads_ = 0;
+  // If `drop_cache_behind_`, the position since which data read sequentially
+  // were not dropped from the page cache yet.
+  Position drop_cache_pos_ = 0;
+  std::shared_ptr<IoObserver> io_observer_;
+  internal::IoStatsCounter io_stats_;
 
   // Invariant: `limit_pos() <= std::numeric_limits<off_t>::max()`
 };
@@ -177,8 +367,90 @@ class FdMMapReaderBase : public ChainReader<Chain> {
       return independent_pos_;
     }
 
+    // If `true`, the mapping is expected to be read sequentially, and this is
+    // described to the kernel with `madvise(MADV_SEQUENTIAL)`, which increases
+    // kernel read-ahead and lets pages already read be reclaimed early.
+    //
+    // Default: `false`.
+    Options& set_sequential(bool sequential) & {
+      sequential_ = sequential;
+      return *this;
+    }
+    Options&& set_sequential(bool sequential) && {
+      return std::move(set_sequential(sequential));
+    }
+    bool sequential() const { return sequential_; }
+
+    // If `true`, the whole mapping following the initial position is expected
+    // to be read soon, and this is described to the kernel with
+    // `madvise(MADV_WILLNEED)`, which starts reading it in the background.
+    //
+    // Default: `false`.
+    Options& set_will_need(bool will_need) & {
+      will_need_ = will_need;
+      return *this;
+    }
+    Options&& set_will_need(bool will_need) && {
+      return std::move(set_will_need(will_need));
+    }
+    bool will_need() const { return will_need_; }
+
+    // If `true`, mappings are created with `MAP_POPULATE`, which reads the
+    // mapped part of the file and sets up page tables immediately, so that
+    // later reads do not incur page faults.
+    //
+    // Default: `false`.
+    Options& set_populate(bool populate) & {
+      populate_ = populate;
+      return *this;
+    }
+    Options&& set_populate(bool populate) && {
+      return std::move(set_populate(populate));
+    }
+    bool populate() const { return populate_; }
+
+    // If `true`, transparent huge pages are requested for mappings with
+    // `madvise(MADV_HUGEPAGE)`, which reduces TLB misses for random access.
+    // This has an effect only if the kernel supports huge pages for the
+    // filesystem.
+    //
+    // Default: `false`.
+    Options& set_huge_pages(bool huge_pages) & {
+      huge_pages_ = huge_pages;
+      return *this;
+    }
+    Options&& set_huge_pages(bool huge_pages) && {
+      return std::move(set_huge_pages(huge_pages));
+    }
+    bool huge_pages() const { return huge_pages_; }
+
+    // If positive, only a window of this size (rounded up to the page size)
+    // containing the current position is mapped at a time, and it is moved
+    // when reading or seeking leaves it. Data read as a `Chain` or
+    // `absl::Cord` keep their window mapped while they are referenced.
+    //
+    // This bounds the address space used for large files, at the cost of
+    // `mmap()` calls when the window moves.
+    //
+    // If 0, the whole file is mapped.
+    //
+    // Default: 0.
+    Options& set_window_size(size_t window_size) & {
+      window_size_ = window_size;
+      return *this;
+    }
+    Options&& set_window_size(size_t window_size) && {
+      return std::move(set_window_size(window_size));
+    }
+    size_t window_size() const { return window_size_; }
+
    private:
     absl::optional<Position> independent_pos_;
+    bool sequential_ = false;
+    bool will_need_ = false;
+    bool populate_ = false;
+    bool huge_pages_ = false;
+    size_t window_size_ = 0;
   };
 
   // Returns the fd being read from. If the fd is owned then changed to -1 by
@@ -194,26 +466,52 @@ class FdMMapReaderBase : public ChainReader<Chain> {
  protected:
   FdMMapReaderBase() noexcept {}
 
-  explicit FdMMapReaderBase(bool has_independent_pos);
+  explicit FdMMapReaderBase(bool has_independent_pos, bool sequential,
+                            bool will_need, bool populate, bool huge_pages,
+                            size_t window_size);
 
   FdMMapReaderBase(FdMMapReaderBase&& that) noexcept;
   FdMMapReaderBase& operator=(FdMMapReaderBase&& that) noexcept;
 
   void Reset();
-  void Reset(bool has_independent_pos);
+  void Reset(bool has_independent_pos, bool sequential, bool will_need,
+             bool populate, bool huge_pages, size_t window_size);
   void Initialize(int src, absl::optional<Position> independent_pos);
   int OpenFd(absl::string_view filename, int flags);
   void InitializePos(int src, absl::optional<Position> independent_pos);
   ABSL_ATTRIBUTE_COLD bool FailOperation(absl::string_view operation);
 
   void Done() override;
+  bool PullBehindScratch() override;
+  using ChainReader::ReadBehindScratch;
+  bool ReadBehindScratch(size_t length, Chain& dest) override;
+  bool ReadBehindScratch(size_t length, absl::Cord& dest) override;
+  using ChainReader::CopyBehindScratch;
+  bool CopyBehindScratch(Position length, Writer& dest) override;
+  bool CopyBehindScratch(size_t length, BackwardWriter& dest) override;
+  bool SeekBehindScratch(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
   bool SyncImpl(SyncType sync_type) override;
 
  private:
   void SetFilename(int src);
+  const char* MMap(int src, Position offset, size_t length);
+  void AdviseWillNeed();
+  bool MapWindow(Position new_pos);
 
   std::string filename_;
   bool has_independent_pos_ = false;
+  bool sequential_ = false;
+  bool will_need_ = false;
+  bool populate_ = false;
+  bool huge_pages_ = false;
+  // If positive, the size of the mapped window, a multiple of the page size
+  // after `InitializePos()`. The `Chain` being read from is then the current
+  // window, and `limit_pos()` is the file position of its end, instead of the
+  // position in the `Chain`.
+  size_t window_size_ = 0;
+  // If `window_size_ > 0`, the file size at `InitializePos()`.
+  Position file_size_ = 0;
 };
 
 // A `Reader` which reads from a file descriptor.
@@ -275,6 +573,8 @@ class FdReader : public FdReaderBase {
   FdReader(FdReader&& that) noexcept;
   FdReader& operator=(FdReader&& that) noexcept;
 
+  ~FdReader() { DoneBackground(); }
+
   // Makes `*this` equivalent to a newly constructed `FdReader`. This avoids
   // constructing a temporary `FdReader` and moving from it.
   void Reset();
@@ -324,8 +624,8 @@ explicit FdReader(absl::string_view filename, int flags,
     ->FdReader<>;
 #endif
 
-// A `Reader` which reads from a file descriptor by mapping the whole file to
-// memory. It supports random access.
+// A `Reader` which reads from a file descriptor by mapping the whole file, or a
+// moving window of it, to memory. It supports random access.
 //
 // The fd must support:
 //  * `close()` - if the fd is owned
@@ -428,8 +728,21 @@ explicit FdMMapReader(
 
 // Implementation details follow.
 
-inline FdReaderBase::FdReaderBase(size_t buffer_size)
-    : BufferedReader(buffer_size) {}
+inline FdReaderBase::FdReaderBase(size_t buffer_size, size_t max_buffer_size,
+                                  size_t io_uring_queue_depth,
+                                  size_t read_ahead, bool direct_io,
+                                  bool access_hints, bool drop_cache_behind,
+                                  std::shared_ptr<IoObserver> io_observer)
+    : BufferedReader(buffer_size),
+      buffer_size_for_io_uring_(buffer_size),
+      io_uring_queue_depth_(io_uring_queue_depth),
+      read_ahead_(read_ahead),
+      direct_io_(direct_io),
+      access_hints_(access_hints),
+      drop_cache_behind_(drop_cache_behind),
+      io_observer_(std::move(io_observer)) {
+  set_max_buffer_size(max_buffer_size);
+}
 
 inline FdReaderBase::FdReaderBase(FdReaderBase&& that) noexcept
     : BufferedReader(std::move(that)),
@@ -437,7 +750,22 @@ inline FdReaderBase::FdReaderBase(FdReaderBase&& that) noexcept
       // part was moved.
       filename_(std::move(that.filename_)),
       supports_random_access_(that.supports_random_access_),
-      has_independent_pos_(that.has_independent_pos_) {}
+      has_independent_pos_(that.has_independent_pos_),
+      buffer_size_for_io_uring_(that.buffer_size_for_io_uring_),
+      io_uring_queue_depth_(that.io_uring_queue_depth_),
+      read_ahead_(that.read_ahead_),
+      direct_io_(that.direct_io_),
+      io_uring_(std::move(that.io_uring_)),
+      reads_at_explicit_pos_(that.reads_at_explicit_pos_),
+      direct_buffer_(std::move(that.direct_buffer_)),
+      direct_buffer_pos_(that.direct_buffer_pos_),
+      direct_buffer_length_(that.direct_buffer_length_),
+      access_hints_(that.access_hints_),
+      drop_cache_behind_(that.drop_cache_behind_),
+      sequential_reads_(that.sequential_reads_),
+      drop_cache_pos_(that.drop_cache_pos_),
+      io_observer_(std::move(that.io_observer_)),
+      io_stats_(that.io_stats_) {}
 
 inline FdReaderBase& FdReaderBase::operator=(FdReaderBase&& that) noexcept {
   BufferedReader::operator=(std::move(that));
@@ -446,6 +774,21 @@ inline FdReaderBase& FdReaderBase::operator=(FdReaderBase&& that) noexcept {
   filename_ = std::move(that.filename_);
   supports_random_access_ = that.supports_random_access_;
   has_independent_pos_ = that.has_independent_pos_;
+  buffer_size_for_io_uring_ = that.buffer_size_for_io_uring_;
+  io_uring_queue_depth_ = that.io_uring_queue_depth_;
+  read_ahead_ = that.read_ahead_;
+  direct_io_ = that.direct_io_;
+  io_uring_ = std::move(that.io_uring_);
+  reads_at_explicit_pos_ = that.reads_at_explicit_pos_;
+  direct_buffer_ = std::move(that.direct_buffer_);
+  direct_buffer_pos_ = that.direct_buffer_pos_;
+  direct_buffer_length_ = that.direct_buffer_length_;
+  access_hints_ = that.access_hints_;
+  drop_cache_behind_ = that.drop_cache_behind_;
+  sequential_reads_ = that.sequential_reads_;
+  drop_cache_pos_ = that.drop_cache_pos_;
+  io_observer_ = std::move(that.io_observer_);
+  io_stats_ = that.io_stats_;
   return *this;
 }
 
@@ -454,27 +797,75 @@ inline void FdReaderBase::Reset() {
   filename_.clear();
   supports_random_access_ = false;
   has_independent_pos_ = false;
+  buffer_size_for_io_uring_ = 0;
+  io_uring_queue_depth_ = 0;
+  read_ahead_ = 0;
+  direct_io_ = false;
+  io_uring_.reset();
+  reads_at_explicit_pos_ = false;
+  direct_buffer_ = AlignedBuffer<internal::kDirectIoAlignment>();
+  direct_buffer_pos_ = 0;
+  direct_buffer_length_ = 0;
+  access_hints_ = false;
+  drop_cache_behind_ = false;
+  sequential_reads_ = 0;
+  drop_cache_pos_ = 0;
+  io_observer_.reset();
+  io_stats_.Reset();
 }
 
-inline void FdReaderBase::Reset(size_t buffer_size) {
+inline void FdReaderBase::Reset(size_t buffer_size, size_t max_buffer_size,
+                                size_t io_uring_queue_depth, size_t read_ahead,
+                                bool direct_io, bool access_hints,
+                                bool drop_cache_behind,
+                                std::shared_ptr<IoObserver> io_observer) {
   BufferedReader::Reset(buffer_size);
+  set_max_buffer_size(max_buffer_size);
   // `filename_` was set by `OpenFd()` or will be set by `Initialize()`.
   supports_random_access_ = false;
   has_independent_pos_ = false;
+  buffer_size_for_io_uring_ = buffer_size;
+  io_uring_queue_depth_ = io_uring_queue_depth;
+  read_ahead_ = read_ahead;
+  direct_io_ = direct_io;
+  io_uring_.reset();
+  reads_at_explicit_pos_ = false;
+  direct_buffer_pos_ = 0;
+  direct_buffer_length_ = 0;
+  access_hints_ = access_hints;
+  drop_cache_behind_ = drop_cache_behind;
+  sequential_reads_ = 0;
+  drop_cache_pos_ = 0;
+  io_observer_ = std::move(io_observer);
+  io_stats_.Reset();
 }
 
-inline FdMMapReaderBase::FdMMapReaderBase(bool has_independent_pos)
+inline FdMMapReaderBase::FdMMapReaderBase(bool has_independent_pos,
+                                          bool sequential, bool will_need,
+                                          bool populate, bool huge_pages,
+                                          size_t window_size)
     // Empty `Chain` as the `ChainReader` source is a placeholder, it will be
     // set by `Initialize()`.
     : ChainReader(std::forward_as_tuple()),
-      has_independent_pos_(has_independent_pos) {}
+      has_independent_pos_(has_independent_pos),
+      sequential_(sequential),
+      will_need_(will_need),
+      populate_(populate),
+      huge_pages_(huge_pages),
+      window_size_(window_size) {}
 
 inline FdMMapReaderBase::FdMMapReaderBase(FdMMapReaderBase&& that) noexcept
     : ChainReader(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
       filename_(std::move(that.filename_)),
-      has_independent_pos_(that.has_independent_pos_) {}
+      has_independent_pos_(that.has_independent_pos_),
+      sequential_(that.sequential_),
+      will_need_(that.will_need_),
+      populate_(that.populate_),
+      huge_pages_(that.huge_pages_),
+      window_size_(that.window_size_),
+      file_size_(that.file_size_) {}
 
 inline FdMMapReaderBase& FdMMapReaderBase::operator=(
     FdMMapReaderBase&& that) noexcept {
@@ -483,6 +874,12 @@ inline FdMMapReaderBase& FdMMapReaderBase::operator=(
   // was moved.
   filename_ = std::move(that.filename_);
   has_independent_pos_ = that.has_independent_pos_;
+  sequential_ = that.sequential_;
+  will_need_ = that.will_need_;
+  populate_ = that.populate_;
+  huge_pages_ = that.huge_pages_;
+  window_size_ = that.window_size_;
+  file_size_ = that.file_size_;
   return *this;
 }
 
@@ -490,32 +887,61 @@ inline void FdMMapReaderBase::Reset() {
   ChainReader::Reset();
   filename_.clear();
   has_independent_pos_ = false;
+  sequential_ = false;
+  will_need_ = false;
+  populate_ = false;
+  huge_pages_ = false;
+  window_size_ = 0;
+  file_size_ = 0;
 }
 
-inline void FdMMapReaderBase::Reset(bool has_independent_pos) {
+inline void FdMMapReaderBase::Reset(bool has_independent_pos, bool sequential,
+                                    bool will_need, bool populate,
+                                    bool huge_pages, size_t window_size) {
   // Empty `Chain` as the `ChainReader` source is a placeholder, it will be set
   // by `Initialize()`.
   ChainReader::Reset(std::forward_as_tuple());
   // `filename_` was set by `OpenFd()` or will be set by `Initialize()`.
   has_independent_pos_ = has_independent_pos;
+  sequential_ = sequential;
+  will_need_ = will_need;
+  populate_ = populate;
+  huge_pages_ = huge_pages;
+  window_size_ = window_size;
+  file_size_ = 0;
 }
 
 template <typename Src>
 inline FdReader<Src>::FdReader(const Src& src, Options options)
-    : FdReaderBase(options.buffer_size()), src_(src) {
+    : FdReaderBase(options.buffer_size(), options.max_buffer_size(),
+                   options.io_uring_queue_depth(), options.read_ahead(),
+                   options.direct_io(), options.access_hints(),
+                   options.drop_cache_behind(),
+                   std::move(options.io_observer())),
+      src_(src) {
   Initialize(src_.get(), options.assumed_pos(), options.independent_pos());
 }
 
 template <typename Src>
 inline FdReader<Src>::FdReader(Src&& src, Options options)
-    : FdReaderBase(options.buffer_size()), src_(std::move(src)) {
+    : FdReaderBase(options.buffer_size(), options.max_buffer_size(),
+                   options.io_uring_queue_depth(), options.read_ahead(),
+                   options.direct_io(), options.access_hints(),
+                   options.drop_cache_behind(),
+                   std::move(options.io_observer())),
+      src_(std::move(src)) {
   Initialize(src_.get(), options.assumed_pos(), options.independent_pos());
 }
 
 template <typename Src>
 template <typename... SrcArgs>
 inline FdReader<Src>::FdReader(std::tuple<SrcArgs...> src_args, Options options)
-    : FdReaderBase(options.buffer_size()), src_(std::move(src_args)) {
+    : FdReaderBase(options.buffer_size(), options.max_buffer_size(),
+                   options.io_uring_queue_depth(), options.read_ahead(),
+                   options.direct_io(), options.access_hints(),
+                   options.drop_cache_behind(),
+                   std::move(options.io_observer())),
+      src_(std::move(src_args)) {
   Initialize(src_.get(), options.assumed_pos(), options.independent_pos());
 }
 
@@ -549,14 +975,22 @@ inline void FdReader<Src>::Reset() {
 
 template <typename Src>
 inline void FdReader<Src>::Reset(const Src& src, Options options) {
-  FdReaderBase::Reset(options.buffer_size());
+  FdReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.read_ahead(),
+                      options.direct_io(), options.access_hints(),
+                      options.drop_cache_behind(),
+                      std::move(options.io_observer()));
   src_.Reset(src);
   Initialize(src_.get(), options.assumed_pos(), options.independent_pos());
 }
 
 template <typename Src>
 inline void FdReader<Src>::Reset(Src&& src, Options options) {
-  FdReaderBase::Reset(options.buffer_size());
+  FdReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.read_ahead(),
+                      options.direct_io(), options.access_hints(),
+                      options.drop_cache_behind(),
+                      std::move(options.io_observer()));
   src_.Reset(std::move(src));
   Initialize(src_.get(), options.assumed_pos(), options.independent_pos());
 }
@@ -565,7 +999,11 @@ template <typename Src>
 template <typename... SrcArgs>
 inline void FdReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
                                  Options options) {
-  FdReaderBase::Reset(options.buffer_size());
+  FdReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.read_ahead(),
+                      options.direct_io(), options.access_hints(),
+                      options.drop_cache_behind(),
+                      std::move(options.io_observer()));
   src_.Reset(std::move(src_args));
   Initialize(src_.get(), options.assumed_pos(), options.independent_pos());
 }
@@ -580,9 +1018,13 @@ inline void FdReader<Src>::Reset(absl::string_view filename, int flags,
 template <typename Src>
 void FdReader<Src>::Initialize(absl::string_view filename, int flags,
                                Options&& options) {
-  const int src = OpenFd(filename, flags);
+  const int src = OpenFd(filename, flags, options.direct_io());
   if (ABSL_PREDICT_FALSE(src < 0)) return;
-  FdReaderBase::Reset(options.buffer_size());
+  FdReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.read_ahead(),
+                      options.direct_io(), options.access_hints(),
+                      options.drop_cache_behind(),
+                      std::move(options.io_observer()));
   src_.Reset(std::forward_as_tuple(src));
   InitializePos(src_.get(), options.assumed_pos(), options.independent_pos());
 }
@@ -601,13 +1043,20 @@ void FdReader<Src>::Done() {
 
 template <typename Src>
 inline FdMMapReader<Src>::FdMMapReader(const Src& src, Options options)
-    : FdMMapReaderBase(options.independent_pos() != absl::nullopt), src_(src) {
+    : FdMMapReaderBase(options.independent_pos() != absl::nullopt,
+                       options.sequential(), options.will_need(),
+                       options.populate(), options.huge_pages(),
+                       options.window_size()),
+      src_(src) {
   Initialize(src_.get(), options.independent_pos());
 }
 
 template <typename Src>
 inline FdMMapReader<Src>::FdMMapReader(Src&& src, Options options)
-    : FdMMapReaderBase(options.independent_pos() != absl::nullopt),
+    : FdMMapReaderBase(options.independent_pos() != absl::nullopt,
+                       options.sequential(), options.will_need(),
+                       options.populate(), options.huge_pages(),
+                       options.window_size()),
       src_(std::move(src)) {
   Initialize(src_.get(), options.independent_pos());
 }
@@ -616,7 +1065,10 @@ template <typename Src>
 template <typename... SrcArgs>
 inline FdMMapReader<Src>::FdMMapReader(std::tuple<SrcArgs...> src_args,
                                        Options options)
-    : FdMMapReaderBase(options.independent_pos() != absl::nullopt),
+    : FdMMapReaderBase(options.independent_pos() != absl::nullopt,
+                       options.sequential(), options.will_need(),
+                       options.populate(), options.huge_pages(),
+                       options.window_size()),
       src_(std::move(src_args)) {
   Initialize(src_.get(), options.independent_pos());
 }
@@ -652,14 +1104,20 @@ inline void FdMMapReader<Src>::Reset() {
 
 template <typename Src>
 inline void FdMMapReader<Src>::Reset(const Src& src, Options options) {
-  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt);
+  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.sequential(), options.will_need(),
+                          options.populate(), options.huge_pages(),
+                          options.window_size());
   src_.Reset(src);
   Initialize(src_.get(), options.independent_pos());
 }
 
 template <typename Src>
 inline void FdMMapReader<Src>::Reset(Src&& src, Options options) {
-  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt);
+  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.sequential(), options.will_need(),
+                          options.populate(), options.huge_pages(),
+                          options.window_size());
   src_.Reset(std::move(src));
   Initialize(src_.get(), options.independent_pos());
 }
@@ -668,7 +1126,10 @@ template <typename Src>
 template <typename... SrcArgs>
 inline void FdMMapReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
                                      Options options) {
-  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt);
+  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.sequential(), options.will_need(),
+                          options.populate(), options.huge_pages(),
+                          options.window_size());
   src_.Reset(std::move(src_args));
   Initialize(src_.get(), options.independent_pos());
 }
@@ -685,7 +1146,10 @@ void FdMMapReader<Src>::Initialize(absl::string_view filename, int flags,
                                    Options&& options) {
   const int src = OpenFd(filename, flags);
   if (ABSL_PREDICT_FALSE(src < 0)) return;
-  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt);
+  FdMMapReaderBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.sequential(), options.will_need(),
+                          options.populate(), options.huge_pages(),
+                          options.window_size());
   src_.Reset(std::forward_as_tuple(src));
   InitializePos(src_.get(), options.independent_pos());
 }
@@ -12,7 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// Make `pwrite()` and `ftruncate()` available.
+// Make `O_DIRECT`, `copy_file_range()`, `sync_file_range()`, `fallocate()`, and
+// `mremap()` available.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+// Make `pwrite()`, `pwritev()`, and `ftruncate()` available.
 #if !defined(_XOPEN_SOURCE) || _XOPEN_SOURCE < 500
 #undef _XOPEN_SOURCE
 #define _XOPEN_SOURCE 500
@@ -25,28 +31,58 @@
 #include "riegeli/bytes/fd_writer.h"
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstring>
 #include <limits>
 #include <string>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/buffer.h"
 #include "riegeli/base/errno_mapping.h"
+#include "riegeli/base/object.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/buffered_writer.h"
+#include "riegeli/bytes/fd_io_uring.h"
+#include "riegeli/bytes/io_observer.h"
+#include "riegeli/bytes/sync_scheduler.h"
+#include "riegeli/bytes/writer.h"
 
 namespace riegeli {
 
+namespace {
+
+// `WriteZeros()` of at least this length extends the file with a hole if it
+// reaches beyond the end of file. Shorter lengths are cheaper to write than to
+// flush the buffer and change the file size.
+constexpr Position kMinHoleLength = Position{64} << 10;
+
+// The maximum file size supported by `FdMMapWriter`.
+inline Position MaxMMapFileSize() {
+  return UnsignedMin(Position{std::numeric_limits<off_t>::max()},
+                     std::numeric_limits<size_t>::max());
+}
+
+}  // namespace
+
 void FdWriterBase::Initialize(int dest, absl::optional<Position> assumed_pos,
                               absl::optional<Position> independent_pos) {
   RIEGELI_ASSERT_GE(dest, 0)
@@ -66,7 +102,7 @@ inline void FdWriterBase::SetFilename(int dest) {
 }
 
 int FdWriterBase::OpenFd(absl::string_view filename, int flags,
-                         mode_t permissions) {
+                         mode_t permissions, bool direct_io) {
   RIEGELI_ASSERT((flags & O_ACCMODE) == O_WRONLY ||
                  (flags & O_ACCMODE) == O_RDWR)
       << "Failed precondition of FdWriter: "
@@ -74,10 +110,21 @@ int FdWriterBase::OpenFd(absl::string_view filename, int flags,
   // TODO: When `absl::string_view` becomes C++17 `std::string_view`:
   // `filename_ = filename`
   filename_.assign(filename.data(), filename.size());
+#ifdef O_DIRECT
+  if (direct_io && (flags & O_APPEND) == 0) flags |= O_DIRECT;
+#endif
 again:
   const int dest = open(filename_.c_str(), flags, permissions);
   if (ABSL_PREDICT_FALSE(dest < 0)) {
     if (errno == EINTR) goto again;
+#ifdef O_DIRECT
+    if (errno == EINVAL && (flags & O_DIRECT) != 0) {
+      // The filesystem does not support `O_DIRECT`. Aligned writes still work
+      // through the page cache.
+      flags &= ~O_DIRECT;
+      goto again;
+    }
+#endif
     FailOperation("open()");
     return -1;
   }
@@ -143,6 +190,46 @@ void FdWriterBase::InitializePos(int dest, int flags,
     set_start_pos(IntCast<Position>(file_pos));
     supports_random_access_ = true;
   }
+  if (!supports_random_access_ || (flags & O_APPEND) != 0) direct_io_ = false;
+  if (io_uring_queue_depth_ > 0 && supports_random_access_ &&
+      (flags & O_APPEND) == 0 && !direct_io_) {
+    // If io_uring is not available, `io_uring_` remains `nullptr` and
+    // `write()` or `pwrite()` is used.
+    io_uring_ =
+        internal::IoUringWriteBehind::Create(dest, io_uring_queue_depth_);
+  }
+#ifdef FALLOC_FL_KEEP_SIZE
+  if (preallocate_ > 0 && supports_random_access_ &&
+      preallocate_ <= Position{std::numeric_limits<off_t>::max()} -
+                          start_pos()) {
+    // Failures are ignored: this is only a hint.
+    preallocated_ = fallocate(dest, FALLOC_FL_KEEP_SIZE,
+                              IntCast<off_t>(start_pos()),
+                              IntCast<off_t>(preallocate_)) >= 0;
+  }
+#endif
+}
+
+void FdWriterBase::Done() {
+  BufferedWriter::Done();
+  io_uring_.reset();
+  direct_buffer_ = AlignedBuffer<internal::kDirectIoAlignment>();
+  if (preallocated_) {
+    preallocated_ = false;
+    ReleasePreallocated(dest_fd());
+  }
+}
+
+void FdWriterBase::ReleasePreallocated(int dest) {
+  // Truncating to the current size releases blocks allocated beyond it.
+  // Failures are ignored: the data are not affected.
+  struct stat stat_info;
+  if (ABSL_PREDICT_FALSE(fstat(dest, &stat_info) < 0)) return;
+again:
+  if (ABSL_PREDICT_FALSE(ftruncate(dest, stat_info.st_size) < 0) &&
+      errno == EINTR) {
+    goto again;
+  }
 }
 
 bool FdWriterBase::FailOperation(absl::string_view operation) {
@@ -161,6 +248,65 @@ void FdWriterBase::AnnotateFailure(absl::Status& status) {
   BufferedWriter::AnnotateFailure(status);
 }
 
+TypeId FdWriterBase::GetTypeId() const { return TypeId::For<FdWriterBase>(); }
+
+absl::optional<Position> FdWriterBase::CopyFromFd(
+    int src, absl::optional<Position> src_pos, Position length) {
+#ifdef __linux__
+  if (io_uring_ != nullptr || direct_io_) return absl::nullopt;
+  // Buffered data precede copied data.
+  if (ABSL_PREDICT_FALSE(!Flush(FlushType::kFromObject))) return 0;
+  if (ABSL_PREDICT_FALSE(length > Position{std::numeric_limits<off_t>::max()} -
+                                      start_pos())) {
+    FailOverflow();
+    return 0;
+  }
+  const int dest = dest_fd();
+  off_t src_offset = src_pos == absl::nullopt ? 0 : IntCast<off_t>(*src_pos);
+  off_t dest_offset = IntCast<off_t>(start_pos());
+  // `copy_file_range()` is tried first. Before Linux 5.3 it fails between
+  // filesystems, but `sendfile()` works then if the destination fd position
+  // can be used.
+  bool use_sendfile = false;
+  Position length_copied = 0;
+  while (length_copied < length) {
+    const size_t length_to_copy =
+        UnsignedMin(length - length_copied,
+                    size_t{std::numeric_limits<ssize_t>::max()});
+  again:
+    off_t* const src_offset_ptr =
+        src_pos == absl::nullopt ? nullptr : &src_offset;
+    const ssize_t result =
+        use_sendfile
+            ? sendfile(dest, src, src_offset_ptr, length_to_copy)
+            : copy_file_range(src, src_offset_ptr, dest,
+                              has_independent_pos_ ? &dest_offset : nullptr,
+                              length_to_copy, 0);
+    if (ABSL_PREDICT_FALSE(result < 0)) {
+      if (errno == EINTR) goto again;
+      if (length_copied == 0 && (errno == EXDEV || errno == EINVAL ||
+                                 errno == ENOSYS || errno == EOPNOTSUPP)) {
+        if (!use_sendfile && !has_independent_pos_) {
+          use_sendfile = true;
+          goto again;
+        }
+        return absl::nullopt;
+      }
+      FailOperation(use_sendfile ? "sendfile()" : "copy_file_range()");
+      return length_copied;
+    }
+    // Source ends.
+    if (result == 0) break;
+    move_start_pos(IntCast<size_t>(result));
+    dest_offset += result;
+    length_copied += IntCast<size_t>(result);
+  }
+  return length_copied;
+#else
+  return absl::nullopt;
+#endif
+}
+
 bool FdWriterBase::WriteInternal(absl::string_view src) {
   RIEGELI_ASSERT(!src.empty())
       << "Failed precondition of BufferedWriter::WriteInternal(): "
@@ -173,8 +319,20 @@ bool FdWriterBase::WriteInternal(absl::string_view src) {
                              start_pos())) {
     return FailOverflow();
   }
+  if (io_uring_ != nullptr) {
+    const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+    const bool write_ok = io_uring_->Write(start_pos(), src);
+    timer.ReportWrite("io_uring write", start_pos(), src.size(), write_ok,
+                      src.size());
+    if (ABSL_PREDICT_FALSE(!write_ok)) return FailOperation("io_uring write");
+    move_start_pos(src.size());
+    MaybeWriteBehind(src.size());
+    return true;
+  }
+  if (direct_io_) return WriteDirect(src);
   do {
   again:
+    const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
     const ssize_t length_written =
         has_independent_pos_
             ? pwrite(dest, src.data(),
@@ -184,6 +342,9 @@ bool FdWriterBase::WriteInternal(absl::string_view src) {
             : write(dest, src.data(),
                     UnsignedMin(src.size(),
                                 size_t{std::numeric_limits<ssize_t>::max()}));
+    timer.ReportWrite(has_independent_pos_ ? "pwrite()" : "write()",
+                      start_pos(), src.size(), length_written >= 0,
+                      static_cast<size_t>(length_written));
     if (ABSL_PREDICT_FALSE(length_written < 0)) {
       if (errno == EINTR) goto again;
       return FailOperation(has_independent_pos_ ? "pwrite()" : "write()");
@@ -194,11 +355,231 @@ bool FdWriterBase::WriteInternal(absl::string_view src) {
         << (has_independent_pos_ ? "pwrite()" : "write()")
         << " wrote more than requested";
     move_start_pos(IntCast<size_t>(length_written));
+    MaybeWriteBehind(IntCast<size_t>(length_written));
     src.remove_prefix(IntCast<size_t>(length_written));
   } while (!src.empty());
   return true;
 }
 
+bool FdWriterBase::WriteVectoredInternal(
+    absl::Span<const absl::string_view> srcs) {
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of BufferedWriter::WriteVectoredInternal(): "
+      << status();
+  if (io_uring_ != nullptr || direct_io_) {
+    return BufferedWriter::WriteVectoredInternal(srcs);
+  }
+  const int dest = dest_fd();
+  // Skip empty pieces, and bound the number of pieces passed at once.
+  std::vector<iovec> iovecs;
+  iovecs.reserve(UnsignedMin(srcs.size(), size_t{IOV_MAX}));
+  size_t src_index = 0;
+  for (;;) {
+    iovecs.clear();
+    size_t length = 0;
+    while (src_index < srcs.size() && iovecs.size() < size_t{IOV_MAX}) {
+      const absl::string_view src = srcs[src_index];
+      if (src.size() > size_t{std::numeric_limits<ssize_t>::max()} - length) {
+        break;
+      }
+      ++src_index;
+      if (src.empty()) continue;
+      iovecs.push_back(iovec{const_cast<char*>(src.data()), src.size()});
+      length += src.size();
+    }
+    if (iovecs.empty()) {
+      if (src_index == srcs.size()) return true;
+      // A single piece too long for one call.
+      if (ABSL_PREDICT_FALSE(!WriteInternal(srcs[src_index]))) return false;
+      ++src_index;
+      continue;
+    }
+    if (ABSL_PREDICT_FALSE(length >
+                           Position{std::numeric_limits<off_t>::max()} -
+                               start_pos())) {
+      return FailOverflow();
+    }
+    iovec* iov = iovecs.data();
+    int iov_count = IntCast<int>(iovecs.size());
+    do {
+    again:
+      const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+      const ssize_t length_written =
+          has_independent_pos_
+              ? pwritev(dest, iov, iov_count, IntCast<off_t>(start_pos()))
+              : writev(dest, iov, iov_count);
+      timer.ReportWrite(has_independent_pos_ ? "pwritev()" : "writev()",
+                        start_pos(), length, length_written >= 0,
+                        static_cast<size_t>(length_written));
+      if (ABSL_PREDICT_FALSE(length_written < 0)) {
+        if (errno == EINTR) goto again;
+        return FailOperation(has_independent_pos_ ? "pwritev()" : "writev()");
+      }
+      RIEGELI_ASSERT_GT(length_written, 0)
+          << (has_independent_pos_ ? "pwritev()" : "writev()")
+          << " returned 0";
+      RIEGELI_ASSERT_LE(IntCast<size_t>(length_written), length)
+          << (has_independent_pos_ ? "pwritev()" : "writev()")
+          << " wrote more than requested";
+      move_start_pos(IntCast<size_t>(length_written));
+      MaybeWriteBehind(IntCast<size_t>(length_written));
+      length -= IntCast<size_t>(length_written);
+      // Skip pieces written completely, and the written prefix of the next
+      // piece.
+      size_t remaining = IntCast<size_t>(length_written);
+      while (iov_count > 0 && remaining >= iov->iov_len) {
+        remaining -= iov->iov_len;
+        ++iov;
+        --iov_count;
+      }
+      if (remaining > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+        iov->iov_len -= remaining;
+      }
+    } while (length > 0);
+  }
+}
+
+bool FdWriterBase::WriteZerosSlow(Position length) {
+  RIEGELI_ASSERT_LT(UnsignedMin(available(), kMaxBytesToCopy), length)
+      << "Failed precondition of Writer::WriteZerosSlow(): "
+         "enough space available, use WriteZeros() instead";
+  if (length < kMinHoleLength || !supports_random_access_) {
+    return BufferedWriter::WriteZerosSlow(length);
+  }
+  const absl::optional<Position> size = Size();
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
+  if (ABSL_PREDICT_FALSE(length > Position{std::numeric_limits<off_t>::max()} -
+                                      pos())) {
+    return FailOverflow();
+  }
+  const Position new_pos = pos() + length;
+  if (*size >= new_pos) {
+    // Existing data must be overwritten.
+    return BufferedWriter::WriteZerosSlow(length);
+  }
+  if (*size > pos() && ABSL_PREDICT_FALSE(!WriteZeros(*size - pos()))) {
+    return false;
+  }
+  // Extend the file with a hole instead of writing zeros.
+  const int dest = dest_fd();
+again:
+  if (ABSL_PREDICT_FALSE(ftruncate(dest, IntCast<off_t>(new_pos)) < 0)) {
+    if (errno == EINTR) goto again;
+    return FailOperation("ftruncate()");
+  }
+  return Seek(new_pos);
+}
+
+inline bool FdWriterBase::WriteDirect(absl::string_view src) {
+  RIEGELI_ASSERT(direct_io_)
+      << "Failed precondition of FdWriterBase::WriteDirect(): "
+         "direct I/O not used";
+  if (direct_buffer_.capacity() == 0) {
+    direct_buffer_.Reset(UnsignedMin(
+        RoundUp<internal::kDirectIoAlignment>(buffer_size_for_direct_io_),
+        RoundDown<internal::kDirectIoAlignment>(
+            size_t{std::numeric_limits<ssize_t>::max()})));
+  }
+  if (direct_pending_ == 0) {
+    const Position head_end =
+        RoundUp<internal::kDirectIoAlignment>(start_pos());
+    if (head_end != start_pos()) {
+      // `O_DIRECT` requires aligned positions, so data before the next
+      // alignment boundary are written without it.
+      const size_t length =
+          UnsignedMin(src.size(), IntCast<size_t>(head_end - start_pos()));
+      if (ABSL_PREDICT_FALSE(
+              !WriteUnaligned(start_pos(), absl::string_view(src.data(),
+                                                             length)))) {
+        return false;
+      }
+      move_start_pos(length);
+      src.remove_prefix(length);
+      if (src.empty()) return true;
+    }
+    direct_pos_ = start_pos();
+  }
+  for (;;) {
+    const size_t length =
+        UnsignedMin(src.size(), direct_buffer_.capacity() - direct_pending_);
+    std::memcpy(direct_buffer_.data() + direct_pending_, src.data(), length);
+    direct_pending_ += length;
+    move_start_pos(length);
+    src.remove_prefix(length);
+    if (direct_pending_ < direct_buffer_.capacity()) return true;
+    if (ABSL_PREDICT_FALSE(!WriteAt(
+            direct_pos_,
+            absl::string_view(direct_buffer_.data(), direct_pending_)))) {
+      return false;
+    }
+    direct_pos_ += direct_pending_;
+    direct_pending_ = 0;
+    if (src.empty()) return true;
+  }
+}
+
+inline bool FdWriterBase::WriteAt(Position pos, absl::string_view src) {
+  const int dest = dest_fd();
+  while (!src.empty()) {
+  again:
+    const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+    const ssize_t length_written = pwrite(
+        dest, src.data(),
+        UnsignedMin(src.size(), size_t{std::numeric_limits<ssize_t>::max()}),
+        IntCast<off_t>(pos));
+    timer.ReportWrite("pwrite()", pos, src.size(), length_written >= 0,
+                      static_cast<size_t>(length_written));
+    if (ABSL_PREDICT_FALSE(length_written < 0)) {
+      if (errno == EINTR) goto again;
+      return FailOperation("pwrite()");
+    }
+    RIEGELI_ASSERT_GT(length_written, 0) << "pwrite() returned 0";
+    RIEGELI_ASSERT_LE(IntCast<size_t>(length_written), src.size())
+        << "pwrite() wrote more than requested";
+    pos += IntCast<size_t>(length_written);
+    src.remove_prefix(IntCast<size_t>(length_written));
+  }
+  return true;
+}
+
+bool FdWriterBase::WriteUnaligned(Position pos, absl::string_view src) {
+#ifdef O_DIRECT
+  const int dest = dest_fd();
+  const int flags = fcntl(dest, F_GETFL);
+  if (ABSL_PREDICT_FALSE(flags < 0)) return FailOperation("fcntl()");
+  if ((flags & O_DIRECT) != 0) {
+    if (ABSL_PREDICT_FALSE(fcntl(dest, F_SETFL, flags & ~O_DIRECT) < 0)) {
+      return FailOperation("fcntl()");
+    }
+    const bool write_ok = WriteAt(pos, src);
+    if (ABSL_PREDICT_FALSE(fcntl(dest, F_SETFL, flags) < 0) &&
+        ABSL_PREDICT_TRUE(write_ok)) {
+      return FailOperation("fcntl()");
+    }
+    return write_ok;
+  }
+#endif
+  return WriteAt(pos, src);
+}
+
+inline void FdWriterBase::MaybeWriteBehind(size_t length_written) {
+  if (write_behind_interval_ == 0) return;
+  write_behind_pending_ += length_written;
+  if (write_behind_pending_ < write_behind_interval_) return;
+#ifdef SYNC_FILE_RANGE_WRITE
+  const Position pos = start_pos() - write_behind_pending_;
+  const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+  const bool sync_ok =
+      sync_file_range(dest_fd(), IntCast<off_t>(pos),
+                      IntCast<off_t>(write_behind_pending_),
+                      SYNC_FILE_RANGE_WRITE) >= 0;
+  timer.ReportSync("sync_file_range()", sync_ok);
+  // Failures are ignored: this is only a hint.
+#endif
+  write_behind_pending_ = 0;
+}
+
 bool FdWriterBase::FlushImpl(FlushType flush_type) {
   if (ABSL_PREDICT_FALSE(!BufferedWriter::FlushImpl(flush_type))) return false;
   switch (flush_type) {
@@ -207,9 +588,21 @@ bool FdWriterBase::FlushImpl(FlushType flush_type) {
       return true;
     case FlushType::kFromMachine: {
       const int dest = dest_fd();
-      if (ABSL_PREDICT_FALSE(fsync(dest) < 0)) {
-        return FailOperation("fsync()");
+      const internal::IoOperationTimer timer(io_observer_.get(), io_stats_);
+      if (sync_scheduler_ != nullptr) {
+        absl::Status status = sync_scheduler_->Sync(dest);
+        timer.ReportSync("fdatasync()", status.ok());
+        if (ABSL_PREDICT_FALSE(!status.ok())) return Fail(std::move(status));
+        return true;
       }
+      const absl::string_view operation =
+          sync_method_ == SyncMethod::kFdatasync ? "fdatasync()" : "fsync()";
+      const bool sync_ok = (sync_method_ == SyncMethod::kFdatasync
+                                ? fdatasync(dest)
+                                : fsync(dest)) >= 0;
+      timer.ReportSync(operation, sync_ok);
+      if (ABSL_PREDICT_FALSE(!sync_ok)) return FailOperation(operation);
+      write_behind_pending_ = 0;
       return true;
     }
   }
@@ -217,10 +610,64 @@ bool FdWriterBase::FlushImpl(FlushType flush_type) {
       << "Unknown flush type: " << static_cast<int>(flush_type);
 }
 
+bool FdWriterBase::FlushBehindBuffer(absl::string_view src,
+                                     FlushType flush_type) {
+  if (ABSL_PREDICT_FALSE(!BufferedWriter::FlushBehindBuffer(src, flush_type))) {
+    return false;
+  }
+  if (io_uring_ != nullptr || direct_io_) return SyncPos();
+  return true;
+}
+
+inline bool FdWriterBase::SyncPos() {
+  RIEGELI_ASSERT(io_uring_ != nullptr || direct_io_)
+      << "Failed precondition of FdWriterBase::SyncPos(): "
+         "writes not at explicit positions";
+  if (io_uring_ != nullptr && ABSL_PREDICT_FALSE(!io_uring_->Flush())) {
+    return FailOperation("io_uring write");
+  }
+  if (direct_pending_ > 0) {
+    const size_t aligned_length =
+        RoundDown<internal::kDirectIoAlignment>(direct_pending_);
+    if (ABSL_PREDICT_FALSE(!WriteAt(
+            direct_pos_,
+            absl::string_view(direct_buffer_.data(), aligned_length)))) {
+      return false;
+    }
+    if (direct_pending_ > aligned_length &&
+        ABSL_PREDICT_FALSE(!WriteUnaligned(
+            direct_pos_ + aligned_length,
+            absl::string_view(direct_buffer_.data() + aligned_length,
+                              direct_pending_ - aligned_length)))) {
+      return false;
+    }
+    // Keep the unaligned tail buffered, so that its block can be written
+    // aligned when completed.
+    std::memmove(direct_buffer_.data(), direct_buffer_.data() + aligned_length,
+                 direct_pending_ - aligned_length);
+    direct_pos_ += aligned_length;
+    direct_pending_ -= aligned_length;
+  }
+  if (!has_independent_pos_) {
+    // Writes at explicit positions do not move the fd position.
+    const int dest = dest_fd();
+    if (ABSL_PREDICT_FALSE(lseek(dest, IntCast<off_t>(start_pos()), SEEK_SET) <
+                           0)) {
+      return FailOperation("lseek()");
+    }
+  }
+  return true;
+}
+
 inline bool FdWriterBase::SeekInternal(int dest, Position new_pos) {
   RIEGELI_ASSERT_EQ(buffer_size(), 0u)
       << "Failed precondition of FdWriterBase::SeekInternal(): "
          "buffer not empty";
+  // The unaligned tail of direct I/O, if any, was written by `SyncPos()`.
+  direct_pending_ = 0;
+  // Writeback of data before the seek is not requested.
+  write_behind_pending_ = 0;
+  io_stats_.AddSeek();
   if (!has_independent_pos_) {
     if (ABSL_PREDICT_FALSE(lseek(dest, IntCast<off_t>(new_pos), SEEK_SET) <
                            0)) {
@@ -236,6 +683,9 @@ bool FdWriterBase::SeekBehindBuffer(Position new_pos) {
       << "Failed precondition of BufferedWriter::SeekBehindBuffer(): "
          "buffer not empty";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if ((io_uring_ != nullptr || direct_io_) && ABSL_PREDICT_FALSE(!SyncPos())) {
+    return false;
+  }
   const int dest = dest_fd();
   if (new_pos >= start_pos()) {
     // Seeking forwards.
@@ -257,6 +707,9 @@ absl::optional<Position> FdWriterBase::SizeBehindBuffer() {
       << "Failed precondition of BufferedWriter::SizeBehindBuffer(): "
          "buffer not empty";
   if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  if ((io_uring_ != nullptr || direct_io_) && ABSL_PREDICT_FALSE(!SyncPos())) {
+    return absl::nullopt;
+  }
   const int dest = dest_fd();
   struct stat stat_info;
   if (ABSL_PREDICT_FALSE(fstat(dest, &stat_info) < 0)) {
@@ -271,6 +724,9 @@ bool FdWriterBase::TruncateBehindBuffer(Position new_size) {
       << "Failed precondition of BufferedWriter::TruncateBehindBuffer(): "
          "buffer not empty";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if ((io_uring_ != nullptr || direct_io_) && ABSL_PREDICT_FALSE(!SyncPos())) {
+    return false;
+  }
   const int dest = dest_fd();
   if (new_size >= start_pos()) {
     // Seeking forwards.
@@ -292,4 +748,239 @@ again:
   return SeekInternal(dest, new_size);
 }
 
+void FdMMapWriterBase::Initialize(int dest,
+                                  absl::optional<Position> independent_pos) {
+  RIEGELI_ASSERT_GE(dest, 0)
+      << "Failed precondition of FdMMapWriter: negative file descriptor";
+  SetFilename(dest);
+  InitializePos(dest, independent_pos);
+}
+
+inline void FdMMapWriterBase::SetFilename(int dest) {
+  filename_ = absl::StrCat("/proc/self/fd/", dest);
+}
+
+int FdMMapWriterBase::OpenFd(absl::string_view filename, int flags,
+                             mode_t permissions) {
+  RIEGELI_ASSERT((flags & O_ACCMODE) == O_RDWR)
+      << "Failed precondition of FdMMapWriter: flags must include O_RDWR";
+  // TODO: When `absl::string_view` becomes C++17 `std::string_view`:
+  // `filename_ = filename`
+  filename_.assign(filename.data(), filename.size());
+again:
+  const int dest = open(filename_.c_str(), flags, permissions);
+  if (ABSL_PREDICT_FALSE(dest < 0)) {
+    if (errno == EINTR) goto again;
+    FailOperation("open()");
+    return -1;
+  }
+  return dest;
+}
+
+void FdMMapWriterBase::InitializePos(int dest,
+                                     absl::optional<Position> independent_pos) {
+  struct stat stat_info;
+  if (ABSL_PREDICT_FALSE(fstat(dest, &stat_info) < 0)) {
+    FailOperation("fstat()");
+    return;
+  }
+  file_size_ = IntCast<Position>(stat_info.st_size);
+  data_size_ = file_size_;
+  Position initial_pos;
+  if (independent_pos != absl::nullopt) {
+    initial_pos = *independent_pos;
+  } else {
+    const off_t file_pos = lseek(dest, 0, SEEK_CUR);
+    if (ABSL_PREDICT_FALSE(file_pos < 0)) {
+      FailOperation("lseek()");
+      return;
+    }
+    initial_pos = IntCast<Position>(file_pos);
+  }
+  if (ABSL_PREDICT_FALSE(UnsignedMax(file_size_, initial_pos) >
+                         MaxMMapFileSize())) {
+    Fail(absl::OutOfRangeError(absl::StrCat("mmap() cannot be used writing ",
+                                            filename_, ": File too large")));
+    return;
+  }
+  if (file_size_ > 0 &&
+      ABSL_PREDICT_FALSE(!Remap(dest, IntCast<size_t>(file_size_)))) {
+    return;
+  }
+  set_buffer(mapping_, IntCast<size_t>(file_size_));
+  if (initial_pos > file_size_) {
+    if (ABSL_PREDICT_FALSE(!ResizeFile(dest, initial_pos))) return;
+  }
+  set_cursor(start() + IntCast<size_t>(initial_pos));
+}
+
+bool FdMMapWriterBase::Remap(int dest, size_t new_mapping_size) {
+  if (new_mapping_size <= mapping_size_) return true;
+  void* data;
+  if (mapping_ == nullptr) {
+    data = mmap(nullptr, new_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                dest, 0);
+    if (ABSL_PREDICT_FALSE(data == MAP_FAILED)) return FailOperation("mmap()");
+  } else {
+#ifdef MREMAP_MAYMOVE
+    data = mremap(mapping_, mapping_size_, new_mapping_size, MREMAP_MAYMOVE);
+    if (ABSL_PREDICT_FALSE(data == MAP_FAILED)) {
+      return FailOperation("mremap()");
+    }
+#else
+    data = mmap(nullptr, new_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                dest, 0);
+    if (ABSL_PREDICT_FALSE(data == MAP_FAILED)) return FailOperation("mmap()");
+    munmap(mapping_, mapping_size_);
+#endif
+  }
+  mapping_ = static_cast<char*>(data);
+  mapping_size_ = new_mapping_size;
+  return true;
+}
+
+bool FdMMapWriterBase::ResizeFile(int dest, Position new_file_size) {
+  RIEGELI_ASSERT_LE(new_file_size, MaxMMapFileSize())
+      << "Failed precondition of FdMMapWriterBase::ResizeFile(): "
+         "file size out of range";
+  const size_t written = written_to_buffer();
+again:
+  if (ABSL_PREDICT_FALSE(ftruncate(dest, IntCast<off_t>(new_file_size)) <
+                         0)) {
+    if (errno == EINTR) goto again;
+    return FailOperation("ftruncate()");
+  }
+  file_size_ = new_file_size;
+  // The mapping is extended after the file, so that it is never accessed
+  // beyond the end of file. It is not shrunk, to be reused when the file
+  // grows again.
+  if (ABSL_PREDICT_FALSE(!Remap(dest, IntCast<size_t>(new_file_size)))) {
+    return false;
+  }
+  set_buffer(mapping_, IntCast<size_t>(file_size_),
+             UnsignedMin(written, IntCast<size_t>(file_size_)));
+  return true;
+}
+
+void FdMMapWriterBase::Unmap() {
+  if (mapping_ == nullptr) return;
+  munmap(mapping_, mapping_size_);
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+}
+
+void FdMMapWriterBase::Done() {
+  const Position size = UnsignedMax(data_size_, pos());
+  Writer::Done();
+  Unmap();
+  const int dest = dest_fd();
+  if (file_size_ != size) {
+    // Release space allocated beyond data.
+    if (ABSL_PREDICT_FALSE(ftruncate(dest, IntCast<off_t>(size)) < 0) &&
+        ABSL_PREDICT_TRUE(healthy())) {
+      FailOperation("ftruncate()");
+    }
+    file_size_ = size;
+  }
+  data_size_ = size;
+  if (!has_independent_pos_ && ABSL_PREDICT_TRUE(healthy())) {
+    if (ABSL_PREDICT_FALSE(lseek(dest, IntCast<off_t>(pos()), SEEK_SET) < 0)) {
+      FailOperation("lseek()");
+    }
+  }
+}
+
+bool FdMMapWriterBase::FailOperation(absl::string_view operation) {
+  const int error_number = errno;
+  RIEGELI_ASSERT_NE(error_number, 0)
+      << "Failed precondition of FdMMapWriterBase::FailOperation(): "
+         "zero errno";
+  return Fail(
+      ErrnoToCanonicalStatus(error_number, absl::StrCat(operation, " failed")));
+}
+
+void FdMMapWriterBase::AnnotateFailure(absl::Status& status) {
+  RIEGELI_ASSERT(!status.ok())
+      << "Failed precondition of Object::AnnotateFailure(): status not failed";
+  status = Annotate(status, absl::StrCat("writing ", filename_));
+  Writer::AnnotateFailure(status);
+}
+
+bool FdMMapWriterBase::PushSlow(size_t min_length,
+                                size_t recommended_length) {
+  RIEGELI_ASSERT_LT(available(), min_length)
+      << "Failed precondition of Writer::PushSlow(): "
+         "enough space available, use Push() instead";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  const Position max_size = MaxMMapFileSize();
+  data_size_ = UnsignedMax(data_size_, pos());
+  if (ABSL_PREDICT_FALSE(min_length > max_size - pos())) return FailOverflow();
+  return ResizeFile(
+      dest_fd(),
+      pos() + UnsignedMin(UnsignedMax(Position{min_length},
+                                      Position{recommended_length},
+                                      growth_step_),
+                          max_size - pos()));
+}
+
+bool FdMMapWriterBase::FlushImpl(FlushType flush_type) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (flush_type == FlushType::kFromObject) return true;
+  // Data written to the mapping are already visible in the file, but the file
+  // size must exclude space allocated for future writes.
+  const int dest = dest_fd();
+  data_size_ = UnsignedMax(data_size_, pos());
+  if (file_size_ != data_size_ &&
+      ABSL_PREDICT_FALSE(!ResizeFile(dest, data_size_))) {
+    return false;
+  }
+  switch (flush_type) {
+    case FlushType::kFromObject:
+    case FlushType::kFromProcess:
+      return true;
+    case FlushType::kFromMachine:
+      if (data_size_ > 0 &&
+          ABSL_PREDICT_FALSE(msync(mapping_, IntCast<size_t>(data_size_),
+                                   MS_SYNC) < 0)) {
+        return FailOperation("msync()");
+      }
+      if (ABSL_PREDICT_FALSE(fsync(dest) < 0)) return FailOperation("fsync()");
+      return true;
+  }
+  RIEGELI_ASSERT_UNREACHABLE()
+      << "Unknown flush type: " << static_cast<int>(flush_type);
+}
+
+bool FdMMapWriterBase::SeekImpl(Position new_pos) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  data_size_ = UnsignedMax(data_size_, pos());
+  if (ABSL_PREDICT_FALSE(new_pos > data_size_)) {
+    // File ends.
+    set_cursor(start() + IntCast<size_t>(data_size_));
+    return false;
+  }
+  set_cursor(start() + IntCast<size_t>(new_pos));
+  return true;
+}
+
+absl::optional<Position> FdMMapWriterBase::SizeImpl() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  return UnsignedMax(data_size_, pos());
+}
+
+bool FdMMapWriterBase::TruncateImpl(Position new_size) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  data_size_ = UnsignedMax(data_size_, pos());
+  if (ABSL_PREDICT_FALSE(new_size > data_size_)) {
+    // File ends.
+    set_cursor(start() + IntCast<size_t>(data_size_));
+    return false;
+  }
+  // Data beyond `new_size` are removed from the file by `Flush()` or
+  // `Close()`.
+  data_size_ = new_size;
+  set_cursor(start() + IntCast<size_t>(new_size));
+  return true;
+}
+
 }  // namespace riegeli
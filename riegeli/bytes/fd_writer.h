@@ -19,6 +19,7 @@
 #include <stddef.h>
 #include <sys/types.h>
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <type_traits>
@@ -29,16 +30,36 @@
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/buffer.h"
 #include "riegeli/base/dependency.h"
+#include "riegeli/base/object.h"
 #include "riegeli/bytes/buffered_writer.h"
 #include "riegeli/bytes/fd_dependency.h"
+#include "riegeli/bytes/fd_io_uring.h"
+#include "riegeli/bytes/io_observer.h"
+#include "riegeli/bytes/io_stats.h"
+#include "riegeli/bytes/sync_scheduler.h"
+#include "riegeli/bytes/writer.h"
 
 namespace riegeli {
 
+class FdReaderBase;
+
 // Template parameter independent part of `FdWriter`.
 class FdWriterBase : public BufferedWriter {
  public:
+  // Specifies how `Flush(FlushType::kFromMachine)` makes data durable.
+  enum class SyncMethod {
+    // `fsync()`: data and all metadata.
+    kFsync,
+    // `fdatasync()`: data and metadata needed to read them back, e.g. file
+    // size, but not e.g. modification time. This is cheaper, in particular
+    // for appending.
+    kFdatasync,
+  };
+
   class Options {
    public:
     Options() noexcept {}
@@ -113,11 +134,171 @@ class FdWriterBase : public BufferedWriter {
     }
     size_t buffer_size() const { return buffer_size_; }
 
+    // If larger than `buffer_size()`, the buffer grows up to
+    // `max_buffer_size()` when longer writes arrive, so that shorter writes
+    // which follow are gathered into longer writes to the file. It returns to
+    // `buffer_size()` after seeking.
+    //
+    // Default: 0 (the buffer size is `buffer_size()`).
+    Options& set_max_buffer_size(size_t max_buffer_size) & {
+      max_buffer_size_ = max_buffer_size;
+      return *this;
+    }
+    Options&& set_max_buffer_size(size_t max_buffer_size) && {
+      return std::move(set_max_buffer_size(max_buffer_size));
+    }
+    size_t max_buffer_size() const { return max_buffer_size_; }
+
+    // If positive, writes are submitted through Linux io_uring, keeping up to
+    // `io_uring_queue_depth()` writes in flight while further data are being
+    // buffered. Errors of writes in flight are reported by a later operation,
+    // at the latest by `Flush()` or `Close()`.
+    //
+    // This is used only if random access is supported and the fd is not opened
+    // with `O_APPEND`. If io_uring is not available, `write()` or `pwrite()` is
+    // used instead.
+    //
+    // Default: 0 (io_uring is not used).
+    Options& set_io_uring_queue_depth(size_t io_uring_queue_depth) & {
+      io_uring_queue_depth_ = io_uring_queue_depth;
+      return *this;
+    }
+    Options&& set_io_uring_queue_depth(size_t io_uring_queue_depth) && {
+      return std::move(set_io_uring_queue_depth(io_uring_queue_depth));
+    }
+    size_t io_uring_queue_depth() const { return io_uring_queue_depth_; }
+
+    // If `true`, the file is written bypassing the page cache: it is opened
+    // with `O_DIRECT` (if opened by `FdWriter` and if the filesystem supports
+    // it), and data are written with `pwrite()` from an aligned buffer at
+    // aligned positions and lengths, as `O_DIRECT` requires. Unaligned parts at
+    // the beginning and at the end are written with `O_DIRECT` temporarily
+    // cleared, the latter by `Flush()` and `Close()`. If the fd is given, it
+    // should have been opened with `O_DIRECT`.
+    //
+    // This is used only if random access is supported and the fd is not opened
+    // with `O_APPEND`. io_uring is then not used.
+    //
+    // Default: `false`.
+    Options& set_direct_io(bool direct_io) & {
+      direct_io_ = direct_io;
+      return *this;
+    }
+    Options&& set_direct_io(bool direct_io) && {
+      return std::move(set_direct_io(direct_io));
+    }
+    bool direct_io() const { return direct_io_; }
+
+    // Sets the `IoObserver` which receives `write()`, `pwrite()`, `writev()`,
+    // `pwritev()`, and `fsync()` calls, with their timings.
+    //
+    // If `nullptr`, calls are not reported.
+    //
+    // Default: `nullptr`.
+    Options& set_io_observer(std::shared_ptr<IoObserver> io_observer) & {
+      io_observer_ = std::move(io_observer);
+      return *this;
+    }
+    Options&& set_io_observer(std::shared_ptr<IoObserver> io_observer) && {
+      return std::move(set_io_observer(std::move(io_observer)));
+    }
+    std::shared_ptr<IoObserver>& io_observer() { return io_observer_; }
+    const std::shared_ptr<IoObserver>& io_observer() const {
+      return io_observer_;
+    }
+
+    // Specifies how `Flush(FlushType::kFromMachine)` makes data durable.
+    //
+    // This is ignored if `sync_scheduler() != nullptr`.
+    //
+    // Default: `SyncMethod::kFsync`.
+    Options& set_sync_method(SyncMethod sync_method) & {
+      sync_method_ = sync_method;
+      return *this;
+    }
+    Options&& set_sync_method(SyncMethod sync_method) && {
+      return std::move(set_sync_method(sync_method));
+    }
+    SyncMethod sync_method() const { return sync_method_; }
+
+    // If positive, whenever this many bytes have been written since the last
+    // time, writeback of these bytes is started in background with
+    // `sync_file_range(SYNC_FILE_RANGE_WRITE)`, without waiting for it.
+    //
+    // This bounds the amount of dirty data in the page cache, so that a later
+    // `Flush(FlushType::kFromMachine)` or closing the file does not have to
+    // write back everything at once, which avoids large latency spikes. This
+    // does not by itself make data durable.
+    //
+    // This is a hint, ignored where `sync_file_range()` is unavailable or
+    // fails, or with direct I/O. Writeback is requested for positions reported
+    // by `pos()`, so `assumed_pos()` should correspond to the fd position.
+    //
+    // Default: 0 (disabled).
+    Options& set_write_behind_interval(Position write_behind_interval) & {
+      write_behind_interval_ = write_behind_interval;
+      return *this;
+    }
+    Options&& set_write_behind_interval(Position write_behind_interval) && {
+      return std::move(set_write_behind_interval(write_behind_interval));
+    }
+    Position write_behind_interval() const { return write_behind_interval_; }
+
+    // If positive, disk space for this many bytes starting from the initial
+    // position is allocated when the file is opened, with
+    // `fallocate(FALLOC_FL_KEEP_SIZE)`. This reduces fragmentation if the
+    // expected size of the file is known. Space allocated beyond the data
+    // actually written is released by `Close()`.
+    //
+    // This is a hint, ignored where `fallocate()` is unavailable or fails, or
+    // if random access is not supported.
+    //
+    // Default: 0 (disabled).
+    Options& set_preallocate(Position preallocate) & {
+      preallocate_ = preallocate;
+      return *this;
+    }
+    Options&& set_preallocate(Position preallocate) && {
+      return std::move(set_preallocate(preallocate));
+    }
+    Position preallocate() const { return preallocate_; }
+
+    // Sets the `SyncScheduler` which makes data durable for
+    // `Flush(FlushType::kFromMachine)`, coalescing it with syncs requested by
+    // other `FdWriter`s sharing the scheduler. Data are then synced with
+    // `fdatasync()` or `syncfs()` instead of `fsync()`, so metadata not needed
+    // to read the data back, e.g. modification time, might not be durable.
+    //
+    // If `nullptr`, `fsync()` is called directly.
+    //
+    // Default: `nullptr`.
+    Options& set_sync_scheduler(
+        std::shared_ptr<SyncScheduler> sync_scheduler) & {
+      sync_scheduler_ = std::move(sync_scheduler);
+      return *this;
+    }
+    Options&& set_sync_scheduler(
+        std::shared_ptr<SyncScheduler> sync_scheduler) && {
+      return std::move(set_sync_scheduler(std::move(sync_scheduler)));
+    }
+    std::shared_ptr<SyncScheduler>& sync_scheduler() { return sync_scheduler_; }
+    const std::shared_ptr<SyncScheduler>& sync_scheduler() const {
+      return sync_scheduler_;
+    }
+
    private:
     mode_t permissions_ = 0666;
     absl::optional<Position> assumed_pos_;
     absl::optional<Position> independent_pos_;
     size_t buffer_size_ = kDefaultBufferSize;
+    size_t max_buffer_size_ = 0;
+    size_t io_uring_queue_depth_ = 0;
+    bool direct_io_ = false;
+    std::shared_ptr<IoObserver> io_observer_;
+    SyncMethod sync_method_ = SyncMethod::kFsync;
+    Position write_behind_interval_ = 0;
+    Position preallocate_ = 0;
+    std::shared_ptr<SyncScheduler> sync_scheduler_;
   };
 
   // Returns the fd being written to. If the fd is owned then changed to -1 by
@@ -129,41 +310,119 @@ class FdWriterBase : public BufferedWriter {
   // `Close()`.
   const std::string& filename() const { return filename_; }
 
+  // Returns counters of system calls performed so far, without blocking.
+  //
+  // This can be called concurrently with writing, e.g. to export the counters
+  // periodically.
+  IoStats io_stats() const { return io_stats_.Get(); }
+
   bool SupportsRandomAccess() override { return supports_random_access_; }
 
+  TypeId GetTypeId() const override;
+
  protected:
   FdWriterBase() noexcept {}
 
-  explicit FdWriterBase(size_t buffer_size);
+  explicit FdWriterBase(size_t buffer_size, size_t max_buffer_size,
+                        size_t io_uring_queue_depth, bool direct_io,
+                        std::shared_ptr<IoObserver> io_observer,
+                        SyncMethod sync_method, Position write_behind_interval,
+                        Position preallocate,
+                        std::shared_ptr<SyncScheduler> sync_scheduler);
 
   FdWriterBase(FdWriterBase&& that) noexcept;
   FdWriterBase& operator=(FdWriterBase&& that) noexcept;
 
   void Reset();
-  void Reset(size_t buffer_size);
+  void Reset(size_t buffer_size, size_t max_buffer_size,
+             size_t io_uring_queue_depth, bool direct_io,
+             std::shared_ptr<IoObserver> io_observer, SyncMethod sync_method,
+             Position write_behind_interval, Position preallocate,
+             std::shared_ptr<SyncScheduler> sync_scheduler);
   void Initialize(int dest, absl::optional<Position> assumed_pos,
                   absl::optional<Position> independent_pos);
-  int OpenFd(absl::string_view filename, int flags, mode_t permissions);
+  int OpenFd(absl::string_view filename, int flags, mode_t permissions,
+             bool direct_io);
   void InitializePos(int dest, absl::optional<Position> assumed_pos,
                      absl::optional<Position> independent_pos);
   void InitializePos(int dest, int flags, absl::optional<Position> assumed_pos,
                      absl::optional<Position> independent_pos);
   ABSL_ATTRIBUTE_COLD bool FailOperation(absl::string_view operation);
 
+  void Done() override;
   void AnnotateFailure(absl::Status& status) override;
   bool WriteInternal(absl::string_view src) override;
+  bool WriteVectoredInternal(absl::Span<const absl::string_view> srcs) override;
+  bool WriteZerosSlow(Position length) override;
   bool FlushImpl(FlushType flush_type) override;
+  bool FlushBehindBuffer(absl::string_view src, FlushType flush_type) override;
   bool SeekBehindBuffer(Position new_pos) override;
   absl::optional<Position> SizeBehindBuffer() override;
   bool TruncateBehindBuffer(Position new_size) override;
 
  private:
+  // For `CopyFromFd()`.
+  friend class FdReaderBase;
+
   void SetFilename(int dest);
   bool SeekInternal(int dest, Position new_pos);
+  // Copies up to `length` bytes from `src` directly, without passing them
+  // through user space, reading at `*src_pos` if present, otherwise at the fd
+  // position of `src`.
+  //
+  // Return values:
+  //  * `absl::nullopt`              - not supported for these fds, nothing
+  //                                    copied
+  //  * `length`                     - success
+  //  * `< length` (when `healthy()`)  - `src` ends
+  //  * `< length` (when `!healthy()`) - failure, including a failure of
+  //                                     reading `src`
+  absl::optional<Position> CopyFromFd(int src,
+                                      absl::optional<Position> src_pos,
+                                      Position length);
+  bool WriteDirect(absl::string_view src);
+  bool WriteAt(Position pos, absl::string_view src);
+  bool WriteUnaligned(Position pos, absl::string_view src);
+  bool SyncPos();
+  // Starts writeback of data written since the last writeback, if there are
+  // at least `write_behind_interval_` bytes of them.
+  void MaybeWriteBehind(size_t length_written);
+  // Releases disk space allocated by `Options::preallocate()` beyond the end
+  // of file.
+  void ReleasePreallocated(int dest);
 
   std::string filename_;
   bool supports_random_access_ = false;
   bool has_independent_pos_ = false;
+  size_t buffer_size_for_direct_io_ = 0;
+  size_t io_uring_queue_depth_ = 0;
+  // Whether direct I/O was requested, and then whether it is used.
+  bool direct_io_ = false;
+  // Present if writes are submitted through io_uring.
+  std::unique_ptr<internal::IoUringWriteBehind> io_uring_;
+  // If `direct_io_`, data starting at the aligned position `direct_pos_` with
+  // length `direct_pending_`, ending at `start_pos()`. Complete aligned blocks
+  // are written as soon as the buffer is full. The unaligned tail is written
+  // by `SyncPos()` but stays in the buffer, to be written again as a part of
+  // its aligned block.
+  //
+  // With io_uring or direct I/O, writes are performed at explicit positions,
+  // and the fd position is synchronized by `SyncPos()` if
+  // `!has_independent_pos_`.
+  AlignedBuffer<internal::kDirectIoAlignment> direct_buffer_;
+  Position direct_pos_ = 0;
+  size_t direct_pending_ = 0;
+  std::shared_ptr<IoObserver> io_observer_;
+  SyncMethod sync_method_ = SyncMethod::kFsync;
+  Position write_behind_interval_ = 0;
+  // Length of data ending at `start_pos()` written since the last writeback.
+  Position write_behind_pending_ = 0;
+  // Length to preallocate by `InitializePos()`.
+  Position preallocate_ = 0;
+  // Whether space was preallocated, so it should be released by `Done()`.
+  bool preallocated_ = false;
+  std::shared_ptr<SyncScheduler> sync_scheduler_;
+  internal::IoStatsCounter io_stats_;
 
   // Invariant: `start_pos() <= std::numeric_limits<off_t>::max()`
 };
@@ -173,7 +432,8 @@ class FdWriterBase : public BufferedWriter {
 // The fd must support:
 //  * `fcntl()`     - for the constructor from fd,
 //                    if `Options::assumed_pos() == absl::nullopt`
-//                    and `Options::independent_pos() == absl::nullopt`
+//                    and `Options::independent_pos() == absl::nullopt`,
+//                    or if `Options::direct_io()`
 //  * `close()`     - if the fd is owned
 //  * `write()`     - if `Options::independent_pos() == absl::nullopt`
 //  * `pwrite()`    - if `Options::independent_pos() != absl::nullopt`
@@ -284,10 +544,266 @@ explicit FdWriter(absl::string_view filename, int flags,
     ->FdWriter<>;
 #endif
 
+// Template parameter independent part of `FdMMapWriter`.
+class FdMMapWriterBase : public Writer {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Permissions to use in case a new file is created (9 bits). The effective
+    // permissions are modified by the process's umask.
+    //
+    // Default: `0666`.
+    Options& set_permissions(mode_t permissions) & {
+      permissions_ = permissions;
+      return *this;
+    }
+    Options&& set_permissions(mode_t permissions) && {
+      return std::move(set_permissions(permissions));
+    }
+    mode_t permissions() const { return permissions_; }
+
+    // If `absl::nullopt`, `FdMMapWriter` writes starting from the current fd
+    // position. The fd position is synchronized with the `FdMMapWriter`
+    // position by `Close()`.
+    //
+    // If not `absl::nullopt`, `FdMMapWriter` writes starting from this
+    // position, without disturbing the current fd position.
+    //
+    // Default: `absl::nullopt`.
+    Options& set_independent_pos(absl::optional<Position> independent_pos) & {
+      independent_pos_ = independent_pos;
+      return *this;
+    }
+    Options&& set_independent_pos(absl::optional<Position> independent_pos) && {
+      return std::move(set_independent_pos(independent_pos));
+    }
+    absl::optional<Position> independent_pos() const {
+      return independent_pos_;
+    }
+
+    // When the mapping is full, the file is extended with `ftruncate()` by at
+    // least this many bytes, and the mapping is extended accordingly. Larger
+    // steps need fewer system calls; the file is truncated to the size of data
+    // written by `Close()` and `Flush()`.
+    //
+    // Default: 64M.
+    Options& set_growth_step(Position growth_step) & {
+      growth_step_ = growth_step;
+      return *this;
+    }
+    Options&& set_growth_step(Position growth_step) && {
+      return std::move(set_growth_step(growth_step));
+    }
+    Position growth_step() const { return growth_step_; }
+
+   private:
+    mode_t permissions_ = 0666;
+    absl::optional<Position> independent_pos_;
+    Position growth_step_ = Position{64} << 20;
+  };
+
+  // Returns the fd being written to. If the fd is owned then changed to -1 by
+  // `Close()`, otherwise unchanged.
+  virtual int dest_fd() const = 0;
+
+  // Returns the original name of the file being written to (or
+  // "/proc/self/fd/<fd>" if fd was given). Unchanged by `Close()`.
+  const std::string& filename() const { return filename_; }
+
+  bool SupportsRandomAccess() override { return true; }
+
+  void AnnotateFailure(absl::Status& status) override;
+
+ protected:
+  FdMMapWriterBase() noexcept : Writer(kInitiallyClosed) {}
+
+  explicit FdMMapWriterBase(bool has_independent_pos, Position growth_step);
+
+  FdMMapWriterBase(FdMMapWriterBase&& that) noexcept;
+  FdMMapWriterBase& operator=(FdMMapWriterBase&& that) noexcept;
+
+  ~FdMMapWriterBase();
+
+  void Reset();
+  void Reset(bool has_independent_pos, Position growth_step);
+  void Initialize(int dest, absl::optional<Position> independent_pos);
+  int OpenFd(absl::string_view filename, int flags, mode_t permissions);
+  void InitializePos(int dest, absl::optional<Position> independent_pos);
+  ABSL_ATTRIBUTE_COLD bool FailOperation(absl::string_view operation);
+
+  void Done() override;
+  bool PushSlow(size_t min_length, size_t recommended_length) override;
+  bool FlushImpl(FlushType flush_type) override;
+  bool SeekImpl(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
+  bool TruncateImpl(Position new_size) override;
+
+ private:
+  void SetFilename(int dest);
+  // Makes the mapping cover at least `new_mapping_size` bytes.
+  bool Remap(int dest, size_t new_mapping_size);
+  // Changes the file size, and makes it the buffer size.
+  bool ResizeFile(int dest, Position new_file_size);
+  void Unmap();
+
+  std::string filename_;
+  bool has_independent_pos_ = false;
+  Position growth_step_ = 0;
+  // The mapping, starting at file position 0, which is the buffer.
+  char* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  // The current file size. Only the part of the mapping below `file_size_` is
+  // accessible, and that is the buffer size.
+  Position file_size_ = 0;
+  // The size of data written to the file, not including `written_to_buffer()`
+  // if that is larger. Bytes between this and `file_size_` are zeros allocated
+  // for future writes.
+  Position data_size_ = 0;
+
+  // Invariants:
+  //   `start() == mapping_`
+  //   `start_pos() == 0`
+  //   `file_size_ <= mapping_size_`
+  //   `buffer_size() == file_size_`
+};
+
+// A `Writer` which writes to a file descriptor by mapping the file to memory.
+// Data are written directly into the mapping, without copying through a
+// buffer. This is useful for building large files which are read back soon,
+// e.g. temporary files.
+//
+// The file is extended in steps of `Options::growth_step()`, and truncated to
+// the size of data written by `Close()`. `Close()` must be called for the file
+// to have the right size.
+//
+// The fd must support:
+//  * `close()`     - if the fd is owned
+//  * `fstat()`
+//  * `ftruncate()`
+//  * `mmap()`      - with `PROT_READ | PROT_WRITE` and `MAP_SHARED`, so the fd
+//                    must be opened with `O_RDWR`
+//  * `lseek()`     - if `Options::independent_pos() == absl::nullopt`
+//  * `fsync()`     - for `Flush(FlushType::kFromMachine)`
+//
+// `FdMMapWriter` supports random access.
+//
+// The `Dest` template parameter specifies the type of the object providing and
+// possibly owning the fd being written to. `Dest` must support
+// `Dependency<int, Dest>`, e.g. `OwnedFd` (owned, default), `UnownedFd`
+// (not owned).
+//
+// By relying on CTAD the template argument can be deduced as `OwnedFd` if the
+// first constructor argument is a filename or an `int`, otherwise as the value
+// type of the first constructor argument. This requires C++17.
+//
+// Until the `FdMMapWriter` is closed or no longer used, the fd must not be
+// closed, and the file must not be truncated or written by other means.
+template <typename Dest = OwnedFd>
+class FdMMapWriter : public FdMMapWriterBase {
+ public:
+  // Creates a closed `FdMMapWriter`.
+  FdMMapWriter() noexcept {}
+
+  // Will write to the fd provided by `dest`.
+  explicit FdMMapWriter(const Dest& dest, Options options = Options());
+  explicit FdMMapWriter(Dest&& dest, Options options = Options());
+
+  // Will write to the fd provided by a `Dest` constructed from elements of
+  // `dest_args`. This avoids constructing a temporary `Dest` and moving from
+  // it.
+  template <typename... DestArgs>
+  explicit FdMMapWriter(std::tuple<DestArgs...> dest_args,
+                        Options options = Options());
+
+  // Opens a file for writing.
+  //
+  // `flags` is the second argument of `open()`, typically
+  // `O_RDWR | O_CREAT | O_TRUNC`.
+  //
+  // `flags` must include `O_RDWR`.
+  //
+  // If opening the file fails, `FdMMapWriter` will be failed and closed.
+  explicit FdMMapWriter(absl::string_view filename, int flags,
+                        Options options = Options());
+
+  FdMMapWriter(FdMMapWriter&& that) noexcept;
+  FdMMapWriter& operator=(FdMMapWriter&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `FdMMapWriter`. This avoids
+  // constructing a temporary `FdMMapWriter` and moving from it.
+  void Reset();
+  void Reset(const Dest& dest, Options options = Options());
+  void Reset(Dest&& dest, Options options = Options());
+  template <typename... DestArgs>
+  void Reset(std::tuple<DestArgs...> dest_args, Options options = Options());
+  void Reset(absl::string_view filename, int flags,
+             Options options = Options());
+
+  // Returns the object providing and possibly owning the fd being written to.
+  // If the fd is owned then changed to -1 by `Close()`, otherwise unchanged.
+  Dest& dest() { return dest_.manager(); }
+  const Dest& dest() const { return dest_.manager(); }
+  int dest_fd() const override { return dest_.get(); }
+
+ protected:
+  using FdMMapWriterBase::Initialize;
+  void Initialize(absl::string_view filename, int flags, Options&& options);
+
+  void Done() override;
+
+ private:
+  // The object providing and possibly owning the fd being written to.
+  Dependency<int, Dest> dest_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+FdMMapWriter()->FdMMapWriter<DeleteCtad<>>;
+template <typename Dest>
+explicit FdMMapWriter(const Dest& dest, FdMMapWriterBase::Options options =
+                                            FdMMapWriterBase::Options())
+    -> FdMMapWriter<
+        std::conditional_t<std::is_convertible<const Dest&, int>::value,
+                           OwnedFd, std::decay_t<Dest>>>;
+template <typename Dest>
+explicit FdMMapWriter(Dest&& dest, FdMMapWriterBase::Options options =
+                                       FdMMapWriterBase::Options())
+    -> FdMMapWriter<std::conditional_t<std::is_convertible<Dest&&, int>::value,
+                                       OwnedFd, std::decay_t<Dest>>>;
+template <typename... DestArgs>
+explicit FdMMapWriter(
+    std::tuple<DestArgs...> dest_args,
+    FdMMapWriterBase::Options options = FdMMapWriterBase::Options())
+    -> FdMMapWriter<DeleteCtad<std::tuple<DestArgs...>>>;
+explicit FdMMapWriter(
+    absl::string_view filename, int flags,
+    FdMMapWriterBase::Options options = FdMMapWriterBase::Options())
+    ->FdMMapWriter<>;
+#endif
+
 // Implementation details follow.
 
-inline FdWriterBase::FdWriterBase(size_t buffer_size)
-    : BufferedWriter(buffer_size) {}
+inline FdWriterBase::FdWriterBase(size_t buffer_size, size_t max_buffer_size,
+                                  size_t io_uring_queue_depth,
+                                  bool direct_io,
+                                  std::shared_ptr<IoObserver> io_observer,
+                                  SyncMethod sync_method,
+                                  Position write_behind_interval,
+                                  Position preallocate,
+                                  std::shared_ptr<SyncScheduler> sync_scheduler)
+    : BufferedWriter(buffer_size),
+      buffer_size_for_direct_io_(buffer_size),
+      io_uring_queue_depth_(io_uring_queue_depth),
+      direct_io_(direct_io),
+      io_observer_(std::move(io_observer)),
+      sync_method_(sync_method),
+      write_behind_interval_(write_behind_interval),
+      preallocate_(preallocate),
+      sync_scheduler_(std::move(sync_scheduler)) {
+  set_max_buffer_size(max_buffer_size);
+}
 
 inline FdWriterBase::FdWriterBase(FdWriterBase&& that) noexcept
     : BufferedWriter(std::move(that)),
@@ -295,7 +811,22 @@ inline FdWriterBase::FdWriterBase(FdWriterBase&& that) noexcept
       // part was moved.
       filename_(std::move(that.filename_)),
       supports_random_access_(that.supports_random_access_),
-      has_independent_pos_(that.has_independent_pos_) {}
+      has_independent_pos_(that.has_independent_pos_),
+      buffer_size_for_direct_io_(that.buffer_size_for_direct_io_),
+      io_uring_queue_depth_(that.io_uring_queue_depth_),
+      direct_io_(that.direct_io_),
+      io_uring_(std::move(that.io_uring_)),
+      direct_buffer_(std::move(that.direct_buffer_)),
+      direct_pos_(that.direct_pos_),
+      direct_pending_(that.direct_pending_),
+      io_observer_(std::move(that.io_observer_)),
+      sync_method_(that.sync_method_),
+      write_behind_interval_(that.write_behind_interval_),
+      write_behind_pending_(that.write_behind_pending_),
+      preallocate_(that.preallocate_),
+      preallocated_(that.preallocated_),
+      sync_scheduler_(std::move(that.sync_scheduler_)),
+      io_stats_(that.io_stats_) {}
 
 inline FdWriterBase& FdWriterBase::operator=(FdWriterBase&& that) noexcept {
   BufferedWriter::operator=(std::move(that));
@@ -304,6 +835,21 @@ inline FdWriterBase& FdWriterBase::operator=(FdWriterBase&& that) noexcept {
   filename_ = std::move(that.filename_);
   supports_random_access_ = that.supports_random_access_;
   has_independent_pos_ = that.has_independent_pos_;
+  buffer_size_for_direct_io_ = that.buffer_size_for_direct_io_;
+  io_uring_queue_depth_ = that.io_uring_queue_depth_;
+  direct_io_ = that.direct_io_;
+  io_uring_ = std::move(that.io_uring_);
+  direct_buffer_ = std::move(that.direct_buffer_);
+  direct_pos_ = that.direct_pos_;
+  direct_pending_ = that.direct_pending_;
+  io_observer_ = std::move(that.io_observer_);
+  sync_method_ = that.sync_method_;
+  write_behind_interval_ = that.write_behind_interval_;
+  write_behind_pending_ = that.write_behind_pending_;
+  preallocate_ = that.preallocate_;
+  preallocated_ = that.preallocated_;
+  sync_scheduler_ = std::move(that.sync_scheduler_);
+  io_stats_ = that.io_stats_;
   return *this;
 }
 
@@ -312,24 +858,70 @@ inline void FdWriterBase::Reset() {
   filename_.clear();
   supports_random_access_ = false;
   has_independent_pos_ = false;
+  buffer_size_for_direct_io_ = 0;
+  io_uring_queue_depth_ = 0;
+  direct_io_ = false;
+  io_uring_.reset();
+  direct_buffer_ = AlignedBuffer<internal::kDirectIoAlignment>();
+  direct_pos_ = 0;
+  direct_pending_ = 0;
+  io_observer_.reset();
+  sync_method_ = SyncMethod::kFsync;
+  write_behind_interval_ = 0;
+  write_behind_pending_ = 0;
+  preallocate_ = 0;
+  preallocated_ = false;
+  sync_scheduler_.reset();
+  io_stats_.Reset();
 }
 
-inline void FdWriterBase::Reset(size_t buffer_size) {
+inline void FdWriterBase::Reset(size_t buffer_size, size_t max_buffer_size,
+                                size_t io_uring_queue_depth, bool direct_io,
+                                std::shared_ptr<IoObserver> io_observer,
+                                SyncMethod sync_method,
+                                Position write_behind_interval,
+                                Position preallocate,
+                                std::shared_ptr<SyncScheduler> sync_scheduler) {
   BufferedWriter::Reset(buffer_size);
+  set_max_buffer_size(max_buffer_size);
   // `filename_` was set by `OpenFd()` or will be set by `Initialize()`.
   supports_random_access_ = false;
   has_independent_pos_ = false;
+  buffer_size_for_direct_io_ = buffer_size;
+  io_uring_queue_depth_ = io_uring_queue_depth;
+  direct_io_ = direct_io;
+  io_uring_.reset();
+  direct_pos_ = 0;
+  direct_pending_ = 0;
+  io_observer_ = std::move(io_observer);
+  sync_method_ = sync_method;
+  write_behind_interval_ = write_behind_interval;
+  write_behind_pending_ = 0;
+  preallocate_ = preallocate;
+  preallocated_ = false;
+  sync_scheduler_ = std::move(sync_scheduler);
+  io_stats_.Reset();
 }
 
 template <typename Dest>
 inline FdWriter<Dest>::FdWriter(const Dest& dest, Options options)
-    : FdWriterBase(options.buffer_size()), dest_(dest) {
+    : FdWriterBase(options.buffer_size(), options.max_buffer_size(),
+                   options.io_uring_queue_depth(), options.direct_io(),
+                   std::move(options.io_observer()), options.sync_method(),
+                   options.write_behind_interval(), options.preallocate(),
+                   std::move(options.sync_scheduler())),
+      dest_(dest) {
   Initialize(dest_.get(), options.assumed_pos(), options.independent_pos());
 }
 
 template <typename Dest>
 inline FdWriter<Dest>::FdWriter(Dest&& dest, Options options)
-    : FdWriterBase(options.buffer_size()), dest_(std::move(dest)) {
+    : FdWriterBase(options.buffer_size(), options.max_buffer_size(),
+                   options.io_uring_queue_depth(), options.direct_io(),
+                   std::move(options.io_observer()), options.sync_method(),
+                   options.write_behind_interval(), options.preallocate(),
+                   std::move(options.sync_scheduler())),
+      dest_(std::move(dest)) {
   Initialize(dest_.get(), options.assumed_pos(), options.independent_pos());
 }
 
@@ -337,7 +929,12 @@ template <typename Dest>
 template <typename... DestArgs>
 inline FdWriter<Dest>::FdWriter(std::tuple<DestArgs...> dest_args,
                                 Options options)
-    : FdWriterBase(options.buffer_size()), dest_(std::move(dest_args)) {
+    : FdWriterBase(options.buffer_size(), options.max_buffer_size(),
+                   options.io_uring_queue_depth(), options.direct_io(),
+                   std::move(options.io_observer()), options.sync_method(),
+                   options.write_behind_interval(), options.preallocate(),
+                   std::move(options.sync_scheduler())),
+      dest_(std::move(dest_args)) {
   Initialize(dest_.get(), options.assumed_pos(), options.independent_pos());
 }
 
@@ -371,14 +968,22 @@ inline void FdWriter<Dest>::Reset() {
 
 template <typename Dest>
 inline void FdWriter<Dest>::Reset(const Dest& dest, Options options) {
-  FdWriterBase::Reset(options.buffer_size());
+  FdWriterBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.direct_io(),
+                      std::move(options.io_observer()), options.sync_method(),
+                      options.write_behind_interval(), options.preallocate(),
+                      std::move(options.sync_scheduler()));
   dest_.Reset(dest);
   Initialize(dest_.get(), options.assumed_pos(), options.independent_pos());
 }
 
 template <typename Dest>
 inline void FdWriter<Dest>::Reset(Dest&& dest, Options options) {
-  FdWriterBase::Reset(options.buffer_size());
+  FdWriterBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.direct_io(),
+                      std::move(options.io_observer()), options.sync_method(),
+                      options.write_behind_interval(), options.preallocate(),
+                      std::move(options.sync_scheduler()));
   dest_.Reset(std::move(dest));
   Initialize(dest_.get(), options.assumed_pos(), options.independent_pos());
 }
@@ -387,7 +992,11 @@ template <typename Dest>
 template <typename... DestArgs>
 inline void FdWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
                                   Options options) {
-  FdWriterBase::Reset(options.buffer_size());
+  FdWriterBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.direct_io(),
+                      std::move(options.io_observer()), options.sync_method(),
+                      options.write_behind_interval(), options.preallocate(),
+                      std::move(options.sync_scheduler()));
   dest_.Reset(std::move(dest_args));
   Initialize(dest_.get(), options.assumed_pos(), options.independent_pos());
 }
@@ -402,9 +1011,14 @@ inline void FdWriter<Dest>::Reset(absl::string_view filename, int flags,
 template <typename Dest>
 void FdWriter<Dest>::Initialize(absl::string_view filename, int flags,
                                 Options&& options) {
-  const int dest = OpenFd(filename, flags, options.permissions());
+  const int dest =
+      OpenFd(filename, flags, options.permissions(), options.direct_io());
   if (ABSL_PREDICT_FALSE(dest < 0)) return;
-  FdWriterBase::Reset(options.buffer_size());
+  FdWriterBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                      options.io_uring_queue_depth(), options.direct_io(),
+                      std::move(options.io_observer()), options.sync_method(),
+                      options.write_behind_interval(), options.preallocate(),
+                      std::move(options.sync_scheduler()));
   dest_.Reset(std::forward_as_tuple(dest));
   InitializePos(dest_.get(), flags, options.assumed_pos(),
                 options.independent_pos());
@@ -422,6 +1036,174 @@ void FdWriter<Dest>::Done() {
   }
 }
 
+inline FdMMapWriterBase::FdMMapWriterBase(bool has_independent_pos,
+                                          Position growth_step)
+    : Writer(kInitiallyOpen),
+      has_independent_pos_(has_independent_pos),
+      growth_step_(growth_step) {}
+
+inline FdMMapWriterBase::FdMMapWriterBase(FdMMapWriterBase&& that) noexcept
+    : Writer(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      filename_(std::move(that.filename_)),
+      has_independent_pos_(that.has_independent_pos_),
+      growth_step_(that.growth_step_),
+      mapping_(std::exchange(that.mapping_, nullptr)),
+      mapping_size_(std::exchange(that.mapping_size_, 0)),
+      file_size_(that.file_size_),
+      data_size_(that.data_size_) {}
+
+inline FdMMapWriterBase& FdMMapWriterBase::operator=(
+    FdMMapWriterBase&& that) noexcept {
+  Unmap();
+  Writer::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  filename_ = std::move(that.filename_);
+  has_independent_pos_ = that.has_independent_pos_;
+  growth_step_ = that.growth_step_;
+  mapping_ = std::exchange(that.mapping_, nullptr);
+  mapping_size_ = std::exchange(that.mapping_size_, 0);
+  file_size_ = that.file_size_;
+  data_size_ = that.data_size_;
+  return *this;
+}
+
+inline FdMMapWriterBase::~FdMMapWriterBase() { Unmap(); }
+
+inline void FdMMapWriterBase::Reset() {
+  Unmap();
+  Writer::Reset(kInitiallyClosed);
+  filename_.clear();
+  has_independent_pos_ = false;
+  growth_step_ = 0;
+  file_size_ = 0;
+  data_size_ = 0;
+}
+
+inline void FdMMapWriterBase::Reset(bool has_independent_pos,
+                                    Position growth_step) {
+  Unmap();
+  Writer::Reset(kInitiallyOpen);
+  // `filename_` was set by `OpenFd()` or will be set by `Initialize()`.
+  has_independent_pos_ = has_independent_pos;
+  growth_step_ = growth_step;
+  file_size_ = 0;
+  data_size_ = 0;
+}
+
+template <typename Dest>
+inline FdMMapWriter<Dest>::FdMMapWriter(const Dest& dest, Options options)
+    : FdMMapWriterBase(options.independent_pos() != absl::nullopt,
+                       options.growth_step()),
+      dest_(dest) {
+  Initialize(dest_.get(), options.independent_pos());
+}
+
+template <typename Dest>
+inline FdMMapWriter<Dest>::FdMMapWriter(Dest&& dest, Options options)
+    : FdMMapWriterBase(options.independent_pos() != absl::nullopt,
+                       options.growth_step()),
+      dest_(std::move(dest)) {
+  Initialize(dest_.get(), options.independent_pos());
+}
+
+template <typename Dest>
+template <typename... DestArgs>
+inline FdMMapWriter<Dest>::FdMMapWriter(std::tuple<DestArgs...> dest_args,
+                                        Options options)
+    : FdMMapWriterBase(options.independent_pos() != absl::nullopt,
+                       options.growth_step()),
+      dest_(std::move(dest_args)) {
+  Initialize(dest_.get(), options.independent_pos());
+}
+
+template <typename Dest>
+inline FdMMapWriter<Dest>::FdMMapWriter(absl::string_view filename, int flags,
+                                        Options options) {
+  Initialize(filename, flags, std::move(options));
+}
+
+template <typename Dest>
+inline FdMMapWriter<Dest>::FdMMapWriter(FdMMapWriter&& that) noexcept
+    : FdMMapWriterBase(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      dest_(std::move(that.dest_)) {}
+
+template <typename Dest>
+inline FdMMapWriter<Dest>& FdMMapWriter<Dest>::operator=(
+    FdMMapWriter&& that) noexcept {
+  FdMMapWriterBase::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  dest_ = std::move(that.dest_);
+  return *this;
+}
+
+template <typename Dest>
+inline void FdMMapWriter<Dest>::Reset() {
+  FdMMapWriterBase::Reset();
+  dest_.Reset();
+}
+
+template <typename Dest>
+inline void FdMMapWriter<Dest>::Reset(const Dest& dest, Options options) {
+  FdMMapWriterBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.growth_step());
+  dest_.Reset(dest);
+  Initialize(dest_.get(), options.independent_pos());
+}
+
+template <typename Dest>
+inline void FdMMapWriter<Dest>::Reset(Dest&& dest, Options options) {
+  FdMMapWriterBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.growth_step());
+  dest_.Reset(std::move(dest));
+  Initialize(dest_.get(), options.independent_pos());
+}
+
+template <typename Dest>
+template <typename... DestArgs>
+inline void FdMMapWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
+                                      Options options) {
+  FdMMapWriterBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.growth_step());
+  dest_.Reset(std::move(dest_args));
+  Initialize(dest_.get(), options.independent_pos());
+}
+
+template <typename Dest>
+inline void FdMMapWriter<Dest>::Reset(absl::string_view filename, int flags,
+                                      Options options) {
+  Reset();
+  Initialize(filename, flags, std::move(options));
+}
+
+template <typename Dest>
+void FdMMapWriter<Dest>::Initialize(absl::string_view filename, int flags,
+                                    Options&& options) {
+  const int dest = OpenFd(filename, flags, options.permissions());
+  if (ABSL_PREDICT_FALSE(dest < 0)) return;
+  FdMMapWriterBase::Reset(options.independent_pos() != absl::nullopt,
+                          options.growth_step());
+  dest_.Reset(std::forward_as_tuple(dest));
+  InitializePos(dest_.get(), options.independent_pos());
+}
+
+template <typename Dest>
+void FdMMapWriter<Dest>::Done() {
+  FdMMapWriterBase::Done();
+  if (dest_.is_owning()) {
+    const int dest = dest_.Release();
+    if (ABSL_PREDICT_FALSE(internal::CloseFd(dest) < 0) &&
+        ABSL_PREDICT_TRUE(healthy())) {
+      FailOperation(internal::kCloseFunctionName);
+    }
+  }
+}
+
 }  // namespace riegeli
 
 #endif  // RIEGELI_BYTES_FD_WRITER_H_
@@ -0,0 +1,130 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/bytes/file_growth_waiter.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <string>
+
+#include "absl/base/optimization.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/errno_mapping.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/status.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+namespace riegeli {
+
+FileGrowthWaiter::FileGrowthWaiter(absl::string_view filename,
+                                   Options options)
+    : Object(kInitiallyOpen),
+      filename_(filename),
+      poll_interval_(options.poll_interval()) {
+  bool grown;
+  if (ABSL_PREDICT_FALSE(!UpdateSize(grown))) return;
+#ifdef __linux__
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ >= 0 &&
+      inotify_add_watch(inotify_fd_, filename_.c_str(), IN_MODIFY) < 0) {
+    // Polling the file size still works.
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+  }
+#endif
+}
+
+FileGrowthWaiter::~FileGrowthWaiter() {
+  if (inotify_fd_ >= 0) close(inotify_fd_);
+}
+
+void FileGrowthWaiter::Done() {
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+  }
+}
+
+bool FileGrowthWaiter::FailOperation(absl::string_view operation) {
+  const int error_number = errno;
+  RIEGELI_ASSERT_NE(error_number, 0)
+      << "Failed precondition of FileGrowthWaiter::FailOperation(): "
+         "zero errno";
+  return Fail(Annotate(
+      ErrnoToCanonicalStatus(error_number, absl::StrCat(operation, " failed")),
+      absl::StrCat("waiting for ", filename_)));
+}
+
+inline bool FileGrowthWaiter::UpdateSize(bool& grown) {
+  struct stat stat_info;
+  if (ABSL_PREDICT_FALSE(stat(filename_.c_str(), &stat_info) < 0)) {
+    return FailOperation("stat()");
+  }
+  const Position size = IntCast<Position>(stat_info.st_size);
+  grown = size > size_;
+  // A file truncated in the meantime is followed from its new size.
+  size_ = size;
+  return true;
+}
+
+bool FileGrowthWaiter::Wait(absl::Duration timeout) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  const absl::Time deadline = absl::Now() + timeout;
+  for (;;) {
+    bool grown = false;
+    if (ABSL_PREDICT_FALSE(!UpdateSize(grown))) return false;
+    if (grown) return true;
+    const absl::Duration remaining = deadline - absl::Now();
+    if (remaining <= absl::ZeroDuration()) return false;
+    const absl::Duration wait_time = std::min(remaining, poll_interval_);
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+      struct pollfd poll_fd;
+      poll_fd.fd = inotify_fd_;
+      poll_fd.events = POLLIN;
+      poll_fd.revents = 0;
+      const int result =
+          poll(&poll_fd, 1,
+               SaturatingIntCast<int>(absl::ToInt64Milliseconds(
+                   absl::Ceil(wait_time, absl::Milliseconds(1)))));
+      if (ABSL_PREDICT_FALSE(result < 0)) {
+        if (errno == EINTR) continue;
+        return FailOperation("poll()");
+      }
+      if (result > 0) {
+        // Drain pending events. Their contents do not matter because the size
+        // is checked anyway.
+        char events[4096];
+        while (read(inotify_fd_, events, sizeof(events)) > 0) {
+        }
+      }
+      continue;
+    }
+#endif
+    absl::SleepFor(wait_time);
+  }
+}
+
+}  // namespace riegeli
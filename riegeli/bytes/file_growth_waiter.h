@@ -0,0 +1,110 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_FILE_GROWTH_WAITER_H_
+#define RIEGELI_BYTES_FILE_GROWTH_WAITER_H_
+
+#include <string>
+#include <utility>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/object.h"
+
+namespace riegeli {
+
+// `FileGrowthWaiter` waits until a file grows, so that a reader can follow a
+// file being written, like `tail -f`, without a busy loop.
+//
+// On Linux, inotify wakes up the waiter when the file is modified. The file
+// size is also polled with `Options::poll_interval()`, which is the only
+// mechanism elsewhere, or if inotify is not available or does not report
+// modifications, e.g. on some network filesystems.
+//
+// Example:
+// ```
+//   riegeli::FileGrowthWaiter waiter(filename);
+//   riegeli::RecordReader<riegeli::FdReader<>> record_reader(
+//       std::forward_as_tuple(filename, O_RDONLY));
+//   for (;;) {
+//     while (record_reader.ReadRecord(record)) {
+//       ... Process record.
+//     }
+//     if (!record_reader.healthy()) ... Handle failure.
+//     if (!waiter.Wait(absl::InfiniteDuration())) ... Handle failure.
+//   }
+// ```
+class FileGrowthWaiter : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // How often the file size is checked if no modification is reported
+    // earlier.
+    //
+    // Default: `absl::Seconds(1)`.
+    Options& set_poll_interval(absl::Duration poll_interval) & {
+      poll_interval_ = poll_interval;
+      return *this;
+    }
+    Options&& set_poll_interval(absl::Duration poll_interval) && {
+      return std::move(set_poll_interval(poll_interval));
+    }
+    absl::Duration poll_interval() const { return poll_interval_; }
+
+   private:
+    absl::Duration poll_interval_ = absl::Seconds(1);
+  };
+
+  // Will wait for growth of the file named `filename`. Its current size is
+  // the reference for the first `Wait()`.
+  explicit FileGrowthWaiter(absl::string_view filename,
+                            Options options = Options());
+
+  FileGrowthWaiter(const FileGrowthWaiter&) = delete;
+  FileGrowthWaiter& operator=(const FileGrowthWaiter&) = delete;
+
+  ~FileGrowthWaiter();
+
+  // Returns the name of the file being watched. Unchanged by `Close()`.
+  const std::string& filename() const { return filename_; }
+
+  // Waits until the file is larger than at the previous `Wait()` (or at
+  // construction), or until `timeout` passes.
+  //
+  // Return values:
+  //  * `true`                      - the file has grown
+  //  * `false` (when `healthy()`)  - timeout
+  //  * `false` (when `!healthy()`) - failure
+  bool Wait(absl::Duration timeout);
+
+ protected:
+  void Done() override;
+
+ private:
+  bool FailOperation(absl::string_view operation);
+  bool UpdateSize(bool& grown);
+
+  std::string filename_;
+  absl::Duration poll_interval_;
+  // inotify fd watching the file, or -1 if inotify is not used.
+  int inotify_fd_ = -1;
+  Position size_ = 0;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_FILE_GROWTH_WAITER_H_
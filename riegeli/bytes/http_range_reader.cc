@@ -0,0 +1,299 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/bytes/http_range_reader.h"
+
+#include <stddef.h>
+
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/buffered_reader.h"
+
+namespace riegeli {
+
+// Before C++17 if a constexpr static data member is ODR-used, its definition at
+// namespace scope is required. Since C++17 these definitions are deprecated:
+// http://en.cppreference.com/w/cpp/language/static
+#if __cplusplus < 201703
+constexpr size_t HttpRangeReaderBase::Options::kDefaultRequestSize;
+#endif
+
+// A range of the object, requested by one or two concurrent requests (the
+// second one if the first one was hedged).
+struct HttpRangeReaderBase::Range {
+  explicit Range(Position pos, size_t length) : pos(pos), length(length) {}
+
+  const Position pos;
+  const size_t length;
+  // Whether a hedged request was issued. Used only by the reading thread.
+  bool hedged = false;
+
+  absl::Mutex mutex;
+  // Number of requests for this range which have not completed.
+  int pending ABSL_GUARDED_BY(mutex) = 0;
+  // Whether `status` and `data` are final: either a request succeeded, or all
+  // requests failed.
+  bool done ABSL_GUARDED_BY(mutex) = false;
+  absl::Status status ABSL_GUARDED_BY(mutex);
+  // Flat, so that reading from it does not need to flatten it.
+  Chain data ABSL_GUARDED_BY(mutex);
+};
+
+struct HttpRangeReaderBase::Requests {
+  absl::Mutex mutex;
+  size_t running ABSL_GUARDED_BY(mutex) = 0;
+};
+
+HttpRangeReaderBase::HttpRangeReaderBase(const Options& options)
+    : BufferedReader(options.buffer_size()),
+      request_size_(options.request_size()),
+      parallelism_(options.parallelism()),
+      hedge_delay_(options.hedge_delay()),
+      requests_(std::make_unique<Requests>()) {}
+
+HttpRangeReaderBase::HttpRangeReaderBase(HttpRangeReaderBase&& that) noexcept
+    : BufferedReader(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      request_size_(that.request_size_),
+      parallelism_(that.parallelism_),
+      hedge_delay_(that.hedge_delay_),
+      size_(that.size_),
+      num_hedged_requests_(that.num_hedged_requests_),
+      ranges_(std::move(that.ranges_)),
+      requests_(std::move(that.requests_)) {
+  // The transport is about to be moved by the derived class.
+  WaitForRequests();
+}
+
+HttpRangeReaderBase& HttpRangeReaderBase::operator=(
+    HttpRangeReaderBase&& that) noexcept {
+  // Both transports are about to be moved or destroyed by the derived class.
+  WaitForRequests();
+  that.WaitForRequests();
+  BufferedReader::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  request_size_ = that.request_size_;
+  parallelism_ = that.parallelism_;
+  hedge_delay_ = that.hedge_delay_;
+  size_ = that.size_;
+  num_hedged_requests_ = that.num_hedged_requests_;
+  ranges_ = std::move(that.ranges_);
+  requests_ = std::move(that.requests_);
+  return *this;
+}
+
+HttpRangeReaderBase::~HttpRangeReaderBase() {}
+
+void HttpRangeReaderBase::Reset() {
+  WaitForRequests();
+  BufferedReader::Reset();
+  request_size_ = 0;
+  parallelism_ = 0;
+  hedge_delay_ = absl::nullopt;
+  size_ = 0;
+  num_hedged_requests_ = 0;
+  ranges_.clear();
+}
+
+void HttpRangeReaderBase::Reset(const Options& options) {
+  WaitForRequests();
+  BufferedReader::Reset(options.buffer_size());
+  request_size_ = options.request_size();
+  parallelism_ = options.parallelism();
+  hedge_delay_ = options.hedge_delay();
+  size_ = 0;
+  num_hedged_requests_ = 0;
+  ranges_.clear();
+  if (requests_ == nullptr) requests_ = std::make_unique<Requests>();
+}
+
+void HttpRangeReaderBase::Initialize(HttpTransport* src) {
+  RIEGELI_ASSERT(src != nullptr)
+      << "Failed precondition of HttpRangeReader: null HttpTransport pointer";
+  absl::Status status = src->GetSize(size_);
+  if (ABSL_PREDICT_FALSE(!status.ok())) {
+    Fail(std::move(status));
+    return;
+  }
+  set_size_hint(size_);
+}
+
+void HttpRangeReaderBase::WaitForRequests() {
+  if (requests_ == nullptr) return;
+  absl::MutexLock lock(&requests_->mutex);
+  requests_->mutex.Await(absl::Condition(
+      +[](size_t* running) { return *running == 0; }, &requests_->running));
+}
+
+void HttpRangeReaderBase::Done() {
+  BufferedReader::Done();
+  ranges_.clear();
+  WaitForRequests();
+}
+
+size_t HttpRangeReaderBase::EstimateMemory() const {
+  return BufferedReader::EstimateMemory() +
+         ranges_.size() * (sizeof(Range) + request_size_);
+}
+
+void HttpRangeReaderBase::RequestRanges(Position pos) {
+  // Drop ranges which were read, and drop all ranges if `pos` is not covered
+  // by them. Requests for dropped ranges still running are abandoned.
+  while (!ranges_.empty() &&
+         pos >= ranges_.front()->pos + ranges_.front()->length) {
+    ranges_.pop_front();
+  }
+  if (!ranges_.empty() && pos < ranges_.front()->pos) ranges_.clear();
+  Position next_pos =
+      ranges_.empty() ? pos : ranges_.back()->pos + ranges_.back()->length;
+  while (ranges_.size() < IntCast<size_t>(parallelism_) && next_pos < size_) {
+    ranges_.push_back(std::make_shared<Range>(
+        next_pos, UnsignedMin(request_size_, size_ - next_pos)));
+    StartRequest(ranges_.back());
+    next_pos += ranges_.back()->length;
+  }
+}
+
+void HttpRangeReaderBase::StartRequest(const std::shared_ptr<Range>& range) {
+  {
+    absl::MutexLock lock(&range->mutex);
+    ++range->pending;
+  }
+  Requests* const requests = requests_.get();
+  {
+    absl::MutexLock lock(&requests->mutex);
+    ++requests->running;
+  }
+  HttpTransport* const src = src_transport();
+  internal::ThreadPool::global().Schedule([src, range, requests] {
+    Chain data;
+    absl::Status status = src->ReadRange(range->pos, range->length, data);
+    if (status.ok()) data.Flatten();
+    {
+      absl::MutexLock lock(&range->mutex);
+      --range->pending;
+      if (!range->done) {
+        if (status.ok()) {
+          range->status = absl::OkStatus();
+          range->data = std::move(data);
+          range->done = true;
+        } else {
+          if (range->status.ok()) range->status = std::move(status);
+          if (range->pending == 0) range->done = true;
+        }
+      }
+    }
+    absl::MutexLock lock(&requests->mutex);
+    --requests->running;
+  });
+}
+
+void HttpRangeReaderBase::AwaitRange(const std::shared_ptr<Range>& range) {
+  if (hedge_delay_ != absl::nullopt && !range->hedged) {
+    bool done;
+    {
+      absl::MutexLock lock(&range->mutex);
+      done = range->mutex.AwaitWithTimeout(absl::Condition(&range->done),
+                                           *hedge_delay_);
+    }
+    if (!done) {
+      range->hedged = true;
+      ++num_hedged_requests_;
+      StartRequest(range);
+    }
+  }
+  absl::MutexLock lock(&range->mutex);
+  range->mutex.Await(absl::Condition(&range->done));
+}
+
+bool HttpRangeReaderBase::ReadInternal(size_t min_length, size_t max_length,
+                                       char* dest) {
+  RIEGELI_ASSERT_GT(min_length, 0u)
+      << "Failed precondition of BufferedReader::ReadInternal(): "
+         "nothing to read";
+  RIEGELI_ASSERT_GE(max_length, min_length)
+      << "Failed precondition of BufferedReader::ReadInternal(): "
+         "max_length < min_length";
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of BufferedReader::ReadInternal(): " << status();
+  for (;;) {
+    const Position pos = limit_pos();
+    if (pos >= size_) return false;
+    RequestRanges(pos);
+    const std::shared_ptr<Range> range = ranges_.front();
+    AwaitRange(range);
+    absl::Status status;
+    size_t length_read = 0;
+    {
+      absl::MutexLock lock(&range->mutex);
+      if (ABSL_PREDICT_FALSE(!range->status.ok())) {
+        status = range->status;
+      } else {
+        const absl::string_view data = range->data.Flatten();
+        const size_t offset = IntCast<size_t>(pos - range->pos);
+        // Fewer bytes than requested mean that the object ended.
+        if (offset >= data.size()) return false;
+        length_read = UnsignedMin(max_length, data.size() - offset);
+        std::memcpy(dest, data.data() + offset, length_read);
+      }
+    }
+    if (ABSL_PREDICT_FALSE(!status.ok())) {
+      ranges_.clear();
+      return Fail(std::move(status));
+    }
+    move_limit_pos(length_read);
+    if (length_read >= min_length) return true;
+    dest += length_read;
+    min_length -= length_read;
+    max_length -= length_read;
+  }
+}
+
+bool HttpRangeReaderBase::SeekBehindBuffer(Position new_pos) {
+  RIEGELI_ASSERT(new_pos < start_pos() || new_pos > limit_pos())
+      << "Failed precondition of BufferedReader::SeekBehindBuffer(): "
+         "position in the buffer, use Seek() instead";
+  RIEGELI_ASSERT_EQ(buffer_size(), 0u)
+      << "Failed precondition of BufferedReader::SeekBehindBuffer(): "
+         "buffer not empty";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (new_pos > size_) {
+    // File ends.
+    set_limit_pos(size_);
+    return false;
+  }
+  set_limit_pos(new_pos);
+  return true;
+}
+
+absl::optional<Position> HttpRangeReaderBase::SizeImpl() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  return size_;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,367 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_HTTP_RANGE_READER_H_
+#define RIEGELI_BYTES_HTTP_RANGE_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/bytes/buffered_reader.h"
+
+namespace riegeli {
+
+// Fetches byte ranges of a remote object, e.g. with HTTP range requests to
+// an object store like S3 or GCS.
+//
+// `HttpRangeReader` issues many requests for the same object, so an
+// implementation should keep connections open and reuse them across requests,
+// e.g. with a pool of keep-alive connections.
+//
+// Member functions are called concurrently from several threads.
+class HttpTransport {
+ public:
+  virtual ~HttpTransport() {}
+
+  // Sets `size` to the size of the object, e.g. from `Content-Length` of a
+  // `HEAD` request.
+  virtual absl::Status GetSize(Position& size) = 0;
+
+  // Appends to `dest` the range of the object of `length` bytes starting at
+  // `pos`, e.g. with a `GET` request with `Range: bytes=pos-(pos+length-1)`.
+  //
+  // Fewer bytes may be appended only if the object ends.
+  //
+  // Precondition: `length > 0`
+  virtual absl::Status ReadRange(Position pos, size_t length, Chain& dest) = 0;
+};
+
+// Template parameter independent part of `HttpRangeReader`.
+class HttpRangeReaderBase : public BufferedReader {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Size of a single range request.
+    //
+    // Larger requests amortize their latency better; smaller requests let
+    // random access read less unneeded data.
+    //
+    // Default: `kDefaultRequestSize` (1M).
+    static constexpr size_t kDefaultRequestSize = size_t{1} << 20;
+    Options& set_request_size(size_t request_size) & {
+      RIEGELI_ASSERT_GT(request_size, 0u)
+          << "Failed precondition of "
+             "HttpRangeReaderBase::Options::set_request_size(): "
+             "zero request size";
+      request_size_ = request_size;
+      return *this;
+    }
+    Options&& set_request_size(size_t request_size) && {
+      return std::move(set_request_size(request_size));
+    }
+    size_t request_size() const { return request_size_; }
+
+    // Maximum number of range requests in flight. While data are read
+    // sequentially, requests for the following ranges are issued concurrently
+    // in background, so that bandwidth is not limited by the latency of a
+    // single request.
+    //
+    // If 1, a single request is issued at a time, still in background.
+    //
+    // Default: 4.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GT(parallelism, 0)
+          << "Failed precondition of "
+             "HttpRangeReaderBase::Options::set_parallelism(): "
+             "parallelism must be positive";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+    // If not `absl::nullopt`, a request which has not completed after this
+    // delay while data from it are awaited is hedged: the same range is
+    // requested again, and whichever request completes first is used. This
+    // reduces tail latency caused by slow servers or connections, at the cost
+    // of some duplicate requests.
+    //
+    // A reasonable delay is around the 95th percentile of request latency.
+    //
+    // Default: `absl::nullopt` (no hedging).
+    Options& set_hedge_delay(absl::optional<absl::Duration> hedge_delay) & {
+      hedge_delay_ = hedge_delay;
+      return *this;
+    }
+    Options&& set_hedge_delay(absl::optional<absl::Duration> hedge_delay) && {
+      return std::move(set_hedge_delay(hedge_delay));
+    }
+    absl::optional<absl::Duration> hedge_delay() const { return hedge_delay_; }
+
+    // Tunes how much data is buffered after reading from the object.
+    //
+    // Default: `kDefaultBufferSize` (64K).
+    Options& set_buffer_size(size_t buffer_size) & {
+      RIEGELI_ASSERT_GT(buffer_size, 0u)
+          << "Failed precondition of "
+             "HttpRangeReaderBase::Options::set_buffer_size(): "
+             "zero buffer size";
+      buffer_size_ = buffer_size;
+      return *this;
+    }
+    Options&& set_buffer_size(size_t buffer_size) && {
+      return std::move(set_buffer_size(buffer_size));
+    }
+    size_t buffer_size() const { return buffer_size_; }
+
+   private:
+    size_t request_size_ = kDefaultRequestSize;
+    int parallelism_ = 4;
+    absl::optional<absl::Duration> hedge_delay_;
+    size_t buffer_size_ = kDefaultBufferSize;
+  };
+
+  // Returns the transport being read from. Unchanged by `Close()`.
+  virtual HttpTransport* src_transport() = 0;
+  virtual const HttpTransport* src_transport() const = 0;
+
+  // Returns the number of hedged requests issued so far.
+  uint64_t num_hedged_requests() const { return num_hedged_requests_; }
+
+  bool SupportsRandomAccess() override { return true; }
+  size_t EstimateMemory() const override;
+
+ protected:
+  HttpRangeReaderBase() noexcept {}
+
+  explicit HttpRangeReaderBase(const Options& options);
+
+  HttpRangeReaderBase(HttpRangeReaderBase&& that) noexcept;
+  HttpRangeReaderBase& operator=(HttpRangeReaderBase&& that) noexcept;
+
+  ~HttpRangeReaderBase();
+
+  void Reset();
+  void Reset(const Options& options);
+  void Initialize(HttpTransport* src);
+
+  // Waits for requests running in background, which refer to
+  // `*src_transport()`.
+  //
+  // A derived class must call this in its destructor. It is called
+  // automatically before moving or resetting the transport.
+  void WaitForRequests();
+
+  void Done() override;
+  bool ReadInternal(size_t min_length, size_t max_length, char* dest) override;
+  bool SeekBehindBuffer(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
+
+ private:
+  struct Range;
+  struct Requests;
+
+  // Makes `ranges_` begin with a range containing `pos` and contain up to
+  // `parallelism_` ranges, issuing requests for new ranges.
+  void RequestRanges(Position pos);
+  void StartRequest(const std::shared_ptr<Range>& range);
+  // Waits for `range` to complete, hedging its request if it takes longer than
+  // `hedge_delay_`.
+  void AwaitRange(const std::shared_ptr<Range>& range);
+
+  size_t request_size_ = 0;
+  int parallelism_ = 0;
+  absl::optional<absl::Duration> hedge_delay_;
+  Position size_ = 0;
+  uint64_t num_hedged_requests_ = 0;
+  // Ranges requested for read-ahead, at consecutive positions. The first range
+  // contains `limit_pos()` unless it is empty.
+  std::deque<std::shared_ptr<Range>> ranges_;
+  // Tracks requests running in background. It is allocated separately so that
+  // requests can refer to it while `*this` is moved.
+  std::unique_ptr<Requests> requests_;
+};
+
+// A `Reader` which reads from a remote object through an `HttpTransport`,
+// issuing concurrent range requests for read-ahead, and optionally hedging
+// slow requests.
+//
+// `HttpRangeReader` supports random access. The size of the object is fetched
+// once when it is opened, and the object must not change while it is read.
+//
+// The `Src` template parameter specifies the type of the object providing and
+// possibly owning the transport being read from. `Src` must support
+// `Dependency<HttpTransport*, Src>`, e.g. `HttpTransport*` (not owned,
+// default), `std::unique_ptr<HttpTransport>` (owned), `MyTransport` (owned).
+//
+// By relying on CTAD the template argument can be deduced as the value type of
+// the first constructor argument. This requires C++17.
+//
+// The transport must not be closed until the `HttpRangeReader` is closed or no
+// longer used.
+template <typename Src = HttpTransport*>
+class HttpRangeReader : public HttpRangeReaderBase {
+ public:
+  // Creates a closed `HttpRangeReader`.
+  HttpRangeReader() noexcept {}
+
+  // Will read from the transport provided by `src`.
+  explicit HttpRangeReader(const Src& src, Options options = Options());
+  explicit HttpRangeReader(Src&& src, Options options = Options());
+
+  // Will read from the transport provided by a `Src` constructed from elements
+  // of `src_args`. This avoids constructing a temporary `Src` and moving from
+  // it.
+  template <typename... SrcArgs>
+  explicit HttpRangeReader(std::tuple<SrcArgs...> src_args,
+                           Options options = Options());
+
+  HttpRangeReader(HttpRangeReader&& that) noexcept;
+  HttpRangeReader& operator=(HttpRangeReader&& that) noexcept;
+
+  ~HttpRangeReader();
+
+  // Makes `*this` equivalent to a newly constructed `HttpRangeReader`. This
+  // avoids constructing a temporary `HttpRangeReader` and moving from it.
+  void Reset();
+  void Reset(const Src& src, Options options = Options());
+  void Reset(Src&& src, Options options = Options());
+  template <typename... SrcArgs>
+  void Reset(std::tuple<SrcArgs...> src_args, Options options = Options());
+
+  // Returns the object providing and possibly owning the transport being read
+  // from. Unchanged by `Close()`.
+  Src& src() { return src_.manager(); }
+  const Src& src() const { return src_.manager(); }
+  HttpTransport* src_transport() override { return src_.get(); }
+  const HttpTransport* src_transport() const override { return src_.get(); }
+
+ private:
+  // The object providing and possibly owning the transport being read from.
+  Dependency<HttpTransport*, Src> src_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+HttpRangeReader()->HttpRangeReader<DeleteCtad<>>;
+template <typename Src>
+explicit HttpRangeReader(const Src& src, HttpRangeReaderBase::Options options =
+                                             HttpRangeReaderBase::Options())
+    -> HttpRangeReader<std::decay_t<Src>>;
+template <typename Src>
+explicit HttpRangeReader(Src&& src, HttpRangeReaderBase::Options options =
+                                        HttpRangeReaderBase::Options())
+    -> HttpRangeReader<std::decay_t<Src>>;
+template <typename... SrcArgs>
+explicit HttpRangeReader(
+    std::tuple<SrcArgs...> src_args,
+    HttpRangeReaderBase::Options options = HttpRangeReaderBase::Options())
+    -> HttpRangeReader<DeleteCtad<std::tuple<SrcArgs...>>>;
+#endif
+
+// Implementation details follow.
+
+template <typename Src>
+inline HttpRangeReader<Src>::HttpRangeReader(const Src& src, Options options)
+    : HttpRangeReaderBase(options), src_(src) {
+  Initialize(src_.get());
+}
+
+template <typename Src>
+inline HttpRangeReader<Src>::HttpRangeReader(Src&& src, Options options)
+    : HttpRangeReaderBase(options), src_(std::move(src)) {
+  Initialize(src_.get());
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline HttpRangeReader<Src>::HttpRangeReader(std::tuple<SrcArgs...> src_args,
+                                             Options options)
+    : HttpRangeReaderBase(options), src_(std::move(src_args)) {
+  Initialize(src_.get());
+}
+
+template <typename Src>
+inline HttpRangeReader<Src>::HttpRangeReader(HttpRangeReader&& that) noexcept
+    : HttpRangeReaderBase(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      src_(std::move(that.src_)) {}
+
+template <typename Src>
+inline HttpRangeReader<Src>& HttpRangeReader<Src>::operator=(
+    HttpRangeReader&& that) noexcept {
+  HttpRangeReaderBase::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  src_ = std::move(that.src_);
+  return *this;
+}
+
+template <typename Src>
+HttpRangeReader<Src>::~HttpRangeReader() {
+  WaitForRequests();
+}
+
+template <typename Src>
+inline void HttpRangeReader<Src>::Reset() {
+  HttpRangeReaderBase::Reset();
+  src_.Reset();
+}
+
+template <typename Src>
+inline void HttpRangeReader<Src>::Reset(const Src& src, Options options) {
+  HttpRangeReaderBase::Reset(options);
+  src_.Reset(src);
+  Initialize(src_.get());
+}
+
+template <typename Src>
+inline void HttpRangeReader<Src>::Reset(Src&& src, Options options) {
+  HttpRangeReaderBase::Reset(options);
+  src_.Reset(std::move(src));
+  Initialize(src_.get());
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline void HttpRangeReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
+                                        Options options) {
+  HttpRangeReaderBase::Reset(options);
+  src_.Reset(std::move(src_args));
+  Initialize(src_.get());
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_HTTP_RANGE_READER_H_
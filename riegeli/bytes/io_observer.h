@@ -0,0 +1,131 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_IO_OBSERVER_H_
+#define RIEGELI_BYTES_IO_OBSERVER_H_
+
+#include <stddef.h>
+
+#include <cerrno>
+
+#include "absl/base/optimization.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "riegeli/base/base.h"
+#include "riegeli/bytes/io_stats.h"
+
+namespace riegeli {
+
+// A single I/O operation performed by a `Reader` or `Writer`, reported to an
+// `IoObserver`.
+struct IoEvent {
+  // Name of the operation, e.g. "pread()", "writev()", or "fsync()".
+  absl::string_view operation;
+  // Position of the `Reader` or `Writer` where the operation starts. Zero for
+  // operations not associated with a position.
+  Position pos = 0;
+  // Number of bytes requested.
+  size_t length = 0;
+  // Number of bytes transferred. Zero if `!ok`.
+  size_t length_done = 0;
+  // Whether the operation succeeded. An interrupted operation which is retried
+  // is reported as a failure.
+  bool ok = true;
+  // When the operation started, and how long it took, measured with the wall
+  // clock.
+  absl::Time start_time;
+  absl::Duration duration;
+};
+
+// Receives I/O operations performed by a `Reader` or `Writer`, e.g. to export
+// latency histograms or traces.
+//
+// An observer is set with `FdReaderBase::Options::set_io_observer()` or
+// `FdWriterBase::Options::set_io_observer()`.
+//
+// Implementations must be thread-safe if an observer is shared among objects
+// used by different threads, or if `FdReaderBase::Options::read_ahead() > 0`,
+// in which case reads ahead are reported by a background thread.
+class IoObserver {
+ public:
+  virtual ~IoObserver() {}
+
+  // Called after an I/O operation finished.
+  virtual void OnIoEvent(const IoEvent& event) = 0;
+};
+
+namespace internal {
+
+// Times an I/O operation, accounting it in an `IoStatsCounter` and reporting
+// it to an optional `IoObserver`.
+class IoOperationTimer {
+ public:
+  explicit IoOperationTimer(IoObserver* observer, IoStatsCounter& stats)
+      : observer_(observer), stats_(stats), start_time_(absl::Now()) {}
+
+  IoOperationTimer(const IoOperationTimer&) = delete;
+  IoOperationTimer& operator=(const IoOperationTimer&) = delete;
+
+  // Reports a read or write operation. `length_done` is ignored if `!ok`.
+  //
+  // `errno` is preserved, so that the caller can inspect it afterwards.
+  void ReportRead(absl::string_view operation, Position pos, size_t length,
+                  bool ok, size_t length_done) const {
+    const absl::Duration duration = absl::Now() - start_time_;
+    stats_.AddRead(length, ok ? length_done : 0, duration);
+    Report(operation, pos, length, ok, length_done, duration);
+  }
+  void ReportWrite(absl::string_view operation, Position pos, size_t length,
+                   bool ok, size_t length_done) const {
+    const absl::Duration duration = absl::Now() - start_time_;
+    stats_.AddWrite(length, ok ? length_done : 0, duration);
+    Report(operation, pos, length, ok, length_done, duration);
+  }
+
+  // Reports a sync operation.
+  //
+  // `errno` is preserved, so that the caller can inspect it afterwards.
+  void ReportSync(absl::string_view operation, bool ok) const {
+    const absl::Duration duration = absl::Now() - start_time_;
+    stats_.AddSync(duration);
+    Report(operation, 0, 0, ok, 0, duration);
+  }
+
+ private:
+  void Report(absl::string_view operation, Position pos, size_t length,
+              bool ok, size_t length_done, absl::Duration duration) const {
+    if (ABSL_PREDICT_TRUE(observer_ == nullptr)) return;
+    const int saved_errno = errno;
+    IoEvent event;
+    event.operation = operation;
+    event.pos = pos;
+    event.length = length;
+    event.length_done = ok ? length_done : 0;
+    event.ok = ok;
+    event.start_time = start_time_;
+    event.duration = duration;
+    observer_->OnIoEvent(event);
+    errno = saved_errno;
+  }
+
+  IoObserver* observer_;
+  IoStatsCounter& stats_;
+  absl::Time start_time_;
+};
+
+}  // namespace internal
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_IO_OBSERVER_H_
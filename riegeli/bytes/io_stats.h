@@ -0,0 +1,149 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_IO_STATS_H_
+#define RIEGELI_BYTES_IO_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/time/time.h"
+
+namespace riegeli {
+
+// Counters of I/O operations performed by a `Reader` or `Writer` since it was
+// opened. They help to tune buffer sizes.
+struct IoStats {
+  // Number of read operations, e.g. `read()` or `pread()`, and the number of
+  // bytes they read.
+  uint64_t num_reads = 0;
+  uint64_t bytes_read = 0;
+  // Number of read operations which read less than requested, including
+  // reaching the end of file and failures.
+  uint64_t num_short_reads = 0;
+
+  // Number of write operations, e.g. `write()` or `pwritev()`, and the number
+  // of bytes they wrote.
+  uint64_t num_writes = 0;
+  uint64_t bytes_written = 0;
+  // Number of write operations which wrote less than requested, including
+  // failures.
+  uint64_t num_short_writes = 0;
+
+  // Number of seeks which could not be served from the buffer.
+  uint64_t num_seeks = 0;
+
+  // Number of sync operations, e.g. `fsync()` or `sync_file_range()`.
+  uint64_t num_syncs = 0;
+
+  // Total time of read, write, and sync operations, measured with the wall
+  // clock.
+  absl::Duration io_time;
+};
+
+namespace internal {
+
+// Accumulates `IoStats`.
+//
+// Counters are updated with relaxed atomic operations, so that they are cheap
+// and can be updated by a background thread reading ahead while they are
+// being read.
+class IoStatsCounter {
+ public:
+  IoStatsCounter() noexcept {}
+
+  IoStatsCounter(const IoStatsCounter& that) noexcept { Set(that.Get()); }
+  IoStatsCounter& operator=(const IoStatsCounter& that) noexcept {
+    Set(that.Get());
+    return *this;
+  }
+
+  void Reset() { Set(IoStats()); }
+
+  void AddRead(size_t length, size_t length_read, absl::Duration time) {
+    num_reads_.fetch_add(1, std::memory_order_relaxed);
+    bytes_read_.fetch_add(length_read, std::memory_order_relaxed);
+    if (length_read < length) {
+      num_short_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    AddTime(time);
+  }
+
+  void AddWrite(size_t length, size_t length_written, absl::Duration time) {
+    num_writes_.fetch_add(1, std::memory_order_relaxed);
+    bytes_written_.fetch_add(length_written, std::memory_order_relaxed);
+    if (length_written < length) {
+      num_short_writes_.fetch_add(1, std::memory_order_relaxed);
+    }
+    AddTime(time);
+  }
+
+  void AddSeek() { num_seeks_.fetch_add(1, std::memory_order_relaxed); }
+
+  void AddSync(absl::Duration time) {
+    num_syncs_.fetch_add(1, std::memory_order_relaxed);
+    AddTime(time);
+  }
+
+  IoStats Get() const {
+    IoStats stats;
+    stats.num_reads = num_reads_.load(std::memory_order_relaxed);
+    stats.bytes_read = bytes_read_.load(std::memory_order_relaxed);
+    stats.num_short_reads = num_short_reads_.load(std::memory_order_relaxed);
+    stats.num_writes = num_writes_.load(std::memory_order_relaxed);
+    stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+    stats.num_short_writes = num_short_writes_.load(std::memory_order_relaxed);
+    stats.num_seeks = num_seeks_.load(std::memory_order_relaxed);
+    stats.num_syncs = num_syncs_.load(std::memory_order_relaxed);
+    stats.io_time =
+        absl::Nanoseconds(io_time_nanos_.load(std::memory_order_relaxed));
+    return stats;
+  }
+
+ private:
+  void Set(const IoStats& stats) {
+    num_reads_.store(stats.num_reads, std::memory_order_relaxed);
+    bytes_read_.store(stats.bytes_read, std::memory_order_relaxed);
+    num_short_reads_.store(stats.num_short_reads, std::memory_order_relaxed);
+    num_writes_.store(stats.num_writes, std::memory_order_relaxed);
+    bytes_written_.store(stats.bytes_written, std::memory_order_relaxed);
+    num_short_writes_.store(stats.num_short_writes, std::memory_order_relaxed);
+    num_seeks_.store(stats.num_seeks, std::memory_order_relaxed);
+    num_syncs_.store(stats.num_syncs, std::memory_order_relaxed);
+    io_time_nanos_.store(absl::ToInt64Nanoseconds(stats.io_time),
+                         std::memory_order_relaxed);
+  }
+
+  void AddTime(absl::Duration time) {
+    io_time_nanos_.fetch_add(absl::ToInt64Nanoseconds(time),
+                             std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> num_reads_{0};
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> num_short_reads_{0};
+  std::atomic<uint64_t> num_writes_{0};
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> num_short_writes_{0};
+  std::atomic<uint64_t> num_seeks_{0};
+  std::atomic<uint64_t> num_syncs_{0};
+  std::atomic<int64_t> io_time_nanos_{0};
+};
+
+}  // namespace internal
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_IO_STATS_H_
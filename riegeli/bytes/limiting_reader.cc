@@ -36,6 +36,36 @@ namespace riegeli {
 constexpr Position LimitingReaderBase::kNoSizeLimit;
 #endif
 
+TypeId LimitingReaderBase::GetTypeId() const {
+  return TypeId::For<LimitingReaderBase>();
+}
+
+Reader& LimitingReaderBase::SyncNested() {
+  if (nested_ != nullptr) {
+    SyncBuffer(*nested_);
+    return nested_->SyncNested();
+  }
+  Reader& src = *src_reader();
+  SyncBuffer(src);
+  return src;
+}
+
+void LimitingReaderBase::MakeNestedBuffer(Reader& src) {
+  if (nested_ != nullptr) {
+    nested_->MakeNestedBuffer(src);
+    MakeBuffer(*nested_);
+    return;
+  }
+  MakeBuffer(src);
+}
+
+Position LimitingReaderBase::NestedSizeLimit() const {
+  if (nested_ != nullptr) {
+    return UnsignedMin(size_limit_, nested_->NestedSizeLimit());
+  }
+  return size_limit_;
+}
+
 void LimitingReaderBase::Done() {
   if (ABSL_PREDICT_TRUE(healthy())) {
     Reader& src = *src_reader();
@@ -52,12 +82,12 @@ bool LimitingReaderBase::PullSlow(size_t min_length,
   RIEGELI_ASSERT_LE(pos(), size_limit_)
       << "Failed invariant of LimitingReaderBase: position exceeds size limit";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
   const size_t min_length_to_pull =
-      UnsignedMin(min_length, size_limit_ - pos());
+      UnsignedMin(min_length, size_limit - pos());
   const bool ok = src.Pull(min_length_to_pull, recommended_length);
-  MakeBuffer(src);
+  MakeNestedBuffer(src);
   return ok && min_length_to_pull == min_length;
 }
 
@@ -68,11 +98,11 @@ bool LimitingReaderBase::ReadSlow(size_t length, char* dest) {
   RIEGELI_ASSERT_LE(pos(), size_limit_)
       << "Failed invariant of LimitingReaderBase: position exceeds size limit";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
-  const size_t length_to_read = UnsignedMin(length, size_limit_ - pos());
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
+  const size_t length_to_read = UnsignedMin(length, size_limit - pos());
   const bool ok = src.Read(length_to_read, dest);
-  MakeBuffer(src);
+  MakeNestedBuffer(src);
   return ok && length_to_read == length;
 }
 
@@ -101,11 +131,11 @@ inline bool LimitingReaderBase::ReadInternal(size_t length, Dest& dest) {
   RIEGELI_ASSERT_LE(pos(), size_limit_)
       << "Failed invariant of LimitingReaderBase: position exceeds size limit";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
-  const size_t length_to_read = UnsignedMin(length, size_limit_ - pos());
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
+  const size_t length_to_read = UnsignedMin(length, size_limit - pos());
   const bool ok = src.ReadAndAppend(length_to_read, dest);
-  MakeBuffer(src);
+  MakeNestedBuffer(src);
   return ok && length_to_read == length;
 }
 
@@ -116,11 +146,11 @@ bool LimitingReaderBase::CopySlow(Position length, Writer& dest) {
   RIEGELI_ASSERT_LE(pos(), size_limit_)
       << "Failed invariant of LimitingReaderBase: position exceeds size limit";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
-  const Position length_to_copy = UnsignedMin(length, size_limit_ - pos());
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
+  const Position length_to_copy = UnsignedMin(length, size_limit - pos());
   const bool ok = src.Copy(length_to_copy, dest);
-  MakeBuffer(src);
+  MakeNestedBuffer(src);
   return ok && length_to_copy == length;
 }
 
@@ -131,15 +161,15 @@ bool LimitingReaderBase::CopySlow(size_t length, BackwardWriter& dest) {
   RIEGELI_ASSERT_LE(pos(), size_limit_)
       << "Failed invariant of LimitingReaderBase: position exceeds size limit";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
-  if (ABSL_PREDICT_FALSE(length > size_limit_ - pos())) {
-    src.Seek(size_limit_);
-    MakeBuffer(src);
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
+  if (ABSL_PREDICT_FALSE(length > size_limit - pos())) {
+    src.Seek(size_limit);
+    MakeNestedBuffer(src);
     return false;
   }
   const bool ok = src.Copy(length, dest);
-  MakeBuffer(src);
+  MakeNestedBuffer(src);
   return ok;
 }
 
@@ -150,10 +180,10 @@ void LimitingReaderBase::ReadHintSlow(size_t length) {
   RIEGELI_ASSERT_LE(pos(), size_limit_)
       << "Failed invariant of LimitingReaderBase: position exceeds size limit";
   if (ABSL_PREDICT_FALSE(!healthy())) return;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
-  src.ReadHint(UnsignedMin(length, size_limit_ - pos()));
-  MakeBuffer(src);
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
+  src.ReadHint(UnsignedMin(length, size_limit - pos()));
+  MakeNestedBuffer(src);
 }
 
 bool LimitingReaderBase::SupportsRandomAccess() {
@@ -171,11 +201,11 @@ bool LimitingReaderBase::SeekSlow(Position new_pos) {
       << "Failed precondition of Reader::SeekSlow(): "
          "position in the buffer, use Seek() instead";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
-  const Position pos_to_seek = UnsignedMin(new_pos, size_limit_);
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
+  const Position pos_to_seek = UnsignedMin(new_pos, size_limit);
   const bool ok = src.Seek(pos_to_seek);
-  MakeBuffer(src);
+  MakeNestedBuffer(src);
   return ok && pos_to_seek == new_pos;
 }
 
@@ -186,12 +216,12 @@ bool LimitingReaderBase::SupportsSize() {
 
 absl::optional<Position> LimitingReaderBase::SizeImpl() {
   if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
-  Reader& src = *src_reader();
-  SyncBuffer(src);
+  Reader& src = SyncNested();
+  const Position size_limit = NestedSizeLimit();
   const absl::optional<Position> size = src.Size();
-  MakeBuffer(src);
+  MakeNestedBuffer(src);
   if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return absl::nullopt;
-  return UnsignedMin(*size, size_limit_);
+  return UnsignedMin(*size, size_limit);
 }
 
 }  // namespace riegeli
@@ -60,6 +60,8 @@ class LimitingReaderBase : public Reader {
   bool SupportsRewind() override;
   bool SupportsSize() override;
 
+  TypeId GetTypeId() const override;
+
  protected:
   LimitingReaderBase() noexcept : Reader(kInitiallyClosed) {}
 
@@ -92,6 +94,10 @@ class LimitingReaderBase : public Reader {
   // them for the size limit. Fails `*this` if `src` failed.
   void MakeBuffer(Reader& src);
 
+  // Remembers whether `src` is a `LimitingReaderBase`, so that nested limits
+  // collapse.
+  void FindNested(Reader* src);
+
   // Invariant: pos() <= size_limit_
   Position size_limit_ = kNoSizeLimit;
 
@@ -102,10 +108,30 @@ class LimitingReaderBase : public Reader {
   // current limit.
   void reset_size_limit(Position size_limit);
 
+  // Nested `LimitingReaderBase` layers collapse into one: if the original
+  // `Reader` is a `LimitingReaderBase`, slow operations skip it and operate
+  // directly on its source with the tightest size limit, instead of passing
+  // through virtual functions of each layer. Buffer pointers of skipped layers
+  // are brought up to date afterwards, so that they remain consistent.
+
+  // Sets cursors of nested layers and of the innermost source to cursor of
+  // `*this`, and returns the innermost source.
+  Reader& SyncNested();
+
+  // Sets buffer pointers of nested layers, and then of `*this`, from the
+  // innermost source `src`.
+  void MakeNestedBuffer(Reader& src);
+
+  // Returns the tightest size limit of `*this` and nested layers.
+  Position NestedSizeLimit() const;
+
   // This template is defined and used only in limiting_reader.cc.
   template <typename Dest>
   bool ReadInternal(size_t length, Dest& dest);
 
+  // `src_reader()` if it is a `LimitingReaderBase`, otherwise `nullptr`.
+  LimitingReaderBase* nested_ = nullptr;
+
   // Invariants if `is_open()`:
   //   `start() == src_reader()->start()`
   //   `limit() <= src_reader()->limit()`
@@ -232,7 +258,8 @@ inline LimitingReaderBase::LimitingReaderBase(
     : Reader(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
-      size_limit_(that.size_limit_) {}
+      size_limit_(that.size_limit_),
+      nested_(that.nested_) {}
 
 inline LimitingReaderBase& LimitingReaderBase::operator=(
     LimitingReaderBase&& that) noexcept {
@@ -240,17 +267,20 @@ inline LimitingReaderBase& LimitingReaderBase::operator=(
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   size_limit_ = that.size_limit_;
+  nested_ = that.nested_;
   return *this;
 }
 
 inline void LimitingReaderBase::Reset() {
   Reader::Reset(kInitiallyClosed);
   size_limit_ = kNoSizeLimit;
+  nested_ = nullptr;
 }
 
 inline void LimitingReaderBase::Reset(Position size_limit) {
   Reader::Reset(kInitiallyOpen);
   size_limit_ = size_limit;
+  nested_ = nullptr;
 }
 
 inline void LimitingReaderBase::Initialize(Reader* src) {
@@ -259,6 +289,7 @@ inline void LimitingReaderBase::Initialize(Reader* src) {
   RIEGELI_ASSERT_GE(size_limit_, src->pos())
       << "Failed precondition of LimitingReader: "
          "size limit smaller than current position";
+  FindNested(src);
   MakeBuffer(*src);
 }
 
@@ -298,6 +329,12 @@ inline void LimitingReaderBase::MakeBuffer(Reader& src) {
   if (ABSL_PREDICT_FALSE(!src.healthy())) FailWithoutAnnotation(src);
 }
 
+inline void LimitingReaderBase::FindNested(Reader* src) {
+  nested_ = src->GetTypeId() == TypeId::For<LimitingReaderBase>()
+                ? static_cast<LimitingReaderBase*>(src)
+                : nullptr;
+}
+
 template <typename Src>
 inline LimitingReader<Src>::LimitingReader(const Src& src, Position size_limit)
     : LimitingReaderBase(size_limit), src_(src) {
@@ -374,6 +411,7 @@ inline void LimitingReader<Src>::MoveSrc(LimitingReader&& that) {
     // `src_` is not moved yet so `src_` is taken from `that`.
     SyncBuffer(*that.src_);
     src_ = std::move(that.src_);
+    FindNested(src_.get());
     MakeBuffer(*src_);
   }
 }
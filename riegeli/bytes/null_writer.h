@@ -38,6 +38,7 @@ class NullWriter : public Writer {
   using Object::kInitiallyOpen;
 
   // Creates a closed `NullWriter`.
+  NullWriter() noexcept : Writer(kInitiallyClosed) {}
   explicit NullWriter(InitiallyClosed) noexcept : Writer(kInitiallyClosed) {}
 
   // Will discard all output.
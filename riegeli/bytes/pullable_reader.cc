@@ -30,6 +30,7 @@
 #include "riegeli/base/chain.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/scratch_pool.h"
 #include "riegeli/bytes/writer.h"
 
 namespace riegeli {
@@ -94,7 +95,8 @@ bool PullableReader::PullSlow(size_t min_length, size_t recommended_length) {
       if (available() >= min_length) return true;
     }
     size_t remaining_min_length = min_length;
-    recommended_length = UnsignedMax(min_length, recommended_length);
+    recommended_length =
+        UnsignedMax(min_length, recommended_length, scratch_merge_length_);
     size_t max_length = SaturatingAdd(recommended_length, recommended_length);
     std::unique_ptr<Scratch> new_scratch;
     if (ABSL_PREDICT_FALSE(scratch_ == nullptr)) {
@@ -118,7 +120,15 @@ bool PullableReader::PullSlow(size_t min_length, size_t recommended_length) {
     char* dest = flat_buffer.data();
     char* const min_limit = flat_buffer.data() + remaining_min_length;
     char* const max_limit = flat_buffer.data() + flat_buffer.size();
+    char* const merge_limit =
+        flat_buffer.data() +
+        UnsignedMin(scratch_merge_length_, flat_buffer.size());
     do {
+      if (dest >= min_limit && available() > PtrDistance(dest, merge_limit)) {
+        // Merging the next fragment would copy it only partially. Leave it to
+        // be read directly after scratch ends.
+        break;
+      }
       const size_t length =
           UnsignedMin(available(), PtrDistance(dest, max_limit));
       if (
@@ -127,7 +137,7 @@ bool PullableReader::PullSlow(size_t min_length, size_t recommended_length) {
         std::memcpy(dest, cursor(), length);
         move_cursor(length);
         dest += length;
-        if (dest >= min_limit) break;
+        if (dest >= min_limit && dest >= merge_limit) break;
       }
       if (ABSL_PREDICT_FALSE(scratch_used())) {
         SyncScratch();
@@ -135,6 +145,9 @@ bool PullableReader::PullSlow(size_t min_length, size_t recommended_length) {
       }
     } while (PullBehindScratch());
     new_scratch->buffer.RemoveSuffix(PtrDistance(dest, max_limit));
+    ++scratch_fills_;
+    scratch_bytes_copied_ += PtrDistance(flat_buffer.data(), dest);
+    internal::CountScratchFill(PtrDistance(flat_buffer.data(), dest));
     set_limit_pos(pos());
     new_scratch->original_start = start();
     new_scratch->original_buffer_size = buffer_size();
@@ -16,6 +16,7 @@
 #define RIEGELI_BYTES_PULLABLE_READER_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <memory>
 #include <utility>
@@ -27,6 +28,7 @@
 #include "riegeli/base/object.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/scratch_pool.h"
 #include "riegeli/bytes/writer.h"
 
 namespace riegeli {
@@ -39,6 +41,16 @@ class PullableReader : public Reader {
  private:
   struct Scratch;
 
+ public:
+  // Statistics of scratch usage, accumulated since the `PullableReader` was
+  // created or `Reset()`. They show the cost of `Pull()` calls which span
+  // fragments of the source.
+  //
+  // `scratch_fills()` is the number of times when data were copied to scratch.
+  // `scratch_bytes_copied()` is the total length of these data.
+  uint64_t scratch_fills() const { return scratch_fills_; }
+  uint64_t scratch_bytes_copied() const { return scratch_bytes_copied_; }
+
  protected:
   // Helps to implement move constructor or move assignment if scratch is used.
   //
@@ -88,6 +100,20 @@ class PullableReader : public Reader {
   // temporarily unrelated to the source. This is exposed for assertions.
   bool scratch_used() const;
 
+  // When scratch is filled, keeps copying further fragments of the source
+  // which fit in full within `merge_length` bytes of scratch, even after
+  // `min_length` is satisfied. This merges adjacent small fragments once,
+  // instead of filling scratch again at each of their boundaries.
+  //
+  // This is suitable only if `PullBehindScratch()` is cheap and does not
+  // block, e.g. if the source is already in memory.
+  //
+  // Default: 0 (only `min_length` is copied, or more if it is available without
+  // pulling).
+  void set_scratch_merge_length(size_t merge_length) {
+    scratch_merge_length_ = merge_length;
+  }
+
   // `PullableReader::{Done,SyncImpl}()` seek the source back to the current
   // position if scratch is used but not all data from scratch were read.
   // This is feasible only if `SupportsRandomAccess()`.
@@ -136,6 +162,13 @@ class PullableReader : public Reader {
 
  private:
   struct Scratch {
+    Scratch() : buffer(internal::GetScratchBlock()) {}
+
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+
+    ~Scratch() { internal::PutScratchBlock(std::move(buffer)); }
+
     ChainBlock buffer;
     const char* original_start = nullptr;
     size_t original_buffer_size = 0;
@@ -149,6 +182,9 @@ class PullableReader : public Reader {
   bool ScratchEnds();
 
   std::unique_ptr<Scratch> scratch_;
+  size_t scratch_merge_length_ = 0;
+  uint64_t scratch_fills_ = 0;
+  uint64_t scratch_bytes_copied_ = 0;
 
   // Invariants if `scratch_used()`:
   //   `start() == scratch_->buffer.data()`
@@ -161,7 +197,10 @@ inline PullableReader::PullableReader(PullableReader&& that) noexcept
     : Reader(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
-      scratch_(std::move(that.scratch_)) {}
+      scratch_(std::move(that.scratch_)),
+      scratch_merge_length_(that.scratch_merge_length_),
+      scratch_fills_(that.scratch_fills_),
+      scratch_bytes_copied_(that.scratch_bytes_copied_) {}
 
 inline PullableReader& PullableReader::operator=(
     PullableReader&& that) noexcept {
@@ -169,17 +208,26 @@ inline PullableReader& PullableReader::operator=(
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   scratch_ = std::move(that.scratch_);
+  scratch_merge_length_ = that.scratch_merge_length_;
+  scratch_fills_ = that.scratch_fills_;
+  scratch_bytes_copied_ = that.scratch_bytes_copied_;
   return *this;
 }
 
 inline void PullableReader::Reset(InitiallyClosed) {
   Reader::Reset(kInitiallyClosed);
   if (ABSL_PREDICT_FALSE(scratch_used())) scratch_->buffer.Clear();
+  scratch_merge_length_ = 0;
+  scratch_fills_ = 0;
+  scratch_bytes_copied_ = 0;
 }
 
 inline void PullableReader::Reset(InitiallyOpen) {
   Reader::Reset(kInitiallyOpen);
   if (ABSL_PREDICT_FALSE(scratch_used())) scratch_->buffer.Clear();
+  scratch_merge_length_ = 0;
+  scratch_fills_ = 0;
+  scratch_bytes_copied_ = 0;
 }
 
 inline bool PullableReader::scratch_used() const {
@@ -29,6 +29,7 @@
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/bytes/backward_writer.h"
+#include "riegeli/bytes/scratch_pool.h"
 
 namespace riegeli {
 
@@ -63,6 +64,7 @@ bool PushableBackwardWriter::SyncScratch() {
       << "Failed invariant of PushableBackwardWriter: "
          "scratch used but buffer pointers do not point to scratch";
   const size_t length_to_write = written_to_buffer();
+  internal::CountScratchFill(length_to_write);
   set_buffer(scratch_->original_limit, scratch_->original_buffer_size,
              scratch_->original_written_to_buffer);
   set_start_pos(start_pos() - written_to_buffer());
@@ -27,6 +27,7 @@
 #include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
 #include "riegeli/bytes/backward_writer.h"
+#include "riegeli/bytes/scratch_pool.h"
 
 namespace riegeli {
 
@@ -147,6 +148,13 @@ class PushableBackwardWriter : public BackwardWriter {
 
  private:
   struct Scratch {
+    Scratch() : buffer(internal::GetScratchBlock()) {}
+
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+
+    ~Scratch() { internal::PutScratchBlock(std::move(buffer)); }
+
     ChainBlock buffer;
     char* original_limit = nullptr;
     size_t original_buffer_size = 0;
@@ -28,6 +28,7 @@
 #include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/bytes/scratch_pool.h"
 #include "riegeli/bytes/writer.h"
 
 namespace riegeli {
@@ -63,6 +64,7 @@ bool PushableWriter::SyncScratch() {
       << "Failed invariant of PushableWriter: "
          "scratch used but buffer pointers do not point to scratch";
   const size_t length_to_write = written_to_buffer();
+  internal::CountScratchFill(length_to_write);
   set_buffer(scratch_->original_start, scratch_->original_buffer_size,
              scratch_->original_written_to_buffer);
   set_start_pos(start_pos() - written_to_buffer());
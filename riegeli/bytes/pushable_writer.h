@@ -28,6 +28,7 @@
 #include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
 #include "riegeli/bytes/writer.h"
+#include "riegeli/bytes/scratch_pool.h"
 
 namespace riegeli {
 
@@ -150,6 +151,13 @@ class PushableWriter : public Writer {
 
  private:
   struct Scratch {
+    Scratch() : buffer(internal::GetScratchBlock()) {}
+
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+
+    ~Scratch() { internal::PutScratchBlock(std::move(buffer)); }
+
     ChainBlock buffer;
     char* original_start = nullptr;
     size_t original_buffer_size = 0;
@@ -184,6 +184,18 @@ bool Reader::CopySlow(size_t length, BackwardWriter& dest) {
   return dest.Write(std::move(data));
 }
 
+bool Reader::ReadVSlow(absl::Span<const absl::Span<char>> dest) {
+  RIEGELI_ASSERT(!dest.empty())
+      << "Failed precondition of Reader::ReadVSlow(): no pieces";
+  RIEGELI_ASSERT_LT(available(), dest.front().size())
+      << "Failed precondition of Reader::ReadVSlow(): "
+         "enough data available, use ReadV() instead";
+  for (const absl::Span<char> piece : dest) {
+    if (ABSL_PREDICT_FALSE(!Read(piece.size(), piece.data()))) return false;
+  }
+  return true;
+}
+
 void Reader::ReadHintSlow(size_t length) {
   RIEGELI_ASSERT_LT(available(), length)
       << "Failed precondition of Reader::ReadHintSlow(): "
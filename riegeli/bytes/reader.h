@@ -29,6 +29,7 @@
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
@@ -151,6 +152,18 @@ class Reader : public Object {
   bool Read(size_t length, Chain& dest);
   bool Read(size_t length, absl::Cord& dest);
 
+  // Reads fixed numbers of bytes from the buffer and/or the source to each
+  // piece of `dest` in turn, like `Read(piece.size(), piece.data())` for each
+  // piece, but possibly filling many pieces with one operation on the source,
+  // e.g. `readv()`.
+  //
+  // Return values:
+  //  * `true`                      - success (all pieces filled)
+  //  * `false` (when `healthy()`)  - source ends
+  //                                  (some pieces not filled)
+  //  * `false` (when `!healthy()`) - failure (some pieces not filled)
+  bool ReadV(absl::Span<const absl::Span<char>> dest);
+
   // Reads a fixed number of bytes from the buffer and/or the source to `dest`,
   // appending to any existing data in `dest`.
   //
@@ -339,6 +352,15 @@ class Reader : public Object {
   // Returns `absl::nullopt` on failure (`!healthy()`).
   absl::optional<Position> Size();
 
+  // Returns an estimate of memory owned by this `Reader` for buffering,
+  // excluding `sizeof(*this)` and memory of the source.
+  //
+  // This is cheap enough to be called periodically, e.g. to enforce a memory
+  // budget across many open readers.
+  //
+  // The default implementation returns 0.
+  virtual size_t EstimateMemory() const { return 0; }
+
  protected:
   // Creates a `Reader` with the given initial state.
   explicit Reader(InitiallyClosed) noexcept : Object(kInitiallyClosed) {}
@@ -419,6 +441,13 @@ class Reader : public Object {
   virtual bool CopySlow(Position length, Writer& dest);
   virtual bool CopySlow(size_t length, BackwardWriter& dest);
 
+  // Implementation of the slow part of `ReadV()`.
+  //
+  // By default calls `Read()` for each piece.
+  //
+  // Precondition: `available() < dest.front().size()`
+  virtual bool ReadVSlow(absl::Span<const absl::Span<char>> dest);
+
   // Implementation of the slow part of `ReadHint()`.
   //
   // By default does nothing.
@@ -655,6 +684,22 @@ inline bool Reader::ReadAndAppend(size_t length, absl::Cord& dest) {
   return ReadSlow(length, dest);
 }
 
+inline bool Reader::ReadV(absl::Span<const absl::Span<char>> dest) {
+  for (size_t index = 0; index < dest.size(); ++index) {
+    const absl::Span<char> piece = dest[index];
+    if (ABSL_PREDICT_FALSE(available() < piece.size())) {
+      return ReadVSlow(dest.subspan(index));
+    }
+    // `std::memcpy(nullptr, _, 0)` and `std::memcpy(_, nullptr, 0)` are
+    // undefined.
+    if (ABSL_PREDICT_TRUE(!piece.empty())) {
+      std::memcpy(piece.data(), cursor(), piece.size());
+      move_cursor(piece.size());
+    }
+  }
+  return true;
+}
+
 inline bool Reader::Copy(Position length, Writer& dest) {
   if (ABSL_PREDICT_TRUE(available() >= length && length <= kMaxBytesToCopy)) {
     const absl::string_view data(cursor(), IntCast<size_t>(length));
@@ -16,6 +16,7 @@
 
 #include <stddef.h>
 
+#include <cstring>
 #include <limits>
 
 #include "absl/base/optimization.h"
@@ -80,6 +81,17 @@ int ReaderStreambuf::underflow() {
 std::streamsize ReaderStreambuf::xsgetn(char* dest, std::streamsize length) {
   RIEGELI_ASSERT_GE(length, 0)
       << "Failed precondition of streambuf::xsgetn(): negative length";
+  if (ABSL_PREDICT_TRUE(length <= egptr() - gptr())) {
+    // Fast path: the data are in the get area, which is the buffer of `*src_`,
+    // so there is no need to synchronize the position with `*src_`.
+    if (ABSL_PREDICT_TRUE(
+            // `std::memcpy(_, nullptr, 0)` is undefined.
+            length > 0)) {
+      std::memcpy(dest, gptr(), IntCast<size_t>(length));
+      setg(eback(), gptr() + length, egptr());
+    }
+    return length;
+  }
   if (ABSL_PREDICT_FALSE(!healthy())) return 0;
   BufferSync buffer_sync(this);
   const Position pos_before = src_->pos();
@@ -0,0 +1,150 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/bytes/scratch_pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/memory.h"
+
+namespace riegeli {
+
+namespace {
+
+// Each thread keeps up to `kMaxPooledBlocks` freed scratch blocks, each using
+// at most `kMaxPooledBlockMemory`, without synchronization. Scratch is used
+// at boundaries of source or destination fragments, so a thread rarely needs
+// more blocks at once than the depth of its stack of readers and writers.
+constexpr size_t kMaxPooledBlocks = 4;
+constexpr size_t kMaxPooledBlockMemory = 2 * kMaxBufferSize;
+// Thread-local statistics are added to the global statistics when this many
+// events were counted.
+constexpr uint64_t kStatsBatchSize = 256;
+
+struct GlobalScratchStats {
+  std::atomic<uint64_t> fills{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> pool_hits{0};
+  std::atomic<uint64_t> pool_misses{0};
+};
+
+GlobalScratchStats& global_scratch_stats() {
+  static NoDestructor<GlobalScratchStats> kGlobalScratchStats;
+  return *kGlobalScratchStats;
+}
+
+struct ScratchCache {
+  ~ScratchCache();
+
+  void PublishStats();
+  void CountEvent() {
+    if (ABSL_PREDICT_FALSE(++num_events >= kStatsBatchSize)) PublishStats();
+  }
+
+  size_t num_blocks = 0;
+  ChainBlock blocks[kMaxPooledBlocks];
+  uint64_t num_events = 0;
+  ScratchStats stats;
+};
+
+// Set when `scratch_cache` of this thread is destroyed, after which scratch is
+// not pooled and not counted. This is trivially destructible, so that it
+// remains usable by other thread-local destructors.
+thread_local bool scratch_cache_destroyed = false;
+thread_local ScratchCache scratch_cache;
+
+ScratchCache::~ScratchCache() {
+  PublishStats();
+  scratch_cache_destroyed = true;
+}
+
+void ScratchCache::PublishStats() {
+  GlobalScratchStats& global = global_scratch_stats();
+  global.fills.fetch_add(std::exchange(stats.fills, 0),
+                         std::memory_order_relaxed);
+  global.bytes.fetch_add(std::exchange(stats.bytes, 0),
+                         std::memory_order_relaxed);
+  global.pool_hits.fetch_add(std::exchange(stats.pool_hits, 0),
+                             std::memory_order_relaxed);
+  global.pool_misses.fetch_add(std::exchange(stats.pool_misses, 0),
+                               std::memory_order_relaxed);
+  num_events = 0;
+}
+
+}  // namespace
+
+ScratchStats GetScratchStats() {
+  const GlobalScratchStats& global = global_scratch_stats();
+  ScratchStats stats;
+  stats.fills = global.fills.load(std::memory_order_relaxed);
+  stats.bytes = global.bytes.load(std::memory_order_relaxed);
+  stats.pool_hits = global.pool_hits.load(std::memory_order_relaxed);
+  stats.pool_misses = global.pool_misses.load(std::memory_order_relaxed);
+  if (!scratch_cache_destroyed) {
+    stats.fills += scratch_cache.stats.fills;
+    stats.bytes += scratch_cache.stats.bytes;
+    stats.pool_hits += scratch_cache.stats.pool_hits;
+    stats.pool_misses += scratch_cache.stats.pool_misses;
+  }
+  return stats;
+}
+
+namespace internal {
+
+ChainBlock GetScratchBlock() {
+  if (ABSL_PREDICT_FALSE(scratch_cache_destroyed)) return ChainBlock();
+  ScratchCache& cache = scratch_cache;
+  if (cache.num_blocks == 0) {
+    ++cache.stats.pool_misses;
+    cache.CountEvent();
+    return ChainBlock();
+  }
+  --cache.num_blocks;
+  ++cache.stats.pool_hits;
+  cache.CountEvent();
+  return std::move(cache.blocks[cache.num_blocks]);
+}
+
+void PutScratchBlock(ChainBlock&& block) {
+  // `ChainBlock::Clear()` keeps the allocated space only if it is not shared.
+  block.Clear();
+  const size_t memory = block.EstimateMemory();
+  // `memory == sizeof(ChainBlock)` means that no space is allocated.
+  if (memory == sizeof(ChainBlock) || memory > kMaxPooledBlockMemory ||
+      ABSL_PREDICT_FALSE(scratch_cache_destroyed)) {
+    return;
+  }
+  ScratchCache& cache = scratch_cache;
+  if (cache.num_blocks == kMaxPooledBlocks) return;
+  cache.blocks[cache.num_blocks] = std::move(block);
+  ++cache.num_blocks;
+}
+
+void CountScratchFill(size_t length) {
+  if (ABSL_PREDICT_FALSE(scratch_cache_destroyed)) return;
+  ScratchCache& cache = scratch_cache;
+  ++cache.stats.fills;
+  cache.stats.bytes += length;
+  cache.CountEvent();
+}
+
+}  // namespace internal
+}  // namespace riegeli
@@ -0,0 +1,61 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_SCRATCH_POOL_H_
+#define RIEGELI_BYTES_SCRATCH_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "riegeli/base/chain.h"
+
+namespace riegeli {
+
+// Statistics of scratch buffers of `PullableReader`, `PushableWriter`, and
+// `PushableBackwardWriter`, accumulated over all threads since the program
+// started.
+//
+// Statistics of a running thread are published in batches, so they can lag
+// behind by a few hundred events per thread.
+struct ScratchStats {
+  // Number of times when data were passed through scratch.
+  uint64_t fills = 0;
+  // Total length of these data.
+  uint64_t bytes = 0;
+  // Number of scratch buffers taken from the pool of freed scratch buffers.
+  uint64_t pool_hits = 0;
+  // Number of scratch buffers created when the pool was empty.
+  uint64_t pool_misses = 0;
+};
+
+// Returns statistics of scratch buffers.
+ScratchStats GetScratchStats();
+
+namespace internal {
+
+// Returns an empty `ChainBlock` for scratch, with space allocated by a previous
+// scratch user of this thread if available.
+ChainBlock GetScratchBlock();
+
+// Returns `block` to the pool of freed scratch buffers of this thread if it is
+// not shared and not too large, otherwise frees it.
+void PutScratchBlock(ChainBlock&& block);
+
+// Records that `length` bytes were passed through scratch.
+void CountScratchFill(size_t length);
+
+}  // namespace internal
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_SCRATCH_POOL_H_
@@ -0,0 +1,143 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Make `syncfs()` available.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "riegeli/bytes/sync_scheduler.h"
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/errno_mapping.h"
+#include "riegeli/base/parallelism.h"
+
+namespace riegeli {
+
+namespace {
+
+absl::Status FdatasyncFd(int fd) {
+again:
+  if (ABSL_PREDICT_FALSE(fdatasync(fd) < 0)) {
+    if (errno == EINTR) goto again;
+    return ErrnoToCanonicalStatus(errno, "fdatasync() failed");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SyncfsFd(int fd) {
+again:
+  if (ABSL_PREDICT_FALSE(syncfs(fd) < 0)) {
+    if (errno == EINTR) goto again;
+    return ErrnoToCanonicalStatus(errno, "syncfs() failed");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+SyncScheduler::SyncScheduler(Options options) : options_(std::move(options)) {}
+
+SyncScheduler::~SyncScheduler() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(&idle_));
+}
+
+void SyncScheduler::SyncAsync(int fd, SyncCallback callback) {
+  {
+    absl::MutexLock lock(&mutex_);
+    pending_.push_back(Request{fd, std::move(callback)});
+    if (!idle_) return;
+    idle_ = false;
+  }
+  internal::ThreadPool::global().Schedule([this] { RunBatches(); });
+}
+
+std::future<absl::Status> SyncScheduler::SyncAsync(int fd) {
+  // `std::function` requires a copyable callback, hence `std::shared_ptr`.
+  const std::shared_ptr<std::promise<absl::Status>> promise =
+      std::make_shared<std::promise<absl::Status>>();
+  std::future<absl::Status> future = promise->get_future();
+  SyncAsync(fd, [promise](absl::Status status) {
+    promise->set_value(std::move(status));
+  });
+  return future;
+}
+
+absl::Status SyncScheduler::Sync(int fd) { return SyncAsync(fd).get(); }
+
+void SyncScheduler::RunBatches() {
+  std::vector<Request> requests;
+  for (;;) {
+    {
+      absl::MutexLock lock(&mutex_);
+      if (pending_.empty()) {
+        idle_ = true;
+        return;
+      }
+      requests.swap(pending_);
+    }
+    SyncBatch(options_.syncfs_threshold(), requests);
+    requests.clear();
+  }
+}
+
+void SyncScheduler::SyncBatch(size_t syncfs_threshold,
+                              std::vector<Request>& requests) {
+  // Results of distinct fds of the batch, and whether they have been synced.
+  absl::flat_hash_map<int, std::pair<absl::Status, bool>> results;
+  results.reserve(requests.size());
+  for (const Request& request : requests) {
+    results.emplace(request.fd, std::make_pair(absl::OkStatus(), false));
+  }
+  if (syncfs_threshold > 0 && results.size() >= syncfs_threshold) {
+    // Group fds by filesystem. Fds which cannot be examined are synced
+    // individually.
+    absl::flat_hash_map<dev_t, std::vector<int>> filesystems;
+    for (const auto& result : results) {
+      struct stat stat_info;
+      if (fstat(result.first, &stat_info) < 0) continue;
+      filesystems[stat_info.st_dev].push_back(result.first);
+    }
+    for (const auto& filesystem : filesystems) {
+      if (filesystem.second.size() < syncfs_threshold) continue;
+      const absl::Status status = SyncfsFd(filesystem.second.front());
+      for (const int fd : filesystem.second) {
+        results[fd] = std::make_pair(status, true);
+      }
+    }
+  }
+  for (auto& result : results) {
+    if (!result.second.second) result.second.first = FdatasyncFd(result.first);
+  }
+  for (Request& request : requests) {
+    request.callback(results.find(request.fd)->second.first);
+  }
+}
+
+}  // namespace riegeli
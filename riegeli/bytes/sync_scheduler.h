@@ -0,0 +1,111 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_BYTES_SYNC_SCHEDULER_H_
+#define RIEGELI_BYTES_SYNC_SCHEDULER_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+
+namespace riegeli {
+
+// Coalesces requests to make data of fds durable, coming from many
+// `FdWriter`s with `set_sync_scheduler()` in their options, into batches
+// performed in background.
+//
+// While a batch is being synced, further requests accumulate, and are synced
+// together as the next batch. Each fd is synced once per batch even if it was
+// requested several times. Filesystems with a journal commit concurrent
+// requests together, so this amortizes journal commits across files, instead
+// of serializing them.
+//
+// A request is completed when a sync covering it, started after the request,
+// has finished.
+class SyncScheduler {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // If a batch contains at least `syncfs_threshold()` distinct fds on the
+    // same filesystem, they are synced with a single `syncfs()` instead of
+    // `fdatasync()` of each fd. This commits the journal once for all of
+    // them, but also writes back unrelated dirty data of that filesystem.
+    //
+    // 0 disables `syncfs()`.
+    //
+    // Default: 0.
+    Options& set_syncfs_threshold(size_t syncfs_threshold) & {
+      syncfs_threshold_ = syncfs_threshold;
+      return *this;
+    }
+    Options&& set_syncfs_threshold(size_t syncfs_threshold) && {
+      return std::move(set_syncfs_threshold(syncfs_threshold));
+    }
+    size_t syncfs_threshold() const { return syncfs_threshold_; }
+
+   private:
+    size_t syncfs_threshold_ = 0;
+  };
+
+  // Called with the result of syncing an fd.
+  using SyncCallback = std::function<void(absl::Status)>;
+
+  explicit SyncScheduler(Options options = Options());
+
+  SyncScheduler(const SyncScheduler&) = delete;
+  SyncScheduler& operator=(const SyncScheduler&) = delete;
+
+  // Waits for pending requests to complete.
+  ~SyncScheduler();
+
+  // Schedules syncing data of `fd` with `fdatasync()` or `syncfs()`, and calls
+  // `callback` with the result from a background thread. `fd` must stay open
+  // until then.
+  void SyncAsync(int fd, SyncCallback callback);
+
+  // Like `SyncAsync()`, but returns a future instead of calling a callback.
+  std::future<absl::Status> SyncAsync(int fd);
+
+  // Like `SyncAsync()`, but waits for the result.
+  absl::Status Sync(int fd);
+
+ private:
+  struct Request {
+    int fd;
+    SyncCallback callback;
+  };
+
+  void RunBatches();
+  static void SyncBatch(size_t syncfs_threshold,
+                        std::vector<Request>& requests);
+
+  Options options_;
+  absl::Mutex mutex_;
+  std::vector<Request> pending_ ABSL_GUARDED_BY(mutex_);
+  // Whether no background task is running.
+  bool idle_ ABSL_GUARDED_BY(mutex_) = true;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_BYTES_SYNC_SCHEDULER_H_
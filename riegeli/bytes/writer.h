@@ -223,6 +223,15 @@ class Writer : public Object {
   //  * `false` (when `!healthy()`) - failure
   bool Truncate(Position new_size);
 
+  // Returns an estimate of memory owned by this `Writer` for buffering,
+  // excluding `sizeof(*this)` and memory of the destination.
+  //
+  // This is cheap enough to be called periodically, e.g. to enforce a memory
+  // budget across many open writers.
+  //
+  // The default implementation returns 0.
+  virtual size_t EstimateMemory() const { return 0; }
+
  protected:
   // Creates a `Writer` with the given initial state.
   explicit Writer(InitiallyClosed) noexcept : Object(kInitiallyClosed) {}
@@ -16,6 +16,7 @@
 
 #include <stddef.h>
 
+#include <cstring>
 #include <limits>
 
 #include "absl/base/optimization.h"
@@ -73,6 +74,17 @@ std::streamsize WriterStreambuf::xsputn(const char* src,
                                         std::streamsize length) {
   RIEGELI_ASSERT_GE(length, 0)
       << "Failed precondition of streambuf::xsputn(): negative length";
+  if (ABSL_PREDICT_TRUE(length <= epptr() - pptr())) {
+    // Fast path: the data fit in the put area, which is the buffer of
+    // `*dest_`, so there is no need to synchronize the position with `*dest_`.
+    if (ABSL_PREDICT_TRUE(
+            // `std::memcpy(nullptr, _, 0)` is undefined.
+            length > 0)) {
+      std::memcpy(pptr(), src, IntCast<size_t>(length));
+      setp(pptr() + length, epptr());
+    }
+    return length;
+  }
   if (ABSL_PREDICT_FALSE(!healthy())) return 0;
   BufferSync buffer_sync(this);
   const Position pos_before = dest_->pos();
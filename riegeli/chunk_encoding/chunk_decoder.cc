@@ -17,41 +17,111 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
+#include "absl/strings/cord.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/shared_buffer.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/chain_backward_writer.h"
 #include "riegeli/bytes/chain_reader.h"
 #include "riegeli/bytes/limiting_reader.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
 #include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/chunk_encoding/field_projection.h"
+#include "riegeli/chunk_encoding/hash.h"
+#include "riegeli/chunk_encoding/message_projector.h"
 #include "riegeli/chunk_encoding/simple_decoder.h"
 #include "riegeli/chunk_encoding/transpose_decoder.h"
+#include "riegeli/endian/endian_reading.h"
 #include "riegeli/messages/message_parse.h"
+#include "riegeli/varint/varint_reading.h"
+#include "riegeli/zstd/zstd_reader.h"
 
 namespace riegeli {
 
+namespace {
+
+// Reads the reference stored at the beginning of a `ChunkType::kPrefixed`
+// chunk: the size and the hash of records of the previous chunk, or size 0 if
+// the chunk does not depend on the previous chunk.
+bool ReadReference(Reader& src, uint64_t& reference_size,
+                   uint64_t& reference_hash) {
+  const absl::optional<uint64_t> size = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
+  reference_size = *size;
+  reference_hash = 0;
+  if (reference_size == 0) return true;
+  const absl::optional<uint64_t> hash = ReadLittleEndian64(src);
+  if (ABSL_PREDICT_FALSE(hash == absl::nullopt)) return false;
+  reference_hash = *hash;
+  return true;
+}
+
+}  // namespace
+
 void ChunkDecoder::Done() { recoverable_ = false; }
 
 bool ChunkDecoder::Decode(const Chunk& chunk) {
+  // Reuse the memory of values of the previous chunk for this chunk. Blocks
+  // still shared with records returned earlier are not reused.
+  Chain values = std::move(values_reader_.src());
   Clear();
-  ChainReader<> data_reader(&chunk.data);
+  values.Clear();
+  const absl::Time decode_start = absl::Now();
+  if (verify_data_hash_) {
+    const uint64_t computed_data_hash = internal::Hash(chunk.data);
+    if (ABSL_PREDICT_FALSE(computed_data_hash != chunk.header.data_hash())) {
+      return Fail(absl::InvalidArgumentError(absl::StrCat(
+          "Corrupted Riegeli/records file: chunk data hash mismatch "
+          "(computed 0x",
+          absl::Hex(computed_data_hash, absl::PadSpec::kZeroPad16),
+          ", stored 0x",
+          absl::Hex(chunk.header.data_hash(), absl::PadSpec::kZeroPad16),
+          ")")));
+    }
+  }
+  // Chunk data read from a file often consist of many small blocks, while
+  // headers and varints are read in small pieces.
+  ChainReader<> data_reader(
+      &chunk.data, ChainReaderBase::Options().set_merge_length(kMinBufferSize));
   if (ABSL_PREDICT_FALSE(chunk.header.num_records() > limits_.max_size())) {
     return Fail(absl::ResourceExhaustedError("Too many records"));
   }
-  Chain values;
+  if (chunk_filter_ != nullptr &&
+      chunk.header.chunk_type() == ChunkType::kTransposedV2 &&
+      chunk.header.num_records() > 0) {
+    ChunkStatistics statistics;
+    if (ABSL_PREDICT_FALSE(
+            !internal::ReadChunkStatistics(data_reader, statistics))) {
+      return Fail(absl::InvalidArgumentError(
+          "Invalid transposed chunk: invalid column statistics"));
+    }
+    // Records of a chunk rejected by the filter are skipped, leaving the
+    // decoder empty as after `Clear()`.
+    if (!statistics.empty() && !chunk_filter_(statistics)) return true;
+    if (!data_reader.Seek(0)) {
+      RIEGELI_ASSERT_UNREACHABLE()
+          << "Seeking chunk data failed: " << data_reader.status();
+    }
+  }
   if (ABSL_PREDICT_FALSE(!Parse(chunk.header, data_reader, values))) {
     limits_.clear();  // Ensure that `index() == num_records()`.
+    stats_ = ChunkStats();
     return false;
   }
   RIEGELI_ASSERT_EQ(limits_.size(), chunk.header.num_records())
@@ -67,10 +137,41 @@ bool ChunkDecoder::Decode(const Chunk& chunk) {
     RIEGELI_ASSERT_LE(values.size(), chunk.header.decoded_data_size())
         << "Wrong decoded data size";
   }
+  if (contiguous_records_ && values.TryFlat() == absl::nullopt) {
+    // Large flat buffers are recycled through a pool when the last record
+    // sharing them is released, even by another thread.
+    SharedBuffer flat(values.size());
+    values.CopyTo(flat.mutable_data());
+    const absl::string_view data(flat.const_data(), values.size());
+    values = Chain::FromExternal(std::move(flat), data);
+  }
   values_reader_.Reset(std::move(values));
+  if (chunk.header.num_records() == 0) {
+    stats_ = ChunkStats();
+  } else {
+    stats_.num_chunks = 1;
+    stats_.num_records = chunk.header.num_records();
+    stats_.decoded_data_size = chunk.header.decoded_data_size();
+    stats_.encoded_data_size = chunk.data.size();
+    stats_.decode_time = absl::Now() - decode_start;
+  }
   return true;
 }
 
+bool ChunkDecoder::NeedsReference(const Chunk& chunk) const {
+  if (chunk.header.chunk_type() != ChunkType::kPrefixed) return false;
+  ChainReader<> data_reader(&chunk.data);
+  uint64_t reference_size;
+  uint64_t reference_hash;
+  // An invalid reference is reported by `Decode()`.
+  if (ABSL_PREDICT_FALSE(
+          !ReadReference(data_reader, reference_size, reference_hash))) {
+    return false;
+  }
+  return reference_size > 0 && (reference_.size() != reference_size ||
+                                reference_hash_ != reference_hash);
+}
+
 inline bool ChunkDecoder::Parse(const ChunkHeader& header, Reader& src,
                                 Chain& dest) {
   switch (header.chunk_type()) {
@@ -85,11 +186,8 @@ inline bool ChunkDecoder::Parse(const ChunkHeader& header, Reader& src,
             "Invalid file signature chunk: number of records is not zero: ",
             header.num_records())));
       }
-      if (ABSL_PREDICT_FALSE(header.decoded_data_size() != 0)) {
-        return Fail(absl::InvalidArgumentError(absl::StrCat(
-            "Invalid file signature chunk: decoded data size is not zero: ",
-            header.decoded_data_size())));
-      }
+      // `header.decoded_data_size()` declares the block size of the file. It
+      // is verified by `DefaultChunkReader`, which depends on it.
       return true;
     case ChunkType::kFileMetadata:
       if (ABSL_PREDICT_FALSE(header.num_records() != 0)) {
@@ -98,6 +196,13 @@ inline bool ChunkDecoder::Parse(const ChunkHeader& header, Reader& src,
             header.num_records())));
       }
       return true;
+    case ChunkType::kIndex:
+      if (ABSL_PREDICT_FALSE(header.num_records() != 0)) {
+        return Fail(absl::InvalidArgumentError(absl::StrCat(
+            "Invalid index chunk: number of records is not zero: ",
+            header.num_records())));
+      }
+      return true;
     case ChunkType::kPadding:
       if (ABSL_PREDICT_FALSE(header.num_records() != 0)) {
         return Fail(absl::InvalidArgumentError(absl::StrCat(
@@ -110,35 +215,68 @@ inline bool ChunkDecoder::Parse(const ChunkHeader& header, Reader& src,
             header.decoded_data_size())));
       }
       return true;
-    case ChunkType::kSimple: {
-      SimpleDecoder simple_decoder;
-      if (ABSL_PREDICT_FALSE(!simple_decoder.Decode(&src, header.num_records(),
-                                                    header.decoded_data_size(),
-                                                    limits_))) {
-        return Fail(simple_decoder);
+    case ChunkType::kSimple:
+    case ChunkType::kDeduplicated:
+      if (ABSL_PREDICT_FALSE(
+              !ParseSimple(header, src, zstd_dictionary_, dest))) {
+        return false;
+      }
+      if (project_simple_chunks_ && !field_projection_.includes_all()) {
+        ProjectSimpleRecords(dest);
       }
-      if (ABSL_PREDICT_FALSE(!simple_decoder.reader().Read(
-              IntCast<size_t>(header.decoded_data_size()), dest))) {
-        simple_decoder.reader().Fail(
-            absl::InvalidArgumentError("Reading record values failed"));
-        return Fail(simple_decoder.reader());
+      return true;
+    case ChunkType::kPrefixed: {
+      uint64_t reference_size;
+      uint64_t reference_hash;
+      if (ABSL_PREDICT_FALSE(
+              !ReadReference(src, reference_size, reference_hash))) {
+        src.Fail(absl::InvalidArgumentError("Reading chunk reference failed"));
+        return Fail(src);
       }
-      if (ABSL_PREDICT_FALSE(!simple_decoder.VerifyEndAndClose())) {
-        return Fail(simple_decoder);
+      {
+        ZstdReaderBase::Dictionary zstd_dictionary = zstd_dictionary_;
+        if (reference_size > 0) {
+          if (ABSL_PREDICT_FALSE(reference_.size() != reference_size ||
+                                 reference_hash_ != reference_hash)) {
+            return Fail(absl::FailedPreconditionError(
+                "Decoding a prefixed chunk requires decoding the previous "
+                "chunk first"));
+          }
+          zstd_dictionary =
+              ZstdReaderBase::Dictionary()
+                  .set_content_type(ZstdReaderBase::ContentType::kRaw)
+                  .set_data_unowned(reference_.Flatten());
+        }
+        if (ABSL_PREDICT_FALSE(
+                !ParseSimple(header, src, zstd_dictionary, dest))) {
+          return false;
+        }
+      }
+      reference_ = dest;
+      reference_hash_ = internal::Hash(reference_);
+      if (project_simple_chunks_ && !field_projection_.includes_all()) {
+        ProjectSimpleRecords(dest);
       }
-      if (ABSL_PREDICT_FALSE(!src.VerifyEndAndClose())) return Fail(src);
       return true;
     }
-    case ChunkType::kTransposed: {
-      TransposeDecoder transpose_decoder;
+    case ChunkType::kTransposed:
+    case ChunkType::kTransposedV2: {
+      if (transpose_decoder_ == nullptr) {
+        transpose_decoder_ = std::make_unique<TransposeDecoder>();
+      }
+      TransposeDecoder& transpose_decoder = *transpose_decoder_;
       ChainBackwardWriter<> dest_writer(
           &dest, ChainBackwardWriterBase::Options().set_size_hint(
                      field_projection_.includes_all()
                          ? absl::make_optional(header.decoded_data_size())
                          : absl::nullopt));
       const bool ok = transpose_decoder.Decode(
-          header.num_records(), header.decoded_data_size(), field_projection_,
-          src, dest_writer, limits_);
+          header.chunk_type(), header.num_records(), header.decoded_data_size(),
+          field_projection_, zstd_dictionary_, brotli_dictionary_, src,
+          dest_writer, limits_, executor_.get());
+      buckets_decompressed_ = transpose_decoder.buckets_decompressed();
+      bytes_skipped_ = transpose_decoder.bytes_skipped();
+      stats_.decompress_time = transpose_decoder.decompress_time();
       if (ABSL_PREDICT_FALSE(!dest_writer.Close())) return Fail(dest_writer);
       if (ABSL_PREDICT_FALSE(!ok)) return Fail(transpose_decoder);
       if (ABSL_PREDICT_FALSE(!src.VerifyEndAndClose())) return Fail(src);
@@ -153,6 +291,47 @@ inline bool ChunkDecoder::Parse(const ChunkHeader& header, Reader& src,
       "Unknown chunk type: ", static_cast<uint64_t>(header.chunk_type()))));
 }
 
+inline bool ChunkDecoder::ParseSimple(
+    const ChunkHeader& header, Reader& src,
+    const ZstdReaderBase::Dictionary& zstd_dictionary, Chain& dest) {
+  // Decoding a simple chunk consists of decompressing it.
+  const absl::Time decompress_start = absl::Now();
+  if (simple_decoder_ == nullptr) {
+    simple_decoder_ = std::make_unique<SimpleDecoder>();
+  }
+  SimpleDecoder& simple_decoder = *simple_decoder_;
+  if (ABSL_PREDICT_FALSE(!simple_decoder.Decode(
+          header.chunk_type(), &src, header.num_records(),
+          header.decoded_data_size(), zstd_dictionary, brotli_dictionary_,
+          limits_))) {
+    return Fail(simple_decoder);
+  }
+  if (ABSL_PREDICT_FALSE(!simple_decoder.ReadRecordValues(limits_, dest))) {
+    return Fail(simple_decoder);
+  }
+  if (ABSL_PREDICT_FALSE(!simple_decoder.VerifyEndAndClose())) {
+    return Fail(simple_decoder);
+  }
+  if (ABSL_PREDICT_FALSE(!src.VerifyEndAndClose())) return Fail(src);
+  stats_.decompress_time = absl::Now() - decompress_start;
+  return true;
+}
+
+void ChunkDecoder::ProjectSimpleRecords(Chain& values) {
+  if (limits_.empty()) return;
+  const internal::MessageProjector projector(field_projection_);
+  const absl::string_view flat = values.Flatten();
+  std::string projected;
+  projected.reserve(flat.size());
+  size_t start = 0;
+  for (size_t& limit : limits_) {
+    projector.Project(flat.substr(start, limit - start), projected);
+    start = limit;
+    limit = projected.size();
+  }
+  values = Chain(std::move(projected));
+}
+
 bool ChunkDecoder::ReadRecord(google::protobuf::MessageLite& record) {
   if (ABSL_PREDICT_FALSE(!healthy() || index() == num_records())) return false;
   const size_t start = IntCast<size_t>(values_reader_.pos());
@@ -160,8 +339,17 @@ bool ChunkDecoder::ReadRecord(google::protobuf::MessageLite& record) {
   RIEGELI_ASSERT_LE(start, limit)
       << "Failed invariant of ChunkDecoder: record end positions not sorted";
   {
-    absl::Status status =
-        ParseFromReader(LimitingReader<>(&values_reader_, limit), record);
+    absl::Status status;
+    if (values_reader_.available() >= limit - start) {
+      // The record is flat in the decoded chunk. Parse it in place, which is
+      // faster than parsing through a `LimitingReader`, whatever the size.
+      status = ParseFromString(
+          absl::string_view(values_reader_.cursor(), limit - start), record);
+      values_reader_.move_cursor(limit - start);
+    } else {
+      status =
+          ParseFromReader(LimitingReader<>(&values_reader_, limit), record);
+    }
     if (ABSL_PREDICT_FALSE(!status.ok())) {
       if (!values_reader_.Seek(limit)) {
         RIEGELI_ASSERT_UNREACHABLE()
@@ -175,6 +363,74 @@ bool ChunkDecoder::ReadRecord(google::protobuf::MessageLite& record) {
   return true;
 }
 
+bool ChunkDecoder::ReadRecords(size_t max_records,
+                               std::vector<absl::string_view>& records) {
+  RIEGELI_ASSERT_GT(max_records, 0u)
+      << "Failed precondition of ChunkDecoder::ReadRecords(): "
+         "no records requested";
+  records.clear();
+  noncontiguous_records_.clear();
+  if (ABSL_PREDICT_FALSE(!healthy() || index() == num_records())) return false;
+  const size_t num_records_to_read =
+      UnsignedMin(max_records, IntCast<size_t>(num_records() - index()));
+  records.reserve(num_records_to_read);
+  for (size_t i = 0; i < num_records_to_read; ++i) {
+    const size_t start = IntCast<size_t>(values_reader_.pos());
+    const size_t limit = limits_[IntCast<size_t>(index_)];
+    RIEGELI_ASSERT_LE(start, limit)
+        << "Failed invariant of ChunkDecoder: record end positions not sorted";
+    const size_t length = limit - start;
+    if (values_reader_.available() == 0 && length > 0) {
+      // Move to the next block of values without using a scratch buffer.
+      values_reader_.Pull();
+    }
+    if (ABSL_PREDICT_TRUE(values_reader_.available() >= length)) {
+      records.emplace_back(values_reader_.cursor(), length);
+      values_reader_.move_cursor(length);
+    } else {
+      noncontiguous_records_.emplace_back();
+      if (!values_reader_.Read(length, noncontiguous_records_.back())) {
+        RIEGELI_ASSERT_UNREACHABLE()
+            << "Failed reading record from values reader: "
+            << values_reader_.status();
+      }
+      records.emplace_back(noncontiguous_records_.back());
+    }
+    ++index_;
+  }
+  return true;
+}
+
+bool ChunkDecoder::ReadRecords(size_t max_records,
+                               std::vector<Chain>& records) {
+  return ReadRecordsImpl(max_records, records);
+}
+
+bool ChunkDecoder::ReadRecords(size_t max_records,
+                               std::vector<absl::Cord>& records) {
+  return ReadRecordsImpl(max_records, records);
+}
+
+template <typename Record>
+inline bool ChunkDecoder::ReadRecordsImpl(size_t max_records,
+                                          std::vector<Record>& records) {
+  RIEGELI_ASSERT_GT(max_records, 0u)
+      << "Failed precondition of ChunkDecoder::ReadRecords(): "
+         "no records requested";
+  records.clear();
+  if (ABSL_PREDICT_FALSE(!healthy() || index() == num_records())) return false;
+  const size_t num_records_to_read =
+      UnsignedMin(max_records, IntCast<size_t>(num_records() - index()));
+  records.resize(num_records_to_read);
+  for (Record& record : records) {
+    if (!ReadRecord(record)) {
+      RIEGELI_ASSERT_UNREACHABLE()
+          << "Failed reading record from ChunkDecoder: " << status();
+    }
+  }
+  return true;
+}
+
 bool ChunkDecoder::Recover() {
   if (!recoverable_) return false;
   RIEGELI_ASSERT(!healthy()) << "Failed invariant of ChunkDecoder: "
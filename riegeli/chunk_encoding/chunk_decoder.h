@@ -18,6 +18,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <deque>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -30,11 +32,18 @@
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/base/object.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/chain_reader.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
 #include "riegeli/chunk_encoding/field_projection.h"
+#include "riegeli/chunk_encoding/simple_decoder.h"
+#include "riegeli/chunk_encoding/transpose_decoder.h"
+#include "riegeli/zstd/zstd_reader.h"
 
 namespace riegeli {
 
@@ -68,8 +77,160 @@ class ChunkDecoder : public Object {
       return field_projection_;
     }
 
+    // If `true` and `field_projection()` does not include all fields, records
+    // of simple chunks are projected too, by scanning their wire format and
+    // dropping fields which are not included. Records which are not valid
+    // proto messages are left unchanged.
+    //
+    // This costs a pass over records of the chunk, which pays off if much of
+    // the data is excluded, or if records are parsed afterwards anyway.
+    //
+    // If `false`, `field_projection()` applies only to transposed chunks.
+    //
+    // Default: `false`.
+    Options& set_project_simple_chunks(bool project_simple_chunks) & {
+      project_simple_chunks_ = project_simple_chunks;
+      return *this;
+    }
+    Options&& set_project_simple_chunks(bool project_simple_chunks) && {
+      return std::move(set_project_simple_chunks(project_simple_chunks));
+    }
+    bool project_simple_chunks() const { return project_simple_chunks_; }
+
+    // If not `nullptr`, called with column statistics of a transposed chunk
+    // which stores them. If it returns `false`, the chunk is not decompressed,
+    // and it is decoded as if it contained no records.
+    //
+    // Chunks without column statistics are decoded normally.
+    //
+    // Default: `nullptr`.
+    Options& set_chunk_filter(ChunkFilter chunk_filter) & {
+      chunk_filter_ = std::move(chunk_filter);
+      return *this;
+    }
+    Options&& set_chunk_filter(ChunkFilter chunk_filter) && {
+      return std::move(set_chunk_filter(std::move(chunk_filter)));
+    }
+    ChunkFilter& chunk_filter() { return chunk_filter_; }
+    const ChunkFilter& chunk_filter() const { return chunk_filter_; }
+
+    // If `true`, decoded records of a chunk are stored in a single flat
+    // buffer, copying them there once per chunk if needed. Then
+    // `ReadRecord(absl::string_view&)` never copies a record, and
+    // `ReadRecord(absl::Cord&)` and `ReadRecord(Chain&)` share chunk memory
+    // instead of copying records which are not small.
+    //
+    // The flat buffer is a `SharedBuffer`, so large buffers are recycled
+    // when the decoder and all records sharing the buffer are gone.
+    //
+    // If `false`, decoded records are stored in the `Chain` produced by
+    // decoding, and reading a record which happens to be split between blocks
+    // of the `Chain` copies it.
+    //
+    // Default: `false`.
+    Options& set_contiguous_records(bool contiguous_records) & {
+      contiguous_records_ = contiguous_records;
+      return *this;
+    }
+    Options&& set_contiguous_records(bool contiguous_records) && {
+      return std::move(set_contiguous_records(contiguous_records));
+    }
+    bool contiguous_records() const { return contiguous_records_; }
+
+    // If `true`, `Decode()` verifies the hash of chunk data stored in the chunk
+    // header before decoding, and fails on a mismatch.
+    //
+    // This is useful when the chunk was read with
+    // `DefaultChunkReaderBase::ReadChunkUnverified()`, so that hashing can be
+    // performed together with decoding, e.g. in a background thread.
+    //
+    // Default: `false`.
+    Options& set_verify_data_hash(bool verify_data_hash) & {
+      verify_data_hash_ = verify_data_hash;
+      return *this;
+    }
+    Options&& set_verify_data_hash(bool verify_data_hash) && {
+      return std::move(set_verify_data_hash(verify_data_hash));
+    }
+    bool verify_data_hash() const { return verify_data_hash_; }
+
+    // Zstd dictionary used for decompressing chunks. It must be the dictionary
+    // used for compression, if any.
+    //
+    // Default: `ZstdReaderBase::Dictionary()` (no dictionary).
+    Options& set_zstd_dictionary(
+        const ZstdReaderBase::Dictionary& zstd_dictionary) & {
+      zstd_dictionary_ = zstd_dictionary;
+      return *this;
+    }
+    Options& set_zstd_dictionary(
+        ZstdReaderBase::Dictionary&& zstd_dictionary) & {
+      zstd_dictionary_ = std::move(zstd_dictionary);
+      return *this;
+    }
+    Options&& set_zstd_dictionary(
+        const ZstdReaderBase::Dictionary& zstd_dictionary) && {
+      return std::move(set_zstd_dictionary(zstd_dictionary));
+    }
+    Options&& set_zstd_dictionary(
+        ZstdReaderBase::Dictionary&& zstd_dictionary) && {
+      return std::move(set_zstd_dictionary(std::move(zstd_dictionary)));
+    }
+    ZstdReaderBase::Dictionary& zstd_dictionary() { return zstd_dictionary_; }
+    const ZstdReaderBase::Dictionary& zstd_dictionary() const {
+      return zstd_dictionary_;
+    }
+
+    // Brotli dictionary used for decompressing chunks. It must be the
+    // dictionary used for compression, if any.
+    //
+    // Default: `BrotliDictionary()` (no dictionary).
+    Options& set_brotli_dictionary(
+        const BrotliDictionary& brotli_dictionary) & {
+      brotli_dictionary_ = brotli_dictionary;
+      return *this;
+    }
+    Options& set_brotli_dictionary(BrotliDictionary&& brotli_dictionary) & {
+      brotli_dictionary_ = std::move(brotli_dictionary);
+      return *this;
+    }
+    Options&& set_brotli_dictionary(
+        const BrotliDictionary& brotli_dictionary) && {
+      return std::move(set_brotli_dictionary(brotli_dictionary));
+    }
+    Options&& set_brotli_dictionary(BrotliDictionary&& brotli_dictionary) && {
+      return std::move(set_brotli_dictionary(std::move(brotli_dictionary)));
+    }
+    BrotliDictionary& brotli_dictionary() { return brotli_dictionary_; }
+    const BrotliDictionary& brotli_dictionary() const {
+      return brotli_dictionary_;
+    }
+
+    // If not `nullptr`, data buckets of a transposed chunk are decompressed
+    // concurrently in this `Executor`, which reduces latency of decoding a
+    // chunk with many buckets. This applies if `field_projection()` includes
+    // all fields.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
    private:
     FieldProjection field_projection_ = FieldProjection::All();
+    bool project_simple_chunks_ = false;
+    ChunkFilter chunk_filter_;
+    bool contiguous_records_ = false;
+    bool verify_data_hash_ = false;
+    ZstdReaderBase::Dictionary zstd_dictionary_;
+    BrotliDictionary brotli_dictionary_;
+    std::shared_ptr<Executor> executor_;
   };
 
   // Creates an empty `ChunkDecoder`.
@@ -82,7 +243,8 @@ class ChunkDecoder : public Object {
   // constructing a temporary `ChunkDecoder` and moving from it.
   void Reset(Options options = Options());
 
-  // Resets the `ChunkDecoder` to an empty chunk. Keeps options unchanged.
+  // Resets the `ChunkDecoder` to an empty chunk. Keeps options unchanged, and
+  // keeps the reference for decoding a `ChunkType::kPrefixed` chunk.
   void Clear();
 
   // Resets the `ChunkDecoder` and parses the chunk. Keeps options unchanged.
@@ -92,6 +254,13 @@ class ChunkDecoder : public Object {
   //  * `false` - failure (`!healthy()`)
   bool Decode(const Chunk& chunk);
 
+  // Returns `true` if `chunk` is a `ChunkType::kPrefixed` chunk compressed
+  // with records of the previous chunk as a reference, and the reference is
+  // not available, i.e. the previous chunk was not the last
+  // `ChunkType::kPrefixed` chunk decoded by this `ChunkDecoder`. Then the
+  // previous chunk must be decoded first, otherwise `Decode(chunk)` fails.
+  bool NeedsReference(const Chunk& chunk) const;
+
   // Reads the next record.
   //
   // `ReadRecord(google::protobuf::MessageLite&)` parses raw bytes to a proto
@@ -110,6 +279,25 @@ class ChunkDecoder : public Object {
   bool ReadRecord(Chain& record);
   bool ReadRecord(absl::Cord& record);
 
+  // Reads up to `max_records` next records, replacing the contents of
+  // `records`. This is faster than calling `ReadRecord()` repeatedly.
+  //
+  // For `ReadRecords(size_t, std::vector<absl::string_view>&)` the
+  // `absl::string_view`s are valid until the next non-const operation on this
+  // `ChunkDecoder`. They point to decoded chunk data, except for records which
+  // are not contiguous there, which are copied.
+  //
+  // Precondition: `max_records > 0`
+  //
+  // Return values:
+  //  * `true`                      - success (`records` is not empty,
+  //                                  `healthy()`)
+  //  * `false` (when `healthy()`)  - chunk ends (`records` is empty)
+  //  * `false` (when `!healthy()`) - failure (`records` is empty)
+  bool ReadRecords(size_t max_records, std::vector<absl::string_view>& records);
+  bool ReadRecords(size_t max_records, std::vector<Chain>& records);
+  bool ReadRecords(size_t max_records, std::vector<absl::Cord>& records);
+
   // If `!healthy()` and the failure was caused by an unparsable message, then
   // `Recover()` allows reading again by skipping the unparsable message.
   //
@@ -134,25 +322,85 @@ class ChunkDecoder : public Object {
   // Returns the number of records. Unchanged by `Close()`.
   uint64_t num_records() const { return IntCast<uint64_t>(limits_.size()); }
 
+  // Returns the total size of records. Unchanged by `Close()`.
+  size_t records_size() const { return limits_.empty() ? 0 : limits_.back(); }
+
+  // Returns the number of data buckets of a transposed chunk which were
+  // decompressed when decoding the current chunk. Unchanged by `Close()`.
+  //
+  // With field projection, only buckets containing included fields are
+  // decompressed. Together with `bytes_skipped()` this helps to tune
+  // `RecordWriterBase::Options::set_bucket_fraction()`.
+  uint64_t buckets_decompressed() const { return buckets_decompressed_; }
+
+  // Returns the total compressed size of data buckets of a transposed chunk
+  // which were not decompressed when decoding the current chunk because of
+  // field projection. Unchanged by `Close()`.
+  uint64_t bytes_skipped() const { return bytes_skipped_; }
+
+  // Returns sizes and timings of decoding the current chunk. They are zero if
+  // the chunk contains no records or decoding failed. Unchanged by `Close()`.
+  const ChunkStats& stats() const { return stats_; }
+
+  // Returns an estimate of memory used by the decoded chunk, excluding
+  // `sizeof(*this)`. This does not traverse the data, so it is cheap enough to
+  // be called periodically.
+  size_t EstimateMemory() const {
+    return records_size() + limits_.capacity() * sizeof(size_t) +
+           reference_.size();
+  }
+
  protected:
   void Done() override;
 
  private:
   bool Parse(const ChunkHeader& header, Reader& src, Chain& dest);
+  // Implements `Parse()` for simple chunks, except for projection.
+  bool ParseSimple(const ChunkHeader& header, Reader& src,
+                   const ZstdReaderBase::Dictionary& zstd_dictionary,
+                   Chain& dest);
+  // Applies `field_projection_` to records of a simple chunk stored in
+  // `values`, adjusting `limits_`.
+  void ProjectSimpleRecords(Chain& values);
+
+  template <typename Record>
+  bool ReadRecordsImpl(size_t max_records, std::vector<Record>& records);
 
   FieldProjection field_projection_;
+  bool project_simple_chunks_ = false;
+  ChunkFilter chunk_filter_;
+  bool contiguous_records_ = false;
+  bool verify_data_hash_ = false;
+  ZstdReaderBase::Dictionary zstd_dictionary_;
+  BrotliDictionary brotli_dictionary_;
+  std::shared_ptr<Executor> executor_;
   // Invariants if `healthy()`:
   //   `limits_` are sorted
   //   `(limits_.empty() ? 0 : limits_.back())` == size of `values_reader_`
   //   `(index_ == 0 ? 0 : limits_[index_ - 1]) == values_reader_.pos()`
   std::vector<size_t> limits_;
   ChainReader<Chain> values_reader_;
+  // Copies of records returned by `ReadRecords()` as `absl::string_view` which
+  // are not contiguous in `values_reader_`. `std::deque` keeps their addresses
+  // stable while more records are added.
+  std::deque<std::string> noncontiguous_records_;
   // Invariant: if `healthy()` then `index_ <= num_records()`
   uint64_t index_ = 0;
   // Whether `Recover()` is applicable.
   //
   // Invariant: if `recoverable_` then `!healthy()`
   bool recoverable_ = false;
+  uint64_t buckets_decompressed_ = 0;
+  uint64_t bytes_skipped_ = 0;
+  ChunkStats stats_;
+  // Decoders kept between chunks, so that decoding a sequence of chunks reuses
+  // their memory. Created when first needed.
+  std::unique_ptr<SimpleDecoder> simple_decoder_;
+  std::unique_ptr<TransposeDecoder> transpose_decoder_;
+  // Records of the last decoded `ChunkType::kPrefixed` chunk, before
+  // projection, which can be the reference of the next chunk, and their hash.
+  Chain reference_;
+  uint64_t reference_hash_ = 0;
 };
 
 // Implementation details follow.
@@ -160,6 +408,13 @@ class ChunkDecoder : public Object {
 inline ChunkDecoder::ChunkDecoder(Options options)
     : Object(kInitiallyOpen),
       field_projection_(std::move(options.field_projection())),
+      project_simple_chunks_(options.project_simple_chunks()),
+      chunk_filter_(std::move(options.chunk_filter())),
+      contiguous_records_(options.contiguous_records()),
+      verify_data_hash_(options.verify_data_hash()),
+      zstd_dictionary_(std::move(options.zstd_dictionary())),
+      brotli_dictionary_(std::move(options.brotli_dictionary())),
+      executor_(std::move(options.executor())),
       values_reader_(std::forward_as_tuple()) {}
 
 inline ChunkDecoder::ChunkDecoder(ChunkDecoder&& that) noexcept
@@ -167,34 +422,77 @@ inline ChunkDecoder::ChunkDecoder(ChunkDecoder&& that) noexcept
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
       field_projection_(std::move(that.field_projection_)),
+      project_simple_chunks_(that.project_simple_chunks_),
+      chunk_filter_(std::move(that.chunk_filter_)),
+      contiguous_records_(that.contiguous_records_),
+      verify_data_hash_(that.verify_data_hash_),
+      zstd_dictionary_(std::move(that.zstd_dictionary_)),
+      brotli_dictionary_(std::move(that.brotli_dictionary_)),
+      executor_(std::move(that.executor_)),
       limits_(std::move(that.limits_)),
       values_reader_(std::move(that.values_reader_)),
+      noncontiguous_records_(std::move(that.noncontiguous_records_)),
       index_(that.index_),
-      recoverable_(std::exchange(that.recoverable_, false)) {}
+      recoverable_(std::exchange(that.recoverable_, false)),
+      buckets_decompressed_(that.buckets_decompressed_),
+      bytes_skipped_(that.bytes_skipped_),
+      stats_(that.stats_),
+      simple_decoder_(std::move(that.simple_decoder_)),
+      transpose_decoder_(std::move(that.transpose_decoder_)),
+      reference_(std::move(that.reference_)),
+      reference_hash_(that.reference_hash_) {}
 
 inline ChunkDecoder& ChunkDecoder::operator=(ChunkDecoder&& that) noexcept {
   Object::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   field_projection_ = std::move(that.field_projection_);
+  project_simple_chunks_ = that.project_simple_chunks_;
+  chunk_filter_ = std::move(that.chunk_filter_);
+  contiguous_records_ = that.contiguous_records_;
+  verify_data_hash_ = that.verify_data_hash_;
+  zstd_dictionary_ = std::move(that.zstd_dictionary_);
+  brotli_dictionary_ = std::move(that.brotli_dictionary_);
+  executor_ = std::move(that.executor_);
   limits_ = std::move(that.limits_);
   values_reader_ = std::move(that.values_reader_);
+  noncontiguous_records_ = std::move(that.noncontiguous_records_);
   index_ = that.index_;
   recoverable_ = std::exchange(that.recoverable_, false);
+  buckets_decompressed_ = that.buckets_decompressed_;
+  bytes_skipped_ = that.bytes_skipped_;
+  stats_ = that.stats_;
+  simple_decoder_ = std::move(that.simple_decoder_);
+  transpose_decoder_ = std::move(that.transpose_decoder_);
+  reference_ = std::move(that.reference_);
+  reference_hash_ = that.reference_hash_;
   return *this;
 }
 
 inline void ChunkDecoder::Reset(Options options) {
   field_projection_ = std::move(options.field_projection());
+  project_simple_chunks_ = options.project_simple_chunks();
+  chunk_filter_ = std::move(options.chunk_filter());
+  contiguous_records_ = options.contiguous_records();
+  verify_data_hash_ = options.verify_data_hash();
+  zstd_dictionary_ = std::move(options.zstd_dictionary());
+  brotli_dictionary_ = std::move(options.brotli_dictionary());
+  executor_ = std::move(options.executor());
   Clear();
+  reference_ = Chain();
+  reference_hash_ = 0;
 }
 
 inline void ChunkDecoder::Clear() {
   Object::Reset(kInitiallyOpen);
   limits_.clear();
   values_reader_.Reset(std::forward_as_tuple());
+  noncontiguous_records_.clear();
   index_ = 0;
   recoverable_ = false;
+  buckets_decompressed_ = 0;
+  bytes_skipped_ = 0;
+  stats_ = ChunkStats();
 }
 
 inline bool ChunkDecoder::ReadRecord(absl::string_view& record) {
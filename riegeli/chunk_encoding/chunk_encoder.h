@@ -31,6 +31,7 @@
 #include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
 #include "riegeli/bytes/writer.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
 #include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/messages/message_serialize.h"
 
@@ -89,6 +90,15 @@ class ChunkEncoder : public Object {
   // Returns the sum of record sizes added so far.
   uint64_t decoded_data_size() const { return decoded_data_size_; }
 
+  // Returns an estimate of memory used by records added so far, excluding
+  // `sizeof(*this)`. This does not traverse the data, so it is cheap enough to
+  // be called periodically.
+  //
+  // The default implementation returns `decoded_data_size()`.
+  virtual size_t EstimateMemory() const {
+    return SaturatingIntCast<size_t>(decoded_data_size_);
+  }
+
   // Encodes the chunk to `dest`, setting `chunk_type`, `num_records`, and
   // `decoded_data_size`. Closes the `ChunkEncoder`.
   //
@@ -100,11 +110,16 @@ class ChunkEncoder : public Object {
                               uint64_t& num_records,
                               uint64_t& decoded_data_size) = 0;
 
+  // Returns sizes and timings of encoding the chunk. They are filled by
+  // `EncodeAndClose()` and are unchanged by `Close()`.
+  const ChunkStats& stats() const { return stats_; }
+
  protected:
   void Done() override;
 
   uint64_t num_records_ = 0;
   uint64_t decoded_data_size_ = 0;
+  ChunkStats stats_;
 };
 
 // Implementation details follow.
@@ -113,6 +128,7 @@ inline void ChunkEncoder::Clear() {
   Object::Reset(kInitiallyOpen);
   num_records_ = 0;
   decoded_data_size_ = 0;
+  stats_ = ChunkStats();
 }
 
 inline bool ChunkEncoder::AddRecord(
@@ -0,0 +1,295 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/chunk_encoding/chunk_recompression.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
+#include "riegeli/chunk_encoding/compressor.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/chunk_encoding/decompressor.h"
+#include "riegeli/varint/varint_reading.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+
+namespace {
+
+// Decompresses `data` compressed with `compression_type`, and replaces it with
+// data compressed with `compressor_options`.
+absl::Status RecompressStream(CompressionType compression_type,
+                              const CompressorOptions& compressor_options,
+                              Chain& data) {
+  Chain decompressed;
+  {
+    internal::Decompressor<ChainReader<>> decompressor(
+        std::forward_as_tuple(&data), compression_type);
+    if (ABSL_PREDICT_FALSE(!decompressor.healthy())) {
+      return decompressor.status();
+    }
+    if (ABSL_PREDICT_FALSE(!decompressor.reader().ReadAll(decompressed))) {
+      return decompressor.reader().status();
+    }
+    if (ABSL_PREDICT_FALSE(!decompressor.VerifyEndAndClose())) {
+      return decompressor.status();
+    }
+  }
+  internal::Compressor compressor(
+      compressor_options,
+      internal::Compressor::TuningOptions().set_pledged_size(
+          decompressed.size()));
+  if (ABSL_PREDICT_FALSE(!compressor.writer().Write(std::move(decompressed)))) {
+    return compressor.writer().status();
+  }
+  data.Clear();
+  ChainWriter<> data_writer(&data);
+  if (ABSL_PREDICT_FALSE(!compressor.EncodeAndClose(data_writer))) {
+    return compressor.status();
+  }
+  if (ABSL_PREDICT_FALSE(!data_writer.Close())) return data_writer.status();
+  return absl::OkStatus();
+}
+
+// Recompresses all `streams`, concurrently in `executor` if it is not
+// `nullptr`.
+absl::Status RecompressStreams(CompressionType compression_type,
+                               const CompressorOptions& compressor_options,
+                               Executor* executor,
+                               std::vector<Chain>& streams) {
+  std::vector<absl::Status> statuses(streams.size());
+  ParallelFor(executor, streams.size(), [&](size_t index) {
+    statuses[index] =
+        RecompressStream(compression_type, compressor_options, streams[index]);
+  });
+  for (absl::Status& status : statuses) {
+    if (ABSL_PREDICT_FALSE(!status.ok())) return std::move(status);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ReadCompressionType(ChainReader<>& src,
+                                 CompressionType& compression_type) {
+  const absl::optional<uint8_t> compression_type_byte = src.ReadByte();
+  if (ABSL_PREDICT_FALSE(compression_type_byte == absl::nullopt)) {
+    return absl::InvalidArgumentError("Reading compression type failed");
+  }
+  compression_type = static_cast<CompressionType>(*compression_type_byte);
+  return absl::OkStatus();
+}
+
+// Chunk data of a simple chunk:
+//  * compression type (1 byte)
+//  * size of compressed record sizes (varint64)
+//  * compressed record sizes
+//  * compressed record values, until the end of the chunk
+absl::Status RecompressSimple(const Chain& src,
+                              const CompressorOptions& compressor_options,
+                              Executor* executor, Chain& dest) {
+  ChainReader<> src_reader(&src);
+  CompressionType compression_type;
+  {
+    absl::Status status = ReadCompressionType(src_reader, compression_type);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  const absl::optional<uint64_t> sizes_size = ReadVarint64(src_reader);
+  if (ABSL_PREDICT_FALSE(sizes_size == absl::nullopt)) {
+    return absl::InvalidArgumentError("Reading size of sizes failed");
+  }
+  std::vector<Chain> streams(2);
+  if (ABSL_PREDICT_FALSE(*sizes_size > src.size()) ||
+      ABSL_PREDICT_FALSE(
+          !src_reader.Read(IntCast<size_t>(*sizes_size), streams[0]))) {
+    return absl::InvalidArgumentError("Reading record sizes failed");
+  }
+  if (ABSL_PREDICT_FALSE(!src_reader.ReadAll(streams[1]))) {
+    return src_reader.status();
+  }
+  {
+    absl::Status status = RecompressStreams(
+        compression_type, compressor_options, executor, streams);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  ChainWriter<> dest_writer(&dest);
+  dest_writer.WriteByte(
+      static_cast<uint8_t>(compressor_options.compression_type()));
+  WriteVarint64(uint64_t{streams[0].size()}, dest_writer);
+  dest_writer.Write(std::move(streams[0]));
+  dest_writer.Write(std::move(streams[1]));
+  if (ABSL_PREDICT_FALSE(!dest_writer.Close())) return dest_writer.status();
+  return absl::OkStatus();
+}
+
+// Chunk data of a transposed chunk:
+//  * column statistics (only `ChunkType::kTransposedV2`)
+//  * compression type (1 byte)
+//  * size of compressed header (varint64)
+//  * compressed header:
+//    * number of buckets (varint32)
+//    * number of buffers (varint32)
+//    * compressed sizes of buckets (varint64 each)
+//    * the rest of the header, which does not depend on compression
+//  * compressed buckets
+//  * compressed transitions, until the end of the chunk
+absl::Status RecompressTransposed(ChunkType chunk_type, const Chain& src,
+                                  const CompressorOptions& compressor_options,
+                                  Executor* executor, Chain& dest) {
+  ChainReader<> src_reader(&src);
+  Chain statistics;
+  if (chunk_type == ChunkType::kTransposedV2) {
+    if (ABSL_PREDICT_FALSE(!internal::SkipChunkStatistics(src_reader))) {
+      return absl::InvalidArgumentError("Invalid column statistics");
+    }
+    const Position statistics_size = src_reader.pos();
+    src_reader.Seek(0);
+    src_reader.Read(IntCast<size_t>(statistics_size), statistics);
+  }
+  CompressionType compression_type;
+  {
+    absl::Status status = ReadCompressionType(src_reader, compression_type);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  const absl::optional<uint64_t> header_size = ReadVarint64(src_reader);
+  if (ABSL_PREDICT_FALSE(header_size == absl::nullopt)) {
+    return absl::InvalidArgumentError("Reading header size failed");
+  }
+  Chain header;
+  if (ABSL_PREDICT_FALSE(*header_size > src.size()) ||
+      ABSL_PREDICT_FALSE(
+          !src_reader.Read(IntCast<size_t>(*header_size), header))) {
+    return absl::InvalidArgumentError("Reading header failed");
+  }
+  // Decompress the header, which is compressed again after bucket sizes in it
+  // are updated.
+  {
+    absl::Status status = RecompressStream(
+        compression_type, CompressorOptions().set_uncompressed(), header);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  ChainReader<> header_reader(&header);
+  const absl::optional<uint32_t> num_buckets = ReadVarint32(header_reader);
+  const absl::optional<uint32_t> num_buffers = ReadVarint32(header_reader);
+  if (ABSL_PREDICT_FALSE(num_buckets == absl::nullopt ||
+                         num_buffers == absl::nullopt)) {
+    return absl::InvalidArgumentError("Reading number of buckets failed");
+  }
+  if (ABSL_PREDICT_FALSE(*num_buckets > src.size())) {
+    return absl::InvalidArgumentError("Too many buckets");
+  }
+  // `streams[0]` is the transitions, and the rest are the buckets.
+  std::vector<Chain> streams(1 + size_t{*num_buckets});
+  for (size_t bucket_index = 0; bucket_index < *num_buckets; ++bucket_index) {
+    const absl::optional<uint64_t> bucket_length = ReadVarint64(header_reader);
+    if (ABSL_PREDICT_FALSE(bucket_length == absl::nullopt)) {
+      return absl::InvalidArgumentError("Reading bucket length failed");
+    }
+    if (ABSL_PREDICT_FALSE(*bucket_length > src.size()) ||
+        ABSL_PREDICT_FALSE(!src_reader.Read(IntCast<size_t>(*bucket_length),
+                                            streams[1 + bucket_index]))) {
+      return absl::InvalidArgumentError("Reading bucket failed");
+    }
+  }
+  Chain header_rest;
+  if (ABSL_PREDICT_FALSE(!header_reader.ReadAll(header_rest))) {
+    return header_reader.status();
+  }
+  if (ABSL_PREDICT_FALSE(!header_reader.Close())) {
+    return header_reader.status();
+  }
+  if (ABSL_PREDICT_FALSE(!src_reader.ReadAll(streams[0]))) {
+    return src_reader.status();
+  }
+  {
+    absl::Status status = RecompressStreams(
+        compression_type, compressor_options, executor, streams);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  header.Clear();
+  {
+    ChainWriter<> header_writer(&header);
+    WriteVarint32(*num_buckets, header_writer);
+    WriteVarint32(*num_buffers, header_writer);
+    for (size_t bucket_index = 0; bucket_index < *num_buckets;
+         ++bucket_index) {
+      WriteVarint64(uint64_t{streams[1 + bucket_index].size()}, header_writer);
+    }
+    header_writer.Write(std::move(header_rest));
+    if (ABSL_PREDICT_FALSE(!header_writer.Close())) {
+      return header_writer.status();
+    }
+  }
+  {
+    absl::Status status = RecompressStream(CompressionType::kNone,
+                                           compressor_options, header);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  ChainWriter<> dest_writer(&dest);
+  dest_writer.Write(std::move(statistics));
+  dest_writer.WriteByte(
+      static_cast<uint8_t>(compressor_options.compression_type()));
+  WriteVarint64(uint64_t{header.size()}, dest_writer);
+  dest_writer.Write(std::move(header));
+  for (size_t bucket_index = 0; bucket_index < *num_buckets; ++bucket_index) {
+    dest_writer.Write(std::move(streams[1 + bucket_index]));
+  }
+  dest_writer.Write(std::move(streams[0]));
+  if (ABSL_PREDICT_FALSE(!dest_writer.Close())) return dest_writer.status();
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status RecompressChunk(const Chunk& src,
+                             const CompressorOptions& compressor_options,
+                             Executor* executor, Chunk& dest) {
+  const ChunkType chunk_type = src.header.chunk_type();
+  Chain data;
+  absl::Status status;
+  switch (chunk_type) {
+    case ChunkType::kSimple:
+    case ChunkType::kDeduplicated:
+      status = RecompressSimple(src.data, compressor_options, executor, data);
+      break;
+    case ChunkType::kTransposed:
+    case ChunkType::kTransposedV2:
+      status = RecompressTransposed(chunk_type, src.data, compressor_options,
+                                    executor, data);
+      break;
+    default:
+      dest = src;
+      return absl::OkStatus();
+  }
+  if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  dest.header = ChunkHeader(data, chunk_type, src.header.num_records(),
+                            src.header.decoded_data_size());
+  dest.data = std::move(data);
+  return absl::OkStatus();
+}
+
+}  // namespace riegeli
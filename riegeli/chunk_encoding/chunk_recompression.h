@@ -0,0 +1,45 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_CHUNK_ENCODING_CHUNK_RECOMPRESSION_H_
+#define RIEGELI_CHUNK_ENCODING_CHUNK_RECOMPRESSION_H_
+
+#include "absl/status/status.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+
+namespace riegeli {
+
+// Compresses data of `src` again with `compressor_options`, writing the
+// resulting chunk to `dest`, without decoding records.
+//
+// Compressed streams of a chunk (record sizes and values of a simple chunk;
+// the header, buckets, and transitions of a transposed chunk) are decompressed
+// and compressed again independently, concurrently in `executor` if it is not
+// `nullptr`. The layout of records, and thus the decoded data, stay the same.
+//
+// Chunks of other types, including `ChunkType::kPrefixed` chunks which depend
+// on the previous chunk, are copied unchanged.
+//
+// Compression dictionaries are not supported: `src` must not be compressed
+// with a dictionary, and `compressor_options` must not specify one.
+// `compressor_options.min_compression_ratio()` is ignored.
+absl::Status RecompressChunk(const Chunk& src,
+                             const CompressorOptions& compressor_options,
+                             Executor* executor, Chunk& dest);
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_CHUNK_ENCODING_CHUNK_RECOMPRESSION_H_
@@ -0,0 +1,34 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/chunk_encoding/chunk_stats.h"
+
+namespace riegeli {
+
+ChunkStats& ChunkStats::operator+=(const ChunkStats& that) {
+  num_chunks += that.num_chunks;
+  num_records += that.num_records;
+  decoded_data_size += that.decoded_data_size;
+  encoded_data_size += that.encoded_data_size;
+  num_buckets += that.num_buckets;
+  bucket_uncompressed_size += that.bucket_uncompressed_size;
+  bucket_compressed_size += that.bucket_compressed_size;
+  encode_time += that.encode_time;
+  compress_time += that.compress_time;
+  decode_time += that.decode_time;
+  decompress_time += that.decompress_time;
+  return *this;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,71 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_CHUNK_ENCODING_CHUNK_STATS_H_
+#define RIEGELI_CHUNK_ENCODING_CHUNK_STATS_H_
+
+#include <stdint.h>
+
+#include "absl/time/time.h"
+
+namespace riegeli {
+
+// Sizes and timings of encoding or decoding chunks, either of a single chunk
+// or accumulated over chunks of a file. They help to tune compression options
+// and chunk size.
+//
+// Times are measured with the wall clock.
+struct ChunkStats {
+  // Adds `that` to `*this`.
+  ChunkStats& operator+=(const ChunkStats& that);
+
+  // Number of chunks.
+  uint64_t num_chunks = 0;
+  // Number of records.
+  uint64_t num_records = 0;
+  // Sum of record sizes.
+  uint64_t decoded_data_size = 0;
+  // Sum of chunk data sizes, excluding chunk headers and padding.
+  uint64_t encoded_data_size = 0;
+
+  // Number of separately compressed buckets: record sizes and record values
+  // of a simple chunk; the header, data buckets, and transitions of
+  // a transposed chunk. Filled when encoding.
+  uint64_t num_buckets = 0;
+  // Sums of bucket sizes before and after compression. Filled when encoding.
+  uint64_t bucket_uncompressed_size = 0;
+  uint64_t bucket_compressed_size = 0;
+
+  // Time spent in `ChunkEncoder::EncodeAndClose()`. Filled when encoding.
+  absl::Duration encode_time;
+  // The part of `encode_time` spent compressing buckets. Filled when encoding.
+  //
+  // If record values of a simple chunk are compressed while records are added
+  // (`stream_values` of `SimpleEncoder`), only finishing their compression is
+  // included.
+  absl::Duration compress_time;
+
+  // Time spent in `ChunkDecoder::Decode()`. Filled when decoding.
+  absl::Duration decode_time;
+  // The part of `decode_time` spent decompressing buckets. Filled when
+  // decoding.
+  //
+  // The header and transitions of a transposed chunk are decompressed
+  // incrementally while they are parsed, and are not included.
+  absl::Duration decompress_time;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_CHUNK_ENCODING_CHUNK_STATS_H_
@@ -0,0 +1,431 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/chunk_encoding/column_encoding.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/endian/endian_reading.h"
+#include "riegeli/endian/endian_writing.h"
+#include "riegeli/varint/varint_reading.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+namespace internal {
+
+namespace {
+
+inline uint64_t ZigZagDelta(uint64_t previous, uint64_t value) {
+  const uint64_t delta = value - previous;
+  return (delta << 1) ^
+         static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+inline uint64_t UndoZigZagDelta(uint64_t previous, uint64_t zigzag) {
+  return previous + ((zigzag >> 1) ^ (uint64_t{0} - (zigzag & 1)));
+}
+
+inline int BitWidth(uint64_t value) {
+  if (value == 0) return 0;
+#if RIEGELI_INTERNAL_HAS_BUILTIN(__builtin_clzll) || \
+    RIEGELI_INTERNAL_IS_GCC_VERSION(3, 4)
+  return 64 - __builtin_clzll(value);
+#else
+  int bit_width = 0;
+  while (value != 0) {
+    ++bit_width;
+    value >>= 1;
+  }
+  return bit_width;
+#endif
+}
+
+// Range of values to be bit-packed.
+class BitPacking {
+ public:
+  void Add(uint64_t value) {
+    reference_ = UnsignedMin(reference_, value);
+    max_value_ = UnsignedMax(max_value_, value);
+  }
+
+  uint64_t reference() const { return reference_; }
+  int bit_width() const { return BitWidth(max_value_ - reference_); }
+
+  // Returns the size of bit-packed values, excluding the encoding byte.
+  size_t EncodedSize(size_t num_values) const {
+    return LengthVarint64(num_values) + LengthVarint64(reference_) + 1 +
+           PackedSize(num_values, bit_width());
+  }
+
+  static size_t PackedSize(size_t num_values, int bit_width) {
+    return IntCast<size_t>(
+        (IntCast<uint64_t>(num_values) * IntCast<uint64_t>(bit_width) + 7) /
+        8);
+  }
+
+ private:
+  uint64_t reference_ = std::numeric_limits<uint64_t>::max();
+  uint64_t max_value_ = 0;
+};
+
+inline void WriteEncoding(ColumnEncoding encoding, Chain& dest) {
+  const char byte = static_cast<char>(encoding);
+  dest.Append(absl::string_view(&byte, 1));
+}
+
+// Writes bit-packed values, excluding the encoding byte.
+template <bool delta>
+void WriteBitPacked(const std::vector<uint64_t>& values,
+                    const BitPacking& bit_packing, Chain& dest) {
+  const uint64_t reference = bit_packing.reference();
+  const int bit_width = bit_packing.bit_width();
+  char header[kMaxLengthVarint64 * 2 + 1];
+  char* cursor = header;
+  cursor = WriteVarint64(IntCast<uint64_t>(values.size()), cursor);
+  cursor = WriteVarint64(reference, cursor);
+  *cursor++ = static_cast<char>(bit_width);
+  dest.Append(absl::string_view(header, PtrDistance(header, cursor)));
+
+  const size_t packed_size = BitPacking::PackedSize(values.size(), bit_width);
+  if (packed_size == 0) return;
+  std::vector<uint64_t> words(packed_size / sizeof(uint64_t) + 1);
+  uint64_t previous = 0;
+  uint64_t bit = 0;
+  for (const uint64_t value : values) {
+    const uint64_t packed = (delta ? ZigZagDelta(previous, value) : value) -
+                            reference;
+    previous = value;
+    const size_t word = IntCast<size_t>(bit / 64);
+    const int shift = static_cast<int>(bit % 64);
+    words[word] |= packed << shift;
+    if (shift + bit_width > 64) words[word + 1] |= packed >> (64 - shift);
+    bit += IntCast<uint64_t>(bit_width);
+  }
+  std::string packed_data(words.size() * sizeof(uint64_t), '\0');
+  for (size_t i = 0; i < words.size(); ++i) {
+    WriteLittleEndian64(words[i], &packed_data[i * sizeof(uint64_t)]);
+  }
+  packed_data.resize(packed_size);
+  dest.Append(std::move(packed_data));
+}
+
+// Writes `value` as a varint with highest bits cleared.
+inline char* WriteVarintWithoutHighBits(uint64_t value, char* dest) {
+  while (value >= 0x80) {
+    *dest++ = static_cast<char>(value & 0x7f);
+    value >>= 7;
+  }
+  *dest++ = static_cast<char>(value);
+  return dest;
+}
+
+// Bit-packed values read by `ReadBitPacked()`.
+struct BitPacked {
+  uint64_t num_values;
+  uint64_t reference;
+  int bit_width;
+  // Packed values, followed by two words of padding, which let
+  // `UnpackValues()` load the word after the last packed value
+  // unconditionally.
+  std::vector<uint64_t> words;
+};
+
+// Reads bit-packed values which extend until the end of `src`.
+//
+// Each value is decoded to at least one byte, hence there can be at most
+// `max_size` values.
+bool ReadBitPacked(Reader& src, size_t src_size, size_t max_size,
+                   BitPacked& dest) {
+  const absl::optional<uint64_t> num_values = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(num_values == absl::nullopt)) return false;
+  const absl::optional<uint64_t> reference = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(reference == absl::nullopt)) return false;
+  const absl::optional<uint8_t> bit_width = src.ReadByte();
+  if (ABSL_PREDICT_FALSE(bit_width == absl::nullopt || *bit_width > 64)) {
+    return false;
+  }
+  if (ABSL_PREDICT_FALSE(*num_values > max_size)) return false;
+  const size_t remaining = IntCast<size_t>(src_size - src.pos());
+  if (ABSL_PREDICT_FALSE(*bit_width > 0 &&
+                         *num_values > IntCast<uint64_t>(remaining) * 8 /
+                                           *bit_width)) {
+    return false;
+  }
+  const size_t packed_size =
+      BitPacking::PackedSize(IntCast<size_t>(*num_values), *bit_width);
+  if (ABSL_PREDICT_FALSE(packed_size != remaining)) return false;
+  dest.num_values = *num_values;
+  dest.reference = *reference;
+  dest.bit_width = *bit_width;
+  dest.words.assign(packed_size / sizeof(uint64_t) + 2, 0);
+  if (ABSL_PREDICT_FALSE(!src.Read(
+          packed_size, reinterpret_cast<char*>(dest.words.data())))) {
+    return false;
+  }
+  for (uint64_t& word : dest.words) {
+    word = ReadLittleEndian64(reinterpret_cast<const char*>(&word));
+  }
+  return true;
+}
+
+// Calls `consume(value)` for each value, with branch-free word loads. Stops
+// early if `consume()` returns `false`.
+template <bool delta, typename Consume>
+bool UnpackValues(const BitPacked& src, Consume consume) {
+  const uint64_t mask = src.bit_width == 64
+                            ? std::numeric_limits<uint64_t>::max()
+                            : (uint64_t{1} << src.bit_width) - 1;
+  uint64_t previous = 0;
+  uint64_t bit = 0;
+  for (uint64_t i = 0; i < src.num_values; ++i) {
+    const size_t word = IntCast<size_t>(bit / 64);
+    const int shift = static_cast<int>(bit % 64);
+    // Shifting left in two steps avoids shifting by 64 if `shift == 0`.
+    const uint64_t packed = ((src.words[word] >> shift) |
+                             ((src.words[word + 1] << 1) << (63 - shift))) &
+                            mask;
+    bit += IntCast<uint64_t>(src.bit_width);
+    uint64_t value = packed + src.reference;
+    if (delta) value = UndoZigZagDelta(previous, value);
+    previous = value;
+    if (ABSL_PREDICT_FALSE(!consume(value))) return false;
+  }
+  return true;
+}
+
+template <bool delta>
+bool DecodeBitPacked(const BitPacked& bit_packed, size_t max_size,
+                     Chain& dest) {
+  ChainWriter<> writer(&dest);
+  if (ABSL_PREDICT_FALSE(!UnpackValues<delta>(
+          bit_packed, [&writer, max_size](uint64_t value) {
+            if (ABSL_PREDICT_FALSE(!writer.Push(kMaxLengthVarint64))) {
+              return false;
+            }
+            writer.set_cursor(
+                WriteVarintWithoutHighBits(value, writer.cursor()));
+            return writer.pos() <= max_size;
+          }))) {
+    return false;
+  }
+  return writer.Close();
+}
+
+bool DecodeDictionary(Reader& src, size_t src_size, size_t max_size,
+                      Chain& dest) {
+  const absl::optional<uint64_t> dictionary_size = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(dictionary_size == absl::nullopt)) return false;
+  // Each entry has at least one byte.
+  if (ABSL_PREDICT_FALSE(*dictionary_size > src_size)) return false;
+  std::vector<Chain> dictionary(IntCast<size_t>(*dictionary_size));
+  for (Chain& entry : dictionary) {
+    const Position entry_begin = src.pos();
+    const absl::optional<uint64_t> length = ReadVarint64(src);
+    if (ABSL_PREDICT_FALSE(length == absl::nullopt)) return false;
+    if (ABSL_PREDICT_FALSE(*length > src_size - src.pos())) return false;
+    const size_t entry_size =
+        IntCast<size_t>(src.pos() - entry_begin + *length);
+    if (ABSL_PREDICT_FALSE(!src.Seek(entry_begin)) ||
+        ABSL_PREDICT_FALSE(!src.Read(entry_size, entry))) {
+      return false;
+    }
+  }
+  BitPacked indices;
+  if (ABSL_PREDICT_FALSE(!ReadBitPacked(src, src_size, max_size, indices))) {
+    return false;
+  }
+  ChainWriter<> writer(&dest);
+  if (ABSL_PREDICT_FALSE(!UnpackValues<false>(
+          indices, [&writer, &dictionary, max_size](uint64_t index) {
+            if (ABSL_PREDICT_FALSE(index >= dictionary.size())) return false;
+            const Chain& entry = dictionary[IntCast<size_t>(index)];
+            if (ABSL_PREDICT_FALSE(entry.size() > max_size - writer.pos())) {
+              return false;
+            }
+            return writer.Write(entry);
+          }))) {
+    return false;
+  }
+  return writer.Close();
+}
+
+}  // namespace
+
+void EncodeVarintColumn(const Chain& varints, Chain& dest) {
+  std::vector<uint64_t> values;
+  BitPacking plain;
+  BitPacking deltas;
+  ChainReader<> reader(&varints);
+  uint64_t previous = 0;
+  while (reader.Pull()) {
+    const absl::optional<uint64_t> value = ReadVarint64(reader);
+    if (value == absl::nullopt) {
+      RIEGELI_ASSERT_UNREACHABLE() << "Invalid varint: " << reader.status();
+    }
+    values.push_back(*value);
+    plain.Add(*value);
+    deltas.Add(ZigZagDelta(previous, *value));
+    previous = *value;
+  }
+
+  const size_t raw_size = varints.size();
+  const size_t plain_size = plain.EncodedSize(values.size());
+  const size_t delta_size = deltas.EncodedSize(values.size());
+  if (delta_size < raw_size && delta_size < plain_size) {
+    WriteEncoding(ColumnEncoding::kDeltaBitPacked, dest);
+    WriteBitPacked<true>(values, deltas, dest);
+    return;
+  }
+  if (plain_size < raw_size) {
+    WriteEncoding(ColumnEncoding::kBitPacked, dest);
+    WriteBitPacked<false>(values, plain, dest);
+    return;
+  }
+  // Clear high bit of each byte.
+  std::string raw;
+  raw.reserve(1 + raw_size);
+  raw.push_back(static_cast<char>(ColumnEncoding::kRaw));
+  for (const uint64_t value : values) {
+    char buffer[kMaxLengthVarint64];
+    raw.append(buffer, PtrDistance(buffer,
+                                   WriteVarintWithoutHighBits(value, buffer)));
+  }
+  dest.Append(std::move(raw));
+}
+
+void EncodeStringColumn(Chain& strings) {
+  // Dictionary encoding is abandoned when the dictionary would take more than
+  // this fraction of the raw size, which bounds the cost of trying it on
+  // columns with mostly distinct values.
+  constexpr size_t kMaxDictionaryFraction = 2;
+  const size_t max_dictionary_size = strings.size() / kMaxDictionaryFraction;
+  absl::flat_hash_map<std::string, uint64_t> index_of;
+  size_t dictionary_size = 0;
+  std::vector<uint64_t> indices;
+  BitPacking bit_packing;
+  ChainReader<> reader(&strings);
+  while (reader.Pull()) {
+    const Position entry_begin = reader.pos();
+    const absl::optional<uint64_t> length = ReadVarint64(reader);
+    if (length == absl::nullopt) {
+      RIEGELI_ASSERT_UNREACHABLE() << "Invalid length: " << reader.status();
+    }
+    const size_t entry_size =
+        IntCast<size_t>(reader.pos() - entry_begin + *length);
+    std::string entry;
+    if (!reader.Seek(entry_begin) || !reader.Read(entry_size, entry)) {
+      RIEGELI_ASSERT_UNREACHABLE() << "Reading string failed: "
+                                   << reader.status();
+    }
+    const std::pair<absl::flat_hash_map<std::string, uint64_t>::iterator,
+                    bool>
+        insert_result =
+            index_of.emplace(std::move(entry),
+                             IntCast<uint64_t>(index_of.size()));
+    if (insert_result.second) {
+      dictionary_size += entry_size;
+      if (dictionary_size > max_dictionary_size) {
+        EncodeRawColumn(strings);
+        return;
+      }
+    }
+    indices.push_back(insert_result.first->second);
+    bit_packing.Add(insert_result.first->second);
+  }
+
+  const size_t raw_size = strings.size();
+  const size_t encoded_size = LengthVarint64(index_of.size()) +
+                              dictionary_size +
+                              bit_packing.EncodedSize(indices.size());
+  if (encoded_size >= raw_size) {
+    EncodeRawColumn(strings);
+    return;
+  }
+  // Keys of `index_of` are not moved after insertions are done.
+  std::vector<absl::string_view> dictionary(index_of.size());
+  for (const std::pair<const std::string, uint64_t>& entry : index_of) {
+    dictionary[IntCast<size_t>(entry.second)] = entry.first;
+  }
+  Chain dest;
+  WriteEncoding(ColumnEncoding::kDictionary, dest);
+  char header[kMaxLengthVarint64];
+  dest.Append(absl::string_view(
+      header, PtrDistance(header, WriteVarint64(
+                                      IntCast<uint64_t>(dictionary.size()),
+                                      header))));
+  for (const absl::string_view entry : dictionary) dest.Append(entry);
+  WriteBitPacked<false>(indices, bit_packing, dest);
+  strings = std::move(dest);
+}
+
+void EncodeRawColumn(Chain& buffer) {
+  const char encoding = static_cast<char>(ColumnEncoding::kRaw);
+  buffer.Prepend(absl::string_view(&encoding, 1));
+}
+
+bool DecodeColumn(Chain& buffer, size_t max_size) {
+  Chain decoded;
+  {
+    ChainReader<> reader(&buffer);
+    const absl::optional<uint8_t> encoding = reader.ReadByte();
+    if (ABSL_PREDICT_FALSE(encoding == absl::nullopt)) return false;
+    switch (static_cast<ColumnEncoding>(*encoding)) {
+      case ColumnEncoding::kRaw:
+        buffer.RemovePrefix(1);
+        return true;
+      case ColumnEncoding::kBitPacked:
+      case ColumnEncoding::kDeltaBitPacked: {
+        BitPacked bit_packed;
+        if (ABSL_PREDICT_FALSE(!ReadBitPacked(reader, buffer.size(), max_size,
+                                              bit_packed))) {
+          return false;
+        }
+        if (static_cast<ColumnEncoding>(*encoding) ==
+                    ColumnEncoding::kDeltaBitPacked
+                ? !DecodeBitPacked<true>(bit_packed, max_size, decoded)
+                : !DecodeBitPacked<false>(bit_packed, max_size, decoded)) {
+          return false;
+        }
+      } break;
+      case ColumnEncoding::kDictionary:
+        if (ABSL_PREDICT_FALSE(
+                !DecodeDictionary(reader, buffer.size(), max_size, decoded))) {
+          return false;
+        }
+        break;
+      default:
+        return false;
+    }
+  }
+  buffer = std::move(decoded);
+  return true;
+}
+
+}  // namespace internal
+}  // namespace riegeli
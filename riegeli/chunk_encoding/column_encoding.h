@@ -0,0 +1,87 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_CHUNK_ENCODING_COLUMN_ENCODING_H_
+#define RIEGELI_CHUNK_ENCODING_COLUMN_ENCODING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "riegeli/base/chain.h"
+
+namespace riegeli {
+namespace internal {
+
+// Encodings of data buffers of a `ChunkType::kTransposedV2` chunk. Each buffer
+// begins with a byte specifying its encoding.
+//
+// These values are frozen in the file format.
+enum class ColumnEncoding : uint8_t {
+  // Buffer contents as in `ChunkType::kTransposed` follow.
+  kRaw = 0,
+  // Values of a varint field, bit-packed relative to their minimum.
+  kBitPacked = 1,
+  // Values of a varint field as zigzag-encoded differences from the previous
+  // value (the first value from 0), bit-packed relative to their minimum.
+  kDeltaBitPacked = 2,
+  // Values of a string field as a dictionary of distinct values, followed by
+  // bit-packed indices into the dictionary.
+  kDictionary = 3,
+};
+
+// Format of a bit-packed buffer, after the encoding byte (values are varint
+// encoded unless indicated otherwise):
+//  - Number of values [`num_values`]
+//  - Reference value subtracted from each packed value
+//  - Bit width of packed values [`bit_width`] (byte, at most 64)
+//  - `num_values` packed values, `bit_width` bits each, least significant bits
+//    first, in `(num_values * bit_width + 7) / 8` bytes
+//
+// Format of a dictionary buffer, after the encoding byte:
+//  - Number of dictionary entries (varint)
+//  - Dictionary entries, each as in `ChunkType::kTransposed`: length (varint)
+//    followed by contents
+//  - Indices of values in the dictionary, bit-packed as above
+
+// Encodes a data buffer of a varint field into `dest`, choosing the smallest
+// encoding.
+//
+// `varints` are canonical varints with their highest bits (signifying end of
+// number) intact, unlike in `ChunkType::kTransposed`. If `ColumnEncoding::kRaw`
+// is chosen, the highest bits are cleared.
+void EncodeVarintColumn(const Chain& varints, Chain& dest);
+
+// Encodes a data buffer of a string field in place, as `ColumnEncoding::kRaw`
+// or as `ColumnEncoding::kDictionary` if that is smaller.
+//
+// `strings` are as in `ChunkType::kTransposed`.
+void EncodeStringColumn(Chain& strings);
+
+// Encodes a data buffer of another kind as `ColumnEncoding::kRaw`.
+void EncodeRawColumn(Chain& buffer);
+
+// Decodes a data buffer written by `EncodeVarintColumn()`,
+// `EncodeStringColumn()`, or `EncodeRawColumn()` in place, leaving contents as
+// in `ChunkType::kTransposed`.
+//
+// `max_size` bounds the decoded size, to reject corrupted data before
+// allocating memory for it.
+//
+// Returns `false` if the data are invalid.
+bool DecodeColumn(Chain& buffer, size_t max_size);
+
+}  // namespace internal
+}  // namespace riegeli
+
+#endif  // RIEGELI_CHUNK_ENCODING_COLUMN_ENCODING_H_
@@ -0,0 +1,525 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/chunk_encoding/column_statistics.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/bytes/limiting_reader.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/writer.h"
+#include "riegeli/chunk_encoding/field_projection.h"
+#include "riegeli/chunk_encoding/hash.h"
+#include "riegeli/endian/endian_reading.h"
+#include "riegeli/endian/endian_writing.h"
+#include "riegeli/messages/message_wire_format.h"
+#include "riegeli/varint/varint_reading.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+
+namespace {
+
+// Number of bits set for each value in a Bloom filter being written, and the
+// number of bits per distinct value. Together they give about 1% of false
+// positives.
+constexpr int kBloomFilterNumHashes = 7;
+constexpr size_t kBloomFilterBitsPerValue = 10;
+
+// Maximum number of bits set for each value accepted when reading a Bloom
+// filter.
+constexpr uint8_t kMaxBloomFilterNumHashes = 32;
+
+// Calls `visit_bit(bit)` for each bit of a Bloom filter of `num_bits` bits
+// corresponding to a value with `hash`, until `visit_bit()` returns `false`.
+// Returns the last result of `visit_bit()`.
+template <typename VisitBit>
+bool ForEachBloomFilterBit(uint64_t hash, int num_hashes, uint64_t num_bits,
+                           VisitBit visit_bit) {
+  const uint64_t hash1 = hash & 0xffffffff;
+  const uint64_t hash2 = hash >> 32;
+  for (int i = 0; i < num_hashes; ++i) {
+    if (!visit_bit((hash1 + IntCast<uint64_t>(i) * hash2) % num_bits)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool FieldBloomFilter::MayContain(absl::string_view value) const {
+  const uint64_t num_bits = IntCast<uint64_t>(bits.size()) * 8;
+  if (num_bits == 0) return false;
+  return ForEachBloomFilterBit(
+      internal::Hash(value), num_hashes, num_bits, [this](uint64_t bit) {
+        return ((static_cast<unsigned char>(bits[IntCast<size_t>(bit / 8)]) >>
+                 (bit % 8)) &
+                1) != 0;
+      });
+}
+
+const ColumnStatistics* ChunkStatistics::FindColumn(const Field& field) const {
+  for (const ColumnStatistics& column : columns) {
+    if (column.field.path() == field.path()) return &column;
+  }
+  return nullptr;
+}
+
+const FieldBloomFilter* ChunkStatistics::FindBloomFilter(
+    const Field& field) const {
+  for (const FieldBloomFilter& bloom_filter : bloom_filters) {
+    if (bloom_filter.field.path() == field.path()) return &bloom_filter;
+  }
+  return nullptr;
+}
+
+namespace internal {
+
+namespace {
+
+// Maximum length of a field path accepted when reading statistics, which
+// bounds the memory allocated for corrupted data.
+constexpr uint64_t kMaxPathLength = 100;
+
+// A value of a field found by `FindValues()`.
+struct FieldValue {
+  WireType wire_type;
+  // The value of a varint or fixed field.
+  uint64_t number = 0;
+  // The contents of a length-delimited field.
+  Chain contents;
+};
+
+// Appends values of the field at `path[depth..]` in the message read from
+// `src` until `src` ends to `values`.
+//
+// Returns `false` if the message is invalid, in which case `values` are left
+// unchanged, because the bytes were likely not a submessage.
+bool FindValues(Reader& src, const Field::Path& path, size_t depth,
+                std::vector<FieldValue>& values) {
+  const size_t size_before = values.size();
+  const bool is_leaf = depth + 1 == path.size();
+  int group_depth = 0;
+  while (src.Pull()) {
+    const absl::optional<uint32_t> tag = ReadVarint32(src);
+    if (ABSL_PREDICT_FALSE(tag == absl::nullopt)) goto invalid;
+    {
+      const bool matches =
+          group_depth == 0 && GetTagFieldNumber(*tag) == path[depth];
+      const WireType wire_type = GetTagWireType(*tag);
+      switch (wire_type) {
+        case WireType::kVarint: {
+          const absl::optional<uint64_t> value = ReadVarint64(src);
+          if (ABSL_PREDICT_FALSE(value == absl::nullopt)) goto invalid;
+          if (matches && is_leaf) {
+            values.emplace_back();
+            values.back().wire_type = wire_type;
+            values.back().number = *value;
+          }
+        } break;
+        case WireType::kFixed32: {
+          const absl::optional<uint32_t> value = ReadLittleEndian32(src);
+          if (ABSL_PREDICT_FALSE(value == absl::nullopt)) goto invalid;
+          if (matches && is_leaf) {
+            values.emplace_back();
+            values.back().wire_type = wire_type;
+            values.back().number = *value;
+          }
+        } break;
+        case WireType::kFixed64: {
+          const absl::optional<uint64_t> value = ReadLittleEndian64(src);
+          if (ABSL_PREDICT_FALSE(value == absl::nullopt)) goto invalid;
+          if (matches && is_leaf) {
+            values.emplace_back();
+            values.back().wire_type = wire_type;
+            values.back().number = *value;
+          }
+        } break;
+        case WireType::kLengthDelimited: {
+          const absl::optional<uint32_t> length = ReadVarint32(src);
+          if (ABSL_PREDICT_FALSE(length == absl::nullopt)) goto invalid;
+          if (matches && is_leaf) {
+            values.emplace_back();
+            values.back().wire_type = wire_type;
+            if (ABSL_PREDICT_FALSE(
+                    !src.Read(*length, values.back().contents))) {
+              goto invalid;
+            }
+            break;
+          }
+          const Position end_pos = src.pos() + *length;
+          if (matches) {
+            LimitingReader<> submessage(&src, end_pos);
+            FindValues(submessage, path, depth + 1, values);
+            if (ABSL_PREDICT_FALSE(!submessage.Close())) goto invalid;
+          }
+          if (src.pos() < end_pos) {
+            if (ABSL_PREDICT_FALSE(!src.Skip(end_pos - src.pos()))) {
+              goto invalid;
+            }
+          } else if (ABSL_PREDICT_FALSE(src.pos() > end_pos)) {
+            goto invalid;
+          }
+        } break;
+        case WireType::kStartGroup:
+          ++group_depth;
+          break;
+        case WireType::kEndGroup:
+          if (ABSL_PREDICT_FALSE(group_depth == 0)) goto invalid;
+          --group_depth;
+          break;
+        default:
+          goto invalid;
+      }
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!src.healthy() || group_depth != 0)) goto invalid;
+  return true;
+
+invalid:
+  values.erase(values.begin() + size_before, values.end());
+  return false;
+}
+
+// Returns `value` represented as in `FieldBloomFilter`.
+Chain ValueBytes(const FieldValue& value) {
+  switch (value.wire_type) {
+    case WireType::kVarint: {
+      char buffer[kMaxLengthVarint64];
+      return Chain(absl::string_view(
+          buffer, PtrDistance(buffer, WriteVarint64(value.number, buffer))));
+    }
+    case WireType::kFixed32: {
+      char buffer[sizeof(uint32_t)];
+      WriteLittleEndian32(IntCast<uint32_t>(value.number), buffer);
+      return Chain(absl::string_view(buffer, sizeof(buffer)));
+    }
+    case WireType::kFixed64: {
+      char buffer[sizeof(uint64_t)];
+      WriteLittleEndian64(value.number, buffer);
+      return Chain(absl::string_view(buffer, sizeof(buffer)));
+    }
+    default:
+      return value.contents;
+  }
+}
+
+inline uint64_t DecodeZigZag64(uint64_t value) {
+  return (value >> 1) ^ (uint64_t{0} - (value & 1));
+}
+
+// Returns a numeric value interpreted according to `type`, or `absl::nullopt`
+// for a length-delimited value.
+absl::optional<uint64_t> NumericValue(const FieldValue& value,
+                                      NumericType type) {
+  switch (value.wire_type) {
+    case WireType::kVarint:
+      return type == NumericType::kZigZag ? DecodeZigZag64(value.number)
+                                          : value.number;
+    case WireType::kFixed32:
+      return type == NumericType::kUnsigned
+                 ? value.number
+                 : static_cast<uint64_t>(int64_t{
+                       static_cast<int32_t>(IntCast<uint32_t>(value.number))});
+    case WireType::kFixed64:
+      return value.number;
+    default:
+      return absl::nullopt;
+  }
+}
+
+// Adds a value to the range of values in `column`.
+void AddValue(uint64_t value, ColumnStatistics& column) {
+  if (column.num_values == 0) {
+    column.min = value;
+    column.max = value;
+  } else if (column.type == NumericType::kUnsigned) {
+    column.min = UnsignedMin(column.min, value);
+    column.max = UnsignedMax(column.max, value);
+  } else {
+    if (static_cast<int64_t>(value) < column.signed_min()) column.min = value;
+    if (static_cast<int64_t>(value) > column.signed_max()) column.max = value;
+  }
+  ++column.num_values;
+}
+
+void WritePath(const Field& field, Writer& dest) {
+  WriteVarint64(IntCast<uint64_t>(field.path().size()), dest);
+  for (const int field_number : field.path()) {
+    WriteVarint32(IntCast<uint32_t>(field_number), dest);
+  }
+}
+
+bool ReadPath(Reader& src, Field& dest) {
+  const absl::optional<uint64_t> path_length = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(path_length == absl::nullopt ||
+                         *path_length == 0 ||
+                         *path_length > kMaxPathLength)) {
+    return false;
+  }
+  dest = Field();
+  for (uint64_t i = 0; i < *path_length; ++i) {
+    const absl::optional<uint32_t> field_number = ReadVarint32(src);
+    if (ABSL_PREDICT_FALSE(field_number == absl::nullopt ||
+                           *field_number == 0 ||
+                           *field_number > (uint32_t{1} << 29) - 1)) {
+      return false;
+    }
+    dest.AddFieldNumber(IntCast<int>(*field_number));
+  }
+  return true;
+}
+
+bool ReadColumn(Reader& src, ColumnStatistics& dest) {
+  if (ABSL_PREDICT_FALSE(!ReadPath(src, dest.field))) return false;
+  const absl::optional<uint8_t> type = src.ReadByte();
+  if (ABSL_PREDICT_FALSE(type == absl::nullopt ||
+                         *type > static_cast<uint8_t>(NumericType::kZigZag))) {
+    return false;
+  }
+  dest.type = static_cast<NumericType>(*type);
+  const absl::optional<uint64_t> num_missing = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(num_missing == absl::nullopt)) return false;
+  dest.num_missing = *num_missing;
+  const absl::optional<uint64_t> num_values = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(num_values == absl::nullopt)) return false;
+  dest.num_values = *num_values;
+  if (dest.num_values == 0) {
+    dest.min = 0;
+    dest.max = 0;
+    return true;
+  }
+  const absl::optional<uint64_t> min = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(min == absl::nullopt)) return false;
+  const absl::optional<uint64_t> max = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(max == absl::nullopt)) return false;
+  dest.min = *min;
+  dest.max = *max;
+  return true;
+}
+
+bool ReadBloomFilter(Reader& src, Position end_pos, FieldBloomFilter& dest) {
+  if (ABSL_PREDICT_FALSE(!ReadPath(src, dest.field))) return false;
+  const absl::optional<uint8_t> num_hashes = src.ReadByte();
+  if (ABSL_PREDICT_FALSE(num_hashes == absl::nullopt || *num_hashes == 0 ||
+                         *num_hashes > kMaxBloomFilterNumHashes)) {
+    return false;
+  }
+  dest.num_hashes = *num_hashes;
+  const absl::optional<uint64_t> size = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt ||
+                         *size > end_pos - src.pos())) {
+    return false;
+  }
+  return src.Read(IntCast<size_t>(*size), dest.bits);
+}
+
+}  // namespace
+
+ColumnStatisticsCollector::ColumnStatisticsCollector(
+    std::vector<StatisticsField> fields, std::vector<Field> bloom_filter_fields)
+    : bloom_filter_hashes_(bloom_filter_fields.size()) {
+  statistics_.columns.reserve(fields.size());
+  for (const StatisticsField& field : fields) {
+    statistics_.columns.emplace_back();
+    statistics_.columns.back().field = field.field();
+    statistics_.columns.back().type = field.type();
+  }
+  statistics_.bloom_filters.reserve(bloom_filter_fields.size());
+  for (Field& field : bloom_filter_fields) {
+    RIEGELI_ASSERT(!field.path().empty())
+        << "Failed precondition of ColumnStatisticsCollector: "
+           "empty field path";
+    statistics_.bloom_filters.emplace_back();
+    statistics_.bloom_filters.back().field = std::move(field);
+  }
+}
+
+void ColumnStatisticsCollector::Clear() {
+  for (ColumnStatistics& column : statistics_.columns) {
+    column.num_missing = 0;
+    column.num_values = 0;
+    column.min = 0;
+    column.max = 0;
+  }
+  for (absl::flat_hash_set<uint64_t>& hashes : bloom_filter_hashes_) {
+    hashes.clear();
+  }
+}
+
+void ColumnStatisticsCollector::AddMessage(Reader& src) {
+  const Position pos_before = src.pos();
+  std::vector<FieldValue> values;
+  const auto find_values = [&](const Field& field) {
+    values.clear();
+    if (!src.Seek(pos_before)) {
+      RIEGELI_ASSERT_UNREACHABLE()
+          << "Seeking reader of a record failed: " << src.status();
+    }
+    FindValues(src, field.path(), 0, values);
+  };
+  for (ColumnStatistics& column : statistics_.columns) {
+    find_values(column.field);
+    const uint64_t num_values_before = column.num_values;
+    for (const FieldValue& value : values) {
+      const absl::optional<uint64_t> number = NumericValue(value, column.type);
+      if (number != absl::nullopt) AddValue(*number, column);
+    }
+    if (column.num_values == num_values_before) ++column.num_missing;
+  }
+  for (size_t i = 0; i < statistics_.bloom_filters.size(); ++i) {
+    find_values(statistics_.bloom_filters[i].field);
+    for (const FieldValue& value : values) {
+      bloom_filter_hashes_[i].insert(Hash(ValueBytes(value)));
+    }
+  }
+}
+
+void ColumnStatisticsCollector::AddNonProto() {
+  for (ColumnStatistics& column : statistics_.columns) ++column.num_missing;
+}
+
+void ColumnStatisticsCollector::Write(Chain& dest) const {
+  if (empty()) {
+    // No statistics are stored as their size 0.
+    const char size = 0;
+    dest.Append(absl::string_view(&size, 1));
+    return;
+  }
+  ChainWriter<Chain> writer(std::forward_as_tuple());
+  WriteVarint64(IntCast<uint64_t>(statistics_.columns.size()), writer);
+  for (const ColumnStatistics& column : statistics_.columns) {
+    WritePath(column.field, writer);
+    writer.WriteByte(static_cast<uint8_t>(column.type));
+    WriteVarint64(column.num_missing, writer);
+    WriteVarint64(column.num_values, writer);
+    if (column.num_values > 0) {
+      WriteVarint64(column.min, writer);
+      WriteVarint64(column.max, writer);
+    }
+  }
+  WriteVarint64(IntCast<uint64_t>(statistics_.bloom_filters.size()), writer);
+  for (size_t i = 0; i < statistics_.bloom_filters.size(); ++i) {
+    const absl::flat_hash_set<uint64_t>& hashes = bloom_filter_hashes_[i];
+    std::string bits;
+    if (!hashes.empty()) {
+      bits.resize(UnsignedMax(
+          (hashes.size() * kBloomFilterBitsPerValue + 7) / 8, size_t{8}));
+      const uint64_t num_bits = IntCast<uint64_t>(bits.size()) * 8;
+      for (const uint64_t hash : hashes) {
+        ForEachBloomFilterBit(hash, kBloomFilterNumHashes, num_bits,
+                              [&bits](uint64_t bit) {
+                                bits[IntCast<size_t>(bit / 8)] |=
+                                    static_cast<char>(1 << (bit % 8));
+                                return true;
+                              });
+      }
+    }
+    WritePath(statistics_.bloom_filters[i].field, writer);
+    writer.WriteByte(static_cast<uint8_t>(kBloomFilterNumHashes));
+    WriteVarint64(IntCast<uint64_t>(bits.size()), writer);
+    writer.Write(std::move(bits));
+  }
+  if (!writer.Close()) {
+    RIEGELI_ASSERT_UNREACHABLE()
+        << "Writing statistics failed: " << writer.status();
+  }
+  ChainWriter<> dest_writer(&dest,
+                            ChainWriterBase::Options().set_append(true));
+  if (!WriteVarint64(IntCast<uint64_t>(writer.dest().size()), dest_writer) ||
+      !dest_writer.Write(std::move(writer.dest())) || !dest_writer.Close()) {
+    RIEGELI_ASSERT_UNREACHABLE()
+        << "Writing statistics failed: " << dest_writer.status();
+  }
+}
+
+bool ReadChunkStatistics(Reader& src, ChunkStatistics& dest) {
+  dest.columns.clear();
+  dest.bloom_filters.clear();
+  const absl::optional<uint64_t> size = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
+  if (*size == 0) return true;
+  const Position end_pos = SaturatingAdd(src.pos(), *size);
+  LimitingReader<> statistics_reader(&src, end_pos);
+  const absl::optional<uint64_t> num_columns = ReadVarint64(statistics_reader);
+  // Each column takes at least 5 bytes.
+  if (ABSL_PREDICT_FALSE(num_columns == absl::nullopt ||
+                         *num_columns > *size / 5)) {
+    goto invalid;
+  }
+  dest.columns.resize(IntCast<size_t>(*num_columns));
+  for (ColumnStatistics& column : dest.columns) {
+    if (ABSL_PREDICT_FALSE(!ReadColumn(statistics_reader, column))) {
+      goto invalid;
+    }
+  }
+  {
+    const absl::optional<uint64_t> num_bloom_filters =
+        ReadVarint64(statistics_reader);
+    // Each Bloom filter takes at least 4 bytes.
+    if (ABSL_PREDICT_FALSE(num_bloom_filters == absl::nullopt ||
+                           *num_bloom_filters > *size / 4)) {
+      goto invalid;
+    }
+    dest.bloom_filters.resize(IntCast<size_t>(*num_bloom_filters));
+  }
+  for (FieldBloomFilter& bloom_filter : dest.bloom_filters) {
+    if (ABSL_PREDICT_FALSE(
+            !ReadBloomFilter(statistics_reader, end_pos, bloom_filter))) {
+      goto invalid;
+    }
+  }
+  if (ABSL_PREDICT_FALSE(statistics_reader.pos() != end_pos) ||
+      ABSL_PREDICT_FALSE(!statistics_reader.Close())) {
+    goto invalid;
+  }
+  return true;
+
+invalid:
+  dest.columns.clear();
+  dest.bloom_filters.clear();
+  return false;
+}
+
+bool SkipChunkStatistics(Reader& src) {
+  const absl::optional<uint64_t> size = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return false;
+  return src.Skip(*size);
+}
+
+bool HasFieldValue(Reader& src, const Field& field, absl::string_view value) {
+  std::vector<FieldValue> values;
+  FindValues(src, field.path(), 0, values);
+  for (const FieldValue& field_value : values) {
+    if (ValueBytes(field_value) == value) return true;
+  }
+  return false;
+}
+
+}  // namespace internal
+}  // namespace riegeli
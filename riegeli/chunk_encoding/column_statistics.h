@@ -0,0 +1,236 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_CHUNK_ENCODING_COLUMN_STATISTICS_H_
+#define RIEGELI_CHUNK_ENCODING_COLUMN_STATISTICS_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/chunk_encoding/field_projection.h"
+
+namespace riegeli {
+
+// Interpretation of values of a numeric field for `ColumnStatistics`.
+//
+// These values are frozen in the file format.
+enum class NumericType : uint8_t {
+  // `uint32`, `uint64`, `fixed32`, `fixed64`, `bool`: values are compared as
+  // unsigned.
+  kUnsigned = 0,
+  // `int32`, `int64`, `sfixed32`, `sfixed64`, `enum`: values are compared as
+  // signed.
+  kSigned = 1,
+  // `sint32`, `sint64`: values are zigzag-decoded and compared as signed.
+  kZigZag = 2,
+};
+
+// A numeric field whose `ColumnStatistics` are stored in transposed chunks.
+class StatisticsField {
+ public:
+  // `field` must not include `Field::kExistenceOnly`. Values of a packed
+  // repeated field are not included in statistics.
+  StatisticsField(Field field, NumericType type);
+
+  StatisticsField(const StatisticsField& that);
+  StatisticsField& operator=(const StatisticsField& that);
+
+  StatisticsField(StatisticsField&& that) noexcept;
+  StatisticsField& operator=(StatisticsField&& that) noexcept;
+
+  const Field& field() const { return field_; }
+  NumericType type() const { return type_; }
+
+ private:
+  Field field_;
+  NumericType type_;
+};
+
+// Statistics of values of a numeric field over records of a chunk.
+struct ColumnStatistics {
+  // Path of the field.
+  Field field;
+  // Interpretation of values.
+  NumericType type = NumericType::kUnsigned;
+  // Number of records which do not contain the field.
+  uint64_t num_missing = 0;
+  // Number of values, counting each element of a repeated field.
+  uint64_t num_values = 0;
+  // The smallest and the largest value if `num_values > 0`.
+  //
+  // These are `uint64_t` values for `NumericType::kUnsigned`, and `int64_t`
+  // values cast to `uint64_t` otherwise; see `signed_min()` and `signed_max()`.
+  uint64_t min = 0;
+  uint64_t max = 0;
+
+  int64_t signed_min() const { return static_cast<int64_t>(min); }
+  int64_t signed_max() const { return static_cast<int64_t>(max); }
+};
+
+// A Bloom filter of values of a field over records of a chunk.
+//
+// A value is represented as in the binary proto format: contents of a
+// length-delimited field (`string`, `bytes`, or a submessage), the canonical
+// varint of a varint field, or the little endian bytes of a fixed field.
+struct FieldBloomFilter {
+  // Returns `false` if no record of the chunk contains `value` in the field.
+  bool MayContain(absl::string_view value) const;
+
+  // Path of the field.
+  Field field;
+  // Number of bits set for each value.
+  int num_hashes = 0;
+  // Bits, least significant bit of each byte first.
+  std::string bits;
+};
+
+// Statistics stored in a transposed chunk.
+struct ChunkStatistics {
+  bool empty() const { return columns.empty() && bloom_filters.empty(); }
+
+  // Returns statistics of `field`, or `nullptr` if they are not stored.
+  const ColumnStatistics* FindColumn(const Field& field) const;
+
+  // Returns the Bloom filter of `field`, or `nullptr` if it is not stored.
+  const FieldBloomFilter* FindBloomFilter(const Field& field) const;
+
+  std::vector<ColumnStatistics> columns;
+  std::vector<FieldBloomFilter> bloom_filters;
+};
+
+// Decides whether a chunk may contain records of interest, given statistics
+// stored in the chunk. If it returns `false`, records of the chunk are skipped
+// without decompressing them.
+using ChunkFilter = std::function<bool(const ChunkStatistics&)>;
+
+namespace internal {
+
+// Collects `ChunkStatistics` of records added to a chunk.
+class ColumnStatisticsCollector {
+ public:
+  explicit ColumnStatisticsCollector(
+      std::vector<StatisticsField> fields,
+      std::vector<Field> bloom_filter_fields = {});
+
+  ColumnStatisticsCollector(ColumnStatisticsCollector&& that) noexcept;
+  ColumnStatisticsCollector& operator=(
+      ColumnStatisticsCollector&& that) noexcept;
+
+  // Returns `true` if no fields are configured, so that statistics are not
+  // stored.
+  bool empty() const {
+    return statistics_.columns.empty() && bloom_filter_hashes_.empty();
+  }
+
+  // Resets statistics, keeping the configured fields.
+  void Clear();
+
+  // Adds values from a record which is a valid proto message, read from `src`
+  // until `src` ends. Leaves `src` at an unspecified position.
+  void AddMessage(Reader& src);
+
+  // Adds a record which is not a proto message, counting configured fields as
+  // missing.
+  void AddNonProto();
+
+  // Appends statistics to `dest` in the format read by
+  // `ReadChunkStatistics()`, including their size.
+  void Write(Chain& dest) const;
+
+ private:
+  // `bloom_filters` contain only fields, and their bits are filled by
+  // `Write()` from `bloom_filter_hashes_`.
+  ChunkStatistics statistics_;
+  // Hashes of distinct values of each field of `statistics_.bloom_filters`.
+  std::vector<absl::flat_hash_set<uint64_t>> bloom_filter_hashes_;
+};
+
+// Reads statistics stored at the beginning of a `kTransposedV2` chunk. Chunks
+// without statistics yield empty statistics.
+//
+// Returns `false` if the data are invalid.
+bool ReadChunkStatistics(Reader& src, ChunkStatistics& dest);
+
+// Skips statistics stored at the beginning of a `kTransposedV2` chunk.
+//
+// Returns `false` if the data are invalid.
+bool SkipChunkStatistics(Reader& src);
+
+// Returns `true` if the proto message read from `src` until `src` ends has
+// `value` in `field`, with `value` represented as in `FieldBloomFilter`.
+bool HasFieldValue(Reader& src, const Field& field, absl::string_view value);
+
+}  // namespace internal
+
+// Implementation details follow.
+
+inline StatisticsField::StatisticsField(Field field, NumericType type)
+    : field_(std::move(field)), type_(type) {
+  RIEGELI_ASSERT(!field_.path().empty())
+      << "Failed precondition of StatisticsField: empty field path";
+  for (const int field_number : field_.path()) {
+    RIEGELI_ASSERT_NE(field_number, Field::kExistenceOnly)
+        << "Failed precondition of StatisticsField: "
+           "Field::kExistenceOnly in field path";
+  }
+}
+
+inline StatisticsField::StatisticsField(const StatisticsField& that)
+    : field_(that.field_), type_(that.type_) {}
+
+inline StatisticsField& StatisticsField::operator=(
+    const StatisticsField& that) {
+  field_ = that.field_;
+  type_ = that.type_;
+  return *this;
+}
+
+inline StatisticsField::StatisticsField(StatisticsField&& that) noexcept
+    : field_(std::move(that.field_)), type_(that.type_) {}
+
+inline StatisticsField& StatisticsField::operator=(
+    StatisticsField&& that) noexcept {
+  field_ = std::move(that.field_);
+  type_ = that.type_;
+  return *this;
+}
+
+namespace internal {
+
+inline ColumnStatisticsCollector::ColumnStatisticsCollector(
+    ColumnStatisticsCollector&& that) noexcept
+    : statistics_(std::move(that.statistics_)),
+      bloom_filter_hashes_(std::move(that.bloom_filter_hashes_)) {}
+
+inline ColumnStatisticsCollector& ColumnStatisticsCollector::operator=(
+    ColumnStatisticsCollector&& that) noexcept {
+  statistics_ = std::move(that.statistics_);
+  bloom_filter_hashes_ = std::move(that.bloom_filter_hashes_);
+  return *this;
+}
+
+}  // namespace internal
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_CHUNK_ENCODING_COLUMN_STATISTICS_H_
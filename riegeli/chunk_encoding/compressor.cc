@@ -25,11 +25,16 @@
 #include "absl/types/optional.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/object.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/brotli/brotli_allocator.h"
 #include "riegeli/brotli/brotli_writer.h"
 #include "riegeli/bytes/chain_writer.h"
+#include "riegeli/bytes/null_writer.h"
 #include "riegeli/bytes/writer.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
 #include "riegeli/chunk_encoding/compressor_options.h"
 #include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/lz4/lz4_writer.h"
 #include "riegeli/snappy/snappy_writer.h"
 #include "riegeli/varint/varint_writing.h"
 #include "riegeli/zstd/zstd_writer.h"
@@ -56,23 +61,34 @@ void Compressor::Clear() {
 }
 
 void Compressor::Initialize() {
+  // The pledged size is the best size hint for writers which do not take a
+  // pledged size.
+  const absl::optional<Position> size_hint =
+      tuning_options_.pledged_size() != absl::nullopt
+          ? tuning_options_.pledged_size()
+          : tuning_options_.size_hint();
   switch (compressor_options_.compression_type()) {
-    case CompressionType::kNone:
+    case CompressionType::kNone: {
+      ChainWriterBase::Options chain_writer_options;
+      chain_writer_options.set_size_hint(size_hint);
+      if (tuning_options_.reserve_size() && size_hint != absl::nullopt) {
+        // Let the first block cover the whole expected size.
+        chain_writer_options.set_max_block_size(UnsignedMax(
+            kMaxBufferSize, SaturatingIntCast<size_t>(*size_hint)));
+      }
       writer_ = absl::make_unique<ChainWriter<>>(
-          &compressed_, ChainWriterBase::Options().set_size_hint(
-                            tuning_options_.pledged_size() != absl::nullopt
-                                ? tuning_options_.pledged_size()
-                                : tuning_options_.size_hint()));
+          &compressed_, std::move(chain_writer_options));
       return;
+    }
     case CompressionType::kBrotli:
       writer_ = absl::make_unique<BrotliWriter<ChainWriter<>>>(
           std::forward_as_tuple(&compressed_),
           BrotliWriterBase::Options()
               .set_compression_level(compressor_options_.compression_level())
               .set_window_log(compressor_options_.brotli_window_log())
-              .set_size_hint(tuning_options_.pledged_size() != absl::nullopt
-                                 ? tuning_options_.pledged_size()
-                                 : tuning_options_.size_hint()));
+              .set_dictionary(compressor_options_.brotli_dictionary())
+              .set_allocator(BrotliAllocator::Recycling())
+              .set_size_hint(size_hint));
       return;
     case CompressionType::kZstd:
       writer_ = absl::make_unique<ZstdWriter<ChainWriter<>>>(
@@ -80,14 +96,23 @@ void Compressor::Initialize() {
           ZstdWriterBase::Options()
               .set_compression_level(compressor_options_.compression_level())
               .set_window_log(compressor_options_.zstd_window_log())
+              .set_dictionary(compressor_options_.zstd_dictionary())
+              .set_hardware_offload(compressor_options_.hardware_offload())
               .set_pledged_size(tuning_options_.pledged_size())
-              .set_size_hint(tuning_options_.size_hint()));
+              .set_size_hint(size_hint));
       return;
     case CompressionType::kSnappy:
       writer_ = absl::make_unique<SnappyWriter<ChainWriter<>>>(
           std::forward_as_tuple(&compressed_),
-          SnappyWriterBase::Options().set_size_hint(
-              tuning_options_.size_hint()));
+          SnappyWriterBase::Options().set_size_hint(size_hint));
+      return;
+    case CompressionType::kLz4:
+      writer_ = absl::make_unique<Lz4Writer<ChainWriter<>>>(
+          std::forward_as_tuple(&compressed_),
+          Lz4WriterBase::Options()
+              .set_compression_level(compressor_options_.compression_level())
+              .set_pledged_size(tuning_options_.pledged_size())
+              .set_size_hint(size_hint));
       return;
   }
   RIEGELI_ASSERT_UNREACHABLE()
@@ -111,5 +136,34 @@ bool Compressor::EncodeAndClose(Writer& dest) {
   return Close();
 }
 
+bool Compressor::EncodeAndClose(Writer& dest, ChunkStats& stats) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  const Position uncompressed_size = writer().pos();
+  const Position pos_before = dest.pos();
+  if (ABSL_PREDICT_FALSE(!EncodeAndClose(dest))) return false;
+  ++stats.num_buckets;
+  stats.bucket_uncompressed_size += uncompressed_size;
+  stats.bucket_compressed_size += dest.pos() - pos_before;
+  return true;
+}
+
+bool CompressionPaysOff(const CompressorOptions& compressor_options,
+                        const Chain& sample) {
+  if (!IsAdaptive(compressor_options) || sample.empty()) return true;
+  Compressor compressor(
+      compressor_options,
+      Compressor::TuningOptions().set_pledged_size(sample.size()));
+  NullWriter compressed_writer(NullWriter::kInitiallyOpen);
+  if (ABSL_PREDICT_FALSE(!compressor.writer().Write(sample)) ||
+      ABSL_PREDICT_FALSE(!compressor.EncodeAndClose(compressed_writer)) ||
+      ABSL_PREDICT_FALSE(!compressed_writer.Close())) {
+    // Let compressing the whole chunk report the failure.
+    return true;
+  }
+  return static_cast<double>(sample.size()) >=
+         *compressor_options.min_compression_ratio() *
+             static_cast<double>(compressed_writer.pos());
+}
+
 }  // namespace internal
 }  // namespace riegeli
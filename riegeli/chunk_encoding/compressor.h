@@ -15,6 +15,8 @@
 #ifndef RIEGELI_CHUNK_ENCODING_COMPRESSOR_H_
 #define RIEGELI_CHUNK_ENCODING_COMPRESSOR_H_
 
+#include <stddef.h>
+
 #include <memory>
 #include <utility>
 
@@ -24,7 +26,9 @@
 #include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
 #include "riegeli/bytes/writer.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
 #include "riegeli/chunk_encoding/compressor_options.h"
+#include "riegeli/chunk_encoding/constants.h"
 
 namespace riegeli {
 namespace internal {
@@ -68,9 +72,26 @@ class Compressor : public Object {
     }
     absl::optional<Position> size_hint() const { return size_hint_; }
 
+    // If `true` and data are stored uncompressed, the expected size
+    // (`pledged_size()` or `size_hint()`) is allocated up front as a single
+    // block instead of blocks growing progressively up to `kMaxBufferSize`.
+    // This avoids most block allocations and keeps the data contiguous, at the
+    // cost of holding memory for the whole expected size early.
+    //
+    // Default: `false`.
+    TuningOptions& set_reserve_size(bool reserve_size) & {
+      reserve_size_ = reserve_size;
+      return *this;
+    }
+    TuningOptions&& set_reserve_size(bool reserve_size) && {
+      return std::move(set_reserve_size(reserve_size));
+    }
+    bool reserve_size() const { return reserve_size_; }
+
    private:
     absl::optional<Position> pledged_size_;
     absl::optional<Position> size_hint_;
+    bool reserve_size_ = false;
   };
 
   // Creates a closed `Compressor`.
@@ -106,6 +127,15 @@ class Compressor : public Object {
   //  * `false` - failure (`!healthy()`)
   bool EncodeAndClose(Writer& dest);
 
+  // Like `EncodeAndClose(dest)`, and adds the compressed bucket with its sizes
+  // to `stats`.
+  bool EncodeAndClose(Writer& dest, ChunkStats& stats);
+
+  // Returns an estimate of memory used by data written so far, excluding
+  // `sizeof(*this)` and internal state of the compression library. This does
+  // not traverse the data.
+  size_t EstimateMemory() const;
+
  private:
   void Initialize();
 
@@ -115,6 +145,25 @@ class Compressor : public Object {
   std::unique_ptr<Writer> writer_;
 };
 
+// Returns `true` if compression is adaptive, i.e. if
+// `compressor_options.min_compression_ratio()` applies.
+bool IsAdaptive(const CompressorOptions& compressor_options);
+
+// The size of a sample of a chunk which is compressed to decide whether
+// adaptive compression should compress the whole chunk.
+constexpr size_t kCompressionSampleSize = size_t{64} << 10;
+
+// Returns `true` if data resembling `sample` should be compressed according to
+// `compressor_options`, or `false` if they should be stored uncompressed.
+//
+// If compression is adaptive, compresses `sample` and compares the ratio
+// with `compressor_options.min_compression_ratio()`. Otherwise returns `true`
+// without looking at `sample`. An empty `sample` is always compressed.
+//
+// `sample` should have at most `kCompressionSampleSize` bytes.
+bool CompressionPaysOff(const CompressorOptions& compressor_options,
+                        const Chain& sample);
+
 // Implementation details follow.
 
 inline Writer& Compressor::writer() {
@@ -123,6 +172,17 @@ inline Writer& Compressor::writer() {
   return *writer_;
 }
 
+inline size_t Compressor::EstimateMemory() const {
+  // `compressed_` includes the buffer of the `ChainWriter` writing there.
+  if (writer_ == nullptr) return compressed_.size();
+  return SaturatingAdd(compressed_.size(), writer_->EstimateMemory());
+}
+
+inline bool IsAdaptive(const CompressorOptions& compressor_options) {
+  return compressor_options.min_compression_ratio() != absl::nullopt &&
+         compressor_options.compression_type() != CompressionType::kNone;
+}
+
 }  // namespace internal
 }  // namespace riegeli
 
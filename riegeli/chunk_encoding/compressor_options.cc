@@ -14,6 +14,7 @@
 
 #include "riegeli/chunk_encoding/compressor_options.h"
 
+#include <limits>
 #include <string>
 #include <utility>
 
@@ -25,6 +26,7 @@
 #include "riegeli/base/options_parser.h"
 #include "riegeli/brotli/brotli_writer.h"
 #include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/lz4/lz4_writer.h"
 #include "riegeli/zstd/zstd_writer.h"
 
 namespace riegeli {
@@ -39,6 +41,9 @@ constexpr int CompressorOptions::kDefaultBrotli;
 constexpr int CompressorOptions::kMinZstd;
 constexpr int CompressorOptions::kMaxZstd;
 constexpr int CompressorOptions::kDefaultZstd;
+constexpr int CompressorOptions::kMinLz4;
+constexpr int CompressorOptions::kMaxLz4;
+constexpr int CompressorOptions::kDefaultLz4;
 constexpr int CompressorOptions::kMinWindowLog;
 constexpr int CompressorOptions::kMaxWindowLog;
 #endif
@@ -50,39 +55,56 @@ absl::Status CompressorOptions::FromString(absl::string_view text) {
     OptionsParser options_parser;
     options_parser.AddOption(
         "uncompressed",
-        ValueParser::And(ValueParser::FailIfSeen("brotli", "zstd", "snappy"),
-                         [this](ValueParser& value_parser) {
-                           compression_type_ = CompressionType::kNone;
-                           return true;
-                         }));
+        ValueParser::And(
+            ValueParser::FailIfSeen("brotli", "zstd", "snappy", "lz4"),
+            [this](ValueParser& value_parser) {
+              compression_type_ = CompressionType::kNone;
+              return true;
+            }));
     options_parser.AddOption(
-        "brotli", ValueParser::And(
-                      ValueParser::FailIfSeen("uncompressed", "zstd", "snappy"),
-                      [this](ValueParser& value_parser) {
-                        compression_type_ = CompressionType::kBrotli;
-                        return true;
-                      }));
+        "brotli",
+        ValueParser::And(
+            ValueParser::FailIfSeen("uncompressed", "zstd", "snappy", "lz4"),
+            [this](ValueParser& value_parser) {
+              compression_type_ = CompressionType::kBrotli;
+              return true;
+            }));
     options_parser.AddOption(
-        "zstd", ValueParser::And(
-                    ValueParser::FailIfSeen("uncompressed", "brotli", "snappy"),
-                    [this](ValueParser& value_parser) {
-                      compression_type_ = CompressionType::kZstd;
-                      return true;
-                    }));
+        "zstd",
+        ValueParser::And(
+            ValueParser::FailIfSeen("uncompressed", "brotli", "snappy", "lz4"),
+            [this](ValueParser& value_parser) {
+              compression_type_ = CompressionType::kZstd;
+              return true;
+            }));
     options_parser.AddOption(
-        "snappy", ValueParser::And(
-                      ValueParser::FailIfSeen("uncompressed", "brotli", "zstd"),
-                      [this](ValueParser& value_parser) {
-                        compression_type_ = CompressionType::kSnappy;
-                        return true;
-                      }));
+        "snappy",
+        ValueParser::And(
+            ValueParser::FailIfSeen("uncompressed", "brotli", "zstd", "lz4"),
+            [this](ValueParser& value_parser) {
+              compression_type_ = CompressionType::kSnappy;
+              return true;
+            }));
+    options_parser.AddOption(
+        "lz4",
+        ValueParser::And(
+            ValueParser::FailIfSeen("uncompressed", "brotli", "zstd", "snappy"),
+            [this](ValueParser& value_parser) {
+              compression_type_ = CompressionType::kLz4;
+              return true;
+            }));
     options_parser.AddOption("window_log",
                              [](ValueParser& value_parser) { return true; });
+    options_parser.AddOption("min_compression_ratio",
+                             [](ValueParser& value_parser) { return true; });
+    options_parser.AddOption("hardware_offload",
+                             [](ValueParser& value_parser) { return true; });
     if (ABSL_PREDICT_FALSE(!options_parser.FromString(text))) {
       return options_parser.status();
     }
   }
   int window_log;
+  double min_compression_ratio;
   OptionsParser options_parser;
   options_parser.AddOption(
       "uncompressed",
@@ -108,6 +130,17 @@ absl::Status CompressorOptions::FromString(absl::string_view text) {
   options_parser.AddOption(
       "snappy", ValueParser::And(ValueParser::FailIfSeen("window_log"),
                                  ValueParser::Empty(0, &compression_level_)));
+  options_parser.AddOption(
+      "lz4",
+      ValueParser::And(
+          ValueParser::FailIfSeen("window_log"),
+          ValueParser::Or(
+              ValueParser::Empty(
+                  Lz4WriterBase::Options::kDefaultCompressionLevel,
+                  &compression_level_),
+              ValueParser::Int(Lz4WriterBase::Options::kMinCompressionLevel,
+                               Lz4WriterBase::Options::kMaxCompressionLevel,
+                               &compression_level_))));
   options_parser.AddOption("window_log", [&] {
     switch (compression_type_) {
       case CompressionType::kNone:
@@ -136,10 +169,25 @@ absl::Status CompressorOptions::FromString(absl::string_view text) {
                 }));
       case CompressionType::kSnappy:
         return ValueParser::FailIfSeen("snappy");
+      case CompressionType::kLz4:
+        return ValueParser::FailIfSeen("lz4");
     }
     RIEGELI_ASSERT_UNREACHABLE() << "Unknown compression type: "
                                  << static_cast<unsigned>(compression_type_);
   }());
+  options_parser.AddOption(
+      "min_compression_ratio",
+      ValueParser::And(
+          ValueParser::Real(1.0, std::numeric_limits<double>::max(),
+                            &min_compression_ratio),
+          [this, &min_compression_ratio](ValueParser& value_parser) {
+            min_compression_ratio_ = min_compression_ratio;
+            return true;
+          }));
+  options_parser.AddOption(
+      "hardware_offload",
+      ValueParser::Enum({{"", true}, {"true", true}, {"false", false}},
+                        &hardware_offload_));
   if (ABSL_PREDICT_FALSE(!options_parser.FromString(text))) {
     return options_parser.status();
   }
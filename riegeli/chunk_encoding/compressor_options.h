@@ -21,8 +21,10 @@
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "riegeli/base/base.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/brotli/brotli_writer.h"
 #include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/lz4/lz4_writer.h"
 #include "riegeli/zstd/zstd_writer.h"
 
 namespace riegeli {
@@ -39,10 +41,15 @@ class CompressorOptions {
   //     "brotli" (":" brotli_level)? |
   //     "zstd" (":" zstd_level)? |
   //     "snappy" |
-  //     "window_log" ":" window_log
+  //     "lz4" (":" lz4_level)? |
+  //     "window_log" ":" window_log |
+  //     "min_compression_ratio" ":" min_compression_ratio |
+  //     "hardware_offload" (":" ("true" | "false"))?
   //   brotli_level ::= integer in the range [0..11] (default 6)
   //   zstd_level ::= integer in the range [-131072..22] (default 3)
+  //   lz4_level ::= integer in the range [-65536..12] (default 0)
   //   window_log ::= "auto" or integer in the range [10..31]
+  //   min_compression_ratio ::= real not smaller than 1
   // ```
   //
   // Returns status:
@@ -125,6 +132,35 @@ class CompressorOptions {
   }
   CompressorOptions&& set_snappy() && { return std::move(set_snappy()); }
 
+  // Changes compression algorithm to LZ4. Sets compression level which tunes
+  // the tradeoff between compression density and compression speed (higher =
+  // better density but slower).
+  //
+  // LZ4 typically decompresses faster than Snappy, with similar compression
+  // density at low levels.
+  //
+  // `compression_level` must be between `kMinLz4` (-65536) and `kMaxLz4` (12).
+  // Levels below 3 use the fast LZ4 compressor, levels 3 and above use LZ4HC.
+  // Default: `kDefaultLz4` (0).
+  static constexpr int kMinLz4 = Lz4WriterBase::Options::kMinCompressionLevel;
+  static constexpr int kMaxLz4 = Lz4WriterBase::Options::kMaxCompressionLevel;
+  static constexpr int kDefaultLz4 =
+      Lz4WriterBase::Options::kDefaultCompressionLevel;
+  CompressorOptions& set_lz4(int compression_level = kDefaultLz4) & {
+    RIEGELI_ASSERT_GE(compression_level, kMinLz4)
+        << "Failed precondition of CompressorOptions::set_lz4(): "
+           "compression level out of range";
+    RIEGELI_ASSERT_LE(compression_level, kMaxLz4)
+        << "Failed precondition of CompressorOptions::set_lz4(): "
+           "compression level out of range";
+    compression_type_ = CompressionType::kLz4;
+    compression_level_ = compression_level;
+    return *this;
+  }
+  CompressorOptions&& set_lz4(int compression_level = kDefaultLz4) && {
+    return std::move(set_lz4(compression_level));
+  }
+
   CompressionType compression_type() const { return compression_type_; }
 
   int compression_level() const { return compression_level_; }
@@ -136,7 +172,7 @@ class CompressorOptions {
   // Special value `absl::nullopt` means to keep the default (Brotli: 22,
   // Zstd: derived from compression level and chunk size).
   //
-  // For Uncompressed and Snappy, `window_log` must be `absl::nullopt`.
+  // For Uncompressed, Snappy, and LZ4, `window_log` must be `absl::nullopt`.
   //
   // For Brotli, `window_log` must be `absl::nullopt` or between
   // `BrotliWriterBase::Options::kMinWindowLog` (10) and
@@ -171,6 +207,119 @@ class CompressorOptions {
   }
   absl::optional<int> window_log() const { return window_log_; }
 
+  // Zstd dictionary. This improves compression of small chunks whose records
+  // share content with the dictionary.
+  //
+  // A `RecordWriter` stores the dictionary in the file metadata, from where a
+  // `RecordReader` loads it automatically.
+  //
+  // Used only for Zstd.
+  //
+  // Default: `ZstdWriterBase::Dictionary()` (no dictionary).
+  CompressorOptions& set_zstd_dictionary(
+      const ZstdWriterBase::Dictionary& zstd_dictionary) & {
+    zstd_dictionary_ = zstd_dictionary;
+    return *this;
+  }
+  CompressorOptions& set_zstd_dictionary(
+      ZstdWriterBase::Dictionary&& zstd_dictionary) & {
+    zstd_dictionary_ = std::move(zstd_dictionary);
+    return *this;
+  }
+  CompressorOptions&& set_zstd_dictionary(
+      const ZstdWriterBase::Dictionary& zstd_dictionary) && {
+    return std::move(set_zstd_dictionary(zstd_dictionary));
+  }
+  CompressorOptions&& set_zstd_dictionary(
+      ZstdWriterBase::Dictionary&& zstd_dictionary) && {
+    return std::move(set_zstd_dictionary(std::move(zstd_dictionary)));
+  }
+  ZstdWriterBase::Dictionary& zstd_dictionary() { return zstd_dictionary_; }
+  const ZstdWriterBase::Dictionary& zstd_dictionary() const {
+    return zstd_dictionary_;
+  }
+
+  // Brotli shared dictionary. This improves compression of small chunks whose
+  // records share content with the dictionary, without increasing chunk size.
+  //
+  // A `RecordWriter` stores an identifier of the dictionary in the file
+  // metadata. The dictionary itself is not stored, it must be given to a
+  // `RecordReader` which verifies the identifier.
+  //
+  // Used only for Brotli.
+  //
+  // Default: `BrotliDictionary()` (no dictionary).
+  CompressorOptions& set_brotli_dictionary(
+      const BrotliDictionary& brotli_dictionary) & {
+    brotli_dictionary_ = brotli_dictionary;
+    return *this;
+  }
+  CompressorOptions& set_brotli_dictionary(
+      BrotliDictionary&& brotli_dictionary) & {
+    brotli_dictionary_ = std::move(brotli_dictionary);
+    return *this;
+  }
+  CompressorOptions&& set_brotli_dictionary(
+      const BrotliDictionary& brotli_dictionary) && {
+    return std::move(set_brotli_dictionary(brotli_dictionary));
+  }
+  CompressorOptions&& set_brotli_dictionary(
+      BrotliDictionary&& brotli_dictionary) && {
+    return std::move(set_brotli_dictionary(std::move(brotli_dictionary)));
+  }
+  BrotliDictionary& brotli_dictionary() { return brotli_dictionary_; }
+  const BrotliDictionary& brotli_dictionary() const {
+    return brotli_dictionary_;
+  }
+
+  // If not `absl::nullopt`, compression is adaptive: a sample of each chunk is
+  // compressed first, and if it does not shrink by at least this factor
+  // (uncompressed size / compressed size), the chunk is stored uncompressed.
+  // This avoids wasting CPU on data which are already compressed. The cost is
+  // that a chunk being encoded is kept uncompressed in memory.
+  //
+  // This needs no support from readers because each chunk stores its own
+  // compression type.
+  //
+  // Ignored for Uncompressed.
+  //
+  // `min_compression_ratio` must be `absl::nullopt` or at least 1.
+  //
+  // Default: `absl::nullopt` (always compress).
+  CompressorOptions& set_min_compression_ratio(
+      absl::optional<double> min_compression_ratio) & {
+    if (min_compression_ratio != absl::nullopt) {
+      RIEGELI_ASSERT_GE(*min_compression_ratio, 1.0)
+          << "Failed precondition of "
+             "CompressorOptions::set_min_compression_ratio(): "
+             "minimum compression ratio out of range";
+    }
+    min_compression_ratio_ = min_compression_ratio;
+    return *this;
+  }
+  CompressorOptions&& set_min_compression_ratio(
+      absl::optional<double> min_compression_ratio) && {
+    return std::move(set_min_compression_ratio(min_compression_ratio));
+  }
+  absl::optional<double> min_compression_ratio() const {
+    return min_compression_ratio_;
+  }
+
+  // If `true`, compression is offloaded to a hardware accelerator if available,
+  // falling back to software otherwise. Compressed data are the same format.
+  //
+  // Used only for Zstd, see `ZstdWriterBase::Options::set_hardware_offload()`.
+  //
+  // Default: `false`.
+  CompressorOptions& set_hardware_offload(bool hardware_offload) & {
+    hardware_offload_ = hardware_offload;
+    return *this;
+  }
+  CompressorOptions&& set_hardware_offload(bool hardware_offload) && {
+    return std::move(set_hardware_offload(hardware_offload));
+  }
+  bool hardware_offload() const { return hardware_offload_; }
+
   // Returns `window_log()` translated for `BrotliWriter`.
   //
   // Precondition: `compression_type() == CompressionType::kBrotli`
@@ -185,6 +334,10 @@ class CompressorOptions {
   CompressionType compression_type_ = CompressionType::kBrotli;
   int compression_level_ = kDefaultBrotli;
   absl::optional<int> window_log_;
+  ZstdWriterBase::Dictionary zstd_dictionary_;
+  BrotliDictionary brotli_dictionary_;
+  absl::optional<double> min_compression_ratio_;
+  bool hardware_offload_ = false;
 };
 
 }  // namespace riegeli
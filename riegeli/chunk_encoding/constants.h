@@ -29,7 +29,11 @@ enum class ChunkType : uint8_t {
   kFileMetadata = 'm',
   kPadding = 'p',
   kSimple = 'r',
+  kDeduplicated = 'd',
+  kPrefixed = 'R',
   kTransposed = 't',
+  kTransposedV2 = 'T',
+  kIndex = 'i',
 };
 
 // These values are frozen in the file format.
@@ -38,6 +42,7 @@ enum class CompressionType : uint8_t {
   kBrotli = 'b',
   kZstd = 'z',
   kSnappy = 's',
+  kLz4 = 'l',
 };
 
 RIEGELI_INTERNAL_INLINE_CONSTEXPR(uint64_t, kMaxNumRecords,
@@ -30,10 +30,13 @@
 #include "riegeli/base/chain.h"
 #include "riegeli/base/dependency.h"
 #include "riegeli/base/object.h"
+#include "riegeli/brotli/brotli_allocator.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/brotli/brotli_reader.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/bytes/wrapped_reader.h"
 #include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/lz4/lz4_reader.h"
 #include "riegeli/snappy/snappy_reader.h"
 #include "riegeli/varint/varint_reading.h"
 #include "riegeli/zstd/zstd_reader.h"
@@ -62,15 +65,30 @@ class Decompressor : public Object {
   Decompressor() noexcept : Object(kInitiallyClosed) {}
 
   // Will read from the compressed stream provided by `src`.
-  explicit Decompressor(const Src& src, CompressionType compression_type);
-  explicit Decompressor(Src&& src, CompressionType compression_type);
+  //
+  // `zstd_dictionary` is used if `compression_type` is `kZstd`, and
+  // `brotli_dictionary` is used if `compression_type` is `kBrotli`. They must
+  // be the dictionaries used for compression, if any.
+  explicit Decompressor(
+      const Src& src, CompressionType compression_type,
+      ZstdReaderBase::Dictionary zstd_dictionary =
+          ZstdReaderBase::Dictionary(),
+      BrotliDictionary brotli_dictionary = BrotliDictionary());
+  explicit Decompressor(
+      Src&& src, CompressionType compression_type,
+      ZstdReaderBase::Dictionary zstd_dictionary =
+          ZstdReaderBase::Dictionary(),
+      BrotliDictionary brotli_dictionary = BrotliDictionary());
 
   // Will read from the compressed stream provided by a `Src` constructed from
   // elements of `src_args`. This avoids constructing a temporary `Src` and
   // moving from it.
   template <typename... SrcArgs>
-  explicit Decompressor(std::tuple<SrcArgs...> src_args,
-                        CompressionType compression_type);
+  explicit Decompressor(
+      std::tuple<SrcArgs...> src_args, CompressionType compression_type,
+      ZstdReaderBase::Dictionary zstd_dictionary =
+          ZstdReaderBase::Dictionary(),
+      BrotliDictionary brotli_dictionary = BrotliDictionary());
 
   Decompressor(Decompressor&& that) noexcept;
   Decompressor& operator=(Decompressor&& that) noexcept;
@@ -78,10 +96,22 @@ class Decompressor : public Object {
   // Makes `*this` equivalent to a newly constructed `Decompressor`. This avoids
   // constructing a temporary `Decompressor` and moving from it.
   void Reset();
-  void Reset(const Src& src, CompressionType compression_type);
-  void Reset(Src&& src, CompressionType compression_type);
+  void Reset(
+      const Src& src, CompressionType compression_type,
+      ZstdReaderBase::Dictionary zstd_dictionary =
+          ZstdReaderBase::Dictionary(),
+      BrotliDictionary brotli_dictionary = BrotliDictionary());
+  void Reset(
+      Src&& src, CompressionType compression_type,
+      ZstdReaderBase::Dictionary zstd_dictionary =
+          ZstdReaderBase::Dictionary(),
+      BrotliDictionary brotli_dictionary = BrotliDictionary());
   template <typename... SrcArgs>
-  void Reset(std::tuple<SrcArgs...> src_args, CompressionType compression_type);
+  void Reset(
+      std::tuple<SrcArgs...> src_args, CompressionType compression_type,
+      ZstdReaderBase::Dictionary zstd_dictionary =
+          ZstdReaderBase::Dictionary(),
+      BrotliDictionary brotli_dictionary = BrotliDictionary());
 
   // Returns the `Reader` from which uncompressed data should be read.
   //
@@ -109,7 +139,9 @@ class Decompressor : public Object {
 
  private:
   template <typename SrcInit>
-  void Initialize(SrcInit&& src_init, CompressionType compression_type);
+  void Initialize(SrcInit&& src_init, CompressionType compression_type,
+                  ZstdReaderBase::Dictionary&& zstd_dictionary,
+                  BrotliDictionary&& brotli_dictionary);
 
   std::unique_ptr<Reader> reader_;
 };
@@ -117,25 +149,34 @@ class Decompressor : public Object {
 // Implementation details follow.
 
 template <typename Src>
-inline Decompressor<Src>::Decompressor(const Src& src,
-                                       CompressionType compression_type)
+inline Decompressor<Src>::Decompressor(
+    const Src& src, CompressionType compression_type,
+    ZstdReaderBase::Dictionary zstd_dictionary,
+    BrotliDictionary brotli_dictionary)
     : Object(kInitiallyOpen) {
-  Initialize(src, compression_type);
+  Initialize(src, compression_type, std::move(zstd_dictionary),
+             std::move(brotli_dictionary));
 }
 
 template <typename Src>
-inline Decompressor<Src>::Decompressor(Src&& src,
-                                       CompressionType compression_type)
+inline Decompressor<Src>::Decompressor(
+    Src&& src, CompressionType compression_type,
+    ZstdReaderBase::Dictionary zstd_dictionary,
+    BrotliDictionary brotli_dictionary)
     : Object(kInitiallyOpen) {
-  Initialize(std::move(src), compression_type);
+  Initialize(std::move(src), compression_type, std::move(zstd_dictionary),
+             std::move(brotli_dictionary));
 }
 
 template <typename Src>
 template <typename... SrcArgs>
-inline Decompressor<Src>::Decompressor(std::tuple<SrcArgs...> src_args,
-                                       CompressionType compression_type)
+inline Decompressor<Src>::Decompressor(
+    std::tuple<SrcArgs...> src_args, CompressionType compression_type,
+    ZstdReaderBase::Dictionary zstd_dictionary,
+    BrotliDictionary brotli_dictionary)
     : Object(kInitiallyOpen) {
-  Initialize(std::move(src_args), compression_type);
+  Initialize(std::move(src_args), compression_type, std::move(zstd_dictionary),
+             std::move(brotli_dictionary));
 }
 
 template <typename Src>
@@ -162,31 +203,42 @@ inline void Decompressor<Src>::Reset() {
 }
 
 template <typename Src>
-inline void Decompressor<Src>::Reset(const Src& src,
-                                     CompressionType compression_type) {
+inline void Decompressor<Src>::Reset(
+    const Src& src, CompressionType compression_type,
+    ZstdReaderBase::Dictionary zstd_dictionary,
+    BrotliDictionary brotli_dictionary) {
   Object::Reset(kInitiallyOpen);
-  Initialize(src, compression_type);
+  Initialize(src, compression_type, std::move(zstd_dictionary),
+             std::move(brotli_dictionary));
 }
 
 template <typename Src>
-inline void Decompressor<Src>::Reset(Src&& src,
-                                     CompressionType compression_type) {
+inline void Decompressor<Src>::Reset(
+    Src&& src, CompressionType compression_type,
+    ZstdReaderBase::Dictionary zstd_dictionary,
+    BrotliDictionary brotli_dictionary) {
   Object::Reset(kInitiallyOpen);
-  Initialize(std::move(src), compression_type);
+  Initialize(std::move(src), compression_type, std::move(zstd_dictionary),
+             std::move(brotli_dictionary));
 }
 
 template <typename Src>
 template <typename... SrcArgs>
-inline void Decompressor<Src>::Reset(std::tuple<SrcArgs...> src_args,
-                                     CompressionType compression_type) {
+inline void Decompressor<Src>::Reset(
+    std::tuple<SrcArgs...> src_args, CompressionType compression_type,
+    ZstdReaderBase::Dictionary zstd_dictionary,
+    BrotliDictionary brotli_dictionary) {
   Object::Reset(kInitiallyOpen);
-  Initialize(std::move(src_args), compression_type);
+  Initialize(std::move(src_args), compression_type, std::move(zstd_dictionary),
+             std::move(brotli_dictionary));
 }
 
 template <typename Src>
 template <typename SrcInit>
-void Decompressor<Src>::Initialize(SrcInit&& src_init,
-                                   CompressionType compression_type) {
+void Decompressor<Src>::Initialize(
+    SrcInit&& src_init, CompressionType compression_type,
+    ZstdReaderBase::Dictionary&& zstd_dictionary,
+    BrotliDictionary&& brotli_dictionary) {
   if (compression_type == CompressionType::kNone) {
     reader_ =
         absl::make_unique<WrappedReader<Src>>(std::forward<SrcInit>(src_init));
@@ -206,17 +258,27 @@ void Decompressor<Src>::Initialize(SrcInit&& src_init,
       RIEGELI_ASSERT_UNREACHABLE() << "kNone handled above";
     case CompressionType::kBrotli:
       reader_ = absl::make_unique<BrotliReader<Src>>(
-          std::move(compressed_reader.manager()));
+          std::move(compressed_reader.manager()),
+          BrotliReaderBase::Options()
+              .set_dictionary(std::move(brotli_dictionary))
+              .set_allocator(BrotliAllocator::Recycling()));
       return;
     case CompressionType::kZstd:
       reader_ = absl::make_unique<ZstdReader<Src>>(
           std::move(compressed_reader.manager()),
-          ZstdReaderBase::Options().set_size_hint(*uncompressed_size));
+          ZstdReaderBase::Options()
+              .set_dictionary(std::move(zstd_dictionary))
+              .set_size_hint(*uncompressed_size));
       return;
     case CompressionType::kSnappy:
       reader_ = absl::make_unique<SnappyReader<Src>>(
           std::move(compressed_reader.manager()));
       return;
+    case CompressionType::kLz4:
+      reader_ = absl::make_unique<Lz4Reader<Src>>(
+          std::move(compressed_reader.manager()),
+          Lz4ReaderBase::Options().set_size_hint(*uncompressed_size));
+      return;
   }
   Fail(absl::UnimplementedError(absl::StrCat(
       "Unknown compression type: ", static_cast<unsigned>(compression_type))));
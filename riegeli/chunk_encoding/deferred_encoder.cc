@@ -17,6 +17,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <limits>
 #include <memory>
 #include <tuple>
@@ -27,6 +28,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
@@ -38,9 +40,17 @@
 
 namespace riegeli {
 
+// Before C++17 if a constexpr static data member is ODR-used, its definition at
+// namespace scope is required. Since C++17 these definitions are deprecated:
+// http://en.cppreference.com/w/cpp/language/static
+#if __cplusplus < 201703
+constexpr size_t DeferredEncoder::kDefaultSampleSize;
+#endif
+
 void DeferredEncoder::Clear() {
   ChunkEncoder::Clear();
   base_encoder_->Clear();
+  if (fallback_encoder_ != nullptr) fallback_encoder_->Clear();
   records_writer_.Reset(std::forward_as_tuple());
   limits_.clear();
 }
@@ -140,16 +150,92 @@ bool DeferredEncoder::EncodeAndClose(Writer& dest, ChunkType& chunk_type,
                                      uint64_t& num_records,
                                      uint64_t& decoded_data_size) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  const absl::Time encode_start = absl::Now();
   if (ABSL_PREDICT_FALSE(!records_writer_.Close())) {
     return Fail(records_writer_);
   }
-  if (ABSL_PREDICT_FALSE(!base_encoder_->AddRecords(
+  ChunkEncoder* encoder = base_encoder_.get();
+  if (fallback_encoder_ != nullptr && !limits_.empty()) {
+    const size_t num_sample_records = UnsignedMax(
+        IntCast<size_t>(
+            std::upper_bound(limits_.begin(), limits_.end(), sample_size_) -
+            limits_.begin()),
+        size_t{1});
+    Chain base_encoded, fallback_encoded;
+    ChunkType base_chunk_type, fallback_chunk_type;
+    uint64_t base_num_records, fallback_num_records;
+    uint64_t base_decoded_data_size, fallback_decoded_data_size;
+    if (ABSL_PREDICT_FALSE(!TrialEncode(*base_encoder_, num_sample_records,
+                                        base_encoded, base_chunk_type,
+                                        base_num_records,
+                                        base_decoded_data_size)) ||
+        ABSL_PREDICT_FALSE(!TrialEncode(
+            *fallback_encoder_, num_sample_records, fallback_encoded,
+            fallback_chunk_type, fallback_num_records,
+            fallback_decoded_data_size))) {
+      return false;
+    }
+    const bool use_base =
+        static_cast<long double>(base_encoded.size()) <=
+        static_cast<long double>(fallback_encoded.size()) *
+            (1.0L - static_cast<long double>(min_base_gain_));
+    if (!use_base) encoder = fallback_encoder_.get();
+    if (num_sample_records == limits_.size()) {
+      // The sample covers the whole chunk, so its trial encoding is final.
+      if (use_base) {
+        chunk_type = base_chunk_type;
+        num_records = base_num_records;
+        decoded_data_size = base_decoded_data_size;
+      } else {
+        chunk_type = fallback_chunk_type;
+        num_records = fallback_num_records;
+        decoded_data_size = fallback_decoded_data_size;
+      }
+      if (ABSL_PREDICT_FALSE(
+              !dest.Write(std::move(use_base ? base_encoded
+                                             : fallback_encoded)))) {
+        return Fail(dest);
+      }
+      stats_ = encoder->stats();
+      stats_.encode_time = absl::Now() - encode_start;
+      return Close();
+    }
+    encoder->Clear();
+  }
+  if (ABSL_PREDICT_FALSE(!encoder->AddRecords(
           std::move(records_writer_.dest()), std::move(limits_))) ||
-      ABSL_PREDICT_FALSE(!base_encoder_->EncodeAndClose(
-          dest, chunk_type, num_records, decoded_data_size))) {
-    Fail(*base_encoder_);
+      ABSL_PREDICT_FALSE(!encoder->EncodeAndClose(dest, chunk_type, num_records,
+                                                  decoded_data_size))) {
+    Fail(*encoder);
   }
+  // Adding records to `*encoder` and trial encoding are a part of encoding
+  // here.
+  stats_ = encoder->stats();
+  stats_.encode_time = absl::Now() - encode_start;
   return Close();
 }
 
+bool DeferredEncoder::TrialEncode(ChunkEncoder& encoder, size_t num_records,
+                                  Chain& dest, ChunkType& chunk_type,
+                                  uint64_t& num_records_encoded,
+                                  uint64_t& decoded_data_size) {
+  RIEGELI_ASSERT_GT(num_records, 0u)
+      << "Failed precondition of DeferredEncoder::TrialEncode(): no records";
+  RIEGELI_ASSERT_LE(num_records, limits_.size())
+      << "Failed precondition of DeferredEncoder::TrialEncode(): "
+         "not enough records";
+  const Chain& records = records_writer_.dest();
+  ChainWriter<> dest_writer(&dest);
+  if (ABSL_PREDICT_FALSE(!encoder.AddRecords(
+          records.Substr(0, limits_[num_records - 1]),
+          std::vector<size_t>(limits_.begin(),
+                              limits_.begin() + num_records))) ||
+      ABSL_PREDICT_FALSE(!encoder.EncodeAndClose(
+          dest_writer, chunk_type, num_records_encoded, decoded_data_size))) {
+    return Fail(encoder);
+  }
+  if (ABSL_PREDICT_FALSE(!dest_writer.Close())) return Fail(dest_writer);
+  return true;
+}
+
 }  // namespace riegeli
@@ -26,6 +26,7 @@
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
 #include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/bytes/chain_writer.h"
 #include "riegeli/bytes/writer.h"
@@ -38,10 +39,32 @@ namespace riegeli {
 // `DeferredEncoder` performs a minimal amount of the encoding work in
 // `AddRecord()`, deferring as much as possible to `EncodeAndClose()`.
 // It does more memory copying than the base encoder though.
+//
+// Having all records of a chunk at hand, `DeferredEncoder` can also choose the
+// encoder per chunk: if `fallback_encoder` is given, a sample of records is
+// trial-encoded with both encoders, and `base_encoder` is used only if its
+// output is smaller by at least the fraction `min_base_gain`. This suits a
+// `base_encoder` which is more expensive and usually, but not always, better,
+// e.g. `TransposeEncoder` with `SimpleEncoder` as the fallback.
 class DeferredEncoder : public ChunkEncoder {
  public:
+  // Default for `sample_size`.
+  static constexpr size_t kDefaultSampleSize = size_t{64} << 10;
+
   explicit DeferredEncoder(std::unique_ptr<ChunkEncoder> base_encoder);
 
+  // Will encode a chunk with `base_encoder` or `fallback_encoder`, whichever
+  // is chosen by trial-encoding its first records, up to `sample_size` bytes
+  // but at least one record.
+  //
+  // If the sample covers all records, its trial encoding is used directly.
+  //
+  // Precondition: `min_base_gain` in the range [0..1]
+  explicit DeferredEncoder(std::unique_ptr<ChunkEncoder> base_encoder,
+                           std::unique_ptr<ChunkEncoder> fallback_encoder,
+                           double min_base_gain,
+                           size_t sample_size = kDefaultSampleSize);
+
   void Clear() override;
 
   using ChunkEncoder::AddRecord;
@@ -64,7 +87,17 @@ class DeferredEncoder : public ChunkEncoder {
   template <typename Record>
   bool AddRecordImpl(Record&& record);
 
+  // Encodes the first `num_records` records with `encoder` to `dest`.
+  bool TrialEncode(ChunkEncoder& encoder, size_t num_records, Chain& dest,
+                   ChunkType& chunk_type, uint64_t& num_records_encoded,
+                   uint64_t& decoded_data_size);
+
   std::unique_ptr<ChunkEncoder> base_encoder_;
+  // If not `nullptr`, used instead of `base_encoder_` for chunks for which
+  // `base_encoder_` does not give enough gain.
+  std::unique_ptr<ChunkEncoder> fallback_encoder_;
+  double min_base_gain_ = 0.0;
+  size_t sample_size_ = 0;
   // `Writer` of concatenated record values.
   ChainWriter<Chain> records_writer_;
   // Sorted record end positions.
@@ -83,6 +116,23 @@ inline DeferredEncoder::DeferredEncoder(
     : base_encoder_(std::move(base_encoder)),
       records_writer_(std::forward_as_tuple()) {}
 
+inline DeferredEncoder::DeferredEncoder(
+    std::unique_ptr<ChunkEncoder> base_encoder,
+    std::unique_ptr<ChunkEncoder> fallback_encoder, double min_base_gain,
+    size_t sample_size)
+    : base_encoder_(std::move(base_encoder)),
+      fallback_encoder_(std::move(fallback_encoder)),
+      min_base_gain_(min_base_gain),
+      sample_size_(sample_size),
+      records_writer_(std::forward_as_tuple()) {
+  RIEGELI_ASSERT_GE(min_base_gain, 0.0)
+      << "Failed precondition of DeferredEncoder::DeferredEncoder(): "
+         "min_base_gain out of range";
+  RIEGELI_ASSERT_LE(min_base_gain, 1.0)
+      << "Failed precondition of DeferredEncoder::DeferredEncoder(): "
+         "min_base_gain out of range";
+}
+
 }  // namespace riegeli
 
 #endif  // RIEGELI_CHUNK_ENCODING_DEFERRED_ENCODER_H_
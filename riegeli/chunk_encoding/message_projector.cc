@@ -0,0 +1,218 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/chunk_encoding/message_projector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "absl/base/optimization.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/chunk_encoding/field_projection.h"
+#include "riegeli/messages/message_wire_format.h"
+#include "riegeli/varint/varint_reading.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+namespace internal {
+
+namespace {
+
+// Appends `data` as a varint to `dest`.
+void AppendVarint32(uint32_t data, std::string& dest) {
+  char buffer[kMaxLengthVarint32];
+  const char* const end = WriteVarint32(data, buffer);
+  dest.append(buffer, PtrDistance(buffer, end));
+}
+
+// Skips the value of a field with `tag` whose value starts at `cursor`.
+// For a group, skips everything up to and including its end.
+//
+// Returns the position after the field, or `nullptr` if the data are invalid.
+const char* SkipFieldValue(uint32_t tag, const char* cursor,
+                           const char* limit) {
+  switch (GetTagWireType(tag)) {
+    case WireType::kVarint: {
+      const absl::optional<ReadFromStringResult<uint64_t>> value =
+          ReadVarint64(cursor, limit);
+      if (ABSL_PREDICT_FALSE(value == absl::nullopt)) return nullptr;
+      return value->cursor;
+    }
+    case WireType::kFixed32:
+      if (ABSL_PREDICT_FALSE(PtrDistance(cursor, limit) < sizeof(uint32_t))) {
+        return nullptr;
+      }
+      return cursor + sizeof(uint32_t);
+    case WireType::kFixed64:
+      if (ABSL_PREDICT_FALSE(PtrDistance(cursor, limit) < sizeof(uint64_t))) {
+        return nullptr;
+      }
+      return cursor + sizeof(uint64_t);
+    case WireType::kLengthDelimited: {
+      const absl::optional<ReadFromStringResult<uint32_t>> length =
+          ReadVarint32(cursor, limit);
+      if (ABSL_PREDICT_FALSE(length == absl::nullopt ||
+                             length->value >
+                                 PtrDistance(length->cursor, limit))) {
+        return nullptr;
+      }
+      return length->cursor + length->value;
+    }
+    case WireType::kStartGroup:
+      for (;;) {
+        const absl::optional<ReadFromStringResult<uint32_t>> inner_tag =
+            ReadVarint32(cursor, limit);
+        if (ABSL_PREDICT_FALSE(inner_tag == absl::nullopt ||
+                               GetTagFieldNumber(inner_tag->value) == 0)) {
+          return nullptr;
+        }
+        if (GetTagWireType(inner_tag->value) == WireType::kEndGroup) {
+          if (ABSL_PREDICT_FALSE(GetTagFieldNumber(inner_tag->value) !=
+                                 GetTagFieldNumber(tag))) {
+            return nullptr;
+          }
+          return inner_tag->cursor;
+        }
+        cursor = SkipFieldValue(inner_tag->value, inner_tag->cursor, limit);
+        if (ABSL_PREDICT_FALSE(cursor == nullptr)) return nullptr;
+      }
+    case WireType::kEndGroup:
+      return nullptr;
+  }
+  return nullptr;
+}
+
+// Appends a field with `tag` and the default value to `dest`.
+void AppendDefaultField(uint32_t tag, std::string& dest) {
+  AppendVarint32(tag, dest);
+  switch (GetTagWireType(tag)) {
+    case WireType::kVarint:
+    case WireType::kLengthDelimited:
+      dest.push_back('\0');
+      return;
+    case WireType::kFixed32:
+      dest.append(sizeof(uint32_t), '\0');
+      return;
+    case WireType::kFixed64:
+      dest.append(sizeof(uint64_t), '\0');
+      return;
+    case WireType::kStartGroup:
+      AppendVarint32(
+          MakeTag(GetTagFieldNumber(tag), WireType::kEndGroup), dest);
+      return;
+    case WireType::kEndGroup:
+      break;
+  }
+  RIEGELI_ASSERT_UNREACHABLE()
+      << "Unexpected wire type: " << static_cast<uint32_t>(GetTagWireType(tag));
+}
+
+}  // namespace
+
+MessageProjector::MessageProjector(const FieldProjection& field_projection) {
+  RIEGELI_ASSERT(!field_projection.includes_all())
+      << "Failed precondition of MessageProjector: projection includes all";
+  nodes_.emplace_back();
+  for (const Field& field : field_projection.fields()) {
+    uint32_t node_index = 0;
+    bool existence_only = false;
+    for (const int field_number : field.path()) {
+      if (field_number == Field::kExistenceOnly) {
+        existence_only = true;
+        break;
+      }
+      const auto inserted = nodes_[node_index].children.emplace(
+          field_number, IntCast<uint32_t>(nodes_.size()));
+      const uint32_t child_index = inserted.first->second;
+      if (inserted.second) nodes_.emplace_back();
+      node_index = child_index;
+    }
+    if (existence_only) {
+      nodes_[node_index].existence_only = true;
+    } else {
+      nodes_[node_index].include_all = true;
+    }
+  }
+}
+
+void MessageProjector::Project(absl::string_view record,
+                               std::string& dest) const {
+  const size_t dest_size = dest.size();
+  if (ABSL_PREDICT_FALSE(!ProjectMessage(0, record, dest))) {
+    dest.resize(dest_size);
+    dest.append(record.data(), record.size());
+  }
+}
+
+bool MessageProjector::ProjectMessage(uint32_t node_index,
+                                      absl::string_view src,
+                                      std::string& dest) const {
+  const Node& node = nodes_[node_index];
+  const char* cursor = src.data();
+  const char* const limit = src.data() + src.size();
+  std::string submessage;
+  while (cursor < limit) {
+    const char* const field_begin = cursor;
+    const absl::optional<ReadFromStringResult<uint32_t>> tag =
+        ReadVarint32(cursor, limit);
+    if (ABSL_PREDICT_FALSE(tag == absl::nullopt ||
+                           GetTagFieldNumber(tag->value) == 0)) {
+      return false;
+    }
+    cursor = SkipFieldValue(tag->value, tag->cursor, limit);
+    if (ABSL_PREDICT_FALSE(cursor == nullptr)) return false;
+    const auto child = node.children.find(GetTagFieldNumber(tag->value));
+    if (child == node.children.end()) continue;
+    const Node& child_node = nodes_[child->second];
+    if (child_node.include_all) {
+      dest.append(field_begin, PtrDistance(field_begin, cursor));
+      continue;
+    }
+    if (!child_node.children.empty()) {
+      if (GetTagWireType(tag->value) != WireType::kLengthDelimited) {
+        // A group or a scalar on a projection path: keep it whole.
+        dest.append(field_begin, PtrDistance(field_begin, cursor));
+        continue;
+      }
+      const absl::optional<ReadFromStringResult<uint32_t>> length =
+          ReadVarint32(tag->cursor, cursor);
+      RIEGELI_ASSERT(length != absl::nullopt)
+          << "Length of a field should have been validated";
+      submessage.clear();
+      if (ABSL_PREDICT_FALSE(!ProjectMessage(
+              child->second,
+              absl::string_view(length->cursor, length->value), submessage))) {
+        // Not a valid message: keep it whole.
+        dest.append(field_begin, PtrDistance(field_begin, cursor));
+        continue;
+      }
+      if (submessage.empty() && !child_node.existence_only) continue;
+      dest.append(field_begin, PtrDistance(field_begin, tag->cursor));
+      AppendVarint32(IntCast<uint32_t>(submessage.size()), dest);
+      dest.append(submessage);
+      continue;
+    }
+    RIEGELI_ASSERT(child_node.existence_only)
+        << "A leaf of a projection tree should be included";
+    AppendDefaultField(tag->value, dest);
+  }
+  return true;
+}
+
+}  // namespace internal
+}  // namespace riegeli
@@ -0,0 +1,75 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_CHUNK_ENCODING_MESSAGE_PROJECTOR_H_
+#define RIEGELI_CHUNK_ENCODING_MESSAGE_PROJECTOR_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/chunk_encoding/field_projection.h"
+
+namespace riegeli {
+namespace internal {
+
+// Applies a `FieldProjection` to serialized proto messages by streaming their
+// wire format and copying only included fields, without parsing messages.
+//
+// Like projection of transposed chunks, this does not guarantee exclusion:
+// groups are kept whole if any of their fields is included, and so are
+// length-delimited fields on a projection path which are not valid messages.
+class MessageProjector {
+ public:
+  // Precondition: `!field_projection.includes_all()`
+  explicit MessageProjector(const FieldProjection& field_projection);
+
+  MessageProjector(const MessageProjector&) = delete;
+  MessageProjector& operator=(const MessageProjector&) = delete;
+
+  // Appends `record` with only included fields to `dest`. If `record` is not a
+  // valid proto message, appends it unchanged.
+  void Project(absl::string_view record, std::string& dest) const;
+
+ private:
+  // A node of the tree of field paths to include. The root corresponds to the
+  // whole message.
+  struct Node {
+    // The whole field is included.
+    bool include_all = false;
+    // The field is included with a default value, unless `include_all` or
+    // some of `children` make it included anyway.
+    bool existence_only = false;
+    // Maps field numbers of the submessage to indices of nodes.
+    absl::flat_hash_map<int, uint32_t> children;
+  };
+
+  // Appends fields of the message `src` included by `nodes_[node_index]` to
+  // `dest`.
+  //
+  // Returns `false` if `src` is not a valid proto message, leaving `dest` in an
+  // unspecified state.
+  bool ProjectMessage(uint32_t node_index, absl::string_view src,
+                      std::string& dest) const;
+
+  std::vector<Node> nodes_;
+};
+
+}  // namespace internal
+}  // namespace riegeli
+
+#endif  // RIEGELI_CHUNK_ENCODING_MESSAGE_PROJECTOR_H_
@@ -17,15 +17,22 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <cstring>
 #include <limits>
+#include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
+#include "absl/base/macros.h"
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/limiting_reader.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/chunk_encoding/constants.h"
@@ -40,10 +47,19 @@ void SimpleDecoder::Done() {
   }
 }
 
-bool SimpleDecoder::Decode(Reader* src, uint64_t num_records,
-                           uint64_t decoded_data_size,
+bool SimpleDecoder::Decode(ChunkType chunk_type, Reader* src,
+                           uint64_t num_records, uint64_t decoded_data_size,
+                           const ZstdReaderBase::Dictionary& zstd_dictionary,
+                           const BrotliDictionary& brotli_dictionary,
                            std::vector<size_t>& limits) {
+  RIEGELI_ASSERT(chunk_type == ChunkType::kSimple ||
+                 chunk_type == ChunkType::kDeduplicated ||
+                 chunk_type == ChunkType::kPrefixed)
+      << "Failed precondition of SimpleDecoder::Decode(): "
+         "unexpected chunk type: "
+      << static_cast<uint64_t>(chunk_type);
   Object::Reset(kInitiallyOpen);
+  sources_.clear();
   if (ABSL_PREDICT_FALSE(num_records > limits.max_size())) {
     return Fail(absl::ResourceExhaustedError("Too many records"));
   }
@@ -71,26 +87,53 @@ bool SimpleDecoder::Decode(Reader* src, uint64_t num_records,
     return Fail(absl::ResourceExhaustedError("Size of sizes too large"));
   }
   internal::Decompressor<LimitingReader<>> sizes_decompressor(
-      std::forward_as_tuple(src, src->pos() + *sizes_size), compression_type);
+      std::forward_as_tuple(src, src->pos() + *sizes_size), compression_type,
+      zstd_dictionary, brotli_dictionary);
   if (ABSL_PREDICT_FALSE(!sizes_decompressor.healthy())) {
     return Fail(sizes_decompressor);
   }
   limits.clear();
+  const bool deduplicated = chunk_type == ChunkType::kDeduplicated;
+  bool has_duplicates = false;
   size_t limit = 0;
+  // Record sizes are read in batches, which is faster than one by one.
+  uint64_t sizes[256];
   while (limits.size() != num_records) {
-    const absl::optional<uint64_t> size =
-        ReadVarint64(sizes_decompressor.reader());
-    if (ABSL_PREDICT_FALSE(size == absl::nullopt)) {
+    const size_t batch_size =
+        UnsignedMin(num_records - limits.size(), ABSL_ARRAYSIZE(sizes));
+    if (ABSL_PREDICT_FALSE(!ReadVarint64s(sizes_decompressor.reader(),
+                                          absl::MakeSpan(sizes, batch_size)))) {
       sizes_decompressor.reader().Fail(
           absl::InvalidArgumentError("Reading record size failed"));
       return Fail(sizes_decompressor.reader());
     }
-    if (ABSL_PREDICT_FALSE(*size > decoded_data_size - limit)) {
-      return Fail(
-          absl::InvalidArgumentError("Decoded data size larger than expected"));
+    for (uint64_t size : absl::MakeConstSpan(sizes, batch_size)) {
+      if (deduplicated) {
+        // The lowest bit distinguishes a stored record (0) from a duplicate
+        // (1), whose remaining bits are its distance to an earlier record.
+        if ((size & 1) == 0) {
+          sources_.push_back(limits.size());
+          size >>= 1;
+        } else {
+          const uint64_t distance = size >> 1;
+          if (ABSL_PREDICT_FALSE(distance == 0 || distance > limits.size())) {
+            return Fail(absl::InvalidArgumentError(
+                "Invalid reference to a duplicate record"));
+          }
+          const size_t source = limits.size() - IntCast<size_t>(distance);
+          sources_.push_back(sources_[source]);
+          size = limits[source] -
+                 (source == 0 ? size_t{0} : limits[source - 1]);
+          has_duplicates = true;
+        }
+      }
+      if (ABSL_PREDICT_FALSE(size > decoded_data_size - limit)) {
+        return Fail(absl::InvalidArgumentError(
+            "Decoded data size larger than expected"));
+      }
+      limit += IntCast<size_t>(size);
+      limits.push_back(limit);
     }
-    limit += IntCast<size_t>(*size);
-    limits.push_back(limit);
   }
   if (ABSL_PREDICT_FALSE(!sizes_decompressor.VerifyEndAndClose())) {
     return Fail(sizes_decompressor);
@@ -100,13 +143,51 @@ bool SimpleDecoder::Decode(Reader* src, uint64_t num_records,
         absl::InvalidArgumentError("Decoded data size smaller than expected"));
   }
 
-  values_decompressor_.Reset(src, compression_type);
+  if (!has_duplicates) sources_.clear();
+
+  values_decompressor_.Reset(src, compression_type, zstd_dictionary,
+                             brotli_dictionary);
   if (ABSL_PREDICT_FALSE(!values_decompressor_.healthy())) {
     return Fail(values_decompressor_);
   }
   return true;
 }
 
+bool SimpleDecoder::ReadRecordValues(const std::vector<size_t>& limits,
+                                     Chain& dest) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  const size_t size = limits.empty() ? size_t{0} : limits.back();
+  if (sources_.empty()) {
+    if (ABSL_PREDICT_FALSE(!reader().Read(size, dest))) {
+      reader().Fail(absl::InvalidArgumentError("Reading record values failed"));
+      return Fail(reader());
+    }
+    return true;
+  }
+  RIEGELI_ASSERT_EQ(sources_.size(), limits.size())
+      << "Failed precondition of SimpleDecoder::ReadRecordValues(): "
+         "record end positions do not match the chunk";
+  std::string values(size, '\0');
+  size_t start = 0;
+  for (size_t index = 0; index < limits.size(); ++index) {
+    const size_t limit = limits[index];
+    const size_t source = sources_[index];
+    if (source == index) {
+      if (ABSL_PREDICT_FALSE(!reader().Read(limit - start, &values[start]))) {
+        reader().Fail(
+            absl::InvalidArgumentError("Reading record values failed"));
+        return Fail(reader());
+      }
+    } else {
+      const size_t source_start = source == 0 ? size_t{0} : limits[source - 1];
+      std::memcpy(&values[start], &values[source_start], limit - start);
+    }
+    start = limit;
+  }
+  dest = Chain(std::move(values));
+  return true;
+}
+
 bool SimpleDecoder::VerifyEndAndClose() {
   values_decompressor_.VerifyEnd();
   return Close();
@@ -22,9 +22,13 @@
 
 #include "absl/status/status.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
 #include "riegeli/base/object.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/reader.h"
+#include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/chunk_encoding/decompressor.h"
+#include "riegeli/zstd/zstd_reader.h"
 
 namespace riegeli {
 
@@ -36,10 +40,16 @@ class SimpleDecoder : public Object {
   SimpleDecoder(const SimpleDecoder&) = delete;
   SimpleDecoder& operator=(const SimpleDecoder&) = delete;
 
-  // Resets the `SimpleDecoder` and parses the chunk.
+  // Resets the `SimpleDecoder` and parses the chunk of type `chunk_type`,
+  // which must be `ChunkType::kSimple`, `ChunkType::kDeduplicated`, or
+  // `ChunkType::kPrefixed`. The reference of a `ChunkType::kPrefixed` chunk
+  // must have been already read from `*src`.
   //
-  // Makes concatenated record values available for reading from `reader()`.
-  // Sets `limits` to sorted record end positions.
+  // Makes concatenated record values available for reading with
+  // `ReadRecordValues()`. Sets `limits` to sorted record end positions.
+  //
+  // `zstd_dictionary` is used if the chunk is compressed with Zstd, and
+  // `brotli_dictionary` is used if the chunk is compressed with Brotli.
   //
   // `*src` is not owned by this `SimpleDecoder` and must be kept alive but not
   // accessed until closing the `SimpleDecoder`.
@@ -47,10 +57,24 @@ class SimpleDecoder : public Object {
   // Return values:
   //  * `true`  - success (`healthy()`)
   //  * `false` - failure (`!healthy()`)
-  bool Decode(Reader* src, uint64_t num_records, uint64_t decoded_data_size,
+  bool Decode(ChunkType chunk_type, Reader* src, uint64_t num_records,
+              uint64_t decoded_data_size,
+              const ZstdReaderBase::Dictionary& zstd_dictionary,
+              const BrotliDictionary& brotli_dictionary,
               std::vector<size_t>& limits);
 
-  // Returns the `Reader` from which concatenated record values should be read.
+  // Reads concatenated record values to `dest`, copying values of duplicate
+  // records of a `ChunkType::kDeduplicated` chunk. `limits` must be the record
+  // end positions set by `Decode()`.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool ReadRecordValues(const std::vector<size_t>& limits, Chain& dest);
+
+  // Returns the `Reader` from which stored record values should be read.
+  // Values of duplicate records of a `ChunkType::kDeduplicated` chunk are
+  // stored only once; `ReadRecordValues()` takes care of this.
   //
   // Precondition: `healthy()`
   Reader& reader();
@@ -71,6 +95,9 @@ class SimpleDecoder : public Object {
 
  private:
   internal::Decompressor<> values_decompressor_;
+  // For a `ChunkType::kDeduplicated` chunk with duplicate records: for each
+  // record, the index of the record whose value is stored. Otherwise empty.
+  std::vector<size_t> sources_;
 };
 
 // Implementation details follow.
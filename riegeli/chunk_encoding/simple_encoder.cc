@@ -17,45 +17,153 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <cstring>
 #include <limits>
+#include <memory>
+#include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
 #include "absl/base/optimization.h"
+#include "absl/hash/hash.h"
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/bytes/chain_writer.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
 #include "riegeli/chunk_encoding/compressor.h"
 #include "riegeli/chunk_encoding/compressor_options.h"
 #include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/chunk_encoding/hash.h"
+#include "riegeli/endian/endian_writing.h"
 #include "riegeli/messages/message_serialize.h"
 #include "riegeli/varint/varint_writing.h"
+#include "riegeli/zstd/zstd_writer.h"
 
 namespace riegeli {
 
-SimpleEncoder::SimpleEncoder(CompressorOptions options, uint64_t size_hint)
-    : compression_type_(options.compression_type()),
-      sizes_compressor_(options),
+namespace {
+
+// Record sizes and record values are compressed concurrently only if record
+// sizes are at least this large, i.e. if there are many records. Otherwise
+// compressing record sizes is too cheap to be worth a task.
+constexpr size_t kMinConcurrentSizesSize = size_t{64} << 10;
+
+// Finishes compressing by `compressor` to `dest`, adding the bucket to
+// `stats`.
+absl::Status FinishCompression(internal::Compressor& compressor, Chain& dest,
+                               ChunkStats& stats) {
+  ChainWriter<> dest_writer(&dest);
+  if (ABSL_PREDICT_FALSE(!compressor.EncodeAndClose(dest_writer, stats))) {
+    return compressor.status();
+  }
+  if (ABSL_PREDICT_FALSE(!dest_writer.Close())) return dest_writer.status();
+  return absl::OkStatus();
+}
+
+// Compresses `data` to `dest` with its exact size pledged, adding the bucket
+// to `stats`.
+absl::Status CompressBlock(const CompressorOptions& compressor_options,
+                           Chain&& data, Chain& dest, ChunkStats& stats) {
+  internal::Compressor compressor(
+      compressor_options,
+      internal::Compressor::TuningOptions().set_pledged_size(data.size()));
+  if (ABSL_PREDICT_FALSE(!compressor.writer().Write(std::move(data)))) {
+    return compressor.writer().status();
+  }
+  return FinishCompression(compressor, dest, stats);
+}
+
+// Returns the value of `record` as a flat array, using `scratch` if needed.
+absl::string_view FlatRecord(absl::string_view record, std::string& scratch) {
+  return record;
+}
+
+absl::string_view FlatRecord(const Chain& record, std::string& scratch) {
+  const absl::optional<absl::string_view> flat = record.TryFlat();
+  if (flat != absl::nullopt) return *flat;
+  scratch = std::string(record);
+  return scratch;
+}
+
+absl::string_view FlatRecord(const absl::Cord& record, std::string& scratch) {
+  const absl::optional<absl::string_view> flat = record.TryFlat();
+  if (flat != absl::nullopt) return *flat;
+  scratch = std::string(record);
+  return scratch;
+}
+
+}  // namespace
+
+SimpleEncoder::SimpleEncoder(CompressorOptions options, uint64_t size_hint,
+                             bool reserve_size_hint, bool deduplicate,
+                             std::shared_ptr<Executor> executor,
+                             bool stream_values)
+    : compressor_options_(std::move(options)),
+      executor_(std::move(executor)),
+      stream_values_(stream_values && !deduplicate &&
+                     compressor_options_.compression_type() !=
+                         CompressionType::kNone &&
+                     !internal::IsAdaptive(compressor_options_)),
+      sizes_compressor_(CompressorOptions().set_uncompressed()),
       values_compressor_(
-          options,
-          internal::Compressor::TuningOptions().set_size_hint(size_hint)) {}
+          stream_values_ ? compressor_options_
+                         : CompressorOptions().set_uncompressed(),
+          internal::Compressor::TuningOptions()
+              .set_size_hint(deduplicate ? 0 : size_hint)
+              .set_reserve_size(reserve_size_hint && !deduplicate &&
+                                !stream_values_)),
+      deduplicate_(deduplicate) {}
 
 void SimpleEncoder::Clear() {
   ChunkEncoder::Clear();
   sizes_compressor_.Clear();
   values_compressor_.Clear();
+  distinct_values_.clear();
+  distinct_records_.clear();
+}
+
+void SimpleEncoder::SetReference(const Chain& reference) {
+  RIEGELI_ASSERT(!deduplicate_)
+      << "Failed precondition of SimpleEncoder::SetReference(): "
+         "deduplicated chunks can not be prefixed";
+  RIEGELI_ASSERT(!stream_values_)
+      << "Failed precondition of SimpleEncoder::SetReference(): "
+         "chunks with streamed values can not be prefixed";
+  prefixed_ = true;
+  reference_size_ = IntCast<uint64_t>(reference.size());
+  reference_hash_ = reference.empty() ? 0 : internal::Hash(reference);
+  if (!reference.empty()) {
+    compressor_options_.set_zstd_dictionary(
+        ZstdWriterBase::Dictionary()
+            .set_content_type(ZstdWriterBase::ContentType::kRaw)
+            .set_data(std::string(reference)));
+  }
 }
 
 bool SimpleEncoder::AddRecord(const google::protobuf::MessageLite& record,
                               SerializeOptions serialize_options) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (deduplicate_) {
+    std::string serialized;
+    {
+      absl::Status status = SerializeToString(record, serialized,
+                                              std::move(serialize_options));
+      if (ABSL_PREDICT_FALSE(!status.ok())) {
+        return Fail(std::move(status));
+      }
+    }
+    return AddDeduplicatedRecord(serialized);
+  }
   const size_t size = serialize_options.GetByteSize(record);
   if (ABSL_PREDICT_FALSE(num_records_ == kMaxNumRecords)) {
     return Fail(absl::ResourceExhaustedError("Too many records"));
@@ -103,6 +211,10 @@ bool SimpleEncoder::AddRecord(absl::Cord&& record) {
 template <typename Record>
 bool SimpleEncoder::AddRecordImpl(Record&& record) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (deduplicate_) {
+    std::string scratch;
+    return AddDeduplicatedRecord(FlatRecord(record, scratch));
+  }
   if (ABSL_PREDICT_FALSE(num_records_ == kMaxNumRecords)) {
     return Fail(absl::ResourceExhaustedError("Too many records"));
   }
@@ -123,11 +235,63 @@ bool SimpleEncoder::AddRecordImpl(Record&& record) {
   return true;
 }
 
+bool SimpleEncoder::AddDeduplicatedRecord(absl::string_view record) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (ABSL_PREDICT_FALSE(num_records_ == kMaxNumRecords)) {
+    return Fail(absl::ResourceExhaustedError("Too many records"));
+  }
+  if (ABSL_PREDICT_FALSE(record.size() > std::numeric_limits<uint64_t>::max() -
+                                             decoded_data_size_)) {
+    return Fail(absl::ResourceExhaustedError("Decoded data size too large"));
+  }
+  const std::pair<absl::flat_hash_map<size_t, DistinctRecord>::iterator, bool>
+      inserted = distinct_records_.emplace(
+          absl::Hash<absl::string_view>()(record),
+          DistinctRecord{num_records_, distinct_values_.size(), record.size()});
+  uint64_t encoded_size = IntCast<uint64_t>(record.size()) << 1;
+  if (inserted.second) {
+    distinct_values_.append(record.data(), record.size());
+  } else {
+    const DistinctRecord& distinct_record = inserted.first->second;
+    if (distinct_record.size == record.size() &&
+        std::memcmp(distinct_values_.data() + distinct_record.start,
+                    record.data(), record.size()) == 0) {
+      encoded_size = ((num_records_ - distinct_record.index) << 1) | 1;
+    } else {
+      // A hash collision: store the record without making it a reference
+      // target.
+      distinct_values_.append(record.data(), record.size());
+    }
+  }
+  ++num_records_;
+  decoded_data_size_ += IntCast<uint64_t>(record.size());
+  if (ABSL_PREDICT_FALSE(
+          !WriteVarint64(encoded_size, sizes_compressor_.writer()))) {
+    return Fail(sizes_compressor_.writer());
+  }
+  return true;
+}
+
 bool SimpleEncoder::AddRecords(Chain records, std::vector<size_t> limits) {
   RIEGELI_ASSERT_EQ(limits.empty() ? size_t{0} : limits.back(), records.size())
       << "Failed precondition of ChunkEncoder::AddRecords(): "
          "record end positions do not match concatenated record values";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (deduplicate_) {
+    const absl::string_view flat = records.Flatten();
+    size_t start = 0;
+    for (const size_t limit : limits) {
+      RIEGELI_ASSERT_GE(limit, start)
+          << "Failed precondition of ChunkEncoder::AddRecords(): "
+             "record end positions not sorted";
+      if (ABSL_PREDICT_FALSE(
+              !AddDeduplicatedRecord(flat.substr(start, limit - start)))) {
+        return false;
+      }
+      start = limit;
+    }
+    return true;
+  }
   if (ABSL_PREDICT_FALSE(limits.size() > kMaxNumRecords - num_records_)) {
     return Fail(absl::ResourceExhaustedError("Too many records"));
   }
@@ -158,36 +322,140 @@ bool SimpleEncoder::AddRecords(Chain records, std::vector<size_t> limits) {
   return true;
 }
 
+size_t SimpleEncoder::EstimateMemory() const {
+  return SaturatingAdd(
+      sizes_compressor_.EstimateMemory(), values_compressor_.EstimateMemory(),
+      distinct_values_.capacity(),
+      distinct_records_.capacity() *
+          sizeof(std::pair<const size_t, DistinctRecord>));
+}
+
 bool SimpleEncoder::EncodeAndClose(Writer& dest, ChunkType& chunk_type,
                                    uint64_t& num_records,
                                    uint64_t& decoded_data_size) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  chunk_type = ChunkType::kSimple;
+  const absl::Time encode_start = absl::Now();
+  const Position pos_before = dest.pos();
+  chunk_type = prefixed_       ? ChunkType::kPrefixed
+               : deduplicate_ ? ChunkType::kDeduplicated
+                              : ChunkType::kSimple;
   num_records = num_records_;
   decoded_data_size = decoded_data_size_;
+  stats_.num_chunks = 1;
+  stats_.num_records = num_records_;
+  stats_.decoded_data_size = decoded_data_size_;
+  const bool ok = EncodeCollectedAndClose(dest);
+  stats_.encoded_data_size = dest.pos() - pos_before;
+  stats_.encode_time = absl::Now() - encode_start;
+  return ok;
+}
 
-  if (ABSL_PREDICT_FALSE(
-          !dest.WriteByte(static_cast<uint8_t>(compression_type_)))) {
-    return Fail(dest);
+inline bool SimpleEncoder::EncodeCollectedAndClose(Writer& dest) {
+  if (prefixed_) {
+    if (ABSL_PREDICT_FALSE(!WriteVarint64(reference_size_, dest))) {
+      return Fail(dest);
+    }
+    if (reference_size_ > 0 &&
+        ABSL_PREDICT_FALSE(!WriteLittleEndian64(reference_hash_, dest))) {
+      return Fail(dest);
+    }
   }
-
-  ChainWriter<Chain> compressed_sizes_writer(std::forward_as_tuple());
-  if (ABSL_PREDICT_FALSE(
-          !sizes_compressor_.EncodeAndClose(compressed_sizes_writer))) {
+  if (deduplicate_) {
+    distinct_records_.clear();
+    if (ABSL_PREDICT_FALSE(!values_compressor_.writer().Write(
+            Chain(std::move(distinct_values_))))) {
+      return Fail(values_compressor_.writer());
+    }
+    distinct_values_.clear();
+  }
+  ChainWriter<Chain> sizes_writer(std::forward_as_tuple());
+  if (ABSL_PREDICT_FALSE(!sizes_compressor_.EncodeAndClose(sizes_writer))) {
     return Fail(sizes_compressor_);
   }
-  if (ABSL_PREDICT_FALSE(!compressed_sizes_writer.Close())) {
-    return Fail(compressed_sizes_writer);
+  if (ABSL_PREDICT_FALSE(!sizes_writer.Close())) return Fail(sizes_writer);
+  if (stream_values_) {
+    if (ABSL_PREDICT_FALSE(!dest.WriteByte(
+            static_cast<uint8_t>(compressor_options_.compression_type())))) {
+      return Fail(dest);
+    }
+    return CompressAndClose(std::move(sizes_writer.dest()), nullptr, dest);
   }
-  if (ABSL_PREDICT_FALSE(!WriteVarint64(
-          IntCast<uint64_t>(compressed_sizes_writer.dest().size()), dest)) ||
-      ABSL_PREDICT_FALSE(
-          !dest.Write(std::move(compressed_sizes_writer.dest())))) {
+  ChainWriter<Chain> values_writer(std::forward_as_tuple());
+  if (ABSL_PREDICT_FALSE(!values_compressor_.EncodeAndClose(values_writer))) {
+    return Fail(values_compressor_);
+  }
+  if (ABSL_PREDICT_FALSE(!values_writer.Close())) return Fail(values_writer);
+
+  bool compress =
+      compressor_options_.compression_type() != CompressionType::kNone;
+  if (compress && internal::IsAdaptive(compressor_options_)) {
+    Chain sample = values_writer.dest();
+    if (sample.size() > internal::kCompressionSampleSize) {
+      sample.RemoveSuffix(sample.size() - internal::kCompressionSampleSize);
+    }
+    const absl::Time sample_start = absl::Now();
+    compress = internal::CompressionPaysOff(compressor_options_, sample);
+    stats_.compress_time += absl::Now() - sample_start;
+  }
+  if (!compress) {
+    stats_.num_buckets += 2;
+    stats_.bucket_uncompressed_size +=
+        sizes_writer.dest().size() + values_writer.dest().size();
+    stats_.bucket_compressed_size +=
+        sizes_writer.dest().size() + values_writer.dest().size();
+    if (ABSL_PREDICT_FALSE(
+            !dest.WriteByte(static_cast<uint8_t>(CompressionType::kNone))) ||
+        ABSL_PREDICT_FALSE(!WriteVarint64(
+            IntCast<uint64_t>(sizes_writer.dest().size()), dest)) ||
+        ABSL_PREDICT_FALSE(!dest.Write(std::move(sizes_writer.dest()))) ||
+        ABSL_PREDICT_FALSE(!dest.Write(std::move(values_writer.dest())))) {
+      return Fail(dest);
+    }
+    return Close();
+  }
+
+  if (ABSL_PREDICT_FALSE(!dest.WriteByte(
+          static_cast<uint8_t>(compressor_options_.compression_type())))) {
     return Fail(dest);
   }
+  return CompressAndClose(std::move(sizes_writer.dest()), &values_writer.dest(),
+                          dest);
+}
 
-  if (ABSL_PREDICT_FALSE(!values_compressor_.EncodeAndClose(dest))) {
-    return Fail(values_compressor_);
+bool SimpleEncoder::CompressAndClose(Chain&& sizes, Chain* values,
+                                     Writer& dest) {
+  const absl::Time compress_start = absl::Now();
+  Executor* const executor =
+      sizes.size() >= kMinConcurrentSizesSize ? executor_.get() : nullptr;
+  Chain compressed_sizes, compressed_values;
+  ChunkStats sizes_stats, values_stats;
+  absl::Status sizes_status, values_status;
+  ParallelFor(executor, 2, [&](size_t index) {
+    if (index == 0) {
+      sizes_status = CompressBlock(compressor_options_, std::move(sizes),
+                                   compressed_sizes, sizes_stats);
+    } else if (values != nullptr) {
+      values_status = CompressBlock(compressor_options_, std::move(*values),
+                                    compressed_values, values_stats);
+    } else {
+      values_status = FinishCompression(values_compressor_, compressed_values,
+                                        values_stats);
+    }
+  });
+  stats_.compress_time += absl::Now() - compress_start;
+  if (ABSL_PREDICT_FALSE(!sizes_status.ok())) {
+    return Fail(std::move(sizes_status));
+  }
+  if (ABSL_PREDICT_FALSE(!values_status.ok())) {
+    return Fail(std::move(values_status));
+  }
+  stats_ += sizes_stats;
+  stats_ += values_stats;
+  if (ABSL_PREDICT_FALSE(!WriteVarint64(
+          IntCast<uint64_t>(compressed_sizes.size()), dest)) ||
+      ABSL_PREDICT_FALSE(!dest.Write(std::move(compressed_sizes))) ||
+      ABSL_PREDICT_FALSE(!dest.Write(std::move(compressed_values)))) {
+    return Fail(dest);
   }
   return Close();
 }
@@ -18,12 +18,16 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/chunk_encoding/chunk_encoder.h"
 #include "riegeli/chunk_encoding/compressor.h"
@@ -43,13 +47,58 @@ namespace riegeli {
 //
 // If compression is used, a compressed block is prefixed by its varint-encoded
 // uncompressed size.
+//
+// With deduplication the chunk type is `ChunkType::kDeduplicated`, and each
+// record is represented in record sizes by a varint:
+//  - `size << 1` for a record whose value is stored in record values
+//  - `(distance << 1) | 1` for a record whose value is the same as the value of
+//    the record `distance` records earlier, which is not stored again
 class SimpleEncoder : public ChunkEncoder {
  public:
   // Creates an empty `SimpleEncoder`.
-  explicit SimpleEncoder(CompressorOptions options, uint64_t size_hint);
+  //
+  // If `reserve_size_hint` is `true`, `size_hint` is allocated up front for
+  // collecting record values as a single block (see
+  // `internal::Compressor::TuningOptions::set_reserve_size()`).
+  //
+  // If `deduplicate` is `true`, records identical to an earlier record of the
+  // chunk are stored as references to it. This requires keeping record values
+  // flat until the chunk is encoded.
+  //
+  // If `executor` is not `nullptr`, record sizes and record values of a chunk
+  // with many records are compressed concurrently in it.
+  //
+  // If `stream_values` is `true`, record values are compressed while records
+  // are added, instead of being collected and compressed when the chunk is
+  // encoded. This reduces latency of `EncodeAndClose()` at the cost of not
+  // pledging the exact size to the compressor. This applies only if
+  // compression is enabled and not adaptive, and `!deduplicate`.
+  explicit SimpleEncoder(CompressorOptions options, uint64_t size_hint,
+                         bool reserve_size_hint = false,
+                         bool deduplicate = false,
+                         std::shared_ptr<Executor> executor = nullptr,
+                         bool stream_values = false);
 
   void Clear() override;
 
+  // Makes the chunk a `ChunkType::kPrefixed` chunk, which is like a simple
+  // chunk, but can depend on the previous chunk.
+  //
+  // If `reference` is not empty, it must be the concatenated records of the
+  // previous chunk. It is used as a Zstd reference prefix (a raw content
+  // dictionary) for compressing this chunk, instead of
+  // `CompressorOptions::zstd_dictionary()`. Records resembling records of the
+  // previous chunk then compress better, which matters for small chunks, but
+  // decoding this chunk requires decoding the previous chunk first.
+  //
+  // If `reference` is empty, the chunk is a keyframe, which can be decoded
+  // independently.
+  //
+  // `Clear()` keeps the reference.
+  //
+  // Precondition: `!deduplicate` and `!stream_values`
+  void SetReference(const Chain& reference);
+
   using ChunkEncoder::AddRecord;
   bool AddRecord(const google::protobuf::MessageLite& record,
                  SerializeOptions serialize_options) override;
@@ -61,6 +110,8 @@ class SimpleEncoder : public ChunkEncoder {
 
   bool AddRecords(Chain records, std::vector<size_t> limits) override;
 
+  size_t EstimateMemory() const override;
+
   bool EncodeAndClose(Writer& dest, ChunkType& chunk_type,
                       uint64_t& num_records,
                       uint64_t& decoded_data_size) override;
@@ -70,9 +121,45 @@ class SimpleEncoder : public ChunkEncoder {
   template <typename Record>
   bool AddRecordImpl(Record&& record);
 
-  CompressionType compression_type_;
+  // Implements adding a record if `deduplicate_`.
+  bool AddDeduplicatedRecord(absl::string_view record);
+
+  // Implements `EncodeAndClose()`.
+  bool EncodeCollectedAndClose(Writer& dest);
+
+  // Compresses `sizes`, and `*values` or the rest of `values_compressor_` if
+  // `values == nullptr`, and writes them to `dest`. Closes the `SimpleEncoder`.
+  bool CompressAndClose(Chain&& sizes, Chain* values, Writer& dest);
+
+  CompressorOptions compressor_options_;
+  std::shared_ptr<Executor> executor_;
+  // Whether `values_compressor_` compresses record values as they are added.
+  bool stream_values_;
+  // `sizes_compressor_` and `values_compressor_` collect uncompressed data,
+  // unless `stream_values_`. `EncodeCollectedAndClose()` compresses them with
+  // their exact sizes pledged, and if compression is adaptive, only if this
+  // pays off.
   internal::Compressor sizes_compressor_;
   internal::Compressor values_compressor_;
+  bool deduplicate_;
+  // Whether `SetReference()` was called.
+  bool prefixed_ = false;
+  // The size and hash of the reference, stored in a `ChunkType::kPrefixed`
+  // chunk so that the reader can verify that it has the right reference.
+  uint64_t reference_size_ = 0;
+  uint64_t reference_hash_ = 0;
+
+  // A record whose value is stored in `distinct_values_`.
+  struct DistinctRecord {
+    uint64_t index;
+    size_t start;
+    size_t size;
+  };
+  // If `deduplicate_`, record values are collected in `distinct_values_`
+  // instead of `values_compressor_`, and `distinct_records_` maps hashes of
+  // their values to the first record with that hash.
+  std::string distinct_values_;
+  absl::flat_hash_map<size_t, DistinctRecord> distinct_records_;
 };
 
 }  // namespace riegeli
@@ -21,6 +21,7 @@
 #include <cstring>
 #include <iterator>
 #include <limits>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -31,16 +32,22 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/base/memory.h"
 #include "riegeli/base/object.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/chain_reader.h"
 #include "riegeli/bytes/limiting_backward_writer.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/bytes/string_reader.h"
+#include "riegeli/chunk_encoding/column_encoding.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
 #include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/chunk_encoding/decompressor.h"
 #include "riegeli/chunk_encoding/field_projection.h"
@@ -48,6 +55,7 @@
 #include "riegeli/messages/message_wire_format.h"
 #include "riegeli/varint/varint_reading.h"
 #include "riegeli/varint/varint_writing.h"
+#include "riegeli/zstd/zstd_reader.h"
 
 namespace riegeli {
 
@@ -77,6 +85,63 @@ struct DataBucket {
   std::vector<ChainReader<Chain>> buffers;
 };
 
+// Information about one data bucket decoded without projection.
+struct FullBucket {
+  Chain compressed_data;
+  // Sizes of data buffers in the bucket.
+  std::vector<size_t> buffer_sizes;
+  // Decompressed data buffers, filled by `DecompressBucket()`.
+  std::vector<Chain> buffers;
+  // Failure of `DecompressBucket()`.
+  absl::Status status;
+};
+
+void DecompressBucket(CompressionType compression_type,
+                      const ZstdReaderBase::Dictionary& zstd_dictionary,
+                      const BrotliDictionary& brotli_dictionary,
+                      bool column_encoding, size_t decoded_data_size,
+                      FullBucket& bucket) {
+  internal::Decompressor<ChainReader<>> decompressor(
+      std::forward_as_tuple(&bucket.compressed_data), compression_type,
+      zstd_dictionary, brotli_dictionary);
+  if (ABSL_PREDICT_FALSE(!decompressor.healthy())) {
+    bucket.status = decompressor.status();
+    return;
+  }
+  // Decompress the whole bucket with one read, which lets the decompressor
+  // write directly to a destination of the right size, and then split it into
+  // buffers sharing its blocks.
+  size_t bucket_size = 0;
+  for (const size_t buffer_size : bucket.buffer_sizes) {
+    bucket_size += buffer_size;
+  }
+  Chain decompressed;
+  if (ABSL_PREDICT_FALSE(
+          !decompressor.reader().Read(bucket_size, decompressed))) {
+    decompressor.reader().Fail(
+        absl::InvalidArgumentError("Reading buffer failed"));
+    bucket.status = decompressor.reader().status();
+    return;
+  }
+  bucket.buffers.reserve(bucket.buffer_sizes.size());
+  size_t buffer_pos = 0;
+  for (const size_t buffer_size : bucket.buffer_sizes) {
+    bucket.buffers.push_back(decompressed.Substr(buffer_pos, buffer_size));
+    buffer_pos += buffer_size;
+    if (column_encoding &&
+        ABSL_PREDICT_FALSE(!internal::DecodeColumn(bucket.buffers.back(),
+                                                   decoded_data_size))) {
+      bucket.status = absl::InvalidArgumentError("Invalid column encoding");
+      return;
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!decompressor.VerifyEndAndClose())) {
+    bucket.status = decompressor.status();
+    return;
+  }
+  bucket.compressed_data = Chain();
+}
+
 // Should the data content of the field be decoded?
 enum class FieldIncluded {
   kYes,
@@ -368,6 +433,18 @@ inline bool IsImplicit(CallbackType callback_type) {
 struct TransposeDecoder::Context {
   // Compression type of the input.
   CompressionType compression_type = CompressionType::kNone;
+  // Zstd dictionary used if `compression_type` is `kZstd`.
+  ZstdReaderBase::Dictionary zstd_dictionary;
+  // Brotli dictionary used if `compression_type` is `kBrotli`.
+  BrotliDictionary brotli_dictionary;
+  // If not `nullptr`, buckets are decompressed concurrently in it.
+  // Note: Used only when projection is disabled.
+  Executor* executor = nullptr;
+  // If `true`, each data buffer begins with an `internal::ColumnEncoding`
+  // byte.
+  bool column_encoding = false;
+  // Bounds the size of a decoded data buffer.
+  size_t decoded_data_size = 0;
   // Buffer containing all the data.
   // Note: Used only when projection is disabled.
   std::vector<ChainReader<Chain>> buffers;
@@ -406,16 +483,56 @@ struct TransposeDecoder::Context {
   std::vector<DataBucket> buckets;
   // Template that can later be used later to finalize `StateMachineNode`.
   std::vector<StateMachineNodeTemplate> node_templates;
+  // Scratch space of `Parse()` used with projection.
+  std::vector<uint32_t> first_buffer_indices;
+  std::vector<uint32_t> bucket_indices;
+  // Stack of all open sub-messages, used by `Decode()`.
+  std::vector<SubmessageStackElement> submessage_stack;
+
+  // Prepares for decoding another chunk. Containers are cleared rather than
+  // replaced, so that their capacity is reused by the next chunk.
+  void Clear() {
+    compression_type = CompressionType::kNone;
+    zstd_dictionary = ZstdReaderBase::Dictionary();
+    brotli_dictionary = BrotliDictionary();
+    executor = nullptr;
+    column_encoding = false;
+    decoded_data_size = 0;
+    buffers.clear();
+    nonproto_lengths = nullptr;
+    state_machine_nodes.clear();
+    first_node = 0;
+    include_fields.clear();
+    buckets.clear();
+    node_templates.clear();
+    first_buffer_indices.clear();
+    bucket_indices.clear();
+    submessage_stack.clear();
+  }
 };
 
-bool TransposeDecoder::Decode(uint64_t num_records, uint64_t decoded_data_size,
+TransposeDecoder::TransposeDecoder() noexcept : Object(kInitiallyClosed) {}
+
+TransposeDecoder::~TransposeDecoder() {}
+
+bool TransposeDecoder::Decode(ChunkType chunk_type, uint64_t num_records,
+                              uint64_t decoded_data_size,
                               const FieldProjection& field_projection,
+                              const ZstdReaderBase::Dictionary& zstd_dictionary,
+                              const BrotliDictionary& brotli_dictionary,
                               Reader& src, BackwardWriter& dest,
-                              std::vector<size_t>& limits) {
+                              std::vector<size_t>& limits, Executor* executor) {
+  RIEGELI_ASSERT(chunk_type == ChunkType::kTransposed ||
+                 chunk_type == ChunkType::kTransposedV2)
+      << "Failed precondition of TransposeDecoder::Reset(): "
+         "not a transposed chunk";
   RIEGELI_ASSERT_EQ(dest.pos(), 0u)
       << "Failed precondition of TransposeDecoder::Reset(): "
          "non-zero destination position";
   Object::Reset(kInitiallyOpen);
+  buckets_decompressed_ = 0;
+  bytes_skipped_ = 0;
+  decompress_time_ = absl::ZeroDuration();
   if (ABSL_PREDICT_FALSE(num_records > limits.max_size())) {
     return Fail(absl::ResourceExhaustedError("Too many records"));
   }
@@ -424,7 +541,23 @@ bool TransposeDecoder::Decode(uint64_t num_records, uint64_t decoded_data_size,
     return Fail(absl::ResourceExhaustedError("Records too large"));
   }
 
-  Context context;
+  // The context is kept between chunks, so that decoding a sequence of chunks
+  // does not allocate its containers again for each chunk.
+  if (context_ == nullptr) {
+    context_ = std::make_unique<Context>();
+  } else {
+    context_->Clear();
+  }
+  Context& context = *context_;
+  context.zstd_dictionary = zstd_dictionary;
+  context.brotli_dictionary = brotli_dictionary;
+  context.executor = executor;
+  context.column_encoding = chunk_type == ChunkType::kTransposedV2;
+  context.decoded_data_size = IntCast<size_t>(decoded_data_size);
+  if (context.column_encoding &&
+      ABSL_PREDICT_FALSE(!internal::SkipChunkStatistics(src))) {
+    return Fail(absl::InvalidArgumentError("Invalid column statistics"));
+  }
   if (ABSL_PREDICT_FALSE(!Parse(context, src, field_projection))) return false;
   LimitingBackwardWriter<> limiting_dest(&dest, decoded_data_size);
   if (ABSL_PREDICT_FALSE(
@@ -432,6 +565,9 @@ bool TransposeDecoder::Decode(uint64_t num_records, uint64_t decoded_data_size,
     limiting_dest.Close();
     return false;
   }
+  for (const DataBucket& bucket : context.buckets) {
+    if (bucket.buffers.empty()) bytes_skipped_ += bucket.compressed_data.size();
+  }
   if (ABSL_PREDICT_FALSE(!limiting_dest.Close())) return Fail(limiting_dest);
   RIEGELI_ASSERT_LE(dest.pos(), decoded_data_size)
       << "Decoded data size larger than expected";
@@ -504,14 +640,15 @@ inline bool TransposeDecoder::Parse(Context& context, Reader& src,
     return Fail(src);
   }
   internal::Decompressor<ChainReader<>> header_decompressor(
-      std::forward_as_tuple(&header), context.compression_type);
+      std::forward_as_tuple(&header), context.compression_type,
+      context.zstd_dictionary, context.brotli_dictionary);
   if (ABSL_PREDICT_FALSE(!header_decompressor.healthy())) {
     return Fail(header_decompressor);
   }
 
   uint32_t num_buffers;
-  std::vector<uint32_t> first_buffer_indices;
-  std::vector<uint32_t> bucket_indices;
+  std::vector<uint32_t>& first_buffer_indices = context.first_buffer_indices;
+  std::vector<uint32_t>& bucket_indices = context.bucket_indices;
   if (projection_enabled) {
     if (ABSL_PREDICT_FALSE(!ParseBuffersForFiltering(
             context, header_decompressor.reader(), src, first_buffer_indices,
@@ -542,30 +679,22 @@ inline bool TransposeDecoder::Parse(Context& context, Reader& src,
       context.state_machine_nodes;
   bool has_nonproto_op = false;
   size_t num_subtypes = 0;
-  std::vector<uint32_t> tags;
-  tags.reserve(*state_machine_size);
-  for (size_t i = 0; i < *state_machine_size; ++i) {
-    const absl::optional<uint32_t> tag =
-        ReadVarint32(header_decompressor.reader());
-    if (ABSL_PREDICT_FALSE(tag == absl::nullopt)) {
-      header_decompressor.reader().Fail(
-          absl::InvalidArgumentError("Reading field tag failed"));
-      return Fail(header_decompressor.reader());
-    }
-    tags.push_back(*tag);
-    if (ValidTag(*tag) && internal::HasSubtype(*tag)) ++num_subtypes;
+  std::vector<uint32_t> tags(*state_machine_size);
+  if (ABSL_PREDICT_FALSE(
+          !ReadVarint32s(header_decompressor.reader(), absl::MakeSpan(tags)))) {
+    header_decompressor.reader().Fail(
+        absl::InvalidArgumentError("Reading field tag failed"));
+    return Fail(header_decompressor.reader());
   }
-  std::vector<uint32_t> next_node_indices;
-  next_node_indices.reserve(*state_machine_size);
-  for (size_t i = 0; i < *state_machine_size; ++i) {
-    const absl::optional<uint32_t> next_node =
-        ReadVarint32(header_decompressor.reader());
-    if (ABSL_PREDICT_FALSE(next_node == absl::nullopt)) {
-      header_decompressor.reader().Fail(
-          absl::InvalidArgumentError("Reading next node index failed"));
-      return Fail(header_decompressor.reader());
-    }
-    next_node_indices.push_back(*next_node);
+  for (const uint32_t tag : tags) {
+    if (ValidTag(tag) && internal::HasSubtype(tag)) ++num_subtypes;
+  }
+  std::vector<uint32_t> next_node_indices(*state_machine_size);
+  if (ABSL_PREDICT_FALSE(!ReadVarint32s(header_decompressor.reader(),
+                                        absl::MakeSpan(next_node_indices)))) {
+    header_decompressor.reader().Fail(
+        absl::InvalidArgumentError("Reading next node index failed"));
+    return Fail(header_decompressor.reader());
   }
   std::string subtypes;
   if (ABSL_PREDICT_FALSE(
@@ -760,7 +889,8 @@ inline bool TransposeDecoder::Parse(Context& context, Reader& src,
   if (ABSL_PREDICT_FALSE(!header_decompressor.VerifyEndAndClose())) {
     return Fail(header_decompressor);
   }
-  context.transitions.Reset(&src, context.compression_type);
+  context.transitions.Reset(&src, context.compression_type,
+                            context.zstd_dictionary, context.brotli_dictionary);
   if (ABSL_PREDICT_FALSE(!context.transitions.healthy())) {
     return Fail(context.transitions);
   }
@@ -790,12 +920,11 @@ inline bool TransposeDecoder::ParseBuffers(Context& context,
     }
     return true;
   }
-  context.buffers.reserve(*num_buffers);
-  std::vector<internal::Decompressor<ChainReader<Chain>>> bucket_decompressors;
-  if (ABSL_PREDICT_FALSE(*num_buckets > bucket_decompressors.max_size())) {
+  std::vector<FullBucket> buckets;
+  if (ABSL_PREDICT_FALSE(*num_buckets > buckets.max_size())) {
     return Fail(absl::ResourceExhaustedError("Too many buckets"));
   }
-  bucket_decompressors.reserve(*num_buckets);
+  buckets.reserve(*num_buckets);
   for (uint32_t bucket_index = 0; bucket_index < *num_buckets; ++bucket_index) {
     const absl::optional<uint64_t> bucket_length = ReadVarint64(header_reader);
     if (ABSL_PREDICT_FALSE(bucket_length == absl::nullopt)) {
@@ -807,20 +936,23 @@ inline bool TransposeDecoder::ParseBuffers(Context& context,
                            std::numeric_limits<size_t>::max())) {
       return Fail(absl::ResourceExhaustedError("Bucket too large"));
     }
-    Chain bucket;
-    if (ABSL_PREDICT_FALSE(
-            !src.Read(IntCast<size_t>(*bucket_length), bucket))) {
+    buckets.emplace_back();
+    if (ABSL_PREDICT_FALSE(!src.Read(IntCast<size_t>(*bucket_length),
+                                     buckets.back().compressed_data))) {
       src.Fail(absl::InvalidArgumentError("Reading bucket failed"));
       return Fail(src);
     }
-    bucket_decompressors.emplace_back(std::forward_as_tuple(std::move(bucket)),
-                                      context.compression_type);
-    if (ABSL_PREDICT_FALSE(!bucket_decompressors.back().healthy())) {
-      return Fail(bucket_decompressors.back());
-    }
   }
+  buckets_decompressed_ = *num_buckets;
 
+  // Assign buffers to buckets first, so that buckets can be decompressed
+  // independently.
   uint32_t bucket_index = 0;
+  absl::optional<uint64_t> remaining_bucket_size = internal::UncompressedSize(
+      buckets[0].compressed_data, context.compression_type);
+  if (ABSL_PREDICT_FALSE(remaining_bucket_size == absl::nullopt)) {
+    return Fail(absl::InvalidArgumentError("Reading uncompressed size failed"));
+  }
   for (size_t buffer_index = 0; buffer_index < *num_buffers; ++buffer_index) {
     const absl::optional<uint64_t> buffer_length = ReadVarint64(header_reader);
     if (ABSL_PREDICT_FALSE(buffer_length == absl::nullopt)) {
@@ -832,30 +964,47 @@ inline bool TransposeDecoder::ParseBuffers(Context& context,
                            std::numeric_limits<size_t>::max())) {
       return Fail(absl::ResourceExhaustedError("Buffer too large"));
     }
-    Chain buffer;
-    if (ABSL_PREDICT_FALSE(!bucket_decompressors[bucket_index].reader().Read(
-            IntCast<size_t>(*buffer_length), buffer))) {
-      bucket_decompressors[bucket_index].reader().Fail(
-          absl::InvalidArgumentError("Reading buffer failed"));
-      return Fail(bucket_decompressors[bucket_index].reader());
+    if (ABSL_PREDICT_FALSE(*buffer_length > *remaining_bucket_size)) {
+      return Fail(absl::InvalidArgumentError("Buffer does not fit in bucket"));
     }
-    context.buffers.emplace_back(std::move(buffer));
-    while (!bucket_decompressors[bucket_index].reader().Pull() &&
-           bucket_index + 1 < *num_buckets) {
-      if (ABSL_PREDICT_FALSE(
-              !bucket_decompressors[bucket_index].VerifyEndAndClose())) {
-        return Fail(bucket_decompressors[bucket_index].status());
-      }
+    buckets[bucket_index].buffer_sizes.push_back(
+        IntCast<size_t>(*buffer_length));
+    *remaining_bucket_size -= *buffer_length;
+    while (*remaining_bucket_size == 0 && bucket_index + 1 < *num_buckets) {
       ++bucket_index;
+      remaining_bucket_size = internal::UncompressedSize(
+          buckets[bucket_index].compressed_data, context.compression_type);
+      if (ABSL_PREDICT_FALSE(remaining_bucket_size == absl::nullopt)) {
+        return Fail(
+            absl::InvalidArgumentError("Reading uncompressed size failed"));
+      }
     }
   }
   if (ABSL_PREDICT_FALSE(bucket_index + 1 < *num_buckets)) {
     return Fail(absl::InvalidArgumentError("Too few buckets"));
   }
-  if (ABSL_PREDICT_FALSE(
-          !bucket_decompressors[bucket_index].VerifyEndAndClose())) {
-    return Fail(bucket_decompressors[bucket_index]);
+  if (ABSL_PREDICT_FALSE(*remaining_bucket_size > 0)) {
+    return Fail(absl::InvalidArgumentError("End of data expected"));
+  }
+
+  const absl::Time decompress_start = absl::Now();
+  ParallelFor(context.executor, buckets.size(),
+              [&context, &buckets](size_t index) {
+                DecompressBucket(
+                    context.compression_type, context.zstd_dictionary,
+                    context.brotli_dictionary, context.column_encoding,
+                    context.decoded_data_size, buckets[index]);
+              });
+  context.buffers.reserve(*num_buffers);
+  for (FullBucket& bucket : buckets) {
+    if (ABSL_PREDICT_FALSE(!bucket.status.ok())) {
+      return Fail(std::move(bucket.status));
+    }
+    for (Chain& buffer : bucket.buffers) {
+      context.buffers.emplace_back(std::move(buffer));
+    }
   }
+  decompress_time_ += absl::Now() - decompress_start;
   return true;
 }
 
@@ -965,11 +1114,18 @@ inline Reader* TransposeDecoder::GetBuffer(Context& context,
                                              ? bucket.buffer_sizes.size()
                                              : bucket.buffers.size())
       << "Index within bucket out of range";
+  if (index_within_bucket < bucket.buffers.size()) {
+    return &bucket.buffers[index_within_bucket];
+  }
+  const absl::Time decompress_start = absl::Now();
   while (index_within_bucket >= bucket.buffers.size()) {
     if (bucket.buffers.empty()) {
       // This is the first buffer to be decompressed from this bucket.
+      ++buckets_decompressed_;
       bucket.decompressor.Reset(std::forward_as_tuple(&bucket.compressed_data),
-                                context.compression_type);
+                                context.compression_type,
+                                context.zstd_dictionary,
+                                context.brotli_dictionary);
       if (ABSL_PREDICT_FALSE(!bucket.decompressor.healthy())) {
         Fail(bucket.decompressor);
         return nullptr;
@@ -985,6 +1141,12 @@ inline Reader* TransposeDecoder::GetBuffer(Context& context,
       Fail(bucket.decompressor.reader());
       return nullptr;
     }
+    if (context.column_encoding &&
+        ABSL_PREDICT_FALSE(
+            !internal::DecodeColumn(buffer, context.decoded_data_size))) {
+      Fail(absl::InvalidArgumentError("Invalid column encoding"));
+      return nullptr;
+    }
     bucket.buffers.emplace_back(std::move(buffer));
     if (bucket.buffers.size() == bucket.buffer_sizes.size()) {
       // This was the last decompressed buffer from this bucket.
@@ -997,6 +1159,7 @@ inline Reader* TransposeDecoder::GetBuffer(Context& context,
       bucket.buffer_sizes = std::vector<size_t>();
     }
   }
+  decompress_time_ += absl::Now() - decompress_start;
   return &bucket.buffers[index_within_bucket];
 }
 
@@ -1109,6 +1272,59 @@ inline bool TransposeDecoder::ContainsImplicitLoop(
     }                                                                    \
   } while (false)
 
+// Threaded dispatch: with computed goto, each callback jumps directly to the
+// code handling the next node, instead of returning to a shared `switch`. This
+// gives the branch predictor a separate indirect branch per callback, which
+// follows the structure of the state machine. The `switch` is still used to
+// enter the loop, and as the whole dispatch mechanism without computed goto.
+#if defined(__GNUC__) || defined(__clang__)
+#define RIEGELI_INTERNAL_TRANSPOSE_COMPUTED_GOTO 1
+#else
+#define RIEGELI_INTERNAL_TRANSPOSE_COMPUTED_GOTO 0
+#endif
+
+#if RIEGELI_INTERNAL_TRANSPOSE_COMPUTED_GOTO
+
+// Label of code handling `CallbackType::type`.
+#define CALLBACK_CASE(type)         \
+  case internal::CallbackType::type: \
+  callback_##type
+
+// Continue with the callback of `*node`.
+#define DISPATCH()                                                        \
+  goto* kCallbacks[static_cast<uint8_t>(node->callback_type) &           \
+                   ~static_cast<uint8_t>(internal::CallbackType::kImplicit)]
+
+// Move to the next node and continue with its callback.
+#define TRANSITION()   \
+  TRANSITION_STEP(); \
+  DISPATCH()
+
+#else
+
+#define CALLBACK_CASE(type) case internal::CallbackType::type
+#define DISPATCH() continue
+#define TRANSITION() goto do_transition
+
+#endif
+
+// Move `node` to the next node, reading a transition byte unless the
+// transition is implicit.
+#define TRANSITION_STEP()                                                      \
+  do {                                                                         \
+    node = node->next_node;                                                    \
+    if (num_iters == 0) {                                                      \
+      const absl::optional<uint8_t> transition_byte =                          \
+          transitions_reader.ReadByte();                                       \
+      if (ABSL_PREDICT_FALSE(transition_byte == absl::nullopt)) goto done;     \
+      node += (*transition_byte >> 2);                                         \
+      num_iters = *transition_byte & 3;                                        \
+      if (internal::IsImplicit(node->callback_type)) ++num_iters;              \
+    } else {                                                                   \
+      if (!internal::IsImplicit(node->callback_type)) --num_iters;             \
+    }                                                                          \
+  } while (false)
+
 inline bool TransposeDecoder::Decode(Context& context, uint64_t num_records,
                                      BackwardWriter& dest,
                                      std::vector<size_t>& limits) {
@@ -1125,42 +1341,84 @@ inline bool TransposeDecoder::Decode(Context& context, uint64_t num_records,
 
   Reader& transitions_reader = context.transitions.reader();
   // Stack of all open sub-messages.
-  std::vector<SubmessageStackElement> submessage_stack;
+  std::vector<SubmessageStackElement>& submessage_stack =
+      context.submessage_stack;
   submessage_stack.reserve(16);
   // Number of following iteration that go directly to `node->next_node`
   // without reading transition byte.
   int num_iters = 0;
 
   if (internal::IsImplicit(node->callback_type)) ++num_iters;
+
+#if RIEGELI_INTERNAL_TRANSPOSE_COMPUTED_GOTO
+  // Addresses of code handling each `CallbackType` other than `kImplicit`, in
+  // the order of their values.
+  static const void* const kCallbacks[] = {
+      &&callback_kNoOp,
+      &&callback_kMessageStart,
+      &&callback_kSubmessageStart,
+      &&callback_kSubmessageEnd,
+      &&callback_kSelectCallback,
+      &&callback_kSkippedSubmessageStart,
+      &&callback_kSkippedSubmessageEnd,
+      &&callback_kNonProto,
+      &&callback_kFailure,
+#define CALLBACKS_FOR_TAG_LEN(tag_length)                                     \
+  &&callback_kCopyTag_##tag_length, &&callback_kVarint_1_##tag_length,        \
+      &&callback_kVarint_2_##tag_length, &&callback_kVarint_3_##tag_length,   \
+      &&callback_kVarint_4_##tag_length, &&callback_kVarint_5_##tag_length,   \
+      &&callback_kVarint_6_##tag_length, &&callback_kVarint_7_##tag_length,   \
+      &&callback_kVarint_8_##tag_length, &&callback_kVarint_9_##tag_length,   \
+      &&callback_kVarint_10_##tag_length, &&callback_kFixed32_##tag_length,   \
+      &&callback_kFixed64_##tag_length,                                       \
+      &&callback_kFixed32Existence_##tag_length,                              \
+      &&callback_kFixed64Existence_##tag_length,                              \
+      &&callback_kString_##tag_length,                                        \
+      &&callback_kStartProjectionGroup_##tag_length,                          \
+      &&callback_kEndProjectionGroup_##tag_length
+      CALLBACKS_FOR_TAG_LEN(1),
+      CALLBACKS_FOR_TAG_LEN(2),
+      CALLBACKS_FOR_TAG_LEN(3),
+      CALLBACKS_FOR_TAG_LEN(4),
+      CALLBACKS_FOR_TAG_LEN(5),
+#undef CALLBACKS_FOR_TAG_LEN
+      &&callback_kCopyTag_6,
+      &&callback_kUnknown,
+  };
+  static_assert(sizeof(kCallbacks) / sizeof(kCallbacks[0]) ==
+                    static_cast<size_t>(internal::CallbackType::kUnknown) + 1,
+                "kCallbacks do not match CallbackType");
+#endif
+
   for (;;) {
     switch (static_cast<riegeli::internal::CallbackType>(
         static_cast<uint8_t>(node->callback_type) &
         ~static_cast<uint8_t>(internal::CallbackType::kImplicit))) {
-      case internal::CallbackType::kSelectCallback:
+      CALLBACK_CASE(kSelectCallback):
         if (ABSL_PREDICT_FALSE(!SetCallbackType(
                 context, skipped_submessage_level, submessage_stack, *node))) {
           return false;
         }
-        continue;
+        DISPATCH();
 
-      case internal::CallbackType::kSkippedSubmessageEnd:
+      CALLBACK_CASE(kSkippedSubmessageEnd):
         ++skipped_submessage_level;
-        goto do_transition;
+        TRANSITION();
 
-      case internal::CallbackType::kSkippedSubmessageStart:
+      CALLBACK_CASE(kSkippedSubmessageStart):
         if (ABSL_PREDICT_FALSE(skipped_submessage_level == 0)) {
           return Fail(
               absl::InvalidArgumentError("Skipped submessage stack underflow"));
         }
         --skipped_submessage_level;
-        goto do_transition;
+        TRANSITION();
 
-      case internal::CallbackType::kSubmessageEnd:
+      CALLBACK_CASE(kSubmessageEnd):
         submessage_stack.push_back(
             {IntCast<size_t>(dest.pos()), node->tag_data});
-        goto do_transition;
+        TRANSITION();
 
-      case internal::CallbackType::kSubmessageStart: {
+      CALLBACK_CASE(kSubmessageStart): {
         if (ABSL_PREDICT_FALSE(submessage_stack.empty())) {
           return Fail(absl::InvalidArgumentError("Submessage stack underflow"));
         }
@@ -1182,68 +1440,68 @@ inline bool TransposeDecoder::Decode(Context& context, uint64_t num_records,
         }
         submessage_stack.pop_back();
       }
-        goto do_transition;
+        TRANSITION();
 
 #define ACTIONS_FOR_TAG_LEN(tag_length)                                        \
-  case internal::CallbackType::kCopyTag_##tag_length:                          \
+  CALLBACK_CASE(kCopyTag_##tag_length):                                        \
     COPY_TAG_CALLBACK(tag_length);                                             \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_1_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_1_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 1);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_2_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_2_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 2);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_3_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_3_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 3);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_4_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_4_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 4);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_5_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_5_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 5);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_6_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_6_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 6);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_7_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_7_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 7);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_8_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_8_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 8);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_9_##tag_length:                         \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_9_##tag_length):                                       \
     VARINT_CALLBACK(tag_length, 9);                                            \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kVarint_10_##tag_length:                        \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kVarint_10_##tag_length):                                      \
     VARINT_CALLBACK(tag_length, 10);                                           \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kFixed32_##tag_length:                          \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kFixed32_##tag_length):                                        \
     FIXED_CALLBACK(tag_length, 4);                                             \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kFixed64_##tag_length:                          \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kFixed64_##tag_length):                                        \
     FIXED_CALLBACK(tag_length, 8);                                             \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kFixed32Existence_##tag_length:                 \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kFixed32Existence_##tag_length):                               \
     FIXED_EXISTENCE_CALLBACK(tag_length, 4);                                   \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kFixed64Existence_##tag_length:                 \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kFixed64Existence_##tag_length):                               \
     FIXED_EXISTENCE_CALLBACK(tag_length, 8);                                   \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kString_##tag_length:                           \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kString_##tag_length):                                         \
     STRING_CALLBACK(tag_length);                                               \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kStartProjectionGroup_##tag_length:             \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kStartProjectionGroup_##tag_length):                           \
     if (ABSL_PREDICT_FALSE(submessage_stack.empty())) {                        \
       return Fail(absl::InvalidArgumentError("Submessage stack underflow"));   \
     }                                                                          \
     submessage_stack.pop_back();                                               \
     COPY_TAG_CALLBACK(tag_length);                                             \
-    goto do_transition;                                                        \
-  case internal::CallbackType::kEndProjectionGroup_##tag_length:               \
+    TRANSITION();                                                              \
+  CALLBACK_CASE(kEndProjectionGroup_##tag_length):                             \
     submessage_stack.push_back({IntCast<size_t>(dest.pos()), node->tag_data}); \
     COPY_TAG_CALLBACK(tag_length);                                             \
-    goto do_transition
+    TRANSITION()
 
         ACTIONS_FOR_TAG_LEN(1);
         ACTIONS_FOR_TAG_LEN(2);
@@ -1252,15 +1510,15 @@ inline bool TransposeDecoder::Decode(Context& context, uint64_t num_records,
         ACTIONS_FOR_TAG_LEN(5);
 #undef ACTIONS_FOR_TAG_LEN
 
-      case internal::CallbackType::kCopyTag_6:
+      CALLBACK_CASE(kCopyTag_6):
         COPY_TAG_CALLBACK(6);
-        goto do_transition;
+        TRANSITION();
 
-      case internal::CallbackType::kUnknown:
-      case internal::CallbackType::kFailure:
+      CALLBACK_CASE(kUnknown):
+      CALLBACK_CASE(kFailure):
         return Fail(absl::InvalidArgumentError("Invalid node index"));
 
-      case internal::CallbackType::kNonProto: {
+      CALLBACK_CASE(kNonProto): {
         const absl::optional<uint32_t> length =
             ReadVarint32(*context.nonproto_lengths);
         if (ABSL_PREDICT_FALSE(length == absl::nullopt)) {
@@ -1277,7 +1535,7 @@ inline bool TransposeDecoder::Decode(Context& context, uint64_t num_records,
       }
         ABSL_FALLTHROUGH_INTENDED;
 
-      case internal::CallbackType::kMessageStart:
+      CALLBACK_CASE(kMessageStart):
         if (ABSL_PREDICT_FALSE(!submessage_stack.empty())) {
           return Fail(absl::InvalidArgumentError("Submessages still open"));
         }
@@ -1287,20 +1545,12 @@ inline bool TransposeDecoder::Decode(Context& context, uint64_t num_records,
         limits.push_back(IntCast<size_t>(dest.pos()));
         ABSL_FALLTHROUGH_INTENDED;
 
-      case internal::CallbackType::kNoOp:
+      CALLBACK_CASE(kNoOp):
+#if !RIEGELI_INTERNAL_TRANSPOSE_COMPUTED_GOTO
       do_transition:
-        node = node->next_node;
-        if (num_iters == 0) {
-          const absl::optional<uint8_t> transition_byte =
-              transitions_reader.ReadByte();
-          if (ABSL_PREDICT_FALSE(transition_byte == absl::nullopt)) goto done;
-          node += (*transition_byte >> 2);
-          num_iters = *transition_byte & 3;
-          if (internal::IsImplicit(node->callback_type)) ++num_iters;
-        } else {
-          if (!internal::IsImplicit(node->callback_type)) --num_iters;
-        }
-        continue;
+#endif
+        TRANSITION_STEP();
+        DISPATCH();
 
       case internal::CallbackType::kImplicit:
         RIEGELI_ASSERT_UNREACHABLE() << "kImplicit is masked out";
@@ -1344,6 +1594,11 @@ done:
   return true;
 }
 
+#undef CALLBACK_CASE
+#undef DISPATCH
+#undef TRANSITION
+#undef TRANSITION_STEP
+
 // Do not inline this function. This helps Clang to generate better code for
 // the main loop in `Decode()`.
 ABSL_ATTRIBUTE_NOINLINE inline bool TransposeDecoder::SetCallbackType(
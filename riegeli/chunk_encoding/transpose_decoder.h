@@ -18,14 +18,20 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
 #include <vector>
 
+#include "absl/time/time.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/base/object.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/reader.h"
+#include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/chunk_encoding/field_projection.h"
 #include "riegeli/chunk_encoding/transpose_internal.h"
 #include "riegeli/varint/varint_writing.h"
+#include "riegeli/zstd/zstd_reader.h"
 
 namespace riegeli {
 
@@ -36,25 +42,54 @@ enum class CallbackType : uint8_t;
 class TransposeDecoder : public Object {
  public:
   // Creates a closed `TransposeDecoder`.
-  TransposeDecoder() noexcept : Object(kInitiallyClosed) {}
+  TransposeDecoder() noexcept;
 
   TransposeDecoder(const TransposeDecoder&) = delete;
   TransposeDecoder& operator=(const TransposeDecoder&) = delete;
 
-  // Resets the `TransposeDecoder` and parses the chunk.
+  ~TransposeDecoder();
+
+  // Resets the `TransposeDecoder` and parses the chunk of type `chunk_type`,
+  // which must be `ChunkType::kTransposed` or `ChunkType::kTransposedV2`.
+  //
+  // Reusing a `TransposeDecoder` for a sequence of chunks reuses memory
+  // allocated for decoding state.
   //
   // Writes concatenated record values to `dest`. Sets `limits` to sorted
   // record end positions.
   //
+  // `zstd_dictionary` is used if the chunk is compressed with Zstd, and
+  // `brotli_dictionary` is used if the chunk is compressed with Brotli.
+  //
+  // If `executor` is not `nullptr` and `field_projection` includes all fields,
+  // data buckets are decompressed concurrently in it before decoding.
+  //
   // Precondition: `dest.pos() == 0`
   //
   // Return values:
   //  * `true`  - success (`healthy()`)
   //  * `false` - failure (`!healthy()`);
   //              if `!dest.healthy()` then the problem was at `dest`
-  bool Decode(uint64_t num_records, uint64_t decoded_data_size,
-              const FieldProjection& field_projection, Reader& src,
-              BackwardWriter& dest, std::vector<size_t>& limits);
+  bool Decode(ChunkType chunk_type, uint64_t num_records,
+              uint64_t decoded_data_size,
+              const FieldProjection& field_projection,
+              const ZstdReaderBase::Dictionary& zstd_dictionary,
+              const BrotliDictionary& brotli_dictionary, Reader& src,
+              BackwardWriter& dest, std::vector<size_t>& limits,
+              Executor* executor = nullptr);
+
+  // Returns the number of data buckets decompressed by the last `Decode()`.
+  //
+  // With field projection, only buckets containing included fields are
+  // decompressed.
+  uint64_t buckets_decompressed() const { return buckets_decompressed_; }
+
+  // Returns the total compressed size of data buckets which were not
+  // decompressed by the last `Decode()` because of field projection.
+  uint64_t bytes_skipped() const { return bytes_skipped_; }
+
+  // Returns the time spent decompressing data buckets by the last `Decode()`.
+  absl::Duration decompress_time() const { return decompress_time_; }
 
  private:
   // Information about one proto tag.
@@ -149,6 +184,13 @@ class TransposeDecoder : public Object {
       Context& context, int skipped_submessage_level,
       const std::vector<SubmessageStackElement>& submessage_stack,
       StateMachineNode& node);
+
+  // Decoding state, kept between chunks to reuse its memory. Data buffers of
+  // the previous chunk remain referenced until the next `Decode()`.
+  std::unique_ptr<Context> context_;
+  uint64_t buckets_decompressed_ = 0;
+  uint64_t bytes_skipped_ = 0;
+  absl::Duration decompress_time_;
 };
 
 }  // namespace riegeli
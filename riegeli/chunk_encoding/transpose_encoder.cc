@@ -33,9 +33,11 @@
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/chain_backward_writer.h"
 #include "riegeli/bytes/chain_reader.h"
@@ -46,6 +48,7 @@
 #include "riegeli/bytes/string_reader.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/chunk_encoding/column_encoding.h"
 #include "riegeli/chunk_encoding/compressor.h"
 #include "riegeli/chunk_encoding/compressor_options.h"
 #include "riegeli/chunk_encoding/constants.h"
@@ -70,6 +73,17 @@ static_assert(kMaxVarintInline < 0x80,
 // deeper nesting are encoded as strings.
 constexpr int kMaxRecursionDepth = 100;
 
+// After this many records of a chunk were checked whether they are proto
+// messages, if at least 15/16 of them were not, records are stored as
+// non-proto without checking, except for every `kProtoCheckInterval`-th record
+// which keeps being checked in case the input changes.
+//
+// Checking a non-proto record can scan much of it before failing, e.g. text
+// often looks like a sequence of valid tags. Storing a proto message as a
+// non-proto is always correct, only compression can be worse.
+constexpr uint64_t kMinProtoChecks = 64;
+constexpr uint64_t kProtoCheckInterval = 64;
+
 // Returns `true` if `record` is a valid protocol buffer message in the
 // canonical encoding. The purpose of this method is to distinguish a string
 // from a submessage in the proto wire format and to perform validity checks
@@ -127,13 +141,19 @@ bool IsProtoMessage(Reader& record) {
 struct PriorityQueueEntry {
   PriorityQueueEntry() {}
 
-  explicit PriorityQueueEntry(uint32_t dest_index, size_t num_transitions)
-      : dest_index(dest_index), num_transitions(num_transitions) {}
+  explicit PriorityQueueEntry(uint32_t dest_index, size_t num_transitions,
+                              uint32_t dest_info_index = kInvalidPos)
+      : dest_index(dest_index),
+        num_transitions(num_transitions),
+        dest_info_index(dest_info_index) {}
 
   // Index of the destination in `tags_list_`.
   uint32_t dest_index = 0;
   // Number of transitions into destination.
   size_t num_transitions = 0;
+  // Index of the transition in `TransposeEncoder::dest_info_`, or `kInvalidPos`
+  // if not applicable. Not used for ordering.
+  uint32_t dest_info_index = kInvalidPos;
 };
 
 bool operator<(PriorityQueueEntry a, PriorityQueueEntry b) {
@@ -145,6 +165,42 @@ bool operator<(PriorityQueueEntry a, PriorityQueueEntry b) {
   return a.dest_index < b.dest_index;
 }
 
+// Data buffers compressed together.
+struct Bucket {
+  // Buffers to compress, released after they are compressed, so that
+  // uncompressed buffers and compressed buckets of the whole chunk are not held
+  // in memory together.
+  std::vector<Chain*> buffers;
+  size_t uncompressed_size = 0;
+  // Compressed bucket, filled by `CompressBucket()`.
+  Chain compressed;
+  // Failure of `CompressBucket()`.
+  absl::Status status;
+};
+
+void CompressBucket(const CompressorOptions& compressor_options,
+                    Bucket& bucket) {
+  internal::Compressor compressor(
+      compressor_options,
+      internal::Compressor::TuningOptions().set_pledged_size(
+          bucket.uncompressed_size));
+  for (Chain* const buffer : bucket.buffers) {
+    if (ABSL_PREDICT_FALSE(!compressor.writer().Write(*buffer))) {
+      bucket.status = compressor.status();
+      return;
+    }
+    *buffer = Chain();
+  }
+  ChainWriter<> compressed_writer(&bucket.compressed);
+  if (ABSL_PREDICT_FALSE(!compressor.EncodeAndClose(compressed_writer))) {
+    bucket.status = compressor.status();
+    return;
+  }
+  if (ABSL_PREDICT_FALSE(!compressed_writer.Close())) {
+    bucket.status = compressed_writer.status();
+  }
+}
+
 }  // namespace
 
 inline TransposeEncoder::MessageNode::MessageNode(
@@ -164,7 +220,8 @@ inline TransposeEncoder::StateInfo::StateInfo(uint32_t etag_index,
                                               uint32_t base)
     : etag_index(etag_index), base(base), canonical_source(kInvalidPos) {}
 
-inline TransposeEncoder::DestInfo::DestInfo() : pos(kInvalidPos) {}
+inline TransposeEncoder::DestInfo::DestInfo(uint32_t dest_index)
+    : dest_index(dest_index), pos(kInvalidPos) {}
 
 inline TransposeEncoder::EncodedTagInfo::EncodedTagInfo(
     NodeId node_id, internal::Subtype subtype)
@@ -177,12 +234,16 @@ inline TransposeEncoder::EncodedTagInfo::EncodedTagInfo(
 inline TransposeEncoder::BufferWithMetadata::BufferWithMetadata(NodeId node_id)
     : buffer(std::make_unique<Chain>()), node_id(node_id) {}
 
-TransposeEncoder::TransposeEncoder(CompressorOptions options,
-                                   uint64_t bucket_size)
+TransposeEncoder::TransposeEncoder(
+    CompressorOptions options, uint64_t bucket_size,
+    std::shared_ptr<Executor> executor, bool column_encoding,
+    std::vector<StatisticsField> statistics_fields,
+    std::vector<Field> bloom_filter_fields)
     : compressor_options_(std::move(options)),
-      bucket_size_(options.compression_type() == CompressionType::kNone
-                       ? std::numeric_limits<uint64_t>::max()
-                       : bucket_size),
+      bucket_size_(bucket_size),
+      executor_(std::move(executor)),
+      column_encoding_(column_encoding),
+      statistics_(std::move(statistics_fields), std::move(bloom_filter_fields)),
       nonproto_lengths_writer_(std::forward_as_tuple()) {}
 
 TransposeEncoder::~TransposeEncoder() {}
@@ -191,10 +252,16 @@ void TransposeEncoder::Clear() {
   ChunkEncoder::Clear();
   tags_list_.clear();
   encoded_tags_.clear();
+  dest_info_.clear();
+  transition_dest_info_.clear();
   for (std::vector<BufferWithMetadata>& buffers : data_) buffers.clear();
   group_stack_.clear();
   message_nodes_.clear();
   nonproto_lengths_writer_.Reset(std::forward_as_tuple());
+  statistics_.Clear();
+  num_proto_checks_ = 0;
+  num_nonproto_checks_ = 0;
+  num_unchecked_ = 0;
   next_message_id_ = internal::MessageId::kRoot + 1;
 }
 
@@ -257,10 +324,26 @@ inline bool TransposeEncoder::AddRecordInternal(Reader& record) {
   }
   ++num_records_;
   decoded_data_size_ += IntCast<uint64_t>(*size);
-  const bool is_proto = IsProtoMessage(record);
-  if (!record.Seek(pos_before)) {
-    RIEGELI_ASSERT_UNREACHABLE()
-        << "Seeking reader of a record failed: " << record.status();
+  bool is_proto = false;
+  if (ShouldCheckProto()) {
+    is_proto = IsProtoMessage(record);
+    ++num_proto_checks_;
+    if (!is_proto) ++num_nonproto_checks_;
+    if (!record.Seek(pos_before)) {
+      RIEGELI_ASSERT_UNREACHABLE()
+          << "Seeking reader of a record failed: " << record.status();
+    }
+  }
+  if (!statistics_.empty()) {
+    if (is_proto) {
+      statistics_.AddMessage(record);
+      if (!record.Seek(pos_before)) {
+        RIEGELI_ASSERT_UNREACHABLE()
+            << "Seeking reader of a record failed: " << record.status();
+      }
+    } else {
+      statistics_.AddNonProto();
+    }
   }
   if (is_proto) {
     encoded_tags_.push_back(GetPosInTagsList(
@@ -284,6 +367,18 @@ inline bool TransposeEncoder::AddRecordInternal(Reader& record) {
   }
 }
 
+inline bool TransposeEncoder::ShouldCheckProto() {
+  // Statistics must see every proto message.
+  if (!statistics_.empty()) return true;
+  if (num_proto_checks_ < kMinProtoChecks ||
+      num_nonproto_checks_ < num_proto_checks_ - num_proto_checks_ / 16) {
+    return true;
+  }
+  if (++num_unchecked_ < kProtoCheckInterval) return false;
+  num_unchecked_ = 0;
+  return true;
+}
+
 inline BackwardWriter* TransposeEncoder::GetBuffer(Node* node,
                                                    BufferType type) {
   if (!node->second.writer) {
@@ -355,8 +450,12 @@ inline bool TransposeEncoder::AddMessage(LimitingReaderBase& record,
           encoded_tags_.push_back(
               GetPosInTagsList(node, internal::Subtype::kVarint1 +
                                          IntCast<uint8_t>(value_length - 1)));
-          // Clear high bit of each byte.
-          for (uint64_t& word : value) word &= ~uint64_t{0x8080808080808080};
+          if (!column_encoding_) {
+            // Clear high bit of each byte.
+            for (uint64_t& word : value) {
+              word &= ~uint64_t{0x8080808080808080};
+            }
+          }
           BackwardWriter* const buffer = GetBuffer(node, BufferType::kVarint);
           if (ABSL_PREDICT_FALSE(!buffer->Write(absl::string_view(
                   reinterpret_cast<const char*>(value), value_length)))) {
@@ -451,36 +550,63 @@ inline bool TransposeEncoder::AddMessage(LimitingReaderBase& record,
   return true;
 }
 
-inline bool TransposeEncoder::AddBuffer(
-    absl::optional<size_t> new_uncompressed_bucket_size, const Chain& buffer,
-    internal::Compressor& bucket_compressor, Writer& data_writer,
-    std::vector<size_t>& compressed_bucket_sizes,
-    std::vector<size_t>& buffer_sizes) {
-  buffer_sizes.push_back(buffer.size());
-  if (new_uncompressed_bucket_size != absl::nullopt) {
-    if (bucket_compressor.writer().pos() > 0) {
-      const Position pos_before = data_writer.pos();
-      if (ABSL_PREDICT_FALSE(!bucket_compressor.EncodeAndClose(data_writer))) {
-        return Fail(bucket_compressor);
+void TransposeEncoder::EncodeColumns() {
+  for (size_t type = 0; type < kNumBufferTypes; ++type) {
+    for (BufferWithMetadata& buffer : data_[type]) {
+      if (!column_encoding_) {
+        internal::EncodeRawColumn(*buffer.buffer);
+      } else if (type == static_cast<size_t>(BufferType::kVarint)) {
+        Chain encoded;
+        internal::EncodeVarintColumn(*buffer.buffer, encoded);
+        *buffer.buffer = std::move(encoded);
+      } else if (type == static_cast<size_t>(BufferType::kString)) {
+        internal::EncodeStringColumn(*buffer.buffer);
+      } else {
+        internal::EncodeRawColumn(*buffer.buffer);
       }
-      RIEGELI_ASSERT_GE(data_writer.pos(), pos_before)
-          << "Data writer position decreased";
-      compressed_bucket_sizes.push_back(
-          IntCast<size_t>(data_writer.pos() - pos_before));
     }
-    bucket_compressor.Clear(
-        internal::Compressor::TuningOptions().set_pledged_size(
-            *new_uncompressed_bucket_size));
   }
-  if (ABSL_PREDICT_FALSE(!bucket_compressor.writer().Write(buffer))) {
-    return Fail(bucket_compressor);
+  // `nonproto_lengths` is written only if non-empty.
+  if (!nonproto_lengths_writer_.dest().empty()) {
+    internal::EncodeRawColumn(nonproto_lengths_writer_.dest());
   }
-  return true;
+}
+
+Chain TransposeEncoder::CompressionSample() const {
+  const Chain& nonproto_lengths = nonproto_lengths_writer_.dest();
+  uint64_t total_size = nonproto_lengths.size();
+  for (const std::vector<BufferWithMetadata>& buffers : data_) {
+    for (const BufferWithMetadata& buffer : buffers) {
+      total_size += buffer.buffer->size();
+    }
+  }
+  Chain sample;
+  const auto append_prefix = [&](const Chain& buffer) {
+    Chain prefix = buffer;
+    if (total_size > internal::kCompressionSampleSize) {
+      prefix.RemoveSuffix(
+          prefix.size() -
+          IntCast<size_t>(IntCast<uint64_t>(prefix.size()) *
+                          internal::kCompressionSampleSize / total_size));
+    }
+    sample.Append(std::move(prefix));
+  };
+  for (const std::vector<BufferWithMetadata>& buffers : data_) {
+    for (const BufferWithMetadata& buffer : buffers) {
+      append_prefix(*buffer.buffer);
+    }
+  }
+  append_prefix(nonproto_lengths);
+  return sample;
 }
 
 inline bool TransposeEncoder::WriteBuffers(
-    Writer& header_writer, Writer& data_writer,
-    absl::flat_hash_map<NodeId, uint32_t>* buffer_pos) {
+    const CompressorOptions& compressor_options, Writer& header_writer,
+    Writer& data_writer, absl::flat_hash_map<NodeId, uint32_t>* buffer_pos) {
+  const uint64_t bucket_size =
+      compressor_options.compression_type() == CompressionType::kNone
+          ? std::numeric_limits<uint64_t>::max()
+          : bucket_size_;
   size_t num_buffers = 0;
   for (std::vector<BufferWithMetadata>& buffers : data_) {
     // Sort buffers by length, smallest to largest.
@@ -500,12 +626,11 @@ inline bool TransposeEncoder::WriteBuffers(
   const Chain& nonproto_lengths = nonproto_lengths_writer_.dest();
   if (!nonproto_lengths.empty()) ++num_buffers;
 
-  std::vector<size_t> compressed_bucket_sizes;
+  std::vector<Bucket> buckets;
   std::vector<size_t> buffer_sizes;
   buffer_sizes.reserve(num_buffers);
 
-  internal::Compressor bucket_compressor(compressor_options_);
-  for (const std::vector<BufferWithMetadata>& buffers : data_) {
+  for (std::vector<BufferWithMetadata>& buffers : data_) {
     // Split data into buckets.
     size_t remaining_buffers_size = 0;
     for (const BufferWithMetadata& buffer : buffers) {
@@ -519,13 +644,13 @@ inline bool TransposeEncoder::WriteBuffers(
          iter != buffers.crend(); ++iter) {
       const size_t current_buffer_size = iter->buffer->size();
       if (current_bucket_size > 0 &&
-          current_bucket_size + current_buffer_size / 2 >= bucket_size_) {
+          current_bucket_size + current_buffer_size / 2 >= bucket_size) {
         uncompressed_bucket_sizes.push_back(current_bucket_size);
         current_bucket_size = 0;
       }
       current_bucket_size += current_buffer_size;
       remaining_buffers_size -= current_buffer_size;
-      if (remaining_buffers_size <= bucket_size_ / 2) {
+      if (remaining_buffers_size <= bucket_size / 2) {
         current_bucket_size += remaining_buffers_size;
         break;
       }
@@ -535,23 +660,20 @@ inline bool TransposeEncoder::WriteBuffers(
     }
 
     current_bucket_size = 0;
-    for (const BufferWithMetadata& buffer : buffers) {
-      absl::optional<size_t> new_uncompressed_bucket_size;
+    for (BufferWithMetadata& buffer : buffers) {
       if (current_bucket_size == 0) {
         RIEGELI_ASSERT(!uncompressed_bucket_sizes.empty())
             << "Bucket sizes and buffer sizes do not match";
         current_bucket_size = uncompressed_bucket_sizes.back();
         uncompressed_bucket_sizes.pop_back();
-        new_uncompressed_bucket_size = current_bucket_size;
+        buckets.emplace_back();
+        buckets.back().uncompressed_size = current_bucket_size;
       }
       RIEGELI_ASSERT_GE(current_bucket_size, buffer.buffer->size())
           << "Bucket sizes and buffer sizes do not match";
       current_bucket_size -= buffer.buffer->size();
-      if (ABSL_PREDICT_FALSE(!AddBuffer(
-              new_uncompressed_bucket_size, *buffer.buffer, bucket_compressor,
-              data_writer, compressed_bucket_sizes, buffer_sizes))) {
-        return false;
-      }
+      buckets.back().buffers.push_back(buffer.buffer.get());
+      buffer_sizes.push_back(buffer.buffer->size());
       const std::pair<absl::flat_hash_map<NodeId, uint32_t>::iterator, bool>
           insert_result = buffer_pos->emplace(
               buffer.node_id, IntCast<uint32_t>(buffer_pos->size()));
@@ -566,26 +688,34 @@ inline bool TransposeEncoder::WriteBuffers(
         << "Bucket sizes and buffer sizes do not match";
   }
   if (!nonproto_lengths.empty()) {
-    // `nonproto_lengths` is the last buffer if non-empty.
-    if (ABSL_PREDICT_FALSE(!AddBuffer(nonproto_lengths.size(), nonproto_lengths,
-                                      bucket_compressor, data_writer,
-                                      compressed_bucket_sizes, buffer_sizes))) {
-      return false;
-    }
+    // `nonproto_lengths` is the last buffer if non-empty, in its own bucket.
     // Note: `nonproto_lengths` needs no `buffer_pos`.
+    buckets.emplace_back();
+    buckets.back().uncompressed_size = nonproto_lengths.size();
+    buckets.back().buffers.push_back(&nonproto_lengths_writer_.dest());
+    buffer_sizes.push_back(nonproto_lengths.size());
   }
 
-  if (bucket_compressor.writer().pos() > 0) {
-    // Last bucket.
-    const Position pos_before = data_writer.pos();
-    if (ABSL_PREDICT_FALSE(!bucket_compressor.EncodeAndClose(data_writer))) {
-      return Fail(bucket_compressor);
+  const absl::Time compress_start = absl::Now();
+  ParallelFor(executor_.get(), buckets.size(),
+              [&compressor_options, &buckets](size_t index) {
+                CompressBucket(compressor_options, buckets[index]);
+              });
+  std::vector<size_t> compressed_bucket_sizes;
+  compressed_bucket_sizes.reserve(buckets.size());
+  for (Bucket& bucket : buckets) {
+    if (ABSL_PREDICT_FALSE(!bucket.status.ok())) {
+      return Fail(std::move(bucket.status));
+    }
+    compressed_bucket_sizes.push_back(bucket.compressed.size());
+    ++stats_.num_buckets;
+    stats_.bucket_uncompressed_size += bucket.uncompressed_size;
+    stats_.bucket_compressed_size += bucket.compressed.size();
+    if (ABSL_PREDICT_FALSE(!data_writer.Write(std::move(bucket.compressed)))) {
+      return Fail(data_writer);
     }
-    RIEGELI_ASSERT_GE(data_writer.pos(), pos_before)
-        << "Data writer position decreased";
-    compressed_bucket_sizes.push_back(
-        IntCast<size_t>(data_writer.pos() - pos_before));
   }
+  stats_.compress_time += absl::Now() - compress_start;
 
   if (ABSL_PREDICT_FALSE(!WriteVarint32(
           IntCast<uint32_t>(compressed_bucket_sizes.size()), header_writer)) ||
@@ -610,23 +740,19 @@ inline bool TransposeEncoder::WriteBuffers(
 
 inline bool TransposeEncoder::WriteStatesAndData(
     uint32_t max_transition, const std::vector<StateInfo>& state_machine,
-    Writer& header_writer, Writer& data_writer) {
-  if (!encoded_tags_.empty() &&
-      tags_list_[encoded_tags_[0]].dest_info.size() == 1) {
+    const CompressorOptions& compressor_options, Writer& header_writer,
+    Writer& data_writer) {
+  if (!encoded_tags_.empty()) {
     // There should be no implicit transition from the last state. If there was
     // one, then it would not be obvious whether to stop or continue decoding.
     // Only if transition is explicit we check whether there is more transition
     // bytes.
-    absl::flat_hash_map<uint32_t, DestInfo>& dest_info =
-        tags_list_[encoded_tags_[0]].dest_info;
-    const uint32_t first_key = dest_info.begin()->first;
-    dest_info[first_key + 1];
-    RIEGELI_ASSERT_NE(tags_list_[encoded_tags_[0]].dest_info.size(), 1u)
-        << "Number of transitions from the last state did not increase";
+    tags_list_[encoded_tags_[0]].implicit_transition = false;
   }
   absl::flat_hash_map<NodeId, uint32_t> buffer_pos;
   if (ABSL_PREDICT_FALSE(
-          !WriteBuffers(header_writer, data_writer, &buffer_pos))) {
+          !WriteBuffers(compressor_options, header_writer, data_writer,
+                        &buffer_pos))) {
     return false;
   }
 
@@ -718,7 +844,7 @@ inline bool TransposeEncoder::WriteStatesAndData(
       // Signal implicit transition by adding `state_machine.size()`.
       base_to_write.push_back(
           tags_list_[state_info.etag_index].base +
-          (tags_list_[state_info.etag_index].dest_info.size() == 1
+          (tags_list_[state_info.etag_index].implicit_transition
                ? IntCast<uint32_t>(state_machine.size())
                : uint32_t{0}));
     } else {
@@ -726,18 +852,15 @@ inline bool TransposeEncoder::WriteStatesAndData(
       base_to_write.push_back(0);
     }
   }
-  for (const uint32_t value : base_to_write) {
-    if (ABSL_PREDICT_FALSE(!WriteVarint32(value, header_writer))) {
-      return Fail(header_writer);
-    }
+  if (ABSL_PREDICT_FALSE(!WriteVarint32s(base_to_write, header_writer))) {
+    return Fail(header_writer);
   }
   if (ABSL_PREDICT_FALSE(!header_writer.Write(std::move(subtype_to_write)))) {
     return Fail(header_writer);
   }
-  for (const uint32_t value : buffer_index_to_write) {
-    if (ABSL_PREDICT_FALSE(!WriteVarint32(value, header_writer))) {
-      return Fail(header_writer);
-    }
+  if (ABSL_PREDICT_FALSE(
+          !WriteVarint32s(buffer_index_to_write, header_writer))) {
+    return Fail(header_writer);
   }
 
   // Find the smallest index that has first tag.
@@ -753,14 +876,19 @@ inline bool TransposeEncoder::WriteStatesAndData(
     return Fail(header_writer);
   }
 
-  internal::Compressor transitions_compressor(compressor_options_);
+  // Transitions are compressed while they are generated, so the time of
+  // generating them is included in `stats_.compress_time`.
+  const absl::Time compress_start = absl::Now();
+  internal::Compressor transitions_compressor(compressor_options);
   if (ABSL_PREDICT_FALSE(!WriteTransitions(max_transition, state_machine,
                                            transitions_compressor.writer()))) {
     return false;
   }
-  if (ABSL_PREDICT_FALSE(!transitions_compressor.EncodeAndClose(data_writer))) {
+  if (ABSL_PREDICT_FALSE(
+          !transitions_compressor.EncodeAndClose(data_writer, stats_))) {
     return Fail(transitions_compressor);
   }
+  stats_.compress_time += absl::Now() - compress_start;
   return true;
 }
 
@@ -793,9 +921,9 @@ inline bool TransposeEncoder::WriteTransitions(
     //         the public list and then continue as above.
     uint32_t tag = encoded_tags_[i - 1];
     // Check whether this is implicit transition.
-    if (tags_list_[prev_etag].dest_info.size() != 1) {
+    if (!tags_list_[prev_etag].implicit_transition) {
       // Position in the private list.
-      uint32_t pos = tags_list_[prev_etag].dest_info[tag].pos;
+      uint32_t pos = dest_info_[transition_dest_info_[i - 1]].pos;
       if (pos == kInvalidPos) {
         // `pos` is not in the private list, go to `public_list_noop_pos` if
         // available.
@@ -898,14 +1026,55 @@ inline bool TransposeEncoder::WriteTransitions(
 }
 
 inline void TransposeEncoder::CollectTransitionStatistics() {
-  // Go through all the transitions from back to front and collect transition
-  // distribution statistics.
-  uint32_t prev_pos = encoded_tags_.back();
-  for (size_t i = encoded_tags_.size() - 1; i > 0; --i) {
-    const uint32_t pos = encoded_tags_[i - 1];
-    ++tags_list_[prev_pos].dest_info[pos].num_transitions;
-    ++tags_list_[pos].num_incoming_transitions;
-    prev_pos = pos;
+  // Transitions go from `encoded_tags_[i + 1]` to `encoded_tags_[i]`. They are
+  // grouped by their source with a counting sort, so that destinations of each
+  // source can be deduplicated using flat arrays indexed by the destination.
+  const uint32_t num_tags = IntCast<uint32_t>(tags_list_.size());
+  const uint32_t num_transitions = IntCast<uint32_t>(encoded_tags_.size() - 1);
+  // `transitions_by_source[source_begin[source]..source_begin[source + 1])`
+  // are indices `i` of transitions from `source`, in the order of processing
+  // transitions from back to front.
+  std::vector<uint32_t> source_begin(num_tags + 1);
+  for (uint32_t i = 0; i < num_transitions; ++i) {
+    ++source_begin[encoded_tags_[i + 1] + 1];
+  }
+  for (uint32_t source = 0; source < num_tags; ++source) {
+    source_begin[source + 1] += source_begin[source];
+  }
+  std::vector<uint32_t> transitions_by_source(num_transitions);
+  {
+    std::vector<uint32_t> next_transition(source_begin.begin(),
+                                          source_begin.end() - 1);
+    for (uint32_t i = num_transitions; i > 0; --i) {
+      transitions_by_source[next_transition[encoded_tags_[i]]++] = i - 1;
+    }
+  }
+
+  dest_info_.clear();
+  transition_dest_info_.resize(num_transitions);
+  // `dest_info_[dest_info_index[dest]]` is the `DestInfo` of `dest` from the
+  // current source, if `last_source[dest]` is the current source.
+  std::vector<uint32_t> last_source(num_tags, kInvalidPos);
+  std::vector<uint32_t> dest_info_index(num_tags);
+  for (uint32_t source = 0; source < num_tags; ++source) {
+    EncodedTagInfo& tag_info = tags_list_[source];
+    tag_info.dest_info_begin = IntCast<uint32_t>(dest_info_.size());
+    for (uint32_t j = source_begin[source]; j < source_begin[source + 1];
+         ++j) {
+      const uint32_t i = transitions_by_source[j];
+      const uint32_t dest = encoded_tags_[i];
+      if (last_source[dest] != source) {
+        last_source[dest] = source;
+        dest_info_index[dest] = IntCast<uint32_t>(dest_info_.size());
+        dest_info_.emplace_back(dest);
+      }
+      ++dest_info_[dest_info_index[dest]].num_transitions;
+      transition_dest_info_[i] = dest_info_index[dest];
+      ++tags_list_[dest].num_incoming_transitions;
+    }
+    tag_info.dest_info_end = IntCast<uint32_t>(dest_info_.size());
+    tag_info.implicit_transition =
+        tag_info.dest_info_end - tag_info.dest_info_begin == 1;
   }
 
   if (tags_list_[encoded_tags_.back()].num_incoming_transitions == 0) {
@@ -934,15 +1103,18 @@ inline void TransposeEncoder::ComputeBaseIndices(
     uint32_t base = kInvalidPos;
     // Smallest position of node used in transition.
     uint32_t min_pos = kInvalidPos;
-    for (const std::pair<const uint32_t, DestInfo>& dest_info :
-         tags_list_[tag_index_and_state_index.first].dest_info) {
-      uint32_t pos = dest_info.second.pos;
+    const EncodedTagInfo& tag_info =
+        tags_list_[tag_index_and_state_index.first];
+    for (uint32_t k = tag_info.dest_info_begin; k < tag_info.dest_info_end;
+         ++k) {
+      const DestInfo& dest_info = dest_info_[k];
+      uint32_t pos = dest_info.pos;
       if (pos != kInvalidPos) {
         // This tag has a node in the private list.
         continue;
       }
       // Position of the state that we need to reach.
-      pos = tags_list_[dest_info.first].state_machine_pos;
+      pos = tags_list_[dest_info.dest_index].state_machine_pos;
       RIEGELI_ASSERT_NE(pos, kInvalidPos) << "Invalid position";
       // Assuming we processed some states already and `base` is already set to
       // non-`kInvalidPos` we find the base of the block that is the common
@@ -1017,13 +1189,14 @@ inline void TransposeEncoder::ComputeBaseIndices(
     }
     uint32_t base = kInvalidPos;
     uint32_t min_pos = kInvalidPos;
-    for (const std::pair<const uint32_t, DestInfo>& dest_info : tag.dest_info) {
-      uint32_t pos = dest_info.second.pos;
+    for (uint32_t k = tag.dest_info_begin; k < tag.dest_info_end; ++k) {
+      const DestInfo& dest_info = dest_info_[k];
+      uint32_t pos = dest_info.pos;
       if (pos != kInvalidPos) {
         // Skip destinations in the private list.
         continue;
       }
-      pos = tags_list_[dest_info.first].state_machine_pos;
+      pos = tags_list_[dest_info.dest_index].state_machine_pos;
       RIEGELI_ASSERT_NE(pos, kInvalidPos) << "Invalid position";
       while (base > pos || pos - base > max_transition) {
         if (base > pos) {
@@ -1072,17 +1245,14 @@ TransposeEncoder::CreateStateMachine(uint32_t max_transition,
   // Go through all the tag infos and update transitions that will be included
   // in the private list for the node.
   constexpr uint32_t kInListPos = 0;
-  for (EncodedTagInfo& tag_info : tags_list_) {
-    for (std::pair<const uint32_t, DestInfo>& dest_and_count :
-         tag_info.dest_info) {
-      if (dest_and_count.second.num_transitions >= min_count_for_state) {
-        // Subtract transitions so we have the right estimate of the remaining
-        // transitions into each node.
-        tags_list_[dest_and_count.first].num_incoming_transitions -=
-            dest_and_count.second.num_transitions;
-        // Mark transition to be included in list.
-        dest_and_count.second.pos = kInListPos;
-      }
+  for (DestInfo& dest_info : dest_info_) {
+    if (dest_info.num_transitions >= min_count_for_state) {
+      // Subtract transitions so we have the right estimate of the remaining
+      // transitions into each node.
+      tags_list_[dest_info.dest_index].num_incoming_transitions -=
+          dest_info.num_transitions;
+      // Mark transition to be included in list.
+      dest_info.pos = kInListPos;
     }
   }
 
@@ -1099,36 +1269,38 @@ TransposeEncoder::CreateStateMachine(uint32_t max_transition,
   // After this loop:
   //  - `state_machine` will contain states of created private lists.
   //  - `base` in `tags_list_` will be set for tags with private list.
-  //  - `dest_info` in `tags_list_` will have `pos != kInvalidPos` for those
-  //    nodes that already have state.
+  //  - `dest_info_` will have `pos != kInvalidPos` for those nodes that
+  //    already have state.
   //  - `public_list_noops` will have a record for all `kNoOp` states reaching
   //    public list.
   for (uint32_t tag_id = 0; tag_id < tags_list_.size(); ++tag_id) {
     EncodedTagInfo& tag_info = tags_list_[tag_id];
-    const uint32_t sz = IntCast<uint32_t>(tag_info.dest_info.size());
+    const uint32_t sz = tag_info.dest_info_end - tag_info.dest_info_begin;
     // If we exclude just one state we add it instead of creating the `kNoOp`
     // state.
     PriorityQueueEntry excluded_state;
     // Number of transitions into public list states.
     uint32_t num_excluded_transitions = 0;
-    for (const std::pair<const uint32_t, DestInfo>& dest_info :
-         tag_info.dest_info) {
+    for (uint32_t k = tag_info.dest_info_begin; k < tag_info.dest_info_end;
+         ++k) {
+      const DestInfo& dest_info = dest_info_[k];
       // If destination was marked as `kInListPos` or all transitions into it go
       // from this node.
-      if (dest_info.second.pos == kInListPos ||
-          dest_info.second.num_transitions ==
-              tags_list_[dest_info.first].num_incoming_transitions) {
-        if (dest_info.second.pos != kInListPos) {
+      if (dest_info.pos == kInListPos ||
+          dest_info.num_transitions ==
+              tags_list_[dest_info.dest_index].num_incoming_transitions) {
+        if (dest_info.pos != kInListPos) {
           // Not yet subtracted.
-          tags_list_[dest_info.first].num_incoming_transitions -=
-              dest_info.second.num_transitions;
+          tags_list_[dest_info.dest_index].num_incoming_transitions -=
+              dest_info.num_transitions;
         }
         // Add to the priority queue.
-        tag_priority.emplace(dest_info.first, dest_info.second.num_transitions);
+        tag_priority.emplace(dest_info.dest_index, dest_info.num_transitions,
+                             k);
       } else {
-        num_excluded_transitions += dest_info.second.num_transitions;
-        excluded_state = PriorityQueueEntry(dest_info.first,
-                                            dest_info.second.num_transitions);
+        num_excluded_transitions += dest_info.num_transitions;
+        excluded_state = PriorityQueueEntry(dest_info.dest_index,
+                                            dest_info.num_transitions, k);
       }
     }
     uint32_t num_states = IntCast<uint32_t>(tag_priority.size());
@@ -1191,7 +1363,7 @@ TransposeEncoder::CreateStateMachine(uint32_t max_transition,
         } else {
           // Regular state.
           state_machine[--prev_state] = StateInfo(node_index, kInvalidPos);
-          tag_info.dest_info[node_index].pos = prev_state;
+          dest_info_[tag_priority.top().dest_info_index].pos = prev_state;
         }
         tag_priority.pop();
       }
@@ -1284,9 +1456,20 @@ constexpr uint32_t kMinCountForState = 10;
 bool TransposeEncoder::EncodeAndClose(Writer& dest, ChunkType& chunk_type,
                                       uint64_t& num_records,
                                       uint64_t& decoded_data_size) {
-  chunk_type = ChunkType::kTransposed;
-  return EncodeAndCloseInternal(kMaxTransition, kMinCountForState, dest,
-                                num_records, decoded_data_size);
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  const absl::Time encode_start = absl::Now();
+  const Position pos_before = dest.pos();
+  chunk_type = column_encoding_ || !statistics_.empty()
+                   ? ChunkType::kTransposedV2
+                   : ChunkType::kTransposed;
+  stats_.num_chunks = 1;
+  stats_.num_records = num_records_;
+  stats_.decoded_data_size = decoded_data_size_;
+  const bool ok = EncodeAndCloseInternal(kMaxTransition, kMinCountForState,
+                                         dest, num_records, decoded_data_size);
+  stats_.encoded_data_size = dest.pos() - pos_before;
+  stats_.encode_time = absl::Now() - encode_start;
+  return ok;
 }
 
 bool TransposeEncoder::EncodeAndCloseInternal(uint32_t max_transition,
@@ -1310,9 +1493,28 @@ bool TransposeEncoder::EncodeAndCloseInternal(uint32_t max_transition,
   if (ABSL_PREDICT_FALSE(!nonproto_lengths_writer_.Close())) {
     return Fail(nonproto_lengths_writer_);
   }
+  if (column_encoding_ || !statistics_.empty()) {
+    EncodeColumns();
+    Chain statistics;
+    statistics_.Write(statistics);
+    if (ABSL_PREDICT_FALSE(!dest.Write(std::move(statistics)))) {
+      return Fail(dest);
+    }
+  }
+
+  const CompressorOptions uncompressed_options =
+      CompressorOptions().set_uncompressed();
+  const absl::Time sample_start = absl::Now();
+  const CompressorOptions& compressor_options =
+      !internal::IsAdaptive(compressor_options_) ||
+              internal::CompressionPaysOff(compressor_options_,
+                                           CompressionSample())
+          ? compressor_options_
+          : uncompressed_options;
+  stats_.compress_time += absl::Now() - sample_start;
 
   if (ABSL_PREDICT_FALSE(!dest.WriteByte(
-          static_cast<uint8_t>(compressor_options_.compression_type())))) {
+          static_cast<uint8_t>(compressor_options.compression_type())))) {
     return Fail(dest);
   }
 
@@ -1322,28 +1524,31 @@ bool TransposeEncoder::EncodeAndCloseInternal(uint32_t max_transition,
   ChainWriter<Chain> header_writer(std::forward_as_tuple());
   ChainWriter<Chain> data_writer(std::forward_as_tuple());
   if (ABSL_PREDICT_FALSE(!WriteStatesAndData(max_transition, state_machine,
-                                             header_writer, data_writer))) {
+                                             compressor_options, header_writer,
+                                             data_writer))) {
     return false;
   }
   if (ABSL_PREDICT_FALSE(!header_writer.Close())) return Fail(header_writer);
   if (ABSL_PREDICT_FALSE(!data_writer.Close())) return Fail(data_writer);
 
+  const absl::Time compress_start = absl::Now();
   ChainWriter<Chain> compressed_header_writer(std::forward_as_tuple());
   internal::Compressor header_compressor(
-      compressor_options_,
+      compressor_options,
       internal::Compressor::TuningOptions().set_pledged_size(
           header_writer.dest().size()));
   if (ABSL_PREDICT_FALSE(
           !header_compressor.writer().Write(std::move(header_writer.dest())))) {
     return Fail(header_compressor.writer());
   }
-  if (ABSL_PREDICT_FALSE(
-          !header_compressor.EncodeAndClose(compressed_header_writer))) {
+  if (ABSL_PREDICT_FALSE(!header_compressor.EncodeAndClose(
+          compressed_header_writer, stats_))) {
     return Fail(header_compressor);
   }
   if (ABSL_PREDICT_FALSE(!compressed_header_writer.Close())) {
     return Fail(compressed_header_writer);
   }
+  stats_.compress_time += absl::Now() - compress_start;
   if (ABSL_PREDICT_FALSE(!WriteVarint64(
           IntCast<uint64_t>(compressed_header_writer.dest().size()), dest)) ||
       ABSL_PREDICT_FALSE(
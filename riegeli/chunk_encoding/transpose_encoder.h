@@ -26,13 +26,14 @@
 #include "absl/container/inlined_vector.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
-#include "absl/types/optional.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/chain_backward_writer.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
 #include "riegeli/chunk_encoding/compressor.h"
 #include "riegeli/chunk_encoding/compressor_options.h"
 #include "riegeli/chunk_encoding/constants.h"
@@ -64,10 +65,48 @@ class LimitingReaderBase;
 //      - Concatenated data buffers in this bucket (bytes)
 //  - Transitions (possibly compressed):
 //    - State machine transitions (bytes)
+//
+// With column encoding, column statistics, or Bloom filters, the chunk type is
+// `ChunkType::kTransposedV2`. The format is preceded by:
+//  - Statistics length (0 if there are no statistics)
+//  - Statistics:
+//    - Number of fields
+//    - For each field:
+//      - Length of field path
+//      - Field numbers of the path
+//      - `NumericType` (byte)
+//      - Number of records which do not contain the field
+//      - Number of values [`num_values`]
+//      - Minimum and maximum value, if `num_values > 0`
+//    - Number of Bloom filters
+//    - For each Bloom filter:
+//      - Length of field path
+//      - Field numbers of the path
+//      - Number of hashes (byte)
+//      - Length of bits
+//      - Bits (bytes)
+//
+// Each data buffer of such a chunk begins with an `internal::ColumnEncoding`
+// byte. With column encoding, buffers of varint fields are bit-packed, possibly
+// as deltas, and buffers of string fields are dictionary encoded, if this makes
+// them smaller.
 class TransposeEncoder : public ChunkEncoder {
  public:
   // Creates an empty `TransposeEncoder`.
-  explicit TransposeEncoder(CompressorOptions options, uint64_t bucket_size);
+  //
+  // If `executor` is not `nullptr`, buckets of a chunk are compressed
+  // concurrently in it. The thread encoding the chunk compresses buckets too,
+  // so this may be called in a task of `executor`.
+  //
+  // If `column_encoding` is `true`, or `statistics_fields` or
+  // `bloom_filter_fields` are not empty, the chunk is written as
+  // `ChunkType::kTransposedV2`, which older readers do not support.
+  explicit TransposeEncoder(
+      CompressorOptions options, uint64_t bucket_size,
+      std::shared_ptr<Executor> executor = nullptr,
+      bool column_encoding = false,
+      std::vector<StatisticsField> statistics_fields = {},
+      std::vector<Field> bloom_filter_fields = {});
 
   ~TransposeEncoder();
 
@@ -103,7 +142,7 @@ class TransposeEncoder : public ChunkEncoder {
   // buffers together hoping that this helps with compression context modeling.
   enum class BufferType : int {
     // Varint-encoded numbers, with the highest bit (signifying end of number)
-    // stripped.
+    // stripped, or kept until `EncodeColumns()` if `column_encoding_`.
     kVarint,
     // Fixed width 32bit integer or floating point numbers.
     kFixed32,
@@ -150,6 +189,11 @@ class TransposeEncoder : public ChunkEncoder {
     uint32_t tag;
   };
 
+  // Returns `true` if the next record should be checked whether it is a proto
+  // message, or `false` if it should be stored as a non-proto without checking
+  // because most records of this chunk were not proto messages.
+  bool ShouldCheckProto();
+
   // Add message recursively to the internal data structures.
   // Precondition: `message` is a valid proto message, i.e. `IsProtoMessage()`
   // on this message returns `true`.
@@ -157,10 +201,21 @@ class TransposeEncoder : public ChunkEncoder {
   bool AddMessage(LimitingReaderBase& record,
                   internal::MessageId parent_message_id, int depth);
 
+  // Prepends an `internal::ColumnEncoding` byte to each data buffer, choosing
+  // the encoding of buffers of varint and string fields if `column_encoding_`.
+  void EncodeColumns();
+
+  // Returns a sample of data buffers, of at most
+  // `internal::kCompressionSampleSize` bytes, taking a prefix from every buffer
+  // in proportion to its size.
+  Chain CompressionSample() const;
+
   // Write all buffer lengths to `header_writer` and data buffers in `data_` to
-  // `data_writer` (compressed using `compressor_`). Fill map with the
-  // sequential position of each buffer written.
-  bool WriteBuffers(Writer& header_writer, Writer& data_writer,
+  // `data_writer` (compressed using `compressor_options`), releasing each
+  // buffer after it is written. Fill map with the sequential position of each
+  // buffer written.
+  bool WriteBuffers(const CompressorOptions& compressor_options,
+                    Writer& header_writer, Writer& data_writer,
                     absl::flat_hash_map<NodeId, uint32_t>* buffer_pos);
 
   // One state of the state machine created in encoder.
@@ -180,15 +235,6 @@ class TransposeEncoder : public ChunkEncoder {
     uint32_t canonical_source;
   };
 
-  // Add `buffer` to `bucket_compressor.writer()`.
-  // If `new_uncompressed_bucket_size` is not `absl::nullopt`, flush the current
-  // bucket to `data_writer` first and create a new bucket of that size.
-  bool AddBuffer(absl::optional<size_t> new_uncompressed_bucket_size,
-                 const Chain& buffer, internal::Compressor& bucket_compressor,
-                 Writer& data_writer,
-                 std::vector<size_t>& compressed_bucket_sizes,
-                 std::vector<size_t>& buffer_sizes);
-
   // Compute base indices for states in `state_machine` that don't have one yet.
   // `public_list_base` is the index of the start of the public list.
   // `public_list_noops` is the list of `kNoOp` states that don't have a base
@@ -198,8 +244,10 @@ class TransposeEncoder : public ChunkEncoder {
       const std::vector<std::pair<uint32_t, uint32_t>>& public_list_noops,
       std::vector<StateInfo>& state_machine);
 
-  // Traverse `encoded_tags_` and populate `num_incoming_transitions` and
-  // `dest_info` in `tags_list_` based on transition distribution.
+  // Traverse `encoded_tags_` and populate `dest_info_`,
+  // `transition_dest_info_`, and `num_incoming_transitions`,
+  // `dest_info_begin`, `dest_info_end`, and `implicit_transition` in
+  // `tags_list_` based on transition distribution.
   void CollectTransitionStatistics();
 
   // Create a state machine for `encoded_tags_`.
@@ -207,9 +255,10 @@ class TransposeEncoder : public ChunkEncoder {
                                             uint32_t min_count_for_state);
 
   // Write state machine states into `header_writer` and all data buffers and
-  // transitions into `data_writer` (compressed using `compressor_`).
+  // transitions into `data_writer` (compressed using `compressor_options`).
   bool WriteStatesAndData(uint32_t max_transition,
                           const std::vector<StateInfo>& state_machine,
+                          const CompressorOptions& compressor_options,
                           Writer& header_writer, Writer& data_writer);
 
   // Write all state machine transitions from `encoded_tags_` into
@@ -234,7 +283,9 @@ class TransposeEncoder : public ChunkEncoder {
 
   // Information about the state machine transition destination.
   struct DestInfo {
-    DestInfo();
+    explicit DestInfo(uint32_t dest_index);
+    // Index of the destination in `tags_list_`.
+    uint32_t dest_index;
     // Position of the destination in destination list created for this state.
     // `kInvalidPos` if transition destination is not in the list. In that case
     // transition is encoded using the public list of states.
@@ -248,8 +299,13 @@ class TransposeEncoder : public ChunkEncoder {
     explicit EncodedTagInfo(NodeId node_id, internal::Subtype subtype);
     NodeId node_id;
     internal::Subtype subtype;
-    // Maps all destinations reachable from this encoded tag to `DestInfo`.
-    absl::flat_hash_map<uint32_t, DestInfo> dest_info;
+    // All destinations reachable from this encoded tag are
+    // `dest_info_[dest_info_begin..dest_info_end)`.
+    uint32_t dest_info_begin = 0;
+    uint32_t dest_info_end = 0;
+    // Whether the only destination reachable from this encoded tag is reached
+    // by an implicit transition, without writing a transition byte.
+    bool implicit_transition = false;
     // Number of incoming tranitions into this state.
     size_t num_incoming_transitions = 0;
     // Index of this state in the state machine.
@@ -280,11 +336,22 @@ class TransposeEncoder : public ChunkEncoder {
   // Finer bucket granularity (i.e. smaller size) worsens compression density
   // but makes field projection more effective.
   uint64_t bucket_size_;
+  // If not `nullptr`, buckets are compressed concurrently in it.
+  std::shared_ptr<Executor> executor_;
+  bool column_encoding_;
+  internal::ColumnStatisticsCollector statistics_;
 
   // List of all distinct Encoded tags.
   std::vector<EncodedTagInfo> tags_list_;
   // Sequence of tags on input as indices into `tags_list_`.
   std::vector<uint32_t> encoded_tags_;
+  // Destinations of all encoded tags, grouped by the source tag. Flat arrays
+  // indexed by precomputed positions are used instead of a map per tag, which
+  // matters for chunks with many distinct tags.
+  std::vector<DestInfo> dest_info_;
+  // Index in `dest_info_` of the transition into `encoded_tags_[i]` from
+  // `encoded_tags_[i + 1]`, for `i < encoded_tags_.size() - 1`.
+  std::vector<uint32_t> transition_dest_info_;
   // Data buffers in separate vectors per buffer type.
   std::vector<BufferWithMetadata> data_[kNumBufferTypes];
   // Every group creates a new message ID. We keep track of open groups in this
@@ -293,6 +360,12 @@ class TransposeEncoder : public ChunkEncoder {
   // Tree of message nodes.
   absl::flat_hash_map<NodeId, MessageNode> message_nodes_;
   ChainBackwardWriter<Chain> nonproto_lengths_writer_;
+  // Number of records checked whether they are proto messages, and how many of
+  // them were not, used to skip checking records of mostly non-proto chunks.
+  uint64_t num_proto_checks_ = 0;
+  uint64_t num_nonproto_checks_ = 0;
+  // Number of records not checked since the last check.
+  uint64_t num_unchecked_ = 0;
   // Counter used to assign unique IDs to the message nodes.
   internal::MessageId next_message_id_ = internal::MessageId::kRoot + 1;
 };
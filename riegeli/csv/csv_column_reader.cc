@@ -0,0 +1,169 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/csv/csv_column_reader.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/charconv.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/status.h"
+#include "riegeli/csv/csv_reader.h"
+#include "riegeli/csv/csv_record.h"
+
+namespace riegeli {
+
+void CsvColumnBatch::Clear(const std::vector<CsvColumnType>& types) {
+  num_records_ = 0;
+  types_ = types;
+  int64_columns_.resize(types_.size());
+  double_columns_.resize(types_.size());
+  for (std::vector<int64_t>& column : int64_columns_) column.clear();
+  for (std::vector<double>& column : double_columns_) column.clear();
+}
+
+void CsvColumnBatch::DropIncompleteRecord() {
+  for (size_t i = 0; i < types_.size(); ++i) {
+    switch (types_[i]) {
+      case CsvColumnType::kInt64:
+        int64_columns_[i].resize(num_records_);
+        continue;
+      case CsvColumnType::kDouble:
+        double_columns_[i].resize(num_records_);
+        continue;
+    }
+    RIEGELI_ASSERT_UNREACHABLE()
+        << "Unknown CSV column type: " << static_cast<int>(types_[i]);
+  }
+}
+
+void CsvColumnReaderBase::Initialize(CsvReaderBase* src, CsvHeader&& columns,
+                                     std::vector<CsvColumnType>&& types) {
+  RIEGELI_ASSERT(src != nullptr)
+      << "Failed precondition of CsvColumnReader: null CsvReaderBase pointer";
+  RIEGELI_ASSERT_EQ(columns.size(), types.size())
+      << "Failed precondition of CsvColumnReader: "
+         "mismatched number of column names and types";
+  if (ABSL_PREDICT_FALSE(!src->healthy())) {
+    Fail(*src);
+    return;
+  }
+  if (ABSL_PREDICT_FALSE(!src->has_header())) {
+    Fail(absl::FailedPreconditionError(
+        "CsvColumnReader requires CsvReaderBase::Options::read_header()"));
+    return;
+  }
+  columns_ = std::move(columns);
+  types_ = std::move(types);
+  positions_.clear();
+  positions_.reserve(columns_.size());
+  min_num_fields_ = 0;
+  const CsvHeader& header = src->header();
+  for (const std::string& name : columns_) {
+    const CsvHeader::iterator iter = header.find(name);
+    if (ABSL_PREDICT_FALSE(iter == header.end())) {
+      Fail(absl::InvalidArgumentError(
+          absl::StrCat("Missing CSV field: ", name)));
+      return;
+    }
+    const size_t position = IntCast<size_t>(iter - header.begin());
+    positions_.push_back(position);
+    min_num_fields_ = std::max(min_num_fields_, position + 1);
+  }
+}
+
+bool CsvColumnReaderBase::ReadBatch(size_t max_records, CsvColumnBatch& batch) {
+  batch.Clear(types_);
+  if (ABSL_PREDICT_FALSE(!pending_failure_.ok())) {
+    return Fail(std::exchange(pending_failure_, absl::OkStatus()));
+  }
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  CsvReaderBase& src = *src_csv_reader();
+  while (batch.num_records_ < max_records) {
+    if (ABSL_PREDICT_FALSE(!src.ReadRecord(fields_))) {
+      if (ABSL_PREDICT_FALSE(!src.healthy())) {
+        if (batch.num_records_ > 0) {
+          pending_failure_ = src.status();
+          return true;
+        }
+        return Fail(src);
+      }
+      break;
+    }
+    if (ABSL_PREDICT_FALSE(!ParseRecord(src, batch))) {
+      batch.DropIncompleteRecord();
+      if (batch.num_records_ > 0) {
+        pending_failure_ = status();
+        MarkNotFailed();
+        return true;
+      }
+      return false;
+    }
+    ++batch.num_records_;
+  }
+  return batch.num_records_ > 0;
+}
+
+inline bool CsvColumnReaderBase::ParseRecord(CsvReaderBase& src,
+                                             CsvColumnBatch& batch) {
+  if (ABSL_PREDICT_FALSE(fields_.size() < min_num_fields_)) {
+    return Fail(Annotate(
+        absl::InvalidArgumentError(
+            absl::StrCat("Mismatched number of CSV fields: expected at least ",
+                         min_num_fields_, ", record has ", fields_.size())),
+        absl::StrCat("at line ", src.last_line_number())));
+  }
+  for (size_t i = 0; i < types_.size(); ++i) {
+    const absl::string_view field = fields_[positions_[i]];
+    switch (types_[i]) {
+      case CsvColumnType::kInt64: {
+        int64_t value;
+        if (ABSL_PREDICT_FALSE(!absl::SimpleAtoi(field, &value))) break;
+        batch.int64_columns_[i].push_back(value);
+        continue;
+      }
+      case CsvColumnType::kDouble: {
+        double value;
+        const absl::from_chars_result result =
+            absl::from_chars(field.data(), field.data() + field.size(), value);
+        if (ABSL_PREDICT_FALSE(result.ec != std::errc() ||
+                               result.ptr != field.data() + field.size())) {
+          break;
+        }
+        batch.double_columns_[i].push_back(value);
+        continue;
+      }
+    }
+    return Fail(Annotate(
+        absl::InvalidArgumentError(absl::StrCat(
+            "Invalid ",
+            types_[i] == CsvColumnType::kInt64 ? "integer" : "number",
+            " in CSV field ", *(columns_.begin() + i), ": ", field)),
+        absl::StrCat("at line ", src.last_line_number())));
+  }
+  return true;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,389 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_CSV_CSV_COLUMN_READER_H_
+#define RIEGELI_CSV_CSV_COLUMN_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/base/object.h"
+#include "riegeli/csv/csv_reader.h"
+#include "riegeli/csv/csv_record.h"
+
+namespace riegeli {
+
+// The type of values of a column read by `CsvColumnReader`.
+enum class CsvColumnType {
+  kInt64,   // Decimal integer, parsed like by `absl::SimpleAtoi()`.
+  kDouble,  // Floating point number, parsed like by `absl::from_chars()`.
+};
+
+// A batch of records read by `CsvColumnReader`, stored by columns.
+//
+// Storage is reused when the `CsvColumnBatch` is passed to `ReadBatch()` again.
+class CsvColumnBatch {
+ public:
+  CsvColumnBatch() noexcept {}
+
+  CsvColumnBatch(const CsvColumnBatch& that) = default;
+  CsvColumnBatch& operator=(const CsvColumnBatch& that) = default;
+
+  CsvColumnBatch(CsvColumnBatch&& that) noexcept = default;
+  CsvColumnBatch& operator=(CsvColumnBatch&& that) noexcept = default;
+
+  // Returns the number of records.
+  size_t num_records() const { return num_records_; }
+
+  // Returns the number of columns.
+  size_t num_columns() const { return types_.size(); }
+
+  // Returns the type of the column with the given index.
+  //
+  // Precondition: `index < num_columns()`
+  CsvColumnType type(size_t index) const;
+
+  // Returns values of the column with the given index, one per record.
+  //
+  // Preconditions:
+  //   `index < num_columns()`
+  //   `type(index) == CsvColumnType::kInt64`
+  absl::Span<const int64_t> int64_column(size_t index) const;
+
+  // Returns values of the column with the given index, one per record.
+  //
+  // Preconditions:
+  //   `index < num_columns()`
+  //   `type(index) == CsvColumnType::kDouble`
+  absl::Span<const double> double_column(size_t index) const;
+
+ private:
+  friend class CsvColumnReaderBase;
+
+  // Makes the batch empty, with columns of the given types.
+  void Clear(const std::vector<CsvColumnType>& types);
+  // Removes values of a partially read record.
+  void DropIncompleteRecord();
+
+  size_t num_records_ = 0;
+  std::vector<CsvColumnType> types_;
+  // Indexed by column index, meaningful for columns of the corresponding type.
+  std::vector<std::vector<int64_t>> int64_columns_;
+  std::vector<std::vector<double>> double_columns_;
+};
+
+// Template parameter independent part of `CsvColumnReader`.
+class CsvColumnReaderBase : public Object {
+ public:
+  // Returns the `CsvReaderBase` being read from. Unchanged by `Close()`.
+  virtual CsvReaderBase* src_csv_reader() = 0;
+  virtual const CsvReaderBase* src_csv_reader() const = 0;
+
+  // Returns the names of the columns being read.
+  const CsvHeader& columns() const { return columns_; }
+
+  // Reads up to `max_records` records, replacing the contents of `batch`.
+  //
+  // Fields are parsed directly from views of the CSV source without being
+  // materialized as strings, see
+  // `CsvReaderBase::ReadRecord(std::vector<absl::string_view>&)`.
+  //
+  // If a failure occurs after some records were read, these records are
+  // returned in `batch`, and the failure is reported by the next call.
+  //
+  // Return values:
+  //  * `true`                      - success (`batch.num_records() > 0`)
+  //  * `false` (when `healthy()`)  - source ends (`batch.num_records() == 0`)
+  //  * `false` (when `!healthy()`) - failure (`batch.num_records() == 0`)
+  bool ReadBatch(size_t max_records, CsvColumnBatch& batch);
+
+ protected:
+  explicit CsvColumnReaderBase(InitiallyClosed) noexcept;
+  explicit CsvColumnReaderBase(InitiallyOpen) noexcept;
+
+  CsvColumnReaderBase(CsvColumnReaderBase&& that) noexcept;
+  CsvColumnReaderBase& operator=(CsvColumnReaderBase&& that) noexcept;
+
+  void Reset(InitiallyClosed);
+  void Reset(InitiallyOpen);
+  void Initialize(CsvReaderBase* src, CsvHeader&& columns,
+                  std::vector<CsvColumnType>&& types);
+
+ private:
+  // Parses `fields_` and appends the values to `batch`.
+  bool ParseRecord(CsvReaderBase& src, CsvColumnBatch& batch);
+
+  CsvHeader columns_;
+  std::vector<CsvColumnType> types_;
+  // `positions_[i]` is the index of the field of column `i` in a record.
+  std::vector<size_t> positions_;
+  // The minimum number of fields of a record.
+  size_t min_num_fields_ = 0;
+  // A failure to be reported by the next `ReadBatch()`.
+  absl::Status pending_failure_;
+  std::vector<absl::string_view> fields_;
+};
+
+// `CsvColumnReader` reads selected columns of a CSV file with a header, parsing
+// their values as numbers and storing them by columns in batches.
+//
+// The `Src` template parameter specifies the type of the object providing and
+// possibly owning the `CsvReaderBase`. `Src` must support
+// `Dependency<CsvReaderBase*, Src>`, e.g. `CsvReaderBase*` (not owned,
+// default), `std::unique_ptr<CsvReaderBase>` (owned), `CsvReader<>` (owned).
+// The `CsvReaderBase` must have been created with `Options::read_header()`.
+//
+// By relying on CTAD the template argument can be deduced as the value type of
+// the first constructor argument. This requires C++17.
+template <typename Src = CsvReaderBase*>
+class CsvColumnReader : public CsvColumnReaderBase {
+ public:
+  // Creates a closed `CsvColumnReader`.
+  CsvColumnReader() noexcept : CsvColumnReaderBase(kInitiallyClosed) {}
+
+  // Will read from the `CsvReaderBase` provided by `src` the columns named by
+  // `columns`, with the corresponding `types`.
+  //
+  // Precondition: `columns.size() == types.size()`
+  explicit CsvColumnReader(const Src& src, CsvHeader columns,
+                           std::vector<CsvColumnType> types);
+  explicit CsvColumnReader(Src&& src, CsvHeader columns,
+                           std::vector<CsvColumnType> types);
+
+  // Will read from the `CsvReaderBase` provided by a `Src` constructed from
+  // elements of `src_args`. This avoids constructing a temporary `Src` and
+  // moving from it.
+  template <typename... SrcArgs>
+  explicit CsvColumnReader(std::tuple<SrcArgs...> src_args, CsvHeader columns,
+                           std::vector<CsvColumnType> types);
+
+  CsvColumnReader(CsvColumnReader&& that) noexcept;
+  CsvColumnReader& operator=(CsvColumnReader&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `CsvColumnReader`. This
+  // avoids constructing a temporary `CsvColumnReader` and moving from it.
+  void Reset();
+  void Reset(const Src& src, CsvHeader columns,
+             std::vector<CsvColumnType> types);
+  void Reset(Src&& src, CsvHeader columns, std::vector<CsvColumnType> types);
+  template <typename... SrcArgs>
+  void Reset(std::tuple<SrcArgs...> src_args, CsvHeader columns,
+             std::vector<CsvColumnType> types);
+
+  // Returns the object providing and possibly owning the `CsvReaderBase`.
+  // Unchanged by `Close()`.
+  Src& src() { return src_.manager(); }
+  const Src& src() const { return src_.manager(); }
+  CsvReaderBase* src_csv_reader() override { return src_.get(); }
+  const CsvReaderBase* src_csv_reader() const override { return src_.get(); }
+
+ protected:
+  void Done() override;
+
+ private:
+  // The object providing and possibly owning the `CsvReaderBase`.
+  Dependency<CsvReaderBase*, Src> src_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+CsvColumnReader()->CsvColumnReader<DeleteCtad<>>;
+template <typename Src>
+explicit CsvColumnReader(const Src& src, CsvHeader columns,
+                         std::vector<CsvColumnType> types)
+    -> CsvColumnReader<std::decay_t<Src>>;
+template <typename Src>
+explicit CsvColumnReader(Src&& src, CsvHeader columns,
+                         std::vector<CsvColumnType> types)
+    -> CsvColumnReader<std::decay_t<Src>>;
+template <typename... SrcArgs>
+explicit CsvColumnReader(std::tuple<SrcArgs...> src_args, CsvHeader columns,
+                         std::vector<CsvColumnType> types)
+    -> CsvColumnReader<DeleteCtad<std::tuple<SrcArgs...>>>;
+#endif
+
+// Implementation details follow.
+
+inline CsvColumnType CsvColumnBatch::type(size_t index) const {
+  RIEGELI_ASSERT_LT(index, types_.size())
+      << "Failed precondition of CsvColumnBatch::type(): "
+         "column index out of range";
+  return types_[index];
+}
+
+inline absl::Span<const int64_t> CsvColumnBatch::int64_column(
+    size_t index) const {
+  RIEGELI_ASSERT_LT(index, types_.size())
+      << "Failed precondition of CsvColumnBatch::int64_column(): "
+         "column index out of range";
+  RIEGELI_ASSERT(types_[index] == CsvColumnType::kInt64)
+      << "Failed precondition of CsvColumnBatch::int64_column(): "
+         "column type is not kInt64";
+  return int64_columns_[index];
+}
+
+inline absl::Span<const double> CsvColumnBatch::double_column(
+    size_t index) const {
+  RIEGELI_ASSERT_LT(index, types_.size())
+      << "Failed precondition of CsvColumnBatch::double_column(): "
+         "column index out of range";
+  RIEGELI_ASSERT(types_[index] == CsvColumnType::kDouble)
+      << "Failed precondition of CsvColumnBatch::double_column(): "
+         "column type is not kDouble";
+  return double_columns_[index];
+}
+
+inline CsvColumnReaderBase::CsvColumnReaderBase(InitiallyClosed) noexcept
+    : Object(kInitiallyClosed) {}
+
+inline CsvColumnReaderBase::CsvColumnReaderBase(InitiallyOpen) noexcept
+    : Object(kInitiallyOpen) {}
+
+inline CsvColumnReaderBase::CsvColumnReaderBase(
+    CsvColumnReaderBase&& that) noexcept
+    : Object(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      columns_(std::move(that.columns_)),
+      types_(std::move(that.types_)),
+      positions_(std::move(that.positions_)),
+      min_num_fields_(std::exchange(that.min_num_fields_, 0)),
+      pending_failure_(std::move(that.pending_failure_)),
+      fields_(std::move(that.fields_)) {}
+
+inline CsvColumnReaderBase& CsvColumnReaderBase::operator=(
+    CsvColumnReaderBase&& that) noexcept {
+  Object::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  columns_ = std::move(that.columns_);
+  types_ = std::move(that.types_);
+  positions_ = std::move(that.positions_);
+  min_num_fields_ = std::exchange(that.min_num_fields_, 0);
+  pending_failure_ = std::move(that.pending_failure_);
+  fields_ = std::move(that.fields_);
+  return *this;
+}
+
+inline void CsvColumnReaderBase::Reset(InitiallyClosed) {
+  Object::Reset(kInitiallyClosed);
+  columns_.Reset();
+  types_.clear();
+  positions_.clear();
+  min_num_fields_ = 0;
+  pending_failure_ = absl::OkStatus();
+}
+
+inline void CsvColumnReaderBase::Reset(InitiallyOpen) {
+  Object::Reset(kInitiallyOpen);
+  columns_.Reset();
+  types_.clear();
+  positions_.clear();
+  min_num_fields_ = 0;
+  pending_failure_ = absl::OkStatus();
+}
+
+template <typename Src>
+inline CsvColumnReader<Src>::CsvColumnReader(const Src& src, CsvHeader columns,
+                                             std::vector<CsvColumnType> types)
+    : CsvColumnReaderBase(kInitiallyOpen), src_(src) {
+  Initialize(src_.get(), std::move(columns), std::move(types));
+}
+
+template <typename Src>
+inline CsvColumnReader<Src>::CsvColumnReader(Src&& src, CsvHeader columns,
+                                             std::vector<CsvColumnType> types)
+    : CsvColumnReaderBase(kInitiallyOpen), src_(std::move(src)) {
+  Initialize(src_.get(), std::move(columns), std::move(types));
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline CsvColumnReader<Src>::CsvColumnReader(std::tuple<SrcArgs...> src_args,
+                                             CsvHeader columns,
+                                             std::vector<CsvColumnType> types)
+    : CsvColumnReaderBase(kInitiallyOpen), src_(std::move(src_args)) {
+  Initialize(src_.get(), std::move(columns), std::move(types));
+}
+
+template <typename Src>
+inline CsvColumnReader<Src>::CsvColumnReader(CsvColumnReader&& that) noexcept
+    : CsvColumnReaderBase(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      src_(std::move(that.src_)) {}
+
+template <typename Src>
+inline CsvColumnReader<Src>& CsvColumnReader<Src>::operator=(
+    CsvColumnReader&& that) noexcept {
+  CsvColumnReaderBase::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  src_ = std::move(that.src_);
+  return *this;
+}
+
+template <typename Src>
+inline void CsvColumnReader<Src>::Reset() {
+  CsvColumnReaderBase::Reset(kInitiallyClosed);
+  src_.Reset();
+}
+
+template <typename Src>
+inline void CsvColumnReader<Src>::Reset(const Src& src, CsvHeader columns,
+                                        std::vector<CsvColumnType> types) {
+  CsvColumnReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(src);
+  Initialize(src_.get(), std::move(columns), std::move(types));
+}
+
+template <typename Src>
+inline void CsvColumnReader<Src>::Reset(Src&& src, CsvHeader columns,
+                                        std::vector<CsvColumnType> types) {
+  CsvColumnReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(std::move(src));
+  Initialize(src_.get(), std::move(columns), std::move(types));
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline void CsvColumnReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
+                                        CsvHeader columns,
+                                        std::vector<CsvColumnType> types) {
+  CsvColumnReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(std::move(src_args));
+  Initialize(src_.get(), std::move(columns), std::move(types));
+}
+
+template <typename Src>
+void CsvColumnReader<Src>::Done() {
+  if (src_.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!src_->Close())) Fail(*src_);
+  }
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_CSV_CSV_COLUMN_READER_H_
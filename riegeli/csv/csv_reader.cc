@@ -15,6 +15,7 @@
 #include "riegeli/csv/csv_reader.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <array>
 #include <functional>
@@ -35,8 +36,76 @@
 #include "riegeli/bytes/string_reader.h"
 #include "riegeli/csv/csv_record.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RIEGELI_INTERNAL_CSV_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RIEGELI_INTERNAL_CSV_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace riegeli {
 
+namespace {
+
+#if RIEGELI_INTERNAL_CSV_SSE2 || RIEGELI_INTERNAL_CSV_NEON
+
+// Precondition: `x != 0`
+inline int CountTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+  unsigned long index;
+#ifdef _WIN64
+  _BitScanForward64(&index, x);
+#else
+  if (static_cast<uint32_t>(x) != 0) {
+    _BitScanForward(&index, static_cast<uint32_t>(x));
+  } else {
+    _BitScanForward(&index, static_cast<uint32_t>(x >> 32));
+    index += 32;
+  }
+#endif
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+#endif
+
+// Destination of contents of a field being read: appends them to a string.
+class StringField {
+ public:
+  explicit StringField(std::string& dest) : dest_(dest) {}
+
+  bool empty() const { return dest_.empty(); }
+  size_t size() const { return dest_.size(); }
+  void Append(const char* data, size_t length) { dest_.append(data, length); }
+
+ private:
+  std::string& dest_;
+};
+
+// Destination of contents of a field which is not projected: only its length
+// is tracked, for validation.
+class SkippedField {
+ public:
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  void Append(const char* /*data*/, size_t length) { size_ += length; }
+
+ private:
+  size_t size_ = 0;
+};
+
+}  // namespace
+
+constexpr size_t CsvReaderBase::kNotProjected;
+
 void CsvReaderBase::Initialize(Reader* src, Options&& options) {
   RIEGELI_ASSERT(src != nullptr)
       << "Failed precondition of CsvReader: null Reader pointer";
@@ -56,6 +125,11 @@ void CsvReaderBase::Initialize(Reader* src, Options&& options) {
     RIEGELI_ASSERT(*options.escape() != options.quote())
         << "Escape character conflicts with quote character";
   }
+  RIEGELI_ASSERT(options.projection().empty() || options.read_header())
+      << "Projection by field names requires reading the header";
+  RIEGELI_ASSERT(options.projection().empty() ||
+                 options.projection_indices().empty())
+      << "Projection by field names conflicts with projection by indices";
   if (ABSL_PREDICT_FALSE(!src->healthy())) {
     Fail(*src);
     return;
@@ -77,6 +151,11 @@ void CsvReaderBase::Initialize(Reader* src, Options&& options) {
     char_classes_[static_cast<unsigned char>(*options.escape())] =
         CharClass::kEscape;
   }
+  special_chars_ = {'\n', '\r',
+                    options.comment().value_or('\n'),
+                    options.field_separator(),
+                    options.quote().value_or('\n'),
+                    options.escape().value_or('\n')};
   quote_ = options.quote().value_or('\0');
   max_num_fields_ = UnsignedMin(options.max_num_fields(),
                                 std::vector<std::string>().max_size());
@@ -90,16 +169,40 @@ void CsvReaderBase::Initialize(Reader* src, Options&& options) {
     std::vector<std::string> header;
     if (ABSL_PREDICT_FALSE(!ReadRecord(header))) {
       Fail(absl::InvalidArgumentError("Empty CSV file"));
-    } else {
-      --record_index_;
-      {
-        const absl::Status status = header_.TryReset(std::move(header));
-        if (!status.ok()) {
-          FailAtPreviousRecord(absl::InvalidArgumentError(status.message()));
+      return;
+    }
+    --record_index_;
+    {
+      const absl::Status status = header_.TryReset(std::move(header));
+      if (!status.ok()) {
+        FailAtPreviousRecord(absl::InvalidArgumentError(status.message()));
+        return;
+      }
+    }
+    num_source_header_fields_ = header_.size();
+    if (!options.projection().empty()) {
+      std::vector<size_t> projection_indices;
+      projection_indices.reserve(options.projection().size());
+      for (const std::string& name : options.projection()) {
+        const absl::optional<size_t> index = header_.IndexOf(name);
+        if (ABSL_PREDICT_FALSE(index == absl::nullopt)) {
+          FailAtPreviousRecord(absl::InvalidArgumentError(
+              absl::StrCat("Projected field missing in CSV header: ", name)));
+          return;
         }
+        projection_indices.push_back(*index);
+      }
+      if (ABSL_PREDICT_FALSE(!InitializeProjection(projection_indices))) {
+        return;
       }
     }
   }
+  if (!options.projection_indices().empty()) {
+    if (ABSL_PREDICT_FALSE(
+            !InitializeProjection(options.projection_indices()))) {
+      return;
+    }
+  }
 
   recovery_ = std::move(options.recovery());
 }
@@ -123,12 +226,94 @@ void CsvReaderBase::FailAtPreviousRecord(absl::Status status) {
       Annotate(status, absl::StrCat("at line ", last_line_number())));
 }
 
+bool CsvReaderBase::InitializeProjection(
+    const std::vector<size_t>& projection_indices) {
+  std::vector<std::string> projected_names;
+  for (size_t projected_index = 0; projected_index < projection_indices.size();
+       ++projected_index) {
+    const size_t field_index = projection_indices[projected_index];
+    if (ABSL_PREDICT_FALSE(has_header_ && field_index >= header_.size())) {
+      return Fail(absl::InvalidArgumentError(
+          absl::StrCat("Projected field index out of range: ", field_index,
+                       " >= ", header_.size())));
+    }
+    if (field_index >= projection_.size()) {
+      projection_.resize(field_index + 1, kNotProjected);
+    }
+    if (ABSL_PREDICT_FALSE(projection_[field_index] != kNotProjected)) {
+      return Fail(absl::InvalidArgumentError(
+          absl::StrCat("Duplicate projected field index: ", field_index)));
+    }
+    projection_[field_index] = projected_index;
+    if (has_header_) projected_names.push_back(header_.names()[field_index]);
+  }
+  num_projected_fields_ = projection_indices.size();
+  if (has_header_) header_.Reset(std::move(projected_names));
+  return true;
+}
+
 bool CsvReaderBase::MaxFieldLengthExceeded() {
   recoverable_ = true;
   return Fail(absl::ResourceExhaustedError(
       absl::StrCat("Maximum field length exceeded: ", max_field_length_)));
 }
 
+inline const char* CsvReaderBase::SkipOtherChars(const char* ptr,
+                                                 const char* limit) const {
+  // Most characters are usually of class `CharClass::kOther`, so check 16
+  // characters at a time, comparing them with all special characters at once.
+  // The tail is checked one character at a time using `char_classes_`.
+#if RIEGELI_INTERNAL_CSV_SSE2
+  const __m128i special0 = _mm_set1_epi8(special_chars_[0]);
+  const __m128i special1 = _mm_set1_epi8(special_chars_[1]);
+  const __m128i special2 = _mm_set1_epi8(special_chars_[2]);
+  const __m128i special3 = _mm_set1_epi8(special_chars_[3]);
+  const __m128i special4 = _mm_set1_epi8(special_chars_[4]);
+  const __m128i special5 = _mm_set1_epi8(special_chars_[5]);
+  while (PtrDistance(ptr, limit) >= sizeof(__m128i)) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    const __m128i matches = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, special0),
+                                  _mm_cmpeq_epi8(block, special1)),
+                     _mm_or_si128(_mm_cmpeq_epi8(block, special2),
+                                  _mm_cmpeq_epi8(block, special3))),
+        _mm_or_si128(_mm_cmpeq_epi8(block, special4),
+                     _mm_cmpeq_epi8(block, special5)));
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+    if (mask != 0) return ptr + CountTrailingZeros(mask);
+    ptr += sizeof(__m128i);
+  }
+#elif RIEGELI_INTERNAL_CSV_NEON
+  const uint8_t* const special_chars =
+      reinterpret_cast<const uint8_t*>(special_chars_.data());
+  const uint8x16_t special0 = vdupq_n_u8(special_chars[0]);
+  const uint8x16_t special1 = vdupq_n_u8(special_chars[1]);
+  const uint8x16_t special2 = vdupq_n_u8(special_chars[2]);
+  const uint8x16_t special3 = vdupq_n_u8(special_chars[3]);
+  const uint8x16_t special4 = vdupq_n_u8(special_chars[4]);
+  const uint8x16_t special5 = vdupq_n_u8(special_chars[5]);
+  while (PtrDistance(ptr, limit) >= sizeof(uint8x16_t)) {
+    const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(ptr));
+    const uint8x16_t matches = vorrq_u8(
+        vorrq_u8(vorrq_u8(vceqq_u8(block, special0), vceqq_u8(block, special1)),
+                 vorrq_u8(vceqq_u8(block, special2),
+                          vceqq_u8(block, special3))),
+        vorrq_u8(vceqq_u8(block, special4), vceqq_u8(block, special5)));
+    // Narrow each byte of `matches` to 4 bits, giving a 64-bit mask.
+    const uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+    if (mask != 0) return ptr + CountTrailingZeros(mask) / 4;
+    ptr += sizeof(uint8x16_t);
+  }
+#endif
+  while (ptr != limit &&
+         char_classes_[static_cast<unsigned char>(*ptr)] == CharClass::kOther) {
+    ++ptr;
+  }
+  return ptr;
+}
+
 inline void CsvReaderBase::SkipLine(Reader& src) {
   const char* ptr = src.cursor();
   for (;;) {
@@ -157,7 +342,8 @@ inline void CsvReaderBase::SkipLine(Reader& src) {
   }
 }
 
-inline bool CsvReaderBase::ReadQuoted(Reader& src, std::string& field) {
+template <typename Field>
+inline bool CsvReaderBase::ReadQuoted(Reader& src, Field& field) {
   if (ABSL_PREDICT_FALSE(!field.empty())) {
     recoverable_ = true;
     return Fail(
@@ -172,7 +358,7 @@ inline bool CsvReaderBase::ReadQuoted(Reader& src, std::string& field) {
                              max_field_length_ - field.size())) {
         return MaxFieldLengthExceeded();
       }
-      field.append(src.cursor(), src.available());
+      field.Append(src.cursor(), src.available());
       src.move_cursor(src.available());
       if (ABSL_PREDICT_FALSE(!src.Pull())) {
         if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
@@ -181,9 +367,10 @@ inline bool CsvReaderBase::ReadQuoted(Reader& src, std::string& field) {
       }
       ptr = src.cursor();
     }
+    ptr = SkipOtherChars(ptr, src.limit());
+    if (ptr == src.limit()) continue;
     const CharClass char_class =
         char_classes_[static_cast<unsigned char>(*ptr++)];
-    if (ABSL_PREDICT_TRUE(char_class == CharClass::kOther)) continue;
     switch (char_class) {
       case CharClass::kLf:
         ++line_number_;
@@ -195,7 +382,7 @@ inline bool CsvReaderBase::ReadQuoted(Reader& src, std::string& field) {
                                  max_field_length_ - field.size())) {
             return MaxFieldLengthExceeded();
           }
-          field.append(src.cursor(), src.available());
+          field.Append(src.cursor(), src.available());
           src.move_cursor(src.available());
           if (ABSL_PREDICT_FALSE(!src.Pull())) {
             if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
@@ -216,7 +403,7 @@ inline bool CsvReaderBase::ReadQuoted(Reader& src, std::string& field) {
     if (ABSL_PREDICT_FALSE(length > max_field_length_ - field.size())) {
       return MaxFieldLengthExceeded();
     }
-    field.append(src.cursor(), length);
+    field.Append(src.cursor(), length);
     src.set_cursor(ptr);
     switch (char_class) {
       case CharClass::kOther:
@@ -251,64 +438,42 @@ inline bool CsvReaderBase::ReadQuoted(Reader& src, std::string& field) {
   }
 }
 
-inline bool CsvReaderBase::ReadFields(Reader& src,
-                                      std::vector<std::string>& fields,
-                                      size_t& field_index) {
-  RIEGELI_ASSERT_EQ(field_index, 0u)
-      << "Failed precondition of CsvReaderBase::ReadFields(): "
-         "initial index must be 0";
-next_record:
-  last_line_number_ = line_number_;
-  if (standalone_record_) {
-    if (ABSL_PREDICT_FALSE(record_index_ > 0)) return false;
-  } else {
-    if (ABSL_PREDICT_FALSE(!src.Pull())) {
-      // End of file at the beginning of a record.
-      if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
-      return false;
-    }
-  }
-
-next_field:
-  if (ABSL_PREDICT_FALSE(field_index == max_num_fields_)) {
-    recoverable_ = true;
-    return Fail(absl::ResourceExhaustedError(
-        absl::StrCat("Maximum number of fields exceeded: ", max_num_fields_)));
-  }
-  if (fields.size() == field_index) {
-    fields.emplace_back();
-  } else {
-    fields[field_index].clear();
-  }
-  std::string& field = fields[field_index];
-
+template <typename Field>
+inline CsvReaderBase::FieldEnd CsvReaderBase::ReadField(Reader& src,
+                                                        Field& field,
+                                                        bool first_field) {
   // Data from `src.cursor()` to where `ptr` stops will be appended to `field`.
   const char* ptr = src.cursor();
   for (;;) {
     if (ABSL_PREDICT_FALSE(ptr == src.limit())) {
       if (ABSL_PREDICT_FALSE(src.available() >
                              max_field_length_ - field.size())) {
-        return MaxFieldLengthExceeded();
+        MaxFieldLengthExceeded();
+        return FieldEnd::kFailure;
       }
-      field.append(src.cursor(), src.available());
+      field.Append(src.cursor(), src.available());
       src.move_cursor(src.available());
       if (ABSL_PREDICT_FALSE(!src.Pull())) {
-        if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
+        if (ABSL_PREDICT_FALSE(!src.healthy())) {
+          Fail(src);
+          return FieldEnd::kFailure;
+        }
         // Set `line_number_` as if the last line was terminated by a newline.
         ++line_number_;
-        return true;
+        return FieldEnd::kRecordEnd;
       }
       ptr = src.cursor();
     }
+    ptr = SkipOtherChars(ptr, src.limit());
+    if (ptr == src.limit()) continue;
     const CharClass char_class =
         char_classes_[static_cast<unsigned char>(*ptr++)];
-    if (ABSL_PREDICT_TRUE(char_class == CharClass::kOther)) continue;
     switch (char_class) {
       case CharClass::kComment:
-        if (field_index == 0 && field.empty() && ptr - 1 == src.cursor()) {
+        if (first_field && field.empty() && ptr - 1 == src.cursor()) {
           src.set_cursor(ptr);
           SkipLine(src);
-          goto next_record;
+          return FieldEnd::kComment;
         }
         continue;
       default:
@@ -316,9 +481,10 @@ next_field:
     }
     const size_t length = PtrDistance(src.cursor(), ptr - 1);
     if (ABSL_PREDICT_FALSE(length > max_field_length_ - field.size())) {
-      return MaxFieldLengthExceeded();
+      MaxFieldLengthExceeded();
+      return FieldEnd::kFailure;
     }
-    field.append(src.cursor(), length);
+    field.Append(src.cursor(), length);
     src.set_cursor(ptr);
     switch (char_class) {
       case CharClass::kOther:
@@ -327,32 +493,38 @@ next_field:
       case CharClass::kLf:
         ++line_number_;
         if (ABSL_PREDICT_FALSE(standalone_record_)) {
-          return Fail(absl::InvalidArgumentError("Unexpected newline"));
+          Fail(absl::InvalidArgumentError("Unexpected newline"));
+          return FieldEnd::kFailure;
         }
-        return true;
+        return FieldEnd::kRecordEnd;
       case CharClass::kCr:
         ++line_number_;
         if (ABSL_PREDICT_FALSE(standalone_record_)) {
-          return Fail(absl::InvalidArgumentError("Unexpected newline"));
+          Fail(absl::InvalidArgumentError("Unexpected newline"));
+          return FieldEnd::kFailure;
         }
         if (ABSL_PREDICT_FALSE(!src.Pull())) {
           // If `src` failed after a CR, do not propagate the failure yet. The
           // last record was correctly terminated, no matter whether a LF would
           // follow.
-          return true;
+          return FieldEnd::kRecordEnd;
         }
         if (*src.cursor() == '\n') src.move_cursor(1);
-        return true;
+        return FieldEnd::kRecordEnd;
       case CharClass::kFieldSeparator:
-        ++field_index;
-        goto next_field;
+        return FieldEnd::kFieldSeparator;
       case CharClass::kQuote: {
-        if (ABSL_PREDICT_FALSE(!ReadQuoted(src, field))) return false;
+        if (ABSL_PREDICT_FALSE(!ReadQuoted(src, field))) {
+          return FieldEnd::kFailure;
+        }
         if (ABSL_PREDICT_FALSE(!src.Pull())) {
-          if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
+          if (ABSL_PREDICT_FALSE(!src.healthy())) {
+            Fail(src);
+            return FieldEnd::kFailure;
+          }
           // Set `line_number_` as if the last line was terminated by a newline.
           ++line_number_;
-          return true;
+          return FieldEnd::kRecordEnd;
         }
         const CharClass char_class_after_quoted =
             char_classes_[static_cast<unsigned char>(*src.cursor())];
@@ -362,30 +534,32 @@ next_field:
           case CharClass::kComment:
           case CharClass::kEscape:
             recoverable_ = true;
-            return Fail(absl::InvalidArgumentError(
+            Fail(absl::InvalidArgumentError(
                 "Unquoted data after closing quote"));
+            return FieldEnd::kFailure;
           case CharClass::kFieldSeparator:
-            ++field_index;
-            goto next_field;
+            return FieldEnd::kFieldSeparator;
           case CharClass::kLf:
             ++line_number_;
             if (ABSL_PREDICT_FALSE(standalone_record_)) {
-              return Fail(absl::InvalidArgumentError("Unexpected newline"));
+              Fail(absl::InvalidArgumentError("Unexpected newline"));
+              return FieldEnd::kFailure;
             }
-            return true;
+            return FieldEnd::kRecordEnd;
           case CharClass::kCr:
             ++line_number_;
             if (ABSL_PREDICT_FALSE(standalone_record_)) {
-              return Fail(absl::InvalidArgumentError("Unexpected newline"));
+              Fail(absl::InvalidArgumentError("Unexpected newline"));
+              return FieldEnd::kFailure;
             }
             if (ABSL_PREDICT_FALSE(!src.Pull())) {
               // If `src` failed after a CR, do not propagate the failure yet.
               // The last record was correctly terminated, no matter whether a
               // LF would follow.
-              return true;
+              return FieldEnd::kRecordEnd;
             }
             if (*src.cursor() == '\n') src.move_cursor(1);
-            return true;
+            return FieldEnd::kRecordEnd;
           case CharClass::kQuote:
             RIEGELI_ASSERT_UNREACHABLE() << "Handled by ReadQuoted()";
         }
@@ -395,10 +569,13 @@ next_field:
       }
       case CharClass::kEscape:
         if (ABSL_PREDICT_FALSE(!src.Pull())) {
-          if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
+          if (ABSL_PREDICT_FALSE(!src.healthy())) {
+            Fail(src);
+            return FieldEnd::kFailure;
+          }
           recoverable_ = true;
-          return Fail(
-              absl::InvalidArgumentError("Missing character after escape"));
+          Fail(absl::InvalidArgumentError("Missing character after escape"));
+          return FieldEnd::kFailure;
         }
         ptr = src.cursor() + 1;
         continue;
@@ -408,6 +585,59 @@ next_field:
   }
 }
 
+inline bool CsvReaderBase::ReadFields(Reader& src,
+                                      std::vector<std::string>& fields,
+                                      size_t& field_index) {
+  RIEGELI_ASSERT_EQ(field_index, 0u)
+      << "Failed precondition of CsvReaderBase::ReadFields(): "
+         "initial index must be 0";
+next_record:
+  last_line_number_ = line_number_;
+  if (standalone_record_) {
+    if (ABSL_PREDICT_FALSE(record_index_ > 0)) return false;
+  } else {
+    if (ABSL_PREDICT_FALSE(!src.Pull())) {
+      // End of file at the beginning of a record.
+      if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
+      return false;
+    }
+  }
+
+  for (;; ++field_index) {
+    if (ABSL_PREDICT_FALSE(field_index == max_num_fields_)) {
+      recoverable_ = true;
+      return Fail(absl::ResourceExhaustedError(absl::StrCat(
+          "Maximum number of fields exceeded: ", max_num_fields_)));
+    }
+    FieldEnd field_end;
+    const size_t projected_index = ProjectedIndex(field_index);
+    if (projected_index == kNotProjected) {
+      SkippedField field;
+      field_end = ReadField(src, field, field_index == 0);
+    } else {
+      if (fields.size() <= projected_index) {
+        fields.resize(projected_index + 1);
+      } else {
+        fields[projected_index].clear();
+      }
+      StringField field(fields[projected_index]);
+      field_end = ReadField(src, field, field_index == 0);
+    }
+    switch (field_end) {
+      case FieldEnd::kFailure:
+        return false;
+      case FieldEnd::kFieldSeparator:
+        continue;
+      case FieldEnd::kRecordEnd:
+        return true;
+      case FieldEnd::kComment:
+        goto next_record;
+    }
+    RIEGELI_ASSERT_UNREACHABLE()
+        << "Unknown field end: " << static_cast<int>(field_end);
+  }
+}
+
 bool CsvReaderBase::ReadRecord(CsvRecord& record) {
   RIEGELI_CHECK(has_header())
       << "Failed precondition of CsvReaderBase::ReadRecord(CsvRecord&): "
@@ -424,13 +654,13 @@ try_again:
     record.Reset();
     return false;
   }
-  if (ABSL_PREDICT_FALSE(record.fields_.size() != header_.size())) {
+  if (ABSL_PREDICT_FALSE(last_num_fields_ != num_source_header_fields_)) {
     --record_index_;
-    const size_t record_size = record.fields_.size();
     record.Reset();
     FailAtPreviousRecord(absl::InvalidArgumentError(
         absl::StrCat("Mismatched number of CSV fields: header has ",
-                     header_.size(), ", record has ", record_size)));
+                     num_source_header_fields_, ", record has ",
+                     last_num_fields_)));
     if (recovery_ != nullptr) {
       absl::Status status = this->status();
       MarkNotFailed();
@@ -445,6 +675,84 @@ bool CsvReaderBase::ReadRecord(std::vector<std::string>& record) {
   return ReadRecordInternal(record);
 }
 
+bool CsvReaderBase::ReadRecord(std::vector<absl::string_view>& record) {
+  if (ABSL_PREDICT_FALSE(!healthy())) {
+    record.clear();
+    return false;
+  }
+  Reader& src = *src_reader();
+  if (ABSL_PREDICT_TRUE(ReadRecordFromBuffer(src, record))) return true;
+  if (ABSL_PREDICT_FALSE(!ReadRecordInternal(field_storage_))) {
+    record.clear();
+    return false;
+  }
+  record.assign(field_storage_.begin(), field_storage_.end());
+  return true;
+}
+
+inline bool CsvReaderBase::ReadRecordFromBuffer(
+    Reader& src, std::vector<absl::string_view>& record) {
+  if (ABSL_PREDICT_FALSE(!src.Pull())) return false;
+  record.clear();
+  if (!projection_.empty()) record.resize(num_projected_fields_);
+  size_t field_index = 0;
+  const auto add_field = [&](const char* field_begin, const char* field_end) {
+    const absl::string_view field(field_begin,
+                                  PtrDistance(field_begin, field_end));
+    if (projection_.empty()) {
+      record.push_back(field);
+    } else {
+      const size_t projected_index = ProjectedIndex(field_index);
+      if (projected_index != kNotProjected) record[projected_index] = field;
+    }
+    ++field_index;
+  };
+  const char* field_begin = src.cursor();
+  const char* ptr = field_begin;
+  for (;;) {
+    ptr = SkipOtherChars(ptr, src.limit());
+    if (ABSL_PREDICT_FALSE(ptr == src.limit())) return false;
+    if (ABSL_PREDICT_FALSE(PtrDistance(field_begin, ptr) > max_field_length_)) {
+      return false;
+    }
+    switch (char_classes_[static_cast<unsigned char>(*ptr)]) {
+      case CharClass::kFieldSeparator:
+        if (ABSL_PREDICT_FALSE(field_index + 1 >= max_num_fields_)) {
+          return false;
+        }
+        add_field(field_begin, ptr);
+        field_begin = ++ptr;
+        continue;
+      case CharClass::kComment:
+        if (ABSL_PREDICT_FALSE(ptr == src.cursor())) return false;
+        ++ptr;
+        continue;
+      case CharClass::kLf:
+        add_field(field_begin, ptr);
+        ++ptr;
+        break;
+      case CharClass::kCr:
+        if (ABSL_PREDICT_FALSE(ptr + 1 == src.limit())) return false;
+        add_field(field_begin, ptr);
+        ptr += ptr[1] == '\n' ? 2 : 1;
+        break;
+      case CharClass::kOther:
+      case CharClass::kQuote:
+      case CharClass::kEscape:
+        return false;
+    }
+    break;
+  }
+  // A record missing projected fields is reported by the slow path.
+  if (ABSL_PREDICT_FALSE(field_index < projection_.size())) return false;
+  src.set_cursor(ptr);
+  last_num_fields_ = field_index;
+  last_line_number_ = line_number_;
+  ++line_number_;
+  ++record_index_;
+  return true;
+}
+
 namespace internal {
 
 inline bool ReadStandaloneRecord(CsvReaderBase& csv_reader,
@@ -453,6 +761,13 @@ inline bool ReadStandaloneRecord(CsvReaderBase& csv_reader,
   return csv_reader.ReadRecordInternal(record);
 }
 
+// Used by `ParallelCsvReader` for blocks which do not begin at the beginning of
+// the source, so that failures are annotated with the right line numbers.
+void SetCsvLineNumber(CsvReaderBase& csv_reader, int64_t line_number) {
+  csv_reader.last_line_number_ = line_number;
+  csv_reader.line_number_ = line_number;
+}
+
 }  // namespace internal
 
 inline bool CsvReaderBase::ReadRecordInternal(
@@ -495,7 +810,29 @@ try_again:
     record.clear();
     return false;
   }
-  record.erase(record.begin() + field_index + 1, record.end());
+  last_num_fields_ = field_index + 1;
+  if (projection_.empty()) {
+    record.erase(record.begin() + field_index + 1, record.end());
+  } else {
+    if (ABSL_PREDICT_FALSE(last_num_fields_ < projection_.size())) {
+      absl::Status status = absl::InvalidArgumentError(
+          absl::StrCat("Missing projected CSV fields: projection needs ",
+                       projection_.size(), ", record has ", last_num_fields_));
+      if (standalone_record_) {
+        Fail(std::move(status));
+      } else {
+        FailAtPreviousRecord(std::move(status));
+        if (recovery_ != nullptr) {
+          status = this->status();
+          MarkNotFailed();
+          if (recovery_(std::move(status))) goto try_again;
+        }
+      }
+      record.clear();
+      return false;
+    }
+    record.erase(record.begin() + num_projected_fields_, record.end());
+  }
   ++record_index_;
   return true;
 }
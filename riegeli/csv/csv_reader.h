@@ -45,6 +45,7 @@ class CsvReaderBase;
 namespace internal {
 bool ReadStandaloneRecord(CsvReaderBase& csv_reader,
                           std::vector<std::string>& record);
+void SetCsvLineNumber(CsvReaderBase& csv_reader, int64_t line_number);
 }  // namespace internal
 
 // Template parameter independent part of `CsvReader`.
@@ -225,6 +226,54 @@ class CsvReaderBase : public Object {
       return recovery_;
     }
 
+    // If not empty, only fields with these names are read, in this order.
+    // Other fields are skipped by scanning for the next field separator,
+    // without being copied. `header()` and records read contain only the
+    // projected fields.
+    //
+    // Names are resolved against the header, so this requires
+    // `read_header()`. If a name is missing in the header, reading the header
+    // fails.
+    //
+    // At most one of `set_projection()` and `set_projection_indices()` may be
+    // non-empty. Not supported by `ParallelCsvReader`.
+    //
+    // Default: empty (all fields).
+    Options& set_projection(std::vector<std::string> projection) & {
+      projection_ = std::move(projection);
+      return *this;
+    }
+    Options&& set_projection(std::vector<std::string> projection) && {
+      return std::move(set_projection(std::move(projection)));
+    }
+    std::vector<std::string>& projection() { return projection_; }
+    const std::vector<std::string>& projection() const { return projection_; }
+
+    // If not empty, only fields with these indices (starting from 0) are
+    // read, in this order. Other fields are skipped by scanning for the next
+    // field separator, without being copied. Records read contain only the
+    // projected fields, and so does `header()` if `read_header()`.
+    //
+    // Indices must be distinct. A record which has too few fields to include
+    // all projected fields is invalid.
+    //
+    // At most one of `set_projection()` and `set_projection_indices()` may be
+    // non-empty. Not supported by `ParallelCsvReader`.
+    //
+    // Default: empty (all fields).
+    Options& set_projection_indices(std::vector<size_t> projection_indices) & {
+      projection_indices_ = std::move(projection_indices);
+      return *this;
+    }
+    Options&& set_projection_indices(
+        std::vector<size_t> projection_indices) && {
+      return std::move(set_projection_indices(std::move(projection_indices)));
+    }
+    std::vector<size_t>& projection_indices() { return projection_indices_; }
+    const std::vector<size_t>& projection_indices() const {
+      return projection_indices_;
+    }
+
    private:
     bool read_header_ = false;
     absl::optional<char> comment_;
@@ -234,6 +283,8 @@ class CsvReaderBase : public Object {
     size_t max_num_fields_ = std::numeric_limits<size_t>::max();
     size_t max_field_length_ = std::numeric_limits<size_t>::max();
     std::function<bool(absl::Status)> recovery_;
+    std::vector<std::string> projection_;
+    std::vector<size_t> projection_indices_;
   };
 
   // Returns the byte `Reader` being read from. Unchanged by `Close()`.
@@ -296,6 +347,23 @@ class CsvReaderBase : public Object {
   //  * `false` (when `!healthy()`) - failure (`record` is empty)
   bool ReadRecord(std::vector<std::string>& record);
 
+  // Reads the next record expressed as a vector of views of fields.
+  //
+  // If the record is present in the buffer of the byte `Reader` and its fields
+  // are neither quoted nor escaped, views point directly to the buffer.
+  // Otherwise fields are unescaped into storage owned by the `CsvReader` and
+  // reused for subsequent records. Either way, after the first few records no
+  // memory is allocated per record.
+  //
+  // Views are valid until the next non-const operation on the `CsvReader` or
+  // the byte `Reader`.
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - source ends (`record` is empty)
+  //  * `false` (when `!healthy()`) - failure (`record` is empty)
+  bool ReadRecord(std::vector<absl::string_view>& record);
+
   // The index of the most recently read record, starting from 0.
   //
   // The record count does not include any header read with
@@ -352,6 +420,8 @@ class CsvReaderBase : public Object {
  private:
   friend bool internal::ReadStandaloneRecord(CsvReaderBase& csv_reader,
                                              std::vector<std::string>& record);
+  friend void internal::SetCsvLineNumber(CsvReaderBase& csv_reader,
+                                         int64_t line_number);
 
   enum class CharClass : uint8_t {
     kOther,
@@ -363,12 +433,41 @@ class CsvReaderBase : public Object {
     kEscape,
   };
 
+  // What follows a field read by `ReadField()`.
+  enum class FieldEnd : uint8_t {
+    kFailure,         // Reading failed.
+    kFieldSeparator,  // Another field of the same record follows.
+    kRecordEnd,       // The record ends.
+    kComment,         // The line was a comment and has been skipped.
+  };
+
+  // Marks a source field which is not projected, in `projection_`.
+  static constexpr size_t kNotProjected = std::numeric_limits<size_t>::max();
+
   ABSL_ATTRIBUTE_COLD bool MaxFieldLengthExceeded();
+  // Sets up `projection_`. Indices refer to fields of the source.
+  bool InitializeProjection(const std::vector<size_t>& projection_indices);
+  // Returns the index in a record being read for the field with the given
+  // index in the source, or `kNotProjected` if the field is skipped.
+  size_t ProjectedIndex(size_t field_index) const;
+  // Returns the first position in [`ptr`..`limit`) whose character class is
+  // not `CharClass::kOther`, or `limit` if there is none.
+  const char* SkipOtherChars(const char* ptr, const char* limit) const;
   void SkipLine(Reader& src);
-  bool ReadQuoted(Reader& src, std::string& field);
+  // `Field` is the destination of field contents, either appending them to a
+  // string or only counting their length if the field is skipped.
+  template <typename Field>
+  bool ReadQuoted(Reader& src, Field& field);
+  template <typename Field>
+  FieldEnd ReadField(Reader& src, Field& field, bool first_field);
   bool ReadFields(Reader& src, std::vector<std::string>& fields,
                   size_t& field_index);
   bool ReadRecordInternal(std::vector<std::string>& record);
+  // Reads a record to views of the buffer of `src` if the record is present
+  // there and has no quoted or escaped fields. Returns `false` and leaves
+  // `src` unchanged otherwise.
+  bool ReadRecordFromBuffer(Reader& src,
+                            std::vector<absl::string_view>& record);
 
   bool standalone_record_ = false;
   bool has_header_ = false;
@@ -376,11 +475,28 @@ class CsvReaderBase : public Object {
   // Lookup table for interpreting source characters.
   std::array<CharClass, std::numeric_limits<unsigned char>::max() + 1>
       char_classes_{};
+  // Characters whose class is not `CharClass::kOther`, for scanning many
+  // characters at a time. Unused entries repeat '\n'.
+  std::array<char, 6> special_chars_{};
   // Meaningful if `char_classes_` contains `CharClass::kQuote`.
   char quote_ = '\0';
   size_t max_num_fields_ = 0;
   size_t max_field_length_ = 0;
   std::function<bool(absl::Status)> recovery_;
+  // If not empty, indexed by the index of a source field, the index of that
+  // field in records being read, or `kNotProjected`. Fields beyond its size
+  // are not projected, and a record must include all of its fields.
+  std::vector<size_t> projection_;
+  // The number of fields in records being read if `projection_` is not empty.
+  size_t num_projected_fields_ = 0;
+  // The number of fields of the source header, which can be larger than
+  // `header_.size()` if `projection_` is not empty.
+  size_t num_source_header_fields_ = 0;
+  // The number of fields of the source in the most recently read record.
+  size_t last_num_fields_ = 0;
+  // Fields backing `ReadRecord(std::vector<absl::string_view>&)` when they
+  // cannot point to the buffer.
+  std::vector<std::string> field_storage_;
   uint64_t record_index_ = 0;
   int64_t last_line_number_ = 1;
   int64_t line_number_ = 1;
@@ -518,10 +634,16 @@ inline CsvReaderBase::CsvReaderBase(CsvReaderBase&& that) noexcept
       has_header_(that.has_header_),
       header_(std::move(that.header_)),
       char_classes_(that.char_classes_),
+      special_chars_(that.special_chars_),
       quote_(that.quote_),
       max_num_fields_(that.max_num_fields_),
       max_field_length_(that.max_field_length_),
       recovery_(std::move(that.recovery_)),
+      projection_(std::move(that.projection_)),
+      num_projected_fields_(that.num_projected_fields_),
+      num_source_header_fields_(that.num_source_header_fields_),
+      last_num_fields_(that.last_num_fields_),
+      field_storage_(std::move(that.field_storage_)),
       record_index_(std::exchange(that.record_index_, 0)),
       last_line_number_(std::exchange(that.last_line_number_, 1)),
       line_number_(std::exchange(that.line_number_, 1)),
@@ -535,10 +657,16 @@ inline CsvReaderBase& CsvReaderBase::operator=(CsvReaderBase&& that) noexcept {
   has_header_ = that.has_header_;
   header_ = std::move(that.header_);
   char_classes_ = that.char_classes_;
+  special_chars_ = that.special_chars_;
   quote_ = that.quote_;
   max_num_fields_ = that.max_num_fields_;
   max_field_length_ = that.max_field_length_;
   recovery_ = std::move(that.recovery_);
+  projection_ = std::move(that.projection_);
+  num_projected_fields_ = that.num_projected_fields_;
+  num_source_header_fields_ = that.num_source_header_fields_;
+  last_num_fields_ = that.last_num_fields_;
+  field_storage_ = std::move(that.field_storage_);
   record_index_ = std::exchange(that.record_index_, 0);
   last_line_number_ = std::exchange(that.last_line_number_, 1);
   line_number_ = std::exchange(that.line_number_, 1);
@@ -552,6 +680,10 @@ inline void CsvReaderBase::Reset(InitiallyClosed) {
   has_header_ = false;
   header_.Reset();
   recovery_ = nullptr;
+  projection_.clear();
+  num_projected_fields_ = 0;
+  num_source_header_fields_ = 0;
+  last_num_fields_ = 0;
   record_index_ = 0;
   last_line_number_ = 1;
   line_number_ = 1;
@@ -565,12 +697,22 @@ inline void CsvReaderBase::Reset(InitiallyOpen) {
   header_.Reset();
   char_classes_ = {};
   recovery_ = nullptr;
+  projection_.clear();
+  num_projected_fields_ = 0;
+  num_source_header_fields_ = 0;
+  last_num_fields_ = 0;
   record_index_ = 0;
   last_line_number_ = 1;
   line_number_ = 1;
   recoverable_ = false;
 }
 
+inline size_t CsvReaderBase::ProjectedIndex(size_t field_index) const {
+  if (projection_.empty()) return field_index;
+  if (field_index >= projection_.size()) return kNotProjected;
+  return projection_[field_index];
+}
+
 inline uint64_t CsvReaderBase::last_record_index() const {
   RIEGELI_ASSERT_GT(record_index_, 0u)
       << "Failed precondition of CsvReaderBase::last_record_index(): "
@@ -15,8 +15,12 @@
 #include "riegeli/csv/csv_writer.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <utility>
@@ -24,6 +28,7 @@
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/escaping.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
@@ -34,8 +39,76 @@
 #include "riegeli/bytes/writer.h"
 #include "riegeli/csv/csv_record.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RIEGELI_INTERNAL_CSV_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RIEGELI_INTERNAL_CSV_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace riegeli {
 
+namespace {
+
+#if RIEGELI_INTERNAL_CSV_SSE2 || RIEGELI_INTERNAL_CSV_NEON
+
+// Precondition: `x != 0`
+inline int CountTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+  unsigned long index;
+#ifdef _WIN64
+  _BitScanForward64(&index, x);
+#else
+  if (static_cast<uint32_t>(x) != 0) {
+    _BitScanForward(&index, static_cast<uint32_t>(x));
+  } else {
+    _BitScanForward(&index, static_cast<uint32_t>(x >> 32));
+    index += 32;
+  }
+#endif
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+#endif
+
+// Enough for any number formatted by `FormatNumber()`, including the
+// terminating NUL.
+constexpr size_t kMaxNumberLength = 32;
+
+// Characters which can occur in a number formatted by `FormatNumber()`.
+constexpr absl::string_view kNumberChars = "0123456789+-.eEinfaINFA";
+
+// Writes `value` to `dest`, which must have room for `kMaxNumberLength`
+// characters. Returns the end of the written characters.
+inline char* FormatNumber(int64_t value, char* dest) {
+  return absl::numbers_internal::FastIntToBuffer(value, dest);
+}
+
+inline char* FormatNumber(uint64_t value, char* dest) {
+  return absl::numbers_internal::FastIntToBuffer(value, dest);
+}
+
+inline char* FormatNumber(double value, char* dest) {
+  // 15 significant digits suffice for most values coming from decimal input,
+  // and 17 digits always round trip.
+  int length = std::snprintf(dest, kMaxNumberLength, "%.15g", value);
+  if (std::isfinite(value) && std::strtod(dest, nullptr) != value) {
+    length = std::snprintf(dest, kMaxNumberLength, "%.17g", value);
+  }
+  return dest + length;
+}
+
+}  // namespace
+
 void CsvWriterBase::Initialize(Writer* dest, Options&& options) {
   RIEGELI_ASSERT(dest != nullptr)
       << "Failed precondition of CsvWriter: null Writer pointer";
@@ -61,6 +134,15 @@ void CsvWriterBase::Initialize(Writer* dest, Options&& options) {
   if (options.quote() != absl::nullopt) {
     quotes_needed_[static_cast<unsigned char>(*options.quote())] = true;
   }
+  special_chars_ = {'\n', '\r', options.comment().value_or('\n'),
+                    options.field_separator(), options.quote().value_or('\n')};
+  numbers_need_quoting_ = false;
+  for (const char ch : kNumberChars) {
+    if (quotes_needed_[static_cast<unsigned char>(ch)]) {
+      numbers_need_quoting_ = true;
+      break;
+    }
+  }
   newline_ = options.newline();
   field_separator_ = options.field_separator();
   quote_ = options.quote();
@@ -113,16 +195,101 @@ inline bool CsvWriterBase::WriteQuoted(Writer& dest, absl::string_view field,
   return true;
 }
 
+inline const char* CsvWriterBase::SkipPlainChars(const char* ptr,
+                                                 const char* limit) const {
+  // Most fields do not need quoting, so check 16 characters at a time,
+  // comparing them with all special characters at once. The tail is checked
+  // one character at a time using `quotes_needed_`.
+#if RIEGELI_INTERNAL_CSV_SSE2
+  const __m128i special0 = _mm_set1_epi8(special_chars_[0]);
+  const __m128i special1 = _mm_set1_epi8(special_chars_[1]);
+  const __m128i special2 = _mm_set1_epi8(special_chars_[2]);
+  const __m128i special3 = _mm_set1_epi8(special_chars_[3]);
+  const __m128i special4 = _mm_set1_epi8(special_chars_[4]);
+  while (PtrDistance(ptr, limit) >= sizeof(__m128i)) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    const __m128i matches = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, special0),
+                                  _mm_cmpeq_epi8(block, special1)),
+                     _mm_or_si128(_mm_cmpeq_epi8(block, special2),
+                                  _mm_cmpeq_epi8(block, special3))),
+        _mm_cmpeq_epi8(block, special4));
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+    if (mask != 0) return ptr + CountTrailingZeros(mask);
+    ptr += sizeof(__m128i);
+  }
+#elif RIEGELI_INTERNAL_CSV_NEON
+  const uint8_t* const special_chars =
+      reinterpret_cast<const uint8_t*>(special_chars_.data());
+  const uint8x16_t special0 = vdupq_n_u8(special_chars[0]);
+  const uint8x16_t special1 = vdupq_n_u8(special_chars[1]);
+  const uint8x16_t special2 = vdupq_n_u8(special_chars[2]);
+  const uint8x16_t special3 = vdupq_n_u8(special_chars[3]);
+  const uint8x16_t special4 = vdupq_n_u8(special_chars[4]);
+  while (PtrDistance(ptr, limit) >= sizeof(uint8x16_t)) {
+    const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(ptr));
+    const uint8x16_t matches = vorrq_u8(
+        vorrq_u8(vorrq_u8(vceqq_u8(block, special0), vceqq_u8(block, special1)),
+                 vorrq_u8(vceqq_u8(block, special2),
+                          vceqq_u8(block, special3))),
+        vceqq_u8(block, special4));
+    // Narrow each byte of `matches` to 4 bits, giving a 64-bit mask.
+    const uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+    if (mask != 0) return ptr + CountTrailingZeros(mask) / 4;
+    ptr += sizeof(uint8x16_t);
+  }
+#endif
+  while (ptr != limit && !quotes_needed_[static_cast<unsigned char>(*ptr)]) {
+    ++ptr;
+  }
+  return ptr;
+}
+
 bool CsvWriterBase::WriteField(Writer& dest, absl::string_view field) {
-  for (size_t i = 0; i < field.size(); ++i) {
-    if (quotes_needed_[static_cast<unsigned char>(field[i])]) {
-      return WriteQuoted(dest, field, i);
-    }
+  const char* const limit = field.data() + field.size();
+  const char* const special = SkipPlainChars(field.data(), limit);
+  if (ABSL_PREDICT_FALSE(special != limit)) {
+    return WriteQuoted(dest, field, PtrDistance(field.data(), special));
   }
   if (ABSL_PREDICT_FALSE(!dest.Write(field))) return Fail(dest);
   return true;
 }
 
+template <typename T>
+inline bool CsvWriterBase::WriteNumericField(Writer& dest, T value) {
+  if (ABSL_PREDICT_FALSE(numbers_need_quoting_)) {
+    char buffer[kMaxNumberLength];
+    const char* const end = FormatNumber(value, buffer);
+    return WriteField(dest,
+                      absl::string_view(buffer, PtrDistance(buffer, end)));
+  }
+  if (ABSL_PREDICT_FALSE(!dest.Push(kMaxNumberLength))) return Fail(dest);
+  dest.set_cursor(FormatNumber(value, dest.cursor()));
+  return true;
+}
+
+template <typename T>
+inline bool CsvWriterBase::WriteNumericRecord(absl::Span<const T> record) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (standalone_record_) {
+    RIEGELI_ASSERT_EQ(record_index_, 0u)
+        << "Failed precondition of CsvWriterBase::WriteNumericRecord(): "
+           "called more than once by WriteCsvRecordToString()";
+  }
+  Writer& dest = *dest_writer();
+  for (size_t i = 0; i < record.size(); ++i) {
+    if (i > 0) {
+      if (ABSL_PREDICT_FALSE(!dest.WriteChar(field_separator_))) {
+        return Fail(dest);
+      }
+    }
+    if (ABSL_PREDICT_FALSE(!WriteNumericField(dest, record[i]))) return false;
+  }
+  return WriteRecordEnd(dest);
+}
+
 bool CsvWriterBase::WriteRecord(const CsvRecord& record) {
   RIEGELI_CHECK(has_header_)
       << "Failed precondition of CsvWriterBase::WriteRecord(CsvRecord): "
@@ -135,4 +302,16 @@ bool CsvWriterBase::WriteRecord(const CsvRecord& record) {
   return WriteRecord(record.fields());
 }
 
+bool CsvWriterBase::WriteRecord(absl::Span<const int64_t> record) {
+  return WriteNumericRecord(record);
+}
+
+bool CsvWriterBase::WriteRecord(absl::Span<const uint64_t> record) {
+  return WriteNumericRecord(record);
+}
+
+bool CsvWriterBase::WriteRecord(absl::Span<const double> record) {
+  return WriteNumericRecord(record);
+}
+
 }  // namespace riegeli
@@ -32,6 +32,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/dependency.h"
 #include "riegeli/base/object.h"
@@ -217,6 +218,32 @@ class CsvWriterBase : public Object {
   bool WriteRecord(const Record& record);
   bool WriteRecord(std::initializer_list<absl::string_view> record);
 
+  // Writes the next record expressed as a sequence of numeric fields.
+  //
+  // Numbers are formatted directly into the buffer of the byte `Writer`,
+  // without temporary strings. A `double` is written with 15 significant
+  // digits if this represents it exactly, or with 17 significant digits
+  // otherwise, so that it round trips.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool WriteRecord(absl::Span<const int64_t> record);
+  bool WriteRecord(absl::Span<const uint64_t> record);
+  bool WriteRecord(absl::Span<const double> record);
+
+  // Writes a sequence of records.
+  //
+  // Each element of `records` must be accepted by some `WriteRecord()`
+  // overload, e.g. `std::vector<std::vector<std::string>>` or
+  // `std::vector<std::vector<double>>`.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  template <typename Records>
+  bool WriteRecords(const Records& records);
+
   // The index of the most recently written record, starting from 0.
   //
   // The record count does not include any header written with
@@ -255,11 +282,19 @@ class CsvWriterBase : public Object {
   friend bool internal::WriteStandaloneRecord(const Record& record,
                                               CsvWriterBase& csv_writer);
 
+  // Returns the first position in [`ptr`..`limit`) whose character requires
+  // quoting the field, or `limit` if there is none.
+  const char* SkipPlainChars(const char* ptr, const char* limit) const;
   bool WriteQuoted(Writer& dest, absl::string_view field,
                    size_t already_scanned);
   bool WriteField(Writer& dest, absl::string_view field);
+  template <typename T>
+  bool WriteNumericField(Writer& dest, T value);
+  bool WriteRecordEnd(Writer& dest);
   template <typename Record>
   bool WriteRecordInternal(const Record& record);
+  template <typename T>
+  bool WriteNumericRecord(absl::Span<const T> record);
 
   bool standalone_record_ = false;
   bool has_header_ = false;
@@ -271,6 +306,12 @@ class CsvWriterBase : public Object {
   // of a more complicated lookup code.
   std::array<bool, std::numeric_limits<unsigned char>::max() + 1>
       quotes_needed_{};
+  // Characters for which `quotes_needed_` is `true`, for checking 16
+  // characters at a time. Unused entries are filled with '\n'.
+  std::array<char, 5> special_chars_{};
+  // Whether some character which can occur in a formatted number requires
+  // quoting, e.g. if the field separator is '.'.
+  bool numbers_need_quoting_ = false;
   Newline newline_ = Newline::kLf;
   char field_separator_ = '\0';
   absl::optional<char> quote_;
@@ -412,6 +453,8 @@ inline CsvWriterBase::CsvWriterBase(CsvWriterBase&& that) noexcept
       has_header_(that.has_header_),
       header_(std::move(that.header_)),
       quotes_needed_(that.quotes_needed_),
+      special_chars_(that.special_chars_),
+      numbers_need_quoting_(that.numbers_need_quoting_),
       newline_(that.newline_),
       field_separator_(that.field_separator_),
       quote_(that.quote_),
@@ -425,6 +468,8 @@ inline CsvWriterBase& CsvWriterBase::operator=(CsvWriterBase&& that) noexcept {
   has_header_ = that.has_header_;
   header_ = std::move(that.header_);
   quotes_needed_ = that.quotes_needed_;
+  special_chars_ = that.special_chars_;
+  numbers_need_quoting_ = that.numbers_need_quoting_;
   newline_ = that.newline_;
   field_separator_ = that.field_separator_;
   quote_ = that.quote_;
@@ -446,6 +491,8 @@ inline void CsvWriterBase::Reset(InitiallyOpen) {
   has_header_ = false;
   header_.Reset();
   quotes_needed_ = {};
+  special_chars_ = {};
+  numbers_need_quoting_ = false;
   record_index_ = 0;
 }
 
@@ -491,6 +538,10 @@ inline bool CsvWriterBase::WriteRecordInternal(const Record& record) {
       }
     }
   }
+  return WriteRecordEnd(dest);
+}
+
+inline bool CsvWriterBase::WriteRecordEnd(Writer& dest) {
   if (!standalone_record_) {
     if (ABSL_PREDICT_FALSE(
             !WriteLine(dest, WriteLineOptions().set_newline(newline_)))) {
@@ -506,6 +557,15 @@ inline bool CsvWriterBase::WriteRecord(
   return WriteRecord<std::initializer_list<absl::string_view>>(record);
 }
 
+template <typename Records>
+bool CsvWriterBase::WriteRecords(const Records& records) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  for (const auto& record : records) {
+    if (ABSL_PREDICT_FALSE(!WriteRecord(record))) return false;
+  }
+  return true;
+}
+
 inline uint64_t CsvWriterBase::last_record_index() const {
   RIEGELI_ASSERT_GT(record_index_, 0u)
       << "Failed precondition of CsvWriterBase::last_record_index(): "
@@ -0,0 +1,592 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/csv/parallel_csv_reader.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/base/status.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/string_reader.h"
+#include "riegeli/csv/csv_reader.h"
+#include "riegeli/csv/csv_record.h"
+
+namespace riegeli {
+
+namespace {
+
+// Finds boundaries between records of CSV data without parsing fields, so that
+// the data can be split into blocks parsed independently.
+//
+// This follows the grammar recognized by `CsvReaderBase::ReadFields()`,
+// including quoting, escaping, comments, and skipping the rest of a line after
+// misplaced quotes, but it does not validate anything else.
+class RecordBoundaryScanner {
+ public:
+  explicit RecordBoundaryScanner(const CsvReaderBase::Options& options);
+
+  // Continues scanning `data`, which must begin with the data passed to the
+  // previous call, and must begin at a record boundary.
+  //
+  // If `at_end` is `true`, `data` is the rest of the source. Otherwise scanning
+  // might stop before the end of `data` if a character after the end is needed
+  // to interpret a character.
+  void Scan(absl::string_view data, bool at_end);
+
+  // Returns the position after the last record terminator found so far, or 0
+  // if none.
+  size_t boundary() const { return boundary_; }
+
+  // Returns the number of lines before `boundary()`.
+  int64_t lines_before_boundary() const { return lines_before_boundary_; }
+
+  // Returns the number of lines before the position where scanning stopped.
+  int64_t lines() const { return lines_; }
+
+ private:
+  enum class CharClass : uint8_t {
+    kOther,
+    kLf,
+    kCr,
+    kComment,
+    kFieldSeparator,
+    kQuote,
+    kEscape,
+  };
+
+  enum class State {
+    kRecordStart,  // At the beginning of a record.
+    kFieldStart,   // At the beginning of a field other than the first one.
+    kField,        // Inside an unquoted field with some data.
+    kQuoted,       // Inside a quoted field.
+    kAfterQuoted,  // After the closing quote of a quoted field.
+    kSkipLine,     // Skipping the rest of a comment or malformed line.
+  };
+
+  // Called after a record terminator, with `pos_` after it.
+  void EndRecord();
+
+  std::array<CharClass, std::numeric_limits<unsigned char>::max() + 1>
+      char_classes_{};
+  State state_ = State::kRecordStart;
+  size_t pos_ = 0;
+  int64_t lines_ = 0;
+  size_t boundary_ = 0;
+  int64_t lines_before_boundary_ = 0;
+};
+
+RecordBoundaryScanner::RecordBoundaryScanner(
+    const CsvReaderBase::Options& options) {
+  char_classes_['\n'] = CharClass::kLf;
+  char_classes_['\r'] = CharClass::kCr;
+  if (options.comment() != absl::nullopt) {
+    char_classes_[static_cast<unsigned char>(*options.comment())] =
+        CharClass::kComment;
+  }
+  char_classes_[static_cast<unsigned char>(options.field_separator())] =
+      CharClass::kFieldSeparator;
+  if (options.quote() != absl::nullopt) {
+    char_classes_[static_cast<unsigned char>(*options.quote())] =
+        CharClass::kQuote;
+  }
+  if (options.escape() != absl::nullopt) {
+    char_classes_[static_cast<unsigned char>(*options.escape())] =
+        CharClass::kEscape;
+  }
+}
+
+inline void RecordBoundaryScanner::EndRecord() {
+  ++lines_;
+  boundary_ = pos_;
+  lines_before_boundary_ = lines_;
+  state_ = State::kRecordStart;
+}
+
+void RecordBoundaryScanner::Scan(absl::string_view data, bool at_end) {
+  RIEGELI_ASSERT_GE(data.size(), pos_)
+      << "Failed precondition of RecordBoundaryScanner::Scan(): "
+         "data shrunk";
+  while (pos_ < data.size()) {
+    const CharClass char_class =
+        char_classes_[static_cast<unsigned char>(data[pos_])];
+    if (ABSL_PREDICT_TRUE(char_class == CharClass::kOther)) {
+      if (state_ == State::kRecordStart || state_ == State::kFieldStart) {
+        state_ = State::kField;
+      } else if (state_ == State::kAfterQuoted) {
+        // Unquoted data after closing quote.
+        state_ = State::kSkipLine;
+      }
+      ++pos_;
+      continue;
+    }
+    // A character which might need to be interpreted together with the next
+    // one.
+    const bool needs_next =
+        char_class == CharClass::kCr || char_class == CharClass::kEscape ||
+        (char_class == CharClass::kQuote && state_ == State::kQuoted);
+    if (needs_next && pos_ + 1 == data.size() && !at_end) return;
+    const bool next_is_lf = pos_ + 1 < data.size() && data[pos_ + 1] == '\n';
+    switch (state_) {
+      case State::kRecordStart:
+        if (char_class == CharClass::kComment) {
+          state_ = State::kSkipLine;
+          ++pos_;
+          continue;
+        }
+        ABSL_FALLTHROUGH_INTENDED;
+      case State::kFieldStart:
+      case State::kField:
+        switch (char_class) {
+          case CharClass::kOther:
+          case CharClass::kComment:
+            state_ = State::kField;
+            ++pos_;
+            continue;
+          case CharClass::kFieldSeparator:
+            state_ = State::kFieldStart;
+            ++pos_;
+            continue;
+          case CharClass::kQuote:
+            // A quote not at the beginning of a field is a failure, after
+            // which the rest of the line is skipped.
+            state_ = state_ == State::kField ? State::kSkipLine
+                                             : State::kQuoted;
+            ++pos_;
+            continue;
+          case CharClass::kEscape:
+            state_ = State::kField;
+            pos_ += 2;
+            continue;
+          case CharClass::kLf:
+            ++pos_;
+            EndRecord();
+            continue;
+          case CharClass::kCr:
+            pos_ += next_is_lf ? 2 : 1;
+            EndRecord();
+            continue;
+        }
+        break;
+      case State::kQuoted:
+        switch (char_class) {
+          case CharClass::kOther:
+          case CharClass::kComment:
+          case CharClass::kFieldSeparator:
+            ++pos_;
+            continue;
+          case CharClass::kQuote:
+            if (pos_ + 1 < data.size() && data[pos_ + 1] == data[pos_]) {
+              // Quote written twice.
+              pos_ += 2;
+              continue;
+            }
+            state_ = State::kAfterQuoted;
+            ++pos_;
+            continue;
+          case CharClass::kEscape:
+            pos_ += 2;
+            continue;
+          case CharClass::kLf:
+            ++lines_;
+            ++pos_;
+            continue;
+          case CharClass::kCr:
+            ++lines_;
+            pos_ += next_is_lf ? 2 : 1;
+            continue;
+        }
+        break;
+      case State::kAfterQuoted:
+        switch (char_class) {
+          case CharClass::kFieldSeparator:
+            state_ = State::kFieldStart;
+            ++pos_;
+            continue;
+          case CharClass::kLf:
+            ++pos_;
+            EndRecord();
+            continue;
+          case CharClass::kCr:
+            pos_ += next_is_lf ? 2 : 1;
+            EndRecord();
+            continue;
+          case CharClass::kOther:
+          case CharClass::kComment:
+          case CharClass::kQuote:
+          case CharClass::kEscape:
+            // Unquoted data after closing quote.
+            state_ = State::kSkipLine;
+            ++pos_;
+            continue;
+        }
+        break;
+      case State::kSkipLine:
+        switch (char_class) {
+          case CharClass::kLf:
+            ++pos_;
+            EndRecord();
+            continue;
+          case CharClass::kCr:
+            pos_ += next_is_lf ? 2 : 1;
+            EndRecord();
+            continue;
+          default:
+            ++pos_;
+            continue;
+        }
+    }
+    RIEGELI_ASSERT_UNREACHABLE()
+        << "Unknown character class: " << static_cast<int>(char_class);
+  }
+  // An escape at the end skipped past the end.
+  if (pos_ > data.size()) pos_ = data.size();
+}
+
+// Records of a block, parsed in background.
+struct ParsedBlock {
+  std::vector<std::vector<std::string>> records;
+  // `line_numbers[i]` is the number of the first line of `records[i]`.
+  std::vector<int64_t> line_numbers;
+  // Failures skipped by recovery. `first` is the number of records in the
+  // block preceding the failure.
+  std::vector<std::pair<size_t, absl::Status>> skipped;
+  // Failure which ended parsing the block, after `records`.
+  absl::Status status;
+};
+
+}  // namespace
+
+// Blocks read ahead from the source and parsed in background.
+class ParallelCsvReaderBase::ReadAhead {
+ public:
+  explicit ReadAhead(int parallelism, std::shared_ptr<Executor> executor)
+      : parallelism(parallelism), executor(std::move(executor)) {}
+
+  // Reads blocks from `src` until `parallelism` blocks are pending, or until
+  // `src` ends, and schedules parsing them in background with
+  // `csv_reader.csv_options_`.
+  void Fill(Reader& src, ParallelCsvReaderBase& csv_reader);
+
+  int parallelism;
+  // If not `nullptr`, parses blocks instead of the global thread pool.
+  std::shared_ptr<Executor> executor;
+  // Invariant: `blocks.size() <= parallelism`
+  std::deque<std::future<ParsedBlock>> blocks;
+  // The block records are currently taken from.
+  ParsedBlock current;
+  // The index of the next record of `current`.
+  size_t record_index = 0;
+  // The index of the next element of `current.skipped`.
+  size_t skipped_index = 0;
+};
+
+void ParallelCsvReaderBase::ReadAhead::Fill(Reader& src,
+                                            ParallelCsvReaderBase& csv_reader) {
+  while (blocks.size() < IntCast<size_t>(parallelism)) {
+    std::string data;
+    int64_t num_lines;
+    if (!csv_reader.ReadBlock(src, data, num_lines)) return;
+    // The state of parsing is kept in a single allocation, so that the task
+    // capturing only a pointer fits in the small buffer of `std::function`
+    // and scheduling it does not allocate.
+    struct PendingBlock {
+      std::string data;
+      int64_t first_line_number;
+      CsvReaderBase::Options csv_options;
+      std::promise<ParsedBlock> parsed_block;
+    };
+    PendingBlock* const pending_block =
+        new PendingBlock{std::move(data), csv_reader.next_line_number_,
+                         csv_reader.csv_options_, std::promise<ParsedBlock>()};
+    csv_reader.next_line_number_ += num_lines;
+    blocks.push_back(pending_block->parsed_block.get_future());
+    std::function<void()> task = [pending_block] {
+      ParsedBlock parsed_block;
+      CsvReaderBase::Options& csv_options = pending_block->csv_options;
+      // The header is read by the reading thread before any block.
+      csv_options.set_read_header(false);
+      if (csv_options.recovery() != nullptr) {
+        // Recovery is deferred to the reading thread, to call the recovery
+        // function there and in the order of records.
+        csv_options.set_recovery([&parsed_block](absl::Status status) {
+          parsed_block.skipped.emplace_back(parsed_block.records.size(),
+                                            std::move(status));
+          return true;
+        });
+      }
+      CsvReader<StringReader<>> block_reader(
+          std::forward_as_tuple(pending_block->data), std::move(csv_options));
+      internal::SetCsvLineNumber(block_reader,
+                                 pending_block->first_line_number);
+      std::vector<std::string> record;
+      while (block_reader.ReadRecord(record)) {
+        parsed_block.line_numbers.push_back(block_reader.last_line_number());
+        parsed_block.records.push_back(std::move(record));
+      }
+      if (ABSL_PREDICT_FALSE(!block_reader.healthy())) {
+        parsed_block.status = block_reader.status();
+      }
+      pending_block->parsed_block.set_value(std::move(parsed_block));
+      delete pending_block;
+    };
+    if (executor != nullptr) {
+      executor->Schedule(this, std::move(task));
+    } else {
+      internal::ThreadPool::global().Schedule(std::move(task));
+    }
+  }
+}
+
+ParallelCsvReaderBase::ParallelCsvReaderBase(InitiallyClosed) noexcept
+    : Object(kInitiallyClosed) {}
+
+ParallelCsvReaderBase::ParallelCsvReaderBase(InitiallyOpen) noexcept
+    : Object(kInitiallyOpen) {}
+
+ParallelCsvReaderBase::ParallelCsvReaderBase(
+    ParallelCsvReaderBase&& that) noexcept
+    : Object(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      csv_options_(std::move(that.csv_options_)),
+      block_size_(that.block_size_),
+      has_header_(that.has_header_),
+      header_(std::move(that.header_)),
+      pending_(std::move(that.pending_)),
+      src_ended_(that.src_ended_),
+      next_line_number_(std::exchange(that.next_line_number_, 1)),
+      cancelled_(std::exchange(that.cancelled_, false)),
+      read_ahead_(std::move(that.read_ahead_)),
+      record_index_(std::exchange(that.record_index_, 0)),
+      last_line_number_(std::exchange(that.last_line_number_, 1)) {}
+
+ParallelCsvReaderBase& ParallelCsvReaderBase::operator=(
+    ParallelCsvReaderBase&& that) noexcept {
+  Object::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  csv_options_ = std::move(that.csv_options_);
+  block_size_ = that.block_size_;
+  has_header_ = that.has_header_;
+  header_ = std::move(that.header_);
+  pending_ = std::move(that.pending_);
+  src_ended_ = that.src_ended_;
+  next_line_number_ = std::exchange(that.next_line_number_, 1);
+  cancelled_ = std::exchange(that.cancelled_, false);
+  read_ahead_ = std::move(that.read_ahead_);
+  record_index_ = std::exchange(that.record_index_, 0);
+  last_line_number_ = std::exchange(that.last_line_number_, 1);
+  return *this;
+}
+
+ParallelCsvReaderBase::~ParallelCsvReaderBase() {}
+
+void ParallelCsvReaderBase::Reset(InitiallyClosed) {
+  Object::Reset(kInitiallyClosed);
+  csv_options_ = CsvReaderBase::Options();
+  block_size_ = 0;
+  has_header_ = false;
+  header_.Reset();
+  pending_ = std::string();
+  src_ended_ = false;
+  next_line_number_ = 1;
+  cancelled_ = false;
+  read_ahead_.reset();
+  record_index_ = 0;
+  last_line_number_ = 1;
+}
+
+void ParallelCsvReaderBase::Reset(InitiallyOpen) {
+  Object::Reset(kInitiallyOpen);
+  csv_options_ = CsvReaderBase::Options();
+  block_size_ = 0;
+  has_header_ = false;
+  header_.Reset();
+  pending_ = std::string();
+  src_ended_ = false;
+  next_line_number_ = 1;
+  cancelled_ = false;
+  read_ahead_.reset();
+  record_index_ = 0;
+  last_line_number_ = 1;
+}
+
+void ParallelCsvReaderBase::Initialize(Reader* src, Options&& options) {
+  RIEGELI_ASSERT(src != nullptr)
+      << "Failed precondition of ParallelCsvReader: null Reader pointer";
+  RIEGELI_ASSERT(options.csv_options().projection().empty() &&
+                 options.csv_options().projection_indices().empty())
+      << "Failed precondition of ParallelCsvReader: "
+         "CSV projection not supported";
+  if (ABSL_PREDICT_FALSE(!src->healthy())) {
+    Fail(*src);
+    return;
+  }
+  csv_options_ = std::move(options.csv_options());
+  block_size_ = options.block_size();
+  read_ahead_ = std::make_unique<ReadAhead>(options.parallelism(),
+                                            std::move(options.executor()));
+  if (csv_options_.read_header()) {
+    has_header_ = true;
+    // Read the header directly from `src` with a `CsvReader`, which leaves
+    // `src` positioned after the header.
+    CsvReader<> header_reader(
+        src, CsvReaderBase::Options(csv_options_).set_recovery(nullptr));
+    if (ABSL_PREDICT_FALSE(!header_reader.healthy())) {
+      Fail(header_reader);
+      return;
+    }
+    header_ = header_reader.header();
+    next_line_number_ = header_reader.line_number();
+  }
+}
+
+void ParallelCsvReaderBase::Done() { read_ahead_.reset(); }
+
+bool ParallelCsvReaderBase::ReadBlock(Reader& src, std::string& block,
+                                      int64_t& num_lines) {
+  block = std::move(pending_);
+  pending_ = std::string();
+  RecordBoundaryScanner scanner(csv_options_);
+  for (;;) {
+    if (!src_ended_) {
+      const size_t length = block.size() < block_size_
+                                ? block_size_ - block.size()
+                                : block_size_;
+      if (!src.ReadAndAppend(length, block)) src_ended_ = true;
+    }
+    scanner.Scan(block, src_ended_);
+    if (src_ended_) {
+      num_lines = scanner.lines();
+      return !block.empty();
+    }
+    if (scanner.boundary() > 0) break;
+  }
+  pending_.assign(block, scanner.boundary(), std::string::npos);
+  block.erase(scanner.boundary());
+  num_lines = scanner.lines_before_boundary();
+  return true;
+}
+
+bool ParallelCsvReaderBase::NextBlock(Reader& src) {
+  read_ahead_->Fill(src, *this);
+  if (read_ahead_->blocks.empty()) {
+    if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
+    return false;
+  }
+  read_ahead_->current = read_ahead_->blocks.front().get();
+  read_ahead_->blocks.pop_front();
+  read_ahead_->record_index = 0;
+  read_ahead_->skipped_index = 0;
+  // Keep the pipeline full while records of this block are consumed.
+  read_ahead_->Fill(src, *this);
+  return true;
+}
+
+bool ParallelCsvReaderBase::ReadRecord(CsvRecord& record) {
+  RIEGELI_CHECK(has_header())
+      << "Failed precondition of "
+         "ParallelCsvReaderBase::ReadRecord(CsvRecord&): "
+         "CsvReaderBase::Options::read_header() is required";
+  std::vector<std::string> fields;
+  for (;;) {
+    if (ABSL_PREDICT_FALSE(!ReadRecord(fields))) {
+      record.Reset();
+      return false;
+    }
+    if (ABSL_PREDICT_TRUE(fields.size() == header_.size())) break;
+    --record_index_;
+    const size_t record_size = fields.size();
+    Fail(Annotate(
+        absl::InvalidArgumentError(
+            absl::StrCat("Mismatched number of CSV fields: header has ",
+                         header_.size(), ", record has ", record_size)),
+        absl::StrCat("at line ", last_line_number_)));
+    if (csv_options_.recovery() == nullptr) {
+      record.Reset();
+      return false;
+    }
+    absl::Status status = this->status();
+    MarkNotFailed();
+    if (!csv_options_.recovery()(std::move(status))) {
+      cancelled_ = true;
+      record.Reset();
+      return false;
+    }
+  }
+  record.Reset(header_, std::move(fields));
+  return true;
+}
+
+bool ParallelCsvReaderBase::ReadRecord(std::vector<std::string>& record) {
+  if (ABSL_PREDICT_FALSE(!healthy() || cancelled_)) {
+    record.clear();
+    return false;
+  }
+  Reader& src = *src_reader();
+  for (;;) {
+    ParsedBlock& block = read_ahead_->current;
+    while (read_ahead_->skipped_index < block.skipped.size() &&
+           block.skipped[read_ahead_->skipped_index].first ==
+               read_ahead_->record_index) {
+      absl::Status status =
+          std::move(block.skipped[read_ahead_->skipped_index].second);
+      ++read_ahead_->skipped_index;
+      if (!csv_options_.recovery()(std::move(status))) {
+        cancelled_ = true;
+        record.clear();
+        return false;
+      }
+    }
+    if (read_ahead_->record_index < block.records.size()) {
+      record = std::move(block.records[read_ahead_->record_index]);
+      last_line_number_ = block.line_numbers[read_ahead_->record_index];
+      ++read_ahead_->record_index;
+      ++record_index_;
+      return true;
+    }
+    if (ABSL_PREDICT_FALSE(!block.status.ok())) {
+      Fail(std::move(block.status));
+      record.clear();
+      return false;
+    }
+    if (!NextBlock(src)) {
+      record.clear();
+      return false;
+    }
+  }
+}
+
+}  // namespace riegeli
@@ -0,0 +1,402 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_CSV_PARALLEL_CSV_READER_H_
+#define RIEGELI_CSV_PARALLEL_CSV_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/csv/csv_reader.h"
+#include "riegeli/csv/csv_record.h"
+
+namespace riegeli {
+
+// Template parameter independent part of `ParallelCsvReader`.
+class ParallelCsvReaderBase : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Options of parsing CSV, with the same meaning as for `CsvReader`.
+    //
+    // If `csv_options().recovery()` is not `nullptr`, it is called in the
+    // reading thread, in the order of records.
+    //
+    // Default: `CsvReaderBase::Options()`.
+    Options& set_csv_options(const CsvReaderBase::Options& csv_options) & {
+      csv_options_ = csv_options;
+      return *this;
+    }
+    Options& set_csv_options(CsvReaderBase::Options&& csv_options) & {
+      csv_options_ = std::move(csv_options);
+      return *this;
+    }
+    Options&& set_csv_options(const CsvReaderBase::Options& csv_options) && {
+      return std::move(set_csv_options(csv_options));
+    }
+    Options&& set_csv_options(CsvReaderBase::Options&& csv_options) && {
+      return std::move(set_csv_options(std::move(csv_options)));
+    }
+    CsvReaderBase::Options& csv_options() { return csv_options_; }
+    const CsvReaderBase::Options& csv_options() const { return csv_options_; }
+
+    // Sets the maximum number of blocks being parsed in parallel in
+    // background. Larger parallelism can increase throughput, up to a point
+    // where it no longer matters; smaller parallelism reduces memory usage.
+    //
+    // `parallelism` must be at least 1.
+    // Default: `Executor::DefaultMaxThreads()`.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GE(parallelism, 1)
+          << "Failed precondition of "
+             "ParallelCsvReaderBase::Options::set_parallelism(): "
+             "parallelism out of range";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+    // Sets the approximate size of a block of the source parsed by a single
+    // task. A block is extended to the next record boundary.
+    //
+    // `block_size` must be at least 1.
+    // Default: 1M.
+    Options& set_block_size(size_t block_size) & {
+      RIEGELI_ASSERT_GT(block_size, 0u)
+          << "Failed precondition of "
+             "ParallelCsvReaderBase::Options::set_block_size(): "
+             "zero block size";
+      block_size_ = block_size;
+      return *this;
+    }
+    Options&& set_block_size(size_t block_size) && {
+      return std::move(set_block_size(block_size));
+    }
+    size_t block_size() const { return block_size_; }
+
+    // Sets the `Executor` which parses blocks in background.
+    //
+    // If `nullptr`, blocks are parsed in a global thread pool which creates
+    // threads without a limit.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+   private:
+    CsvReaderBase::Options csv_options_;
+    int parallelism_ = Executor::DefaultMaxThreads();
+    size_t block_size_ = size_t{1} << 20;
+    std::shared_ptr<Executor> executor_;
+  };
+
+  ~ParallelCsvReaderBase();
+
+  // Returns the byte `Reader` being read from. Unchanged by `Close()`.
+  virtual Reader* src_reader() = 0;
+  virtual const Reader* src_reader() const = 0;
+
+  // Returns `true` if reading the header was requested, i.e.
+  // `csv_options().read_header()`.
+  bool has_header() const { return has_header_; }
+
+  // If `has_header()`, returns field names read from the first record. Returns
+  // an empty header if reading the header failed.
+  //
+  // If `!has_header()`, returns an empty header.
+  const CsvHeader& header() const { return header_; }
+
+  // Reads the next record expressed as `CsvRecord`, with named fields.
+  //
+  // See `CsvReaderBase::ReadRecord(CsvRecord&)` for details.
+  //
+  // Precondition:
+  //   `has_header()`, i.e. `csv_options().read_header()`
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - source ends (`record` is empty)
+  //  * `false` (when `!healthy()`) - failure (`record` is empty)
+  bool ReadRecord(CsvRecord& record);
+
+  // Reads the next record expressed as a vector of fields.
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - source ends (`record` is empty)
+  //  * `false` (when `!healthy()`) - failure (`record` is empty)
+  bool ReadRecord(std::vector<std::string>& record);
+
+  // The index of the most recently read record, starting from 0.
+  //
+  // The record count does not include any header read with
+  // `csv_options().read_header()`.
+  //
+  // Precondition: some record was successfully read (`record_index() > 0`).
+  uint64_t last_record_index() const;
+
+  // The index of the next record, starting from 0.
+  //
+  // The record count does not include any header read with
+  // `csv_options().read_header()`.
+  uint64_t record_index() const { return record_index_; }
+
+  // The number of the first line of the most recently read record, starting
+  // from 1.
+  //
+  // This is 1 if no record was read.
+  int64_t last_line_number() const { return last_line_number_; }
+
+ protected:
+  explicit ParallelCsvReaderBase(InitiallyClosed) noexcept;
+  explicit ParallelCsvReaderBase(InitiallyOpen) noexcept;
+
+  ParallelCsvReaderBase(ParallelCsvReaderBase&& that) noexcept;
+  ParallelCsvReaderBase& operator=(ParallelCsvReaderBase&& that) noexcept;
+
+  void Reset(InitiallyClosed);
+  void Reset(InitiallyOpen);
+  void Initialize(Reader* src, Options&& options);
+
+  void Done() override;
+
+ private:
+  class ReadAhead;
+
+  // Reads the next block from `src`, ending at a record boundary. Sets
+  // `num_lines` to the number of lines in the block.
+  //
+  // Returns `false` if `src` has no more data.
+  bool ReadBlock(Reader& src, std::string& block, int64_t& num_lines);
+  // Makes the next parsed block current, waiting for it if needed.
+  //
+  // Returns `false` if there are no more blocks.
+  bool NextBlock(Reader& src);
+
+  CsvReaderBase::Options csv_options_;
+  size_t block_size_ = 0;
+  bool has_header_ = false;
+  CsvHeader header_;
+  // Data read from the source after the last block, beginning at a record
+  // boundary.
+  std::string pending_;
+  // `true` if the source has no more data after `pending_`.
+  bool src_ended_ = false;
+  // The line number of the first line of the next block read from the source.
+  int64_t next_line_number_ = 1;
+  // `true` if the recovery function cancelled reading.
+  bool cancelled_ = false;
+  std::unique_ptr<ReadAhead> read_ahead_;
+  uint64_t record_index_ = 0;
+  int64_t last_line_number_ = 1;
+};
+
+// `ParallelCsvReader` reads records of a CSV (comma-separated values) file,
+// like `CsvReader`, but splits the source into blocks ending at record
+// boundaries and parses them in parallel in background. Records are returned
+// in order.
+//
+// Blocks are read sequentially from the source in the reading thread, which
+// finds record boundaries with a lightweight scan which follows quoting and
+// escaping but does not materialize fields, so that parsing, which dominates
+// the cost, runs on all cores.
+//
+// With a recovery function, some malformed lines (e.g. with unquoted data
+// before an opening quote) might be delimited differently than by `CsvReader`.
+//
+// The `Src` template parameter specifies the type of the object providing and
+// possibly owning the byte `Reader`. `Src` must support
+// `Dependency<Reader*, Src>`, e.g. `Reader*` (not owned, default),
+// `std::unique_ptr<Reader>` (owned), `FdReader<>` (owned).
+//
+// By relying on CTAD the template argument can be deduced as the value type of
+// the first constructor argument. This requires C++17.
+//
+// The byte `Reader` is read ahead by up to `parallelism()` blocks, so the
+// current position is not synchronized with it between records.
+template <typename Src = Reader*>
+class ParallelCsvReader : public ParallelCsvReaderBase {
+ public:
+  // Creates a closed `ParallelCsvReader`.
+  ParallelCsvReader() noexcept : ParallelCsvReaderBase(kInitiallyClosed) {}
+
+  // Will read from the byte `Reader` provided by `src`.
+  explicit ParallelCsvReader(const Src& src, Options options = Options());
+  explicit ParallelCsvReader(Src&& src, Options options = Options());
+
+  // Will read from the byte `Reader` provided by a `Src` constructed from
+  // elements of `src_args`. This avoids constructing a temporary `Src` and
+  // moving from it.
+  template <typename... SrcArgs>
+  explicit ParallelCsvReader(std::tuple<SrcArgs...> src_args,
+                             Options options = Options());
+
+  ParallelCsvReader(ParallelCsvReader&& that) noexcept;
+  ParallelCsvReader& operator=(ParallelCsvReader&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `ParallelCsvReader`. This
+  // avoids constructing a temporary `ParallelCsvReader` and moving from it.
+  void Reset();
+  void Reset(const Src& src, Options options = Options());
+  void Reset(Src&& src, Options options = Options());
+  template <typename... SrcArgs>
+  void Reset(std::tuple<SrcArgs...> src_args, Options options = Options());
+
+  // Returns the object providing and possibly owning the byte `Reader`.
+  // Unchanged by `Close()`.
+  Src& src() { return src_.manager(); }
+  const Src& src() const { return src_.manager(); }
+  Reader* src_reader() override { return src_.get(); }
+  const Reader* src_reader() const override { return src_.get(); }
+
+ protected:
+  void Done() override;
+
+ private:
+  // The object providing and possibly owning the byte `Reader`.
+  Dependency<Reader*, Src> src_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+ParallelCsvReader()->ParallelCsvReader<DeleteCtad<>>;
+template <typename Src>
+explicit ParallelCsvReader(const Src& src,
+                           ParallelCsvReaderBase::Options options =
+                               ParallelCsvReaderBase::Options())
+    -> ParallelCsvReader<std::decay_t<Src>>;
+template <typename Src>
+explicit ParallelCsvReader(Src&& src, ParallelCsvReaderBase::Options options =
+                                          ParallelCsvReaderBase::Options())
+    -> ParallelCsvReader<std::decay_t<Src>>;
+template <typename... SrcArgs>
+explicit ParallelCsvReader(std::tuple<SrcArgs...> src_args,
+                           ParallelCsvReaderBase::Options options =
+                               ParallelCsvReaderBase::Options())
+    -> ParallelCsvReader<DeleteCtad<std::tuple<SrcArgs...>>>;
+#endif
+
+// Implementation details follow.
+
+inline uint64_t ParallelCsvReaderBase::last_record_index() const {
+  RIEGELI_ASSERT_GT(record_index_, 0u)
+      << "Failed precondition of ParallelCsvReaderBase::last_record_index(): "
+         "no record was read";
+  return record_index_ - 1;
+}
+
+template <typename Src>
+inline ParallelCsvReader<Src>::ParallelCsvReader(const Src& src,
+                                                 Options options)
+    : ParallelCsvReaderBase(kInitiallyOpen), src_(src) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+inline ParallelCsvReader<Src>::ParallelCsvReader(Src&& src, Options options)
+    : ParallelCsvReaderBase(kInitiallyOpen), src_(std::move(src)) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline ParallelCsvReader<Src>::ParallelCsvReader(
+    std::tuple<SrcArgs...> src_args, Options options)
+    : ParallelCsvReaderBase(kInitiallyOpen), src_(std::move(src_args)) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+inline ParallelCsvReader<Src>::ParallelCsvReader(
+    ParallelCsvReader&& that) noexcept
+    : ParallelCsvReaderBase(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      src_(std::move(that.src_)) {}
+
+template <typename Src>
+inline ParallelCsvReader<Src>& ParallelCsvReader<Src>::operator=(
+    ParallelCsvReader&& that) noexcept {
+  ParallelCsvReaderBase::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  src_ = std::move(that.src_);
+  return *this;
+}
+
+template <typename Src>
+inline void ParallelCsvReader<Src>::Reset() {
+  ParallelCsvReaderBase::Reset(kInitiallyClosed);
+  src_.Reset();
+}
+
+template <typename Src>
+inline void ParallelCsvReader<Src>::Reset(const Src& src, Options options) {
+  ParallelCsvReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(src);
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+inline void ParallelCsvReader<Src>::Reset(Src&& src, Options options) {
+  ParallelCsvReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(std::move(src));
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline void ParallelCsvReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
+                                          Options options) {
+  ParallelCsvReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(std::move(src_args));
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+void ParallelCsvReader<Src>::Done() {
+  ParallelCsvReaderBase::Done();
+  if (src_.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!src_->Close())) Fail(*src_);
+  }
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_CSV_PARALLEL_CSV_READER_H_
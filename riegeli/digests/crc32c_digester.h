@@ -0,0 +1,56 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_DIGESTS_CRC32C_DIGESTER_H_
+#define RIEGELI_DIGESTS_CRC32C_DIGESTER_H_
+
+#include <stdint.h>
+
+#include "absl/strings/string_view.h"
+#include "crc32c/crc32c.h"
+
+namespace riegeli {
+
+// A `Digester` for `DigestingReader` and `DigestingWriter` which computes
+// CRC32C (Castagnoli) of the data.
+//
+// This uses SSE4.2 or ARMv8 CRC32 instructions when available, detected at
+// runtime, processing three streams in parallel to hide their latency.
+//
+// `Chain` and `absl::Cord` data are digested block by block, without copying.
+class Crc32cDigester {
+ public:
+  // Starts with the given CRC32C of preceding data, or 0 if there are none.
+  explicit Crc32cDigester(uint32_t initial_crc32c = 0)
+      : crc32c_(initial_crc32c) {}
+
+  Crc32cDigester(const Crc32cDigester& that) = default;
+  Crc32cDigester& operator=(const Crc32cDigester& that) = default;
+
+  void Reset(uint32_t initial_crc32c = 0) { crc32c_ = initial_crc32c; }
+
+  void Write(absl::string_view src) {
+    crc32c_ = crc32c::Extend(
+        crc32c_, reinterpret_cast<const uint8_t*>(src.data()), src.size());
+  }
+
+  uint32_t Digest() const { return crc32c_; }
+
+ private:
+  uint32_t crc32c_;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_DIGESTS_CRC32C_DIGESTER_H_
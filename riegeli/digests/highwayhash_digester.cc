@@ -0,0 +1,78 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/digests/highwayhash_digester.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <utility>
+
+#include "absl/strings/string_view.h"
+#include "highwayhash/highwayhash.h"
+#include "highwayhash/hh_types.h"
+#include "riegeli/base/memory.h"
+
+namespace riegeli {
+
+// `HighwayHashCatT` is kept behind a pointer so that the target-specific state
+// type is visible only here. It is over-aligned, so it is allocated with
+// `NewAligned()`, which supports that also before C++17.
+class HighwayHashDigester::State
+    : public highwayhash::HighwayHashCatT<HH_TARGET_PREFERRED> {
+ public:
+  using HighwayHashCatT::HighwayHashCatT;
+};
+
+const highwayhash::HHKey HighwayHashDigester::kDefaultKey = {
+    0x2f696c6567656952,  // 'Riegeli/'
+    0x0a7364726f636572,  // 'records\n'
+    0x2f696c6567656952,  // 'Riegeli/'
+    0x0a7364726f636572,  // 'records\n'
+};
+
+void HighwayHashDigester::StateDeleter::operator()(State* ptr) const {
+  DeleteAligned<State>(ptr, sizeof(State));
+}
+
+HighwayHashDigester::HighwayHashDigester(const highwayhash::HHKey& key)
+    : state_(NewAligned<State>(sizeof(State), key)) {}
+
+HighwayHashDigester::HighwayHashDigester(HighwayHashDigester&& that) noexcept =
+    default;
+
+HighwayHashDigester& HighwayHashDigester::operator=(
+    HighwayHashDigester&& that) noexcept = default;
+
+HighwayHashDigester::~HighwayHashDigester() = default;
+
+void HighwayHashDigester::Reset(const highwayhash::HHKey& key) {
+  if (state_ == nullptr) {
+    state_.reset(NewAligned<State>(sizeof(State), key));
+  } else {
+    state_->Reset(key);
+  }
+}
+
+void HighwayHashDigester::Write(absl::string_view src) {
+  state_->Append(src.data(), src.size());
+}
+
+uint64_t HighwayHashDigester::Digest() const {
+  highwayhash::HHResult64 result;
+  state_->Finalize(&result);
+  return result;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,62 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_DIGESTS_HIGHWAYHASH_DIGESTER_H_
+#define RIEGELI_DIGESTS_HIGHWAYHASH_DIGESTER_H_
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "absl/strings/string_view.h"
+#include "highwayhash/hh_types.h"
+
+namespace riegeli {
+
+// A `Digester` for `DigestingReader` and `DigestingWriter` which computes
+// 64-bit HighwayHash of the data, a keyed hash which uses SIMD instructions
+// available for the target (AVX2, SSE4.1, or portable code).
+//
+// `Chain` and `absl::Cord` data are digested block by block, without copying.
+class HighwayHashDigester {
+ public:
+  // The key used by default, the same as for Riegeli chunk hashes.
+  static const highwayhash::HHKey kDefaultKey;
+
+  explicit HighwayHashDigester(const highwayhash::HHKey& key = kDefaultKey);
+
+  HighwayHashDigester(HighwayHashDigester&& that) noexcept;
+  HighwayHashDigester& operator=(HighwayHashDigester&& that) noexcept;
+
+  ~HighwayHashDigester();
+
+  void Reset(const highwayhash::HHKey& key = kDefaultKey);
+
+  void Write(absl::string_view src);
+
+  uint64_t Digest() const;
+
+ private:
+  class State;
+
+  struct StateDeleter {
+    void operator()(State* ptr) const;
+  };
+
+  std::unique_ptr<State, StateDeleter> state_;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_DIGESTS_HIGHWAYHASH_DIGESTER_H_
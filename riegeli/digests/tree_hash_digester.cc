@@ -0,0 +1,124 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/digests/tree_hash_digester.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/digests/highwayhash_digester.h"
+#include "riegeli/endian/endian_writing.h"
+
+namespace riegeli {
+
+namespace {
+
+uint64_t HashLeaf(absl::string_view leaf) {
+  HighwayHashDigester digester;
+  digester.Write(leaf);
+  return digester.Digest();
+}
+
+}  // namespace
+
+TreeHashDigester::TreeHashDigester(Options options)
+    : leaf_size_(options.leaf_size()),
+      max_pending_leaves_(options.max_pending_leaves()),
+      executor_(std::move(options.executor())) {}
+
+TreeHashDigester::TreeHashDigester(TreeHashDigester&& that) noexcept =
+    default;
+
+TreeHashDigester& TreeHashDigester::operator=(
+    TreeHashDigester&& that) noexcept = default;
+
+// Pending tasks own their leaves and promises, so they do not need to be
+// waited for.
+TreeHashDigester::~TreeHashDigester() = default;
+
+void TreeHashDigester::Reset(Options options) {
+  leaf_size_ = options.leaf_size();
+  max_pending_leaves_ = options.max_pending_leaves();
+  executor_ = std::move(options.executor());
+  size_ = 0;
+  leaf_.clear();
+  pending_leaves_.clear();
+  leaf_hashes_.clear();
+}
+
+void TreeHashDigester::Write(absl::string_view src) {
+  size_ += src.size();
+  while (!src.empty()) {
+    if (leaf_.capacity() < leaf_size_) leaf_.reserve(leaf_size_);
+    const size_t length = UnsignedMin(src.size(), leaf_size_ - leaf_.size());
+    leaf_.append(src.data(), length);
+    src.remove_prefix(length);
+    if (leaf_.size() == leaf_size_) ScheduleLeaf();
+  }
+}
+
+void TreeHashDigester::ScheduleLeaf() {
+  if (pending_leaves_.size() >= max_pending_leaves_) FinishOldestLeaf();
+  // `std::function` requires a copyable task, hence `std::shared_ptr`.
+  const std::shared_ptr<const std::string> leaf =
+      std::make_shared<const std::string>(std::move(leaf_));
+  leaf_ = std::string();
+  const std::shared_ptr<std::promise<uint64_t>> promise =
+      std::make_shared<std::promise<uint64_t>>();
+  pending_leaves_.push_back(promise->get_future());
+  std::function<void()> task = [leaf, promise] {
+    promise->set_value(HashLeaf(*leaf));
+  };
+  if (executor_ != nullptr) {
+    executor_->Schedule(this, std::move(task));
+  } else {
+    internal::ThreadPool::global().Schedule(std::move(task));
+  }
+}
+
+void TreeHashDigester::FinishOldestLeaf() {
+  leaf_hashes_.push_back(pending_leaves_.front().get());
+  pending_leaves_.pop_front();
+}
+
+uint64_t TreeHashDigester::Digest() {
+  while (!pending_leaves_.empty()) FinishOldestLeaf();
+  HighwayHashDigester digester;
+  char buffer[sizeof(uint64_t)];
+  for (const uint64_t leaf_hash : leaf_hashes_) {
+    WriteLittleEndian64(leaf_hash, buffer);
+    digester.Write(absl::string_view(buffer, sizeof(buffer)));
+  }
+  // The incomplete last leaf stays in `leaf_`, so that more data can be
+  // appended to it.
+  if (!leaf_.empty() || leaf_hashes_.empty()) {
+    WriteLittleEndian64(HashLeaf(leaf_), buffer);
+    digester.Write(absl::string_view(buffer, sizeof(buffer)));
+  }
+  WriteLittleEndian64(uint64_t{size_}, buffer);
+  digester.Write(absl::string_view(buffer, sizeof(buffer)));
+  return digester.Digest();
+}
+
+}  // namespace riegeli
@@ -0,0 +1,143 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_DIGESTS_TREE_HASH_DIGESTER_H_
+#define RIEGELI_DIGESTS_TREE_HASH_DIGESTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/executor.h"
+
+namespace riegeli {
+
+// A `Digester` for `DigestingReader` and `DigestingWriter` which computes a
+// 64-bit tree hash of the data, hashing parts of the data concurrently so that
+// digesting large streams is not bound by a single core.
+//
+// The data are split into leaves of `leaf_size()` bytes (the last leaf can be
+// shorter). Each leaf is hashed with `HighwayHashDigester` in a background
+// thread, and the digest is the `HighwayHashDigester` hash of the leaf hashes
+// (8 bytes each, little endian) followed by the total size of the data (8
+// bytes, little endian).
+//
+// The digest depends on `leaf_size()`, and differs from the digest computed by
+// `HighwayHashDigester`.
+class TreeHashDigester {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Length of data hashed sequentially as one leaf.
+    //
+    // Default: 1M.
+    Options& set_leaf_size(size_t leaf_size) & {
+      RIEGELI_ASSERT_GT(leaf_size, 0u)
+          << "Failed precondition of "
+             "TreeHashDigester::Options::set_leaf_size(): "
+             "leaf size not positive";
+      leaf_size_ = leaf_size;
+      return *this;
+    }
+    Options&& set_leaf_size(size_t leaf_size) && {
+      return std::move(set_leaf_size(leaf_size));
+    }
+    size_t leaf_size() const { return leaf_size_; }
+
+    // Maximum number of leaves being hashed concurrently. When this many
+    // leaves are pending, writing waits for the oldest one. This bounds the
+    // memory used for copies of leaves to about
+    // `max_pending_leaves() * leaf_size()`.
+    //
+    // Default: `Executor::DefaultMaxThreads() * 2`.
+    Options& set_max_pending_leaves(size_t max_pending_leaves) & {
+      RIEGELI_ASSERT_GT(max_pending_leaves, 0u)
+          << "Failed precondition of "
+             "TreeHashDigester::Options::set_max_pending_leaves(): "
+             "number of leaves not positive";
+      max_pending_leaves_ = max_pending_leaves;
+      return *this;
+    }
+    Options&& set_max_pending_leaves(size_t max_pending_leaves) && {
+      return std::move(set_max_pending_leaves(max_pending_leaves));
+    }
+    size_t max_pending_leaves() const { return max_pending_leaves_; }
+
+    // If not `nullptr`, leaves are hashed in `executor`. Otherwise they are
+    // hashed in a global thread pool.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+   private:
+    size_t leaf_size_ = size_t{1} << 20;
+    size_t max_pending_leaves_ =
+        IntCast<size_t>(Executor::DefaultMaxThreads()) * 2;
+    std::shared_ptr<Executor> executor_;
+  };
+
+  explicit TreeHashDigester(Options options = Options());
+
+  TreeHashDigester(TreeHashDigester&& that) noexcept;
+  TreeHashDigester& operator=(TreeHashDigester&& that) noexcept;
+
+  ~TreeHashDigester();
+
+  void Reset(Options options = Options());
+
+  void Write(absl::string_view src);
+
+  // Waits for leaves being hashed. Returns the digest of data written so far;
+  // more data can be written afterwards.
+  uint64_t Digest();
+
+ private:
+  // Starts hashing `leaf_` in the background.
+  void ScheduleLeaf();
+  // Waits for the oldest pending leaf and appends its hash to `leaf_hashes_`.
+  void FinishOldestLeaf();
+
+  size_t leaf_size_;
+  size_t max_pending_leaves_;
+  std::shared_ptr<Executor> executor_;
+  Position size_ = 0;
+  // Data of the current leaf, not yet scheduled for hashing.
+  std::string leaf_;
+  // Hashes of leaves being hashed, in the order of data.
+  std::deque<std::future<uint64_t>> pending_leaves_;
+  // Hashes of leaves preceding `pending_leaves_`.
+  std::vector<uint64_t> leaf_hashes_;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_DIGESTS_TREE_HASH_DIGESTER_H_
@@ -15,12 +15,15 @@
 #ifndef RIEGELI_ENDIAN_ENDIAN_READING_H_
 #define RIEGELI_ENDIAN_ENDIAN_READING_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <cstring>
 
 #include "absl/base/optimization.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "riegeli/base/base.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/endian/endian_common.h"
 
@@ -38,7 +41,8 @@ absl::optional<uint64_t> ReadBigEndian64(Reader& src);
 
 // Reads an array of numbers in a fixed width Little/Big Endian encoding.
 //
-// This is faster than reading them individually for native endianness.
+// This is faster than reading them individually, especially for native
+// endianness.
 //
 // Returns `false` on failure, with unspecified current position.
 bool ReadLittleEndian16s(Reader& src, absl::Span<uint16_t> dest);
@@ -61,7 +65,8 @@ uint64_t ReadBigEndian64(const char* src);
 // Reads an array of numbers in a fixed width Little/Big Endian encoding from an
 // array.
 //
-// This is faster than reading them individually for native endianness.
+// This is faster than reading them individually, especially for native
+// endianness.
 //
 // Reads `dest.size() * sizeof(uint{16,32,64}_t)` bytes  from `src[]`.
 void ReadLittleEndian16s(const char* src, absl::Span<uint16_t> dest);
@@ -120,10 +125,17 @@ inline bool ReadLittleEndian16s(Reader& src, absl::Span<uint16_t> dest) {
     return src.Read(dest.size() * sizeof(uint16_t),
                     reinterpret_cast<char*>(dest.data()));
   } else {
-    for (uint16_t& dest_value : dest) {
-      const absl::optional<uint16_t> src_value = ReadLittleEndian16(src);
-      if (ABSL_PREDICT_FALSE(src_value == absl::nullopt)) return false;
-      dest_value = *src_value;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!dest.empty()) {
+      if (ABSL_PREDICT_FALSE(!src.Pull(sizeof(uint16_t),
+                                      dest.size() * sizeof(uint16_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(src.available() / sizeof(uint16_t), dest.size());
+      ReadLittleEndian16s(src.cursor(), dest.subspan(0, length));
+      src.move_cursor(length * sizeof(uint16_t));
+      dest.remove_prefix(length);
     }
     return true;
   }
@@ -134,10 +146,17 @@ inline bool ReadLittleEndian32s(Reader& src, absl::Span<uint32_t> dest) {
     return src.Read(dest.size() * sizeof(uint32_t),
                     reinterpret_cast<char*>(dest.data()));
   } else {
-    for (uint32_t& dest_value : dest) {
-      const absl::optional<uint32_t> src_value = ReadLittleEndian32(src);
-      if (ABSL_PREDICT_FALSE(src_value == absl::nullopt)) return false;
-      dest_value = *src_value;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!dest.empty()) {
+      if (ABSL_PREDICT_FALSE(!src.Pull(sizeof(uint32_t),
+                                      dest.size() * sizeof(uint32_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(src.available() / sizeof(uint32_t), dest.size());
+      ReadLittleEndian32s(src.cursor(), dest.subspan(0, length));
+      src.move_cursor(length * sizeof(uint32_t));
+      dest.remove_prefix(length);
     }
     return true;
   }
@@ -148,10 +167,17 @@ inline bool ReadLittleEndian64s(Reader& src, absl::Span<uint64_t> dest) {
     return src.Read(dest.size() * sizeof(uint64_t),
                     reinterpret_cast<char*>(dest.data()));
   } else {
-    for (uint64_t& dest_value : dest) {
-      const absl::optional<uint64_t> src_value = ReadLittleEndian64(src);
-      if (ABSL_PREDICT_FALSE(src_value == absl::nullopt)) return false;
-      dest_value = *src_value;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!dest.empty()) {
+      if (ABSL_PREDICT_FALSE(!src.Pull(sizeof(uint64_t),
+                                      dest.size() * sizeof(uint64_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(src.available() / sizeof(uint64_t), dest.size());
+      ReadLittleEndian64s(src.cursor(), dest.subspan(0, length));
+      src.move_cursor(length * sizeof(uint64_t));
+      dest.remove_prefix(length);
     }
     return true;
   }
@@ -162,10 +188,17 @@ inline bool ReadBigEndian16s(Reader& src, absl::Span<uint16_t> dest) {
     return src.Read(dest.size() * sizeof(uint16_t),
                     reinterpret_cast<char*>(dest.data()));
   } else {
-    for (uint16_t& dest_value : dest) {
-      const absl::optional<uint16_t> src_value = ReadBigEndian16(src);
-      if (ABSL_PREDICT_FALSE(src_value == absl::nullopt)) return false;
-      dest_value = *src_value;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!dest.empty()) {
+      if (ABSL_PREDICT_FALSE(!src.Pull(sizeof(uint16_t),
+                                      dest.size() * sizeof(uint16_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(src.available() / sizeof(uint16_t), dest.size());
+      ReadBigEndian16s(src.cursor(), dest.subspan(0, length));
+      src.move_cursor(length * sizeof(uint16_t));
+      dest.remove_prefix(length);
     }
     return true;
   }
@@ -176,10 +209,17 @@ inline bool ReadBigEndian32s(Reader& src, absl::Span<uint32_t> dest) {
     return src.Read(dest.size() * sizeof(uint32_t),
                     reinterpret_cast<char*>(dest.data()));
   } else {
-    for (uint32_t& dest_value : dest) {
-      const absl::optional<uint32_t> src_value = ReadBigEndian32(src);
-      if (ABSL_PREDICT_FALSE(src_value == absl::nullopt)) return false;
-      dest_value = *src_value;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!dest.empty()) {
+      if (ABSL_PREDICT_FALSE(!src.Pull(sizeof(uint32_t),
+                                      dest.size() * sizeof(uint32_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(src.available() / sizeof(uint32_t), dest.size());
+      ReadBigEndian32s(src.cursor(), dest.subspan(0, length));
+      src.move_cursor(length * sizeof(uint32_t));
+      dest.remove_prefix(length);
     }
     return true;
   }
@@ -190,10 +230,17 @@ inline bool ReadBigEndian64s(Reader& src, absl::Span<uint64_t> dest) {
     return src.Read(dest.size() * sizeof(uint64_t),
                     reinterpret_cast<char*>(dest.data()));
   } else {
-    for (uint64_t& dest_value : dest) {
-      const absl::optional<uint64_t> src_value = ReadBigEndian64(src);
-      if (ABSL_PREDICT_FALSE(src_value == absl::nullopt)) return false;
-      dest_value = *src_value;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!dest.empty()) {
+      if (ABSL_PREDICT_FALSE(!src.Pull(sizeof(uint64_t),
+                                      dest.size() * sizeof(uint64_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(src.available() / sizeof(uint64_t), dest.size());
+      ReadBigEndian64s(src.cursor(), dest.subspan(0, length));
+      src.move_cursor(length * sizeof(uint64_t));
+      dest.remove_prefix(length);
     }
     return true;
   }
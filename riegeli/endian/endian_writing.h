@@ -15,6 +15,7 @@
 #ifndef RIEGELI_ENDIAN_ENDIAN_WRITING_H_
 #define RIEGELI_ENDIAN_ENDIAN_WRITING_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <cstring>
@@ -22,6 +23,7 @@
 #include "absl/base/optimization.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "riegeli/base/base.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/endian/endian_common.h"
@@ -46,7 +48,8 @@ bool WriteBigEndian64(uint64_t data, BackwardWriter& dest);
 
 // Writes an array of numbers in a fixed width Little/Big Endian encoding.
 //
-// This is faster than writing them individually for native endianness.
+// This is faster than writing them individually, especially for native
+// endianness.
 //
 // Returns `false` on failure.
 bool WriteLittleEndian16s(absl::Span<const uint16_t> data, Writer& dest);
@@ -69,7 +72,8 @@ void WriteBigEndian64(uint64_t data, char* dest);
 // Writes an array of numbers in a fixed width Little/Big Endian encoding to an
 // array.
 //
-// This is faster than writing them individually for native endianness.
+// This is faster than writing them individually, especially for native
+// endianness.
 //
 // Writes `data.size() * sizeof(uint{16,32,64}_t)` bytes to `dest[]`.
 void WriteLittleEndian16s(absl::Span<const uint16_t> data, char* dest);
@@ -171,8 +175,17 @@ inline bool WriteLittleEndian16s(absl::Span<const uint16_t> data,
         absl::string_view(reinterpret_cast<const char*>(data.data()),
                           data.size() * sizeof(uint16_t)));
   } else {
-    for (const uint16_t value : data) {
-      if (ABSL_PREDICT_FALSE(!WriteLittleEndian16(value, dest))) return false;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!data.empty()) {
+      if (ABSL_PREDICT_FALSE(!dest.Push(sizeof(uint16_t),
+                                       data.size() * sizeof(uint16_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(dest.available() / sizeof(uint16_t), data.size());
+      WriteLittleEndian16s(data.subspan(0, length), dest.cursor());
+      dest.move_cursor(length * sizeof(uint16_t));
+      data.remove_prefix(length);
     }
     return true;
   }
@@ -185,8 +198,17 @@ inline bool WriteLittleEndian32s(absl::Span<const uint32_t> data,
         absl::string_view(reinterpret_cast<const char*>(data.data()),
                           data.size() * sizeof(uint32_t)));
   } else {
-    for (const uint32_t value : data) {
-      if (ABSL_PREDICT_FALSE(!WriteLittleEndian32(value, dest))) return false;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!data.empty()) {
+      if (ABSL_PREDICT_FALSE(!dest.Push(sizeof(uint32_t),
+                                       data.size() * sizeof(uint32_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(dest.available() / sizeof(uint32_t), data.size());
+      WriteLittleEndian32s(data.subspan(0, length), dest.cursor());
+      dest.move_cursor(length * sizeof(uint32_t));
+      data.remove_prefix(length);
     }
     return true;
   }
@@ -199,8 +221,17 @@ inline bool WriteLittleEndian64s(absl::Span<const uint64_t> data,
         absl::string_view(reinterpret_cast<const char*>(data.data()),
                           data.size() * sizeof(uint64_t)));
   } else {
-    for (const uint64_t value : data) {
-      if (ABSL_PREDICT_FALSE(!WriteLittleEndian64(value, dest))) return false;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!data.empty()) {
+      if (ABSL_PREDICT_FALSE(!dest.Push(sizeof(uint64_t),
+                                       data.size() * sizeof(uint64_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(dest.available() / sizeof(uint64_t), data.size());
+      WriteLittleEndian64s(data.subspan(0, length), dest.cursor());
+      dest.move_cursor(length * sizeof(uint64_t));
+      data.remove_prefix(length);
     }
     return true;
   }
@@ -212,8 +243,17 @@ inline bool WriteBigEndian16s(absl::Span<const uint16_t> data, Writer& dest) {
         absl::string_view(reinterpret_cast<const char*>(data.data()),
                           data.size() * sizeof(uint16_t)));
   } else {
-    for (const uint16_t value : data) {
-      if (ABSL_PREDICT_FALSE(!WriteBigEndian16(value, dest))) return false;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!data.empty()) {
+      if (ABSL_PREDICT_FALSE(!dest.Push(sizeof(uint16_t),
+                                       data.size() * sizeof(uint16_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(dest.available() / sizeof(uint16_t), data.size());
+      WriteBigEndian16s(data.subspan(0, length), dest.cursor());
+      dest.move_cursor(length * sizeof(uint16_t));
+      data.remove_prefix(length);
     }
     return true;
   }
@@ -225,8 +265,17 @@ inline bool WriteBigEndian32s(absl::Span<const uint32_t> data, Writer& dest) {
         absl::string_view(reinterpret_cast<const char*>(data.data()),
                           data.size() * sizeof(uint32_t)));
   } else {
-    for (const uint32_t value : data) {
-      if (ABSL_PREDICT_FALSE(!WriteBigEndian32(value, dest))) return false;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!data.empty()) {
+      if (ABSL_PREDICT_FALSE(!dest.Push(sizeof(uint32_t),
+                                       data.size() * sizeof(uint32_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(dest.available() / sizeof(uint32_t), data.size());
+      WriteBigEndian32s(data.subspan(0, length), dest.cursor());
+      dest.move_cursor(length * sizeof(uint32_t));
+      data.remove_prefix(length);
     }
     return true;
   }
@@ -238,8 +287,17 @@ inline bool WriteBigEndian64s(absl::Span<const uint64_t> data, Writer& dest) {
         absl::string_view(reinterpret_cast<const char*>(data.data()),
                           data.size() * sizeof(uint64_t)));
   } else {
-    for (const uint64_t value : data) {
-      if (ABSL_PREDICT_FALSE(!WriteBigEndian64(value, dest))) return false;
+    // Convert whole buffers at a time, which the compiler vectorizes.
+    while (!data.empty()) {
+      if (ABSL_PREDICT_FALSE(!dest.Push(sizeof(uint64_t),
+                                       data.size() * sizeof(uint64_t)))) {
+        return false;
+      }
+      const size_t length =
+          UnsignedMin(dest.available() / sizeof(uint64_t), data.size());
+      WriteBigEndian64s(data.subspan(0, length), dest.cursor());
+      dest.move_cursor(length * sizeof(uint64_t));
+      data.remove_prefix(length);
     }
     return true;
   }
@@ -15,9 +15,11 @@
 #include "riegeli/lines/line_reading.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <cstring>
 #include <string>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
@@ -29,10 +31,79 @@
 #include "riegeli/base/chain.h"
 #include "riegeli/bytes/reader.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RIEGELI_INTERNAL_LINES_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RIEGELI_INTERNAL_LINES_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace riegeli {
 
 namespace {
 
+#if RIEGELI_INTERNAL_LINES_SSE2 || RIEGELI_INTERNAL_LINES_NEON
+
+// Precondition: `x != 0`
+inline int CountTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+  unsigned long index;
+#ifdef _WIN64
+  _BitScanForward64(&index, x);
+#else
+  if (static_cast<uint32_t>(x) != 0) {
+    _BitScanForward(&index, static_cast<uint32_t>(x));
+  } else {
+    _BitScanForward(&index, static_cast<uint32_t>(x >> 32));
+    index += 32;
+  }
+#endif
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+#endif
+
+// Returns the first position in [`ptr`..`limit`) containing LF or CR, or
+// `limit` if there is none.
+inline const char* FindLfOrCr(const char* ptr, const char* limit) {
+#if RIEGELI_INTERNAL_LINES_SSE2
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  while (PtrDistance(ptr, limit) >= sizeof(__m128i)) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(block, lf), _mm_cmpeq_epi8(block, cr))));
+    if (mask != 0) return ptr + CountTrailingZeros(mask);
+    ptr += sizeof(__m128i);
+  }
+#elif RIEGELI_INTERNAL_LINES_NEON
+  const uint8x16_t lf = vdupq_n_u8('\n');
+  const uint8x16_t cr = vdupq_n_u8('\r');
+  while (PtrDistance(ptr, limit) >= sizeof(uint8x16_t)) {
+    const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(ptr));
+    const uint8x16_t matches =
+        vorrq_u8(vceqq_u8(block, lf), vceqq_u8(block, cr));
+    // Narrow each byte of `matches` to 4 bits, giving a 64-bit mask.
+    const uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+    if (mask != 0) return ptr + CountTrailingZeros(mask) / 4;
+    ptr += sizeof(uint8x16_t);
+  }
+#endif
+  while (ptr != limit && *ptr != '\n' && *ptr != '\r') ++ptr;
+  return ptr;
+}
+
 // Reads `length_to_read` bytes from `src`, writes their prefix of
 // `length_to_write` bytes to `dest`, appending to existing contents
 // (unless `Dest` is `absl::string_view`).
@@ -115,23 +186,19 @@ inline bool ReadLineInternal(Reader& src, Dest& dest, ReadLineOptions options) {
         }
         goto continue_reading;
       }
-      case ReadLineOptions::Newline::kAny:
-        for (const char* newline = src.cursor(); newline < src.limit();
-             ++newline) {
-          if (ABSL_PREDICT_FALSE(*newline == '\n')) {
-            return FoundNewline(src, dest, options,
-                                PtrDistance(src.cursor(), newline), 1);
-          }
-          if (ABSL_PREDICT_FALSE(*newline == '\r')) {
-            const size_t length = PtrDistance(src.cursor(), newline);
-            return FoundNewline(src, dest, options, length,
-                                ABSL_PREDICT_TRUE(src.Pull(length + 2)) &&
-                                        src.cursor()[length + 1] == '\n'
-                                    ? size_t{2}
-                                    : size_t{1});
-          }
+      case ReadLineOptions::Newline::kAny: {
+        const char* const newline = FindLfOrCr(src.cursor(), src.limit());
+        if (ABSL_PREDICT_FALSE(newline == src.limit())) goto continue_reading;
+        const size_t length = PtrDistance(src.cursor(), newline);
+        if (*newline == '\n') {
+          return FoundNewline(src, dest, options, length, 1);
         }
-        goto continue_reading;
+        return FoundNewline(src, dest, options, length,
+                            ABSL_PREDICT_TRUE(src.Pull(length + 2)) &&
+                                    src.cursor()[length + 1] == '\n'
+                                ? size_t{2}
+                                : size_t{1});
+      }
     }
     RIEGELI_ASSERT_UNREACHABLE()
         << "Unknown newline: " << static_cast<int>(options.newline());
@@ -165,23 +232,20 @@ bool ReadLine(Reader& src, absl::string_view& dest, ReadLineOptions options) {
         }
         goto continue_reading;
       }
-      case ReadLineOptions::Newline::kAny:
-        for (const char* newline = src.cursor() + length; newline < src.limit();
-             ++newline) {
-          if (ABSL_PREDICT_FALSE(*newline == '\n')) {
-            return FoundNewline(src, dest, options,
-                                PtrDistance(src.cursor(), newline), 1);
-          }
-          if (ABSL_PREDICT_FALSE(*newline == '\r')) {
-            length = PtrDistance(src.cursor(), newline);
-            return FoundNewline(src, dest, options, length,
-                                ABSL_PREDICT_TRUE(src.Pull(length + 2)) &&
-                                        src.cursor()[length + 1] == '\n'
-                                    ? size_t{2}
-                                    : size_t{1});
-          }
+      case ReadLineOptions::Newline::kAny: {
+        const char* const newline =
+            FindLfOrCr(src.cursor() + length, src.limit());
+        if (ABSL_PREDICT_FALSE(newline == src.limit())) goto continue_reading;
+        length = PtrDistance(src.cursor(), newline);
+        if (*newline == '\n') {
+          return FoundNewline(src, dest, options, length, 1);
         }
-        goto continue_reading;
+        return FoundNewline(src, dest, options, length,
+                            ABSL_PREDICT_TRUE(src.Pull(length + 2)) &&
+                                    src.cursor()[length + 1] == '\n'
+                                ? size_t{2}
+                                : size_t{1});
+      }
     }
     RIEGELI_ASSERT_UNREACHABLE()
         << "Unknown newline: " << static_cast<int>(options.newline());
@@ -212,6 +276,57 @@ bool ReadLine(Reader& src, absl::Cord& dest, ReadLineOptions options) {
   return ReadLineInternal(src, dest, options);
 }
 
+bool ReadLines(Reader& src, std::vector<absl::string_view>& dest,
+               size_t max_lines, ReadLineOptions options) {
+  RIEGELI_ASSERT_GT(max_lines, 0u)
+      << "Failed precondition of ReadLines(): no lines requested";
+  dest.clear();
+  options.set_max_length(
+      UnsignedMin(options.max_length(), absl::string_view().max_size()));
+  if (ABSL_PREDICT_FALSE(!src.Pull())) return false;
+  // Collect lines whose terminator is in the buffer. Pulling is avoided because
+  // it could invalidate lines already collected.
+  const char* cursor = src.cursor();
+  const char* const limit = src.limit();
+  while (dest.size() < max_lines) {
+    const char* newline = limit;
+    switch (options.newline()) {
+      case ReadLineOptions::Newline::kLf:
+        newline = static_cast<const char*>(
+            std::memchr(cursor, '\n', PtrDistance(cursor, limit)));
+        if (newline == nullptr) newline = limit;
+        break;
+      case ReadLineOptions::Newline::kAny:
+        newline = FindLfOrCr(cursor, limit);
+        break;
+    }
+    if (newline == limit) break;
+    size_t newline_length = 1;
+    if (*newline == '\r') {
+      // Whether CR is followed by LF is unknown at the end of the buffer.
+      if (ABSL_PREDICT_FALSE(newline + 1 == limit)) break;
+      if (newline[1] == '\n') newline_length = 2;
+    }
+    const size_t length_with_newline =
+        PtrDistance(cursor, newline) + newline_length;
+    const size_t length = options.keep_newline()
+                              ? length_with_newline
+                              : PtrDistance(cursor, newline);
+    // An overlong line is left for `ReadLine()` to report.
+    if (ABSL_PREDICT_FALSE(length > options.max_length())) break;
+    dest.emplace_back(cursor, length);
+    cursor += length_with_newline;
+  }
+  src.set_cursor(cursor);
+  if (!dest.empty()) return true;
+  dest.emplace_back();
+  if (ABSL_PREDICT_FALSE(!ReadLine(src, dest.back(), options))) {
+    if (dest.back().empty()) dest.clear();
+    return false;
+  }
+  return true;
+}
+
 void SkipBOM(riegeli::Reader& src) {
   if (src.pos() != 0) return;
   src.Pull(3);
@@ -20,6 +20,7 @@
 #include <limits>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
@@ -111,6 +112,27 @@ bool ReadLine(Reader& src, Chain& dest,
 bool ReadLine(Reader& src, absl::Cord& dest,
               ReadLineOptions options = ReadLineOptions());
 
+// Reads lines which are already available in the buffer of `src`, at most
+// `max_lines` of them, avoiding a separate call per line.
+//
+// `dest` is cleared and filled with lines pointing into the buffer of `src`.
+// They are valid until the next non-const operation on `src`.
+//
+// If the buffer does not contain a complete line, reads a single line like
+// `ReadLine()`, pulling more data as needed.
+//
+// Precondition: `max_lines > 0`
+//
+// Return values:
+//  * `true`                          - success (`dest` is not empty)
+//  * `false` (when `src.healthy()`)  - source ends (`dest` is empty)
+//  * `false` (when `!src.healthy()`) - failure (`dest` contains the partial
+//                                               line read before the failure,
+//                                               if any)
+bool ReadLines(Reader& src, std::vector<absl::string_view>& dest,
+               size_t max_lines = std::numeric_limits<size_t>::max(),
+               ReadLineOptions options = ReadLineOptions());
+
 // Skips an initial UTF-8 BOM if it is present.
 //
 // Does nothing unless `src.pos() == 0`.
@@ -0,0 +1,293 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/lines/parallel_line_reader.h"
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/base/status.h"
+#include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/writer.h"
+#include "riegeli/lines/line_reading.h"
+
+namespace riegeli {
+
+namespace {
+
+constexpr size_t kMinAutomaticRangeSize = size_t{64} << 10;
+constexpr size_t kDefaultRangeSize = size_t{1} << 20;
+
+// A range of the source together with the result of processing it.
+struct LineRange {
+  Position start_pos = 0;
+  Chain src;
+  Chain dest;
+  absl::Status status;
+  // Set when processing completed. Guarded by `RangeQueue::State::mutex`.
+  bool done = false;
+};
+
+// Returns the position after the first line terminator in
+// [`cursor`..`limit`), or `nullptr` if there is none.
+//
+// If `*result == '\r'` for the returned `result`, the terminator might be
+// CR LF, which is not checked here.
+const char* FindNewline(const char* cursor, const char* limit,
+                        ReadLineOptions::Newline newline) {
+  switch (newline) {
+    case ReadLineOptions::Newline::kLf: {
+      const char* const found = static_cast<const char*>(
+          std::memchr(cursor, '\n', PtrDistance(cursor, limit)));
+      return found == nullptr ? nullptr : found + 1;
+    }
+    case ReadLineOptions::Newline::kAny:
+      for (; cursor != limit; ++cursor) {
+        if (*cursor == '\n' || *cursor == '\r') return cursor + 1;
+      }
+      return nullptr;
+  }
+  RIEGELI_ASSERT_UNREACHABLE()
+      << "Unknown newline: " << static_cast<int>(newline);
+}
+
+// Reads about `range_size` bytes from `src` to `dest`, extended to the next
+// line boundary.
+//
+// Returns `false` if `src` has no more data.
+bool ReadLineRange(Reader& src, size_t range_size,
+                   ReadLineOptions::Newline newline, Chain& dest) {
+  if (ABSL_PREDICT_FALSE(!src.Pull())) return false;
+  // The last byte of the nominal range is left for the search below, so that
+  // a line terminator there is found, and CR LF is not split.
+  if (!src.ReadAndAppend(range_size - 1, dest)) return true;
+  while (src.Pull()) {
+    const char* const found = FindNewline(src.cursor(), src.limit(), newline);
+    if (found == nullptr) {
+      src.ReadAndAppend(src.available(), dest);
+      continue;
+    }
+    size_t length = PtrDistance(src.cursor(), found);
+    if (found[-1] == '\r' && src.Pull(length + 1) &&
+        src.cursor()[length] == '\n') {
+      ++length;
+    }
+    src.ReadAndAppend(length, dest);
+    break;
+  }
+  return true;
+}
+
+}  // namespace
+
+// Ranges being processed in background, in the order they were read.
+class ParallelLineReaderBase::RangeQueue {
+ public:
+  explicit RangeQueue(bool ordered, std::shared_ptr<Executor> executor)
+      : ordered_(ordered),
+        executor_(std::move(executor)),
+        state_(std::make_shared<State>()) {}
+
+  RangeQueue(const RangeQueue&) = delete;
+  RangeQueue& operator=(const RangeQueue&) = delete;
+
+  // Waits for all pending ranges, because they refer to the processing
+  // function owned by the caller.
+  ~RangeQueue() {
+    while (!pending_.empty()) Next();
+  }
+
+  size_t size() const { return pending_.size(); }
+
+  // Schedules processing `range` with `process_range` in background.
+  //
+  // `process_range` must be valid until the range is returned by `Next()`.
+  void Schedule(std::unique_ptr<LineRange> range,
+                const ProcessRangeFunction* process_range);
+
+  // Waits until processing some range completes, and returns it: the oldest
+  // range if `ordered`, or the range completed first otherwise.
+  //
+  // Precondition: `size() > 0`
+  std::unique_ptr<LineRange> Next();
+
+ private:
+  // State shared with tasks, which can outlive `RangeQueue` for a moment after
+  // they mark their range as done.
+  struct State {
+    absl::Mutex mutex;
+    // Ranges completed and not yet returned by `Next()`, in the order of
+    // completion. Used only if not `ordered_`.
+    std::deque<LineRange*> completed ABSL_GUARDED_BY(mutex);
+  };
+
+  static bool HasCompleted(std::deque<LineRange*>* completed) {
+    return !completed->empty();
+  }
+
+  bool ordered_;
+  std::shared_ptr<Executor> executor_;
+  std::shared_ptr<State> state_;
+  // Ranges scheduled and not yet returned by `Next()`, in the order of the
+  // source.
+  std::deque<std::unique_ptr<LineRange>> pending_;
+};
+
+void ParallelLineReaderBase::RangeQueue::Schedule(
+    std::unique_ptr<LineRange> range,
+    const ProcessRangeFunction* process_range) {
+  LineRange* const range_ptr = range.get();
+  pending_.push_back(std::move(range));
+  std::function<void()> task = [range_ptr, process_range, ordered = ordered_,
+                                state = state_] {
+    ChainReader<> src(&range_ptr->src);
+    ChainWriter<> dest(&range_ptr->dest);
+    absl::Status status = (*process_range)(src, dest);
+    if (ABSL_PREDICT_FALSE(!src.Close()) && status.ok()) status = src.status();
+    if (ABSL_PREDICT_FALSE(!dest.Close()) && status.ok()) {
+      status = dest.status();
+    }
+    range_ptr->status = std::move(status);
+    absl::MutexLock lock(&state->mutex);
+    range_ptr->done = true;
+    if (!ordered) state->completed.push_back(range_ptr);
+  };
+  if (executor_ != nullptr) {
+    executor_->Schedule(this, std::move(task));
+  } else {
+    internal::ThreadPool::global().Schedule(std::move(task));
+  }
+}
+
+std::unique_ptr<LineRange> ParallelLineReaderBase::RangeQueue::Next() {
+  RIEGELI_ASSERT(!pending_.empty())
+      << "Failed precondition of ParallelLineReaderBase::RangeQueue::Next(): "
+         "no pending ranges";
+  absl::MutexLock lock(&state_->mutex);
+  if (ordered_) {
+    state_->mutex.Await(absl::Condition(&pending_.front()->done));
+    std::unique_ptr<LineRange> range = std::move(pending_.front());
+    pending_.pop_front();
+    return range;
+  }
+  state_->mutex.Await(absl::Condition(HasCompleted, &state_->completed));
+  LineRange* const range_ptr = state_->completed.front();
+  state_->completed.pop_front();
+  const auto iter =
+      std::find_if(pending_.begin(), pending_.end(),
+                   [range_ptr](const std::unique_ptr<LineRange>& range) {
+                     return range.get() == range_ptr;
+                   });
+  RIEGELI_ASSERT(iter != pending_.end())
+      << "A completed range is not pending";
+  std::unique_ptr<LineRange> range = std::move(*iter);
+  pending_.erase(iter);
+  return range;
+}
+
+void ParallelLineReaderBase::Initialize(Reader* src, Options&& options) {
+  RIEGELI_ASSERT(src != nullptr)
+      << "Failed precondition of ParallelLineReader: null Reader pointer";
+  newline_ = options.newline();
+  parallelism_ = options.parallelism();
+  range_size_ = options.range_size();
+  ordered_ = options.ordered();
+  executor_ = std::move(options.executor());
+  if (ABSL_PREDICT_FALSE(!src->healthy())) Fail(*src);
+}
+
+inline size_t ParallelLineReaderBase::RangeSize(Reader& src) {
+  if (range_size_ > 0) return range_size_;
+  if (src.SupportsSize()) {
+    const absl::optional<Position> size = src.Size();
+    if (size != absl::nullopt && *size > src.pos()) {
+      const Position per_range =
+          (*size - src.pos() - 1) / IntCast<Position>(parallelism_) + 1;
+      return UnsignedMax(UnsignedMin(per_range, size_t{1} << 30),
+                         kMinAutomaticRangeSize);
+    }
+  }
+  return kDefaultRangeSize;
+}
+
+bool ParallelLineReaderBase::ProcessRanges(
+    std::function<absl::Status(Reader& src)> process_range) {
+  return ProcessRangesInternal(
+      nullptr, [&process_range](Reader& src, Writer& dest) {
+        return process_range(src);
+      });
+}
+
+bool ParallelLineReaderBase::ProcessRanges(
+    Writer& dest, ProcessRangeFunction process_range) {
+  return ProcessRangesInternal(&dest, process_range);
+}
+
+bool ParallelLineReaderBase::ProcessRangesInternal(
+    Writer* dest, const ProcessRangeFunction& process_range) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  Reader& src = *src_reader();
+  const size_t range_size = RangeSize(src);
+  RangeQueue queue(ordered_, executor_);
+  // Writes the output of the next completed range to `dest`.
+  const auto finish_range = [&]() -> bool {
+    const std::unique_ptr<LineRange> range = queue.Next();
+    if (ABSL_PREDICT_FALSE(!range->status.ok())) {
+      return Fail(Annotate(
+          range->status,
+          absl::StrCat("in lines starting at byte ", range->start_pos)));
+    }
+    if (dest != nullptr) {
+      if (ABSL_PREDICT_FALSE(!dest->Write(std::move(range->dest)))) {
+        return Fail(*dest);
+      }
+    }
+    return true;
+  };
+  for (;;) {
+    if (queue.size() >= IntCast<size_t>(parallelism_)) {
+      if (ABSL_PREDICT_FALSE(!finish_range())) return false;
+    }
+    std::unique_ptr<LineRange> range = std::make_unique<LineRange>();
+    range->start_pos = src.pos();
+    if (!ReadLineRange(src, range_size, newline_, range->src)) break;
+    queue.Schedule(std::move(range), &process_range);
+  }
+  while (queue.size() > 0) {
+    if (ABSL_PREDICT_FALSE(!finish_range())) return false;
+  }
+  if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
+  return true;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,386 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_LINES_PARALLEL_LINE_READER_H_
+#define RIEGELI_LINES_PARALLEL_LINE_READER_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/writer.h"
+#include "riegeli/lines/line_reading.h"
+
+namespace riegeli {
+
+// Template parameter independent part of `ParallelLineReader`.
+class ParallelLineReaderBase : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Line terminator representations to recognize at range boundaries.
+    //
+    // Default: `ReadLineOptions::Newline::kLf`.
+    Options& set_newline(ReadLineOptions::Newline newline) & {
+      newline_ = newline;
+      return *this;
+    }
+    Options&& set_newline(ReadLineOptions::Newline newline) && {
+      return std::move(set_newline(newline));
+    }
+    ReadLineOptions::Newline newline() const { return newline_; }
+
+    // Sets the maximum number of ranges being processed in parallel in
+    // background. Larger parallelism can increase throughput, up to a point
+    // where it no longer matters; smaller parallelism reduces memory usage.
+    //
+    // `parallelism` must be at least 1.
+    // Default: `Executor::DefaultMaxThreads()`.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GE(parallelism, 1)
+          << "Failed precondition of "
+             "ParallelLineReaderBase::Options::set_parallelism(): "
+             "parallelism out of range";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+    // Sets the approximate size of a range of the source processed by a
+    // single task. A range is extended to the next line boundary.
+    //
+    // If 0, the size is chosen automatically: if the source supports `Size()`,
+    // the rest of the source is split into `parallelism()` ranges (but not
+    // smaller than 64K), otherwise ranges of 1M are used.
+    //
+    // Default: 0.
+    Options& set_range_size(size_t range_size) & {
+      range_size_ = range_size;
+      return *this;
+    }
+    Options&& set_range_size(size_t range_size) && {
+      return std::move(set_range_size(range_size));
+    }
+    size_t range_size() const { return range_size_; }
+
+    // If `true`, outputs of ranges are written in the order of ranges.
+    //
+    // If `false`, outputs of ranges are written in the order in which
+    // processing them completes. This avoids waiting for a slow range while
+    // later ranges are done.
+    //
+    // Default: `true`.
+    Options& set_ordered(bool ordered) & {
+      ordered_ = ordered;
+      return *this;
+    }
+    Options&& set_ordered(bool ordered) && {
+      return std::move(set_ordered(ordered));
+    }
+    bool ordered() const { return ordered_; }
+
+    // Sets the `Executor` which processes ranges in background.
+    //
+    // If `nullptr`, ranges are processed in a global thread pool which creates
+    // threads without a limit.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+   private:
+    ReadLineOptions::Newline newline_ = ReadLineOptions::Newline::kLf;
+    int parallelism_ = Executor::DefaultMaxThreads();
+    size_t range_size_ = 0;
+    bool ordered_ = true;
+    std::shared_ptr<Executor> executor_;
+  };
+
+  // Processes a range of lines read from `src`, writing any output to `dest`.
+  //
+  // `src` and `dest` are closed after the function returns. A failure of
+  // either of them is reported if the function returns `absl::OkStatus()`.
+  using ProcessRangeFunction =
+      std::function<absl::Status(Reader& src, Writer& dest)>;
+
+  // Returns the byte `Reader` being read from. Unchanged by `Close()`.
+  virtual Reader* src_reader() = 0;
+  virtual const Reader* src_reader() const = 0;
+
+  // Splits the rest of the source into ranges ending at line boundaries, and
+  // calls `process_range` for each range in background, with a `Reader` of
+  // the range. Returns after all ranges are processed.
+  //
+  // Lines are typically read from the range with `ReadLine()` or
+  // `ReadLines()`.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`); processing stops at the first range
+  //              for which `process_range` returned a failure, which is
+  //              annotated with the position of the range
+  bool ProcessRanges(std::function<absl::Status(Reader& src)> process_range);
+
+  // Like `ProcessRanges(process_range)`, but `process_range` also gets a
+  // `Writer` for the output of the range. Outputs of ranges are written to
+  // `dest` in the order specified by `Options::ordered()`.
+  bool ProcessRanges(Writer& dest, ProcessRangeFunction process_range);
+
+ protected:
+  explicit ParallelLineReaderBase(InitiallyClosed) noexcept
+      : Object(kInitiallyClosed) {}
+  explicit ParallelLineReaderBase(InitiallyOpen) noexcept
+      : Object(kInitiallyOpen) {}
+
+  ParallelLineReaderBase(ParallelLineReaderBase&& that) noexcept;
+  ParallelLineReaderBase& operator=(ParallelLineReaderBase&& that) noexcept;
+
+  void Reset(InitiallyClosed);
+  void Reset(InitiallyOpen);
+  void Initialize(Reader* src, Options&& options);
+
+ private:
+  class RangeQueue;
+
+  bool ProcessRangesInternal(Writer* dest,
+                             const ProcessRangeFunction& process_range);
+  size_t RangeSize(Reader& src);
+
+  ReadLineOptions::Newline newline_ = ReadLineOptions::Newline::kLf;
+  int parallelism_ = 0;
+  size_t range_size_ = 0;
+  bool ordered_ = true;
+  std::shared_ptr<Executor> executor_;
+};
+
+// `ParallelLineReader` processes lines of a byte `Reader` in parallel, e.g.
+// newline-delimited JSON.
+//
+// The source is read sequentially in the calling thread, and split into ranges
+// ending at line boundaries. Each range is processed in background by a
+// function given to `ProcessRanges()`, which reads lines from the range.
+//
+// A range is held as a `Chain`. If the source is a `ChainReader` or an
+// `FdMMapReader`, the range shares memory with the source instead of being
+// copied.
+//
+// The `Src` template parameter specifies the type of the object providing and
+// possibly owning the byte `Reader`. `Src` must support
+// `Dependency<Reader*, Src>`, e.g. `Reader*` (not owned, default),
+// `std::unique_ptr<Reader>` (owned), `FdMMapReader<>` (owned).
+//
+// By relying on CTAD the template argument can be deduced as the value type of
+// the first constructor argument. This requires C++17.
+//
+// The byte `Reader` must not be accessed until `ProcessRanges()` returns.
+template <typename Src = Reader*>
+class ParallelLineReader : public ParallelLineReaderBase {
+ public:
+  // Creates a closed `ParallelLineReader`.
+  ParallelLineReader() noexcept : ParallelLineReaderBase(kInitiallyClosed) {}
+
+  // Will read from the byte `Reader` provided by `src`.
+  explicit ParallelLineReader(const Src& src, Options options = Options());
+  explicit ParallelLineReader(Src&& src, Options options = Options());
+
+  // Will read from the byte `Reader` provided by a `Src` constructed from
+  // elements of `src_args`. This avoids constructing a temporary `Src` and
+  // moving from it.
+  template <typename... SrcArgs>
+  explicit ParallelLineReader(std::tuple<SrcArgs...> src_args,
+                              Options options = Options());
+
+  ParallelLineReader(ParallelLineReader&& that) noexcept;
+  ParallelLineReader& operator=(ParallelLineReader&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `ParallelLineReader`. This
+  // avoids constructing a temporary `ParallelLineReader` and moving from it.
+  void Reset();
+  void Reset(const Src& src, Options options = Options());
+  void Reset(Src&& src, Options options = Options());
+  template <typename... SrcArgs>
+  void Reset(std::tuple<SrcArgs...> src_args, Options options = Options());
+
+  // Returns the object providing and possibly owning the byte `Reader`.
+  // Unchanged by `Close()`.
+  Src& src() { return src_.manager(); }
+  const Src& src() const { return src_.manager(); }
+  Reader* src_reader() override { return src_.get(); }
+  const Reader* src_reader() const override { return src_.get(); }
+
+ protected:
+  void Done() override;
+
+ private:
+  // The object providing and possibly owning the byte `Reader`.
+  Dependency<Reader*, Src> src_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+ParallelLineReader()->ParallelLineReader<DeleteCtad<>>;
+template <typename Src>
+explicit ParallelLineReader(const Src& src,
+                            ParallelLineReaderBase::Options options =
+                                ParallelLineReaderBase::Options())
+    -> ParallelLineReader<std::decay_t<Src>>;
+template <typename Src>
+explicit ParallelLineReader(Src&& src, ParallelLineReaderBase::Options options =
+                                           ParallelLineReaderBase::Options())
+    -> ParallelLineReader<std::decay_t<Src>>;
+template <typename... SrcArgs>
+explicit ParallelLineReader(std::tuple<SrcArgs...> src_args,
+                            ParallelLineReaderBase::Options options =
+                                ParallelLineReaderBase::Options())
+    -> ParallelLineReader<DeleteCtad<std::tuple<SrcArgs...>>>;
+#endif
+
+// Implementation details follow.
+
+inline ParallelLineReaderBase::ParallelLineReaderBase(
+    ParallelLineReaderBase&& that) noexcept
+    : Object(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      newline_(that.newline_),
+      parallelism_(that.parallelism_),
+      range_size_(that.range_size_),
+      ordered_(that.ordered_),
+      executor_(std::move(that.executor_)) {}
+
+inline ParallelLineReaderBase& ParallelLineReaderBase::operator=(
+    ParallelLineReaderBase&& that) noexcept {
+  Object::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  newline_ = that.newline_;
+  parallelism_ = that.parallelism_;
+  range_size_ = that.range_size_;
+  ordered_ = that.ordered_;
+  executor_ = std::move(that.executor_);
+  return *this;
+}
+
+inline void ParallelLineReaderBase::Reset(InitiallyClosed) {
+  Object::Reset(kInitiallyClosed);
+  executor_.reset();
+}
+
+inline void ParallelLineReaderBase::Reset(InitiallyOpen) {
+  Object::Reset(kInitiallyOpen);
+  executor_.reset();
+}
+
+template <typename Src>
+inline ParallelLineReader<Src>::ParallelLineReader(const Src& src,
+                                                   Options options)
+    : ParallelLineReaderBase(kInitiallyOpen), src_(src) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+inline ParallelLineReader<Src>::ParallelLineReader(Src&& src, Options options)
+    : ParallelLineReaderBase(kInitiallyOpen), src_(std::move(src)) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline ParallelLineReader<Src>::ParallelLineReader(
+    std::tuple<SrcArgs...> src_args, Options options)
+    : ParallelLineReaderBase(kInitiallyOpen), src_(std::move(src_args)) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+inline ParallelLineReader<Src>::ParallelLineReader(
+    ParallelLineReader&& that) noexcept
+    : ParallelLineReaderBase(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      src_(std::move(that.src_)) {}
+
+template <typename Src>
+inline ParallelLineReader<Src>& ParallelLineReader<Src>::operator=(
+    ParallelLineReader&& that) noexcept {
+  ParallelLineReaderBase::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  src_ = std::move(that.src_);
+  return *this;
+}
+
+template <typename Src>
+inline void ParallelLineReader<Src>::Reset() {
+  ParallelLineReaderBase::Reset(kInitiallyClosed);
+  src_.Reset();
+}
+
+template <typename Src>
+inline void ParallelLineReader<Src>::Reset(const Src& src, Options options) {
+  ParallelLineReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(src);
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+inline void ParallelLineReader<Src>::Reset(Src&& src, Options options) {
+  ParallelLineReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(std::move(src));
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline void ParallelLineReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
+                                           Options options) {
+  ParallelLineReaderBase::Reset(kInitiallyOpen);
+  src_.Reset(std::move(src_args));
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+void ParallelLineReader<Src>::Done() {
+  ParallelLineReaderBase::Done();
+  if (src_.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!src_->Close())) Fail(*src_);
+  }
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_LINES_PARALLEL_LINE_READER_H_
@@ -0,0 +1,205 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/lz4/lz4_reader.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <memory>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "lz4frame.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/status.h"
+#include "riegeli/bytes/buffered_reader.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/endian/endian_reading.h"
+
+namespace riegeli {
+
+void Lz4ReaderBase::Initialize(Reader* src) {
+  RIEGELI_ASSERT(src != nullptr)
+      << "Failed precondition of Lz4Reader: null Reader pointer";
+  if (ABSL_PREDICT_FALSE(!src->healthy()) && src->available() == 0) {
+    Fail(*src);
+    return;
+  }
+  initial_compressed_pos_ = src->pos();
+  InitializeDecompressor(*src);
+}
+
+inline void Lz4ReaderBase::InitializeDecompressor(Reader& src) {
+  LZ4F_dctx* decompressor = nullptr;
+  if (ABSL_PREDICT_FALSE(LZ4F_isError(
+          LZ4F_createDecompressionContext(&decompressor, LZ4F_VERSION)))) {
+    decompressor = nullptr;
+  }
+  decompressor_.reset(decompressor);
+  if (ABSL_PREDICT_FALSE(decompressor_ == nullptr)) {
+    Fail(absl::InternalError("LZ4F_createDecompressionContext() failed"));
+    return;
+  }
+  uncompressed_size_ = Lz4UncompressedSize(src);
+  if (uncompressed_size_ != absl::nullopt) {
+    // If `uncompressed_size_` is 0, set `size_hint` to 1, because the first
+    // `Pull()` call will need a non-empty destination buffer before calling the
+    // LZ4 decoder.
+    set_size_hint(UnsignedMax(Position{1}, *uncompressed_size_));
+  }
+}
+
+void Lz4ReaderBase::Done() {
+  if (ABSL_PREDICT_FALSE(truncated_)) {
+    Reader& src = *src_reader();
+    Fail(Annotate(absl::InvalidArgumentError("Truncated LZ4-compressed stream"),
+                  absl::StrCat("at byte ", src.pos())));
+  }
+  BufferedReader::Done();
+  decompressor_.reset();
+}
+
+void Lz4ReaderBase::AnnotateFailure(absl::Status& status) {
+  RIEGELI_ASSERT(!status.ok())
+      << "Failed precondition of Object::AnnotateFailure(): status not failed";
+  status = Annotate(status, absl::StrCat("at uncompressed byte ", pos()));
+}
+
+bool Lz4ReaderBase::PullSlow(size_t min_length, size_t recommended_length) {
+  RIEGELI_ASSERT_LT(available(), min_length)
+      << "Failed precondition of Reader::PullSlow(): "
+         "enough data available, use Pull() instead";
+  // After all data have been decompressed, skip `BufferedReader::PullSlow()`
+  // to avoid allocating the buffer in case it was not allocated yet.
+  if (ABSL_PREDICT_FALSE(decompressor_ == nullptr)) return false;
+  return BufferedReader::PullSlow(min_length, recommended_length);
+}
+
+bool Lz4ReaderBase::ReadInternal(size_t min_length, size_t max_length,
+                                 char* dest) {
+  RIEGELI_ASSERT_GT(min_length, 0u)
+      << "Failed precondition of BufferedReader::ReadInternal(): "
+         "nothing to read";
+  RIEGELI_ASSERT_GE(max_length, min_length)
+      << "Failed precondition of BufferedReader::ReadInternal(): "
+         "max_length < min_length";
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of BufferedReader::ReadInternal(): " << status();
+  if (ABSL_PREDICT_FALSE(decompressor_ == nullptr)) return false;
+  Reader& src = *src_reader();
+  truncated_ = false;
+  if (ABSL_PREDICT_FALSE(max_length >
+                         std::numeric_limits<Position>::max() - limit_pos())) {
+    return FailOverflow();
+  }
+  size_t length_read = 0;
+  for (;;) {
+    size_t src_length = src.available();
+    size_t dest_length = max_length - length_read;
+    const size_t result =
+        LZ4F_decompress(decompressor_.get(), dest + length_read, &dest_length,
+                        src.cursor(), &src_length, nullptr);
+    src.move_cursor(src_length);
+    length_read += dest_length;
+    if (ABSL_PREDICT_FALSE(result == 0)) {
+      decompressor_.reset();
+      move_limit_pos(length_read);
+      return length_read >= min_length;
+    }
+    if (ABSL_PREDICT_FALSE(LZ4F_isError(result))) {
+      Fail(Annotate(
+          absl::InvalidArgumentError(absl::StrCat(
+              "LZ4F_decompress() failed: ", LZ4F_getErrorName(result))),
+          absl::StrCat("at byte ", src.pos())));
+      move_limit_pos(length_read);
+      return length_read >= min_length;
+    }
+    if (length_read >= min_length) {
+      move_limit_pos(length_read);
+      return true;
+    }
+    if (ABSL_PREDICT_FALSE(!src.Pull(1, result))) {
+      move_limit_pos(length_read);
+      if (ABSL_PREDICT_FALSE(!src.healthy())) {
+        Fail(src);
+      } else if (growing_source_) {
+        truncated_ = true;
+      } else {
+        Fail(Annotate(
+            absl::InvalidArgumentError("Truncated LZ4-compressed stream"),
+            absl::StrCat("at byte ", src.pos())));
+      }
+      return length_read >= min_length;
+    }
+  }
+}
+
+bool Lz4ReaderBase::SupportsRewind() {
+  Reader* const src = src_reader();
+  return src != nullptr && src->SupportsRewind();
+}
+
+bool Lz4ReaderBase::SeekBehindBuffer(Position new_pos) {
+  RIEGELI_ASSERT(new_pos < start_pos() || new_pos > limit_pos())
+      << "Failed precondition of BufferedReader::SeekBehindBuffer(): "
+         "position in the buffer, use Seek() instead";
+  RIEGELI_ASSERT_EQ(buffer_size(), 0u)
+      << "Failed precondition of BufferedReader::SeekBehindBuffer(): "
+         "buffer not empty";
+  if (new_pos <= limit_pos()) {
+    // Seeking backwards.
+    if (ABSL_PREDICT_FALSE(!healthy())) return false;
+    Reader& src = *src_reader();
+    truncated_ = false;
+    set_buffer();
+    set_limit_pos(0);
+    decompressor_.reset();
+    if (ABSL_PREDICT_FALSE(!src.Seek(initial_compressed_pos_))) {
+      src.Fail(absl::DataLossError("LZ4-compressed stream got truncated"));
+      return Fail(src);
+    }
+    InitializeDecompressor(src);
+    if (ABSL_PREDICT_FALSE(!healthy())) return false;
+    if (new_pos == 0) return true;
+  }
+  return BufferedReader::SeekBehindBuffer(new_pos);
+}
+
+absl::optional<Position> Lz4ReaderBase::SizeImpl() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  if (ABSL_PREDICT_FALSE(uncompressed_size_ == absl::nullopt)) {
+    Fail(absl::UnimplementedError(
+        "Uncompressed size was not stored in the LZ4-compressed stream"));
+    return absl::nullopt;
+  }
+  return *uncompressed_size_;
+}
+
+absl::optional<Position> Lz4UncompressedSize(Reader& src) {
+  // The frame header begins with the magic number (4 bytes, `0x184D2204`),
+  // the FLG byte, and the BD byte. If the FLG byte has the content size flag
+  // (bit 3) set, the content size follows (8 bytes).
+  if (ABSL_PREDICT_FALSE(!src.Pull(4 + 1 + 1 + 8))) return absl::nullopt;
+  if (ReadLittleEndian32(src.cursor()) != uint32_t{0x184D2204}) {
+    return absl::nullopt;
+  }
+  if ((static_cast<uint8_t>(src.cursor()[4]) & 0x08) == 0) return absl::nullopt;
+  return ReadLittleEndian64(src.cursor() + 4 + 1 + 1);
+}
+
+}  // namespace riegeli
@@ -0,0 +1,379 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_LZ4_LZ4_READER_H_
+#define RIEGELI_LZ4_LZ4_READER_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "lz4frame.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/bytes/buffered_reader.h"
+#include "riegeli/bytes/reader.h"
+
+namespace riegeli {
+
+// Template parameter independent part of `Lz4Reader`.
+class Lz4ReaderBase : public BufferedReader {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // If `true`, supports decompressing as much as possible from a truncated
+    // source, then retrying when the source has grown. This has a small
+    // performance penalty.
+    //
+    // Default: `false`.
+    Options& set_growing_source(bool growing_source) & {
+      growing_source_ = growing_source;
+      return *this;
+    }
+    Options&& set_growing_source(bool growing_source) && {
+      return std::move(set_growing_source(growing_source));
+    }
+    bool growing_source() const { return growing_source_; }
+
+    // Expected uncompressed size, or `absl::nullopt` if unknown. This may
+    // improve performance.
+    //
+    // If the size hint turns out to not match reality, nothing breaks.
+    //
+    // Default: `absl::nullopt`.
+    Options& set_size_hint(absl::optional<Position> size_hint) & {
+      size_hint_ = size_hint;
+      return *this;
+    }
+    Options&& set_size_hint(absl::optional<Position> size_hint) && {
+      return std::move(set_size_hint(size_hint));
+    }
+    absl::optional<Position> size_hint() const { return size_hint_; }
+
+    // Tunes how much data is buffered after calling the decompression engine.
+    //
+    // Default: `kDefaultBufferSize` (64K).
+    Options& set_buffer_size(size_t buffer_size) & {
+      RIEGELI_ASSERT_GT(buffer_size, 0u)
+          << "Failed precondition of "
+             "Lz4ReaderBase::Options::set_buffer_size(): "
+             "zero buffer size";
+      buffer_size_ = buffer_size;
+      return *this;
+    }
+    Options&& set_buffer_size(size_t buffer_size) && {
+      return std::move(set_buffer_size(buffer_size));
+    }
+    size_t buffer_size() const { return buffer_size_; }
+
+   private:
+    bool growing_source_ = false;
+    absl::optional<Position> size_hint_;
+    size_t buffer_size_ = kDefaultBufferSize;
+  };
+
+  // Returns the compressed `Reader`. Unchanged by `Close()`.
+  virtual Reader* src_reader() = 0;
+  virtual const Reader* src_reader() const = 0;
+
+  // Returns `true` if the source is truncated (without a clean end of the
+  // compressed stream) at the current position. In such case, if the source
+  // does not grow, `Close()` will fail.
+  bool truncated() const { return truncated_; }
+
+  bool SupportsRewind() override;
+  bool SupportsSize() override { return uncompressed_size_ != absl::nullopt; }
+
+ protected:
+  Lz4ReaderBase() noexcept {}
+
+  explicit Lz4ReaderBase(bool growing_source, size_t buffer_size,
+                         absl::optional<Position> size_hint);
+
+  Lz4ReaderBase(Lz4ReaderBase&& that) noexcept;
+  Lz4ReaderBase& operator=(Lz4ReaderBase&& that) noexcept;
+
+  void Reset();
+  void Reset(bool growing_source, size_t buffer_size,
+             absl::optional<Position> size_hint);
+  void Initialize(Reader* src);
+
+  void Done() override;
+  // `Lz4ReaderBase` overrides `Reader::AnnotateFailure()` to annotate the
+  // status with the current position, clarifying that this is the uncompressed
+  // position. A status propagated from `*src_reader()` might carry annotation
+  // with the compressed position.
+  ABSL_ATTRIBUTE_COLD void AnnotateFailure(absl::Status& status) override;
+  bool PullSlow(size_t min_length, size_t recommended_length) override;
+  bool ReadInternal(size_t min_length, size_t max_length, char* dest) override;
+  bool SeekBehindBuffer(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
+
+ private:
+  struct LZ4F_dctxDeleter {
+    void operator()(LZ4F_dctx* ptr) const {
+      LZ4F_freeDecompressionContext(ptr);
+    }
+  };
+
+  void InitializeDecompressor(Reader& src);
+
+  // If `true`, supports decompressing as much as possible from a truncated
+  // source, then retrying when the source has grown.
+  bool growing_source_ = false;
+  // If `true`, the source is truncated (without a clean end of the compressed
+  // stream) at the current position. If the source does not grow, `Close()`
+  // will fail.
+  bool truncated_ = false;
+  Position initial_compressed_pos_ = 0;
+  // If `healthy()` but `decompressor_ == nullptr` then all data have been
+  // decompressed. In this case `LZ4F_decompress()` must not be called again.
+  //
+  // This is not recycled because `LZ4F_resetDecompressionContext()` does not
+  // reset the whole state after a frame was abandoned in the middle.
+  std::unique_ptr<LZ4F_dctx, LZ4F_dctxDeleter> decompressor_;
+  // Uncompressed size, if known.
+  absl::optional<Position> uncompressed_size_;
+};
+
+// A `Reader` which decompresses data with LZ4 (frame format) after getting it
+// from another `Reader`.
+//
+// The `Src` template parameter specifies the type of the object providing and
+// possibly owning the compressed `Reader`. `Src` must support
+// `Dependency<Reader*, Src>`, e.g. `Reader*` (not owned, default),
+// `std::unique_ptr<Reader>` (owned), `ChainReader<>` (owned).
+//
+// By relying on CTAD the template argument can be deduced as the value type of
+// the first constructor argument. This requires C++17.
+//
+// The compressed `Reader` must not be accessed until the `Lz4Reader` is closed
+// or no longer used.
+template <typename Src = Reader*>
+class Lz4Reader : public Lz4ReaderBase {
+ public:
+  // Creates a closed `Lz4Reader`.
+  Lz4Reader() noexcept {}
+
+  // Will read from the compressed `Reader` provided by `src`.
+  explicit Lz4Reader(const Src& src, Options options = Options());
+  explicit Lz4Reader(Src&& src, Options options = Options());
+
+  // Will read from the compressed `Reader` provided by a `Src` constructed from
+  // elements of `src_args`. This avoids constructing a temporary `Src` and
+  // moving from it.
+  template <typename... SrcArgs>
+  explicit Lz4Reader(std::tuple<SrcArgs...> src_args,
+                     Options options = Options());
+
+  Lz4Reader(Lz4Reader&& that) noexcept;
+  Lz4Reader& operator=(Lz4Reader&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `Lz4Reader`. This avoids
+  // constructing a temporary `Lz4Reader` and moving from it.
+  void Reset();
+  void Reset(const Src& src, Options options = Options());
+  void Reset(Src&& src, Options options = Options());
+  template <typename... SrcArgs>
+  void Reset(std::tuple<SrcArgs...> src_args, Options options = Options());
+
+  // Returns the object providing and possibly owning the compressed `Reader`.
+  // Unchanged by `Close()`.
+  Src& src() { return src_.manager(); }
+  const Src& src() const { return src_.manager(); }
+  Reader* src_reader() override { return src_.get(); }
+  const Reader* src_reader() const override { return src_.get(); }
+
+  void VerifyEnd() override;
+
+ protected:
+  void Done() override;
+
+ private:
+  // The object providing and possibly owning the compressed `Reader`.
+  Dependency<Reader*, Src> src_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+Lz4Reader()->Lz4Reader<DeleteCtad<>>;
+template <typename Src>
+explicit Lz4Reader(const Src& src,
+                   Lz4ReaderBase::Options options = Lz4ReaderBase::Options())
+    -> Lz4Reader<std::decay_t<Src>>;
+template <typename Src>
+explicit Lz4Reader(Src&& src,
+                   Lz4ReaderBase::Options options = Lz4ReaderBase::Options())
+    -> Lz4Reader<std::decay_t<Src>>;
+template <typename... SrcArgs>
+explicit Lz4Reader(std::tuple<SrcArgs...> src_args,
+                   Lz4ReaderBase::Options options = Lz4ReaderBase::Options())
+    -> Lz4Reader<DeleteCtad<std::tuple<SrcArgs...>>>;
+#endif
+
+// Returns the claimed uncompressed size of LZ4-compressed data.
+//
+// Returns `absl::nullopt` if the size was not stored or on failure. The size is
+// stored if `Lz4WriterBase::Options::pledged_size() != absl::nullopt`.
+//
+// The current position of `src` is unchanged.
+absl::optional<Position> Lz4UncompressedSize(Reader& src);
+
+// Implementation details follow.
+
+inline Lz4ReaderBase::Lz4ReaderBase(bool growing_source, size_t buffer_size,
+                                    absl::optional<Position> size_hint)
+    : BufferedReader(buffer_size, size_hint), growing_source_(growing_source) {}
+
+inline Lz4ReaderBase::Lz4ReaderBase(Lz4ReaderBase&& that) noexcept
+    : BufferedReader(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      growing_source_(that.growing_source_),
+      truncated_(that.truncated_),
+      initial_compressed_pos_(that.initial_compressed_pos_),
+      decompressor_(std::move(that.decompressor_)),
+      uncompressed_size_(that.uncompressed_size_) {}
+
+inline Lz4ReaderBase& Lz4ReaderBase::operator=(Lz4ReaderBase&& that) noexcept {
+  BufferedReader::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  growing_source_ = that.growing_source_;
+  truncated_ = that.truncated_;
+  initial_compressed_pos_ = that.initial_compressed_pos_;
+  decompressor_ = std::move(that.decompressor_);
+  uncompressed_size_ = that.uncompressed_size_;
+  return *this;
+}
+
+inline void Lz4ReaderBase::Reset() {
+  BufferedReader::Reset();
+  growing_source_ = false;
+  truncated_ = false;
+  initial_compressed_pos_ = 0;
+  decompressor_.reset();
+  uncompressed_size_ = absl::nullopt;
+}
+
+inline void Lz4ReaderBase::Reset(bool growing_source, size_t buffer_size,
+                                 absl::optional<Position> size_hint) {
+  BufferedReader::Reset(buffer_size, size_hint);
+  growing_source_ = growing_source;
+  truncated_ = false;
+  initial_compressed_pos_ = 0;
+  decompressor_.reset();
+  uncompressed_size_ = absl::nullopt;
+}
+
+template <typename Src>
+inline Lz4Reader<Src>::Lz4Reader(const Src& src, Options options)
+    : Lz4ReaderBase(options.growing_source(), options.buffer_size(),
+                    options.size_hint()),
+      src_(src) {
+  Initialize(src_.get());
+}
+
+template <typename Src>
+inline Lz4Reader<Src>::Lz4Reader(Src&& src, Options options)
+    : Lz4ReaderBase(options.growing_source(), options.buffer_size(),
+                    options.size_hint()),
+      src_(std::move(src)) {
+  Initialize(src_.get());
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline Lz4Reader<Src>::Lz4Reader(std::tuple<SrcArgs...> src_args,
+                                 Options options)
+    : Lz4ReaderBase(options.growing_source(), options.buffer_size(),
+                    options.size_hint()),
+      src_(std::move(src_args)) {
+  Initialize(src_.get());
+}
+
+template <typename Src>
+inline Lz4Reader<Src>::Lz4Reader(Lz4Reader&& that) noexcept
+    : Lz4ReaderBase(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      src_(std::move(that.src_)) {}
+
+template <typename Src>
+inline Lz4Reader<Src>& Lz4Reader<Src>::operator=(Lz4Reader&& that) noexcept {
+  Lz4ReaderBase::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  src_ = std::move(that.src_);
+  return *this;
+}
+
+template <typename Src>
+inline void Lz4Reader<Src>::Reset() {
+  Lz4ReaderBase::Reset();
+  src_.Reset();
+}
+
+template <typename Src>
+inline void Lz4Reader<Src>::Reset(const Src& src, Options options) {
+  Lz4ReaderBase::Reset(options.growing_source(), options.buffer_size(),
+                       options.size_hint());
+  src_.Reset(src);
+  Initialize(src_.get());
+}
+
+template <typename Src>
+inline void Lz4Reader<Src>::Reset(Src&& src, Options options) {
+  Lz4ReaderBase::Reset(options.growing_source(), options.buffer_size(),
+                       options.size_hint());
+  src_.Reset(std::move(src));
+  Initialize(src_.get());
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline void Lz4Reader<Src>::Reset(std::tuple<SrcArgs...> src_args,
+                                  Options options) {
+  Lz4ReaderBase::Reset(options.growing_source(), options.buffer_size(),
+                       options.size_hint());
+  src_.Reset(std::move(src_args));
+  Initialize(src_.get());
+}
+
+template <typename Src>
+void Lz4Reader<Src>::Done() {
+  Lz4ReaderBase::Done();
+  if (src_.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!src_->Close())) Fail(*src_);
+  }
+}
+
+template <typename Src>
+void Lz4Reader<Src>::VerifyEnd() {
+  Lz4ReaderBase::VerifyEnd();
+  if (src_.is_owning() && ABSL_PREDICT_TRUE(healthy())) src_->VerifyEnd();
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_LZ4_LZ4_READER_H_
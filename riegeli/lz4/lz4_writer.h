@@ -0,0 +1,403 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_LZ4_LZ4_WRITER_H_
+#define RIEGELI_LZ4_LZ4_WRITER_H_
+
+#include <stddef.h>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "lz4frame.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/base/recycling_pool.h"
+#include "riegeli/bytes/buffered_writer.h"
+#include "riegeli/bytes/writer.h"
+
+namespace riegeli {
+
+// Template parameter independent part of `Lz4Writer`.
+class Lz4WriterBase : public BufferedWriter {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Tunes the tradeoff between compression density and compression speed
+    // (higher = better density but slower).
+    //
+    // Levels below 3 use the fast LZ4 compressor, negative levels trading
+    // compression density for even faster compression. Levels 3 and above use
+    // LZ4HC.
+    //
+    // `compression_level` must be between `kMinCompressionLevel` (-65536) and
+    // `kMaxCompressionLevel` (12). Default: `kDefaultCompressionLevel` (0).
+    static constexpr int kMinCompressionLevel = -65536;
+    static constexpr int kMaxCompressionLevel = 12;  // `LZ4HC_CLEVEL_MAX`
+    static constexpr int kDefaultCompressionLevel = 0;
+    Options& set_compression_level(int compression_level) & {
+      RIEGELI_ASSERT_GE(compression_level, kMinCompressionLevel)
+          << "Failed precondition of "
+             "Lz4WriterBase::Options::set_compression_level(): "
+             "compression level out of range";
+      RIEGELI_ASSERT_LE(compression_level, kMaxCompressionLevel)
+          << "Failed precondition of "
+             "Lz4WriterBase::Options::set_compression_level(): "
+             "compression level out of range";
+      compression_level_ = compression_level;
+      return *this;
+    }
+    Options&& set_compression_level(int compression_level) && {
+      return std::move(set_compression_level(compression_level));
+    }
+    int compression_level() const { return compression_level_; }
+
+    // If `true`, computes checksum of uncompressed data and stores it in the
+    // compressed stream. This lets decompression verify the checksum.
+    //
+    // Default: `false`.
+    Options& set_store_checksum(bool store_checksum) & {
+      store_checksum_ = store_checksum;
+      return *this;
+    }
+    Options&& set_store_checksum(bool store_checksum) && {
+      return std::move(set_store_checksum(store_checksum));
+    }
+    bool store_checksum() const { return store_checksum_; }
+
+    // Exact uncompressed size, or `absl::nullopt` if unknown. This causes the
+    // size to be stored in the compressed stream header.
+    //
+    // If the pledged size turns out to not match reality, compression fails.
+    //
+    // Default: `absl::nullopt`.
+    Options& set_pledged_size(absl::optional<Position> pledged_size) & {
+      pledged_size_ = pledged_size;
+      return *this;
+    }
+    Options&& set_pledged_size(absl::optional<Position> pledged_size) && {
+      return std::move(set_pledged_size(pledged_size));
+    }
+    absl::optional<Position> pledged_size() const { return pledged_size_; }
+
+    // Expected uncompressed size, or `absl::nullopt` if unknown. This may
+    // improve performance.
+    //
+    // If the size hint turns out to not match reality, nothing breaks.
+    //
+    // `pledged_size()`, if not `absl::nullopt`, overrides `size_hint()`.
+    //
+    // Default: `absl::nullopt`.
+    Options& set_size_hint(absl::optional<Position> size_hint) & {
+      size_hint_ = size_hint;
+      return *this;
+    }
+    Options&& set_size_hint(absl::optional<Position> size_hint) && {
+      return std::move(set_size_hint(size_hint));
+    }
+    absl::optional<Position> size_hint() const { return size_hint_; }
+    absl::optional<Position> effective_size_hint() const {
+      if (pledged_size() != absl::nullopt) return *pledged_size();
+      return size_hint();
+    }
+
+    // Tunes how much data is buffered before calling the compression engine.
+    //
+    // Default: `kDefaultBufferSize` (64K).
+    Options& set_buffer_size(size_t buffer_size) & {
+      RIEGELI_ASSERT_GT(buffer_size, 0u)
+          << "Failed precondition of "
+             "Lz4WriterBase::Options::set_buffer_size(): "
+             "zero buffer size";
+      buffer_size_ = buffer_size;
+      return *this;
+    }
+    Options&& set_buffer_size(size_t buffer_size) && {
+      return std::move(set_buffer_size(buffer_size));
+    }
+    size_t buffer_size() const { return buffer_size_; }
+
+   private:
+    int compression_level_ = kDefaultCompressionLevel;
+    bool store_checksum_ = false;
+    absl::optional<Position> pledged_size_;
+    absl::optional<Position> size_hint_;
+    size_t buffer_size_ = kDefaultBufferSize;
+  };
+
+  // Returns the compressed `Writer`. Unchanged by `Close()`.
+  virtual Writer* dest_writer() = 0;
+  virtual const Writer* dest_writer() const = 0;
+
+ protected:
+  Lz4WriterBase() noexcept {}
+
+  explicit Lz4WriterBase(size_t buffer_size,
+                         absl::optional<Position> pledged_size,
+                         absl::optional<Position> size_hint);
+
+  Lz4WriterBase(Lz4WriterBase&& that) noexcept;
+  Lz4WriterBase& operator=(Lz4WriterBase&& that) noexcept;
+
+  void Reset();
+  void Reset(size_t buffer_size, absl::optional<Position> pledged_size,
+             absl::optional<Position> size_hint);
+  void Initialize(Writer* dest, int compression_level, bool store_checksum);
+
+  void DoneBehindBuffer(absl::string_view src) override;
+  void Done() override;
+  // `Lz4WriterBase` overrides `Writer::AnnotateFailure()` to annotate the
+  // status with the current position, clarifying that this is the uncompressed
+  // position. A status propagated from `*dest_writer()` might carry annotation
+  // with the compressed position.
+  ABSL_ATTRIBUTE_COLD void AnnotateFailure(absl::Status& status) override;
+  bool WriteInternal(absl::string_view src) override;
+  bool FlushBehindBuffer(absl::string_view src, FlushType flush_type);
+
+ private:
+  struct LZ4F_cctxDeleter {
+    void operator()(LZ4F_cctx* ptr) const { LZ4F_freeCompressionContext(ptr); }
+  };
+
+  bool WriteInternal(absl::string_view src, Writer& dest);
+
+  absl::optional<Position> pledged_size_;
+  LZ4F_preferences_t preferences_{};
+  RecyclingPool<LZ4F_cctx, LZ4F_cctxDeleter>::Handle compressor_;
+};
+
+// A `Writer` which compresses data with LZ4 (frame format) before passing it to
+// another `Writer`.
+//
+// The `Dest` template parameter specifies the type of the object providing and
+// possibly owning the compressed `Writer`. `Dest` must support
+// `Dependency<Writer*, Dest>`, e.g. `Writer*` (not owned, default),
+// `std::unique_ptr<Writer>` (owned), `ChainWriter<>` (owned).
+//
+// By relying on CTAD the template argument can be deduced as the value type of
+// the first constructor argument. This requires C++17.
+//
+// The compressed `Writer` must not be accessed until the `Lz4Writer` is closed
+// or no longer used, except that it is allowed to read the destination of the
+// compressed `Writer` immediately after `Flush()`.
+template <typename Dest = Writer*>
+class Lz4Writer : public Lz4WriterBase {
+ public:
+  // Creates a closed `Lz4Writer`.
+  Lz4Writer() noexcept {}
+
+  // Will write to the compressed `Writer` provided by `dest`.
+  explicit Lz4Writer(const Dest& dest, Options options = Options());
+  explicit Lz4Writer(Dest&& dest, Options options = Options());
+
+  // Will write to the compressed `Writer` provided by a `Dest` constructed from
+  // elements of `dest_args`. This avoids constructing a temporary `Dest` and
+  // moving from it.
+  template <typename... DestArgs>
+  explicit Lz4Writer(std::tuple<DestArgs...> dest_args,
+                     Options options = Options());
+
+  Lz4Writer(Lz4Writer&& that) noexcept;
+  Lz4Writer& operator=(Lz4Writer&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `Lz4Writer`. This avoids
+  // constructing a temporary `Lz4Writer` and moving from it.
+  void Reset();
+  void Reset(const Dest& dest, Options options = Options());
+  void Reset(Dest&& dest, Options options = Options());
+  template <typename... DestArgs>
+  void Reset(std::tuple<DestArgs...> dest_args, Options options = Options());
+
+  // Returns the object providing and possibly owning the compressed `Writer`.
+  // Unchanged by `Close()`.
+  Dest& dest() { return dest_.manager(); }
+  const Dest& dest() const { return dest_.manager(); }
+  Writer* dest_writer() override { return dest_.get(); }
+  const Writer* dest_writer() const override { return dest_.get(); }
+
+ protected:
+  void Done() override;
+  bool FlushImpl(FlushType flush_type) override;
+
+ private:
+  // The object providing and possibly owning the compressed `Writer`.
+  Dependency<Writer*, Dest> dest_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+Lz4Writer()->Lz4Writer<DeleteCtad<>>;
+template <typename Dest>
+explicit Lz4Writer(const Dest& dest,
+                   Lz4WriterBase::Options options = Lz4WriterBase::Options())
+    -> Lz4Writer<std::decay_t<Dest>>;
+template <typename Dest>
+explicit Lz4Writer(Dest&& dest,
+                   Lz4WriterBase::Options options = Lz4WriterBase::Options())
+    -> Lz4Writer<std::decay_t<Dest>>;
+template <typename... DestArgs>
+explicit Lz4Writer(std::tuple<DestArgs...> dest_args,
+                   Lz4WriterBase::Options options = Lz4WriterBase::Options())
+    -> Lz4Writer<DeleteCtad<std::tuple<DestArgs...>>>;
+#endif
+
+// Implementation details follow.
+
+inline Lz4WriterBase::Lz4WriterBase(size_t buffer_size,
+                                    absl::optional<Position> pledged_size,
+                                    absl::optional<Position> size_hint)
+    : BufferedWriter(buffer_size, size_hint), pledged_size_(pledged_size) {}
+
+inline Lz4WriterBase::Lz4WriterBase(Lz4WriterBase&& that) noexcept
+    : BufferedWriter(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      pledged_size_(that.pledged_size_),
+      preferences_(that.preferences_),
+      compressor_(std::move(that.compressor_)) {}
+
+inline Lz4WriterBase& Lz4WriterBase::operator=(Lz4WriterBase&& that) noexcept {
+  BufferedWriter::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  pledged_size_ = that.pledged_size_;
+  preferences_ = that.preferences_;
+  compressor_ = std::move(that.compressor_);
+  return *this;
+}
+
+inline void Lz4WriterBase::Reset() {
+  BufferedWriter::Reset();
+  pledged_size_ = absl::nullopt;
+  preferences_ = LZ4F_preferences_t();
+  compressor_.reset();
+}
+
+inline void Lz4WriterBase::Reset(size_t buffer_size,
+                                 absl::optional<Position> pledged_size,
+                                 absl::optional<Position> size_hint) {
+  BufferedWriter::Reset(buffer_size, size_hint);
+  pledged_size_ = pledged_size;
+  preferences_ = LZ4F_preferences_t();
+  compressor_.reset();
+}
+
+template <typename Dest>
+inline Lz4Writer<Dest>::Lz4Writer(const Dest& dest, Options options)
+    : Lz4WriterBase(options.buffer_size(), options.pledged_size(),
+                    options.effective_size_hint()),
+      dest_(dest) {
+  Initialize(dest_.get(), options.compression_level(),
+             options.store_checksum());
+}
+
+template <typename Dest>
+inline Lz4Writer<Dest>::Lz4Writer(Dest&& dest, Options options)
+    : Lz4WriterBase(options.buffer_size(), options.pledged_size(),
+                    options.effective_size_hint()),
+      dest_(std::move(dest)) {
+  Initialize(dest_.get(), options.compression_level(),
+             options.store_checksum());
+}
+
+template <typename Dest>
+template <typename... DestArgs>
+inline Lz4Writer<Dest>::Lz4Writer(std::tuple<DestArgs...> dest_args,
+                                  Options options)
+    : Lz4WriterBase(options.buffer_size(), options.pledged_size(),
+                    options.effective_size_hint()),
+      dest_(std::move(dest_args)) {
+  Initialize(dest_.get(), options.compression_level(),
+             options.store_checksum());
+}
+
+template <typename Dest>
+inline Lz4Writer<Dest>::Lz4Writer(Lz4Writer&& that) noexcept
+    : Lz4WriterBase(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      dest_(std::move(that.dest_)) {}
+
+template <typename Dest>
+inline Lz4Writer<Dest>& Lz4Writer<Dest>::operator=(Lz4Writer&& that) noexcept {
+  Lz4WriterBase::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  dest_ = std::move(that.dest_);
+  return *this;
+}
+
+template <typename Dest>
+inline void Lz4Writer<Dest>::Reset() {
+  Lz4WriterBase::Reset();
+  dest_.Reset();
+}
+
+template <typename Dest>
+inline void Lz4Writer<Dest>::Reset(const Dest& dest, Options options) {
+  Lz4WriterBase::Reset(options.buffer_size(), options.pledged_size(),
+                       options.effective_size_hint());
+  dest_.Reset(dest);
+  Initialize(dest_.get(), options.compression_level(),
+             options.store_checksum());
+}
+
+template <typename Dest>
+inline void Lz4Writer<Dest>::Reset(Dest&& dest, Options options) {
+  Lz4WriterBase::Reset(options.buffer_size(), options.pledged_size(),
+                       options.effective_size_hint());
+  dest_.Reset(std::move(dest));
+  Initialize(dest_.get(), options.compression_level(),
+             options.store_checksum());
+}
+
+template <typename Dest>
+template <typename... DestArgs>
+inline void Lz4Writer<Dest>::Reset(std::tuple<DestArgs...> dest_args,
+                                   Options options) {
+  Lz4WriterBase::Reset(options.buffer_size(), options.pledged_size(),
+                       options.effective_size_hint());
+  dest_.Reset(std::move(dest_args));
+  Initialize(dest_.get(), options.compression_level(),
+             options.store_checksum());
+}
+
+template <typename Dest>
+void Lz4Writer<Dest>::Done() {
+  Lz4WriterBase::Done();
+  if (dest_.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!dest_->Close())) Fail(*dest_);
+  }
+}
+
+template <typename Dest>
+bool Lz4Writer<Dest>::FlushImpl(FlushType flush_type) {
+  if (ABSL_PREDICT_FALSE(!Lz4WriterBase::FlushImpl(flush_type))) return false;
+  if (flush_type != FlushType::kFromObject || dest_.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!dest_->Flush(flush_type))) return Fail(*dest_);
+  }
+  return true;
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_LZ4_LZ4_WRITER_H_
@@ -27,6 +27,7 @@
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "google/protobuf/message_lite.h"
+#include "google/protobuf/stubs/stringpiece.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/bytes/chain_reader.h"
@@ -48,6 +49,21 @@ inline absl::Status CheckInitialized(google::protobuf::MessageLite& dest,
   return absl::OkStatus();
 }
 
+// Parses flat `src` with aliasing enabled.
+inline absl::Status ParseWithAliasing(absl::string_view src,
+                                      google::protobuf::MessageLite& dest,
+                                      ParseOptions options) {
+  if (ABSL_PREDICT_FALSE(
+          src.size() > size_t{std::numeric_limits<int>::max()} ||
+          !dest.ParseFrom<
+              google::protobuf::MessageLite::kParsePartialWithAliasing>(
+              google::protobuf::StringPiece(src.data(), src.size())))) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to parse message of type ", dest.GetTypeName()));
+  }
+  return CheckInitialized(dest, options);
+}
+
 }  // namespace
 
 namespace internal {
@@ -90,6 +106,7 @@ absl::Status ParseFromReaderImpl(Reader& src,
 absl::Status ParseFromString(absl::string_view src,
                              google::protobuf::MessageLite& dest,
                              ParseOptions options) {
+  if (options.enable_aliasing()) return ParseWithAliasing(src, dest, options);
   if (ABSL_PREDICT_FALSE(
           src.size() > size_t{std::numeric_limits<int>::max()} ||
           !dest.ParsePartialFromArray(src.data(), IntCast<int>(src.size())))) {
@@ -102,6 +119,13 @@ absl::Status ParseFromString(absl::string_view src,
 absl::Status ParseFromChain(const Chain& src,
                             google::protobuf::MessageLite& dest,
                             ParseOptions options) {
+  if (options.enable_aliasing()) {
+    // Aliasing is applied only to flat data. A fragmented `Chain` is parsed
+    // below with copying.
+    if (const absl::optional<absl::string_view> flat = src.TryFlat()) {
+      return ParseWithAliasing(*flat, dest, options);
+    }
+  }
   if (src.size() <= kMaxBytesToCopy) {
     if (const absl::optional<absl::string_view> flat = src.TryFlat()) {
       // The data are flat. `ParsePartialFromArray()` is faster than
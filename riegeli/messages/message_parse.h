@@ -24,6 +24,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
@@ -52,8 +53,29 @@ class ParseOptions {
   }
   bool partial() const { return partial_; }
 
+  // If `true`, the parsed message may refer to the source data instead of
+  // copying them, where the protobuf implementation supports this (with
+  // `google::protobuf::MessageLite::kParsePartialWithAliasing`), e.g. for
+  // large `bytes` fields.
+  //
+  // This requires the source to outlive the message and to stay unchanged.
+  //
+  // This is applicable only to `ParseFromString()`, and to `ParseFromChain()`
+  // if the `Chain` is flat. A fragmented `Chain` is parsed with copying.
+  //
+  // Default: `false`.
+  ParseOptions& set_enable_aliasing(bool enable_aliasing) & {
+    enable_aliasing_ = enable_aliasing;
+    return *this;
+  }
+  ParseOptions&& set_enable_aliasing(bool enable_aliasing) && {
+    return std::move(set_enable_aliasing(enable_aliasing));
+  }
+  bool enable_aliasing() const { return enable_aliasing_; }
+
  private:
   bool partial_ = false;
+  bool enable_aliasing_ = false;
 };
 
 // Reads a message in binary format from the given `Reader`. If successful, the
@@ -82,6 +104,33 @@ absl::Status ParseFromReader(std::tuple<SrcArgs...> src_args,
                              google::protobuf::MessageLite& dest,
                              ParseOptions options = ParseOptions());
 
+// Like `ParseFromReader()`, but the message is created on `arena` as a new
+// message of the same type as `prototype`, and `dest` is set to point to it.
+// The message is owned by `arena`.
+//
+// This avoids separate heap allocations of the message and its parts when many
+// messages are parsed and then discarded together by `arena.Reset()`.
+//
+// Returns status:
+//  * `status.ok()`  - success (`*dest` is filled)
+//  * `!status.ok()` - failure (`*dest` is unspecified)
+template <typename Src>
+absl::Status ParseFromReaderWithArena(
+    const Src& src, const google::protobuf::MessageLite& prototype,
+    google::protobuf::Arena& arena, google::protobuf::MessageLite*& dest,
+    ParseOptions options = ParseOptions());
+template <typename Src>
+absl::Status ParseFromReaderWithArena(
+    Src&& src, const google::protobuf::MessageLite& prototype,
+    google::protobuf::Arena& arena, google::protobuf::MessageLite*& dest,
+    ParseOptions options = ParseOptions());
+template <typename Src, typename... SrcArgs>
+absl::Status ParseFromReaderWithArena(
+    std::tuple<SrcArgs...> src_args,
+    const google::protobuf::MessageLite& prototype,
+    google::protobuf::Arena& arena, google::protobuf::MessageLite*& dest,
+    ParseOptions options = ParseOptions());
+
 // Reads a message in binary format from the given `absl::string_view`. If
 // successful, the entire input will be consumed.
 //
@@ -178,6 +227,34 @@ inline absl::Status ParseFromReader(std::tuple<SrcArgs...> src_args,
       Dependency<Reader*, Src>(std::move(src_args)), dest, options);
 }
 
+template <typename Src>
+inline absl::Status ParseFromReaderWithArena(
+    const Src& src, const google::protobuf::MessageLite& prototype,
+    google::protobuf::Arena& arena, google::protobuf::MessageLite*& dest,
+    ParseOptions options) {
+  dest = prototype.New(&arena);
+  return ParseFromReader(src, *dest, options);
+}
+
+template <typename Src>
+inline absl::Status ParseFromReaderWithArena(
+    Src&& src, const google::protobuf::MessageLite& prototype,
+    google::protobuf::Arena& arena, google::protobuf::MessageLite*& dest,
+    ParseOptions options) {
+  dest = prototype.New(&arena);
+  return ParseFromReader(std::forward<Src>(src), *dest, options);
+}
+
+template <typename Src, typename... SrcArgs>
+inline absl::Status ParseFromReaderWithArena(
+    std::tuple<SrcArgs...> src_args,
+    const google::protobuf::MessageLite& prototype,
+    google::protobuf::Arena& arena, google::protobuf::MessageLite*& dest,
+    ParseOptions options) {
+  dest = prototype.New(&arena);
+  return ParseFromReader<Src>(std::move(src_args), *dest, options);
+}
+
 }  // namespace riegeli
 
 #endif  // RIEGELI_MESSAGES_MESSAGE_PARSE_H_
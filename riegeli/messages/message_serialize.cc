@@ -19,6 +19,7 @@
 
 #include <limits>
 #include <string>
+#include <utility>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
@@ -28,6 +29,7 @@
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/chain_writer.h"
 #include "riegeli/bytes/cord_writer.h"
 #include "riegeli/bytes/string_writer.h"
@@ -35,6 +37,36 @@
 
 namespace riegeli {
 
+namespace {
+
+// A message up to this size is serialized directly to the buffer of a `Writer`
+// even if this requires `Writer::Push()` to make space for the whole message.
+constexpr size_t kMaxSizeToPush = size_t{64} << 10;
+
+// Returns `true` if `SerializeWithCachedSizesToArray()` respects
+// `options.deterministic()`.
+inline bool CanSerializeToArray(const SerializeOptions& options) {
+  return !options.deterministic() ||
+         google::protobuf::io::CodedOutputStream::
+             IsDefaultSerializationDeterministic();
+}
+
+// Serializes `src` having cached size `size` to the array at `dest`.
+inline void SerializeToArray(const google::protobuf::MessageLite& src,
+                             size_t size, char* dest) {
+  uint8_t* const start = reinterpret_cast<uint8_t*>(dest);
+  uint8_t* const end = src.SerializeWithCachedSizesToArray(start);
+  RIEGELI_ASSERT_EQ(size, src.ByteSizeLong())
+      << src.GetTypeName() << " was modified concurrently during serialization";
+  RIEGELI_ASSERT_EQ(PtrDistance(start, end), size)
+      << "Byte size calculation and serialization were inconsistent. This "
+         "may indicate a bug in protocol buffers or it may be caused by "
+         "concurrent modification of "
+      << src.GetTypeName();
+}
+
+}  // namespace
+
 namespace internal {
 
 absl::Status SerializeToWriterImpl(const google::protobuf::MessageLite& src,
@@ -49,6 +81,18 @@ absl::Status SerializeToWriterImpl(const google::protobuf::MessageLite& src,
         "Failed to serialize message of type ", src.GetTypeName(),
         " because it exceeds maximum protobuf size of 2GB: ", size));
   }
+  if (CanSerializeToArray(options)) {
+    // Serialize directly to the buffer of `dest` if the message fits there, or
+    // if it is small enough that making space for it at once is cheap. This
+    // avoids the overhead of `CodedOutputStream` and `WriterOutputStream`.
+    if (size <= dest.available() ||
+        (size <= kMaxSizeToPush && ABSL_PREDICT_TRUE(dest.Push(size)))) {
+      SerializeToArray(src, size, dest.cursor());
+      dest.move_cursor(size);
+      return absl::OkStatus();
+    }
+    if (ABSL_PREDICT_FALSE(!dest.healthy())) return dest.status();
+  }
   WriterOutputStream output_stream(&dest);
   google::protobuf::io::CodedOutputStream coded_stream(&output_stream);
   coded_stream.SetSerializationDeterministic(options.deterministic());
@@ -67,6 +111,39 @@ absl::Status SerializeToWriterImpl(const google::protobuf::MessageLite& src,
   return absl::OkStatus();
 }
 
+absl::Status SerializeToBackwardWriterImpl(
+    const google::protobuf::MessageLite& src, BackwardWriter& dest,
+    SerializeOptions options) {
+  RIEGELI_ASSERT(options.partial() || src.IsInitialized())
+      << "Failed to serialize message of type " << src.GetTypeName()
+      << " because it is missing required fields: "
+      << src.InitializationErrorString();
+  const size_t size = options.GetByteSize(src);
+  if (ABSL_PREDICT_FALSE(size > size_t{std::numeric_limits<int>::max()})) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "Failed to serialize message of type ", src.GetTypeName(),
+        " because it exceeds maximum protobuf size of 2GB: ", size));
+  }
+  if (CanSerializeToArray(options)) {
+    if (size <= dest.available() ||
+        (size <= kMaxSizeToPush && ABSL_PREDICT_TRUE(dest.Push(size)))) {
+      dest.move_cursor(size);
+      SerializeToArray(src, size, dest.cursor());
+      return absl::OkStatus();
+    }
+    if (ABSL_PREDICT_FALSE(!dest.healthy())) return dest.status();
+  }
+  Chain serialized;
+  {
+    absl::Status status = SerializeToChain(src, serialized, options);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  if (ABSL_PREDICT_FALSE(!dest.Write(std::move(serialized)))) {
+    return dest.status();
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace internal
 
 absl::Status SerializeToString(const google::protobuf::MessageLite& src,
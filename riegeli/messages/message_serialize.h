@@ -31,6 +31,7 @@
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/dependency.h"
+#include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/writer.h"
 
 namespace riegeli {
@@ -130,6 +131,40 @@ absl::Status SerializeToWriter(const google::protobuf::MessageLite& src,
                                std::tuple<DestArgs...> dest_args,
                                SerializeOptions options = SerializeOptions());
 
+// Writes the message in binary format to the given `BackwardWriter`.
+//
+// This is useful for prepending messages, e.g. when building a structure back
+// to front with `ChainBackwardWriter`.
+//
+// The message is serialized directly to the buffer of `dest` if it fits there
+// or is small. Otherwise it is serialized to a `Chain` which is then prepended,
+// which does not copy large blocks.
+//
+// The `Dest` template parameter specifies the type of the object providing and
+// possibly owning the `BackwardWriter`. `Dest` must support
+// `Dependency<BackwardWriter*, Dest>`, e.g. `BackwardWriter&` (not owned),
+// `BackwardWriter*` (not owned), `std::unique_ptr<BackwardWriter>` (owned),
+// `ChainBackwardWriter<>` (owned).
+//
+// With a `dest_args` parameter, writes to a `Dest` constructed from elements of
+// `dest_args`. This avoids constructing a temporary `Dest` and moving from it.
+//
+// Returns status:
+//  * `status.ok()`  - success (`dest` is written to)
+//  * `!status.ok()` - failure (`dest` is unspecified)
+template <typename Dest>
+absl::Status SerializeToBackwardWriter(
+    const google::protobuf::MessageLite& src, const Dest& dest,
+    SerializeOptions options = SerializeOptions());
+template <typename Dest>
+absl::Status SerializeToBackwardWriter(
+    const google::protobuf::MessageLite& src, Dest&& dest,
+    SerializeOptions options = SerializeOptions());
+template <typename Dest, typename... DestArgs>
+absl::Status SerializeToBackwardWriter(
+    const google::protobuf::MessageLite& src, std::tuple<DestArgs...> dest_args,
+    SerializeOptions options = SerializeOptions());
+
 // Writes the message in binary format to the given `std::string`, clearing it
 // first.
 //
@@ -207,6 +242,21 @@ inline absl::Status SerializeToWriterUsingDependency(
   return status;
 }
 
+absl::Status SerializeToBackwardWriterImpl(
+    const google::protobuf::MessageLite& src, BackwardWriter& dest,
+    SerializeOptions options);
+
+template <typename Dest>
+inline absl::Status SerializeToBackwardWriterUsingDependency(
+    const google::protobuf::MessageLite& src,
+    Dependency<BackwardWriter*, Dest> dest, SerializeOptions options) {
+  absl::Status status = SerializeToBackwardWriterImpl(src, *dest, options);
+  if (dest.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!dest->Close())) status = dest->status();
+  }
+  return status;
+}
+
 }  // namespace internal
 
 template <typename Dest>
@@ -232,6 +282,31 @@ inline absl::Status SerializeToWriter(const google::protobuf::MessageLite& src,
       src, Dependency<Writer*, Dest>(std::move(dest_args)), options);
 }
 
+template <typename Dest>
+inline absl::Status SerializeToBackwardWriter(
+    const google::protobuf::MessageLite& src, const Dest& dest,
+    SerializeOptions options) {
+  return internal::SerializeToBackwardWriterUsingDependency(
+      src, Dependency<BackwardWriter*, const Dest&>(dest), options);
+}
+
+template <typename Dest>
+inline absl::Status SerializeToBackwardWriter(
+    const google::protobuf::MessageLite& src, Dest&& dest,
+    SerializeOptions options) {
+  return internal::SerializeToBackwardWriterUsingDependency(
+      src, Dependency<BackwardWriter*, Dest&&>(std::forward<Dest>(dest)),
+      options);
+}
+
+template <typename Dest, typename... DestArgs>
+inline absl::Status SerializeToBackwardWriter(
+    const google::protobuf::MessageLite& src, std::tuple<DestArgs...> dest_args,
+    SerializeOptions options) {
+  return internal::SerializeToBackwardWriterUsingDependency(
+      src, Dependency<BackwardWriter*, Dest>(std::move(dest_args)), options);
+}
+
 }  // namespace riegeli
 
 #endif  // RIEGELI_MESSAGES_MESSAGE_SERIALIZE_H_
@@ -14,13 +14,18 @@
 
 #include "riegeli/ordered_varint/ordered_varint_reading.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <limits>
+
 #include "absl/base/optimization.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/endian/endian_reading.h"
+#include "riegeli/ordered_varint/ordered_varint.h"
 
 namespace riegeli {
 namespace internal {
@@ -166,4 +171,97 @@ absl::optional<uint64_t> ReadOrderedVarint64Slow(Reader& src) {
 }
 
 }  // namespace internal
+
+namespace {
+
+// The length of an ordered varint, indexed by its first byte.
+const uint8_t kLengthOrderedVarint[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 8, 9,
+};
+
+// Decodes an ordered varint from `src[]` which has at least
+// `kMaxLengthOrderedVarint64` bytes available, and returns its length, or 0
+// if it is not canonical.
+inline size_t DecodeOrderedVarint64(const char* src, uint64_t& value) {
+  const uint8_t first_byte = static_cast<uint8_t>(*src);
+  if (ABSL_PREDICT_TRUE(first_byte < 0x80)) {
+    value = first_byte;
+    return 1;
+  }
+  const size_t length = kLengthOrderedVarint[first_byte];
+  if (ABSL_PREDICT_FALSE(length == kMaxLengthOrderedVarint64)) {
+    value = ReadBigEndian64(src + 1);
+  } else {
+    // The encoding is at the top of 8 bytes read in big endian, and the value
+    // is in its lower `7 * length` bits.
+    value = (ReadBigEndian64(src) >> ((8 - length) * 8)) &
+            ((uint64_t{1} << (7 * length)) - 1);
+  }
+  if (ABSL_PREDICT_FALSE(value < uint64_t{1} << (7 * (length - 1)))) return 0;
+  return length;
+}
+
+}  // namespace
+
+bool ReadOrderedVarint64s(Reader& src, absl::Span<uint64_t> dest) {
+  while (!dest.empty()) {
+    if (ABSL_PREDICT_FALSE(!src.Pull(
+            1, UnsignedMin(dest.size(), std::numeric_limits<size_t>::max() /
+                                            kMaxLengthOrderedVarint64) *
+                   kMaxLengthOrderedVarint64))) {
+      return false;
+    }
+    const char* cursor = src.cursor();
+    // Values which might not be fully present in the buffer, near its end,
+    // are read individually.
+    const char* const limit =
+        src.available() >= kMaxLengthOrderedVarint64
+            ? src.limit() - (kMaxLengthOrderedVarint64 - 1)
+            : cursor;
+    while (cursor < limit && !dest.empty()) {
+      const size_t length = DecodeOrderedVarint64(cursor, dest.front());
+      if (ABSL_PREDICT_FALSE(length == 0)) return false;
+      cursor += length;
+      dest.remove_prefix(1);
+    }
+    src.set_cursor(cursor);
+    if (cursor >= limit && !dest.empty()) {
+      const absl::optional<uint64_t> value = ReadOrderedVarint64(src);
+      if (ABSL_PREDICT_FALSE(value == absl::nullopt)) return false;
+      dest.front() = *value;
+      dest.remove_prefix(1);
+    }
+  }
+  return true;
+}
+
+bool ReadDeltaOrderedVarint64s(Reader& src, absl::Span<uint64_t> dest) {
+  if (ABSL_PREDICT_FALSE(!ReadOrderedVarint64s(src, dest))) return false;
+  uint64_t value = 0;
+  for (uint64_t& delta : dest) {
+    if (ABSL_PREDICT_FALSE(delta > std::numeric_limits<uint64_t>::max() -
+                                       value)) {
+      return false;
+    }
+    value += delta;
+    delta = value;
+  }
+  return true;
+}
+
 }  // namespace riegeli
@@ -19,6 +19,7 @@
 
 #include "absl/base/optimization.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/ordered_varint/ordered_varint.h"
 
@@ -48,6 +49,25 @@ namespace riegeli {
 absl::optional<uint32_t> ReadOrderedVarint32(Reader& src);
 absl::optional<uint64_t> ReadOrderedVarint64(Reader& src);
 
+// Reads an array of ordered varints.
+//
+// This is faster than reading them individually: values fully present in the
+// buffer are decoded with a table lookup of the length and a single big endian
+// load, without branching on the length.
+//
+// Returns `false` on failure, with unspecified current position.
+bool ReadOrderedVarint64s(Reader& src, absl::Span<uint64_t> dest);
+
+// Reads an array of non-decreasing values written by
+// `WriteDeltaOrderedVarint64s()`: the first value and differences between
+// consecutive values, as ordered varints.
+//
+// This is suitable for sorted columns, e.g. of keys or positions, where
+// differences are much smaller than values.
+//
+// Returns `false` on failure, with unspecified current position.
+bool ReadDeltaOrderedVarint64s(Reader& src, absl::Span<uint64_t> dest);
+
 // Implementation details follow.
 
 namespace internal {
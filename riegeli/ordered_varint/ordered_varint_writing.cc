@@ -14,12 +14,17 @@
 
 #include "riegeli/ordered_varint/ordered_varint_writing.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <limits>
+
 #include "absl/base/optimization.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/endian/endian_writing.h"
+#include "riegeli/ordered_varint/ordered_varint.h"
 
 namespace riegeli {
 namespace internal {
@@ -114,4 +119,80 @@ bool WriteOrderedVarint64Slow(uint64_t data, riegeli::Writer& dest) {
 }
 
 }  // namespace internal
+
+namespace {
+
+// Encodes `data` to `dest[]` which has at least `kMaxLengthOrderedVarint64`
+// bytes available, and returns the length of the encoding.
+inline size_t EncodeOrderedVarint64(uint64_t data, char* dest) {
+  const size_t length = LengthOrderedVarint64(data);
+  if (ABSL_PREDICT_FALSE(length == kMaxLengthOrderedVarint64)) {
+    dest[0] = static_cast<char>(0xff);
+    WriteBigEndian64(data, dest + 1);
+  } else {
+    // The encoding is `length - 1` one bits, a zero bit, and `data` in the
+    // lower `7 * length` bits. It is written at the top of 8 bytes in big
+    // endian; bytes after `length` are overwritten later or left unused.
+    const uint64_t marker = ((uint64_t{1} << (length - 1)) - 1)
+                            << (7 * length + 1);
+    WriteBigEndian64((data | marker) << ((8 - length) * 8), dest);
+  }
+  return length;
+}
+
+}  // namespace
+
+bool WriteOrderedVarint64s(absl::Span<const uint64_t> data, Writer& dest) {
+  while (!data.empty()) {
+    if (ABSL_PREDICT_FALSE(!dest.Push(
+            1, UnsignedMin(data.size(), std::numeric_limits<size_t>::max() /
+                                            kMaxLengthOrderedVarint64) *
+                   kMaxLengthOrderedVarint64))) {
+      return false;
+    }
+    char* cursor = dest.cursor();
+    // Values which might not fit in the buffer, near its end, are written
+    // individually.
+    char* const limit = dest.available() >= kMaxLengthOrderedVarint64
+                            ? dest.limit() - (kMaxLengthOrderedVarint64 - 1)
+                            : cursor;
+    while (cursor < limit && !data.empty()) {
+      cursor += EncodeOrderedVarint64(data.front(), cursor);
+      data.remove_prefix(1);
+    }
+    dest.set_cursor(cursor);
+    if (cursor >= limit && !data.empty()) {
+      if (ABSL_PREDICT_FALSE(!WriteOrderedVarint64(data.front(), dest))) {
+        return false;
+      }
+      data.remove_prefix(1);
+    }
+  }
+  return true;
+}
+
+bool WriteDeltaOrderedVarint64s(absl::Span<const uint64_t> data,
+                                Writer& dest) {
+  // Differences are computed in blocks, to be written in bulk.
+  constexpr size_t kBlockSize = 256;
+  uint64_t deltas[kBlockSize];
+  uint64_t previous = 0;
+  while (!data.empty()) {
+    const size_t length = UnsignedMin(data.size(), kBlockSize);
+    for (size_t i = 0; i < length; ++i) {
+      RIEGELI_ASSERT_GE(data[i], previous)
+          << "Failed precondition of WriteDeltaOrderedVarint64s(): "
+             "values not sorted";
+      deltas[i] = data[i] - previous;
+      previous = data[i];
+    }
+    if (ABSL_PREDICT_FALSE(!WriteOrderedVarint64s(
+            absl::MakeConstSpan(deltas, length), dest))) {
+      return false;
+    }
+    data.remove_prefix(length);
+  }
+  return true;
+}
+
 }  // namespace riegeli
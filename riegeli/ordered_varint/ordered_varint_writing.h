@@ -19,6 +19,7 @@
 #include <stdint.h>
 
 #include "absl/base/optimization.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/port.h"
 #include "riegeli/bytes/writer.h"
@@ -52,6 +53,26 @@ namespace riegeli {
 bool WriteOrderedVarint32(uint32_t data, Writer& dest);
 bool WriteOrderedVarint64(uint64_t data, Writer& dest);
 
+// Writes an array of ordered varints.
+//
+// This is faster than writing them individually: values are encoded with a
+// single big endian store each, without branching on the length.
+//
+// Returns `false` on failure.
+bool WriteOrderedVarint64s(absl::Span<const uint64_t> data, Writer& dest);
+
+// Writes an array of non-decreasing values: the first value and differences
+// between consecutive values, as ordered varints. They can be read with
+// `ReadDeltaOrderedVarint64s()`.
+//
+// This is suitable for sorted columns, e.g. of keys or positions, where
+// differences are much smaller than values.
+//
+// Precondition: `data` is sorted in non-decreasing order.
+//
+// Returns `false` on failure.
+bool WriteDeltaOrderedVarint64s(absl::Span<const uint64_t> data, Writer& dest);
+
 // Returns the length needed to write a given value as an ordered varint, which
 // is at most `kMaxLengthOrderedVarint{32,64}`.
 size_t LengthOrderedVarint32(uint32_t data);
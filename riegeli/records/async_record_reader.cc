@@ -0,0 +1,145 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/async_record_reader.h"
+
+#include <stddef.h>
+
+#include <future>
+#include <memory>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/records/record_position.h"
+#include "riegeli/records/record_reader.h"
+
+namespace riegeli {
+
+AsyncRecordReaderBase::~AsyncRecordReaderBase() { WaitForOperations(); }
+
+void AsyncRecordReaderBase::Initialize(RecordReaderBase* src,
+                                       Options&& options) {
+  RIEGELI_ASSERT(src != nullptr)
+      << "Failed precondition of AsyncRecordReader: null RecordReader pointer";
+  executor_ = std::move(options.executor());
+  if (executor_ == nullptr) executor_ = std::make_shared<Executor>(1);
+  if (ABSL_PREDICT_FALSE(!src->healthy())) Fail(*src);
+}
+
+void AsyncRecordReaderBase::Done() { WaitForOperations(); }
+
+void AsyncRecordReaderBase::ReadRecordsAsync(size_t max_records,
+                                             ReadRecordsCallback callback) {
+  RIEGELI_ASSERT_GT(max_records, 0u)
+      << "Failed precondition of AsyncRecordReaderBase::ReadRecordsAsync(): "
+         "no records requested";
+  Schedule([max_records,
+            callback = std::move(callback)](RecordReaderBase& src) {
+    ReadRecordsResult result;
+    if (ABSL_PREDICT_FALSE(!src.ReadRecords(max_records, result.records))) {
+      if (ABSL_PREDICT_FALSE(!src.healthy())) result.status = src.status();
+    }
+    if (ABSL_PREDICT_TRUE(result.status.ok())) result.pos = src.pos();
+    callback(std::move(result));
+  });
+}
+
+std::future<AsyncRecordReaderBase::ReadRecordsResult>
+AsyncRecordReaderBase::ReadRecordsAsync(size_t max_records) {
+  // `std::function` requires a copyable callback, hence `std::shared_ptr`.
+  const std::shared_ptr<std::promise<ReadRecordsResult>> promise =
+      std::make_shared<std::promise<ReadRecordsResult>>();
+  std::future<ReadRecordsResult> future = promise->get_future();
+  ReadRecordsAsync(max_records, [promise](ReadRecordsResult result) {
+    promise->set_value(std::move(result));
+  });
+  return future;
+}
+
+void AsyncRecordReaderBase::SeekAsync(RecordPosition new_pos,
+                                      SeekCallback callback) {
+  Schedule([new_pos, callback = std::move(callback)](RecordReaderBase& src) {
+    callback(ABSL_PREDICT_TRUE(src.Seek(new_pos)) ? absl::OkStatus()
+                                                  : src.status());
+  });
+}
+
+void AsyncRecordReaderBase::SeekAsync(Position new_pos,
+                                      SeekCallback callback) {
+  Schedule([new_pos, callback = std::move(callback)](RecordReaderBase& src) {
+    callback(ABSL_PREDICT_TRUE(src.Seek(new_pos)) ? absl::OkStatus()
+                                                  : src.status());
+  });
+}
+
+std::future<absl::Status> AsyncRecordReaderBase::SeekAsync(
+    RecordPosition new_pos) {
+  const std::shared_ptr<std::promise<absl::Status>> promise =
+      std::make_shared<std::promise<absl::Status>>();
+  std::future<absl::Status> future = promise->get_future();
+  SeekAsync(new_pos, [promise](absl::Status status) {
+    promise->set_value(std::move(status));
+  });
+  return future;
+}
+
+std::future<absl::Status> AsyncRecordReaderBase::SeekAsync(Position new_pos) {
+  const std::shared_ptr<std::promise<absl::Status>> promise =
+      std::make_shared<std::promise<absl::Status>>();
+  std::future<absl::Status> future = promise->get_future();
+  SeekAsync(new_pos, [promise](absl::Status status) {
+    promise->set_value(std::move(status));
+  });
+  return future;
+}
+
+void AsyncRecordReaderBase::WaitForOperations() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(&idle_));
+}
+
+void AsyncRecordReaderBase::Schedule(Operation operation) {
+  RIEGELI_ASSERT(is_open())
+      << "Failed precondition of AsyncRecordReaderBase: object closed";
+  {
+    absl::MutexLock lock(&mutex_);
+    operations_.push_back(std::move(operation));
+    if (!idle_) return;
+    idle_ = false;
+  }
+  executor_->Schedule(this, [this] { RunOperations(); });
+}
+
+void AsyncRecordReaderBase::RunOperations() {
+  RecordReaderBase& src = *src_record_reader();
+  for (;;) {
+    Operation operation;
+    {
+      absl::MutexLock lock(&mutex_);
+      if (operations_.empty()) {
+        idle_ = true;
+        return;
+      }
+      operation = std::move(operations_.front());
+      operations_.pop_front();
+    }
+    operation(src);
+  }
+}
+
+}  // namespace riegeli
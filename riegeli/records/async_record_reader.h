@@ -0,0 +1,356 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_ASYNC_RECORD_READER_H_
+#define RIEGELI_RECORDS_ASYNC_RECORD_READER_H_
+
+#include <stddef.h>
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#if __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/dependency.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/object.h"
+#include "riegeli/records/record_position.h"
+#include "riegeli/records/record_reader.h"
+
+namespace riegeli {
+
+#if __cpp_impl_coroutine
+
+namespace internal {
+
+// An awaitable for a C++20 coroutine, which starts an operation completing
+// with a callback, suspends the coroutine until the callback is called, and
+// resumes the coroutine in the thread calling the callback, yielding the
+// `Result`.
+template <typename Result>
+class CallbackAwaiter {
+ public:
+  using Start = std::function<void(std::function<void(Result)> callback)>;
+
+  explicit CallbackAwaiter(Start start) : start_(std::move(start)) {}
+
+  CallbackAwaiter(const CallbackAwaiter&) = delete;
+  CallbackAwaiter& operator=(const CallbackAwaiter&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    // The coroutine can be resumed and `*this` destroyed before `start()`
+    // returns, hence `start_` is moved out first.
+    const Start start = std::move(start_);
+    start([this, coroutine](Result result) {
+      result_ = std::move(result);
+      coroutine.resume();
+    });
+  }
+  Result await_resume() { return std::move(result_); }
+
+ private:
+  Start start_;
+  Result result_;
+};
+
+}  // namespace internal
+
+#endif
+
+// Template parameter independent part of `AsyncRecordReader`.
+class AsyncRecordReaderBase : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Sets the `Executor` running operations of the `AsyncRecordReader`,
+    // including I/O of the underlying byte `Reader` and decoding of chunks.
+    //
+    // If `nullptr`, a private `Executor` with one thread is used.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+   private:
+    std::shared_ptr<Executor> executor_;
+  };
+
+  // The result of `ReadRecordsAsync()`.
+  struct ReadRecordsResult {
+    // `absl::OkStatus()` on success, including when the source ends. Otherwise
+    // the status of the failed `RecordReader`.
+    absl::Status status;
+    // Records read, fewer than `max_records` (possibly none) if the source
+    // ends or on failure.
+    std::vector<Chain> records;
+    // The position of the next record after the operation, valid if
+    // `status.ok()`.
+    RecordPosition pos;
+  };
+
+  using ReadRecordsCallback = std::function<void(ReadRecordsResult result)>;
+  using SeekCallback = std::function<void(absl::Status status)>;
+
+  ~AsyncRecordReaderBase();
+
+  // Returns the `RecordReader` being read from. Unchanged by `Close()`.
+  //
+  // It must not be accessed while operations are pending.
+  virtual RecordReaderBase* src_record_reader() = 0;
+  virtual const RecordReaderBase* src_record_reader() const = 0;
+
+  // Reads up to `max_records` next records in background, like
+  // `RecordReaderBase::ReadRecords()`, and calls `callback` with the result.
+  //
+  // Operations are performed in the order in which they were issued, one at a
+  // time. `callback` is called in a thread of the `Executor`, and must not wait
+  // for other operations of this `AsyncRecordReader`.
+  //
+  // Precondition: `max_records > 0`
+  void ReadRecordsAsync(size_t max_records, ReadRecordsCallback callback);
+
+  // Like `ReadRecordsAsync()` with a callback, but returns a future.
+  std::future<ReadRecordsResult> ReadRecordsAsync(size_t max_records);
+
+  // Seeks in background, like `RecordReaderBase::Seek()`, and calls `callback`
+  // with `absl::OkStatus()` on success, or with the status of the failed
+  // `RecordReader`.
+  //
+  // Operations are ordered and `callback` is called as for
+  // `ReadRecordsAsync()`.
+  void SeekAsync(RecordPosition new_pos, SeekCallback callback);
+  void SeekAsync(Position new_pos, SeekCallback callback);
+
+  // Like `SeekAsync()` with a callback, but returns a future.
+  std::future<absl::Status> SeekAsync(RecordPosition new_pos);
+  std::future<absl::Status> SeekAsync(Position new_pos);
+
+#if __cpp_impl_coroutine
+  // Like `ReadRecordsAsync()` and `SeekAsync()`, but return awaitables for a
+  // C++20 coroutine:
+  //
+  // ```
+  //   ReadRecordsResult result = co_await reader.ReadRecordsAwaitable(n);
+  //   absl::Status status = co_await reader.SeekAwaitable(pos);
+  // ```
+  //
+  // The coroutine is suspended without blocking a thread until the operation
+  // completes, and is resumed in a thread of the `Executor`. This lets many
+  // concurrent streams be served by a few threads.
+  internal::CallbackAwaiter<ReadRecordsResult> ReadRecordsAwaitable(
+      size_t max_records);
+  internal::CallbackAwaiter<absl::Status> SeekAwaitable(RecordPosition new_pos);
+  internal::CallbackAwaiter<absl::Status> SeekAwaitable(Position new_pos);
+#endif
+
+  // Blocks until operations issued so far have completed, including their
+  // callbacks.
+  //
+  // This is meant for shutdown or tests, not for an event loop.
+  void WaitForOperations();
+
+ protected:
+  explicit AsyncRecordReaderBase(InitiallyClosed) noexcept
+      : Object(kInitiallyClosed) {}
+  explicit AsyncRecordReaderBase(InitiallyOpen) noexcept
+      : Object(kInitiallyOpen) {}
+
+  void Initialize(RecordReaderBase* src, Options&& options);
+
+  // Waits for pending operations.
+  void Done() override;
+
+ private:
+  using Operation = std::function<void(RecordReaderBase& src)>;
+
+  // Schedules `operation` to run after previously issued operations.
+  void Schedule(Operation operation);
+
+  // Runs pending operations until there are none.
+  void RunOperations();
+
+  std::shared_ptr<Executor> executor_;
+  absl::Mutex mutex_;
+  std::deque<Operation> operations_ ABSL_GUARDED_BY(mutex_);
+  // `true` if no operation is pending or running.
+  bool idle_ ABSL_GUARDED_BY(mutex_) = true;
+};
+
+// `AsyncRecordReader` reads records of a Riegeli/records file without blocking
+// the calling thread, e.g. an event loop: each operation runs in background in
+// an `Executor`, performing I/O and decoding there, and completes by calling a
+// callback or resolving a future.
+//
+// Operations are performed one at a time in the order in which they were
+// issued, on the underlying `RecordReader`, so they have the same semantics as
+// corresponding methods of `RecordReaderBase`.
+//
+// The `Src` template parameter specifies the type of the object providing and
+// possibly owning the `RecordReader`. `Src` must support
+// `Dependency<RecordReaderBase*, Src>`, e.g. `RecordReaderBase*` (not owned,
+// default), `std::unique_ptr<RecordReaderBase>` (owned),
+// `RecordReader<FdReader<>>` (owned).
+//
+// The `RecordReader` must not be accessed until the `AsyncRecordReader` is
+// closed or no longer used. An `AsyncRecordReader` is not movable, because
+// pending operations refer to it.
+template <typename Src = RecordReaderBase*>
+class AsyncRecordReader : public AsyncRecordReaderBase {
+ public:
+  // Creates a closed `AsyncRecordReader`.
+  AsyncRecordReader() noexcept : AsyncRecordReaderBase(kInitiallyClosed) {}
+
+  // Will read from the `RecordReader` provided by `src`.
+  explicit AsyncRecordReader(const Src& src, Options options = Options());
+  explicit AsyncRecordReader(Src&& src, Options options = Options());
+
+  // Will read from the `RecordReader` provided by a `Src` constructed from
+  // elements of `src_args`. This avoids constructing a temporary `Src` and
+  // moving from it.
+  template <typename... SrcArgs>
+  explicit AsyncRecordReader(std::tuple<SrcArgs...> src_args,
+                             Options options = Options());
+
+  AsyncRecordReader(const AsyncRecordReader&) = delete;
+  AsyncRecordReader& operator=(const AsyncRecordReader&) = delete;
+
+  ~AsyncRecordReader();
+
+  // Returns the object providing and possibly owning the `RecordReader`.
+  // Unchanged by `Close()`.
+  Src& src() { return src_.manager(); }
+  const Src& src() const { return src_.manager(); }
+  RecordReaderBase* src_record_reader() override { return src_.get(); }
+  const RecordReaderBase* src_record_reader() const override {
+    return src_.get();
+  }
+
+ protected:
+  void Done() override;
+
+ private:
+  // The object providing and possibly owning the `RecordReader`.
+  Dependency<RecordReaderBase*, Src> src_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+template <typename Src>
+explicit AsyncRecordReader(const Src& src,
+                           AsyncRecordReaderBase::Options options =
+                               AsyncRecordReaderBase::Options())
+    -> AsyncRecordReader<std::decay_t<Src>>;
+template <typename Src>
+explicit AsyncRecordReader(Src&& src, AsyncRecordReaderBase::Options options =
+                                          AsyncRecordReaderBase::Options())
+    -> AsyncRecordReader<std::decay_t<Src>>;
+template <typename... SrcArgs>
+explicit AsyncRecordReader(std::tuple<SrcArgs...> src_args,
+                           AsyncRecordReaderBase::Options options =
+                               AsyncRecordReaderBase::Options())
+    -> AsyncRecordReader<DeleteCtad<std::tuple<SrcArgs...>>>;
+#endif
+
+// Implementation details follow.
+
+#if __cpp_impl_coroutine
+
+inline internal::CallbackAwaiter<AsyncRecordReaderBase::ReadRecordsResult>
+AsyncRecordReaderBase::ReadRecordsAwaitable(size_t max_records) {
+  return internal::CallbackAwaiter<ReadRecordsResult>(
+      [this, max_records](ReadRecordsCallback callback) {
+        ReadRecordsAsync(max_records, std::move(callback));
+      });
+}
+
+inline internal::CallbackAwaiter<absl::Status>
+AsyncRecordReaderBase::SeekAwaitable(RecordPosition new_pos) {
+  return internal::CallbackAwaiter<absl::Status>(
+      [this, new_pos](SeekCallback callback) {
+        SeekAsync(new_pos, std::move(callback));
+      });
+}
+
+inline internal::CallbackAwaiter<absl::Status>
+AsyncRecordReaderBase::SeekAwaitable(Position new_pos) {
+  return internal::CallbackAwaiter<absl::Status>(
+      [this, new_pos](SeekCallback callback) {
+        SeekAsync(new_pos, std::move(callback));
+      });
+}
+
+#endif
+
+template <typename Src>
+inline AsyncRecordReader<Src>::AsyncRecordReader(const Src& src,
+                                                 Options options)
+    : AsyncRecordReaderBase(kInitiallyOpen), src_(src) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+inline AsyncRecordReader<Src>::AsyncRecordReader(Src&& src, Options options)
+    : AsyncRecordReaderBase(kInitiallyOpen), src_(std::move(src)) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+template <typename... SrcArgs>
+inline AsyncRecordReader<Src>::AsyncRecordReader(
+    std::tuple<SrcArgs...> src_args, Options options)
+    : AsyncRecordReaderBase(kInitiallyOpen), src_(std::move(src_args)) {
+  Initialize(src_.get(), std::move(options));
+}
+
+template <typename Src>
+AsyncRecordReader<Src>::~AsyncRecordReader() {
+  // Pending operations refer to `src_`, which is destroyed before the base
+  // class.
+  WaitForOperations();
+}
+
+template <typename Src>
+void AsyncRecordReader<Src>::Done() {
+  AsyncRecordReaderBase::Done();
+  if (src_.is_owning()) {
+    if (ABSL_PREDICT_FALSE(!src_->Close())) Fail(*src_);
+  }
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_ASYNC_RECORD_READER_H_
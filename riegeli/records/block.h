@@ -73,70 +73,128 @@ class BlockHeader {
   char bytes_[3 * sizeof(uint64_t)];
 };
 
+// The default block size. Files with a standard file signature use it.
 RIEGELI_INTERNAL_INLINE_CONSTEXPR(Position, kBlockSize, Position{1} << 16);
 
+// The largest block size which a file signature can declare.
+RIEGELI_INTERNAL_INLINE_CONSTEXPR(Position, kMaxBlockSize, Position{1} << 30);
+
 RIEGELI_INTERNAL_INLINE_CONSTEXPR(Position, kUsableBlockSize,
                                   kBlockSize - BlockHeader::size());
 
+// Whether `block_size` is a power of 2 between `kBlockSize` and
+// `kMaxBlockSize`. Functions below which take `block_size` require this.
+inline bool IsValidBlockSize(Position block_size) {
+  return block_size >= kBlockSize && block_size <= kMaxBlockSize &&
+         (block_size & (block_size - 1)) == 0;
+}
+
+// The `decoded_data_size()` of the file signature chunk of a file with the
+// given block size.
+//
+// A file with `kBlockSize` has the standard file signature, with 0 there, so
+// that it remains readable by readers which do not support other block sizes.
+// Such readers reject a file with another block size as lacking the file
+// signature.
+inline uint64_t SignatureDecodedDataSize(Position block_size) {
+  return block_size == kBlockSize ? 0 : IntCast<uint64_t>(block_size);
+}
+
+// The block size of a file whose file signature chunk has the given
+// `decoded_data_size()`, or 0 if it is invalid.
+inline Position BlockSizeFromSignature(uint64_t decoded_data_size) {
+  if (decoded_data_size == 0) return kBlockSize;
+  if (decoded_data_size == kBlockSize ||
+      !IsValidBlockSize(decoded_data_size)) {
+    return 0;
+  }
+  return decoded_data_size;
+}
+
+inline Position UsableBlockSize(Position block_size = kBlockSize) {
+  return block_size - BlockHeader::size();
+}
+
 // Whether `pos` is a block boundary (immediately before a block header).
-inline bool IsBlockBoundary(Position pos) { return pos % kBlockSize == 0; }
+inline bool IsBlockBoundary(Position pos, Position block_size = kBlockSize) {
+  return (pos & (block_size - 1)) == 0;
+}
 
 // The nearest block boundary at or before `pos`.
-inline Position RoundDownToBlockBoundary(Position pos) {
-  return pos - pos % kBlockSize;
+inline Position RoundDownToBlockBoundary(Position pos,
+                                         Position block_size = kBlockSize) {
+  return pos & ~(block_size - 1);
 }
 
 // How many bytes remain until the end of the block (0 at a block boundary).
-inline Position RemainingInBlock(Position pos) { return (-pos) % kBlockSize; }
+inline Position RemainingInBlock(Position pos,
+                                 Position block_size = kBlockSize) {
+  return (-pos) & (block_size - 1);
+}
 
 // Whether `pos` is a possible chunk boundary (not inside nor immediately after
 // a block header).
-inline bool IsPossibleChunkBoundary(Position pos) {
-  return RemainingInBlock(pos) < kUsableBlockSize;
+inline bool IsPossibleChunkBoundary(Position pos,
+                                    Position block_size = kBlockSize) {
+  return RemainingInBlock(pos, block_size) < UsableBlockSize(block_size);
 }
 
 // The nearest possible chunk boundary at or after `pos` (chunk boundaries are
 // not valid inside or immediately after a block header).
-inline Position RoundUpToPossibleChunkBoundary(Position pos) {
-  return pos + SaturatingSub(RemainingInBlock(pos), kUsableBlockSize - 1);
+inline Position RoundUpToPossibleChunkBoundary(
+    Position pos, Position block_size = kBlockSize) {
+  return pos + SaturatingSub(RemainingInBlock(pos, block_size),
+                             UsableBlockSize(block_size) - 1);
 }
 
 // If `pos` is immediately before or inside a block header, how many bytes
 // remain until the end of the block header, otherwise 0.
-inline size_t RemainingInBlockHeader(Position pos) {
-  return SaturatingSub(BlockHeader::size(), IntCast<size_t>(pos % kBlockSize));
+inline size_t RemainingInBlockHeader(Position pos,
+                                     Position block_size = kBlockSize) {
+  return SaturatingSub(BlockHeader::size(),
+                       IntCast<size_t>(pos & (block_size - 1)));
 }
 
 // For a chunk beginning at `chunk_begin`, the position after `length`, adding
 // intervening block headers.
-inline Position AddWithOverhead(Position chunk_begin, Position length) {
-  RIEGELI_ASSERT_LT(RemainingInBlock(chunk_begin), kUsableBlockSize)
+inline Position AddWithOverhead(Position chunk_begin, Position length,
+                                Position block_size = kBlockSize) {
+  const Position usable_block_size = UsableBlockSize(block_size);
+  RIEGELI_ASSERT_LT(RemainingInBlock(chunk_begin, block_size),
+                    usable_block_size)
       << "Failed precondition of AddWithOverhead(): invalid chunk boundary";
   const Position num_overhead_blocks =
-      (length + (chunk_begin + kUsableBlockSize - 1) % kBlockSize) /
-      kUsableBlockSize;
+      (length +
+       ((chunk_begin + usable_block_size - 1) & (block_size - 1))) /
+      usable_block_size;
   return chunk_begin + length + num_overhead_blocks * BlockHeader::size();
 }
 
 // For a chunk beginning at `chunk_begin`, the length until `pos`, subtracting
 // intervening block headers.
-inline Position DistanceWithoutOverhead(Position chunk_begin, Position pos) {
+inline Position DistanceWithoutOverhead(Position chunk_begin, Position pos,
+                                        Position block_size = kBlockSize) {
   RIEGELI_ASSERT_LE(chunk_begin, pos)
       << "Failed precondition of DistanceWithoutOverhead(): "
          "positions in the wrong order";
   const Position num_overhead_blocks =
-      pos / kBlockSize - chunk_begin / kBlockSize;
-  return (pos - UnsignedMin(pos % kBlockSize, BlockHeader::size())) -
+      (RoundDownToBlockBoundary(pos, block_size) -
+       RoundDownToBlockBoundary(chunk_begin, block_size)) /
+      block_size;
+  return (pos - UnsignedMin(pos & (block_size - 1), BlockHeader::size())) -
          (chunk_begin -
-          UnsignedMin(chunk_begin % kBlockSize, BlockHeader::size())) -
+          UnsignedMin(chunk_begin & (block_size - 1), BlockHeader::size())) -
          num_overhead_blocks * BlockHeader::size();
 }
 
 // The position after a chunk which begins at `chunk_begin`.
-inline Position ChunkEnd(const ChunkHeader& header, Position chunk_begin) {
+inline Position ChunkEnd(const ChunkHeader& header, Position chunk_begin,
+                         Position block_size = kBlockSize) {
   return UnsignedMax(
-      AddWithOverhead(chunk_begin, header.size() + header.data_size()),
-      RoundUpToPossibleChunkBoundary(chunk_begin + header.num_records()));
+      AddWithOverhead(chunk_begin, header.size() + header.data_size(),
+                      block_size),
+      RoundUpToPossibleChunkBoundary(chunk_begin + header.num_records(),
+                                     block_size));
 }
 
 }  // namespace internal
@@ -0,0 +1,116 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/chunk_concatenator.h"
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/status.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/chunk_writer.h"
+
+namespace riegeli {
+
+ChunkConcatenator::ChunkConcatenator(ChunkWriter* dest)
+    : Object(kInitiallyOpen), dest_(RIEGELI_ASSERT_NOTNULL(dest)) {
+  if (ABSL_PREDICT_FALSE(!dest_->healthy())) {
+    Fail(*dest_);
+    return;
+  }
+  if (dest_->pos() > 0) {
+    metadata_known_ = true;
+    metadata_unverified_ = true;
+  }
+}
+
+bool ChunkConcatenator::Append(ChunkReader& src) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  ++num_sources_;
+  // Whether the previous chunk was the file signature, so that the current
+  // chunk is the file metadata if the file has them.
+  bool after_signature = false;
+  Chunk chunk;
+  while (src.ReadChunk(chunk)) {
+    if (after_signature) {
+      after_signature = false;
+      if (chunk.header.chunk_type() == ChunkType::kFileMetadata) {
+        if (ABSL_PREDICT_FALSE(!HandleMetadata(&chunk))) return false;
+        continue;
+      }
+      if (ABSL_PREDICT_FALSE(!HandleMetadata(nullptr))) return false;
+    }
+    switch (chunk.header.chunk_type()) {
+      case ChunkType::kFileSignature:
+        if (!metadata_known_) {
+          if (ABSL_PREDICT_FALSE(!dest_->WriteChunk(chunk))) {
+            return Fail(*dest_);
+          }
+        }
+        after_signature = true;
+        continue;
+      case ChunkType::kFileMetadata:
+        return Fail(absl::InvalidArgumentError(absl::StrCat(
+            "File metadata chunk not after the file signature in source #",
+            num_sources_, " at byte ", src.pos())));
+      default:
+        break;
+    }
+    if (chunk.header.num_records() == 0) continue;
+    if (ABSL_PREDICT_FALSE(!metadata_known_)) {
+      return Fail(absl::InvalidArgumentError(absl::StrCat(
+          "Missing file signature in source #", num_sources_)));
+    }
+    if (ABSL_PREDICT_FALSE(!dest_->WriteChunk(chunk))) return Fail(*dest_);
+    ++num_chunks_;
+  }
+  if (after_signature && ABSL_PREDICT_FALSE(!HandleMetadata(nullptr))) {
+    return false;
+  }
+  if (ABSL_PREDICT_FALSE(!src.healthy())) {
+    return Fail(Annotate(src.status(),
+                         absl::StrCat("in source #", num_sources_)));
+  }
+  return true;
+}
+
+inline bool ChunkConcatenator::HandleMetadata(const Chunk* metadata) {
+  if (!metadata_known_) {
+    metadata_known_ = true;
+    if (metadata != nullptr) {
+      if (ABSL_PREDICT_FALSE(!dest_->WriteChunk(*metadata))) {
+        return Fail(*dest_);
+      }
+      metadata_ = metadata->data;
+    }
+    return true;
+  }
+  if (metadata_unverified_) return true;
+  if (ABSL_PREDICT_FALSE(metadata == nullptr
+                             ? metadata_ != absl::nullopt
+                             : metadata_ == absl::nullopt ||
+                                   *metadata_ != metadata->data)) {
+    return Fail(absl::InvalidArgumentError(
+        absl::StrCat("File metadata in source #", num_sources_,
+                     " differ from file metadata of the first source")));
+  }
+  return true;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,91 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_CHUNK_CONCATENATOR_H_
+#define RIEGELI_RECORDS_CHUNK_CONCATENATOR_H_
+
+#include <stdint.h>
+
+#include "absl/types/optional.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/chunk_writer.h"
+
+namespace riegeli {
+
+// `ChunkConcatenator` concatenates Riegeli/records files by copying their
+// chunks, without decoding and reencoding records. Only block headers are
+// computed again for new chunk positions, so concatenation runs at the speed
+// of sequential I/O.
+//
+// The file signature and file metadata are written once, taken from the first
+// source. Later sources must have the same metadata, because their records can
+// depend on it, e.g. on a Zstd dictionary stored there. Their signature and
+// metadata chunks are dropped.
+//
+// Padding and index chunks are dropped because chunk positions change. Other
+// chunks without records are dropped too.
+class ChunkConcatenator : public Object {
+ public:
+  // Will write to `*dest`, which is not owned and must be alive until the last
+  // `Append()`.
+  //
+  // If `dest->pos() > 0`, `*dest` is assumed to already contain a file
+  // signature and metadata matching the sources, and the first source is
+  // treated like later sources, except that its metadata are not verified.
+  explicit ChunkConcatenator(ChunkWriter* dest);
+
+  ChunkConcatenator(const ChunkConcatenator&) = delete;
+  ChunkConcatenator& operator=(const ChunkConcatenator&) = delete;
+
+  // Copies chunks of `src`, which should be positioned at the beginning of a
+  // file, until the end of `src`.
+  //
+  // Chunk data hashes are verified while reading, so that corrupted chunks are
+  // not copied with valid block headers.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool Append(ChunkReader& src);
+
+  // Returns the number of sources appended so far.
+  uint64_t num_sources() const { return num_sources_; }
+
+  // Returns the number of chunks with records copied so far.
+  uint64_t num_chunks() const { return num_chunks_; }
+
+ private:
+  // Handles a metadata chunk, or its absence (`metadata == nullptr`) when
+  // the first chunk after the signature is not a metadata chunk.
+  bool HandleMetadata(const Chunk* metadata);
+
+  ChunkWriter* dest_;
+  // Whether `metadata_` is known, i.e. it has been taken from the first source,
+  // or `*dest_` was not empty initially.
+  bool metadata_known_ = false;
+  // Whether `*dest_` was not empty initially, so that metadata are unknown and
+  // are not verified.
+  bool metadata_unverified_ = false;
+  // Data of the metadata chunk of the first source, or `absl::nullopt` if it
+  // has no metadata.
+  absl::optional<Chain> metadata_;
+  uint64_t num_sources_ = 0;
+  uint64_t num_chunks_ = 0;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_CHUNK_CONCATENATOR_H_
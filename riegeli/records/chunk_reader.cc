@@ -17,6 +17,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <cstring>
 #include <string>
 #include <utility>
 
@@ -36,6 +37,38 @@
 
 namespace riegeli {
 
+namespace {
+
+// Returns the block size declared by the file signature chunk at the current
+// position of `src`, which must be 0, without changing the position.
+//
+// If the file signature cannot be read or is invalid, returns
+// `internal::kBlockSize`, leaving reporting the problem to reading the chunk.
+Position PeekBlockSize(Reader& src) {
+  RIEGELI_ASSERT_EQ(src.pos(), 0u)
+      << "Failed precondition of PeekBlockSize(): not at the beginning";
+  internal::BlockHeader block_header;
+  ChunkHeader chunk_header;
+  if (!src.Pull(block_header.size() + chunk_header.size())) {
+    return internal::kBlockSize;
+  }
+  std::memcpy(block_header.bytes(), src.cursor(), block_header.size());
+  std::memcpy(chunk_header.bytes(), src.cursor() + block_header.size(),
+              chunk_header.size());
+  if (block_header.computed_header_hash() !=
+          block_header.stored_header_hash() ||
+      chunk_header.computed_header_hash() !=
+          chunk_header.stored_header_hash() ||
+      chunk_header.chunk_type() != ChunkType::kFileSignature) {
+    return internal::kBlockSize;
+  }
+  const Position block_size =
+      internal::BlockSizeFromSignature(chunk_header.decoded_data_size());
+  return block_size == 0 ? internal::kBlockSize : block_size;
+}
+
+}  // namespace
+
 void DefaultChunkReaderBase::Initialize(Reader* src) {
   RIEGELI_ASSERT(src != nullptr)
       << "Failed precondition of DefaultChunkReader: null Reader pointer";
@@ -44,7 +77,21 @@ void DefaultChunkReaderBase::Initialize(Reader* src) {
     Fail(*src);
     return;
   }
-  if (ABSL_PREDICT_FALSE(!internal::IsPossibleChunkBoundary(pos_))) {
+  if (pos_ == 0) {
+    block_size_ = PeekBlockSize(*src);
+  } else if (src->SupportsRandomAccess()) {
+    // The block size is needed to interpret `pos_`, so read it from the file
+    // signature at the beginning.
+    if (src->Seek(0)) block_size_ = PeekBlockSize(*src);
+    if (ABSL_PREDICT_FALSE(!src->Seek(pos_))) {
+      if (ABSL_PREDICT_FALSE(!src->healthy())) {
+        Fail(*src);
+        return;
+      }
+    }
+  }
+  if (ABSL_PREDICT_FALSE(
+          !internal::IsPossibleChunkBoundary(pos_, block_size_))) {
     recoverable_ = Recoverable::kFindChunk;
     recoverable_pos_ = pos_;
     Fail(absl::InvalidArgumentError(
@@ -88,20 +135,32 @@ bool DefaultChunkReaderBase::CheckFileFormat() {
 }
 
 bool DefaultChunkReaderBase::ReadChunk(Chunk& chunk) {
-  if (ABSL_PREDICT_FALSE(!PullChunkHeader(nullptr))) return false;
+  return ReadChunkImpl(chunk, true);
+}
+
+bool DefaultChunkReaderBase::ReadChunkUnverified(Chunk& chunk) {
+  return ReadChunkImpl(chunk, false);
+}
+
+inline bool DefaultChunkReaderBase::ReadChunkImpl(Chunk& chunk,
+                                                  bool verify_data_hash) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
   Reader& src = *src_reader();
-  const Position chunk_end = internal::ChunkEnd(chunk_.header, pos_);
+  if (ABSL_PREDICT_FALSE(!PullChunkHeaderImpl(src))) return false;
+  const Position chunk_end =
+      internal::ChunkEnd(chunk_.header, pos_, block_size_);
   src.ReadHint(SaturatingIntCast<size_t>(
-      internal::AddWithOverhead(chunk_end, ChunkHeader::size()) - src.pos()));
+      internal::AddWithOverhead(chunk_end, ChunkHeader::size(), block_size_) -
+      src.pos()));
 
   while (chunk_.data.size() < chunk_.header.data_size()) {
-    if (internal::RemainingInBlockHeader(src.pos()) > 0) {
+    if (internal::RemainingInBlockHeader(src.pos(), block_size_) > 0) {
       const Position block_begin =
-          internal::RoundDownToBlockBoundary(src.pos());
-      if (ABSL_PREDICT_FALSE(!ReadBlockHeader())) return false;
+          internal::RoundDownToBlockBoundary(src.pos(), block_size_);
+      if (ABSL_PREDICT_FALSE(!ReadBlockHeader(src))) return false;
       if (ABSL_PREDICT_FALSE(block_header_.previous_chunk() !=
                              block_begin - pos_)) {
-        if (block_header_.next_chunk() <= internal::kBlockSize) {
+        if (block_header_.next_chunk() <= block_size_) {
           // Trust the rest of the block header: skip to the next chunk.
           recoverable_ = Recoverable::kHaveChunk;
           recoverable_pos_ = block_begin + block_header_.next_chunk();
@@ -131,9 +190,9 @@ bool DefaultChunkReaderBase::ReadChunk(Chunk& chunk) {
       }
     }
     if (ABSL_PREDICT_FALSE(!src.ReadAndAppend(
-            IntCast<size_t>(
-                UnsignedMin(chunk_.header.data_size() - chunk_.data.size(),
-                            internal::RemainingInBlock(src.pos()))),
+            IntCast<size_t>(UnsignedMin(
+                chunk_.header.data_size() - chunk_.data.size(),
+                internal::RemainingInBlock(src.pos(), block_size_))),
             chunk_.data))) {
       return FailReading(src);
     }
@@ -141,18 +200,22 @@ bool DefaultChunkReaderBase::ReadChunk(Chunk& chunk) {
 
   if (ABSL_PREDICT_FALSE(!src.Seek(chunk_end))) return FailReading(src);
 
-  const uint64_t computed_data_hash = internal::Hash(chunk_.data);
-  if (ABSL_PREDICT_FALSE(computed_data_hash != chunk_.header.data_hash())) {
-    // `Recoverable::kHaveChunk`, not `Recoverable::kFindChunk`, because while
-    // chunk data are invalid, chunk header has a correct hash, and thus the
-    // next chunk is believed to be present after this chunk.
-    recoverable_ = Recoverable::kHaveChunk;
-    recoverable_pos_ = chunk_end;
-    return Fail(absl::InvalidArgumentError(absl::StrCat(
-        "Corrupted Riegeli/records file: chunk data hash mismatch (computed 0x",
-        absl::Hex(computed_data_hash, absl::PadSpec::kZeroPad16), ", stored 0x",
-        absl::Hex(chunk_.header.data_hash(), absl::PadSpec::kZeroPad16),
-        "), chunk at ", pos_, " with length ", chunk_end - pos_)));
+  if (verify_data_hash) {
+    const uint64_t computed_data_hash = internal::Hash(chunk_.data);
+    if (ABSL_PREDICT_FALSE(computed_data_hash != chunk_.header.data_hash())) {
+      // `Recoverable::kHaveChunk`, not `Recoverable::kFindChunk`, because
+      // while chunk data are invalid, chunk header has a correct hash, and
+      // thus the next chunk is believed to be present after this chunk.
+      recoverable_ = Recoverable::kHaveChunk;
+      recoverable_pos_ = chunk_end;
+      return Fail(absl::InvalidArgumentError(absl::StrCat(
+          "Corrupted Riegeli/records file: chunk data hash mismatch "
+          "(computed 0x",
+          absl::Hex(computed_data_hash, absl::PadSpec::kZeroPad16),
+          ", stored 0x",
+          absl::Hex(chunk_.header.data_hash(), absl::PadSpec::kZeroPad16),
+          "), chunk at ", pos_, " with length ", chunk_end - pos_)));
+    }
   }
 
   chunk = std::move(chunk_);
@@ -163,7 +226,12 @@ bool DefaultChunkReaderBase::ReadChunk(Chunk& chunk) {
 
 bool DefaultChunkReaderBase::PullChunkHeader(const ChunkHeader** chunk_header) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  Reader& src = *src_reader();
+  if (ABSL_PREDICT_FALSE(!PullChunkHeaderImpl(*src_reader()))) return false;
+  if (chunk_header != nullptr) *chunk_header = &chunk_.header;
+  return true;
+}
+
+inline bool DefaultChunkReaderBase::PullChunkHeaderImpl(Reader& src) {
   truncated_ = false;
 
   if (ABSL_PREDICT_FALSE(src.pos() < pos_)) {
@@ -183,33 +251,32 @@ bool DefaultChunkReaderBase::PullChunkHeader(const ChunkHeader** chunk_header) {
   }
 
   const Position chunk_header_read =
-      internal::DistanceWithoutOverhead(pos_, src.pos());
+      internal::DistanceWithoutOverhead(pos_, src.pos(), block_size_);
   if (chunk_header_read < chunk_.header.size()) {
-    if (ABSL_PREDICT_FALSE(!ReadChunkHeader())) return false;
+    if (ABSL_PREDICT_FALSE(!ReadChunkHeader(src))) return false;
   }
-  if (chunk_header != nullptr) *chunk_header = &chunk_.header;
   return true;
 }
 
-inline bool DefaultChunkReaderBase::ReadChunkHeader() {
+inline bool DefaultChunkReaderBase::ReadChunkHeader(Reader& src) {
   RIEGELI_ASSERT(healthy())
       << "Failed precondition of DefaultChunkReaderBase::ReadChunkHeader(): "
       << status();
-  Reader& src = *src_reader();
-  RIEGELI_ASSERT_LT(internal::DistanceWithoutOverhead(pos_, src.pos()),
-                    chunk_.header.size())
+  RIEGELI_ASSERT_LT(
+      internal::DistanceWithoutOverhead(pos_, src.pos(), block_size_),
+      chunk_.header.size())
       << "Failed precondition of DefaultChunkReaderBase::ReadChunkHeader(): "
          "chunk header already read";
   size_t remaining_length;
   size_t length_to_read;
   do {
-    if (internal::RemainingInBlockHeader(src.pos()) > 0) {
+    if (internal::RemainingInBlockHeader(src.pos(), block_size_) > 0) {
       const Position block_begin =
-          internal::RoundDownToBlockBoundary(src.pos());
-      if (ABSL_PREDICT_FALSE(!ReadBlockHeader())) return false;
+          internal::RoundDownToBlockBoundary(src.pos(), block_size_);
+      if (ABSL_PREDICT_FALSE(!ReadBlockHeader(src))) return false;
       if (ABSL_PREDICT_FALSE(block_header_.previous_chunk() !=
                              block_begin - pos_)) {
-        if (block_header_.next_chunk() <= internal::kBlockSize) {
+        if (block_header_.next_chunk() <= block_size_) {
           // Trust the rest of the block header: skip to the next chunk.
           recoverable_ = Recoverable::kHaveChunk;
           recoverable_pos_ = block_begin + block_header_.next_chunk();
@@ -228,11 +295,11 @@ inline bool DefaultChunkReaderBase::ReadChunkHeader() {
                                block_header_.previous_chunk() - block_begin))));
       }
     }
-    const size_t chunk_header_read =
-        IntCast<size_t>(internal::DistanceWithoutOverhead(pos_, src.pos()));
+    const size_t chunk_header_read = IntCast<size_t>(
+        internal::DistanceWithoutOverhead(pos_, src.pos(), block_size_));
     remaining_length = chunk_.header.size() - chunk_header_read;
-    length_to_read =
-        UnsignedMin(remaining_length, internal::RemainingInBlock(src.pos()));
+    length_to_read = UnsignedMin(
+        remaining_length, internal::RemainingInBlock(src.pos(), block_size_));
     if (ABSL_PREDICT_FALSE(!src.Read(
             length_to_read, chunk_.header.bytes() + chunk_header_read))) {
       return FailReading(src);
@@ -253,11 +320,13 @@ inline bool DefaultChunkReaderBase::ReadChunkHeader() {
                   absl::PadSpec::kZeroPad16),
         "), chunk at ", pos_)));
   }
-  if (internal::RemainingInBlock(pos_) < chunk_.header.size()) {
+  if (internal::RemainingInBlock(pos_, block_size_) < chunk_.header.size()) {
     // The chunk header was interrupted by a block header. Both headers have
     // been read so verify that they agree.
-    const Position block_begin = pos_ + internal::RemainingInBlock(pos_);
-    const Position chunk_end = internal::ChunkEnd(chunk_.header, pos_);
+    const Position block_begin =
+        pos_ + internal::RemainingInBlock(pos_, block_size_);
+    const Position chunk_end =
+        internal::ChunkEnd(chunk_.header, pos_, block_size_);
     if (ABSL_PREDICT_FALSE(block_header_.next_chunk() !=
                            chunk_end - block_begin)) {
       recoverable_ = Recoverable::kFindChunk;
@@ -275,22 +344,25 @@ inline bool DefaultChunkReaderBase::ReadChunkHeader() {
                            chunk_.header.chunk_type() !=
                                ChunkType::kFileSignature ||
                            chunk_.header.num_records() != 0 ||
-                           chunk_.header.decoded_data_size() != 0)) {
+                           internal::BlockSizeFromSignature(
+                               chunk_.header.decoded_data_size()) == 0)) {
       recoverable_ = Recoverable::kFindChunk;
       recoverable_pos_ = src.pos();
       return Fail(absl::InvalidArgumentError(
           "Invalid Riegeli/records file: missing file signature"));
     }
+    block_size_ =
+        internal::BlockSizeFromSignature(chunk_.header.decoded_data_size());
   }
   return true;
 }
 
-inline bool DefaultChunkReaderBase::ReadBlockHeader() {
+inline bool DefaultChunkReaderBase::ReadBlockHeader(Reader& src) {
   RIEGELI_ASSERT(healthy())
       << "Failed precondition of DefaultChunkReaderBase::ReadBlockHeader(): "
       << status();
-  Reader& src = *src_reader();
-  const size_t remaining_length = internal::RemainingInBlockHeader(src.pos());
+  const size_t remaining_length =
+      internal::RemainingInBlockHeader(src.pos(), block_size_);
   RIEGELI_ASSERT_GT(remaining_length, 0u)
       << "Failed precondition of DefaultChunkReaderBase::ReadBlockHeader(): "
          "not before nor inside a block header";
@@ -311,7 +383,8 @@ inline bool DefaultChunkReaderBase::ReadBlockHeader() {
         ", stored 0x",
         absl::Hex(block_header_.stored_header_hash(),
                   absl::PadSpec::kZeroPad16),
-        "), block at ", internal::RoundDownToBlockBoundary(recoverable_pos_))));
+        "), block at ",
+        internal::RoundDownToBlockBoundary(recoverable_pos_, block_size_))));
   }
   return true;
 }
@@ -342,7 +415,8 @@ again:
         }
         return true;
       }
-      if (ABSL_PREDICT_FALSE(!internal::IsPossibleChunkBoundary(pos_))) {
+      if (ABSL_PREDICT_FALSE(
+              !internal::IsPossibleChunkBoundary(pos_, block_size_))) {
         recoverable_ = Recoverable::kFindChunk;
         recoverable_pos_ = pos_;
         goto again;
@@ -360,7 +434,7 @@ again:
   pos_ = recoverable_pos;
 
 find_chunk:
-  pos_ += internal::RemainingInBlock(pos_);
+  pos_ += internal::RemainingInBlock(pos_, block_size_);
   if (ABSL_PREDICT_FALSE(!src.Seek(pos_))) {
     if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
     if (skipped_region != nullptr) {
@@ -369,14 +443,15 @@ find_chunk:
     }
     return true;
   }
-  if (ABSL_PREDICT_FALSE(!ReadBlockHeader())) {
+  if (ABSL_PREDICT_FALSE(!ReadBlockHeader(src))) {
     if (recoverable_ != Recoverable::kNo) goto again;
     if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
   } else if (block_header_.previous_chunk() == 0) {
     // A chunk boundary coincides with block boundary. Recovery is done.
   } else {
     pos_ += block_header_.next_chunk();
-    if (ABSL_PREDICT_FALSE(!internal::IsPossibleChunkBoundary(pos_))) {
+    if (ABSL_PREDICT_FALSE(
+            !internal::IsPossibleChunkBoundary(pos_, block_size_))) {
       goto find_chunk;
     }
     if (ABSL_PREDICT_FALSE(!src.Seek(pos_))) {
@@ -408,7 +483,8 @@ bool DefaultChunkReaderBase::Seek(Position new_pos) {
   pos_ = new_pos;
   chunk_.Reset();
   if (ABSL_PREDICT_FALSE(!src.Seek(pos_))) return FailSeeking(src, pos_);
-  if (ABSL_PREDICT_FALSE(!internal::IsPossibleChunkBoundary(pos_))) {
+  if (ABSL_PREDICT_FALSE(
+          !internal::IsPossibleChunkBoundary(pos_, block_size_))) {
     recoverable_ = Recoverable::kFindChunk;
     recoverable_pos_ = pos_;
     return Fail(absl::InvalidArgumentError(
@@ -435,13 +511,14 @@ bool DefaultChunkReaderBase::SeekToChunk(Position new_pos) {
   if (pos_ == new_pos) return true;
   Reader& src = *src_reader();
   truncated_ = false;
-  const Position block_begin = internal::RoundDownToBlockBoundary(new_pos);
+  const Position block_begin =
+      internal::RoundDownToBlockBoundary(new_pos, block_size_);
   Position chunk_begin;
   if (pos_ < new_pos) {
     // The current chunk begins before `new_pos`. If it also ends at or after
     // `block_begin`, it is better to start searching from the current position
     // than to seek back to `block_begin`.
-    if (ABSL_PREDICT_FALSE(!PullChunkHeader(nullptr))) {
+    if (ABSL_PREDICT_FALSE(!PullChunkHeaderImpl(src))) {
       if (ABSL_PREDICT_FALSE(!healthy())) return false;
       truncated_ = false;
       return FailSeeking(src, new_pos);
@@ -450,7 +527,8 @@ bool DefaultChunkReaderBase::SeekToChunk(Position new_pos) {
         pos_ + chunk_.header.num_records() > new_pos) {
       return true;
     }
-    const Position chunk_end = internal::ChunkEnd(chunk_.header, pos_);
+    const Position chunk_end =
+        internal::ChunkEnd(chunk_.header, pos_, block_size_);
     if (which_chunk == WhichChunk::kBefore && chunk_end > new_pos) return true;
     if (chunk_end < block_begin) {
       // The current chunk ends too early. Skip to `block_begin`.
@@ -463,7 +541,7 @@ bool DefaultChunkReaderBase::SeekToChunk(Position new_pos) {
     pos_ = block_begin;
     chunk_.Reset();
     if (ABSL_PREDICT_FALSE(!src.Seek(pos_))) return FailSeeking(src, new_pos);
-    if (ABSL_PREDICT_FALSE(!ReadBlockHeader())) {
+    if (ABSL_PREDICT_FALSE(!ReadBlockHeader(src))) {
       if (ABSL_PREDICT_FALSE(!healthy())) return false;
       if (ABSL_PREDICT_TRUE(!truncated_)) {
         // File ends at this block boundary, so a chunk ends here too.
@@ -492,7 +570,8 @@ bool DefaultChunkReaderBase::SeekToChunk(Position new_pos) {
       }
       chunk_begin = block_begin - block_header_.previous_chunk();
     }
-    if (ABSL_PREDICT_FALSE(!internal::IsPossibleChunkBoundary(chunk_begin))) {
+    if (ABSL_PREDICT_FALSE(
+            !internal::IsPossibleChunkBoundary(chunk_begin, block_size_))) {
       recoverable_ = Recoverable::kFindChunk;
       recoverable_pos_ = src.pos();
       return Fail(absl::InvalidArgumentError(absl::StrCat(
@@ -506,7 +585,7 @@ bool DefaultChunkReaderBase::SeekToChunk(Position new_pos) {
     if (ABSL_PREDICT_FALSE(!src.Seek(pos_))) return FailSeeking(src, new_pos);
   check_current_chunk:
     if (pos_ >= new_pos) return true;
-    if (ABSL_PREDICT_FALSE(!ReadChunkHeader())) {
+    if (ABSL_PREDICT_FALSE(!ReadChunkHeader(src))) {
       if (ABSL_PREDICT_FALSE(!healthy())) return false;
       truncated_ = false;
       return FailSeeking(src, new_pos);
@@ -515,7 +594,8 @@ bool DefaultChunkReaderBase::SeekToChunk(Position new_pos) {
         pos_ + chunk_.header.num_records() > new_pos) {
       return true;
     }
-    const Position chunk_end = internal::ChunkEnd(chunk_.header, pos_);
+    const Position chunk_end =
+        internal::ChunkEnd(chunk_.header, pos_, block_size_);
     if (which_chunk == WhichChunk::kBefore && chunk_end > new_pos) return true;
     chunk_begin = chunk_end;
   }
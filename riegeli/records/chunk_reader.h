@@ -49,14 +49,40 @@ class DefaultChunkReaderBase : public Object {
   //  * `false` (when `!healthy()`) - failure
   bool CheckFileFormat();
 
+  // Returns an estimate of memory used for buffering by the source `Reader`.
+  // This is cheap enough to be called periodically.
+  size_t EstimateMemory() const {
+    const Reader* const src = src_reader();
+    return src == nullptr ? 0 : src->EstimateMemory();
+  }
+
   // Reads the next chunk.
   //
+  // If the source `Reader` shares its data, e.g. `ChainReader` or
+  // `FdMMapReader`, then `chunk.data` shares the source memory instead of
+  // copying it. A chunk crossing block boundaries becomes a `Chain` with one
+  // block per fragment between block headers. Only fragments not longer than
+  // `kMaxBytesToCopy` are copied.
+  //
   // Return values:
   //  * `true`                      - success (`chunk` is set)
   //  * `false` (when `healthy()`)  - source ends
   //  * `false` (when `!healthy()`) - failure
   bool ReadChunk(Chunk& chunk);
 
+  // Like `ReadChunk()`, but the hash of chunk data is not verified. The chunk
+  // header is still verified, so chunk boundaries remain trustworthy.
+  //
+  // The caller becomes responsible for verifying chunk data if desired, e.g.
+  // with `ChunkDecoder::Options::set_verify_data_hash()`, possibly only for
+  // some chunks or in another thread.
+  //
+  // Return values:
+  //  * `true`                      - success (`chunk` is set)
+  //  * `false` (when `healthy()`)  - source ends
+  //  * `false` (when `!healthy()`) - failure
+  bool ReadChunkUnverified(Chunk& chunk);
+
   // Reads the next chunk header, from same chunk which will be read by an
   // immediately following `ReadChunk()`.
   //
@@ -97,6 +123,24 @@ class DefaultChunkReaderBase : public Object {
   // `pos()` is unchanged by `Close()`.
   Position pos() const { return pos_; }
 
+  // Returns `true` if the source is truncated (in the middle of a chunk) at the
+  // current position, i.e. the last `ReadChunk()` or `PullChunkHeader()`
+  // returned `false` for an incomplete chunk rather than at a chunk boundary.
+  // In such case, if the source does not grow, `Close()` will fail.
+  //
+  // If the file is still being written, reading can be retried after the
+  // source grows, e.g. after `FileGrowthWaiter::Wait()`, and it continues
+  // from the incomplete chunk.
+  bool truncated() const { return truncated_; }
+
+  // Returns the block size of the file, declared by its file signature chunk,
+  // or `internal::kBlockSize` for a standard file.
+  //
+  // The block size is known after the constructor if the source begins at
+  // position 0 or supports random access, and otherwise after the file
+  // signature chunk is read.
+  Position block_size() const { return block_size_; }
+
   // Returns `true` if this `ChunkReader` supports `Seek()`,
   // `SeekToChunkContaining()`, `SeekToChunkAfter()`, and `Size()`.
   bool SupportsRandomAccess();
@@ -169,15 +213,24 @@ class DefaultChunkReaderBase : public Object {
   // Always returns `false`.
   bool FailSeeking(const Reader& src, Position new_pos);
 
+  // The helpers below take `src` which must be `*src_reader()`, so that the
+  // virtual `src_reader()` is called once per chunk rather than once per
+  // header or block.
+
+  bool ReadChunkImpl(Chunk& chunk, bool verify_data_hash);
+
+  // Implementation of `PullChunkHeader()` after checking `healthy()`.
+  bool PullChunkHeaderImpl(Reader& src);
+
   // Reads or continues reading `chunk_.header`.
-  bool ReadChunkHeader();
+  bool ReadChunkHeader(Reader& src);
 
   // Reads or continues reading `block_header_`.
   //
   // Preconditions:
   //   `healthy()`
-  //   `internal::RemainingInBlockHeader(src_reader()->pos()) > 0`
-  bool ReadBlockHeader();
+  //   `internal::RemainingInBlockHeader(src.pos(), block_size_) > 0`
+  bool ReadBlockHeader(Reader& src);
 
   // Shared implementation of `SeekToChunkContaining()`, `SeekToChunkBefore()`,
   // and `SeekToChunkAfter()`.
@@ -198,6 +251,9 @@ class DefaultChunkReaderBase : public Object {
   // this case `pos_` can be a block boundary instead of a chunk boundary.
   Position pos_ = 0;
 
+  // Block size of the file, see `block_size()`.
+  Position block_size_ = internal::kBlockSize;
+
   // Chunk header and chunk data, filled to the point derived from `pos_` and
   // `src_reader()->pos()`.
   Chunk chunk_;
@@ -317,6 +373,7 @@ inline DefaultChunkReaderBase::DefaultChunkReaderBase(
       // part was moved.
       truncated_(that.truncated_),
       pos_(that.pos_),
+      block_size_(that.block_size_),
       chunk_(std::move(that.chunk_)),
       block_header_(that.block_header_),
       recoverable_(std::exchange(that.recoverable_, Recoverable::kNo)),
@@ -329,6 +386,7 @@ inline DefaultChunkReaderBase& DefaultChunkReaderBase::operator=(
   // was moved.
   truncated_ = that.truncated_;
   pos_ = that.pos_;
+  block_size_ = that.block_size_;
   chunk_ = that.chunk_;
   block_header_ = that.block_header_;
   recoverable_ = std::exchange(that.recoverable_, Recoverable::kNo);
@@ -340,6 +398,7 @@ inline void DefaultChunkReaderBase::Reset(InitiallyClosed) {
   Object::Reset(kInitiallyClosed);
   truncated_ = false;
   pos_ = 0;
+  block_size_ = internal::kBlockSize;
   chunk_.Reset();
   recoverable_ = Recoverable::kNo;
   recoverable_pos_ = 0;
@@ -349,6 +408,7 @@ inline void DefaultChunkReaderBase::Reset(InitiallyOpen) {
   Object::Reset(kInitiallyOpen);
   truncated_ = false;
   pos_ = 0;
+  block_size_ = internal::kBlockSize;
   chunk_.Reset();
   recoverable_ = Recoverable::kNo;
   recoverable_pos_ = 0;
@@ -19,6 +19,7 @@
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "riegeli/base/base.h"
@@ -36,15 +37,16 @@ namespace riegeli {
 
 ChunkWriter::~ChunkWriter() {}
 
-void DefaultChunkWriterBase::Initialize(Writer* dest, Position pos) {
+void DefaultChunkWriterBase::Initialize(Writer* dest, Position pos,
+                                        Position block_size) {
   RIEGELI_ASSERT(dest != nullptr)
       << "Failed precondition of DefaultChunkWriter: null Writer pointer";
-  if (ABSL_PREDICT_FALSE(!internal::IsPossibleChunkBoundary(pos))) {
-    const Position length = internal::RemainingInBlock(pos);
+  if (ABSL_PREDICT_FALSE(!internal::IsPossibleChunkBoundary(pos, block_size))) {
+    const Position length = internal::RemainingInBlock(pos, block_size);
     dest->WriteZeros(length);
     pos += length;
   }
-  ChunkWriter::Initialize(pos);
+  ChunkWriter::Initialize(pos, block_size);
   if (ABSL_PREDICT_FALSE(!dest->healthy())) Fail(*dest);
 }
 
@@ -53,13 +55,25 @@ bool DefaultChunkWriterBase::WriteChunk(const Chunk& chunk) {
       << "Failed precondition of ChunkWriter::WriteChunk(): "
          "Wrong chunk data hash";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (chunk.header.chunk_type() == ChunkType::kFileSignature && pos_ == 0) {
+    // The file signature declares the block size of the file.
+    const Position block_size =
+        internal::BlockSizeFromSignature(chunk.header.decoded_data_size());
+    if (ABSL_PREDICT_FALSE(block_size == 0)) {
+      return Fail(absl::InvalidArgumentError(absl::StrCat(
+          "Invalid file signature chunk: unsupported block size: ",
+          chunk.header.decoded_data_size())));
+    }
+    block_size_ = block_size;
+  }
   // Matches `FutureRecordPosition::FutureChunkBegin::Resolve()`.
   Writer& dest = *dest_writer();
   StringReader<> header_reader(
       absl::string_view(chunk.header.bytes(), chunk.header.size()));
   ChainReader<> data_reader(&chunk.data);
   const Position chunk_begin = pos_;
-  const Position chunk_end = internal::ChunkEnd(chunk.header, chunk_begin);
+  const Position chunk_end =
+      internal::ChunkEnd(chunk.header, chunk_begin, block_size_);
   if (ABSL_PREDICT_FALSE(
           !WriteSection(header_reader, chunk_begin, chunk_end, dest))) {
     return false;
@@ -87,7 +101,7 @@ inline bool DefaultChunkWriterBase::WriteSection(Reader& src,
   }
   RIEGELI_ASSERT_EQ(src.pos(), 0u) << "Non-zero section reader position";
   while (src.pos() < *size) {
-    if (internal::IsBlockBoundary(pos_)) {
+    if (internal::IsBlockBoundary(pos_, block_size_)) {
       internal::BlockHeader block_header(IntCast<uint64_t>(pos_ - chunk_begin),
                                          IntCast<uint64_t>(chunk_end - pos_));
       if (ABSL_PREDICT_FALSE(!dest.Write(
@@ -96,8 +110,8 @@ inline bool DefaultChunkWriterBase::WriteSection(Reader& src,
       }
       pos_ += block_header.size();
     }
-    const Position length =
-        UnsignedMin(*size - src.pos(), internal::RemainingInBlock(pos_));
+    const Position length = UnsignedMin(
+        *size - src.pos(), internal::RemainingInBlock(pos_, block_size_));
     if (ABSL_PREDICT_FALSE(!src.Copy(length, dest))) return Fail(dest);
     pos_ += length;
   }
@@ -112,7 +126,7 @@ inline bool DefaultChunkWriterBase::WritePadding(Position chunk_begin,
                                                  Position chunk_end,
                                                  Writer& dest) {
   while (pos_ < chunk_end) {
-    if (internal::IsBlockBoundary(pos_)) {
+    if (internal::IsBlockBoundary(pos_, block_size_)) {
       internal::BlockHeader block_header(IntCast<uint64_t>(pos_ - chunk_begin),
                                          IntCast<uint64_t>(chunk_end - pos_));
       if (ABSL_PREDICT_FALSE(!dest.Write(
@@ -121,8 +135,8 @@ inline bool DefaultChunkWriterBase::WritePadding(Position chunk_begin,
       }
       pos_ += block_header.size();
     }
-    const Position length =
-        UnsignedMin(chunk_end - pos_, internal::RemainingInBlock(pos_));
+    const Position length = UnsignedMin(
+        chunk_end - pos_, internal::RemainingInBlock(pos_, block_size_));
     if (ABSL_PREDICT_FALSE(!dest.WriteZeros(length))) return Fail(dest);
     pos_ += length;
   }
@@ -132,11 +146,12 @@ inline bool DefaultChunkWriterBase::WritePadding(Position chunk_begin,
 bool DefaultChunkWriterBase::PadToBlockBoundary() {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   // Matches `FutureRecordPosition::FutureChunkBegin::Resolve()`.
-  size_t length = IntCast<size_t>(internal::RemainingInBlock(pos_));
+  size_t length =
+      IntCast<size_t>(internal::RemainingInBlock(pos_, block_size_));
   if (length == 0) return true;
   if (length < ChunkHeader::size()) {
     // Not enough space for a padding chunk in this block. Write one more block.
-    length += size_t{internal::kUsableBlockSize};
+    length += IntCast<size_t>(internal::UsableBlockSize(block_size_));
   }
   length -= ChunkHeader::size();
   Chunk chunk;
@@ -27,6 +27,7 @@
 #include "riegeli/bytes/reader.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/records/block.h"
 
 namespace riegeli {
 
@@ -53,7 +54,7 @@ class ChunkWriter : public Object {
   //  * `false` - failure (`!healthy()`)
   virtual bool WriteChunk(const Chunk& chunk) = 0;
 
-  // Writes padding to reach a 64KB block boundary.
+  // Writes padding to reach a block boundary.
   //
   // Return values:
   //  * `true`  - success (`healthy()`)
@@ -88,13 +89,27 @@ class ChunkWriter : public Object {
   // Returns the current byte position. Unchanged by `Close()`.
   Position pos() const { return pos_; }
 
+  // Returns the block size of the file being written, which is 64KB unless
+  // set otherwise by the `ChunkWriter` options or by the file signature.
+  Position block_size() const { return block_size_; }
+
+  // Returns an estimate of memory used for buffering, excluding
+  // `sizeof(*this)`. This is cheap enough to be called periodically.
+  //
+  // The default implementation returns 0.
+  virtual size_t EstimateMemory() const { return 0; }
+
  protected:
   void Reset(InitiallyClosed);
   void Reset(InitiallyOpen);
-  void Initialize(Position pos) { pos_ = pos; }
+  void Initialize(Position pos, Position block_size = internal::kBlockSize) {
+    pos_ = pos;
+    block_size_ = block_size;
+  }
   virtual bool FlushImpl(FlushType flush_type) = 0;
 
   Position pos_ = 0;
+  Position block_size_ = internal::kBlockSize;
 };
 
 // Template parameter independent part of `DefaultChunkWriter`.
@@ -119,8 +134,32 @@ class DefaultChunkWriterBase : public ChunkWriter {
     }
     absl::optional<Position> assumed_pos() const { return assumed_pos_; }
 
+    // Sets the block size, i.e. the distance between block headers, which
+    // must be a power of 2 between 64KB and 1GB.
+    //
+    // This matters when appending to a file with a block size other than the
+    // default. A file signature chunk written at position 0 overrides this
+    // with the block size it declares, so `RecordWriter` creating a file sets
+    // the block size with `RecordWriterBase::Options::set_block_size()`.
+    //
+    // Default: 64KB.
+    Options& set_block_size(Position block_size) & {
+      RIEGELI_ASSERT(internal::IsValidBlockSize(block_size))
+          << "Failed precondition of "
+             "DefaultChunkWriterBase::Options::set_block_size(): "
+             "block size not a power of 2 between 64KB and 1GB: "
+          << block_size;
+      block_size_ = block_size;
+      return *this;
+    }
+    Options&& set_block_size(Position block_size) && {
+      return std::move(set_block_size(block_size));
+    }
+    Position block_size() const { return block_size_; }
+
    private:
     absl::optional<Position> assumed_pos_;
+    Position block_size_ = internal::kBlockSize;
   };
 
   // Returns the Riegeli/records file being written to. Unchanged by `Close()`.
@@ -129,6 +168,10 @@ class DefaultChunkWriterBase : public ChunkWriter {
 
   bool WriteChunk(const Chunk& chunk) override;
   bool PadToBlockBoundary() override;
+  size_t EstimateMemory() const override {
+    const Writer* const dest = dest_writer();
+    return dest == nullptr ? 0 : dest->EstimateMemory();
+  }
 
  protected:
   explicit DefaultChunkWriterBase(InitiallyClosed)
@@ -139,7 +182,7 @@ class DefaultChunkWriterBase : public ChunkWriter {
   DefaultChunkWriterBase(DefaultChunkWriterBase&& that) noexcept;
   DefaultChunkWriterBase& operator=(DefaultChunkWriterBase&& that) noexcept;
 
-  void Initialize(Writer* dest, Position pos);
+  void Initialize(Writer* dest, Position pos, Position block_size);
 
  private:
   bool WriteSection(Reader& src, Position chunk_begin, Position chunk_end,
@@ -232,24 +275,28 @@ inline ChunkWriter::ChunkWriter(ChunkWriter&& that) noexcept
     : Object(std::move(that)),
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
-      pos_(that.pos_) {}
+      pos_(that.pos_),
+      block_size_(that.block_size_) {}
 
 inline ChunkWriter& ChunkWriter::operator=(ChunkWriter&& that) noexcept {
   Object::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   pos_ = that.pos_;
+  block_size_ = that.block_size_;
   return *this;
 }
 
 inline void ChunkWriter::Reset(InitiallyClosed) {
   Object::Reset(kInitiallyClosed);
   pos_ = 0;
+  block_size_ = internal::kBlockSize;
 }
 
 inline void ChunkWriter::Reset(InitiallyOpen) {
   Object::Reset(kInitiallyOpen);
   pos_ = 0;
+  block_size_ = internal::kBlockSize;
 }
 
 inline bool ChunkWriter::Flush(FlushType flush_type) {
@@ -270,14 +317,16 @@ template <typename Dest>
 inline DefaultChunkWriter<Dest>::DefaultChunkWriter(const Dest& dest,
                                                     Options options)
     : DefaultChunkWriterBase(kInitiallyOpen), dest_(dest) {
-  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()));
+  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()),
+             options.block_size());
 }
 
 template <typename Dest>
 inline DefaultChunkWriter<Dest>::DefaultChunkWriter(Dest&& dest,
                                                     Options options)
     : DefaultChunkWriterBase(kInitiallyOpen), dest_(std::move(dest)) {
-  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()));
+  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()),
+             options.block_size());
 }
 
 template <typename Dest>
@@ -285,7 +334,8 @@ template <typename... DestArgs>
 inline DefaultChunkWriter<Dest>::DefaultChunkWriter(
     std::tuple<DestArgs...> dest_args, Options options)
     : DefaultChunkWriterBase(kInitiallyOpen), dest_(std::move(dest_args)) {
-  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()));
+  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()),
+             options.block_size());
 }
 
 template <typename Dest>
@@ -316,14 +366,16 @@ template <typename Dest>
 inline void DefaultChunkWriter<Dest>::Reset(const Dest& dest, Options options) {
   DefaultChunkWriterBase::Reset(kInitiallyOpen);
   dest_.Reset(dest);
-  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()));
+  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()),
+             options.block_size());
 }
 
 template <typename Dest>
 inline void DefaultChunkWriter<Dest>::Reset(Dest&& dest, Options options) {
   DefaultChunkWriterBase::Reset(kInitiallyOpen);
   dest_.Reset(std::move(dest));
-  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()));
+  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()),
+             options.block_size());
 }
 
 template <typename Dest>
@@ -332,7 +384,8 @@ inline void DefaultChunkWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
                                             Options options) {
   DefaultChunkWriterBase::Reset(kInitiallyOpen);
   dest_.Reset(std::move(dest_args));
-  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()));
+  Initialize(dest_.get(), options.assumed_pos().value_or(dest_->pos()),
+             options.block_size());
 }
 
 template <typename Dest>
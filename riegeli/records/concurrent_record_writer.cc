@@ -0,0 +1,222 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/concurrent_record_writer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/messages/message_serialize.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+// An open chunk, shared by producer threads whose thread ids hash to it.
+struct ConcurrentRecordWriterBase::Shard {
+  absl::Mutex mutex;
+  std::unique_ptr<ChunkEncoder> chunk_encoder ABSL_GUARDED_BY(mutex);
+  // Sum of sizes of records in `chunk_encoder`, measured as by `RecordWriter`.
+  uint64_t chunk_size_so_far ABSL_GUARDED_BY(mutex) = 0;
+  // Chunks finalized from this shard are numbered consecutively, and written
+  // in that order, so that records of one thread keep their order even if
+  // chunks are encoded concurrently.
+  //
+  // `next_ticket` is the number of chunks finalized, and `written_ticket` is
+  // the number of chunks written (or abandoned after a failure).
+  uint64_t next_ticket ABSL_GUARDED_BY(mutex) = 0;
+  uint64_t written_ticket ABSL_GUARDED_BY(mutex) = 0;
+};
+
+ConcurrentRecordWriterBase::ConcurrentRecordWriterBase(const Options& options)
+    : Object(kInitiallyOpen),
+      record_writer_options_(options.record_writer_options()),
+      // Ensure that `num_records` does not overflow, as in `RecordWriter`.
+      desired_chunk_size_(
+          UnsignedMin(record_writer_options_.effective_chunk_size(),
+                      kMaxNumRecords * sizeof(uint64_t))) {
+  shards_.reserve(IntCast<size_t>(options.num_shards()));
+  for (int i = 0; i < options.num_shards(); ++i) {
+    std::unique_ptr<Shard> shard = std::make_unique<Shard>();
+    shard->chunk_encoder = MakeChunkEncoder();
+    shards_.push_back(std::move(shard));
+  }
+}
+
+ConcurrentRecordWriterBase::~ConcurrentRecordWriterBase() {}
+
+void ConcurrentRecordWriterBase::Initialize(RecordWriterBase* dest) {
+  absl::MutexLock lock(&dest_mutex_);
+  dest_ = RIEGELI_ASSERT_NOTNULL(dest);
+  if (ABSL_PREDICT_FALSE(!dest_->healthy())) Fail(*dest_);
+}
+
+void ConcurrentRecordWriterBase::Done() {
+  for (const std::unique_ptr<Shard>& shard : shards_) WriteOpenChunk(*shard);
+}
+
+inline std::unique_ptr<ChunkEncoder>
+ConcurrentRecordWriterBase::MakeChunkEncoder() const {
+  return internal::MakeRecordsChunkEncoder(
+      record_writer_options_, record_writer_options_.compressor_options(),
+      record_writer_options_.effective_chunk_size());
+}
+
+inline ConcurrentRecordWriterBase::Shard&
+ConcurrentRecordWriterBase::ShardForThisThread() {
+  return *shards_[std::hash<std::thread::id>()(std::this_thread::get_id()) %
+                  shards_.size()];
+}
+
+bool ConcurrentRecordWriterBase::WriteRecord(
+    const google::protobuf::MessageLite& record) {
+  Chain serialized;
+  {
+    absl::Status status = SerializeToChain(record, serialized);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return Fail(std::move(status));
+  }
+  const uint64_t size = serialized.size();
+  return WriteRecordImpl(std::move(serialized), size);
+}
+
+bool ConcurrentRecordWriterBase::WriteRecord(absl::string_view record) {
+  return WriteRecordImpl(record, record.size());
+}
+
+bool ConcurrentRecordWriterBase::WriteRecord(const Chain& record) {
+  return WriteRecordImpl(record, record.size());
+}
+
+template <typename Record>
+inline bool ConcurrentRecordWriterBase::WriteRecordImpl(Record&& record,
+                                                        uint64_t size) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  const uint64_t added_size = SaturatingAdd(size, uint64_t{sizeof(uint64_t)});
+  Shard& shard = ShardForThisThread();
+  std::unique_ptr<ChunkEncoder> full_chunk_encoder;
+  uint64_t ticket = 0;
+  {
+    absl::MutexLock lock(&shard.mutex);
+    if (ABSL_PREDICT_FALSE(shard.chunk_size_so_far > desired_chunk_size_ ||
+                           added_size >
+                               desired_chunk_size_ - shard.chunk_size_so_far) &&
+        shard.chunk_size_so_far > 0) {
+      // Take the full chunk out of the shard, and encode it without holding
+      // the lock, so that other threads can add records to the next chunk.
+      full_chunk_encoder =
+          std::exchange(shard.chunk_encoder, MakeChunkEncoder());
+      shard.chunk_size_so_far = 0;
+      ticket = shard.next_ticket++;
+    }
+    shard.chunk_size_so_far += added_size;
+    if (ABSL_PREDICT_FALSE(
+            !shard.chunk_encoder->AddRecord(std::forward<Record>(record)))) {
+      Fail(*shard.chunk_encoder);
+    }
+  }
+  if (full_chunk_encoder != nullptr) {
+    WriteChunk(shard, ticket, *full_chunk_encoder);
+  }
+  return healthy();
+}
+
+bool ConcurrentRecordWriterBase::Flush(FlushType flush_type) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  for (const std::unique_ptr<Shard>& shard : shards_) {
+    if (ABSL_PREDICT_FALSE(!WriteOpenChunk(*shard))) return false;
+  }
+  absl::MutexLock lock(&dest_mutex_);
+  if (ABSL_PREDICT_FALSE(!dest_->Flush(flush_type))) return Fail(*dest_);
+  return healthy();
+}
+
+bool ConcurrentRecordWriterBase::WriteOpenChunk(Shard& shard) {
+  std::unique_ptr<ChunkEncoder> chunk_encoder;
+  uint64_t ticket;
+  {
+    absl::MutexLock lock(&shard.mutex);
+    if (shard.chunk_size_so_far > 0) {
+      chunk_encoder = std::exchange(shard.chunk_encoder, MakeChunkEncoder());
+      shard.chunk_size_so_far = 0;
+      ticket = shard.next_ticket++;
+    } else {
+      ticket = shard.next_ticket;
+    }
+  }
+  if (chunk_encoder != nullptr) {
+    return WriteChunk(shard, ticket, *chunk_encoder);
+  }
+  AwaitTurn(shard, ticket);
+  return healthy();
+}
+
+bool ConcurrentRecordWriterBase::WriteChunk(Shard& shard, uint64_t ticket,
+                                            ChunkEncoder& chunk_encoder) {
+  bool ok = healthy();
+  Chunk chunk;
+  if (ABSL_PREDICT_TRUE(ok)) {
+    ChunkType chunk_type;
+    uint64_t num_records;
+    uint64_t decoded_data_size;
+    ChainWriter<> data_writer(&chunk.data);
+    if (ABSL_PREDICT_FALSE(!chunk_encoder.EncodeAndClose(
+            data_writer, chunk_type, num_records, decoded_data_size))) {
+      ok = Fail(chunk_encoder);
+    } else if (ABSL_PREDICT_FALSE(!data_writer.Close())) {
+      ok = Fail(data_writer);
+    } else {
+      chunk.header =
+          ChunkHeader(chunk.data, chunk_type, num_records, decoded_data_size);
+    }
+  }
+  AwaitTurn(shard, ticket);
+  if (ABSL_PREDICT_TRUE(ok)) {
+    absl::MutexLock lock(&dest_mutex_);
+    if (ABSL_PREDICT_FALSE(!dest_->WriteChunk(chunk))) ok = Fail(*dest_);
+  }
+  // Let the next chunk of this shard be written even after a failure, so that
+  // threads waiting for it do not block forever.
+  absl::MutexLock lock(&shard.mutex);
+  ++shard.written_ticket;
+  return ok;
+}
+
+void ConcurrentRecordWriterBase::AwaitTurn(Shard& shard, uint64_t ticket) {
+  const std::pair<Shard*, uint64_t> turn(&shard, ticket);
+  absl::MutexLock lock(&shard.mutex);
+  shard.mutex.Await(absl::Condition(
+      +[](const std::pair<Shard*, uint64_t>* turn) {
+        return turn->first->written_ticket == turn->second;
+      },
+      &turn));
+}
+
+}  // namespace riegeli
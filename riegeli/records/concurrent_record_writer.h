@@ -0,0 +1,276 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_CONCURRENT_RECORD_WRITER_H_
+#define RIEGELI_RECORDS_CONCURRENT_RECORD_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/writer.h"
+#include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+// Template parameter independent part of `ConcurrentRecordWriter`.
+class ConcurrentRecordWriterBase : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Sets the number of chunks open concurrently. A producer thread appends
+    // records to the chunk chosen by a hash of its thread id, so threads
+    // contend only if they share a chunk.
+    //
+    // This should be at least the number of producer threads, preferably a few
+    // times more to make collisions rare. Each open chunk costs memory of up
+    // to `RecordWriterBase::Options::chunk_size()`.
+    //
+    // Default: 16.
+    Options& set_num_shards(int num_shards) & {
+      RIEGELI_ASSERT_GT(num_shards, 0)
+          << "Failed precondition of "
+             "ConcurrentRecordWriterBase::Options::set_num_shards(): "
+             "number of shards not positive";
+      num_shards_ = num_shards;
+      return *this;
+    }
+    Options&& set_num_shards(int num_shards) && {
+      return std::move(set_num_shards(num_shards));
+    }
+    int num_shards() const { return num_shards_; }
+
+    // Sets options of the `RecordWriter` which writes encoded chunks, and of
+    // encoding chunks.
+    //
+    // `RecordWriterBase::Options::keyframe_interval()` is ignored, and
+    // `RecordWriterBase::Options::index_key()` and `index_time()` are not
+    // supported, because chunks are encoded outside of the `RecordWriter`.
+    //
+    // Default: `RecordWriterBase::Options()`.
+    Options& set_record_writer_options(
+        const RecordWriterBase::Options& record_writer_options) & {
+      record_writer_options_ = record_writer_options;
+      return *this;
+    }
+    Options& set_record_writer_options(
+        RecordWriterBase::Options&& record_writer_options) & {
+      record_writer_options_ = std::move(record_writer_options);
+      return *this;
+    }
+    Options&& set_record_writer_options(
+        const RecordWriterBase::Options& record_writer_options) && {
+      return std::move(set_record_writer_options(record_writer_options));
+    }
+    Options&& set_record_writer_options(
+        RecordWriterBase::Options&& record_writer_options) && {
+      return std::move(
+          set_record_writer_options(std::move(record_writer_options)));
+    }
+    RecordWriterBase::Options& record_writer_options() {
+      return record_writer_options_;
+    }
+    const RecordWriterBase::Options& record_writer_options() const {
+      return record_writer_options_;
+    }
+
+   private:
+    int num_shards_ = 16;
+    RecordWriterBase::Options record_writer_options_;
+  };
+
+  ConcurrentRecordWriterBase(const ConcurrentRecordWriterBase&) = delete;
+  ConcurrentRecordWriterBase& operator=(const ConcurrentRecordWriterBase&) =
+      delete;
+
+  // Writes the next record.
+  //
+  // This may be called concurrently from several threads. Records written by
+  // one thread keep their order; the order of records written by different
+  // threads is not specified.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool WriteRecord(const google::protobuf::MessageLite& record);
+  bool WriteRecord(absl::string_view record);
+  bool WriteRecord(const Chain& record);
+
+  // Finalizes open chunks, writes them, and flushes the `RecordWriter` as
+  // `RecordWriterBase::Flush()`. Records whose `WriteRecord()` returned before
+  // `Flush()` was called are included.
+  //
+  // This may be called concurrently with `WriteRecord()`.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool Flush(FlushType flush_type = FlushType::kFromProcess);
+
+ protected:
+  explicit ConcurrentRecordWriterBase(const Options& options);
+
+  ~ConcurrentRecordWriterBase();
+
+  void Initialize(RecordWriterBase* dest);
+
+  // Writes open chunks. A derived class should close the `RecordWriter`
+  // afterwards.
+  void Done() override;
+
+ private:
+  struct Shard;
+
+  template <typename Record>
+  bool WriteRecordImpl(Record&& record, uint64_t size);
+  std::unique_ptr<ChunkEncoder> MakeChunkEncoder() const;
+  Shard& ShardForThisThread();
+  // Finalizes the chunk open in `shard` if it is not empty, and writes it.
+  // Then waits until chunks of `shard` finalized earlier are written.
+  bool WriteOpenChunk(Shard& shard);
+  // Encodes `chunk_encoder` and writes it to `*dest_` in the order of `ticket`
+  // among chunks of `shard`.
+  bool WriteChunk(Shard& shard, uint64_t ticket, ChunkEncoder& chunk_encoder);
+  // Waits until chunks of `shard` with tickets before `ticket` are written.
+  static void AwaitTurn(Shard& shard, uint64_t ticket);
+
+  RecordWriterBase::Options record_writer_options_;
+  uint64_t desired_chunk_size_ = 0;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  absl::Mutex dest_mutex_;
+  RecordWriterBase* dest_ ABSL_GUARDED_BY(dest_mutex_) = nullptr;
+};
+
+// `ConcurrentRecordWriter` writes records to a Riegeli/records file, like
+// `RecordWriter`, but `WriteRecord()` may be called concurrently from many
+// threads.
+//
+// Each producer thread appends records to one of several open chunks, each
+// with its own `ChunkEncoder`, and encodes a chunk when it becomes full,
+// without holding locks shared with other chunks. Encoded chunks are then
+// passed to a `RecordWriter` in turn. This lets write throughput scale with
+// producer threads instead of serializing them on a single `RecordWriter`.
+//
+// The `Dest` template parameter specifies the type of the object providing and
+// possibly owning the byte `Writer` or `ChunkWriter`, as for `RecordWriter`.
+//
+// By relying on CTAD the template argument can be deduced as the value type of
+// the first constructor argument. This requires C++17.
+//
+// The byte `Writer` or `ChunkWriter` must not be accessed until the
+// `ConcurrentRecordWriter` is closed or no longer used.
+template <typename Dest = Writer*>
+class ConcurrentRecordWriter : public ConcurrentRecordWriterBase {
+ public:
+  // Will write to the byte `Writer` or `ChunkWriter` provided by `dest`.
+  explicit ConcurrentRecordWriter(const Dest& dest,
+                                  Options options = Options());
+  explicit ConcurrentRecordWriter(Dest&& dest, Options options = Options());
+
+  // Will write to the byte `Writer` or `ChunkWriter` provided by a `Dest`
+  // constructed from elements of `dest_args`. This avoids constructing a
+  // temporary `Dest` and moving from it.
+  template <typename... DestArgs>
+  explicit ConcurrentRecordWriter(std::tuple<DestArgs...> dest_args,
+                                  Options options = Options());
+
+  ~ConcurrentRecordWriter();
+
+  // Returns the object providing and possibly owning the byte `Writer` or
+  // `ChunkWriter`. Unchanged by `Close()`.
+  Dest& dest() { return record_writer_.dest(); }
+  const Dest& dest() const { return record_writer_.dest(); }
+
+ protected:
+  void Done() override;
+
+ private:
+  RecordWriter<Dest> record_writer_;
+};
+
+// Support CTAD.
+#if __cpp_deduction_guides
+template <typename Dest>
+explicit ConcurrentRecordWriter(const Dest& dest,
+                                ConcurrentRecordWriterBase::Options options =
+                                    ConcurrentRecordWriterBase::Options())
+    -> ConcurrentRecordWriter<std::decay_t<Dest>>;
+template <typename Dest>
+explicit ConcurrentRecordWriter(Dest&& dest,
+                                ConcurrentRecordWriterBase::Options options =
+                                    ConcurrentRecordWriterBase::Options())
+    -> ConcurrentRecordWriter<std::decay_t<Dest>>;
+template <typename... DestArgs>
+explicit ConcurrentRecordWriter(std::tuple<DestArgs...> dest_args,
+                                ConcurrentRecordWriterBase::Options options =
+                                    ConcurrentRecordWriterBase::Options())
+    -> ConcurrentRecordWriter<DeleteCtad<std::tuple<DestArgs...>>>;
+#endif
+
+// Implementation details follow.
+
+template <typename Dest>
+inline ConcurrentRecordWriter<Dest>::ConcurrentRecordWriter(const Dest& dest,
+                                                            Options options)
+    : ConcurrentRecordWriterBase(options),
+      record_writer_(dest, std::move(options.record_writer_options())) {
+  Initialize(&record_writer_);
+}
+
+template <typename Dest>
+inline ConcurrentRecordWriter<Dest>::ConcurrentRecordWriter(Dest&& dest,
+                                                            Options options)
+    : ConcurrentRecordWriterBase(options),
+      record_writer_(std::move(dest),
+                     std::move(options.record_writer_options())) {
+  Initialize(&record_writer_);
+}
+
+template <typename Dest>
+template <typename... DestArgs>
+inline ConcurrentRecordWriter<Dest>::ConcurrentRecordWriter(
+    std::tuple<DestArgs...> dest_args, Options options)
+    : ConcurrentRecordWriterBase(options),
+      record_writer_(std::move(dest_args),
+                     std::move(options.record_writer_options())) {
+  Initialize(&record_writer_);
+}
+
+template <typename Dest>
+ConcurrentRecordWriter<Dest>::~ConcurrentRecordWriter() {}
+
+template <typename Dest>
+void ConcurrentRecordWriter<Dest>::Done() {
+  ConcurrentRecordWriterBase::Done();
+  if (ABSL_PREDICT_FALSE(!record_writer_.Close())) Fail(record_writer_);
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_CONCURRENT_RECORD_WRITER_H_
@@ -0,0 +1,247 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/multi_file_record_reader.h"
+
+#include <fcntl.h>
+#include <glob.h>
+#include <stddef.h>
+
+#include <future>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/cord.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/records/record_position.h"
+#include "riegeli/records/record_reader.h"
+
+namespace riegeli {
+
+namespace {
+
+// Appends names of files matching `pattern` to `filenames`.
+absl::Status ExpandPattern(const std::string& pattern,
+                           std::vector<std::string>& filenames) {
+  if (pattern.find_first_of("*?[") == std::string::npos) {
+    filenames.push_back(pattern);
+    return absl::OkStatus();
+  }
+  glob_t matches;
+  const int result = glob(pattern.c_str(), 0, nullptr, &matches);
+  absl::Status status;
+  switch (result) {
+    case 0:
+      for (size_t i = 0; i < matches.gl_pathc; ++i) {
+        filenames.emplace_back(matches.gl_pathv[i]);
+      }
+      break;
+    case GLOB_NOMATCH:
+      status = absl::NotFoundError(absl::StrCat("No files match ", pattern));
+      break;
+    case GLOB_NOSPACE:
+      status = absl::ResourceExhaustedError(
+          absl::StrCat("glob() ran out of memory expanding ", pattern));
+      break;
+    default:
+      status =
+          absl::UnknownError(absl::StrCat("glob() failed expanding ", pattern));
+      break;
+  }
+  globfree(&matches);
+  return status;
+}
+
+}  // namespace
+
+std::string MultiFileRecordPosition::ToString() const {
+  return absl::StrCat(file_index_, ":", record_position_.ToString());
+}
+
+std::ostream& operator<<(std::ostream& out, MultiFileRecordPosition pos) {
+  return out << pos.ToString();
+}
+
+MultiFileRecordReader::MultiFileRecordReader(
+    const std::vector<std::string>& patterns, Options options)
+    : Object(kInitiallyOpen),
+      record_reader_options_(std::move(options.record_reader_options())),
+      open_ahead_(options.open_ahead()) {
+  for (const std::string& pattern : patterns) {
+    absl::Status status = ExpandPattern(pattern, filenames_);
+    if (ABSL_PREDICT_FALSE(!status.ok())) {
+      Fail(std::move(status));
+      return;
+    }
+  }
+  while (opening_ahead_.size() < open_ahead_ &&
+         opening_ahead_.size() < filenames_.size()) {
+    StartOpeningAhead(opening_ahead_.size());
+  }
+}
+
+MultiFileRecordReader::~MultiFileRecordReader() { CancelOpeningAhead(); }
+
+void MultiFileRecordReader::Done() {
+  if (current_ != nullptr) {
+    if (ABSL_PREDICT_FALSE(!current_->Close())) Fail(*current_);
+    current_.reset();
+  }
+  CancelOpeningAhead();
+}
+
+std::unique_ptr<MultiFileRecordReader::FileReader>
+MultiFileRecordReader::OpenFileNow(
+    const std::string& filename,
+    const RecordReaderBase::Options& record_reader_options) {
+  std::unique_ptr<FileReader> file_reader = absl::make_unique<FileReader>(
+      std::forward_as_tuple(filename, O_RDONLY), record_reader_options);
+  // Read the first buffer. A failure is reported when the file is read.
+  file_reader->CheckFileFormat();
+  return file_reader;
+}
+
+void MultiFileRecordReader::StartOpeningAhead(size_t file_index) {
+  if (opening_ahead_.empty()) ahead_index_ = file_index;
+  RIEGELI_ASSERT_EQ(ahead_index_ + opening_ahead_.size(), file_index)
+      << "Failed precondition of MultiFileRecordReader::StartOpeningAhead(): "
+         "files opened ahead not consecutive";
+  // `std::function` requires a copyable task, hence `std::shared_ptr`.
+  const std::shared_ptr<std::promise<std::unique_ptr<FileReader>>> promise =
+      std::make_shared<std::promise<std::unique_ptr<FileReader>>>();
+  opening_ahead_.push_back(promise->get_future());
+  internal::ThreadPool::global().Schedule(
+      [promise, filename = filenames_[file_index],
+       record_reader_options = record_reader_options_] {
+        promise->set_value(OpenFileNow(filename, record_reader_options));
+      });
+}
+
+void MultiFileRecordReader::AbandonCurrentFile() {
+  if (current_ == nullptr) return;
+  current_->Close();
+  current_.reset();
+}
+
+void MultiFileRecordReader::CancelOpeningAhead() {
+  for (std::future<std::unique_ptr<FileReader>>& opening : opening_ahead_) {
+    opening.get()->Close();
+  }
+  opening_ahead_.clear();
+}
+
+bool MultiFileRecordReader::OpenFile() {
+  RIEGELI_ASSERT(current_ == nullptr)
+      << "Failed precondition of MultiFileRecordReader::OpenFile(): "
+         "file already open";
+  RIEGELI_ASSERT_LT(file_index_, filenames_.size())
+      << "Failed precondition of MultiFileRecordReader::OpenFile(): "
+         "no more files";
+  // Files opened ahead before `file_index_` were skipped by `Seek()`.
+  while (!opening_ahead_.empty() && ahead_index_ < file_index_) {
+    opening_ahead_.front().get()->Close();
+    opening_ahead_.pop_front();
+    ++ahead_index_;
+  }
+  if (!opening_ahead_.empty() && ahead_index_ == file_index_) {
+    current_ = opening_ahead_.front().get();
+    opening_ahead_.pop_front();
+    ++ahead_index_;
+  } else {
+    CancelOpeningAhead();
+    current_ = OpenFileNow(filenames_[file_index_], record_reader_options_);
+  }
+  while (opening_ahead_.size() < open_ahead_ &&
+         file_index_ + 1 + opening_ahead_.size() < filenames_.size()) {
+    StartOpeningAhead(file_index_ + 1 + opening_ahead_.size());
+  }
+  if (ABSL_PREDICT_FALSE(!current_->healthy())) return Fail(*current_);
+  return true;
+}
+
+template <typename Record>
+inline bool MultiFileRecordReader::ReadRecordImpl(Record& record) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  for (;;) {
+    if (current_ == nullptr) {
+      if (file_index_ == filenames_.size()) return false;
+      if (ABSL_PREDICT_FALSE(!OpenFile())) return false;
+    }
+    if (current_->ReadRecord(record)) return true;
+    if (ABSL_PREDICT_FALSE(!current_->healthy())) return Fail(*current_);
+    if (ABSL_PREDICT_FALSE(!current_->Close())) return Fail(*current_);
+    current_.reset();
+    ++file_index_;
+  }
+}
+
+bool MultiFileRecordReader::ReadRecord(google::protobuf::MessageLite& record) {
+  return ReadRecordImpl(record);
+}
+
+bool MultiFileRecordReader::ReadRecord(absl::string_view& record) {
+  return ReadRecordImpl(record);
+}
+
+bool MultiFileRecordReader::ReadRecord(std::string& record) {
+  return ReadRecordImpl(record);
+}
+
+bool MultiFileRecordReader::ReadRecord(Chain& record) {
+  return ReadRecordImpl(record);
+}
+
+bool MultiFileRecordReader::ReadRecord(absl::Cord& record) {
+  return ReadRecordImpl(record);
+}
+
+MultiFileRecordPosition MultiFileRecordReader::pos() const {
+  if (current_ == nullptr) return MultiFileRecordPosition(file_index_, {});
+  return MultiFileRecordPosition(file_index_, current_->pos());
+}
+
+bool MultiFileRecordReader::Seek(MultiFileRecordPosition new_pos) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (new_pos.file_index() >= filenames_.size()) {
+    AbandonCurrentFile();
+    CancelOpeningAhead();
+    file_index_ = filenames_.size();
+    return true;
+  }
+  if (current_ == nullptr || file_index_ != new_pos.file_index()) {
+    AbandonCurrentFile();
+    file_index_ = new_pos.file_index();
+    if (ABSL_PREDICT_FALSE(!OpenFile())) return false;
+  }
+  if (ABSL_PREDICT_FALSE(!current_->Seek(new_pos.record_position()))) {
+    return Fail(*current_);
+  }
+  return true;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,253 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_MULTI_FILE_RECORD_READER_H_
+#define RIEGELI_RECORDS_MULTI_FILE_RECORD_READER_H_
+
+#include <stddef.h>
+
+#include <deque>
+#include <future>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/cord.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/records/record_position.h"
+#include "riegeli/records/record_reader.h"
+
+namespace riegeli {
+
+// `MultiFileRecordPosition` represents the position of a record in a sequence
+// of Riegeli/records files read by `MultiFileRecordReader`: the index of the
+// file in `MultiFileRecordReader::filenames()`, and the `RecordPosition` in
+// that file.
+class MultiFileRecordPosition {
+ public:
+  // Creates a `MultiFileRecordPosition` corresponding to the first record of
+  // the first file.
+  constexpr MultiFileRecordPosition() noexcept {}
+
+  // Creates a `MultiFileRecordPosition` corresponding to the given record
+  // position in the file with the given index.
+  explicit MultiFileRecordPosition(size_t file_index,
+                                   RecordPosition record_position)
+      : file_index_(file_index), record_position_(record_position) {}
+
+  MultiFileRecordPosition(const MultiFileRecordPosition& that) noexcept =
+      default;
+  MultiFileRecordPosition& operator=(
+      const MultiFileRecordPosition& that) noexcept = default;
+
+  // Index of the file in `MultiFileRecordReader::filenames()`.
+  size_t file_index() const { return file_index_; }
+  // Position in the file.
+  RecordPosition record_position() const { return record_position_; }
+
+  // Text format: "<file_index>:<chunk_begin>/<record_index>".
+  std::string ToString() const;
+
+  friend bool operator==(MultiFileRecordPosition a, MultiFileRecordPosition b) {
+    return a.file_index_ == b.file_index_ &&
+           a.record_position_ == b.record_position_;
+  }
+  friend bool operator!=(MultiFileRecordPosition a, MultiFileRecordPosition b) {
+    return !(a == b);
+  }
+  friend bool operator<(MultiFileRecordPosition a, MultiFileRecordPosition b) {
+    if (a.file_index_ != b.file_index_) return a.file_index_ < b.file_index_;
+    return a.record_position_ < b.record_position_;
+  }
+  friend bool operator>(MultiFileRecordPosition a, MultiFileRecordPosition b) {
+    return b < a;
+  }
+  friend bool operator<=(MultiFileRecordPosition a, MultiFileRecordPosition b) {
+    return !(b < a);
+  }
+  friend bool operator>=(MultiFileRecordPosition a, MultiFileRecordPosition b) {
+    return !(a < b);
+  }
+
+  // Same as: `out << pos.ToString()`
+  friend std::ostream& operator<<(std::ostream& out,
+                                  MultiFileRecordPosition pos);
+
+ private:
+  size_t file_index_ = 0;
+  RecordPosition record_position_;
+};
+
+// `MultiFileRecordReader` reads records of a sequence of Riegeli/records files
+// as if they were concatenated, e.g. shards of a dataset. This is like a
+// `RecordReader` reading from a `JoiningReader`, but each file is read by its
+// own `RecordReader`, so that files stay independently valid and positions
+// refer to records of a particular file.
+//
+// Files are given by names or glob patterns, expanded with `glob()` in sorted
+// order. The next `open_ahead()` files are opened concurrently in background,
+// and their first buffers are read, so that reading does not stall at file
+// boundaries, e.g. on remote storage.
+//
+// Chunks of each file can be decoded in parallel with
+// `RecordReaderBase::Options::set_parallelism()` in `record_reader_options()`.
+class MultiFileRecordReader : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Sets options of the `RecordReader` of each file.
+    //
+    // Default: `RecordReaderBase::Options()`.
+    Options& set_record_reader_options(
+        const RecordReaderBase::Options& record_reader_options) & {
+      record_reader_options_ = record_reader_options;
+      return *this;
+    }
+    Options& set_record_reader_options(
+        RecordReaderBase::Options&& record_reader_options) & {
+      record_reader_options_ = std::move(record_reader_options);
+      return *this;
+    }
+    Options&& set_record_reader_options(
+        const RecordReaderBase::Options& record_reader_options) && {
+      return std::move(set_record_reader_options(record_reader_options));
+    }
+    Options&& set_record_reader_options(
+        RecordReaderBase::Options&& record_reader_options) && {
+      return std::move(
+          set_record_reader_options(std::move(record_reader_options)));
+    }
+    RecordReaderBase::Options& record_reader_options() {
+      return record_reader_options_;
+    }
+    const RecordReaderBase::Options& record_reader_options() const {
+      return record_reader_options_;
+    }
+
+    // Sets the number of files following the current file which are opened
+    // in background. 0 disables opening ahead.
+    //
+    // Default: 2.
+    Options& set_open_ahead(size_t open_ahead) & {
+      open_ahead_ = open_ahead;
+      return *this;
+    }
+    Options&& set_open_ahead(size_t open_ahead) && {
+      return std::move(set_open_ahead(open_ahead));
+    }
+    size_t open_ahead() const { return open_ahead_; }
+
+   private:
+    RecordReaderBase::Options record_reader_options_;
+    size_t open_ahead_ = 2;
+  };
+
+  // Will read files named by `patterns`, in order. A pattern containing any of
+  // "*?[" is expanded to names of matching files in sorted order, and it fails
+  // if no files match.
+  explicit MultiFileRecordReader(const std::vector<std::string>& patterns,
+                                 Options options = Options());
+
+  MultiFileRecordReader(const MultiFileRecordReader&) = delete;
+  MultiFileRecordReader& operator=(const MultiFileRecordReader&) = delete;
+
+  // Waits for files being opened in background.
+  ~MultiFileRecordReader();
+
+  // Returns names of files being read, after expanding patterns.
+  const std::vector<std::string>& filenames() const { return filenames_; }
+
+  // Reads the next record, moving to the next file when a file ends.
+  //
+  // `ReadRecord(google::protobuf::MessageLite&)` parses raw bytes to a proto
+  // message after reading. The remaining overloads read raw bytes. For
+  // `ReadRecord(absl::string_view&)` the `absl::string_view` is valid until the
+  // next non-const operation on this `MultiFileRecordReader`.
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - all files end
+  //  * `false` (when `!healthy()`) - failure
+  bool ReadRecord(google::protobuf::MessageLite& record);
+  bool ReadRecord(absl::string_view& record);
+  bool ReadRecord(std::string& record);
+  bool ReadRecord(Chain& record);
+  bool ReadRecord(absl::Cord& record);
+
+  // Returns the current position.
+  //
+  // After a file ends, this is the beginning of the next file, and after all
+  // files end, this has `file_index() == filenames().size()`.
+  MultiFileRecordPosition pos() const;
+
+  // Seeks to a position, opening its file if it is not the current file.
+  //
+  // A position with `file_index() >= filenames().size()` seeks to the end.
+  //
+  // Return values:
+  //  * `true`  - success (position is set to `new_pos`, or to the end of its
+  //              file if `new_pos` is after the end of its file)
+  //  * `false` - failure (`!healthy()`)
+  bool Seek(MultiFileRecordPosition new_pos);
+
+ protected:
+  void Done() override;
+
+ private:
+  using FileReader = RecordReader<FdReader<>>;
+
+  static std::unique_ptr<FileReader> OpenFileNow(
+      const std::string& filename,
+      const RecordReaderBase::Options& record_reader_options);
+  void StartOpeningAhead(size_t file_index);
+  // Closes the current file, ignoring failures.
+  void AbandonCurrentFile();
+  // Waits for opening ahead, abandoning the files.
+  void CancelOpeningAhead();
+  // Makes the file with index `file_index_` current, taking it from files
+  // opened ahead if possible, and starts opening following files.
+  //
+  // Return values:
+  //  * `true`  - success (`current_ != nullptr`)
+  //  * `false` - failure (`!healthy()`)
+  bool OpenFile();
+
+  template <typename Record>
+  bool ReadRecordImpl(Record& record);
+
+  std::vector<std::string> filenames_;
+  RecordReaderBase::Options record_reader_options_;
+  size_t open_ahead_ = 0;
+  // Index of the current file, or of the file to be opened next if
+  // `current_ == nullptr`.
+  size_t file_index_ = 0;
+  std::unique_ptr<FileReader> current_;
+  // Files being opened in background, with consecutive indices beginning with
+  // `ahead_index_`.
+  std::deque<std::future<std::unique_ptr<FileReader>>> opening_ahead_;
+  size_t ahead_index_ = 0;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_MULTI_FILE_RECORD_READER_H_
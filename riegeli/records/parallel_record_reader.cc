@@ -0,0 +1,299 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/parallel_record_reader.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+
+#include <cerrno>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/cord.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/errno_mapping.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/base/status.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/record_reader.h"
+#include "riegeli/records/records_metadata.pb.h"
+#include "riegeli/zstd/zstd_reader.h"
+
+namespace riegeli {
+
+struct ParallelRecordReader::File {
+  std::string filename;
+  OwnedFd fd;
+  ChunkDecoder::Options chunk_decoder_options;
+};
+
+struct ParallelRecordReader::Range {
+  size_t file_index;
+  Position begin;
+  Position end;
+};
+
+struct ParallelRecordReader::Shared {
+  explicit Shared(size_t max_queued_chunks)
+      : max_queued_chunks(max_queued_chunks) {}
+
+  const size_t max_queued_chunks;
+  // Filled before background tasks start, then constant.
+  std::vector<File> files;
+  std::vector<Range> ranges;
+
+  absl::Mutex mutex;
+  // Index in `ranges` of the next range to be claimed.
+  size_t next_range ABSL_GUARDED_BY(mutex) = 0;
+  // Number of background tasks which have not finished.
+  size_t running ABSL_GUARDED_BY(mutex) = 0;
+  // Whether background tasks should stop early.
+  bool cancelled ABSL_GUARDED_BY(mutex) = false;
+  // The first failure of a background task.
+  absl::Status status ABSL_GUARDED_BY(mutex);
+  // Decoded chunks with at least one record, taken by the reading thread.
+  //
+  // A whole chunk is queued at a time, so that the mutex is locked once per
+  // chunk rather than once per record.
+  std::deque<std::unique_ptr<ChunkDecoder>> chunks ABSL_GUARDED_BY(mutex);
+};
+
+ParallelRecordReader::ParallelRecordReader(std::vector<std::string> filenames,
+                                           Options options)
+    : Object(kInitiallyOpen),
+      executor_(std::move(options.executor())),
+      shared_(std::make_unique<Shared>(options.max_queued_chunks())) {
+  shared_->files.reserve(filenames.size());
+  for (std::string& filename : filenames) {
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (ABSL_PREDICT_FALSE(fd < 0)) {
+      const int error_number = errno;
+      Fail(Annotate(ErrnoToCanonicalStatus(error_number, "open() failed"),
+                    absl::StrCat("reading ", filename)));
+      return;
+    }
+    const size_t file_index = shared_->files.size();
+    shared_->files.emplace_back();
+    File& file = shared_->files.back();
+    file.filename = std::move(filename);
+    file.fd = OwnedFd(fd);
+    // Chunks compressed with a Zstd dictionary need the dictionary from file
+    // metadata.
+    RecordReader<FdReader<UnownedFd>> record_reader(std::forward_as_tuple(
+        fd, FdReaderBase::Options().set_independent_pos(0)));
+    RecordsMetadata metadata;
+    if (ABSL_PREDICT_FALSE(!record_reader.ReadMetadata(metadata))) {
+      Fail(record_reader);
+      return;
+    }
+    const absl::optional<Position> size = record_reader.Size();
+    if (ABSL_PREDICT_FALSE(size == absl::nullopt)) {
+      Fail(record_reader);
+      return;
+    }
+    if (ABSL_PREDICT_FALSE(!record_reader.Close())) {
+      Fail(record_reader);
+      return;
+    }
+    file.chunk_decoder_options.set_field_projection(options.field_projection());
+    if (metadata.has_zstd_dictionary()) {
+      file.chunk_decoder_options.set_zstd_dictionary(
+          ZstdReaderBase::Dictionary().set_data(
+              std::move(*metadata.mutable_zstd_dictionary())));
+    }
+    for (Position begin = 0; begin < *size;) {
+      const Position end =
+          begin + UnsignedMin(options.range_size(), *size - begin);
+      shared_->ranges.push_back(Range{file_index, begin, end});
+      begin = end;
+    }
+  }
+  const size_t num_tasks = UnsignedMin(IntCast<size_t>(options.parallelism()),
+                                       shared_->ranges.size());
+  {
+    absl::MutexLock lock(&shared_->mutex);
+    shared_->running = num_tasks;
+  }
+  Shared* const shared = shared_.get();
+  const std::function<void()> task = [shared] { ReadRanges(*shared); };
+  for (size_t i = 0; i < num_tasks; ++i) {
+    if (executor_ != nullptr) {
+      executor_->Schedule(shared, task);
+    } else {
+      internal::ThreadPool::global().Schedule(task);
+    }
+  }
+}
+
+ParallelRecordReader::~ParallelRecordReader() { StopTasks(); }
+
+void ParallelRecordReader::StopTasks() {
+  absl::MutexLock lock(&shared_->mutex);
+  shared_->cancelled = true;
+  shared_->mutex.Await(absl::Condition(
+      +[](size_t* running) { return *running == 0; }, &shared_->running));
+}
+
+void ParallelRecordReader::Done() {
+  StopTasks();
+  chunk_.reset();
+  {
+    absl::MutexLock lock(&shared_->mutex);
+    shared_->chunks.clear();
+  }
+  shared_->files.clear();
+}
+
+void ParallelRecordReader::ReadRanges(Shared& shared) {
+  for (;;) {
+    size_t range_index;
+    {
+      absl::MutexLock lock(&shared.mutex);
+      if (shared.cancelled || shared.next_range == shared.ranges.size()) break;
+      range_index = shared.next_range++;
+    }
+    absl::Status status = ReadRange(shared, shared.ranges[range_index]);
+    if (ABSL_PREDICT_FALSE(!status.ok())) {
+      absl::MutexLock lock(&shared.mutex);
+      if (shared.status.ok()) shared.status = std::move(status);
+      shared.cancelled = true;
+      break;
+    }
+  }
+  absl::MutexLock lock(&shared.mutex);
+  --shared.running;
+}
+
+absl::Status ParallelRecordReader::ReadRange(Shared& shared,
+                                             const Range& range) {
+  const File& file = shared.files[range.file_index];
+  DefaultChunkReader<FdReader<UnownedFd>> chunk_reader(std::forward_as_tuple(
+      file.fd.get(), FdReaderBase::Options().set_independent_pos(0)));
+  if (ABSL_PREDICT_FALSE(!chunk_reader.SeekToChunkAfter(range.begin))) {
+    return Annotate(chunk_reader.status(),
+                    absl::StrCat("reading ", file.filename));
+  }
+  Chunk chunk;
+  while (chunk_reader.pos() < range.end) {
+    const Position chunk_begin = chunk_reader.pos();
+    if (ABSL_PREDICT_FALSE(!chunk_reader.ReadChunk(chunk))) {
+      if (ABSL_PREDICT_FALSE(!chunk_reader.healthy())) {
+        return Annotate(chunk_reader.status(),
+                        absl::StrCat("reading ", file.filename));
+      }
+      // File ends.
+      break;
+    }
+    if (chunk.header.num_records() == 0) continue;
+    std::unique_ptr<ChunkDecoder> chunk_decoder =
+        std::make_unique<ChunkDecoder>(file.chunk_decoder_options);
+    if (ABSL_PREDICT_FALSE(chunk_decoder->NeedsReference(chunk))) {
+      return Annotate(
+          absl::UnimplementedError(
+              "Chunks compressed with the previous chunk as a reference are "
+              "not supported by ParallelRecordReader"),
+          absl::StrCat("reading ", file.filename, " at chunk ", chunk_begin));
+    }
+    if (ABSL_PREDICT_FALSE(!chunk_decoder->Decode(chunk))) {
+      return Annotate(
+          chunk_decoder->status(),
+          absl::StrCat("reading ", file.filename, " at chunk ", chunk_begin));
+    }
+    absl::MutexLock lock(&shared.mutex);
+    shared.mutex.Await(absl::Condition(
+        +[](Shared* shared) {
+          return shared->cancelled ||
+                 shared->chunks.size() < shared->max_queued_chunks;
+        },
+        &shared));
+    if (shared.cancelled) break;
+    shared.chunks.push_back(std::move(chunk_decoder));
+  }
+  if (ABSL_PREDICT_FALSE(!chunk_reader.Close())) {
+    return Annotate(chunk_reader.status(),
+                    absl::StrCat("reading ", file.filename));
+  }
+  return absl::OkStatus();
+}
+
+bool ParallelRecordReader::NextChunk() {
+  chunk_.reset();
+  absl::MutexLock lock(&shared_->mutex);
+  shared_->mutex.Await(absl::Condition(
+      +[](Shared* shared) {
+        return !shared->chunks.empty() || shared->running == 0 ||
+               !shared->status.ok();
+      },
+      shared_.get()));
+  if (ABSL_PREDICT_FALSE(!shared_->status.ok())) return Fail(shared_->status);
+  // If no chunks are queued, all background tasks finished.
+  if (shared_->chunks.empty()) return false;
+  chunk_ = std::move(shared_->chunks.front());
+  shared_->chunks.pop_front();
+  return true;
+}
+
+template <typename Record>
+inline bool ParallelRecordReader::ReadRecordImpl(Record& record) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  while (chunk_ == nullptr || !chunk_->ReadRecord(record)) {
+    if (chunk_ != nullptr && ABSL_PREDICT_FALSE(!chunk_->healthy())) {
+      return Fail(*chunk_);
+    }
+    if (!NextChunk()) return false;
+  }
+  return true;
+}
+
+bool ParallelRecordReader::ReadRecord(google::protobuf::MessageLite& record) {
+  return ReadRecordImpl(record);
+}
+
+bool ParallelRecordReader::ReadRecord(absl::string_view& record) {
+  return ReadRecordImpl(record);
+}
+
+bool ParallelRecordReader::ReadRecord(std::string& record) {
+  return ReadRecordImpl(record);
+}
+
+bool ParallelRecordReader::ReadRecord(Chain& record) {
+  return ReadRecordImpl(record);
+}
+
+bool ParallelRecordReader::ReadRecord(absl::Cord& record) {
+  return ReadRecordImpl(record);
+}
+
+}  // namespace riegeli
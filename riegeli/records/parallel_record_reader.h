@@ -0,0 +1,230 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_PARALLEL_RECORD_READER_H_
+#define RIEGELI_RECORDS_PARALLEL_RECORD_READER_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/cord.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/object.h"
+#include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/chunk_encoding/field_projection.h"
+
+namespace riegeli {
+
+// `ParallelRecordReader` reads records of one or more Riegeli/records files
+// using many threads, returning them in no particular order. This suits
+// consumers for which record order does not matter, e.g. training and
+// analytics, and scales to all cores.
+//
+// Files are split into ranges of `range_size()` bytes. Each background task
+// claims the next range, reads chunks beginning in it with `pread()`, decodes
+// them independently, and queues decoded chunks. The reading thread takes
+// records from queued chunks in the order they were decoded. Unlike
+// `RecordReaderBase::Options::set_parallelism()`, which keeps records in file
+// order, there is no reordering: a slow chunk does not hold back the others.
+//
+// Chunks compressed with the previous chunk as a reference (written with
+// `RecordWriterBase::Options::set_keyframe_interval()`) can not be decoded
+// independently, and reading them fails.
+//
+// `ParallelRecordReader` is not movable. Its reading functions must be called
+// by one thread at a time.
+class ParallelRecordReader : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Specifies the set of fields to be included in returned records, as for
+    // `RecordReaderBase::Options::set_field_projection()`.
+    //
+    // Default: `FieldProjection::All()`.
+    Options& set_field_projection(const FieldProjection& field_projection) & {
+      field_projection_ = field_projection;
+      return *this;
+    }
+    Options& set_field_projection(FieldProjection&& field_projection) & {
+      field_projection_ = std::move(field_projection);
+      return *this;
+    }
+    Options&& set_field_projection(const FieldProjection& field_projection) && {
+      return std::move(set_field_projection(field_projection));
+    }
+    Options&& set_field_projection(FieldProjection&& field_projection) && {
+      return std::move(set_field_projection(std::move(field_projection)));
+    }
+    FieldProjection& field_projection() { return field_projection_; }
+    const FieldProjection& field_projection() const {
+      return field_projection_;
+    }
+
+    // Sets the number of background tasks reading and decoding chunks.
+    //
+    // Default: `Executor::DefaultMaxThreads()`.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GT(parallelism, 0)
+          << "Failed precondition of "
+             "ParallelRecordReader::Options::set_parallelism(): "
+             "parallelism not positive";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+    // Sets the size of ranges of files claimed by background tasks. A chunk
+    // belongs to the range containing its beginning.
+    //
+    // Smaller ranges balance the work better near the end of reading; larger
+    // ranges make seeking to a chunk boundary at their beginnings rarer.
+    //
+    // Default: 64M.
+    Options& set_range_size(Position range_size) & {
+      RIEGELI_ASSERT_GT(range_size, 0u)
+          << "Failed precondition of "
+             "ParallelRecordReader::Options::set_range_size(): "
+             "range size not positive";
+      range_size_ = range_size;
+      return *this;
+    }
+    Options&& set_range_size(Position range_size) && {
+      return std::move(set_range_size(range_size));
+    }
+    Position range_size() const { return range_size_; }
+
+    // Sets the maximum number of decoded chunks waiting for the reading
+    // thread. Background tasks wait when it is reached. This bounds memory
+    // usage to about `max_queued_chunks()` decoded chunks.
+    //
+    // Default: 64.
+    Options& set_max_queued_chunks(size_t max_queued_chunks) & {
+      RIEGELI_ASSERT_GT(max_queued_chunks, 0u)
+          << "Failed precondition of "
+             "ParallelRecordReader::Options::set_max_queued_chunks(): "
+             "queue size not positive";
+      max_queued_chunks_ = max_queued_chunks;
+      return *this;
+    }
+    Options&& set_max_queued_chunks(size_t max_queued_chunks) && {
+      return std::move(set_max_queued_chunks(max_queued_chunks));
+    }
+    size_t max_queued_chunks() const { return max_queued_chunks_; }
+
+    // Sets the `Executor` which runs background tasks.
+    //
+    // Background tasks wait while the queue of decoded chunks is full, so a
+    // shared `Executor` should have threads to spare.
+    //
+    // If `nullptr`, background tasks run in a global thread pool which creates
+    // threads without a limit.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+   private:
+    FieldProjection field_projection_ = FieldProjection::All();
+    int parallelism_ = Executor::DefaultMaxThreads();
+    Position range_size_ = Position{64} << 20;
+    size_t max_queued_chunks_ = 64;
+    std::shared_ptr<Executor> executor_;
+  };
+
+  // Opens the files named by `filenames`, and starts reading them in
+  // background.
+  explicit ParallelRecordReader(std::vector<std::string> filenames,
+                                Options options = Options());
+
+  ParallelRecordReader(const ParallelRecordReader&) = delete;
+  ParallelRecordReader& operator=(const ParallelRecordReader&) = delete;
+
+  // Stops background tasks and waits for them to finish.
+  ~ParallelRecordReader();
+
+  // Reads the next record, in no particular order.
+  //
+  // `ReadRecord(google::protobuf::MessageLite&)` parses raw bytes to a proto
+  // message after reading. The remaining overloads read raw bytes. For
+  // `ReadRecord(absl::string_view&)` the `absl::string_view` is valid until the
+  // next non-const operation on this `ParallelRecordReader`.
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - all files end
+  //  * `false` (when `!healthy()`) - failure
+  bool ReadRecord(google::protobuf::MessageLite& record);
+  bool ReadRecord(absl::string_view& record);
+  bool ReadRecord(std::string& record);
+  bool ReadRecord(Chain& record);
+  bool ReadRecord(absl::Cord& record);
+
+ protected:
+  // Stops background tasks and waits for them to finish.
+  void Done() override;
+
+ private:
+  struct File;
+  struct Range;
+  struct Shared;
+
+  // Reads ranges claimed from `shared` until none are left or reading is
+  // cancelled. Runs in a background task.
+  static void ReadRanges(Shared& shared);
+  // Reads and queues chunks beginning in `range`.
+  static absl::Status ReadRange(Shared& shared, const Range& range);
+  // Cancels background tasks and waits for them to finish.
+  void StopTasks();
+
+  template <typename Record>
+  bool ReadRecordImpl(Record& record);
+  // Makes the next queued chunk current, waiting for one if needed.
+  //
+  // Return values:
+  //  * `true`                      - success (`chunk_` is set)
+  //  * `false` (when `healthy()`)  - all files end
+  //  * `false` (when `!healthy()`) - failure
+  bool NextChunk();
+
+  // Kept alive until background tasks finish.
+  std::shared_ptr<Executor> executor_;
+  std::unique_ptr<Shared> shared_;
+  // The chunk records are being read from, or `nullptr`.
+  std::unique_ptr<ChunkDecoder> chunk_;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_PARALLEL_RECORD_READER_H_
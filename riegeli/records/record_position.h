@@ -112,8 +112,10 @@ class FutureRecordPosition {
 
   explicit FutureRecordPosition(RecordPosition pos) noexcept;
 
+  // `block_size` is the block size of the file, which determines the effect
+  // of `actions`.
   FutureRecordPosition(Position pos_before_chunks, std::vector<Action> actions,
-                       uint64_t record_index);
+                       uint64_t record_index, Position block_size);
 
   FutureRecordPosition(const FutureRecordPosition& that) noexcept;
   FutureRecordPosition& operator=(const FutureRecordPosition& that) noexcept;
@@ -197,7 +199,7 @@ inline HashState AbslHashValue(HashState hash_state, RecordPosition self) {
 class FutureRecordPosition::FutureChunkBegin {
  public:
   explicit FutureChunkBegin(Position pos_before_chunks,
-                            std::vector<Action> actions);
+                            std::vector<Action> actions, Position block_size);
 
   FutureChunkBegin(const FutureChunkBegin&) = delete;
   FutureChunkBegin& operator=(const FutureChunkBegin&) = delete;
@@ -212,6 +214,7 @@ class FutureRecordPosition::FutureChunkBegin {
   mutable Position pos_before_chunks_ = 0;
   // Headers of chunks to be written after `pos_before_chunks_`.
   mutable std::vector<Action> actions_;
+  Position block_size_;
 };
 
 inline Position FutureRecordPosition::FutureChunkBegin::get() const {
@@ -17,52 +17,85 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <deque>
 #include <functional>
+#include <future>
+#include <list>
+#include <limits>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/compare.h"
 #include "absl/types/optional.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
 #include "google/protobuf/message.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/binary_search.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/memory.h"
 #include "riegeli/base/object.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/chain_backward_writer.h"
 #include "riegeli/bytes/chain_reader.h"
+#include "riegeli/bytes/string_reader.h"
 #include "riegeli/chunk_encoding/chunk.h"
 #include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
 #include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/chunk_encoding/field_projection.h"
+#include "riegeli/chunk_encoding/hash.h"
 #include "riegeli/chunk_encoding/transpose_decoder.h"
 #include "riegeli/messages/message_parse.h"
 #include "riegeli/records/chunk_reader.h"
 #include "riegeli/records/record_position.h"
 #include "riegeli/records/records_metadata.pb.h"
+#include "riegeli/records/records_observer.h"
 #include "riegeli/records/skipped_region.h"
+#include "riegeli/varint/varint_writing.h"
+#include "riegeli/zstd/zstd_reader.h"
 
 namespace riegeli {
 
+namespace {
+
+// Maximum number of schemas kept in the cache of `RecordsMetadataDescriptors`.
+// When it is full, schemas not used by any `RecordsMetadataDescriptors` are
+// evicted.
+constexpr size_t kMaxCachedSchemas = 256;
+
+}  // namespace
+
 class RecordsMetadataDescriptors::ErrorCollector
     : public google::protobuf::DescriptorPool::ErrorCollector {
  public:
   void AddError(const std::string& filename, const std::string& element_name,
                 const google::protobuf::Message* descriptor,
                 ErrorLocation location, const std::string& message) override {
-    descriptors_->Fail(absl::InvalidArgumentError(
+    if (!status_->ok()) return;
+    *status_ = absl::InvalidArgumentError(
         absl::StrCat("Error in file ", filename, ", element ", element_name,
-                     ": ", message)));
+                     ": ", message));
   }
 
   void AddWarning(const std::string& filename, const std::string& element_name,
@@ -73,31 +106,276 @@ class RecordsMetadataDescriptors::ErrorCollector
  private:
   friend class RecordsMetadataDescriptors;
 
-  explicit ErrorCollector(RecordsMetadataDescriptors* descriptors)
-      : descriptors_(descriptors) {}
+  explicit ErrorCollector(absl::Status* status) : status_(status) {}
+
+  absl::Status* status_;
+};
+
+struct RecordsMetadataDescriptors::Schema {
+  explicit Schema(std::string serialized_file_descriptors)
+      : serialized_file_descriptors(std::move(serialized_file_descriptors)) {}
 
-  RecordsMetadataDescriptors* descriptors_;
+  // Length-prefixed serialized `file_descriptor`, compared on a cache hit to
+  // rule out a fingerprint collision.
+  std::string serialized_file_descriptors;
+  // The first error of building `pool`.
+  absl::Status status;
+  google::protobuf::DescriptorPool pool;
+  // `google::protobuf::DynamicMessageFactory` is thread-safe, so it can be used
+  // through a shared `const Schema`.
+  mutable google::protobuf::DynamicMessageFactory factory{&pool};
 };
 
 RecordsMetadataDescriptors::RecordsMetadataDescriptors(
     const RecordsMetadata& metadata)
     : Object(kInitiallyOpen), record_type_name_(metadata.record_type_name()) {
   if (record_type_name_.empty() || metadata.file_descriptor().empty()) return;
-  pool_ = std::make_unique<google::protobuf::DescriptorPool>();
-  ErrorCollector error_collector(this);
+  schema_ = GetSchema(metadata);
+  if (ABSL_PREDICT_FALSE(!schema_->status.ok())) Fail(schema_->status);
+}
+
+std::shared_ptr<const RecordsMetadataDescriptors::Schema>
+RecordsMetadataDescriptors::GetSchema(const RecordsMetadata& metadata) {
+  std::string serialized_file_descriptors;
+  for (const google::protobuf::FileDescriptorProto& file_descriptor :
+       metadata.file_descriptor()) {
+    const std::string serialized = file_descriptor.SerializeAsString();
+    const size_t pos = serialized_file_descriptors.size();
+    serialized_file_descriptors.resize(pos +
+                                       LengthVarint64(serialized.size()));
+    WriteVarint64(serialized.size(), &serialized_file_descriptors[pos]);
+    serialized_file_descriptors.append(serialized);
+  }
+  const uint64_t fingerprint = internal::Hash(serialized_file_descriptors);
+
+  struct Cache {
+    absl::Mutex mutex;
+    absl::flat_hash_map<uint64_t, std::shared_ptr<const Schema>> schemas
+        ABSL_GUARDED_BY(mutex);
+  };
+  static NoDestructor<Cache> kCache;
+  {
+    absl::MutexLock lock(&kCache->mutex);
+    const auto iter = kCache->schemas.find(fingerprint);
+    if (iter != kCache->schemas.end() &&
+        iter->second->serialized_file_descriptors ==
+            serialized_file_descriptors) {
+      return iter->second;
+    }
+  }
+
+  // Build the schema without holding the lock. If another thread concurrently
+  // builds the same schema, one of them is cached.
+  const std::shared_ptr<Schema> schema =
+      std::make_shared<Schema>(std::move(serialized_file_descriptors));
+  ErrorCollector error_collector(&schema->status);
   for (const google::protobuf::FileDescriptorProto& file_descriptor :
        metadata.file_descriptor()) {
-    if (ABSL_PREDICT_FALSE(pool_->BuildFileCollectingErrors(
+    if (ABSL_PREDICT_FALSE(schema->pool.BuildFileCollectingErrors(
                                file_descriptor, &error_collector) == nullptr)) {
-      return;
+      break;
+    }
+  }
+
+  absl::MutexLock lock(&kCache->mutex);
+  if (kCache->schemas.size() >= kMaxCachedSchemas) {
+    for (auto iter = kCache->schemas.begin(); iter != kCache->schemas.end();) {
+      if (iter->second.use_count() == 1) {
+        kCache->schemas.erase(iter++);
+      } else {
+        ++iter;
+      }
     }
   }
+  if (kCache->schemas.size() < kMaxCachedSchemas) {
+    kCache->schemas.emplace(fingerprint, schema);
+  }
+  return schema;
 }
 
 const google::protobuf::Descriptor* RecordsMetadataDescriptors::descriptor()
     const {
-  if (pool_ == nullptr) return nullptr;
-  return pool_->FindMessageTypeByName(record_type_name_);
+  if (schema_ == nullptr) return nullptr;
+  return schema_->pool.FindMessageTypeByName(record_type_name_);
+}
+
+const google::protobuf::Message* RecordsMetadataDescriptors::prototype()
+    const {
+  const google::protobuf::Descriptor* const message_descriptor = descriptor();
+  if (message_descriptor == nullptr) return nullptr;
+  return schema_->factory.GetPrototype(message_descriptor);
+}
+
+// Chunks read ahead from the `ChunkReader` and decoded in background.
+class RecordReaderBase::ReadAhead {
+ public:
+  struct DecodedChunk {
+    Position chunk_begin;
+    // Decoded size of the chunk, as declared by its header.
+    uint64_t decoded_data_size;
+    std::future<ChunkDecoder> chunk_decoder;
+  };
+
+  explicit ReadAhead(int parallelism, std::shared_ptr<Executor> executor)
+      : parallelism(parallelism), executor(std::move(executor)) {}
+
+  // Reads chunks from `src` until `parallelism` chunks are pending, or until
+  // `src` ends or fails, and schedules decoding them in background with
+  // `record_reader.chunk_decoder_options_`. Data of chunks selected by
+  // `record_reader.VerifyNextChunkData()` are verified in background too.
+  void Fill(ChunkReader& src, RecordReaderBase& record_reader);
+
+  int parallelism;
+  // If not `nullptr`, decodes chunks instead of the global thread pool.
+  std::shared_ptr<Executor> executor;
+  // Invariant: `chunks.size() <= parallelism`
+  std::deque<DecodedChunk> chunks;
+};
+
+void RecordReaderBase::ReadAhead::Fill(ChunkReader& src,
+                                       RecordReaderBase& record_reader) {
+  while (chunks.size() < IntCast<size_t>(parallelism)) {
+    const Position chunk_begin = src.pos();
+    if (chunk_begin >= record_reader.chunk_range_end_) return;
+    const ChunkHeader* chunk_header;
+    if (ABSL_PREDICT_FALSE(!src.PullChunkHeader(&chunk_header))) return;
+    // A prefixed chunk depends on the previous chunk, so it is decoded by the
+    // reading thread.
+    if (chunk_header->chunk_type() == ChunkType::kPrefixed) return;
+    Chunk chunk;
+    if (ABSL_PREDICT_FALSE(
+            !record_reader.ReadChunkFromSrc(src, false, chunk))) {
+      return;
+    }
+    // The state of decoding is kept in a single allocation, so that the task
+    // capturing only a pointer fits in the small buffer of `std::function`
+    // and scheduling it does not allocate.
+    struct PendingChunk {
+      Chunk chunk;
+      ChunkDecoder::Options chunk_decoder_options;
+      std::promise<ChunkDecoder> chunk_decoder;
+    };
+    PendingChunk* const pending_chunk = new PendingChunk{
+        std::move(chunk), record_reader.chunk_decoder_options_,
+        std::promise<ChunkDecoder>()};
+    pending_chunk->chunk_decoder_options.set_verify_data_hash(
+        record_reader.VerifyNextChunkData());
+    chunks.push_back(DecodedChunk{
+        chunk_begin, pending_chunk->chunk.header.decoded_data_size(),
+        pending_chunk->chunk_decoder.get_future()});
+    std::function<void()> task = [pending_chunk] {
+      ChunkDecoder chunk_decoder(
+          std::move(pending_chunk->chunk_decoder_options));
+      // A failure is detected by the reading thread, which checks
+      // `chunk_decoder.healthy()`.
+      chunk_decoder.Decode(pending_chunk->chunk);
+      pending_chunk->chunk_decoder.set_value(std::move(chunk_decoder));
+      delete pending_chunk;
+    };
+    if (executor != nullptr) {
+      executor->Schedule(this, std::move(task));
+    } else {
+      internal::ThreadPool::global().Schedule(std::move(task));
+    }
+  }
+}
+
+class RecordReaderBase::Index {
+ public:
+  // Beginnings of chunks containing records, in increasing order.
+  std::vector<Position> chunk_begins;
+  // `records_before[i]` is the number of records before `chunk_begins[i]`.
+  // The last element is the number of records in the file.
+  //
+  // Empty if the file has no index.
+  std::vector<uint64_t> records_before;
+  // `min_keys[i]` and `max_keys[i]` are the smallest and the largest key of
+  // records in the chunk at `chunk_begins[i]`.
+  //
+  // Empty if the index has no ranges of keys.
+  std::vector<std::string> min_keys;
+  std::vector<std::string> max_keys;
+  // `max_times[i]` is the latest time of records in chunks up to
+  // `chunk_begins[i]` inclusive. This is non-decreasing even if records are
+  // not sorted by time.
+  //
+  // Empty if the index has no ranges of times.
+  std::vector<absl::Time> max_times;
+};
+
+class RecordReaderBase::ChunkCache {
+ public:
+  struct Entry {
+    Position chunk_begin;
+    // Position of `src_chunk_reader()` after reading the chunk.
+    Position chunk_end;
+    ChunkDecoder chunk_decoder;
+  };
+
+  explicit ChunkCache(size_t max_size) : max_size_(max_size) {}
+
+  // Stores a decoded chunk, evicting least recently stored chunks to stay
+  // within `max_size`. A chunk larger than `max_size` is not stored.
+  void Insert(Position chunk_begin, Position chunk_end,
+              ChunkDecoder&& chunk_decoder);
+
+  // Removes and returns the chunk beginning at `chunk_begin` if it is stored.
+  absl::optional<Entry> Take(Position chunk_begin);
+
+  void Clear();
+
+  // Returns the total size of stored chunks, as limited by `max_size`.
+  size_t size() const { return size_; }
+
+ private:
+  static size_t EntrySize(const ChunkDecoder& chunk_decoder) {
+    return chunk_decoder.records_size() +
+           IntCast<size_t>(chunk_decoder.num_records()) * sizeof(size_t);
+  }
+
+  size_t max_size_;
+  size_t size_ = 0;
+  // Most recently stored chunks first.
+  std::list<Entry> entries_;
+  absl::flat_hash_map<Position, std::list<Entry>::iterator> by_chunk_begin_;
+};
+
+void RecordReaderBase::ChunkCache::Insert(Position chunk_begin,
+                                          Position chunk_end,
+                                          ChunkDecoder&& chunk_decoder) {
+  const size_t entry_size = EntrySize(chunk_decoder);
+  if (entry_size > max_size_) return;
+  const auto found = by_chunk_begin_.find(chunk_begin);
+  if (found != by_chunk_begin_.end()) {
+    size_ -= EntrySize(found->second->chunk_decoder);
+    entries_.erase(found->second);
+    by_chunk_begin_.erase(found);
+  }
+  while (size_ + entry_size > max_size_) {
+    size_ -= EntrySize(entries_.back().chunk_decoder);
+    by_chunk_begin_.erase(entries_.back().chunk_begin);
+    entries_.pop_back();
+  }
+  entries_.push_front(Entry{chunk_begin, chunk_end, std::move(chunk_decoder)});
+  by_chunk_begin_.emplace(chunk_begin, entries_.begin());
+  size_ += entry_size;
+}
+
+absl::optional<RecordReaderBase::ChunkCache::Entry>
+RecordReaderBase::ChunkCache::Take(Position chunk_begin) {
+  const auto found = by_chunk_begin_.find(chunk_begin);
+  if (found == by_chunk_begin_.end()) return absl::nullopt;
+  Entry entry = std::move(*found->second);
+  size_ -= EntrySize(entry.chunk_decoder);
+  entries_.erase(found->second);
+  by_chunk_begin_.erase(found);
+  return entry;
+}
+
+void RecordReaderBase::ChunkCache::Clear() {
+  size_ = 0;
+  entries_.clear();
+  by_chunk_begin_.clear();
 }
 
 RecordReaderBase::RecordReaderBase(InitiallyClosed) noexcept
@@ -111,10 +389,26 @@ RecordReaderBase::RecordReaderBase(RecordReaderBase&& that) noexcept
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
       chunk_begin_(that.chunk_begin_),
+      chunk_decoder_options_(std::move(that.chunk_decoder_options_)),
       chunk_decoder_(std::move(that.chunk_decoder_)),
+      buckets_decompressed_(that.buckets_decompressed_),
+      bytes_skipped_(that.bytes_skipped_),
+      stats_(that.stats_),
       last_record_is_valid_(std::exchange(that.last_record_is_valid_, false)),
       recoverable_(std::exchange(that.recoverable_, Recoverable::kNo)),
-      recovery_(std::move(that.recovery_)) {}
+      recovery_(std::move(that.recovery_)),
+      read_ahead_(std::move(that.read_ahead_)),
+      use_index_(that.use_index_),
+      index_(std::move(that.index_)),
+      chunk_cache_(std::move(that.chunk_cache_)),
+      dictionaries_checked_(that.dictionaries_checked_),
+      trusted_metadata_(std::move(that.trusted_metadata_)),
+      data_verification_fraction_(that.data_verification_fraction_),
+      data_verification_credit_(that.data_verification_credit_),
+      chunk_range_end_(that.chunk_range_end_),
+      search_fanout_(that.search_fanout_),
+      search_src_factory_(std::move(that.search_src_factory_)),
+      observer_(std::move(that.observer_)) {}
 
 RecordReaderBase& RecordReaderBase::operator=(
     RecordReaderBase&& that) noexcept {
@@ -122,29 +416,79 @@ RecordReaderBase& RecordReaderBase::operator=(
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   chunk_begin_ = that.chunk_begin_;
+  chunk_decoder_options_ = std::move(that.chunk_decoder_options_);
   chunk_decoder_ = std::move(that.chunk_decoder_);
+  buckets_decompressed_ = that.buckets_decompressed_;
+  bytes_skipped_ = that.bytes_skipped_;
+  stats_ = that.stats_;
   last_record_is_valid_ = std::exchange(that.last_record_is_valid_, false);
   recoverable_ = std::exchange(that.recoverable_, Recoverable::kNo);
   recovery_ = std::move(that.recovery_);
+  read_ahead_ = std::move(that.read_ahead_);
+  use_index_ = that.use_index_;
+  index_ = std::move(that.index_);
+  chunk_cache_ = std::move(that.chunk_cache_);
+  dictionaries_checked_ = that.dictionaries_checked_;
+  trusted_metadata_ = std::move(that.trusted_metadata_);
+  data_verification_fraction_ = that.data_verification_fraction_;
+  data_verification_credit_ = that.data_verification_credit_;
+  chunk_range_end_ = that.chunk_range_end_;
+  search_fanout_ = that.search_fanout_;
+  search_src_factory_ = std::move(that.search_src_factory_);
+  observer_ = std::move(that.observer_);
   return *this;
 }
 
+RecordReaderBase::~RecordReaderBase() {}
+
 void RecordReaderBase::Reset(InitiallyClosed) {
   Object::Reset(kInitiallyClosed);
   chunk_begin_ = 0;
+  chunk_decoder_options_ = ChunkDecoder::Options();
   chunk_decoder_.Clear();
+  buckets_decompressed_ = 0;
+  bytes_skipped_ = 0;
+  stats_ = ChunkStats();
   last_record_is_valid_ = false;
   recoverable_ = Recoverable::kNo;
   recovery_ = nullptr;
+  read_ahead_.reset();
+  use_index_ = false;
+  index_.reset();
+  chunk_cache_.reset();
+  dictionaries_checked_ = false;
+  trusted_metadata_ = absl::nullopt;
+  data_verification_fraction_ = 1.0;
+  data_verification_credit_ = 0.0;
+  chunk_range_end_ = std::numeric_limits<Position>::max();
+  search_fanout_ = 2;
+  search_src_factory_ = nullptr;
+  observer_.reset();
 }
 
 void RecordReaderBase::Reset(InitiallyOpen) {
   Object::Reset(kInitiallyOpen);
   chunk_begin_ = 0;
+  chunk_decoder_options_ = ChunkDecoder::Options();
   chunk_decoder_.Clear();
+  buckets_decompressed_ = 0;
+  bytes_skipped_ = 0;
+  stats_ = ChunkStats();
   last_record_is_valid_ = false;
   recoverable_ = Recoverable::kNo;
   recovery_ = nullptr;
+  read_ahead_.reset();
+  use_index_ = false;
+  index_.reset();
+  chunk_cache_.reset();
+  dictionaries_checked_ = false;
+  trusted_metadata_ = absl::nullopt;
+  data_verification_fraction_ = 1.0;
+  data_verification_credit_ = 0.0;
+  chunk_range_end_ = std::numeric_limits<Position>::max();
+  search_fanout_ = 2;
+  search_src_factory_ = nullptr;
+  observer_.reset();
 }
 
 void RecordReaderBase::Initialize(ChunkReader* src, Options&& options) {
@@ -154,19 +498,125 @@ void RecordReaderBase::Initialize(ChunkReader* src, Options&& options) {
     Fail(*src);
     return;
   }
+  if (options.chunk_range_begin() > src->pos() &&
+      ABSL_PREDICT_FALSE(!src->SeekToChunkAfter(options.chunk_range_begin()))) {
+    FailSeeking(*src);
+    return;
+  }
   chunk_begin_ = src->pos();
-  chunk_decoder_.Reset(ChunkDecoder::Options().set_field_projection(
-      std::move(options.field_projection())));
+  chunk_range_end_ = options.chunk_range_end();
+  search_fanout_ = options.search_fanout();
+  search_src_factory_ = std::move(options.search_src_factory());
+  observer_ = std::move(options.observer());
+  if (options.parallelism() > 0) {
+    read_ahead_ = std::make_unique<ReadAhead>(options.parallelism(),
+                                              options.executor());
+  }
+  chunk_decoder_options_ =
+      ChunkDecoder::Options()
+          .set_field_projection(std::move(options.field_projection()))
+          .set_project_simple_chunks(options.project_simple_chunks())
+          .set_chunk_filter(std::move(options.chunk_filter()))
+          .set_contiguous_records(options.contiguous_records())
+          .set_brotli_dictionary(std::move(options.brotli_dictionary()))
+          .set_executor(std::move(options.executor()));
+  chunk_decoder_.Reset(chunk_decoder_options_);
   recovery_ = std::move(options.recovery());
+  use_index_ = options.index();
+  if (options.chunk_cache_size() > 0) {
+    chunk_cache_ = std::make_unique<ChunkCache>(options.chunk_cache_size());
+  }
+  data_verification_fraction_ = options.data_verification_fraction();
+  if (options.trusted_metadata() != absl::nullopt) {
+    trusted_metadata_ = std::move(options.trusted_metadata());
+    dictionaries_checked_ = true;
+    SetDictionaries(*trusted_metadata_);
+  }
 }
 
 void RecordReaderBase::Done() {
   last_record_is_valid_ = false;
   recoverable_ = Recoverable::kNo;
+  if (read_ahead_ != nullptr && !read_ahead_->chunks.empty()) {
+    // Keep only the position of the next chunk, so that `pos()` is unchanged
+    // by `Close()`. Pending decoding results are abandoned.
+    read_ahead_->chunks.erase(read_ahead_->chunks.begin() + 1,
+                              read_ahead_->chunks.end());
+    read_ahead_->chunks.front().chunk_decoder = std::future<ChunkDecoder>();
+  }
+  if (chunk_cache_ != nullptr) chunk_cache_->Clear();
   if (ABSL_PREDICT_FALSE(!chunk_decoder_.Close())) Fail(chunk_decoder_);
 }
 
-inline bool RecordReaderBase::FailReading(const ChunkReader& src) {
+Position RecordReaderBase::ReadAheadPos() const {
+  RIEGELI_ASSERT(read_ahead_ != nullptr)
+      << "Failed precondition of RecordReaderBase::ReadAheadPos(): "
+         "no read ahead";
+  if (!read_ahead_->chunks.empty()) {
+    return read_ahead_->chunks.front().chunk_begin;
+  }
+  return src_chunk_reader()->pos();
+}
+
+inline void RecordReaderBase::DiscardReadAhead() {
+  // Decoding tasks own their data, so their results can be abandoned without
+  // waiting for them.
+  if (read_ahead_ != nullptr) read_ahead_->chunks.clear();
+}
+
+inline void RecordReaderBase::CacheCurrentChunk() {
+  if (chunk_cache_ == nullptr || chunk_decoder_.num_records() == 0) return;
+  const Position chunk_end = ABSL_PREDICT_FALSE(read_ahead_ != nullptr)
+                                 ? ReadAheadPos()
+                                 : src_chunk_reader()->pos();
+  chunk_cache_->Insert(chunk_begin_, chunk_end, std::move(chunk_decoder_));
+  chunk_decoder_.Reset(chunk_decoder_options_);
+}
+
+inline bool RecordReaderBase::TakeCachedChunk(Position chunk_begin,
+                                              bool& from_cache) {
+  from_cache = false;
+  if (chunk_cache_ == nullptr) return true;
+  absl::optional<ChunkCache::Entry> entry = chunk_cache_->Take(chunk_begin);
+  if (entry == absl::nullopt) return true;
+  ChunkReader& src = *src_chunk_reader();
+  if (ABSL_PREDICT_FALSE(!src.Seek(entry->chunk_end))) return FailSeeking(src);
+  chunk_begin_ = chunk_begin;
+  chunk_decoder_ = std::move(entry->chunk_decoder);
+  from_cache = true;
+  return true;
+}
+
+inline bool RecordReaderBase::VerifyNextChunkData() {
+  if (data_verification_fraction_ >= 1.0) return true;
+  data_verification_credit_ += data_verification_fraction_;
+  if (data_verification_credit_ < 1.0) return false;
+  data_verification_credit_ -= 1.0;
+  return true;
+}
+
+bool RecordReaderBase::ReadChunkFromSrc(ChunkReader& src, bool verify_data,
+                                        Chunk& chunk) {
+  if (ABSL_PREDICT_TRUE(observer_ == nullptr)) {
+    return verify_data ? src.ReadChunk(chunk) : src.ReadChunkUnverified(chunk);
+  }
+  const Position chunk_begin = src.pos();
+  const absl::Time start_time = absl::Now();
+  if (ABSL_PREDICT_FALSE(!(verify_data ? src.ReadChunk(chunk)
+                                       : src.ReadChunkUnverified(chunk)))) {
+    return false;
+  }
+  observer_->OnChunkRead(chunk_begin, chunk.header, absl::Now() - start_time);
+  return true;
+}
+
+inline void RecordReaderBase::ReportChunkDecoded() {
+  if (ABSL_PREDICT_FALSE(observer_ != nullptr)) {
+    observer_->OnChunkDecoded(chunk_begin_, chunk_decoder_.stats());
+  }
+}
+
+bool RecordReaderBase::FailReading(const ChunkReader& src) {
   recoverable_ = Recoverable::kRecoverChunkReader;
   Fail(src);
   return TryRecovery();
@@ -183,6 +633,8 @@ inline bool RecordReaderBase::FailSeeking(const ChunkReader& src) {
 bool RecordReaderBase::CheckFileFormat() {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   if (chunk_decoder_.num_records() > 0) return true;
+  if (read_ahead_ != nullptr && !read_ahead_->chunks.empty()) return true;
+  if (trusted_metadata_ != absl::nullopt) return true;
   ChunkReader& src = *src_chunk_reader();
   if (ABSL_PREDICT_FALSE(!src.CheckFileFormat())) {
     chunk_decoder_.Clear();
@@ -219,6 +671,12 @@ bool RecordReaderBase::ReadSerializedMetadata(Chain& metadata) {
         "RecordReaderBase::ReadMetadata() must be called "
         "while the RecordReader is at the beginning of the file"));
   }
+  if (trusted_metadata_ != absl::nullopt) {
+    // The signature and metadata chunks are not read. Reading records skips
+    // them.
+    metadata = *trusted_metadata_;
+    return true;
+  }
 
   chunk_begin_ = src.pos();
   Chunk chunk;
@@ -238,6 +696,7 @@ bool RecordReaderBase::ReadSerializedMetadata(Chain& metadata) {
   }
   if (chunk_header->chunk_type() != ChunkType::kFileMetadata) {
     // Missing file metadata chunk, assume empty `RecordsMetadata`.
+    dictionaries_checked_ = true;
     return true;
   }
   if (ABSL_PREDICT_FALSE(!src.ReadChunk(chunk))) {
@@ -248,9 +707,94 @@ bool RecordReaderBase::ReadSerializedMetadata(Chain& metadata) {
     recoverable_ = Recoverable::kRecoverChunkDecoder;
     return TryRecovery();
   }
+  dictionaries_checked_ = true;
+  return SetDictionaries(metadata);
+}
+
+inline bool RecordReaderBase::SetDictionaries(
+    const Chain& serialized_metadata) {
+  RecordsMetadata metadata;
+  {
+    absl::Status status = ParseFromChain(serialized_metadata, metadata);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return Fail(std::move(status));
+  }
+  if (metadata.has_brotli_dictionary_id()) {
+    const BrotliDictionary& brotli_dictionary =
+        chunk_decoder_options_.brotli_dictionary();
+    if (ABSL_PREDICT_FALSE(brotli_dictionary.empty())) {
+      return Fail(absl::FailedPreconditionError(
+          "Records are compressed with a Brotli dictionary, which must be "
+          "given to RecordReaderBase::Options::set_brotli_dictionary()"));
+    }
+    if (ABSL_PREDICT_FALSE(internal::Hash(brotli_dictionary.data()) !=
+                           metadata.brotli_dictionary_id())) {
+      return Fail(absl::InvalidArgumentError(
+          "Brotli dictionary does not match the dictionary used for "
+          "compression"));
+    }
+  }
+  if (!metadata.has_zstd_dictionary()) return true;
+  chunk_decoder_options_.set_zstd_dictionary(
+      ZstdReaderBase::Dictionary().set_data(
+          std::move(*metadata.mutable_zstd_dictionary())));
+  chunk_decoder_.Reset(chunk_decoder_options_);
   return true;
 }
 
+inline bool RecordReaderBase::LoadDictionaries() {
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of RecordReaderBase::LoadDictionaries(): "
+      << status();
+  dictionaries_checked_ = true;
+  ChunkReader& src = *src_chunk_reader();
+  const Position pos = src.pos();
+  if (pos != 0) {
+    // Without random access file metadata are not available, and chunks
+    // compressed with a Zstd dictionary fail to decode. A Brotli dictionary
+    // is used without verification.
+    if (!src.SupportsRandomAccess()) return true;
+    if (ABSL_PREDICT_FALSE(!src.Seek(0))) {
+      recoverable_ = Recoverable::kRecoverChunkReader;
+      return Fail(src);
+    }
+  }
+  Chunk chunk;
+  // Whether it is known if the file has metadata. This is not known if the
+  // file ends before, e.g. it is still being written.
+  bool metadata_known = false;
+  bool has_metadata = false;
+  if (src.ReadChunk(chunk)) {
+    RIEGELI_ASSERT(chunk.header.chunk_type() == ChunkType::kFileSignature)
+        << "Unexpected type of the first chunk: "
+        << static_cast<unsigned>(chunk.header.chunk_type());
+    const ChunkHeader* chunk_header;
+    if (src.PullChunkHeader(&chunk_header)) {
+      if (chunk_header->chunk_type() == ChunkType::kFileMetadata) {
+        has_metadata = src.ReadChunk(chunk);
+        metadata_known = has_metadata;
+      } else {
+        metadata_known = true;
+      }
+    }
+  }
+  if (pos != 0) src.Seek(pos);
+  if (ABSL_PREDICT_FALSE(!src.healthy())) {
+    recoverable_ = Recoverable::kRecoverChunkReader;
+    return Fail(src);
+  }
+  if (!has_metadata) {
+    // Check again after reading more, in case the file grows.
+    if (!metadata_known) dictionaries_checked_ = false;
+    return true;
+  }
+  Chain serialized_metadata;
+  if (ABSL_PREDICT_FALSE(!ParseMetadata(chunk, serialized_metadata))) {
+    recoverable_ = Recoverable::kRecoverChunkDecoder;
+    return false;
+  }
+  return SetDictionaries(serialized_metadata);
+}
+
 inline bool RecordReaderBase::ParseMetadata(const Chunk& chunk,
                                             Chain& metadata) {
   RIEGELI_ASSERT(chunk.header.chunk_type() == ChunkType::kFileMetadata)
@@ -261,26 +805,124 @@ inline bool RecordReaderBase::ParseMetadata(const Chunk& chunk,
         "Invalid file metadata chunk: number of records is not zero: ",
         chunk.header.num_records())));
   }
+  return ParseSingleRecordChunk(chunk, metadata);
+}
+
+inline bool RecordReaderBase::ParseIndex(const Chunk& chunk, Index& index) {
+  RIEGELI_ASSERT(chunk.header.chunk_type() == ChunkType::kIndex)
+      << "Failed precondition of RecordReaderBase::ParseIndex(): "
+         "wrong chunk type";
+  if (ABSL_PREDICT_FALSE(chunk.header.num_records() != 0)) {
+    return Fail(absl::InvalidArgumentError(
+        absl::StrCat("Invalid index chunk: number of records is not zero: ",
+                     chunk.header.num_records())));
+  }
+  Chain serialized_index;
+  if (ABSL_PREDICT_FALSE(!ParseSingleRecordChunk(chunk, serialized_index))) {
+    return false;
+  }
+  RecordsIndex records_index;
+  {
+    absl::Status status = ParseFromChain(serialized_index, records_index);
+    if (ABSL_PREDICT_FALSE(!status.ok())) {
+      return Fail(std::move(status));
+    }
+  }
+  if (ABSL_PREDICT_FALSE(records_index.num_records_size() !=
+                         records_index.chunk_begin_size())) {
+    return Fail(absl::InvalidArgumentError(absl::StrCat(
+        "Invalid index chunk: numbers of chunk positions and record counts "
+        "differ: ",
+        records_index.chunk_begin_size(),
+        " != ", records_index.num_records_size())));
+  }
+  if (ABSL_PREDICT_FALSE(
+          (records_index.min_key_size() != 0 ||
+           records_index.max_key_size() != 0) &&
+          (records_index.min_key_size() != records_index.chunk_begin_size() ||
+           records_index.max_key_size() != records_index.chunk_begin_size()))) {
+    return Fail(absl::InvalidArgumentError(absl::StrCat(
+        "Invalid index chunk: numbers of chunk positions and keys differ: ",
+        records_index.chunk_begin_size(), " != ",
+        records_index.min_key_size(), " or ", records_index.max_key_size())));
+  }
+  if (ABSL_PREDICT_FALSE(
+          (records_index.min_time_size() != 0 ||
+           records_index.max_time_size() != 0) &&
+          (records_index.min_time_size() != records_index.chunk_begin_size() ||
+           records_index.max_time_size() !=
+               records_index.chunk_begin_size()))) {
+    return Fail(absl::InvalidArgumentError(absl::StrCat(
+        "Invalid index chunk: numbers of chunk positions and times differ: ",
+        records_index.chunk_begin_size(), " != ",
+        records_index.min_time_size(), " or ",
+        records_index.max_time_size())));
+  }
+  index.chunk_begins.clear();
+  index.records_before.clear();
+  index.chunk_begins.reserve(IntCast<size_t>(records_index.chunk_begin_size()));
+  index.records_before.reserve(
+      IntCast<size_t>(records_index.chunk_begin_size()) + 1);
+  uint64_t records_before = 0;
+  for (int i = 0; i < records_index.chunk_begin_size(); ++i) {
+    if (ABSL_PREDICT_FALSE(i > 0 && records_index.chunk_begin(i) <=
+                                        records_index.chunk_begin(i - 1))) {
+      return Fail(absl::InvalidArgumentError(
+          "Invalid index chunk: chunk positions are not increasing"));
+    }
+    if (ABSL_PREDICT_FALSE(records_index.num_records(i) == 0 ||
+                           records_index.num_records(i) > kMaxNumRecords)) {
+      return Fail(absl::InvalidArgumentError(absl::StrCat(
+          "Invalid index chunk: invalid number of records in a chunk: ",
+          records_index.num_records(i))));
+    }
+    index.chunk_begins.push_back(Position{records_index.chunk_begin(i)});
+    index.records_before.push_back(records_before);
+    if (ABSL_PREDICT_FALSE(records_index.num_records(i) >
+                           std::numeric_limits<uint64_t>::max() -
+                               records_before)) {
+      return Fail(absl::InvalidArgumentError(
+          "Invalid index chunk: number of records overflows"));
+    }
+    records_before += records_index.num_records(i);
+  }
+  index.records_before.push_back(records_before);
+  index.min_keys.assign(records_index.min_key().begin(),
+                        records_index.min_key().end());
+  index.max_keys.assign(records_index.max_key().begin(),
+                        records_index.max_key().end());
+  index.max_times.clear();
+  index.max_times.reserve(IntCast<size_t>(records_index.max_time_size()));
+  for (const int64_t max_time : records_index.max_time()) {
+    const absl::Time time = absl::FromUnixNanos(max_time);
+    index.max_times.push_back(index.max_times.empty()
+                                  ? time
+                                  : std::max(index.max_times.back(), time));
+  }
+  return true;
+}
+
+inline bool RecordReaderBase::ParseSingleRecordChunk(const Chunk& chunk,
+                                                     Chain& record) {
   ChainReader<> data_reader(&chunk.data);
   TransposeDecoder transpose_decoder;
-  ChainBackwardWriter<> serialized_metadata_writer(
-      &metadata, ChainBackwardWriterBase::Options().set_size_hint(
-                     chunk.header.decoded_data_size()));
+  ChainBackwardWriter<> record_writer(
+      &record, ChainBackwardWriterBase::Options().set_size_hint(
+                   chunk.header.decoded_data_size()));
   std::vector<size_t> limits;
-  const bool ok = transpose_decoder.Decode(1, chunk.header.decoded_data_size(),
-                                           FieldProjection::All(), data_reader,
-                                           serialized_metadata_writer, limits);
-  if (ABSL_PREDICT_FALSE(!serialized_metadata_writer.Close())) {
-    return Fail(serialized_metadata_writer);
-  }
+  const bool ok = transpose_decoder.Decode(
+      ChunkType::kTransposed, 1, chunk.header.decoded_data_size(),
+      FieldProjection::All(), ZstdReaderBase::Dictionary(), BrotliDictionary(),
+      data_reader, record_writer, limits);
+  if (ABSL_PREDICT_FALSE(!record_writer.Close())) return Fail(record_writer);
   if (ABSL_PREDICT_FALSE(!ok)) return Fail(transpose_decoder);
   if (ABSL_PREDICT_FALSE(!data_reader.VerifyEndAndClose())) {
     return Fail(data_reader);
   }
   RIEGELI_ASSERT_EQ(limits.size(), 1u)
-      << "Metadata chunk has unexpected record limits";
-  RIEGELI_ASSERT_EQ(limits.back(), metadata.size())
-      << "Metadata chunk has unexpected record limits";
+      << "Single record chunk has unexpected record limits";
+  RIEGELI_ASSERT_EQ(limits.back(), record.size())
+      << "Single record chunk has unexpected record limits";
   return true;
 }
 
@@ -330,12 +972,164 @@ inline bool RecordReaderBase::ReadRecordImpl(Record& record) {
   }
 }
 
+bool RecordReaderBase::ReadRecords(size_t max_records,
+                                   std::vector<absl::string_view>& records) {
+  return ReadRecordsImpl(max_records, records);
+}
+
+bool RecordReaderBase::ReadRecords(size_t max_records,
+                                   std::vector<Chain>& records) {
+  return ReadRecordsImpl(max_records, records);
+}
+
+bool RecordReaderBase::ReadRecords(size_t max_records,
+                                   std::vector<absl::Cord>& records) {
+  return ReadRecordsImpl(max_records, records);
+}
+
+bool RecordReaderBase::ReadRecords(
+    size_t max_records, const google::protobuf::MessageLite& prototype,
+    google::protobuf::Arena& arena,
+    std::vector<google::protobuf::MessageLite*>& records) {
+  RIEGELI_ASSERT_GT(max_records, 0u)
+      << "Failed precondition of RecordReaderBase::ReadRecords(): "
+         "no records requested";
+  records.clear();
+  arena.Reset();
+  do {
+    google::protobuf::MessageLite* const record = prototype.New(&arena);
+    if (ABSL_PREDICT_FALSE(!ReadRecord(*record))) break;
+    records.push_back(record);
+  } while (records.size() < max_records &&
+           chunk_decoder_.index() < chunk_decoder_.num_records());
+  return !records.empty();
+}
+
+template <typename Record>
+inline bool RecordReaderBase::ReadRecordsImpl(size_t max_records,
+                                              std::vector<Record>& records) {
+  last_record_is_valid_ = false;
+  for (;;) {
+    if (ABSL_PREDICT_TRUE(chunk_decoder_.ReadRecords(max_records, records))) {
+      RIEGELI_ASSERT_GT(chunk_decoder_.index(), 0u)
+          << "ChunkDecoder::ReadRecords() left record index at 0";
+      last_record_is_valid_ = true;
+      return true;
+    }
+    if (ABSL_PREDICT_FALSE(!healthy())) {
+      if (!TryRecovery()) return false;
+      continue;
+    }
+    if (ABSL_PREDICT_FALSE(!chunk_decoder_.healthy())) {
+      recoverable_ = Recoverable::kRecoverChunkDecoder;
+      Fail(chunk_decoder_);
+      if (!TryRecovery()) return false;
+      continue;
+    }
+    if (ABSL_PREDICT_FALSE(!ReadChunk())) {
+      if (!TryRecovery()) return false;
+    }
+  }
+}
+
+bool RecordReaderBase::ReadChunk(Chunk& chunk) {
+  last_record_is_valid_ = false;
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (ABSL_PREDICT_FALSE(!dictionaries_checked_) &&
+      ABSL_PREDICT_FALSE(!LoadDictionaries())) {
+    return false;
+  }
+  ChunkReader& src = *src_chunk_reader();
+  if (ABSL_PREDICT_FALSE(read_ahead_ != nullptr) &&
+      !read_ahead_->chunks.empty()) {
+    // Chunks read ahead have been decoded, so they are read again.
+    const Position pos = ReadAheadPos();
+    DiscardReadAhead();
+    if (ABSL_PREDICT_FALSE(!src.Seek(pos))) {
+      chunk_begin_ = src.pos();
+      chunk_decoder_.Clear();
+      recoverable_ = Recoverable::kRecoverChunkReader;
+      return Fail(src);
+    }
+  }
+  chunk_decoder_.Clear();
+  for (;;) {
+    chunk_begin_ = src.pos();
+    // `Options::chunk_range_end()` is reported as the end of file.
+    if (ABSL_PREDICT_FALSE(chunk_begin_ >= chunk_range_end_)) return false;
+    if (ABSL_PREDICT_FALSE(
+            !ReadChunkFromSrc(src, VerifyNextChunkData(), chunk))) {
+      if (ABSL_PREDICT_FALSE(!src.healthy())) {
+        recoverable_ = Recoverable::kRecoverChunkReader;
+        return Fail(src);
+      }
+      return false;
+    }
+    if (chunk.header.num_records() > 0) return true;
+  }
+}
+
+bool RecordReaderBase::LookupImpl(const Field& field, absl::string_view value) {
+  last_record_is_valid_ = false;
+  for (;;) {
+    // Check the remaining records of the current chunk.
+    absl::string_view record;
+    while (chunk_decoder_.ReadRecord(record)) {
+      StringReader<> record_reader(record);
+      if (internal::HasFieldValue(record_reader, field, value)) {
+        chunk_decoder_.SetIndex(chunk_decoder_.index() - 1);
+        return true;
+      }
+    }
+    if (ABSL_PREDICT_FALSE(!healthy())) {
+      if (!TryRecovery()) return false;
+      continue;
+    }
+    if (ABSL_PREDICT_FALSE(!chunk_decoder_.healthy())) {
+      recoverable_ = Recoverable::kRecoverChunkDecoder;
+      Fail(chunk_decoder_);
+      if (!TryRecovery()) return false;
+      continue;
+    }
+    Chunk chunk;
+    if (ABSL_PREDICT_FALSE(!ReadChunk(chunk))) {
+      if (ABSL_PREDICT_FALSE(!healthy()) && TryRecovery()) continue;
+      return false;
+    }
+    if (chunk.header.chunk_type() == ChunkType::kTransposedV2) {
+      ChainReader<> data_reader(&chunk.data);
+      ChunkStatistics statistics;
+      // Invalid statistics are reported by decoding the chunk below.
+      if (internal::ReadChunkStatistics(data_reader, statistics)) {
+        const FieldBloomFilter* const bloom_filter =
+            statistics.FindBloomFilter(field);
+        if (bloom_filter != nullptr && !bloom_filter->MayContain(value)) {
+          continue;
+        }
+      }
+    }
+    const bool ok = chunk_decoder_.Decode(chunk);
+    buckets_decompressed_ += chunk_decoder_.buckets_decompressed();
+    bytes_skipped_ += chunk_decoder_.bytes_skipped();
+    stats_ += chunk_decoder_.stats();
+    ReportChunkDecoded();
+    if (ABSL_PREDICT_FALSE(!ok)) {
+      recoverable_ = Recoverable::kRecoverChunkDecoder;
+      Fail(chunk_decoder_);
+      if (!TryRecovery()) return false;
+    }
+  }
+}
+
 bool RecordReaderBase::SetFieldProjection(FieldProjection field_projection) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   ChunkReader& src = *src_chunk_reader();
   const uint64_t record_index = chunk_decoder_.index();
-  chunk_decoder_.Reset(ChunkDecoder::Options().set_field_projection(
-      std::move(field_projection)));
+  DiscardReadAhead();
+  chunk_decoder_options_.set_field_projection(std::move(field_projection));
+  // Cached chunks were decoded with the previous field projection.
+  if (chunk_cache_ != nullptr) chunk_cache_->Clear();
+  chunk_decoder_.Reset(chunk_decoder_options_);
   if (ABSL_PREDICT_FALSE(!src.Seek(chunk_begin_))) return FailSeeking(src);
   if (record_index > 0) {
     if (ABSL_PREDICT_FALSE(!ReadChunk())) return TryRecovery();
@@ -398,6 +1192,16 @@ bool RecordReaderBase::Seek(RecordPosition new_pos) {
       goto skip_reading_chunk;
     }
   } else {
+    CacheCurrentChunk();
+    DiscardReadAhead();
+    if (new_pos.record_index() > 0) {
+      bool from_cache;
+      if (ABSL_PREDICT_FALSE(
+              !TakeCachedChunk(new_pos.chunk_begin(), from_cache))) {
+        return false;
+      }
+      if (from_cache) goto skip_reading_chunk;
+    }
     if (ABSL_PREDICT_FALSE(!src.Seek(new_pos.chunk_begin()))) {
       return FailSeeking(src);
     }
@@ -419,11 +1223,15 @@ bool RecordReaderBase::Seek(Position new_pos) {
   last_record_is_valid_ = false;
   if (ABSL_PREDICT_FALSE(!healthy())) return TryRecovery();
   ChunkReader& src = *src_chunk_reader();
-  if (new_pos >= chunk_begin_ && new_pos <= src.pos()) {
+  const Position chunk_end =
+      ABSL_PREDICT_FALSE(read_ahead_ != nullptr) ? ReadAheadPos() : src.pos();
+  if (new_pos >= chunk_begin_ && new_pos <= chunk_end) {
     // Seeking inside or just after the current chunk which has been read,
     // or to the beginning of the current chunk which has been located,
     // or to the end of file which has been reached.
   } else {
+    CacheCurrentChunk();
+    DiscardReadAhead();
     if (ABSL_PREDICT_FALSE(!src.SeekToChunkContaining(new_pos))) {
       return FailSeeking(src);
     }
@@ -438,12 +1246,184 @@ bool RecordReaderBase::Seek(Position new_pos) {
       chunk_decoder_.Clear();
       return true;
     }
-    if (ABSL_PREDICT_FALSE(!ReadChunk())) return TryRecovery();
+    bool from_cache;
+    if (ABSL_PREDICT_FALSE(!TakeCachedChunk(src.pos(), from_cache))) {
+      return false;
+    }
+    if (!from_cache && ABSL_PREDICT_FALSE(!ReadChunk())) return TryRecovery();
   }
   chunk_decoder_.SetIndex(IntCast<uint64_t>(new_pos - chunk_begin_));
   return true;
 }
 
+bool RecordReaderBase::SeekToRecordNumber(uint64_t record_number) {
+  last_record_is_valid_ = false;
+  if (ABSL_PREDICT_FALSE(!healthy())) return TryRecovery();
+  if (use_index_ && index_ == nullptr) {
+    if (ABSL_PREDICT_FALSE(!ReadIndex())) return false;
+  }
+  ChunkReader& src = *src_chunk_reader();
+  if (index_ != nullptr && !index_->chunk_begins.empty()) {
+    const std::vector<uint64_t>& records_before = index_->records_before;
+    // Find the last chunk whose first record is at or before the record.
+    const size_t chunk_index =
+        IntCast<size_t>(std::upper_bound(records_before.begin(),
+                                         records_before.end() - 1,
+                                         record_number) -
+                        records_before.begin()) -
+        1;
+    return Seek(RecordPosition(
+        index_->chunk_begins[chunk_index],
+        UnsignedMin(record_number - records_before[chunk_index],
+                    records_before[chunk_index + 1] -
+                        records_before[chunk_index])));
+  }
+  // Without an index, skip chunks by reading only their headers.
+  DiscardReadAhead();
+  if (ABSL_PREDICT_FALSE(!src.Seek(0))) return FailSeeking(src);
+  uint64_t records_to_skip = record_number;
+  for (;;) {
+    const ChunkHeader* chunk_header;
+    if (ABSL_PREDICT_FALSE(!src.PullChunkHeader(&chunk_header))) {
+      chunk_begin_ = src.pos();
+      chunk_decoder_.Clear();
+      if (ABSL_PREDICT_FALSE(!src.healthy())) return FailReading(src);
+      // End of file reached.
+      return true;
+    }
+    if (chunk_header->num_records() > records_to_skip) break;
+    records_to_skip -= chunk_header->num_records();
+    if (ABSL_PREDICT_FALSE(!src.SeekToChunkAfter(src.pos() + 1))) {
+      return FailSeeking(src);
+    }
+  }
+  chunk_begin_ = src.pos();
+  chunk_decoder_.Clear();
+  return Seek(RecordPosition(chunk_begin_, records_to_skip));
+}
+
+bool RecordReaderBase::SearchByKey(
+    absl::string_view key,
+    absl::FunctionRef<std::string(absl::string_view record)> get_key) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  last_record_is_valid_ = false;
+  if (use_index_ && index_ == nullptr) {
+    if (ABSL_PREDICT_FALSE(!ReadIndex())) return false;
+  }
+  if (index_ == nullptr || index_->max_keys.empty()) {
+    return Search<absl::string_view>([&](absl::string_view record) {
+      return absl::string_view(get_key(record)) < key
+                 ? absl::partial_ordering::less
+                 : absl::partial_ordering::greater;
+    });
+  }
+  const std::vector<uint64_t>& records_before = index_->records_before;
+  // Find the earliest chunk containing a key not less than `key`.
+  const size_t chunk_index = IntCast<size_t>(
+      std::lower_bound(index_->max_keys.begin(), index_->max_keys.end(), key,
+                       [](const std::string& max_key, absl::string_view key) {
+                         return absl::string_view(max_key) < key;
+                       }) -
+      index_->max_keys.begin());
+  if (chunk_index == index_->max_keys.size()) {
+    // All keys are less than `key`. Seek to the end of the last chunk.
+    return Seek(RecordPosition(index_->chunk_begins.back(),
+                               records_before[chunk_index] -
+                                   records_before[chunk_index - 1]));
+  }
+  const Position chunk_begin = index_->chunk_begins[chunk_index];
+  if (absl::string_view(index_->min_keys[chunk_index]) >= key) {
+    return Seek(RecordPosition(chunk_begin, 0));
+  }
+  // The record is in this chunk, after its first record. Read the chunk and
+  // search its records.
+  if (ABSL_PREDICT_FALSE(!Seek(RecordPosition(chunk_begin, 1)))) return false;
+  if (ABSL_PREDICT_FALSE(chunk_begin_ != chunk_begin)) {
+    // The chunk was skipped by the recovery function.
+    return true;
+  }
+  uint64_t low = 1;
+  uint64_t high = chunk_decoder_.num_records();
+  while (low < high) {
+    const uint64_t middle = low + (high - low) / 2;
+    chunk_decoder_.SetIndex(middle);
+    absl::string_view record;
+    if (ABSL_PREDICT_FALSE(!chunk_decoder_.ReadRecord(record))) {
+      RIEGELI_ASSERT_UNREACHABLE()
+          << "Failed reading a record from ChunkDecoder: "
+          << chunk_decoder_.status();
+    }
+    if (absl::string_view(get_key(record)) < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  chunk_decoder_.SetIndex(low);
+  return true;
+}
+
+bool RecordReaderBase::SeekToTime(absl::Time time) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  last_record_is_valid_ = false;
+  if (use_index_ && index_ == nullptr) {
+    if (ABSL_PREDICT_FALSE(!ReadIndex())) return false;
+  }
+  if (ABSL_PREDICT_FALSE(index_ == nullptr || index_->max_times.empty())) {
+    return Fail(absl::FailedPreconditionError(
+        "RecordReaderBase::SeekToTime() requires "
+        "RecordReaderBase::Options::set_index() and an index with times, "
+        "written with RecordWriterBase::Options::set_index_time()"));
+  }
+  // Find the earliest chunk containing a time not earlier than `time`.
+  const size_t chunk_index = IntCast<size_t>(
+      std::lower_bound(index_->max_times.begin(), index_->max_times.end(),
+                       time) -
+      index_->max_times.begin());
+  if (chunk_index == index_->max_times.size()) {
+    // All times are earlier than `time`. Seek to the end of the last chunk.
+    const std::vector<uint64_t>& records_before = index_->records_before;
+    return Seek(RecordPosition(index_->chunk_begins.back(),
+                               records_before[chunk_index] -
+                                   records_before[chunk_index - 1]));
+  }
+  return Seek(RecordPosition(index_->chunk_begins[chunk_index], 0));
+}
+
+inline bool RecordReaderBase::ReadIndex() {
+  index_ = std::make_unique<Index>();
+  ChunkReader& src = *src_chunk_reader();
+  if (!src.SupportsRandomAccess()) return true;
+  DiscardReadAhead();
+  chunk_decoder_.Clear();
+  const absl::optional<Position> size = src.Size();
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return FailSeeking(src);
+  // The index is the last chunk, possibly followed by padding.
+  Position chunk_pos = *size;
+  while (chunk_pos > 0) {
+    if (ABSL_PREDICT_FALSE(!src.SeekToChunkBefore(chunk_pos - 1))) {
+      return FailSeeking(src);
+    }
+    chunk_pos = src.pos();
+    chunk_begin_ = chunk_pos;
+    const ChunkHeader* chunk_header;
+    if (ABSL_PREDICT_FALSE(!src.PullChunkHeader(&chunk_header))) {
+      if (ABSL_PREDICT_FALSE(!src.healthy())) return FailReading(src);
+      // The last chunk is truncated, the file has no complete index.
+      return true;
+    }
+    if (chunk_header->chunk_type() == ChunkType::kPadding) continue;
+    if (chunk_header->chunk_type() != ChunkType::kIndex) return true;
+    Chunk chunk;
+    if (ABSL_PREDICT_FALSE(!src.ReadChunk(chunk))) {
+      if (ABSL_PREDICT_FALSE(!src.healthy())) return FailReading(src);
+      return true;
+    }
+    return ParseIndex(chunk, *index_);
+  }
+  return true;
+}
+
 bool RecordReaderBase::SeekBack() {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   last_record_is_valid_ = false;
@@ -452,6 +1432,7 @@ bool RecordReaderBase::SeekBack() {
     return true;
   }
   ChunkReader& src = *src_chunk_reader();
+  DiscardReadAhead();
   Position chunk_pos = chunk_begin_;
   while (chunk_pos > 0) {
     if (ABSL_PREDICT_FALSE(!src.SeekToChunkBefore(chunk_pos - 1))) {
@@ -526,6 +1507,126 @@ class RecordReaderBase::ChunkSearchTraits {
   RecordReaderBase* self_;
 };
 
+// Records of a chunk from `record_index` until its end.
+struct RecordReaderBase::ChunkSuffix {
+  Position chunk_begin;
+  uint64_t record_index;
+  uint64_t num_records;
+};
+
+absl::optional<RecordPosition> RecordReaderBase::NarrowSearch(
+    absl::FunctionRef<absl::partial_ordering(RecordReaderBase& reader)> test,
+    Position& low, Position& high, absl::optional<ChunkSuffix>& less_found) {
+  if (ABSL_PREDICT_FALSE(!dictionaries_checked_) &&
+      ABSL_PREDICT_FALSE(!LoadDictionaries())) {
+    // Cancel the search.
+    return RecordPosition(low, 0);
+  }
+  struct Probe {
+    std::unique_ptr<ChunkReader> src;
+    Position chunk_begin = 0;
+    Position chunk_end = 0;
+    ChunkDecoder chunk_decoder;
+    // Whether `chunk_decoder` holds some records of a chunk beginning in the
+    // searched range.
+    bool ok = false;
+  };
+  std::vector<Probe> probes(IntCast<size_t>(search_fanout_ - 1));
+  for (Probe& probe : probes) {
+    probe.src = search_src_factory_();
+    RIEGELI_ASSERT(probe.src != nullptr)
+        << "Failed precondition of RecordReaderBase::Search(): "
+           "search_src_factory() returned nullptr";
+  }
+  ChunkReader& src = *src_chunk_reader();
+  while (low < high) {
+    // Probes are read and decoded in the global thread pool rather than in
+    // `chunk_decoder_options_.executor()`, because decoding a chunk may wait
+    // for tasks in that `Executor`.
+    absl::BlockingCounter pending_probes(IntCast<int>(probes.size()));
+    for (size_t i = 0; i < probes.size(); ++i) {
+      Probe* const probe = &probes[i];
+      const Position target =
+          low + (high - low) / IntCast<Position>(search_fanout_) *
+                    IntCast<Position>(i + 1);
+      internal::ThreadPool::global().Schedule([this, probe, target, low, high,
+                                               &pending_probes] {
+        // A failure of a probe only makes it uninformative. Failures which
+        // matter are reported by reading from `src_chunk_reader()` later.
+        probe->ok = false;
+        ChunkReader& probe_src = *probe->src;
+        if (probe_src.SeekToChunkBefore(target) && probe_src.pos() >= low &&
+            probe_src.pos() < high) {
+          probe->chunk_begin = probe_src.pos();
+          Chunk chunk;
+          if (probe_src.ReadChunk(chunk)) {
+            probe->chunk_end = probe_src.pos();
+            probe->chunk_decoder.Reset(chunk_decoder_options_);
+            probe->ok = probe->chunk_decoder.Decode(chunk) &&
+                        probe->chunk_decoder.num_records() > 0;
+          }
+        }
+        pending_probes.DecrementCount();
+      });
+    }
+    pending_probes.Wait();
+
+    Position new_low = low;
+    Position new_high = high;
+    absl::optional<Position> last_chunk_begin;
+    for (Probe& probe : probes) {
+      // Several probes can find the same chunk if chunks are large relatively
+      // to the range.
+      if (!probe.ok || probe.chunk_begin == last_chunk_begin) continue;
+      last_chunk_begin = probe.chunk_begin;
+      if (ABSL_PREDICT_FALSE(!src.Seek(probe.chunk_end))) {
+        if (!FailSeeking(src)) {
+          // Cancel the search.
+          return RecordPosition(low, 0);
+        }
+        continue;
+      }
+      chunk_begin_ = probe.chunk_begin;
+      chunk_decoder_ = std::move(probe.chunk_decoder);
+      buckets_decompressed_ += chunk_decoder_.buckets_decompressed();
+      bytes_skipped_ += chunk_decoder_.bytes_skipped();
+      stats_ += chunk_decoder_.stats();
+      ReportChunkDecoded();
+      const uint64_t num_records = chunk_decoder_.num_records();
+      if (ABSL_PREDICT_FALSE(!Seek(RecordPosition(probe.chunk_begin, 0)))) {
+        // Cancel the search.
+        return RecordPosition(low, 0);
+      }
+      const absl::partial_ordering ordering = test(*this);
+      if (ABSL_PREDICT_FALSE(!healthy())) {
+        // Reading the record made the `RecordReader` unhealthy, probably
+        // because a message could not be parsed (or `test()` did something
+        // unusual).
+        if (!TryRecovery()) {
+          // Cancel the search.
+          return RecordPosition(low, 0);
+        }
+        // Consider the skipped record unordered.
+        continue;
+      }
+      if (ordering < 0) {
+        less_found = ChunkSuffix{probe.chunk_begin, 1, num_records};
+        new_low = probe.chunk_end;
+        continue;
+      }
+      if (ordering == 0) return RecordPosition(probe.chunk_begin, 0);
+      if (ordering > 0) {
+        new_high = probe.chunk_begin;
+        break;
+      }
+    }
+    if (new_low == low && new_high == high) break;
+    low = new_low;
+    high = new_high;
+  }
+  return absl::nullopt;
+}
+
 bool RecordReaderBase::Search(
     absl::FunctionRef<absl::partial_ordering(RecordReaderBase& reader)> test) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
@@ -533,15 +1634,24 @@ bool RecordReaderBase::Search(
   ChunkReader& src = *src_chunk_reader();
   const absl::optional<Position> size = src.Size();
   if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return Fail(src);
-  struct ChunkSuffix {
-    Position chunk_begin;
-    uint64_t record_index;
-    uint64_t num_records;
-  };
+  // Probing chunks during the search does not benefit from reading ahead.
+  std::unique_ptr<ReadAhead> read_ahead = std::move(read_ahead_);
+  if (read_ahead != nullptr) read_ahead->chunks.clear();
   absl::optional<ChunkSuffix> less_found;
   uint64_t greater_record_index = 0;
+  Position low = 0;
+  Position high = *size;
+  if (search_fanout_ > 2 && search_src_factory_ != nullptr) {
+    const absl::optional<RecordPosition> finished =
+        NarrowSearch(test, low, high, less_found);
+    if (finished != absl::nullopt) {
+      read_ahead_ = std::move(read_ahead);
+      if (ABSL_PREDICT_FALSE(!Seek(*finished))) return healthy();
+      return true;
+    }
+  }
   const Position greater_chunk_begin = BinarySearch(
-      0, *size,
+      low, high,
       [&](Position chunk_begin) {
         if (ABSL_PREDICT_FALSE(!src.Seek(chunk_begin))) {
           if (!FailSeeking(src)) {
@@ -655,6 +1765,7 @@ bool RecordReaderBase::Search(
       position = RecordPosition(less_chunk_begin, less_record_index);
     }
   }
+  read_ahead_ = std::move(read_ahead);
   if (ABSL_PREDICT_FALSE(!Seek(position))) return healthy();
   return true;
 }
@@ -662,10 +1773,40 @@ bool RecordReaderBase::Search(
 inline bool RecordReaderBase::ReadChunk() {
   RIEGELI_ASSERT(healthy())
       << "Failed precondition of RecordReaderBase::ReadChunk(): " << status();
+  if (ABSL_PREDICT_FALSE(!dictionaries_checked_) &&
+      ABSL_PREDICT_FALSE(!LoadDictionaries())) {
+    return false;
+  }
   ChunkReader& src = *src_chunk_reader();
+  if (read_ahead_ != nullptr) {
+    read_ahead_->Fill(src, *this);
+    if (ABSL_PREDICT_TRUE(!read_ahead_->chunks.empty())) {
+      ReadAhead::DecodedChunk& decoded_chunk = read_ahead_->chunks.front();
+      chunk_begin_ = decoded_chunk.chunk_begin;
+      chunk_decoder_ = decoded_chunk.chunk_decoder.get();
+      read_ahead_->chunks.pop_front();
+      buckets_decompressed_ += chunk_decoder_.buckets_decompressed();
+      bytes_skipped_ += chunk_decoder_.bytes_skipped();
+      stats_ += chunk_decoder_.stats();
+      ReportChunkDecoded();
+      if (ABSL_PREDICT_FALSE(!chunk_decoder_.healthy())) {
+        recoverable_ = Recoverable::kRecoverChunkDecoder;
+        return Fail(chunk_decoder_);
+      }
+      return true;
+    }
+    // No chunk could be read ahead. Reading it again below reports the end of
+    // file or the failure.
+  }
   chunk_begin_ = src.pos();
+  if (ABSL_PREDICT_FALSE(chunk_begin_ >= chunk_range_end_)) {
+    // `Options::chunk_range_end()` is reported as the end of file.
+    chunk_decoder_.Clear();
+    return false;
+  }
   Chunk chunk;
-  if (ABSL_PREDICT_FALSE(!src.ReadChunk(chunk))) {
+  if (ABSL_PREDICT_FALSE(
+          !ReadChunkFromSrc(src, VerifyNextChunkData(), chunk))) {
     chunk_decoder_.Clear();
     if (ABSL_PREDICT_FALSE(!src.healthy())) {
       recoverable_ = Recoverable::kRecoverChunkReader;
@@ -673,11 +1814,79 @@ inline bool RecordReaderBase::ReadChunk() {
     }
     return false;
   }
-  if (ABSL_PREDICT_FALSE(!chunk_decoder_.Decode(chunk))) {
+  if (ABSL_PREDICT_FALSE(chunk_decoder_.NeedsReference(chunk)) &&
+      ABSL_PREDICT_FALSE(!LoadReference())) {
+    return false;
+  }
+  const bool ok = chunk_decoder_.Decode(chunk);
+  buckets_decompressed_ += chunk_decoder_.buckets_decompressed();
+  bytes_skipped_ += chunk_decoder_.bytes_skipped();
+  stats_ += chunk_decoder_.stats();
+  ReportChunkDecoded();
+  if (ABSL_PREDICT_FALSE(!ok)) {
     recoverable_ = Recoverable::kRecoverChunkDecoder;
     return Fail(chunk_decoder_);
   }
   return true;
 }
 
+bool RecordReaderBase::LoadReference() {
+  ChunkReader& src = *src_chunk_reader();
+  if (!src.SupportsRandomAccess()) return true;
+  const Position chunk_end = src.pos();
+  // Chunks back to the first one which does not need a reference, in reverse
+  // order.
+  std::vector<Chunk> chunks;
+  Position pos = chunk_begin_;
+  while (pos > 0) {
+    if (ABSL_PREDICT_FALSE(!src.SeekToChunkBefore(pos - 1))) break;
+    pos = src.pos();
+    Chunk chunk;
+    if (ABSL_PREDICT_FALSE(!src.ReadChunk(chunk))) break;
+    // Skip padding.
+    if (chunk.header.num_records() == 0) continue;
+    // Another chunk with records can not be a reference. Decoding reports the
+    // missing reference.
+    if (chunk.header.chunk_type() != ChunkType::kPrefixed) break;
+    const bool needs_reference = chunk_decoder_.NeedsReference(chunk);
+    chunks.push_back(std::move(chunk));
+    if (!needs_reference) break;
+  }
+  // Failures are reported after returning to `chunk_end`, so that recovery
+  // skips the chunk at `chunk_begin_`.
+  bool decoded = true;
+  if (src.healthy()) {
+    for (auto iter = chunks.rbegin(); iter != chunks.rend(); ++iter) {
+      decoded = chunk_decoder_.Decode(*iter);
+      if (ABSL_PREDICT_FALSE(!decoded)) break;
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!src.Seek(chunk_end))) {
+    chunk_decoder_.Clear();
+    recoverable_ = Recoverable::kRecoverChunkReader;
+    return Fail(src);
+  }
+  if (ABSL_PREDICT_FALSE(!decoded)) {
+    recoverable_ = Recoverable::kRecoverChunkDecoder;
+    return Fail(chunk_decoder_);
+  }
+  return true;
+}
+
+size_t RecordReaderBase::EstimateMemory() const {
+  size_t memory = chunk_decoder_.EstimateMemory();
+  if (chunk_cache_ != nullptr) {
+    memory = SaturatingAdd(memory, chunk_cache_->size());
+  }
+  if (read_ahead_ != nullptr) {
+    for (const ReadAhead::DecodedChunk& decoded_chunk : read_ahead_->chunks) {
+      memory = SaturatingAdd(
+          memory, SaturatingIntCast<size_t>(decoded_chunk.decoded_data_size));
+    }
+  }
+  const ChunkReader* const src = src_chunk_reader();
+  if (src != nullptr) memory = SaturatingAdd(memory, src->EstimateMemory());
+  return memory;
+}
+
 }  // namespace riegeli
@@ -15,38 +15,54 @@
 #ifndef RIEGELI_RECORDS_RECORD_READER_H_
 #define RIEGELI_RECORDS_RECORD_READER_H_
 
+#include <stddef.h>
+
 #include <functional>
+#include <limits>
 #include <memory>
 #include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/functional/function_ref.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/compare.h"
 #include "absl/types/optional.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
 #include "riegeli/base/dependency.h"
 #include "riegeli/base/object.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/chunk_encoding/chunk.h"
 #include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
 #include "riegeli/chunk_encoding/field_projection.h"
 #include "riegeli/records/chunk_reader.h"
 #include "riegeli/records/chunk_reader_dependency.h"
 #include "riegeli/records/record_position.h"
 #include "riegeli/records/records_metadata.pb.h"
+#include "riegeli/records/records_observer.h"
 #include "riegeli/records/skipped_region.h"
 
 namespace riegeli {
 
 // Interprets `record_type_name` and `file_descriptor` from metadata.
+//
+// Descriptors built from the same `file_descriptor` are cached process-wide and
+// shared, so that interpreting metadata of many files with the same schema
+// builds the `google::protobuf::DescriptorPool` once.
 class RecordsMetadataDescriptors : public Object {
  public:
   explicit RecordsMetadataDescriptors(const RecordsMetadata& metadata);
@@ -61,14 +77,27 @@ class RecordsMetadataDescriptors : public Object {
   // object is valid.
   const google::protobuf::Descriptor* descriptor() const;
 
+  // Returns the default instance of a dynamic message of the record type, or
+  // `nullptr` if not available. A mutable message can be created with `New()`.
+  //
+  // The prototype is valid as long as the `RecordsMetadataDescriptors` object
+  // is valid. Messages created from it must not outlive it.
+  const google::protobuf::Message* prototype() const;
+
   // Returns record type full name, or an empty string if not available.
   const std::string& record_type_name() const { return record_type_name_; }
 
  private:
   class ErrorCollector;
+  struct Schema;
+
+  // Returns a cached `Schema` built from `metadata.file_descriptor()`, building
+  // it if needed.
+  static std::shared_ptr<const Schema> GetSchema(
+      const RecordsMetadata& metadata);
 
   std::string record_type_name_;
-  std::unique_ptr<google::protobuf::DescriptorPool> pool_;
+  std::shared_ptr<const Schema> schema_;
 };
 
 // Template parameter independent part of `RecordReader`.
@@ -84,7 +113,8 @@ class RecordReaderBase : public Object {
     //
     // Projection is effective if the file has been written with
     // `set_transpose(true)`. Additionally, `set_bucket_fraction()` with a lower
-    // value can make reading with projection faster.
+    // value can make reading with projection faster. For files written without
+    // transposition, see `set_project_simple_chunks()`.
     //
     // Default: `FieldProjection::All()`.
     Options& set_field_projection(const FieldProjection& field_projection) & {
@@ -106,6 +136,40 @@ class RecordReaderBase : public Object {
       return field_projection_;
     }
 
+    // If `true` and `field_projection()` does not include all fields, records
+    // of chunks written with `set_transpose(false)` are projected too, by
+    // scanning their wire format and dropping fields which are not included.
+    // This does not avoid decompression, but saves parsing excluded fields.
+    //
+    // Default: `false`.
+    Options& set_project_simple_chunks(bool project_simple_chunks) & {
+      project_simple_chunks_ = project_simple_chunks;
+      return *this;
+    }
+    Options&& set_project_simple_chunks(bool project_simple_chunks) && {
+      return std::move(set_project_simple_chunks(project_simple_chunks));
+    }
+    bool project_simple_chunks() const { return project_simple_chunks_; }
+
+    // If not `nullptr`, called with statistics stored in a transposed chunk,
+    // written with `RecordWriterBase::Options::set_column_statistics()` or
+    // `RecordWriterBase::Options::set_bloom_filter_fields()`. If it returns
+    // `false`, records of the chunk are skipped without decompressing them.
+    //
+    // The filter should return `false` only if no record of the chunk can be
+    // of interest. Records of chunks without statistics are always read.
+    //
+    // Default: `nullptr`.
+    Options& set_chunk_filter(ChunkFilter chunk_filter) & {
+      chunk_filter_ = std::move(chunk_filter);
+      return *this;
+    }
+    Options&& set_chunk_filter(ChunkFilter chunk_filter) && {
+      return std::move(set_chunk_filter(std::move(chunk_filter)));
+    }
+    ChunkFilter& chunk_filter() { return chunk_filter_; }
+    const ChunkFilter& chunk_filter() const { return chunk_filter_; }
+
     // Sets the recovery function to be called after skipping over invalid file
     // contents.
     //
@@ -158,11 +222,322 @@ class RecordReaderBase : public Object {
       return recovery_;
     }
 
+    // Sets the maximum number of chunks being decoded in parallel in
+    // background. Larger parallelism can increase throughput, up to a point
+    // where it no longer matters; smaller parallelism reduces memory usage.
+    //
+    // If `parallelism > 0`, chunks are read ahead from the `ChunkReader` in
+    // the reading thread and decoded in background, and chunks which are
+    // read ahead are discarded when the `RecordReader` seeks elsewhere. Records
+    // are still returned in order, and `pos()` and `Seek()` are unaffected.
+    //
+    // Chunks written with `RecordWriterBase::Options::set_keyframe_interval()`
+    // depend on the previous chunk, and are decoded in the reading thread.
+    //
+    // Default: 0.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GE(parallelism, 0)
+          << "Failed precondition of "
+             "RecordReaderBase::Options::set_parallelism(): "
+             "negative parallelism";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+    // Sets the `Executor` which decodes chunks in background, if
+    // `parallelism() > 0`, and which decompresses data buckets of a transposed
+    // chunk concurrently, even if `parallelism() == 0`.
+    //
+    // Sharing an `Executor` among many `RecordReader`s and `RecordWriter`s
+    // bounds the total number of threads which decode and encode their chunks,
+    // while serving them in turns.
+    //
+    // If `nullptr`, chunks are decoded in a global thread pool which creates
+    // threads without a limit.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+    // Sets the `RecordsObserver` which receives events about reading and
+    // decoding chunks, with their timings.
+    //
+    // Events are delivered by the thread which reads records, even if
+    // `parallelism() > 0`.
+    //
+    // If `nullptr`, events are not timed.
+    //
+    // Default: `nullptr`.
+    Options& set_observer(std::shared_ptr<RecordsObserver> observer) & {
+      observer_ = std::move(observer);
+      return *this;
+    }
+    Options&& set_observer(std::shared_ptr<RecordsObserver> observer) && {
+      return std::move(set_observer(std::move(observer)));
+    }
+    std::shared_ptr<RecordsObserver>& observer() { return observer_; }
+    const std::shared_ptr<RecordsObserver>& observer() const {
+      return observer_;
+    }
+
+    // If `true`, decoded records of a chunk are stored in a single flat
+    // buffer, copying them there once per chunk if needed. Then
+    // `ReadRecord(absl::string_view&)` never copies a record, and
+    // `ReadRecord(absl::Cord&)` shares chunk memory instead of copying records
+    // which are not small.
+    //
+    // This costs a copy of decoded data of chunks which are not already flat,
+    // and makes memory of a whole chunk live as long as any `absl::Cord`
+    // sharing it.
+    //
+    // Default: `false`.
+    Options& set_contiguous_records(bool contiguous_records) & {
+      contiguous_records_ = contiguous_records;
+      return *this;
+    }
+    Options&& set_contiguous_records(bool contiguous_records) && {
+      return std::move(set_contiguous_records(contiguous_records));
+    }
+    bool contiguous_records() const { return contiguous_records_; }
+
+    // If `true`, `SeekToRecordNumber()` reads the index written with
+    // `RecordWriterBase::Options::set_index()` when it is first needed, and
+    // uses it if the file has one. This requires `SupportsRandomAccess()`.
+    //
+    // If `false`, or if the file has no index, `SeekToRecordNumber()` reads
+    // chunk headers from the beginning of the file.
+    //
+    // Default: `false`.
+    Options& set_index(bool index) & {
+      index_ = index;
+      return *this;
+    }
+    Options&& set_index(bool index) && { return std::move(set_index(index)); }
+    bool index() const { return index_; }
+
+    // Fraction of chunks containing records whose data are verified against
+    // the hash stored in the chunk header, in the range [0.0..1.0]. Verified
+    // chunks are spread evenly.
+    //
+    // Chunk headers are always verified, so chunk boundaries are trustworthy
+    // regardless of this setting. File metadata and the index are always
+    // verified too.
+    //
+    // Lowering this makes reading faster when the storage is trusted to detect
+    // corruption by itself. Undetected corruption of unverified chunk data can
+    // make records differ from what was written, or make decoding fail.
+    //
+    // If `parallelism() > 0`, verification is performed in background together
+    // with decoding.
+    //
+    // Default: 1.0.
+    Options& set_data_verification_fraction(
+        double data_verification_fraction) & {
+      RIEGELI_ASSERT_GE(data_verification_fraction, 0.0)
+          << "Failed precondition of "
+             "RecordReaderBase::Options::set_data_verification_fraction(): "
+             "negative data verification fraction";
+      RIEGELI_ASSERT_LE(data_verification_fraction, 1.0)
+          << "Failed precondition of "
+             "RecordReaderBase::Options::set_data_verification_fraction(): "
+             "fraction larger than 1";
+      data_verification_fraction_ = data_verification_fraction;
+      return *this;
+    }
+    Options&& set_data_verification_fraction(
+        double data_verification_fraction) && {
+      return std::move(
+          set_data_verification_fraction(data_verification_fraction));
+    }
+    double data_verification_fraction() const {
+      return data_verification_fraction_;
+    }
+
+    // Restricts reading to chunks which begin in the range [`begin`..`end`) of
+    // file positions. This partitions a file between independent readers at
+    // chunk granularity without overlap: e.g. shard `i` of `n` can use
+    // `set_chunk_range(size * i / n, size * (i + 1) / n)`.
+    //
+    // If `begin > 0`, reading starts from the first chunk beginning at or after
+    // `begin`. This requires `SupportsRandomAccess()`. Reading reports the end
+    // of file before the first chunk beginning at or after `end`.
+    //
+    // `Seek()` and related functions are not restricted, but sequential
+    // reading after them still stops before `end`.
+    //
+    // Default: [0..`std::numeric_limits<Position>::max()`) (the whole file).
+    Options& set_chunk_range(Position begin, Position end) & {
+      RIEGELI_ASSERT_LE(begin, end)
+          << "Failed precondition of "
+             "RecordReaderBase::Options::set_chunk_range(): "
+             "range in reverse order";
+      chunk_range_begin_ = begin;
+      chunk_range_end_ = end;
+      return *this;
+    }
+    Options&& set_chunk_range(Position begin, Position end) && {
+      return std::move(set_chunk_range(begin, end));
+    }
+    Position chunk_range_begin() const { return chunk_range_begin_; }
+    Position chunk_range_end() const { return chunk_range_end_; }
+
+    // If positive, chunks which have been decoded are kept in a cache of up to
+    // this total size of records when `Seek()` leaves them, so that seeking
+    // back into a recently visited chunk does not read and decode it again.
+    // Chunks are evicted in LRU order.
+    //
+    // This helps random access alternating between a few chunks. Sequential
+    // reading does not fill the cache.
+    //
+    // Default: 0 (no cache).
+    Options& set_chunk_cache_size(size_t chunk_cache_size) & {
+      chunk_cache_size_ = chunk_cache_size;
+      return *this;
+    }
+    Options&& set_chunk_cache_size(size_t chunk_cache_size) && {
+      return std::move(set_chunk_cache_size(chunk_cache_size));
+    }
+    size_t chunk_cache_size() const { return chunk_cache_size_; }
+
+    // If greater than 2 and `search_src_factory()` is set, `Search()` begins
+    // with a k-ary search over chunks: each round probes
+    // `search_fanout() - 1` chunks evenly spaced in the searched range,
+    // reading and decoding them concurrently, and then tests their first
+    // records. This narrows the range by a factor of `search_fanout()` per
+    // round, at the latency of one read, instead of by 2 per read. When a
+    // round does not narrow the range, the search continues as a binary
+    // search.
+    //
+    // This helps on storage with high latency which serves concurrent reads.
+    //
+    // Default: 2 (binary search).
+    Options& set_search_fanout(int search_fanout) & {
+      RIEGELI_ASSERT_GE(search_fanout, 2)
+          << "Failed precondition of "
+             "RecordReaderBase::Options::set_search_fanout(): "
+             "fanout smaller than 2";
+      search_fanout_ = search_fanout;
+      return *this;
+    }
+    Options&& set_search_fanout(int search_fanout) && {
+      return std::move(set_search_fanout(search_fanout));
+    }
+    int search_fanout() const { return search_fanout_; }
+
+    // Creates additional `ChunkReader`s reading the same file, which probe
+    // chunks concurrently during `Search()` if `search_fanout() > 2`.
+    // `search_fanout() - 1` of them are created per `Search()`, and each is
+    // used by one thread at a time.
+    //
+    // The returned `ChunkReader` must not be `nullptr`.
+    //
+    // Default: `nullptr` (binary search).
+    Options& set_search_src_factory(
+        std::function<std::unique_ptr<ChunkReader>()> search_src_factory) & {
+      search_src_factory_ = std::move(search_src_factory);
+      return *this;
+    }
+    Options&& set_search_src_factory(
+        std::function<std::unique_ptr<ChunkReader>()> search_src_factory) && {
+      return std::move(set_search_src_factory(std::move(search_src_factory)));
+    }
+    std::function<std::unique_ptr<ChunkReader>()>& search_src_factory() {
+      return search_src_factory_;
+    }
+    const std::function<std::unique_ptr<ChunkReader>()>& search_src_factory()
+        const {
+      return search_src_factory_;
+    }
+
+    // Brotli dictionary used for decompressing chunks. It must be the
+    // dictionary given to `RecordWriterBase::Options::set_brotli_dictionary()`
+    // when the file was written, which is verified against the identifier
+    // stored in file metadata.
+    //
+    // Unlike a Zstd dictionary, a Brotli dictionary is not stored in the file,
+    // so that it can be shared by many files.
+    //
+    // Default: `BrotliDictionary()` (no dictionary).
+    Options& set_brotli_dictionary(
+        const BrotliDictionary& brotli_dictionary) & {
+      brotli_dictionary_ = brotli_dictionary;
+      return *this;
+    }
+    Options& set_brotli_dictionary(BrotliDictionary&& brotli_dictionary) & {
+      brotli_dictionary_ = std::move(brotli_dictionary);
+      return *this;
+    }
+    Options&& set_brotli_dictionary(
+        const BrotliDictionary& brotli_dictionary) && {
+      return std::move(set_brotli_dictionary(brotli_dictionary));
+    }
+    Options&& set_brotli_dictionary(BrotliDictionary&& brotli_dictionary) && {
+      return std::move(set_brotli_dictionary(std::move(brotli_dictionary)));
+    }
+    BrotliDictionary& brotli_dictionary() { return brotli_dictionary_; }
+    const BrotliDictionary& brotli_dictionary() const {
+      return brotli_dictionary_;
+    }
+
+    // If set, the file is trusted to have these serialized `RecordsMetadata`
+    // and a valid file signature, e.g. because the caller cached metadata
+    // returned by `ReadSerializedMetadata()` together with a fingerprint of
+    // the file, and the fingerprint matches.
+    //
+    // This makes opening a file cheap for short-lived point lookups:
+    // `CheckFileFormat()` does not read the file signature, `ReadMetadata()`
+    // returns these metadata without reading the file, and reading from a
+    // position other than the beginning does not first read the file
+    // signature and metadata to load compression dictionaries. The first
+    // record is then available after one read.
+    //
+    // Default: `absl::nullopt` (the file signature and metadata are read from
+    // the file).
+    Options& set_trusted_metadata(absl::optional<Chain> trusted_metadata) & {
+      trusted_metadata_ = std::move(trusted_metadata);
+      return *this;
+    }
+    Options&& set_trusted_metadata(absl::optional<Chain> trusted_metadata) && {
+      return std::move(set_trusted_metadata(std::move(trusted_metadata)));
+    }
+    absl::optional<Chain>& trusted_metadata() { return trusted_metadata_; }
+    const absl::optional<Chain>& trusted_metadata() const {
+      return trusted_metadata_;
+    }
+
    private:
     FieldProjection field_projection_ = FieldProjection::All();
+    bool project_simple_chunks_ = false;
+    ChunkFilter chunk_filter_;
     std::function<bool(const SkippedRegion&)> recovery_;
+    int parallelism_ = 0;
+    std::shared_ptr<Executor> executor_;
+    std::shared_ptr<RecordsObserver> observer_;
+    bool contiguous_records_ = false;
+    bool index_ = false;
+    double data_verification_fraction_ = 1.0;
+    Position chunk_range_begin_ = 0;
+    Position chunk_range_end_ = std::numeric_limits<Position>::max();
+    size_t chunk_cache_size_ = 0;
+    int search_fanout_ = 2;
+    std::function<std::unique_ptr<ChunkReader>()> search_src_factory_;
+    BrotliDictionary brotli_dictionary_;
+    absl::optional<Chain> trusted_metadata_;
   };
 
+  ~RecordReaderBase();
+
   // Returns the Riegeli/records file being read from. Unchanged by `Close()`.
   virtual ChunkReader* src_chunk_reader() = 0;
   virtual const ChunkReader* src_chunk_reader() const = 0;
@@ -217,6 +592,81 @@ class RecordReaderBase : public Object {
   bool ReadRecord(Chain& record);
   bool ReadRecord(absl::Cord& record);
 
+  // Reads the next chunk of records as is, without decoding it, e.g. to write
+  // it to another file with `RecordWriterBase::WriteChunk()`. Records of the
+  // current chunk which have not been read yet are skipped. Chunks without
+  // records are skipped.
+  //
+  // Decoding the chunk requires the file metadata of this file, e.g. a Zstd
+  // dictionary stored there.
+  //
+  // Afterwards `pos()` is the position after the chunk.
+  //
+  // Return values:
+  //  * `true`                      - success (`chunk` is set)
+  //  * `false` (when `healthy()`)  - source ends
+  //  * `false` (when `!healthy()`) - failure
+  bool ReadChunk(Chunk& chunk);
+
+  // Reads up to `max_records` next records, replacing the contents of
+  // `records`.
+  //
+  // Records are returned only from the current chunk, so fewer than
+  // `max_records` can be returned even if more records follow. This avoids
+  // per-record overhead of `ReadRecord()` when records are small.
+  //
+  // For `ReadRecords(size_t, std::vector<absl::string_view>&)` the
+  // `absl::string_view`s are valid until the next non-const operation on this
+  // `RecordReader`.
+  //
+  // `last_pos()` refers to the last record returned.
+  //
+  // Precondition: `max_records > 0`
+  //
+  // Return values:
+  //  * `true`                      - success (`records` is not empty)
+  //  * `false` (when `healthy()`)  - source ends (`records` is empty)
+  //  * `false` (when `!healthy()`) - failure (`records` is empty)
+  bool ReadRecords(size_t max_records, std::vector<absl::string_view>& records);
+  bool ReadRecords(size_t max_records, std::vector<Chain>& records);
+  bool ReadRecords(size_t max_records, std::vector<absl::Cord>& records);
+
+  // Like `ReadRecords()`, but parses the records as new messages of the same
+  // type as `prototype`, created on `arena`, and sets `records` to point to
+  // them.
+  //
+  // `arena` is reset first, which destroys messages returned by the previous
+  // call with the same `arena`. Reusing the `arena` for consecutive batches
+  // avoids separate heap allocations for each parsed message.
+  //
+  // If a record cannot be parsed after some records of the batch have been
+  // parsed, the parsed records are returned, and the failure is reported by the
+  // next call. In this case `last_record_is_valid()` is `false`, otherwise
+  // `last_pos()` refers to the last record returned.
+  //
+  // Precondition: `max_records > 0`
+  //
+  // Return values:
+  //  * `true`                      - success (`records` is not empty)
+  //  * `false` (when `healthy()`)  - source ends (`records` is empty)
+  //  * `false` (when `!healthy()`) - failure (`records` is empty)
+  bool ReadRecords(size_t max_records,
+                   const google::protobuf::MessageLite& prototype,
+                   google::protobuf::Arena& arena,
+                   std::vector<google::protobuf::MessageLite*>& records);
+
+  // Returns `true` if the source is truncated (in the middle of a chunk) after
+  // the records read so far, i.e. the last `ReadRecord()` returned `false`
+  // when `healthy()` because the last chunk is incomplete rather than because
+  // the file ends at a chunk boundary. In such case, if the source does not
+  // grow, `Close()` will fail.
+  //
+  // This allows to follow a file which is being written, like `tail -f`: when
+  // `ReadRecord()` returns `false` and `healthy()`, reading can be retried
+  // after the source grows, e.g. after `FileGrowthWaiter::Wait()`. Reading
+  // continues from the incomplete chunk.
+  bool truncated() const;
+
   // Like `Options::set_field_projection()`, but can be done at any time.
   //
   // This may cause reading the current chunk again.
@@ -301,6 +751,17 @@ class RecordReaderBase : public Object {
   bool Seek(RecordPosition new_pos);
   bool Seek(Position new_pos);
 
+  // Seeks to the record with the given ordinal number, counting from 0, or to
+  // the end of file if there are not that many records.
+  //
+  // This uses the index if `Options::index()` and the file has one, otherwise
+  // it reads chunk headers from the beginning of the file.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool SeekToRecordNumber(uint64_t record_number);
+
   // Seeks back by one record.
   //
   // Return values:
@@ -315,6 +776,39 @@ class RecordReaderBase : public Object {
   // Returns `absl::nullopt` on failure (`!healthy()`).
   absl::optional<Position> Size();
 
+  // Statistics of field projection, accumulated over transposed chunks decoded
+  // so far. They help to tune
+  // `RecordWriterBase::Options::set_bucket_fraction()` for the projections
+  // which are used for reading.
+  //
+  // `buckets_decompressed()` is the number of data buckets which were
+  // decompressed. `bytes_skipped()` is the total compressed size of data
+  // buckets which were not decompressed because they contained no included
+  // fields.
+  //
+  // Chunks which were read ahead (`Options::parallelism() > 0`) are counted
+  // when they become current.
+  uint64_t buckets_decompressed() const { return buckets_decompressed_; }
+  uint64_t bytes_skipped() const { return bytes_skipped_; }
+
+  // Returns sizes and timings of decoding chunks with records, accumulated
+  // over chunks decoded so far. This helps to tune compression options and
+  // `RecordWriterBase::Options::set_chunk_size()` for reading performance.
+  //
+  // Chunks which were read ahead (`Options::parallelism() > 0`) are counted
+  // when they become current.
+  const ChunkStats& stats() const { return stats_; }
+
+  // Returns an estimate of memory used by this `RecordReader`, excluding
+  // `sizeof(*this)`: the current decoded chunk, chunks in the chunk cache,
+  // chunks read ahead, and the buffer of the byte `Reader`.
+  //
+  // This uses sizes maintained while reading rather than traversing the data,
+  // so it is cheap enough to be called periodically, e.g. to enforce a memory
+  // budget across many open readers. A chunk read ahead is counted with its
+  // decoded size even if decoding it has not finished yet.
+  size_t EstimateMemory() const;
+
   // Searches the file for a desired record, or for a desired position between
   // records, given that it is possible to determine whether a given record is
   // before or after the desired position.
@@ -375,6 +869,64 @@ class RecordReaderBase : public Object {
   template <typename Record, typename Test>
   bool Search(Test test);
 
+  // Searches a file whose records are sorted by key for the earliest record
+  // whose key is not less than `key`. Keys are compared as byte strings.
+  //
+  // `get_key` computes the key of a serialized record, consistently with
+  // `RecordWriterBase::Options::index_key()` if the file was written with it.
+  //
+  // If `Options::index()` and the file has an index with ranges of keys, the
+  // chunk containing the record is found without decoding other chunks.
+  // Otherwise this is equivalent to `Search()` with a test derived from
+  // `get_key`.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  //
+  // On success, `SearchByKey()` points to the earliest record whose key is
+  // not less than `key`, or to the end of file if there is no such record.
+  bool SearchByKey(
+      absl::string_view key,
+      absl::FunctionRef<std::string(absl::string_view record)> get_key);
+
+  // Seeks to the beginning of the earliest chunk which can contain a record
+  // whose time is not earlier than `time`, using the ranges of times stored in
+  // the index by `RecordWriterBase::Options::set_index_time()`. All records
+  // before the new position are earlier than `time`.
+  //
+  // If records are only roughly sorted by time, records after the new position
+  // can still be earlier than `time`. Reading records between two times should
+  // then filter the records read, and stop after records sufficiently later
+  // than the end of the range.
+  //
+  // This requires `Options::index()` and a file whose index has ranges of
+  // times.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool SeekToTime(absl::Time time);
+
+  // Reads the next record which has `value` in `field`, skipping other
+  // records.
+  //
+  // `value` is represented as in the binary proto format: contents of a
+  // `string`, `bytes`, or submessage field, the canonical varint of a varint
+  // field, or the little endian bytes of a fixed field.
+  //
+  // Chunks written with `RecordWriterBase::Options::set_bloom_filter_fields()`
+  // including `field` are skipped without decompressing them if their Bloom
+  // filter rules `value` out. Other chunks are decoded and their records are
+  // checked.
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - source ends
+  //  * `false` (when `!healthy()`) - failure
+  template <typename Record>
+  bool Lookup(const Field& field, absl::string_view value, Record& record);
+
  protected:
   enum class Recoverable { kNo, kRecoverChunkReader, kRecoverChunkDecoder };
 
@@ -392,11 +944,20 @@ class RecordReaderBase : public Object {
 
   bool TryRecovery();
 
+  // Returns the position of the chunk following the current chunk, taking
+  // into account chunks which have been read ahead.
+  //
+  // Precondition: `read_ahead_ != nullptr`
+  Position ReadAheadPos() const;
+
   // Position of the beginning of the current chunk or end of file, except when
   // `Seek(Position)` failed to locate the chunk containing the position, in
   // which case this is that position.
   Position chunk_begin_ = 0;
 
+  // Options for decoding chunks, derived from `Options`.
+  ChunkDecoder::Options chunk_decoder_options_;
+
   // Current chunk if a chunk has been read, empty otherwise.
   //
   // Invariants:
@@ -406,6 +967,13 @@ class RecordReaderBase : public Object {
   //        chunk_decoder_.index() == chunk_decoder_.num_records()`
   ChunkDecoder chunk_decoder_;
 
+  // Sums of `chunk_decoder_.buckets_decompressed()` and
+  // `chunk_decoder_.bytes_skipped()` over chunks decoded so far.
+  uint64_t buckets_decompressed_ = 0;
+  uint64_t bytes_skipped_ = 0;
+  // Sum of `chunk_decoder_.stats()` over chunks decoded so far.
+  ChunkStats stats_;
+
   bool last_record_is_valid_ = false;
 
   // Whether `Recover()` is applicable, and if so, how it should be performed:
@@ -425,17 +993,143 @@ class RecordReaderBase : public Object {
 
   std::function<bool(const SkippedRegion&)> recovery_;
 
+  class ReadAhead;
+
+  // If `Options::parallelism() > 0`, chunks which have been read from
+  // `src_chunk_reader()` after the current chunk, and are being decoded in
+  // background. Otherwise `nullptr`.
+  std::unique_ptr<ReadAhead> read_ahead_;
+
+  class Index;
+
+  // Whether `SeekToRecordNumber()` should use the index.
+  bool use_index_ = false;
+
+  // If `use_index_`, the index once it has been read, empty if the file has
+  // none. Otherwise `nullptr`.
+  std::unique_ptr<Index> index_;
+
+  class ChunkCache;
+
+  // If `Options::chunk_cache_size() > 0`, chunks which `Seek()` has left,
+  // ready to be reused. Otherwise `nullptr`.
+  std::unique_ptr<ChunkCache> chunk_cache_;
+
+  // Whether file metadata have been looked at for a Zstd dictionary, which is
+  // then set in `chunk_decoder_options_`, and for the identifier of a Brotli
+  // dictionary, which is then verified.
+  bool dictionaries_checked_ = false;
+
+  // `Options::trusted_metadata()`. If present, the file signature and metadata
+  // are not read.
+  absl::optional<Chain> trusted_metadata_;
+
+  // `Options::data_verification_fraction()`, and the accumulated fraction of a
+  // chunk which is due to be verified, in the range [0.0..1.0).
+  double data_verification_fraction_ = 1.0;
+  double data_verification_credit_ = 0.0;
+
+  // `Options::chunk_range_end()`. Reading stops before a chunk beginning at or
+  // after this position.
+  Position chunk_range_end_ = std::numeric_limits<Position>::max();
+
+  // `Options::search_fanout()` and `Options::search_src_factory()`.
+  int search_fanout_ = 2;
+  std::function<std::unique_ptr<ChunkReader>()> search_src_factory_;
+
+  // `Options::observer()`.
+  std::shared_ptr<RecordsObserver> observer_;
+
  private:
   class ChunkSearchTraits;
+  struct ChunkSuffix;
+
+  // Narrows the range [`low`..`high`) of chunk beginnings searched by
+  // `Search()` with concurrent probes, as described at
+  // `Options::search_fanout()`. Updates `less_found` to the records after the
+  // first record of the last chunk whose first record is `less`.
+  //
+  // Returns the position where `Search()` finishes if an `equivalent` record
+  // was found or the search was cancelled, or `absl::nullopt` if `Search()`
+  // continues with a binary search in the narrowed range.
+  absl::optional<RecordPosition> NarrowSearch(
+      absl::FunctionRef<absl::partial_ordering(RecordReaderBase& reader)> test,
+      Position& low, Position& high, absl::optional<ChunkSuffix>& less_found);
+
+  // Returns whether data of the next chunk containing records should be
+  // verified, according to `data_verification_fraction_`.
+  bool VerifyNextChunkData();
+
+  // Reads a chunk from `src`, verifying its data if `verify_data`, and reports
+  // it to `observer_`.
+  bool ReadChunkFromSrc(ChunkReader& src, bool verify_data, Chunk& chunk);
+
+  // Reports the chunk which has just been decoded to `chunk_decoder_` to
+  // `observer_`.
+  void ReportChunkDecoded();
+
+  // Decodes chunks preceding the `ChunkType::kPrefixed` chunk which has just
+  // been read from `chunk_begin_`, back to a keyframe, so that
+  // `chunk_decoder_` has the reference needed to decode it. Leaves the
+  // `ChunkReader` after that chunk.
+  //
+  // Without random access this does nothing, and decoding the chunk fails.
+  bool LoadReference();
 
   bool FailReading(const ChunkReader& src);
   bool FailSeeking(const ChunkReader& src);
 
   bool ParseMetadata(const Chunk& chunk, Chain& metadata);
+  bool ParseIndex(const Chunk& chunk, Index& index);
+  bool ParseSingleRecordChunk(const Chunk& chunk, Chain& record);
+
+  // Sets the Zstd dictionary from `serialized_metadata`, if any, in
+  // `chunk_decoder_options_` and `chunk_decoder_`, clearing the current chunk.
+  // Verifies that the Brotli dictionary matches the identifier from
+  // `serialized_metadata`, if any.
+  bool SetDictionaries(const Chain& serialized_metadata);
+
+  // Reads file metadata at the beginning of the file and calls
+  // `SetDictionaries()`. If `src_chunk_reader()` was not at the beginning of
+  // the file, its position is restored, or metadata are skipped if it does not
+  // support random access.
+  //
+  // Precondition: `healthy()`
+  bool LoadDictionaries();
+
+  // Reads the index into `index_`, leaving `src_chunk_reader()` at an
+  // unspecified position.
+  //
+  // Precondition: `healthy()`
+  bool ReadIndex();
+
+  // Discards chunks which have been read ahead. This must be done before
+  // changing the position of `src_chunk_reader()`.
+  void DiscardReadAhead();
+
+  // If `chunk_cache_ != nullptr` and the current chunk has records, moves it
+  // to `chunk_cache_`. This must be done before `DiscardReadAhead()` when
+  // seeking to another chunk.
+  void CacheCurrentChunk();
+
+  // If `chunk_cache_` has the chunk beginning at `chunk_begin`, makes it the
+  // current chunk and sets `from_cache` to `true`.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool TakeCachedChunk(Position chunk_begin, bool& from_cache);
 
   template <typename Record>
   bool ReadRecordImpl(Record& record);
 
+  template <typename Record>
+  bool ReadRecordsImpl(size_t max_records, std::vector<Record>& records);
+
+  // Implementation of `Lookup()` without reading the record: points
+  // `chunk_decoder_` to the next record which has `value` in `field`.
+  bool LookupImpl(const Field& field, absl::string_view value);
+
   // Reads the next chunk from `chunk_reader_` and decodes it into
   // `chunk_decoder_` and `chunk_begin_`. On failure resets `chunk_decoder_`.
   //
@@ -582,7 +1276,7 @@ inline RecordsMetadataDescriptors::RecordsMetadataDescriptors(
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
       record_type_name_(std::move(that.record_type_name_)),
-      pool_(std::move(that.pool_)) {}
+      schema_(std::move(that.schema_)) {}
 
 inline RecordsMetadataDescriptors& RecordsMetadataDescriptors::operator=(
     RecordsMetadataDescriptors&& that) {
@@ -590,7 +1284,7 @@ inline RecordsMetadataDescriptors& RecordsMetadataDescriptors::operator=(
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   record_type_name_ = std::move(that.record_type_name_),
-  pool_ = std::move(that.pool_);
+  schema_ = std::move(that.schema_);
   return *this;
 }
 
@@ -610,12 +1304,20 @@ inline RecordPosition RecordReaderBase::last_pos() const {
   return RecordPosition(chunk_begin_, chunk_decoder_.index() - 1);
 }
 
+inline bool RecordReaderBase::truncated() const {
+  const ChunkReader* const src = src_chunk_reader();
+  return src != nullptr && src->truncated();
+}
+
 inline RecordPosition RecordReaderBase::pos() const {
   if (ABSL_PREDICT_TRUE(chunk_decoder_.index() <
                         chunk_decoder_.num_records()) ||
       ABSL_PREDICT_FALSE(recoverable_ == Recoverable::kRecoverChunkDecoder)) {
     return RecordPosition(chunk_begin_, chunk_decoder_.index());
   }
+  if (ABSL_PREDICT_FALSE(read_ahead_ != nullptr)) {
+    return RecordPosition(ReadAheadPos(), 0);
+  }
   return RecordPosition(src_chunk_reader()->pos(), 0);
 }
 
@@ -630,6 +1332,13 @@ bool RecordReaderBase::Search(Test test) {
   });
 }
 
+template <typename Record>
+bool RecordReaderBase::Lookup(const Field& field, absl::string_view value,
+                              Record& record) {
+  if (ABSL_PREDICT_FALSE(!LookupImpl(field, value))) return false;
+  return ReadRecord(record);
+}
+
 template <typename Src>
 inline RecordReader<Src>::RecordReader(const Src& src, Options options)
     : RecordReaderBase(kInitiallyOpen), src_(src) {
@@ -715,6 +1424,9 @@ inline RecordPosition RecordReader<Src>::pos() const {
       ABSL_PREDICT_FALSE(recoverable_ == Recoverable::kRecoverChunkDecoder)) {
     return RecordPosition(chunk_begin_, chunk_decoder_.index());
   }
+  if (ABSL_PREDICT_FALSE(read_ahead_ != nullptr)) {
+    return RecordPosition(ReadAheadPos(), 0);
+  }
   return RecordPosition(src_->pos(), 0);
 }
 
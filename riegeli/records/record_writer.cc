@@ -33,28 +33,38 @@
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "absl/types/variant.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/descriptor.pb.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/memory_budget.h"
 #include "riegeli/base/object.h"
 #include "riegeli/base/options_parser.h"
 #include "riegeli/base/parallelism.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/chain_writer.h"
+#include "riegeli/bytes/null_writer.h"
 #include "riegeli/chunk_encoding/chunk.h"
 #include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
 #include "riegeli/chunk_encoding/compressor_options.h"
 #include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/chunk_encoding/deferred_encoder.h"
+#include "riegeli/chunk_encoding/hash.h"
 #include "riegeli/chunk_encoding/simple_encoder.h"
 #include "riegeli/chunk_encoding/transpose_encoder.h"
 #include "riegeli/messages/message_serialize.h"
 #include "riegeli/records/chunk_writer.h"
 #include "riegeli/records/record_position.h"
 #include "riegeli/records/records_metadata.pb.h"
+#include "riegeli/records/records_observer.h"
+#include "riegeli/zstd/zstd_writer.h"
 
 namespace riegeli {
 
@@ -68,6 +78,9 @@ constexpr int RecordWriterBase::Options::kDefaultBrotli;
 constexpr int RecordWriterBase::Options::kMinZstd;
 constexpr int RecordWriterBase::Options::kMaxZstd;
 constexpr int RecordWriterBase::Options::kDefaultZstd;
+constexpr int RecordWriterBase::Options::kMinLz4;
+constexpr int RecordWriterBase::Options::kMaxLz4;
+constexpr int RecordWriterBase::Options::kDefaultLz4;
 constexpr int RecordWriterBase::Options::kMinWindowLog;
 constexpr int RecordWriterBase::Options::kMaxWindowLog;
 #endif
@@ -95,6 +108,26 @@ class FileDescriptorCollector {
   absl::flat_hash_set<std::string> files_seen_;
 };
 
+// Returns `compressor_options` with the compression level changed to
+// `compression_level`, keeping the compression type.
+CompressorOptions WithCompressionLevel(CompressorOptions compressor_options,
+                                       int compression_level) {
+  switch (compressor_options.compression_type()) {
+    case CompressionType::kBrotli:
+      compressor_options.set_brotli(compression_level);
+      break;
+    case CompressionType::kZstd:
+      compressor_options.set_zstd(compression_level);
+      break;
+    case CompressionType::kLz4:
+      compressor_options.set_lz4(compression_level);
+      break;
+    default:
+      break;
+  }
+  return compressor_options;
+}
+
 }  // namespace
 
 void SetRecordType(const google::protobuf::Descriptor& descriptor,
@@ -105,21 +138,100 @@ void SetRecordType(const google::protobuf::Descriptor& descriptor,
   collector.AddFile(descriptor.file());
 }
 
+namespace {
+
+std::unique_ptr<ChunkEncoder> MakeTransposeEncoder(
+    const RecordWriterBase::Options& options,
+    const CompressorOptions& compressor_options, uint64_t chunk_size) {
+  const long double long_double_bucket_size =
+      std::round(static_cast<long double>(chunk_size) *
+                 static_cast<long double>(options.bucket_fraction()));
+  const uint64_t bucket_size =
+      ABSL_PREDICT_FALSE(
+          long_double_bucket_size >=
+          static_cast<long double>(std::numeric_limits<uint64_t>::max()))
+          ? std::numeric_limits<uint64_t>::max()
+      : ABSL_PREDICT_TRUE(long_double_bucket_size >= 1.0L)
+          ? static_cast<uint64_t>(long_double_bucket_size)
+          : uint64_t{1};
+  return std::make_unique<TransposeEncoder>(
+      compressor_options, bucket_size, options.executor(),
+      options.column_encoding(), options.column_statistics(),
+      options.bloom_filter_fields());
+}
+
+std::unique_ptr<ChunkEncoder> MakeSimpleEncoder(
+    const RecordWriterBase::Options& options,
+    const CompressorOptions& compressor_options, uint64_t chunk_size) {
+  return std::make_unique<SimpleEncoder>(
+      compressor_options, chunk_size, options.reserve_chunk_size(),
+      options.deduplicate(), options.executor());
+}
+
+}  // namespace
+
+namespace internal {
+
+std::unique_ptr<ChunkEncoder> MakeRecordsChunkEncoder(
+    const RecordWriterBase::Options& options,
+    const CompressorOptions& compressor_options, uint64_t chunk_size) {
+  if (!options.transpose()) {
+    return MakeSimpleEncoder(options, compressor_options, chunk_size);
+  }
+  if (options.adaptive_transpose() != absl::nullopt) {
+    return std::make_unique<DeferredEncoder>(
+        MakeTransposeEncoder(options, compressor_options, chunk_size),
+        MakeSimpleEncoder(options, compressor_options, chunk_size),
+        *options.adaptive_transpose());
+  }
+  return MakeTransposeEncoder(options, compressor_options, chunk_size);
+}
+
+}  // namespace internal
+
 absl::Status RecordWriterBase::Options::FromString(absl::string_view text) {
   std::string compressor_text;
   uint64_t chunk_size;
+  double adaptive_transpose;
+  double autotune_chunk_size;
+  uint64_t block_size;
+  uint64_t max_pending_bytes;
+  int min_adaptive_compression_level;
   OptionsParser options_parser;
   options_parser.AddOption("default", ValueParser::FailIfAnySeen());
   options_parser.AddOption(
       "transpose",
       ValueParser::Enum({{"", true}, {"true", true}, {"false", false}},
                         &transpose_));
+  options_parser.AddOption(
+      "adaptive_transpose",
+      ValueParser::Or(
+          ValueParser::Enum({{"none", absl::nullopt}}, &adaptive_transpose_),
+          ValueParser::And(
+              ValueParser::Real(0.0, 1.0, &adaptive_transpose),
+              [this, &adaptive_transpose](ValueParser& value_parser) {
+                adaptive_transpose_ = adaptive_transpose;
+                return true;
+              })));
+  options_parser.AddOption(
+      "column_encoding",
+      ValueParser::Enum({{"", true}, {"true", true}, {"false", false}},
+                        &column_encoding_));
+  options_parser.AddOption(
+      "deduplicate",
+      ValueParser::Enum({{"", true}, {"true", true}, {"false", false}},
+                        &deduplicate_));
   options_parser.AddOption("uncompressed",
                            ValueParser::CopyTo(&compressor_text));
   options_parser.AddOption("brotli", ValueParser::CopyTo(&compressor_text));
   options_parser.AddOption("zstd", ValueParser::CopyTo(&compressor_text));
   options_parser.AddOption("snappy", ValueParser::CopyTo(&compressor_text));
+  options_parser.AddOption("lz4", ValueParser::CopyTo(&compressor_text));
   options_parser.AddOption("window_log", ValueParser::CopyTo(&compressor_text));
+  options_parser.AddOption("min_compression_ratio",
+                           ValueParser::CopyTo(&compressor_text));
+  options_parser.AddOption("hardware_offload",
+                           ValueParser::CopyTo(&compressor_text));
   options_parser.AddOption(
       "chunk_size",
       ValueParser::Or(
@@ -133,13 +245,73 @@ absl::Status RecordWriterBase::Options::FromString(absl::string_view text) {
               })));
   options_parser.AddOption("bucket_fraction",
                            ValueParser::Real(0.0, 1.0, &bucket_fraction_));
+  options_parser.AddOption(
+      "autotune_chunk_size",
+      ValueParser::Or(
+          ValueParser::Enum({{"none", absl::nullopt}}, &autotune_chunk_size_),
+          ValueParser::And(
+              ValueParser::Real(0.0, std::numeric_limits<double>::max(),
+                                &autotune_chunk_size),
+              [this, &autotune_chunk_size](ValueParser& value_parser) {
+                autotune_chunk_size_ = autotune_chunk_size;
+                return true;
+              })));
+  options_parser.AddOption(
+      "keyframe_interval",
+      ValueParser::Int(0, std::numeric_limits<int>::max(),
+                       &keyframe_interval_));
   options_parser.AddOption(
       "pad_to_block_boundary",
       ValueParser::Enum({{"", true}, {"true", true}, {"false", false}},
                         &pad_to_block_boundary_));
+  options_parser.AddOption(
+      "block_size",
+      ValueParser::And(
+          ValueParser::Bytes(internal::kBlockSize, internal::kMaxBlockSize,
+                             &block_size),
+          [this, &block_size](ValueParser& value_parser) {
+            if (ABSL_PREDICT_FALSE(!internal::IsValidBlockSize(block_size))) {
+              return value_parser.InvalidValue("power of 2");
+            }
+            block_size_ = block_size;
+            return true;
+          }));
+  options_parser.AddOption(
+      "index", ValueParser::Enum({{"", true}, {"true", true}, {"false", false}},
+                                 &index_));
   options_parser.AddOption(
       "parallelism",
       ValueParser::Int(0, std::numeric_limits<int>::max(), &parallelism_));
+  options_parser.AddOption(
+      "max_pending_bytes",
+      ValueParser::Or(
+          ValueParser::Enum({{"none", absl::nullopt}}, &max_pending_bytes_),
+          ValueParser::And(
+              ValueParser::Bytes(1, std::numeric_limits<uint64_t>::max(),
+                                 &max_pending_bytes),
+              [this, &max_pending_bytes](ValueParser& value_parser) {
+                max_pending_bytes_ = max_pending_bytes;
+                return true;
+              })));
+  options_parser.AddOption(
+      "min_adaptive_compression_level",
+      ValueParser::Or(
+          ValueParser::Enum({{"none", absl::nullopt}},
+                            &min_adaptive_compression_level_),
+          ValueParser::And(
+              ValueParser::Int(CompressorOptions::kMinZstd,
+                               CompressorOptions::kMaxZstd,
+                               &min_adaptive_compression_level),
+              [this,
+               &min_adaptive_compression_level](ValueParser& value_parser) {
+                min_adaptive_compression_level_ =
+                    min_adaptive_compression_level;
+                return true;
+              })));
+  options_parser.AddOption(
+      "reserve_chunk_size",
+      ValueParser::Enum({{"", true}, {"true", true}, {"false", false}},
+                        &reserve_chunk_size_));
   if (ABSL_PREDICT_FALSE(!options_parser.FromString(text))) {
     return options_parser.status();
   }
@@ -151,6 +323,7 @@ class RecordWriterBase::Worker : public Object {
   explicit Worker(ChunkWriter* chunk_writer, Options&& options)
       : Object(kInitiallyOpen),
         options_(std::move(options)),
+        memory_account_(options_.memory_budget()),
         chunk_writer_(RIEGELI_ASSERT_NOTNULL(chunk_writer)),
         chunk_encoder_(MakeChunkEncoder()) {
     if (ABSL_PREDICT_FALSE(!chunk_writer_->healthy())) Fail(*chunk_writer_);
@@ -166,6 +339,8 @@ class RecordWriterBase::Worker : public Object {
   // Precondition: chunk is open.
   template <typename Record>
   bool AddRecord(Record&& record);
+  // Adds records expressed as in `ChunkEncoder::AddRecords()`.
+  bool AddRecords(Chain&& records, std::vector<size_t>&& limits);
   bool AddRecord(const google::protobuf::MessageLite& record,
                  SerializeOptions serialize_options);
 
@@ -176,6 +351,27 @@ class RecordWriterBase::Worker : public Object {
 
   bool MaybePadToBlockBoundary();
 
+  // If the chunk size is being tuned, trial-encodes records collected so far
+  // with candidate chunk sizes, finishes tuning, and returns the chosen chunk
+  // size, which is used by chunk encoders from now on. Otherwise returns
+  // `absl::nullopt`.
+  //
+  // If the result is `absl::nullopt` and the chunk size is being tuned then
+  // `!healthy()`.
+  //
+  // Precondition: chunk is open.
+  absl::optional<uint64_t> TuneChunkSize();
+
+  // Writes a chunk of records which is already encoded.
+  //
+  // Precondition: chunk is not open.
+  bool WriteChunk(const Chunk& chunk);
+
+  // Writes the index chunk if the file is being indexed.
+  //
+  // Precondition: chunk is not open.
+  bool MaybeWriteIndex();
+
   // Precondition: chunk is not open.
   virtual bool Flush(FlushType flush_type) = 0;
 
@@ -188,28 +384,168 @@ class RecordWriterBase::Worker : public Object {
 
   virtual Position EstimatedSize() const = 0;
 
+  virtual uint64_t PendingChunks() const = 0;
+
+  virtual uint64_t PendingBytes() const = 0;
+
+  virtual size_t EstimateMemory() const = 0;
+
+  // Memory of the current chunk and of pending chunks in
+  // `Options::memory_budget()`.
+  MemoryBudget::Account& memory_account() { return memory_account_; }
+
+  ChunkStats Stats() const;
+
+  virtual PipelineStats GetPipelineStats() const;
+
  protected:
   void Initialize(Position initial_pos);
   virtual bool WriteSignature() = 0;
   virtual bool WriteMetadata() = 0;
   virtual bool PadToBlockBoundary() = 0;
+  virtual bool WriteRawChunk(const Chunk& chunk) = 0;
+  virtual bool WriteIndex() = 0;
+
+  // Adds the chunk which is about to be written to `chunk_writer_` to the
+  // index, if the file is being indexed and the chunk contains records.
+  //
+  // This must be called by the thread which writes chunks.
+  void AddToIndex(const ChunkHeader& chunk_header);
+
+  // Adds the range of keys of the current chunk to the index, if the file is
+  // being indexed by key.
+  //
+  // This must be called by the thread which adds records, when the chunk is
+  // closed.
+  void AddKeysToIndex();
+
+  // Adds the range of times of the current chunk to the index, if the file is
+  // being indexed by time.
+  //
+  // This must be called by the thread which adds records, when the chunk is
+  // closed.
+  void AddTimesToIndex();
 
   std::unique_ptr<ChunkEncoder> MakeChunkEncoder();
+  // Updates `reference_` for the next chunk when the current chunk is closed,
+  // if `prefixing_`.
+  //
+  // This must be called by the thread which adds records, when the chunk is
+  // closed.
+  void UpdateReference();
   void EncodeSignature(Chunk& chunk);
   bool EncodeMetadata(Chunk& chunk);
+  bool EncodeIndex(Chunk& chunk);
   bool EncodeChunk(ChunkEncoder& chunk_encoder, Chunk& chunk);
 
+  // Writes `chunk` to `chunk_writer_`, reporting it to `options_.observer()`.
+  //
+  // This must be called by the thread which writes chunks.
+  bool WriteToChunkWriter(const Chunk& chunk);
+
   Options options_;
+  MemoryBudget::Account memory_account_;
   // Invariant: `chunk_writer_ != nullptr`
   ChunkWriter* chunk_writer_;
+  // Whether `options_.keyframe_interval() > 1` applies: chunks are not
+  // transposed nor deduplicated, and are compressed with Zstd. Then chunks
+  // have type `ChunkType::kPrefixed`, and a chunk encoder is made for each
+  // chunk.
+  bool prefixing_ = false;
+  // Compression level of chunk encoders made by `MakeChunkEncoder()`. This
+  // differs from `options_.compression_level()` if it is being adapted by
+  // `ParallelWorker`.
+  int compression_level_ = options_.compression_level();
   // Invariant: if chunk is open then `chunk_encoder_ != nullptr`
   std::unique_ptr<ChunkEncoder> chunk_encoder_;
+
+ private:
+  template <typename Record>
+  bool EncodeSingleRecordChunk(const Record& record, ChunkType chunk_type,
+                               Chunk& chunk);
+
+  std::unique_ptr<ChunkEncoder> MakeChunkEncoder(
+      const CompressorOptions& compressor_options);
+  std::unique_ptr<ChunkEncoder> MakeBaseChunkEncoder(
+      const CompressorOptions& compressor_options, uint64_t chunk_size);
+  template <typename Record>
+  void AddToTuningSample(const Record& record);
+  // Returns the total size of `tuning_sample_` encoded in chunks of
+  // `chunk_size`, including chunk headers, or `absl::nullopt` on failure.
+  absl::optional<uint64_t> EncodedSampleSize(uint64_t chunk_size);
+
+  void AddKey(absl::string_view record);
+  void AddKey(const Chain& record);
+  void AddKey(const absl::Cord& record);
+  void AddTime(absl::string_view record);
+  void AddTime(const Chain& record);
+  void AddTime(const absl::Cord& record);
+
+  // Whether `Options::index()` was requested and the file is written from the
+  // beginning.
+  bool indexing_ = false;
+  // Chunks containing records which have been written so far, if `indexing_`.
+  RecordsIndex index_;
+  // Whether `indexing_` and `options_.index_key() != nullptr`.
+  bool indexing_keys_ = false;
+  // The range of keys of records in the current chunk, if `indexing_keys_`
+  // and `chunk_has_keys_`.
+  bool chunk_has_keys_ = false;
+  std::string chunk_min_key_;
+  std::string chunk_max_key_;
+  // Ranges of keys of chunks which have been closed, if `indexing_keys_`. They
+  // are kept apart from `index_` because they are collected by a different
+  // thread.
+  RecordsIndex key_ranges_;
+  // Whether `indexing_` and `options_.index_time() != nullptr`.
+  bool indexing_times_ = false;
+  // The range of times of records in the current chunk, if `indexing_times_`
+  // and `chunk_has_times_`.
+  bool chunk_has_times_ = false;
+  absl::Time chunk_min_time_;
+  absl::Time chunk_max_time_;
+  // Ranges of times of chunks which have been closed, if `indexing_times_`.
+  // They are kept apart from `index_` because they are collected by a
+  // different thread.
+  RecordsIndex time_ranges_;
+  // Whether `options_.autotune_chunk_size() != absl::nullopt` and
+  // `TuneChunkSize()` was not called yet.
+  bool tuning_chunk_size_ = false;
+  // Copies of records written so far, if `tuning_chunk_size_`.
+  std::vector<Chain> tuning_sample_;
+  // The chunk size chosen by `TuneChunkSize()`, or 0 if none. It is recorded
+  // in the index.
+  uint64_t tuned_chunk_size_ = 0;
+  // Records of the current chunk, if `prefixing_`.
+  Chain chunk_records_;
+  // Records of the previous chunk, used as the reference for compressing the
+  // current chunk, or empty if the current chunk is a keyframe.
+  Chain reference_;
+  // Number of chunks closed since the last keyframe was opened, if
+  // `prefixing_`.
+  int chunks_since_keyframe_ = 0;
+  // Sum of `ChunkEncoder::stats()` of chunks with records which have been
+  // encoded so far. Chunks are encoded by different threads if
+  // `options_.parallelism() > 0`.
+  mutable absl::Mutex stats_mutex_;
+  ChunkStats stats_ ABSL_GUARDED_BY(stats_mutex_);
+  // Sum of times of `chunk_writer_->WriteChunk()`.
+  absl::Duration write_time_ ABSL_GUARDED_BY(stats_mutex_);
 };
 
 RecordWriterBase::Worker::~Worker() {}
 
 inline void RecordWriterBase::Worker::Initialize(Position initial_pos) {
+  prefixing_ = options_.keyframe_interval() > 1 && !options_.transpose() &&
+               !options_.deduplicate() &&
+               options_.compression_type() == CompressionType::kZstd;
+  // The first chunk is a keyframe.
+  if (prefixing_) chunk_encoder_ = MakeChunkEncoder();
   if (initial_pos == 0) {
+    indexing_ = options_.index();
+    indexing_keys_ = indexing_ && options_.index_key() != nullptr;
+    indexing_times_ = indexing_ && options_.index_time() != nullptr;
+    tuning_chunk_size_ = options_.autotune_chunk_size() != absl::nullopt;
     if (ABSL_PREDICT_FALSE(!WriteSignature())) return;
     if (ABSL_PREDICT_FALSE(!WriteMetadata())) return;
   } else {
@@ -225,65 +561,334 @@ inline bool RecordWriterBase::Worker::MaybePadToBlockBoundary() {
   }
 }
 
+bool RecordWriterBase::Worker::WriteChunk(const Chunk& chunk) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  switch (chunk.header.chunk_type()) {
+    case ChunkType::kFileSignature:
+    case ChunkType::kFileMetadata:
+    case ChunkType::kPadding:
+    case ChunkType::kIndex:
+      return Fail(absl::InvalidArgumentError(
+          "File signature, file metadata, padding, and index chunks are "
+          "written only by RecordWriter itself"));
+    default:
+      break;
+  }
+  if (ABSL_PREDICT_FALSE(chunk.header.num_records() == 0)) {
+    return Fail(absl::InvalidArgumentError("Chunk contains no records"));
+  }
+  if (ABSL_PREDICT_FALSE(indexing_keys_ || indexing_times_)) {
+    return Fail(absl::FailedPreconditionError(
+        "Writing an encoded chunk is not supported with an index by key "
+        "or by time"));
+  }
+  if (prefixing_) {
+    // The next chunk can not refer to records of a chunk written in between.
+    chunks_since_keyframe_ = 0;
+    reference_ = Chain();
+  }
+  return WriteRawChunk(chunk);
+}
+
+inline bool RecordWriterBase::Worker::MaybeWriteIndex() {
+  if (indexing_) {
+    return WriteIndex();
+  } else {
+    return true;
+  }
+}
+
+inline void RecordWriterBase::Worker::AddToIndex(
+    const ChunkHeader& chunk_header) {
+  if (!indexing_ || chunk_header.num_records() == 0) return;
+  index_.add_chunk_begin(chunk_writer_->pos());
+  index_.add_num_records(chunk_header.num_records());
+  index_.add_decoded_data_size(chunk_header.decoded_data_size());
+}
+
+inline void RecordWriterBase::Worker::AddKeysToIndex() {
+  if (!indexing_keys_) return;
+  RIEGELI_ASSERT(chunk_has_keys_)
+      << "Failed precondition of RecordWriterBase::Worker::AddKeysToIndex(): "
+         "no records in the chunk";
+  key_ranges_.add_min_key(std::move(chunk_min_key_));
+  key_ranges_.add_max_key(std::move(chunk_max_key_));
+  chunk_min_key_.clear();
+  chunk_max_key_.clear();
+  chunk_has_keys_ = false;
+}
+
+inline void RecordWriterBase::Worker::AddKey(absl::string_view record) {
+  std::string key = options_.index_key()(record);
+  if (!chunk_has_keys_) {
+    chunk_min_key_ = key;
+    chunk_max_key_ = std::move(key);
+    chunk_has_keys_ = true;
+  } else if (key < chunk_min_key_) {
+    chunk_min_key_ = std::move(key);
+  } else if (key > chunk_max_key_) {
+    chunk_max_key_ = std::move(key);
+  }
+}
+
+inline void RecordWriterBase::Worker::AddKey(const Chain& record) {
+  const absl::optional<absl::string_view> flat = record.TryFlat();
+  if (flat != absl::nullopt) {
+    AddKey(*flat);
+  } else {
+    AddKey(std::string(record));
+  }
+}
+
+inline void RecordWriterBase::Worker::AddKey(const absl::Cord& record) {
+  const absl::optional<absl::string_view> flat = record.TryFlat();
+  if (flat != absl::nullopt) {
+    AddKey(*flat);
+  } else {
+    AddKey(std::string(record));
+  }
+}
+
+inline void RecordWriterBase::Worker::AddTimesToIndex() {
+  if (!indexing_times_) return;
+  RIEGELI_ASSERT(chunk_has_times_)
+      << "Failed precondition of RecordWriterBase::Worker::AddTimesToIndex(): "
+         "no records in the chunk";
+  time_ranges_.add_min_time(absl::ToUnixNanos(chunk_min_time_));
+  time_ranges_.add_max_time(absl::ToUnixNanos(chunk_max_time_));
+  chunk_has_times_ = false;
+}
+
+inline void RecordWriterBase::Worker::AddTime(absl::string_view record) {
+  const absl::Time time = options_.index_time()(record);
+  if (!chunk_has_times_) {
+    chunk_min_time_ = time;
+    chunk_max_time_ = time;
+    chunk_has_times_ = true;
+  } else if (time < chunk_min_time_) {
+    chunk_min_time_ = time;
+  } else if (time > chunk_max_time_) {
+    chunk_max_time_ = time;
+  }
+}
+
+inline void RecordWriterBase::Worker::AddTime(const Chain& record) {
+  const absl::optional<absl::string_view> flat = record.TryFlat();
+  if (flat != absl::nullopt) {
+    AddTime(*flat);
+  } else {
+    AddTime(std::string(record));
+  }
+}
+
+inline void RecordWriterBase::Worker::AddTime(const absl::Cord& record) {
+  const absl::optional<absl::string_view> flat = record.TryFlat();
+  if (flat != absl::nullopt) {
+    AddTime(*flat);
+  } else {
+    AddTime(std::string(record));
+  }
+}
+
 inline std::unique_ptr<ChunkEncoder>
 RecordWriterBase::Worker::MakeChunkEncoder() {
+  if (ABSL_PREDICT_FALSE(compression_level_ != options_.compression_level())) {
+    return MakeChunkEncoder(WithCompressionLevel(options_.compressor_options(),
+                                                 compression_level_));
+  }
+  return MakeChunkEncoder(options_.compressor_options());
+}
+
+inline std::unique_ptr<ChunkEncoder> RecordWriterBase::Worker::MakeChunkEncoder(
+    const CompressorOptions& compressor_options) {
   std::unique_ptr<ChunkEncoder> chunk_encoder;
-  if (options_.transpose()) {
-    const long double long_double_bucket_size =
-        std::round(static_cast<long double>(options_.effective_chunk_size()) *
-                   static_cast<long double>(options_.bucket_fraction()));
-    const uint64_t bucket_size =
-        ABSL_PREDICT_FALSE(
-            long_double_bucket_size >=
-            static_cast<long double>(std::numeric_limits<uint64_t>::max()))
-            ? std::numeric_limits<uint64_t>::max()
-        : ABSL_PREDICT_TRUE(long_double_bucket_size >= 1.0L)
-            ? static_cast<uint64_t>(long_double_bucket_size)
-            : uint64_t{1};
-    chunk_encoder = std::make_unique<TransposeEncoder>(
-        options_.compressor_options(), bucket_size);
+  if (prefixing_) {
+    std::unique_ptr<SimpleEncoder> simple_encoder =
+        std::make_unique<SimpleEncoder>(
+            compressor_options, options_.effective_chunk_size(),
+            options_.reserve_chunk_size(), /*deduplicate=*/false,
+            options_.executor());
+    simple_encoder->SetReference(reference_);
+    chunk_encoder = std::move(simple_encoder);
   } else {
-    chunk_encoder = std::make_unique<SimpleEncoder>(
-        options_.compressor_options(), options_.effective_chunk_size());
+    chunk_encoder = MakeBaseChunkEncoder(compressor_options,
+                                         options_.effective_chunk_size());
   }
-  if (options_.parallelism() == 0) {
+  if (options_.parallelism() == 0 ||
+      (!prefixing_ && options_.transpose() &&
+       options_.adaptive_transpose() != absl::nullopt)) {
+    // An adaptive encoder is already deferred.
     return chunk_encoder;
   } else {
     return std::make_unique<DeferredEncoder>(std::move(chunk_encoder));
   }
 }
 
+std::unique_ptr<ChunkEncoder> RecordWriterBase::Worker::MakeBaseChunkEncoder(
+    const CompressorOptions& compressor_options, uint64_t chunk_size) {
+  return internal::MakeRecordsChunkEncoder(options_, compressor_options,
+                                           chunk_size);
+}
+
+inline void RecordWriterBase::Worker::UpdateReference() {
+  if (!prefixing_) return;
+  if (++chunks_since_keyframe_ == options_.keyframe_interval()) {
+    chunks_since_keyframe_ = 0;
+    reference_ = Chain();
+  } else {
+    reference_ = std::move(chunk_records_);
+  }
+  chunk_records_ = Chain();
+}
+
+template <typename Record>
+inline void RecordWriterBase::Worker::AddToTuningSample(const Record& record) {
+  Chain sample;
+  sample.Append(record);
+  tuning_sample_.push_back(std::move(sample));
+}
+
+absl::optional<uint64_t> RecordWriterBase::Worker::TuneChunkSize() {
+  if (!tuning_chunk_size_) return absl::nullopt;
+  tuning_chunk_size_ = false;
+  // Candidate chunk sizes, from the largest, each half of the previous one.
+  static constexpr int kNumCandidates = 5;
+  const uint64_t max_chunk_size = options_.effective_chunk_size();
+  uint64_t candidate_sizes[kNumCandidates];
+  uint64_t encoded_sizes[kNumCandidates];
+  int num_candidates = 0;
+  for (uint64_t chunk_size = max_chunk_size;
+       num_candidates < kNumCandidates && chunk_size > 0; chunk_size /= 2) {
+    const absl::optional<uint64_t> encoded_size = EncodedSampleSize(chunk_size);
+    if (ABSL_PREDICT_FALSE(encoded_size == absl::nullopt)) {
+      tuning_sample_ = std::vector<Chain>();
+      return absl::nullopt;
+    }
+    candidate_sizes[num_candidates] = chunk_size;
+    encoded_sizes[num_candidates] = *encoded_size;
+    ++num_candidates;
+  }
+  tuning_sample_ = std::vector<Chain>();
+  uint64_t best_encoded_size = std::numeric_limits<uint64_t>::max();
+  for (int i = 0; i < num_candidates; ++i) {
+    best_encoded_size = UnsignedMin(best_encoded_size, encoded_sizes[i]);
+  }
+  const long double max_encoded_size =
+      static_cast<long double>(best_encoded_size) *
+      (1.0L + static_cast<long double>(*options_.autotune_chunk_size()));
+  uint64_t chosen_chunk_size = max_chunk_size;
+  for (int i = 0; i < num_candidates; ++i) {
+    if (static_cast<long double>(encoded_sizes[i]) <= max_encoded_size) {
+      chosen_chunk_size = candidate_sizes[i];
+    }
+  }
+  options_.set_chunk_size(chosen_chunk_size);
+  tuned_chunk_size_ = chosen_chunk_size;
+  return chosen_chunk_size;
+}
+
+absl::optional<uint64_t> RecordWriterBase::Worker::EncodedSampleSize(
+    uint64_t chunk_size) {
+  uint64_t encoded_size = 0;
+  std::unique_ptr<ChunkEncoder> chunk_encoder;
+  uint64_t chunk_size_so_far = 0;
+  const auto encode_chunk = [&]() -> bool {
+    NullWriter dest(NullWriter::kInitiallyOpen);
+    ChunkType chunk_type;
+    uint64_t num_records;
+    uint64_t decoded_data_size;
+    if (ABSL_PREDICT_FALSE(!chunk_encoder->EncodeAndClose(
+            dest, chunk_type, num_records, decoded_data_size))) {
+      return Fail(*chunk_encoder);
+    }
+    encoded_size = SaturatingAdd(
+        encoded_size,
+        SaturatingAdd(IntCast<uint64_t>(dest.pos()),
+                      IntCast<uint64_t>(ChunkHeader::size())));
+    chunk_encoder.reset();
+    return true;
+  };
+  // Records are grouped into chunks like in `RecordWriterBase::WriteRecord()`.
+  for (const Chain& record : tuning_sample_) {
+    const uint64_t added_size = SaturatingAdd(IntCast<uint64_t>(record.size()),
+                                              uint64_t{sizeof(uint64_t)});
+    if (chunk_encoder != nullptr &&
+        (chunk_size_so_far > chunk_size ||
+         added_size > chunk_size - chunk_size_so_far)) {
+      if (ABSL_PREDICT_FALSE(!encode_chunk())) return absl::nullopt;
+    }
+    if (chunk_encoder == nullptr) {
+      chunk_encoder =
+          MakeBaseChunkEncoder(options_.compressor_options(), chunk_size);
+      chunk_size_so_far = 0;
+    }
+    if (ABSL_PREDICT_FALSE(!chunk_encoder->AddRecord(record))) {
+      Fail(*chunk_encoder);
+      return absl::nullopt;
+    }
+    chunk_size_so_far += added_size;
+  }
+  if (chunk_encoder != nullptr) {
+    if (ABSL_PREDICT_FALSE(!encode_chunk())) return absl::nullopt;
+  }
+  return encoded_size;
+}
+
 inline void RecordWriterBase::Worker::EncodeSignature(Chunk& chunk) {
-  chunk.header = ChunkHeader(chunk.data, ChunkType::kFileSignature, 0, 0);
+  chunk.header = ChunkHeader(
+      chunk.data, ChunkType::kFileSignature, 0,
+      internal::SignatureDecodedDataSize(options_.block_size()));
 }
 
 inline bool RecordWriterBase::Worker::EncodeMetadata(Chunk& chunk) {
-  TransposeEncoder transpose_encoder(options_.compressor_options(),
+  if (options_.metadata() != absl::nullopt) {
+    return EncodeSingleRecordChunk(*options_.metadata(),
+                                   ChunkType::kFileMetadata, chunk);
+  }
+  return EncodeSingleRecordChunk(*options_.serialized_metadata(),
+                                 ChunkType::kFileMetadata, chunk);
+}
+
+inline bool RecordWriterBase::Worker::EncodeIndex(Chunk& chunk) {
+  index_.MergeFrom(key_ranges_);
+  index_.MergeFrom(time_ranges_);
+  if (tuned_chunk_size_ > 0) index_.set_chunk_size(tuned_chunk_size_);
+  return EncodeSingleRecordChunk(index_, ChunkType::kIndex, chunk);
+}
+
+template <typename Record>
+inline bool RecordWriterBase::Worker::EncodeSingleRecordChunk(
+    const Record& record, ChunkType chunk_type, Chunk& chunk) {
+  // Metadata and index chunks are compressed without dictionaries, because
+  // dictionaries are found from metadata.
+  CompressorOptions compressor_options = options_.compressor_options();
+  compressor_options.set_zstd_dictionary(ZstdWriterBase::Dictionary());
+  compressor_options.set_brotli_dictionary(BrotliDictionary());
+  TransposeEncoder transpose_encoder(std::move(compressor_options),
                                      std::numeric_limits<uint64_t>::max());
-  if (ABSL_PREDICT_FALSE(
-          options_.metadata() != absl::nullopt
-              ? !transpose_encoder.AddRecord(*options_.metadata())
-              : !transpose_encoder.AddRecord(
-                    *options_.serialized_metadata()))) {
+  if (ABSL_PREDICT_FALSE(!transpose_encoder.AddRecord(record))) {
     return Fail(transpose_encoder);
   }
   ChainWriter<> data_writer(&chunk.data);
-  ChunkType chunk_type;
+  ChunkType encoded_chunk_type;
   uint64_t num_records;
   uint64_t decoded_data_size;
   if (ABSL_PREDICT_FALSE(!transpose_encoder.EncodeAndClose(
-          data_writer, chunk_type, num_records, decoded_data_size))) {
+          data_writer, encoded_chunk_type, num_records, decoded_data_size))) {
     return Fail(transpose_encoder);
   }
   if (ABSL_PREDICT_FALSE(!data_writer.Close())) return Fail(data_writer);
-  chunk.header =
-      ChunkHeader(chunk.data, ChunkType::kFileMetadata, 0, decoded_data_size);
+  chunk.header = ChunkHeader(chunk.data, chunk_type, 0, decoded_data_size);
   return true;
 }
 
 template <typename Record>
 inline bool RecordWriterBase::Worker::AddRecord(Record&& record) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (indexing_keys_) AddKey(record);
+  if (indexing_times_) AddTime(record);
+  if (tuning_chunk_size_) AddToTuningSample(record);
+  if (prefixing_) chunk_records_.Append(record);
   if (ABSL_PREDICT_FALSE(
           !chunk_encoder_->AddRecord(std::forward<Record>(record)))) {
     return Fail(*chunk_encoder_);
@@ -295,6 +900,15 @@ inline bool RecordWriterBase::Worker::AddRecord(
     const google::protobuf::MessageLite& record,
     SerializeOptions serialize_options) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (indexing_keys_ || indexing_times_ || tuning_chunk_size_ || prefixing_) {
+    Chain serialized;
+    {
+      absl::Status status =
+          SerializeToChain(record, serialized, std::move(serialize_options));
+      if (ABSL_PREDICT_FALSE(!status.ok())) return Fail(std::move(status));
+    }
+    return AddRecord(std::move(serialized));
+  }
   if (ABSL_PREDICT_FALSE(
           !chunk_encoder_->AddRecord(record, std::move(serialize_options)))) {
     return Fail(*chunk_encoder_);
@@ -302,6 +916,28 @@ inline bool RecordWriterBase::Worker::AddRecord(
   return true;
 }
 
+inline bool RecordWriterBase::Worker::AddRecords(Chain&& records,
+                                                 std::vector<size_t>&& limits) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (indexing_keys_ || indexing_times_ || tuning_chunk_size_ || prefixing_) {
+    // These need to see each record separately.
+    size_t start = 0;
+    for (const size_t limit : limits) {
+      if (ABSL_PREDICT_FALSE(
+              !AddRecord(records.Substr(start, limit - start)))) {
+        return false;
+      }
+      start = limit;
+    }
+    return true;
+  }
+  if (ABSL_PREDICT_FALSE(
+          !chunk_encoder_->AddRecords(std::move(records), std::move(limits)))) {
+    return Fail(*chunk_encoder_);
+  }
+  return true;
+}
+
 inline bool RecordWriterBase::Worker::EncodeChunk(ChunkEncoder& chunk_encoder,
                                                   Chunk& chunk) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
@@ -316,25 +952,69 @@ inline bool RecordWriterBase::Worker::EncodeChunk(ChunkEncoder& chunk_encoder,
   if (ABSL_PREDICT_FALSE(!data_writer.Close())) return Fail(data_writer);
   chunk.header =
       ChunkHeader(chunk.data, chunk_type, num_records, decoded_data_size);
+  if (ABSL_PREDICT_FALSE(options_.observer() != nullptr)) {
+    options_.observer()->OnChunkEncoded(chunk.header, chunk_encoder.stats());
+  }
+  absl::MutexLock lock(&stats_mutex_);
+  stats_ += chunk_encoder.stats();
   return true;
 }
 
+inline bool RecordWriterBase::Worker::WriteToChunkWriter(const Chunk& chunk) {
+  const Position chunk_begin = chunk_writer_->pos();
+  const absl::Time start_time = absl::Now();
+  const bool ok = chunk_writer_->WriteChunk(chunk);
+  const absl::Duration write_time = absl::Now() - start_time;
+  if (ABSL_PREDICT_FALSE(options_.observer() != nullptr)) {
+    options_.observer()->OnChunkWritten(chunk_begin, chunk.header, write_time);
+  }
+  absl::MutexLock lock(&stats_mutex_);
+  write_time_ += write_time;
+  return ok;
+}
+
+inline ChunkStats RecordWriterBase::Worker::Stats() const {
+  absl::MutexLock lock(&stats_mutex_);
+  return stats_;
+}
+
+RecordWriterBase::PipelineStats RecordWriterBase::Worker::GetPipelineStats()
+    const {
+  PipelineStats pipeline_stats;
+  absl::MutexLock lock(&stats_mutex_);
+  pipeline_stats.encode_time = stats_.encode_time;
+  pipeline_stats.write_time = write_time_;
+  return pipeline_stats;
+}
+
 class RecordWriterBase::SerialWorker : public Worker {
  public:
   explicit SerialWorker(ChunkWriter* chunk_writer, Options&& options);
 
-  void OpenChunk() override { chunk_encoder_->Clear(); }
+  void OpenChunk() override {
+    if (ABSL_PREDICT_FALSE(prefixing_)) {
+      // The reference differs for each chunk.
+      chunk_encoder_ = MakeChunkEncoder();
+    } else {
+      chunk_encoder_->Clear();
+    }
+  }
   bool CloseChunk() override;
   bool Flush(FlushType flush_type) override;
   std::future<bool> FutureFlush(FlushType flush_type) override;
   FutureRecordPosition LastPos() const override;
   FutureRecordPosition Pos() const override;
   Position EstimatedSize() const override;
+  uint64_t PendingChunks() const override { return 0; }
+  uint64_t PendingBytes() const override { return 0; }
+  size_t EstimateMemory() const override;
 
  protected:
   bool WriteSignature() override;
   bool WriteMetadata() override;
   bool PadToBlockBoundary() override;
+  bool WriteRawChunk(const Chunk& chunk) override;
+  bool WriteIndex() override;
 };
 
 inline RecordWriterBase::SerialWorker::SerialWorker(ChunkWriter* chunk_writer,
@@ -347,7 +1027,7 @@ bool RecordWriterBase::SerialWorker::WriteSignature() {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   Chunk chunk;
   EncodeSignature(chunk);
-  if (ABSL_PREDICT_FALSE(!chunk_writer_->WriteChunk(chunk))) {
+  if (ABSL_PREDICT_FALSE(!WriteToChunkWriter(chunk))) {
     return Fail(*chunk_writer_);
   }
   return true;
@@ -361,19 +1041,24 @@ bool RecordWriterBase::SerialWorker::WriteMetadata() {
   }
   Chunk chunk;
   if (ABSL_PREDICT_FALSE(!EncodeMetadata(chunk))) return false;
-  if (ABSL_PREDICT_FALSE(!chunk_writer_->WriteChunk(chunk))) {
+  if (ABSL_PREDICT_FALSE(!WriteToChunkWriter(chunk))) {
     return Fail(*chunk_writer_);
   }
   return true;
 }
 
 bool RecordWriterBase::SerialWorker::CloseChunk() {
+  memory_account_.UpdateFlushable(0);
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  AddKeysToIndex();
+  AddTimesToIndex();
+  UpdateReference();
   Chunk chunk;
   if (ABSL_PREDICT_FALSE(!EncodeChunk(*chunk_encoder_, chunk))) {
     return false;
   }
-  if (ABSL_PREDICT_FALSE(!chunk_writer_->WriteChunk(chunk))) {
+  AddToIndex(chunk.header);
+  if (ABSL_PREDICT_FALSE(!WriteToChunkWriter(chunk))) {
     return Fail(*chunk_writer_);
   }
   return true;
@@ -387,6 +1072,25 @@ bool RecordWriterBase::SerialWorker::PadToBlockBoundary() {
   return true;
 }
 
+bool RecordWriterBase::SerialWorker::WriteRawChunk(const Chunk& chunk) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  AddToIndex(chunk.header);
+  if (ABSL_PREDICT_FALSE(!WriteToChunkWriter(chunk))) {
+    return Fail(*chunk_writer_);
+  }
+  return true;
+}
+
+bool RecordWriterBase::SerialWorker::WriteIndex() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  Chunk chunk;
+  if (ABSL_PREDICT_FALSE(!EncodeIndex(chunk))) return false;
+  if (ABSL_PREDICT_FALSE(!WriteToChunkWriter(chunk))) {
+    return Fail(*chunk_writer_);
+  }
+  return true;
+}
+
 bool RecordWriterBase::SerialWorker::Flush(FlushType flush_type) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   if (ABSL_PREDICT_FALSE(!chunk_writer_->Flush(flush_type))) {
@@ -419,6 +1123,11 @@ Position RecordWriterBase::SerialWorker::EstimatedSize() const {
   return chunk_writer_->pos();
 }
 
+size_t RecordWriterBase::SerialWorker::EstimateMemory() const {
+  return SaturatingAdd(chunk_encoder_->EstimateMemory(),
+                       chunk_writer_->EstimateMemory());
+}
+
 // `ParallelWorker` uses parallelism internally, but the class is still only
 // thread-compatible, not thread-safe.
 class RecordWriterBase::ParallelWorker : public Worker {
@@ -427,19 +1136,25 @@ class RecordWriterBase::ParallelWorker : public Worker {
 
   ~ParallelWorker();
 
-  void OpenChunk() override { chunk_encoder_ = MakeChunkEncoder(); }
+  void OpenChunk() override;
   bool CloseChunk() override;
   bool Flush(FlushType flush_type) override;
   std::future<bool> FutureFlush(FlushType flush_type) override;
   FutureRecordPosition LastPos() const override;
   FutureRecordPosition Pos() const override;
   Position EstimatedSize() const override;
+  uint64_t PendingChunks() const override;
+  uint64_t PendingBytes() const override;
+  size_t EstimateMemory() const override;
+  PipelineStats GetPipelineStats() const override;
 
  protected:
   void Done() override;
   bool WriteSignature() override;
   bool WriteMetadata() override;
   bool PadToBlockBoundary() override;
+  bool WriteRawChunk(const Chunk& chunk) override;
+  bool WriteIndex() override;
 
  private:
   struct ChunkPromises {
@@ -447,6 +1162,14 @@ class RecordWriterBase::ParallelWorker : public Worker {
     std::promise<Chunk> chunk;
   };
 
+  // A chunk being encoded in background. It is kept in a single allocation, so
+  // that a task capturing only pointers fits in the small buffer of
+  // `std::function` and scheduling it does not allocate.
+  struct PendingChunk {
+    std::unique_ptr<ChunkEncoder> chunk_encoder;
+    ChunkPromises chunk_promises;
+  };
+
   // A request to the chunk writer thread.
   struct DoneRequest {
     std::promise<void> done;
@@ -454,6 +1177,8 @@ class RecordWriterBase::ParallelWorker : public Worker {
   struct WriteChunkRequest {
     std::shared_future<ChunkHeader> chunk_header;
     std::future<Chunk> chunk;
+    // Size of records in the chunk, counted in `pending_bytes_`.
+    uint64_t decoded_data_size;
   };
   struct PadToBlockBoundaryRequest {};
   struct FlushRequest {
@@ -465,19 +1190,75 @@ class RecordWriterBase::ParallelWorker : public Worker {
                     FlushRequest>;
 
   bool HasCapacityForRequest() const;
+  // Locks `mutex_` when `HasCapacityForRequest()`, accounting the time this
+  // blocked.
+  void LockWhenHasCapacity() ABSL_EXCLUSIVE_LOCK_FUNCTION(mutex_);
+  void RecordQueueLength();
+  // Adapts `compression_level_` to the number of pending chunks, if
+  // `min_compression_level_ < options_.compression_level()`.
+  void AdaptCompressionLevel();
+  void AddWriteChunkRequest(WriteChunkRequest request);
+  // Schedules background encoding on `options_.executor()` if set, otherwise on
+  // the global thread pool.
+  void ScheduleEncoding(std::function<void()> task);
   template <typename GetRecordIndex>
   FutureRecordPosition PosInternal(GetRecordIndex get_record_index) const;
 
   mutable absl::Mutex mutex_;
   std::deque<ChunkWriterRequest> chunk_writer_requests_ ABSL_GUARDED_BY(mutex_);
+  // The lowest compression level which `AdaptCompressionLevel()` may choose:
+  // `options_.min_adaptive_compression_level()` clamped to the valid range, or
+  // `options_.compression_level()` if it is not adapted.
+  int min_compression_level_;
   // Position before handling `chunk_writer_requests_`.
   Position pos_before_chunks_ ABSL_GUARDED_BY(mutex_);
+  // Block size of the file, fixed before `chunk_writer_` is used by the chunk
+  // writer thread.
+  Position block_size_;
+  // The number of `WriteChunkRequest`s in `chunk_writer_requests_`, and the
+  // sum of their `decoded_data_size`.
+  uint64_t pending_chunks_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t pending_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Parts of `PipelineStats` specific to `ParallelWorker`.
+  uint64_t num_waits_for_capacity_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::Duration wait_for_capacity_time_ ABSL_GUARDED_BY(mutex_);
+  absl::Duration wait_for_encoding_time_ ABSL_GUARDED_BY(mutex_);
+  std::vector<uint64_t> queue_lengths_ ABSL_GUARDED_BY(mutex_);
+  uint64_t num_chunks_with_lowered_compression_level_ ABSL_GUARDED_BY(mutex_) =
+      0;
 };
 
 inline RecordWriterBase::ParallelWorker::ParallelWorker(
     ChunkWriter* chunk_writer, Options&& options)
     : Worker(chunk_writer, std::move(options)),
-      pos_before_chunks_(chunk_writer_->pos()) {
+      min_compression_level_(options_.compression_level()),
+      pos_before_chunks_(chunk_writer_->pos()),
+      block_size_(chunk_writer_->pos() == 0 ? options_.block_size()
+                                            : chunk_writer_->block_size()),
+      queue_lengths_(IntCast<size_t>(options_.parallelism())) {
+  if (options_.min_adaptive_compression_level() != absl::nullopt) {
+    int lowest_compression_level = options_.compression_level();
+    switch (options_.compression_type()) {
+      case CompressionType::kBrotli:
+        lowest_compression_level = CompressorOptions::kMinBrotli;
+        break;
+      case CompressionType::kZstd:
+        lowest_compression_level = CompressorOptions::kMinZstd;
+        break;
+      case CompressionType::kLz4:
+        lowest_compression_level = CompressorOptions::kMinLz4;
+        break;
+      default:
+        break;
+    }
+    min_compression_level_ = SignedMin(
+        SignedMax(*options_.min_adaptive_compression_level(),
+                  lowest_compression_level),
+        options_.compression_level());
+  }
+  // The chunk writer thread waits for chunks being encoded, so it runs in the
+  // global thread pool rather than in `options_.executor()`, where tasks must
+  // not block waiting for other tasks.
   internal::ThreadPool::global().Schedule([this] {
     struct Visitor {
       bool operator()(DoneRequest& request) const {
@@ -489,9 +1270,16 @@ inline RecordWriterBase::ParallelWorker::ParallelWorker(
         // If `!healthy()`, the chunk must still be waited for, to ensure that
         // the chunk encoder thread exits before the chunk writer thread
         // responds to `DoneRequest`.
+        const absl::Time start_time = absl::Now();
         const Chunk chunk = request.chunk.get();
+        const absl::Duration wait_time = absl::Now() - start_time;
+        {
+          absl::MutexLock lock(&self->mutex_);
+          self->wait_for_encoding_time_ += wait_time;
+        }
         if (ABSL_PREDICT_FALSE(!self->healthy())) return true;
-        if (ABSL_PREDICT_FALSE(!self->chunk_writer_->WriteChunk(chunk))) {
+        self->AddToIndex(chunk.header);
+        if (ABSL_PREDICT_FALSE(!self->WriteToChunkWriter(chunk))) {
           self->Fail(*self->chunk_writer_);
         }
         return true;
@@ -534,6 +1322,12 @@ inline RecordWriterBase::ParallelWorker::ParallelWorker(
       mutex_.Unlock();
       if (ABSL_PREDICT_FALSE(!absl::visit(Visitor{this}, request))) return;
       mutex_.Lock();
+      if (const WriteChunkRequest* const write_chunk_request =
+              absl::get_if<WriteChunkRequest>(&request)) {
+        --pending_chunks_;
+        pending_bytes_ -= write_chunk_request->decoded_data_size;
+        memory_account_.RemovePending(write_chunk_request->decoded_data_size);
+      }
       chunk_writer_requests_.pop_front();
       pos_before_chunks_ = chunk_writer_->pos();
     }
@@ -562,7 +1356,67 @@ void RecordWriterBase::ParallelWorker::Done() {
 bool RecordWriterBase::ParallelWorker::HasCapacityForRequest() const
     ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
   return chunk_writer_requests_.size() <
-         IntCast<size_t>(options_.parallelism());
+             IntCast<size_t>(options_.parallelism()) &&
+         (options_.max_pending_bytes() == absl::nullopt ||
+          pending_bytes_ < *options_.max_pending_bytes());
+}
+
+inline void RecordWriterBase::ParallelWorker::LockWhenHasCapacity() {
+  mutex_.Lock();
+  if (ABSL_PREDICT_TRUE(HasCapacityForRequest())) return;
+  const absl::Time start_time = absl::Now();
+  mutex_.Await(absl::Condition(this, &ParallelWorker::HasCapacityForRequest));
+  ++num_waits_for_capacity_;
+  wait_for_capacity_time_ += absl::Now() - start_time;
+}
+
+inline void RecordWriterBase::ParallelWorker::RecordQueueLength()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+  if (queue_lengths_.empty()) return;
+  ++queue_lengths_[UnsignedMin(chunk_writer_requests_.size(),
+                               queue_lengths_.size() - 1)];
+}
+
+void RecordWriterBase::ParallelWorker::OpenChunk() {
+  AdaptCompressionLevel();
+  chunk_encoder_ = MakeChunkEncoder();
+}
+
+inline void RecordWriterBase::ParallelWorker::AdaptCompressionLevel() {
+  if (min_compression_level_ == options_.compression_level()) return;
+  uint64_t pending_chunks;
+  {
+    absl::MutexLock lock(&mutex_);
+    pending_chunks = pending_chunks_;
+  }
+  const uint64_t parallelism = IntCast<uint64_t>(options_.parallelism());
+  if (pending_chunks >= parallelism) {
+    // Encoding does not keep up with records being written. Trade compression
+    // density for speed.
+    if (compression_level_ > min_compression_level_) --compression_level_;
+  } else if (pending_chunks * 2 < parallelism) {
+    if (compression_level_ < options_.compression_level()) {
+      ++compression_level_;
+    }
+  }
+}
+
+inline void RecordWriterBase::ParallelWorker::ScheduleEncoding(
+    std::function<void()> task) {
+  if (options_.executor() != nullptr) {
+    options_.executor()->Schedule(this, std::move(task));
+  } else {
+    internal::ThreadPool::global().Schedule(std::move(task));
+  }
+}
+
+inline void RecordWriterBase::ParallelWorker::AddWriteChunkRequest(
+    WriteChunkRequest request) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+  RecordQueueLength();
+  ++pending_chunks_;
+  pending_bytes_ += request.decoded_data_size;
+  memory_account_.AddPending(request.decoded_data_size);
+  chunk_writer_requests_.emplace_back(std::move(request));
 }
 
 bool RecordWriterBase::ParallelWorker::WriteSignature() {
@@ -572,11 +1426,10 @@ bool RecordWriterBase::ParallelWorker::WriteSignature() {
   ChunkPromises chunk_promises;
   chunk_promises.chunk_header.set_value(chunk.header);
   chunk_promises.chunk.set_value(std::move(chunk));
-  mutex_.LockWhen(
-      absl::Condition(this, &ParallelWorker::HasCapacityForRequest));
-  chunk_writer_requests_.emplace_back(
-      WriteChunkRequest{chunk_promises.chunk_header.get_future(),
-                        chunk_promises.chunk.get_future()});
+  LockWhenHasCapacity();
+  AddWriteChunkRequest(WriteChunkRequest{
+      chunk_promises.chunk_header.get_future(),
+      chunk_promises.chunk.get_future(), 0});
   mutex_.Unlock();
   return true;
 }
@@ -588,13 +1441,12 @@ bool RecordWriterBase::ParallelWorker::WriteMetadata() {
     return true;
   }
   ChunkPromises* const chunk_promises = new ChunkPromises();
-  mutex_.LockWhen(
-      absl::Condition(this, &ParallelWorker::HasCapacityForRequest));
-  chunk_writer_requests_.emplace_back(
-      WriteChunkRequest{chunk_promises->chunk_header.get_future(),
-                        chunk_promises->chunk.get_future()});
+  LockWhenHasCapacity();
+  AddWriteChunkRequest(WriteChunkRequest{
+      chunk_promises->chunk_header.get_future(),
+      chunk_promises->chunk.get_future(), 0});
   mutex_.Unlock();
-  internal::ThreadPool::global().Schedule([this, chunk_promises] {
+  ScheduleEncoding([this, chunk_promises] {
     Chunk chunk;
     EncodeMetadata(chunk);
     chunk_promises->chunk_header.set_value(chunk.header);
@@ -605,36 +1457,80 @@ bool RecordWriterBase::ParallelWorker::WriteMetadata() {
 }
 
 bool RecordWriterBase::ParallelWorker::CloseChunk() {
+  // Records of the chunk are counted as pending by `AddWriteChunkRequest()`.
+  memory_account_.UpdateFlushable(0);
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  ChunkEncoder* const chunk_encoder = chunk_encoder_.release();
-  ChunkPromises* const chunk_promises = new ChunkPromises();
-  mutex_.LockWhen(
-      absl::Condition(this, &ParallelWorker::HasCapacityForRequest));
-  chunk_writer_requests_.emplace_back(
-      WriteChunkRequest{chunk_promises->chunk_header.get_future(),
-                        chunk_promises->chunk.get_future()});
+  AddKeysToIndex();
+  AddTimesToIndex();
+  UpdateReference();
+  PendingChunk* const pending_chunk = new PendingChunk();
+  pending_chunk->chunk_encoder = std::move(chunk_encoder_);
+  LockWhenHasCapacity();
+  if (compression_level_ < options_.compression_level()) {
+    ++num_chunks_with_lowered_compression_level_;
+  }
+  AddWriteChunkRequest(WriteChunkRequest{
+      pending_chunk->chunk_promises.chunk_header.get_future(),
+      pending_chunk->chunk_promises.chunk.get_future(),
+      pending_chunk->chunk_encoder->decoded_data_size()});
   mutex_.Unlock();
-  internal::ThreadPool::global().Schedule(
-      [this, chunk_encoder, chunk_promises] {
-        Chunk chunk;
-        EncodeChunk(*chunk_encoder, chunk);
-        delete chunk_encoder;
-        chunk_promises->chunk_header.set_value(chunk.header);
-        chunk_promises->chunk.set_value(std::move(chunk));
-        delete chunk_promises;
-      });
+  ScheduleEncoding([this, pending_chunk] {
+    Chunk chunk;
+    EncodeChunk(*pending_chunk->chunk_encoder, chunk);
+    pending_chunk->chunk_encoder.reset();
+    pending_chunk->chunk_promises.chunk_header.set_value(chunk.header);
+    pending_chunk->chunk_promises.chunk.set_value(std::move(chunk));
+    delete pending_chunk;
+  });
   return true;
 }
 
 bool RecordWriterBase::ParallelWorker::PadToBlockBoundary() {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
-  mutex_.LockWhen(
-      absl::Condition(this, &ParallelWorker::HasCapacityForRequest));
+  LockWhenHasCapacity();
+  RecordQueueLength();
   chunk_writer_requests_.emplace_back(PadToBlockBoundaryRequest());
   mutex_.Unlock();
   return true;
 }
 
+bool RecordWriterBase::ParallelWorker::WriteRawChunk(const Chunk& chunk) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  ChunkPromises chunk_promises;
+  chunk_promises.chunk_header.set_value(chunk.header);
+  chunk_promises.chunk.set_value(chunk);
+  LockWhenHasCapacity();
+  AddWriteChunkRequest(WriteChunkRequest{
+      chunk_promises.chunk_header.get_future(),
+      chunk_promises.chunk.get_future(), chunk.header.decoded_data_size()});
+  mutex_.Unlock();
+  return true;
+}
+
+bool RecordWriterBase::ParallelWorker::WriteIndex() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  // The index is complete when the chunk writer thread has written all
+  // preceding chunks. It is not accessed by that thread while it is idle.
+  mutex_.LockWhen(absl::Condition(
+      +[](std::deque<ChunkWriterRequest>* chunk_writer_requests) {
+        return chunk_writer_requests->empty();
+      },
+      &chunk_writer_requests_));
+  mutex_.Unlock();
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  Chunk chunk;
+  if (ABSL_PREDICT_FALSE(!EncodeIndex(chunk))) return false;
+  ChunkPromises chunk_promises;
+  chunk_promises.chunk_header.set_value(chunk.header);
+  chunk_promises.chunk.set_value(std::move(chunk));
+  LockWhenHasCapacity();
+  AddWriteChunkRequest(WriteChunkRequest{
+      chunk_promises.chunk_header.get_future(),
+      chunk_promises.chunk.get_future(), 0});
+  mutex_.Unlock();
+  return true;
+}
+
 bool RecordWriterBase::ParallelWorker::Flush(FlushType flush_type) {
   return FutureFlush(flush_type).get();
 }
@@ -643,8 +1539,7 @@ std::future<bool> RecordWriterBase::ParallelWorker::FutureFlush(
     FlushType flush_type) {
   std::promise<bool> done_promise;
   std::future<bool> done_future = done_promise.get_future();
-  mutex_.LockWhen(
-      absl::Condition(this, &ParallelWorker::HasCapacityForRequest));
+  LockWhenHasCapacity();
   chunk_writer_requests_.emplace_back(
       FlushRequest{flush_type, std::move(done_promise)});
   mutex_.Unlock();
@@ -673,7 +1568,7 @@ FutureRecordPosition RecordWriterBase::ParallelWorker::PosInternal(
     absl::visit(visitor, request);
   }
   return FutureRecordPosition(pos_before_chunks_, std::move(visitor.actions),
-                              get_record_index());
+                              get_record_index(), block_size_);
 }
 
 FutureRecordPosition RecordWriterBase::ParallelWorker::LastPos() const {
@@ -704,6 +1599,39 @@ Position RecordWriterBase::ParallelWorker::EstimatedSize() const {
   return pos_before_chunks_;
 }
 
+uint64_t RecordWriterBase::ParallelWorker::PendingChunks() const {
+  absl::MutexLock lock(&mutex_);
+  return pending_chunks_;
+}
+
+uint64_t RecordWriterBase::ParallelWorker::PendingBytes() const {
+  absl::MutexLock lock(&mutex_);
+  return pending_bytes_;
+}
+
+RecordWriterBase::PipelineStats
+RecordWriterBase::ParallelWorker::GetPipelineStats() const {
+  PipelineStats pipeline_stats = Worker::GetPipelineStats();
+  absl::MutexLock lock(&mutex_);
+  pipeline_stats.num_waits_for_capacity = num_waits_for_capacity_;
+  pipeline_stats.wait_for_capacity_time = wait_for_capacity_time_;
+  pipeline_stats.wait_for_encoding_time = wait_for_encoding_time_;
+  pipeline_stats.queue_lengths = queue_lengths_;
+  pipeline_stats.num_chunks_with_lowered_compression_level =
+      num_chunks_with_lowered_compression_level_;
+  return pipeline_stats;
+}
+
+size_t RecordWriterBase::ParallelWorker::EstimateMemory() const {
+  // The chunk writer is used by a background thread, so its buffer is not
+  // looked at.
+  size_t memory = SaturatingIntCast<size_t>(PendingBytes());
+  if (chunk_encoder_ != nullptr) {
+    memory = SaturatingAdd(memory, chunk_encoder_->EstimateMemory());
+  }
+  return memory;
+}
+
 RecordWriterBase::RecordWriterBase(InitiallyClosed) noexcept
     : Object(kInitiallyClosed) {}
 
@@ -714,16 +1642,26 @@ void RecordWriterBase::Reset(InitiallyClosed) {
   Object::Reset(kInitiallyClosed);
   desired_chunk_size_ = 0;
   chunk_size_so_far_ = 0;
+  tuned_chunk_size_ = absl::nullopt;
+  max_chunk_latency_ = absl::InfiniteDuration();
+  chunk_open_time_ = absl::Time();
   last_record_is_valid_ = false;
   worker_.reset();
+  stats_ = ChunkStats();
+  pipeline_stats_ = PipelineStats();
 }
 
 void RecordWriterBase::Reset(InitiallyOpen) {
   Object::Reset(kInitiallyOpen);
   desired_chunk_size_ = 0;
   chunk_size_so_far_ = 0;
+  tuned_chunk_size_ = absl::nullopt;
+  max_chunk_latency_ = absl::InfiniteDuration();
+  chunk_open_time_ = absl::Time();
   last_record_is_valid_ = false;
   worker_.reset();
+  stats_ = ChunkStats();
+  pipeline_stats_ = PipelineStats();
 }
 
 RecordWriterBase::RecordWriterBase(RecordWriterBase&& that) noexcept
@@ -732,8 +1670,13 @@ RecordWriterBase::RecordWriterBase(RecordWriterBase&& that) noexcept
       // part was moved.
       desired_chunk_size_(that.desired_chunk_size_),
       chunk_size_so_far_(that.chunk_size_so_far_),
+      tuned_chunk_size_(that.tuned_chunk_size_),
+      max_chunk_latency_(that.max_chunk_latency_),
+      chunk_open_time_(that.chunk_open_time_),
       last_record_is_valid_(std::exchange(that.last_record_is_valid_, false)),
-      worker_(std::move(that.worker_)) {}
+      worker_(std::move(that.worker_)),
+      stats_(that.stats_),
+      pipeline_stats_(std::move(that.pipeline_stats_)) {}
 
 RecordWriterBase& RecordWriterBase::operator=(
     RecordWriterBase&& that) noexcept {
@@ -742,8 +1685,13 @@ RecordWriterBase& RecordWriterBase::operator=(
   // was moved.
   desired_chunk_size_ = that.desired_chunk_size_;
   chunk_size_so_far_ = that.chunk_size_so_far_;
+  tuned_chunk_size_ = that.tuned_chunk_size_;
+  max_chunk_latency_ = that.max_chunk_latency_;
+  chunk_open_time_ = that.chunk_open_time_;
   last_record_is_valid_ = std::exchange(that.last_record_is_valid_, false);
   worker_ = std::move(that.worker_);
+  stats_ = that.stats_;
+  pipeline_stats_ = std::move(that.pipeline_stats_);
   return *this;
 }
 
@@ -760,6 +1708,44 @@ void RecordWriterBase::Initialize(ChunkWriter* dest, Options&& options) {
   // `num_records * sizeof(uint64_t)` under `desired_chunk_size_`.
   desired_chunk_size_ = UnsignedMin(options.effective_chunk_size(),
                                     kMaxNumRecords * sizeof(uint64_t));
+  max_chunk_latency_ = options.max_chunk_latency();
+  if (options.compression_type() == CompressionType::kZstd &&
+      !options.zstd_dictionary().empty()) {
+    // Store the dictionary in metadata, so that readers can decompress chunks.
+    if (options.serialized_metadata() != absl::nullopt) {
+      // Concatenating serialized messages merges them.
+      RecordsMetadata dictionary_metadata;
+      dictionary_metadata.set_zstd_dictionary(
+          std::string(options.zstd_dictionary().data()));
+      options.serialized_metadata()->Append(
+          dictionary_metadata.SerializeAsString());
+    } else {
+      if (options.metadata() == absl::nullopt) {
+        options.metadata().emplace();
+      }
+      options.metadata()->set_zstd_dictionary(
+          std::string(options.zstd_dictionary().data()));
+    }
+  }
+  if (options.compression_type() == CompressionType::kBrotli &&
+      !options.brotli_dictionary().empty()) {
+    // Store the dictionary identifier in metadata, so that readers can verify
+    // the dictionary they are given.
+    const uint64_t brotli_dictionary_id =
+        internal::Hash(options.brotli_dictionary().data());
+    if (options.serialized_metadata() != absl::nullopt) {
+      // Concatenating serialized messages merges them.
+      RecordsMetadata dictionary_metadata;
+      dictionary_metadata.set_brotli_dictionary_id(brotli_dictionary_id);
+      options.serialized_metadata()->Append(
+          dictionary_metadata.SerializeAsString());
+    } else {
+      if (options.metadata() == absl::nullopt) {
+        options.metadata().emplace();
+      }
+      options.metadata()->set_brotli_dictionary_id(brotli_dictionary_id);
+    }
+  }
   if (options.parallelism() == 0) {
     worker_ = std::make_unique<SerialWorker>(dest, std::move(options));
   } else {
@@ -779,8 +1765,11 @@ void RecordWriterBase::Done() {
     if (ABSL_PREDICT_FALSE(!worker_->CloseChunk())) Fail(*worker_);
     chunk_size_so_far_ = 0;
   }
+  if (ABSL_PREDICT_FALSE(!worker_->MaybeWriteIndex())) Fail(*worker_);
   if (ABSL_PREDICT_FALSE(!worker_->MaybePadToBlockBoundary())) Fail(*worker_);
   if (ABSL_PREDICT_FALSE(!worker_->Close())) Fail(*worker_);
+  stats_ = worker_->Stats();
+  pipeline_stats_ = worker_->GetPipelineStats();
 }
 
 void RecordWriterBase::DoneBackground() { worker_.reset(); }
@@ -797,13 +1786,22 @@ bool RecordWriterBase::WriteRecord(const google::protobuf::MessageLite& record,
       SaturatingAdd(IntCast<uint64_t>(size), uint64_t{sizeof(uint64_t)});
   if (ABSL_PREDICT_FALSE(chunk_size_so_far_ > desired_chunk_size_ ||
                          added_size >
-                             desired_chunk_size_ - chunk_size_so_far_) &&
+                             desired_chunk_size_ - chunk_size_so_far_ ||
+                         worker_->memory_account().flush_requested() ||
+                         ChunkIsStale()) &&
       chunk_size_so_far_ > 0) {
+    if (ABSL_PREDICT_FALSE(!MaybeTuneChunkSize(added_size))) return false;
     if (ABSL_PREDICT_FALSE(!worker_->CloseChunk())) return Fail(*worker_);
+    if (ABSL_PREDICT_FALSE(!FlushClosedChunk())) return false;
     worker_->OpenChunk();
     chunk_size_so_far_ = 0;
   }
+  if (chunk_size_so_far_ == 0 &&
+      max_chunk_latency_ != absl::InfiniteDuration()) {
+    chunk_open_time_ = absl::Now();
+  }
   chunk_size_so_far_ += added_size;
+  worker_->memory_account().UpdateFlushable(chunk_size_so_far_);
   if (ABSL_PREDICT_FALSE(!worker_->AddRecord(record, serialize_options))) {
     return Fail(*worker_);
   }
@@ -852,13 +1850,22 @@ inline bool RecordWriterBase::WriteRecordImpl(Record&& record) {
                                             uint64_t{sizeof(uint64_t)});
   if (ABSL_PREDICT_FALSE(chunk_size_so_far_ > desired_chunk_size_ ||
                          added_size >
-                             desired_chunk_size_ - chunk_size_so_far_) &&
+                             desired_chunk_size_ - chunk_size_so_far_ ||
+                         worker_->memory_account().flush_requested() ||
+                         ChunkIsStale()) &&
       chunk_size_so_far_ > 0) {
+    if (ABSL_PREDICT_FALSE(!MaybeTuneChunkSize(added_size))) return false;
     if (ABSL_PREDICT_FALSE(!worker_->CloseChunk())) return Fail(*worker_);
+    if (ABSL_PREDICT_FALSE(!FlushClosedChunk())) return false;
     worker_->OpenChunk();
     chunk_size_so_far_ = 0;
   }
+  if (chunk_size_so_far_ == 0 &&
+      max_chunk_latency_ != absl::InfiniteDuration()) {
+    chunk_open_time_ = absl::Now();
+  }
   chunk_size_so_far_ += added_size;
+  worker_->memory_account().UpdateFlushable(chunk_size_so_far_);
   if (ABSL_PREDICT_FALSE(!worker_->AddRecord(std::forward<Record>(record)))) {
     return Fail(*worker_);
   }
@@ -866,6 +1873,100 @@ inline bool RecordWriterBase::WriteRecordImpl(Record&& record) {
   return true;
 }
 
+bool RecordWriterBase::WriteRecords(
+    absl::Span<const absl::string_view> records) {
+  Chain concatenated;
+  std::vector<size_t> limits;
+  limits.reserve(records.size());
+  for (const absl::string_view record : records) {
+    concatenated.Append(record);
+    limits.push_back(concatenated.size());
+  }
+  return WriteRecords(std::move(concatenated), std::move(limits));
+}
+
+bool RecordWriterBase::WriteRecords(Chain records, std::vector<size_t> limits) {
+  RIEGELI_ASSERT_EQ(limits.empty() ? size_t{0} : limits.back(), records.size())
+      << "Failed precondition of RecordWriterBase::WriteRecords(): "
+         "record end positions do not match concatenated record values";
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (limits.empty()) return true;
+  last_record_is_valid_ = false;
+  size_t begin_index = 0;
+  size_t begin_pos = 0;
+  while (begin_index < limits.size()) {
+    // See `WriteRecordImpl()` for the meaning of `added_size`.
+    uint64_t added_size = SaturatingAdd(
+        IntCast<uint64_t>(limits[begin_index] - begin_pos),
+        uint64_t{sizeof(uint64_t)});
+    if (ABSL_PREDICT_FALSE(chunk_size_so_far_ > desired_chunk_size_ ||
+                           added_size >
+                               desired_chunk_size_ - chunk_size_so_far_ ||
+                           worker_->memory_account().flush_requested() ||
+                           ChunkIsStale()) &&
+        chunk_size_so_far_ > 0) {
+      if (ABSL_PREDICT_FALSE(!MaybeTuneChunkSize(added_size))) return false;
+      if (ABSL_PREDICT_FALSE(!worker_->CloseChunk())) return Fail(*worker_);
+      if (ABSL_PREDICT_FALSE(!FlushClosedChunk())) return false;
+      worker_->OpenChunk();
+      chunk_size_so_far_ = 0;
+    }
+    if (chunk_size_so_far_ == 0 &&
+        max_chunk_latency_ != absl::InfiniteDuration()) {
+      chunk_open_time_ = absl::Now();
+    }
+    // Take records while they fit in the open chunk, at least one.
+    size_t end_index = begin_index;
+    for (;;) {
+      chunk_size_so_far_ += added_size;
+      ++end_index;
+      if (end_index == limits.size()) break;
+      added_size = SaturatingAdd(
+          IntCast<uint64_t>(limits[end_index] - limits[end_index - 1]),
+          uint64_t{sizeof(uint64_t)});
+      if (chunk_size_so_far_ > desired_chunk_size_ ||
+          added_size > desired_chunk_size_ - chunk_size_so_far_) {
+        break;
+      }
+    }
+    worker_->memory_account().UpdateFlushable(chunk_size_so_far_);
+    const size_t end_pos = limits[end_index - 1];
+    Chain part;
+    std::vector<size_t> part_limits;
+    if (begin_index == 0 && end_index == limits.size()) {
+      part = std::move(records);
+      part_limits = std::move(limits);
+    } else {
+      part = records.Substr(begin_pos, end_pos - begin_pos);
+      part_limits.reserve(end_index - begin_index);
+      for (size_t i = begin_index; i < end_index; ++i) {
+        part_limits.push_back(limits[i] - begin_pos);
+      }
+    }
+    if (ABSL_PREDICT_FALSE(
+            !worker_->AddRecords(std::move(part), std::move(part_limits)))) {
+      return Fail(*worker_);
+    }
+    if (end_index == limits.size()) break;
+    begin_index = end_index;
+    begin_pos = end_pos;
+  }
+  last_record_is_valid_ = true;
+  return true;
+}
+
+bool RecordWriterBase::WriteChunk(const Chunk& chunk) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  last_record_is_valid_ = false;
+  if (chunk_size_so_far_ != 0) {
+    if (ABSL_PREDICT_FALSE(!worker_->CloseChunk())) return Fail(*worker_);
+    worker_->OpenChunk();
+    chunk_size_so_far_ = 0;
+  }
+  if (ABSL_PREDICT_FALSE(!worker_->WriteChunk(chunk))) return Fail(*worker_);
+  return true;
+}
+
 bool RecordWriterBase::Flush(FlushType flush_type) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   last_record_is_valid_ = false;
@@ -922,6 +2023,51 @@ RecordWriterBase::FutureBool RecordWriterBase::FutureFlush(
   return result;
 }
 
+bool RecordWriterBase::FlushStaleChunk() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (chunk_size_so_far_ == 0 || !ChunkIsStale()) return true;
+  last_record_is_valid_ = false;
+  if (ABSL_PREDICT_FALSE(!worker_->CloseChunk())) return Fail(*worker_);
+  if (ABSL_PREDICT_FALSE(!FlushClosedChunk())) return false;
+  worker_->OpenChunk();
+  chunk_size_so_far_ = 0;
+  return true;
+}
+
+inline bool RecordWriterBase::ChunkIsStale() const {
+  return max_chunk_latency_ != absl::InfiniteDuration() &&
+         absl::Now() - chunk_open_time_ >= max_chunk_latency_;
+}
+
+inline bool RecordWriterBase::FlushClosedChunk() {
+  if (max_chunk_latency_ == absl::InfiniteDuration()) return true;
+  // Padding is not written, and background writing is not waited for. If
+  // `parallelism() > 0`, its failures are reported by later operations.
+  worker_->FutureFlush(FlushType::kFromProcess);
+  if (ABSL_PREDICT_FALSE(!worker_->healthy())) return Fail(*worker_);
+  return true;
+}
+
+inline bool RecordWriterBase::MaybeTuneChunkSize(uint64_t added_size) {
+  if (tuned_chunk_size_ != absl::nullopt ||
+      (chunk_size_so_far_ <= desired_chunk_size_ &&
+       added_size <= desired_chunk_size_ - chunk_size_so_far_)) {
+    // Tuning is finished, or the chunk is closed early by a flush request or
+    // by `max_chunk_latency_`. In the latter case records collected for tuning
+    // are kept until a chunk is filled.
+    return true;
+  }
+  const absl::optional<uint64_t> chunk_size = worker_->TuneChunkSize();
+  if (chunk_size == absl::nullopt) {
+    if (ABSL_PREDICT_FALSE(!worker_->healthy())) return Fail(*worker_);
+    return true;
+  }
+  tuned_chunk_size_ = *chunk_size;
+  desired_chunk_size_ =
+      UnsignedMin(*chunk_size, kMaxNumRecords * sizeof(uint64_t));
+  return true;
+}
+
 FutureRecordPosition RecordWriterBase::LastPos() const {
   RIEGELI_ASSERT(last_record_is_valid())
       << "Failed precondition of RecordWriterBase::LastPos(): "
@@ -942,4 +2088,29 @@ Position RecordWriterBase::EstimatedSize() const {
   return worker_->EstimatedSize();
 }
 
+ChunkStats RecordWriterBase::Stats() const {
+  if (worker_ == nullptr) return stats_;
+  return worker_->Stats();
+}
+
+RecordWriterBase::PipelineStats RecordWriterBase::GetPipelineStats() const {
+  if (worker_ == nullptr) return pipeline_stats_;
+  return worker_->GetPipelineStats();
+}
+
+uint64_t RecordWriterBase::PendingChunks() const {
+  if (ABSL_PREDICT_FALSE(worker_ == nullptr)) return 0;
+  return worker_->PendingChunks();
+}
+
+uint64_t RecordWriterBase::PendingBytes() const {
+  if (ABSL_PREDICT_FALSE(worker_ == nullptr)) return 0;
+  return worker_->PendingBytes();
+}
+
+size_t RecordWriterBase::EstimateMemory() const {
+  if (ABSL_PREDICT_FALSE(worker_ == nullptr)) return 0;
+  return worker_->EstimateMemory();
+}
+
 }  // namespace riegeli
@@ -17,34 +17,50 @@
 
 #include <stdint.h>
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message_lite.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/memory_budget.h"
 #include "riegeli/base/object.h"
 #include "riegeli/base/stable_dependency.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
+#include "riegeli/chunk_encoding/column_statistics.h"
 #include "riegeli/chunk_encoding/compressor_options.h"
 #include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/chunk_encoding/field_projection.h"
 #include "riegeli/messages/message_serialize.h"
+#include "riegeli/records/block.h"
 #include "riegeli/records/chunk_writer.h"
 #include "riegeli/records/chunk_writer_dependency.h"
 #include "riegeli/records/record_position.h"
 #include "riegeli/records/records_metadata.pb.h"
+#include "riegeli/records/records_observer.h"
+#include "riegeli/zstd/zstd_writer.h"
 
 namespace riegeli {
 
+class ChunkEncoder;
+
 // Sets `record_type_name` and `file_descriptor` in metadata, based on the
 // message descriptor of the type of records.
 //
@@ -66,22 +82,44 @@ class RecordWriterBase : public Object {
     //   option ::=
     //     "default" |
     //     "transpose" (":" ("true" | "false"))? |
+    //     "adaptive_transpose" ":" adaptive_transpose |
+    //     "column_encoding" (":" ("true" | "false"))? |
+    //     "deduplicate" (":" ("true" | "false"))? |
     //     "uncompressed" |
     //     "brotli" (":" brotli_level)? |
     //     "zstd" (":" zstd_level)? |
     //     "snappy" |
+    //     "lz4" (":" lz4_level)? |
     //     "window_log" ":" window_log |
+    //     "min_compression_ratio" ":" min_compression_ratio |
+    //     "hardware_offload" (":" ("true" | "false"))? |
     //     "chunk_size" ":" chunk_size |
     //     "bucket_fraction" ":" bucket_fraction |
+    //     "autotune_chunk_size" ":" autotune_chunk_size |
+    //     "keyframe_interval" ":" keyframe_interval |
     //     "pad_to_block_boundary" (":" ("true" | "false"))? |
-    //     "parallelism" ":" parallelism
+    //     "index" (":" ("true" | "false"))? |
+    //     "parallelism" ":" parallelism |
+    //     "max_pending_bytes" ":" max_pending_bytes |
+    //     "min_adaptive_compression_level" ":"
+    //       min_adaptive_compression_level |
+    //     "reserve_chunk_size" (":" ("true" | "false"))?
+    //   adaptive_transpose ::= "none" or real in the range [0..1]
     //   brotli_level ::= integer in the range [0..11] (default 6)
     //   zstd_level ::= integer in the range [-131072..22] (default 3)
+    //   lz4_level ::= integer in the range [-65536..12] (default 0)
     //   window_log ::= "auto" or integer in the range [10..31]
+    //   min_compression_ratio ::= real not smaller than 1
     //   chunk_size ::= "auto" or positive integer expressed as real with
     //     optional suffix [BkKMGTPE]
     //   bucket_fraction ::= real in the range [0..1]
+    //   autotune_chunk_size ::= "none" or non-negative real
+    //   keyframe_interval ::= non-negative integer
     //   parallelism ::= non-negative integer
+    //   max_pending_bytes ::= "none" or positive integer expressed as real with
+    //     optional suffix [BkKMGTPE]
+    //   min_adaptive_compression_level ::= "none" or integer in the range
+    //     [-131072..22]
     // ```
     //
     // An empty string is the same as "default".
@@ -111,6 +149,131 @@ class RecordWriterBase : public Object {
     }
     bool transpose() const { return transpose_; }
 
+    // If not `absl::nullopt` and `transpose()`, each chunk is transposed only
+    // if this pays off: a sample of its records, up to 64KB, is trial-encoded
+    // both transposed and not, and the chunk is transposed only if this makes
+    // the sample smaller by at least the fraction `adaptive_transpose()`.
+    // Otherwise the chunk is stored as with `!transpose()`.
+    //
+    // This helps files mixing proto messages with opaque bytes, where
+    // transposition of the latter costs time for no gain. A positive value
+    // additionally avoids the cost of transposition when the gain is small.
+    //
+    // Trial encoding costs encoding the sample twice, and keeping a copy of
+    // records of the chunk.
+    //
+    // Default: `absl::nullopt` (every chunk is transposed if `transpose()`).
+    Options& set_adaptive_transpose(absl::optional<double> min_gain) & {
+      if (min_gain != absl::nullopt) {
+        RIEGELI_ASSERT_GE(*min_gain, 0.0)
+            << "Failed precondition of "
+               "RecordWriterBase::Options::set_adaptive_transpose(): "
+               "gain out of range";
+        RIEGELI_ASSERT_LE(*min_gain, 1.0)
+            << "Failed precondition of "
+               "RecordWriterBase::Options::set_adaptive_transpose(): "
+               "gain out of range";
+      }
+      adaptive_transpose_ = min_gain;
+      return *this;
+    }
+    Options&& set_adaptive_transpose(absl::optional<double> min_gain) && {
+      return std::move(set_adaptive_transpose(min_gain));
+    }
+    absl::optional<double> adaptive_transpose() const {
+      return adaptive_transpose_;
+    }
+
+    // If `true` and `transpose()`, varint fields of transposed chunks are
+    // stored bit-packed, possibly as zigzag-encoded deltas, if this makes
+    // them smaller. This helps e.g. timestamps and ids which grow slowly.
+    // String fields with few distinct values are stored as a dictionary and
+    // indices into it, if this makes them smaller.
+    //
+    // Such chunks have type `ChunkType::kTransposedV2`, which is not supported
+    // by readers older than this option.
+    //
+    // Default: `false`.
+    Options& set_column_encoding(bool column_encoding) & {
+      column_encoding_ = column_encoding;
+      return *this;
+    }
+    Options&& set_column_encoding(bool column_encoding) && {
+      return std::move(set_column_encoding(column_encoding));
+    }
+    bool column_encoding() const { return column_encoding_; }
+
+    // If not empty and `transpose()`, transposed chunks store statistics of
+    // these numeric fields: the number of records without the field, and the
+    // smallest and the largest value. A `RecordReader` with
+    // `RecordReaderBase::Options::set_chunk_filter()` can skip whole chunks
+    // using them, without decompressing them.
+    //
+    // Such chunks have type `ChunkType::kTransposedV2`, which is not supported
+    // by readers older than this option.
+    //
+    // Default: `{}`.
+    Options& set_column_statistics(
+        std::vector<StatisticsField> column_statistics) & {
+      column_statistics_ = std::move(column_statistics);
+      return *this;
+    }
+    Options&& set_column_statistics(
+        std::vector<StatisticsField> column_statistics) && {
+      return std::move(set_column_statistics(std::move(column_statistics)));
+    }
+    std::vector<StatisticsField>& column_statistics() {
+      return column_statistics_;
+    }
+    const std::vector<StatisticsField>& column_statistics() const {
+      return column_statistics_;
+    }
+
+    // If not empty and `transpose()`, transposed chunks store a Bloom filter of
+    // values of each of these fields, e.g. keys. `RecordReaderBase::Lookup()`
+    // skips chunks whose Bloom filter rules the value out, without
+    // decompressing them.
+    //
+    // A Bloom filter costs about 10 bits per distinct value in a chunk and
+    // gives about 1% of false positives.
+    //
+    // Such chunks have type `ChunkType::kTransposedV2`, which is not supported
+    // by readers older than this option.
+    //
+    // Default: `{}`.
+    Options& set_bloom_filter_fields(std::vector<Field> bloom_filter_fields) & {
+      bloom_filter_fields_ = std::move(bloom_filter_fields);
+      return *this;
+    }
+    Options&& set_bloom_filter_fields(
+        std::vector<Field> bloom_filter_fields) && {
+      return std::move(set_bloom_filter_fields(std::move(bloom_filter_fields)));
+    }
+    std::vector<Field>& bloom_filter_fields() { return bloom_filter_fields_; }
+    const std::vector<Field>& bloom_filter_fields() const {
+      return bloom_filter_fields_;
+    }
+
+    // If `true` and `!transpose()`, a record identical to an earlier record of
+    // the same chunk is stored as a reference to it instead of its value. This
+    // helps if records repeat, e.g. retries or heartbeats: duplicates are not
+    // compressed again and do not occupy space in the compression window.
+    //
+    // Records of a chunk are kept flat in memory until the chunk is encoded.
+    //
+    // Such chunks have type `ChunkType::kDeduplicated`, which is not supported
+    // by readers older than this option.
+    //
+    // Default: `false`.
+    Options& set_deduplicate(bool deduplicate) & {
+      deduplicate_ = deduplicate;
+      return *this;
+    }
+    Options&& set_deduplicate(bool deduplicate) && {
+      return std::move(set_deduplicate(deduplicate));
+    }
+    bool deduplicate() const { return deduplicate_; }
+
     // Changes compression algorithm to Uncompressed (turns compression off).
     Options& set_uncompressed() & {
       compressor_options_.set_uncompressed();
@@ -164,6 +327,27 @@ class RecordWriterBase : public Object {
     }
     Options&& set_snappy() && { return std::move(set_snappy()); }
 
+    // Changes compression algorithm to LZ4. Sets compression level which tunes
+    // the tradeoff between compression density and compression speed (higher =
+    // better density but slower).
+    //
+    // LZ4 typically decompresses faster than Snappy, with similar compression
+    // density at low levels.
+    //
+    // `compression_level` must be between `kMinLz4` (-65536) and `kMaxLz4`
+    // (12). Levels below 3 use the fast LZ4 compressor, levels 3 and above use
+    // LZ4HC. Default: `kDefaultLz4` (0).
+    static constexpr int kMinLz4 = CompressorOptions::kMinLz4;
+    static constexpr int kMaxLz4 = CompressorOptions::kMaxLz4;
+    static constexpr int kDefaultLz4 = CompressorOptions::kDefaultLz4;
+    Options& set_lz4(int compression_level = kDefaultLz4) & {
+      compressor_options_.set_lz4(compression_level);
+      return *this;
+    }
+    Options&& set_lz4(int compression_level = kDefaultLz4) && {
+      return std::move(set_lz4(compression_level));
+    }
+
     CompressionType compression_type() const {
       return compressor_options_.compression_type();
     }
@@ -179,7 +363,8 @@ class RecordWriterBase : public Object {
     // Special value `absl::nullopt` means to keep the default (Brotli: 22,
     // Zstd: derived from compression level and chunk size).
     //
-    // For Uncompressed and Snappy, `window_log` must be `absl::nullopt`.
+    // For Uncompressed, Snappy, and LZ4, `window_log` must be
+    // `absl::nullopt`.
     //
     // For Brotli, `window_log` must be `absl::nullopt` or between
     // `BrotliWriterBase::Options::kMinWindowLog` (10) and
@@ -204,6 +389,111 @@ class RecordWriterBase : public Object {
       return compressor_options_.window_log();
     }
 
+    // Zstd dictionary. This improves compression of small chunks whose records
+    // share content with the dictionary. A dictionary can be trained with
+    // `ZstdDictionaryTrainer`.
+    //
+    // The dictionary is stored in `RecordsMetadata::zstd_dictionary`, from
+    // where a `RecordReader` loads it automatically.
+    //
+    // Used only for Zstd.
+    //
+    // Default: `ZstdWriterBase::Dictionary()` (no dictionary).
+    Options& set_zstd_dictionary(
+        const ZstdWriterBase::Dictionary& zstd_dictionary) & {
+      compressor_options_.set_zstd_dictionary(zstd_dictionary);
+      return *this;
+    }
+    Options& set_zstd_dictionary(
+        ZstdWriterBase::Dictionary&& zstd_dictionary) & {
+      compressor_options_.set_zstd_dictionary(std::move(zstd_dictionary));
+      return *this;
+    }
+    Options&& set_zstd_dictionary(
+        const ZstdWriterBase::Dictionary& zstd_dictionary) && {
+      return std::move(set_zstd_dictionary(zstd_dictionary));
+    }
+    Options&& set_zstd_dictionary(
+        ZstdWriterBase::Dictionary&& zstd_dictionary) && {
+      return std::move(set_zstd_dictionary(std::move(zstd_dictionary)));
+    }
+    const ZstdWriterBase::Dictionary& zstd_dictionary() const {
+      return compressor_options_.zstd_dictionary();
+    }
+
+    // Brotli shared dictionary. This improves compression of small chunks
+    // whose records share content with the dictionary, so that `chunk_size`
+    // and thus read latency can stay small.
+    //
+    // Only an identifier of the dictionary is stored, in
+    // `RecordsMetadata::brotli_dictionary_id`, so that the dictionary can be
+    // shared by many files. The same dictionary must be given to
+    // `RecordReaderBase::Options::set_brotli_dictionary()`.
+    //
+    // Used only for Brotli.
+    //
+    // Default: `BrotliDictionary()` (no dictionary).
+    Options& set_brotli_dictionary(
+        const BrotliDictionary& brotli_dictionary) & {
+      compressor_options_.set_brotli_dictionary(brotli_dictionary);
+      return *this;
+    }
+    Options& set_brotli_dictionary(BrotliDictionary&& brotli_dictionary) & {
+      compressor_options_.set_brotli_dictionary(std::move(brotli_dictionary));
+      return *this;
+    }
+    Options&& set_brotli_dictionary(
+        const BrotliDictionary& brotli_dictionary) && {
+      return std::move(set_brotli_dictionary(brotli_dictionary));
+    }
+    Options&& set_brotli_dictionary(BrotliDictionary&& brotli_dictionary) && {
+      return std::move(set_brotli_dictionary(std::move(brotli_dictionary)));
+    }
+    const BrotliDictionary& brotli_dictionary() const {
+      return compressor_options_.brotli_dictionary();
+    }
+
+    // If not `absl::nullopt`, compression is adaptive: a sample of each chunk
+    // is compressed first, and if it does not shrink by at least this factor
+    // (uncompressed size / compressed size), the chunk is stored uncompressed.
+    // This avoids wasting CPU on records which are already compressed.
+    //
+    // Ignored for Uncompressed.
+    //
+    // `min_compression_ratio` must be `absl::nullopt` or at least 1.
+    //
+    // Default: `absl::nullopt` (always compress).
+    Options& set_min_compression_ratio(
+        absl::optional<double> min_compression_ratio) & {
+      compressor_options_.set_min_compression_ratio(min_compression_ratio);
+      return *this;
+    }
+    Options&& set_min_compression_ratio(
+        absl::optional<double> min_compression_ratio) && {
+      return std::move(set_min_compression_ratio(min_compression_ratio));
+    }
+    absl::optional<double> min_compression_ratio() const {
+      return compressor_options_.min_compression_ratio();
+    }
+
+    // If `true`, compression is offloaded to a hardware accelerator if
+    // available, falling back to software otherwise. Files are the same format.
+    //
+    // Used only for Zstd, see
+    // `ZstdWriterBase::Options::set_hardware_offload()`.
+    //
+    // Default: `false`.
+    Options& set_hardware_offload(bool hardware_offload) & {
+      compressor_options_.set_hardware_offload(hardware_offload);
+      return *this;
+    }
+    Options&& set_hardware_offload(bool hardware_offload) && {
+      return std::move(set_hardware_offload(hardware_offload));
+    }
+    bool hardware_offload() const {
+      return compressor_options_.hardware_offload();
+    }
+
     // Returns grouped compression options.
     CompressorOptions& compressor_options() { return compressor_options_; }
     const CompressorOptions& compressor_options() const {
@@ -272,11 +562,46 @@ class RecordWriterBase : public Object {
     }
     double bucket_fraction() const { return bucket_fraction_; }
 
+    // If not `absl::nullopt`, the chunk size is tuned to the data: records of
+    // the first chunk, filled up to `chunk_size()`, are trial-encoded with
+    // several chunk sizes from `chunk_size() / 16` to `chunk_size()`, and
+    // further chunks use the smallest size whose total encoded size is at most
+    // `1 + autotune_chunk_size()` times the smallest total encoded size.
+    //
+    // For example 0.02 accepts a 2% larger file in exchange for smaller
+    // chunks, which reduce memory usage and make random access cheaper.
+    // `chunk_size()` then serves as the upper bound.
+    //
+    // The chosen size is available as `RecordWriterBase::tuned_chunk_size()`,
+    // and if `index()`, it is recorded in the index as `chunk_size`.
+    //
+    // Tuning costs encoding the first chunk several more times, and keeping a
+    // copy of its records.
+    //
+    // Default: `absl::nullopt` (chunk size is not tuned).
+    Options& set_autotune_chunk_size(absl::optional<double> tolerance) & {
+      if (tolerance != absl::nullopt) {
+        RIEGELI_ASSERT_GE(*tolerance, 0.0)
+            << "Failed precondition of "
+               "RecordWriterBase::Options::set_autotune_chunk_size(): "
+               "negative tolerance";
+      }
+      autotune_chunk_size_ = tolerance;
+      return *this;
+    }
+    Options&& set_autotune_chunk_size(absl::optional<double> tolerance) && {
+      return std::move(set_autotune_chunk_size(tolerance));
+    }
+    absl::optional<double> autotune_chunk_size() const {
+      return autotune_chunk_size_;
+    }
+
     // Sets file metadata to be written at the beginning (unless
     // `absl::nullopt`).
     //
     // Metadata are written only when the file is written from the beginning,
-    // not when it is appended to.
+    // not when it is appended to (see `PrepareForAppending()` in
+    // `riegeli/records/records_appending.h`).
     //
     // Record type in metadata can be conveniently set by `SetRecordType()`.
     //
@@ -387,6 +712,138 @@ class RecordWriterBase : public Object {
     }
     bool pad_to_block_boundary() const { return pad_to_block_boundary_; }
 
+    // Sets the block size of a new file: a power of 2 between 64KB and 1GB.
+    //
+    // Block headers, which allow to skip over corrupted regions and to seek to
+    // a chunk, are written at multiples of the block size. A larger block size
+    // makes a block header interrupt fewer chunks, and reduces their overhead,
+    // which matters for files with large chunks on storage with large
+    // transfers, at the cost of recovery skipping more after corruption.
+    //
+    // A block size other than 64KB is declared in the file signature. Such
+    // files cannot be read by older readers, which do not support other block
+    // sizes.
+    //
+    // This applies only if the file is written from the beginning. When
+    // appending, the block size of the `ChunkWriter` is used, which for
+    // `DefaultChunkWriter` can be set with
+    // `DefaultChunkWriterBase::Options::set_block_size()`.
+    //
+    // Default: 64KB.
+    Options& set_block_size(Position block_size) & {
+      RIEGELI_ASSERT(internal::IsValidBlockSize(block_size))
+          << "Failed precondition of "
+             "RecordWriterBase::Options::set_block_size(): "
+             "block size not a power of 2 between 64KB and 1GB: "
+          << block_size;
+      block_size_ = block_size;
+      return *this;
+    }
+    Options&& set_block_size(Position block_size) && {
+      return std::move(set_block_size(block_size));
+    }
+    Position block_size() const { return block_size_; }
+
+    // If `true`, an index of chunks containing records is written at the end
+    // of the file by `Close()`. It allows
+    // `RecordReaderBase::SeekToRecordNumber()` to avoid reading all preceding
+    // chunk headers.
+    //
+    // The index is written only if the file is written from the beginning, not
+    // appended to.
+    //
+    // Default: `false`.
+    Options& set_index(bool index) & {
+      index_ = index;
+      return *this;
+    }
+    Options&& set_index(bool index) && {
+      return std::move(set_index(index));
+    }
+    bool index() const { return index_; }
+
+    // If not `nullptr` and `index()`, the index also records the smallest and
+    // largest key of records in each chunk, where the key of a record is
+    // computed by this function from the serialized record. Keys are compared
+    // as byte strings.
+    //
+    // For a file whose records are sorted by key, this allows
+    // `RecordReaderBase::SearchByKey()` to locate a record by decoding only
+    // the chunk containing it.
+    //
+    // Records written as proto messages are serialized once before computing
+    // their keys.
+    //
+    // Default: `nullptr`.
+    Options& set_index_key(
+        const std::function<std::string(absl::string_view record)>&
+            index_key) & {
+      index_key_ = index_key;
+      return *this;
+    }
+    Options& set_index_key(
+        std::function<std::string(absl::string_view record)>&& index_key) & {
+      index_key_ = std::move(index_key);
+      return *this;
+    }
+    Options&& set_index_key(
+        const std::function<std::string(absl::string_view record)>&
+            index_key) && {
+      return std::move(set_index_key(index_key));
+    }
+    Options&& set_index_key(
+        std::function<std::string(absl::string_view record)>&& index_key) && {
+      return std::move(set_index_key(std::move(index_key)));
+    }
+    std::function<std::string(absl::string_view record)>& index_key() {
+      return index_key_;
+    }
+    const std::function<std::string(absl::string_view record)>& index_key()
+        const {
+      return index_key_;
+    }
+
+    // If not `nullptr` and `index()`, the index also records the earliest and
+    // latest time of records in each chunk, where the time of a record is
+    // computed by this function from the serialized record, e.g. from its
+    // event time field.
+    //
+    // For a file whose records are roughly sorted by time, e.g. a log, this
+    // allows `RecordReaderBase::SeekToTime()` to skip chunks with only earlier
+    // records without reading them.
+    //
+    // Records written as proto messages are serialized once before computing
+    // their times.
+    //
+    // Default: `nullptr`.
+    Options& set_index_time(
+        const std::function<absl::Time(absl::string_view record)>&
+            index_time) & {
+      index_time_ = index_time;
+      return *this;
+    }
+    Options& set_index_time(
+        std::function<absl::Time(absl::string_view record)>&& index_time) & {
+      index_time_ = std::move(index_time);
+      return *this;
+    }
+    Options&& set_index_time(
+        const std::function<absl::Time(absl::string_view record)>&
+            index_time) && {
+      return std::move(set_index_time(index_time));
+    }
+    Options&& set_index_time(
+        std::function<absl::Time(absl::string_view record)>&& index_time) && {
+      return std::move(set_index_time(std::move(index_time)));
+    }
+    std::function<absl::Time(absl::string_view record)>& index_time() {
+      return index_time_;
+    }
+    const std::function<absl::Time(absl::string_view record)>& index_time()
+        const {
+      return index_time_;
+    }
+
     // Sets the maximum number of chunks being encoded in parallel in
     // background. Larger parallelism can increase throughput, up to a point
     // where it no longer matters; smaller parallelism reduces memory usage.
@@ -408,15 +865,241 @@ class RecordWriterBase : public Object {
     }
     int parallelism() const { return parallelism_; }
 
+    // Sets the maximum total size of records in chunks being encoded or
+    // waiting to be written in background, if `parallelism() > 0`.
+    //
+    // When this is reached, writing a record which closes a chunk blocks until
+    // background work catches up. This bounds memory usage when records are
+    // produced faster than they can be encoded and written, independently
+    // of `parallelism()` and `chunk_size()`.
+    //
+    // Special value `absl::nullopt` means no limit besides `parallelism()`.
+    //
+    // Default: `absl::nullopt`.
+    Options& set_max_pending_bytes(
+        absl::optional<uint64_t> max_pending_bytes) & {
+      if (max_pending_bytes != absl::nullopt) {
+        RIEGELI_ASSERT_GT(*max_pending_bytes, 0u)
+            << "Failed precondition of "
+               "RecordWriterBase::Options::set_max_pending_bytes(): "
+               "zero max pending bytes";
+      }
+      max_pending_bytes_ = max_pending_bytes;
+      return *this;
+    }
+    Options&& set_max_pending_bytes(
+        absl::optional<uint64_t> max_pending_bytes) && {
+      return std::move(set_max_pending_bytes(max_pending_bytes));
+    }
+    absl::optional<uint64_t> max_pending_bytes() const {
+      return max_pending_bytes_;
+    }
+
+    // If not `absl::nullopt` and `parallelism() > 0`, the compression level is
+    // adapted to the backlog of chunks being encoded in background, so that
+    // compression keeps up with records being written.
+    //
+    // When a chunk is opened while `parallelism()` chunks are pending, the
+    // compression level of further chunks is lowered by 1, down to
+    // `min_adaptive_compression_level`. When fewer than half of
+    // `parallelism()` chunks are pending, it is raised by 1, up to
+    // `compression_level()`.
+    //
+    // Ignored for Uncompressed and Snappy, which have no compression levels.
+    // `min_adaptive_compression_level` is clamped to the range of compression
+    // levels of the compression type, and to `compression_level()`.
+    //
+    // Default: `absl::nullopt` (always use `compression_level()`).
+    Options& set_min_adaptive_compression_level(
+        absl::optional<int> min_adaptive_compression_level) & {
+      min_adaptive_compression_level_ = min_adaptive_compression_level;
+      return *this;
+    }
+    Options&& set_min_adaptive_compression_level(
+        absl::optional<int> min_adaptive_compression_level) && {
+      return std::move(
+          set_min_adaptive_compression_level(min_adaptive_compression_level));
+    }
+    absl::optional<int> min_adaptive_compression_level() const {
+      return min_adaptive_compression_level_;
+    }
+
+    // Sets the `Executor` which encodes chunks in background, if
+    // `parallelism() > 0`.
+    //
+    // Sharing an `Executor` among many `RecordWriter`s and `RecordReader`s
+    // bounds the total number of threads which encode and decode their chunks,
+    // while serving them in turns. `parallelism()` still limits the number of
+    // pending chunks of each `RecordWriter`.
+    //
+    // If `nullptr`, chunks are encoded in a global thread pool which creates
+    // threads without a limit.
+    //
+    // If `transpose()` and `bucket_fraction() < 1`, buckets of a chunk are
+    // also compressed concurrently in the `Executor`, even if
+    // `parallelism() == 0`. Similarly, if `!transpose()`, record sizes and
+    // record values of a chunk with many records are compressed concurrently.
+    // This reduces latency of encoding a large chunk.
+    //
+    // Default: `nullptr`.
+    Options& set_executor(std::shared_ptr<Executor> executor) & {
+      executor_ = std::move(executor);
+      return *this;
+    }
+    Options&& set_executor(std::shared_ptr<Executor> executor) && {
+      return std::move(set_executor(std::move(executor)));
+    }
+    std::shared_ptr<Executor>& executor() { return executor_; }
+    const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+    // If `true`, the buffer collecting records of a non-transposed chunk is
+    // allocated up front for the whole `chunk_size()` as a single block,
+    // instead of blocks growing progressively.
+    //
+    // This avoids most allocations while collecting a chunk and keeps the data
+    // contiguous for compression, at the cost of holding `chunk_size()` of
+    // memory from the first record of each chunk, per chunk being encoded.
+    //
+    // Default: `false`.
+    Options& set_reserve_chunk_size(bool reserve_chunk_size) & {
+      reserve_chunk_size_ = reserve_chunk_size;
+      return *this;
+    }
+    Options&& set_reserve_chunk_size(bool reserve_chunk_size) && {
+      return std::move(set_reserve_chunk_size(reserve_chunk_size));
+    }
+    bool reserve_chunk_size() const { return reserve_chunk_size_; }
+
+    // Sets the `MemoryBudget` shared with other `RecordWriter`s, which limits
+    // their total memory of records in chunks being collected, and, if
+    // `parallelism() > 0`, of chunks pending in background.
+    //
+    // When the total exceeds the limit, writers collecting the largest chunks
+    // close them early, at their next `WriteRecord()`. This makes chunks
+    // smaller, which costs compression density, instead of letting memory
+    // grow with the number of writers.
+    //
+    // If `nullptr`, memory is limited only by `chunk_size()` and
+    // `max_pending_bytes()` of each `RecordWriter`.
+    //
+    // Default: `nullptr`.
+    Options& set_memory_budget(std::shared_ptr<MemoryBudget> memory_budget) & {
+      memory_budget_ = std::move(memory_budget);
+      return *this;
+    }
+    Options&& set_memory_budget(
+        std::shared_ptr<MemoryBudget> memory_budget) && {
+      return std::move(set_memory_budget(std::move(memory_budget)));
+    }
+    std::shared_ptr<MemoryBudget>& memory_budget() { return memory_budget_; }
+    const std::shared_ptr<MemoryBudget>& memory_budget() const {
+      return memory_budget_;
+    }
+
+    // If finite, records are streamed to readers tailing the file with a
+    // bounded latency: a chunk is closed when its first record is at least
+    // this old, or when it reaches `chunk_size()`, whichever comes first, and
+    // each chunk closed this way is flushed to the byte `Writer` with
+    // `FlushType::kFromProcess`.
+    //
+    // This flush is lighter than `Flush()`: it does not pad to a block
+    // boundary even if `pad_to_block_boundary()`, and if `parallelism() > 0`,
+    // it does not wait for background writing.
+    //
+    // The age of the chunk is checked when a record is written, and by
+    // `FlushStaleChunk()`, which should be called periodically so that the
+    // latency is bounded also when records stop arriving.
+    //
+    // Default: `absl::InfiniteDuration()` (chunks are closed only by size).
+    Options& set_max_chunk_latency(absl::Duration max_chunk_latency) & {
+      max_chunk_latency_ = max_chunk_latency;
+      return *this;
+    }
+    Options&& set_max_chunk_latency(absl::Duration max_chunk_latency) && {
+      return std::move(set_max_chunk_latency(max_chunk_latency));
+    }
+    absl::Duration max_chunk_latency() const { return max_chunk_latency_; }
+
+    // If greater than 1, each chunk is compressed with records of the previous
+    // chunk as a Zstd reference prefix, except that every
+    // `keyframe_interval()`-th chunk is a keyframe compressed independently.
+    //
+    // This improves compression of small chunks, e.g. with a small
+    // `max_chunk_latency()`, which otherwise start with an empty compression
+    // window. Reading a chunk requires decoding the previous chunks back to a
+    // keyframe, i.e. random access decodes up to `keyframe_interval()` chunks,
+    // and such chunks are not decoded in background by
+    // `RecordReaderBase::Options::set_parallelism()`.
+    //
+    // This applies if `!transpose()`, `!deduplicate()`, and Zstd compression
+    // is used. A `zstd_dictionary()` is used only for keyframes.
+    //
+    // Such chunks have type `ChunkType::kPrefixed`, which is not supported by
+    // readers older than this option.
+    //
+    // 0 and 1 disable this.
+    //
+    // Default: 0.
+    Options& set_keyframe_interval(int keyframe_interval) & {
+      RIEGELI_ASSERT_GE(keyframe_interval, 0)
+          << "Failed precondition of "
+             "RecordWriterBase::Options::set_keyframe_interval(): "
+             "negative keyframe interval";
+      keyframe_interval_ = keyframe_interval;
+      return *this;
+    }
+    Options&& set_keyframe_interval(int keyframe_interval) && {
+      return std::move(set_keyframe_interval(keyframe_interval));
+    }
+    int keyframe_interval() const { return keyframe_interval_; }
+
+    // Sets the `RecordsObserver` which receives events about encoding and
+    // writing chunks, with their timings.
+    //
+    // If `parallelism() > 0`, events are delivered by background threads.
+    //
+    // If `nullptr`, events are not reported.
+    //
+    // Default: `nullptr`.
+    Options& set_observer(std::shared_ptr<RecordsObserver> observer) & {
+      observer_ = std::move(observer);
+      return *this;
+    }
+    Options&& set_observer(std::shared_ptr<RecordsObserver> observer) && {
+      return std::move(set_observer(std::move(observer)));
+    }
+    std::shared_ptr<RecordsObserver>& observer() { return observer_; }
+    const std::shared_ptr<RecordsObserver>& observer() const {
+      return observer_;
+    }
+
    private:
     bool transpose_ = false;
+    absl::optional<double> adaptive_transpose_;
+    bool column_encoding_ = false;
+    std::vector<StatisticsField> column_statistics_;
+    std::vector<Field> bloom_filter_fields_;
+    bool deduplicate_ = false;
     CompressorOptions compressor_options_;
     absl::optional<uint64_t> chunk_size_;
     double bucket_fraction_ = 1.0;
+    absl::optional<double> autotune_chunk_size_;
     absl::optional<RecordsMetadata> metadata_;
     absl::optional<Chain> serialized_metadata_;
     bool pad_to_block_boundary_ = false;
+    Position block_size_ = internal::kBlockSize;
+    bool index_ = false;
+    std::function<std::string(absl::string_view record)> index_key_;
+    std::function<absl::Time(absl::string_view record)> index_time_;
     int parallelism_ = 0;
+    absl::optional<uint64_t> max_pending_bytes_;
+    absl::optional<int> min_adaptive_compression_level_;
+    std::shared_ptr<Executor> executor_;
+    bool reserve_chunk_size_ = false;
+    std::shared_ptr<MemoryBudget> memory_budget_;
+    absl::Duration max_chunk_latency_ = absl::InfiniteDuration();
+    int keyframe_interval_ = 0;
+    std::shared_ptr<RecordsObserver> observer_;
   };
 
   // `get()` returns the resolved value. Can block.
@@ -452,6 +1135,39 @@ class RecordWriterBase : public Object {
   bool WriteRecord(const absl::Cord& record);
   bool WriteRecord(absl::Cord&& record);
 
+  // Writes several records, with the same effect as `WriteRecord()` of each
+  // of them, but with less overhead per record: checking whether the chunk is
+  // full is done once per part of the batch which fits in the open chunk, and
+  // the part is passed to the `ChunkEncoder` at once.
+  //
+  // The `Chain` variant accepts concatenated record values and sorted record
+  // end positions, like `ChunkEncoder::AddRecords()`.
+  //
+  // Precondition for the `Chain` variant:
+  //   `(limits.empty() ? 0 : limits.back()) == records.size()`
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool WriteRecords(absl::Span<const absl::string_view> records);
+  bool WriteRecords(Chain records, std::vector<size_t> limits);
+
+  // Writes a chunk of records as is, without decoding and reencoding it, e.g.
+  // a chunk read by `RecordReaderBase::ReadChunk()` from another file. Any open
+  // chunk is finalized first, so that records keep their order.
+  //
+  // The chunk must contain records, and must be compatible with the file
+  // metadata of this file, e.g. it must not depend on a Zstd dictionary
+  // missing there. Its sizes and timings are not included in `Stats()`.
+  //
+  // This is not supported if `Options::index_key()` is set, because keys of
+  // records in the chunk are not known.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool WriteChunk(const Chunk& chunk);
+
   // Finalizes any open chunk and pushes buffered data to the destination.
   // If `Options::parallelism() > 0`, waits for any background writing to
   // complete.
@@ -492,6 +1208,18 @@ class RecordWriterBase : public Object {
   // `Flush()` is equivalent to `FutureFlush().get()`.
   FutureBool FutureFlush(FlushType flush_type = FlushType::kFromProcess);
 
+  // If `Options::max_chunk_latency()` is finite and the first record of the
+  // open chunk is at least that old, closes the chunk and flushes it like
+  // writing a record would. Otherwise does nothing.
+  //
+  // This should be called periodically, e.g. from a timer, so that records are
+  // streamed with a bounded latency also when no more records arrive.
+  //
+  // Return values:
+  //  * `true`  - success (`healthy()`)
+  //  * `false` - failure (`!healthy()`)
+  bool FlushStaleChunk();
+
   // Returns the canonical position of the last record written.
   //
   // The canonical position is the largest among all equivalent positions.
@@ -536,6 +1264,85 @@ class RecordWriterBase : public Object {
   // background work to complete.
   Position EstimatedSize() const;
 
+  // Returns the number of chunks being encoded or waiting to be written in
+  // background, without blocking. This is always 0 if
+  // `Options::parallelism() == 0`.
+  uint64_t PendingChunks() const;
+
+  // Returns the total size of records in chunks being encoded or waiting to be
+  // written in background, without blocking. This is always 0 if
+  // `Options::parallelism() == 0`.
+  //
+  // This is limited by `Options::max_pending_bytes()`.
+  uint64_t PendingBytes() const;
+
+  // Returns an estimate of memory used by this `RecordWriter`, excluding
+  // `sizeof(*this)`, without blocking:
+  //  * records of the current chunk being collected
+  //  * if `Options::parallelism() > 0`, `PendingBytes()` for chunks being
+  //    encoded or waiting to be written in background
+  //  * if `Options::parallelism() == 0`, the buffer of the byte `Writer`
+  //
+  // This uses counters maintained while writing rather than traversing the
+  // data, so it is cheap enough to be called periodically, e.g. to enforce a
+  // memory budget across many open writers.
+  size_t EstimateMemory() const;
+
+  // Returns the chunk size chosen by `Options::set_autotune_chunk_size()`, or
+  // `absl::nullopt` if the chunk size is not tuned or tuning is not finished
+  // yet.
+  absl::optional<uint64_t> tuned_chunk_size() const {
+    return tuned_chunk_size_;
+  }
+
+  // Returns sizes and timings of encoding chunks with records, accumulated
+  // over chunks encoded so far. This helps to tune compression options and
+  // `Options::set_chunk_size()`. Metadata and index chunks are not included.
+  //
+  // If `Options::parallelism() > 0`, chunks being encoded in background are
+  // not included yet. After `Close()`, all chunks are included.
+  ChunkStats Stats() const;
+
+  // Timings of the stages of writing chunks, and lengths of the queue of
+  // chunks waiting to be written, accumulated so far. They help to tell
+  // whether writing is bound by encoding or by the byte `Writer`.
+  //
+  // Times are measured with the wall clock.
+  struct PipelineStats {
+    // Time spent in `ChunkEncoder::EncodeAndClose()` for chunks with records,
+    // summed over threads encoding them. Equal to `Stats().encode_time`.
+    absl::Duration encode_time;
+    // Time spent in `ChunkWriter::WriteChunk()` for all chunks.
+    absl::Duration write_time;
+
+    // The following are filled only if `Options::parallelism() > 0`.
+
+    // Number of times and total time the thread writing records blocked
+    // because `Options::parallelism()` chunks or `Options::max_pending_bytes()`
+    // were pending. Significant time here, with little time in
+    // `wait_for_encoding_time`, means that writing is I/O-bound.
+    uint64_t num_waits_for_capacity = 0;
+    absl::Duration wait_for_capacity_time;
+    // Time the background thread writing chunks waited for a chunk to be
+    // encoded. Significant time here means that writing is encode-bound.
+    absl::Duration wait_for_encoding_time;
+    // Histogram of the length of the queue of pending requests to the
+    // background thread writing chunks: `queue_lengths[i]` is the number of
+    // chunks which were queued when `i` requests were already pending. The
+    // size is `Options::parallelism()`.
+    std::vector<uint64_t> queue_lengths;
+    // Number of chunks with records which were compressed with a level lower
+    // than `Options::compression_level()`, because of
+    // `Options::min_adaptive_compression_level()`.
+    uint64_t num_chunks_with_lowered_compression_level = 0;
+  };
+
+  // Returns `PipelineStats` accumulated so far.
+  //
+  // If `Options::parallelism() > 0`, chunks being encoded or written in
+  // background are not included yet. After `Close()`, all chunks are included.
+  PipelineStats GetPipelineStats() const;
+
  protected:
   explicit RecordWriterBase(InitiallyClosed) noexcept;
   explicit RecordWriterBase(InitiallyOpen) noexcept;
@@ -559,14 +1366,44 @@ class RecordWriterBase : public Object {
 
   template <typename Record>
   bool WriteRecordImpl(Record&& record);
+  // Returns `true` if `max_chunk_latency_` is finite and the open chunk was
+  // opened at least that long ago.
+  bool ChunkIsStale() const;
+  // If `max_chunk_latency_` is finite, flushes a chunk which has just been
+  // closed.
+  bool FlushClosedChunk();
+  // If the chunk size is being tuned and the open chunk is about to be closed
+  // because adding a record of `added_size` would exceed
+  // `desired_chunk_size_`, finishes tuning and updates `desired_chunk_size_`.
+  bool MaybeTuneChunkSize(uint64_t added_size);
 
   uint64_t desired_chunk_size_ = 0;
   uint64_t chunk_size_so_far_ = 0;
+  absl::optional<uint64_t> tuned_chunk_size_;
+  absl::Duration max_chunk_latency_ = absl::InfiniteDuration();
+  // When the first record of the open chunk was written, if
+  // `max_chunk_latency_` is finite and `chunk_size_so_far_ > 0`.
+  absl::Time chunk_open_time_;
   bool last_record_is_valid_ = false;
   // Invariant: if `is_open()` then `worker_ != nullptr`.
   std::unique_ptr<Worker> worker_;
+  // `worker_->Stats()` saved when `worker_` is closed.
+  ChunkStats stats_;
+  // `worker_->GetPipelineStats()` saved when `worker_` is closed.
+  PipelineStats pipeline_stats_;
 };
 
+namespace internal {
+
+// Creates a `ChunkEncoder` for a chunk of records written with `options`,
+// compressed with `compressor_options`, expected to have about `chunk_size`
+// bytes. Prefixed chunks (`Options::keyframe_interval()`) are not covered.
+std::unique_ptr<ChunkEncoder> MakeRecordsChunkEncoder(
+    const RecordWriterBase::Options& options,
+    const CompressorOptions& compressor_options, uint64_t chunk_size);
+
+}  // namespace internal
+
 // `RecordWriter` writes records to a Riegeli/records file. A record is
 // conceptually a binary string; usually it is a serialized proto message.
 //
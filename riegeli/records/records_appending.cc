@@ -0,0 +1,86 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/records_appending.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <tuple>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/records/chunk_reader.h"
+
+namespace riegeli {
+
+absl::Status PrepareForAppending(absl::string_view filename) {
+  Position append_pos;
+  {
+    DefaultChunkReader<FdReader<>> chunk_reader(
+        std::forward_as_tuple(filename, O_RDONLY));
+    if (ABSL_PREDICT_FALSE(!chunk_reader.healthy())) {
+      // A missing file is created by `RecordWriter`.
+      struct stat stat_info;
+      if (stat(std::string(filename).c_str(), &stat_info) < 0 &&
+          errno == ENOENT) {
+        return absl::OkStatus();
+      }
+      return chunk_reader.status();
+    }
+    const absl::optional<Position> size = chunk_reader.Size();
+    if (ABSL_PREDICT_FALSE(size == absl::nullopt)) {
+      return chunk_reader.status();
+    }
+    if (*size == 0) return absl::OkStatus();
+    if (ABSL_PREDICT_FALSE(!chunk_reader.CheckFileFormat())) {
+      if (ABSL_PREDICT_FALSE(!chunk_reader.healthy())) {
+        return chunk_reader.status();
+      }
+      // Even the file signature is incomplete.
+      append_pos = 0;
+    } else {
+      // Find the last chunk boundary using block headers, then read chunks
+      // from there, verifying them.
+      if (ABSL_PREDICT_FALSE(!chunk_reader.SeekToChunkBefore(*size - 1))) {
+        return chunk_reader.status();
+      }
+      Chunk chunk;
+      while (chunk_reader.ReadChunk(chunk)) {
+      }
+      if (ABSL_PREDICT_FALSE(!chunk_reader.healthy())) {
+        return chunk_reader.status();
+      }
+      append_pos = chunk_reader.pos();
+    }
+    // `Close()` fails if the file ends with an incomplete chunk, which is
+    // expected here.
+    chunk_reader.Close();
+    if (append_pos >= *size) return absl::OkStatus();
+  }
+  FdWriter<> writer(filename, O_WRONLY);
+  if (ABSL_PREDICT_FALSE(!writer.Truncate(append_pos))) return writer.status();
+  if (ABSL_PREDICT_FALSE(!writer.Close())) return writer.status();
+  return absl::OkStatus();
+}
+
+}  // namespace riegeli
@@ -0,0 +1,48 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_RECORDS_APPENDING_H_
+#define RIEGELI_RECORDS_RECORDS_APPENDING_H_
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+
+namespace riegeli {
+
+// Prepares an existing Riegeli/records file for appending records to it,
+// without rewriting it.
+//
+// The file signature is verified, and chunks near the end of the file are
+// read to find where the last complete chunk ends. An incomplete chunk after
+// that, e.g. left by a writer which crashed, is truncated. A missing file or
+// an empty file is left as is.
+//
+// Afterwards records can be appended with:
+// ```
+//   riegeli::RecordWriter<riegeli::FdWriter<>> record_writer(
+//       std::forward_as_tuple(filename, O_WRONLY | O_CREAT | O_APPEND),
+//       std::move(record_writer_options));
+// ```
+//
+// `RecordWriter` then starts at the end of the file, so it continues at the
+// right offset in the current block and does not write the file signature
+// and metadata again. Appended records must be compatible with the file
+// metadata already present, e.g. they must not be compressed with a Zstd
+// dictionary missing there. `RecordWriterBase::Options::index()` has no
+// effect when appending.
+absl::Status PrepareForAppending(absl::string_view filename);
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_RECORDS_APPENDING_H_
@@ -0,0 +1,70 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_RECORDS_OBSERVER_H_
+#define RIEGELI_RECORDS_RECORDS_OBSERVER_H_
+
+#include "absl/time/time.h"
+#include "riegeli/base/base.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
+
+namespace riegeli {
+
+// Receives events about stages of processing chunks by a `RecordWriter` or
+// `RecordReader`, with their timings, e.g. to export latency histograms or
+// traces.
+//
+// An observer is set with `RecordWriterBase::Options::set_observer()` or
+// `RecordReaderBase::Options::set_observer()`. If it is not set, events are
+// not reported.
+//
+// Compression and decompression are reported as parts of encoding and decoding,
+// in `ChunkStats::compress_time` and `ChunkStats::decompress_time`.
+//
+// Default implementations of all functions do nothing. Implementations must be
+// thread-safe if an observer is shared among objects used by different
+// threads, or if a `RecordWriter` has `parallelism() > 0`, in which case
+// chunks are encoded in background threads concurrently with writing other
+// chunks.
+class RecordsObserver {
+ public:
+  virtual ~RecordsObserver() {}
+
+  // Called by a `RecordWriter` after a chunk containing records has been
+  // encoded. `stats` are of that chunk.
+  virtual void OnChunkEncoded(const ChunkHeader& header,
+                              const ChunkStats& stats) {}
+
+  // Called by a `RecordWriter` after a chunk has been passed to the
+  // `ChunkWriter` at `chunk_begin`, with the time this took.
+  virtual void OnChunkWritten(Position chunk_begin, const ChunkHeader& header,
+                              absl::Duration write_time) {}
+
+  // Called by a `RecordReader` after a chunk has been read from the
+  // `ChunkReader` at `chunk_begin`, with the time this took.
+  virtual void OnChunkRead(Position chunk_begin, const ChunkHeader& header,
+                           absl::Duration read_time) {}
+
+  // Called by a `RecordReader` when a chunk read from `chunk_begin` is decoded
+  // and becomes current. `stats` are of that chunk.
+  //
+  // If the `RecordReader` has `parallelism() > 0`, the chunk has been decoded
+  // in background earlier, but this is still called by the reading thread.
+  virtual void OnChunkDecoded(Position chunk_begin, const ChunkStats& stats) {}
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_RECORDS_OBSERVER_H_
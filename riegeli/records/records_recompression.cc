@@ -0,0 +1,139 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/records_recompression.h"
+
+#include <fcntl.h>
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_recompression.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/chunk_writer.h"
+#include "riegeli/records/record_reader.h"
+#include "riegeli/records/records_metadata.pb.h"
+
+namespace riegeli {
+
+namespace {
+
+struct Recompressed {
+  absl::Status status;
+  Chunk chunk;
+};
+
+}  // namespace
+
+absl::Status RecompressRecords(absl::string_view input,
+                               absl::string_view output,
+                               RecompressRecordsOptions options) {
+  {
+    RecordReader<FdReader<>> record_reader(
+        std::forward_as_tuple(input, O_RDONLY));
+    RecordsMetadata metadata;
+    if (ABSL_PREDICT_FALSE(!record_reader.ReadMetadata(metadata))) {
+      return record_reader.status();
+    }
+    if (ABSL_PREDICT_FALSE(!record_reader.Close())) {
+      return record_reader.status();
+    }
+    if (ABSL_PREDICT_FALSE(metadata.has_zstd_dictionary() ||
+                           metadata.has_brotli_dictionary_id())) {
+      return absl::UnimplementedError(
+          "Recompressing records compressed with a dictionary is not "
+          "supported");
+    }
+  }
+  DefaultChunkReader<FdReader<>> chunk_reader(
+      std::forward_as_tuple(input, O_RDONLY));
+  DefaultChunkWriter<FdWriter<>> chunk_writer(
+      std::forward_as_tuple(output, O_WRONLY | O_CREAT | O_TRUNC));
+  const std::shared_ptr<const CompressorOptions> compressor_options =
+      std::make_shared<const CompressorOptions>(
+          std::move(options.compressor_options()));
+  Executor* const executor = options.executor().get();
+  // Chunks being recompressed, in the order of writing them.
+  std::deque<std::future<Recompressed>> pending;
+  const auto write_oldest = [&]() -> absl::Status {
+    Recompressed recompressed = pending.front().get();
+    pending.pop_front();
+    if (ABSL_PREDICT_FALSE(!recompressed.status.ok())) {
+      return recompressed.status;
+    }
+    if (ABSL_PREDICT_FALSE(!chunk_writer.WriteChunk(recompressed.chunk))) {
+      return chunk_writer.status();
+    }
+    return absl::OkStatus();
+  };
+  absl::Status status;
+  for (;;) {
+    // `std::function` requires a copyable task, hence `std::shared_ptr`.
+    const std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+    if (!chunk_reader.ReadChunk(*chunk)) {
+      if (ABSL_PREDICT_FALSE(!chunk_reader.healthy())) {
+        status = chunk_reader.status();
+      }
+      break;
+    }
+    // Positions of chunks change, which would make the index wrong, and
+    // padding is relevant only at original positions.
+    if (chunk->header.chunk_type() == ChunkType::kIndex ||
+        chunk->header.chunk_type() == ChunkType::kPadding) {
+      continue;
+    }
+    const std::shared_ptr<std::promise<Recompressed>> promise =
+        std::make_shared<std::promise<Recompressed>>();
+    pending.push_back(promise->get_future());
+    const std::function<void()> task = [chunk, compressor_options, executor,
+                                        promise] {
+      Recompressed recompressed;
+      recompressed.status = RecompressChunk(*chunk, *compressor_options,
+                                            executor, recompressed.chunk);
+      promise->set_value(std::move(recompressed));
+    };
+    if (executor != nullptr) {
+      executor->Schedule(&pending, task);
+    } else {
+      internal::ThreadPool::global().Schedule(task);
+    }
+    if (pending.size() >= IntCast<size_t>(options.parallelism())) {
+      status = write_oldest();
+      if (ABSL_PREDICT_FALSE(!status.ok())) break;
+    }
+  }
+  while (status.ok() && !pending.empty()) status = write_oldest();
+  // After a failure, wait for tasks still using `executor`.
+  for (std::future<Recompressed>& recompressed : pending) recompressed.wait();
+  if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  if (ABSL_PREDICT_FALSE(!chunk_reader.Close())) return chunk_reader.status();
+  if (ABSL_PREDICT_FALSE(!chunk_writer.Close())) return chunk_writer.status();
+  return absl::OkStatus();
+}
+
+}  // namespace riegeli
@@ -0,0 +1,121 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_RECORDS_RECOMPRESSION_H_
+#define RIEGELI_RECORDS_RECORDS_RECOMPRESSION_H_
+
+#include <memory>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+
+namespace riegeli {
+
+class RecompressRecordsOptions {
+ public:
+  RecompressRecordsOptions() noexcept {}
+
+  // Sets compression of the output.
+  //
+  // A Zstd dictionary is not supported.
+  // `CompressorOptions::min_compression_ratio()` is ignored.
+  //
+  // Default: `CompressorOptions()`.
+  RecompressRecordsOptions& set_compressor_options(
+      const CompressorOptions& compressor_options) & {
+    compressor_options_ = compressor_options;
+    return *this;
+  }
+  RecompressRecordsOptions& set_compressor_options(
+      CompressorOptions&& compressor_options) & {
+    compressor_options_ = std::move(compressor_options);
+    return *this;
+  }
+  RecompressRecordsOptions&& set_compressor_options(
+      const CompressorOptions& compressor_options) && {
+    return std::move(set_compressor_options(compressor_options));
+  }
+  RecompressRecordsOptions&& set_compressor_options(
+      CompressorOptions&& compressor_options) && {
+    return std::move(set_compressor_options(std::move(compressor_options)));
+  }
+  CompressorOptions& compressor_options() { return compressor_options_; }
+  const CompressorOptions& compressor_options() const {
+    return compressor_options_;
+  }
+
+  // Sets the maximum number of chunks being recompressed in background at a
+  // time. Memory usage is up to about `parallelism()` chunks, each in both
+  // compressions.
+  //
+  // Default: `Executor::DefaultMaxThreads()`.
+  RecompressRecordsOptions& set_parallelism(int parallelism) & {
+    RIEGELI_ASSERT_GT(parallelism, 0)
+        << "Failed precondition of "
+           "RecompressRecordsOptions::set_parallelism(): "
+           "parallelism not positive";
+    parallelism_ = parallelism;
+    return *this;
+  }
+  RecompressRecordsOptions&& set_parallelism(int parallelism) && {
+    return std::move(set_parallelism(parallelism));
+  }
+  int parallelism() const { return parallelism_; }
+
+  // Sets the `Executor` which recompresses chunks, and buckets of a chunk
+  // concurrently.
+  //
+  // If `nullptr`, chunks are recompressed in a global thread pool which
+  // creates threads without a limit, and buckets of a chunk sequentially.
+  //
+  // Default: `nullptr`.
+  RecompressRecordsOptions& set_executor(std::shared_ptr<Executor> executor) & {
+    executor_ = std::move(executor);
+    return *this;
+  }
+  RecompressRecordsOptions&& set_executor(
+      std::shared_ptr<Executor> executor) && {
+    return std::move(set_executor(std::move(executor)));
+  }
+  std::shared_ptr<Executor>& executor() { return executor_; }
+  const std::shared_ptr<Executor>& executor() const { return executor_; }
+
+ private:
+  CompressorOptions compressor_options_;
+  int parallelism_ = Executor::DefaultMaxThreads();
+  std::shared_ptr<Executor> executor_;
+};
+
+// Copies the Riegeli/records file `input` to `output`, compressing chunks of
+// records again with `options.compressor_options()`, e.g. to recompress cold
+// data with stronger compression.
+//
+// Records are not decoded: compressed streams of each chunk are decompressed
+// and compressed again, see `RecompressChunk()`. Chunks are read in order,
+// recompressed in parallel, and written in order, so records keep their
+// order and positions of chunks change.
+//
+// Files with records compressed with a Zstd or Brotli dictionary are not
+// supported.
+absl::Status RecompressRecords(
+    absl::string_view input, absl::string_view output,
+    RecompressRecordsOptions options = RecompressRecordsOptions());
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_RECORDS_RECOMPRESSION_H_
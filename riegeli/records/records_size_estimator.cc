@@ -0,0 +1,139 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/records_size_estimator.h"
+
+#include <stdint.h>
+
+#include <cmath>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/strings/cord.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/null_writer.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+RecordsSizeEstimator::RecordsSizeEstimator(Options options)
+    : Object(kInitiallyOpen) {
+  RecordWriterBase::Options& writer_options = options.record_writer_options();
+  writer_options.set_index(false).set_pad_to_block_boundary(false);
+  {
+    RecordWriter<NullWriter> empty_writer(
+        NullWriter(NullWriter::kInitiallyOpen), writer_options);
+    if (ABSL_PREDICT_FALSE(!empty_writer.Close())) {
+      Fail(empty_writer);
+      return;
+    }
+    header_size_ = empty_writer.dest().pos();
+  }
+  span_size_ = writer_options.effective_chunk_size();
+  sample_period_ = UnsignedMax(
+      static_cast<uint64_t>(std::round(1.0 / options.sample_fraction())),
+      uint64_t{1});
+  writer_.Reset(NullWriter(NullWriter::kInitiallyOpen),
+                std::move(writer_options));
+}
+
+RecordsSizeEstimator::RecordsSizeEstimator(
+    RecordsSizeEstimator&& that) noexcept
+    : Object(std::move(that)),
+      header_size_(that.header_size_),
+      span_size_(that.span_size_),
+      sample_period_(that.sample_period_),
+      writer_(std::move(that.writer_)),
+      num_records_(std::exchange(that.num_records_, 0)),
+      size_(std::exchange(that.size_, 0)),
+      sampled_size_(std::exchange(that.sampled_size_, 0)),
+      span_index_(std::exchange(that.span_index_, 0)),
+      span_size_so_far_(std::exchange(that.span_size_so_far_, 0)) {}
+
+RecordsSizeEstimator& RecordsSizeEstimator::operator=(
+    RecordsSizeEstimator&& that) noexcept {
+  Object::operator=(std::move(that));
+  header_size_ = that.header_size_;
+  span_size_ = that.span_size_;
+  sample_period_ = that.sample_period_;
+  writer_ = std::move(that.writer_);
+  num_records_ = std::exchange(that.num_records_, 0);
+  size_ = std::exchange(that.size_, 0);
+  sampled_size_ = std::exchange(that.sampled_size_, 0);
+  span_index_ = std::exchange(that.span_index_, 0);
+  span_size_so_far_ = std::exchange(that.span_size_so_far_, 0);
+  return *this;
+}
+
+void RecordsSizeEstimator::Done() {
+  if (ABSL_PREDICT_FALSE(!writer_.Close())) Fail(writer_);
+}
+
+bool RecordsSizeEstimator::AddRecord(
+    const google::protobuf::MessageLite& record) {
+  return AddRecordImpl(record, record.ByteSizeLong());
+}
+
+bool RecordsSizeEstimator::AddRecord(absl::string_view record) {
+  return AddRecordImpl(record, record.size());
+}
+
+bool RecordsSizeEstimator::AddRecord(const Chain& record) {
+  return AddRecordImpl(record, record.size());
+}
+
+bool RecordsSizeEstimator::AddRecord(const absl::Cord& record) {
+  return AddRecordImpl(record, record.size());
+}
+
+template <typename Record>
+inline bool RecordsSizeEstimator::AddRecordImpl(const Record& record,
+                                                uint64_t size) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  ++num_records_;
+  size_ = SaturatingAdd(size_, size);
+  if (span_index_ % sample_period_ == 0) {
+    sampled_size_ = SaturatingAdd(sampled_size_, size);
+    if (ABSL_PREDICT_FALSE(!writer_.WriteRecord(record))) return Fail(writer_);
+  }
+  span_size_so_far_ = SaturatingAdd(span_size_so_far_, size);
+  if (span_size_so_far_ >= span_size_) {
+    span_size_so_far_ = 0;
+    ++span_index_;
+  }
+  return true;
+}
+
+absl::optional<Position> RecordsSizeEstimator::EstimatedSize() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  if (sampled_size_ == 0) return header_size_;
+  if (ABSL_PREDICT_FALSE(!writer_.Flush(FlushType::kFromObject))) {
+    Fail(writer_);
+    return absl::nullopt;
+  }
+  const Position sampled_encoded_size =
+      writer_.EstimatedSize() - header_size_;
+  const long double encoded_size =
+      static_cast<long double>(sampled_encoded_size) *
+      static_cast<long double>(size_) / static_cast<long double>(sampled_size_);
+  return SaturatingAdd(header_size_,
+                       static_cast<Position>(std::round(encoded_size)));
+}
+
+}  // namespace riegeli
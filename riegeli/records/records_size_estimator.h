@@ -0,0 +1,170 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_RECORDS_SIZE_ESTIMATOR_H_
+#define RIEGELI_RECORDS_RECORDS_SIZE_ESTIMATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+
+#include "absl/strings/cord.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/null_writer.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+// `RecordsSizeEstimator` predicts the size of a Riegeli/records file which a
+// `RecordWriter` would write given the same records, while encoding only a
+// sample of them, e.g. to choose shard boundaries before writing.
+//
+// Records are grouped into spans of
+// `RecordWriterBase::Options::effective_chunk_size()` bytes, like records
+// grouped into chunks by a `RecordWriter`. Every `1 / sample_fraction()`-th
+// span is encoded by a `RecordWriter` writing to a `NullWriter`, and the
+// encoded size of the sample is extrapolated to all records by the ratio of
+// their sizes.
+//
+// Sampling whole chunks keeps chunk headers, block headers, and compression
+// contexts representative. The error comes from records which compress
+// differently from the sampled ones, and it decreases as the number of sampled
+// spans grows.
+class RecordsSizeEstimator : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Sets the fraction of spans of records which are encoded, in the range
+    // (0.0..1.0]. It is rounded to 1 / n for an integer n.
+    //
+    // 1.0 encodes all records, which predicts the size exactly, except for the
+    // index and padding.
+    //
+    // Default: 0.1.
+    Options& set_sample_fraction(double sample_fraction) & {
+      RIEGELI_ASSERT_GT(sample_fraction, 0.0)
+          << "Failed precondition of "
+             "RecordsSizeEstimator::Options::set_sample_fraction(): "
+             "fraction not positive";
+      RIEGELI_ASSERT_LE(sample_fraction, 1.0)
+          << "Failed precondition of "
+             "RecordsSizeEstimator::Options::set_sample_fraction(): "
+             "fraction larger than 1";
+      sample_fraction_ = sample_fraction;
+      return *this;
+    }
+    Options&& set_sample_fraction(double sample_fraction) && {
+      return std::move(set_sample_fraction(sample_fraction));
+    }
+    double sample_fraction() const { return sample_fraction_; }
+
+    // Sets options of the `RecordWriter` whose output size is predicted.
+    //
+    // `RecordWriterBase::Options::index()` and `pad_to_block_boundary()` are
+    // ignored, and the size of the index and padding is not included.
+    //
+    // Default: `RecordWriterBase::Options()`.
+    Options& set_record_writer_options(
+        const RecordWriterBase::Options& record_writer_options) & {
+      record_writer_options_ = record_writer_options;
+      return *this;
+    }
+    Options& set_record_writer_options(
+        RecordWriterBase::Options&& record_writer_options) & {
+      record_writer_options_ = std::move(record_writer_options);
+      return *this;
+    }
+    Options&& set_record_writer_options(
+        const RecordWriterBase::Options& record_writer_options) && {
+      return std::move(set_record_writer_options(record_writer_options));
+    }
+    Options&& set_record_writer_options(
+        RecordWriterBase::Options&& record_writer_options) && {
+      return std::move(
+          set_record_writer_options(std::move(record_writer_options)));
+    }
+    RecordWriterBase::Options& record_writer_options() {
+      return record_writer_options_;
+    }
+    const RecordWriterBase::Options& record_writer_options() const {
+      return record_writer_options_;
+    }
+
+   private:
+    double sample_fraction_ = 0.1;
+    RecordWriterBase::Options record_writer_options_;
+  };
+
+  // Creates a closed `RecordsSizeEstimator`.
+  RecordsSizeEstimator() noexcept : Object(kInitiallyClosed) {}
+
+  // Will predict the size of a file written with
+  // `options.record_writer_options()`.
+  explicit RecordsSizeEstimator(Options options = Options());
+
+  RecordsSizeEstimator(RecordsSizeEstimator&& that) noexcept;
+  RecordsSizeEstimator& operator=(RecordsSizeEstimator&& that) noexcept;
+
+  // Accounts the next record.
+  //
+  // Return values:
+  //  * `true`  - success
+  //  * `false` - failure (`!healthy()`)
+  bool AddRecord(const google::protobuf::MessageLite& record);
+  bool AddRecord(absl::string_view record);
+  bool AddRecord(const Chain& record);
+  bool AddRecord(const absl::Cord& record);
+
+  // Returns the predicted size of the file if no more records are added, or
+  // `absl::nullopt` on failure (`!healthy()`).
+  //
+  // This closes the chunk being encoded, which makes the prediction slightly
+  // less accurate if this is called often.
+  absl::optional<Position> EstimatedSize();
+
+  // Returns the number of records added so far.
+  uint64_t num_records() const { return num_records_; }
+
+ protected:
+  void Done() override;
+
+ private:
+  template <typename Record>
+  bool AddRecordImpl(const Record& record, uint64_t size);
+
+  // Size of a file without records.
+  Position header_size_ = 0;
+  uint64_t span_size_ = 0;
+  uint64_t sample_period_ = 1;
+  RecordWriter<NullWriter> writer_;
+  uint64_t num_records_ = 0;
+  // Sizes of all records, and of sampled records.
+  uint64_t size_ = 0;
+  uint64_t sampled_size_ = 0;
+  // Index of the current span, and the size of its records so far.
+  uint64_t span_index_ = 0;
+  uint64_t span_size_so_far_ = 0;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_RECORDS_SIZE_ESTIMATOR_H_
@@ -0,0 +1,296 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/records_sorting.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/records/record_reader.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+namespace {
+
+struct KeyedRecord {
+  std::string key;
+  std::string record;
+};
+
+// Sorts `run` and writes its records to `filename`.
+absl::Status WriteRun(std::vector<KeyedRecord>& run,
+                      const std::string& filename) {
+  std::stable_sort(run.begin(), run.end(),
+                   [](const KeyedRecord& a, const KeyedRecord& b) {
+                     return a.key < b.key;
+                   });
+  // Runs are read once soon after being written, so fast compression is
+  // preferred.
+  RecordWriter<FdWriter<>> record_writer(
+      std::forward_as_tuple(filename, O_WRONLY | O_CREAT | O_TRUNC),
+      RecordWriterBase::Options().set_snappy());
+  for (const KeyedRecord& keyed_record : run) {
+    if (ABSL_PREDICT_FALSE(!record_writer.WriteRecord(keyed_record.record))) {
+      return record_writer.status();
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!record_writer.Close())) return record_writer.status();
+  return absl::OkStatus();
+}
+
+// Sorts and writes runs in background, with at most `parallelism` runs in
+// progress at a time.
+class RunWriter {
+ public:
+  explicit RunWriter(int parallelism) : parallelism_(parallelism) {}
+
+  RunWriter(const RunWriter&) = delete;
+  RunWriter& operator=(const RunWriter&) = delete;
+
+  ~RunWriter() { Finish().IgnoreError(); }
+
+  // Schedules writing `run` to `filename`, first waiting if `parallelism`
+  // runs are in progress. Returns a failure of an earlier run if any.
+  absl::Status Write(std::vector<KeyedRecord>&& run,
+                     const std::string& filename);
+
+  // Waits until all runs are written. Returns the first failure if any.
+  absl::Status Finish();
+
+ private:
+  void TaskDone(absl::Status status);
+
+  int parallelism_;
+  absl::Mutex mutex_;
+  int in_progress_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::Status status_ ABSL_GUARDED_BY(mutex_);
+};
+
+absl::Status RunWriter::Write(std::vector<KeyedRecord>&& run,
+                              const std::string& filename) {
+  if (parallelism_ == 0) {
+    const absl::Status status = WriteRun(run, filename);
+    absl::MutexLock lock(&mutex_);
+    if (ABSL_PREDICT_FALSE(!status.ok()) && status_.ok()) status_ = status;
+    return status_;
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(
+        +[](RunWriter* self) {
+          return self->in_progress_ < self->parallelism_;
+        },
+        this));
+    if (ABSL_PREDICT_FALSE(!status_.ok())) return status_;
+    ++in_progress_;
+  }
+  // `std::function` requires a copyable task, hence `std::shared_ptr`.
+  const std::shared_ptr<std::vector<KeyedRecord>> shared_run =
+      std::make_shared<std::vector<KeyedRecord>>(std::move(run));
+  internal::ThreadPool::global().Schedule([this, shared_run, filename] {
+    TaskDone(WriteRun(*shared_run, filename));
+  });
+  return absl::OkStatus();
+}
+
+void RunWriter::TaskDone(absl::Status status) {
+  absl::MutexLock lock(&mutex_);
+  if (ABSL_PREDICT_FALSE(!status.ok()) && status_.ok()) {
+    status_ = std::move(status);
+  }
+  --in_progress_;
+}
+
+absl::Status RunWriter::Finish() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(
+      +[](int* in_progress) { return *in_progress == 0; }, &in_progress_));
+  return status_;
+}
+
+// Merges sorted runs from `run_filenames` into `record_writer`. Records with
+// equal keys are taken from earlier runs first.
+absl::Status MergeRuns(
+    const std::vector<std::string>& run_filenames,
+    const std::function<std::string(absl::string_view record)>& get_key,
+    RecordWriterBase& record_writer) {
+  struct Source {
+    std::unique_ptr<RecordReader<FdReader<>>> reader;
+    std::string key;
+    std::string record;
+  };
+  std::vector<Source> sources(run_filenames.size());
+  // Indices of sources with a current record, as a heap ordered by their keys,
+  // with the smallest key at the front.
+  std::vector<size_t> heap;
+  heap.reserve(sources.size());
+  const auto greater = [&](size_t a, size_t b) {
+    const int ordering = sources[a].key.compare(sources[b].key);
+    return ordering > 0 || (ordering == 0 && a > b);
+  };
+  // Reads the next record of `sources[index]`. Returns `false` on failure.
+  const auto read_next = [&](size_t index) {
+    Source& source = sources[index];
+    if (!source.reader->ReadRecord(source.record)) {
+      return source.reader->healthy();
+    }
+    source.key = get_key(source.record);
+    heap.push_back(index);
+    std::push_heap(heap.begin(), heap.end(), greater);
+    return true;
+  };
+  for (size_t index = 0; index < sources.size(); ++index) {
+    // Reading ahead in background, both by `FdReader` and by decoding chunks,
+    // overlaps reading runs with merging them.
+    sources[index].reader = absl::make_unique<RecordReader<FdReader<>>>(
+        std::forward_as_tuple(run_filenames[index], O_RDONLY,
+                              FdReaderBase::Options().set_read_ahead(2)),
+        RecordReaderBase::Options().set_parallelism(1));
+    if (ABSL_PREDICT_FALSE(!read_next(index))) {
+      return sources[index].reader->status();
+    }
+  }
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), greater);
+    const size_t index = heap.back();
+    heap.pop_back();
+    if (ABSL_PREDICT_FALSE(
+            !record_writer.WriteRecord(std::move(sources[index].record)))) {
+      return record_writer.status();
+    }
+    if (ABSL_PREDICT_FALSE(!read_next(index))) {
+      return sources[index].reader->status();
+    }
+  }
+  for (Source& source : sources) {
+    if (ABSL_PREDICT_FALSE(!source.reader->Close())) {
+      return source.reader->status();
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SortRecordsInternal(
+    absl::Span<const std::string> inputs, absl::string_view output,
+    const std::function<std::string(absl::string_view record)>& get_key,
+    const SortRecordsOptions& options,
+    std::vector<std::string>& run_filenames) {
+  const std::string temp_prefix = options.temp_prefix().empty()
+                                      ? absl::StrCat(output, ".sort-tmp")
+                                      : options.temp_prefix();
+  RecordWriterBase::Options record_writer_options =
+      options.record_writer_options();
+  record_writer_options.set_index(true).set_index_key(get_key);
+
+  RunWriter run_writer(options.parallelism());
+  std::vector<KeyedRecord> run;
+  Position run_size = 0;
+  for (const std::string& input : inputs) {
+    RecordReader<FdReader<>> record_reader(
+        std::forward_as_tuple(input, O_RDONLY));
+    KeyedRecord keyed_record;
+    while (record_reader.ReadRecord(keyed_record.record)) {
+      keyed_record.key = get_key(keyed_record.record);
+      run_size += keyed_record.key.size() + keyed_record.record.size();
+      run.push_back(std::move(keyed_record));
+      if (run_size >= options.run_size()) {
+        run_filenames.push_back(
+            absl::StrFormat("%s-%05u", temp_prefix, run_filenames.size()));
+        const absl::Status status =
+            run_writer.Write(std::move(run), run_filenames.back());
+        if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+        run.clear();
+        run_size = 0;
+      }
+    }
+    if (ABSL_PREDICT_FALSE(!record_reader.Close())) {
+      return record_reader.status();
+    }
+  }
+
+  RecordWriter<FdWriter<>> record_writer(
+      std::forward_as_tuple(output, O_WRONLY | O_CREAT | O_TRUNC),
+      std::move(record_writer_options));
+  if (run_filenames.empty()) {
+    // All records fit in one run, which is written directly to `output`.
+    std::stable_sort(run.begin(), run.end(),
+                     [](const KeyedRecord& a, const KeyedRecord& b) {
+                       return a.key < b.key;
+                     });
+    for (KeyedRecord& keyed_record : run) {
+      if (ABSL_PREDICT_FALSE(
+              !record_writer.WriteRecord(std::move(keyed_record.record)))) {
+        return record_writer.status();
+      }
+    }
+  } else {
+    if (!run.empty()) {
+      run_filenames.push_back(
+          absl::StrFormat("%s-%05u", temp_prefix, run_filenames.size()));
+      const absl::Status status =
+          run_writer.Write(std::move(run), run_filenames.back());
+      if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+    }
+    {
+      const absl::Status status = run_writer.Finish();
+      if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+    }
+    const absl::Status status =
+        MergeRuns(run_filenames, get_key, record_writer);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  if (ABSL_PREDICT_FALSE(!record_writer.Close())) return record_writer.status();
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status SortRecords(
+    absl::Span<const std::string> inputs, absl::string_view output,
+    std::function<std::string(absl::string_view record)> get_key,
+    SortRecordsOptions options) {
+  std::vector<std::string> run_filenames;
+  const absl::Status status =
+      SortRecordsInternal(inputs, output, get_key, options, run_filenames);
+  for (const std::string& run_filename : run_filenames) {
+    // A run might not have been created if sorting failed early.
+    unlink(run_filename.c_str());
+  }
+  return status;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,142 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_RECORDS_SORTING_H_
+#define RIEGELI_RECORDS_RECORDS_SORTING_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "riegeli/base/base.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+class SortRecordsOptions {
+ public:
+  SortRecordsOptions() noexcept {}
+
+  // Sets the total size of records sorted in memory as one run. Runs are
+  // written to temporary files and merged at the end.
+  //
+  // Default: 256M.
+  SortRecordsOptions& set_run_size(Position run_size) & {
+    RIEGELI_ASSERT_GT(run_size, 0u)
+        << "Failed precondition of SortRecordsOptions::set_run_size(): "
+           "zero run size";
+    run_size_ = run_size;
+    return *this;
+  }
+  SortRecordsOptions&& set_run_size(Position run_size) && {
+    return std::move(set_run_size(run_size));
+  }
+  Position run_size() const { return run_size_; }
+
+  // Sets the maximum number of runs being sorted and written in parallel in
+  // background, in addition to the run being read. Memory usage is up to
+  // about `(parallelism() + 1) * run_size()`.
+  //
+  // Default: 2.
+  SortRecordsOptions& set_parallelism(int parallelism) & {
+    RIEGELI_ASSERT_GE(parallelism, 0)
+        << "Failed precondition of SortRecordsOptions::set_parallelism(): "
+           "negative parallelism";
+    parallelism_ = parallelism;
+    return *this;
+  }
+  SortRecordsOptions&& set_parallelism(int parallelism) && {
+    return std::move(set_parallelism(parallelism));
+  }
+  int parallelism() const { return parallelism_; }
+
+  // Sets the prefix of names of temporary files holding sorted runs. Names
+  // are formed by appending `-00000`, `-00001`, etc. Temporary files are
+  // deleted when they are no longer needed.
+  //
+  // If empty, the output filename followed by `.sort-tmp` is used.
+  //
+  // Default: "".
+  SortRecordsOptions& set_temp_prefix(absl::string_view temp_prefix) & {
+    temp_prefix_.assign(temp_prefix.data(), temp_prefix.size());
+    return *this;
+  }
+  SortRecordsOptions&& set_temp_prefix(absl::string_view temp_prefix) && {
+    return std::move(set_temp_prefix(temp_prefix));
+  }
+  const std::string& temp_prefix() const { return temp_prefix_; }
+
+  // Sets options for writing the output file.
+  //
+  // `RecordWriterBase::Options::index()` and
+  // `RecordWriterBase::Options::index_key()` are overridden so that the
+  // output can be searched with `RecordReaderBase::SearchByKey()`.
+  //
+  // Default: `RecordWriterBase::Options()`.
+  SortRecordsOptions& set_record_writer_options(
+      const RecordWriterBase::Options& record_writer_options) & {
+    record_writer_options_ = record_writer_options;
+    return *this;
+  }
+  SortRecordsOptions& set_record_writer_options(
+      RecordWriterBase::Options&& record_writer_options) & {
+    record_writer_options_ = std::move(record_writer_options);
+    return *this;
+  }
+  SortRecordsOptions&& set_record_writer_options(
+      const RecordWriterBase::Options& record_writer_options) && {
+    return std::move(set_record_writer_options(record_writer_options));
+  }
+  SortRecordsOptions&& set_record_writer_options(
+      RecordWriterBase::Options&& record_writer_options) && {
+    return std::move(
+        set_record_writer_options(std::move(record_writer_options)));
+  }
+  RecordWriterBase::Options& record_writer_options() {
+    return record_writer_options_;
+  }
+  const RecordWriterBase::Options& record_writer_options() const {
+    return record_writer_options_;
+  }
+
+ private:
+  Position run_size_ = Position{256} << 20;
+  int parallelism_ = 2;
+  std::string temp_prefix_;
+  RecordWriterBase::Options record_writer_options_;
+};
+
+// Sorts records of Riegeli/records files `inputs` by key, writing them to the
+// Riegeli/records file `output`. Keys are computed by `get_key` from
+// serialized records and compared as byte strings. Records with equal keys
+// keep their order in `inputs`.
+//
+// This is an external merge sort: runs of records which fit in memory are
+// sorted in parallel and written to temporary files with fast compression,
+// then runs are merged. The output has an index with ranges of keys, so that
+// `RecordReaderBase::SearchByKey()` with the same `get_key` decodes only the
+// chunk containing the record.
+absl::Status SortRecords(
+    absl::Span<const std::string> inputs, absl::string_view output,
+    std::function<std::string(absl::string_view record)> get_key,
+    SortRecordsOptions options = SortRecordsOptions());
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_RECORDS_SORTING_H_
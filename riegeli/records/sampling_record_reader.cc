@@ -0,0 +1,161 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/sampling_record_reader.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/messages/message_parse.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/record_position.h"
+#include "riegeli/records/record_reader.h"
+
+namespace riegeli {
+
+SamplingRecordReader::SamplingRecordReader(std::vector<std::string> filenames,
+                                           Options options)
+    : Object(kInitiallyOpen),
+      filenames_(std::move(filenames)),
+      record_reader_options_(std::move(options.record_reader_options())),
+      window_size_(options.window_size()),
+      random_(options.seed() != absl::nullopt ? *options.seed()
+                                              : std::random_device()()),
+      file_readers_(filenames_.size()) {
+  for (size_t file_index = 0; file_index < filenames_.size(); ++file_index) {
+    if (ABSL_PREDICT_FALSE(!ListChunks(file_index))) return;
+  }
+  std::shuffle(chunks_.begin(), chunks_.end(), random_);
+}
+
+void SamplingRecordReader::Done() {
+  for (std::unique_ptr<FileReader>& file_reader : file_readers_) {
+    if (file_reader == nullptr) continue;
+    if (ABSL_PREDICT_FALSE(!file_reader->Close())) Fail(*file_reader);
+    file_reader.reset();
+  }
+  chunks_ = std::vector<ChunkRef>();
+  window_ = std::vector<std::string>();
+  record_ = std::string();
+}
+
+bool SamplingRecordReader::ListChunks(size_t file_index) {
+  // Only chunk headers are read: data of each chunk are skipped by seeking to
+  // the next chunk boundary.
+  DefaultChunkReader<FdReader<>> chunk_reader(
+      std::forward_as_tuple(filenames_[file_index], O_RDONLY));
+  for (;;) {
+    const ChunkHeader* chunk_header;
+    if (!chunk_reader.PullChunkHeader(&chunk_header)) {
+      if (ABSL_PREDICT_FALSE(!chunk_reader.healthy())) {
+        return Fail(chunk_reader);
+      }
+      break;
+    }
+    if (chunk_header->num_records() > 0) {
+      chunks_.push_back(ChunkRef{file_index, chunk_reader.pos(),
+                                 chunk_header->num_records()});
+    }
+    if (ABSL_PREDICT_FALSE(
+            !chunk_reader.SeekToChunkAfter(chunk_reader.pos() + 1))) {
+      return Fail(chunk_reader);
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!chunk_reader.Close())) return Fail(chunk_reader);
+  return true;
+}
+
+bool SamplingRecordReader::LoadChunk(const ChunkRef& chunk) {
+  std::unique_ptr<FileReader>& file_reader = file_readers_[chunk.file_index];
+  if (file_reader == nullptr) {
+    file_reader = absl::make_unique<FileReader>(
+        std::forward_as_tuple(filenames_[chunk.file_index], O_RDONLY),
+        record_reader_options_);
+  }
+  if (ABSL_PREDICT_FALSE(
+          !file_reader->Seek(RecordPosition(chunk.chunk_begin, 0)))) {
+    return Fail(*file_reader);
+  }
+  for (uint64_t i = 0; i < chunk.num_records; ++i) {
+    std::string record;
+    if (ABSL_PREDICT_FALSE(!file_reader->ReadRecord(record))) {
+      if (ABSL_PREDICT_FALSE(!file_reader->healthy())) {
+        return Fail(*file_reader);
+      }
+      break;
+    }
+    // With recovery, skipping an invalid region could reach the next chunk,
+    // which is visited separately.
+    if (ABSL_PREDICT_FALSE(file_reader->last_pos().chunk_begin() !=
+                           chunk.chunk_begin)) {
+      break;
+    }
+    window_.push_back(std::move(record));
+  }
+  return true;
+}
+
+bool SamplingRecordReader::NextRecord() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  while (window_.size() < window_size_ && next_chunk_ < chunks_.size()) {
+    if (ABSL_PREDICT_FALSE(!LoadChunk(chunks_[next_chunk_++]))) return false;
+  }
+  if (window_.empty()) return false;
+  const size_t index =
+      std::uniform_int_distribution<size_t>(0, window_.size() - 1)(random_);
+  using std::swap;
+  swap(window_[index], window_.back());
+  record_ = std::move(window_.back());
+  window_.pop_back();
+  return true;
+}
+
+bool SamplingRecordReader::ReadRecord(google::protobuf::MessageLite& record) {
+  if (ABSL_PREDICT_FALSE(!NextRecord())) return false;
+  absl::Status status = ParseFromString(record_, record);
+  if (ABSL_PREDICT_FALSE(!status.ok())) return Fail(std::move(status));
+  return true;
+}
+
+bool SamplingRecordReader::ReadRecord(absl::string_view& record) {
+  if (ABSL_PREDICT_FALSE(!NextRecord())) return false;
+  record = record_;
+  return true;
+}
+
+bool SamplingRecordReader::ReadRecord(std::string& record) {
+  if (ABSL_PREDICT_FALSE(!NextRecord())) return false;
+  record = std::move(record_);
+  return true;
+}
+
+}  // namespace riegeli
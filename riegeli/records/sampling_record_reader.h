@@ -0,0 +1,191 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_SAMPLING_RECORD_READER_H_
+#define RIEGELI_RECORDS_SAMPLING_RECORD_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/records/record_reader.h"
+
+namespace riegeli {
+
+// `SamplingRecordReader` reads records of one or more Riegeli/records files in
+// a pseudo-random order, e.g. for shuffling training data, without reading all
+// records into a shuffle buffer first.
+//
+// Chunk boundaries of all files are listed from chunk headers, and chunks are
+// visited in a random permutation across files. Each chunk is read and decoded
+// once, as a whole, so I/O stays sequential within a chunk. Records of visited
+// chunks are collected in a window of about `window_size()` records, and each
+// record returned is chosen at random from the window. The order approaches a
+// uniformly random permutation as the window spans more chunks.
+//
+// A file is opened when its first chunk is visited, and stays open until the
+// `SamplingRecordReader` is closed.
+class SamplingRecordReader : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Sets options of the `RecordReader` of each file.
+    //
+    // Default: `RecordReaderBase::Options()`.
+    Options& set_record_reader_options(
+        const RecordReaderBase::Options& record_reader_options) & {
+      record_reader_options_ = record_reader_options;
+      return *this;
+    }
+    Options& set_record_reader_options(
+        RecordReaderBase::Options&& record_reader_options) & {
+      record_reader_options_ = std::move(record_reader_options);
+      return *this;
+    }
+    Options&& set_record_reader_options(
+        const RecordReaderBase::Options& record_reader_options) && {
+      return std::move(set_record_reader_options(record_reader_options));
+    }
+    Options&& set_record_reader_options(
+        RecordReaderBase::Options&& record_reader_options) && {
+      return std::move(
+          set_record_reader_options(std::move(record_reader_options)));
+    }
+    RecordReaderBase::Options& record_reader_options() {
+      return record_reader_options_;
+    }
+    const RecordReaderBase::Options& record_reader_options() const {
+      return record_reader_options_;
+    }
+
+    // Sets the number of records collected from visited chunks before a record
+    // is chosen at random among them. Larger windows shuffle more thoroughly
+    // at the cost of memory.
+    //
+    // Default: 10000.
+    Options& set_window_size(size_t window_size) & {
+      RIEGELI_ASSERT_GT(window_size, 0u)
+          << "Failed precondition of "
+             "SamplingRecordReader::Options::set_window_size(): "
+             "window size not positive";
+      window_size_ = window_size;
+      return *this;
+    }
+    Options&& set_window_size(size_t window_size) && {
+      return std::move(set_window_size(window_size));
+    }
+    size_t window_size() const { return window_size_; }
+
+    // If not `absl::nullopt`, the seed of the pseudo-random generator, making
+    // the order of records reproducible.
+    //
+    // If `absl::nullopt`, the seed is taken from `std::random_device`.
+    //
+    // Default: `absl::nullopt`.
+    Options& set_seed(absl::optional<uint64_t> seed) & {
+      seed_ = seed;
+      return *this;
+    }
+    Options&& set_seed(absl::optional<uint64_t> seed) && {
+      return std::move(set_seed(seed));
+    }
+    absl::optional<uint64_t> seed() const { return seed_; }
+
+   private:
+    RecordReaderBase::Options record_reader_options_;
+    size_t window_size_ = 10000;
+    absl::optional<uint64_t> seed_;
+  };
+
+  // Lists chunks of the files named by `filenames`, and chooses the order of
+  // visiting them.
+  explicit SamplingRecordReader(std::vector<std::string> filenames,
+                                Options options = Options());
+
+  SamplingRecordReader(const SamplingRecordReader&) = delete;
+  SamplingRecordReader& operator=(const SamplingRecordReader&) = delete;
+
+  // Reads the next record, in a pseudo-random order.
+  //
+  // `ReadRecord(google::protobuf::MessageLite&)` parses raw bytes to a proto
+  // message after reading. The remaining overloads read raw bytes. For
+  // `ReadRecord(absl::string_view&)` the `absl::string_view` is valid until the
+  // next non-const operation on this `SamplingRecordReader`.
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - all records were read
+  //  * `false` (when `!healthy()`) - failure
+  bool ReadRecord(google::protobuf::MessageLite& record);
+  bool ReadRecord(absl::string_view& record);
+  bool ReadRecord(std::string& record);
+
+  // Returns the number of chunks containing records in all files.
+  size_t num_chunks() const { return chunks_.size(); }
+
+ protected:
+  void Done() override;
+
+ private:
+  using FileReader = RecordReader<FdReader<>>;
+
+  struct ChunkRef {
+    size_t file_index;
+    Position chunk_begin;
+    uint64_t num_records;
+  };
+
+  // Appends chunks of the file with index `file_index` which contain records
+  // to `chunks_`.
+  bool ListChunks(size_t file_index);
+  // Appends records of `chunk` to `window_`.
+  bool LoadChunk(const ChunkRef& chunk);
+  // Moves a record chosen at random from `window_` to `record_`, visiting
+  // more chunks first if the window is not full.
+  //
+  // Return values:
+  //  * `true`                      - success (`record_` is set)
+  //  * `false` (when `healthy()`)  - all records were read
+  //  * `false` (when `!healthy()`) - failure
+  bool NextRecord();
+
+  std::vector<std::string> filenames_;
+  RecordReaderBase::Options record_reader_options_;
+  size_t window_size_ = 0;
+  std::mt19937_64 random_;
+  // `RecordReader`s of files, `nullptr` if not opened yet.
+  std::vector<std::unique_ptr<FileReader>> file_readers_;
+  // Chunks in the order of visiting them.
+  std::vector<ChunkRef> chunks_;
+  size_t next_chunk_ = 0;
+  std::vector<std::string> window_;
+  std::string record_;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_SAMPLING_RECORD_READER_H_
@@ -0,0 +1,159 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/sharded_record_writer.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+ShardedRecordWriter::ShardedRecordWriter(absl::string_view prefix,
+                                         Options options)
+    : Object(kInitiallyOpen),
+      prefix_(prefix),
+      shard_size_(options.shard_size()),
+      record_writer_options_(std::move(options.record_writer_options())),
+      shards_(IntCast<size_t>(options.num_shards())) {
+  if (record_writer_options_.parallelism() == 0) {
+    record_writer_options_.set_parallelism(1);
+  }
+  for (size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+    if (ABSL_PREDICT_FALSE(!OpenPart(shard_index))) return;
+  }
+}
+
+ShardedRecordWriter::ShardedRecordWriter(ShardedRecordWriter&& that) noexcept
+    : Object(std::move(that)),
+      prefix_(std::move(that.prefix_)),
+      shard_size_(that.shard_size_),
+      record_writer_options_(std::move(that.record_writer_options_)),
+      shards_(std::move(that.shards_)),
+      filenames_(std::move(that.filenames_)),
+      round_robin_shard_(std::exchange(that.round_robin_shard_, 0)),
+      round_robin_size_(std::exchange(that.round_robin_size_, 0)) {}
+
+ShardedRecordWriter& ShardedRecordWriter::operator=(
+    ShardedRecordWriter&& that) noexcept {
+  Object::operator=(std::move(that));
+  prefix_ = std::move(that.prefix_);
+  shard_size_ = that.shard_size_;
+  record_writer_options_ = std::move(that.record_writer_options_);
+  shards_ = std::move(that.shards_);
+  filenames_ = std::move(that.filenames_);
+  round_robin_shard_ = std::exchange(that.round_robin_shard_, 0);
+  round_robin_size_ = std::exchange(that.round_robin_size_, 0);
+  return *this;
+}
+
+void ShardedRecordWriter::Done() {
+  for (Shard& shard : shards_) {
+    if (shard.writer == nullptr) continue;
+    if (ABSL_PREDICT_FALSE(!shard.writer->Close()) && healthy()) {
+      Fail(*shard.writer);
+    }
+    shard.writer.reset();
+  }
+}
+
+bool ShardedRecordWriter::OpenPart(size_t shard_index) {
+  Shard& shard = shards_[shard_index];
+  if (shard.writer != nullptr) {
+    // Closing waits for chunks of this part encoded in background. Other
+    // shards keep being written meanwhile.
+    if (ABSL_PREDICT_FALSE(!shard.writer->Close())) return Fail(*shard.writer);
+    ++shard.part_index;
+  }
+  filenames_.push_back(absl::StrFormat("%s-%05u-%05u", prefix_, shard_index,
+                                       shard.part_index));
+  shard.writer = absl::make_unique<RecordWriter<FdWriter<>>>(
+      std::forward_as_tuple(filenames_.back(), O_WRONLY | O_CREAT | O_TRUNC),
+      record_writer_options_);
+  if (ABSL_PREDICT_FALSE(!shard.writer->healthy())) return Fail(*shard.writer);
+  return true;
+}
+
+inline bool ShardedRecordWriter::WriteToShard(size_t shard_index,
+                                              absl::string_view record) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  RecordWriterBase& writer = *shards_[shard_index].writer;
+  if (ABSL_PREDICT_FALSE(!writer.WriteRecord(record))) return Fail(writer);
+  if (shard_size_ != absl::nullopt && writer.EstimatedSize() >= *shard_size_) {
+    return OpenPart(shard_index);
+  }
+  return true;
+}
+
+bool ShardedRecordWriter::WriteRecord(
+    const google::protobuf::MessageLite& record) {
+  return WriteRecord(record.SerializeAsString());
+}
+
+bool ShardedRecordWriter::WriteRecord(absl::string_view record) {
+  // Switching shards after about a chunk keeps records of each chunk together,
+  // so that chunks are as large and as well compressed as with one shard.
+  if (round_robin_size_ >= record_writer_options_.effective_chunk_size()) {
+    round_robin_shard_ = (round_robin_shard_ + 1) % shards_.size();
+    round_robin_size_ = 0;
+  }
+  round_robin_size_ += record.size();
+  return WriteToShard(round_robin_shard_, record);
+}
+
+bool ShardedRecordWriter::WriteRecord(
+    absl::string_view key, const google::protobuf::MessageLite& record) {
+  return WriteRecord(key, record.SerializeAsString());
+}
+
+bool ShardedRecordWriter::WriteRecord(absl::string_view key,
+                                      absl::string_view record) {
+  return WriteToShard(absl::Hash<absl::string_view>()(key) % shards_.size(),
+                      record);
+}
+
+bool ShardedRecordWriter::Flush(FlushType flush_type) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  // Start flushing all shards before waiting for any of them.
+  std::vector<RecordWriterBase::FutureBool> flushed;
+  flushed.reserve(shards_.size());
+  for (Shard& shard : shards_) {
+    flushed.push_back(shard.writer->FutureFlush(flush_type));
+  }
+  bool ok = true;
+  for (size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+    if (ABSL_PREDICT_FALSE(!flushed[shard_index].get()) && ok) {
+      ok = Fail(*shards_[shard_index].writer);
+    }
+  }
+  return ok;
+}
+
+}  // namespace riegeli
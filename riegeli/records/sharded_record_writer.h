@@ -0,0 +1,191 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_SHARDED_RECORD_WRITER_H_
+#define RIEGELI_RECORDS_SHARDED_RECORD_WRITER_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "google/protobuf/message_lite.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/records/record_writer.h"
+
+namespace riegeli {
+
+// `ShardedRecordWriter` writes records to several Riegeli/records files
+// concurrently, to increase aggregate write bandwidth beyond what one file
+// and one encoder provide.
+//
+// Each shard has its own `RecordWriter`, which encodes chunks and writes them
+// in background. Records are distributed either round-robin, switching shards
+// after about a chunk worth of records so that each chunk is encoded whole in
+// one shard, or by a hash of a key, so that records with the same key are
+// written to the same shard.
+//
+// Shard files are named `<prefix>-SSSSS-PPPPP`, where `SSSSS` is the shard
+// index and `PPPPP` is the part index, which is incremented whenever a part
+// reaches `Options::shard_size()`.
+//
+// The order of records across shards is not preserved.
+class ShardedRecordWriter : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Sets the number of shards written concurrently.
+    //
+    // Default: 4.
+    Options& set_num_shards(int num_shards) & {
+      RIEGELI_ASSERT_GT(num_shards, 0)
+          << "Failed precondition of "
+             "ShardedRecordWriter::Options::set_num_shards(): "
+             "number of shards not positive";
+      num_shards_ = num_shards;
+      return *this;
+    }
+    Options&& set_num_shards(int num_shards) && {
+      return std::move(set_num_shards(num_shards));
+    }
+    int num_shards() const { return num_shards_; }
+
+    // If not `absl::nullopt`, a part of a shard is closed and the next part is
+    // started when its `RecordWriterBase::EstimatedSize()` reaches this.
+    //
+    // Default: `absl::nullopt`.
+    Options& set_shard_size(absl::optional<Position> shard_size) & {
+      if (shard_size != absl::nullopt) {
+        RIEGELI_ASSERT_GT(*shard_size, 0u)
+            << "Failed precondition of "
+               "ShardedRecordWriter::Options::set_shard_size(): "
+               "zero shard size";
+      }
+      shard_size_ = shard_size;
+      return *this;
+    }
+    Options&& set_shard_size(absl::optional<Position> shard_size) && {
+      return std::move(set_shard_size(shard_size));
+    }
+    absl::optional<Position> shard_size() const { return shard_size_; }
+
+    // Sets options of `RecordWriter`s of shards.
+    //
+    // If `RecordWriterBase::Options::parallelism()` is 0, it is overridden
+    // with 1, so that each shard is encoded and written in background.
+    //
+    // Default: `RecordWriterBase::Options()`.
+    Options& set_record_writer_options(
+        const RecordWriterBase::Options& record_writer_options) & {
+      record_writer_options_ = record_writer_options;
+      return *this;
+    }
+    Options& set_record_writer_options(
+        RecordWriterBase::Options&& record_writer_options) & {
+      record_writer_options_ = std::move(record_writer_options);
+      return *this;
+    }
+    Options&& set_record_writer_options(
+        const RecordWriterBase::Options& record_writer_options) && {
+      return std::move(set_record_writer_options(record_writer_options));
+    }
+    Options&& set_record_writer_options(
+        RecordWriterBase::Options&& record_writer_options) && {
+      return std::move(
+          set_record_writer_options(std::move(record_writer_options)));
+    }
+    RecordWriterBase::Options& record_writer_options() {
+      return record_writer_options_;
+    }
+    const RecordWriterBase::Options& record_writer_options() const {
+      return record_writer_options_;
+    }
+
+   private:
+    int num_shards_ = 4;
+    absl::optional<Position> shard_size_;
+    RecordWriterBase::Options record_writer_options_;
+  };
+
+  // Creates a closed `ShardedRecordWriter`.
+  ShardedRecordWriter() noexcept : Object(kInitiallyClosed) {}
+
+  // Will write to files named `<prefix>-SSSSS-PPPPP`.
+  explicit ShardedRecordWriter(absl::string_view prefix,
+                               Options options = Options());
+
+  ShardedRecordWriter(ShardedRecordWriter&& that) noexcept;
+  ShardedRecordWriter& operator=(ShardedRecordWriter&& that) noexcept;
+
+  // Writes the next record to a shard chosen round-robin.
+  //
+  // Return values:
+  //  * `true`  - success
+  //  * `false` - failure (`!healthy()`)
+  bool WriteRecord(const google::protobuf::MessageLite& record);
+  bool WriteRecord(absl::string_view record);
+
+  // Writes the next record to a shard chosen by a hash of `key`.
+  //
+  // Return values:
+  //  * `true`  - success
+  //  * `false` - failure (`!healthy()`)
+  bool WriteRecord(absl::string_view key,
+                   const google::protobuf::MessageLite& record);
+  bool WriteRecord(absl::string_view key, absl::string_view record);
+
+  // Flushes all shards, as `RecordWriterBase::Flush()`.
+  //
+  // Return values:
+  //  * `true`  - success
+  //  * `false` - failure (`!healthy()`)
+  bool Flush(FlushType flush_type = FlushType::kFromProcess);
+
+  // Returns names of files written so far, including open parts.
+  const std::vector<std::string>& filenames() const { return filenames_; }
+
+ protected:
+  void Done() override;
+
+ private:
+  struct Shard {
+    std::unique_ptr<RecordWriter<FdWriter<>>> writer;
+    Position part_index = 0;
+  };
+
+  bool OpenPart(size_t shard_index);
+  bool WriteToShard(size_t shard_index, absl::string_view record);
+
+  std::string prefix_;
+  absl::optional<Position> shard_size_;
+  RecordWriterBase::Options record_writer_options_;
+  std::vector<Shard> shards_;
+  std::vector<std::string> filenames_;
+  // The shard receiving round-robin records, and the size of records written
+  // to it since it was chosen.
+  size_t round_robin_shard_ = 0;
+  Position round_robin_size_ = 0;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_SHARDED_RECORD_WRITER_H_
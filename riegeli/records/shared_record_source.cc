@@ -0,0 +1,248 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/shared_record_source.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/errno_mapping.h"
+#include "riegeli/base/object.h"
+#include "riegeli/base/status.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/record_position.h"
+#include "riegeli/records/record_reader.h"
+#include "riegeli/records/records_metadata.pb.h"
+#include "riegeli/zstd/zstd_reader.h"
+
+namespace riegeli {
+
+SharedRecordSource::SharedRecordSource(absl::string_view filename,
+                                       Options options)
+    : Object(kInitiallyOpen),
+      filename_(filename),
+      shard_cache_size_(options.cache_size() /
+                        IntCast<size_t>(options.cache_shards())),
+      shards_(absl::make_unique<CacheShard[]>(
+          IntCast<size_t>(options.cache_shards()))),
+      num_shards_(IntCast<size_t>(options.cache_shards())) {
+  const int fd = open(filename_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (ABSL_PREDICT_FALSE(fd < 0)) {
+    const int error_number = errno;
+    Fail(Annotate(ErrnoToCanonicalStatus(error_number, "open() failed"),
+                  absl::StrCat("reading ", filename_)));
+    return;
+  }
+  fd_ = OwnedFd(fd);
+  // Chunks compressed with a Zstd dictionary need the dictionary from file
+  // metadata.
+  RecordReader<FdReader<UnownedFd>> record_reader(std::forward_as_tuple(
+      fd, FdReaderBase::Options().set_independent_pos(0)));
+  RecordsMetadata metadata;
+  if (ABSL_PREDICT_FALSE(!record_reader.ReadMetadata(metadata))) {
+    Fail(record_reader);
+    return;
+  }
+  if (ABSL_PREDICT_FALSE(!record_reader.Close())) {
+    Fail(record_reader);
+    return;
+  }
+  if (metadata.has_zstd_dictionary()) {
+    chunk_decoder_options_.set_zstd_dictionary(
+        ZstdReaderBase::Dictionary().set_data(
+            std::move(*metadata.mutable_zstd_dictionary())));
+  }
+  // Records are served as `absl::string_view` shared by cursors.
+  chunk_decoder_options_.set_contiguous_records(true);
+}
+
+void SharedRecordSource::Done() { fd_ = OwnedFd(); }
+
+std::unique_ptr<SharedRecordCursor> SharedRecordSource::NewCursor() const {
+  return std::unique_ptr<SharedRecordCursor>(
+      new SharedRecordCursor(this, fd_.get()));
+}
+
+inline SharedRecordSource::CacheShard& SharedRecordSource::ShardFor(
+    Position chunk_begin) const {
+  return shards_[absl::Hash<Position>()(chunk_begin) % num_shards_];
+}
+
+std::shared_ptr<const SharedRecordSource::DecodedChunk>
+SharedRecordSource::GetChunk(Position chunk_begin, DefaultChunkReaderBase& src,
+                             absl::Status& status) const {
+  CacheShard& shard = ShardFor(chunk_begin);
+  {
+    absl::MutexLock lock(&shard.mutex);
+    const auto iter = shard.chunks.find(chunk_begin);
+    if (iter != shard.chunks.end()) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+      return *iter->second;
+    }
+  }
+  // Read and decode the chunk without holding the lock. If several threads
+  // miss the same chunk concurrently, each decodes it.
+  Chunk chunk;
+  if (ABSL_PREDICT_FALSE(!src.Seek(chunk_begin)) || !src.ReadChunk(chunk)) {
+    if (ABSL_PREDICT_FALSE(!src.healthy())) status = src.status();
+    return nullptr;
+  }
+  const std::shared_ptr<DecodedChunk> decoded =
+      std::make_shared<DecodedChunk>();
+  decoded->chunk_begin = chunk_begin;
+  decoded->chunk_end = src.pos();
+  if (chunk.header.num_records() > 0) {
+    decoded->decoder.Reset(chunk_decoder_options_);
+    if (ABSL_PREDICT_FALSE(!decoded->decoder.Decode(chunk)) ||
+        ABSL_PREDICT_FALSE(!decoded->decoder.ReadRecords(
+            IntCast<size_t>(decoded->decoder.num_records()),
+            decoded->records))) {
+      status = Annotate(decoded->decoder.status(),
+                        absl::StrCat("at chunk ", chunk_begin));
+      return nullptr;
+    }
+  }
+  decoded->memory = sizeof(DecodedChunk) +
+                    IntCast<size_t>(chunk.header.decoded_data_size()) +
+                    decoded->records.size() * sizeof(absl::string_view);
+  if (decoded->memory <= shard_cache_size_) {
+    absl::MutexLock lock(&shard.mutex);
+    if (shard.chunks.find(chunk_begin) == shard.chunks.end()) {
+      shard.lru.push_front(decoded);
+      shard.chunks.emplace(chunk_begin, shard.lru.begin());
+      shard.memory += decoded->memory;
+      while (shard.memory > shard_cache_size_) {
+        const DecodedChunk& evicted = *shard.lru.back();
+        shard.memory -= evicted.memory;
+        shard.chunks.erase(evicted.chunk_begin);
+        // Cursors still reading the chunk keep it alive.
+        shard.lru.pop_back();
+      }
+    }
+  }
+  return decoded;
+}
+
+SharedRecordCursor::SharedRecordCursor(const SharedRecordSource* source,
+                                       int fd)
+    : Object(kInitiallyOpen),
+      source_(RIEGELI_ASSERT_NOTNULL(source)),
+      chunk_reader_(std::forward_as_tuple(
+          fd, FdReaderBase::Options().set_independent_pos(0))) {
+  if (ABSL_PREDICT_FALSE(!source_->healthy())) Fail(*source_);
+}
+
+void SharedRecordCursor::Done() {
+  chunk_.reset();
+  if (ABSL_PREDICT_FALSE(!chunk_reader_.Close())) Fail(chunk_reader_);
+}
+
+bool SharedRecordCursor::LoadChunk(Position chunk_begin) {
+  for (;;) {
+    chunk_begin_ = chunk_begin;
+    record_index_ = 0;
+    absl::Status status;
+    chunk_ = source_->GetChunk(chunk_begin, chunk_reader_, status);
+    if (chunk_ == nullptr) {
+      if (ABSL_PREDICT_FALSE(!status.ok())) return Fail(std::move(status));
+      // End of file.
+      return true;
+    }
+    if (!chunk_->records.empty()) return true;
+    chunk_begin = chunk_->chunk_end;
+  }
+}
+
+bool SharedRecordCursor::ReadRecord(absl::string_view& record) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (chunk_ == nullptr || record_index_ >= chunk_->records.size()) {
+    if (ABSL_PREDICT_FALSE(!LoadChunk(
+            chunk_ == nullptr ? chunk_begin_ : chunk_->chunk_end))) {
+      return false;
+    }
+    if (chunk_ == nullptr) return false;
+  }
+  record = chunk_->records[IntCast<size_t>(record_index_++)];
+  return true;
+}
+
+bool SharedRecordCursor::ReadRecord(std::string& record) {
+  absl::string_view record_view;
+  if (ABSL_PREDICT_FALSE(!ReadRecord(record_view))) return false;
+  record.assign(record_view.data(), record_view.size());
+  return true;
+}
+
+RecordPosition SharedRecordCursor::pos() const {
+  if (chunk_ == nullptr) return RecordPosition(chunk_begin_, 0);
+  if (record_index_ >= chunk_->records.size()) {
+    return RecordPosition(chunk_->chunk_end, 0);
+  }
+  return RecordPosition(chunk_begin_, record_index_);
+}
+
+bool SharedRecordCursor::Seek(RecordPosition new_pos) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  chunk_.reset();
+  chunk_begin_ = new_pos.chunk_begin();
+  record_index_ = 0;
+  // Seeking to the beginning of a chunk does not need reading the chunk.
+  if (new_pos.record_index() == 0) return true;
+  if (ABSL_PREDICT_FALSE(!LoadChunk(new_pos.chunk_begin()))) return false;
+  if (chunk_ != nullptr && chunk_begin_ == new_pos.chunk_begin()) {
+    record_index_ =
+        UnsignedMin(new_pos.record_index(), chunk_->records.size());
+  }
+  return true;
+}
+
+bool SharedRecordCursor::Seek(Position new_pos) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  chunk_.reset();
+  record_index_ = 0;
+  if (ABSL_PREDICT_FALSE(!chunk_reader_.SeekToChunkContaining(new_pos))) {
+    return Fail(chunk_reader_);
+  }
+  const Position chunk_begin = chunk_reader_.pos();
+  chunk_begin_ = chunk_begin;
+  // If `chunk_begin >= new_pos`, this seeks to the beginning of a chunk, which
+  // does not need reading the chunk.
+  if (chunk_begin >= new_pos) return true;
+  if (ABSL_PREDICT_FALSE(!LoadChunk(chunk_begin))) return false;
+  if (chunk_ != nullptr && chunk_begin_ == chunk_begin) {
+    record_index_ = UnsignedMin(IntCast<uint64_t>(new_pos - chunk_begin),
+                                chunk_->records.size());
+  }
+  return true;
+}
+
+}  // namespace riegeli
@@ -0,0 +1,214 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_SHARED_RECORD_SOURCE_H_
+#define RIEGELI_RECORDS_SHARED_RECORD_SOURCE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/object.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/record_position.h"
+
+namespace riegeli {
+
+class SharedRecordCursor;
+
+// `SharedRecordSource` serves records of a Riegeli/records file to many
+// threads doing random access, sharing one file descriptor and a cache of
+// decoded chunks.
+//
+// Each thread reads through its own lightweight `SharedRecordCursor`, created
+// with `NewCursor()`. Cursors read chunks with `pread()` from the shared file
+// descriptor, and decoded chunks are cached by chunk begin position in a
+// sharded LRU cache, so that threads reading nearby records decode each chunk
+// once.
+//
+// `SharedRecordSource` is thread-safe after construction. It must outlive its
+// cursors.
+class SharedRecordSource : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Sets the total size of decoded records kept in the cache. Chunks are
+    // evicted in LRU order; a chunk larger than the whole cache is not cached
+    // but still served.
+    //
+    // Default: 64M.
+    Options& set_cache_size(size_t cache_size) & {
+      cache_size_ = cache_size;
+      return *this;
+    }
+    Options&& set_cache_size(size_t cache_size) && {
+      return std::move(set_cache_size(cache_size));
+    }
+    size_t cache_size() const { return cache_size_; }
+
+    // Sets the number of independently locked parts of the cache. More shards
+    // reduce lock contention; each shard holds up to
+    // `cache_size() / cache_shards()`.
+    //
+    // Default: 16.
+    Options& set_cache_shards(int cache_shards) & {
+      RIEGELI_ASSERT_GT(cache_shards, 0)
+          << "Failed precondition of "
+             "SharedRecordSource::Options::set_cache_shards(): "
+             "number of shards not positive";
+      cache_shards_ = cache_shards;
+      return *this;
+    }
+    Options&& set_cache_shards(int cache_shards) && {
+      return std::move(set_cache_shards(cache_shards));
+    }
+    int cache_shards() const { return cache_shards_; }
+
+   private:
+    size_t cache_size_ = size_t{64} << 20;
+    int cache_shards_ = 16;
+  };
+
+  // Opens the file named `filename` and reads its metadata.
+  explicit SharedRecordSource(absl::string_view filename,
+                              Options options = Options());
+
+  SharedRecordSource(const SharedRecordSource&) = delete;
+  SharedRecordSource& operator=(const SharedRecordSource&) = delete;
+
+  // Returns a new cursor, positioned at the beginning of the file.
+  //
+  // Cursors must not be used after the `SharedRecordSource` is closed or
+  // destroyed.
+  std::unique_ptr<SharedRecordCursor> NewCursor() const;
+
+ protected:
+  void Done() override;
+
+ private:
+  friend class SharedRecordCursor;
+
+  // A chunk decoded into records, immutable after construction.
+  struct DecodedChunk {
+    Position chunk_begin = 0;
+    Position chunk_end = 0;
+    ChunkDecoder decoder;
+    // Point to data owned by `decoder`.
+    std::vector<absl::string_view> records;
+    size_t memory = 0;
+  };
+
+  struct CacheShard {
+    using LruList = std::list<std::shared_ptr<const DecodedChunk>>;
+
+    absl::Mutex mutex;
+    // Most recently used chunks first.
+    LruList lru ABSL_GUARDED_BY(mutex);
+    absl::flat_hash_map<Position, LruList::iterator> chunks
+        ABSL_GUARDED_BY(mutex);
+    size_t memory ABSL_GUARDED_BY(mutex) = 0;
+  };
+
+  // Returns the chunk beginning at `chunk_begin`, from the cache or reading
+  // it with `src` and decoding it.
+  //
+  // Return values:
+  //  * non-`nullptr`                             - success
+  //  * `nullptr` (when `status.ok()`)            - source ends
+  //  * `nullptr` (when `!status.ok()`)           - failure
+  std::shared_ptr<const DecodedChunk> GetChunk(
+      Position chunk_begin, DefaultChunkReaderBase& src,
+      absl::Status& status) const;
+
+  CacheShard& ShardFor(Position chunk_begin) const;
+
+  OwnedFd fd_;
+  std::string filename_;
+  ChunkDecoder::Options chunk_decoder_options_;
+  size_t shard_cache_size_ = 0;
+  std::unique_ptr<CacheShard[]> shards_;
+  size_t num_shards_ = 0;
+};
+
+// A cursor reading records from a `SharedRecordSource`, to be used by one
+// thread at a time.
+//
+// Records are returned in file order, and positions are compatible with
+// `RecordReaderBase::pos()` and `RecordReaderBase::Seek()`.
+class SharedRecordCursor : public Object {
+ public:
+  SharedRecordCursor(const SharedRecordCursor&) = delete;
+  SharedRecordCursor& operator=(const SharedRecordCursor&) = delete;
+
+  // Reads the next record.
+  //
+  // For `ReadRecord(absl::string_view&)` the `absl::string_view` is valid until
+  // the next non-const operation on this `SharedRecordCursor`.
+  //
+  // Return values:
+  //  * `true`                      - success (`record` is set)
+  //  * `false` (when `healthy()`)  - source ends
+  //  * `false` (when `!healthy()`) - failure
+  bool ReadRecord(absl::string_view& record);
+  bool ReadRecord(std::string& record);
+
+  // Returns the canonical position of the next record.
+  RecordPosition pos() const;
+
+  // Seeks to a position, like `RecordReaderBase::Seek()`.
+  //
+  // Return values:
+  //  * `true`  - success (position is set to `new_pos`, or to the end of file
+  //              if `new_pos` is past the end)
+  //  * `false` - failure (`!healthy()`)
+  bool Seek(RecordPosition new_pos);
+  bool Seek(Position new_pos);
+
+ protected:
+  void Done() override;
+
+ private:
+  friend class SharedRecordSource;
+
+  explicit SharedRecordCursor(const SharedRecordSource* source, int fd);
+
+  // Makes the chunk beginning at `chunk_begin` current, skipping chunks
+  // without records.
+  bool LoadChunk(Position chunk_begin);
+
+  const SharedRecordSource* source_;
+  DefaultChunkReader<FdReader<UnownedFd>> chunk_reader_;
+  std::shared_ptr<const SharedRecordSource::DecodedChunk> chunk_;
+  // Beginning of the current chunk, or of the end of file.
+  Position chunk_begin_ = 0;
+  uint64_t record_index_ = 0;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_SHARED_RECORD_SOURCE_H_
@@ -0,0 +1,408 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/bytes/chain_writer.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/chunk_encoding/chunk_encoder.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/chunk_encoding/field_projection.h"
+#include "riegeli/chunk_encoding/simple_encoder.h"
+#include "riegeli/chunk_encoding/transpose_encoder.h"
+#include "riegeli/records/record_writer.h"
+#include "riegeli/records/tools/synthetic_records.h"
+
+ABSL_FLAG(int, depth, 2,
+          "Number of levels of nested messages, including the top level.");
+ABSL_FLAG(int, width, 8, "Number of fields of each message.");
+ABSL_FLAG(double, repeated_fraction, 0.25,
+          "Probability that a field is repeated.");
+ABSL_FLAG(int, max_repeated, 4,
+          "Maximum number of elements of a repeated field.");
+ABSL_FLAG(double, string_fraction, 0.5,
+          "Probability that a field which is not a submessage is a string.");
+ABSL_FLAG(uint64_t, cardinality, 1000,
+          "Number of distinct values of each field.");
+ABSL_FLAG(uint64_t, string_length, 16, "Average length of a string value.");
+ABSL_FLAG(uint64_t, seed, 0, "Seed of the schema and of the records.");
+ABSL_FLAG(uint64_t, num_records, 100000, "Number of records to generate.");
+ABSL_FLAG(bool, print_schema, false,
+          "If true, print the generated schema to stderr.");
+ABSL_FLAG(std::string, output, "",
+          "If not empty, also write generated records to this "
+          "Riegeli/records file, e.g. for records_benchmark.");
+ABSL_FLAG(std::string, record_writer_options, "transpose",
+          "RecordWriter options of --output, as for "
+          "RecordWriterBase::Options::FromString().");
+ABSL_FLAG(bool, transpose, true,
+          "If true, chunks are encoded by TransposeEncoder, otherwise by "
+          "SimpleEncoder.");
+ABSL_FLAG(std::string, compression, "zstd:3",
+          "Compression of chunks, as for CompressorOptions::FromString().");
+ABSL_FLAG(uint64_t, chunk_size, uint64_t{1} << 20,
+          "Records are split into chunks of approximately this decoded size.");
+ABSL_FLAG(double, bucket_fraction, 1.0,
+          "Maximum size of a bucket of a transposed chunk, as a fraction of "
+          "--chunk_size.");
+ABSL_FLAG(std::string, projection, "1",
+          "Comma-separated fields included by the projection stage, each "
+          "given as a path of field numbers separated by dots, e.g. "
+          "\"1.2,3\".");
+ABSL_FLAG(std::string, stages, "encode,decode,project",
+          "Comma-separated stages to measure: encode, decode, project. "
+          "Measuring one stage at a time makes profiles easier to read.");
+ABSL_FLAG(double, min_time, 1.0,
+          "Minimum time in seconds of repeating each stage.");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+uint64_t RealTimeNow_ns() {
+  struct timespec time_info;
+  RIEGELI_CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &time_info), 0);
+  return IntCast<uint64_t>(time_info.tv_sec) * uint64_t{1000000000} +
+         IntCast<uint64_t>(time_info.tv_nsec);
+}
+
+// Returns the value of the CPU timestamp counter, which counts reference
+// cycles, or 0 if it is not available.
+uint64_t CyclesNow() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// Records split into chunks, and chunks encoded from them.
+struct Corpus {
+  std::vector<std::vector<std::string>> chunk_records;
+  std::vector<Chunk> chunks;
+  uint64_t num_records = 0;
+  uint64_t decoded_size = 0;
+};
+
+// Encodes records of one chunk.
+class Encoder {
+ public:
+  Encoder(bool transpose, const CompressorOptions& compressor_options,
+          uint64_t chunk_size, uint64_t bucket_size)
+      : transpose_(transpose),
+        compressor_options_(compressor_options),
+        chunk_size_(chunk_size),
+        bucket_size_(bucket_size) {}
+
+  void Encode(const std::vector<std::string>& records, Chunk& chunk);
+
+ private:
+  bool transpose_;
+  CompressorOptions compressor_options_;
+  uint64_t chunk_size_;
+  uint64_t bucket_size_;
+  std::unique_ptr<ChunkEncoder> encoder_;
+};
+
+void Encoder::Encode(const std::vector<std::string>& records, Chunk& chunk) {
+  if (encoder_ == nullptr) {
+    if (transpose_) {
+      encoder_ = std::make_unique<TransposeEncoder>(compressor_options_,
+                                                    bucket_size_);
+    } else {
+      encoder_ =
+          std::make_unique<SimpleEncoder>(compressor_options_, chunk_size_);
+    }
+  } else {
+    encoder_->Clear();
+  }
+  for (const std::string& record : records) {
+    RIEGELI_CHECK(encoder_->AddRecord(absl::string_view(record)))
+        << encoder_->status();
+  }
+  chunk.data.Clear();
+  ChainWriter<> data_writer(&chunk.data);
+  ChunkType chunk_type;
+  uint64_t num_records;
+  uint64_t decoded_data_size;
+  RIEGELI_CHECK(encoder_->EncodeAndClose(data_writer, chunk_type, num_records,
+                                         decoded_data_size))
+      << encoder_->status();
+  RIEGELI_CHECK(data_writer.Close()) << data_writer.status();
+  chunk.header =
+      ChunkHeader(chunk.data, chunk_type, num_records, decoded_data_size);
+}
+
+// Decodes all records of `chunk`.
+void DecodeChunk(ChunkDecoder& decoder, const Chunk& chunk) {
+  RIEGELI_CHECK(decoder.Decode(chunk)) << decoder.status();
+  absl::string_view record;
+  while (decoder.ReadRecord(record)) {
+  }
+  RIEGELI_CHECK(decoder.healthy()) << decoder.status();
+}
+
+// Runs `pass` at least once and until `min_time_seconds` elapse, and reports
+// throughput of processing `corpus.decoded_size` bytes and `corpus.num_records`
+// records per pass.
+void Measure(absl::string_view stage, const Corpus& corpus,
+             double min_time_seconds, absl::FunctionRef<void()> pass) {
+  const uint64_t min_time_ns =
+      static_cast<uint64_t>(min_time_seconds * 1e9);
+  uint64_t num_passes = 0;
+  const uint64_t real_time_before_ns = RealTimeNow_ns();
+  const uint64_t cycles_before = CyclesNow();
+  uint64_t real_time_ns;
+  do {
+    pass();
+    ++num_passes;
+    real_time_ns = RealTimeNow_ns() - real_time_before_ns;
+  } while (real_time_ns < min_time_ns);
+  const uint64_t cycles = CyclesNow() - cycles_before;
+  const double num_records =
+      static_cast<double>(corpus.num_records * num_passes);
+  absl::Format(&std::cout, "%-8s %9.1f MB/s %9.1f ns/record", stage,
+               static_cast<double>(corpus.decoded_size * num_passes) /
+                   static_cast<double>(real_time_ns) * 1000.0,
+               static_cast<double>(real_time_ns) / num_records);
+  if (cycles > 0) {
+    absl::Format(&std::cout, " %9.1f cycles/record",
+                 static_cast<double>(cycles) / num_records);
+  }
+  absl::Format(&std::cout, " (%u passes)\n", num_passes);
+}
+
+// Parses `--projection`.
+absl::Status ParseProjection(absl::string_view text,
+                             FieldProjection& projection) {
+  for (const absl::string_view path :
+       absl::StrSplit(text, ',', absl::SkipEmpty())) {
+    Field field;
+    for (const absl::string_view number_text : absl::StrSplit(path, '.')) {
+      int field_number;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtoi(number_text, &field_number) ||
+                             field_number < 1 ||
+                             field_number > (1 << 29) - 1)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Invalid field path in --projection: ", path));
+      }
+      field.AddFieldNumber(field_number);
+    }
+    projection.AddField(std::move(field));
+  }
+  return absl::OkStatus();
+}
+
+const char kUsage[] =
+    "Usage: chunk_codec_benchmark (OPTION)...\n"
+    "\n"
+    "Generates synthetic records of a configurable schema shape, and measures\n"
+    "encoding, decoding, and decoding with field projection of chunks of\n"
+    "them. Each stage is repeated in a loop, which makes it suitable for\n"
+    "profiling with perf.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  absl::ParseCommandLine(argc, argv);
+  riegeli::CompressorOptions compressor_options;
+  {
+    const absl::Status status =
+        compressor_options.FromString(absl::GetFlag(FLAGS_compression));
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+  }
+  riegeli::FieldProjection projection;
+  {
+    const absl::Status status = riegeli::tools::ParseProjection(
+        absl::GetFlag(FLAGS_projection), projection);
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+  }
+  bool measure_encode = false;
+  bool measure_decode = false;
+  bool measure_project = false;
+  for (const absl::string_view stage :
+       absl::StrSplit(absl::GetFlag(FLAGS_stages), ',', absl::SkipEmpty())) {
+    if (stage == "encode") {
+      measure_encode = true;
+    } else if (stage == "decode") {
+      measure_decode = true;
+    } else if (stage == "project") {
+      measure_project = true;
+    } else {
+      absl::Format(&std::cerr, "Unknown stage in --stages: %s\n", stage);
+      return 1;
+    }
+  }
+  const uint64_t chunk_size =
+      std::max(absl::GetFlag(FLAGS_chunk_size), uint64_t{1});
+  const double bucket_fraction = absl::GetFlag(FLAGS_bucket_fraction);
+  if (!(bucket_fraction >= 0.0 && bucket_fraction <= 1.0)) {
+    absl::Format(&std::cerr, "--bucket_fraction must be between 0 and 1\n");
+    return 1;
+  }
+  const uint64_t bucket_size = std::max(
+      static_cast<uint64_t>(static_cast<double>(chunk_size) * bucket_fraction),
+      uint64_t{1});
+
+  riegeli::SyntheticRecordGenerator generator(
+      riegeli::SyntheticRecordGenerator::Options()
+          .set_depth(std::max(absl::GetFlag(FLAGS_depth), 1))
+          .set_width(std::max(absl::GetFlag(FLAGS_width), 1))
+          .set_repeated_fraction(
+              std::min(std::max(absl::GetFlag(FLAGS_repeated_fraction), 0.0),
+                       1.0))
+          .set_max_repeated(std::max(absl::GetFlag(FLAGS_max_repeated), 0))
+          .set_string_fraction(
+              std::min(std::max(absl::GetFlag(FLAGS_string_fraction), 0.0),
+                       1.0))
+          .set_cardinality(riegeli::IntCast<size_t>(
+              std::max(absl::GetFlag(FLAGS_cardinality), uint64_t{1})))
+          .set_string_length(
+              riegeli::IntCast<size_t>(absl::GetFlag(FLAGS_string_length)))
+          .set_seed(absl::GetFlag(FLAGS_seed)));
+  if (absl::GetFlag(FLAGS_print_schema)) {
+    absl::Format(&std::cerr, "%s", generator.SchemaToString());
+  }
+
+  riegeli::tools::Corpus corpus;
+  {
+    const uint64_t num_records = absl::GetFlag(FLAGS_num_records);
+    uint64_t chunk_decoded_size = 0;
+    std::string record;
+    for (uint64_t i = 0; i < num_records; ++i) {
+      generator.Generate(record);
+      if (corpus.chunk_records.empty() || chunk_decoded_size >= chunk_size) {
+        corpus.chunk_records.emplace_back();
+        chunk_decoded_size = 0;
+      }
+      chunk_decoded_size += record.size();
+      corpus.decoded_size += record.size();
+      corpus.chunk_records.back().push_back(record);
+    }
+    corpus.num_records = num_records;
+  }
+  if (corpus.num_records == 0) {
+    absl::Format(&std::cerr, "--num_records must be positive\n");
+    return 1;
+  }
+
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (!output.empty()) {
+    riegeli::RecordWriterBase::Options record_writer_options;
+    const absl::Status status = record_writer_options.FromString(
+        absl::GetFlag(FLAGS_record_writer_options));
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+    riegeli::RecordWriter<riegeli::FdWriter<>> record_writer(
+        std::forward_as_tuple(output, O_WRONLY | O_CREAT | O_TRUNC),
+        std::move(record_writer_options));
+    for (const std::vector<std::string>& records : corpus.chunk_records) {
+      for (const std::string& record : records) {
+        record_writer.WriteRecord(record);
+      }
+    }
+    if (!record_writer.Close()) {
+      absl::Format(&std::cerr, "%s\n", record_writer.status().message());
+      return 1;
+    }
+  }
+
+  riegeli::tools::Encoder encoder(absl::GetFlag(FLAGS_transpose),
+                                  compressor_options, chunk_size,
+                                  bucket_size);
+  corpus.chunks.resize(corpus.chunk_records.size());
+  for (size_t i = 0; i < corpus.chunks.size(); ++i) {
+    encoder.Encode(corpus.chunk_records[i], corpus.chunks[i]);
+  }
+  uint64_t encoded_size = 0;
+  for (const riegeli::Chunk& chunk : corpus.chunks) {
+    encoded_size += chunk.data.size();
+  }
+  absl::Format(&std::cout,
+               "%u records, %u chunks, %.3f MB, compressed to %.3f%%\n",
+               corpus.num_records, corpus.chunks.size(),
+               static_cast<double>(corpus.decoded_size) / 1000000.0,
+               static_cast<double>(encoded_size) /
+                   static_cast<double>(corpus.decoded_size) * 100.0);
+
+  const double min_time = absl::GetFlag(FLAGS_min_time);
+  if (measure_encode) {
+    riegeli::Chunk chunk;
+    riegeli::tools::Measure("encode", corpus, min_time, [&] {
+      for (const std::vector<std::string>& records : corpus.chunk_records) {
+        encoder.Encode(records, chunk);
+      }
+    });
+  }
+  if (measure_decode) {
+    riegeli::ChunkDecoder decoder;
+    riegeli::tools::Measure("decode", corpus, min_time, [&] {
+      for (const riegeli::Chunk& chunk : corpus.chunks) {
+        riegeli::tools::DecodeChunk(decoder, chunk);
+      }
+    });
+  }
+  if (measure_project) {
+    riegeli::ChunkDecoder decoder(
+        riegeli::ChunkDecoder::Options().set_field_projection(projection));
+    riegeli::tools::Measure("project", corpus, min_time, [&] {
+      for (const riegeli::Chunk& chunk : corpus.chunks) {
+        riegeli::tools::DecodeChunk(decoder, chunk);
+      }
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,532 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/message.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/csv/csv_reader.h"
+#include "riegeli/csv/csv_record.h"
+#include "riegeli/csv/parallel_csv_reader.h"
+#include "riegeli/messages/message_parse.h"
+#include "riegeli/messages/message_wire_format.h"
+#include "riegeli/records/record_writer.h"
+#include "riegeli/records/records_metadata.pb.h"
+#include "riegeli/varint/varint_writing.h"
+
+ABSL_FLAG(std::string, output, "",
+          "Name of the Riegeli/records file to write.");
+ABSL_FLAG(std::string, record_writer_options, "transpose",
+          "RecordWriter options, as for "
+          "RecordWriterBase::Options::FromString(), e.g. "
+          "\"transpose,zstd:3\". Parallelism of RecordWriter defaults to "
+          "--parallelism.");
+ABSL_FLAG(std::string, field_separator, ",",
+          "Field separator of the CSV input, a single character.");
+ABSL_FLAG(std::string, descriptor_set, "",
+          "Name of a file with a serialized google.protobuf.FileDescriptorSet "
+          "which defines --message_type.");
+ABSL_FLAG(std::string, message_type, "",
+          "Full name of the message type of records. If empty, column i of "
+          "each row is written as a bytes field with number i + 1, so that "
+          "with transposition each column is stored separately.");
+ABSL_FLAG(std::string, field_mapping, "",
+          "Comma-separated column=field pairs mapping names in the CSV header "
+          "to names of fields of --message_type. Other columns map to fields "
+          "with the same name.");
+ABSL_FLAG(bool, ignore_unknown_columns, false,
+          "If true, columns without a corresponding field of --message_type "
+          "are skipped. If false, they are an error.");
+ABSL_FLAG(int, parallelism, riegeli::Executor::DefaultMaxThreads(),
+          "Number of threads parsing CSV, converting rows, and encoding "
+          "chunks.");
+ABSL_FLAG(uint64_t, block_size, uint64_t{1} << 20,
+          "Approximate size of a block of CSV parsed by a single task.");
+ABSL_FLAG(uint64_t, batch_size, 16384,
+          "Number of rows converted to records together.");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+// Converts rows of CSV fields to serialized records.
+class RowConverter {
+ public:
+  virtual ~RowConverter() = default;
+
+  // Converts `rows[begin..end)` to `records[begin..end)`. Called concurrently
+  // for disjoint ranges.
+  //
+  // If a row cannot be converted, returns its index with the failure status.
+  virtual absl::Status Convert(std::vector<std::vector<std::string>>& rows,
+                               size_t begin, size_t end,
+                               std::vector<std::string>& records,
+                               size_t& failed_index) const = 0;
+};
+
+// Writes column i as a length-delimited field with number i + 1. Empty
+// fields are omitted.
+class ColumnarConverter : public RowConverter {
+ public:
+  absl::Status Convert(std::vector<std::vector<std::string>>& rows,
+                       size_t begin, size_t end,
+                       std::vector<std::string>& records,
+                       size_t& failed_index) const override;
+};
+
+absl::Status ColumnarConverter::Convert(
+    std::vector<std::vector<std::string>>& rows, size_t begin, size_t end,
+    std::vector<std::string>& records, size_t& failed_index) const {
+  for (size_t i = begin; i < end; ++i) {
+    const std::vector<std::string>& row = rows[i];
+    size_t size = 0;
+    for (size_t column = 0; column < row.size(); ++column) {
+      if (row[column].empty()) continue;
+      size += LengthVarint32(MakeTag(IntCast<int>(column + 1),
+                                     WireType::kLengthDelimited)) +
+              LengthVarint32(IntCast<uint32_t>(row[column].size())) +
+              row[column].size();
+    }
+    std::string& record = records[i];
+    record.resize(size);
+    char* cursor = &record[0];
+    for (size_t column = 0; column < row.size(); ++column) {
+      if (row[column].empty()) continue;
+      cursor = WriteVarint32(
+          MakeTag(IntCast<int>(column + 1), WireType::kLengthDelimited),
+          cursor);
+      cursor = WriteVarint32(IntCast<uint32_t>(row[column].size()), cursor);
+      std::memcpy(cursor, row[column].data(), row[column].size());
+      cursor += row[column].size();
+    }
+    RIEGELI_ASSERT(cursor == record.data() + record.size())
+        << "Record size was computed incorrectly";
+  }
+  return absl::OkStatus();
+}
+
+// Parses each column as the value of the corresponding singular scalar field
+// of a message. Empty fields leave the field unset.
+class MessageConverter : public RowConverter {
+ public:
+  // `fields[column]` is the field for `column`, or `nullptr` to skip it.
+  explicit MessageConverter(
+      const google::protobuf::Message* prototype,
+      std::vector<const google::protobuf::FieldDescriptor*> fields)
+      : prototype_(prototype), fields_(std::move(fields)) {}
+
+  absl::Status Convert(std::vector<std::vector<std::string>>& rows,
+                       size_t begin, size_t end,
+                       std::vector<std::string>& records,
+                       size_t& failed_index) const override;
+
+ private:
+  static absl::Status SetField(const google::protobuf::FieldDescriptor& field,
+                               std::string&& text,
+                               google::protobuf::Message& message);
+
+  const google::protobuf::Message* prototype_;
+  std::vector<const google::protobuf::FieldDescriptor*> fields_;
+};
+
+absl::Status MessageConverter::Convert(
+    std::vector<std::vector<std::string>>& rows, size_t begin, size_t end,
+    std::vector<std::string>& records, size_t& failed_index) const {
+  const std::unique_ptr<google::protobuf::Message> message(prototype_->New());
+  for (size_t i = begin; i < end; ++i) {
+    std::vector<std::string>& row = rows[i];
+    message->Clear();
+    for (size_t column = 0; column < row.size(); ++column) {
+      if (fields_[column] == nullptr || row[column].empty()) continue;
+      absl::Status status =
+          SetField(*fields_[column], std::move(row[column]), *message);
+      if (ABSL_PREDICT_FALSE(!status.ok())) {
+        failed_index = i;
+        return status;
+      }
+    }
+    if (ABSL_PREDICT_FALSE(!message->SerializeToString(&records[i]))) {
+      failed_index = i;
+      return absl::InvalidArgumentError(
+          absl::StrCat("Missing required fields: ",
+                       message->InitializationErrorString()));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MessageConverter::SetField(
+    const google::protobuf::FieldDescriptor& field, std::string&& text,
+    google::protobuf::Message& message) {
+  const google::protobuf::Reflection& reflection = *message.GetReflection();
+  switch (field.cpp_type()) {
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT32: {
+      int32_t value;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtoi(text, &value))) break;
+      reflection.SetInt32(&message, &field, value);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT64: {
+      int64_t value;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtoi(text, &value))) break;
+      reflection.SetInt64(&message, &field, value);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT32: {
+      uint32_t value;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtoi(text, &value))) break;
+      reflection.SetUInt32(&message, &field, value);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT64: {
+      uint64_t value;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtoi(text, &value))) break;
+      reflection.SetUInt64(&message, &field, value);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: {
+      float value;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtof(text, &value))) break;
+      reflection.SetFloat(&message, &field, value);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: {
+      double value;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtod(text, &value))) break;
+      reflection.SetDouble(&message, &field, value);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_BOOL: {
+      bool value;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtob(text, &value))) break;
+      reflection.SetBool(&message, &field, value);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+      const google::protobuf::EnumValueDescriptor* const value =
+          field.enum_type()->FindValueByName(text);
+      if (value != nullptr) {
+        reflection.SetEnum(&message, &field, value);
+        return absl::OkStatus();
+      }
+      int number;
+      if (ABSL_PREDICT_FALSE(!absl::SimpleAtoi(text, &number))) break;
+      reflection.SetEnumValue(&message, &field, number);
+      return absl::OkStatus();
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_STRING:
+      reflection.SetString(&message, &field, std::move(text));
+      return absl::OkStatus();
+    case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+      RIEGELI_ASSERT_UNREACHABLE()
+          << "Message fields are rejected by ResolveFields()";
+  }
+  return absl::InvalidArgumentError(absl::StrCat(
+      "Invalid value for field ", field.full_name(), ": ", text));
+}
+
+// Parses `--field_mapping`.
+absl::Status ParseFieldMapping(
+    absl::string_view text,
+    absl::flat_hash_map<std::string, std::string>& mapping) {
+  for (const absl::string_view pair :
+       absl::StrSplit(text, ',', absl::SkipEmpty())) {
+    const std::pair<absl::string_view, absl::string_view> column_and_field =
+        absl::StrSplit(pair, absl::MaxSplits('=', 1));
+    if (ABSL_PREDICT_FALSE(column_and_field.first.empty() ||
+                           column_and_field.second.empty())) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid --field_mapping entry: ", pair));
+    }
+    mapping[std::string(column_and_field.first)] =
+        std::string(column_and_field.second);
+  }
+  return absl::OkStatus();
+}
+
+// Finds the field of `descriptor` corresponding to each column of `header`.
+absl::Status ResolveFields(
+    const CsvHeader& header, const google::protobuf::Descriptor& descriptor,
+    const absl::flat_hash_map<std::string, std::string>& mapping,
+    bool ignore_unknown_columns,
+    std::vector<const google::protobuf::FieldDescriptor*>& fields) {
+  fields.clear();
+  fields.reserve(header.size());
+  for (const std::string& column : header) {
+    const auto mapped = mapping.find(column);
+    const absl::string_view field_name =
+        mapped == mapping.end() ? column : absl::string_view(mapped->second);
+    const google::protobuf::FieldDescriptor* const field =
+        descriptor.FindFieldByName(std::string(field_name));
+    if (field == nullptr) {
+      if (ABSL_PREDICT_FALSE(!ignore_unknown_columns)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Column ", column, " has no corresponding field in ",
+                         descriptor.full_name()));
+      }
+    } else if (ABSL_PREDICT_FALSE(field->is_repeated() ||
+                                  field->cpp_type() ==
+                                      google::protobuf::FieldDescriptor::
+                                          CPPTYPE_MESSAGE)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Column ", column, " maps to field ",
+                       field->full_name(),
+                       " which is not a singular scalar field"));
+    }
+    fields.push_back(field);
+  }
+  return absl::OkStatus();
+}
+
+// Converts `rows` to records, splitting them among up to `parallelism`
+// concurrent tasks, and writes them to `dest`.
+absl::Status ConvertBatch(const RowConverter& converter, Executor& executor,
+                          int parallelism,
+                          std::vector<std::vector<std::string>>& rows,
+                          const std::vector<int64_t>& line_numbers,
+                          RecordWriterBase& dest) {
+  const size_t num_tasks =
+      std::min(rows.size(), IntCast<size_t>(std::max(parallelism, 1)));
+  if (num_tasks == 0) return absl::OkStatus();
+  std::vector<std::string> records(rows.size());
+  std::vector<absl::Status> statuses(num_tasks);
+  std::vector<size_t> failed_indices(num_tasks);
+  ParallelFor(&executor, num_tasks, [&](size_t task) {
+    statuses[task] = converter.Convert(
+        rows, rows.size() * task / num_tasks,
+        rows.size() * (task + 1) / num_tasks, records, failed_indices[task]);
+  });
+  for (size_t task = 0; task < num_tasks; ++task) {
+    if (ABSL_PREDICT_FALSE(!statuses[task].ok())) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("At line ", line_numbers[failed_indices[task]], ": ",
+                       statuses[task].message()));
+    }
+  }
+  for (std::string& record : records) {
+    if (ABSL_PREDICT_FALSE(!dest.WriteRecord(std::move(record)))) {
+      return dest.status();
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Converts one CSV file, appending its records to `dest`.
+absl::Status ConvertFile(const std::string& filename,
+                         const google::protobuf::Message* prototype,
+                         const absl::flat_hash_map<std::string, std::string>&
+                             field_mapping,
+                         const std::shared_ptr<Executor>& executor,
+                         RecordWriterBase& dest, uint64_t& num_records) {
+  const int parallelism = absl::GetFlag(FLAGS_parallelism);
+  ParallelCsvReader<FdReader<>> csv_reader(
+      std::forward_as_tuple(filename, O_RDONLY),
+      ParallelCsvReaderBase::Options()
+          .set_csv_options(
+              CsvReaderBase::Options()
+                  .set_read_header(true)
+                  .set_field_separator(absl::GetFlag(FLAGS_field_separator)[0]))
+          .set_parallelism(parallelism)
+          .set_block_size(
+              IntCast<size_t>(std::max(absl::GetFlag(FLAGS_block_size),
+                                       uint64_t{1})))
+          .set_executor(executor));
+  if (ABSL_PREDICT_FALSE(!csv_reader.healthy())) return csv_reader.status();
+  const CsvHeader& header = csv_reader.header();
+  std::unique_ptr<RowConverter> converter;
+  if (prototype == nullptr) {
+    converter = std::make_unique<ColumnarConverter>();
+  } else {
+    std::vector<const google::protobuf::FieldDescriptor*> fields;
+    const absl::Status status = ResolveFields(
+        header, *prototype->GetDescriptor(), field_mapping,
+        absl::GetFlag(FLAGS_ignore_unknown_columns), fields);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+    converter =
+        std::make_unique<MessageConverter>(prototype, std::move(fields));
+  }
+  const size_t batch_size =
+      IntCast<size_t>(std::max(absl::GetFlag(FLAGS_batch_size), uint64_t{1}));
+  std::vector<std::vector<std::string>> rows;
+  std::vector<int64_t> line_numbers;
+  for (;;) {
+    std::vector<std::string> row;
+    const bool have_row = csv_reader.ReadRecord(row);
+    if (have_row) {
+      if (ABSL_PREDICT_FALSE(row.size() != header.size())) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "At line ", csv_reader.last_line_number(), ": expected ",
+            header.size(), " fields, got ", row.size()));
+      }
+      rows.push_back(std::move(row));
+      line_numbers.push_back(csv_reader.last_line_number());
+    } else if (ABSL_PREDICT_FALSE(!csv_reader.healthy())) {
+      return csv_reader.status();
+    }
+    if (rows.size() >= batch_size || (!have_row && !rows.empty())) {
+      const absl::Status status = ConvertBatch(
+          *converter, *executor, parallelism, rows, line_numbers, dest);
+      if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+      num_records += rows.size();
+      rows.clear();
+      line_numbers.clear();
+    }
+    if (!have_row) break;
+  }
+  if (ABSL_PREDICT_FALSE(!csv_reader.Close())) return csv_reader.status();
+  return absl::OkStatus();
+}
+
+const char kUsage[] =
+    "Usage: csv_to_riegeli --output=FILE (OPTION|FILE)...\n"
+    "\n"
+    "Converts CSV files with a header to a Riegeli/records file. Rows are\n"
+    "converted to messages of --message_type defined in --descriptor_set,\n"
+    "with columns mapped to fields by name, or without --message_type to\n"
+    "messages with a field per column. Parsing, conversion, and encoding run\n"
+    "in parallel.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    absl::Format(&std::cerr, "Missing --output\n");
+    return 1;
+  }
+  if (absl::GetFlag(FLAGS_field_separator).size() != 1) {
+    absl::Format(&std::cerr, "--field_separator must be a single character\n");
+    return 1;
+  }
+  const int parallelism = absl::GetFlag(FLAGS_parallelism);
+  if (parallelism <= 0) {
+    absl::Format(&std::cerr, "--parallelism must be positive\n");
+    return 1;
+  }
+  absl::flat_hash_map<std::string, std::string> field_mapping;
+  {
+    const absl::Status status = riegeli::tools::ParseFieldMapping(
+        absl::GetFlag(FLAGS_field_mapping), field_mapping);
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+  }
+  riegeli::RecordWriterBase::Options record_writer_options;
+  record_writer_options.set_parallelism(parallelism);
+  {
+    const absl::Status status = record_writer_options.FromString(
+        absl::GetFlag(FLAGS_record_writer_options));
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+  }
+  google::protobuf::DescriptorPool pool;
+  google::protobuf::DynamicMessageFactory factory(&pool);
+  const google::protobuf::Message* prototype = nullptr;
+  const std::string message_type = absl::GetFlag(FLAGS_message_type);
+  if (!message_type.empty()) {
+    const std::string descriptor_set_filename =
+        absl::GetFlag(FLAGS_descriptor_set);
+    if (descriptor_set_filename.empty()) {
+      absl::Format(&std::cerr, "--message_type requires --descriptor_set\n");
+      return 1;
+    }
+    google::protobuf::FileDescriptorSet descriptor_set;
+    {
+      const absl::Status status =
+          riegeli::ParseFromReader<riegeli::FdReader<>>(
+              std::forward_as_tuple(descriptor_set_filename, O_RDONLY),
+              descriptor_set);
+      if (!status.ok()) {
+        absl::Format(&std::cerr, "%s: %s\n", descriptor_set_filename,
+                     status.message());
+        return 1;
+      }
+    }
+    for (const google::protobuf::FileDescriptorProto& file :
+         descriptor_set.file()) {
+      if (pool.BuildFile(file) == nullptr) {
+        absl::Format(&std::cerr, "%s: invalid file descriptor %s\n",
+                     descriptor_set_filename, file.name());
+        return 1;
+      }
+    }
+    const google::protobuf::Descriptor* const descriptor =
+        pool.FindMessageTypeByName(message_type);
+    if (descriptor == nullptr) {
+      absl::Format(&std::cerr, "%s: message type %s not found\n",
+                   descriptor_set_filename, message_type);
+      return 1;
+    }
+    prototype = factory.GetPrototype(descriptor);
+    riegeli::RecordsMetadata metadata;
+    riegeli::SetRecordType(*descriptor, metadata);
+    record_writer_options.set_metadata(std::move(metadata));
+  }
+  const std::shared_ptr<riegeli::Executor> executor =
+      std::make_shared<riegeli::Executor>(parallelism);
+  record_writer_options.set_executor(executor);
+  riegeli::RecordWriter<riegeli::FdWriter<>> dest(
+      std::forward_as_tuple(output, O_WRONLY | O_CREAT | O_TRUNC),
+      std::move(record_writer_options));
+  uint64_t num_records = 0;
+  for (size_t i = 1; i < args.size(); ++i) {
+    const absl::Status status = riegeli::tools::ConvertFile(
+        args[i], prototype, field_mapping, executor, dest, num_records);
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s: %s\n", args[i], status.message());
+      return 1;
+    }
+  }
+  if (!dest.Close()) {
+    absl::Format(&std::cerr, "%s\n", dest.status().message());
+    return 1;
+  }
+  absl::Format(&std::cerr, "Converted %u records\n", num_records);
+  return 0;
+}
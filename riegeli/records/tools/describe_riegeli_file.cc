@@ -18,8 +18,10 @@
 
 #include <iostream>
 #include <limits>
+#include <sstream>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "absl/base/optimization.h"
@@ -31,11 +33,16 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/text_format.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/brotli/brotli_dictionary.h"
 #include "riegeli/bytes/chain_backward_writer.h"
 #include "riegeli/bytes/chain_reader.h"
 #include "riegeli/bytes/fd_reader.h"
@@ -43,21 +50,35 @@
 #include "riegeli/bytes/null_backward_writer.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_decoder.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
 #include "riegeli/chunk_encoding/constants.h"
 #include "riegeli/chunk_encoding/decompressor.h"
 #include "riegeli/chunk_encoding/field_projection.h"
 #include "riegeli/chunk_encoding/transpose_decoder.h"
 #include "riegeli/messages/message_parse.h"
+#include "riegeli/records/block.h"
 #include "riegeli/records/chunk_reader.h"
 #include "riegeli/records/records_metadata.pb.h"
 #include "riegeli/records/skipped_region.h"
 #include "riegeli/records/tools/riegeli_summary.pb.h"
 #include "riegeli/varint/varint_reading.h"
+#include "riegeli/zstd/zstd_reader.h"
 
 ABSL_FLAG(bool, show_records_metadata, true,
           "If true, show parsed file metadata.");
 ABSL_FLAG(bool, show_record_sizes, false,
           "If true, show the list of record sizes in each chunk.");
+ABSL_FLAG(bool, show_stats, false,
+          "If true, decode chunks with records, and show sizes and timings of "
+          "decoding them, in each chunk and in total.");
+ABSL_FLAG(bool, headers_only, false,
+          "If true, read only chunk headers, skipping chunk data, and show "
+          "chunk sizes and total counts and sizes. This is much faster, but "
+          "file metadata, record sizes, and timings are not shown.");
+ABSL_FLAG(int, parallelism, 1,
+          "Number of files described concurrently. Reports are shown in the "
+          "order of files.");
 
 namespace riegeli {
 namespace tools {
@@ -77,9 +98,10 @@ absl::Status DescribeFileMetadataChunk(const Chunk& chunk,
       std::forward_as_tuple(), ChainBackwardWriterBase::Options().set_size_hint(
                                    chunk.header.decoded_data_size()));
   std::vector<size_t> limits;
-  const bool ok = transpose_decoder.Decode(1, chunk.header.decoded_data_size(),
-                                           FieldProjection::All(), data_reader,
-                                           serialized_metadata_writer, limits);
+  const bool ok = transpose_decoder.Decode(
+      ChunkType::kTransposed, 1, chunk.header.decoded_data_size(),
+      FieldProjection::All(), ZstdReaderBase::Dictionary(), BrotliDictionary(),
+      data_reader, serialized_metadata_writer, limits);
   if (ABSL_PREDICT_FALSE(!serialized_metadata_writer.Close())) {
     return serialized_metadata_writer.status();
   }
@@ -95,8 +117,9 @@ absl::Status DescribeFileMetadataChunk(const Chunk& chunk,
   return ParseFromChain(serialized_metadata, records_metadata);
 }
 
-absl::Status DescribeSimpleChunk(const Chunk& chunk,
-                                 summary::SimpleChunk& simple_chunk) {
+absl::Status DescribeSimpleChunk(
+    const Chunk& chunk, const ZstdReaderBase::Dictionary& zstd_dictionary,
+    summary::SimpleChunk& simple_chunk) {
   // Based on `SimpleDecoder::Decode()`.
   ChainReader<> chunk_reader(&chunk.data);
 
@@ -121,19 +144,36 @@ absl::Status DescribeSimpleChunk(const Chunk& chunk,
     }
     internal::Decompressor<LimitingReader<>> sizes_decompressor(
         std::forward_as_tuple(&chunk_reader, chunk_reader.pos() + *sizes_size),
-        compression_type);
+        compression_type, zstd_dictionary);
     if (ABSL_PREDICT_FALSE(!sizes_decompressor.healthy())) {
       return sizes_decompressor.status();
     }
+    const bool deduplicated =
+        chunk.header.chunk_type() == ChunkType::kDeduplicated;
     while (IntCast<size_t>(simple_chunk.record_sizes_size()) <
            chunk.header.num_records()) {
-      const absl::optional<uint64_t> size =
-          ReadVarint64(sizes_decompressor.reader());
+      absl::optional<uint64_t> size = ReadVarint64(sizes_decompressor.reader());
       if (ABSL_PREDICT_FALSE(size == absl::nullopt)) {
         sizes_decompressor.reader().Fail(
             absl::InvalidArgumentError("Reading record size failed"));
         return sizes_decompressor.reader().status();
       }
+      if (deduplicated) {
+        if ((*size & 1) == 0) {
+          *size >>= 1;
+        } else {
+          const uint64_t distance = *size >> 1;
+          if (ABSL_PREDICT_FALSE(
+                  distance == 0 ||
+                  distance > IntCast<uint64_t>(
+                                 simple_chunk.record_sizes_size()))) {
+            return absl::InvalidArgumentError(
+                "Invalid reference to a duplicate record");
+          }
+          size = simple_chunk.record_sizes(
+              simple_chunk.record_sizes_size() - IntCast<int>(distance));
+        }
+      }
       simple_chunk.add_record_sizes(*size);
     }
     if (ABSL_PREDICT_FALSE(!sizes_decompressor.VerifyEndAndClose())) {
@@ -144,7 +184,8 @@ absl::Status DescribeSimpleChunk(const Chunk& chunk,
 }
 
 absl::Status DescribeTransposedChunk(
-    const Chunk& chunk, summary::TransposedChunk& transposed_chunk) {
+    const Chunk& chunk, const ZstdReaderBase::Dictionary& zstd_dictionary,
+    summary::TransposedChunk& transposed_chunk) {
   // Based on `TransposeDecoder::Decode()`.
   ChainReader<> chunk_reader(&chunk.data);
 
@@ -162,8 +203,9 @@ absl::Status DescribeTransposedChunk(
     NullBackwardWriter dest_writer(NullBackwardWriter::kInitiallyOpen);
     std::vector<size_t> limits;
     const bool ok = transpose_decoder.Decode(
-        chunk.header.num_records(), chunk.header.decoded_data_size(),
-        FieldProjection::All(), chunk_reader, dest_writer, limits);
+        chunk.header.chunk_type(), chunk.header.num_records(),
+        chunk.header.decoded_data_size(), FieldProjection::All(),
+        zstd_dictionary, BrotliDictionary(), chunk_reader, dest_writer, limits);
     if (ABSL_PREDICT_FALSE(!dest_writer.Close())) return dest_writer.status();
     if (ABSL_PREDICT_FALSE(!ok)) return transpose_decoder.status();
     if (ABSL_PREDICT_FALSE(!chunk_reader.VerifyEndAndClose())) {
@@ -181,7 +223,35 @@ absl::Status DescribeTransposedChunk(
   return absl::OkStatus();
 }
 
-void DescribeFile(absl::string_view filename, std::ostream& report) {
+void DescribeStats(const ChunkStats& stats,
+                   summary::ChunkStats& stats_summary) {
+  stats_summary.set_num_chunks(stats.num_chunks);
+  stats_summary.set_num_records(stats.num_records);
+  stats_summary.set_decoded_data_size(stats.decoded_data_size);
+  stats_summary.set_encoded_data_size(stats.encoded_data_size);
+  // Timings are not known if only chunk headers were read.
+  if (stats.decode_time != absl::ZeroDuration()) {
+    stats_summary.set_decode_seconds(absl::ToDoubleSeconds(stats.decode_time));
+    stats_summary.set_decompress_seconds(
+        absl::ToDoubleSeconds(stats.decompress_time));
+  }
+}
+
+// Reads the header of the next chunk into `chunk.header`, and skips chunk data
+// using the block layout.
+bool ReadChunkHeader(ChunkReader& chunk_reader, Chunk& chunk) {
+  const Position chunk_begin = chunk_reader.pos();
+  const ChunkHeader* chunk_header;
+  if (ABSL_PREDICT_FALSE(!chunk_reader.PullChunkHeader(&chunk_header))) {
+    return false;
+  }
+  chunk.header = *chunk_header;
+  return chunk_reader.Seek(
+      internal::ChunkEnd(chunk.header, chunk_begin, chunk_reader.block_size()));
+}
+
+void DescribeFile(absl::string_view filename, std::ostream& report,
+                  std::ostream& errors) {
   absl::Format(&report,
                "file {\n"
                "  filename: \"%s\"\n",
@@ -196,14 +266,19 @@ void DescribeFile(absl::string_view filename, std::ostream& report) {
   printer.SetInitialIndentLevel(2);
   printer.SetUseShortRepeatedPrimitives(true);
   printer.SetUseUtf8StringEscaping(true);
+  const bool headers_only = absl::GetFlag(FLAGS_headers_only);
+  ZstdReaderBase::Dictionary zstd_dictionary;
+  ChunkStats total_stats;
   for (;;) {
     report.flush();
     const Position chunk_begin = chunk_reader.pos();
     Chunk chunk;
-    if (ABSL_PREDICT_FALSE(!chunk_reader.ReadChunk(chunk))) {
+    if (ABSL_PREDICT_FALSE(!(headers_only
+                                 ? ReadChunkHeader(chunk_reader, chunk)
+                                 : chunk_reader.ReadChunk(chunk)))) {
       SkippedRegion skipped_region;
       if (chunk_reader.Recover(&skipped_region)) {
-        absl::Format(&std::cerr, "%s\n", skipped_region.message());
+        absl::Format(&errors, "%s\n", skipped_region.message());
         continue;
       }
       break;
@@ -215,28 +290,59 @@ void DescribeFile(absl::string_view filename, std::ostream& report) {
     chunk_summary.set_data_size(chunk.header.data_size());
     chunk_summary.set_num_records(chunk.header.num_records());
     chunk_summary.set_decoded_data_size(chunk.header.decoded_data_size());
-    {
+    if (headers_only) {
+      if (chunk.header.num_records() > 0) {
+        ++total_stats.num_chunks;
+        total_stats.num_records += chunk.header.num_records();
+        total_stats.decoded_data_size += chunk.header.decoded_data_size();
+        total_stats.encoded_data_size += chunk.header.data_size();
+      }
+    } else {
       absl::Status status;
       switch (chunk.header.chunk_type()) {
-        case ChunkType::kFileMetadata:
-          if (absl::GetFlag(FLAGS_show_records_metadata)) {
-            status = DescribeFileMetadataChunk(
-                chunk, *chunk_summary.mutable_file_metadata_chunk());
+        case ChunkType::kFileMetadata: {
+          // The metadata are parsed even if not shown, because they can hold
+          // the Zstd dictionary needed for the remaining chunks.
+          RecordsMetadata& records_metadata =
+              *chunk_summary.mutable_file_metadata_chunk();
+          status = DescribeFileMetadataChunk(chunk, records_metadata);
+          if (records_metadata.has_zstd_dictionary()) {
+            zstd_dictionary.set_data(
+                std::move(*records_metadata.mutable_zstd_dictionary()));
+            records_metadata.clear_zstd_dictionary();
+          }
+          if (!absl::GetFlag(FLAGS_show_records_metadata)) {
+            chunk_summary.clear_file_metadata_chunk();
           }
           break;
+        }
         case ChunkType::kSimple:
-          status =
-              DescribeSimpleChunk(chunk, *chunk_summary.mutable_simple_chunk());
+        case ChunkType::kDeduplicated:
+          status = DescribeSimpleChunk(chunk, zstd_dictionary,
+                                       *chunk_summary.mutable_simple_chunk());
           break;
         case ChunkType::kTransposed:
+        case ChunkType::kTransposedV2:
           status = DescribeTransposedChunk(
-              chunk, *chunk_summary.mutable_transposed_chunk());
+              chunk, zstd_dictionary,
+              *chunk_summary.mutable_transposed_chunk());
           break;
         default:
           break;
       }
       if (ABSL_PREDICT_FALSE(!status.ok())) {
-        absl::Format(&std::cerr, "%s\n", status.message());
+        absl::Format(&errors, "%s\n", status.message());
+      }
+    }
+    if (absl::GetFlag(FLAGS_show_stats) && !headers_only &&
+        chunk.header.num_records() > 0) {
+      ChunkDecoder chunk_decoder(
+          ChunkDecoder::Options().set_zstd_dictionary(zstd_dictionary));
+      if (ABSL_PREDICT_FALSE(!chunk_decoder.Decode(chunk))) {
+        absl::Format(&errors, "%s\n", chunk_decoder.status().message());
+      } else {
+        total_stats += chunk_decoder.stats();
+        DescribeStats(chunk_decoder.stats(), *chunk_summary.mutable_stats());
       }
     }
     absl::Format(&report, "  chunk {\n");
@@ -244,11 +350,66 @@ void DescribeFile(absl::string_view filename, std::ostream& report) {
     printer.Print(chunk_summary, &proto_out);
     absl::Format(&report, "  }\n");
   }
+  if (absl::GetFlag(FLAGS_show_stats) || headers_only) {
+    summary::ChunkStats stats_summary;
+    DescribeStats(total_stats, stats_summary);
+    absl::Format(&report, "  stats {\n");
+    google::protobuf::io::OstreamOutputStream proto_out(&report);
+    printer.Print(stats_summary, &proto_out);
+    absl::Format(&report, "  }\n");
+  }
   absl::Format(&report, "}\n");
   report.flush();
   if (!chunk_reader.Close()) {
-    absl::Format(&std::cerr, "%s\n", chunk_reader.status().message());
+    absl::Format(&errors, "%s\n", chunk_reader.status().message());
+  }
+}
+
+// Describes files concurrently, and writes their reports in the order of
+// files, each one as soon as it and the preceding ones are ready.
+void DescribeFilesInParallel(const std::vector<char*>& filenames,
+                             int parallelism) {
+  struct Result {
+    bool done = false;
+    std::string report;
+    std::string errors;
+  };
+  absl::Mutex mutex;
+  size_t next_file = 0;
+  std::vector<Result> results(filenames.size());
+  const size_t num_workers =
+      UnsignedMin(filenames.size(), IntCast<size_t>(parallelism));
+  absl::BlockingCounter running_workers(IntCast<int>(num_workers));
+  for (size_t i = 0; i < num_workers; ++i) {
+    internal::ThreadPool::global().Schedule([&] {
+      for (;;) {
+        size_t file_index;
+        {
+          absl::MutexLock lock(&mutex);
+          if (next_file == filenames.size()) break;
+          file_index = next_file++;
+        }
+        std::ostringstream report;
+        std::ostringstream errors;
+        DescribeFile(filenames[file_index], report, errors);
+        absl::MutexLock lock(&mutex);
+        results[file_index].report = report.str();
+        results[file_index].errors = errors.str();
+        results[file_index].done = true;
+      }
+      running_workers.DecrementCount();
+    });
   }
+  for (Result& result : results) {
+    mutex.LockWhen(absl::Condition(&result.done));
+    const std::string report = std::move(result.report);
+    const std::string errors = std::move(result.errors);
+    mutex.Unlock();
+    std::cerr << errors;
+    std::cout << report;
+    std::cout.flush();
+  }
+  running_workers.Wait();
 }
 
 const char kUsage[] =
@@ -263,7 +424,13 @@ const char kUsage[] =
 int main(int argc, char** argv) {
   absl::SetProgramUsageMessage(riegeli::tools::kUsage);
   const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const int parallelism = absl::GetFlag(FLAGS_parallelism);
+  if (parallelism > 1) {
+    riegeli::tools::DescribeFilesInParallel(
+        std::vector<char*>(args.begin() + 1, args.end()), parallelism);
+    return 0;
+  }
   for (size_t i = 1; i < args.size(); ++i) {
-    riegeli::tools::DescribeFile(args[i], std::cout);
+    riegeli::tools::DescribeFile(args[i], std::cout, std::cerr);
   }
 }
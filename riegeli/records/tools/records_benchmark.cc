@@ -19,10 +19,12 @@
 #include <fcntl.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <array>
@@ -31,6 +33,7 @@
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <random>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -44,16 +47,28 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/compare.h"
+#include "absl/types/optional.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/errno_mapping.h"
 #include "riegeli/base/options_parser.h"
 #include "riegeli/bytes/fd_reader.h"
 #include "riegeli/bytes/fd_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/chunk_stats.h"
 #include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/record_position.h"
 #include "riegeli/records/record_reader.h"
 #include "riegeli/records/record_writer.h"
+#include "riegeli/records/records_observer.h"
 #include "riegeli/records/tools/tfrecord_recognizer.h"
 #include "riegeli/varint/varint_writing.h"
 #include "tensorflow/core/lib/io/compression.h"
@@ -88,6 +103,25 @@ ABSL_FLAG(uint64_t, max_size, uint64_t{100} * 1000 * 1000,
 ABSL_FLAG(std::string, output_dir, "/tmp",
           "Directory to write files to (files are named record_benchmark_*)");
 ABSL_FLAG(int32_t, repetitions, 5, "Number of times to repeat each benchmark");
+ABSL_FLAG(std::string, output_format, "text",
+          "Format of the report: \"text\" (a table for humans), \"json\", or "
+          "\"csv\". Machine-readable formats include CPU and real time, peak "
+          "RSS, and time spent in stages of Riegeli benchmarks.");
+ABSL_FLAG(int32_t, random_access_lookups, 0,
+          "If positive, instead of sequential throughput, measure p50, p99, "
+          "and p999 latency of this many random lookups of each kind "
+          "(Seek(Position), Seek(RecordPosition), SeekBack(), Search()) in "
+          "files written by Riegeli benchmarks, with FdReader and "
+          "FdMMapReader, with a warm and a cold page cache.");
+ABSL_FLAG(std::string, parallelism_sweep, "",
+          "Whitespace-separated values of parallelism. Each Riegeli benchmark "
+          "not specifying parallelism is run with each of them.");
+ABSL_FLAG(std::string, chunk_size_sweep, "",
+          "Whitespace-separated values of chunk_size. Each Riegeli benchmark "
+          "not specifying chunk_size is run with each of them.");
+ABSL_FLAG(std::string, bucket_fraction_sweep, "",
+          "Whitespace-separated values of bucket_fraction. Each Riegeli "
+          "benchmark not specifying bucket_fraction is run with each of them.");
 
 namespace {
 
@@ -138,6 +172,37 @@ uint64_t RealTimeNow_ns() {
          riegeli::IntCast<uint64_t>(time_info.tv_nsec);
 }
 
+// Peak resident set size is read from `VmHWM` in /proc/self/status, which can
+// be reset by writing "5" to /proc/self/clear_refs. If that is not supported,
+// the peak since the program started is reported.
+void ResetPeakRss() {
+  const int fd = open("/proc/self/clear_refs", O_WRONLY);
+  if (fd < 0) return;
+  if (write(fd, "5", 1) < 0) {
+    // Not supported, ignore.
+  }
+  close(fd);
+}
+
+uint64_t PeakRss_bytes() {
+  riegeli::FdReader<> status_reader("/proc/self/status", O_RDONLY);
+  std::string status;
+  if (status_reader.ReadAll(status) && status_reader.Close()) {
+    for (absl::string_view line : absl::StrSplit(status, '\n')) {
+      if (!absl::ConsumePrefix(&line, "VmHWM:")) continue;
+      line = absl::StripAsciiWhitespace(line);
+      uint64_t peak_rss_kb;
+      if (absl::ConsumeSuffix(&line, " kB") &&
+          absl::SimpleAtoi(line, &peak_rss_kb)) {
+        return peak_rss_kb * 1024;
+      }
+    }
+  }
+  struct rusage usage_info;
+  RIEGELI_CHECK_EQ(getrusage(RUSAGE_SELF, &usage_info), 0);
+  return riegeli::IntCast<uint64_t>(usage_info.ru_maxrss) * 1024;
+}
+
 class Stats {
  public:
   void Add(double value);
@@ -159,6 +224,210 @@ double Stats::Median() {
   return samples_[middle];
 }
 
+// Times spent in stages of writing (encode, compress, write) or reading (read,
+// decompress, decode). Encoding excludes compression, and decoding excludes
+// decompression.
+using StageTimes = std::array<absl::Duration, 3>;
+
+constexpr std::array<const char*, 3> kWriteStageNames = {
+    {"encode", "compress", "write"}};
+constexpr std::array<const char*, 3> kReadStageNames = {
+    {"read", "decompress", "decode"}};
+
+// Accumulates `StageTimes` of a `RecordWriter` or `RecordReader`, summed over
+// threads which processed chunks.
+class StageTimer : public riegeli::RecordsObserver {
+ public:
+  void OnChunkEncoded(const riegeli::ChunkHeader& header,
+                      const riegeli::ChunkStats& stats) override;
+  void OnChunkWritten(riegeli::Position chunk_begin,
+                      const riegeli::ChunkHeader& header,
+                      absl::Duration write_time) override;
+  void OnChunkRead(riegeli::Position chunk_begin,
+                   const riegeli::ChunkHeader& header,
+                   absl::Duration read_time) override;
+  void OnChunkDecoded(riegeli::Position chunk_begin,
+                      const riegeli::ChunkStats& stats) override;
+
+  StageTimes write_times() const;
+  StageTimes read_times() const;
+
+ private:
+  mutable absl::Mutex mutex_;
+  StageTimes write_times_ ABSL_GUARDED_BY(mutex_);
+  StageTimes read_times_ ABSL_GUARDED_BY(mutex_);
+};
+
+void StageTimer::OnChunkEncoded(const riegeli::ChunkHeader& header,
+                                const riegeli::ChunkStats& stats) {
+  absl::MutexLock lock(&mutex_);
+  write_times_[0] += stats.encode_time - stats.compress_time;
+  write_times_[1] += stats.compress_time;
+}
+
+void StageTimer::OnChunkWritten(riegeli::Position chunk_begin,
+                                const riegeli::ChunkHeader& header,
+                                absl::Duration write_time) {
+  absl::MutexLock lock(&mutex_);
+  write_times_[2] += write_time;
+}
+
+void StageTimer::OnChunkRead(riegeli::Position chunk_begin,
+                             const riegeli::ChunkHeader& header,
+                             absl::Duration read_time) {
+  absl::MutexLock lock(&mutex_);
+  read_times_[0] += read_time;
+}
+
+void StageTimer::OnChunkDecoded(riegeli::Position chunk_begin,
+                                const riegeli::ChunkStats& stats) {
+  absl::MutexLock lock(&mutex_);
+  read_times_[1] += stats.decompress_time;
+  read_times_[2] += stats.decode_time - stats.decompress_time;
+}
+
+StageTimes StageTimer::write_times() const {
+  absl::MutexLock lock(&mutex_);
+  return write_times_;
+}
+
+StageTimes StageTimer::read_times() const {
+  absl::MutexLock lock(&mutex_);
+  return read_times_;
+}
+
+// Medians of measurements of writing or reading over repetitions.
+struct PhaseResult {
+  double cpu_seconds = 0.0;
+  double real_seconds = 0.0;
+  double cpu_speed = 0.0;   // MB/s
+  double real_speed = 0.0;  // MB/s
+  // Maximum over repetitions.
+  uint64_t peak_rss = 0;
+  bool has_stages = false;
+  std::array<double, 3> stage_seconds = {};
+};
+
+class PhaseStats {
+ public:
+  explicit PhaseStats(size_t size) : size_(size) {}
+
+  // `stage_times` may be `nullptr` if stages are not measured.
+  void Add(uint64_t cpu_time_ns, uint64_t real_time_ns, uint64_t peak_rss,
+           const StageTimes* stage_times);
+
+  PhaseResult Result();
+
+ private:
+  size_t size_;
+  Stats cpu_seconds_;
+  Stats real_seconds_;
+  Stats cpu_speed_;
+  Stats real_speed_;
+  uint64_t peak_rss_ = 0;
+  bool has_stages_ = false;
+  std::array<Stats, 3> stage_seconds_;
+};
+
+void PhaseStats::Add(uint64_t cpu_time_ns, uint64_t real_time_ns,
+                     uint64_t peak_rss, const StageTimes* stage_times) {
+  cpu_seconds_.Add(static_cast<double>(cpu_time_ns) / 1e9);
+  real_seconds_.Add(static_cast<double>(real_time_ns) / 1e9);
+  cpu_speed_.Add(static_cast<double>(size_) /
+                 static_cast<double>(cpu_time_ns) * 1000.0);
+  real_speed_.Add(static_cast<double>(size_) /
+                  static_cast<double>(real_time_ns) * 1000.0);
+  peak_rss_ = std::max(peak_rss_, peak_rss);
+  if (stage_times != nullptr) {
+    has_stages_ = true;
+    for (size_t stage = 0; stage < stage_times->size(); ++stage) {
+      stage_seconds_[stage].Add(absl::ToDoubleSeconds((*stage_times)[stage]));
+    }
+  }
+}
+
+PhaseResult PhaseStats::Result() {
+  PhaseResult result;
+  result.cpu_seconds = cpu_seconds_.Median();
+  result.real_seconds = real_seconds_.Median();
+  result.cpu_speed = cpu_speed_.Median();
+  result.real_speed = real_speed_.Median();
+  result.peak_rss = peak_rss_;
+  result.has_stages = has_stages_;
+  if (has_stages_) {
+    for (size_t stage = 0; stage < stage_seconds_.size(); ++stage) {
+      result.stage_seconds[stage] = stage_seconds_[stage].Median();
+    }
+  }
+  return result;
+}
+
+struct BenchmarkResult {
+  std::string name;
+  // Compressed size as percentage of the original size.
+  double compression = 0.0;
+  PhaseResult write;
+  PhaseResult read;
+};
+
+enum class OutputFormat { kText, kJson, kCsv };
+
+// Returns `text` quoted as a JSON string. Names of benchmarks do not contain
+// control characters.
+std::string JsonString(absl::string_view text) {
+  std::string quoted = "\"";
+  for (const char ch : text) {
+    if (ch == '"' || ch == '\\') quoted.push_back('\\');
+    quoted.push_back(ch);
+  }
+  quoted.push_back('"');
+  return quoted;
+}
+
+// Returns `text` quoted as a CSV field.
+std::string CsvString(absl::string_view text) {
+  std::string quoted = "\"";
+  for (const char ch : text) {
+    if (ch == '"') quoted.push_back('"');
+    quoted.push_back(ch);
+  }
+  quoted.push_back('"');
+  return quoted;
+}
+
+void WriteJsonPhase(const PhaseResult& result,
+                    const std::array<const char*, 3>& stage_names,
+                    std::ostream& report) {
+  absl::Format(&report,
+               "{\"cpu_seconds\": %.6f, \"real_seconds\": %.6f, "
+               "\"cpu_mb_per_s\": %.3f, \"real_mb_per_s\": %.3f, "
+               "\"peak_rss_bytes\": %u",
+               result.cpu_seconds, result.real_seconds, result.cpu_speed,
+               result.real_speed, result.peak_rss);
+  if (result.has_stages) {
+    absl::Format(&report, ", \"stage_seconds\": {");
+    for (size_t stage = 0; stage < stage_names.size(); ++stage) {
+      absl::Format(&report, "%s\"%s\": %.6f", stage == 0 ? "" : ", ",
+                   stage_names[stage], result.stage_seconds[stage]);
+    }
+    absl::Format(&report, "}");
+  }
+  absl::Format(&report, "}");
+}
+
+void WriteCsvPhase(const PhaseResult& result, std::ostream& report) {
+  absl::Format(&report, ",%.6f,%.6f,%.3f,%.3f,%u", result.cpu_seconds,
+               result.real_seconds, result.cpu_speed, result.real_speed,
+               result.peak_rss);
+  for (const double stage_seconds : result.stage_seconds) {
+    if (result.has_stages) {
+      absl::Format(&report, ",%.6f", stage_seconds);
+    } else {
+      absl::Format(&report, ",");
+    }
+  }
+}
+
 class Benchmarks {
  public:
   static bool ReadFile(absl::string_view filename,
@@ -171,7 +440,12 @@ class Benchmarks {
   void RegisterTFRecord(absl::string_view tfrecord_options);
   void RegisterRiegeli(absl::string_view riegeli_options);
 
-  void RunAll(std::ostream& report);
+  void RunAll(OutputFormat output_format, std::ostream& report);
+
+  // Measures latency of random access lookups in files written by registered
+  // Riegeli benchmarks, doing `num_lookups` lookups of each kind.
+  void RunRandomAccess(int num_lookups, OutputFormat output_format,
+                       std::ostream& report);
 
  private:
   static void WriteTFRecord(
@@ -192,14 +466,24 @@ class Benchmarks {
       riegeli::RecordReaderBase::Options record_reader_options,
       std::vector<std::string>* records, SizeLimiter* size_limiter = nullptr);
 
-  void RunOne(
-      absl::string_view name,
-      absl::FunctionRef<void(absl::string_view,
-                             const std::vector<std::string>&)>
+  // If `measure_stages`, `write_records` and `read_records` receive a
+  // `StageTimer` to be set as the observer, otherwise `nullptr`.
+  BenchmarkResult RunOne(
+      absl::string_view name, bool measure_stages,
+      absl::FunctionRef<void(absl::string_view, const std::vector<std::string>&,
+                             const std::shared_ptr<StageTimer>&)>
           write_records,
-      absl::FunctionRef<void(absl::string_view, std::vector<std::string>*)>
-          read_records,
-      std::ostream& report);
+      absl::FunctionRef<void(absl::string_view, std::vector<std::string>*,
+                             const std::shared_ptr<StageTimer>&)>
+          read_records);
+
+  void WriteTextHeader(std::ostream& report) const;
+  static void WriteTextResult(const BenchmarkResult& result,
+                              std::ostream& report);
+  void WriteJson(const std::vector<BenchmarkResult>& results,
+                 std::ostream& report) const;
+  static void WriteCsv(const std::vector<BenchmarkResult>& results,
+                       std::ostream& report);
 
   static std::string Filename(absl::string_view name);
 
@@ -390,78 +674,96 @@ void Benchmarks::RegisterRiegeli(absl::string_view riegeli_options) {
   riegeli_benchmarks_.emplace_back(riegeli_options, std::move(options));
 }
 
-void Benchmarks::RunAll(std::ostream& report) {
-  absl::Format(&report, "Original uncompressed size: %.3f MB\n",
-               static_cast<double>(original_size_) / 1000000.0);
-  absl::Format(&report, "Creating files %s/record_benchmark_*\n", output_dir_);
-  absl::Format(&report, "%-*s  Compr.    Write       Read\n", max_name_width_,
-               "");
-  absl::Format(&report, "%-*s  ratio    CPU Real   CPU Real\n", max_name_width_,
-               "");
-  absl::Format(&report, "%-*s    %%     MB/s MB/s  MB/s MB/s\n",
-               max_name_width_, "Format");
-  absl::Format(
-      &report, "%s\n",
-      std::string(riegeli::IntCast<size_t>(max_name_width_ + 30), '-'));
+void Benchmarks::RunAll(OutputFormat output_format, std::ostream& report) {
+  if (output_format == OutputFormat::kText) WriteTextHeader(report);
+  std::vector<BenchmarkResult> results;
+  const auto run = [&](absl::string_view name, bool measure_stages,
+                       auto write_records, auto read_records) {
+    if (output_format == OutputFormat::kText) {
+      absl::Format(&report, "%-*s ", max_name_width_, name);
+      report.flush();
+    }
+    results.push_back(
+        RunOne(name, measure_stages, write_records, read_records));
+    if (output_format == OutputFormat::kText) {
+      WriteTextResult(results.back(), report);
+    }
+  };
 
   for (const std::pair<std::string, const char*>& tfrecord_options :
        tfrecord_benchmarks_) {
-    RunOne(
-        absl::StrCat("tfrecord ", tfrecord_options.first),
-        [&](absl::string_view filename,
-            const std::vector<std::string>& records) {
+    run(
+        absl::StrCat("tfrecord ", tfrecord_options.first), false,
+        [&](absl::string_view filename, const std::vector<std::string>& records,
+            const std::shared_ptr<StageTimer>& stage_timer) {
           WriteTFRecord(
               filename,
               tensorflow::io::RecordWriterOptions::CreateRecordWriterOptions(
                   tfrecord_options.second),
               records);
         },
-        [&](absl::string_view filename, std::vector<std::string>* records) {
+        [&](absl::string_view filename, std::vector<std::string>* records,
+            const std::shared_ptr<StageTimer>& stage_timer) {
           return ReadTFRecord(
               filename,
               tensorflow::io::RecordReaderOptions::CreateRecordReaderOptions(
                   tfrecord_options.second),
               records);
-        },
-        report);
+        });
   }
   for (const std::pair<std::string, riegeli::RecordWriterBase::Options>&
            riegeli_options : riegeli_benchmarks_) {
-    RunOne(
-        absl::StrCat("riegeli ", riegeli_options.first),
-        [&](absl::string_view filename,
-            const std::vector<std::string>& records) {
-          WriteRiegeli(filename, riegeli_options.second, records);
-        },
-        [&](absl::string_view filename, std::vector<std::string>* records) {
-          return ReadRiegeli(filename, riegeli::RecordReaderBase::Options(),
-                             records);
+    run(
+        absl::StrCat("riegeli ", riegeli_options.first), true,
+        [&](absl::string_view filename, const std::vector<std::string>& records,
+            const std::shared_ptr<StageTimer>& stage_timer) {
+          riegeli::RecordWriterBase::Options record_writer_options =
+              riegeli_options.second;
+          record_writer_options.set_observer(stage_timer);
+          WriteRiegeli(filename, std::move(record_writer_options), records);
         },
-        report);
+        [&](absl::string_view filename, std::vector<std::string>* records,
+            const std::shared_ptr<StageTimer>& stage_timer) {
+          return ReadRiegeli(
+              filename,
+              riegeli::RecordReaderBase::Options().set_observer(stage_timer),
+              records);
+        });
+  }
+
+  switch (output_format) {
+    case OutputFormat::kText:
+      break;
+    case OutputFormat::kJson:
+      WriteJson(results, report);
+      break;
+    case OutputFormat::kCsv:
+      WriteCsv(results, report);
+      break;
   }
 }
 
-void Benchmarks::RunOne(
-    absl::string_view name,
-    absl::FunctionRef<void(absl::string_view, const std::vector<std::string>&)>
+BenchmarkResult Benchmarks::RunOne(
+    absl::string_view name, bool measure_stages,
+    absl::FunctionRef<void(absl::string_view, const std::vector<std::string>&,
+                           const std::shared_ptr<StageTimer>&)>
         write_records,
-    absl::FunctionRef<void(absl::string_view, std::vector<std::string>*)>
-        read_records,
-    std::ostream& report) {
-  absl::Format(&report, "%-*s ", max_name_width_, name);
-  report.flush();
+    absl::FunctionRef<void(absl::string_view, std::vector<std::string>*,
+                           const std::shared_ptr<StageTimer>&)>
+        read_records) {
   const std::string filename =
       absl::StrCat(output_dir_, "/record_benchmark_", Filename(name));
 
   Stats compression;
-  Stats writing_cpu_speed;
-  Stats writing_real_speed;
-  Stats reading_cpu_speed;
-  Stats reading_real_speed;
+  PhaseStats writing(original_size_);
+  PhaseStats reading(original_size_);
   for (int i = 0; i < repetitions_ + 1; ++i) {
+    const std::shared_ptr<StageTimer> stage_timer =
+        measure_stages ? std::make_shared<StageTimer>() : nullptr;
+    ResetPeakRss();
     const uint64_t cpu_time_before_ns = CpuTimeNow_ns();
     const uint64_t real_time_before_ns = RealTimeNow_ns();
-    write_records(filename, records_);
+    write_records(filename, records_, stage_timer);
     const uint64_t cpu_time_after_ns = CpuTimeNow_ns();
     const uint64_t real_time_after_ns = RealTimeNow_ns();
     if (i == 0) {
@@ -469,20 +771,21 @@ void Benchmarks::RunOne(
     } else {
       compression.Add(static_cast<double>(FileSize(filename)) /
                       static_cast<double>(original_size_) * 100.0);
-      writing_cpu_speed.Add(
-          static_cast<double>(original_size_) /
-          static_cast<double>(cpu_time_after_ns - cpu_time_before_ns) * 1000.0);
-      writing_real_speed.Add(
-          static_cast<double>(original_size_) /
-          static_cast<double>(real_time_after_ns - real_time_before_ns) *
-          1000.0);
+      const StageTimes stage_times =
+          measure_stages ? stage_timer->write_times() : StageTimes();
+      writing.Add(cpu_time_after_ns - cpu_time_before_ns,
+                  real_time_after_ns - real_time_before_ns, PeakRss_bytes(),
+                  measure_stages ? &stage_times : nullptr);
     }
   }
   for (int i = 0; i < repetitions_ + 1; ++i) {
     std::vector<std::string> decoded_records;
+    const std::shared_ptr<StageTimer> stage_timer =
+        measure_stages ? std::make_shared<StageTimer>() : nullptr;
+    ResetPeakRss();
     const uint64_t cpu_time_before_ns = CpuTimeNow_ns();
     const uint64_t real_time_before_ns = RealTimeNow_ns();
-    read_records(filename, &decoded_records);
+    read_records(filename, &decoded_records, stage_timer);
     const uint64_t cpu_time_after_ns = CpuTimeNow_ns();
     const uint64_t real_time_after_ns = RealTimeNow_ns();
     if (i == 0) {
@@ -490,32 +793,347 @@ void Benchmarks::RunOne(
       RIEGELI_CHECK(decoded_records == records_)
           << "Decoded records do not match for " << name;
     } else {
-      reading_cpu_speed.Add(
-          static_cast<double>(original_size_) /
-          static_cast<double>(cpu_time_after_ns - cpu_time_before_ns) * 1000.0);
-      reading_real_speed.Add(
-          static_cast<double>(original_size_) /
-          static_cast<double>(real_time_after_ns - real_time_before_ns) *
-          1000.0);
+      const StageTimes stage_times =
+          measure_stages ? stage_timer->read_times() : StageTimes();
+      reading.Add(cpu_time_after_ns - cpu_time_before_ns,
+                  real_time_after_ns - real_time_before_ns, PeakRss_bytes(),
+                  measure_stages ? &stage_times : nullptr);
     }
   }
 
-  absl::Format(&report, "%7.3f", compression.Median());
-  for (const std::array<Stats*, 2>& stats_cpu_real :
-       {std::array<Stats*, 2>{{&writing_cpu_speed, &writing_real_speed}},
-        std::array<Stats*, 2>{{&reading_cpu_speed, &reading_real_speed}}}) {
+  BenchmarkResult result;
+  result.name = std::string(name);
+  result.compression = compression.Median();
+  result.write = writing.Result();
+  result.read = reading.Result();
+  return result;
+}
+
+void Benchmarks::WriteTextHeader(std::ostream& report) const {
+  absl::Format(&report, "Original uncompressed size: %.3f MB\n",
+               static_cast<double>(original_size_) / 1000000.0);
+  absl::Format(&report, "Creating files %s/record_benchmark_*\n", output_dir_);
+  absl::Format(&report, "%-*s  Compr.    Write       Read\n", max_name_width_,
+               "");
+  absl::Format(&report, "%-*s  ratio    CPU Real   CPU Real\n", max_name_width_,
+               "");
+  absl::Format(&report, "%-*s    %%     MB/s MB/s  MB/s MB/s\n",
+               max_name_width_, "Format");
+  absl::Format(
+      &report, "%s\n",
+      std::string(riegeli::IntCast<size_t>(max_name_width_ + 30), '-'));
+}
+
+void Benchmarks::WriteTextResult(const BenchmarkResult& result,
+                                 std::ostream& report) {
+  absl::Format(&report, "%7.3f", result.compression);
+  for (const PhaseResult* const phase : {&result.write, &result.read}) {
     absl::Format(&report, " ");
-    for (Stats* const stats : stats_cpu_real) {
-      absl::Format(&report, " %4.0f", stats->Median());
+    absl::Format(&report, " %4.0f %4.0f", phase->cpu_speed, phase->real_speed);
+  }
+  absl::Format(&report, "\n");
+}
+
+void Benchmarks::WriteJson(const std::vector<BenchmarkResult>& results,
+                           std::ostream& report) const {
+  absl::Format(&report,
+               "{\"original_size_bytes\": %u, \"repetitions\": %d, "
+               "\"benchmarks\": [",
+               original_size_, repetitions_);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchmarkResult& result = results[i];
+    absl::Format(&report,
+                 "%s\n  {\"name\": %s, \"compression_percent\": %.3f, "
+                 "\"write\": ",
+                 i == 0 ? "" : ",", JsonString(result.name),
+                 result.compression);
+    WriteJsonPhase(result.write, kWriteStageNames, report);
+    absl::Format(&report, ", \"read\": ");
+    WriteJsonPhase(result.read, kReadStageNames, report);
+    absl::Format(&report, "}");
+  }
+  absl::Format(&report, "\n]}\n");
+}
+
+void Benchmarks::WriteCsv(const std::vector<BenchmarkResult>& results,
+                          std::ostream& report) {
+  absl::Format(&report, "name,compression_percent");
+  for (const std::pair<const char*, const std::array<const char*, 3>*>& phase :
+       {std::make_pair("write", &kWriteStageNames),
+        std::make_pair("read", &kReadStageNames)}) {
+    absl::Format(&report,
+                 ",%1$s_cpu_seconds,%1$s_real_seconds,%1$s_cpu_mb_per_s,"
+                 "%1$s_real_mb_per_s,%1$s_peak_rss_bytes",
+                 phase.first);
+    for (const char* const stage_name : *phase.second) {
+      absl::Format(&report, ",%s_seconds", stage_name);
     }
   }
   absl::Format(&report, "\n");
+  for (const BenchmarkResult& result : results) {
+    absl::Format(&report, "%s,%.3f", CsvString(result.name),
+                 result.compression);
+    WriteCsvPhase(result.write, report);
+    WriteCsvPhase(result.read, report);
+    absl::Format(&report, "\n");
+  }
+}
+
+// Evicts `filename` from the page cache, so that reading it again is cold.
+// Pages kept by a live memory mapping are not evicted.
+void DropPageCache(absl::string_view filename) {
+  const int fd = open(std::string(filename).c_str(), O_RDONLY);
+  RIEGELI_CHECK_GE(fd, 0)
+      << riegeli::ErrnoToCanonicalStatus(errno, "open() failed").message();
+  // Dirty pages are not evicted, so write them first.
+  RIEGELI_CHECK_EQ(fsync(fd), 0)
+      << riegeli::ErrnoToCanonicalStatus(errno, "fsync() failed").message();
+  RIEGELI_CHECK_EQ(posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED), 0);
+  close(fd);
+}
+
+// Kinds of random access lookups, each followed by reading a record.
+enum class Lookup { kSeekPosition, kSeekRecordPosition, kSeekBack, kSearch };
+
+constexpr std::array<Lookup, 4> kLookups = {
+    {Lookup::kSeekPosition, Lookup::kSeekRecordPosition, Lookup::kSeekBack,
+     Lookup::kSearch}};
+
+const char* LookupName(Lookup lookup) {
+  switch (lookup) {
+    case Lookup::kSeekPosition:
+      return "Seek(Position)";
+    case Lookup::kSeekRecordPosition:
+      return "Seek(RecordPosition)";
+    case Lookup::kSeekBack:
+      return "SeekBack()";
+    case Lookup::kSearch:
+      return "Search()";
+  }
+  RIEGELI_ASSERT_UNREACHABLE()
+      << "Unknown lookup: " << static_cast<int>(lookup);
+}
+
+// Latency percentiles of one kind of lookups.
+struct LatencyResult {
+  std::string name;
+  const char* reader;
+  const char* cache;
+  const char* lookup;
+  size_t num_lookups = 0;
+  double p50_us = 0.0;
+  double p99_us = 0.0;
+  double p999_us = 0.0;
+};
+
+// Returns the `fraction` percentile of `samples`, which must be sorted.
+double Percentile(const std::vector<double>& samples, double fraction) {
+  RIEGELI_CHECK(!samples.empty()) << "No data";
+  return samples[std::min(
+      samples.size() - 1,
+      static_cast<size_t>(fraction * static_cast<double>(samples.size())))];
+}
+
+// Measures latencies of `num_lookups` random lookups of each kind in
+// `filename`, in microseconds, reading it with a `RecordReader<Src>`.
+//
+// `positions` are positions of all records, of which there must be at least 2.
+//
+// If `cold`, the page cache is dropped and the `RecordReader` is created again
+// before each lookup, otherwise a single `RecordReader` is used after reading
+// the whole file once.
+template <typename Src>
+std::array<std::vector<double>, 4> MeasureLookups(
+    absl::string_view filename,
+    const std::vector<riegeli::RecordPosition>& positions,
+    uint64_t file_size, bool cold, int num_lookups, std::mt19937_64& random) {
+  std::array<std::vector<double>, 4> latencies_us;
+  absl::optional<riegeli::RecordReader<Src>> record_reader;
+  std::string record;
+  const auto open = [&] {
+    record_reader.emplace(std::forward_as_tuple(filename, O_RDONLY));
+    RIEGELI_CHECK(record_reader->healthy()) << record_reader->status();
+  };
+  if (!cold) {
+    open();
+    while (record_reader->ReadRecord(record)) {
+    }
+    RIEGELI_CHECK(record_reader->healthy()) << record_reader->status();
+  }
+  std::uniform_int_distribution<uint64_t> position_distribution(0,
+                                                                file_size - 1);
+  // Record 0 is excluded, so that `SeekBack()` has a previous record.
+  std::uniform_int_distribution<size_t> record_distribution(
+      1, positions.size() - 1);
+  for (int i = 0; i < num_lookups; ++i) {
+    for (size_t kind = 0; kind < kLookups.size(); ++kind) {
+      const Lookup lookup = kLookups[kind];
+      const riegeli::RecordPosition target =
+          positions[record_distribution(random)];
+      if (cold) {
+        record_reader.reset();
+        DropPageCache(filename);
+        open();
+      }
+      if (lookup == Lookup::kSeekBack) {
+        // Only the step back is measured.
+        RIEGELI_CHECK(record_reader->Seek(target)) << record_reader->status();
+      }
+      const uint64_t real_time_before_ns = RealTimeNow_ns();
+      switch (lookup) {
+        case Lookup::kSeekPosition:
+          RIEGELI_CHECK(record_reader->Seek(
+              riegeli::Position{position_distribution(random)}))
+              << record_reader->status();
+          break;
+        case Lookup::kSeekRecordPosition:
+          RIEGELI_CHECK(record_reader->Seek(target))
+              << record_reader->status();
+          break;
+        case Lookup::kSeekBack:
+          RIEGELI_CHECK(record_reader->SeekBack()) << record_reader->status();
+          break;
+        case Lookup::kSearch:
+          RIEGELI_CHECK(record_reader->Search(
+              [&](riegeli::RecordReaderBase& reader) {
+                const riegeli::RecordPosition pos = reader.pos();
+                if (!reader.ReadRecord(record)) {
+                  return absl::partial_ordering::unordered;
+                }
+                return pos < target    ? absl::partial_ordering::less
+                       : pos == target ? absl::partial_ordering::equivalent
+                                       : absl::partial_ordering::greater;
+              }))
+              << record_reader->status();
+          break;
+      }
+      record_reader->ReadRecord(record);
+      const uint64_t real_time_after_ns = RealTimeNow_ns();
+      RIEGELI_CHECK(record_reader->healthy()) << record_reader->status();
+      latencies_us[kind].push_back(
+          static_cast<double>(real_time_after_ns - real_time_before_ns) /
+          1000.0);
+    }
+  }
+  return latencies_us;
+}
+
+void Benchmarks::RunRandomAccess(int num_lookups, OutputFormat output_format,
+                                 std::ostream& report) {
+  std::mt19937_64 random;
+  std::vector<LatencyResult> results;
+  if (output_format == OutputFormat::kText) {
+    absl::Format(&report, "Creating files %s/record_benchmark_*\n",
+                 output_dir_);
+    absl::Format(&report, "%-*s  Reader Cache %-20s  Latency us\n",
+                 max_name_width_, "", "");
+    absl::Format(&report, "%-*s               %-20s  p50    p99   p999\n",
+                 max_name_width_, "Format", "Lookup");
+    absl::Format(
+        &report, "%s\n",
+        std::string(riegeli::IntCast<size_t>(max_name_width_ + 56), '-'));
+  }
+  for (const std::pair<std::string, riegeli::RecordWriterBase::Options>&
+           riegeli_options : riegeli_benchmarks_) {
+    const std::string name = absl::StrCat("riegeli ", riegeli_options.first);
+    const std::string filename =
+        absl::StrCat(output_dir_, "/record_benchmark_", Filename(name));
+    WriteRiegeli(filename, riegeli_options.second, records_);
+    std::vector<riegeli::RecordPosition> positions;
+    {
+      riegeli::RecordReader<riegeli::FdReader<>> record_reader(
+          std::forward_as_tuple(filename, O_RDONLY));
+      absl::string_view record;
+      for (;;) {
+        const riegeli::RecordPosition pos = record_reader.pos();
+        if (!record_reader.ReadRecord(record)) break;
+        positions.push_back(pos);
+      }
+      RIEGELI_CHECK(record_reader.Close()) << record_reader.status();
+    }
+    RIEGELI_CHECK_GE(positions.size(), 2u)
+        << "Random access benchmarks need at least 2 records";
+    const uint64_t file_size = FileSize(filename);
+    for (const char* const reader : {"fd", "mmap"}) {
+      for (const bool cold : {false, true}) {
+        std::array<std::vector<double>, 4> latencies_us =
+            absl::string_view(reader) == "fd"
+                ? MeasureLookups<riegeli::FdReader<>>(
+                      filename, positions, file_size, cold, num_lookups,
+                      random)
+                : MeasureLookups<riegeli::FdMMapReader<>>(
+                      filename, positions, file_size, cold, num_lookups,
+                      random);
+        for (size_t kind = 0; kind < kLookups.size(); ++kind) {
+          std::vector<double>& samples = latencies_us[kind];
+          std::sort(samples.begin(), samples.end());
+          LatencyResult result;
+          result.name = name;
+          result.reader = reader;
+          result.cache = cold ? "cold" : "warm";
+          result.lookup = LookupName(kLookups[kind]);
+          result.num_lookups = samples.size();
+          result.p50_us = Percentile(samples, 0.5);
+          result.p99_us = Percentile(samples, 0.99);
+          result.p999_us = Percentile(samples, 0.999);
+          if (output_format == OutputFormat::kText) {
+            absl::Format(&report, "%-*s  %-6s %-5s %-20s %6.0f %6.0f %6.0f\n",
+                         max_name_width_, result.name, result.reader,
+                         result.cache, result.lookup, result.p50_us,
+                         result.p99_us, result.p999_us);
+            report.flush();
+          }
+          results.push_back(std::move(result));
+        }
+      }
+    }
+  }
+
+  switch (output_format) {
+    case OutputFormat::kText:
+      break;
+    case OutputFormat::kJson:
+      absl::Format(&report, "{\"lookups\": [");
+      for (size_t i = 0; i < results.size(); ++i) {
+        const LatencyResult& result = results[i];
+        absl::Format(&report,
+                     "%s\n  {\"name\": %s, \"reader\": \"%s\", "
+                     "\"cache\": \"%s\", \"lookup\": \"%s\", "
+                     "\"num_lookups\": %u, \"p50_us\": %.3f, "
+                     "\"p99_us\": %.3f, \"p999_us\": %.3f}",
+                     i == 0 ? "" : ",", JsonString(result.name),
+                     result.reader, result.cache, result.lookup,
+                     result.num_lookups, result.p50_us, result.p99_us,
+                     result.p999_us);
+      }
+      absl::Format(&report, "\n]}\n");
+      break;
+    case OutputFormat::kCsv:
+      absl::Format(&report,
+                   "name,reader,cache,lookup,num_lookups,p50_us,p99_us,"
+                   "p999_us\n");
+      for (const LatencyResult& result : results) {
+        absl::Format(&report, "%s,%s,%s,%s,%u,%.3f,%.3f,%.3f\n",
+                     CsvString(result.name), result.reader, result.cache,
+                     result.lookup, result.num_lookups, result.p50_us,
+                     result.p99_us, result.p999_us);
+      }
+      break;
+  }
 }
 
 const char kUsage[] =
     "Usage: records_benchmark (OPTION|FILE)...\n"
     "\n"
-    "FILEs may be TFRecord or Riegeli/records files.\n";
+    "FILEs may be TFRecord or Riegeli/records files.\n"
+    "\n"
+    "With --output_format=json or csv, the report includes CPU and real time,\n"
+    "peak RSS, and time spent in stages of Riegeli benchmarks, summed over\n"
+    "threads. With --*_sweep, Riegeli benchmarks are repeated with each value\n"
+    "of the swept options.\n"
+    "\n"
+    "With --random_access_lookups, latency of random access is measured\n"
+    "instead of throughput.\n";
 
 template <typename Function>
 void ForEachWord(absl::string_view words, Function f) {
@@ -525,6 +1143,42 @@ void ForEachWord(absl::string_view words, Function f) {
   }
 }
 
+// A Riegeli option swept over `values`.
+struct Sweep {
+  absl::string_view name;
+  std::vector<std::string> values;
+};
+
+// Returns `riegeli_options` extended with each combination of values of
+// `sweeps`, except for options which `riegeli_options` already specifies.
+std::vector<std::string> ExpandSweeps(absl::string_view riegeli_options,
+                                      const std::vector<Sweep>& sweeps) {
+  std::vector<std::string> expanded = {std::string(riegeli_options)};
+  for (const Sweep& sweep : sweeps) {
+    if (sweep.values.empty()) continue;
+    bool specified = false;
+    for (const absl::string_view option :
+         absl::StrSplit(riegeli_options, ',')) {
+      if (option == sweep.name ||
+          absl::StartsWith(option, absl::StrCat(sweep.name, ":"))) {
+        specified = true;
+        break;
+      }
+    }
+    if (specified) continue;
+    std::vector<std::string> next;
+    next.reserve(expanded.size() * sweep.values.size());
+    for (const std::string& options : expanded) {
+      for (const std::string& value : sweep.values) {
+        next.push_back(absl::StrCat(options, options.empty() ? "" : ",",
+                                    sweep.name, ":", value));
+      }
+    }
+    expanded = std::move(next);
+  }
+  return expanded;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -535,10 +1189,26 @@ int main(int argc, char** argv) {
     absl::Format(&std::cerr, "%s\n", kUsage);
     return 1;
   }
+  OutputFormat output_format;
+  const std::string output_format_name = absl::GetFlag(FLAGS_output_format);
+  if (output_format_name == "text") {
+    output_format = OutputFormat::kText;
+  } else if (output_format_name == "json") {
+    output_format = OutputFormat::kJson;
+  } else if (output_format_name == "csv") {
+    output_format = OutputFormat::kCsv;
+  } else {
+    absl::Format(&std::cerr, "Unknown --output_format: %s\n",
+                 output_format_name);
+    return 1;
+  }
+  // Keep machine-readable output free of progress messages.
+  std::ostream& progress =
+      output_format == OutputFormat::kText ? std::cout : std::cerr;
   SizeLimiter size_limiter(
       riegeli::IntCast<size_t>(absl::GetFlag(FLAGS_max_size)));
   for (size_t i = 1; i < args.size(); ++i) {
-    if (!Benchmarks::ReadFile(args[i], &records, &size_limiter, std::cout)) {
+    if (!Benchmarks::ReadFile(args[i], &records, &size_limiter, progress)) {
       break;
     }
   }
@@ -548,9 +1218,30 @@ int main(int argc, char** argv) {
               [&](absl::string_view tfrecord_options) {
                 benchmarks.RegisterTFRecord(tfrecord_options);
               });
+  std::vector<Sweep> sweeps = {{"parallelism", {}},
+                               {"chunk_size", {}},
+                               {"bucket_fraction", {}}};
+  for (const std::pair<Sweep*, std::string>& sweep_values :
+       {std::make_pair(&sweeps[0], absl::GetFlag(FLAGS_parallelism_sweep)),
+        std::make_pair(&sweeps[1], absl::GetFlag(FLAGS_chunk_size_sweep)),
+        std::make_pair(&sweeps[2],
+                       absl::GetFlag(FLAGS_bucket_fraction_sweep))}) {
+    ForEachWord(sweep_values.second, [&](absl::string_view value) {
+      sweep_values.first->values.emplace_back(value);
+    });
+  }
   ForEachWord(absl::GetFlag(FLAGS_riegeli_benchmarks),
               [&](absl::string_view riegeli_options) {
-                benchmarks.RegisterRiegeli(riegeli_options);
+                for (const std::string& expanded_options :
+                     ExpandSweeps(riegeli_options, sweeps)) {
+                  benchmarks.RegisterRiegeli(expanded_options);
+                }
               });
-  benchmarks.RunAll(std::cout);
+  const int random_access_lookups = absl::GetFlag(FLAGS_random_access_lookups);
+  if (random_access_lookups > 0) {
+    benchmarks.RunRandomAccess(random_access_lookups, output_format,
+                               std::cout);
+  } else {
+    benchmarks.RunAll(output_format, std::cout);
+  }
 }
@@ -0,0 +1,287 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/chunk_encoding/constants.h"
+#include "riegeli/records/block.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/chunk_writer.h"
+#include "riegeli/records/skipped_region.h"
+
+ABSL_FLAG(std::string, output, "",
+          "Name of the file to write recovered chunks to. If empty, only "
+          "skipped regions are reported.");
+ABSL_FLAG(int, parallelism, 16,
+          "Number of concurrent tasks validating block headers.");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+// Validates block headers at block boundaries in [`begin_block`, `end_block`)
+// and appends chunk boundaries implied by valid block headers to
+// `chunk_boundaries`.
+absl::Status FindChunkBoundaries(const std::string& filename,
+                                 Position block_size, Position begin_block,
+                                 Position end_block,
+                                 std::vector<Position>& chunk_boundaries) {
+  // A small buffer avoids reading whole blocks after seeking.
+  FdReader<> file_reader(
+      filename, O_RDONLY,
+      FdReaderBase::Options().set_buffer_size(internal::BlockHeader::size()));
+  for (Position block = begin_block; block < end_block; ++block) {
+    const Position block_begin = block * block_size;
+    internal::BlockHeader block_header;
+    if (ABSL_PREDICT_FALSE(!file_reader.Seek(block_begin) ||
+                           !file_reader.Read(internal::BlockHeader::size(),
+                                             block_header.bytes()))) {
+      if (ABSL_PREDICT_FALSE(!file_reader.healthy())) {
+        return file_reader.status();
+      }
+      // The file ends inside the block header.
+      break;
+    }
+    if (block_header.computed_header_hash() !=
+        block_header.stored_header_hash()) {
+      continue;
+    }
+    if (block_header.previous_chunk() <= block_begin) {
+      chunk_boundaries.push_back(block_begin - block_header.previous_chunk());
+    }
+    if (block_header.next_chunk() <=
+        std::numeric_limits<Position>::max() - block_begin) {
+      chunk_boundaries.push_back(block_begin + block_header.next_chunk());
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!file_reader.Close())) return file_reader.status();
+  return absl::OkStatus();
+}
+
+// Returns sorted possible chunk boundaries before `size`, implied by valid
+// block headers, validating block headers concurrently.
+absl::Status FindAllChunkBoundaries(const std::string& filename, Position size,
+                                    Position block_size, int parallelism,
+                                    std::vector<Position>& chunk_boundaries) {
+  const Position num_blocks =
+      size / block_size + (size % block_size > 0 ? 1 : 0);
+  const Position num_tasks =
+      UnsignedMin(num_blocks, IntCast<Position>(std::max(parallelism, 1)));
+  std::vector<std::vector<Position>> task_boundaries(
+      IntCast<size_t>(num_tasks));
+  std::vector<absl::Status> task_statuses(IntCast<size_t>(num_tasks));
+  absl::BlockingCounter pending_tasks(IntCast<int>(num_tasks));
+  for (Position task = 0; task < num_tasks; ++task) {
+    internal::ThreadPool::global().Schedule([&, task] {
+      task_statuses[IntCast<size_t>(task)] = FindChunkBoundaries(
+          filename, block_size, num_blocks * task / num_tasks,
+          num_blocks * (task + 1) / num_tasks,
+          task_boundaries[IntCast<size_t>(task)]);
+      pending_tasks.DecrementCount();
+    });
+  }
+  pending_tasks.Wait();
+  chunk_boundaries.clear();
+  for (size_t task = 0; task < task_boundaries.size(); ++task) {
+    if (ABSL_PREDICT_FALSE(!task_statuses[task].ok())) {
+      return task_statuses[task];
+    }
+    for (const Position chunk_boundary : task_boundaries[task]) {
+      if (chunk_boundary < size &&
+          internal::IsPossibleChunkBoundary(chunk_boundary, block_size)) {
+        chunk_boundaries.push_back(chunk_boundary);
+      }
+    }
+  }
+  std::sort(chunk_boundaries.begin(), chunk_boundaries.end());
+  chunk_boundaries.erase(
+      std::unique(chunk_boundaries.begin(), chunk_boundaries.end()),
+      chunk_boundaries.end());
+  return absl::OkStatus();
+}
+
+// Returns `true` on success.
+bool RecoverFile(const std::string& filename, const std::string& output,
+                 int parallelism) {
+  FdReader<> file_reader(filename, O_RDONLY);
+  const absl::optional<Position> size = file_reader.Size();
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt)) {
+    absl::Format(&std::cerr, "%s\n", file_reader.status().message());
+    return false;
+  }
+  // The block size is declared by the file signature. If it is corrupted, the
+  // default block size is assumed.
+  DefaultChunkReader<> chunk_reader(&file_reader);
+  std::vector<Position> chunk_boundaries;
+  {
+    const absl::Status status =
+        FindAllChunkBoundaries(filename, *size, chunk_reader.block_size(),
+                               parallelism, chunk_boundaries);
+    if (ABSL_PREDICT_FALSE(!status.ok())) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return false;
+    }
+  }
+
+  absl::optional<DefaultChunkWriter<FdWriter<>>> chunk_writer;
+  if (!output.empty()) {
+    chunk_writer.emplace(
+        std::forward_as_tuple(output, O_WRONLY | O_CREAT | O_TRUNC));
+    Chunk signature;
+    signature.header =
+        ChunkHeader(signature.data, ChunkType::kFileSignature, 0, 0);
+    chunk_writer->WriteChunk(signature);
+  }
+  uint64_t num_chunks = 0;
+  uint64_t num_records = 0;
+  Position skipped_bytes = 0;
+  // Whether the previous chunk was the file signature at the beginning, so
+  // that a file metadata chunk is valid.
+  bool after_signature = false;
+  for (;;) {
+    const Position chunk_begin = chunk_reader.pos();
+    // The end of the current chunk, if its header is valid.
+    absl::optional<Position> chunk_end;
+    Chunk chunk;
+    const ChunkHeader* chunk_header;
+    if (chunk_reader.PullChunkHeader(&chunk_header)) {
+      chunk_end = internal::ChunkEnd(*chunk_header, chunk_begin,
+                                     chunk_reader.block_size());
+      if (chunk_reader.ReadChunk(chunk)) {
+        switch (chunk.header.chunk_type()) {
+          case ChunkType::kFileSignature:
+            after_signature = chunk_begin == 0;
+            continue;
+          case ChunkType::kFileMetadata:
+            if (!after_signature) break;
+            after_signature = false;
+            if (chunk_writer != absl::nullopt) chunk_writer->WriteChunk(chunk);
+            continue;
+          case ChunkType::kPadding:
+          case ChunkType::kIndex:
+            // Chunk positions change, so an index would be invalid.
+            break;
+          default:
+            if (chunk.header.num_records() == 0) break;
+            ++num_chunks;
+            num_records += chunk.header.num_records();
+            if (chunk_writer != absl::nullopt) chunk_writer->WriteChunk(chunk);
+            break;
+        }
+        after_signature = false;
+        continue;
+      }
+    }
+    if (chunk_reader.healthy()) {
+      // The file ends.
+      if (chunk_reader.truncated()) {
+        const SkippedRegion skipped_region(
+            chunk_begin, *size, "Incomplete chunk at the end of file");
+        absl::Format(&std::cerr, "%s\n", skipped_region.ToString());
+        skipped_bytes += skipped_region.length();
+      }
+      break;
+    }
+    if (ABSL_PREDICT_FALSE(!file_reader.healthy())) {
+      absl::Format(&std::cerr, "%s\n", file_reader.status().message());
+      return false;
+    }
+    // Resume at the end of the current chunk if its header was valid,
+    // otherwise at the next chunk boundary implied by a valid block header.
+    Position resume_pos;
+    if (chunk_end != absl::nullopt && *chunk_end > chunk_begin &&
+        *chunk_end < *size) {
+      resume_pos = *chunk_end;
+    } else {
+      const std::vector<Position>::const_iterator next_boundary =
+          std::upper_bound(chunk_boundaries.begin(), chunk_boundaries.end(),
+                           chunk_begin);
+      resume_pos =
+          next_boundary == chunk_boundaries.end() ? *size : *next_boundary;
+    }
+    const SkippedRegion skipped_region(
+        chunk_begin, resume_pos, std::string(chunk_reader.status().message()));
+    absl::Format(&std::cerr, "%s\n", skipped_region.ToString());
+    skipped_bytes += skipped_region.length();
+    after_signature = false;
+    if (resume_pos >= *size) break;
+    if (ABSL_PREDICT_FALSE(!file_reader.Seek(resume_pos))) {
+      absl::Format(&std::cerr, "%s\n", file_reader.status().message());
+      return false;
+    }
+    chunk_reader.Reset(&file_reader);
+  }
+  // A failure of `chunk_reader` has been reported as a skipped region.
+  chunk_reader.Close();
+  if (ABSL_PREDICT_FALSE(!file_reader.Close())) {
+    absl::Format(&std::cerr, "%s\n", file_reader.status().message());
+    return false;
+  }
+  if (chunk_writer != absl::nullopt &&
+      ABSL_PREDICT_FALSE(!chunk_writer->Close())) {
+    absl::Format(&std::cerr, "%s\n", chunk_writer->status().message());
+    return false;
+  }
+  absl::Format(&std::cerr,
+               "Recovered %u records in %u chunks, skipped %u bytes\n",
+               num_records, num_chunks, skipped_bytes);
+  return true;
+}
+
+const char kUsage[] =
+    "Usage: recover_riegeli_file (OPTION|FILE)\n"
+    "\n"
+    "Recovers chunks of a damaged Riegeli/records file, and reports skipped\n"
+    "regions. Block headers are validated concurrently to find chunk\n"
+    "boundaries, so that damaged regions are skipped without scanning them\n"
+    "block by block.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() != 2) {
+    absl::Format(&std::cerr, "%s", riegeli::tools::kUsage);
+    return 1;
+  }
+  return riegeli::tools::RecoverFile(args[1], absl::GetFlag(FLAGS_output),
+                                     absl::GetFlag(FLAGS_parallelism))
+             ? 0
+             : 1;
+}
@@ -0,0 +1,86 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/str_format.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/records/chunk_concatenator.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/chunk_writer.h"
+
+ABSL_FLAG(std::string, output, "", "Name of the file to write.");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+// Returns `true` on success.
+bool ConcatFiles(const std::string& output,
+                 const std::vector<char*>& inputs) {
+  DefaultChunkWriter<FdWriter<>> chunk_writer(
+      std::forward_as_tuple(output, O_WRONLY | O_CREAT | O_TRUNC));
+  ChunkConcatenator concatenator(&chunk_writer);
+  for (const char* input : inputs) {
+    DefaultChunkReader<FdReader<>> chunk_reader(
+        std::forward_as_tuple(input, O_RDONLY));
+    concatenator.Append(chunk_reader);
+    chunk_reader.Close();
+    if (!concatenator.healthy()) break;
+  }
+  if (!concatenator.Close()) {
+    absl::Format(&std::cerr, "%s\n", concatenator.status().message());
+    chunk_writer.Close();
+    return false;
+  }
+  if (!chunk_writer.Close()) {
+    absl::Format(&std::cerr, "%s\n", chunk_writer.status().message());
+    return false;
+  }
+  absl::Format(&std::cerr, "Copied %u chunks from %u files\n",
+               concatenator.num_chunks(), concatenator.num_sources());
+  return true;
+}
+
+const char kUsage[] =
+    "Usage: riegeli_concat --output=FILE (OPTION|FILE)...\n"
+    "\n"
+    "Concatenates Riegeli/records files without decoding records.\n"
+    "\n"
+    "All files must have the same file metadata.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    absl::Format(&std::cerr, "Missing --output\n");
+    return 1;
+  }
+  const std::vector<char*> inputs(args.begin() + 1, args.end());
+  return riegeli::tools::ConcatFiles(output, inputs) ? 0 : 1;
+}
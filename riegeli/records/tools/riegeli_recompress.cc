@@ -0,0 +1,88 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "riegeli/base/executor.h"
+#include "riegeli/chunk_encoding/compressor_options.h"
+#include "riegeli/records/records_recompression.h"
+
+ABSL_FLAG(std::string, output, "", "Name of the file to write.");
+ABSL_FLAG(std::string, compression, "brotli:9",
+          "Compression of the output, as for "
+          "CompressorOptions::FromString().");
+ABSL_FLAG(int, parallelism, riegeli::Executor::DefaultMaxThreads(),
+          "Number of chunks recompressed concurrently.");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+const char kUsage[] =
+    "Usage: riegeli_recompress --output=FILE (OPTION|FILE)\n"
+    "\n"
+    "Compresses chunks of a Riegeli/records file again, without decoding "
+    "records.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    absl::Format(&std::cerr, "Missing --output\n");
+    return 1;
+  }
+  if (args.size() != 2) {
+    absl::Format(&std::cerr, "Expected exactly one input file\n");
+    return 1;
+  }
+  riegeli::CompressorOptions compressor_options;
+  {
+    const absl::Status status =
+        compressor_options.FromString(absl::GetFlag(FLAGS_compression));
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+  }
+  const int parallelism = absl::GetFlag(FLAGS_parallelism);
+  if (parallelism <= 0) {
+    absl::Format(&std::cerr, "--parallelism must be positive\n");
+    return 1;
+  }
+  const absl::Status status = riegeli::RecompressRecords(
+      args[1], output,
+      riegeli::RecompressRecordsOptions()
+          .set_compressor_options(std::move(compressor_options))
+          .set_parallelism(parallelism)
+          .set_executor(std::make_shared<riegeli::Executor>(parallelism)));
+  if (!status.ok()) {
+    absl::Format(&std::cerr, "%s\n", status.message());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "riegeli/base/base.h"
+#include "riegeli/bytes/string_reader.h"
+#include "riegeli/endian/endian_reading.h"
+#include "riegeli/endian/endian_writing.h"
+#include "riegeli/messages/message_wire_format.h"
+#include "riegeli/records/record_writer.h"
+#include "riegeli/records/records_sorting.h"
+#include "riegeli/varint/varint_reading.h"
+
+ABSL_FLAG(std::string, output, "", "Name of the file to write.");
+ABSL_FLAG(std::string, key_field, "",
+          "Field numbers of the key, separated by dots for nested messages, "
+          "e.g. \"3.1\".");
+ABSL_FLAG(std::string, record_writer_options, "",
+          "RecordWriter options of the output, as for "
+          "RecordWriterBase::Options::FromString().");
+ABSL_FLAG(uint64_t, run_size, uint64_t{256} << 20,
+          "Total size of records sorted in memory as one run.");
+ABSL_FLAG(int, parallelism, 2,
+          "Number of runs sorted and written concurrently.");
+ABSL_FLAG(std::string, temp_prefix, "",
+          "Prefix of names of temporary files. Default: output name followed "
+          "by .sort-tmp");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+// Returns the key of a serialized message: the first value of the field at
+// `field_path`.
+//
+// Strings and submessages are taken as is. Numeric values are encoded as
+// 8 bytes in big endian, so that unsigned integers are ordered numerically.
+//
+// If the field is absent or the message is malformed, returns an empty key,
+// which is ordered first.
+std::string GetFieldKey(absl::string_view message,
+                        absl::Span<const int> field_path) {
+  for (size_t depth = 0; depth < field_path.size(); ++depth) {
+    const bool last = depth == field_path.size() - 1;
+    StringReader<> reader(message);
+    for (;;) {
+      const absl::optional<uint32_t> tag = ReadVarint32(reader);
+      if (tag == absl::nullopt) return std::string();
+      const bool found = GetTagFieldNumber(*tag) == field_path[depth];
+      absl::optional<uint64_t> value;
+      switch (GetTagWireType(*tag)) {
+        case WireType::kVarint:
+          value = ReadVarint64(reader);
+          break;
+        case WireType::kFixed64:
+          value = ReadLittleEndian64(reader);
+          break;
+        case WireType::kFixed32:
+          value = ReadLittleEndian32(reader);
+          break;
+        case WireType::kLengthDelimited: {
+          const absl::optional<uint32_t> length = ReadVarint32(reader);
+          if (length == absl::nullopt) return std::string();
+          absl::string_view contents;
+          if (!reader.Read(*length, contents)) return std::string();
+          if (found) message = contents;
+          break;
+        }
+        default:
+          // Groups are not supported.
+          return std::string();
+      }
+      if (!found) {
+        if (GetTagWireType(*tag) != WireType::kLengthDelimited &&
+            value == absl::nullopt) {
+          return std::string();
+        }
+        continue;
+      }
+      if (GetTagWireType(*tag) == WireType::kLengthDelimited) {
+        if (last) return std::string(message);
+        break;
+      }
+      if (!last || value == absl::nullopt) return std::string();
+      std::string key(sizeof(uint64_t), '\0');
+      WriteBigEndian64(*value, &key[0]);
+      return key;
+    }
+  }
+  return std::string(message);
+}
+
+const char kUsage[] =
+    "Usage: riegeli_sort --output=FILE --key_field=N[.N]... "
+    "(OPTION|FILE)...\n"
+    "\n"
+    "Sorts records of Riegeli/records files, which are serialized proto\n"
+    "messages, by the value of a field, so that the output can be searched\n"
+    "by key. Files larger than memory are sorted with temporary files.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    absl::Format(&std::cerr, "Missing --output\n");
+    return 1;
+  }
+  std::vector<int> field_path;
+  for (const absl::string_view field :
+       absl::StrSplit(absl::GetFlag(FLAGS_key_field), '.')) {
+    int field_number;
+    if (!absl::SimpleAtoi(field, &field_number) || field_number <= 0) {
+      absl::Format(&std::cerr, "Invalid --key_field\n");
+      return 1;
+    }
+    field_path.push_back(field_number);
+  }
+  riegeli::RecordWriterBase::Options record_writer_options;
+  {
+    const absl::Status status = record_writer_options.FromString(
+        absl::GetFlag(FLAGS_record_writer_options));
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+  }
+  const std::vector<std::string> inputs(args.begin() + 1, args.end());
+  const absl::Status status = riegeli::SortRecords(
+      inputs, output,
+      [&field_path](absl::string_view record) {
+        return riegeli::tools::GetFieldKey(record, field_path);
+      },
+      riegeli::SortRecordsOptions()
+          .set_run_size(absl::GetFlag(FLAGS_run_size))
+          .set_parallelism(absl::GetFlag(FLAGS_parallelism))
+          .set_temp_prefix(absl::GetFlag(FLAGS_temp_prefix))
+          .set_record_writer_options(std::move(record_writer_options)));
+  if (!status.ok()) {
+    absl::Format(&std::cerr, "%s\n", status.message());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,238 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/chunk_encoding/chunk.h"
+#include "riegeli/records/chunk_reader.h"
+#include "riegeli/records/skipped_region.h"
+
+ABSL_FLAG(int, parallelism, 16,
+          "Number of ranges of files verified concurrently.");
+ABSL_FLAG(uint64_t, range_size, uint64_t{1} << 30,
+          "Length of a range of a file verified sequentially by one task.");
+ABSL_FLAG(uint64_t, buffer_size, uint64_t{4} << 20,
+          "Length of each read from a file.");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+// A range of a file, with chunks beginning in [`begin`, `end`).
+struct Range {
+  size_t file_index;
+  Position begin;
+  Position end;
+};
+
+struct RangeResult {
+  absl::Status status;
+  uint64_t num_chunks = 0;
+  std::vector<SkippedRegion> skipped_regions;
+};
+
+// Verifies block headers, chunk headers, and chunk data of chunks beginning in
+// [`begin`, `end`), without decoding records. Invalid regions are appended to
+// `result.skipped_regions`.
+void VerifyRange(const std::string& filename, Position begin, Position end,
+                 size_t buffer_size, RangeResult& result) {
+  FdReader<> file_reader(
+      filename, O_RDONLY, FdReaderBase::Options().set_buffer_size(buffer_size));
+  DefaultChunkReader<> chunk_reader(&file_reader);
+  if (begin > 0 && ABSL_PREDICT_FALSE(!chunk_reader.SeekToChunkAfter(begin))) {
+    SkippedRegion skipped_region;
+    if (ABSL_PREDICT_FALSE(!chunk_reader.Recover(&skipped_region))) {
+      result.status = chunk_reader.status();
+      return;
+    }
+    result.skipped_regions.push_back(std::move(skipped_region));
+  }
+  while (chunk_reader.pos() < end) {
+    const Position chunk_begin = chunk_reader.pos();
+    // `ReadChunk()` verifies block headers inside the chunk, the chunk header
+    // hash, and the chunk data hash.
+    Chunk chunk;
+    if (ABSL_PREDICT_TRUE(chunk_reader.ReadChunk(chunk))) {
+      ++result.num_chunks;
+      continue;
+    }
+    if (chunk_reader.healthy()) {
+      // The file ends.
+      if (chunk_reader.truncated()) {
+        const absl::optional<Position> size = file_reader.Size();
+        result.skipped_regions.emplace_back(
+            chunk_begin, size == absl::nullopt ? chunk_begin : *size,
+            "Incomplete chunk at the end of file");
+      }
+      break;
+    }
+    SkippedRegion skipped_region;
+    if (ABSL_PREDICT_FALSE(!chunk_reader.Recover(&skipped_region))) {
+      result.status = chunk_reader.status();
+      return;
+    }
+    result.skipped_regions.push_back(std::move(skipped_region));
+  }
+  // A failure of `chunk_reader` has been reported as a skipped region.
+  chunk_reader.Close();
+  if (ABSL_PREDICT_FALSE(!file_reader.Close())) {
+    result.status = file_reader.status();
+  }
+}
+
+// Verifies files concurrently, splitting them into ranges of `range_size`
+// bytes, and reports results in the order of files.
+//
+// Returns `true` if all files are valid.
+bool VerifyFiles(const std::vector<std::string>& filenames, int parallelism,
+                 Position range_size, size_t buffer_size) {
+  bool all_valid = true;
+  std::vector<Range> ranges;
+  for (size_t file_index = 0; file_index < filenames.size(); ++file_index) {
+    FdReader<> file_reader(filenames[file_index], O_RDONLY);
+    const absl::optional<Position> size = file_reader.Size();
+    if (ABSL_PREDICT_FALSE(size == absl::nullopt)) {
+      absl::Format(&std::cerr, "%s: %s\n", filenames[file_index],
+                   file_reader.status().message());
+      all_valid = false;
+      continue;
+    }
+    file_reader.Close();
+    Position begin = 0;
+    do {
+      const Position end = begin + UnsignedMin(range_size, *size - begin);
+      ranges.push_back(Range{file_index, begin, end});
+      begin = end;
+    } while (begin < *size);
+  }
+
+  absl::Mutex mutex;
+  size_t next_range = 0;
+  std::vector<RangeResult> results(ranges.size());
+  const size_t num_workers =
+      UnsignedMin(ranges.size(), IntCast<size_t>(std::max(parallelism, 1)));
+  absl::BlockingCounter running_workers(IntCast<int>(num_workers));
+  for (size_t i = 0; i < num_workers; ++i) {
+    internal::ThreadPool::global().Schedule([&] {
+      for (;;) {
+        size_t range_index;
+        {
+          absl::MutexLock lock(&mutex);
+          if (next_range == ranges.size()) break;
+          range_index = next_range++;
+        }
+        const Range& range = ranges[range_index];
+        VerifyRange(filenames[range.file_index], range.begin, range.end,
+                    buffer_size, results[range_index]);
+      }
+      running_workers.DecrementCount();
+    });
+  }
+  running_workers.Wait();
+
+  size_t range_index = 0;
+  while (range_index < ranges.size()) {
+    const size_t file_index = ranges[range_index].file_index;
+    const std::string& filename = filenames[file_index];
+    absl::Status status;
+    uint64_t num_chunks = 0;
+    uint64_t num_skipped_regions = 0;
+    Position skipped_bytes = 0;
+    // The end of the last reported region. Recovery near a range boundary can
+    // find the same invalid region from both adjacent ranges.
+    Position reported_end = 0;
+    for (; range_index < ranges.size() &&
+           ranges[range_index].file_index == file_index;
+         ++range_index) {
+      RangeResult& result = results[range_index];
+      if (ABSL_PREDICT_FALSE(!result.status.ok()) && status.ok()) {
+        status = std::move(result.status);
+      }
+      num_chunks += result.num_chunks;
+      for (const SkippedRegion& skipped_region : result.skipped_regions) {
+        if (skipped_region.end() <= reported_end) continue;
+        absl::Format(&std::cout, "%s: %s\n", filename,
+                     skipped_region.ToString());
+        ++num_skipped_regions;
+        skipped_bytes +=
+            skipped_region.end() - std::max(skipped_region.begin(),
+                                            reported_end);
+        reported_end = skipped_region.end();
+      }
+    }
+    if (ABSL_PREDICT_FALSE(!status.ok())) {
+      absl::Format(&std::cerr, "%s: %s\n", filename, status.message());
+      all_valid = false;
+    } else if (num_skipped_regions > 0) {
+      absl::Format(&std::cout,
+                   "%s: INVALID, %u chunks valid, %u regions with %u bytes "
+                   "invalid\n",
+                   filename, num_chunks, num_skipped_regions, skipped_bytes);
+      all_valid = false;
+    } else {
+      absl::Format(&std::cout, "%s: OK, %u chunks\n", filename, num_chunks);
+    }
+  }
+  return all_valid;
+}
+
+const char kUsage[] =
+    "Usage: riegeli_verify (OPTION|FILE)...\n"
+    "\n"
+    "Verifies integrity of Riegeli/records files: block headers, chunk "
+    "headers,\n"
+    "and chunk data hashes, without decoding records. Ranges of files are\n"
+    "verified concurrently. Exits with status 1 if any file is invalid.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const uint64_t range_size = absl::GetFlag(FLAGS_range_size);
+  const uint64_t buffer_size = absl::GetFlag(FLAGS_buffer_size);
+  if (range_size == 0 || buffer_size == 0) {
+    absl::Format(&std::cerr, "--range_size and --buffer_size must be "
+                             "positive\n");
+    return 1;
+  }
+  return riegeli::tools::VerifyFiles(
+             std::vector<std::string>(args.begin() + 1, args.end()),
+             absl::GetFlag(FLAGS_parallelism), range_size,
+             riegeli::IntCast<size_t>(buffer_size))
+             ? 0
+             : 1;
+}
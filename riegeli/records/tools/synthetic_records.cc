@@ -0,0 +1,203 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/records/tools/synthetic_records.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/endian/endian_writing.h"
+#include "riegeli/messages/message_wire_format.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+
+namespace {
+
+void AppendVarint(uint64_t value, std::string& dest) {
+  char buffer[kMaxLengthVarint64];
+  const char* const end = WriteVarint64(value, buffer);
+  dest.append(buffer, PtrDistance(buffer, end));
+}
+
+}  // namespace
+
+SyntheticRecordGenerator::SyntheticRecordGenerator(Options options)
+    : options_(std::move(options)), random_(options_.seed()) {
+  CreateFields(options_.depth(), fields_);
+}
+
+void SyntheticRecordGenerator::CreateFields(int depth,
+                                            std::vector<FieldSpec>& fields) {
+  std::uniform_real_distribution<double> probability(0.0, 1.0);
+  const int num_submessages =
+      depth > 1 ? std::max(1, options_.width() / 4) : 0;
+  fields.resize(IntCast<size_t>(options_.width()));
+  for (size_t i = 0; i < fields.size(); ++i) {
+    FieldSpec& field = fields[i];
+    field.number = IntCast<int>(i + 1);
+    field.repeated = probability(random_) < options_.repeated_fraction();
+    if (IntCast<int>(i) < num_submessages) {
+      field.kind = Kind::kMessage;
+      CreateFields(depth - 1, field.fields);
+      continue;
+    }
+    if (probability(random_) < options_.string_fraction()) {
+      field.kind = Kind::kString;
+      std::uniform_int_distribution<size_t> length_distribution(
+          0, 2 * options_.string_length());
+      std::uniform_int_distribution<int> char_distribution('a', 'z');
+      field.strings.resize(options_.cardinality());
+      for (std::string& value : field.strings) {
+        value.resize(length_distribution(random_));
+        for (char& ch : value) {
+          ch = static_cast<char>(char_distribution(random_));
+        }
+      }
+      continue;
+    }
+    switch (std::uniform_int_distribution<int>(0, 4)(random_)) {
+      case 0:
+        field.kind = Kind::kFixed32;
+        break;
+      case 1:
+        field.kind = Kind::kFixed64;
+        break;
+      default:
+        field.kind = Kind::kVarint;
+        break;
+    }
+    // Varints have a random bit length, so that their encoded lengths vary.
+    const int num_bits =
+        field.kind == Kind::kVarint
+            ? std::uniform_int_distribution<int>(1, 35)(random_)
+            : field.kind == Kind::kFixed32 ? 32 : 64;
+    field.numbers.resize(options_.cardinality());
+    for (uint64_t& value : field.numbers) value = random_() >> (64 - num_bits);
+  }
+}
+
+void SyntheticRecordGenerator::Generate(std::string& record) {
+  record.clear();
+  GenerateMessage(fields_, record);
+}
+
+void SyntheticRecordGenerator::GenerateMessage(
+    const std::vector<FieldSpec>& fields, std::string& dest) {
+  for (const FieldSpec& field : fields) GenerateField(field, dest);
+}
+
+void SyntheticRecordGenerator::GenerateField(const FieldSpec& field,
+                                             std::string& dest) {
+  const int count =
+      field.repeated ? std::uniform_int_distribution<int>(
+                           0, options_.max_repeated())(random_)
+                     : 1;
+  std::uniform_int_distribution<size_t> value_distribution(
+      0, options_.cardinality() - 1);
+  for (int i = 0; i < count; ++i) {
+    switch (field.kind) {
+      case Kind::kVarint:
+        AppendVarint(MakeTag(field.number, WireType::kVarint), dest);
+        AppendVarint(field.numbers[value_distribution(random_)], dest);
+        break;
+      case Kind::kFixed32: {
+        AppendVarint(MakeTag(field.number, WireType::kFixed32), dest);
+        char buffer[sizeof(uint32_t)];
+        WriteLittleEndian32(
+            static_cast<uint32_t>(field.numbers[value_distribution(random_)]),
+            buffer);
+        dest.append(buffer, sizeof(buffer));
+        break;
+      }
+      case Kind::kFixed64: {
+        AppendVarint(MakeTag(field.number, WireType::kFixed64), dest);
+        char buffer[sizeof(uint64_t)];
+        WriteLittleEndian64(field.numbers[value_distribution(random_)],
+                            buffer);
+        dest.append(buffer, sizeof(buffer));
+        break;
+      }
+      case Kind::kString: {
+        const std::string& value = field.strings[value_distribution(random_)];
+        AppendVarint(MakeTag(field.number, WireType::kLengthDelimited), dest);
+        AppendVarint(value.size(), dest);
+        dest.append(value);
+        break;
+      }
+      case Kind::kMessage: {
+        std::string message;
+        GenerateMessage(field.fields, message);
+        AppendVarint(MakeTag(field.number, WireType::kLengthDelimited), dest);
+        AppendVarint(message.size(), dest);
+        dest.append(message);
+        break;
+      }
+    }
+  }
+}
+
+std::string SyntheticRecordGenerator::SchemaToString() const {
+  std::string schema;
+  AppendSchema(fields_, "Record", 0, schema);
+  return schema;
+}
+
+void SyntheticRecordGenerator::AppendSchema(
+    const std::vector<FieldSpec>& fields, absl::string_view name, int indent,
+    std::string& dest) {
+  const std::string prefix(IntCast<size_t>(indent), ' ');
+  absl::StrAppend(&dest, prefix, "message ", name, " {\n");
+  for (const FieldSpec& field : fields) {
+    if (field.kind == Kind::kMessage) {
+      AppendSchema(field.fields, absl::StrCat("M", field.number), indent + 2,
+                   dest);
+    }
+  }
+  for (const FieldSpec& field : fields) {
+    std::string type;
+    switch (field.kind) {
+      case Kind::kVarint:
+        type = "uint64";
+        break;
+      case Kind::kFixed32:
+        type = "fixed32";
+        break;
+      case Kind::kFixed64:
+        type = "fixed64";
+        break;
+      case Kind::kString:
+        type = "string";
+        break;
+      case Kind::kMessage:
+        type = absl::StrCat("M", field.number);
+        break;
+    }
+    absl::StrAppend(&dest, prefix, "  ",
+                    field.repeated ? "repeated " : "optional ", type, " f",
+                    field.number, " = ", field.number, ";\n");
+  }
+  absl::StrAppend(&dest, prefix, "}\n");
+}
+
+}  // namespace riegeli
@@ -0,0 +1,229 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_RECORDS_TOOLS_SYNTHETIC_RECORDS_H_
+#define RIEGELI_RECORDS_TOOLS_SYNTHETIC_RECORDS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+
+namespace riegeli {
+
+// Generates serialized protocol messages of a random schema with a given
+// shape, so that encoders and field projection can be measured on records
+// resembling real data without sharing it.
+//
+// The schema and the records are deterministic for given `Options`.
+class SyntheticRecordGenerator {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Number of levels of nested messages, including the top level.
+    //
+    // `depth` must be at least 1.
+    // Default: 2.
+    Options& set_depth(int depth) & {
+      RIEGELI_ASSERT_GE(depth, 1)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_depth(): "
+             "depth out of range";
+      depth_ = depth;
+      return *this;
+    }
+    Options&& set_depth(int depth) && { return std::move(set_depth(depth)); }
+    int depth() const { return depth_; }
+
+    // Number of fields of each message. If the message is not at the deepest
+    // level, a quarter of them (at least one) are submessages.
+    //
+    // `width` must be at least 1.
+    // Default: 8.
+    Options& set_width(int width) & {
+      RIEGELI_ASSERT_GE(width, 1)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_width(): "
+             "width out of range";
+      width_ = width;
+      return *this;
+    }
+    Options&& set_width(int width) && { return std::move(set_width(width)); }
+    int width() const { return width_; }
+
+    // Probability that a field is repeated. A repeated field has between 0 and
+    // `max_repeated()` elements, uniformly.
+    //
+    // `repeated_fraction` must be between 0.0 and 1.0.
+    // Default: 0.25.
+    Options& set_repeated_fraction(double repeated_fraction) & {
+      RIEGELI_ASSERT_GE(repeated_fraction, 0.0)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_repeated_fraction(): "
+             "repeated fraction out of range";
+      RIEGELI_ASSERT_LE(repeated_fraction, 1.0)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_repeated_fraction(): "
+             "repeated fraction out of range";
+      repeated_fraction_ = repeated_fraction;
+      return *this;
+    }
+    Options&& set_repeated_fraction(double repeated_fraction) && {
+      return std::move(set_repeated_fraction(repeated_fraction));
+    }
+    double repeated_fraction() const { return repeated_fraction_; }
+
+    // Maximum number of elements of a repeated field.
+    //
+    // Default: 4.
+    Options& set_max_repeated(int max_repeated) & {
+      RIEGELI_ASSERT_GE(max_repeated, 0)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_max_repeated(): "
+             "negative max repeated";
+      max_repeated_ = max_repeated;
+      return *this;
+    }
+    Options&& set_max_repeated(int max_repeated) && {
+      return std::move(set_max_repeated(max_repeated));
+    }
+    int max_repeated() const { return max_repeated_; }
+
+    // Probability that a field which is not a submessage is a string. Other
+    // fields are varints, fixed32, or fixed64 in proportions 3:1:1.
+    //
+    // `string_fraction` must be between 0.0 and 1.0.
+    // Default: 0.5.
+    Options& set_string_fraction(double string_fraction) & {
+      RIEGELI_ASSERT_GE(string_fraction, 0.0)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_string_fraction(): "
+             "string fraction out of range";
+      RIEGELI_ASSERT_LE(string_fraction, 1.0)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_string_fraction(): "
+             "string fraction out of range";
+      string_fraction_ = string_fraction;
+      return *this;
+    }
+    Options&& set_string_fraction(double string_fraction) && {
+      return std::move(set_string_fraction(string_fraction));
+    }
+    double string_fraction() const { return string_fraction_; }
+
+    // Number of distinct values of each field which is not a submessage.
+    // Values are drawn from them uniformly.
+    //
+    // `cardinality` must be at least 1.
+    // Default: 1000.
+    Options& set_cardinality(size_t cardinality) & {
+      RIEGELI_ASSERT_GT(cardinality, 0u)
+          << "Failed precondition of "
+             "SyntheticRecordGenerator::Options::set_cardinality(): "
+             "zero cardinality";
+      cardinality_ = cardinality;
+      return *this;
+    }
+    Options&& set_cardinality(size_t cardinality) && {
+      return std::move(set_cardinality(cardinality));
+    }
+    size_t cardinality() const { return cardinality_; }
+
+    // Average length of a string value. Lengths are uniform between 0 and
+    // twice this.
+    //
+    // Default: 16.
+    Options& set_string_length(size_t string_length) & {
+      string_length_ = string_length;
+      return *this;
+    }
+    Options&& set_string_length(size_t string_length) && {
+      return std::move(set_string_length(string_length));
+    }
+    size_t string_length() const { return string_length_; }
+
+    // Seed of the schema and of the records.
+    //
+    // Default: 0.
+    Options& set_seed(uint64_t seed) & {
+      seed_ = seed;
+      return *this;
+    }
+    Options&& set_seed(uint64_t seed) && { return std::move(set_seed(seed)); }
+    uint64_t seed() const { return seed_; }
+
+   private:
+    int depth_ = 2;
+    int width_ = 8;
+    double repeated_fraction_ = 0.25;
+    int max_repeated_ = 4;
+    double string_fraction_ = 0.5;
+    size_t cardinality_ = 1000;
+    size_t string_length_ = 16;
+    uint64_t seed_ = 0;
+  };
+
+  // Creates the schema and pools of field values.
+  explicit SyntheticRecordGenerator(Options options = Options());
+
+  SyntheticRecordGenerator(const SyntheticRecordGenerator&) = delete;
+  SyntheticRecordGenerator& operator=(const SyntheticRecordGenerator&) =
+      delete;
+
+  // Generates the next record, replacing `record`.
+  void Generate(std::string& record);
+
+  // Returns a description of the schema in the protocol buffer language, with
+  // the top level message named `Record`.
+  std::string SchemaToString() const;
+
+ private:
+  enum class Kind { kVarint, kFixed32, kFixed64, kString, kMessage };
+
+  struct FieldSpec {
+    int number = 0;
+    Kind kind = Kind::kVarint;
+    bool repeated = false;
+    // Fields of a submessage, if `kind == Kind::kMessage`.
+    std::vector<FieldSpec> fields;
+    // Distinct values, if `kind` is numeric.
+    std::vector<uint64_t> numbers;
+    // Distinct values, if `kind == Kind::kString`.
+    std::vector<std::string> strings;
+  };
+
+  void CreateFields(int depth, std::vector<FieldSpec>& fields);
+  void GenerateMessage(const std::vector<FieldSpec>& fields,
+                       std::string& dest);
+  void GenerateField(const FieldSpec& field, std::string& dest);
+  static void AppendSchema(const std::vector<FieldSpec>& fields,
+                           absl::string_view name, int indent,
+                           std::string& dest);
+
+  Options options_;
+  std::mt19937_64 random_;
+  std::vector<FieldSpec> fields_;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_RECORDS_TOOLS_SYNTHETIC_RECORDS_H_
@@ -0,0 +1,326 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/parallelism.h"
+#include "riegeli/bytes/fd_reader.h"
+#include "riegeli/bytes/fd_writer.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/endian/endian_reading.h"
+#include "riegeli/records/record_writer.h"
+#include "riegeli/records/tools/tfrecord_recognizer.h"
+#include "riegeli/zlib/zlib_reader.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+
+ABSL_FLAG(std::string, output, "",
+          "Name of the Riegeli/records file to write. With --shard_size, "
+          "the prefix of names of shards, followed by -00000, -00001, etc.");
+ABSL_FLAG(std::string, record_writer_options, "",
+          "RecordWriter options, as for "
+          "RecordWriterBase::Options::FromString(), e.g. "
+          "\"transpose,zstd:3,parallelism:8\".");
+ABSL_FLAG(uint64_t, shard_size, 0,
+          "If positive, start a new output shard when the current one reaches "
+          "approximately this size in bytes.");
+ABSL_FLAG(int, parallelism, 8,
+          "Number of concurrent tasks verifying record checksums.");
+ABSL_FLAG(uint64_t, batch_size, uint64_t{64} << 20,
+          "Sum of sizes of records whose checksums are verified together.");
+
+namespace riegeli {
+namespace tools {
+namespace {
+
+// A TFRecord record with its stored checksum, not verified yet.
+struct TFRecord {
+  std::string data;
+  uint32_t masked_crc;
+};
+
+// Writes Riegeli/records output, starting new shards if requested.
+class ShardedRecordWriter {
+ public:
+  ShardedRecordWriter(std::string output, Position shard_size,
+                      RecordWriterBase::Options options)
+      : output_(std::move(output)),
+        shard_size_(shard_size),
+        options_(std::move(options)) {}
+
+  bool WriteRecord(std::string&& record);
+  bool Close();
+
+  const absl::Status& status() const { return status_; }
+  uint64_t num_records() const { return num_records_; }
+  int num_shards() const { return num_shards_; }
+
+ private:
+  bool OpenShard();
+  bool CloseShard();
+
+  std::string output_;
+  Position shard_size_;
+  RecordWriterBase::Options options_;
+  absl::optional<RecordWriter<FdWriter<>>> record_writer_;
+  absl::Status status_;
+  uint64_t num_records_ = 0;
+  int num_shards_ = 0;
+};
+
+bool ShardedRecordWriter::OpenShard() {
+  const std::string filename =
+      shard_size_ == 0 ? output_
+                       : absl::StrFormat("%s-%05d", output_, num_shards_);
+  ++num_shards_;
+  record_writer_.emplace(
+      std::forward_as_tuple(filename, O_WRONLY | O_CREAT | O_TRUNC),
+      options_);
+  if (ABSL_PREDICT_FALSE(!record_writer_->healthy())) {
+    status_ = record_writer_->status();
+    return false;
+  }
+  return true;
+}
+
+bool ShardedRecordWriter::CloseShard() {
+  const bool ok = record_writer_->Close();
+  if (ABSL_PREDICT_FALSE(!ok)) status_ = record_writer_->status();
+  record_writer_.reset();
+  return ok;
+}
+
+bool ShardedRecordWriter::WriteRecord(std::string&& record) {
+  if (ABSL_PREDICT_FALSE(!status_.ok())) return false;
+  if (record_writer_ == absl::nullopt) {
+    if (ABSL_PREDICT_FALSE(!OpenShard())) return false;
+  } else if (shard_size_ > 0 &&
+             record_writer_->EstimatedSize() >= shard_size_) {
+    if (ABSL_PREDICT_FALSE(!CloseShard())) return false;
+    if (ABSL_PREDICT_FALSE(!OpenShard())) return false;
+  }
+  if (ABSL_PREDICT_FALSE(!record_writer_->WriteRecord(std::move(record)))) {
+    status_ = record_writer_->status();
+    return false;
+  }
+  ++num_records_;
+  return true;
+}
+
+bool ShardedRecordWriter::Close() {
+  if (ABSL_PREDICT_FALSE(!status_.ok())) return false;
+  // An empty output is still a valid file.
+  if (record_writer_ == absl::nullopt && ABSL_PREDICT_FALSE(!OpenShard())) {
+    return false;
+  }
+  return CloseShard();
+}
+
+// Verifies checksums of `records`, splitting them among `parallelism`
+// concurrent tasks.
+absl::Status VerifyChecksums(const std::vector<TFRecord>& records,
+                             int parallelism) {
+  const size_t num_tasks =
+      std::min(records.size(), IntCast<size_t>(std::max(parallelism, 1)));
+  if (num_tasks == 0) return absl::OkStatus();
+  std::vector<size_t> task_failures(num_tasks, records.size());
+  absl::BlockingCounter pending_tasks(IntCast<int>(num_tasks));
+  for (size_t task = 0; task < num_tasks; ++task) {
+    internal::ThreadPool::global().Schedule([&, task] {
+      const size_t end = records.size() * (task + 1) / num_tasks;
+      for (size_t i = records.size() * task / num_tasks; i < end; ++i) {
+        const TFRecord& record = records[i];
+        if (ABSL_PREDICT_FALSE(
+                tensorflow::crc32c::Unmask(record.masked_crc) !=
+                tensorflow::crc32c::Value(record.data.data(),
+                                          record.data.size()))) {
+          task_failures[task] = i;
+          break;
+        }
+      }
+      pending_tasks.DecrementCount();
+    });
+  }
+  pending_tasks.Wait();
+  for (const size_t failure : task_failures) {
+    if (ABSL_PREDICT_FALSE(failure != records.size())) {
+      return absl::DataLossError(absl::StrCat(
+          "Corrupted TFRecord file: record checksum mismatch, record #",
+          failure, " of the batch"));
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Reads the next TFRecord record from `src`, verifying the checksum of its
+// length.
+//
+// Return values:
+//  * `true`                      - success (`record` is set)
+//  * `false` (when `healthy()`)  - source ends
+//  * `false` (when `!healthy()`) - failure
+bool ReadTFRecord(Reader& src, TFRecord& record) {
+  if (!src.Pull(sizeof(uint64_t) + sizeof(uint32_t))) {
+    if (ABSL_PREDICT_FALSE(src.available() > 0)) {
+      return src.Fail(absl::DataLossError("Truncated TFRecord file"));
+    }
+    return false;
+  }
+  const uint64_t length = ReadLittleEndian64(src.cursor());
+  if (ABSL_PREDICT_FALSE(
+          tensorflow::crc32c::Unmask(
+              ReadLittleEndian32(src.cursor() + sizeof(uint64_t))) !=
+          tensorflow::crc32c::Value(src.cursor(), sizeof(uint64_t)))) {
+    return src.Fail(absl::DataLossError(
+        "Corrupted TFRecord file: record length checksum mismatch"));
+  }
+  src.move_cursor(sizeof(uint64_t) + sizeof(uint32_t));
+  if (ABSL_PREDICT_FALSE(length > record.data.max_size() ||
+                         !src.Read(IntCast<size_t>(length), record.data))) {
+    if (ABSL_PREDICT_FALSE(!src.healthy())) return false;
+    return src.Fail(absl::DataLossError("Truncated TFRecord file"));
+  }
+  const absl::optional<uint32_t> masked_crc = ReadLittleEndian32(src);
+  if (ABSL_PREDICT_FALSE(masked_crc == absl::nullopt)) {
+    if (ABSL_PREDICT_FALSE(!src.healthy())) return false;
+    return src.Fail(absl::DataLossError("Truncated TFRecord file"));
+  }
+  record.masked_crc = *masked_crc;
+  return true;
+}
+
+// Converts one TFRecord file, appending its records to `dest`.
+absl::Status ConvertFile(const std::string& filename, int parallelism,
+                         uint64_t batch_size, ShardedRecordWriter& dest) {
+  FdReader<> file_reader(filename, O_RDONLY);
+  tensorflow::io::RecordReaderOptions record_reader_options;
+  {
+    TFRecordRecognizer tfrecord_recognizer(&file_reader);
+    if (!tfrecord_recognizer.CheckFileFormat(record_reader_options)) {
+      if (ABSL_PREDICT_FALSE(!tfrecord_recognizer.healthy())) {
+        return tfrecord_recognizer.status();
+      }
+      // Empty file.
+      return absl::OkStatus();
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!file_reader.Seek(0))) return file_reader.status();
+  absl::optional<ZlibReader<>> decompressor;
+  Reader* src = &file_reader;
+  if (record_reader_options.compression_type ==
+      tensorflow::io::RecordReaderOptions::ZLIB_COMPRESSION) {
+    decompressor.emplace(&file_reader);
+    src = &*decompressor;
+  }
+  std::vector<TFRecord> batch;
+  uint64_t batch_bytes = 0;
+  for (;;) {
+    TFRecord record;
+    const bool have_record = ReadTFRecord(*src, record);
+    if (have_record) {
+      batch_bytes += record.data.size();
+      batch.push_back(std::move(record));
+    } else if (ABSL_PREDICT_FALSE(!src->healthy())) {
+      return src->status();
+    }
+    if (batch_bytes >= batch_size || (!have_record && !batch.empty())) {
+      {
+        const absl::Status status = VerifyChecksums(batch, parallelism);
+        if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+      }
+      for (TFRecord& verified : batch) {
+        if (ABSL_PREDICT_FALSE(!dest.WriteRecord(std::move(verified.data)))) {
+          return dest.status();
+        }
+      }
+      batch.clear();
+      batch_bytes = 0;
+    }
+    if (!have_record) break;
+  }
+  if (decompressor != absl::nullopt &&
+      ABSL_PREDICT_FALSE(!decompressor->VerifyEndAndClose())) {
+    return decompressor->status();
+  }
+  if (ABSL_PREDICT_FALSE(!file_reader.Close())) return file_reader.status();
+  return absl::OkStatus();
+}
+
+const char kUsage[] =
+    "Usage: tfrecord_to_riegeli --output=FILE (OPTION|FILE)...\n"
+    "\n"
+    "Converts TFRecord files, uncompressed or compressed with zlib or gzip,\n"
+    "to a Riegeli/records file, optionally sharded. Record checksums are\n"
+    "verified concurrently.\n";
+
+}  // namespace
+}  // namespace tools
+}  // namespace riegeli
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(riegeli::tools::kUsage);
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    absl::Format(&std::cerr, "Missing --output\n");
+    return 1;
+  }
+  riegeli::RecordWriterBase::Options record_writer_options;
+  {
+    const absl::Status status = record_writer_options.FromString(
+        absl::GetFlag(FLAGS_record_writer_options));
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s\n", status.message());
+      return 1;
+    }
+  }
+  riegeli::tools::ShardedRecordWriter dest(output,
+                                           absl::GetFlag(FLAGS_shard_size),
+                                           std::move(record_writer_options));
+  for (size_t i = 1; i < args.size(); ++i) {
+    const absl::Status status = riegeli::tools::ConvertFile(
+        args[i], absl::GetFlag(FLAGS_parallelism),
+        absl::GetFlag(FLAGS_batch_size), dest);
+    if (!status.ok()) {
+      absl::Format(&std::cerr, "%s: %s\n", args[i], status.message());
+      return 1;
+    }
+  }
+  if (!dest.Close()) {
+    absl::Format(&std::cerr, "%s\n", dest.status().message());
+    return 1;
+  }
+  absl::Format(&std::cerr, "Converted %u records into %d files\n",
+               dest.num_records(), dest.num_shards());
+  return 0;
+}
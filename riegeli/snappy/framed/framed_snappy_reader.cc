@@ -17,16 +17,23 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
 #include "crc32c/crc32c.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
+#include "riegeli/base/parallelism.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/pullable_reader.h"
 #include "riegeli/bytes/reader.h"
@@ -42,9 +49,40 @@ inline uint32_t MaskChecksum(uint32_t x) {
   return ((x >> 15) | (x << 17)) + 0xa282ead8;
 }
 
+// Skips `length` bytes of `src`. If they are not available, leaves `src`
+// unchanged if possible, and returns `false`.
+bool SkipChunk(Reader& src, size_t length) {
+  if (src.SupportsRandomAccess()) {
+    const Position pos = src.pos();
+    if (src.Skip(length)) return true;
+    src.Seek(pos);
+    return false;
+  }
+  if (!src.Pull(length)) return false;
+  src.move_cursor(length);
+  return true;
+}
+
 }  // namespace
 
-void FramedSnappyReaderBase::Initialize(Reader* src) {
+// A data chunk decompressed in background.
+struct FramedSnappyReaderBase::Frame {
+  // Position of the chunk relative to `initial_compressed_pos_`.
+  Position compressed_pos = 0;
+  uint8_t chunk_type = 0;
+  uint32_t checksum = 0;
+  // Chunk data after the checksum.
+  std::string chunk_data;
+  Buffer uncompressed;
+  // Decompressed data, pointing into `uncompressed` or `chunk_data`.
+  absl::string_view data;
+  // If not empty, the chunk is invalid.
+  absl::string_view error;
+  // Set when processing completed. Guarded by `*frames_mutex_`.
+  bool done = false;
+};
+
+void FramedSnappyReaderBase::Initialize(Reader* src, int parallelism) {
   RIEGELI_ASSERT(src != nullptr)
       << "Failed precondition of FramedSnappyReader: null Reader pointer";
   if (ABSL_PREDICT_FALSE(!src->healthy()) && src->available() == 0) {
@@ -52,6 +90,8 @@ void FramedSnappyReaderBase::Initialize(Reader* src) {
     return;
   }
   initial_compressed_pos_ = src->pos();
+  parallelism_ = parallelism;
+  if (parallelism_ > 0) frames_mutex_ = std::make_shared<absl::Mutex>();
 }
 
 void FramedSnappyReaderBase::Done() {
@@ -63,6 +103,13 @@ void FramedSnappyReaderBase::Done() {
   }
   PullableReader::Done();
   uncompressed_ = Buffer();
+  ClearFrames();
+}
+
+inline void FramedSnappyReaderBase::ClearFrames() {
+  // Background tasks keep their frames alive.
+  pending_frames_.clear();
+  current_frame_.reset();
 }
 
 bool FramedSnappyReaderBase::FailInvalidStream(absl::string_view message) {
@@ -89,6 +136,10 @@ bool FramedSnappyReaderBase::PullBehindScratch() {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   Reader& src = *src_reader();
   truncated_ = false;
+  if (parallelism_ > 0) {
+    current_frame_.reset();
+    return PullParallel(src);
+  }
   while (src.Pull(sizeof(uint32_t))) {
     const uint32_t chunk_header = ReadLittleEndian32(src.cursor());
     const uint8_t chunk_type = static_cast<uint8_t>(chunk_header);
@@ -137,6 +188,7 @@ bool FramedSnappyReaderBase::PullBehindScratch() {
           return FailInvalidStream(
               "Invalid FramedSnappy-compressed stream: wrong checksum");
         }
+        AddChunkPosition(src.pos() - initial_compressed_pos_, limit_pos());
         src.move_cursor(sizeof(uint32_t) + chunk_length);
         if (ABSL_PREDICT_FALSE(uncompressed_length == 0)) continue;
         if (ABSL_PREDICT_FALSE(uncompressed_length >
@@ -169,6 +221,7 @@ bool FramedSnappyReaderBase::PullBehindScratch() {
           set_buffer();
           return FailInvalidStream("wrong checksum");
         }
+        AddChunkPosition(src.pos() - initial_compressed_pos_, limit_pos());
         src.move_cursor(sizeof(uint32_t) + chunk_length);
         if (ABSL_PREDICT_FALSE(uncompressed_length == 0)) continue;
         if (ABSL_PREDICT_FALSE(uncompressed_length >
@@ -206,6 +259,184 @@ bool FramedSnappyReaderBase::PullBehindScratch() {
   return false;
 }
 
+inline bool FramedSnappyReaderBase::PullParallel(Reader& src) {
+  for (;;) {
+    ScheduleFrames(src);
+    if (pending_frames_.empty()) {
+      // The next chunk is not a valid data chunk, or the source ended. Process
+      // it in the calling thread, which reports the end or the failure.
+      const int parallelism = parallelism_;
+      parallelism_ = 0;
+      const bool result = PullBehindScratch();
+      parallelism_ = parallelism;
+      return result;
+    }
+    std::shared_ptr<Frame> frame = std::move(pending_frames_.front());
+    pending_frames_.pop_front();
+    {
+      absl::MutexLock lock(frames_mutex_.get());
+      frames_mutex_->Await(absl::Condition(&frame->done));
+    }
+    if (ABSL_PREDICT_FALSE(!frame->error.empty())) {
+      set_buffer();
+      ClearFrames();
+      return FailInvalidStream(frame->error);
+    }
+    AddChunkPosition(frame->compressed_pos, limit_pos());
+    if (ABSL_PREDICT_FALSE(frame->data.empty())) continue;
+    if (ABSL_PREDICT_FALSE(frame->data.size() >
+                           std::numeric_limits<Position>::max() -
+                               limit_pos())) {
+      set_buffer();
+      ClearFrames();
+      return FailOverflow();
+    }
+    set_buffer(frame->data.data(), frame->data.size());
+    move_limit_pos(available());
+    current_frame_ = std::move(frame);
+    return true;
+  }
+}
+
+inline void FramedSnappyReaderBase::ScheduleFrames(Reader& src) {
+  while (pending_frames_.size() < IntCast<size_t>(parallelism_) &&
+         src.Pull(sizeof(uint32_t))) {
+    const uint32_t chunk_header = ReadLittleEndian32(src.cursor());
+    const uint8_t chunk_type = static_cast<uint8_t>(chunk_header);
+    const size_t chunk_length = IntCast<size_t>(chunk_header >> 8);
+    if ((src.pos() == 0 && chunk_type != 0xff /* Stream identifier */) ||
+        (chunk_type != 0x00 /* Compressed data */ &&
+         chunk_type != 0x01 /* Uncompressed data */ &&
+         chunk_type != 0xff /* Stream identifier */ && chunk_type < 0x80) ||
+        !src.Pull(sizeof(uint32_t) + chunk_length)) {
+      return;
+    }
+    if (chunk_type == 0xff) {
+      if (absl::string_view(src.cursor() + sizeof(uint32_t), chunk_length) !=
+          absl::string_view("sNaPpY", 6)) {
+        return;
+      }
+      src.move_cursor(sizeof(uint32_t) + chunk_length);
+      continue;
+    }
+    if (chunk_type >= 0x80) {
+      // Skippable chunk.
+      src.move_cursor(sizeof(uint32_t) + chunk_length);
+      continue;
+    }
+    if (chunk_length < sizeof(uint32_t)) return;
+    std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+    frame->compressed_pos = src.pos() - initial_compressed_pos_;
+    frame->chunk_type = chunk_type;
+    frame->checksum = ReadLittleEndian32(src.cursor() + sizeof(uint32_t));
+    frame->chunk_data.assign(src.cursor() + 2 * sizeof(uint32_t),
+                             chunk_length - sizeof(uint32_t));
+    src.move_cursor(sizeof(uint32_t) + chunk_length);
+    pending_frames_.push_back(frame);
+    internal::ThreadPool::global().Schedule([frame = std::move(frame),
+                                             mutex = frames_mutex_] {
+      if (frame->chunk_type == 0x00) {
+        size_t uncompressed_length;
+        if (ABSL_PREDICT_FALSE(!snappy::GetUncompressedLength(
+                frame->chunk_data.data(), frame->chunk_data.size(),
+                &uncompressed_length))) {
+          frame->error = "invalid uncompressed length";
+        } else if (ABSL_PREDICT_FALSE(uncompressed_length >
+                                      snappy::kBlockSize)) {
+          frame->error = "uncompressed length too large";
+        } else {
+          frame->uncompressed.Reset(uncompressed_length);
+          if (ABSL_PREDICT_FALSE(!snappy::RawUncompress(
+                  frame->chunk_data.data(), frame->chunk_data.size(),
+                  frame->uncompressed.data()))) {
+            frame->error = "invalid compressed data";
+          } else {
+            frame->data = absl::string_view(frame->uncompressed.data(),
+                                            uncompressed_length);
+          }
+        }
+      } else if (ABSL_PREDICT_FALSE(frame->chunk_data.size() >
+                                    snappy::kBlockSize)) {
+        frame->error = "uncompressed length too large";
+      } else {
+        frame->data = frame->chunk_data;
+      }
+      if (frame->error.empty() &&
+          ABSL_PREDICT_FALSE(MaskChecksum(crc32c::Crc32c(
+                                 frame->data.data(), frame->data.size())) !=
+                             frame->checksum)) {
+        frame->error = "wrong checksum";
+      }
+      absl::MutexLock lock(mutex.get());
+      frame->done = true;
+    });
+  }
+}
+
+inline void FramedSnappyReaderBase::AddChunkPosition(
+    Position compressed_pos, Position uncompressed_pos) {
+  if (chunk_positions_.empty() ||
+      compressed_pos > chunk_positions_.back().compressed_pos) {
+    chunk_positions_.push_back(ChunkPosition{compressed_pos, uncompressed_pos});
+  }
+}
+
+inline void FramedSnappyReaderBase::SkipChunks(Reader& src,
+                                               Position new_pos) {
+  while (src.Pull(sizeof(uint32_t))) {
+    const uint32_t chunk_header = ReadLittleEndian32(src.cursor());
+    const uint8_t chunk_type = static_cast<uint8_t>(chunk_header);
+    const size_t chunk_length = IntCast<size_t>(chunk_header >> 8);
+    if (src.pos() == 0 && chunk_type != 0xff /* Stream identifier */) return;
+    switch (chunk_type) {
+      case 0x00:    // Compressed data.
+      case 0x01: {  // Uncompressed data.
+        if (chunk_length < sizeof(uint32_t)) return;
+        size_t uncompressed_length = chunk_length - sizeof(uint32_t);
+        if (chunk_type == 0x00) {
+          // The uncompressed length is a varint at the beginning of compressed
+          // data.
+          const size_t prefix_length = UnsignedMin(uncompressed_length, 5u);
+          if (!src.Pull(2 * sizeof(uint32_t) + prefix_length) ||
+              !snappy::GetUncompressedLength(
+                  src.cursor() + 2 * sizeof(uint32_t), prefix_length,
+                  &uncompressed_length)) {
+            return;
+          }
+        }
+        if (uncompressed_length > snappy::kBlockSize ||
+            uncompressed_length >
+                std::numeric_limits<Position>::max() - limit_pos()) {
+          return;
+        }
+        AddChunkPosition(src.pos() - initial_compressed_pos_, limit_pos());
+        // Stop at the chunk containing `new_pos`.
+        if (new_pos < limit_pos() + uncompressed_length) return;
+        if (!SkipChunk(src, sizeof(uint32_t) + chunk_length)) return;
+        set_limit_pos(limit_pos() + uncompressed_length);
+        continue;
+      }
+      case 0xff:  // Stream identifier.
+        if (!src.Pull(sizeof(uint32_t) + chunk_length) ||
+            absl::string_view(src.cursor() + sizeof(uint32_t), chunk_length) !=
+                absl::string_view("sNaPpY", 6)) {
+          return;
+        }
+        src.move_cursor(sizeof(uint32_t) + chunk_length);
+        continue;
+      default:
+        if (chunk_type < 0x80) return;
+        if (!SkipChunk(src, sizeof(uint32_t) + chunk_length)) return;
+        continue;
+    }
+  }
+}
+
+bool FramedSnappyReaderBase::SupportsRandomAccess() {
+  Reader* const src = src_reader();
+  return src != nullptr && src->SupportsRandomAccess();
+}
+
 bool FramedSnappyReaderBase::SupportsRewind() {
   Reader* const src = src_reader();
   return src != nullptr && src->SupportsRewind();
@@ -218,13 +449,38 @@ bool FramedSnappyReaderBase::SeekBehindScratch(Position new_pos) {
   RIEGELI_ASSERT(!scratch_used())
       << "Failed precondition of PullableReader::SeekBehindScratch(): "
          "scratch used";
-  if (new_pos <= limit_pos()) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  Reader& src = *src_reader();
+  if (src.SupportsRandomAccess()) {
+    // Jump to the last known chunk at or before `new_pos`.
+    const auto iter = std::upper_bound(
+        chunk_positions_.begin(), chunk_positions_.end(), new_pos,
+        [](Position value, const ChunkPosition& chunk_position) {
+          return value < chunk_position.uncompressed_pos;
+        });
+    const ChunkPosition chunk_position =
+        iter == chunk_positions_.begin() ? ChunkPosition{0, 0}
+                                         : *std::prev(iter);
+    if (new_pos <= limit_pos() ||
+        chunk_position.uncompressed_pos > limit_pos()) {
+      truncated_ = false;
+      set_buffer();
+      set_limit_pos(chunk_position.uncompressed_pos);
+      ClearFrames();
+      if (ABSL_PREDICT_FALSE(!src.Seek(initial_compressed_pos_ +
+                                       chunk_position.compressed_pos))) {
+        src.Fail(absl::DataLossError(
+            "FramedSnappy-compressed stream got truncated"));
+        return Fail(src);
+      }
+      if (new_pos == limit_pos()) return true;
+    }
+  } else if (new_pos <= limit_pos()) {
     // Seeking backwards.
-    if (ABSL_PREDICT_FALSE(!healthy())) return false;
-    Reader& src = *src_reader();
     truncated_ = false;
     set_buffer();
     set_limit_pos(0);
+    ClearFrames();
     if (ABSL_PREDICT_FALSE(!src.Seek(initial_compressed_pos_))) {
       src.Fail(
           absl::DataLossError("FramedSnappy-compressed stream got truncated"));
@@ -233,7 +489,30 @@ bool FramedSnappyReaderBase::SeekBehindScratch(Position new_pos) {
     if (ABSL_PREDICT_FALSE(!healthy())) return false;
     if (new_pos == 0) return true;
   }
+  if (pending_frames_.empty()) {
+    // Skip whole chunks before `new_pos` without decompressing them.
+    set_buffer();
+    current_frame_.reset();
+    SkipChunks(src, new_pos);
+  }
   return PullableReader::SeekBehindScratch(new_pos);
 }
 
+absl::optional<Position> FramedSnappyReaderBase::SizeImpl() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  Reader& src = *src_reader();
+  if (ABSL_PREDICT_FALSE(!src.SupportsRandomAccess())) {
+    Fail(absl::UnimplementedError(
+        "FramedSnappyReaderBase::Size() requires random access to the source"));
+    return absl::nullopt;
+  }
+  // Seeking to the end skips chunks without decompressing them.
+  const Position pos_before = pos();
+  Seek(std::numeric_limits<Position>::max());
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  const Position size = pos();
+  if (ABSL_PREDICT_FALSE(!Seek(pos_before))) return absl::nullopt;
+  return size;
+}
+
 }  // namespace riegeli
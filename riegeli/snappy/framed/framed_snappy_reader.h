@@ -17,14 +17,20 @@
 
 #include <stddef.h>
 
+#include <deque>
+#include <memory>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
 #include "riegeli/base/dependency.h"
 #include "riegeli/base/object.h"
@@ -36,12 +42,43 @@ namespace riegeli {
 // Template parameter independent part of `FramedSnappyReader`.
 class FramedSnappyReaderBase : public PullableReader {
  public:
-  class Options {};
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Number of background threads to use for decompressing and verifying
+    // checksums of frames, which are read ahead from the source. Decompressed
+    // data are returned in the original order.
+    //
+    // If 0, decompresses in the calling thread.
+    //
+    // Default: 0.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GE(parallelism, 0)
+          << "Failed precondition of "
+             "FramedSnappyReaderBase::Options::set_parallelism(): "
+             "negative parallelism";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+   private:
+    int parallelism_ = 0;
+  };
 
   // Returns the compressed `Reader`. Unchanged by `Close()`.
   virtual Reader* src_reader() = 0;
   virtual const Reader* src_reader() const = 0;
 
+  // `FramedSnappyReader` supports random access if the source supports random
+  // access. Positions of chunks are remembered as they are encountered, so
+  // that seeking can start decompression from the nearest chunk, and seeking
+  // forwards skips whole chunks without decompressing them.
+  bool SupportsRandomAccess() override;
   bool SupportsRewind() override;
 
  protected:
@@ -55,7 +92,7 @@ class FramedSnappyReaderBase : public PullableReader {
 
   void Reset(InitiallyClosed);
   void Reset(InitiallyOpen);
-  void Initialize(Reader* src);
+  void Initialize(Reader* src, int parallelism);
 
   void Done() override;
   // `FramedSnappyReaderBase` overrides `Reader::AnnotateFailure()` to annotate
@@ -65,21 +102,56 @@ class FramedSnappyReaderBase : public PullableReader {
   ABSL_ATTRIBUTE_COLD void AnnotateFailure(absl::Status& status) override;
   bool PullBehindScratch() override;
   bool SeekBehindScratch(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
 
  private:
+  struct ChunkPosition {
+    // Position of a data chunk relative to `initial_compressed_pos_`.
+    Position compressed_pos;
+    // Uncompressed position of the beginning of its data.
+    Position uncompressed_pos;
+  };
+
   ABSL_ATTRIBUTE_COLD bool FailInvalidStream(absl::string_view message);
+  void AddChunkPosition(Position compressed_pos, Position uncompressed_pos);
+  // Skips data chunks which end before or at `new_pos`, reading only their
+  // headers. Stops early at anything which needs decompression to be
+  // processed, e.g. an invalid chunk.
+  //
+  // Precondition: no buffered data
+  void SkipChunks(Reader& src, Position new_pos);
+  // Implementation of `PullBehindScratch()` if `parallelism_ > 0`.
+  bool PullParallel(Reader& src);
+  // Reads ahead data chunks from `src`, scheduling them to be decompressed in
+  // background, until `parallelism_` frames are pending or the next chunk
+  // must be processed by the calling thread.
+  void ScheduleFrames(Reader& src);
+  void ClearFrames();
+
+  struct Frame;
 
   // If `true`, the source is truncated (without a clean end of the compressed
   // stream) at the current position. If the source does not grow, `Close()`
   // will fail.
   bool truncated_ = false;
   Position initial_compressed_pos_ = 0;
+  int parallelism_ = 0;
   // Buffered uncompressed data.
   Buffer uncompressed_;
+  // Frames being decompressed in background if `parallelism_ > 0`, in the
+  // order of the source.
+  std::deque<std::shared_ptr<Frame>> pending_frames_;
+  // The frame holding buffered uncompressed data if `parallelism_ > 0`.
+  std::shared_ptr<Frame> current_frame_;
+  // Guards `Frame::done`. Shared with background tasks, which can outlive the
+  // `FramedSnappyReaderBase`.
+  std::shared_ptr<absl::Mutex> frames_mutex_;
+  // Known data chunks, sorted by position.
+  std::vector<ChunkPosition> chunk_positions_;
 
   // Invariant if scratch is not used:
   //   `start() == nullptr` or `start() == uncompressed_.data()` or
-  //   `limit() == src_reader()->cursor()`
+  //   `limit() == src_reader()->cursor()` or `current_frame_ != nullptr`
 };
 
 // A `Reader` which decompresses data with framed Snappy format after getting
@@ -171,7 +243,12 @@ inline FramedSnappyReaderBase::FramedSnappyReaderBase(
       // part was moved.
       truncated_(that.truncated_),
       initial_compressed_pos_(that.initial_compressed_pos_),
-      uncompressed_(std::move(that.uncompressed_)) {}
+      parallelism_(that.parallelism_),
+      uncompressed_(std::move(that.uncompressed_)),
+      pending_frames_(std::move(that.pending_frames_)),
+      current_frame_(std::move(that.current_frame_)),
+      frames_mutex_(std::move(that.frames_mutex_)),
+      chunk_positions_(std::move(that.chunk_positions_)) {}
 
 inline FramedSnappyReaderBase& FramedSnappyReaderBase::operator=(
     FramedSnappyReaderBase&& that) noexcept {
@@ -180,7 +257,12 @@ inline FramedSnappyReaderBase& FramedSnappyReaderBase::operator=(
   // was moved.
   truncated_ = that.truncated_;
   initial_compressed_pos_ = that.initial_compressed_pos_;
+  parallelism_ = that.parallelism_;
   uncompressed_ = std::move(that.uncompressed_);
+  pending_frames_ = std::move(that.pending_frames_);
+  current_frame_ = std::move(that.current_frame_);
+  frames_mutex_ = std::move(that.frames_mutex_);
+  chunk_positions_ = std::move(that.chunk_positions_);
   return *this;
 }
 
@@ -188,25 +270,35 @@ inline void FramedSnappyReaderBase::Reset(InitiallyClosed) {
   PullableReader::Reset(kInitiallyClosed);
   truncated_ = false;
   initial_compressed_pos_ = 0;
+  parallelism_ = 0;
+  pending_frames_.clear();
+  current_frame_.reset();
+  frames_mutex_.reset();
+  chunk_positions_.clear();
 }
 
 inline void FramedSnappyReaderBase::Reset(InitiallyOpen) {
   PullableReader::Reset(kInitiallyOpen);
   truncated_ = false;
   initial_compressed_pos_ = 0;
+  parallelism_ = 0;
+  pending_frames_.clear();
+  current_frame_.reset();
+  frames_mutex_.reset();
+  chunk_positions_.clear();
 }
 
 template <typename Src>
 inline FramedSnappyReader<Src>::FramedSnappyReader(const Src& src,
                                                    Options options)
     : FramedSnappyReaderBase(kInitiallyOpen), src_(src) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options.parallelism());
 }
 
 template <typename Src>
 inline FramedSnappyReader<Src>::FramedSnappyReader(Src&& src, Options options)
     : FramedSnappyReaderBase(kInitiallyOpen), src_(std::move(src)) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options.parallelism());
 }
 
 template <typename Src>
@@ -214,7 +306,7 @@ template <typename... SrcArgs>
 inline FramedSnappyReader<Src>::FramedSnappyReader(
     std::tuple<SrcArgs...> src_args, Options options)
     : FramedSnappyReaderBase(kInitiallyOpen), src_(std::move(src_args)) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options.parallelism());
 }
 
 template <typename Src>
@@ -246,14 +338,14 @@ template <typename Src>
 inline void FramedSnappyReader<Src>::Reset(const Src& src, Options options) {
   FramedSnappyReaderBase::Reset(kInitiallyOpen);
   src_.Reset(src);
-  Initialize(src_.get());
+  Initialize(src_.get(), options.parallelism());
 }
 
 template <typename Src>
 inline void FramedSnappyReader<Src>::Reset(Src&& src, Options options) {
   FramedSnappyReaderBase::Reset(kInitiallyOpen);
   src_.Reset(std::move(src));
-  Initialize(src_.get());
+  Initialize(src_.get(), options.parallelism());
 }
 
 template <typename Src>
@@ -262,7 +354,7 @@ inline void FramedSnappyReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
                                            Options options) {
   FramedSnappyReaderBase::Reset(kInitiallyOpen);
   src_.Reset(std::move(src_args));
-  Initialize(src_.get());
+  Initialize(src_.get(), options.parallelism());
 }
 
 template <typename Src>
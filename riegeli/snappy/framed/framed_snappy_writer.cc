@@ -19,15 +19,19 @@
 
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "crc32c/crc32c.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
+#include "riegeli/base/parallelism.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/writer.h"
 #include "riegeli/endian/endian_writing.h"
@@ -42,8 +46,53 @@ inline uint32_t MaskChecksum(uint32_t x) {
   return ((x >> 15) | (x << 17)) + 0xa282ead8;
 }
 
+// Returns the maximum size of a chunk compressed by `CompressChunk()`.
+inline size_t MaxChunkLength(size_t uncompressed_length) {
+  return 2 * sizeof(uint32_t) +
+         snappy::MaxCompressedLength(uncompressed_length);
+}
+
+// Writes a chunk with `uncompressed_data[0..uncompressed_length)` to `dest`,
+// which must have `MaxChunkLength(uncompressed_length)` bytes available.
+//
+// Returns the length of the chunk.
+size_t CompressChunk(const char* uncompressed_data, size_t uncompressed_length,
+                     char* dest) {
+  size_t compressed_length;
+  snappy::RawCompress(uncompressed_data, uncompressed_length,
+                      dest + 2 * sizeof(uint32_t), &compressed_length);
+  if (compressed_length < uncompressed_length) {
+    WriteLittleEndian32(
+        IntCast<uint32_t>(0x00 /* Compressed data */ |
+                          ((sizeof(uint32_t) + compressed_length) << 8)),
+        dest);
+  } else {
+    std::memcpy(dest + 2 * sizeof(uint32_t), uncompressed_data,
+                uncompressed_length);
+    compressed_length = uncompressed_length;
+    WriteLittleEndian32(
+        IntCast<uint32_t>(0x01 /* Uncompressed data */ |
+                          ((sizeof(uint32_t) + compressed_length) << 8)),
+        dest);
+  }
+  WriteLittleEndian32(
+      MaskChecksum(crc32c::Crc32c(uncompressed_data, uncompressed_length)),
+      dest + sizeof(uint32_t));
+  return 2 * sizeof(uint32_t) + compressed_length;
+}
+
 }  // namespace
 
+// A frame compressed in background.
+struct FramedSnappyWriterBase::Frame {
+  Buffer uncompressed;
+  size_t uncompressed_length = 0;
+  Buffer compressed;
+  size_t compressed_length = 0;
+  // Set when compression completed. Guarded by `*frames_mutex_`.
+  bool done = false;
+};
+
 void FramedSnappyWriterBase::Initialize(Writer* dest) {
   RIEGELI_ASSERT(dest != nullptr)
       << "Failed precondition of FramedSnappyWriter: null Writer pointer";
@@ -92,46 +141,71 @@ inline bool FramedSnappyWriterBase::PushInternal(Writer& dest) {
       << "Failed invariant of FramedSnappyWriterBase: buffer too large";
   if (uncompressed_length == 0) return true;
   set_cursor(start());
-  const char* const uncompressed_data = cursor();
-  if (ABSL_PREDICT_FALSE(
-          !dest.Push(2 * sizeof(uint32_t) +
-                     snappy::MaxCompressedLength(uncompressed_length)))) {
-    return Fail(dest);
+  if (parallelism_ > 0) {
+    while (pending_frames_.size() >= IntCast<size_t>(parallelism_)) {
+      if (ABSL_PREDICT_FALSE(!WritePendingFrame(dest))) return false;
+    }
+    if (frames_mutex_ == nullptr) {
+      frames_mutex_ = std::make_shared<absl::Mutex>();
+    }
+    // The frame takes over `uncompressed_`, which `PushBehindScratch()`
+    // allocates again.
+    std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+    frame->uncompressed = std::move(uncompressed_);
+    frame->uncompressed_length = uncompressed_length;
+    set_buffer();
+    pending_frames_.push_back(frame);
+    internal::ThreadPool::global().Schedule(
+        [frame = std::move(frame), mutex = frames_mutex_] {
+          frame->compressed.Reset(MaxChunkLength(frame->uncompressed_length));
+          frame->compressed_length =
+              CompressChunk(frame->uncompressed.data(),
+                            frame->uncompressed_length,
+                            frame->compressed.data());
+          frame->uncompressed = Buffer();
+          absl::MutexLock lock(mutex.get());
+          frame->done = true;
+        });
+    move_start_pos(uncompressed_length);
+    return true;
   }
-  char* const compressed_chunk = dest.cursor();
-  size_t compressed_length;
-  snappy::RawCompress(uncompressed_data, uncompressed_length,
-                      compressed_chunk + 2 * sizeof(uint32_t),
-                      &compressed_length);
-  if (compressed_length < uncompressed_length) {
-    WriteLittleEndian32(
-        IntCast<uint32_t>(0x00 /* Compressed data */ |
-                          ((sizeof(uint32_t) + compressed_length) << 8)),
-        compressed_chunk);
-  } else {
-    std::memcpy(compressed_chunk + 2 * sizeof(uint32_t), uncompressed_data,
-                uncompressed_length);
-    compressed_length = uncompressed_length;
-    WriteLittleEndian32(
-        IntCast<uint32_t>(0x01 /* Uncompressed data */ |
-                          ((sizeof(uint32_t) + compressed_length) << 8)),
-        compressed_chunk);
+  if (ABSL_PREDICT_FALSE(!dest.Push(MaxChunkLength(uncompressed_length)))) {
+    return Fail(dest);
   }
-  WriteLittleEndian32(
-      MaskChecksum(crc32c::Crc32c(uncompressed_data, uncompressed_length)),
-      compressed_chunk + sizeof(uint32_t));
-  dest.move_cursor(2 * sizeof(uint32_t) + compressed_length);
+  dest.move_cursor(
+      CompressChunk(cursor(), uncompressed_length, dest.cursor()));
   move_start_pos(uncompressed_length);
   return true;
 }
 
+inline bool FramedSnappyWriterBase::WritePendingFrame(Writer& dest) {
+  RIEGELI_ASSERT(!pending_frames_.empty())
+      << "Failed precondition of FramedSnappyWriterBase::WritePendingFrame(): "
+         "no pending frames";
+  const std::shared_ptr<Frame> frame = std::move(pending_frames_.front());
+  pending_frames_.pop_front();
+  {
+    absl::MutexLock lock(frames_mutex_.get());
+    frames_mutex_->Await(absl::Condition(&frame->done));
+  }
+  if (ABSL_PREDICT_FALSE(!dest.Write(absl::string_view(
+          frame->compressed.data(), frame->compressed_length)))) {
+    return Fail(dest);
+  }
+  return true;
+}
+
 bool FramedSnappyWriterBase::FlushBehindScratch(FlushType flush_type) {
   RIEGELI_ASSERT(!scratch_used())
       << "Failed precondition of PushableWriter::FlushBehindScratch(): "
          "scratch used";
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   Writer& dest = *dest_writer();
-  return PushInternal(dest);
+  if (ABSL_PREDICT_FALSE(!PushInternal(dest))) return false;
+  while (!pending_frames_.empty()) {
+    if (ABSL_PREDICT_FALSE(!WritePendingFrame(dest))) return false;
+  }
+  return true;
 }
 
 }  // namespace riegeli
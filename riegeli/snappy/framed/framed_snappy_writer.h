@@ -15,6 +15,8 @@
 #ifndef RIEGELI_SNAPPY_FRAMED_FRAMED_SNAPPY_WRITER_H_
 #define RIEGELI_SNAPPY_FRAMED_FRAMED_SNAPPY_WRITER_H_
 
+#include <deque>
+#include <memory>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -22,6 +24,7 @@
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
@@ -54,8 +57,28 @@ class FramedSnappyWriterBase : public PushableWriter {
     }
     absl::optional<Position> size_hint() const { return size_hint_; }
 
+    // Number of background threads to use for compressing frames. Compressed
+    // frames are written in the original order.
+    //
+    // If 0, compresses in the calling thread.
+    //
+    // Default: 0.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GE(parallelism, 0)
+          << "Failed precondition of "
+             "FramedSnappyWriterBase::Options::set_parallelism(): "
+             "negative parallelism";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
    private:
     absl::optional<Position> size_hint_;
+    int parallelism_ = 0;
   };
 
   // Returns the compressed `Writer`. Unchanged by `Close()`.
@@ -65,13 +88,14 @@ class FramedSnappyWriterBase : public PushableWriter {
  protected:
   FramedSnappyWriterBase() noexcept : PushableWriter(kInitiallyClosed) {}
 
-  explicit FramedSnappyWriterBase(absl::optional<Position> size_hint);
+  explicit FramedSnappyWriterBase(absl::optional<Position> size_hint,
+                                  int parallelism);
 
   FramedSnappyWriterBase(FramedSnappyWriterBase&& that) noexcept;
   FramedSnappyWriterBase& operator=(FramedSnappyWriterBase&& that) noexcept;
 
   void Reset();
-  void Reset(absl::optional<Position> size_hint);
+  void Reset(absl::optional<Position> size_hint, int parallelism);
   void Initialize(Writer* dest);
 
   // `FramedSnappyWriterBase` overrides `Writer::AnnotateFailure()` to annotate
@@ -90,10 +114,24 @@ class FramedSnappyWriterBase : public PushableWriter {
   //
   // Postcondition: `written_to_buffer() == 0`
   bool PushInternal(Writer& dest);
+  // Writes the oldest frame being compressed in background to `dest`, waiting
+  // until it is compressed.
+  //
+  // Precondition: `!pending_frames_.empty()`
+  bool WritePendingFrame(Writer& dest);
+
+  struct Frame;
 
   Position size_hint_ = 0;
+  int parallelism_ = 0;
   // Buffered uncompressed data.
   Buffer uncompressed_;
+  // Frames being compressed in background if `parallelism_ > 0`, in the order
+  // of data.
+  std::deque<std::shared_ptr<Frame>> pending_frames_;
+  // Guards `Frame::done`. Shared with background tasks, which can outlive the
+  // `FramedSnappyWriterBase`.
+  std::shared_ptr<absl::Mutex> frames_mutex_;
 
   // Invariants if scratch is not used:
   //   `start() == nullptr` or `start() == uncompressed_.data()`
@@ -181,8 +219,10 @@ explicit FramedSnappyWriter(
 // Implementation details follow.
 
 inline FramedSnappyWriterBase::FramedSnappyWriterBase(
-    absl::optional<Position> size_hint)
-    : PushableWriter(kInitiallyOpen), size_hint_(size_hint.value_or(0)) {}
+    absl::optional<Position> size_hint, int parallelism)
+    : PushableWriter(kInitiallyOpen),
+      size_hint_(size_hint.value_or(0)),
+      parallelism_(parallelism) {}
 
 inline FramedSnappyWriterBase::FramedSnappyWriterBase(
     FramedSnappyWriterBase&& that) noexcept
@@ -190,7 +230,10 @@ inline FramedSnappyWriterBase::FramedSnappyWriterBase(
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
       size_hint_(that.size_hint_),
-      uncompressed_(std::move(that.uncompressed_)) {}
+      parallelism_(that.parallelism_),
+      uncompressed_(std::move(that.uncompressed_)),
+      pending_frames_(std::move(that.pending_frames_)),
+      frames_mutex_(std::move(that.frames_mutex_)) {}
 
 inline FramedSnappyWriterBase& FramedSnappyWriterBase::operator=(
     FramedSnappyWriterBase&& that) noexcept {
@@ -198,31 +241,43 @@ inline FramedSnappyWriterBase& FramedSnappyWriterBase::operator=(
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   size_hint_ = that.size_hint_;
+  parallelism_ = that.parallelism_;
   uncompressed_ = std::move(that.uncompressed_);
+  pending_frames_ = std::move(that.pending_frames_);
+  frames_mutex_ = std::move(that.frames_mutex_);
   return *this;
 }
 
 inline void FramedSnappyWriterBase::Reset() {
   PushableWriter::Reset(kInitiallyClosed);
   size_hint_ = 0;
+  parallelism_ = 0;
+  pending_frames_.clear();
+  frames_mutex_.reset();
 }
 
-inline void FramedSnappyWriterBase::Reset(absl::optional<Position> size_hint) {
+inline void FramedSnappyWriterBase::Reset(absl::optional<Position> size_hint,
+                                          int parallelism) {
   PushableWriter::Reset(kInitiallyOpen);
   size_hint_ = size_hint.value_or(0);
+  parallelism_ = parallelism;
+  pending_frames_.clear();
+  frames_mutex_.reset();
 }
 
 template <typename Dest>
 inline FramedSnappyWriter<Dest>::FramedSnappyWriter(const Dest& dest,
                                                     Options options)
-    : FramedSnappyWriterBase(options.size_hint()), dest_(dest) {
+    : FramedSnappyWriterBase(options.size_hint(), options.parallelism()),
+      dest_(dest) {
   Initialize(dest_.get());
 }
 
 template <typename Dest>
 inline FramedSnappyWriter<Dest>::FramedSnappyWriter(Dest&& dest,
                                                     Options options)
-    : FramedSnappyWriterBase(options.size_hint()), dest_(std::move(dest)) {
+    : FramedSnappyWriterBase(options.size_hint(), options.parallelism()),
+      dest_(std::move(dest)) {
   Initialize(dest_.get());
 }
 
@@ -230,7 +285,8 @@ template <typename Dest>
 template <typename... DestArgs>
 inline FramedSnappyWriter<Dest>::FramedSnappyWriter(
     std::tuple<DestArgs...> dest_args, Options options)
-    : FramedSnappyWriterBase(options.size_hint()), dest_(std::move(dest_args)) {
+    : FramedSnappyWriterBase(options.size_hint(), options.parallelism()),
+      dest_(std::move(dest_args)) {
   Initialize(dest_.get());
 }
 
@@ -260,14 +316,14 @@ inline void FramedSnappyWriter<Dest>::Reset() {
 
 template <typename Dest>
 inline void FramedSnappyWriter<Dest>::Reset(const Dest& dest, Options options) {
-  FramedSnappyWriterBase::Reset(options.size_hint());
+  FramedSnappyWriterBase::Reset(options.size_hint(), options.parallelism());
   dest_.Reset(dest);
   Initialize(dest_.get());
 }
 
 template <typename Dest>
 inline void FramedSnappyWriter<Dest>::Reset(Dest&& dest, Options options) {
-  FramedSnappyWriterBase::Reset(options.size_hint());
+  FramedSnappyWriterBase::Reset(options.size_hint(), options.parallelism());
   dest_.Reset(std::move(dest));
   Initialize(dest_.get());
 }
@@ -276,7 +332,7 @@ template <typename Dest>
 template <typename... DestArgs>
 inline void FramedSnappyWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
                                             Options options) {
-  FramedSnappyWriterBase::Reset(options.size_hint());
+  FramedSnappyWriterBase::Reset(options.size_hint(), options.parallelism());
   dest_.Reset(std::move(dest_args));
   Initialize(dest_.get());
 }
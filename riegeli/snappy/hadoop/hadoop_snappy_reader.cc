@@ -17,6 +17,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <iterator>
 #include <limits>
 #include <string>
 
@@ -24,6 +26,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
 #include "riegeli/base/status.h"
@@ -34,6 +37,24 @@
 
 namespace riegeli {
 
+namespace {
+
+// Skips `length` bytes of `src`. If they are not available, leaves `src`
+// unchanged if possible, and returns `false`.
+bool SkipChunk(Reader& src, size_t length) {
+  if (src.SupportsRandomAccess()) {
+    const Position pos = src.pos();
+    if (src.Skip(length)) return true;
+    src.Seek(pos);
+    return false;
+  }
+  if (!src.Pull(length)) return false;
+  src.move_cursor(length);
+  return true;
+}
+
+}  // namespace
+
 void HadoopSnappyReaderBase::Initialize(Reader* src) {
   RIEGELI_ASSERT(src != nullptr)
       << "Failed precondition of HadoopSnappyReader: null Reader pointer";
@@ -91,6 +112,7 @@ bool HadoopSnappyReaderBase::PullBehindScratch() {
   size_t uncompressed_length;
   char* uncompressed_data;
   do {
+    AddChunkPosition(src.pos() - initial_compressed_pos_, limit_pos());
     if (ABSL_PREDICT_FALSE(!src.Pull(sizeof(uint32_t)))) {
       set_buffer();
       if (ABSL_PREDICT_FALSE(!src.healthy())) return Fail(src);
@@ -140,6 +162,54 @@ bool HadoopSnappyReaderBase::PullBehindScratch() {
   return true;
 }
 
+inline void HadoopSnappyReaderBase::AddChunkPosition(
+    Position compressed_pos, Position uncompressed_pos) {
+  if (chunk_positions_.empty() ||
+      compressed_pos > chunk_positions_.back().compressed_pos) {
+    chunk_positions_.push_back(ChunkPosition{compressed_pos, uncompressed_pos,
+                                             remaining_chunk_length_});
+  }
+}
+
+inline void HadoopSnappyReaderBase::SkipChunks(Reader& src,
+                                               Position new_pos) {
+  for (;;) {
+    while (remaining_chunk_length_ == 0) {
+      if (!src.Pull(sizeof(uint32_t))) return;
+      remaining_chunk_length_ = ReadBigEndian32(src.cursor());
+      src.move_cursor(sizeof(uint32_t));
+    }
+    if (!src.Pull(sizeof(uint32_t))) return;
+    const uint32_t compressed_length = ReadBigEndian32(src.cursor());
+    if (compressed_length >
+        std::numeric_limits<uint32_t>::max() - sizeof(uint32_t)) {
+      return;
+    }
+    // The uncompressed length is a varint at the beginning of compressed data.
+    const size_t prefix_length = UnsignedMin(compressed_length, uint32_t{5});
+    size_t uncompressed_length;
+    if (!src.Pull(sizeof(uint32_t) + prefix_length) ||
+        !snappy::GetUncompressedLength(src.cursor() + sizeof(uint32_t),
+                                       prefix_length, &uncompressed_length) ||
+        uncompressed_length > remaining_chunk_length_ ||
+        uncompressed_length >
+            std::numeric_limits<Position>::max() - limit_pos()) {
+      return;
+    }
+    AddChunkPosition(src.pos() - initial_compressed_pos_, limit_pos());
+    // Stop at the subblock containing `new_pos`.
+    if (new_pos < limit_pos() + uncompressed_length) return;
+    if (!SkipChunk(src, sizeof(uint32_t) + compressed_length)) return;
+    set_limit_pos(limit_pos() + uncompressed_length);
+    remaining_chunk_length_ -= IntCast<uint32_t>(uncompressed_length);
+  }
+}
+
+bool HadoopSnappyReaderBase::SupportsRandomAccess() {
+  Reader* const src = src_reader();
+  return src != nullptr && src->SupportsRandomAccess();
+}
+
 bool HadoopSnappyReaderBase::SupportsRewind() {
   Reader* const src = src_reader();
   return src != nullptr && src->SupportsRewind();
@@ -152,10 +222,34 @@ bool HadoopSnappyReaderBase::SeekBehindScratch(Position new_pos) {
   RIEGELI_ASSERT(!scratch_used())
       << "Failed precondition of PullableReader::SeekBehindScratch(): "
          "scratch used";
-  if (new_pos <= limit_pos()) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  Reader& src = *src_reader();
+  if (src.SupportsRandomAccess()) {
+    // Jump to the last known subblock at or before `new_pos`.
+    const auto iter = std::upper_bound(
+        chunk_positions_.begin(), chunk_positions_.end(), new_pos,
+        [](Position value, const ChunkPosition& chunk_position) {
+          return value < chunk_position.uncompressed_pos;
+        });
+    const ChunkPosition chunk_position =
+        iter == chunk_positions_.begin() ? ChunkPosition{0, 0, 0}
+                                         : *std::prev(iter);
+    if (new_pos <= limit_pos() ||
+        chunk_position.uncompressed_pos > limit_pos()) {
+      truncated_ = false;
+      remaining_chunk_length_ = chunk_position.remaining_chunk_length;
+      set_buffer();
+      set_limit_pos(chunk_position.uncompressed_pos);
+      if (ABSL_PREDICT_FALSE(!src.Seek(initial_compressed_pos_ +
+                                       chunk_position.compressed_pos))) {
+        src.Fail(absl::DataLossError(
+            "HadoopSnappy-compressed stream got truncated"));
+        return Fail(src);
+      }
+      if (new_pos == limit_pos()) return true;
+    }
+  } else if (new_pos <= limit_pos()) {
     // Seeking backwards.
-    if (ABSL_PREDICT_FALSE(!healthy())) return false;
-    Reader& src = *src_reader();
     truncated_ = false;
     remaining_chunk_length_ = 0;
     set_buffer();
@@ -168,7 +262,27 @@ bool HadoopSnappyReaderBase::SeekBehindScratch(Position new_pos) {
     if (ABSL_PREDICT_FALSE(!healthy())) return false;
     if (new_pos == 0) return true;
   }
+  // Skip whole subblocks before `new_pos` without decompressing them.
+  set_buffer();
+  SkipChunks(src, new_pos);
   return PullableReader::SeekBehindScratch(new_pos);
 }
 
+absl::optional<Position> HadoopSnappyReaderBase::SizeImpl() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  Reader& src = *src_reader();
+  if (ABSL_PREDICT_FALSE(!src.SupportsRandomAccess())) {
+    Fail(absl::UnimplementedError(
+        "HadoopSnappyReaderBase::Size() requires random access to the source"));
+    return absl::nullopt;
+  }
+  // Seeking to the end skips subblocks without decompressing them.
+  const Position pos_before = pos();
+  Seek(std::numeric_limits<Position>::max());
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  const Position size = pos();
+  if (ABSL_PREDICT_FALSE(!Seek(pos_before))) return absl::nullopt;
+  return size;
+}
+
 }  // namespace riegeli
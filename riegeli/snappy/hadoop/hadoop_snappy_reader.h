@@ -20,11 +20,13 @@
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
 #include "riegeli/base/buffer.h"
 #include "riegeli/base/dependency.h"
 #include "riegeli/base/object.h"
@@ -42,6 +44,11 @@ class HadoopSnappyReaderBase : public PullableReader {
   virtual Reader* src_reader() = 0;
   virtual const Reader* src_reader() const = 0;
 
+  // `HadoopSnappyReader` supports random access if the source supports random
+  // access. Positions of subblocks are remembered as they are encountered, so
+  // that seeking can start decompression from the nearest subblock, and
+  // seeking forwards skips whole subblocks without decompressing them.
+  bool SupportsRandomAccess() override;
   bool SupportsRewind() override;
 
  protected:
@@ -65,9 +72,26 @@ class HadoopSnappyReaderBase : public PullableReader {
   ABSL_ATTRIBUTE_COLD void AnnotateFailure(absl::Status& status) override;
   bool PullBehindScratch() override;
   bool SeekBehindScratch(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
 
  private:
+  struct ChunkPosition {
+    // Position of a subblock relative to `initial_compressed_pos_`.
+    Position compressed_pos;
+    // Uncompressed position of the beginning of its data.
+    Position uncompressed_pos;
+    // `remaining_chunk_length_` before the subblock.
+    uint32_t remaining_chunk_length;
+  };
+
   ABSL_ATTRIBUTE_COLD bool FailInvalidStream(absl::string_view message);
+  void AddChunkPosition(Position compressed_pos, Position uncompressed_pos);
+  // Skips subblocks which end before or at `new_pos`, reading only their
+  // headers. Stops early at anything which needs decompression to be
+  // processed, e.g. an invalid subblock.
+  //
+  // Precondition: no buffered data
+  void SkipChunks(Reader& src, Position new_pos);
 
   // If `true`, the source is truncated (without a clean end of the compressed
   // stream) at the current position. If the source does not grow, `Close()`
@@ -78,6 +102,8 @@ class HadoopSnappyReaderBase : public PullableReader {
   Position initial_compressed_pos_ = 0;
   // Buffered uncompressed data.
   Buffer uncompressed_;
+  // Known subblocks, sorted by position.
+  std::vector<ChunkPosition> chunk_positions_;
 
   // Invariant if scratch is not used:
   //   `start() == nullptr` or `start() == uncompressed_.data()`
@@ -171,7 +197,8 @@ inline HadoopSnappyReaderBase::HadoopSnappyReaderBase(
       truncated_(that.truncated_),
       remaining_chunk_length_(that.remaining_chunk_length_),
       initial_compressed_pos_(that.initial_compressed_pos_),
-      uncompressed_(std::move(that.uncompressed_)) {}
+      uncompressed_(std::move(that.uncompressed_)),
+      chunk_positions_(std::move(that.chunk_positions_)) {}
 
 inline HadoopSnappyReaderBase& HadoopSnappyReaderBase::operator=(
     HadoopSnappyReaderBase&& that) noexcept {
@@ -182,6 +209,7 @@ inline HadoopSnappyReaderBase& HadoopSnappyReaderBase::operator=(
   remaining_chunk_length_ = that.remaining_chunk_length_;
   initial_compressed_pos_ = that.initial_compressed_pos_;
   uncompressed_ = std::move(that.uncompressed_);
+  chunk_positions_ = std::move(that.chunk_positions_);
   return *this;
 }
 
@@ -190,6 +218,7 @@ inline void HadoopSnappyReaderBase::Reset(InitiallyClosed) {
   truncated_ = false;
   remaining_chunk_length_ = 0;
   initial_compressed_pos_ = 0;
+  chunk_positions_.clear();
 }
 
 inline void HadoopSnappyReaderBase::Reset(InitiallyOpen) {
@@ -197,6 +226,7 @@ inline void HadoopSnappyReaderBase::Reset(InitiallyOpen) {
   truncated_ = false;
   remaining_chunk_length_ = 0;
   initial_compressed_pos_ = 0;
+  chunk_positions_.clear();
 }
 
 template <typename Src>
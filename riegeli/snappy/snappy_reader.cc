@@ -23,6 +23,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/status.h"
@@ -35,6 +36,25 @@
 
 namespace riegeli {
 
+namespace {
+
+// Decompresses from `src` to `dest`, whose size must be the uncompressed size
+// stored at the beginning of the compressed stream.
+absl::Status DecompressToBuffer(Reader& src, absl::Span<char> dest,
+                                absl::optional<Position> assumed_size) {
+  internal::ReaderSnappySource source(&src, assumed_size);
+  const bool ok = snappy::RawUncompress(&source, dest.data());
+  if (ABSL_PREDICT_FALSE(!src.healthy())) return src.status();
+  if (ABSL_PREDICT_FALSE(!ok)) {
+    return Annotate(
+        absl::InvalidArgumentError("Invalid snappy-compressed stream"),
+        absl::StrCat("at byte ", src.pos()));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
 void SnappyReaderBase::Initialize(Reader* src,
                                   absl::optional<Position> assumed_size) {
   RIEGELI_ASSERT(src != nullptr)
@@ -46,11 +66,22 @@ void SnappyReaderBase::Initialize(Reader* src,
   const absl::optional<size_t> uncompressed_size = SnappyUncompressedSize(*src);
   Chain decompressed;
   {
-    absl::Status status = SnappyDecompress(
-        *src,
-        ChainWriter<>(&decompressed, ChainWriterBase::Options().set_size_hint(
-                                         uncompressed_size)),
-        SnappyDecompressOptions().set_assumed_size(assumed_size));
+    absl::Status status;
+    if (uncompressed_size != absl::nullopt && *uncompressed_size > 0) {
+      // The uncompressed size is known, so decompress directly into a single
+      // flat block of that size. This avoids splitting the output into
+      // multiple blocks, which Snappy handles by a slower path, and makes the
+      // decompressed `Chain` already flat for readers which need that.
+      status = DecompressToBuffer(
+          *src, decompressed.AppendFixedBuffer(*uncompressed_size),
+          assumed_size);
+    } else {
+      status = SnappyDecompress(
+          *src,
+          ChainWriter<>(&decompressed, ChainWriterBase::Options().set_size_hint(
+                                           uncompressed_size)),
+          SnappyDecompressOptions().set_assumed_size(assumed_size));
+    }
     if (ABSL_PREDICT_FALSE(!status.ok())) {
       FailWithoutAnnotation(std::move(status));
       return;
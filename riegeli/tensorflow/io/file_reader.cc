@@ -27,11 +27,13 @@
 #include "absl/strings/cord.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
+#include "riegeli/base/parallelism.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/backward_writer.h"
 #include "riegeli/bytes/reader.h"
@@ -119,10 +121,126 @@ void FileReaderBase::AnnotateFailure(absl::Status& status) {
 }
 
 void FileReaderBase::Done() {
+  DoneBackground();
   Reader::Done();
   buffer_ = ChainBlock();
 }
 
+void FileReaderBase::DoneBackground() {
+  if (read_ahead_ == nullptr) return;
+  absl::MutexLock lock(&read_ahead_->mutex);
+  read_ahead_->Discard(limit_pos());
+}
+
+void FileReaderBase::ReadAhead::StartRequests(
+    ::tensorflow::RandomAccessFile* src) {
+  while (!stopped && requests.size() < max_requests) {
+    if (ABSL_PREDICT_FALSE(next_length >
+                           std::numeric_limits<::tensorflow::uint64>::max() -
+                               next_pos)) {
+      return;
+    }
+    requests.push_back(std::make_unique<ReadAheadRequest>());
+    ReadAheadRequest* const request = requests.back().get();
+    request->pos = next_pos;
+    request->length = next_length;
+    next_pos += next_length;
+    next_length = UnsignedMin(SaturatingAdd(next_length, next_length),
+                              max_length);
+    ++running;
+    internal::ThreadPool::global().Schedule([this, src, request] {
+      Buffer data(request->length);
+      absl::string_view result;
+      ::tensorflow::Status status =
+          src->Read(IntCast<::tensorflow::uint64>(request->pos),
+                    request->length, &result, data.data());
+      absl::MutexLock lock(&mutex);
+      request->data = std::move(data);
+      request->result = result;
+      request->status = std::move(status);
+      request->done = true;
+      if (ABSL_PREDICT_FALSE(!request->status.ok())) stopped = true;
+      --running;
+    });
+  }
+}
+
+void FileReaderBase::ReadAhead::Discard(Position pos) {
+  mutex.Await(absl::Condition(
+      +[](size_t* running) { return *running == 0; }, &running));
+  requests.clear();
+  next_pos = pos;
+  next_length = min_length;
+  stopped = false;
+}
+
+inline ::tensorflow::Status FileReaderBase::ReadFile(
+    ::tensorflow::RandomAccessFile* src, size_t length,
+    absl::string_view* result, char* scratch) {
+  if (read_ahead_ == nullptr) {
+    return src->Read(IntCast<::tensorflow::uint64>(limit_pos()), length,
+                     result, scratch);
+  }
+  return ReadFromReadAhead(src, length, result, scratch);
+}
+
+::tensorflow::Status FileReaderBase::ReadFromReadAhead(
+    ::tensorflow::RandomAccessFile* src, size_t length,
+    absl::string_view* result, char* scratch) {
+  ReadAhead& read_ahead = *read_ahead_;
+  absl::MutexLock lock(&read_ahead.mutex);
+  if (read_ahead.requests.empty()
+          ? read_ahead.next_pos != limit_pos()
+          : read_ahead.requests.front()->pos +
+                    read_ahead.requests.front()->consumed !=
+                limit_pos()) {
+    // The position was changed by seeking, data read ahead are not useful.
+    read_ahead.Discard(limit_pos());
+  }
+  size_t length_read = 0;
+  ::tensorflow::Status status;
+  while (length_read < length) {
+    if (read_ahead.requests.empty()) read_ahead.StartRequests(src);
+    if (ABSL_PREDICT_FALSE(read_ahead.requests.empty())) {
+      // Position overflow.
+      status = ::tensorflow::errors::OutOfRange("Position overflow");
+      break;
+    }
+    ReadAheadRequest& request = *read_ahead.requests.front();
+    read_ahead.mutex.Await(absl::Condition(&request.done));
+    const size_t length_to_copy =
+        UnsignedMin(request.result.size() - request.consumed,
+                    length - length_read);
+    if (
+        // `std::memcpy(nullptr, _, 0)` and `std::memcpy(_, nullptr, 0)` are
+        // undefined.
+        length_to_copy > 0) {
+      std::memcpy(scratch + length_read,
+                  request.result.data() + request.consumed, length_to_copy);
+      request.consumed += length_to_copy;
+      length_read += length_to_copy;
+    }
+    if (request.consumed == request.result.size()) {
+      if (ABSL_PREDICT_FALSE(!request.status.ok())) {
+        // The file ends or reading failed. Let the next call try reading
+        // again.
+        status = request.status;
+        read_ahead.Discard(limit_pos() + length_read);
+        break;
+      }
+      read_ahead.requests.pop_front();
+    }
+  }
+  if (status.ok()) read_ahead.StartRequests(src);
+  *result = absl::string_view(scratch, length_read);
+  return status;
+}
+
+inline void FileReaderBase::GrowReadSize() {
+  read_size_ = UnsignedMin(SaturatingAdd(read_size_, read_size_),
+                           max_buffer_size_);
+}
+
 inline void FileReaderBase::SyncBuffer() {
   buffer_.Clear();
   set_buffer();
@@ -142,7 +260,7 @@ bool FileReaderBase::PullSlow(size_t min_length, size_t recommended_length) {
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   ::tensorflow::RandomAccessFile* const src = src_file();
   const size_t buffer_length =
-      UnsignedMax(buffer_size_, min_length, recommended_length);
+      UnsignedMax(read_size_, min_length, recommended_length);
   const size_t available_length = available();
   size_t cursor_index;
   absl::Span<char> flat_buffer;
@@ -192,8 +310,7 @@ inline bool FileReaderBase::ReadToDest(size_t length,
     return FailOverflow();
   }
   absl::string_view result;
-  const ::tensorflow::Status status = src->Read(
-      IntCast<::tensorflow::uint64>(limit_pos()), length, &result, dest);
+  const ::tensorflow::Status status = ReadFile(src, length, &result, dest);
   RIEGELI_ASSERT_LE(result.size(), length)
       << "RandomAccessFile::Read() read more than requested";
   if (result.data() != dest) std::memcpy(dest, result.data(), result.size());
@@ -224,8 +341,7 @@ inline bool FileReaderBase::ReadToBuffer(size_t cursor_index,
   }
   absl::string_view result;
   const ::tensorflow::Status status =
-      src->Read(IntCast<::tensorflow::uint64>(limit_pos()), flat_buffer.size(),
-                &result, flat_buffer.data());
+      ReadFile(src, flat_buffer.size(), &result, flat_buffer.data());
   RIEGELI_ASSERT_LE(result.size(), flat_buffer.size())
       << "RandomAccessFile::Read() read more than requested";
   if (result.data() == flat_buffer.data()) {
@@ -248,6 +364,7 @@ inline bool FileReaderBase::ReadToBuffer(size_t cursor_index,
     }
     return false;
   }
+  GrowReadSize();
   return true;
 }
 
@@ -311,12 +428,12 @@ bool FileReaderBase::ReadSlow(size_t length, Chain& dest) {
       dest.Append(absl::string_view(cursor(), available()));
       cursor_index = 0;
       flat_buffer =
-          buffer_.AppendBuffer(buffer_size_, buffer_size_,
-                               SaturatingAdd(buffer_size_, buffer_size_));
+          buffer_.AppendBuffer(read_size_, read_size_,
+                               SaturatingAdd(read_size_, read_size_));
     } else {
       cursor_index = read_from_buffer();
       flat_buffer = buffer_.AppendBuffer(
-          0, buffer_size_, SaturatingAdd(buffer_size_, buffer_size_));
+          0, read_size_, SaturatingAdd(read_size_, read_size_));
       if (flat_buffer.empty()) {
         // `flat_buffer` is too small. Append available data to `dest` and make
         // a new buffer.
@@ -325,8 +442,8 @@ bool FileReaderBase::ReadSlow(size_t length, Chain& dest) {
         buffer_.Clear();
         cursor_index = 0;
         flat_buffer =
-            buffer_.AppendBuffer(buffer_size_, buffer_size_,
-                                 SaturatingAdd(buffer_size_, buffer_size_));
+            buffer_.AppendBuffer(read_size_, read_size_,
+                                 SaturatingAdd(read_size_, read_size_));
       }
     }
     // Read more data, preferably into `buffer_`.
@@ -375,12 +492,12 @@ bool FileReaderBase::ReadSlow(size_t length, absl::Cord& dest) {
       dest.Append(absl::string_view(cursor(), available()));
       cursor_index = 0;
       flat_buffer =
-          buffer_.AppendBuffer(buffer_size_, buffer_size_,
-                               SaturatingAdd(buffer_size_, buffer_size_));
+          buffer_.AppendBuffer(read_size_, read_size_,
+                               SaturatingAdd(read_size_, read_size_));
     } else {
       cursor_index = read_from_buffer();
       flat_buffer = buffer_.AppendBuffer(
-          0, buffer_size_, SaturatingAdd(buffer_size_, buffer_size_));
+          0, read_size_, SaturatingAdd(read_size_, read_size_));
       if (flat_buffer.empty()) {
         // `flat_buffer` is too small. Append available data to `dest` and make
         // a new buffer.
@@ -389,8 +506,8 @@ bool FileReaderBase::ReadSlow(size_t length, absl::Cord& dest) {
         buffer_.Clear();
         cursor_index = 0;
         flat_buffer =
-            buffer_.AppendBuffer(buffer_size_, buffer_size_,
-                                 SaturatingAdd(buffer_size_, buffer_size_));
+            buffer_.AppendBuffer(read_size_, read_size_,
+                                 SaturatingAdd(read_size_, read_size_));
       }
     }
     // Read more data, preferably into `buffer_`.
@@ -432,12 +549,12 @@ bool FileReaderBase::CopySlow(Position length, Writer& dest) {
       }
       cursor_index = 0;
       flat_buffer =
-          buffer_.AppendBuffer(buffer_size_, buffer_size_,
-                               SaturatingAdd(buffer_size_, buffer_size_));
+          buffer_.AppendBuffer(read_size_, read_size_,
+                               SaturatingAdd(read_size_, read_size_));
     } else {
       cursor_index = read_from_buffer();
       flat_buffer = buffer_.AppendBuffer(
-          0, buffer_size_, SaturatingAdd(buffer_size_, buffer_size_));
+          0, read_size_, SaturatingAdd(read_size_, read_size_));
       if (flat_buffer.empty()) {
         // `flat_buffer` is too small. Append available data to `dest` and make
         // a new buffer.
@@ -461,8 +578,8 @@ bool FileReaderBase::CopySlow(Position length, Writer& dest) {
         buffer_.Clear();
         cursor_index = 0;
         flat_buffer =
-            buffer_.AppendBuffer(buffer_size_, buffer_size_,
-                                 SaturatingAdd(buffer_size_, buffer_size_));
+            buffer_.AppendBuffer(read_size_, read_size_,
+                                 SaturatingAdd(read_size_, read_size_));
       }
     }
     // Read more data, preferably into `buffer_`.
@@ -517,6 +634,8 @@ bool FileReaderBase::SeekSlow(Position new_pos) {
   if (ABSL_PREDICT_FALSE(filename_.empty())) return Reader::SeekSlow(new_pos);
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
   SyncBuffer();
+  // Reading after seeking is not known to be sequential.
+  read_size_ = buffer_size_;
   if (new_pos > limit_pos()) {
     // Seeking forwards.
     ::tensorflow::uint64 file_size;
@@ -17,6 +17,7 @@
 
 #include <stddef.h>
 
+#include <deque>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -25,12 +26,15 @@
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/dependency.h"
 #include "riegeli/base/object.h"
@@ -93,10 +97,45 @@ class FileReaderBase : public Reader {
     }
     size_t buffer_size() const { return buffer_size_; }
 
+    // If greater than `buffer_size()`, the length of reads from the file grows
+    // by doubling up to `max_buffer_size()` while the file is read
+    // sequentially, and returns to `buffer_size()` after seeking. This reduces
+    // the number of requests to remote file systems with a high latency per
+    // request.
+    //
+    // Default: 0 (reads have the length of `buffer_size()`).
+    Options& set_max_buffer_size(size_t max_buffer_size) & {
+      max_buffer_size_ = max_buffer_size;
+      return *this;
+    }
+    Options&& set_max_buffer_size(size_t max_buffer_size) && {
+      return std::move(set_max_buffer_size(max_buffer_size));
+    }
+    size_t max_buffer_size() const { return max_buffer_size_; }
+
+    // If positive, up to `read_ahead()` reads of the following parts of the
+    // file are issued concurrently on background threads, while data already
+    // read are being consumed. This hides the latency of remote file systems.
+    //
+    // `::tensorflow::RandomAccessFile::Read()` must be safe to call
+    // concurrently, as required by its contract.
+    //
+    // Default: 0 (no read-ahead).
+    Options& set_read_ahead(size_t read_ahead) & {
+      read_ahead_ = read_ahead;
+      return *this;
+    }
+    Options&& set_read_ahead(size_t read_ahead) && {
+      return std::move(set_read_ahead(read_ahead));
+    }
+    size_t read_ahead() const { return read_ahead_; }
+
    private:
     ::tensorflow::Env* env_ = nullptr;
     Position initial_pos_ = 0;
     size_t buffer_size_ = kDefaultBufferSize;
+    size_t max_buffer_size_ = 0;
+    size_t read_ahead_ = 0;
   };
 
   // Returns the `::tensorflow::RandomAccessFile` being read from. If the
@@ -113,13 +152,14 @@ class FileReaderBase : public Reader {
  protected:
   FileReaderBase() noexcept : Reader(kInitiallyClosed) {}
 
-  explicit FileReaderBase(size_t buffer_size);
+  explicit FileReaderBase(size_t buffer_size, size_t max_buffer_size,
+                          size_t read_ahead);
 
   FileReaderBase(FileReaderBase&& that) noexcept;
   FileReaderBase& operator=(FileReaderBase&& that) noexcept;
 
   void Reset();
-  void Reset(size_t buffer_size);
+  void Reset(size_t buffer_size, size_t max_buffer_size, size_t read_ahead);
   void Initialize(::tensorflow::RandomAccessFile* src, ::tensorflow::Env* env,
                   Position initial_pos);
   bool InitializeFilename(::tensorflow::RandomAccessFile* src,
@@ -130,6 +170,12 @@ class FileReaderBase : public Reader {
   ABSL_ATTRIBUTE_COLD bool FailOperation(const ::tensorflow::Status& status,
                                          absl::string_view operation);
 
+  // Waits for background reads to finish, and discards data read ahead.
+  //
+  // A derived class must call `DoneBackground()` in its destructor, because
+  // background reads use the `::tensorflow::RandomAccessFile` until then.
+  void DoneBackground();
+
   void Done() override;
   void AnnotateFailure(absl::Status& status) override;
   bool PullSlow(size_t min_length, size_t recommended_length) override;
@@ -174,12 +220,81 @@ class FileReaderBase : public Reader {
   bool ReadToBuffer(size_t cursor_index, ::tensorflow::RandomAccessFile* src,
                     absl::Span<char> flat_buffer);
 
+  // Reads `length` bytes from `*src`, from the physical file position which is
+  // `limit_pos()`, like `::tensorflow::RandomAccessFile::Read()`. Uses
+  // `read_ahead_` if present.
+  ::tensorflow::Status ReadFile(::tensorflow::RandomAccessFile* src,
+                                size_t length, absl::string_view* result,
+                                char* scratch);
+
+  // Implementation of `ReadFile()` with `read_ahead_`.
+  ::tensorflow::Status ReadFromReadAhead(::tensorflow::RandomAccessFile* src,
+                                         size_t length,
+                                         absl::string_view* result,
+                                         char* scratch);
+
+  // Grows `read_size_` after a sequential read.
+  void GrowReadSize();
+
+  // A read issued in background.
+  struct ReadAheadRequest {
+    Position pos = 0;
+    size_t length = 0;
+    Buffer data;
+    absl::string_view result;
+    ::tensorflow::Status status;
+    // Length of `result` already taken by `ReadFromReadAhead()`.
+    size_t consumed = 0;
+    bool done = false;
+  };
+
+  // State of read-ahead, shared with background reads.
+  struct ReadAhead {
+    explicit ReadAhead(size_t max_requests, size_t min_length,
+                       size_t max_length)
+        : max_requests(max_requests),
+          min_length(min_length),
+          max_length(max_length),
+          next_length(min_length) {}
+
+    // Issues background reads of following parts of the file until
+    // `max_requests` are pending or not consumed.
+    void StartRequests(::tensorflow::RandomAccessFile* src)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex);
+    // Waits for background reads and discards requests, restarting at `pos`.
+    void Discard(Position pos) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex);
+
+    const size_t max_requests;
+    const size_t min_length;
+    const size_t max_length;
+    absl::Mutex mutex;
+    // Requests at consecutive positions.
+    std::deque<std::unique_ptr<ReadAheadRequest>> requests
+        ABSL_GUARDED_BY(mutex);
+    // Position and length of the next request to issue. The length grows
+    // while reading sequentially.
+    Position next_pos ABSL_GUARDED_BY(mutex) = 0;
+    size_t next_length ABSL_GUARDED_BY(mutex);
+    // Number of requests not `done` yet.
+    size_t running ABSL_GUARDED_BY(mutex) = 0;
+    // Whether a request ended the file or failed, so that no more requests are
+    // issued until the requests are consumed.
+    bool stopped ABSL_GUARDED_BY(mutex) = false;
+  };
+
   std::string filename_;
   // Invariant:
   //   if `healthy() && !filename_.empty()` then `file_system_ != nullptr`
   ::tensorflow::FileSystem* file_system_ = nullptr;
   // Invariant: if `is_open()` then `buffer_size_ > 0`
   size_t buffer_size_ = 0;
+  // Invariant: `max_buffer_size_ >= buffer_size_`
+  size_t max_buffer_size_ = 0;
+  // The length of the next read through `buffer_`, between `buffer_size_` and
+  // `max_buffer_size_`.
+  size_t read_size_ = 0;
+  // Present if read-ahead is enabled.
+  std::unique_ptr<ReadAhead> read_ahead_;
   // If `buffer_` is not empty, it contains buffered data, read directly before
   // the physical source position which is `limit_pos()`. Otherwise buffered
   // data are in memory managed by the `::tensorflow::RandomAccessFile`. In any
@@ -230,6 +345,8 @@ class FileReader : public FileReaderBase {
   FileReader(FileReader&& that) noexcept;
   FileReader& operator=(FileReader&& that) noexcept;
 
+  ~FileReader() { DoneBackground(); }
+
   // Makes `*this` equivalent to a newly constructed `FileReader`. This avoids
   // constructing a temporary `FileReader` and moving from it.
   void Reset();
@@ -283,8 +400,17 @@ explicit FileReader(absl::string_view filename,
 
 // Implementation details follow.
 
-inline FileReaderBase::FileReaderBase(size_t buffer_size)
-    : Reader(kInitiallyOpen), buffer_size_(buffer_size) {}
+inline FileReaderBase::FileReaderBase(size_t buffer_size,
+                                      size_t max_buffer_size,
+                                      size_t read_ahead)
+    : Reader(kInitiallyOpen),
+      buffer_size_(buffer_size),
+      max_buffer_size_(UnsignedMax(buffer_size, max_buffer_size)),
+      read_size_(buffer_size),
+      read_ahead_(read_ahead == 0
+                      ? nullptr
+                      : std::make_unique<ReadAhead>(read_ahead, buffer_size,
+                                                    max_buffer_size_)) {}
 
 inline FileReaderBase::FileReaderBase(FileReaderBase&& that) noexcept
     : Reader(std::move(that)),
@@ -293,33 +419,59 @@ inline FileReaderBase::FileReaderBase(FileReaderBase&& that) noexcept
       filename_(std::move(that.filename_)),
       file_system_(that.file_system_),
       buffer_size_(that.buffer_size_),
-      buffer_(std::move(that.buffer_)) {}
+      max_buffer_size_(that.max_buffer_size_),
+      read_size_(that.read_size_),
+      read_ahead_(std::move(that.read_ahead_)),
+      buffer_(std::move(that.buffer_)) {
+  // Background reads may still be using the source of `that`, which is going to
+  // be moved by the derived class.
+  DoneBackground();
+}
 
 inline FileReaderBase& FileReaderBase::operator=(
     FileReaderBase&& that) noexcept {
+  DoneBackground();
+  that.DoneBackground();
   Reader::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   filename_ = std::move(that.filename_);
   file_system_ = that.file_system_;
   buffer_size_ = that.buffer_size_;
+  max_buffer_size_ = that.max_buffer_size_;
+  read_size_ = that.read_size_;
+  read_ahead_ = std::move(that.read_ahead_);
   buffer_ = std::move(that.buffer_);
   return *this;
 }
 
 inline void FileReaderBase::Reset() {
+  DoneBackground();
   Reader::Reset(kInitiallyClosed);
   filename_.clear();
   file_system_ = nullptr;
   buffer_size_ = 0;
+  max_buffer_size_ = 0;
+  read_size_ = 0;
+  read_ahead_.reset();
   buffer_.Clear();
 }
 
-inline void FileReaderBase::Reset(size_t buffer_size) {
+inline void FileReaderBase::Reset(size_t buffer_size, size_t max_buffer_size,
+                                  size_t read_ahead) {
+  DoneBackground();
   Reader::Reset(kInitiallyOpen);
   // `filename_` and `file_system_` will be or were set by
   // `InitializeFilename()`.
   buffer_size_ = buffer_size;
+  max_buffer_size_ = UnsignedMax(buffer_size, max_buffer_size);
+  read_size_ = buffer_size;
+  if (read_ahead == 0) {
+    read_ahead_.reset();
+  } else {
+    read_ahead_ =
+        std::make_unique<ReadAhead>(read_ahead, buffer_size, max_buffer_size_);
+  }
   buffer_.Clear();
 }
 
@@ -334,13 +486,17 @@ inline void FileReaderBase::Initialize(::tensorflow::RandomAccessFile* src,
 
 template <typename Src>
 inline FileReader<Src>::FileReader(const Src& src, Options options)
-    : FileReaderBase(options.buffer_size()), src_(src) {
+    : FileReaderBase(options.buffer_size(), options.max_buffer_size(),
+                     options.read_ahead()),
+      src_(src) {
   Initialize(src_.get(), options.env(), options.initial_pos());
 }
 
 template <typename Src>
 inline FileReader<Src>::FileReader(Src&& src, Options options)
-    : FileReaderBase(options.buffer_size()), src_(std::move(src)) {
+    : FileReaderBase(options.buffer_size(), options.max_buffer_size(),
+                     options.read_ahead()),
+      src_(std::move(src)) {
   Initialize(src_.get(), options.env(), options.initial_pos());
 }
 
@@ -348,7 +504,9 @@ template <typename Src>
 template <typename... SrcArgs>
 inline FileReader<Src>::FileReader(std::tuple<SrcArgs...> src_args,
                                    Options options)
-    : FileReaderBase(options.buffer_size()), src_(std::move(src_args)) {
+    : FileReaderBase(options.buffer_size(), options.max_buffer_size(),
+                     options.read_ahead()),
+      src_(std::move(src_args)) {
   Initialize(src_.get(), options.env(), options.initial_pos());
 }
 
@@ -366,14 +524,16 @@ inline void FileReader<Src>::Reset() {
 
 template <typename Src>
 inline void FileReader<Src>::Reset(const Src& src, Options options) {
-  FileReaderBase::Reset(options.buffer_size());
+  FileReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                        options.read_ahead());
   src_.Reset(src);
   Initialize(src_.get(), options.env(), options.initial_pos());
 }
 
 template <typename Src>
 inline void FileReader<Src>::Reset(Src&& src, Options options) {
-  FileReaderBase::Reset(options.buffer_size());
+  FileReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                        options.read_ahead());
   src_.Reset(std::move(src));
   Initialize(src_.get(), options.env(), options.initial_pos());
 }
@@ -382,7 +542,8 @@ template <typename Src>
 template <typename... SrcArgs>
 inline void FileReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
                                    Options options) {
-  FileReaderBase::Reset(options.buffer_size());
+  FileReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                        options.read_ahead());
   src_.Reset(std::move(src_args));
   Initialize(src_.get(), options.env(), options.initial_pos());
 }
@@ -400,7 +561,8 @@ inline void FileReader<Src>::Initialize(absl::string_view filename,
   if (ABSL_PREDICT_FALSE(!InitializeFilename(filename, options.env()))) return;
   std::unique_ptr<::tensorflow::RandomAccessFile> src = OpenFile();
   if (ABSL_PREDICT_FALSE(src == nullptr)) return;
-  FileReaderBase::Reset(options.buffer_size());
+  FileReaderBase::Reset(options.buffer_size(), options.max_buffer_size(),
+                        options.read_ahead());
   src_.Reset(std::forward_as_tuple(src.release()));
   InitializePos(options.initial_pos());
 }
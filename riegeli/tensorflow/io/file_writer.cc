@@ -26,10 +26,12 @@
 #include "absl/strings/cord.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
 #include "riegeli/base/memory.h"
+#include "riegeli/base/parallelism.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/writer.h"
 #include "tensorflow/core/lib/core/errors.h"
@@ -91,11 +93,20 @@ void FileWriterBase::InitializePos(::tensorflow::WritableFile* dest) {
 }
 
 void FileWriterBase::Done() {
-  SyncBuffer();
+  if (ABSL_PREDICT_TRUE(SyncBuffer())) AwaitBackgroundAppend();
+  DoneBackground();
   buffer_ = Buffer();
+  if (background_ != nullptr) background_->buffer = Buffer();
   Writer::Done();
 }
 
+void FileWriterBase::DoneBackground() {
+  if (background_ == nullptr) return;
+  absl::MutexLock lock(&background_->mutex);
+  background_->mutex.Await(absl::Condition(
+      +[](bool* running) { return !*running; }, &background_->running));
+}
+
 bool FileWriterBase::FailOperation(const ::tensorflow::Status& status,
                                    absl::string_view operation) {
   RIEGELI_ASSERT(!status.ok())
@@ -121,9 +132,62 @@ bool FileWriterBase::SyncBuffer() {
   set_buffer();
   if (data.empty()) return true;
   if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (background_ != nullptr) return StartBackgroundAppend(data.size());
   return WriteInternal(data);
 }
 
+bool FileWriterBase::StartBackgroundAppend(size_t length) {
+  RIEGELI_ASSERT_GT(length, 0u)
+      << "Failed precondition of FileWriterBase::StartBackgroundAppend(): "
+         "nothing to write";
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of FileWriterBase::StartBackgroundAppend(): "
+      << status();
+  RIEGELI_ASSERT(background_ != nullptr)
+      << "Failed precondition of FileWriterBase::StartBackgroundAppend(): "
+         "background appends not enabled";
+  if (ABSL_PREDICT_FALSE(length >
+                         std::numeric_limits<Position>::max() - start_pos())) {
+    return FailOverflow();
+  }
+  if (ABSL_PREDICT_FALSE(!AwaitBackgroundAppend())) return false;
+  ::tensorflow::WritableFile* const dest = dest_file();
+  BackgroundAppend* const background = background_.get();
+  // The previous background append has finished, so its buffer can be reused
+  // for filling while `buffer_` is being appended.
+  {
+    absl::MutexLock lock(&background->mutex);
+    using std::swap;
+    swap(buffer_, background->buffer);
+    background->running = true;
+  }
+  internal::ThreadPool::global().Schedule([dest, background, length] {
+    const ::tensorflow::Status status =
+        dest->Append(absl::string_view(background->buffer.data(), length));
+    absl::MutexLock lock(&background->mutex);
+    background->status = status;
+    background->running = false;
+  });
+  move_start_pos(length);
+  return true;
+}
+
+bool FileWriterBase::AwaitBackgroundAppend() {
+  if (background_ == nullptr) return healthy();
+  ::tensorflow::Status status;
+  {
+    absl::MutexLock lock(&background_->mutex);
+    background_->mutex.Await(absl::Condition(
+        +[](bool* running) { return !*running; }, &background_->running));
+    status = std::move(background_->status);
+    background_->status = ::tensorflow::Status::OK();
+  }
+  if (ABSL_PREDICT_FALSE(!status.ok())) {
+    return FailOperation(status, "WritableFile::Append(string_view)");
+  }
+  return healthy();
+}
+
 inline size_t FileWriterBase::LengthToWriteDirectly() const {
   // Write directly at least `buffer_size_` of data. Even if the buffer is
   // partially full, this ensures that at least every other write has length at
@@ -160,6 +224,8 @@ bool FileWriterBase::WriteInternal(absl::string_view src) {
                          std::numeric_limits<Position>::max() - start_pos())) {
     return FailOverflow();
   }
+  // Appends must stay in order.
+  if (ABSL_PREDICT_FALSE(!AwaitBackgroundAppend())) return false;
   {
     const ::tensorflow::Status status = dest->Append(src);
     if (ABSL_PREDICT_FALSE(!status.ok())) {
@@ -184,7 +250,7 @@ bool FileWriterBase::WriteSlow(absl::string_view src) {
 
 bool FileWriterBase::FlushImpl(FlushType flush_type) {
   if (ABSL_PREDICT_FALSE(!SyncBuffer())) return false;
-  return healthy();
+  return AwaitBackgroundAppend();
 }
 
 }  // namespace tensorflow
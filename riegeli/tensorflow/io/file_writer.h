@@ -25,9 +25,11 @@
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/buffer.h"
 #include "riegeli/base/chain.h"
@@ -95,10 +97,32 @@ class FileWriterBase : public Writer {
     }
     size_t buffer_size() const { return buffer_size_; }
 
+    // If `true`, a full buffer is passed to `WritableFile::Append()` on a
+    // background thread while the next buffer is being filled. At most one
+    // such append is pending at a time.
+    //
+    // This is useful with a large `buffer_size()` (e.g. 64M) for object
+    // storage, where each append may become an upload part and writing would
+    // otherwise be gated on upload round trips.
+    //
+    // A failure of a background append is reported by a later operation.
+    // `pos()` includes data passed to a background append.
+    //
+    // Default: `false`.
+    Options& set_background_append(bool background_append) & {
+      background_append_ = background_append;
+      return *this;
+    }
+    Options&& set_background_append(bool background_append) && {
+      return std::move(set_background_append(background_append));
+    }
+    bool background_append() const { return background_append_; }
+
    private:
     ::tensorflow::Env* env_ = nullptr;
     bool append_ = false;
     size_t buffer_size_ = kDefaultBufferSize;
+    bool background_append_ = false;
   };
 
   // Returns the `::tensorflow::WritableFile` being written to. Unchanged by
@@ -112,13 +136,13 @@ class FileWriterBase : public Writer {
  protected:
   FileWriterBase() noexcept : Writer(kInitiallyClosed) {}
 
-  explicit FileWriterBase(size_t buffer_size);
+  explicit FileWriterBase(size_t buffer_size, bool background_append);
 
   FileWriterBase(FileWriterBase&& that) noexcept;
   FileWriterBase& operator=(FileWriterBase&& that) noexcept;
 
   void Reset();
-  void Reset(size_t buffer_size);
+  void Reset(size_t buffer_size, bool background_append);
   void Initialize(::tensorflow::WritableFile* dest);
   std::unique_ptr<::tensorflow::WritableFile> OpenFile(
       ::tensorflow::Env* env, absl::string_view filename, bool append);
@@ -126,6 +150,12 @@ class FileWriterBase : public Writer {
   ABSL_ATTRIBUTE_COLD bool FailOperation(const ::tensorflow::Status& status,
                                          absl::string_view operation);
 
+  // Waits for a background append to finish, without reporting its failure.
+  //
+  // A derived class must call `DoneBackground()` in its destructor, because a
+  // background append uses the `::tensorflow::WritableFile` until then.
+  void DoneBackground();
+
   void Done() override;
   void AnnotateFailure(absl::Status& status) override;
   bool PushSlow(size_t min_length, size_t recommended_length) override;
@@ -151,9 +181,33 @@ class FileWriterBase : public Writer {
   //   `healthy()`
   bool WriteInternal(absl::string_view src);
 
+  // Passes `length` bytes of `buffer_` to a background append, and swaps
+  // `buffer_` with the buffer of the previous background append.
+  //
+  // Preconditions:
+  //   `length > 0`
+  //   `healthy()`
+  //   `background_ != nullptr`
+  bool StartBackgroundAppend(size_t length);
+
+  // Waits for a background append to finish, and fails `*this` if it failed.
+  // Returns `healthy()`.
+  bool AwaitBackgroundAppend();
+
+  // State of a background append, shared with the background thread.
+  struct BackgroundAppend {
+    absl::Mutex mutex;
+    bool running ABSL_GUARDED_BY(mutex) = false;
+    ::tensorflow::Status status ABSL_GUARDED_BY(mutex);
+    // Data being appended, or a spare buffer.
+    Buffer buffer;
+  };
+
   std::string filename_;
   // Invariant: if `is_open()` then `buffer_size_ > 0`
   size_t buffer_size_ = 0;
+  // Present if background appends are enabled.
+  std::unique_ptr<BackgroundAppend> background_;
   // Buffered data to be written.
   Buffer buffer_;
 };
@@ -199,6 +253,8 @@ class FileWriter : public FileWriterBase {
   FileWriter(FileWriter&& that) noexcept;
   FileWriter& operator=(FileWriter&& that) noexcept;
 
+  ~FileWriter() { DoneBackground(); }
+
   // Makes `*this` equivalent to a newly constructed `FileWriter`. This avoids
   // constructing a temporary `FileWriter` and moving from it.
   void Reset();
@@ -249,8 +305,12 @@ explicit FileWriter(absl::string_view filename,
 
 // Implementation details follow.
 
-inline FileWriterBase::FileWriterBase(size_t buffer_size)
-    : Writer(kInitiallyOpen), buffer_size_(buffer_size) {}
+inline FileWriterBase::FileWriterBase(size_t buffer_size,
+                                      bool background_append)
+    : Writer(kInitiallyOpen),
+      buffer_size_(buffer_size),
+      background_(background_append ? std::make_unique<BackgroundAppend>()
+                                    : nullptr) {}
 
 inline FileWriterBase::FileWriterBase(FileWriterBase&& that) noexcept
     : Writer(std::move(that)),
@@ -258,30 +318,49 @@ inline FileWriterBase::FileWriterBase(FileWriterBase&& that) noexcept
       // part was moved.
       filename_(std::move(that.filename_)),
       buffer_size_(that.buffer_size_),
-      buffer_(std::move(that.buffer_)) {}
+      background_(std::move(that.background_)),
+      buffer_(std::move(that.buffer_)) {
+  // A background append may still be using the destination of `that`, which
+  // is going to be moved by the derived class.
+  DoneBackground();
+}
 
 inline FileWriterBase& FileWriterBase::operator=(
     FileWriterBase&& that) noexcept {
+  DoneBackground();
+  that.DoneBackground();
   Writer::operator=(std::move(that));
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   filename_ = std::move(that.filename_);
   buffer_size_ = that.buffer_size_;
+  background_ = std::move(that.background_);
   buffer_ = std::move(that.buffer_);
   return *this;
 }
 
 inline void FileWriterBase::Reset() {
+  DoneBackground();
   Writer::Reset(kInitiallyClosed);
   filename_.clear();
   buffer_size_ = 0;
+  background_.reset();
 }
 
-inline void FileWriterBase::Reset(size_t buffer_size) {
+inline void FileWriterBase::Reset(size_t buffer_size, bool background_append) {
+  DoneBackground();
   Writer::Reset(kInitiallyOpen);
   // `filename_` will by set by `InitializeFilename()` or was set by
   // `OpenFile()`.
   buffer_size_ = buffer_size;
+  if (!background_append) {
+    background_.reset();
+  } else if (background_ == nullptr) {
+    background_ = std::make_unique<BackgroundAppend>();
+  } else {
+    absl::MutexLock lock(&background_->mutex);
+    background_->status = ::tensorflow::Status::OK();
+  }
 }
 
 inline void FileWriterBase::Initialize(::tensorflow::WritableFile* dest) {
@@ -293,13 +372,15 @@ inline void FileWriterBase::Initialize(::tensorflow::WritableFile* dest) {
 
 template <typename Dest>
 inline FileWriter<Dest>::FileWriter(const Dest& dest, Options options)
-    : FileWriterBase(options.buffer_size()), dest_(dest) {
+    : FileWriterBase(options.buffer_size(), options.background_append()),
+      dest_(dest) {
   Initialize(dest_.get());
 }
 
 template <typename Dest>
 inline FileWriter<Dest>::FileWriter(Dest&& dest, Options options)
-    : FileWriterBase(options.buffer_size()), dest_(std::move(dest)) {
+    : FileWriterBase(options.buffer_size(), options.background_append()),
+      dest_(std::move(dest)) {
   Initialize(dest_.get());
 }
 
@@ -307,7 +388,8 @@ template <typename Dest>
 template <typename... DestArgs>
 inline FileWriter<Dest>::FileWriter(std::tuple<DestArgs...> dest_args,
                                     Options options)
-    : FileWriterBase(options.buffer_size()), dest_(std::move(dest_args)) {
+    : FileWriterBase(options.buffer_size(), options.background_append()),
+      dest_(std::move(dest_args)) {
   Initialize(dest_.get());
 }
 
@@ -343,14 +425,14 @@ inline void FileWriter<Dest>::Reset() {
 
 template <typename Dest>
 inline void FileWriter<Dest>::Reset(const Dest& dest, Options options) {
-  FileWriterBase::Reset(options.buffer_size());
+  FileWriterBase::Reset(options.buffer_size(), options.background_append());
   dest_.Reset(dest);
   Initialize(dest_.get());
 }
 
 template <typename Dest>
 inline void FileWriter<Dest>::Reset(Dest&& dest, Options options) {
-  FileWriterBase::Reset(options.buffer_size());
+  FileWriterBase::Reset(options.buffer_size(), options.background_append());
   dest_.Reset(std::move(dest));
   Initialize(dest_.get());
 }
@@ -359,7 +441,7 @@ template <typename Dest>
 template <typename... DestArgs>
 inline void FileWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
                                     Options options) {
-  FileWriterBase::Reset(options.buffer_size());
+  FileWriterBase::Reset(options.buffer_size(), options.background_append());
   dest_.Reset(std::move(dest_args));
   Initialize(dest_.get());
 }
@@ -377,7 +459,7 @@ inline void FileWriter<Dest>::Initialize(absl::string_view filename,
   std::unique_ptr<::tensorflow::WritableFile> dest =
       OpenFile(options.env(), filename, options.append());
   if (ABSL_PREDICT_FALSE(dest == nullptr)) return;
-  FileWriterBase::Reset(options.buffer_size());
+  FileWriterBase::Reset(options.buffer_size(), options.background_append());
   dest_.Reset(std::forward_as_tuple(dest.release()));
   InitializePos(dest_.get());
 }
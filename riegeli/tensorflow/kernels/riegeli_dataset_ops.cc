@@ -14,6 +14,7 @@
 
 #include <stddef.h>
 
+#include <deque>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -22,19 +23,28 @@
 
 #include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "riegeli/base/base.h"
+#include "riegeli/chunk_encoding/field_projection.h"
 #include "riegeli/records/record_position.h"
 #include "riegeli/records/record_reader.h"
+#include "riegeli/records/record_writer.h"
 #include "riegeli/records/skipped_region.h"
 #include "riegeli/tensorflow/io/file_reader.h"
+#include "riegeli/tensorflow/io/file_writer.h"
 #include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/function_handle_cache.h"
 #include "tensorflow/core/framework/kernel_def_builder.h"
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor_types.h"
@@ -42,6 +52,8 @@
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/status.h"
 #include "tensorflow/core/platform/tstring.h"
@@ -60,9 +72,76 @@ namespace riegeli {
 namespace tensorflow {
 namespace {
 
+// Parses `field_projection` attribute of `RiegeliDataset`: each element is a
+// field path with field numbers separated by '.', e.g. "1.2". An empty list
+// includes all fields.
+::tensorflow::Status ParseFieldProjection(
+    const std::vector<std::string>& field_paths,
+    FieldProjection* field_projection) {
+  if (field_paths.empty()) {
+    *field_projection = FieldProjection::All();
+    return ::tensorflow::Status::OK();
+  }
+  *field_projection = FieldProjection();
+  for (const std::string& field_path : field_paths) {
+    Field field;
+    if (!field_path.empty()) {
+      for (const absl::string_view field_number_text :
+           absl::StrSplit(field_path, '.')) {
+        int field_number;
+        if (TF_PREDICT_FALSE(
+                !absl::SimpleAtoi(field_number_text, &field_number) ||
+                field_number < Field::kExistenceOnly ||
+                field_number > (1 << 29) - 1)) {
+          return ::tensorflow::errors::InvalidArgument(
+              "Invalid field path in `field_projection`: \"", field_path,
+              "\"");
+        }
+        field.AddFieldNumber(field_number);
+      }
+    }
+    field_projection->AddField(std::move(field));
+  }
+  return ::tensorflow::Status::OK();
+}
+
 class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
  public:
-  using DatasetOpKernel::DatasetOpKernel;
+  explicit RiegeliDatasetOp(::tensorflow::OpKernelConstruction* ctx)
+      : DatasetOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("cycle_length", &cycle_length_));
+    OP_REQUIRES(
+        ctx, cycle_length_ > 0,
+        ::tensorflow::errors::InvalidArgument("`cycle_length` must be > 0"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("block_length", &block_length_));
+    OP_REQUIRES(
+        ctx, block_length_ > 0,
+        ::tensorflow::errors::InvalidArgument("`block_length` must be > 0"));
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("num_parallel_reads", &num_parallel_reads_));
+    OP_REQUIRES(ctx, num_parallel_reads_ >= 0,
+                ::tensorflow::errors::InvalidArgument(
+                    "`num_parallel_reads` must be >= 0"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("parallelism", &parallelism_));
+    OP_REQUIRES(
+        ctx, parallelism_ >= 0,
+        ::tensorflow::errors::InvalidArgument("`parallelism` must be >= 0"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("batch_size", &batch_size_));
+    OP_REQUIRES(
+        ctx, batch_size_ >= 0,
+        ::tensorflow::errors::InvalidArgument("`batch_size` must be >= 0"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("num_shards", &num_shards_));
+    OP_REQUIRES(
+        ctx, num_shards_ > 0,
+        ::tensorflow::errors::InvalidArgument("`num_shards` must be > 0"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("shard_index", &shard_index_));
+    OP_REQUIRES(ctx, shard_index_ >= 0 && shard_index_ < num_shards_,
+                ::tensorflow::errors::InvalidArgument(
+                    "`shard_index` must be in [0, num_shards)"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("field_projection", &field_paths_));
+    OP_REQUIRES_OK(ctx,
+                   ParseFieldProjection(field_paths_, &field_projection_));
+  }
 
   void MakeDataset(::tensorflow::OpKernelContext* ctx,
                    ::tensorflow::data::DatasetBase** output) override {
@@ -87,7 +166,10 @@ class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
         ctx, buffer_size > 0,
         ::tensorflow::errors::InvalidArgument("`buffer_size` must be > 0"));
 
-    *output = new Dataset(ctx, std::move(filenames), buffer_size);
+    *output = new Dataset(ctx, std::move(filenames), buffer_size, cycle_length_,
+                          block_length_, num_parallel_reads_, parallelism_,
+                          batch_size_, shard_index_, num_shards_, field_paths_,
+                          field_projection_);
   }
 
  private:
@@ -95,10 +177,30 @@ class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
    public:
     explicit Dataset(::tensorflow::OpKernelContext* ctx,
                      std::vector<std::string> filenames,
-                     ::tensorflow::int64 buffer_size)
+                     ::tensorflow::int64 buffer_size,
+                     ::tensorflow::int64 cycle_length,
+                     ::tensorflow::int64 block_length,
+                     ::tensorflow::int64 num_parallel_reads,
+                     ::tensorflow::int64 parallelism,
+                     ::tensorflow::int64 batch_size,
+                     ::tensorflow::int64 shard_index,
+                     ::tensorflow::int64 num_shards,
+                     std::vector<std::string> field_paths,
+                     FieldProjection field_projection)
         : DatasetBase(::tensorflow::data::DatasetContext(ctx)),
           filenames_(std::move(filenames)),
-          buffer_size_(buffer_size) {}
+          buffer_size_(buffer_size),
+          cycle_length_(cycle_length),
+          block_length_(block_length),
+          num_parallel_reads_(num_parallel_reads),
+          parallelism_(parallelism),
+          batch_size_(batch_size),
+          output_shapes_({batch_size > 0 ? ::tensorflow::PartialTensorShape({-1})
+                                         : ::tensorflow::PartialTensorShape()}),
+          shard_index_(shard_index),
+          num_shards_(num_shards),
+          field_paths_(std::move(field_paths)),
+          field_projection_(std::move(field_projection)) {}
 
     std::unique_ptr<::tensorflow::data::IteratorBase> MakeIteratorInternal(
         const std::string& prefix) const override {
@@ -114,9 +216,7 @@ class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
 
     const std::vector<::tensorflow::PartialTensorShape>& output_shapes()
         const override {
-      static const std::vector<::tensorflow::PartialTensorShape>* const shapes =
-          new std::vector<::tensorflow::PartialTensorShape>({{}});
-      return *shapes;
+      return output_shapes_;
     }
 
     std::string DebugString() const override {
@@ -139,7 +239,33 @@ class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
       TF_RETURN_IF_ERROR(b->AddVector(filenames_, &filenames));
       ::tensorflow::Node* buffer_size = nullptr;
       TF_RETURN_IF_ERROR(b->AddScalar(buffer_size_, &buffer_size));
-      TF_RETURN_IF_ERROR(b->AddDataset(this, {filenames, buffer_size}, output));
+      ::tensorflow::AttrValue cycle_length;
+      b->BuildAttrValue(cycle_length_, &cycle_length);
+      ::tensorflow::AttrValue block_length;
+      b->BuildAttrValue(block_length_, &block_length);
+      ::tensorflow::AttrValue num_parallel_reads;
+      b->BuildAttrValue(num_parallel_reads_, &num_parallel_reads);
+      ::tensorflow::AttrValue parallelism;
+      b->BuildAttrValue(parallelism_, &parallelism);
+      ::tensorflow::AttrValue batch_size;
+      b->BuildAttrValue(batch_size_, &batch_size);
+      ::tensorflow::AttrValue shard_index;
+      b->BuildAttrValue(shard_index_, &shard_index);
+      ::tensorflow::AttrValue num_shards;
+      b->BuildAttrValue(num_shards_, &num_shards);
+      ::tensorflow::AttrValue field_projection;
+      b->BuildAttrValue(field_paths_, &field_projection);
+      TF_RETURN_IF_ERROR(
+          b->AddDataset(this, {filenames, buffer_size},
+                        {{"cycle_length", cycle_length},
+                         {"block_length", block_length},
+                         {"num_parallel_reads", num_parallel_reads},
+                         {"parallelism", parallelism},
+                         {"batch_size", batch_size},
+                         {"shard_index", shard_index},
+                         {"num_shards", num_shards},
+                         {"field_projection", field_projection}},
+                        output));
       return ::tensorflow::Status::OK();
     }
 
@@ -147,64 +273,85 @@ class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
     class Iterator : public ::tensorflow::data::DatasetIterator<Dataset> {
      public:
       explicit Iterator(const Params& params)
-          : DatasetIterator<Dataset>(params) {}
+          : DatasetIterator<Dataset>(params),
+            slots_(IntCast<size_t>(dataset()->cycle_length_)) {
+        if (dataset()->num_parallel_reads_ > 0) {
+          thread_pool_ = std::make_unique<::tensorflow::thread::ThreadPool>(
+              ::tensorflow::Env::Default(), "riegeli_dataset",
+              IntCast<int>(dataset()->num_parallel_reads_));
+        }
+      }
 
       ::tensorflow::Status GetNextInternal(
           ::tensorflow::data::IteratorContext* ctx,
           std::vector<::tensorflow::Tensor>* out_tensors,
           bool* end_of_sequence) override ABSL_LOCKS_EXCLUDED(mu_) {
         absl::MutexLock l(&mu_);
+        const size_t max_records =
+            dataset()->batch_size_ > 0 ? IntCast<size_t>(dataset()->batch_size_)
+                                       : size_t{1};
+        std::vector<::tensorflow::tstring> records;
         for (;;) {
-          if (reader_ != absl::nullopt) {
-            // We are currently processing a file, so try to read the next
-            // record.
-            ::tensorflow::Tensor result_tensor(::tensorflow::cpu_allocator(),
-                                               ::tensorflow::DT_STRING, {});
-            absl::string_view value;
-            if (TF_PREDICT_TRUE(reader_->ReadRecord(value))) {
-              result_tensor.scalar<::tensorflow::tstring>()().assign(
-                  value.data(), value.size());
-              out_tensors->push_back(std::move(result_tensor));
-              *end_of_sequence = false;
-              return ::tensorflow::Status::OK();
-            }
-            SkippedRegion skipped_region;
-            if (reader_->Recover(&skipped_region)) {
-              // File has invalid contents: return an error. Further iteration
-              // will resume reading the file after the invalid region has been
-              // skipped.
-              *end_of_sequence = false;
-              return ::tensorflow::errors::InvalidArgument(
-                  "Skipping invalid region of a Riegeli/records file: ",
-                  skipped_region.ToString());
-            }
-            if (TF_PREDICT_FALSE(!reader_->Close())) {
-              // Failed to read the file: return an error.
-              const absl::Status status = reader_->status();
-              // Further iteration will move on to the next file, if any.
-              reader_.reset();
-              ++current_file_index_;
-              *end_of_sequence =
-                  current_file_index_ == dataset()->filenames_.size();
-              return ::tensorflow::Status(
-                  static_cast<::tensorflow::error::Code>(status.code()),
-                  status.message());
-            }
-            // We have reached the end of the current file, so move on to the
-            // next file, if any.
-            reader_.reset();
-            ++current_file_index_;
+          Slot* const slot = NextElementSlot(ctx);
+          if (slot == nullptr) break;
+          Element& element = slot->elements.front();
+          if (element.kind == Element::Kind::kRecord) {
+            records.push_back(std::move(element.record));
+            slot->elements.pop_front();
+            if (++block_index_ == dataset()->block_length_) NextSlot();
+            if (records.size() == max_records) break;
+            continue;
           }
-
+          if (element.kind == Element::Kind::kEnd) {
+            // We have reached the end of the file in this slot, so move on to
+            // the next file, if any.
+            slot->elements.pop_front();
+            CloseSlot(*slot);
+            NextSlot();
+            continue;
+          }
+          // Records collected so far are returned before an error. The error
+          // is returned by the next call.
+          if (!records.empty()) break;
+          const ::tensorflow::Status status = std::move(element.status);
+          *end_of_sequence = false;
+          if (element.kind == Element::Kind::kSkippedRegion) {
+            // File has invalid contents: return an error. Further iteration
+            // will resume reading the file after the invalid region has been
+            // skipped.
+            slot->elements.pop_front();
+            return status;
+          }
+          // Failed to read the file: return an error. Further iteration will
+          // move on to the next file, if any.
+          slot->elements.pop_front();
+          CloseSlot(*slot);
+          NextSlot();
+          return status;
+        }
+        if (records.empty()) {
           // Iteration ends when there are no more files to process.
-          if (current_file_index_ == dataset()->filenames_.size()) {
-            *end_of_sequence = true;
-            return ::tensorflow::Status::OK();
+          *end_of_sequence = true;
+          return ::tensorflow::Status::OK();
+        }
+        if (dataset()->batch_size_ > 0) {
+          ::tensorflow::Tensor result_tensor(
+              ::tensorflow::cpu_allocator(), ::tensorflow::DT_STRING,
+              {IntCast<::tensorflow::int64>(records.size())});
+          auto result = result_tensor.flat<::tensorflow::tstring>();
+          for (size_t i = 0; i < records.size(); ++i) {
+            result(i) = std::move(records[i]);
           }
-
-          // Actually move on to next file.
-          OpenFile(ctx);
+          out_tensors->push_back(std::move(result_tensor));
+        } else {
+          ::tensorflow::Tensor result_tensor(::tensorflow::cpu_allocator(),
+                                             ::tensorflow::DT_STRING, {});
+          result_tensor.scalar<::tensorflow::tstring>()() =
+              std::move(records.front());
+          out_tensors->push_back(std::move(result_tensor));
         }
+        *end_of_sequence = false;
+        return ::tensorflow::Status::OK();
       }
 
      protected:
@@ -217,12 +364,34 @@ class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
           ::tensorflow::data::IteratorStateWriter* writer) override
           ABSL_LOCKS_EXCLUDED(mu_) {
         absl::MutexLock l(&mu_);
+        // Positions are known only when no reads are pending.
+        mu_.Await(absl::Condition(this, &Iterator::NoReadsPending));
         TF_RETURN_IF_ERROR(writer->WriteScalar(
-            full_name("current_file_index"),
-            IntCast<::tensorflow::int64>(current_file_index_)));
-        if (reader_ != absl::nullopt) {
-          TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("current_pos"),
-                                                 reader_->pos().ToBytes()));
+            full_name("next_file_index"),
+            IntCast<::tensorflow::int64>(next_file_index_)));
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(full_name("current_slot"),
+                                IntCast<::tensorflow::int64>(current_slot_)));
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(full_name("block_index"), block_index_));
+        for (size_t i = 0; i < slots_.size(); ++i) {
+          const Slot& slot = slots_[i];
+          if (slot.reader == absl::nullopt) continue;
+          // Reading resumes from the first element not returned yet, so that
+          // elements read ahead are read again.
+          //
+          // The position is restored with `RecordReaderBase::Seek()`, which
+          // reads only the chunk containing it, so restoring takes time
+          // independent of how far the file has been read.
+          const RecordPosition pos = slot.elements.empty()
+                                         ? slot.reader->pos()
+                                         : slot.elements.front().pos;
+          TF_RETURN_IF_ERROR(writer->WriteScalar(
+              full_name(absl::StrCat("slot_file_index_", i)),
+              IntCast<::tensorflow::int64>(slot.file_index)));
+          TF_RETURN_IF_ERROR(
+              writer->WriteScalar(full_name(absl::StrCat("slot_pos_", i)),
+                                  pos.ToBytes()));
         }
         return ::tensorflow::Status::OK();
       }
@@ -232,71 +401,504 @@ class RiegeliDatasetOp : public ::tensorflow::data::DatasetOpKernel {
           ::tensorflow::data::IteratorStateReader* reader) override
           ABSL_LOCKS_EXCLUDED(mu_) {
         absl::MutexLock l(&mu_);
-        current_file_index_ = 0;
-        reader_.reset();
-
-        ::tensorflow::int64 current_file_index;
-        TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("current_file_index"),
-                                              &current_file_index));
-        if (TF_PREDICT_FALSE(current_file_index < 0 ||
-                             IntCast<::tensorflow::uint64>(current_file_index) >
+        mu_.Await(absl::Condition(this, &Iterator::NoReadsPending));
+        next_file_index_ = 0;
+        current_slot_ = 0;
+        block_index_ = 0;
+        for (Slot& slot : slots_) CloseSlot(slot);
+
+        if (reader->Contains(full_name("current_file_index"))) {
+          // State saved before interleaving was supported.
+          return RestoreSequential(ctx, reader);
+        }
+
+        TF_RETURN_IF_ERROR(
+            ReadFileIndex(reader, "next_file_index", &next_file_index_));
+        ::tensorflow::int64 current_slot;
+        TF_RETURN_IF_ERROR(
+            reader->ReadScalar(full_name("current_slot"), &current_slot));
+        if (TF_PREDICT_FALSE(
+                current_slot < 0 ||
+                IntCast<::tensorflow::uint64>(current_slot) >= slots_.size())) {
+          return ::tensorflow::errors::Internal("current_slot out of range");
+        }
+        current_slot_ = IntCast<size_t>(current_slot);
+        TF_RETURN_IF_ERROR(
+            reader->ReadScalar(full_name("block_index"), &block_index_));
+        if (TF_PREDICT_FALSE(block_index_ < 0 ||
+                             block_index_ >= dataset()->block_length_)) {
+          return ::tensorflow::errors::Internal("block_index out of range");
+        }
+        for (size_t i = 0; i < slots_.size(); ++i) {
+          const std::string slot_file_index_key =
+              absl::StrCat("slot_file_index_", i);
+          if (!reader->Contains(full_name(slot_file_index_key))) continue;
+          size_t file_index;
+          TF_RETURN_IF_ERROR(
+              ReadFileIndex(reader, slot_file_index_key, &file_index));
+          if (TF_PREDICT_FALSE(file_index >= next_file_index_)) {
+            return ::tensorflow::errors::Internal(slot_file_index_key,
+                                                  " out of range");
+          }
+          RecordPosition pos;
+          TF_RETURN_IF_ERROR(
+              ReadPos(reader, absl::StrCat("slot_pos_", i), &pos));
+          OpenFile(ctx, file_index, slots_[i]);
+          slots_[i].reader->Seek(pos);
+          // Any errors from seeking will be reported during reading.
+        }
+        return ::tensorflow::Status::OK();
+      }
+
+     private:
+      // A record read from a file, or another outcome of reading which is
+      // reported by `GetNextInternal()` in order.
+      struct Element {
+        enum class Kind { kRecord, kSkippedRegion, kFailure, kEnd };
+
+        Kind kind;
+        // Position from which reading reproduces this element.
+        RecordPosition pos;
+        // The record if `kind == Kind::kRecord`.
+        ::tensorflow::tstring record;
+        // The error if `kind == Kind::kSkippedRegion` or `Kind::kFailure`.
+        ::tensorflow::Status status;
+      };
+
+      // A file being read, at one position of the interleaving cycle.
+      struct Slot {
+        bool HasElements() const { return !elements.empty(); }
+
+        size_t file_index = 0;
+        // `absl::nullopt` means that the slot is empty.
+        absl::optional<RecordReader<tensorflow::FileReader<>>> reader;
+        // Elements read ahead and not returned yet.
+        std::deque<Element> elements;
+        // Whether the last element of `elements` ends the file.
+        bool done = false;
+        // Whether a background read into this slot is scheduled. If so, only
+        // the background read accesses `reader`.
+        bool read_pending = false;
+      };
+
+      bool NoReadsPending() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+        return reads_pending_ == 0;
+      }
+
+      bool AllFilesDone() const ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+        if (next_file_index_ < dataset()->filenames_.size()) return false;
+        for (const Slot& slot : slots_) {
+          if (slot.reader != absl::nullopt) return false;
+        }
+        return true;
+      }
+
+      // Returns the slot from which the next element should be returned, with
+      // at least one element read, or `nullptr` if there are no more files to
+      // process.
+      Slot* NextElementSlot(::tensorflow::data::IteratorContext* ctx)
+          ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        for (;;) {
+          OpenFiles(ctx);
+          if (AllFilesDone()) return nullptr;
+          Slot& slot = slots_[current_slot_];
+          if (slot.reader == absl::nullopt) {
+            // No more files to put in this slot.
+            NextSlot();
+            continue;
+          }
+          if (thread_pool_ != nullptr) {
+            ScheduleReads();
+            mu_.Await(absl::Condition(&slot, &Slot::HasElements));
+          } else if (slot.elements.empty()) {
+            slot.done = ReadElements(1, *slot.reader, slot.elements);
+          }
+          return &slot;
+        }
+      }
+
+      void NextSlot() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        if (++current_slot_ == slots_.size()) current_slot_ = 0;
+        block_index_ = 0;
+      }
+
+      // Opens next files in empty slots, in the order of slots.
+      void OpenFiles(::tensorflow::data::IteratorContext* ctx)
+          ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        for (Slot& slot : slots_) {
+          if (next_file_index_ == dataset()->filenames_.size()) return;
+          if (slot.reader == absl::nullopt) {
+            OpenFile(ctx, next_file_index_++, slot);
+          }
+        }
+      }
+
+      void OpenFile(::tensorflow::data::IteratorContext* ctx,
+                    size_t file_index, Slot& slot)
+          ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        const std::string& filename = dataset()->filenames_[file_index];
+        RecordReaderBase::Options record_reader_options;
+        record_reader_options
+            .set_field_projection(dataset()->field_projection_)
+            .set_parallelism(IntCast<int>(dataset()->parallelism_));
+        ::tensorflow::Status status;
+        if (dataset()->num_shards_ > 1) {
+          // Partition the file by chunk positions, so that shards can be read
+          // without coordination.
+          ::tensorflow::uint64 size;
+          status = ctx->env()->GetFileSize(filename, &size);
+          if (status.ok()) {
+            const Position num_shards =
+                IntCast<Position>(dataset()->num_shards_);
+            const Position shard_index =
+                IntCast<Position>(dataset()->shard_index_);
+            record_reader_options.set_chunk_range(
+                ShardBoundary(size, shard_index, num_shards),
+                ShardBoundary(size, shard_index + 1, num_shards));
+          }
+        }
+        slot.file_index = file_index;
+        slot.reader.emplace(
+            std::forward_as_tuple(
+                filename,
+                tensorflow::FileReaderBase::Options()
+                    .set_env(ctx->env())
+                    .set_buffer_size(IntCast<size_t>(dataset()->buffer_size_))),
+            std::move(record_reader_options));
+        if (TF_PREDICT_FALSE(!status.ok())) {
+          // Report the failure during reading, in order with other elements.
+          Element element;
+          element.kind = Element::Kind::kFailure;
+          element.pos = slot.reader->pos();
+          element.status = std::move(status);
+          slot.elements.push_back(std::move(element));
+          slot.done = true;
+        }
+      }
+
+      // Returns the position which is `shard_index / num_shards` of `size`.
+      static Position ShardBoundary(Position size, Position shard_index,
+                                    Position num_shards) {
+        // Avoid overflow of `size * shard_index`.
+        return size / num_shards * shard_index +
+               size % num_shards * shard_index / num_shards;
+      }
+
+      void CloseSlot(Slot& slot) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        RIEGELI_ASSERT(!slot.read_pending)
+            << "Failed precondition of RiegeliDatasetOp::Iterator::CloseSlot(): "
+               "read pending";
+        slot.reader.reset();
+        slot.elements.clear();
+        slot.done = false;
+      }
+
+      // Schedules reading the next block of records in background for slots
+      // with no elements read ahead.
+      void ScheduleReads() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        for (Slot& slot : slots_) {
+          if (slot.reader == absl::nullopt || slot.done || slot.read_pending ||
+              !slot.elements.empty()) {
+            continue;
+          }
+          slot.read_pending = true;
+          ++reads_pending_;
+          thread_pool_->Schedule([this, &slot] {
+            std::deque<Element> elements;
+            const bool done =
+                ReadElements(IntCast<size_t>(dataset()->block_length_),
+                             *slot.reader, elements);
+            absl::MutexLock l(&mu_);
+            for (Element& element : elements) {
+              slot.elements.push_back(std::move(element));
+            }
+            slot.done = done;
+            slot.read_pending = false;
+            --reads_pending_;
+          });
+        }
+      }
+
+      // Reads up to `max_records` records from `reader` to `elements`,
+      // stopping early after an element which is not a record.
+      //
+      // Returns `true` if the file ended (with success or failure).
+      static bool ReadElements(size_t max_records,
+                               RecordReader<tensorflow::FileReader<>>& reader,
+                               std::deque<Element>& elements) {
+        for (size_t num_records = 0; num_records < max_records;
+             ++num_records) {
+          Element element;
+          element.pos = reader.pos();
+          absl::string_view record;
+          if (TF_PREDICT_TRUE(reader.ReadRecord(record))) {
+            element.kind = Element::Kind::kRecord;
+            element.record.assign(record.data(), record.size());
+            elements.push_back(std::move(element));
+            continue;
+          }
+          SkippedRegion skipped_region;
+          if (reader.Recover(&skipped_region)) {
+            element.kind = Element::Kind::kSkippedRegion;
+            element.status = ::tensorflow::errors::InvalidArgument(
+                "Skipping invalid region of a Riegeli/records file: ",
+                skipped_region.ToString());
+            elements.push_back(std::move(element));
+            return false;
+          }
+          if (TF_PREDICT_FALSE(!reader.Close())) {
+            const absl::Status status = reader.status();
+            element.kind = Element::Kind::kFailure;
+            element.status = ::tensorflow::Status(
+                static_cast<::tensorflow::error::Code>(status.code()),
+                status.message());
+          } else {
+            element.kind = Element::Kind::kEnd;
+          }
+          elements.push_back(std::move(element));
+          return true;
+        }
+        return false;
+      }
+
+      ::tensorflow::Status ReadFileIndex(
+          ::tensorflow::data::IteratorStateReader* reader,
+          const std::string& key, size_t* file_index) {
+        ::tensorflow::int64 value;
+        TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(key), &value));
+        if (TF_PREDICT_FALSE(value < 0 ||
+                             IntCast<::tensorflow::uint64>(value) >
                                  dataset()->filenames_.size())) {
+          return ::tensorflow::errors::Internal(key, " out of range");
+        }
+        *file_index = IntCast<size_t>(value);
+        return ::tensorflow::Status::OK();
+      }
+
+      ::tensorflow::Status ReadPos(
+          ::tensorflow::data::IteratorStateReader* reader,
+          const std::string& key, RecordPosition* pos) {
+        ::tensorflow::tstring value;
+        TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(key), &value));
+        if (TF_PREDICT_FALSE(!pos->FromBytes(value))) {
           return ::tensorflow::errors::Internal(
-              "current_file_index out of range");
+              key, " is not a valid RecordPosition");
         }
-        current_file_index_ = IntCast<size_t>(current_file_index);
+        return ::tensorflow::Status::OK();
+      }
 
+      // Restores state saved when files were read one after another, which
+      // corresponds to `cycle_length == 1`.
+      ::tensorflow::Status RestoreSequential(
+          ::tensorflow::data::IteratorContext* ctx,
+          ::tensorflow::data::IteratorStateReader* reader)
+          ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        size_t current_file_index;
+        TF_RETURN_IF_ERROR(
+            ReadFileIndex(reader, "current_file_index", &current_file_index));
+        next_file_index_ = current_file_index;
         if (reader->Contains(full_name("current_pos"))) {
-          if (TF_PREDICT_FALSE(current_file_index_ ==
+          if (TF_PREDICT_FALSE(current_file_index ==
                                dataset()->filenames_.size())) {
             return ::tensorflow::errors::Internal(
                 "current_file_index out of range");
           }
-          ::tensorflow::tstring current_pos;
-          TF_RETURN_IF_ERROR(
-              reader->ReadScalar(full_name("current_pos"), &current_pos));
-          RecordPosition pos;
-          if (TF_PREDICT_FALSE(!pos.FromBytes(current_pos))) {
-            return ::tensorflow::errors::Internal(
-                "current_pos is not a valid RecordPosition");
+          if (TF_PREDICT_FALSE(slots_.size() != 1)) {
+            return ::tensorflow::errors::FailedPrecondition(
+                "Restoring a position saved without interleaving requires "
+                "`cycle_length == 1`");
           }
-          OpenFile(ctx);
-          reader_->Seek(pos);
+          RecordPosition pos;
+          TF_RETURN_IF_ERROR(ReadPos(reader, "current_pos", &pos));
+          OpenFile(ctx, next_file_index_++, slots_[0]);
+          slots_[0].reader->Seek(pos);
           // Any errors from seeking will be reported during reading.
         }
         return ::tensorflow::Status::OK();
       }
 
-     private:
-      void OpenFile(::tensorflow::data::IteratorContext* ctx)
-          ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-        reader_.emplace(std::forward_as_tuple(
-            dataset()->filenames_[current_file_index_],
-            tensorflow::FileReaderBase::Options()
-                .set_env(ctx->env())
-                .set_buffer_size(IntCast<size_t>(dataset()->buffer_size_))));
-      }
-
       // Invariants:
-      //   `current_file_index_ <= dataset()->filenames_.size()`
-      //   if `current_file_index_ == dataset()->filenames_.size()` then
-      //       `reader_ == absl::nullopt`
+      //   `next_file_index_ <= dataset()->filenames_.size()`
+      //   `current_slot_ < slots_.size()`
+      //   `block_index_ < dataset()->block_length_`
+      //   `reads_pending_` is the number of slots with `read_pending`
 
       absl::Mutex mu_;
-      size_t current_file_index_ ABSL_GUARDED_BY(mu_) = 0;
-      // `absl::nullopt` means not open yet.
-      absl::optional<RecordReader<tensorflow::FileReader<>>> reader_
-          ABSL_GUARDED_BY(mu_);
+      // Index of the next file to open in an empty slot.
+      size_t next_file_index_ ABSL_GUARDED_BY(mu_) = 0;
+      // Slot from which the next record is returned.
+      size_t current_slot_ ABSL_GUARDED_BY(mu_) = 0;
+      // Number of records returned from `current_slot_` in its current block.
+      ::tensorflow::int64 block_index_ ABSL_GUARDED_BY(mu_) = 0;
+      // `dataset()->cycle_length_` slots. Their addresses are stable.
+      std::vector<Slot> slots_ ABSL_GUARDED_BY(mu_);
+      size_t reads_pending_ ABSL_GUARDED_BY(mu_) = 0;
+      // If `dataset()->num_parallel_reads_ > 0`, reads blocks of records in
+      // background. Otherwise `nullptr`.
+      //
+      // Destroyed first, which waits for pending reads.
+      std::unique_ptr<::tensorflow::thread::ThreadPool> thread_pool_;
     };
 
     const std::vector<std::string> filenames_;
     const ::tensorflow::int64 buffer_size_;
+    const ::tensorflow::int64 cycle_length_;
+    const ::tensorflow::int64 block_length_;
+    const ::tensorflow::int64 num_parallel_reads_;
+    const ::tensorflow::int64 parallelism_;
+    const ::tensorflow::int64 batch_size_;
+    // Scalars if `batch_size_ == 0`, otherwise vectors.
+    const std::vector<::tensorflow::PartialTensorShape> output_shapes_;
+    const ::tensorflow::int64 shard_index_;
+    const ::tensorflow::int64 num_shards_;
+    const std::vector<std::string> field_paths_;
+    const FieldProjection field_projection_;
   };
+
+  ::tensorflow::int64 cycle_length_ = 1;
+  ::tensorflow::int64 block_length_ = 1;
+  ::tensorflow::int64 num_parallel_reads_ = 0;
+  ::tensorflow::int64 parallelism_ = 0;
+  ::tensorflow::int64 batch_size_ = 0;
+  ::tensorflow::int64 shard_index_ = 0;
+  ::tensorflow::int64 num_shards_ = 1;
+  std::vector<std::string> field_paths_;
+  FieldProjection field_projection_;
 };
 
 REGISTER_KERNEL_BUILDER(Name("RiegeliDataset").Device(::tensorflow::DEVICE_CPU),
                         RiegeliDatasetOp);
 
+::tensorflow::Status ToTensorFlowStatus(const absl::Status& status) {
+  return ::tensorflow::Status(
+      static_cast<::tensorflow::error::Code>(status.code()), status.message());
+}
+
+class WriteRiegeliDatasetOp : public ::tensorflow::AsyncOpKernel {
+ public:
+  explicit WriteRiegeliDatasetOp(::tensorflow::OpKernelConstruction* ctx)
+      : AsyncOpKernel(ctx),
+        thread_pool_(::tensorflow::Env::Default(), "write_riegeli_dataset",
+                     1) {
+    std::string options;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("options", &options));
+    OP_REQUIRES_OK(ctx, ToTensorFlowStatus(
+                            record_writer_options_.FromString(options)));
+  }
+
+  void ComputeAsync(::tensorflow::OpKernelContext* ctx,
+                    DoneCallback done) override {
+    // Getting elements of the dataset may block waiting for inter-op threads,
+    // so the dataset is consumed in a separate thread.
+    thread_pool_.Schedule([this, ctx, done] {
+      OP_REQUIRES_OK_ASYNC(ctx, DoCompute(ctx), done);
+      done();
+    });
+  }
+
+ private:
+  ::tensorflow::Status DoCompute(::tensorflow::OpKernelContext* ctx) {
+    ::tensorflow::data::DatasetBase* dataset;
+    TF_RETURN_IF_ERROR(::tensorflow::data::GetDatasetFromVariantTensor(
+        ctx->input(0), &dataset));
+    if (TF_PREDICT_FALSE(dataset->output_dtypes() !=
+                         ::tensorflow::DataTypeVector(
+                             {::tensorflow::DT_STRING}))) {
+      return ::tensorflow::errors::InvalidArgument(
+          "`input_dataset` must contain strings");
+    }
+    const ::tensorflow::Tensor* filenames_tensor;
+    TF_RETURN_IF_ERROR(ctx->input("filenames", &filenames_tensor));
+    if (TF_PREDICT_FALSE(filenames_tensor->dims() > 1 ||
+                         filenames_tensor->NumElements() == 0)) {
+      return ::tensorflow::errors::InvalidArgument(
+          "`filenames` must be a scalar or a non-empty vector.");
+    }
+
+    // Elements are distributed between files round-robin. Each file is
+    // encoded by its own `RecordWriter`, with `parallelism` from
+    // `record_writer_options_` applying to each of them.
+    std::deque<RecordWriter<tensorflow::FileWriter<>>> writers;
+    for (int i = 0; i < filenames_tensor->NumElements(); ++i) {
+      const ::tensorflow::tstring& filename =
+          filenames_tensor->flat<::tensorflow::tstring>()(i);
+      writers.emplace_back(
+          std::forward_as_tuple(
+              absl::string_view(filename.data(), filename.size()),
+              tensorflow::FileWriterBase::Options().set_env(ctx->env())),
+          record_writer_options_);
+    }
+    ::tensorflow::Status status = WriteElements(ctx, dataset, writers);
+    for (RecordWriter<tensorflow::FileWriter<>>& writer : writers) {
+      if (TF_PREDICT_FALSE(!writer.Close()) && status.ok()) {
+        status = ToTensorFlowStatus(writer.status());
+      }
+    }
+    return status;
+  }
+
+  ::tensorflow::Status WriteElements(
+      ::tensorflow::OpKernelContext* ctx,
+      ::tensorflow::data::DatasetBase* dataset,
+      std::deque<RecordWriter<tensorflow::FileWriter<>>>& writers) {
+    for (RecordWriter<tensorflow::FileWriter<>>& writer : writers) {
+      if (TF_PREDICT_FALSE(!writer.healthy())) {
+        return ToTensorFlowStatus(writer.status());
+      }
+    }
+    ::tensorflow::data::IteratorContext::Params params(ctx);
+    ::tensorflow::data::FunctionHandleCache function_handle_cache(params.flr);
+    params.function_handle_cache = &function_handle_cache;
+    ::tensorflow::ResourceMgr resource_mgr;
+    params.resource_mgr = &resource_mgr;
+    // `::tensorflow::data::IteratorContext::Params::cancellation_manager` was
+    // added in TensorFlow 2.1.
+#if TF_MAJOR_VERSION > 2 || (TF_MAJOR_VERSION == 2 && TF_MINOR_VERSION >= 1)
+    ::tensorflow::CancellationManager cancellation_manager;
+    params.cancellation_manager = &cancellation_manager;
+#endif
+    ::tensorflow::data::IteratorContext iter_ctx(std::move(params));
+    std::unique_ptr<::tensorflow::data::IteratorBase> iterator;
+    // `parent` argument of `::tensorflow::data::DatasetBase::MakeIterator()`
+    // was added in TensorFlow 2.2.
+#if TF_MAJOR_VERSION > 2 || (TF_MAJOR_VERSION == 2 && TF_MINOR_VERSION >= 2)
+    TF_RETURN_IF_ERROR(dataset->MakeIterator(
+        &iter_ctx, nullptr, "WriteRiegeliDatasetIterator", &iterator));
+#else
+    TF_RETURN_IF_ERROR(dataset->MakeIterator(
+        &iter_ctx, "WriteRiegeliDatasetIterator", &iterator));
+#endif
+
+    std::vector<::tensorflow::Tensor> components;
+    size_t writer_index = 0;
+    for (;;) {
+      bool end_of_sequence;
+      components.clear();
+      TF_RETURN_IF_ERROR(
+          iterator->GetNext(&iter_ctx, &components, &end_of_sequence));
+      if (end_of_sequence) return ::tensorflow::Status::OK();
+      RecordWriter<tensorflow::FileWriter<>>& writer = writers[writer_index];
+      // A vector element, e.g. from `RiegeliDataset` with `batch_size`, is
+      // written as consecutive records.
+      const auto records = components[0].flat<::tensorflow::tstring>();
+      for (::tensorflow::int64 i = 0; i < records.size(); ++i) {
+        if (TF_PREDICT_FALSE(!writer.WriteRecord(
+                absl::string_view(records(i).data(), records(i).size())))) {
+          return ToTensorFlowStatus(writer.status());
+        }
+      }
+      if (++writer_index == writers.size()) writer_index = 0;
+    }
+  }
+
+  RecordWriterBase::Options record_writer_options_;
+  ::tensorflow::thread::ThreadPool thread_pool_;
+};
+
+REGISTER_KERNEL_BUILDER(
+    Name("WriteRiegeliDataset").Device(::tensorflow::DEVICE_CPU),
+    WriteRiegeliDatasetOp);
+
 }  // namespace
 }  // namespace tensorflow
 }  // namespace riegeli
@@ -23,6 +23,14 @@ REGISTER_OP("RiegeliDataset")
     .Input("filenames: string")
     .Input("buffer_size: int64")
     .Output("handle: variant")
+    .Attr("cycle_length: int = 1")
+    .Attr("block_length: int = 1")
+    .Attr("num_parallel_reads: int = 0")
+    .Attr("parallelism: int = 0")
+    .Attr("batch_size: int = 0")
+    .Attr("shard_index: int = 0")
+    .Attr("num_shards: int = 1")
+    .Attr("field_projection: list(string) = []")
     .SetIsStateful()
     .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
       ::tensorflow::shape_inference::ShapeHandle unused;
@@ -38,6 +46,47 @@ Creates a dataset that emits the records from one or more Riegeli/records files.
 filenames: A scalar or vector containing the name(s) of the file(s) to be
   read.
 buffer_size: Tunes how much data is buffered after reading from the file.
+cycle_length: The number of files read concurrently. Records are interleaved
+  between them.
+block_length: The number of consecutive records to return from each file
+  before moving on to the next one in the cycle.
+num_parallel_reads: If positive, the number of threads reading blocks of
+  records ahead from files in the cycle. If 0, records are read on demand.
+parallelism: If positive, the number of chunks of each file which are read
+  ahead and decoded in background. If 0, chunks are decoded on demand.
+batch_size: If positive, each element is a vector of up to this many records,
+  fewer only at the end of the dataset or before an error. If 0, each element
+  is a scalar with one record.
+shard_index: The shard of each file to read, in [0, num_shards).
+num_shards: If greater than 1, each file is split by position into this many
+  shards, and only chunks beginning in the range of shard_index are read.
+  Readers of different shards read disjoint records without coordination.
+field_projection: Fields to be included in returned records, each as a path of
+  field numbers separated by '.', e.g. "1.2". Field number 0 at the end of a
+  path preserves only field existence. Empty means all fields.
+)doc");
+
+REGISTER_OP("WriteRiegeliDataset")
+    .Input("input_dataset: variant")
+    .Input("filenames: string")
+    .Attr("options: string = ''")
+    .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+      ::tensorflow::shape_inference::ShapeHandle unused;
+      // `input_dataset` could only be a scalar.
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &unused));
+      // `filenames` must be a scalar or a vector.
+      TF_RETURN_IF_ERROR(c->WithRankAtMost(c->input(1), 1, &unused));
+      return ::tensorflow::Status::OK();
+    })
+    .Doc(R"doc(
+Writes records from a dataset to one or more Riegeli/records files.
+
+input_dataset: A dataset of scalar or vector strings. Each element of a vector
+  is written as a separate record.
+filenames: A scalar or vector containing the name(s) of the file(s) to be
+  written. Dataset elements are distributed between files round-robin.
+options: Options of RecordWriter in text format, e.g. "transpose,parallelism:4".
+  Each file is encoded independently with these options.
 )doc");
 
 }  // namespace tensorflow
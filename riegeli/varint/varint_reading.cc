@@ -17,11 +17,77 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <cstring>
+
 #include "absl/base/optimization.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "riegeli/base/base.h"
 #include "riegeli/bytes/reader.h"
+#include "riegeli/varint/varint.h"
 
 namespace riegeli {
+
+namespace {
+
+template <typename T, size_t kMaxLength,
+          absl::optional<T> (*ReadVarint)(Reader&),
+          absl::optional<ReadFromStringResult<T>> (*ReadVarintFromArray)(
+              const char*, const char*)>
+inline bool ReadVarints(Reader& src, absl::Span<T> dest) {
+  size_t index = 0;
+  while (index < dest.size()) {
+    if (src.available() < kMaxLength) {
+      // A varint can cross the end of the buffer. Let `ReadVarint()` pull more
+      // data.
+      const absl::optional<T> value = ReadVarint(src);
+      if (ABSL_PREDICT_FALSE(value == absl::nullopt)) return false;
+      dest[index++] = *value;
+      continue;
+    }
+    // Varints starting before `safe_limit` are entirely in the buffer unless
+    // they are invalid.
+    const char* cursor = src.cursor();
+    const char* const safe_limit = src.limit() - (kMaxLength - 1);
+    while (index < dest.size() && cursor < safe_limit) {
+      if (dest.size() - index >= 8 && PtrDistance(cursor, src.limit()) >= 8) {
+        uint64_t word;
+        std::memcpy(&word, cursor, sizeof(word));
+        if ((word & uint64_t{0x8080808080808080}) == 0) {
+          // 8 varints of one byte each.
+          for (size_t i = 0; i < 8; ++i) {
+            dest[index + i] = T{static_cast<uint8_t>(cursor[i])};
+          }
+          index += 8;
+          cursor += 8;
+          continue;
+        }
+      }
+      const absl::optional<ReadFromStringResult<T>> result =
+          ReadVarintFromArray(cursor, src.limit());
+      if (ABSL_PREDICT_FALSE(result == absl::nullopt)) {
+        src.set_cursor(cursor);
+        return false;
+      }
+      dest[index++] = result->value;
+      cursor = result->cursor;
+    }
+    src.set_cursor(cursor);
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ReadVarint32s(Reader& src, absl::Span<uint32_t> dest) {
+  return ReadVarints<uint32_t, kMaxLengthVarint32, ReadVarint32, ReadVarint32>(
+      src, dest);
+}
+
+bool ReadVarint64s(Reader& src, absl::Span<uint64_t> dest) {
+  return ReadVarints<uint64_t, kMaxLengthVarint64, ReadVarint64, ReadVarint64>(
+      src, dest);
+}
 namespace internal {
 
 absl::optional<ReadFromStringResult<uint64_t>> ReadVarint64Slow(
@@ -22,6 +22,7 @@
 
 #include "absl/base/optimization.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/varint/varint.h"
 
@@ -48,6 +49,17 @@ namespace riegeli {
 absl::optional<uint32_t> ReadVarint32(Reader& src);
 absl::optional<uint64_t> ReadVarint64(Reader& src);
 
+// Reads `dest.size()` varints into `dest`.
+//
+// This is faster than calling `ReadVarint{32,64}()` in a loop, especially if
+// most values are smaller than 128, i.e. take a single byte: runs of 8 such
+// values are decoded at once.
+//
+// Returns `false` on failure. Varints read before the failure are stored in
+// `dest`, and the current position is after them.
+bool ReadVarint32s(Reader& src, absl::Span<uint32_t> dest);
+bool ReadVarint64s(Reader& src, absl::Span<uint64_t> dest);
+
 // Reads a varint.
 //
 // Accepts only the canonical representation, i.e. the shortest: rejecting a
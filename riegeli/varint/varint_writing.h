@@ -18,7 +18,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <limits>
+
 #include "absl/base/optimization.h"
+#include "absl/types/span.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/port.h"
 #include "riegeli/bytes/backward_writer.h"
@@ -35,6 +38,15 @@ bool WriteVarint64(uint64_t data, Writer& dest);
 bool WriteVarint32(uint32_t data, BackwardWriter& dest);
 bool WriteVarint64(uint64_t data, BackwardWriter& dest);
 
+// Writes an array of varints.
+//
+// This is faster than writing them individually: space for many values is
+// reserved at once, instead of checking available space for each value.
+//
+// Returns `false` on failure.
+bool WriteVarint32s(absl::Span<const uint32_t> data, Writer& dest);
+bool WriteVarint64s(absl::Span<const uint64_t> data, Writer& dest);
+
 // Returns the length needed to write a given value as a varint, which is at
 // most `kMaxLengthVarint{32,64}`.
 size_t LengthVarint32(uint32_t data);
@@ -72,6 +84,48 @@ inline bool WriteVarint64(uint64_t data, Writer& dest) {
   return true;
 }
 
+inline bool WriteVarint32s(absl::Span<const uint32_t> data, Writer& dest) {
+  while (!data.empty()) {
+    if (ABSL_PREDICT_FALSE(!dest.Push(
+            kMaxLengthVarint32,
+            UnsignedMin(data.size(), std::numeric_limits<size_t>::max() /
+                                         kMaxLengthVarint32) *
+                kMaxLengthVarint32))) {
+      return false;
+    }
+    const size_t length =
+        UnsignedMin(dest.available() / kMaxLengthVarint32, data.size());
+    char* cursor = dest.cursor();
+    for (const uint32_t value : data.subspan(0, length)) {
+      cursor = WriteVarint32(value, cursor);
+    }
+    dest.set_cursor(cursor);
+    data.remove_prefix(length);
+  }
+  return true;
+}
+
+inline bool WriteVarint64s(absl::Span<const uint64_t> data, Writer& dest) {
+  while (!data.empty()) {
+    if (ABSL_PREDICT_FALSE(!dest.Push(
+            kMaxLengthVarint64,
+            UnsignedMin(data.size(), std::numeric_limits<size_t>::max() /
+                                         kMaxLengthVarint64) *
+                kMaxLengthVarint64))) {
+      return false;
+    }
+    const size_t length =
+        UnsignedMin(dest.available() / kMaxLengthVarint64, data.size());
+    char* cursor = dest.cursor();
+    for (const uint64_t value : data.subspan(0, length)) {
+      cursor = WriteVarint64(value, cursor);
+    }
+    dest.set_cursor(cursor);
+    data.remove_prefix(length);
+  }
+  return true;
+}
+
 inline bool WriteVarint32(uint32_t data, BackwardWriter& dest) {
   const size_t length = LengthVarint32(data);
   if (ABSL_PREDICT_FALSE(!dest.Push(length))) return false;
@@ -0,0 +1,162 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/zlib/zlib_index.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "riegeli/base/base.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/writer.h"
+#include "riegeli/varint/varint_reading.h"
+#include "riegeli/varint/varint_writing.h"
+
+namespace riegeli {
+
+namespace {
+
+constexpr absl::string_view kMagic = "RZLIBIX1";
+
+// Maximum size of the window of an access point: the size of the deflate
+// sliding window.
+constexpr size_t kMaxWindowSize = size_t{32} << 10;
+
+}  // namespace
+
+const ZlibIndex::AccessPoint* ZlibIndex::Find(Position uncompressed_pos) const {
+  const auto iter = std::upper_bound(
+      access_points_.begin(), access_points_.end(), uncompressed_pos,
+      [](Position value, const AccessPoint& access_point) {
+        return value < access_point.uncompressed_pos;
+      });
+  if (iter == access_points_.begin()) return nullptr;
+  return &*std::prev(iter);
+}
+
+void ZlibIndex::AddAccessPoint(AccessPoint&& access_point) {
+  RIEGELI_ASSERT(!complete_)
+      << "Failed precondition of ZlibIndex::AddAccessPoint(): "
+         "index already complete";
+  RIEGELI_ASSERT(access_points_.empty() ||
+                 access_point.uncompressed_pos >
+                     access_points_.back().uncompressed_pos)
+      << "Failed precondition of ZlibIndex::AddAccessPoint(): "
+         "access points not sorted";
+  access_points_.push_back(std::move(access_point));
+}
+
+void ZlibIndex::MarkComplete(Position compressed_size,
+                             Position uncompressed_size) {
+  complete_ = true;
+  compressed_size_ = compressed_size;
+  uncompressed_size_ = uncompressed_size;
+}
+
+absl::Status ZlibIndex::Serialize(Writer& dest) const {
+  RIEGELI_ASSERT(complete_)
+      << "Failed precondition of ZlibIndex::Serialize(): index not complete";
+  if (ABSL_PREDICT_FALSE(!dest.Write(kMagic) ||
+                         !WriteVarint64(compressed_size_, dest) ||
+                         !WriteVarint64(uncompressed_size_, dest) ||
+                         !WriteVarint64(access_points_.size(), dest))) {
+    return dest.status();
+  }
+  Position compressed_pos = 0;
+  Position uncompressed_pos = 0;
+  for (const AccessPoint& access_point : access_points_) {
+    if (ABSL_PREDICT_FALSE(
+            !WriteVarint64(access_point.compressed_pos - compressed_pos,
+                           dest) ||
+            !WriteVarint64(access_point.uncompressed_pos - uncompressed_pos,
+                           dest) ||
+            !dest.WriteByte(IntCast<uint8_t>(access_point.bits)) ||
+            !WriteVarint64(access_point.window.size(), dest) ||
+            !dest.Write(access_point.window))) {
+      return dest.status();
+    }
+    compressed_pos = access_point.compressed_pos;
+    uncompressed_pos = access_point.uncompressed_pos;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ZlibIndex::Parse(Reader& src) {
+  Clear();
+  // Returns the status to report for truncated or malformed data.
+  const auto invalid = [&src](absl::string_view message) {
+    if (ABSL_PREDICT_FALSE(!src.healthy())) return src.status();
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid zlib index: ", message));
+  };
+  absl::string_view magic;
+  if (ABSL_PREDICT_FALSE(!src.Read(kMagic.size(), magic) || magic != kMagic)) {
+    return invalid("wrong magic");
+  }
+  const absl::optional<uint64_t> compressed_size = ReadVarint64(src);
+  const absl::optional<uint64_t> uncompressed_size = ReadVarint64(src);
+  const absl::optional<uint64_t> num_access_points = ReadVarint64(src);
+  if (ABSL_PREDICT_FALSE(compressed_size == absl::nullopt ||
+                         uncompressed_size == absl::nullopt ||
+                         num_access_points == absl::nullopt)) {
+    return invalid("truncated header");
+  }
+  std::vector<AccessPoint> access_points;
+  AccessPoint access_point;
+  for (uint64_t i = 0; i < *num_access_points; ++i) {
+    const absl::optional<uint64_t> compressed_delta = ReadVarint64(src);
+    const absl::optional<uint64_t> uncompressed_delta = ReadVarint64(src);
+    const absl::optional<uint8_t> bits = src.ReadByte();
+    const absl::optional<uint64_t> window_size = ReadVarint64(src);
+    if (ABSL_PREDICT_FALSE(compressed_delta == absl::nullopt ||
+                           uncompressed_delta == absl::nullopt ||
+                           bits == absl::nullopt ||
+                           window_size == absl::nullopt)) {
+      return invalid("truncated access point");
+    }
+    if (ABSL_PREDICT_FALSE(
+            *bits > 7 || *window_size > kMaxWindowSize ||
+            (i > 0 && *uncompressed_delta == 0) ||
+            *compressed_delta >
+                *compressed_size - access_point.compressed_pos ||
+            *uncompressed_delta >
+                *uncompressed_size - access_point.uncompressed_pos)) {
+      return invalid("access point out of range");
+    }
+    access_point.compressed_pos += *compressed_delta;
+    access_point.uncompressed_pos += *uncompressed_delta;
+    access_point.bits = *bits;
+    if (ABSL_PREDICT_FALSE(!src.Read(IntCast<size_t>(*window_size),
+                                     access_point.window))) {
+      return invalid("truncated window");
+    }
+    access_points.push_back(access_point);
+  }
+  access_points_ = std::move(access_points);
+  MarkComplete(*compressed_size, *uncompressed_size);
+  return absl::OkStatus();
+}
+
+}  // namespace riegeli
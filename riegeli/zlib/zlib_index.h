@@ -0,0 +1,145 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_ZLIB_ZLIB_INDEX_H_
+#define RIEGELI_ZLIB_ZLIB_INDEX_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "riegeli/base/base.h"
+#include "riegeli/bytes/reader.h"
+#include "riegeli/bytes/writer.h"
+
+namespace riegeli {
+
+// Access points into a single zlib, gzip, or raw deflate stream, which let
+// `ZlibReader` start decompression in the middle of the stream instead of at
+// its beginning.
+//
+// An access point is a boundary of deflate blocks together with the preceding
+// 32K of uncompressed data, which later blocks can refer to.
+//
+// An index is built by `ZlibReader` while it decompresses the whole stream,
+// see `ZlibReaderBase::Options::set_index()`. It can be saved with
+// `Serialize()` and loaded with `Parse()`, e.g. to a sidecar file, to be
+// reused for the same compressed stream.
+class ZlibIndex {
+ public:
+  struct AccessPoint {
+    // Position in the compressed stream, relative to its beginning, after the
+    // byte containing the first bit of the next deflate block.
+    Position compressed_pos = 0;
+    // Position in the uncompressed stream.
+    Position uncompressed_pos = 0;
+    // Number of bits of the byte before `compressed_pos` which belong to the
+    // next deflate block, between 0 and 7.
+    int bits = 0;
+    // Uncompressed data preceding `uncompressed_pos`, up to 32K.
+    std::string window;
+  };
+
+  // Creates an empty `ZlibIndex`.
+  ZlibIndex() noexcept {}
+
+  ZlibIndex(const ZlibIndex& that) = default;
+  ZlibIndex& operator=(const ZlibIndex& that) = default;
+
+  ZlibIndex(ZlibIndex&& that) noexcept;
+  ZlibIndex& operator=(ZlibIndex&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `ZlibIndex`.
+  void Clear();
+
+  // Returns `true` if the whole stream has been indexed. Only a complete index
+  // is used for seeking.
+  bool complete() const { return complete_; }
+
+  // Returns the sizes of the compressed and uncompressed stream.
+  //
+  // Precondition: `complete()`
+  Position compressed_size() const;
+  Position uncompressed_size() const;
+
+  // Returns access points, sorted by position.
+  const std::vector<AccessPoint>& access_points() const {
+    return access_points_;
+  }
+
+  // Returns the last access point at or before `uncompressed_pos`, or
+  // `nullptr` if there is none.
+  const AccessPoint* Find(Position uncompressed_pos) const;
+
+  // Writes the index in a binary format.
+  //
+  // Precondition: `complete()`
+  absl::Status Serialize(Writer& dest) const;
+
+  // Reads an index written by `Serialize()`.
+  absl::Status Parse(Reader& src);
+
+ private:
+  friend class ZlibReaderBase;
+
+  void AddAccessPoint(AccessPoint&& access_point);
+  void MarkComplete(Position compressed_size, Position uncompressed_size);
+
+  bool complete_ = false;
+  Position compressed_size_ = 0;
+  Position uncompressed_size_ = 0;
+  std::vector<AccessPoint> access_points_;
+};
+
+// Implementation details follow.
+
+inline ZlibIndex::ZlibIndex(ZlibIndex&& that) noexcept
+    : complete_(std::exchange(that.complete_, false)),
+      compressed_size_(std::exchange(that.compressed_size_, 0)),
+      uncompressed_size_(std::exchange(that.uncompressed_size_, 0)),
+      access_points_(std::move(that.access_points_)) {}
+
+inline ZlibIndex& ZlibIndex::operator=(ZlibIndex&& that) noexcept {
+  complete_ = std::exchange(that.complete_, false);
+  compressed_size_ = std::exchange(that.compressed_size_, 0);
+  uncompressed_size_ = std::exchange(that.uncompressed_size_, 0);
+  access_points_ = std::move(that.access_points_);
+  return *this;
+}
+
+inline void ZlibIndex::Clear() {
+  complete_ = false;
+  compressed_size_ = 0;
+  uncompressed_size_ = 0;
+  access_points_.clear();
+}
+
+inline Position ZlibIndex::compressed_size() const {
+  RIEGELI_ASSERT(complete_)
+      << "Failed precondition of ZlibIndex::compressed_size(): "
+         "index not complete";
+  return compressed_size_;
+}
+
+inline Position ZlibIndex::uncompressed_size() const {
+  RIEGELI_ASSERT(complete_)
+      << "Failed precondition of ZlibIndex::uncompressed_size(): "
+         "index not complete";
+  return uncompressed_size_;
+}
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_ZLIB_ZLIB_INDEX_H_
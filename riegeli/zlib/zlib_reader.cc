@@ -15,20 +15,28 @@
 #include "riegeli/zlib/zlib_reader.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <cstring>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "libdeflate.h"
 #include "riegeli/base/base.h"
 #include "riegeli/base/recycling_pool.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/buffered_reader.h"
 #include "riegeli/bytes/reader.h"
+#include "riegeli/endian/endian_reading.h"
+#include "riegeli/zlib/zlib_index.h"
 #include "zconf.h"
 #include "zlib.h"
 
@@ -41,9 +49,29 @@ namespace riegeli {
 constexpr int ZlibReaderBase::Options::kMinWindowLog;
 constexpr int ZlibReaderBase::Options::kMaxWindowLog;
 constexpr ZlibReaderBase::Header ZlibReaderBase::Options::kDefaultHeader;
+constexpr Position ZlibReaderBase::Options::kDefaultIndexInterval;
+constexpr ZlibReaderBase::Backend ZlibReaderBase::Options::kDefaultBackend;
 #endif
 
-void ZlibReaderBase::Initialize(Reader* src) {
+namespace {
+
+// Compressed data larger than this are decompressed with zlib instead of
+// libdeflate, to bound memory usage.
+constexpr Position kMaxLibdeflateCompressedSize = Position{64} << 20;
+// Decompressed data larger than this are decompressed with zlib instead of
+// libdeflate, to bound memory usage.
+constexpr size_t kMaxLibdeflateDecompressedSize = size_t{1} << 30;
+
+struct LibdeflateDecompressorDeleter {
+  void operator()(libdeflate_decompressor* ptr) const {
+    libdeflate_free_decompressor(ptr);
+  }
+};
+
+}  // namespace
+
+void ZlibReaderBase::Initialize(Reader* src, ZlibIndex* index,
+                                Position index_interval, Backend backend) {
   RIEGELI_ASSERT(src != nullptr)
       << "Failed precondition of ZlibReader: null Reader pointer";
   if (ABSL_PREDICT_FALSE(!src->healthy()) && src->available() == 0) {
@@ -51,14 +79,21 @@ void ZlibReaderBase::Initialize(Reader* src) {
     return;
   }
   initial_compressed_pos_ = src->pos();
-  InitializeDecompressor();
+  if (index != nullptr && !concatenate_) {
+    index_ = index;
+    index_interval_ = index_interval;
+    building_index_ = !index_->complete();
+  }
+  try_libdeflate_ = backend == Backend::kLibdeflate && index == nullptr &&
+                    !concatenate_ && dictionary_.empty();
+  InitializeDecompressor(window_bits_);
 }
 
-inline void ZlibReaderBase::InitializeDecompressor() {
+inline void ZlibReaderBase::InitializeDecompressor(int window_bits) {
   decompressor_ = RecyclingPool<z_stream, ZStreamDeleter>::global().Get(
       [&] {
         std::unique_ptr<z_stream, ZStreamDeleter> ptr(new z_stream());
-        const int zlib_code = inflateInit2(ptr.get(), window_bits_);
+        const int zlib_code = inflateInit2(ptr.get(), window_bits);
         if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
           FailOperation(absl::StatusCode::kInternal, "inflateInit2()",
                         zlib_code);
@@ -66,7 +101,7 @@ inline void ZlibReaderBase::InitializeDecompressor() {
         return ptr;
       },
       [&](z_stream* ptr) {
-        const int zlib_code = inflateReset2(ptr, window_bits_);
+        const int zlib_code = inflateReset2(ptr, window_bits);
         if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
           FailOperation(absl::StatusCode::kInternal, "inflateReset2()",
                         zlib_code);
@@ -82,6 +117,7 @@ void ZlibReaderBase::Done() {
                  absl::StrCat("at byte ", src.pos())));
   }
   BufferedReader::Done();
+  decompressed_ = std::string();
   decompressor_.reset();
 }
 
@@ -142,7 +178,10 @@ bool ZlibReaderBase::PullSlow(size_t min_length, size_t recommended_length) {
          "enough data available, use Pull() instead";
   // After all data have been decompressed, skip `BufferedReader::PullSlow()`
   // to avoid allocating the buffer in case it was not allocated yet.
-  if (ABSL_PREDICT_FALSE(decompressor_ == nullptr)) return false;
+  if (ABSL_PREDICT_FALSE(decompressor_ == nullptr) &&
+      decompressed_cursor_ == decompressed_.size()) {
+    return false;
+  }
   return BufferedReader::PullSlow(min_length, recommended_length);
 }
 
@@ -156,8 +195,22 @@ bool ZlibReaderBase::ReadInternal(size_t min_length, size_t max_length,
          "max_length < min_length";
   RIEGELI_ASSERT(healthy())
       << "Failed precondition of BufferedReader::ReadInternal(): " << status();
+  if (libdeflate_used_) {
+    const size_t length =
+        UnsignedMin(max_length, decompressed_.size() - decompressed_cursor_);
+    std::memcpy(dest, decompressed_.data() + decompressed_cursor_, length);
+    decompressed_cursor_ += length;
+    move_limit_pos(length);
+    return length >= min_length;
+  }
   if (ABSL_PREDICT_FALSE(decompressor_ == nullptr)) return false;
   Reader& src = *src_reader();
+  if (try_libdeflate_) {
+    try_libdeflate_ = false;
+    if (DecompressWithLibdeflate(src)) {
+      return ReadInternal(min_length, max_length, dest);
+    }
+  }
   truncated_ = false;
   decompressor_->next_out = reinterpret_cast<Bytef*>(dest);
   for (;;) {
@@ -167,13 +220,22 @@ bool ZlibReaderBase::ReadInternal(size_t min_length, size_t max_length,
         reinterpret_cast<const Bytef*>(src.cursor()));
     decompressor_->avail_in = SaturatingIntCast<uInt>(src.available());
     if (decompressor_->avail_in > 0) stream_had_data_ = true;
-    const int result = inflate(decompressor_.get(), Z_NO_FLUSH);
+    // While building an index, `Z_BLOCK` stops at boundaries of deflate blocks,
+    // where access points can be added.
+    const int result =
+        inflate(decompressor_.get(), building_index_ ? Z_BLOCK : Z_NO_FLUSH);
     src.set_cursor(reinterpret_cast<const char*>(decompressor_->next_in));
     const size_t length_read =
         PtrDistance(dest, reinterpret_cast<char*>(decompressor_->next_out));
     switch (result) {
       case Z_OK:
+        if (building_index_) {
+          MaybeAddAccessPoint(src, limit_pos() + length_read);
+          if (ABSL_PREDICT_FALSE(!healthy())) break;
+        }
         if (length_read >= min_length) break;
+        // `inflate()` stopped at a block boundary because of `Z_BLOCK`.
+        if (decompressor_->avail_in > 0) continue;
         ABSL_FALLTHROUGH_INTENDED;
       case Z_BUF_ERROR:
         RIEGELI_ASSERT_EQ(decompressor_->avail_in, 0u)
@@ -200,6 +262,20 @@ bool ZlibReaderBase::ReadInternal(size_t min_length, size_t max_length,
           continue;
         }
         decompressor_.reset();
+        if (building_index_) {
+          building_index_ = false;
+          index_->MarkComplete(src.pos() - initial_compressed_pos_,
+                               limit_pos() + length_read);
+        }
+        if (restarted_) {
+          // Raw deflate data end before the trailer, which is skipped.
+          if (ABSL_PREDICT_FALSE(!src.Seek(initial_compressed_pos_ +
+                                           index_->compressed_size()))) {
+            src.Fail(
+                absl::DataLossError("Zlib-compressed stream got truncated"));
+            Fail(src);
+          }
+        }
         break;
       case Z_NEED_DICT:
         if (ABSL_PREDICT_TRUE(!dictionary_.empty())) {
@@ -228,6 +304,175 @@ bool ZlibReaderBase::ReadInternal(size_t min_length, size_t max_length,
   }
 }
 
+inline bool ZlibReaderBase::DecompressWithLibdeflate(Reader& src) {
+  if (!src.SupportsSize()) return false;
+  const absl::optional<Position> size = src.Size();
+  if (size == absl::nullopt || *size <= src.pos() ||
+      *size - src.pos() > kMaxLibdeflateCompressedSize) {
+    return false;
+  }
+  const size_t compressed_size = IntCast<size_t>(*size - src.pos());
+  // On failure the source keeps its position, so zlib can take over.
+  if (!src.Pull(compressed_size)) return false;
+  const absl::string_view compressed(src.cursor(), compressed_size);
+  Header header;
+  if (window_bits_ < 0) {
+    header = Header::kRaw;
+  } else if (window_bits_ >= static_cast<int>(Header::kZlibOrGzip)) {
+    header = compressed.size() >= 2 && compressed[0] == '\x1f' &&
+                     compressed[1] == '\x8b'
+                 ? Header::kGzip
+                 : Header::kZlib;
+  } else if (window_bits_ >= static_cast<int>(Header::kGzip)) {
+    header = Header::kGzip;
+  } else {
+    header = Header::kZlib;
+  }
+  const RecyclingPool<libdeflate_decompressor,
+                      LibdeflateDecompressorDeleter>::Handle decompressor =
+      RecyclingPool<libdeflate_decompressor,
+                    LibdeflateDecompressorDeleter>::global()
+          .Get([] {
+            return std::unique_ptr<libdeflate_decompressor,
+                                   LibdeflateDecompressorDeleter>(
+                libdeflate_alloc_decompressor());
+          });
+  if (ABSL_PREDICT_FALSE(decompressor == nullptr)) return false;
+  // The gzip trailer stores the decompressed size modulo 2^32.
+  size_t capacity = header == Header::kGzip && compressed.size() >= 18
+                        ? size_t{ReadLittleEndian32(compressed.data() +
+                                                    compressed.size() - 4)}
+                        : UnsignedMin(compressed.size(),
+                                      kMaxLibdeflateDecompressedSize / 4) *
+                              4;
+  capacity = UnsignedMin(UnsignedMax(capacity, size_t{1}),
+                         kMaxLibdeflateDecompressedSize);
+  std::string decompressed;
+  for (;;) {
+    decompressed.resize(capacity);
+    size_t length_read;
+    size_t length_written;
+    libdeflate_result result;
+    switch (header) {
+      case Header::kRaw:
+        result = libdeflate_deflate_decompress_ex(
+            decompressor.get(), compressed.data(), compressed.size(),
+            &decompressed[0], decompressed.size(), &length_read,
+            &length_written);
+        break;
+      case Header::kGzip:
+        result = libdeflate_gzip_decompress_ex(
+            decompressor.get(), compressed.data(), compressed.size(),
+            &decompressed[0], decompressed.size(), &length_read,
+            &length_written);
+        break;
+      default:
+        result = libdeflate_zlib_decompress_ex(
+            decompressor.get(), compressed.data(), compressed.size(),
+            &decompressed[0], decompressed.size(), &length_read,
+            &length_written);
+        break;
+    }
+    switch (result) {
+      case LIBDEFLATE_SUCCESS:
+        decompressed.resize(length_written);
+        src.move_cursor(length_read);
+        decompressed_ = std::move(decompressed);
+        decompressed_cursor_ = 0;
+        libdeflate_used_ = true;
+        decompressor_.reset();
+        return true;
+      case LIBDEFLATE_INSUFFICIENT_SPACE:
+        if (capacity == kMaxLibdeflateDecompressedSize) return false;
+        capacity = UnsignedMin(capacity, kMaxLibdeflateDecompressedSize / 2) *
+                   2;
+        continue;
+      default:
+        // Let zlib report the error precisely, e.g. as truncation.
+        return false;
+    }
+  }
+}
+
+inline void ZlibReaderBase::MaybeAddAccessPoint(Reader& src,
+                                                Position uncompressed_pos) {
+  // Bit 7 of `data_type` is set at a block boundary, bit 6 after the last
+  // block has begun.
+  if ((decompressor_->data_type & (128 | 64)) != 128) return;
+  const std::vector<ZlibIndex::AccessPoint>& access_points =
+      index_->access_points();
+  if (uncompressed_pos - (access_points.empty()
+                              ? Position{0}
+                              : access_points.back().uncompressed_pos) <
+      index_interval_) {
+    return;
+  }
+  ZlibIndex::AccessPoint access_point;
+  access_point.compressed_pos = src.pos() - initial_compressed_pos_;
+  access_point.uncompressed_pos = uncompressed_pos;
+  access_point.bits = decompressor_->data_type & 7;
+  access_point.window.resize(size_t{1} << MAX_WBITS);
+  uInt window_size = 0;
+  const int zlib_code = inflateGetDictionary(
+      decompressor_.get(), reinterpret_cast<Bytef*>(&access_point.window[0]),
+      &window_size);
+  if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
+    FailOperation(absl::StatusCode::kInternal, "inflateGetDictionary()",
+                  zlib_code);
+    return;
+  }
+  access_point.window.resize(window_size);
+  index_->AddAccessPoint(std::move(access_point));
+}
+
+inline bool ZlibReaderBase::RestartAt(
+    Reader& src, const ZlibIndex::AccessPoint& access_point) {
+  truncated_ = false;
+  stream_had_data_ = false;
+  building_index_ = false;
+  restarted_ = true;
+  set_buffer();
+  set_limit_pos(access_point.uncompressed_pos);
+  decompressor_.reset();
+  // If the block begins in the middle of a byte, that byte is read first.
+  if (ABSL_PREDICT_FALSE(
+          !src.Seek(initial_compressed_pos_ + access_point.compressed_pos -
+                    (access_point.bits > 0 ? 1 : 0)))) {
+    src.Fail(absl::DataLossError("Zlib-compressed stream got truncated"));
+    return Fail(src);
+  }
+  InitializeDecompressor(-MAX_WBITS);
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (access_point.bits > 0) {
+    const absl::optional<uint8_t> byte = src.ReadByte();
+    if (ABSL_PREDICT_FALSE(byte == absl::nullopt)) {
+      src.Fail(absl::DataLossError("Zlib-compressed stream got truncated"));
+      return Fail(src);
+    }
+    const int zlib_code = inflatePrime(decompressor_.get(), access_point.bits,
+                                       *byte >> (8 - access_point.bits));
+    if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
+      return FailOperation(absl::StatusCode::kInternal, "inflatePrime()",
+                           zlib_code);
+    }
+  }
+  const int zlib_code = inflateSetDictionary(
+      decompressor_.get(),
+      reinterpret_cast<const Bytef*>(access_point.window.data()),
+      SaturatingIntCast<uInt>(access_point.window.size()));
+  if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
+    return FailOperation(absl::StatusCode::kInternal, "inflateSetDictionary()",
+                         zlib_code);
+  }
+  return true;
+}
+
+bool ZlibReaderBase::SupportsRandomAccess() {
+  if (index_ == nullptr || !index_->complete()) return false;
+  Reader* const src = src_reader();
+  return src != nullptr && src->SupportsRandomAccess();
+}
+
 bool ZlibReaderBase::SupportsRewind() {
   Reader* const src = src_reader();
   return src != nullptr && src->SupportsRewind();
@@ -240,12 +485,40 @@ bool ZlibReaderBase::SeekBehindBuffer(Position new_pos) {
   RIEGELI_ASSERT_EQ(buffer_size(), 0u)
       << "Failed precondition of BufferedReader::SeekBehindBuffer(): "
          "buffer not empty";
+  if (libdeflate_used_) {
+    set_buffer();
+    if (ABSL_PREDICT_FALSE(new_pos > decompressed_.size())) {
+      // Seeking forwards beyond the end.
+      decompressed_cursor_ = decompressed_.size();
+      set_limit_pos(decompressed_cursor_);
+      return false;
+    }
+    decompressed_cursor_ = IntCast<size_t>(new_pos);
+    set_limit_pos(new_pos);
+    return true;
+  }
+  if (index_ != nullptr && index_->complete()) {
+    const ZlibIndex::AccessPoint* const access_point = index_->Find(new_pos);
+    if (access_point != nullptr &&
+        (new_pos <= limit_pos() ||
+         access_point->uncompressed_pos > limit_pos())) {
+      // Seeking backwards, or forwards beyond another access point.
+      if (ABSL_PREDICT_FALSE(!healthy())) return false;
+      if (ABSL_PREDICT_FALSE(!RestartAt(*src_reader(), *access_point))) {
+        return false;
+      }
+      if (new_pos == limit_pos()) return true;
+      return BufferedReader::SeekBehindBuffer(new_pos);
+    }
+  }
   if (new_pos <= limit_pos()) {
     // Seeking backwards.
     if (ABSL_PREDICT_FALSE(!healthy())) return false;
     Reader& src = *src_reader();
     truncated_ = false;
     stream_had_data_ = false;
+    building_index_ = index_ != nullptr && !index_->complete();
+    restarted_ = false;
     set_buffer();
     set_limit_pos(0);
     decompressor_.reset();
@@ -253,11 +526,21 @@ bool ZlibReaderBase::SeekBehindBuffer(Position new_pos) {
       src.Fail(absl::DataLossError("Zlib-compressed stream got truncated"));
       return Fail(src);
     }
-    InitializeDecompressor();
+    InitializeDecompressor(window_bits_);
     if (ABSL_PREDICT_FALSE(!healthy())) return false;
     if (new_pos == 0) return true;
   }
   return BufferedReader::SeekBehindBuffer(new_pos);
 }
 
+absl::optional<Position> ZlibReaderBase::SizeImpl() {
+  if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
+  if (ABSL_PREDICT_FALSE(index_ == nullptr || !index_->complete())) {
+    Fail(absl::UnimplementedError(
+        "Uncompressed size is known only with a complete ZlibIndex"));
+    return absl::nullopt;
+  }
+  return index_->uncompressed_size();
+}
+
 }  // namespace riegeli
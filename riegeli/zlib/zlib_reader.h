@@ -17,6 +17,7 @@
 
 #include <stddef.h>
 
+#include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -32,6 +33,7 @@
 #include "riegeli/bytes/buffered_reader.h"
 #include "riegeli/bytes/reader.h"
 #include "riegeli/zlib/zlib_dictionary.h"
+#include "riegeli/zlib/zlib_index.h"
 #include "zconf.h"
 #include "zlib.h"
 
@@ -54,6 +56,20 @@ class ZlibReaderBase : public BufferedReader {
     kRaw = -1,
   };
 
+  // Specifies which library performs decompression.
+  enum class Backend {
+    // Zlib, streaming.
+    kZlib,
+    // libdeflate, decompressing whole data at once, which is several times
+    // faster than zlib.
+    //
+    // Used only if the source supports `Size()` and the remaining compressed
+    // data are at most 64M, and with neither a dictionary, `concatenate()`, nor
+    // `index()`. Otherwise, or if the compressed data turn out to be invalid or
+    // to decompress to more than 1G, falls back to zlib.
+    kLibdeflate,
+  };
+
   class Options {
    public:
     Options() noexcept {}
@@ -138,6 +154,62 @@ class ZlibReaderBase : public BufferedReader {
     }
     bool concatenate() const { return concatenate_; }
 
+    // If not `nullptr`, an index of access points which lets seeking restart
+    // decompression from the nearest access point, instead of from the
+    // beginning of the stream.
+    //
+    // If the index is complete (e.g. loaded with `ZlibIndex::Parse()`), it must
+    // have been built for the same compressed stream. Then `ZlibReader`
+    // supports random access if the source supports random access.
+    //
+    // Otherwise the index is built while the stream is decompressed from its
+    // beginning, and becomes complete when the end of the stream is reached.
+    //
+    // An index is not used nor built if `concatenate()` is `true`.
+    //
+    // `index` must be valid until the `ZlibReader` is closed or no longer used.
+    //
+    // Default: `nullptr`.
+    Options& set_index(ZlibIndex* index) & {
+      index_ = index;
+      return *this;
+    }
+    Options&& set_index(ZlibIndex* index) && {
+      return std::move(set_index(index));
+    }
+    ZlibIndex* index() const { return index_; }
+
+    // Minimal distance in uncompressed bytes between access points added to an
+    // index being built. Each access point stores 32K of uncompressed data.
+    //
+    // Default: `kDefaultIndexInterval` (1M).
+    static constexpr Position kDefaultIndexInterval = Position{1} << 20;
+    Options& set_index_interval(Position index_interval) & {
+      RIEGELI_ASSERT_GT(index_interval, 0u)
+          << "Failed precondition of "
+             "ZlibReaderBase::Options::set_index_interval(): "
+             "zero index interval";
+      index_interval_ = index_interval;
+      return *this;
+    }
+    Options&& set_index_interval(Position index_interval) && {
+      return std::move(set_index_interval(index_interval));
+    }
+    Position index_interval() const { return index_interval_; }
+
+    // Which library performs decompression.
+    //
+    // Default: `Backend::kZlib`.
+    static constexpr Backend kDefaultBackend = Backend::kZlib;
+    Options& set_backend(Backend backend) & {
+      backend_ = backend;
+      return *this;
+    }
+    Options&& set_backend(Backend backend) && {
+      return std::move(set_backend(backend));
+    }
+    Backend backend() const { return backend_; }
+
     // Expected uncompressed size, or `absl::nullopt` if unknown. This may
     // improve performance.
     //
@@ -174,6 +246,9 @@ class ZlibReaderBase : public BufferedReader {
     Header header_ = kDefaultHeader;
     ZlibDictionary dictionary_;
     bool concatenate_ = false;
+    ZlibIndex* index_ = nullptr;
+    Position index_interval_ = kDefaultIndexInterval;
+    Backend backend_ = kDefaultBackend;
     absl::optional<Position> size_hint_;
     size_t buffer_size_ = kDefaultBufferSize;
   };
@@ -194,7 +269,13 @@ class ZlibReaderBase : public BufferedReader {
     return truncated_;
   }
 
+  // `ZlibReader` supports random access if `Options::index()` is complete and
+  // the source supports random access.
+  bool SupportsRandomAccess() override;
   bool SupportsRewind() override;
+  bool SupportsSize() override {
+    return index_ != nullptr && index_->complete();
+  }
 
  protected:
   ZlibReaderBase() noexcept {}
@@ -210,7 +291,8 @@ class ZlibReaderBase : public BufferedReader {
   void Reset(int window_bits, ZlibDictionary&& dictionary, bool concatenate,
              size_t buffer_size, absl::optional<Position> size_hint);
   static int GetWindowBits(const Options& options);
-  void Initialize(Reader* src);
+  void Initialize(Reader* src, ZlibIndex* index, Position index_interval,
+                  Backend backend);
 
   void Done() override;
   // `ZlibReaderBase` overrides `Reader::AnnotateFailure()` to annotate the
@@ -221,6 +303,7 @@ class ZlibReaderBase : public BufferedReader {
   bool PullSlow(size_t min_length, size_t recommended_length) override;
   bool ReadInternal(size_t min_length, size_t max_length, char* dest) override;
   bool SeekBehindBuffer(Position new_pos) override;
+  absl::optional<Position> SizeImpl() override;
 
  private:
   struct ZStreamDeleter {
@@ -231,7 +314,15 @@ class ZlibReaderBase : public BufferedReader {
     }
   };
 
-  void InitializeDecompressor();
+  void InitializeDecompressor(int window_bits);
+  // Adds an access point to `*index_` if the decompressor is at a boundary of
+  // deflate blocks far enough from the previous access point.
+  void MaybeAddAccessPoint(Reader& src, Position uncompressed_pos);
+  // Decompresses the whole stream with libdeflate into `decompressed_`.
+  // Returns `false` if zlib should be used instead.
+  bool DecompressWithLibdeflate(Reader& src);
+  // Restarts decompression at `access_point` of `*index_`.
+  bool RestartAt(Reader& src, const ZlibIndex::AccessPoint& access_point);
   ABSL_ATTRIBUTE_COLD bool FailOperation(absl::StatusCode code,
                                          absl::string_view operation,
                                          int zlib_code);
@@ -248,6 +339,22 @@ class ZlibReaderBase : public BufferedReader {
   // legitimate, it does not imply that the source is truncated.
   bool stream_had_data_ = false;
   Position initial_compressed_pos_ = 0;
+  // Index of access points, or `nullptr`. Not used if `concatenate_`.
+  ZlibIndex* index_ = nullptr;
+  Position index_interval_ = 0;
+  // If `true`, `*index_` is being built: decompression started at the beginning
+  // of the stream and the index is not complete.
+  bool building_index_ = false;
+  // If `true`, decompression was restarted at an access point. The
+  // decompressor reads raw deflate data and does not verify the trailer.
+  bool restarted_ = false;
+  // If `true`, the first read tries libdeflate.
+  bool try_libdeflate_ = false;
+  // If `true`, the whole stream was decompressed with libdeflate into
+  // `decompressed_`, and data are read from there at `decompressed_cursor_`.
+  bool libdeflate_used_ = false;
+  std::string decompressed_;
+  size_t decompressed_cursor_ = 0;
   RecyclingPool<z_stream, ZStreamDeleter>::Handle decompressor_;
 };
 
@@ -347,6 +454,14 @@ inline ZlibReaderBase::ZlibReaderBase(ZlibReaderBase&& that) noexcept
       truncated_(that.truncated_),
       stream_had_data_(that.stream_had_data_),
       initial_compressed_pos_(that.initial_compressed_pos_),
+      index_(that.index_),
+      index_interval_(that.index_interval_),
+      building_index_(that.building_index_),
+      restarted_(that.restarted_),
+      try_libdeflate_(that.try_libdeflate_),
+      libdeflate_used_(that.libdeflate_used_),
+      decompressed_(std::move(that.decompressed_)),
+      decompressed_cursor_(that.decompressed_cursor_),
       decompressor_(std::move(that.decompressor_)) {}
 
 inline ZlibReaderBase& ZlibReaderBase::operator=(
@@ -360,6 +475,14 @@ inline ZlibReaderBase& ZlibReaderBase::operator=(
   truncated_ = that.truncated_;
   stream_had_data_ = that.stream_had_data_;
   initial_compressed_pos_ = that.initial_compressed_pos_;
+  index_ = that.index_;
+  index_interval_ = that.index_interval_;
+  building_index_ = that.building_index_;
+  restarted_ = that.restarted_;
+  try_libdeflate_ = that.try_libdeflate_;
+  libdeflate_used_ = that.libdeflate_used_;
+  decompressed_ = std::move(that.decompressed_);
+  decompressed_cursor_ = that.decompressed_cursor_;
   decompressor_ = std::move(that.decompressor_);
   return *this;
 }
@@ -372,6 +495,14 @@ inline void ZlibReaderBase::Reset() {
   truncated_ = false;
   stream_had_data_ = false;
   initial_compressed_pos_ = 0;
+  index_ = nullptr;
+  index_interval_ = 0;
+  building_index_ = false;
+  restarted_ = false;
+  try_libdeflate_ = false;
+  libdeflate_used_ = false;
+  decompressed_ = std::string();
+  decompressed_cursor_ = 0;
   decompressor_.reset();
 }
 
@@ -385,6 +516,14 @@ inline void ZlibReaderBase::Reset(int window_bits, ZlibDictionary&& dictionary,
   truncated_ = false;
   stream_had_data_ = false;
   initial_compressed_pos_ = 0;
+  index_ = nullptr;
+  index_interval_ = 0;
+  building_index_ = false;
+  restarted_ = false;
+  try_libdeflate_ = false;
+  libdeflate_used_ = false;
+  decompressed_ = std::string();
+  decompressed_cursor_ = 0;
   decompressor_.reset();
 }
 
@@ -404,7 +543,8 @@ inline ZlibReader<Src>::ZlibReader(const Src& src, Options options)
                      options.concatenate(), options.buffer_size(),
                      options.size_hint()),
       src_(src) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options.index(), options.index_interval(),
+             options.backend());
 }
 
 template <typename Src>
@@ -413,7 +553,8 @@ inline ZlibReader<Src>::ZlibReader(Src&& src, Options options)
                      options.concatenate(), options.buffer_size(),
                      options.size_hint()),
       src_(std::move(src)) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options.index(), options.index_interval(),
+             options.backend());
 }
 
 template <typename Src>
@@ -424,7 +565,8 @@ inline ZlibReader<Src>::ZlibReader(std::tuple<SrcArgs...> src_args,
                      options.concatenate(), options.buffer_size(),
                      options.size_hint()),
       src_(std::move(src_args)) {
-  Initialize(src_.get());
+  Initialize(src_.get(), options.index(), options.index_interval(),
+             options.backend());
 }
 
 template <typename Src>
@@ -455,7 +597,8 @@ inline void ZlibReader<Src>::Reset(const Src& src, Options options) {
                         options.concatenate(), options.buffer_size(),
                         options.size_hint());
   src_.Reset(src);
-  Initialize(src_.get());
+  Initialize(src_.get(), options.index(), options.index_interval(),
+             options.backend());
 }
 
 template <typename Src>
@@ -464,7 +607,8 @@ inline void ZlibReader<Src>::Reset(Src&& src, Options options) {
                         options.concatenate(), options.buffer_size(),
                         options.size_hint());
   src_.Reset(std::move(src));
-  Initialize(src_.get());
+  Initialize(src_.get(), options.index(), options.index_interval(),
+             options.backend());
 }
 
 template <typename Src>
@@ -475,7 +619,8 @@ inline void ZlibReader<Src>::Reset(std::tuple<SrcArgs...> src_args,
                         options.concatenate(), options.buffer_size(),
                         options.size_hint());
   src_.Reset(std::move(src_args));
-  Initialize(src_.get());
+  Initialize(src_.get(), options.index(), options.index_interval(),
+             options.backend());
 }
 
 template <typename Src>
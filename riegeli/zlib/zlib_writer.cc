@@ -15,20 +15,27 @@
 #include "riegeli/zlib/zlib_writer.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <deque>
 #include <limits>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "absl/base/optimization.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "libdeflate.h"
 #include "riegeli/base/base.h"
+#include "riegeli/base/parallelism.h"
 #include "riegeli/base/recycling_pool.h"
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/buffered_writer.h"
 #include "riegeli/bytes/writer.h"
+#include "riegeli/endian/endian_writing.h"
 #include "zconf.h"
 #include "zlib.h"
 
@@ -45,28 +52,430 @@ constexpr int ZlibWriterBase::Options::kMinWindowLog;
 constexpr int ZlibWriterBase::Options::kMaxWindowLog;
 constexpr int ZlibWriterBase::Options::kDefaultWindowLog;
 constexpr ZlibWriterBase::Header ZlibWriterBase::Options::kDefaultHeader;
+constexpr size_t ZlibWriterBase::Options::kDefaultBlockSize;
+constexpr size_t ZlibWriterBase::Options::kMaxBlockSize;
+constexpr ZlibWriterBase::Backend ZlibWriterBase::Options::kDefaultBackend;
 #endif
 
+namespace {
+
+// Data larger than this are compressed with zlib instead of libdeflate, to
+// bound memory usage.
+constexpr size_t kMaxLibdeflateSize = size_t{64} << 20;
+
+struct LibdeflateCompressorDeleter {
+  void operator()(libdeflate_compressor* ptr) const {
+    libdeflate_free_compressor(ptr);
+  }
+};
+
+}  // namespace
+
+// Compresses blocks of data concurrently, like pigz.
+//
+// Each block is compressed as raw deflate data, primed with the preceding
+// uncompressed data as the dictionary. All blocks except the last one end with
+// `Z_SYNC_FLUSH`, so that they end on a byte boundary and can be concatenated.
+// The header and the trailer are written here, with the checksum combined
+// from checksums of blocks.
+class ZlibWriterBase::ParallelCompressor {
+ public:
+  explicit ParallelCompressor(int compression_level, int window_bits,
+                              int parallelism, size_t block_size,
+                              absl::string_view dictionary);
+
+  ParallelCompressor(const ParallelCompressor&) = delete;
+  ParallelCompressor& operator=(const ParallelCompressor&) = delete;
+
+  // Compresses `src`, scheduling complete blocks in background.
+  absl::Status Write(absl::string_view src, Writer& dest);
+
+  // Ends the current block and writes all scheduled blocks to `dest`.
+  absl::Status Flush(Writer& dest);
+
+  // Ends the last block, writes all scheduled blocks and the trailer to
+  // `dest`.
+  absl::Status Finish(Writer& dest);
+
+ private:
+  enum class Format { kZlib, kGzip, kRaw };
+
+  struct Block {
+    std::string input;
+    std::string dictionary;
+    bool last = false;
+    std::string output;
+    uLong checksum = 0;
+    absl::Status status;
+    // Guarded by `*mutex_` of the `ParallelCompressor`.
+    bool done = false;
+  };
+
+  // Compresses `block`. Called in background.
+  static void CompressBlock(int compression_level, int window_log,
+                            Format format, Block& block);
+
+  absl::Status ScheduleBlock(bool last, Writer& dest);
+  // Waits until the oldest scheduled block is compressed, and writes it.
+  absl::Status WriteBlock(Writer& dest);
+  absl::Status WriteHeader(Writer& dest);
+  absl::Status WriteTrailer(Writer& dest);
+
+  int compression_level_;
+  int window_log_;
+  Format format_;
+  size_t parallelism_;
+  size_t block_size_;
+  std::string dictionary_;
+  bool header_written_ = false;
+  // Uncompressed data of the block being filled.
+  std::string current_block_;
+  // Uncompressed data preceding `current_block_`, up to the window size.
+  std::string window_;
+  uLong checksum_;
+  Position uncompressed_size_ = 0;
+  // Shared with background tasks, which can outlive `ParallelCompressor`.
+  std::shared_ptr<absl::Mutex> mutex_ = std::make_shared<absl::Mutex>();
+  // Blocks scheduled and not yet written, in the order of data.
+  std::deque<std::shared_ptr<Block>> pending_;
+};
+
+void ZlibWriterBase::ParallelCompressorDeleter::operator()(
+    ParallelCompressor* ptr) const {
+  delete ptr;
+}
+
+ZlibWriterBase::ParallelCompressor::ParallelCompressor(
+    int compression_level, int window_bits, int parallelism, size_t block_size,
+    absl::string_view dictionary)
+    : compression_level_(compression_level),
+      window_log_(window_bits < 0    ? -window_bits
+                  : window_bits > 16 ? window_bits - 16
+                                     : window_bits),
+      format_(window_bits < 0    ? Format::kRaw
+              : window_bits > 16 ? Format::kGzip
+                                 : Format::kZlib),
+      parallelism_(IntCast<size_t>(parallelism)),
+      block_size_(block_size),
+      dictionary_(dictionary),
+      checksum_(format_ == Format::kGzip ? crc32(0, nullptr, 0)
+                                         : adler32(0, nullptr, 0)) {}
+
+absl::Status ZlibWriterBase::ParallelCompressor::Write(absl::string_view src,
+                                                       Writer& dest) {
+  while (!src.empty()) {
+    const size_t length =
+        UnsignedMin(src.size(), block_size_ - current_block_.size());
+    current_block_.append(src.data(), length);
+    src.remove_prefix(length);
+    if (current_block_.size() == block_size_) {
+      absl::Status status = ScheduleBlock(false, dest);
+      if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ZlibWriterBase::ParallelCompressor::Flush(Writer& dest) {
+  if (!current_block_.empty()) {
+    absl::Status status = ScheduleBlock(false, dest);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  while (!pending_.empty()) {
+    absl::Status status = WriteBlock(dest);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ZlibWriterBase::ParallelCompressor::Finish(Writer& dest) {
+  // The last block is scheduled even if empty, to mark the end of deflate
+  // data.
+  {
+    absl::Status status = ScheduleBlock(true, dest);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  while (!pending_.empty()) {
+    absl::Status status = WriteBlock(dest);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  return WriteTrailer(dest);
+}
+
+absl::Status ZlibWriterBase::ParallelCompressor::ScheduleBlock(bool last,
+                                                               Writer& dest) {
+  if (!header_written_) {
+    absl::Status status = WriteHeader(dest);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+    header_written_ = true;
+  }
+  while (pending_.size() >= parallelism_) {
+    absl::Status status = WriteBlock(dest);
+    if (ABSL_PREDICT_FALSE(!status.ok())) return status;
+  }
+  std::shared_ptr<Block> block = std::make_shared<Block>();
+  block->input = std::move(current_block_);
+  current_block_.clear();
+  block->dictionary =
+      uncompressed_size_ == 0 ? dictionary_ : window_;
+  block->last = last;
+  uncompressed_size_ += block->input.size();
+  // Keep the last window of uncompressed data as the dictionary of the next
+  // block.
+  const size_t window_size = size_t{1} << window_log_;
+  if (block->input.size() >= window_size) {
+    window_.assign(block->input, block->input.size() - window_size,
+                   window_size);
+  } else {
+    window_.append(block->input);
+    if (window_.size() > window_size) {
+      window_.erase(0, window_.size() - window_size);
+    }
+  }
+  pending_.push_back(block);
+  internal::ThreadPool::global().Schedule(
+      [compression_level = compression_level_, window_log = window_log_,
+       format = format_, block = std::move(block), mutex = mutex_] {
+        CompressBlock(compression_level, window_log, format, *block);
+        absl::MutexLock lock(mutex.get());
+        block->done = true;
+      });
+  return absl::OkStatus();
+}
+
+void ZlibWriterBase::ParallelCompressor::CompressBlock(int compression_level,
+                                                       int window_log,
+                                                       Format format,
+                                                       Block& block) {
+  const KeyedRecyclingPool<z_stream, ZStreamKey, ZStreamDeleter>::Handle
+      compressor =
+          KeyedRecyclingPool<z_stream, ZStreamKey, ZStreamDeleter>::global()
+              .Get(
+                  ZStreamKey{compression_level, -window_log},
+                  [&] {
+                    std::unique_ptr<z_stream, ZStreamDeleter> ptr(
+                        new z_stream());
+                    const int zlib_code =
+                        deflateInit2(ptr.get(), compression_level, Z_DEFLATED,
+                                     -window_log, 8, Z_DEFAULT_STRATEGY);
+                    if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
+                      block.status = absl::InternalError(
+                          absl::StrCat("deflateInit2() failed: ", zlib_code));
+                    }
+                    return ptr;
+                  },
+                  [&](z_stream* ptr) {
+                    const int zlib_code = deflateReset(ptr);
+                    if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
+                      block.status = absl::InternalError(
+                          absl::StrCat("deflateReset() failed: ", zlib_code));
+                    }
+                  });
+  if (ABSL_PREDICT_FALSE(!block.status.ok())) return;
+  if (!block.dictionary.empty()) {
+    const int zlib_code = deflateSetDictionary(
+        compressor.get(),
+        const_cast<z_const Bytef*>(
+            reinterpret_cast<const Bytef*>(block.dictionary.data())),
+        IntCast<uInt>(block.dictionary.size()));
+    if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
+      block.status = absl::InternalError(
+          absl::StrCat("deflateSetDictionary() failed: ", zlib_code));
+      return;
+    }
+  }
+  const int flush = block.last ? Z_FINISH : Z_SYNC_FLUSH;
+  compressor->next_in = const_cast<z_const Bytef*>(
+      reinterpret_cast<const Bytef*>(block.input.data()));
+  compressor->avail_in = IntCast<uInt>(block.input.size());
+  // `Z_SYNC_FLUSH` appends an empty stored block, at most 6 bytes.
+  block.output.resize(
+      deflateBound(compressor.get(), IntCast<uLong>(block.input.size())) + 6);
+  size_t length = 0;
+  for (;;) {
+    compressor->next_out = reinterpret_cast<Bytef*>(&block.output[length]);
+    compressor->avail_out = IntCast<uInt>(block.output.size() - length);
+    const int result = deflate(compressor.get(), flush);
+    length = block.output.size() - compressor->avail_out;
+    if (result == Z_STREAM_END ||
+        (result == Z_OK && flush == Z_SYNC_FLUSH &&
+         compressor->avail_in == 0 && compressor->avail_out > 0)) {
+      break;
+    }
+    if (ABSL_PREDICT_FALSE(result != Z_OK && result != Z_BUF_ERROR)) {
+      block.status =
+          absl::InternalError(absl::StrCat("deflate() failed: ", result));
+      return;
+    }
+    block.output.resize(block.output.size() * 2);
+  }
+  block.output.resize(length);
+  switch (format) {
+    case Format::kZlib:
+      block.checksum =
+          adler32(adler32(0, nullptr, 0),
+                  reinterpret_cast<const Bytef*>(block.input.data()),
+                  IntCast<uInt>(block.input.size()));
+      return;
+    case Format::kGzip:
+      block.checksum =
+          crc32(crc32(0, nullptr, 0),
+                reinterpret_cast<const Bytef*>(block.input.data()),
+                IntCast<uInt>(block.input.size()));
+      return;
+    case Format::kRaw:
+      return;
+  }
+  RIEGELI_ASSERT_UNREACHABLE()
+      << "Unknown format: " << static_cast<int>(format);
+}
+
+absl::Status ZlibWriterBase::ParallelCompressor::WriteBlock(Writer& dest) {
+  RIEGELI_ASSERT(!pending_.empty())
+      << "Failed precondition of "
+         "ZlibWriterBase::ParallelCompressor::WriteBlock(): "
+         "no pending blocks";
+  const std::shared_ptr<Block> block = std::move(pending_.front());
+  pending_.pop_front();
+  {
+    absl::MutexLock lock(mutex_.get());
+    mutex_->Await(absl::Condition(&block->done));
+  }
+  if (ABSL_PREDICT_FALSE(!block->status.ok())) return block->status;
+  if (ABSL_PREDICT_FALSE(!dest.Write(block->output))) return dest.status();
+  switch (format_) {
+    case Format::kZlib:
+      checksum_ = adler32_combine(checksum_, block->checksum,
+                                  IntCast<z_off_t>(block->input.size()));
+      break;
+    case Format::kGzip:
+      checksum_ = crc32_combine(checksum_, block->checksum,
+                                IntCast<z_off_t>(block->input.size()));
+      break;
+    case Format::kRaw:
+      break;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ZlibWriterBase::ParallelCompressor::WriteHeader(Writer& dest) {
+  switch (format_) {
+    case Format::kZlib: {
+      // Like `deflate()`, see RFC 1950.
+      uint16_t header = (Z_DEFLATED + ((window_log_ - 8) << 4)) << 8;
+      const int level_flags = compression_level_ < 2    ? 0
+                              : compression_level_ < 6  ? 1
+                              : compression_level_ == 6 ? 2
+                                                        : 3;
+      header |= level_flags << 6;
+      if (!dictionary_.empty()) header |= 0x20;
+      header += 31 - header % 31;
+      if (ABSL_PREDICT_FALSE(!WriteBigEndian16(header, dest))) {
+        return dest.status();
+      }
+      if (!dictionary_.empty()) {
+        const uLong dictionary_id =
+            adler32(adler32(0, nullptr, 0),
+                    reinterpret_cast<const Bytef*>(dictionary_.data()),
+                    IntCast<uInt>(dictionary_.size()));
+        if (ABSL_PREDICT_FALSE(
+                !WriteBigEndian32(IntCast<uint32_t>(dictionary_id), dest))) {
+          return dest.status();
+        }
+      }
+      return absl::OkStatus();
+    }
+    case Format::kGzip: {
+      // Like `deflate()`, see RFC 1952: no file name, no modification time,
+      // Unix as the operating system.
+      const char extra_flags = compression_level_ == 9   ? 2
+                               : compression_level_ < 2 ? 4
+                                                        : 0;
+      const char header[10] = {'\x1f', '\x8b', Z_DEFLATED, 0, 0, 0, 0, 0,
+                               extra_flags, 3};
+      if (ABSL_PREDICT_FALSE(
+              !dest.Write(absl::string_view(header, sizeof(header))))) {
+        return dest.status();
+      }
+      return absl::OkStatus();
+    }
+    case Format::kRaw:
+      return absl::OkStatus();
+  }
+  RIEGELI_ASSERT_UNREACHABLE()
+      << "Unknown format: " << static_cast<int>(format_);
+}
+
+absl::Status ZlibWriterBase::ParallelCompressor::WriteTrailer(Writer& dest) {
+  switch (format_) {
+    case Format::kZlib:
+      if (ABSL_PREDICT_FALSE(
+              !WriteBigEndian32(IntCast<uint32_t>(checksum_), dest))) {
+        return dest.status();
+      }
+      return absl::OkStatus();
+    case Format::kGzip:
+      if (ABSL_PREDICT_FALSE(
+              !WriteLittleEndian32(IntCast<uint32_t>(checksum_), dest) ||
+              !WriteLittleEndian32(static_cast<uint32_t>(uncompressed_size_),
+                                   dest))) {
+        return dest.status();
+      }
+      return absl::OkStatus();
+    case Format::kRaw:
+      return absl::OkStatus();
+  }
+  RIEGELI_ASSERT_UNREACHABLE()
+      << "Unknown format: " << static_cast<int>(format_);
+}
+
 void ZlibWriterBase::Initialize(Writer* dest, int compression_level,
-                                int window_bits) {
+                                int window_bits, int parallelism,
+                                size_t block_size, Backend backend) {
   RIEGELI_ASSERT(dest != nullptr)
       << "Failed precondition of ZlibWriter: null Writer pointer";
   if (ABSL_PREDICT_FALSE(!dest->healthy())) {
     Fail(*dest);
     return;
   }
+  compression_level_ = compression_level;
+  window_bits_ = window_bits;
+  if (parallelism > 0) {
+    if (ABSL_PREDICT_FALSE(window_bits > 16 && !dictionary_.empty())) {
+      // `deflateSetDictionary()` does not support gzip either.
+      Fail(absl::InvalidArgumentError(
+          "Zlib dictionary is not supported with gzip header"));
+      return;
+    }
+    parallel_compressor_.reset(
+        new ParallelCompressor(compression_level, window_bits, parallelism,
+                               block_size, dictionary_.data()));
+    return;
+  }
+  if (backend == Backend::kLibdeflate && compression_level > 0 &&
+      dictionary_.empty() &&
+      (window_bits == MAX_WBITS || window_bits == MAX_WBITS + 16 ||
+       window_bits == -MAX_WBITS)) {
+    // `compressor_` is initialized if falling back to zlib.
+    use_libdeflate_ = true;
+    return;
+  }
+  InitializeCompressor();
+}
+
+inline void ZlibWriterBase::InitializeCompressor() {
   // Do not reduce `window_log` based on `size_hint`. An unexpected reduction
   // of `window_log` would break concatenation of compressed streams, because
   // Zlib decompressor rejects `window_log` in a subsequent header greater than
   // in the first header.
   compressor_ =
       KeyedRecyclingPool<z_stream, ZStreamKey, ZStreamDeleter>::global().Get(
-          ZStreamKey{compression_level, window_bits},
+          ZStreamKey{compression_level_, window_bits_},
           [&] {
             std::unique_ptr<z_stream, ZStreamDeleter> ptr(new z_stream());
             const int zlib_code =
-                deflateInit2(ptr.get(), compression_level, Z_DEFLATED,
-                             window_bits, 8, Z_DEFAULT_STRATEGY);
+                deflateInit2(ptr.get(), compression_level_, Z_DEFLATED,
+                             window_bits_, 8, Z_DEFAULT_STRATEGY);
             if (ABSL_PREDICT_FALSE(zlib_code != Z_OK)) {
               FailOperation("deflateInit2()", zlib_code);
             }
@@ -102,6 +511,8 @@ void ZlibWriterBase::DoneBehindBuffer(absl::string_view src) {
 void ZlibWriterBase::Done() {
   BufferedWriter::Done();
   compressor_.reset();
+  parallel_compressor_.reset();
+  libdeflate_input_ = std::string();
 }
 
 bool ZlibWriterBase::FailOperation(absl::string_view operation, int zlib_code) {
@@ -168,6 +579,48 @@ inline bool ZlibWriterBase::WriteInternal(absl::string_view src, Writer& dest,
                          std::numeric_limits<Position>::max() - start_pos())) {
     return FailOverflow();
   }
+  if (parallel_compressor_ != nullptr) {
+    absl::Status status = parallel_compressor_->Write(src, dest);
+    if (ABSL_PREDICT_TRUE(status.ok())) {
+      switch (flush) {
+        case Z_SYNC_FLUSH:
+          status = parallel_compressor_->Flush(dest);
+          break;
+        case Z_FINISH:
+          status = parallel_compressor_->Finish(dest);
+          break;
+      }
+    }
+    if (ABSL_PREDICT_FALSE(!status.ok())) return Fail(std::move(status));
+    move_start_pos(src.size());
+    return true;
+  }
+  if (use_libdeflate_) {
+    if (flush != Z_SYNC_FLUSH &&
+        src.size() <= kMaxLibdeflateSize - libdeflate_input_.size()) {
+      libdeflate_input_.append(src.data(), src.size());
+      move_start_pos(src.size());
+      if (flush == Z_FINISH) return CompressWithLibdeflate(dest);
+      return true;
+    }
+    // The data are too large, or the compressed stream must be flushed. Fall
+    // back to zlib, compressing data collected so far first.
+    use_libdeflate_ = false;
+    InitializeCompressor();
+    if (ABSL_PREDICT_FALSE(!healthy())) return false;
+    const std::string input = std::move(libdeflate_input_);
+    libdeflate_input_ = std::string();
+    if (!input.empty()) {
+      if (ABSL_PREDICT_FALSE(!Deflate(input, dest, Z_NO_FLUSH))) return false;
+    }
+  }
+  if (ABSL_PREDICT_FALSE(!Deflate(src, dest, flush))) return false;
+  move_start_pos(src.size());
+  return true;
+}
+
+inline bool ZlibWriterBase::Deflate(absl::string_view src, Writer& dest,
+                                    int flush) {
   compressor_->next_in =
       const_cast<z_const Bytef*>(reinterpret_cast<const Bytef*>(src.data()));
   for (;;) {
@@ -207,11 +660,69 @@ inline bool ZlibWriterBase::WriteInternal(absl::string_view src, Writer& dest,
     }
     RIEGELI_ASSERT_EQ(length_written, src.size())
         << "deflate() returned but there are still input data";
-    move_start_pos(length_written);
     return true;
   }
 }
 
+inline bool ZlibWriterBase::CompressWithLibdeflate(Writer& dest) {
+  const KeyedRecyclingPool<libdeflate_compressor, int,
+                           LibdeflateCompressorDeleter>::Handle compressor =
+      KeyedRecyclingPool<libdeflate_compressor, int,
+                         LibdeflateCompressorDeleter>::global()
+          .Get(compression_level_, [&] {
+            return std::unique_ptr<libdeflate_compressor,
+                                   LibdeflateCompressorDeleter>(
+                libdeflate_alloc_compressor(compression_level_));
+          });
+  if (ABSL_PREDICT_FALSE(compressor == nullptr)) {
+    return Fail(absl::ResourceExhaustedError(
+        "libdeflate_alloc_compressor() failed"));
+  }
+  const Header header = window_bits_ < 0    ? Header::kRaw
+                        : window_bits_ > 16 ? Header::kGzip
+                                            : Header::kZlib;
+  size_t bound = 0;
+  switch (header) {
+    case Header::kZlib:
+      bound = libdeflate_zlib_compress_bound(compressor.get(),
+                                             libdeflate_input_.size());
+      break;
+    case Header::kGzip:
+      bound = libdeflate_gzip_compress_bound(compressor.get(),
+                                             libdeflate_input_.size());
+      break;
+    case Header::kRaw:
+      bound = libdeflate_deflate_compress_bound(compressor.get(),
+                                                libdeflate_input_.size());
+      break;
+  }
+  if (ABSL_PREDICT_FALSE(!dest.Push(bound))) return Fail(dest);
+  size_t compressed_size = 0;
+  switch (header) {
+    case Header::kZlib:
+      compressed_size = libdeflate_zlib_compress(
+          compressor.get(), libdeflate_input_.data(), libdeflate_input_.size(),
+          dest.cursor(), dest.available());
+      break;
+    case Header::kGzip:
+      compressed_size = libdeflate_gzip_compress(
+          compressor.get(), libdeflate_input_.data(), libdeflate_input_.size(),
+          dest.cursor(), dest.available());
+      break;
+    case Header::kRaw:
+      compressed_size = libdeflate_deflate_compress(
+          compressor.get(), libdeflate_input_.data(), libdeflate_input_.size(),
+          dest.cursor(), dest.available());
+      break;
+  }
+  if (ABSL_PREDICT_FALSE(compressed_size == 0)) {
+    return Fail(absl::InternalError("libdeflate compression failed"));
+  }
+  dest.move_cursor(compressed_size);
+  libdeflate_input_ = std::string();
+  return true;
+}
+
 bool ZlibWriterBase::FlushBehindBuffer(absl::string_view src,
                                        FlushType flush_type) {
   RIEGELI_ASSERT_EQ(buffer_size(), 0u)
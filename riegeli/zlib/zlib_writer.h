@@ -17,6 +17,8 @@
 
 #include <stddef.h>
 
+#include <memory>
+#include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -50,6 +52,20 @@ class ZlibWriterBase : public BufferedWriter {
     kRaw = -1,
   };
 
+  // Specifies which library performs compression.
+  enum class Backend {
+    // Zlib, streaming.
+    kZlib,
+    // libdeflate, compressing whole data at once, which is several times
+    // faster than zlib.
+    //
+    // Falls back to zlib if the data turn out to be larger than 64M, if the
+    // `ZlibWriter` is flushed before `Close()`, or if other options are not
+    // supported by libdeflate: a dictionary, `window_log() < 15`,
+    // `compression_level() == 0`, or `parallelism() > 0`.
+    kLibdeflate,
+  };
+
   class Options {
    public:
     Options() noexcept {}
@@ -153,6 +169,67 @@ class ZlibWriterBase : public BufferedWriter {
     }
     absl::optional<Position> size_hint() const { return size_hint_; }
 
+    // Number of background threads to use for compression, like pigz. Data
+    // are split into blocks which are compressed concurrently, each primed
+    // with the preceding 32K of uncompressed data, and concatenated into a
+    // single compressed stream with a combined checksum. This makes compression
+    // of large data faster, at the cost of memory usage and some compression
+    // density.
+    //
+    // If 0, compresses in the calling thread.
+    //
+    // Default: 0.
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GE(parallelism, 0)
+          << "Failed precondition of "
+             "ZlibWriterBase::Options::set_parallelism(): "
+             "negative parallelism";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+    // Size of uncompressed data in one block if `parallelism() > 0`. Larger
+    // blocks improve compression density but limit concurrency for smaller
+    // data.
+    //
+    // `block_size` must be between 1 and `kMaxBlockSize` (1G).
+    // Default: `kDefaultBlockSize` (128K).
+    static constexpr size_t kDefaultBlockSize = size_t{128} << 10;
+    static constexpr size_t kMaxBlockSize = size_t{1} << 30;
+    Options& set_block_size(size_t block_size) & {
+      RIEGELI_ASSERT_GT(block_size, 0u)
+          << "Failed precondition of "
+             "ZlibWriterBase::Options::set_block_size(): "
+             "zero block size";
+      RIEGELI_ASSERT_LE(block_size, kMaxBlockSize)
+          << "Failed precondition of "
+             "ZlibWriterBase::Options::set_block_size(): "
+             "block size out of range";
+      block_size_ = block_size;
+      return *this;
+    }
+    Options&& set_block_size(size_t block_size) && {
+      return std::move(set_block_size(block_size));
+    }
+    size_t block_size() const { return block_size_; }
+
+    // Which library performs compression.
+    //
+    // Default: `Backend::kZlib`.
+    static constexpr Backend kDefaultBackend = Backend::kZlib;
+    Options& set_backend(Backend backend) & {
+      backend_ = backend;
+      return *this;
+    }
+    Options&& set_backend(Backend backend) && {
+      return std::move(set_backend(backend));
+    }
+    Backend backend() const { return backend_; }
+
     // Tunes how much data is buffered before calling the compression engine.
     //
     // Default: `kDefaultBufferSize` (64K).
@@ -175,6 +252,9 @@ class ZlibWriterBase : public BufferedWriter {
     Header header_ = kDefaultHeader;
     ZlibDictionary dictionary_;
     absl::optional<Position> size_hint_;
+    int parallelism_ = 0;
+    size_t block_size_ = kDefaultBlockSize;
+    Backend backend_ = kDefaultBackend;
     size_t buffer_size_ = kDefaultBufferSize;
   };
 
@@ -195,7 +275,8 @@ class ZlibWriterBase : public BufferedWriter {
   void Reset(ZlibDictionary&& dictionary, size_t buffer_size,
              absl::optional<Position> size_hint);
   static int GetWindowBits(const Options& options);
-  void Initialize(Writer* dest, int compression_level, int window_bits);
+  void Initialize(Writer* dest, int compression_level, int window_bits,
+                  int parallelism, size_t block_size, Backend backend);
 
   void DoneBehindBuffer(absl::string_view src) override;
   void Done() override;
@@ -235,12 +316,31 @@ class ZlibWriterBase : public BufferedWriter {
     int window_bits;
   };
 
+  class ParallelCompressor;
+  struct ParallelCompressorDeleter {
+    void operator()(ParallelCompressor* ptr) const;
+  };
+
+  void InitializeCompressor();
   ABSL_ATTRIBUTE_COLD bool FailOperation(absl::string_view operation,
                                          int zlib_code);
   bool WriteInternal(absl::string_view src, Writer& dest, int flush);
+  // Compresses `src` with zlib, without moving `start_pos()`.
+  bool Deflate(absl::string_view src, Writer& dest, int flush);
+  // Compresses `libdeflate_input_` with libdeflate.
+  bool CompressWithLibdeflate(Writer& dest);
 
   ZlibDictionary dictionary_;
+  int compression_level_ = 0;
+  int window_bits_ = 0;
+  // If `true`, data are collected in `libdeflate_input_` to be compressed with
+  // libdeflate by `Close()`, and `compressor_` is not initialized yet.
+  bool use_libdeflate_ = false;
+  std::string libdeflate_input_;
   KeyedRecyclingPool<z_stream, ZStreamKey, ZStreamDeleter>::Handle compressor_;
+  // Used instead of `compressor_` if `Options::parallelism() > 0`.
+  std::unique_ptr<ParallelCompressor, ParallelCompressorDeleter>
+      parallel_compressor_;
 };
 
 // A `Writer` which compresses data with Zlib before passing it to another
@@ -331,7 +431,12 @@ inline ZlibWriterBase::ZlibWriterBase(ZlibWriterBase&& that) noexcept
       // Using `that` after it was moved is correct because only the base class
       // part was moved.
       dictionary_(std::move(that.dictionary_)),
-      compressor_(std::move(that.compressor_)) {}
+      compression_level_(that.compression_level_),
+      window_bits_(that.window_bits_),
+      use_libdeflate_(that.use_libdeflate_),
+      libdeflate_input_(std::move(that.libdeflate_input_)),
+      compressor_(std::move(that.compressor_)),
+      parallel_compressor_(std::move(that.parallel_compressor_)) {}
 
 inline ZlibWriterBase& ZlibWriterBase::operator=(
     ZlibWriterBase&& that) noexcept {
@@ -339,14 +444,24 @@ inline ZlibWriterBase& ZlibWriterBase::operator=(
   // Using `that` after it was moved is correct because only the base class part
   // was moved.
   dictionary_ = std::move(that.dictionary_);
+  compression_level_ = that.compression_level_;
+  window_bits_ = that.window_bits_;
+  use_libdeflate_ = that.use_libdeflate_;
+  libdeflate_input_ = std::move(that.libdeflate_input_);
   compressor_ = std::move(that.compressor_);
+  parallel_compressor_ = std::move(that.parallel_compressor_);
   return *this;
 }
 
 inline void ZlibWriterBase::Reset() {
   BufferedWriter::Reset();
   dictionary_.reset();
+  compression_level_ = 0;
+  window_bits_ = 0;
+  use_libdeflate_ = false;
+  libdeflate_input_ = std::string();
   compressor_.reset();
+  parallel_compressor_.reset();
 }
 
 inline void ZlibWriterBase::Reset(ZlibDictionary&& dictionary,
@@ -354,7 +469,12 @@ inline void ZlibWriterBase::Reset(ZlibDictionary&& dictionary,
                                   absl::optional<Position> size_hint) {
   BufferedWriter::Reset(buffer_size, size_hint);
   dictionary_ = std::move(dictionary);
+  compression_level_ = 0;
+  window_bits_ = 0;
+  use_libdeflate_ = false;
+  libdeflate_input_ = std::string();
   compressor_.reset();
+  parallel_compressor_.reset();
 }
 
 inline int ZlibWriterBase::GetWindowBits(const Options& options) {
@@ -368,7 +488,8 @@ inline ZlibWriter<Dest>::ZlibWriter(const Dest& dest, Options options)
     : ZlibWriterBase(std::move(options.dictionary()), options.buffer_size(),
                      options.size_hint()),
       dest_(dest) {
-  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options));
+  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options),
+             options.parallelism(), options.block_size(), options.backend());
 }
 
 template <typename Dest>
@@ -376,7 +497,8 @@ inline ZlibWriter<Dest>::ZlibWriter(Dest&& dest, Options options)
     : ZlibWriterBase(std::move(options.dictionary()), options.buffer_size(),
                      options.size_hint()),
       dest_(std::move(dest)) {
-  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options));
+  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options),
+             options.parallelism(), options.block_size(), options.backend());
 }
 
 template <typename Dest>
@@ -386,7 +508,8 @@ inline ZlibWriter<Dest>::ZlibWriter(std::tuple<DestArgs...> dest_args,
     : ZlibWriterBase(std::move(options.dictionary()), options.buffer_size(),
                      options.size_hint()),
       dest_(std::move(dest_args)) {
-  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options));
+  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options),
+             options.parallelism(), options.block_size(), options.backend());
 }
 
 template <typename Dest>
@@ -417,7 +540,8 @@ inline void ZlibWriter<Dest>::Reset(const Dest& dest, Options options) {
   ZlibWriterBase::Reset(std::move(options.dictionary()), options.buffer_size(),
                         options.size_hint());
   dest_.Reset(dest);
-  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options));
+  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options),
+             options.parallelism(), options.block_size(), options.backend());
 }
 
 template <typename Dest>
@@ -425,7 +549,8 @@ inline void ZlibWriter<Dest>::Reset(Dest&& dest, Options options) {
   ZlibWriterBase::Reset(std::move(options.dictionary()), options.buffer_size(),
                         options.size_hint());
   dest_.Reset(std::move(dest));
-  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options));
+  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options),
+             options.parallelism(), options.block_size(), options.backend());
 }
 
 template <typename Dest>
@@ -435,7 +560,8 @@ inline void ZlibWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
   ZlibWriterBase::Reset(std::move(options.dictionary()), options.buffer_size(),
                         options.size_hint());
   dest_.Reset(std::move(dest_args));
-  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options));
+  Initialize(dest_.get(), options.compression_level(), GetWindowBits(options),
+             options.parallelism(), options.block_size(), options.backend());
 }
 
 template <typename Dest>
@@ -0,0 +1,123 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "riegeli/zstd/zstd_dictionary_trainer.h"
+
+#include <stddef.h>
+
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+#include "zdict.h"
+
+namespace riegeli {
+
+// Before C++17 if a constexpr static data member is ODR-used, its definition at
+// namespace scope is required. Since C++17 these definitions are deprecated:
+// http://en.cppreference.com/w/cpp/language/static
+#if __cplusplus < 201703
+constexpr size_t ZstdDictionaryTrainer::Options::kDefaultMaxSamples;
+constexpr size_t ZstdDictionaryTrainer::Options::kDefaultMaxDictionarySize;
+#endif
+
+ZstdDictionaryTrainer::ZstdDictionaryTrainer(Options options)
+    : Object(kInitiallyOpen),
+      max_samples_(options.max_samples()),
+      max_dictionary_size_(options.max_dictionary_size()) {}
+
+ZstdDictionaryTrainer::ZstdDictionaryTrainer(
+    ZstdDictionaryTrainer&& that) noexcept
+    : Object(std::move(that)),
+      // Using `that` after it was moved is correct because only the base class
+      // part was moved.
+      max_samples_(that.max_samples_),
+      max_dictionary_size_(that.max_dictionary_size_),
+      samples_(std::move(that.samples_)),
+      sample_sizes_(std::move(that.sample_sizes_)) {}
+
+ZstdDictionaryTrainer& ZstdDictionaryTrainer::operator=(
+    ZstdDictionaryTrainer&& that) noexcept {
+  Object::operator=(std::move(that));
+  // Using `that` after it was moved is correct because only the base class part
+  // was moved.
+  max_samples_ = that.max_samples_;
+  max_dictionary_size_ = that.max_dictionary_size_;
+  samples_ = std::move(that.samples_);
+  sample_sizes_ = std::move(that.sample_sizes_);
+  return *this;
+}
+
+void ZstdDictionaryTrainer::Reset(Options options) {
+  Object::Reset(kInitiallyOpen);
+  max_samples_ = options.max_samples();
+  max_dictionary_size_ = options.max_dictionary_size();
+  samples_.clear();
+  sample_sizes_.clear();
+}
+
+void ZstdDictionaryTrainer::Done() {
+  samples_ = std::string();
+  sample_sizes_ = std::vector<size_t>();
+}
+
+bool ZstdDictionaryTrainer::AddSample(absl::string_view sample) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (sample_sizes_.size() >= max_samples_) return false;
+  samples_.append(sample.data(), sample.size());
+  sample_sizes_.push_back(sample.size());
+  return sample_sizes_.size() < max_samples_;
+}
+
+bool ZstdDictionaryTrainer::AddSample(const Chain& sample) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (sample_sizes_.size() >= max_samples_) return false;
+  sample.AppendTo(samples_);
+  sample_sizes_.push_back(sample.size());
+  return sample_sizes_.size() < max_samples_;
+}
+
+bool ZstdDictionaryTrainer::Train(std::string& dictionary) {
+  if (ABSL_PREDICT_FALSE(!healthy())) return false;
+  if (ABSL_PREDICT_FALSE(sample_sizes_.empty())) {
+    return Fail(absl::FailedPreconditionError(
+        "No samples to train a Zstd dictionary from"));
+  }
+  if (ABSL_PREDICT_FALSE(sample_sizes_.size() >
+                         std::numeric_limits<unsigned>::max())) {
+    return Fail(absl::ResourceExhaustedError("Too many samples"));
+  }
+  dictionary.resize(max_dictionary_size_);
+  const size_t result = ZDICT_trainFromBuffer(
+      &dictionary[0], dictionary.size(), samples_.data(), sample_sizes_.data(),
+      IntCast<unsigned>(sample_sizes_.size()));
+  if (ABSL_PREDICT_FALSE(ZDICT_isError(result))) {
+    dictionary.clear();
+    return Fail(absl::InvalidArgumentError(
+        absl::StrCat("ZDICT_trainFromBuffer() failed: ",
+                     ZDICT_getErrorName(result))));
+  }
+  dictionary.resize(result);
+  return true;
+}
+
+}  // namespace riegeli
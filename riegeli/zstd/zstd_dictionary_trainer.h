@@ -0,0 +1,127 @@
+// Copyright 2017 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RIEGELI_ZSTD_ZSTD_DICTIONARY_TRAINER_H_
+#define RIEGELI_ZSTD_ZSTD_DICTIONARY_TRAINER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "riegeli/base/base.h"
+#include "riegeli/base/chain.h"
+#include "riegeli/base/object.h"
+
+namespace riegeli {
+
+// Trains a Zstd dictionary from samples of data to be compressed, e.g. the
+// first records to be written by a `RecordWriter`.
+//
+// The dictionary can be used with `ZstdWriterBase::Dictionary::set_data()` and
+// `ZstdReaderBase::Dictionary::set_data()`.
+class ZstdDictionaryTrainer : public Object {
+ public:
+  class Options {
+   public:
+    Options() noexcept {}
+
+    // Maximum number of samples to train from. Further samples are ignored.
+    //
+    // Default: `kDefaultMaxSamples` (10000).
+    static constexpr size_t kDefaultMaxSamples = 10000;
+    Options& set_max_samples(size_t max_samples) & {
+      RIEGELI_ASSERT_GT(max_samples, 0u)
+          << "Failed precondition of "
+             "ZstdDictionaryTrainer::Options::set_max_samples(): "
+             "zero max samples";
+      max_samples_ = max_samples;
+      return *this;
+    }
+    Options&& set_max_samples(size_t max_samples) && {
+      return std::move(set_max_samples(max_samples));
+    }
+    size_t max_samples() const { return max_samples_; }
+
+    // Maximum size of the dictionary. A larger dictionary can improve
+    // compression density but makes preparing it slower.
+    //
+    // Default: `kDefaultMaxDictionarySize` (110K, like the `zstd` tool).
+    static constexpr size_t kDefaultMaxDictionarySize = size_t{110} << 10;
+    Options& set_max_dictionary_size(size_t max_dictionary_size) & {
+      RIEGELI_ASSERT_GT(max_dictionary_size, 0u)
+          << "Failed precondition of "
+             "ZstdDictionaryTrainer::Options::set_max_dictionary_size(): "
+             "zero max dictionary size";
+      max_dictionary_size_ = max_dictionary_size;
+      return *this;
+    }
+    Options&& set_max_dictionary_size(size_t max_dictionary_size) && {
+      return std::move(set_max_dictionary_size(max_dictionary_size));
+    }
+    size_t max_dictionary_size() const { return max_dictionary_size_; }
+
+   private:
+    size_t max_samples_ = kDefaultMaxSamples;
+    size_t max_dictionary_size_ = kDefaultMaxDictionarySize;
+  };
+
+  // Creates a `ZstdDictionaryTrainer` with no samples.
+  explicit ZstdDictionaryTrainer(Options options = Options());
+
+  ZstdDictionaryTrainer(ZstdDictionaryTrainer&& that) noexcept;
+  ZstdDictionaryTrainer& operator=(ZstdDictionaryTrainer&& that) noexcept;
+
+  // Makes `*this` equivalent to a newly constructed `ZstdDictionaryTrainer`.
+  // This avoids constructing a temporary `ZstdDictionaryTrainer` and moving
+  // from it.
+  void Reset(Options options = Options());
+
+  // Adds a sample, unless `Options::max_samples()` samples have been added.
+  //
+  // Return values:
+  //  * `true`  - more samples are useful
+  //  * `false` - enough samples have been added
+  bool AddSample(absl::string_view sample);
+  bool AddSample(const Chain& sample);
+
+  // Returns the number of samples added.
+  size_t num_samples() const { return sample_sizes_.size(); }
+
+  // Trains the dictionary from the samples added.
+  //
+  // Training needs enough samples: at least several, totalling many times the
+  // dictionary size.
+  //
+  // Return values:
+  //  * `true`  - success (`dictionary` is set)
+  //  * `false` - failure (`!healthy()`)
+  bool Train(std::string& dictionary);
+
+ protected:
+  void Done() override;
+
+ private:
+  size_t max_samples_ = Options::kDefaultMaxSamples;
+  size_t max_dictionary_size_ = Options::kDefaultMaxDictionarySize;
+  // Concatenated samples.
+  std::string samples_;
+  std::vector<size_t> sample_sizes_;
+};
+
+}  // namespace riegeli
+
+#endif  // RIEGELI_ZSTD_ZSTD_DICTIONARY_TRAINER_H_
@@ -22,11 +22,15 @@
 #include "riegeli/zstd/zstd_reader.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <algorithm>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
@@ -40,6 +44,7 @@
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/buffered_reader.h"
 #include "riegeli/bytes/reader.h"
+#include "riegeli/endian/endian_reading.h"
 #include "zstd.h"
 
 namespace riegeli {
@@ -62,6 +67,15 @@ struct ZSTD_DDictDeleter {
   void operator()(ZSTD_DDict* ptr) const { ZSTD_freeDDict(ptr); }
 };
 
+// Constants of the Zstd seekable format, see
+// https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md
+constexpr uint32_t kSkippableFrameMagic = 0x184D2A5E;
+constexpr uint32_t kSeekableMagic = 0x8F92EAB1;
+constexpr size_t kSkippableFrameHeaderSize = 8;
+constexpr size_t kSeekTableFooterSize = 9;
+constexpr uint8_t kSeekTableChecksumFlag = 0x80;
+constexpr uint8_t kSeekTableReservedBits = 0x7c;
+
 }  // namespace
 
 struct ZstdReaderBase::Dictionary::Shared {
@@ -103,9 +117,72 @@ void ZstdReaderBase::Initialize(Reader* src) {
     return;
   }
   initial_compressed_pos_ = src->pos();
+  if (!growing_source_ && src->SupportsRandomAccess()) {
+    if (ABSL_PREDICT_FALSE(!ReadSeekTable(*src))) return;
+  }
   InitializeDecompressor(*src);
 }
 
+inline bool ZstdReaderBase::ReadSeekTable(Reader& src) {
+  const absl::optional<Position> size = src.Size();
+  if (ABSL_PREDICT_FALSE(size == absl::nullopt)) return Fail(src);
+  if (*size >= initial_compressed_pos_ + kSkippableFrameHeaderSize +
+                  kSeekTableFooterSize) {
+    ParseSeekTable(src, *size);
+  }
+  if (ABSL_PREDICT_FALSE(!src.Seek(initial_compressed_pos_))) {
+    src.Fail(absl::DataLossError("Zstd-compressed stream got truncated"));
+    return Fail(src);
+  }
+  if (!seek_table_.empty()) {
+    uncompressed_size_ = seek_table_.back().uncompressed_pos;
+  }
+  return true;
+}
+
+void ZstdReaderBase::ParseSeekTable(Reader& src, Position size) {
+  // If the seek table is absent or malformed, the stream is read sequentially.
+  if (!src.Seek(size - kSeekTableFooterSize) ||
+      !src.Pull(kSeekTableFooterSize)) {
+    return;
+  }
+  const uint32_t num_frames = ReadLittleEndian32(src.cursor());
+  const uint8_t descriptor = static_cast<uint8_t>(src.cursor()[4]);
+  if (ReadLittleEndian32(src.cursor() + 5) != kSeekableMagic ||
+      (descriptor & kSeekTableReservedBits) != 0) {
+    return;
+  }
+  const size_t entry_size =
+      (descriptor & kSeekTableChecksumFlag) != 0 ? 12 : 8;
+  const Position frame_size =
+      Position{num_frames} * entry_size + kSeekTableFooterSize;
+  if (frame_size > size - initial_compressed_pos_ - kSkippableFrameHeaderSize) {
+    return;
+  }
+  const Position table_pos = size - frame_size - kSkippableFrameHeaderSize;
+  if (!src.Seek(table_pos) || !src.Pull(kSkippableFrameHeaderSize) ||
+      ReadLittleEndian32(src.cursor()) != kSkippableFrameMagic ||
+      ReadLittleEndian32(src.cursor() + 4) != frame_size) {
+    return;
+  }
+  src.move_cursor(kSkippableFrameHeaderSize);
+  std::vector<SeekPoint> seek_table;
+  seek_table.reserve(size_t{num_frames} + 1);
+  SeekPoint point = {0, 0};
+  seek_table.push_back(point);
+  for (uint32_t i = 0; i < num_frames; ++i) {
+    if (!src.Pull(entry_size)) return;
+    point.compressed_pos += ReadLittleEndian32(src.cursor());
+    point.uncompressed_pos += ReadLittleEndian32(src.cursor() + 4);
+    src.move_cursor(entry_size);
+    seek_table.push_back(point);
+  }
+  // Frames must fill the compressed stream up to the seek table.
+  if (point.compressed_pos != table_pos - initial_compressed_pos_) return;
+  seek_table_ = std::move(seek_table);
+  compressed_end_pos_ = size;
+}
+
 inline void ZstdReaderBase::InitializeDecompressor(Reader& src) {
   decompressor_ = RecyclingPool<ZSTD_DCtx, ZSTD_DCtxDeleter>::global().Get(
       [] {
@@ -160,7 +237,9 @@ inline void ZstdReaderBase::InitializeDecompressor(Reader& src) {
       return;
     }
   }
-  uncompressed_size_ = ZstdUncompressedSize(src);
+  // With a seek table, `uncompressed_size_` is already known, and the header
+  // of the current frame stores at most the size of this frame.
+  if (seek_table_.empty()) uncompressed_size_ = ZstdUncompressedSize(src);
   if (uncompressed_size_ != absl::nullopt) {
     // If `uncompressed_size_` is 0, set `size_hint` to 1, because the first
     // `Pull()` call will need a non-empty destination buffer before calling the
@@ -214,10 +293,40 @@ bool ZstdReaderBase::ReadInternal(size_t min_length, size_t max_length,
                          std::numeric_limits<Position>::max() - limit_pos())) {
     return FailOverflow();
   }
+  if (ABSL_PREDICT_FALSE(!seek_table_.empty() &&
+                         limit_pos() == seek_table_.back().uncompressed_pos)) {
+    // There are no frames left, only the seek table.
+    decompressor_.reset();
+    SkipSeekTable(src);
+    return false;
+  }
   size_t effective_min_length = min_length;
-  if (just_initialized_ && !growing_source_ &&
+  // With a seek table, further frames follow the frame being decompressed,
+  // so `ZSTD_d_stableOutBuffer` would not cover all remaining data.
+  if (just_initialized_ && !growing_source_ && seek_table_.empty() &&
       uncompressed_size_ != absl::nullopt &&
       max_length >= *uncompressed_size_) {
+    // If the whole frame is available in the buffer of `src`, decompress it
+    // to `dest` in one step, avoiding the overhead of streaming.
+    const size_t frame_size =
+        ZSTD_findFrameCompressedSize(src.cursor(), src.available());
+    if (!ZSTD_isError(frame_size)) {
+      just_initialized_ = false;
+      const size_t result = ZSTD_decompressDCtx(
+          decompressor_.get(), dest, max_length, src.cursor(), frame_size);
+      if (ABSL_PREDICT_FALSE(ZSTD_isError(result))) {
+        return Fail(Annotate(
+            absl::InvalidArgumentError(absl::StrCat(
+                "ZSTD_decompressDCtx() failed: ", ZSTD_getErrorName(result))),
+            absl::StrCat("at byte ", src.pos())));
+      }
+      src.move_cursor(frame_size);
+      // As with `ZSTD_d_stableOutBuffer` below, only the first frame is
+      // decompressed.
+      decompressor_.reset();
+      move_limit_pos(result);
+      return result >= min_length;
+    }
     // Avoid a memory copy from an internal buffer of the Zstd engine to `dest`
     // by promising to decompress all remaining data to `dest`.
     const size_t result =
@@ -237,11 +346,26 @@ bool ZstdReaderBase::ReadInternal(size_t min_length, size_t max_length,
         ZSTD_decompressStream(decompressor_.get(), &output, &input);
     src.set_cursor(static_cast<const char*>(input.src) + input.pos);
     if (ABSL_PREDICT_FALSE(result == 0)) {
-      decompressor_.reset();
-      move_limit_pos(output.pos);
-      return output.pos >= min_length;
-    }
-    if (ABSL_PREDICT_FALSE(ZSTD_isError(result))) {
+      // A frame ended. Decompression continues with the next frame if there
+      // is one, e.g. if the Zstd seekable format is read sequentially, except
+      // with `ZSTD_d_stableOutBuffer` which covered only the first frame.
+      const bool more_frames =
+          seek_table_.empty()
+              ? effective_min_length != std::numeric_limits<size_t>::max() &&
+                    src.Pull()
+              : limit_pos() + output.pos <
+                    seek_table_.back().uncompressed_pos;
+      if (!more_frames) {
+        decompressor_.reset();
+        move_limit_pos(output.pos);
+        if (!seek_table_.empty()) {
+          SkipSeekTable(src);
+        } else if (ABSL_PREDICT_FALSE(!src.healthy())) {
+          Fail(src);
+        }
+        return output.pos >= min_length;
+      }
+    } else if (ABSL_PREDICT_FALSE(ZSTD_isError(result))) {
       Fail(Annotate(
           absl::InvalidArgumentError(absl::StrCat(
               "ZSTD_decompressStream() failed: ", ZSTD_getErrorName(result))),
@@ -253,6 +377,8 @@ bool ZstdReaderBase::ReadInternal(size_t min_length, size_t max_length,
       move_limit_pos(output.pos);
       return true;
     }
+    // The next frame is started by the next call.
+    if (result == 0) continue;
     RIEGELI_ASSERT_EQ(input.pos, input.size)
         << "ZSTD_decompressStream() returned but there are still input data "
            "and output space";
@@ -284,6 +410,40 @@ bool ZstdReaderBase::SeekBehindBuffer(Position new_pos) {
   RIEGELI_ASSERT_EQ(buffer_size(), 0u)
       << "Failed precondition of BufferedReader::SeekBehindBuffer(): "
          "buffer not empty";
+  if (!seek_table_.empty()) {
+    // Find the frame containing `new_pos`, or the end of the last frame.
+    const auto frame_after = [this](Position position) {
+      return std::upper_bound(seek_table_.begin(), seek_table_.end(), position,
+                              [](Position value, const SeekPoint& point) {
+                                return value < point.uncompressed_pos;
+                              });
+    };
+    const auto frame = std::prev(frame_after(new_pos));
+    if (new_pos <= limit_pos() || decompressor_ == nullptr ||
+        frame >= frame_after(limit_pos())) {
+      // Seeking backwards, or forwards to a later frame.
+      if (ABSL_PREDICT_FALSE(!healthy())) return false;
+      Reader& src = *src_reader();
+      truncated_ = false;
+      set_buffer();
+      set_limit_pos(frame->uncompressed_pos);
+      decompressor_.reset();
+      if (frame == std::prev(seek_table_.end())) {
+        // Seeking to the end or beyond.
+        if (ABSL_PREDICT_FALSE(!SkipSeekTable(src))) return false;
+        return new_pos == limit_pos();
+      }
+      if (ABSL_PREDICT_FALSE(
+              !src.Seek(initial_compressed_pos_ + frame->compressed_pos))) {
+        src.Fail(absl::DataLossError("Zstd-compressed stream got truncated"));
+        return Fail(src);
+      }
+      InitializeDecompressor(src);
+      if (ABSL_PREDICT_FALSE(!healthy())) return false;
+      if (new_pos == limit_pos()) return true;
+    }
+    return BufferedReader::SeekBehindBuffer(new_pos);
+  }
   if (new_pos <= limit_pos()) {
     // Seeking backwards.
     if (ABSL_PREDICT_FALSE(!healthy())) return false;
@@ -303,6 +463,14 @@ bool ZstdReaderBase::SeekBehindBuffer(Position new_pos) {
   return BufferedReader::SeekBehindBuffer(new_pos);
 }
 
+inline bool ZstdReaderBase::SkipSeekTable(Reader& src) {
+  if (ABSL_PREDICT_FALSE(!src.Seek(compressed_end_pos_))) {
+    src.Fail(absl::DataLossError("Zstd-compressed stream got truncated"));
+    return Fail(src);
+  }
+  return true;
+}
+
 absl::optional<Position> ZstdReaderBase::SizeImpl() {
   if (ABSL_PREDICT_FALSE(!healthy())) return absl::nullopt;
   if (ABSL_PREDICT_FALSE(uncompressed_size_ == absl::nullopt)) {
@@ -22,6 +22,7 @@
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
@@ -264,6 +265,11 @@ class ZstdReaderBase : public BufferedReader {
   // does not grow, `Close()` will fail.
   bool truncated() const { return truncated_; }
 
+  // `ZstdReader` supports random access if the compressed stream is in the
+  // Zstd seekable format (see `ZstdWriterBase::Options::seekable_frame_size()`)
+  // and the source supports random access. Seeking then decompresses only from
+  // the beginning of the frame containing the new position.
+  bool SupportsRandomAccess() override { return !seek_table_.empty(); }
   bool SupportsRewind() override;
   bool SupportsSize() override { return uncompressed_size_ != absl::nullopt; }
 
@@ -298,7 +304,17 @@ class ZstdReaderBase : public BufferedReader {
     void operator()(ZSTD_DCtx* ptr) const { ZSTD_freeDCtx(ptr); }
   };
 
+  // A frame boundary of the Zstd seekable format.
+  struct SeekPoint {
+    // Compressed position relative to `initial_compressed_pos_`.
+    Position compressed_pos;
+    Position uncompressed_pos;
+  };
+
+  bool ReadSeekTable(Reader& src);
+  void ParseSeekTable(Reader& src, Position size);
   void InitializeDecompressor(Reader& src);
+  bool SkipSeekTable(Reader& src);
 
   // If `true`, supports decompressing as much as possible from a truncated
   // source, then retrying when the source has grown.
@@ -318,6 +334,12 @@ class ZstdReaderBase : public BufferedReader {
   RecyclingPool<ZSTD_DCtx, ZSTD_DCtxDeleter>::Handle decompressor_;
   // Uncompressed size, if known.
   absl::optional<Position> uncompressed_size_;
+  // If the compressed stream is in the Zstd seekable format and the source
+  // supports random access, boundaries of all frames, followed by the end of
+  // the last frame. Otherwise empty.
+  std::vector<SeekPoint> seek_table_;
+  // If `!seek_table_.empty()`, the compressed position after the seek table.
+  Position compressed_end_pos_ = 0;
 };
 
 // A `Reader` which decompresses data with Zstd after getting it from another
@@ -456,7 +478,9 @@ inline ZstdReaderBase::ZstdReaderBase(ZstdReaderBase&& that) noexcept
       prepared_dictionary_(std::move(that.prepared_dictionary_)),
       initial_compressed_pos_(that.initial_compressed_pos_),
       decompressor_(std::move(that.decompressor_)),
-      uncompressed_size_(that.uncompressed_size_) {}
+      uncompressed_size_(that.uncompressed_size_),
+      seek_table_(std::move(that.seek_table_)),
+      compressed_end_pos_(that.compressed_end_pos_) {}
 
 inline ZstdReaderBase& ZstdReaderBase::operator=(
     ZstdReaderBase&& that) noexcept {
@@ -471,6 +495,8 @@ inline ZstdReaderBase& ZstdReaderBase::operator=(
   initial_compressed_pos_ = that.initial_compressed_pos_;
   decompressor_ = std::move(that.decompressor_);
   uncompressed_size_ = that.uncompressed_size_;
+  seek_table_ = std::move(that.seek_table_);
+  compressed_end_pos_ = that.compressed_end_pos_;
   return *this;
 }
 
@@ -484,6 +510,8 @@ inline void ZstdReaderBase::Reset() {
   initial_compressed_pos_ = 0;
   decompressor_.reset();
   uncompressed_size_ = absl::nullopt;
+  seek_table_.clear();
+  compressed_end_pos_ = 0;
 }
 
 inline void ZstdReaderBase::Reset(bool growing_source, Dictionary&& dictionary,
@@ -498,6 +526,8 @@ inline void ZstdReaderBase::Reset(bool growing_source, Dictionary&& dictionary,
   initial_compressed_pos_ = 0;
   decompressor_.reset();
   uncompressed_size_ = absl::nullopt;
+  seek_table_.clear();
+  compressed_end_pos_ = 0;
 }
 
 template <typename Src>
@@ -17,11 +17,13 @@
 //  * `ZSTD_createCDict_advanced()`
 //  * `ZSTD_dictLoadMethod_e`
 //  * `ZSTD_dictContentType_e`
+//  * `ZSTD_registerSequenceProducer()`
 #define ZSTD_STATIC_LINKING_ONLY
 
 #include "riegeli/zstd/zstd_writer.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <limits>
 #include <memory>
@@ -40,8 +42,20 @@
 #include "riegeli/base/status.h"
 #include "riegeli/bytes/buffered_writer.h"
 #include "riegeli/bytes/writer.h"
+#include "riegeli/endian/endian_writing.h"
 #include "zstd.h"
 
+// The QAT sequence producer requires the external sequence producer API of
+// Zstd 1.5.4.
+#if defined(RIEGELI_ZSTD_QAT) && ZSTD_VERSION_NUMBER >= 10504
+#define RIEGELI_INTERNAL_HAVE_ZSTD_QAT 1
+#endif
+
+#ifdef RIEGELI_INTERNAL_HAVE_ZSTD_QAT
+#include "absl/base/call_once.h"
+#include "qatseqprod.h"
+#endif
+
 namespace riegeli {
 
 // Before C++17 if a constexpr static data member is ODR-used, its definition at
@@ -53,6 +67,8 @@ constexpr int ZstdWriterBase::Options::kMaxCompressionLevel;
 constexpr int ZstdWriterBase::Options::kDefaultCompressionLevel;
 constexpr int ZstdWriterBase::Options::kMinWindowLog;
 constexpr int ZstdWriterBase::Options::kMaxWindowLog;
+constexpr int ZstdWriterBase::Options::kMaxParallelism;
+constexpr size_t ZstdWriterBase::Options::kMaxSeekableFrameSize;
 #endif
 
 // Constants are defined as integer literals in zstd_writer.h and asserted here
@@ -73,8 +89,35 @@ struct ZSTD_CDictDeleter {
   void operator()(ZSTD_CDict* ptr) const { ZSTD_freeCDict(ptr); }
 };
 
+// Constants of the Zstd seekable format, see
+// https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md
+constexpr uint32_t kSkippableFrameMagic = 0x184D2A5E;
+constexpr uint32_t kSeekableMagic = 0x8F92EAB1;
+constexpr size_t kSeekTableFooterSize = 9;
+constexpr size_t kSeekTableEntrySize = 8;
+constexpr size_t kMaxSeekableFrames = size_t{1} << 27;
+
+#ifdef RIEGELI_INTERNAL_HAVE_ZSTD_QAT
+
+// Starts the QAT device once per process. Returns `false` if no device is
+// available.
+bool StartQatDevice() {
+  static absl::once_flag once;
+  static bool started = false;
+  absl::call_once(once, [] { started = QZSTD_startQatDevice() == QZSTD_OK; });
+  return started;
+}
+
+#endif
+
 }  // namespace
 
+void ZstdWriterBase::QatStateDeleter::operator()(void* ptr) const {
+#ifdef RIEGELI_INTERNAL_HAVE_ZSTD_QAT
+  QZSTD_freeSeqProdState(ptr);
+#endif
+}
+
 struct ZstdWriterBase::Dictionary::Shared {
   absl::Mutex mutex;
   int compression_level ABSL_GUARDED_BY(mutex) =
@@ -116,14 +159,26 @@ ZstdWriterBase::Dictionary::PrepareDictionary(int compression_level) const {
 
 void ZstdWriterBase::Initialize(Writer* dest, int compression_level,
                                 absl::optional<int> window_log,
-                                bool store_checksum,
-                                absl::optional<Position> size_hint) {
+                                bool store_checksum, int parallelism,
+                                absl::optional<size_t> job_size,
+                                absl::optional<Position> size_hint,
+                                size_t seekable_frame_size,
+                                bool hardware_offload) {
   RIEGELI_ASSERT(dest != nullptr)
       << "Failed precondition of ZstdWriter: null Writer pointer";
   if (ABSL_PREDICT_FALSE(!dest->healthy())) {
     Fail(*dest);
     return;
   }
+  if (seekable_frame_size > 0) {
+    seekable_frame_size_ = seekable_frame_size;
+    frame_compressed_start_pos_ = dest->pos();
+    // Each frame is ended separately, so the total size cannot be pledged.
+    pledged_size_ = absl::nullopt;
+    size_hint = size_hint == absl::nullopt
+                    ? Position{seekable_frame_size}
+                    : UnsignedMin(*size_hint, Position{seekable_frame_size});
+  }
   compressor_ = RecyclingPool<ZSTD_CCtx, ZSTD_CCtxDeleter>::global().Get(
       [] {
         return std::unique_ptr<ZSTD_CCtx, ZSTD_CCtxDeleter>(ZSTD_createCCtx());
@@ -158,6 +213,18 @@ void ZstdWriterBase::Initialize(Writer* dest, int compression_level,
       return;
     }
   }
+  if (seekable_frame_size_ > 0) {
+    // A frame compressed in one step would store its own size, which would
+    // make sequential decompression treat it as the size of the whole stream.
+    const size_t result = ZSTD_CCtx_setParameter(compressor_.get(),
+                                                 ZSTD_c_contentSizeFlag, 0);
+    if (ABSL_PREDICT_FALSE(ZSTD_isError(result))) {
+      Fail(absl::InternalError(absl::StrCat(
+          "ZSTD_CCtx_setParameter(ZSTD_c_contentSizeFlag) failed: ",
+          ZSTD_getErrorName(result))));
+      return;
+    }
+  }
   {
     const size_t result = ZSTD_CCtx_setParameter(
         compressor_.get(), ZSTD_c_checksumFlag, store_checksum ? 1 : 0);
@@ -168,6 +235,21 @@ void ZstdWriterBase::Initialize(Writer* dest, int compression_level,
       return;
     }
   }
+  // If Zstd is built without multithreading support, setting `ZSTD_c_nbWorkers`
+  // fails. Then compression happens in the calling thread.
+  if (parallelism > 0 &&
+      !ZSTD_isError(ZSTD_CCtx_setParameter(compressor_.get(), ZSTD_c_nbWorkers,
+                                           parallelism)) &&
+      job_size != absl::nullopt) {
+    const size_t result = ZSTD_CCtx_setParameter(
+        compressor_.get(), ZSTD_c_jobSize, SaturatingIntCast<int>(*job_size));
+    if (ABSL_PREDICT_FALSE(ZSTD_isError(result))) {
+      Fail(absl::InternalError(
+          absl::StrCat("ZSTD_CCtx_setParameter(ZSTD_c_jobSize) failed: ",
+                       ZSTD_getErrorName(result))));
+      return;
+    }
+  }
   if (pledged_size_ != absl::nullopt) {
     const size_t result = ZSTD_CCtx_setPledgedSrcSize(
         compressor_.get(), IntCast<unsigned long long>(*pledged_size_));
@@ -202,6 +284,27 @@ void ZstdWriterBase::Initialize(Writer* dest, int compression_level,
       return;
     }
   }
+#ifdef RIEGELI_INTERNAL_HAVE_ZSTD_QAT
+  if (hardware_offload && dictionary_.empty() && parallelism == 0 &&
+      StartQatDevice()) {
+    qat_state_.reset(QZSTD_createSeqProdState());
+    // If the state cannot be made or the sequence producer cannot be
+    // registered, compression happens in software.
+    if (qat_state_ != nullptr) {
+      ZSTD_registerSequenceProducer(compressor_.get(), qat_state_.get(),
+                                    qatSequenceProducer);
+      // Compress a block in software if the device fails to process it.
+      const size_t result = ZSTD_CCtx_setParameter(
+          compressor_.get(), ZSTD_c_enableSeqProdFallback, 1);
+      if (ABSL_PREDICT_FALSE(ZSTD_isError(result))) {
+        Fail(absl::InternalError(absl::StrCat(
+            "ZSTD_CCtx_setParameter(ZSTD_c_enableSeqProdFallback) failed: ",
+            ZSTD_getErrorName(result))));
+        return;
+      }
+    }
+  }
+#endif
 }
 
 void ZstdWriterBase::DoneBehindBuffer(absl::string_view src) {
@@ -210,12 +313,14 @@ void ZstdWriterBase::DoneBehindBuffer(absl::string_view src) {
          "buffer not empty";
   if (ABSL_PREDICT_FALSE(!healthy())) return;
   Writer& dest = *dest_writer();
-  WriteInternal(src, dest, ZSTD_e_end);
+  if (ABSL_PREDICT_FALSE(!WriteInternal(src, dest, ZSTD_e_end))) return;
+  if (seekable_frame_size_ > 0) WriteSeekTable(dest);
 }
 
 void ZstdWriterBase::Done() {
   BufferedWriter::Done();
   compressor_.reset();
+  qat_state_.reset();
 }
 
 void ZstdWriterBase::AnnotateFailure(absl::Status& status) {
@@ -238,6 +343,36 @@ bool ZstdWriterBase::WriteInternal(absl::string_view src, Writer& dest,
                                    ZSTD_EndDirective end_op) {
   RIEGELI_ASSERT(healthy())
       << "Failed precondition of ZstdWriterBase::WriteInternal(): " << status();
+  if (seekable_frame_size_ == 0) return CompressInternal(src, dest, end_op);
+  for (;;) {
+    const Position frame_pos = start_pos() - frame_start_pos_;
+    const size_t remaining = seekable_frame_size_ - IntCast<size_t>(frame_pos);
+    if (src.size() < remaining) {
+      // Avoid writing an empty frame.
+      if (frame_pos == 0 && src.empty()) return true;
+      if (ABSL_PREDICT_FALSE(!CompressInternal(src, dest, end_op))) {
+        return false;
+      }
+      if (end_op == ZSTD_e_end) return FinishFrame(dest);
+      return true;
+    }
+    if (ABSL_PREDICT_FALSE(!CompressInternal(src.substr(0, remaining), dest,
+                                             ZSTD_e_end) ||
+                           !FinishFrame(dest))) {
+      return false;
+    }
+    src.remove_prefix(remaining);
+    // An ended frame is flushed, and ending the stream does not need another
+    // frame.
+    if (src.empty()) return true;
+  }
+}
+
+bool ZstdWriterBase::CompressInternal(absl::string_view src, Writer& dest,
+                                      ZSTD_EndDirective end_op) {
+  RIEGELI_ASSERT(healthy())
+      << "Failed precondition of ZstdWriterBase::CompressInternal(): "
+      << status();
   if (ABSL_PREDICT_FALSE(src.size() >
                          std::numeric_limits<Position>::max() - start_pos())) {
     return FailOverflow();
@@ -279,7 +414,10 @@ bool ZstdWriterBase::WriteInternal(absl::string_view src, Writer& dest,
       RIEGELI_ASSERT_EQ(input.pos, input.size)
           << "ZSTD_compressStream2() returned 0 but there are still input data";
       move_start_pos(input.pos);
-      if (end_op == ZSTD_e_end) compressor_.reset();
+      // In the seekable format the next frame begins with the next call.
+      if (end_op == ZSTD_e_end && seekable_frame_size_ == 0) {
+        compressor_.reset();
+      }
       return true;
     }
     if (ABSL_PREDICT_FALSE(ZSTD_isError(result))) {
@@ -288,14 +426,18 @@ bool ZstdWriterBase::WriteInternal(absl::string_view src, Writer& dest,
                                            ZSTD_getErrorName(result))),
           absl::StrCat("at byte ", dest.pos())));
     }
-    if (output.pos < output.size) {
-      RIEGELI_ASSERT_EQ(input.pos, input.size)
-          << "ZSTD_compressStream2() returned but there are still input data "
-             "and output space";
+    if (end_op == ZSTD_e_continue && input.pos == input.size) {
+      // More compressed data may be pending in background jobs. They are
+      // written by later calls.
       move_start_pos(input.pos);
       return true;
     }
-    if (ABSL_PREDICT_FALSE(!dest.Push(1, result))) return Fail(dest);
+    // With background jobs, `ZSTD_compressStream2()` can return before
+    // consuming all input or flushing all data even if there is output space.
+    // Then it is called again.
+    if (output.pos == output.size) {
+      if (ABSL_PREDICT_FALSE(!dest.Push(1, result))) return Fail(dest);
+    }
   }
 }
 
@@ -309,4 +451,48 @@ bool ZstdWriterBase::FlushBehindBuffer(absl::string_view src,
   return WriteInternal(src, dest, ZSTD_e_flush);
 }
 
+inline bool ZstdWriterBase::FinishFrame(Writer& dest) {
+  if (ABSL_PREDICT_FALSE(seek_table_.size() == kMaxSeekableFrames)) {
+    return Fail(absl::ResourceExhaustedError(
+        "Too many frames for the Zstd seekable format"));
+  }
+  const Position compressed_size = dest.pos() - frame_compressed_start_pos_;
+  if (ABSL_PREDICT_FALSE(compressed_size >
+                         std::numeric_limits<uint32_t>::max())) {
+    return Fail(absl::ResourceExhaustedError(
+        "Frame too large for the Zstd seekable format"));
+  }
+  seek_table_.push_back(
+      SeekTableEntry{IntCast<uint32_t>(compressed_size),
+                     IntCast<uint32_t>(start_pos() - frame_start_pos_)});
+  frame_start_pos_ = start_pos();
+  frame_compressed_start_pos_ = dest.pos();
+  return true;
+}
+
+inline bool ZstdWriterBase::WriteSeekTable(Writer& dest) {
+  // Per-frame checksums are not stored in the seek table, so the descriptor is
+  // 0. `store_checksum()` stores a checksum in each frame instead.
+  const size_t frame_size =
+      seek_table_.size() * kSeekTableEntrySize + kSeekTableFooterSize;
+  if (ABSL_PREDICT_FALSE(!WriteLittleEndian32(kSkippableFrameMagic, dest) ||
+                         !WriteLittleEndian32(IntCast<uint32_t>(frame_size),
+                                              dest))) {
+    return Fail(dest);
+  }
+  for (const SeekTableEntry& entry : seek_table_) {
+    if (ABSL_PREDICT_FALSE(
+            !WriteLittleEndian32(entry.compressed_size, dest) ||
+            !WriteLittleEndian32(entry.decompressed_size, dest))) {
+      return Fail(dest);
+    }
+  }
+  if (ABSL_PREDICT_FALSE(
+          !WriteLittleEndian32(IntCast<uint32_t>(seek_table_.size()), dest) ||
+          !dest.WriteByte(0) || !WriteLittleEndian32(kSeekableMagic, dest))) {
+    return Fail(dest);
+  }
+  return true;
+}
+
 }  // namespace riegeli
@@ -16,12 +16,14 @@
 #define RIEGELI_ZSTD_ZSTD_WRITER_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <memory>
 #include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
@@ -279,6 +281,53 @@ class ZstdWriterBase : public BufferedWriter {
     }
     bool store_checksum() const { return store_checksum_; }
 
+    // Number of background threads to use for compression. Data are split
+    // into jobs which are compressed concurrently. This makes compression of
+    // large data faster, at the cost of memory usage and some compression
+    // density.
+    //
+    // If 0, compresses in the calling thread.
+    //
+    // If Zstd is built without multithreading support, compression silently
+    // happens in the calling thread.
+    //
+    // `parallelism` must be between 0 and `kMaxParallelism` (200).
+    // Default: 0.
+    static constexpr int kMaxParallelism = 200;  // `ZSTDMT_NBWORKERS_MAX`
+    Options& set_parallelism(int parallelism) & {
+      RIEGELI_ASSERT_GE(parallelism, 0)
+          << "Failed precondition of "
+             "ZstdWriterBase::Options::set_parallelism(): "
+             "negative parallelism";
+      RIEGELI_ASSERT_LE(parallelism, kMaxParallelism)
+          << "Failed precondition of "
+             "ZstdWriterBase::Options::set_parallelism(): "
+             "parallelism out of range";
+      parallelism_ = parallelism;
+      return *this;
+    }
+    Options&& set_parallelism(int parallelism) && {
+      return std::move(set_parallelism(parallelism));
+    }
+    int parallelism() const { return parallelism_; }
+
+    // Size of uncompressed data in one compression job if `parallelism() > 0`.
+    // Larger jobs improve compression density but limit concurrency for
+    // smaller data. Zstd clamps the value to at least 512K.
+    //
+    // Special value `absl::nullopt` means to derive `job_size` from
+    // `window_log` (currently 4 times the window size).
+    //
+    // Default: `absl::nullopt`.
+    Options& set_job_size(absl::optional<size_t> job_size) & {
+      job_size_ = job_size;
+      return *this;
+    }
+    Options&& set_job_size(absl::optional<size_t> job_size) && {
+      return std::move(set_job_size(job_size));
+    }
+    absl::optional<size_t> job_size() const { return job_size_; }
+
     // Exact uncompressed size, or `absl::nullopt` if unknown. This may improve
     // compression density and performance, and causes the size to be stored in
     // the compressed stream header.
@@ -338,6 +387,57 @@ class ZstdWriterBase : public BufferedWriter {
     }
     bool reserve_max_size() const { return reserve_max_size_; }
 
+    // If positive, writes the Zstd seekable format: data are compressed into
+    // independent frames of `seekable_frame_size` uncompressed bytes (except
+    // possibly the last one), followed by a seek table in a skippable frame.
+    // This lets `ZstdReader` jump directly to the frame containing a given
+    // position, at the cost of some compression density.
+    //
+    // The seekable format can be decompressed by any Zstd decompressor.
+    //
+    // In the seekable format `pledged_size()` is not stored in the compressed
+    // stream, and it is used only as `size_hint()`.
+    //
+    // If 0, writes a single frame.
+    //
+    // `seekable_frame_size` must be at most `kMaxSeekableFrameSize` (1G).
+    // Default: 0.
+    static constexpr size_t kMaxSeekableFrameSize = size_t{1} << 30;
+    Options& set_seekable_frame_size(size_t seekable_frame_size) & {
+      RIEGELI_ASSERT_LE(seekable_frame_size, kMaxSeekableFrameSize)
+          << "Failed precondition of "
+             "ZstdWriterBase::Options::set_seekable_frame_size(): "
+             "seekable frame size out of range";
+      seekable_frame_size_ = seekable_frame_size;
+      return *this;
+    }
+    Options&& set_seekable_frame_size(size_t seekable_frame_size) && {
+      return std::move(set_seekable_frame_size(seekable_frame_size));
+    }
+    size_t seekable_frame_size() const { return seekable_frame_size_; }
+
+    // If `true`, finding matches is offloaded to an Intel QuickAssist
+    // Technology (QAT) device through the QAT-ZSTD plugin, which reduces CPU
+    // usage of compression. The compressed stream is standard Zstd.
+    //
+    // This requires building with `--define=riegeli_zstd_qat=true`, against
+    // Zstd 1.5.4 or newer and the QAT-ZSTD plugin library. Otherwise, or if no
+    // QAT device is available, or the device fails to process a block,
+    // compression silently happens in software.
+    //
+    // Offloading is not used together with a dictionary or with
+    // `parallelism() > 0`.
+    //
+    // Default: `false`.
+    Options& set_hardware_offload(bool hardware_offload) & {
+      hardware_offload_ = hardware_offload;
+      return *this;
+    }
+    Options&& set_hardware_offload(bool hardware_offload) && {
+      return std::move(set_hardware_offload(hardware_offload));
+    }
+    bool hardware_offload() const { return hardware_offload_; }
+
     // Tunes how much data is buffered before calling the compression engine.
     //
     // If `reserve_max_size()` is `true`, `pledged_size()`, if not
@@ -370,9 +470,13 @@ class ZstdWriterBase : public BufferedWriter {
     absl::optional<int> window_log_;
     Dictionary dictionary_;
     bool store_checksum_ = false;
+    int parallelism_ = 0;
+    absl::optional<size_t> job_size_;
     absl::optional<Position> pledged_size_;
     absl::optional<Position> size_hint_;
     bool reserve_max_size_ = false;
+    size_t seekable_frame_size_ = 0;
+    bool hardware_offload_ = false;
     size_t buffer_size_ = DefaultBufferSize();
   };
 
@@ -397,7 +501,9 @@ class ZstdWriterBase : public BufferedWriter {
              absl::optional<Position> size_hint, bool reserve_max_size);
   void Initialize(Writer* dest, int compression_level,
                   absl::optional<int> window_log, bool store_checksum,
-                  absl::optional<Position> size_hint);
+                  int parallelism, absl::optional<size_t> job_size,
+                  absl::optional<Position> size_hint,
+                  size_t seekable_frame_size, bool hardware_offload);
 
   void DoneBehindBuffer(absl::string_view src) override;
   void Done() override;
@@ -414,13 +520,41 @@ class ZstdWriterBase : public BufferedWriter {
     void operator()(ZSTD_CCtx* ptr) const { ZSTD_freeCCtx(ptr); }
   };
 
+  // Frees the state of the QAT sequence producer.
+  struct QatStateDeleter {
+    void operator()(void* ptr) const;
+  };
+
+  // An entry of the seek table of the Zstd seekable format.
+  struct SeekTableEntry {
+    uint32_t compressed_size;
+    uint32_t decompressed_size;
+  };
+
   bool WriteInternal(absl::string_view src, Writer& dest,
                      ZSTD_EndDirective end_op);
+  bool CompressInternal(absl::string_view src, Writer& dest,
+                        ZSTD_EndDirective end_op);
+  // Records the frame which has just been ended in the seek table.
+  bool FinishFrame(Writer& dest);
+  bool WriteSeekTable(Writer& dest);
 
   Dictionary dictionary_;
   std::shared_ptr<const ZSTD_CDict> prepared_dictionary_;
   absl::optional<Position> pledged_size_;
   bool reserve_max_size_ = false;
+  // If positive, the Zstd seekable format is written with frames of this
+  // uncompressed size.
+  size_t seekable_frame_size_ = 0;
+  // Uncompressed and compressed positions where the current frame begins.
+  // Used only if `seekable_frame_size_ > 0`.
+  Position frame_start_pos_ = 0;
+  Position frame_compressed_start_pos_ = 0;
+  std::vector<SeekTableEntry> seek_table_;
+  // State of the QAT sequence producer registered in `compressor_`, or
+  // `nullptr` if compression is not offloaded. Must outlive `compressor_`,
+  // which refers to it.
+  std::unique_ptr<void, QatStateDeleter> qat_state_;
   // If `healthy()` but `compressor_ == nullptr` then `*pledged_size_` has been
   // reached. In this case `ZSTD_compressStream()` must not be called again.
   RecyclingPool<ZSTD_CCtx, ZSTD_CCtxDeleter>::Handle compressor_;
@@ -553,6 +687,11 @@ inline ZstdWriterBase::ZstdWriterBase(ZstdWriterBase&& that) noexcept
       prepared_dictionary_(std::move(that.prepared_dictionary_)),
       pledged_size_(that.pledged_size_),
       reserve_max_size_(that.reserve_max_size_),
+      seekable_frame_size_(that.seekable_frame_size_),
+      frame_start_pos_(that.frame_start_pos_),
+      frame_compressed_start_pos_(that.frame_compressed_start_pos_),
+      seek_table_(std::move(that.seek_table_)),
+      qat_state_(std::move(that.qat_state_)),
       compressor_(std::move(that.compressor_)) {}
 
 inline ZstdWriterBase& ZstdWriterBase::operator=(
@@ -564,7 +703,14 @@ inline ZstdWriterBase& ZstdWriterBase::operator=(
   prepared_dictionary_ = std::move(that.prepared_dictionary_);
   pledged_size_ = std::move(that.pledged_size_);
   reserve_max_size_ = that.reserve_max_size_;
+  seekable_frame_size_ = that.seekable_frame_size_;
+  frame_start_pos_ = that.frame_start_pos_;
+  frame_compressed_start_pos_ = that.frame_compressed_start_pos_;
+  seek_table_ = std::move(that.seek_table_);
+  // `compressor_` is assigned first because it refers to the previous
+  // `qat_state_`.
   compressor_ = std::move(that.compressor_);
+  qat_state_ = std::move(that.qat_state_);
   return *this;
 }
 
@@ -574,7 +720,12 @@ inline void ZstdWriterBase::Reset() {
   prepared_dictionary_.reset();
   pledged_size_ = absl::nullopt;
   reserve_max_size_ = false;
+  seekable_frame_size_ = 0;
+  frame_start_pos_ = 0;
+  frame_compressed_start_pos_ = 0;
+  seek_table_.clear();
   compressor_.reset();
+  qat_state_.reset();
 }
 
 inline void ZstdWriterBase::Reset(Dictionary&& dictionary, size_t buffer_size,
@@ -586,7 +737,12 @@ inline void ZstdWriterBase::Reset(Dictionary&& dictionary, size_t buffer_size,
   prepared_dictionary_.reset();
   pledged_size_ = pledged_size;
   reserve_max_size_ = reserve_max_size;
+  seekable_frame_size_ = 0;
+  frame_start_pos_ = 0;
+  frame_compressed_start_pos_ = 0;
+  seek_table_.clear();
   compressor_.reset();
+  qat_state_.reset();
 }
 
 template <typename Dest>
@@ -596,7 +752,9 @@ inline ZstdWriter<Dest>::ZstdWriter(const Dest& dest, Options options)
                      options.effective_size_hint(), options.reserve_max_size()),
       dest_(dest) {
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
-             options.store_checksum(), options.effective_size_hint());
+             options.store_checksum(), options.parallelism(),
+             options.job_size(), options.effective_size_hint(),
+             options.seekable_frame_size(), options.hardware_offload());
 }
 
 template <typename Dest>
@@ -606,7 +764,9 @@ inline ZstdWriter<Dest>::ZstdWriter(Dest&& dest, Options options)
                      options.effective_size_hint(), options.reserve_max_size()),
       dest_(std::move(dest)) {
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
-             options.store_checksum(), options.effective_size_hint());
+             options.store_checksum(), options.parallelism(),
+             options.job_size(), options.effective_size_hint(),
+             options.seekable_frame_size(), options.hardware_offload());
 }
 
 template <typename Dest>
@@ -618,7 +778,9 @@ inline ZstdWriter<Dest>::ZstdWriter(std::tuple<DestArgs...> dest_args,
                      options.effective_size_hint(), options.reserve_max_size()),
       dest_(std::move(dest_args)) {
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
-             options.store_checksum(), options.effective_size_hint());
+             options.store_checksum(), options.parallelism(),
+             options.job_size(), options.effective_size_hint(),
+             options.seekable_frame_size(), options.hardware_offload());
 }
 
 template <typename Dest>
@@ -652,7 +814,9 @@ inline void ZstdWriter<Dest>::Reset(const Dest& dest, Options options) {
                         options.reserve_max_size());
   dest_.Reset(dest);
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
-             options.store_checksum(), options.effective_size_hint());
+             options.store_checksum(), options.parallelism(),
+             options.job_size(), options.effective_size_hint(),
+             options.seekable_frame_size(), options.hardware_offload());
 }
 
 template <typename Dest>
@@ -663,7 +827,9 @@ inline void ZstdWriter<Dest>::Reset(Dest&& dest, Options options) {
                         options.reserve_max_size());
   dest_.Reset(std::move(dest));
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
-             options.store_checksum(), options.effective_size_hint());
+             options.store_checksum(), options.parallelism(),
+             options.job_size(), options.effective_size_hint(),
+             options.seekable_frame_size(), options.hardware_offload());
 }
 
 template <typename Dest>
@@ -676,7 +842,9 @@ inline void ZstdWriter<Dest>::Reset(std::tuple<DestArgs...> dest_args,
                         options.reserve_max_size());
   dest_.Reset(std::move(dest_args));
   Initialize(dest_.get(), options.compression_level(), options.window_log(),
-             options.store_checksum(), options.effective_size_hint());
+             options.store_checksum(), options.parallelism(),
+             options.job_size(), options.effective_size_hint(),
+             options.seekable_frame_size(), options.hardware_offload());
 }
 
 template <typename Dest>